@@ -15,7 +15,7 @@
 #include <apex/getopts.h>
 #include <apex/log-domain.h>
 
-LogDomain lg = { "demo", 0 };
+LogDomain lg = LOG_DOMAIN_INIT("demo");
 
 /*
  * main() --Log some message
@@ -3,6 +3,7 @@
  *
  * Contents:
  * load_pidfile() --Load a process ID from a pid file.
+ * send_signal()  --Signal a process, via its pidfd if it has one.
  * main()         --Signal some processes.
  *
  * Remarks:
@@ -11,9 +12,15 @@
  * to force asynchronous/event-driven behaviour in the rest of the system
  * at all privilege levels.
  *
+ * All the processes are identified (and their pidfds opened) before
+ * any are signalled, so a process that exits part-way through can't
+ * have its pid reused by some other process that then gets the
+ * signal.  Where there are no pidfds, it falls back to kill(2).
+ *
  */
 /* LCOV_EXCL_START */
 #include <sys/types.h>
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,6 +31,7 @@
 #include <apex/config.h>
 #include <apex/option.h>
 #include <apex/symbol.h>
+#include <apex/systools.h>
 #include <apex/log.h>
 
 static Enum signals[] = {
@@ -74,24 +82,37 @@ static char epilogue[] =
  * Returns: (int)
  * Success: 1; Failure: 0.
  */
-static int load_pidfile(char *base, int *pid)
+static int load_pidfile(char *base, pid_t *pid)
 {
     char pidfile[LINE_MAX];
-    FILE *fp;
 
-    sprintf(pidfile, "%s/%s.pid", run_dir, base);
-    if ((fp = fopen(pidfile, "r")) != NULL)
+    snprintf(pidfile, sizeof(pidfile), "%s/%s.pid", run_dir, base);
+    if (!read_pidfile(pidfile, pid))
     {
-        if (fscanf(fp, "%d", pid) != 1)
+        if (errno == EINVAL)
         {
             err("%s: cannot read PID", pidfile);
-            fclose(fp);
-            return 0;
         }
-        fclose(fp);
-        return 1;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * send_signal() --Signal a process, via its pidfd if it has one.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int send_signal(pid_t pid, int pidfd, int sig_id)
+{
+    info("sending signal %s (%d) to process %d", sig_name, sig_id, (int) pid);
+    if (pidfd >= 0 ? !signal_pidfd(pidfd, sig_id) : kill(pid, sig_id) != 0)
+    {
+        log_sys(LOG_ERR, "cannot wakeup process %d", (int) pid);
+        return 0;
     }
-    return 0;
+    return 1;
 }
 
 /*
@@ -99,8 +120,11 @@ static int load_pidfile(char *base, int *pid)
  */
 int main(int argc, char *argv[])
 {
-    int pid, sig_id = -1;
+    int sig_id = -1;
     int status = EXIT_SUCCESS;
+    size_t n_pid = 0;
+    pid_t *pid;
+    int *pidfd;
 
     log_init("wakeup");
 
@@ -119,26 +143,48 @@ int main(int argc, char *argv[])
         log_quit(2, "unrecognised signal \"%s\"", sig_name);
     }
 
+    pid = calloc((size_t) argc + 1, sizeof(*pid));
+    pidfd = calloc((size_t) argc + 1, sizeof(*pidfd));
+    if (pid == NULL || pidfd == NULL)
+    {
+        log_quit(1, "out of memory");
+    }
     for (; optind < argc; ++optind)
     {
-        pid = -1;
-        if (!str_int(argv[optind], &pid) && !load_pidfile(argv[optind], &pid))
+        int value = -1;
+
+        if (str_int(argv[optind], &value))
+        {
+            pid[n_pid] = (pid_t) value;
+        }
+        else if (!load_pidfile(argv[optind], &pid[n_pid]))
         {
             warning("unrecognised process: \"%s\"", argv[optind]);
             continue;
         }
-        if (pid < 0)
+        if (pid[n_pid] <= 0)
         {
-            warning("forbidden process ID: %d", pid);
+            warning("forbidden process ID: %d", (int) pid[n_pid]);
             continue;
         }
-        info("sending signal %s (%d) to process %d", sig_name, sig_id, pid);
-        if (kill(pid, sig_id) != 0)
+        if ((pidfd[n_pid] = open_pidfd(pid[n_pid])) < 0 && errno != ENOSYS)
+        {
+            log_sys(LOG_ERR, "cannot wakeup process %d", (int) pid[n_pid]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        ++n_pid;
+    }
+    for (size_t i = 0; i < n_pid; ++i)
+    {
+        if (!send_signal(pid[i], pidfd[i], sig_id))
         {
-            log_sys(LOG_ERR, "cannot wakeup process %d", pid);
             status = EXIT_FAILURE;
         }
     }
+    close_pidfds(n_pid, pidfd);
+    free(pidfd);
+    free(pid);
     exit(status);
 }
 
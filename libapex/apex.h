@@ -12,6 +12,7 @@
  * NEL()             --Return the number of elements in an array.
  * NEW()             --Allocate space for some items of a specified type.
  * SYS_RETRY()       --a lame but portable version of GNU's TEMP_FAILURE_RETRY.
+ * THREAD_LOCAL      --Declare a (static) variable with per-thread storage.
  *
  * See Also:
  * http://unixwiz.net/techtips/gnu-c-attributes.html
@@ -125,5 +126,14 @@
     do { result_ = (expression_); } \
     while (result_ == -1 && (errno == EINTR || errno == EAGAIN))
 #endif /* TEMP_FAILURE_RETRY */
+
+/*
+ * THREAD_LOCAL --Declare a (static) variable with per-thread storage.
+ */
+#if __STDC_VERSION__ >= 201112L
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL __thread
+#endif /* C11 */
 extern const char *apex_version;
 #endif /* APEX_H */
@@ -0,0 +1,54 @@
+/*
+ * ATOMIC.H --Thin wrappers for the compiler's atomic operations.
+ *
+ * Contents:
+ * CACHE_LINE             --The (assumed) size of a CPU cache line.
+ * ATOMIC_LOAD_RELAXED()  --Load a value atomically, with no ordering.
+ * ATOMIC_STORE_RELAXED() --Store a value atomically, with no ordering.
+ * ATOMIC_LOAD_ACQUIRE()  --Load a value; later accesses are ordered after it.
+ * ATOMIC_STORE_RELEASE() --Store a value; earlier accesses are ordered before it.
+ * ATOMIC_CAS()           --Compare and swap; updates expected on failure.
+ * ATOMIC_ADD()           --Add to a value, returning its previous value.
+ * ATOMIC_ADD_RELAXED()   --Add to a value (e.g. a statistic), with no ordering.
+ * ATOMIC_EXCHANGE()      --Replace a value, returning its previous value.
+ * ATOMIC_OR()            --Set bits in a value, returning its previous value.
+ * ATOMIC_AND()           --Mask bits of a value, returning its previous value.
+ * ATOMIC_FENCE()         --A full (sequentially consistent) memory barrier.
+ *
+ * Remarks:
+ * These use the GNU C __atomic builtins, which implement the C11
+ * memory model, but operate on plain (non-_Atomic) objects.  That
+ * keeps the public structures usable from C++ and pre-C11 code.
+ *
+ * See Also:
+ * https://gcc.gnu.org/onlinedocs/gcc/_005f_005fatomic-Builtins.html
+ */
+#ifndef APEX_ATOMIC_H
+#define APEX_ATOMIC_H
+
+#ifndef CACHE_LINE
+#define CACHE_LINE 64
+#endif /* CACHE_LINE */
+
+#define ATOMIC_LOAD_RELAXED(ptr_) __atomic_load_n((ptr_), __ATOMIC_RELAXED)
+#define ATOMIC_STORE_RELAXED(ptr_, value_) \
+    __atomic_store_n((ptr_), (value_), __ATOMIC_RELAXED)
+#define ATOMIC_LOAD_ACQUIRE(ptr_) __atomic_load_n((ptr_), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE_RELEASE(ptr_, value_) \
+    __atomic_store_n((ptr_), (value_), __ATOMIC_RELEASE)
+#define ATOMIC_CAS(ptr_, expected_ptr_, desired_) \
+    __atomic_compare_exchange_n((ptr_), (expected_ptr_), (desired_), 1, \
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+#define ATOMIC_ADD(ptr_, value_) \
+    __atomic_fetch_add((ptr_), (value_), __ATOMIC_ACQ_REL)
+#define ATOMIC_ADD_RELAXED(ptr_, value_) \
+    __atomic_fetch_add((ptr_), (value_), __ATOMIC_RELAXED)
+#define ATOMIC_EXCHANGE(ptr_, value_) \
+    __atomic_exchange_n((ptr_), (value_), __ATOMIC_ACQ_REL)
+#define ATOMIC_OR(ptr_, value_) \
+    __atomic_fetch_or((ptr_), (value_), __ATOMIC_ACQ_REL)
+#define ATOMIC_AND(ptr_, value_) \
+    __atomic_fetch_and((ptr_), (value_), __ATOMIC_ACQ_REL)
+#define ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif /* APEX_ATOMIC_H */
@@ -0,0 +1,60 @@
+/*
+ * CPU.C --Run-time CPU feature tests, for selecting SIMD kernels.
+ *
+ * Contents:
+ * cpu_probe() --Probe the CPU's features.
+ * cpu_has()   --Test whether the CPU supports some features.
+ *
+ * Remarks:
+ * The features are probed once, with the compiler's
+ * __builtin_cpu_supports(), and cached with CPU_PROBED set, so that
+ * a cached value is never zero.
+ */
+#include <apex.h>
+#include <apex/cpu.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86
+#endif
+
+#define CPU_PROBED 0x80000000u         /* (the features have been probed) */
+
+static unsigned int cpu_features;
+
+/*
+ * cpu_probe() --Probe the CPU's features.
+ */
+static unsigned int cpu_probe(void)
+{
+    unsigned int features = CPU_PROBED;
+
+#ifdef CPU_X86
+    __builtin_cpu_init();
+    features |= __builtin_cpu_supports("sse2") ? CPU_SSE2 : 0;
+    features |= __builtin_cpu_supports("ssse3") ? CPU_SSSE3 : 0;
+    features |= __builtin_cpu_supports("popcnt") ? CPU_POPCNT : 0;
+    features |= __builtin_cpu_supports("avx2") ? CPU_AVX2 : 0;
+#endif /* CPU_X86 */
+    return features;
+}
+
+/*
+ * cpu_has() --Test whether the CPU supports some features.
+ *
+ * Parameters:
+ * features --the CpuFeature values to test, or'd together
+ *
+ * Returns: (int)
+ * 1: the CPU supports all of the features; 0: it doesn't.
+ */
+int cpu_has(unsigned int features)
+{
+    unsigned int have = ATOMIC_LOAD_RELAXED(&cpu_features);
+
+    if (have == 0)
+    {
+        have = cpu_probe();
+        ATOMIC_STORE_RELAXED(&cpu_features, have);
+    }
+    return (have & features) == features;
+}
@@ -0,0 +1,50 @@
+/*
+ * CPU.H --Run-time CPU feature tests, for selecting SIMD kernels.
+ *
+ * Contents:
+ * CpuFeature    --The instruction set extensions that kernels use.
+ * cpu_has()     --Test whether the CPU supports some features.
+ * CPU_RESOLVE() --Store the kernel selected for this CPU.
+ *
+ * Remarks:
+ * Modules with SIMD kernels compile each one for its instruction set
+ * (with __attribute__((target(...)))), and call it through a function
+ * pointer that starts out as a "resolver".  On its first call, the
+ * resolver asks cpu_has() which kernels this CPU can run, stores the
+ * best one with CPU_RESOLVE(), and calls it; later calls go straight
+ * to the kernel.
+ *
+ * Threads racing through a resolver all store the same value, so the
+ * relaxed stores are harmless; likewise cpu_has()'s cache of the
+ * probed features.
+ *
+ * cpu_has() only probes x86 CPUs; elsewhere it reports no features.
+ * (ARM's NEON is a baseline feature, so its kernels are chosen at
+ * compile time.)
+ */
+#ifndef APEX_CPU_H
+#define APEX_CPU_H
+
+#include <apex/atomic.h>
+
+#define CPU_RESOLVE(proc_ptr_, proc_) \
+    ATOMIC_STORE_RELAXED((proc_ptr_), (proc_))
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    typedef enum
+    {
+        CPU_SSE2 = 0x01,
+        CPU_SSSE3 = 0x02,
+        CPU_POPCNT = 0x04,
+        CPU_AVX2 = 0x08
+    } CpuFeature;
+
+    int cpu_has(unsigned int features);
+
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* APEX_CPU_H */
@@ -13,6 +13,7 @@
  * CONST()              --Annotate that a function depends only on its (non-ptr) params.
  * DEPRECATED()         --Annotate a function/type as deprecated (warn on use).
  * USED()               --Annotate a function variable as used (don't optimise it away).
+ * NO_SANITIZE()        --Annotate a function as exempt from ASan/TSan checks.
  *
  * See Also:
  * http://unixwiz.net/techtips/gnu-c-attributes.html
@@ -145,4 +146,20 @@
 #ifndef USED
 #define USED __attribute__((used))
 #endif /* USED */
+
+/*
+ * NO_SANITIZE() --Annotate a function as exempt from ASan/TSan checks.
+ *
+ * Remarks:
+ * This is for code that deliberately reads past the end of an object,
+ * but never past its page (e.g. aligned vector loads of a string),
+ * which the sanitizers would otherwise report.
+ */
+#ifndef NO_SANITIZE
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define NO_SANITIZE __attribute__((no_sanitize("address", "thread")))
+#else
+#define NO_SANITIZE
+#endif /* __GNUC__ >= 8 */
+#endif /* NO_SANITIZE */
 #endif /* GNUATTR_H */
@@ -0,0 +1,320 @@
+/*
+ * MEM.C --The library's (tracked) memory allocation.
+ *
+ * Contents:
+ * mem_set_backend() --Set the functions that actually manage memory.
+ * mem_track()       --Enable/disable the collection of statistics.
+ * record_alloc()    --Count an allocation (or a resize).
+ * record_free()     --Count a free.
+ * mem_alloc()       --Allocate some memory for a module.
+ * mem_calloc()      --Allocate some zeroed memory for a module.
+ * mem_realloc()     --Resize some memory allocated for a module.
+ * mem_free()        --Free some memory allocated for a module.
+ * mem_strdup()      --Copy a string, into memory allocated for a module.
+ * mem_module_name() --Return the name of a module.
+ * mem_stats()       --Get a module's allocation statistics.
+ * mem_report()      --Print each module's statistics in "key=value" form.
+ *
+ * Remarks:
+ * The statistics are updated with relaxed atomic operations, and each
+ * module's are on their own cache line, so threads allocating for
+ * different modules don't contend.  mem_stats() reads the counts
+ * individually, so they're only approximately consistent with each
+ * other.
+ *
+ * Statistics are collected from start-up; if they're disabled and
+ * then re-enabled, frees of memory allocated meanwhile will make the
+ * bytes in use too low.
+ */
+#include <apex.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>                    /* malloc_usable_size() */
+#endif /* __GLIBC__ */
+
+#include <apex/mem.h>
+
+#ifdef __GLIBC__
+#define USABLE_SIZE malloc_usable_size
+#else
+#define USABLE_SIZE NULL
+#endif /* __GLIBC__ */
+
+static const MemBackend libc_backend = {
+    malloc, calloc, realloc, free, USABLE_SIZE
+};
+static MemBackend mem_backend = {
+    malloc, calloc, realloc, free, USABLE_SIZE
+};
+
+static int tracking = 1;
+static int allocated;                  /* the backend is in use */
+
+static struct
+{
+    MemStats stats;
+    char pad_0[CACHE_LINE];
+} module_stats[MEM_N_MODULE];
+
+static const char *module_name[] = {
+    "apex", "array", "config", "csv", "hash", "link", "log", "parse",
+    "protocol", "stately", "string", "symbol", "sys", "tfile", "time",
+    "vector"
+};
+
+/*
+ * mem_set_backend() --Set the functions that actually manage memory.
+ *
+ * Parameters:
+ * backend --the functions (NULL: restore malloc() etc.)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set: EBUSY if the library has
+ * already allocated memory, EINVAL if a function is missing).
+ *
+ * Remarks:
+ * The backend must be set before the library allocates any memory,
+ * because memory must be freed by the backend that allocated it.
+ */
+int mem_set_backend(const MemBackend * backend)
+{
+    if (ATOMIC_LOAD_ACQUIRE(&allocated))
+    {
+        errno = EBUSY;
+        return 0;                      /* error: too late */
+    }
+    if (backend == NULL)
+    {
+        backend = &libc_backend;
+    }
+    if (backend->malloc_proc == NULL || backend->calloc_proc == NULL
+        || backend->realloc_proc == NULL || backend->free_proc == NULL)
+    {
+        errno = EINVAL;
+        return 0;                      /* error: incomplete backend */
+    }
+    mem_backend = *backend;
+    return 1;
+}
+
+/*
+ * mem_track() --Enable/disable the collection of statistics.
+ *
+ * Remarks:
+ * Statistics are collected by default; disabling them saves a few
+ * atomic operations per allocation.
+ */
+void mem_track(int enable)
+{
+    ATOMIC_STORE_RELAXED(&tracking, enable != 0);
+}
+
+/*
+ * record_alloc() --Count an allocation (or a resize).
+ *
+ * Parameters:
+ * module --the module
+ * ptr  --the memory allocated
+ * size --the size requested
+ * old_size --the usable size it replaces (for a resize)
+ * resize --1 for a resize, 0 for a new allocation
+ */
+static void record_alloc(MemModule module, void *ptr, size_t size,
+                         size_t old_size, int resize)
+{
+    MemStatsPtr stats = &module_stats[module].stats;
+
+    if (!ATOMIC_LOAD_RELAXED(&allocated))
+    {
+        ATOMIC_STORE_RELEASE(&allocated, 1);
+    }
+    if (ptr == NULL || !ATOMIC_LOAD_RELAXED(&tracking))
+    {
+        return;
+    }
+    ATOMIC_ADD_RELAXED(&stats->n_alloc, (size_t) !resize);
+    ATOMIC_ADD_RELAXED(&stats->total, size);
+    if (mem_backend.size_proc != NULL)
+    {
+        size_t delta = mem_backend.size_proc(ptr) - old_size;
+        size_t in_use = ATOMIC_ADD_RELAXED(&stats->size, delta) + delta;
+        size_t peak = ATOMIC_LOAD_RELAXED(&stats->peak);
+
+        while (in_use > peak && in_use < SIZE_MAX / 2  /* (not < 0) */
+               && !ATOMIC_CAS(&stats->peak, &peak, in_use))
+        {
+            continue;                  /* (peak has been updated) */
+        }
+    }
+}
+
+/*
+ * record_free() --Count a free.
+ */
+static void record_free(MemModule module, void *ptr)
+{
+    MemStatsPtr stats = &module_stats[module].stats;
+
+    if (ptr == NULL || !ATOMIC_LOAD_RELAXED(&tracking))
+    {
+        return;
+    }
+    ATOMIC_ADD_RELAXED(&stats->n_free, 1);
+    if (mem_backend.size_proc != NULL)
+    {
+        ATOMIC_ADD_RELAXED(&stats->size, -mem_backend.size_proc(ptr));
+    }
+}
+
+/*
+ * mem_alloc() --Allocate some memory for a module.
+ *
+ * Returns: (void *)
+ * Success: the memory; Failure: NULL.
+ */
+void *mem_alloc(MemModule module, size_t size)
+{
+    void *ptr = mem_backend.malloc_proc(size);
+
+    record_alloc(module, ptr, size, 0, 0);
+    return ptr;
+}
+
+/*
+ * mem_calloc() --Allocate some zeroed memory for a module.
+ *
+ * Returns: (void *)
+ * Success: the memory; Failure: NULL.
+ */
+void *mem_calloc(MemModule module, size_t n, size_t size)
+{
+    void *ptr = mem_backend.calloc_proc(n, size);
+
+    record_alloc(module, ptr, n * size, 0, 0);
+    return ptr;
+}
+
+/*
+ * mem_realloc() --Resize some memory allocated for a module.
+ *
+ * Returns: (void *)
+ * Success: the (possibly moved) memory; Failure: NULL (ptr is
+ * unchanged).
+ *
+ * Remarks:
+ * Only a realloc() of NULL counts as an allocation, but the new size
+ * is added to the total.
+ */
+void *mem_realloc(MemModule module, void *ptr, size_t size)
+{
+    size_t old_size = 0;
+    void *new_ptr;
+
+    if (ptr != NULL && mem_backend.size_proc != NULL)
+    {
+        old_size = mem_backend.size_proc(ptr);
+    }
+    if ((new_ptr = mem_backend.realloc_proc(ptr, size)) == NULL)
+    {
+        return NULL;
+    }
+    record_alloc(module, new_ptr, size, old_size, ptr != NULL);
+    return new_ptr;
+}
+
+/*
+ * mem_free() --Free some memory allocated for a module.
+ */
+void mem_free(MemModule module, void *ptr)
+{
+    record_free(module, ptr);
+    mem_backend.free_proc(ptr);
+}
+
+/*
+ * mem_strdup() --Copy a string, into memory allocated for a module.
+ *
+ * Returns: (char *)
+ * Success: the copy (to be freed by mem_free()); Failure: NULL.
+ */
+char *mem_strdup(MemModule module, const char *str)
+{
+    size_t size = strlen(str) + 1;
+    char *copy = mem_alloc(module, size);
+
+    return copy != NULL ? memcpy(copy, str, size) : NULL;
+}
+
+/*
+ * mem_module_name() --Return the name of a module.
+ */
+const char *mem_module_name(MemModule module)
+{
+    return (unsigned int) module < MEM_N_MODULE ? module_name[module] : NULL;
+}
+
+/*
+ * mem_stats() --Get a module's allocation statistics.
+ *
+ * Parameters:
+ * module --the module
+ * stats --returns the statistics
+ *
+ * Returns: (MemStatsPtr)
+ * Success: stats; Failure: NULL (no such module).
+ */
+MemStatsPtr mem_stats(MemModule module, MemStatsPtr stats)
+{
+    MemStatsPtr current;
+
+    if ((unsigned int) module >= MEM_N_MODULE)
+    {
+        return NULL;
+    }
+    current = &module_stats[module].stats;
+    stats->n_alloc = ATOMIC_LOAD_RELAXED(&current->n_alloc);
+    stats->n_free = ATOMIC_LOAD_RELAXED(&current->n_free);
+    stats->total = ATOMIC_LOAD_RELAXED(&current->total);
+    stats->size = ATOMIC_LOAD_RELAXED(&current->size);
+    stats->peak = ATOMIC_LOAD_RELAXED(&current->peak);
+    return stats;
+}
+
+/*
+ * mem_report() --Print each module's statistics in "key=value" form.
+ *
+ * Parameters:
+ * fp   --the file to print to
+ *
+ * Returns: (int)
+ * The number of characters printed, as for fprintf().
+ *
+ * Remarks:
+ * Each module that has allocated anything is printed on one line,
+ * for easy scraping; "live" is the No. of allocations not yet freed.
+ */
+int mem_report(FILE *fp)
+{
+    int n = 0;
+
+    for (int i = 0; i < MEM_N_MODULE; ++i)
+    {
+        MemStats stats;
+
+        mem_stats((MemModule) i, &stats);
+        if (stats.n_alloc == 0)
+        {
+            continue;
+        }
+        n += fprintf(fp, "module=%s n_alloc=%zu n_free=%zu live=%zu"
+                     " total=%zu size=%zu peak=%zu\n",
+                     module_name[i], stats.n_alloc, stats.n_free,
+                     stats.n_alloc - stats.n_free, stats.total, stats.size,
+                     stats.peak);
+    }
+    return n;
+}
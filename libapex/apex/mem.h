@@ -0,0 +1,91 @@
+/*
+ * MEM.H --Definitions for the library's (tracked) memory allocation.
+ *
+ * Contents:
+ * MemModule     --The library modules that allocate memory.
+ * MemBackend_t{} --The functions that actually manage memory.
+ * MemStats_t{}  --A module's allocation statistics.
+ * MEM_NEW()     --Allocate space for some items of a specified type.
+ *
+ * Remarks:
+ * The library's own allocations (the ones it also frees) go through
+ * mem_alloc() etc., which count them per module, so that e.g. a
+ * daemon can tell which part of the library is growing.  The memory
+ * is provided by a MemBackend, which is malloc() etc. by default,
+ * but may be replaced by (say) jemalloc's or mimalloc's functions,
+ * before the library allocates anything.  Memory that the library
+ * returns to its caller to free() (e.g. strings) is still allocated
+ * with malloc(), whatever the backend.
+ *
+ * Bytes in use are measured with the backend's size_proc (by default,
+ * malloc_usable_size() where there is one), so they include the
+ * allocator's rounding.  Without a size_proc, only the counts and
+ * the total bytes requested are tracked.
+ */
+#ifndef APEX_MEM_H
+#define APEX_MEM_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <apex/atomic.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    typedef enum
+    {
+        MEM_APEX,
+        MEM_ARRAY,
+        MEM_CONFIG,
+        MEM_CSV,
+        MEM_HASH,
+        MEM_LINK,
+        MEM_LOG,
+        MEM_PARSE,
+        MEM_PROTOCOL,
+        MEM_STATELY,
+        MEM_STRING,
+        MEM_SYMBOL,
+        MEM_SYS,
+        MEM_TFILE,
+        MEM_TIME,
+        MEM_VECTOR,
+        MEM_N_MODULE
+    } MemModule;
+
+    typedef struct MemBackend_t
+    {
+        void *(*malloc_proc)(size_t size);
+        void *(*calloc_proc)(size_t n, size_t size);
+        void *(*realloc_proc)(void *ptr, size_t size);
+        void (*free_proc)(void *ptr);
+        size_t (*size_proc)(void *ptr);    /* usable size, or NULL */
+    } MemBackend, *MemBackendPtr;
+
+    typedef struct MemStats_t
+    {
+        size_t n_alloc;                /* No. of allocations */
+        size_t n_free;                 /* No. of frees */
+        size_t total;                  /* bytes ever allocated */
+        size_t size;                   /* bytes in use (needs size_proc) */
+        size_t peak;                   /* most bytes in use (ditto) */
+    } MemStats, *MemStatsPtr;
+
+#define MEM_NEW(module_, type_, nel_) \
+    mem_calloc((module_), (nel_), sizeof(type_))
+
+    int mem_set_backend(const MemBackend * backend);
+    void mem_track(int enable);
+    void *mem_alloc(MemModule module, size_t size);
+    void *mem_calloc(MemModule module, size_t n, size_t size);
+    void *mem_realloc(MemModule module, void *ptr, size_t size);
+    void mem_free(MemModule module, void *ptr);
+    char *mem_strdup(MemModule module, const char *str);
+    const char *mem_module_name(MemModule module);
+    MemStatsPtr mem_stats(MemModule module, MemStatsPtr stats);
+    int mem_report(FILE * fp);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* APEX_MEM_H */
@@ -0,0 +1,285 @@
+/*
+ * ARENA.C --A bump-pointer ("arena") allocator for temporaries.
+ *
+ * Contents:
+ * arena_init()         --Initialise an (empty) arena.
+ * arena_init_with()    --Initialise an arena with a page placement policy.
+ * arena_alloc_block_() --Allocate memory from a new block.
+ * arena_realloc()      --Resize an allocation (in place, if it's the last).
+ * arena_strdup()       --Copy a string into an arena.
+ * arena_mark()         --Save the arena's current allocation point.
+ * arena_release()      --Release everything allocated since a mark.
+ * arena_reset()        --Release everything allocated from an arena.
+ * arena_free()         --Release all of an arena's memory.
+ *
+ * Remarks:
+ * Blocks are kept on a list, newest first.  Releasing to a mark
+ * frees the newer blocks, and winds back the allocation pointer
+ * in the mark's block; arena_reset() keeps the oldest block, so that
+ * an arena that's reset after each request (say) doesn't re-allocate
+ * every time.  An allocation bigger than the block size gets a block
+ * of its own.
+ *
+ * An arena initialised by arena_init_with() maps its blocks with
+ * page_alloc() instead of malloc(), so they can be placed on a NUMA
+ * node and/or in huge pages; each block is then rounded up to whole
+ * pages, and the slack is used.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <apex/arena.h>
+
+#define ARENA_BLOCK_SIZE 4096          /* default block size */
+#define BLOCK_HEADER \
+    ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+/*
+ * block_data() --Return the first data byte of a block.
+ */
+static inline char *block_data(ArenaBlockPtr block)
+{
+    return (char *) block + BLOCK_HEADER;
+}
+
+/*
+ * arena_init() --Initialise an (empty) arena.
+ *
+ * Parameters:
+ * arena --specifies and returns the initialised arena
+ * block_size --the size of each block (0: a default size)
+ *
+ * Returns: (ArenaPtr)
+ * Success: the arena; Failure: NULL.
+ *
+ * Remarks:
+ * No memory is allocated until the first call to arena_alloc().
+ */
+ArenaPtr arena_init(ArenaPtr arena, size_t block_size)
+{
+    if (arena == NULL)
+    {
+        return NULL;                   /* failure: no arena! */
+    }
+    arena->block = NULL;
+    arena->next = NULL;
+    arena->block_size = block_size != 0 ? block_size : ARENA_BLOCK_SIZE;
+    arena->policy.flags = 0;
+    arena->policy.node = PAGE_NODE_ANY;
+    return arena;
+}
+
+/*
+ * arena_init_with() --Initialise an arena with a page placement policy.
+ *
+ * Parameters:
+ * arena --specifies and returns the initialised arena
+ * block_size --the size of each block (0: a default size)
+ * policy --how to allocate blocks (NULL, or no flags: malloc())
+ *
+ * Returns: (ArenaPtr)
+ * Success: the arena; Failure: NULL.
+ *
+ * Remarks:
+ * With huge pages, a block size of (a multiple of) the huge page size
+ * (e.g. 2MB) avoids wasting the rest of each huge page.
+ */
+ArenaPtr arena_init_with(ArenaPtr arena, size_t block_size,
+                         const PagePolicy * policy)
+{
+    if (arena_init(arena, block_size) != NULL && policy != NULL)
+    {
+        arena->policy = *policy;
+    }
+    return arena;
+}
+
+/*
+ * block_free() --Release a block's memory.
+ */
+static void block_free(ArenaPtr arena, ArenaBlockPtr block)
+{
+    if (arena->policy.flags != 0)
+    {
+        page_free(block, (size_t) (block->end - (char *) block),
+                  arena->policy.flags);
+    }
+    else
+    {
+        free(block);
+    }
+}
+
+/*
+ * arena_alloc_block_() --Allocate memory from a new block.
+ *
+ * Parameters:
+ * arena --the arena
+ * size --the size of memory required (a multiple of ARENA_ALIGN)
+ *
+ * Returns: (void *)
+ * Success: the memory; Failure: NULL.
+ *
+ * Remarks:
+ * This is called by arena_alloc() when the current block is full.
+ * The remainder of that block is abandoned (until the arena is
+ * released or reset).
+ */
+void *arena_alloc_block_(ArenaPtr arena, size_t size)
+{
+    size_t data_size = size > arena->block_size ? size : arena->block_size;
+    ArenaBlockPtr block;
+
+    if (arena->policy.flags != 0)
+    {
+        int flags = arena->policy.flags;
+
+        data_size = page_round(BLOCK_HEADER + data_size, flags) - BLOCK_HEADER;
+        block = page_alloc(BLOCK_HEADER + data_size, 0, arena->policy.node,
+                           flags);
+    }
+    else
+    {
+        block = malloc(BLOCK_HEADER + data_size);
+    }
+    if (block == NULL)
+    {
+        return NULL;                   /* failure: no memory */
+    }
+    block->next = arena->block;
+    block->end = block_data(block) + data_size;
+    arena->block = block;
+    arena->next = block_data(block) + size;
+    return block_data(block);
+}
+
+/*
+ * arena_realloc() --Resize an allocation (in place, if it's the last).
+ *
+ * Parameters:
+ * arena --the arena
+ * ptr --the memory to resize (or NULL)
+ * old_size --the size ptr was allocated with
+ * new_size --the size required
+ *
+ * Returns: (void *)
+ * Success: the (possibly moved) memory; Failure: NULL.
+ *
+ * Remarks:
+ * If ptr is the most recent allocation it's resized in place, so a
+ * single growing object (e.g. a vector) doesn't waste the arena.
+ * The arena doesn't record sizes, so the caller must supply old_size.
+ */
+void *arena_realloc(ArenaPtr arena, void *ptr, size_t old_size,
+                    size_t new_size)
+{
+    size_t mask = ARENA_ALIGN - 1;
+    char *mem = ptr;
+    void *new_mem;
+
+    old_size = (old_size + mask) & ~mask;
+    new_size = (new_size + mask) & ~mask;
+    if (mem == NULL)
+    {
+        return arena_alloc(arena, new_size);
+    }
+    if (mem + old_size == arena->next && mem >= block_data(arena->block)
+        && new_size <= (size_t) (arena->block->end - mem))
+    {
+        arena->next = mem + new_size;
+        return mem;                    /* success: resized in place */
+    }
+    if (new_size <= old_size)
+    {
+        return mem;                    /* success: (shrinking) */
+    }
+    if ((new_mem = arena_alloc(arena, new_size)) != NULL)
+    {
+        memcpy(new_mem, mem, old_size);
+    }
+    return new_mem;
+}
+
+/*
+ * arena_strdup() --Copy a string into an arena.
+ *
+ * Returns: (char *)
+ * Success: the copy; Failure: NULL.
+ */
+char *arena_strdup(ArenaPtr arena, const char *str)
+{
+    size_t n = strlen(str) + 1;
+    char *copy = arena_alloc(arena, n);
+
+    if (copy != NULL)
+    {
+        memcpy(copy, str, n);
+    }
+    return copy;
+}
+
+/*
+ * arena_mark() --Save the arena's current allocation point.
+ *
+ * Parameters:
+ * arena --the arena
+ * mark --returns the allocation point
+ */
+void arena_mark(ArenaPtr arena, ArenaMarkPtr mark)
+{
+    mark->block = arena->block;
+    mark->next = arena->next;
+}
+
+/*
+ * arena_release() --Release everything allocated since a mark.
+ *
+ * Parameters:
+ * arena --the arena
+ * mark --an allocation point returned by arena_mark()
+ *
+ * Remarks:
+ * Marks must be released in reverse order (i.e. like a stack);
+ * releasing a mark invalidates any marks taken after it.
+ */
+void arena_release(ArenaPtr arena, ArenaMarkPtr mark)
+{
+    while (arena->block != mark->block)
+    {
+        ArenaBlockPtr block = arena->block;
+
+        arena->block = block->next;
+        block_free(arena, block);
+    }
+    arena->next = mark->next;
+}
+
+/*
+ * arena_reset() --Release everything allocated from an arena.
+ *
+ * Remarks:
+ * The oldest block is kept, and re-used by subsequent allocations.
+ */
+void arena_reset(ArenaPtr arena)
+{
+    if (arena->block != NULL)
+    {
+        while (arena->block->next != NULL)
+        {
+            ArenaBlockPtr block = arena->block;
+
+            arena->block = block->next;
+            block_free(arena, block);
+        }
+        arena->next = block_data(arena->block);
+    }
+}
+
+/*
+ * arena_free() --Release all of an arena's memory.
+ */
+void arena_free(ArenaPtr arena)
+{
+    ArenaMark empty = { NULL, NULL };
+
+    arena_release(arena, &empty);
+}
@@ -0,0 +1,93 @@
+/*
+ * ARENA.H --A bump-pointer ("arena") allocator for temporaries.
+ *
+ * Contents:
+ * Arena_t{}     --The state of an arena.
+ * ArenaMark_t{} --A saved allocation point, for arena_release().
+ * arena_alloc() --Allocate some (aligned) memory from an arena.
+ *
+ * Remarks:
+ * An arena allocates memory by advancing a pointer through a block,
+ * adding blocks as necessary.  Individual allocations are never
+ * freed; instead, everything allocated since a mark can be released
+ * at once, and arena_reset() releases everything.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <apex/placement.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    /* all arena allocations are aligned to this */
+#define ARENA_ALIGN 16
+
+    typedef struct ArenaBlock_t
+    {
+        struct ArenaBlock_t *next;     /* next (older) block */
+        char *end;                     /* end of this block's data */
+    } ArenaBlock, *ArenaBlockPtr;
+
+    typedef struct Arena_t
+    {
+        ArenaBlockPtr block;           /* current block (newest first) */
+        char *next;                    /* next free byte in current block */
+        size_t block_size;             /* default size of new blocks */
+        PagePolicy policy;             /* how blocks are allocated */
+    } Arena, *ArenaPtr;
+
+    typedef struct ArenaMark_t
+    {
+        ArenaBlockPtr block;
+        char *next;
+    } ArenaMark, *ArenaMarkPtr;
+
+    ArenaPtr arena_init(ArenaPtr arena, size_t block_size);
+    ArenaPtr arena_init_with(ArenaPtr arena, size_t block_size,
+                             const PagePolicy * policy);
+    void *arena_alloc_block_(ArenaPtr arena, size_t size);
+    void *arena_realloc(ArenaPtr arena, void *ptr, size_t old_size,
+                        size_t new_size);
+    char *arena_strdup(ArenaPtr arena, const char *str);
+    void arena_mark(ArenaPtr arena, ArenaMarkPtr mark);
+    void arena_release(ArenaPtr arena, ArenaMarkPtr mark);
+    void arena_reset(ArenaPtr arena);
+    void arena_free(ArenaPtr arena);
+
+    /*
+     * arena_alloc() --Allocate some (aligned) memory from an arena.
+     *
+     * Parameters:
+     * arena --the arena
+     * size --the size of memory required
+     *
+     * Returns: (void *)
+     * Success: the memory; Failure: NULL.
+     *
+     * Remarks:
+     * The common case (there's room in the current block) is inline;
+     * otherwise arena_alloc_block_() adds a block.
+     */
+    static inline void *arena_alloc(ArenaPtr arena, size_t size);
+    static inline void *arena_alloc(ArenaPtr arena, size_t size)
+    {
+        size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+        if (arena->block != NULL
+            && size <= (size_t) (arena->block->end - arena->next))
+        {
+            void *mem = arena->next;
+
+            arena->next += size;
+            return mem;
+        }
+        return arena_alloc_block_(arena, size);
+    }
+
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* ARENA_H */
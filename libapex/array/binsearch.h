@@ -1,12 +1,19 @@
 /*
  * BINSEARCH.H --binsearch(), an improved version of bsearch().
  *
+ * Remarks:
+ * The lower_bound_*() and eytzinger_*() functions are typed
+ * alternatives for integer and double keys; they don't call a
+ * CompareProc, and their inner loops are branch-free.  The
+ * lower_bound_small_*() functions finish the search with SIMD
+ * compares, which pays off most for small arrays.
  */
 #ifndef BINSEARCH_H
 #define BINSEARCH_H
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <apex/compare.h>
 
 #ifdef __cplusplus
@@ -16,6 +23,21 @@ extern "C"
     int binsearch(void *key, void *base, int n_elements, int size,
                   CompareProc compare, bool *status);
 
+    size_t lower_bound_int(const int *base, size_t n, int key);
+    size_t lower_bound_long(const long *base, size_t n, long key);
+    size_t lower_bound_double(const double *base, size_t n, double key);
+
+    size_t lower_bound_small_int(const int *base, size_t n, int key);
+    size_t lower_bound_small_u32(const uint32_t *base, size_t n,
+                                 uint32_t key);
+    size_t lower_bound_small_long(const long *base, size_t n, long key);
+
+    void eytzinger_build(void *tree, const void *base, size_t n,
+                         size_t size);
+    size_t eytzinger_int(const int *tree, size_t n, int key);
+    size_t eytzinger_long(const long *tree, size_t n, long key);
+    size_t eytzinger_double(const double *tree, size_t n, double key);
+
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
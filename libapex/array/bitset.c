@@ -0,0 +1,516 @@
+/*
+ * BITSET.C --Bitsets, with word-at-a-time searches and SIMD set operations.
+ *
+ * Contents:
+ * tail_mask()      --Return the mask of a bitset's bits in its last word.
+ * bitset_init()    --Initialise a bitset, with caller-provided storage.
+ * bitset_new()     --Create a bitset.
+ * bitset_free()    --Free a bitset created by bitset_new().
+ * bitset_resize()  --Change the No. of bits in a bitset.
+ * bitset_fill()    --Set or clear all the bits.
+ * bitset_count()   --Return the No. of set bits.
+ * bitset_next()    --Find the first set bit at or after from.
+ * bitset_next_clear() --Find the first clear bit at or after from.
+ * bitset_prev()    --Find the last set bit at or before from.
+ * bitset_op()      --Combine a bitset with another, in place.
+ * bitset_claim()   --Atomically find and set a clear bit.
+ * bitset_release() --Atomically clear a bit.
+ * op_words()       --Combine arrays of words (scalar).
+ * count_words()    --Count the set bits in an array of words.
+ * op_words_avx2()  --Combine arrays of words, 4 at a time (AVX2).
+ * count_words_popcnt() --Count the set bits, with the POPCNT instruction.
+ * resolve_op()     --Select the best op_words() for this CPU, and call it.
+ * resolve_count()  --Select the best count_words() for this CPU, and call it.
+ * bits_op_()       --Combine arrays of words.
+ * bits_count_()    --Count the set bits in an array of words.
+ *
+ * Remarks:
+ * Searches skip a word of 0s (or 1s) at a time, and find the bit
+ * within a word with __builtin_ctzll() (or clzll).  The set
+ * operations and counts are selected on the first call, as in
+ * simd-search.c: on x86 the and/or/andnot/xor loop uses AVX2, and
+ * the count uses the POPCNT instruction (which x86-64's baseline
+ * doesn't include, so __builtin_popcountll() would otherwise be a
+ * bit-twiddling sequence).
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <apex.h>
+#include <apex/atomic.h>
+#include <apex/bitset.h>
+#include <apex/cpu.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITSET_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*OpWordsProc)(uint64_t *dst, const uint64_t *src,
+                            size_t n_words, BitsetOp op);
+typedef size_t (*CountWordsProc)(const uint64_t *word, size_t n_words);
+
+/*
+ * tail_mask() --Return the mask of a bitset's bits in its last word.
+ */
+static inline uint64_t tail_mask(size_t n_bits)
+{
+    return n_bits % 64 == 0 ? ~0ULL : (1ULL << (n_bits % 64)) - 1;
+}
+
+/*
+ * bitset_init() --Initialise a bitset, with caller-provided storage.
+ *
+ * Parameters:
+ * set      --the bitset to initialise
+ * n_bits   --the No. of bits
+ * word     --storage for BITSET_WORDS(n_bits) words
+ *
+ * Returns: (BitsetPtr)
+ * Success: set; Failure: NULL.
+ *
+ * Remarks:
+ * The bits are all cleared.  Such a bitset can't be resized.
+ */
+BitsetPtr bitset_init(BitsetPtr set, size_t n_bits, uint64_t *word)
+{
+    if (set == NULL || word == NULL)
+    {
+        return NULL;
+    }
+    set->word = word;
+    set->n_bits = n_bits;
+    set->n_words = BITSET_WORDS(n_bits);
+    set->owned = 0;
+    bitset_fill(set, 0);
+    return set;
+}
+
+/*
+ * bitset_new() --Create a bitset.
+ *
+ * Returns: (BitsetPtr)
+ * Success: the bitset, with all its bits clear; Failure: NULL.
+ */
+BitsetPtr bitset_new(size_t n_bits)
+{
+    BitsetPtr set = NEW(Bitset, 1);
+
+    if (set == NULL)
+    {
+        return NULL;
+    }
+    if (!bitset_resize(set, n_bits))
+    {
+        free(set);
+        return NULL;
+    }
+    set->owned = 1;
+    return set;
+}
+
+/*
+ * bitset_free() --Free a bitset created by bitset_new().
+ */
+void bitset_free(BitsetPtr set)
+{
+    if (set != NULL)
+    {
+        free(set->word);
+        free(set);
+    }
+}
+
+/*
+ * bitset_resize() --Change the No. of bits in a bitset.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory, or caller-provided storage).
+ *
+ * Remarks:
+ * Added bits are clear; storage is aligned for SIMD, and grows by
+ * doubling.
+ */
+int bitset_resize(BitsetPtr set, size_t n_bits)
+{
+    size_t n_words = BITSET_WORDS(n_bits);
+
+    if (n_words > set->n_words || set->word == NULL)
+    {
+        size_t n_alloc = MAX(MAX(n_words, 2 * set->n_words), 8);
+        uint64_t *word;
+
+        if ((set->word != NULL && !set->owned)
+            || posix_memalign((void **) &word, CACHE_LINE,
+                              n_alloc * sizeof(uint64_t)) != 0)
+        {
+            return 0;
+        }
+        memset(word, 0, n_alloc * sizeof(uint64_t));
+        if (set->word != NULL)
+        {
+            memcpy(word, set->word, BITSET_WORDS(set->n_bits) * 8);
+            free(set->word);
+        }
+        set->word = word;
+        set->n_words = n_alloc;
+    }
+    else if (n_bits < set->n_bits)
+    {                                  /* (keep the bits past n_bits clear) */
+        memset(set->word + n_words, 0,
+               (BITSET_WORDS(set->n_bits) - n_words) * sizeof(uint64_t));
+        if (n_words > 0)
+        {
+            set->word[n_words - 1] &= tail_mask(n_bits);
+        }
+    }
+    set->n_bits = n_bits;
+    return 1;
+}
+
+/*
+ * bitset_fill() --Set or clear all the bits.
+ */
+void bitset_fill(BitsetPtr set, int value)
+{
+    size_t n_words = BITSET_WORDS(set->n_bits);
+
+    memset(set->word, value ? 0xff : 0, n_words * sizeof(uint64_t));
+    if (value && n_words > 0)
+    {
+        set->word[n_words - 1] = tail_mask(set->n_bits);
+    }
+}
+
+/*
+ * bitset_count() --Return the No. of set bits.
+ */
+size_t bitset_count(const Bitset * set)
+{
+    return bits_count_(set->word, BITSET_WORDS(set->n_bits));
+}
+
+/*
+ * bitset_next() --Find the first set bit at or after from.
+ *
+ * Returns: (size_t)
+ * Success: the bit's index; Failure: set->n_bits (there's none).
+ */
+size_t bitset_next(const Bitset * set, size_t from)
+{
+    size_t n_words = BITSET_WORDS(set->n_bits), w = from / 64;
+    uint64_t x;
+
+    if (from >= set->n_bits)
+    {
+        return set->n_bits;
+    }
+    x = set->word[w] & (~0ULL << (from % 64));
+    while (x == 0)
+    {
+        if (++w >= n_words)
+        {
+            return set->n_bits;
+        }
+        x = set->word[w];
+    }
+    return w * 64 + (size_t) __builtin_ctzll(x);
+}
+
+/*
+ * bitset_next_clear() --Find the first clear bit at or after from.
+ *
+ * Returns: (size_t)
+ * Success: the bit's index; Failure: set->n_bits (there's none).
+ */
+size_t bitset_next_clear(const Bitset * set, size_t from)
+{
+    size_t n_words = BITSET_WORDS(set->n_bits), w = from / 64;
+    uint64_t x;
+
+    if (from >= set->n_bits)
+    {
+        return set->n_bits;
+    }
+    x = ~set->word[w] & (~0ULL << (from % 64));
+    while (x == 0)
+    {
+        if (++w >= n_words)
+        {
+            return set->n_bits;
+        }
+        x = ~set->word[w];
+    }
+    return MIN(w * 64 + (size_t) __builtin_ctzll(x), set->n_bits);
+}
+
+/*
+ * bitset_prev() --Find the last set bit at or before from.
+ *
+ * Returns: (size_t)
+ * Success: the bit's index; Failure: set->n_bits (there's none).
+ */
+size_t bitset_prev(const Bitset * set, size_t from)
+{
+    size_t w;
+    uint64_t x;
+
+    if (set->n_bits == 0)
+    {
+        return 0;
+    }
+    from = MIN(from, set->n_bits - 1);
+    w = from / 64;
+    x = set->word[w] & (~0ULL >> (63 - from % 64));
+    while (x == 0)
+    {
+        if (w-- == 0)
+        {
+            return set->n_bits;
+        }
+        x = set->word[w];
+    }
+    return w * 64 + 63 - (size_t) __builtin_clzll(x);
+}
+
+/*
+ * bitset_op() --Combine a bitset with another, in place.
+ *
+ * Parameters:
+ * dst      --the bitset to update
+ * src      --the other bitset
+ * op       --the operation
+ *
+ * Remarks:
+ * If the sets differ in size, src is treated as if it were padded
+ * with 0s (or truncated) to dst's size.
+ */
+void bitset_op(BitsetPtr dst, const Bitset * src, BitsetOp op)
+{
+    size_t n_dst = BITSET_WORDS(dst->n_bits);
+    size_t n_src = BITSET_WORDS(src->n_bits);
+    size_t n = MIN(n_dst, n_src);
+
+    bits_op_(dst->word, src->word, n, op);
+    if (op == BITSET_AND && n < n_dst)
+    {
+        memset(dst->word + n, 0, (n_dst - n) * sizeof(uint64_t));
+    }
+    if (n_dst > 0)
+    {
+        dst->word[n_dst - 1] &= tail_mask(dst->n_bits);
+    }
+}
+
+/*
+ * bitset_claim() --Atomically find and set a clear bit.
+ *
+ * Parameters:
+ * set      --the bitset
+ * from     --where to start looking (e.g. just after the last claim)
+ *
+ * Returns: (size_t)
+ * Success: the bit's index; Failure: set->n_bits (all bits are set).
+ *
+ * Remarks:
+ * The search wraps around to the start of the set.  Each attempt is
+ * an atomic OR of the candidate bit: if another thread set it first,
+ * the search continues from the word's new value.
+ */
+size_t bitset_claim(BitsetPtr set, size_t from)
+{
+    size_t n_words = BITSET_WORDS(set->n_bits);
+    size_t w0 = from < set->n_bits ? from / 64 : 0;
+
+    for (size_t i = 0; i < n_words; ++i)
+    {
+        size_t w = (w0 + i) % n_words;
+        uint64_t valid = w == n_words - 1 ? tail_mask(set->n_bits) : ~0ULL;
+        uint64_t x = ATOMIC_LOAD_RELAXED(&set->word[w]);
+
+        while ((~x & valid) != 0)
+        {
+            uint64_t bit = 1ULL << __builtin_ctzll(~x & valid);
+
+            x = ATOMIC_OR(&set->word[w], bit);
+            if ((x & bit) == 0)
+            {
+                return w * 64 + (size_t) __builtin_ctzll(bit);
+            }
+        }
+    }
+    return set->n_bits;
+}
+
+/*
+ * bitset_release() --Atomically clear a bit.
+ */
+void bitset_release(BitsetPtr set, size_t i)
+{
+    ATOMIC_AND(&set->word[i / 64], ~(1ULL << (i % 64)));
+}
+
+/*
+ * op_words() --Combine arrays of words (scalar).
+ */
+static void op_words(uint64_t *dst, const uint64_t *src, size_t n_words,
+                     BitsetOp op)
+{
+    switch (op)
+    {
+    case BITSET_AND:
+        for (size_t i = 0; i < n_words; ++i)
+        {
+            dst[i] &= src[i];
+        }
+        break;
+    case BITSET_OR:
+        for (size_t i = 0; i < n_words; ++i)
+        {
+            dst[i] |= src[i];
+        }
+        break;
+    case BITSET_ANDNOT:
+        for (size_t i = 0; i < n_words; ++i)
+        {
+            dst[i] &= ~src[i];
+        }
+        break;
+    case BITSET_XOR:
+        for (size_t i = 0; i < n_words; ++i)
+        {
+            dst[i] ^= src[i];
+        }
+        break;
+    }
+}
+
+/*
+ * count_words() --Count the set bits in an array of words.
+ */
+static size_t count_words(const uint64_t *word, size_t n_words)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < n_words; ++i)
+    {
+        count += (size_t) __builtin_popcountll(word[i]);
+    }
+    return count;
+}
+
+#ifdef BITSET_X86
+/*
+ * op_words_avx2() --Combine arrays of words, 4 at a time (AVX2).
+ *
+ * Remarks:
+ * _mm256_andnot_si256(a, b) is ~a & b, hence the swapped operands.
+ */
+__attribute__((target("avx2")))
+static void op_words_avx2(uint64_t *dst, const uint64_t *src,
+                          size_t n_words, BitsetOp op)
+{
+    size_t i = 0;
+
+    for (; i + 4 <= n_words; i += 4)
+    {
+        __m256i d = _mm256_loadu_si256((const __m256i *) (dst + i));
+        __m256i s = _mm256_loadu_si256((const __m256i *) (src + i));
+
+        switch (op)
+        {
+        case BITSET_AND:
+            d = _mm256_and_si256(d, s);
+            break;
+        case BITSET_OR:
+            d = _mm256_or_si256(d, s);
+            break;
+        case BITSET_ANDNOT:
+            d = _mm256_andnot_si256(s, d);
+            break;
+        case BITSET_XOR:
+            d = _mm256_xor_si256(d, s);
+            break;
+        }
+        _mm256_storeu_si256((__m256i *) (dst + i), d);
+    }
+    op_words(dst + i, src + i, n_words - i, op);
+}
+
+/*
+ * count_words_popcnt() --Count the set bits, with the POPCNT instruction.
+ */
+__attribute__((target("popcnt")))
+static size_t count_words_popcnt(const uint64_t *word, size_t n_words)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < n_words; ++i)
+    {
+        count += (size_t) __builtin_popcountll(word[i]);
+    }
+    return count;
+}
+#endif /* BITSET_X86 */
+
+static void resolve_op(uint64_t *dst, const uint64_t *src, size_t n_words,
+                       BitsetOp op);
+static size_t resolve_count(const uint64_t *word, size_t n_words);
+
+static OpWordsProc op_words_proc = resolve_op;
+static CountWordsProc count_words_proc = resolve_count;
+
+/*
+ * resolve_op() --Select the best op_words() for this CPU, and call it.
+ */
+static void resolve_op(uint64_t *dst, const uint64_t *src, size_t n_words,
+                       BitsetOp op)
+{
+    OpWordsProc proc = op_words;
+
+#ifdef BITSET_X86
+    if (cpu_has(CPU_AVX2))
+    {
+        proc = op_words_avx2;
+    }
+#endif
+    CPU_RESOLVE(&op_words_proc, proc);
+    proc(dst, src, n_words, op);
+}
+
+/*
+ * resolve_count() --Select the best count_words() for this CPU, and call it.
+ */
+static size_t resolve_count(const uint64_t *word, size_t n_words)
+{
+    CountWordsProc proc = count_words;
+
+#ifdef BITSET_X86
+    if (cpu_has(CPU_POPCNT))
+    {
+        proc = count_words_popcnt;
+    }
+#endif
+    CPU_RESOLVE(&count_words_proc, proc);
+    return proc(word, n_words);
+}
+
+/*
+ * bits_op_() --Combine arrays of words.
+ *
+ * Remarks:
+ * This is the kernel of bitset_op(), and of roaring_op()'s bitset
+ * containers.
+ */
+void bits_op_(uint64_t *dst, const uint64_t *src, size_t n_words,
+              BitsetOp op)
+{
+    op_words_proc(dst, src, n_words, op);
+}
+
+/*
+ * bits_count_() --Count the set bits in an array of words.
+ */
+size_t bits_count_(const uint64_t *word, size_t n_words)
+{
+    return count_words_proc(word, n_words);
+}
@@ -0,0 +1,156 @@
+/*
+ * BITSET.H --Definitions for bitsets, and compressed (roaring) bitmaps.
+ *
+ * Contents:
+ * BITSET_WORDS()   --The No. of words needed for n bits.
+ * BitsetOp         --A set operation, combining two bitsets.
+ * Bitset_t{}       --A fixed (or resizable) array of bits.
+ * RoaringContainer_t{} --A roaring bitmap's members with the same high 16 bits.
+ * Roaring_t{}      --A compressed bitmap of 32-bit values.
+ * bitset_set()     --Set a bit.
+ * bitset_unset()   --Clear a bit.
+ * bitset_test()    --Test a bit.
+ *
+ * Remarks:
+ * A Bitset is a plain array of 64-bit words, so it's compact, and its
+ * whole-set operations (counting, and/or/andnot/xor) run a word (or,
+ * with AVX2, 4 words) at a time.  The bits past n_bits in the last
+ * word are always 0.
+ *
+ * A Roaring bitmap splits each value into high and low 16 bits, and
+ * keeps the low halves of each high half in a "container": a sorted
+ * array of uint16_t while there are few of them, or a 65536-bit
+ * bitset once there are more than ROARING_ARRAY_MAX.  Sparse sets are
+ * as small as a sorted array, and dense ones as small as a bitset.
+ *
+ * Neither is thread-safe, except for bitset_claim() and
+ * bitset_release(), which may be called concurrently.
+ */
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+#define BITSET_WORDS(n_bits_) (((n_bits_) + 63) / 64)
+
+    enum
+    {
+        ROARING_ARRAY_MAX = 4096,      /* (above this, a container is a bitset) */
+        ROARING_BITSET_WORDS = 65536 / 64
+    };
+
+    /*
+     * BitsetOp --A set operation, combining two bitsets.
+     */
+    typedef enum BitsetOp_t
+    {
+        BITSET_AND,
+        BITSET_OR,
+        BITSET_ANDNOT,                 /* (members of dst not in src) */
+        BITSET_XOR
+    } BitsetOp;
+
+    /*
+     * Bitset_t{} --A fixed (or resizable) array of bits.
+     */
+    typedef struct Bitset_t
+    {
+        uint64_t *word;
+        size_t n_bits;
+        size_t n_words;                /* No. of words allocated */
+        int owned;                     /* word was allocated by bitset_new() */
+    } Bitset, *BitsetPtr;
+
+    /*
+     * RoaringContainer_t{} --A roaring bitmap's members with the same high 16 bits.
+     */
+    typedef struct RoaringContainer_t
+    {
+        uint16_t key;                  /* the members' high 16 bits */
+        uint16_t is_bitset;
+        uint32_t n;                    /* No. of members */
+        uint32_t n_alloc;              /* (arrays) No. of slots allocated */
+        union
+        {
+            uint16_t *array;           /* sorted low 16 bits */
+            uint64_t *bits;            /* ROARING_BITSET_WORDS */
+        };
+    } RoaringContainer, *RoaringContainerPtr;
+
+    /*
+     * Roaring_t{} --A compressed bitmap of 32-bit values.
+     */
+    typedef struct Roaring_t
+    {
+        RoaringContainerPtr container; /* sorted by key */
+        size_t n_container;
+        size_t n_alloc;
+    } Roaring, *RoaringPtr;
+
+    BitsetPtr bitset_init(BitsetPtr set, size_t n_bits, uint64_t *word);
+    BitsetPtr bitset_new(size_t n_bits);
+    void bitset_free(BitsetPtr set);
+    int bitset_resize(BitsetPtr set, size_t n_bits);
+    void bitset_fill(BitsetPtr set, int value);
+    size_t bitset_count(const Bitset * set);
+    size_t bitset_next(const Bitset * set, size_t from);
+    size_t bitset_next_clear(const Bitset * set, size_t from);
+    size_t bitset_prev(const Bitset * set, size_t from);
+    void bitset_op(BitsetPtr dst, const Bitset * src, BitsetOp op);
+    size_t bitset_claim(BitsetPtr set, size_t from);
+    void bitset_release(BitsetPtr set, size_t i);
+
+    void bits_op_(uint64_t *dst, const uint64_t *src, size_t n_words,
+                  BitsetOp op);
+    size_t bits_count_(const uint64_t *word, size_t n_words);
+
+    RoaringPtr roaring_new(void);
+    void roaring_free(RoaringPtr r);
+    void roaring_clear(RoaringPtr r);
+    int roaring_add(RoaringPtr r, uint32_t value);
+    int roaring_remove(RoaringPtr r, uint32_t value);
+    int roaring_contains(const Roaring * r, uint32_t value);
+    size_t roaring_count(const Roaring * r);
+    int roaring_next(const Roaring * r, uint32_t from, uint32_t *value);
+    int roaring_op(RoaringPtr dst, const Roaring * src, BitsetOp op);
+    size_t roaring_bytes(const Roaring * r);
+
+#define bitset_and(dst_, src_) bitset_op(dst_, src_, BITSET_AND)
+#define bitset_or(dst_, src_) bitset_op(dst_, src_, BITSET_OR)
+#define bitset_andnot(dst_, src_) bitset_op(dst_, src_, BITSET_ANDNOT)
+
+    /*
+     * bitset_set() --Set a bit.
+     */
+    static inline void bitset_set(BitsetPtr set, size_t i);
+    static inline void bitset_set(BitsetPtr set, size_t i)
+    {
+        set->word[i / 64] |= 1ULL << (i % 64);
+    }
+
+    /*
+     * bitset_unset() --Clear a bit.
+     */
+    static inline void bitset_unset(BitsetPtr set, size_t i);
+    static inline void bitset_unset(BitsetPtr set, size_t i)
+    {
+        set->word[i / 64] &= ~(1ULL << (i % 64));
+    }
+
+    /*
+     * bitset_test() --Test a bit.
+     */
+    static inline int bitset_test(const Bitset * set, size_t i);
+    static inline int bitset_test(const Bitset * set, size_t i)
+    {
+        return (set->word[i / 64] >> (i % 64)) & 1;
+    }
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* BITSET_H */
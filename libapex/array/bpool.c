@@ -0,0 +1,69 @@
+/*
+ * BPOOL.C --A thread-safe pool allocator, with an allocation bitmap.
+ *
+ * Contents:
+ * bpool_init()     --Initialise a bitmap pool.
+ * bpool_new()      --Get a new item from the pool.
+ * bpool_delete()   --Return an item to the pool.
+ *
+ * Remarks:
+ * An allocation claims the first clear bit at or after the hint
+ * (the slot after the last one claimed), so allocations sweep
+ * through the items rather than all contending for the same word,
+ * and a deleted item's slot is reused when the sweep comes round.
+ */
+#include <apex/pool.h>
+
+/*
+ * bpool_init() --Initialise a bitmap pool.
+ *
+ * Parameters:
+ * pool     --specifies and returns the initialised pool
+ * n_items  --the number of pool items
+ * item_size --the size of each item
+ * items    --the storage for the items (size == n_items*item_size)
+ * bits     --the storage for the bitmap (BITSET_WORDS(n_items) words)
+ *
+ * Returns: (BPoolPtr)
+ * Success: the pool; Failure: NULL.
+ */
+BPoolPtr bpool_init(BPoolPtr pool, int n_items, int item_size,
+                    void *items, uint64_t *bits)
+{
+    if (pool == NULL || items == NULL || n_items < 0
+        || bitset_init(&pool->used, (size_t) n_items, bits) == NULL)
+    {
+        return NULL;
+    }
+    array_init(&pool->array, n_items, item_size, items);
+    pool->hint = 0;
+    return pool;
+}
+
+/*
+ * bpool_new() --Get a new item from the pool.
+ *
+ * Returns: (void *)
+ * Success: the item; Failure: NULL (all the items are allocated).
+ */
+void *bpool_new(BPoolPtr pool)
+{
+    size_t slot = bitset_claim(&pool->used,
+                               ATOMIC_LOAD_RELAXED(&pool->hint));
+
+    if (slot >= pool->used.n_bits)
+    {
+        return NULL;
+    }
+    ATOMIC_STORE_RELAXED(&pool->hint, slot + 1);
+    return array_item(&pool->array, (int) slot);
+}
+
+/*
+ * bpool_delete() --Return an item to the pool.
+ */
+void bpool_delete(BPoolPtr pool, void *item)
+{
+    bitset_release(&pool->used, (size_t) ((char *) item - pool->array.base)
+                   / (size_t) pool->array.item_size);
+}
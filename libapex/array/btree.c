@@ -0,0 +1,824 @@
+/*
+ * BTREE.C --An ordered map (a B+tree).
+ *
+ * Contents:
+ * key_cmp()        --Compare two keys.
+ * node_lower()     --Return the first slot with a key >= key.
+ * node_upper()     --Return the first slot with a key > key.
+ * node_new()       --Allocate an (empty) node.
+ * node_free()      --Free a node, and all its descendants.
+ * btree_new()      --Create an (empty) tree.
+ * btree_free()     --Free a tree.
+ * btree_clear()    --Remove all the entries from a tree.
+ * split_child()    --Split a full child in two.
+ * put()            --Add or replace an entry.
+ * get()            --Find a key's value.
+ * borrow_left()    --Move an entry into a child from its left sibling.
+ * borrow_right()   --Move an entry into a child from its right sibling.
+ * merge()          --Merge a child with its right sibling.
+ * fix_child()      --Ensure a child can lose an entry.
+ * remove_key()     --Remove an entry.
+ * n_groups()       --Return how many nodes to fill, when bulk-loading.
+ * load()           --Build a tree from sorted entries.
+ * seek()           --Position a cursor at the first key >= key.
+ * btree_put()      --Add or replace an entry.
+ * btree_get()      --Find a key's value.
+ * btree_remove()   --Remove an entry.
+ * btree_load()     --Build a tree from sorted entries.
+ * btree_seek()     --Position a cursor at the first key >= key.
+ * btree_put_long() --Add or replace an entry (long keys).
+ * btree_get_long() --Find a key's value (long keys).
+ * btree_remove_long() --Remove an entry (long keys).
+ * btree_load_long() --Build a tree from sorted entries (long keys).
+ * btree_seek_long() --Position a cursor at the first key >= key (long keys).
+ * btree_first()    --Position a cursor at the first entry.
+ *
+ * Remarks:
+ * Inserts split full nodes on the way down, and removals top up
+ * minimal nodes on the way down (by borrowing from a sibling, or
+ * merging with it), so neither needs to revisit a node's parent.
+ *
+ * In a tree of pointer keys, each separator is a pointer to a key
+ * that's in the tree: a separator equal to a removed (or replaced)
+ * key is updated, so the caller may free keys once they're removed.
+ *
+ * The nodes of a tree of long keys are searched by counting the keys
+ * that are less than the key, which the compiler can vectorise.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <apex.h>
+#include <apex/atomic.h>               /* CACHE_LINE */
+#include <apex/btree.h>
+
+enum
+{
+    MIN_KEYS = BTREE_ORDER / 2 - 1,    /* (except the root) */
+    LOAD_FILL = BTREE_ORDER * 3 / 4    /* keys/children, when bulk-loading */
+};
+
+/*
+ * key_cmp() --Compare two keys.
+ */
+static inline int key_cmp(const BTree * tree, BTreeKey a, BTreeKey b)
+{
+    if (tree->cmp == NULL)
+    {
+        return (a.l > b.l) - (a.l < b.l);
+    }
+    return tree->cmp(a.p, b.p);
+}
+
+/*
+ * node_lower() --Return the first slot with a key >= key.
+ */
+static inline int node_lower(const BTree * tree, const BTreeNode * node,
+                             BTreeKey key)
+{
+    int lo = 0, hi = node->n_keys;
+
+    if (tree->cmp == NULL)
+    {
+        for (int i = 0; i < hi; ++i)
+        {
+            lo += node->key[i].l < key.l;
+        }
+        return lo;
+    }
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (tree->cmp(node->key[mid].p, key.p) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * node_upper() --Return the first slot with a key > key.
+ */
+static inline int node_upper(const BTree * tree, const BTreeNode * node,
+                             BTreeKey key)
+{
+    int lo = 0, hi = node->n_keys;
+
+    if (tree->cmp == NULL)
+    {
+        for (int i = 0; i < hi; ++i)
+        {
+            lo += node->key[i].l <= key.l;
+        }
+        return lo;
+    }
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (tree->cmp(node->key[mid].p, key.p) <= 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * node_new() --Allocate an (empty) node.
+ */
+static BTreeNodePtr node_new(int leaf)
+{
+    BTreeNodePtr node;
+
+    if (posix_memalign((void **) &node, CACHE_LINE, sizeof(*node)) != 0)
+    {
+        return NULL;
+    }
+    node->n_keys = 0;
+    node->leaf = leaf;
+    node->next = NULL;
+    return node;
+}
+
+/*
+ * node_free() --Free a node, and all its descendants.
+ */
+static void node_free(BTreeNodePtr node)
+{
+    if (!node->leaf)
+    {
+        for (int i = 0; i <= node->n_keys; ++i)
+        {
+            node_free(node->child[i]);
+        }
+    }
+    free(node);
+}
+
+/*
+ * btree_new() --Create an (empty) tree.
+ *
+ * Parameters:
+ * cmp      --compares two keys (NULL: the keys are longs)
+ *
+ * Returns: (BTreePtr)
+ * Success: the tree; Failure: NULL.
+ */
+BTreePtr btree_new(CompareProc cmp)
+{
+    BTreePtr tree = NEW(BTree, 1);
+
+    if (tree != NULL)
+    {
+        tree->cmp = cmp;
+    }
+    return tree;
+}
+
+/*
+ * btree_free() --Free a tree.
+ *
+ * Remarks:
+ * The keys and values are not freed.
+ */
+void btree_free(BTreePtr tree)
+{
+    if (tree != NULL)
+    {
+        btree_clear(tree);
+        free(tree);
+    }
+}
+
+/*
+ * btree_clear() --Remove all the entries from a tree.
+ */
+void btree_clear(BTreePtr tree)
+{
+    if (tree->root != NULL)
+    {
+        node_free(tree->root);
+    }
+    tree->root = tree->first = NULL;
+    tree->n_items = 0;
+    tree->height = 0;
+}
+
+/*
+ * split_child() --Split a full child in two.
+ *
+ * Remarks:
+ * A leaf's upper half moves to a new leaf, and a copy of its first
+ * key becomes the separator; an internal node's middle key moves up.
+ */
+static int split_child(BTreeNodePtr parent, int i)
+{
+    BTreeNodePtr left = parent->child[i];
+    BTreeNodePtr right = node_new(left->leaf);
+    int half = left->n_keys / 2;
+    BTreeKey sep;
+
+    if (right == NULL)
+    {
+        return 0;
+    }
+    if (left->leaf)
+    {
+        right->n_keys = left->n_keys - half;
+        memcpy(right->key, left->key + half,
+               right->n_keys * sizeof(BTreeKey));
+        memcpy(right->value, left->value + half,
+               right->n_keys * sizeof(void *));
+        right->next = left->next;
+        left->next = right;
+        sep = right->key[0];
+    }
+    else
+    {
+        sep = left->key[half];
+        right->n_keys = left->n_keys - half - 1;
+        memcpy(right->key, left->key + half + 1,
+               right->n_keys * sizeof(BTreeKey));
+        memcpy(right->child, left->child + half + 1,
+               (right->n_keys + 1) * sizeof(BTreeNodePtr));
+    }
+    left->n_keys = half;
+
+    memmove(parent->key + i + 1, parent->key + i,
+            (parent->n_keys - i) * sizeof(BTreeKey));
+    memmove(parent->child + i + 2, parent->child + i + 1,
+            (parent->n_keys - i) * sizeof(BTreeNodePtr));
+    parent->key[i] = sep;
+    parent->child[i + 1] = right;
+    parent->n_keys += 1;
+    return 1;
+}
+
+/*
+ * put() --Add or replace an entry.
+ */
+static int put(BTreePtr tree, BTreeKey key, void *value, void **old)
+{
+    BTreeNodePtr node;
+    int i;
+
+    if (old != NULL)
+    {
+        *old = NULL;
+    }
+    if (tree->root == NULL)
+    {
+        if ((tree->root = tree->first = node_new(1)) == NULL)
+        {
+            return 0;                  /* failure: no memory */
+        }
+        tree->height = 1;
+    }
+    if (tree->root->n_keys == BTREE_ORDER)
+    {                                  /* grow a new root */
+        if ((node = node_new(0)) == NULL)
+        {
+            return 0;
+        }
+        node->child[0] = tree->root;
+        if (!split_child(node, 0))
+        {
+            free(node);
+            return 0;
+        }
+        tree->root = node;
+        tree->height += 1;
+    }
+    for (node = tree->root; !node->leaf; node = node->child[i])
+    {
+        i = node_upper(tree, node, key);
+        if (node->child[i]->n_keys == BTREE_ORDER)
+        {
+            if (!split_child(node, i))
+            {
+                return 0;
+            }
+            i += key_cmp(tree, node->key[i], key) <= 0;
+        }
+        if (tree->cmp != NULL && i > 0
+            && key_cmp(tree, node->key[i - 1], key) == 0)
+        {
+            node->key[i - 1] = key;    /* (the caller may free the old key) */
+        }
+    }
+    i = node_lower(tree, node, key);
+    if (i < node->n_keys && key_cmp(tree, node->key[i], key) == 0)
+    {
+        if (old != NULL)
+        {
+            *old = node->value[i];
+        }
+        node->key[i] = key;
+        node->value[i] = value;
+        return 1;
+    }
+    memmove(node->key + i + 1, node->key + i,
+            (node->n_keys - i) * sizeof(BTreeKey));
+    memmove(node->value + i + 1, node->value + i,
+            (node->n_keys - i) * sizeof(void *));
+    node->key[i] = key;
+    node->value[i] = value;
+    node->n_keys += 1;
+    tree->n_items += 1;
+    return 1;
+}
+
+/*
+ * get() --Find a key's value.
+ */
+static void *get(BTreePtr tree, BTreeKey key)
+{
+    BTreeNodePtr node = tree->root;
+    int i;
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    while (!node->leaf)
+    {
+        node = node->child[node_upper(tree, node, key)];
+    }
+    i = node_lower(tree, node, key);
+    if (i < node->n_keys && key_cmp(tree, node->key[i], key) == 0)
+    {
+        return node->value[i];
+    }
+    return NULL;
+}
+
+/*
+ * borrow_left() --Move an entry into a child from its left sibling.
+ */
+static void borrow_left(BTreeNodePtr parent, int i)
+{
+    BTreeNodePtr node = parent->child[i];
+    BTreeNodePtr left = parent->child[i - 1];
+
+    memmove(node->key + 1, node->key, node->n_keys * sizeof(BTreeKey));
+    if (node->leaf)
+    {
+        memmove(node->value + 1, node->value,
+                node->n_keys * sizeof(void *));
+        node->key[0] = left->key[left->n_keys - 1];
+        node->value[0] = left->value[left->n_keys - 1];
+        parent->key[i - 1] = node->key[0];
+    }
+    else
+    {
+        memmove(node->child + 1, node->child,
+                (node->n_keys + 1) * sizeof(BTreeNodePtr));
+        node->key[0] = parent->key[i - 1];
+        node->child[0] = left->child[left->n_keys];
+        parent->key[i - 1] = left->key[left->n_keys - 1];
+    }
+    left->n_keys -= 1;
+    node->n_keys += 1;
+}
+
+/*
+ * borrow_right() --Move an entry into a child from its right sibling.
+ */
+static void borrow_right(BTreeNodePtr parent, int i)
+{
+    BTreeNodePtr node = parent->child[i];
+    BTreeNodePtr right = parent->child[i + 1];
+
+    if (node->leaf)
+    {
+        node->key[node->n_keys] = right->key[0];
+        node->value[node->n_keys] = right->value[0];
+        memmove(right->value, right->value + 1,
+                (right->n_keys - 1) * sizeof(void *));
+        memmove(right->key, right->key + 1,
+                (right->n_keys - 1) * sizeof(BTreeKey));
+        parent->key[i] = right->key[0];
+    }
+    else
+    {
+        node->key[node->n_keys] = parent->key[i];
+        node->child[node->n_keys + 1] = right->child[0];
+        parent->key[i] = right->key[0];
+        memmove(right->key, right->key + 1,
+                (right->n_keys - 1) * sizeof(BTreeKey));
+        memmove(right->child, right->child + 1,
+                right->n_keys * sizeof(BTreeNodePtr));
+    }
+    right->n_keys -= 1;
+    node->n_keys += 1;
+}
+
+/*
+ * merge() --Merge a child with its right sibling.
+ */
+static void merge(BTreeNodePtr parent, int i)
+{
+    BTreeNodePtr left = parent->child[i];
+    BTreeNodePtr right = parent->child[i + 1];
+
+    if (left->leaf)
+    {
+        memcpy(left->key + left->n_keys, right->key,
+               right->n_keys * sizeof(BTreeKey));
+        memcpy(left->value + left->n_keys, right->value,
+               right->n_keys * sizeof(void *));
+        left->n_keys += right->n_keys;
+        left->next = right->next;
+    }
+    else
+    {
+        left->key[left->n_keys] = parent->key[i];
+        memcpy(left->key + left->n_keys + 1, right->key,
+               right->n_keys * sizeof(BTreeKey));
+        memcpy(left->child + left->n_keys + 1, right->child,
+               (right->n_keys + 1) * sizeof(BTreeNodePtr));
+        left->n_keys += right->n_keys + 1;
+    }
+    free(right);
+
+    memmove(parent->key + i, parent->key + i + 1,
+            (parent->n_keys - i - 1) * sizeof(BTreeKey));
+    memmove(parent->child + i + 1, parent->child + i + 2,
+            (parent->n_keys - i - 1) * sizeof(BTreeNodePtr));
+    parent->n_keys -= 1;
+}
+
+/*
+ * fix_child() --Ensure a child can lose an entry.
+ *
+ * Returns: (int)
+ * The slot of the child that now holds child i's keys.
+ */
+static int fix_child(BTreeNodePtr parent, int i)
+{
+    if (i > 0 && parent->child[i - 1]->n_keys > MIN_KEYS)
+    {
+        borrow_left(parent, i);
+    }
+    else if (i < parent->n_keys && parent->child[i + 1]->n_keys > MIN_KEYS)
+    {
+        borrow_right(parent, i);
+    }
+    else if (i < parent->n_keys)
+    {
+        merge(parent, i);
+    }
+    else
+    {
+        merge(parent, --i);
+    }
+    return i;
+}
+
+/*
+ * remove_key() --Remove an entry.
+ */
+static void *remove_key(BTreePtr tree, BTreeKey key)
+{
+    BTreeNodePtr node = tree->root;
+    BTreeKey *sep = NULL;
+    void *value;
+    int i;
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    while (!node->leaf)
+    {
+        i = node_upper(tree, node, key);
+        if (node->child[i]->n_keys <= MIN_KEYS)
+        {
+            i = fix_child(node, i);
+            if (node == tree->root && node->n_keys == 0)
+            {                          /* (shrink the tree) */
+                tree->root = node->child[0];
+                tree->height -= 1;
+                free(node);
+                node = tree->root;
+                continue;
+            }
+        }
+        if (tree->cmp != NULL && i > 0
+            && key_cmp(tree, node->key[i - 1], key) == 0)
+        {
+            sep = &node->key[i - 1];
+        }
+        node = node->child[i];
+    }
+    i = node_lower(tree, node, key);
+    if (i >= node->n_keys || key_cmp(tree, node->key[i], key) != 0)
+    {
+        return NULL;
+    }
+    value = node->value[i];
+    memmove(node->key + i, node->key + i + 1,
+            (node->n_keys - i - 1) * sizeof(BTreeKey));
+    memmove(node->value + i, node->value + i + 1,
+            (node->n_keys - i - 1) * sizeof(void *));
+    node->n_keys -= 1;
+    tree->n_items -= 1;
+    if (sep != NULL)
+    {                                  /* (key was its leaf's first) */
+        *sep = node->key[0];
+    }
+    return value;
+}
+
+/*
+ * n_groups() --Return how many nodes to fill, when bulk-loading.
+ *
+ * Remarks:
+ * Nodes are filled to about LOAD_FILL (leaving room for inserts),
+ * but no fewer than min, unless there's only one.
+ */
+static size_t n_groups(size_t n, size_t min)
+{
+    size_t n_group = (n + LOAD_FILL - 1) / LOAD_FILL;
+
+    while (n_group > 1 && n / n_group < min)
+    {
+        n_group -= 1;
+    }
+    return n_group;
+}
+
+/*
+ * load() --Build a tree from sorted entries.
+ *
+ * Remarks:
+ * The leaves are filled first, then each level of internal nodes,
+ * recording each node's smallest key for its separator.
+ */
+static int load(BTreePtr tree, size_t n, const long *l_keys,
+                const void *const *p_keys, void *const *values)
+{
+    size_t n_node = n_groups(n, MIN_KEYS);
+    BTreeNodePtr *node = NEW(BTreeNodePtr, n_node);
+    BTreeKey *min = NEW(BTreeKey, n_node);
+    BTreeNodePtr prev = NULL;
+    size_t n_built = 0;
+    int height = 1;
+
+#define KEY(i_) (l_keys != NULL ? (BTreeKey) {.l = l_keys[i_]} \
+                 : (BTreeKey) {.p = p_keys[i_]})
+    for (size_t j = 0; node != NULL && min != NULL && j < n_node; ++j)
+    {
+        size_t lo = n * j / n_node, hi = n * (j + 1) / n_node;
+
+        if ((node[j] = node_new(1)) == NULL)
+        {
+            goto failure;
+        }
+        n_built += 1;
+        node[j]->n_keys = (int) (hi - lo);
+        for (size_t k = lo; k < hi; ++k)
+        {
+            node[j]->key[k - lo] = KEY(k);
+            node[j]->value[k - lo] = values != NULL ? values[k] : NULL;
+        }
+        min[j] = node[j]->key[0];
+        if (prev != NULL)
+        {
+            prev->next = node[j];
+        }
+        prev = node[j];
+    }
+#undef KEY
+    if (node == NULL || min == NULL)
+    {
+        goto failure;
+    }
+    tree->first = node[0];
+
+    while (n_node > 1)
+    {
+        size_t n_parent = n_groups(n_node, MIN_KEYS + 1);
+
+        for (size_t j = 0; j < n_parent; ++j)
+        {
+            size_t lo = n_node * j / n_parent;
+            size_t hi = n_node * (j + 1) / n_parent;
+            BTreeNodePtr parent = node_new(0);
+
+            if (parent == NULL)
+            {                          /* (keep the subtrees, to free) */
+                memmove(node + j, node + lo, (n_node - lo) * sizeof(*node));
+                n_built = j + n_node - lo;
+                goto failure;
+            }
+            parent->n_keys = (int) (hi - lo - 1);
+            for (size_t k = lo; k < hi; ++k)
+            {
+                parent->child[k - lo] = node[k];
+                if (k > lo)
+                {
+                    parent->key[k - lo - 1] = min[k];
+                }
+            }
+            node[j] = parent;          /* (j <= lo: node[lo] is used) */
+            min[j] = min[lo];
+        }
+        n_node = n_parent;
+        height += 1;
+    }
+    tree->root = node[0];
+    tree->height = height;
+    tree->n_items = n;
+    free(node);
+    free(min);
+    return 1;
+
+  failure:
+    for (size_t j = 0; node != NULL && j < n_built; ++j)
+    {
+        node_free(node[j]);
+    }
+    free(node);
+    free(min);
+    tree->first = NULL;
+    return 0;
+}
+
+/*
+ * seek() --Position a cursor at the first key >= key.
+ */
+static void seek(BTreeCursorPtr cursor, BTreePtr tree, BTreeKey key)
+{
+    BTreeNodePtr node = tree->root;
+
+    cursor->leaf = NULL;
+    cursor->slot = 0;
+    if (node != NULL)
+    {
+        while (!node->leaf)
+        {
+            node = node->child[node_upper(tree, node, key)];
+        }
+        cursor->leaf = node;
+        cursor->slot = node_lower(tree, node, key);
+    }
+}
+
+/*
+ * btree_put() --Add or replace an entry.
+ *
+ * Parameters:
+ * tree     --the tree
+ * key      --the key (stored, not copied)
+ * value    --the value
+ * old      --returns the value replaced (NULL: none), or NULL
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory).
+ *
+ * Remarks:
+ * If the key is already in the tree, its key pointer is replaced by
+ * this one, as well as its value.
+ */
+int btree_put(BTreePtr tree, const void *key, void *value, void **old)
+{
+    return put(tree, (BTreeKey) {.p = key}, value, old);
+}
+
+/*
+ * btree_get() --Find a key's value.
+ *
+ * Returns: (void *)
+ * Success: the value; Failure: NULL (the key isn't in the tree).
+ */
+void *btree_get(BTreePtr tree, const void *key)
+{
+    return get(tree, (BTreeKey) {.p = key});
+}
+
+/*
+ * btree_remove() --Remove an entry.
+ *
+ * Returns: (void *)
+ * Success: the entry's value; Failure: NULL (the key isn't in the tree).
+ */
+void *btree_remove(BTreePtr tree, const void *key)
+{
+    return remove_key(tree, (BTreeKey) {.p = key});
+}
+
+/*
+ * btree_load() --Build a tree from sorted entries.
+ *
+ * Parameters:
+ * tree     --the tree (which must be empty)
+ * keys     --the keys, in strictly increasing order
+ * values   --the corresponding values (NULL: all NULL)
+ * n        --the No. of entries
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the tree isn't empty, the keys aren't
+ * sorted, or no memory).
+ *
+ * Remarks:
+ * This is O(n), and the nodes are filled to 3/4, rather than the
+ * half-full nodes that inserting sorted keys would leave.
+ */
+int btree_load(BTreePtr tree, const void *const *keys,
+               void *const *values, size_t n)
+{
+    if (tree->n_items != 0)
+    {
+        return 0;
+    }
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (tree->cmp(keys[i - 1], keys[i]) >= 0)
+        {
+            return 0;
+        }
+    }
+    btree_clear(tree);
+    return n == 0 || load(tree, n, NULL, keys, values);
+}
+
+/*
+ * btree_seek() --Position a cursor at the first key >= key.
+ */
+void btree_seek(BTreeCursorPtr cursor, BTreePtr tree, const void *key)
+{
+    seek(cursor, tree, (BTreeKey) {.p = key});
+}
+
+/*
+ * btree_put_long() --Add or replace an entry (long keys).
+ */
+int btree_put_long(BTreePtr tree, long key, void *value, void **old)
+{
+    return put(tree, (BTreeKey) {.l = key}, value, old);
+}
+
+/*
+ * btree_get_long() --Find a key's value (long keys).
+ */
+void *btree_get_long(BTreePtr tree, long key)
+{
+    return get(tree, (BTreeKey) {.l = key});
+}
+
+/*
+ * btree_remove_long() --Remove an entry (long keys).
+ */
+void *btree_remove_long(BTreePtr tree, long key)
+{
+    return remove_key(tree, (BTreeKey) {.l = key});
+}
+
+/*
+ * btree_load_long() --Build a tree from sorted entries (long keys).
+ */
+int btree_load_long(BTreePtr tree, const long *keys, void *const *values,
+                    size_t n)
+{
+    if (tree->n_items != 0)
+    {
+        return 0;
+    }
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (keys[i - 1] >= keys[i])
+        {
+            return 0;
+        }
+    }
+    btree_clear(tree);
+    return n == 0 || load(tree, n, keys, NULL, values);
+}
+
+/*
+ * btree_seek_long() --Position a cursor at the first key >= key (long keys).
+ */
+void btree_seek_long(BTreeCursorPtr cursor, BTreePtr tree, long key)
+{
+    seek(cursor, tree, (BTreeKey) {.l = key});
+}
+
+/*
+ * btree_first() --Position a cursor at the first entry.
+ */
+void btree_first(BTreeCursorPtr cursor, BTreePtr tree)
+{
+    cursor->leaf = tree->first;
+    cursor->slot = 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * BTREE.H --Definitions for an ordered map (a B+tree).
+ *
+ * Contents:
+ * BTreeKey_t{}     --A key: a pointer (with a CompareProc), or a long.
+ * BTreeNode_t{}    --A tree node: a leaf, or an internal node.
+ * BTree_t{}        --The tree's root, and housekeeping.
+ * BTreeCursor_t{}  --A position in an in-order traversal.
+ * btree_next()     --Return the next entry of a traversal.
+ *
+ * Remarks:
+ * Entries are (key, value) pairs, kept in key order, so that
+ * inserting, removing and finding a key is O(log n), and traversing
+ * a range is O(log n) to find the start, then a walk along the
+ * leaves.  The nodes are wide (BTREE_ORDER keys), so the tree is
+ * shallow, and a node's keys are searched in a few cache lines.
+ *
+ * A tree created with a CompareProc stores key pointers (the keys
+ * themselves remain owned by the caller, and must not change while
+ * they're in the tree); a tree created without one stores long keys
+ * (e.g. a TimeNs), which are compared inline, and searched without
+ * branches.  The *_long() functions are for such trees.
+ *
+ * A tree is not thread-safe, and any change to it invalidates its
+ * cursors.
+ */
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <stddef.h>
+#include <apex/compare.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        BTREE_ORDER = 32               /* max. keys per node */
+    };
+
+    /*
+     * BTreeKey_t{} --A key: a pointer (with a CompareProc), or a long.
+     */
+    typedef union BTreeKey_t
+    {
+        const void *p;
+        long l;
+    } BTreeKey;
+
+    /*
+     * BTreeNode_t{} --A tree node: a leaf, or an internal node.
+     *
+     * Remarks:
+     * A leaf holds n_keys entries, and is linked to the next leaf.
+     * An internal node holds n_keys separators, and n_keys+1
+     * children: child[i] holds the keys >= key[i-1] and < key[i].
+     */
+    typedef struct BTreeNode_t
+    {
+        int n_keys;
+        int leaf;
+        struct BTreeNode_t *next;      /* (leaves) the next leaf */
+        BTreeKey key[BTREE_ORDER];
+        union
+        {
+            void *value[BTREE_ORDER];  /* (leaves) */
+            struct BTreeNode_t *child[BTREE_ORDER + 1];
+        };
+    } BTreeNode, *BTreeNodePtr;
+
+    /*
+     * BTree_t{} --The tree's root, and housekeeping.
+     */
+    typedef struct BTree_t
+    {
+        CompareProc cmp;               /* (NULL: long keys) */
+        BTreeNodePtr root;             /* (NULL: empty) */
+        BTreeNodePtr first;            /* the first (leftmost) leaf */
+        size_t n_items;
+        int height;                    /* No. of levels, incl. leaves */
+    } BTree, *BTreePtr;
+
+    /*
+     * BTreeCursor_t{} --A position in an in-order traversal.
+     */
+    typedef struct BTreeCursor_t
+    {
+        BTreeNodePtr leaf;             /* (NULL: finished) */
+        int slot;                      /* the next entry in leaf */
+    } BTreeCursor, *BTreeCursorPtr;
+
+    BTreePtr btree_new(CompareProc cmp);
+    void btree_free(BTreePtr tree);
+    void btree_clear(BTreePtr tree);
+
+    int btree_put(BTreePtr tree, const void *key, void *value, void **old);
+    void *btree_get(BTreePtr tree, const void *key);
+    void *btree_remove(BTreePtr tree, const void *key);
+    int btree_load(BTreePtr tree, const void *const *keys,
+                   void *const *values, size_t n);
+    void btree_seek(BTreeCursorPtr cursor, BTreePtr tree, const void *key);
+
+    int btree_put_long(BTreePtr tree, long key, void *value, void **old);
+    void *btree_get_long(BTreePtr tree, long key);
+    void *btree_remove_long(BTreePtr tree, long key);
+    int btree_load_long(BTreePtr tree, const long *keys,
+                        void *const *values, size_t n);
+    void btree_seek_long(BTreeCursorPtr cursor, BTreePtr tree, long key);
+
+    void btree_first(BTreeCursorPtr cursor, BTreePtr tree);
+
+    /*
+     * btree_next() --Return the next entry of a traversal.
+     *
+     * Parameters:
+     * cursor   --the cursor, positioned by btree_first() or btree_seek()
+     * key      --returns the entry's key (or NULL)
+     * value    --returns the entry's value (or NULL)
+     *
+     * Returns: (int)
+     * 1: an entry was returned; 0: the traversal is complete.
+     *
+     * Remarks:
+     * A range [lo, hi) of a tree of long keys is traversed by e.g.:
+     *
+     *     for (btree_seek_long(&c, tree, lo);
+     *          btree_next(&c, &key, &value) && key.l < hi;)
+     */
+    static inline int btree_next(BTreeCursorPtr cursor, BTreeKey * key,
+                                 void **value);
+    static inline int btree_next(BTreeCursorPtr cursor, BTreeKey * key,
+                                 void **value)
+    {
+        while (cursor->leaf != NULL && cursor->slot >= cursor->leaf->n_keys)
+        {
+            cursor->leaf = cursor->leaf->next;
+            cursor->slot = 0;
+        }
+        if (cursor->leaf == NULL)
+        {
+            return 0;
+        }
+        if (key != NULL)
+        {
+            *key = cursor->leaf->key[cursor->slot];
+        }
+        if (value != NULL)
+        {
+            *value = cursor->leaf->value[cursor->slot];
+        }
+        cursor->slot += 1;
+        return 1;
+    }
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* BTREE_H */
@@ -0,0 +1,360 @@
+/*
+ * CPOOL.C --A thread-safe pool allocator, with per-thread caches.
+ *
+ * Contents:
+ * cpool_init()         --Initialise a concurrent pool.
+ * cpool_new()          --Get a new item from the pool.
+ * cpool_delete()       --Return an item to the pool.
+ * cpool_cache_init()   --Initialise a thread's cache for a pool.
+ * cpool_cache_new()    --Get a new item, via the cache.
+ * cpool_cache_delete() --Return an item, via the cache.
+ * cpool_cache_flush()  --Return all of a cache's items to the pool.
+ *
+ * Remarks:
+ * Like Pool, items are taken from the caller's storage until it's
+ * used up, and deleted items are kept on an intrusive free list;
+ * here the free list is a lock-free stack (see CPool_t{}).
+ *
+ * cpool_new()/cpool_delete() use the shared stack directly, so any
+ * thread may delete any item with a single compare-and-swap.  A
+ * thread that allocates heavily should use a CPoolCache, which
+ * refills from the pool CPOOL_BATCH items at a time, and returns
+ * surplus items as a single chain, so most operations are local.
+ */
+#include <string.h>
+#include <apex/pool.h>
+
+#define CPOOL_BATCH 32                 /* items moved per cache refill/flush */
+
+#define TOP_INDEX(top) ((unsigned int) ((top) & 0xffffffffu))
+#define TOP_TAG(top) ((top) >> 32)
+#define TOP(tag, index) (((uint64_t) (tag) << 32) | (index))
+
+/*
+ * Item links: the first word of a free item is the index (+1) of its
+ * successor, on a cache's list or on the pool's stack (0 ends the
+ * list).  It's always accessed atomically, because pool_pop() may
+ * read it from an item that another thread has just popped, and is
+ * linking onto its cache.
+ */
+#define ITEM_NEXT_INDEX(item) (*(unsigned int *) (item))
+
+/*
+ * item_index() --Return the index (+1) of an item in the pool's storage.
+ */
+static inline unsigned int item_index(CPoolPtr pool, void *item)
+{
+    return (unsigned int) (((char *) item - pool->array.base)
+                           / pool->array.item_size) + 1;
+}
+
+/*
+ * item_addr() --Return the address of an item, given its index (+1).
+ */
+static inline void *item_addr(CPoolPtr pool, unsigned int index)
+{
+    return array_item(&pool->array, (int) index - 1);
+}
+
+/*
+ * cache_push() --Push an item onto a cache's list.
+ */
+static inline void cache_push(CPoolCachePtr cache, void *item)
+{
+    unsigned int next = cache->free != NULL
+        ? item_index(cache->pool, cache->free) : 0;
+
+    ATOMIC_STORE_RELAXED(&ITEM_NEXT_INDEX(item), next);
+    cache->free = item;
+    cache->n_free += 1;
+}
+
+/*
+ * cache_pop() --Pop an item from a cache's list (which isn't empty).
+ */
+static inline void *cache_pop(CPoolCachePtr cache)
+{
+    void *item = cache->free;
+    unsigned int next = ATOMIC_LOAD_RELAXED(&ITEM_NEXT_INDEX(item));
+
+    cache->free = next != 0 ? item_addr(cache->pool, next) : NULL;
+    cache->n_free -= 1;
+    return item;
+}
+
+/*
+ * pool_push_chain() --Push a chain of items onto the pool's free stack.
+ *
+ * Parameters:
+ * pool --the pool
+ * first    --the first item of the chain
+ * last     --the last item of the chain (linked by ITEM_NEXT_INDEX)
+ */
+static void pool_push_chain(CPoolPtr pool, void *first, void *last)
+{
+    uint64_t top = ATOMIC_LOAD_RELAXED(&pool->top);
+    unsigned int index = item_index(pool, first);
+
+    do
+    {
+        ATOMIC_STORE_RELAXED(&ITEM_NEXT_INDEX(last), TOP_INDEX(top));
+    } while (!ATOMIC_CAS(&pool->top, &top, TOP(TOP_TAG(top) + 1, index)));
+}
+
+/*
+ * pool_pop() --Pop an item from the pool's free stack.
+ *
+ * Remarks:
+ * The successor is read from an item that another thread may have
+ * popped (and be using) meanwhile; that's harmless, because the
+ * item is still within the pool's storage, and the changed tag
+ * makes the compare-and-swap fail.
+ */
+static void *pool_pop(CPoolPtr pool)
+{
+    uint64_t top = ATOMIC_LOAD_ACQUIRE(&pool->top);
+
+    while (TOP_INDEX(top) != 0)
+    {
+        void *item = item_addr(pool, TOP_INDEX(top));
+        unsigned int next = ATOMIC_LOAD_RELAXED(&ITEM_NEXT_INDEX(item));
+
+        if (ATOMIC_CAS(&pool->top, &top, TOP(TOP_TAG(top) + 1, next)))
+        {
+            return item;               /* success: popped item */
+        }
+    }
+    return NULL;                       /* failure: stack is empty */
+}
+
+/*
+ * pool_claim() --Claim up to n unused items from the pool's storage.
+ *
+ * Returns: (unsigned int)
+ * The number of items claimed (starting at *first).
+ */
+static unsigned int pool_claim(CPoolPtr pool, unsigned int n,
+                               unsigned int *first)
+{
+    unsigned int n_used = ATOMIC_LOAD_RELAXED(&pool->n_used);
+    unsigned int n_items = (unsigned int) pool->array.n_items;
+
+    do
+    {
+        if (n_used >= n_items)
+        {
+            return 0;                  /* failure: storage used up */
+        }
+        if (n > n_items - n_used)
+        {
+            n = n_items - n_used;
+        }
+    } while (!ATOMIC_CAS(&pool->n_used, &n_used, n_used + n));
+    *first = n_used;
+    return n;
+}
+
+/*
+ * cpool_init() --Initialise a concurrent pool.
+ *
+ * Parameters:
+ * pool --specifies and returns the initialised pool
+ * n_items --the number of pool items
+ * item_size --the size of each item
+ * base --the storage for the pool (size == n_items*item_size)
+ *
+ * Returns: (CPoolPtr)
+ * Success: the pool; Failure: NULL.
+ */
+CPoolPtr cpool_init(CPoolPtr pool, int n_items, int item_size, void *base)
+{
+    if (pool != NULL && base != NULL
+        && n_items > 0 && item_size >= (int) sizeof(void *))
+    {
+        memset((void *) pool, 0, sizeof(*pool));
+        array_init(&pool->array, n_items, item_size, base);
+        return pool;
+    }
+    return NULL;                       /* failure: assert? */
+}
+
+/*
+ * cpool_new() --Get a new item from the pool.
+ *
+ * Parameters:
+ * pool --the pool to allocate from
+ *
+ * Returns: (void *)
+ * Success: the newly allocated memory; Failure: NULL.
+ */
+void *cpool_new(CPoolPtr pool)
+{
+    void *item;
+    unsigned int first;
+
+    if (pool == NULL)
+    {
+        return NULL;                   /* failure: no pool! */
+    }
+    if ((item = pool_pop(pool)) != NULL)
+    {
+        return item;                   /* success: return from free list */
+    }
+    if (pool_claim(pool, 1, &first) != 0)
+    {
+        return array_item(&pool->array, (int) first);
+    }
+    return NULL;                       /* failure: the pool is empty! */
+}
+
+/*
+ * cpool_delete() --Return an item to the pool.
+ *
+ * Parameters:
+ * pool --the pool
+ * item --the item to delete
+ *
+ * Remarks:
+ * This may be called by any thread, for any item from the pool.
+ */
+void cpool_delete(CPoolPtr pool, void *item)
+{
+    if (pool != NULL && item != NULL)
+    {
+        pool_push_chain(pool, item, item);
+    }
+}
+
+/*
+ * cpool_cache_init() --Initialise a thread's cache for a pool.
+ *
+ * Parameters:
+ * cache    --specifies and returns the initialised cache
+ * pool --the pool
+ *
+ * Returns: (CPoolCachePtr)
+ * Success: the cache; Failure: NULL.
+ */
+CPoolCachePtr cpool_cache_init(CPoolCachePtr cache, CPoolPtr pool)
+{
+    if (cache == NULL || pool == NULL)
+    {
+        return NULL;                   /* failure: no cache/pool! */
+    }
+    cache->pool = pool;
+    cache->free = NULL;
+    cache->n_free = 0;
+    return cache;
+}
+
+/*
+ * cache_refill() --Move a batch of items from the pool to the cache.
+ *
+ * Remarks:
+ * Unused storage is claimed with a single atomic operation; after
+ * that, items are popped from the pool's free stack.
+ */
+static void cache_refill(CPoolCachePtr cache)
+{
+    CPoolPtr pool = cache->pool;
+    unsigned int first;
+    unsigned int n = pool_claim(pool, CPOOL_BATCH, &first);
+    void *item;
+
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        cache_push(cache, array_item(&pool->array, (int) (first + i)));
+    }
+    while (cache->n_free < CPOOL_BATCH && (item = pool_pop(pool)) != NULL)
+    {
+        cache_push(cache, item);
+    }
+}
+
+/*
+ * cache_spill() --Return up to n items from the cache to the pool.
+ *
+ * Remarks:
+ * The cache's items are already linked by index, so the first n are
+ * pushed as one chain.
+ */
+static void cache_spill(CPoolCachePtr cache, int n)
+{
+    void *first = cache->free;
+    void *last = first;
+
+    if (first == NULL)
+    {
+        return;                        /* (nothing to spill) */
+    }
+    cache_pop(cache);
+    for (int i = 1; i < n && cache->free != NULL; ++i)
+    {
+        last = cache_pop(cache);
+    }
+    pool_push_chain(cache->pool, first, last);
+}
+
+/*
+ * cpool_cache_new() --Get a new item, via the cache.
+ *
+ * Parameters:
+ * cache    --the (calling thread's) cache
+ *
+ * Returns: (void *)
+ * Success: the newly allocated memory; Failure: NULL.
+ */
+void *cpool_cache_new(CPoolCachePtr cache)
+{
+    if (cache == NULL)
+    {
+        return NULL;                   /* failure: no cache! */
+    }
+    if (cache->free == NULL)
+    {
+        cache_refill(cache);
+        if (cache->free == NULL)
+        {
+            return NULL;               /* failure: the pool is empty! */
+        }
+    }
+    return cache_pop(cache);
+}
+
+/*
+ * cpool_cache_delete() --Return an item, via the cache.
+ *
+ * Parameters:
+ * cache    --the (calling thread's) cache
+ * item --the item to delete (from any thread's cache, or the pool)
+ *
+ * Remarks:
+ * When the cache holds more than two batches, a batch is returned
+ * to the pool.
+ */
+void cpool_cache_delete(CPoolCachePtr cache, void *item)
+{
+    if (cache != NULL && item != NULL)
+    {
+        cache_push(cache, item);
+        if (cache->n_free > 2 * CPOOL_BATCH)
+        {
+            cache_spill(cache, CPOOL_BATCH);
+        }
+    }
+}
+
+/*
+ * cpool_cache_flush() --Return all of a cache's items to the pool.
+ *
+ * Remarks:
+ * This should be called before a thread exits, or its cached items
+ * are lost to the pool.
+ */
+void cpool_cache_flush(CPoolCachePtr cache)
+{
+    if (cache != NULL)
+    {
+        cache_spill(cache, cache->n_free);
+    }
+}
@@ -0,0 +1,181 @@
+/*
+ * GROW-QUEUE.C --An unbounded queue built from a chain of atomic queues.
+ *
+ * Contents:
+ * segment_new()       --Allocate a segment, and its storage.
+ * grow_queue_init()   --Initialise an unbounded queue.
+ * grow_queue_free()   --Free all the segments of a queue.
+ * grow_queue_push()   --Push an item onto the queue.
+ * grow_queue_pop()    --Pop an item from the queue.
+ *
+ * Remarks:
+ * While the tail segment has room, grow_queue_push() is just
+ * queue_push() (and grow_queue_pop() is queue_pop() while the head
+ * segment has items).  The producer publishes a new segment via the
+ * old tail's next pointer, after which it never touches the old
+ * segment again; so once the consumer has seen a successor, and
+ * found the segment empty, it can free it.
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apex/queue.h>
+
+#define SEGMENT_HEADER \
+    ((sizeof(QueueSegment) + CACHE_LINE - 1) & ~(size_t) (CACHE_LINE - 1))
+
+/*
+ * segment_new() --Allocate a segment, and its storage.
+ *
+ * Parameters:
+ * n_items  --the number of items (a power of 2)
+ * item_size    --the size of each item
+ *
+ * Returns: (QueueSegmentPtr)
+ * Success: the new segment; Failure: NULL.
+ *
+ * Remarks:
+ * The segment header and its items are allocated as one block.
+ */
+static QueueSegmentPtr segment_new(int n_items, int item_size)
+{
+    QueueSegmentPtr segment =
+        malloc(SEGMENT_HEADER + (size_t) n_items * item_size);
+
+    if (segment != NULL)
+    {
+        segment->next = NULL;
+        queue_init(&segment->queue, n_items, item_size,
+                   (char *) segment + SEGMENT_HEADER);
+    }
+    return segment;
+}
+
+/*
+ * grow_queue_init() --Initialise an unbounded queue.
+ *
+ * Parameters:
+ * queue    --The queue to be initialised (owned by caller).
+ * n_items  --The size of the first segment (must be a power of 2)
+ * item_size    --The size of the queue items.
+ *
+ * Returns:
+ * Success: queue; Failure: NULL.
+ */
+GrowQueuePtr grow_queue_init(GrowQueuePtr queue, int n_items, int item_size)
+{
+    int mask;
+
+    if (queue == NULL || n_items <= 0 || item_size <= 0
+        || !queue_mask(n_items, &mask))
+    {
+        return NULL;                   /* failure: no queue, bad size */
+    }
+    memset((void *) queue, 0, sizeof(*queue));
+    queue->n_items = n_items;
+    queue->item_size = item_size;
+    if ((queue->head = queue->tail = segment_new(n_items, item_size)) == NULL)
+    {
+        return NULL;                   /* failure: no memory */
+    }
+    queue->n_segment = 1;
+    return queue;                      /* success: queue is initialised */
+}
+
+/*
+ * grow_queue_free() --Free all the segments of a queue.
+ *
+ * Remarks:
+ * Any items remaining in the queue are discarded.
+ */
+void grow_queue_free(GrowQueuePtr queue)
+{
+    if (queue != NULL)
+    {
+        QueueSegmentPtr next;
+
+        for (QueueSegmentPtr s = queue->head; s != NULL; s = next)
+        {
+            next = s->next;
+            free(s);
+        }
+        queue->head = queue->tail = NULL;
+    }
+}
+
+/*
+ * grow_queue_push() --Push an item onto the queue.
+ *
+ * Parameters:
+ * queue --the queue to receive the item
+ * item --the queue item to insert
+ *
+ * Returns:
+ * Success: 1; Failure: 0 (no memory for a new segment).
+ */
+int grow_queue_push(GrowQueuePtr queue, const void *item)
+{
+    QueueSegmentPtr segment;
+    int n_items;
+
+    if (queue == NULL || item == NULL)
+    {
+        return 0;                      /* failure: no queue, or no item! */
+    }
+    if (queue_push(&queue->tail->queue, item))
+    {
+        return 1;                      /* success: (the fast path) */
+    }
+    n_items = queue->tail->queue.array.n_items;
+    if (n_items <= INT_MAX / 2)
+    {
+        n_items *= 2;
+    }
+    if ((segment = segment_new(n_items, queue->item_size)) == NULL)
+    {
+        return 0;                      /* failure: no memory */
+    }
+    queue_push(&segment->queue, item);
+    ATOMIC_STORE_RELEASE(&queue->tail->next, segment);
+    queue->tail = segment;
+    queue->n_segment += 1;
+    return 1;                          /* success: pushed to new segment */
+}
+
+/*
+ * grow_queue_pop() --Pop an item from the queue.
+ *
+ * Parameters:
+ * queue --the queue to read from
+ * item --returns the item
+ *
+ * Returns:
+ * Success: 1; Failure: 0 (the queue is empty).
+ */
+int grow_queue_pop(GrowQueuePtr queue, void *item)
+{
+    if (queue == NULL || item == NULL)
+    {
+        return 0;                      /* failure: no queue, or no item! */
+    }
+    for (;;)
+    {
+        QueueSegmentPtr head = queue->head;
+        QueueSegmentPtr next;
+
+        if (queue_pop(&head->queue, item))
+        {
+            return 1;                  /* success: (the fast path) */
+        }
+        if ((next = ATOMIC_LOAD_ACQUIRE(&head->next)) == NULL)
+        {
+            return 0;                  /* failure: queue is empty */
+        }
+        if (queue_pop(&head->queue, item))
+        {                              /* (pushed before next was linked) */
+            return 1;
+        }
+        queue->head = next;            /* head is drained, and retired */
+        free(head);
+    }
+}
@@ -4,6 +4,7 @@
  * Contents:
  * heap_sift_up()   --Sift a value from the bottom of the heap to the top.
  * heap_sift_down() --Sift a value from the top to its "correct" position.
+ * heap_make()      --Re-arrange an array of items into a heap.
  * heap_ok()        --Check the heap condition.
  *
  * Remarks:
@@ -14,12 +15,20 @@
  * array.  An array implementation is possible because binary-tree
  * heaps are inherently "balanced" (maybe "full-ish" is a better term
  * here), so there are no "holes" in the tree.
+ *
+ * The sifts don't swap items at each level: the item being sifted is
+ * saved, each parent (child) is copied into the "hole" it leaves, and
+ * the item is stored once at its final slot.  That's one copy per
+ * level, rather than the three of a swap.  Items bigger than
+ * SIFT_MAX_ITEM bytes (which can't be saved on the stack) are swapped.
  */
 
 #include <string.h>
 #include <apex/heap.h>
 #include <apex/estring.h>               /* for memswap() */
 
+#define SIFT_MAX_ITEM 256              /* larger items are swapped */
+
 /*
  * heap_sift_up() --Sift a value from the bottom of the heap to the top.
  *
@@ -37,16 +46,42 @@
  */
 void heap_sift_up(void *heap, int n_items, int item_size, CompareProc cmp)
 {
-    for (int i = n_items - 1; i > 0; i = (i - 1) / 2)
-    {
-        char *node = (char *) heap + i * item_size;
-        char *parent = (char *) heap + (i - 1) / 2 * item_size;
+    char *base = (char *) heap;
+    char item[SIFT_MAX_ITEM];
+    int i = n_items - 1;
 
-        if (cmp(node, parent) < 0)
+    if (item_size > SIFT_MAX_ITEM)
+    {
+        for (; i > 0; i = (i - 1) / 2)
         {
+            char *node = base + i * item_size;
+            char *parent = base + (i - 1) / 2 * item_size;
+
+            if (cmp(node, parent) >= 0)
+            {
+                break;                 /* heap condition is restored */
+            }
             memswap(parent, node, (size_t) item_size);
         }
+        return;
+    }
+    if (i <= 0 || cmp(base + i * item_size,
+                      base + (i - 1) / 2 * item_size) >= 0)
+    {
+        return;                        /* no change: avoid the copy */
+    }
+    memcpy(item, base + i * item_size, (size_t) item_size);
+    for (; i > 0; i = (i - 1) / 2)
+    {
+        char *parent = base + (i - 1) / 2 * item_size;
+
+        if (cmp(item, parent) >= 0)
+        {
+            break;                     /* heap condition is restored */
+        }
+        memcpy(base + i * item_size, parent, (size_t) item_size);
     }
+    memcpy(base + i * item_size, item, (size_t) item_size);
 }
 
 /*
@@ -64,37 +99,71 @@ void heap_sift_up(void *heap, int n_items, int item_size, CompareProc cmp)
  * the heap by 1. The sift-down re-creates the heap condition by
  * pushing the root down to the child slots.
  */
-void heap_sift_down(void *heap, int slot, int n_items, int item_size, CompareProc cmp)
+void heap_sift_down(void *heap, int slot, int n_items, int item_size,
+                    CompareProc cmp)
 {
-    int level = 1;
-    char *node, *child, *end;
-
-    for (int id = slot; id > 0; id /= 2)
-    {                                   /* find tree level of the item */
-        level *= 2;
-    }
+    char *base = (char *) heap;
+    char buf[SIFT_MAX_ITEM];
+    char *item = base + slot * item_size;      /* (until it's moved) */
+    int moved = 0;
 
-    node = (char *) heap + slot * item_size;
-    end = (char *) heap + n_items * item_size;
-    for (; node < end; node = child, level *= 2)
-    {
-        child = (char *) node + level * item_size;  /* left child */
-        if (child >= end)
+    for (int child = 2 * slot + 1; child < n_items; child = 2 * slot + 1)
+    {                                  /* (left child) */
+        if (child + 1 < n_items
+            && cmp(base + child * item_size,
+                   base + (child + 1) * item_size) > 0)
+        {                              /* choose smallest child */
+            child += 1;
+        }
+        if (cmp(base + child * item_size, item) >= 0)
         {
             break;
         }
-
-        char *alt_child = child + item_size;    /* right child */
-
-        if (alt_child < end && cmp(child, alt_child) > 0)
-        {                              /* choose smallest child */
-            child = alt_child;
+        if (item_size > SIFT_MAX_ITEM)
+        {
+            memswap(base + slot * item_size, base + child * item_size,
+                    (size_t) item_size);
+            item = base + child * item_size;
         }
-        if (cmp(child, node) > 0)
+        else
         {
-            break;
+            if (!moved)
+            {                          /* save the item, leaving a hole */
+                item = memcpy(buf, item, (size_t) item_size);
+                moved = 1;
+            }
+            memcpy(base + slot * item_size, base + child * item_size,
+                   (size_t) item_size);
         }
-        memswap(node, child, (size_t) item_size);
+        slot = child;
+    }
+    if (moved)
+    {
+        memcpy(base + slot * item_size, item, (size_t) item_size);
+    }
+}
+
+/*
+ * heap_make() --Re-arrange an array of items into a heap.
+ *
+ * Parameters:
+ * heap --specifies the heap array
+ * n_items  --No. items in the heap
+ * item_size    --size of each item
+ * cmp  --comparison function
+ *
+ * Remarks:
+ * This is Floyd's bottom-up heap construction: each subtree is
+ * sifted down, starting from the last parent and working towards
+ * the root.  Most nodes are near the bottom and sift only a little
+ * way, so the whole process is O(n), rather than the O(n log n) of
+ * n insertions.
+ */
+void heap_make(void *heap, int n_items, int item_size, CompareProc cmp)
+{
+    for (int slot = n_items / 2 - 1; slot >= 0; --slot)
+    {
+        heap_sift_down(heap, slot, n_items, item_size, cmp);
     }
 }
 
@@ -0,0 +1,175 @@
+/*
+ * HEAP-TYPED.H --Typed, inline heaps generated by a macro.
+ *
+ * Contents:
+ * HEAP_DEFINE()      --Define a (binary) heap type, and its operations.
+ * HEAP_DEFINE_DARY() --Define a heap type with a specified arity.
+ *
+ * Remarks:
+ * The generic Heap (heap.h) calls a CompareProc through a pointer
+ * for every comparison, and swaps items with memswap() at every
+ * level.  A heap defined by HEAP_DEFINE() knows its item type and
+ * ordering at compile time, so the comparisons can be inlined, and
+ * it sifts a "hole" rather than swapping: the moving item is held in
+ * a local, the items it passes are each moved once, and it's stored
+ * once at its final slot.
+ *
+ * e.g.
+ *     static inline int timer_before(const Timer *a, const Timer *b)
+ *     {
+ *         return tv_cmp(&a->when, &b->when) < 0;
+ *     }
+ *     HEAP_DEFINE(TimerHeap, Timer, timer_before)
+ *
+ * defines the type TimerHeap, and TimerHeap_init(), TimerHeap_push(),
+ * TimerHeap_pop(), TimerHeap_peek(), TimerHeap_delete(),
+ * TimerHeap_sift_up() and TimerHeap_sift_down().  The "before"
+ * function (or macro) is called with two item pointers, and returns
+ * true if the first item belongs nearer the top of the heap.  push(),
+ * pop() and delete() return 1 on success, and 0 if the heap is full,
+ * empty, or (for delete()) the slot isn't in use.
+ *
+ * HEAP_DEFINE_DARY() defines a d-ary heap, where each node has
+ * "arity" children.  The tree is shallower (log_d n levels), and a
+ * node's children are adjacent, so sifting down touches fewer cache
+ * lines in a large heap, at the cost of more comparisons per level.
+ * The children of node i are d*i+1...d*i+d, so to keep each family
+ * on one cache line, item[1] should be aligned on a cache line, and
+ * arity*sizeof(item) should be the cache line size (e.g. arity 4 for
+ * 16 byte items, or 8 for 8 byte items).
+ */
+#ifndef HEAP_TYPED_H
+#define HEAP_TYPED_H
+
+#include <stddef.h>
+
+#define HEAP_DEFINE(name_, type_, before_) \
+    HEAP_DEFINE_DARY(name_, type_, before_, 2)
+
+#define HEAP_DEFINE_DARY(name_, type_, before_, arity_)                 \
+    typedef struct name_##_t                                            \
+    {                                                                   \
+        type_ *item;                   /* heap storage */               \
+        int n_items;                   /* capacity of storage */        \
+        int n_used;                    /* current size of heap */       \
+    } name_;                                                            \
+                                                                        \
+    static inline name_ *name_##_init(name_ *heap, int n_items,         \
+                                      type_ *items)                     \
+    {                                                                   \
+        if (heap == NULL || items == NULL)                              \
+        {                                                               \
+            return NULL;                                                \
+        }                                                               \
+        heap->item = items;                                             \
+        heap->n_items = n_items;                                        \
+        heap->n_used = 0;                                               \
+        return heap;                                                    \
+    }                                                                   \
+                                                                        \
+    static inline void name_##_sift_up(type_ *item, int slot)           \
+    {                                                                   \
+        type_ value = item[slot];                                       \
+                                                                        \
+        while (slot > 0)                                                \
+        {                                                               \
+            int parent = (slot - 1) / (arity_);                         \
+                                                                        \
+            if (!before_(&value, &item[parent]))                        \
+            {                                                           \
+                break;                                                  \
+            }                                                           \
+            item[slot] = item[parent];                                  \
+            slot = parent;                                              \
+        }                                                               \
+        item[slot] = value;                                             \
+    }                                                                   \
+                                                                        \
+    static inline void name_##_sift_down(type_ *item, int slot, int n)  \
+    {                                                                   \
+        type_ value = item[slot];                                       \
+                                                                        \
+        for (;;)                                                        \
+        {                                                               \
+            int child = (arity_) * slot + 1;                            \
+            int last = child + (arity_) < n ? child + (arity_) : n;     \
+                                                                        \
+            if (child >= n)                                             \
+            {                                                           \
+                break;                                                  \
+            }                                                           \
+            for (int c = child + 1; c < last; ++c)                      \
+            {                                                           \
+                if (before_(&item[c], &item[child]))                    \
+                {                                                       \
+                    child = c;                                          \
+                }                                                       \
+            }                                                           \
+            if (!before_(&item[child], &value))                         \
+            {                                                           \
+                break;                                                  \
+            }                                                           \
+            item[slot] = item[child];                                   \
+            slot = child;                                               \
+        }                                                               \
+        item[slot] = value;                                             \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_push(name_ *heap, const type_ *value)     \
+    {                                                                   \
+        if (heap->n_used >= heap->n_items)                              \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        heap->item[heap->n_used] = *value;                              \
+        name_##_sift_up(heap->item, heap->n_used++);                    \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline type_ *name_##_peek(name_ *heap)                      \
+    {                                                                   \
+        return heap->n_used > 0 ? &heap->item[0] : NULL;                \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_pop(name_ *heap, type_ *value)            \
+    {                                                                   \
+        if (heap->n_used <= 0)                                          \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        if (value != NULL)                                              \
+        {                                                               \
+            *value = heap->item[0];                                     \
+        }                                                               \
+        if (--heap->n_used > 0)                                         \
+        {                                                               \
+            heap->item[0] = heap->item[heap->n_used];                   \
+            name_##_sift_down(heap->item, 0, heap->n_used);             \
+        }                                                               \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_delete(name_ *heap, int slot)             \
+    {                                                                   \
+        if (slot < 0 || slot >= heap->n_used)                           \
+        {                                                               \
+            return 0;                  /* (includes an empty heap) */   \
+        }                                                               \
+        if (--heap->n_used > slot)                                      \
+        {                                                               \
+            heap->item[slot] = heap->item[heap->n_used];                \
+            if (slot > 0                                                \
+                && before_(&heap->item[slot],                           \
+                           &heap->item[(slot - 1) / (arity_)]))         \
+            {                                                           \
+                name_##_sift_up(heap->item, slot);                      \
+            }                                                           \
+            else                                                        \
+            {                                                           \
+                name_##_sift_down(heap->item, slot, heap->n_used);      \
+            }                                                           \
+        }                                                               \
+        return 1;                                                       \
+    }
+
+#endif /* HEAP_TYPED_H */
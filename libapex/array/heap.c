@@ -8,6 +8,8 @@
  * heap_pop()    --Remove an item from the top of the heap.
  * heap_peek()   --Peek at the top item in the heap.
  * heap_delete() --Delete an item from the heap.
+ * heap_build()  --Make a heap from the items already in its storage.
+ * heap_push_n() --Insert several items into the heap.
  */
 #include <memory.h>
 #include <apex/heap.h>
@@ -148,3 +150,77 @@ void heap_delete(HeapPtr heap, int slot)
     heap_sift_down(heap->array.base, slot,
                    heap->n_used, heap->array.item_size, heap->cmp);
 }
+
+/*
+ * heap_build() --Make a heap from the items already in its storage.
+ *
+ * Parameters:
+ * heap --the heap
+ * n_used --the number of items in the heap's storage
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * Any previous contents are replaced by the first n_used items of
+ * the heap's storage, which are heapified in O(n) (see heap_make()).
+ */
+int heap_build(HeapPtr heap, int n_used)
+{
+    if (heap == NULL || n_used < 0 || n_used > heap->array.n_items)
+    {
+        return 0;                      /* failure: no heap, or overflow */
+    }
+    heap->n_used = n_used;
+    heap_make(heap->array.base, heap->n_used, heap->array.item_size,
+              heap->cmp);
+    return 1;                          /* success */
+}
+
+/*
+ * heap_push_n() --Insert several items into the heap.
+ *
+ * Parameters:
+ * heap --the heap
+ * items --the (contiguous array of) items to insert
+ * n_items --the number of items to insert
+ *
+ * Returns: (int)
+ * The number of items inserted (less than n_items if the heap fills).
+ *
+ * Remarks:
+ * If the new items are at least as many as the existing ones, it's
+ * cheaper to append them all and re-heapify the lot than to sift
+ * each one up.
+ */
+int heap_push_n(HeapPtr heap, const void *items, int n_items)
+{
+    int n_used;
+    int item_size;
+
+    if (heap == NULL || items == NULL || n_items <= 0)
+    {
+        return 0;                      /* failure: no heap, or no items */
+    }
+    n_used = heap->n_used;
+    item_size = heap->array.item_size;
+    if (n_items > heap->array.n_items - n_used)
+    {
+        n_items = heap->array.n_items - n_used;
+    }
+    memcpy(array_item(&heap->array, n_used), items,
+           (size_t) n_items * item_size);
+    if (n_items >= n_used)
+    {
+        heap_build(heap, n_used + n_items);
+    }
+    else
+    {
+        for (int i = 1; i <= n_items; ++i)
+        {
+            heap_sift_up(heap->array.base, n_used + i, item_size, heap->cmp);
+        }
+        heap->n_used = n_used + n_items;
+    }
+    return n_items;
+}
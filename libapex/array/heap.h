@@ -1,5 +1,9 @@
 /*
  * HEAP.H --An implicit (array) heap.
+ *
+ * Contents:
+ * Heap_t{}        --A heap of fixed-size items.
+ * IndexedHeap_t{} --A heap of items that are referred to by handles.
  */
 #ifndef HEAP_H
 #define HEAP_H
@@ -18,6 +22,27 @@ extern "C"
         CompareProc cmp;               /* heap item comparison function */
     } Heap, *HeapPtr;
 
+    /*
+     * IndexedHeap_t{} --A heap of items that are referred to by handles.
+     *
+     * Remarks:
+     * Items stay put in the item array (a handle is simply an item's
+     * index), and the heap itself is an array of handles.  slot[]
+     * maps each handle to its position in heap[], and is updated as
+     * handles are sifted, so that an item can be re-positioned or
+     * removed without searching for it.  The slot of a free handle is
+     * negative, and encodes the (free list) next free handle.
+     */
+    typedef struct IndexedHeap_t
+    {
+        ArrayContainer array;          /* items, indexed by handle */
+        int *heap;                     /* handles, in heap order */
+        int *slot;                     /* handle => slot in heap[] */
+        int n_used;                    /* current size of heap */
+        int free;                      /* first free handle, or -1 */
+        CompareProc cmp;               /* heap item comparison function */
+    } IndexedHeap, *IndexedHeapPtr;
+
     HeapPtr heap_alloc(void);
     HeapPtr heap_init(HeapPtr heap, CompareProc cmp, int n_items,
                       int item_size, void *items);
@@ -26,12 +51,26 @@ extern "C"
     int heap_pop(HeapPtr heap, void *item);
     void *heap_peek(HeapPtr heap, void *item);
     void heap_delete(HeapPtr heap, int slot);
+    int heap_build(HeapPtr heap, int n_used);
+    int heap_push_n(HeapPtr heap, const void *items, int n_items);
+
+    IndexedHeapPtr iheap_init(IndexedHeapPtr heap, CompareProc cmp,
+                              int n_items, int item_size, void *items,
+                              int *index);
+    int iheap_push(IndexedHeapPtr heap, const void *item);
+    int iheap_pop(IndexedHeapPtr heap, void *item);
+    int iheap_peek(IndexedHeapPtr heap);
+    void *iheap_item(IndexedHeapPtr heap, int handle);
+    int iheap_update(IndexedHeapPtr heap, int handle);
+    int iheap_remove(IndexedHeapPtr heap, int handle);
 
     /*
      * Convenience functions for malloc and item-size aware initialisation.
      */
 #define new_heap(cmp, items) init_heap(heap_alloc(), cmp, items)
 #define init_heap(heap, cmp, items) heap_init(heap, cmp, NEL(items), sizeof(items[0]), items)
+#define init_iheap(heap, cmp, items, index) \
+    iheap_init(heap, cmp, NEL(items), sizeof(items[0]), items, index)
 
     /*
      * low-level heap operations.
@@ -41,6 +80,7 @@ extern "C"
                       CompareProc cmp);
     void heap_sift_down(void *heap, int slot, int n_items, int item_size,
                         CompareProc cmp);
+    void heap_make(void *heap, int n_items, int item_size, CompareProc cmp);
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
@@ -0,0 +1,255 @@
+/*
+ * IHEAP.C --An indexed heap, supporting update and removal by handle.
+ *
+ * Contents:
+ * iheap_init()   --Initialise an indexed heap.
+ * iheap_push()   --Insert an item into the heap.
+ * iheap_pop()    --Remove the item at the top of the heap.
+ * iheap_peek()   --Return the handle of the top item in the heap.
+ * iheap_item()   --Return the address of an item, by handle.
+ * iheap_update() --Re-position an item after its key has changed.
+ * iheap_remove() --Remove an item from the heap, by handle.
+ *
+ * Remarks:
+ * This is intended for timers and schedulers, where an item is
+ * scheduled (iheap_push()), and may later be rescheduled (by changing
+ * its key, then iheap_update()) or cancelled (iheap_remove()), each
+ * in O(log n).  The handles are sifted (using a "hole", so each
+ * handle moves once) rather than the items, so items of any size are
+ * cheap to re-order, and their addresses are stable.
+ */
+#include <memory.h>
+#include <apex/heap.h>
+
+#define HEAP_ITEM(heap_, slot_) \
+    array_item(&(heap_)->array, (heap_)->heap[slot_])
+#define FREE_NEXT(slot_) (-2 - (slot_))        /* (encode/decode) */
+
+/*
+ * sift_up() --Move a handle up the heap, towards the root.
+ *
+ * Returns: (int)
+ * The final slot of the handle.
+ */
+static int sift_up(IndexedHeapPtr heap, int slot)
+{
+    int handle = heap->heap[slot];
+    void *item = array_item(&heap->array, handle);
+
+    while (slot > 0)
+    {
+        int parent = (slot - 1) / 2;
+
+        if (heap->cmp(item, HEAP_ITEM(heap, parent)) >= 0)
+        {
+            break;
+        }
+        heap->heap[slot] = heap->heap[parent];
+        heap->slot[heap->heap[slot]] = slot;
+        slot = parent;
+    }
+    heap->heap[slot] = handle;
+    heap->slot[handle] = slot;
+    return slot;
+}
+
+/*
+ * sift_down() --Move a handle down the heap, towards the leaves.
+ */
+static void sift_down(IndexedHeapPtr heap, int slot)
+{
+    int handle = heap->heap[slot];
+    void *item = array_item(&heap->array, handle);
+
+    for (int child = 2 * slot + 1; child < heap->n_used;
+         child = 2 * slot + 1)
+    {
+        if (child + 1 < heap->n_used
+            && heap->cmp(HEAP_ITEM(heap, child + 1),
+                         HEAP_ITEM(heap, child)) < 0)
+        {                              /* choose smallest child */
+            child += 1;
+        }
+        if (heap->cmp(HEAP_ITEM(heap, child), item) >= 0)
+        {
+            break;
+        }
+        heap->heap[slot] = heap->heap[child];
+        heap->slot[heap->heap[slot]] = slot;
+        slot = child;
+    }
+    heap->heap[slot] = handle;
+    heap->slot[handle] = slot;
+}
+
+/*
+ * iheap_init() --Initialise an indexed heap.
+ *
+ * Parameters:
+ * heap --specifies and returns the initialised heap
+ * cmp --item comparison function
+ * n_items --the number of heap items
+ * item_size --the size of each item
+ * items --the storage for the items (n_items*item_size)
+ * index --the storage for the heap's index (2*n_items ints)
+ *
+ * Returns: (IndexedHeapPtr)
+ * Success: The heap; Failure: NULL.
+ */
+IndexedHeapPtr iheap_init(IndexedHeapPtr heap, CompareProc cmp,
+                          int n_items, int item_size, void *items,
+                          int *index)
+{
+    if (heap == NULL || cmp == NULL || items == NULL || index == NULL
+        || n_items <= 0)
+    {
+        return NULL;                   /* failure: bad args */
+    }
+    array_init(&heap->array, n_items, item_size, items);
+    heap->heap = index;
+    heap->slot = index + n_items;
+    heap->n_used = 0;
+    heap->cmp = cmp;
+    for (int i = 0; i < n_items; ++i)
+    {                                  /* all handles are free */
+        heap->slot[i] = FREE_NEXT(i + 1 < n_items ? i + 1 : -1);
+    }
+    heap->free = 0;
+    return heap;
+}
+
+/*
+ * iheap_push() --Insert an item into the heap.
+ *
+ * Parameters:
+ * heap --the heap
+ * item --the item to insert (copied into the heap's item storage)
+ *
+ * Returns: (int)
+ * Success: the item's handle; Failure: -1 (the heap is full).
+ */
+int iheap_push(IndexedHeapPtr heap, const void *item)
+{
+    int handle;
+
+    if (heap == NULL || heap->free < 0)
+    {
+        return -1;                     /* failure: no heap, or overflow */
+    }
+    handle = heap->free;
+    heap->free = FREE_NEXT(heap->slot[handle]);
+    memcpy(array_item(&heap->array, handle), item, heap->array.item_size);
+    heap->heap[heap->n_used] = handle;
+    sift_up(heap, heap->n_used++);
+    return handle;                     /* success */
+}
+
+/*
+ * iheap_peek() --Return the handle of the top item in the heap.
+ *
+ * Returns: (int)
+ * Success: the handle; Failure: -1 (the heap is empty).
+ */
+int iheap_peek(IndexedHeapPtr heap)
+{
+    return heap != NULL && heap->n_used > 0 ? heap->heap[0] : -1;
+}
+
+/*
+ * iheap_item() --Return the address of an item, by handle.
+ *
+ * Remarks:
+ * The item's key may be changed in place, provided that
+ * iheap_update() is called afterwards.
+ */
+void *iheap_item(IndexedHeapPtr heap, int handle)
+{
+    return array_item(&heap->array, handle);
+}
+
+/*
+ * iheap_remove() --Remove an item from the heap, by handle.
+ *
+ * Parameters:
+ * heap --the heap
+ * handle --the item's handle (as returned by iheap_push())
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the handle isn't in the heap).
+ *
+ * Remarks:
+ * The handle is freed, and may be returned by a later iheap_push().
+ */
+int iheap_remove(IndexedHeapPtr heap, int handle)
+{
+    int slot;
+
+    if (heap == NULL || handle < 0 || handle >= heap->array.n_items
+        || (slot = heap->slot[handle]) < 0)
+    {
+        return 0;                      /* failure: not a valid handle */
+    }
+    heap->slot[handle] = FREE_NEXT(heap->free);
+    heap->free = handle;
+    if (--heap->n_used > slot)
+    {                                  /* move last handle into the gap */
+        heap->heap[slot] = heap->heap[heap->n_used];
+        if (sift_up(heap, slot) == slot)
+        {
+            sift_down(heap, slot);
+        }
+    }
+    return 1;                          /* success */
+}
+
+/*
+ * iheap_pop() --Remove the item at the top of the heap.
+ *
+ * Parameters:
+ * heap --the heap
+ * item --returns a copy of the removed item (or NULL)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the heap is empty).
+ */
+int iheap_pop(IndexedHeapPtr heap, void *item)
+{
+    int handle = iheap_peek(heap);
+
+    if (handle < 0)
+    {
+        return 0;                      /* failure: no heap, or underflow */
+    }
+    if (item != NULL)
+    {
+        memcpy(item, array_item(&heap->array, handle),
+               heap->array.item_size);
+    }
+    return iheap_remove(heap, handle);
+}
+
+/*
+ * iheap_update() --Re-position an item after its key has changed.
+ *
+ * Parameters:
+ * heap --the heap
+ * handle --the item's handle
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the handle isn't in the heap).
+ */
+int iheap_update(IndexedHeapPtr heap, int handle)
+{
+    int slot;
+
+    if (heap == NULL || handle < 0 || handle >= heap->array.n_items
+        || (slot = heap->slot[handle]) < 0)
+    {
+        return 0;                      /* failure: not a valid handle */
+    }
+    if (sift_up(heap, slot) == slot)
+    {
+        sift_down(heap, slot);
+    }
+    return 1;                          /* success */
+}
@@ -0,0 +1,183 @@
+/*
+ * LOWER-BOUND.C --Branch-free searches of sorted int/long/double arrays.
+ *
+ * Contents:
+ * lower_bound_int()    --Find the first element >= key, in an int array.
+ * lower_bound_long()   --Find the first element >= key, in a long array.
+ * lower_bound_double() --Find the first element >= key, in a double array.
+ * eytzinger_build()    --Copy a sorted array into Eytzinger (BFS) order.
+ * eytzinger_int()      --Find the first element >= key, in an int tree.
+ * eytzinger_long()     --Find the first element >= key, in a long tree.
+ * eytzinger_double()   --Find the first element >= key, in a double tree.
+ *
+ * Remarks:
+ * binsearch() stops as soon as it finds the key, so each step is a
+ * three-way, unpredictable branch through a function pointer.  These
+ * searches always run log2(n) steps, and each step is a compare and a
+ * conditional move, which the CPU doesn't need to predict.  For large
+ * arrays they prefetch the next step's candidates, overlapping the
+ * cache misses.
+ *
+ * The Eytzinger layout stores a sorted array as an implicit binary
+ * tree in breadth-first order: tree[1] is the root, and the children
+ * of tree[k] are tree[2k] and tree[2k+1] (tree[0] is unused).  The
+ * first few levels of the tree share a few cache lines, and the
+ * descendants of a node four levels down are contiguous, so one
+ * prefetch covers them.  The searches return an index into the tree
+ * (not the sorted array), so any associated data should be stored in
+ * the same order.
+ */
+#include <apex/binsearch.h>
+#include <apex/atomic.h>               /* CACHE_LINE */
+#include <string.h>
+
+#ifdef __GNUC__
+#define PREFETCH(addr_) __builtin_prefetch(addr_)
+#else
+#define PREFETCH(addr_) ((void)(addr_))
+#endif /* __GNUC__ */
+
+/*
+ * LOWER_BOUND() --Define a branch-free lower bound for some type.
+ *
+ * Remarks:
+ * The search range is [base, base+n); each step halves n, keeping
+ * the upper half if its first element is still less than the key.
+ */
+#define LOWER_BOUND(name_, type_)                                       \
+    size_t name_(const type_ *base, size_t n, type_ key)                \
+    {                                                                   \
+        const type_ *p = base;                                          \
+                                                                        \
+        if (n == 0)                                                     \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        while (n > 1)                                                   \
+        {                                                               \
+            size_t half = n / 2;                                        \
+                                                                        \
+            PREFETCH(p + half / 2);                                     \
+            PREFETCH(p + half + half / 2);                              \
+            p = (p[half] < key) ? p + half : p;                         \
+            n -= half;                                                  \
+        }                                                               \
+        return (size_t) (p - base) + (*p < key);                        \
+    }
+
+/*
+ * EYTZINGER() --Define an Eytzinger-order lower bound for some type.
+ *
+ * Remarks:
+ * The descent records each step's direction in the bits of k; the
+ * answer is the last node where the search went left, recovered by
+ * stripping the trailing 1-bits (right turns), and one 0-bit.
+ */
+#define EYTZINGER(name_, type_)                                         \
+    size_t name_(const type_ *tree, size_t n, type_ key)                \
+    {                                                                   \
+        enum { BLOCK = CACHE_LINE / sizeof(type_) };                    \
+        size_t k = 1;                                                   \
+                                                                        \
+        while (k <= n)                                                  \
+        {                                                               \
+            PREFETCH(tree + k * BLOCK);                                 \
+            k = 2 * k + (tree[k] < key);                                \
+        }                                                               \
+        return strip_right_turns(k);                                    \
+    }
+
+/*
+ * strip_right_turns() --Recover the lower-bound node from a descent.
+ */
+static inline size_t strip_right_turns(size_t k)
+{
+#ifdef __GNUC__
+    return k >> __builtin_ffsll((long long) ~k);
+#else
+    while (k & 1)
+    {
+        k >>= 1;
+    }
+    return k >> 1;
+#endif /* __GNUC__ */
+}
+
+/*
+ * lower_bound_int() --Find the first element >= key, in an int array.
+ *
+ * Parameters:
+ * base --the sorted array
+ * n --the No. of elements in the array
+ * key --the value to search for
+ *
+ * Returns: (size_t)
+ * The offset of the first element >= key (i.e. n, if there isn't one).
+ */
+LOWER_BOUND(lower_bound_int, int)
+
+/*
+ * lower_bound_long() --Find the first element >= key, in a long array.
+ */
+LOWER_BOUND(lower_bound_long, long)
+
+/*
+ * lower_bound_double() --Find the first element >= key, in a double array.
+ */
+LOWER_BOUND(lower_bound_double, double)
+
+/*
+ * build() --Fill the subtree at k by an in-order walk of the sorted array.
+ */
+static size_t build(char *tree, const char *base, size_t i, size_t k,
+                    size_t n, size_t size)
+{
+    if (k <= n)
+    {
+        i = build(tree, base, i, 2 * k, n, size);
+        memcpy(tree + k * size, base + i * size, size);
+        i = build(tree, base, i + 1, 2 * k + 1, n, size);
+    }
+    return i;
+}
+
+/*
+ * eytzinger_build() --Copy a sorted array into Eytzinger (BFS) order.
+ *
+ * Parameters:
+ * tree --returns the tree; it must have space for n+1 elements
+ * base --the sorted array
+ * n --the No. of elements in the array
+ * size --the size of each element
+ *
+ * Remarks:
+ * The tree is best aligned so that tree+1 starts a cache line.
+ */
+void eytzinger_build(void *tree, const void *base, size_t n, size_t size)
+{
+    build(tree, base, 0, 1, n, size);
+}
+
+/*
+ * eytzinger_int() --Find the first element >= key, in an int tree.
+ *
+ * Parameters:
+ * tree --the tree built by eytzinger_build()
+ * n --the No. of elements in the tree
+ * key --the value to search for
+ *
+ * Returns: (size_t)
+ * The tree index (1..n) of the first element >= key, or 0 if there
+ * isn't one.
+ */
+EYTZINGER(eytzinger_int, int)
+
+/*
+ * eytzinger_long() --Find the first element >= key, in a long tree.
+ */
+EYTZINGER(eytzinger_long, long)
+
+/*
+ * eytzinger_double() --Find the first element >= key, in a double tree.
+ */
+EYTZINGER(eytzinger_double, double)
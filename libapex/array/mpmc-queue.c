@@ -0,0 +1,154 @@
+/*
+ * MPMC-QUEUE.C --A lock-free multi-producer, multi-consumer queue.
+ *
+ * Contents:
+ * mpmc_queue_init() --Initialise a queue with the specified working storage.
+ * mpmc_queue_push() --Push an item onto the queue.
+ * mpmc_queue_pop()  --Pop an item from the queue.
+ *
+ * Remarks:
+ * This is Dmitry Vyukov's bounded MPMC queue.  Each slot i has a
+ * sequence number, initially i.  A producer that has claimed position
+ * p (by advancing n_write from p to p+1) waits for nothing: it checks
+ * that seq == p (i.e. the slot has been consumed on the previous lap),
+ * copies the item in and sets seq = p+1.  A consumer claiming position
+ * p expects seq == p+1, copies the item out, and sets seq = p+n so
+ * the slot is ready for the next lap's producer.
+ *
+ * See Also:
+ * http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+#include <string.h>
+#include <apex/queue.h>
+
+/*
+ * mpmc_queue_init() --Initialise a queue with the specified working storage.
+ *
+ * Parameters:
+ * queue    --The queue to be initialised (owned by caller).
+ * n_items  --The number of items in the queue (must power of 2)
+ * item_size    --The size of the queue items.
+ * base    --The working storage of the queue.
+ * seq    --storage for the per-item sequence numbers (n_items of them)
+ *
+ * Returns:
+ * Success: queue; Failure: NULL.
+ */
+MPMCQueuePtr mpmc_queue_init(MPMCQueuePtr queue, int n_items,
+                             int item_size, void *base, unsigned int *seq)
+{
+    if (queue == NULL || base == NULL || seq == NULL || n_items <= 0)
+    {
+        return NULL;                   /* failure: no queue, no items? */
+    }
+    memset((void *) queue, 0, sizeof(*queue));
+    if (!queue_mask(n_items, &queue->mask))
+    {
+        return NULL;                   /* error: bad size */
+    }
+    array_init(&queue->array, n_items, item_size, base);
+    queue->seq = seq;
+    for (int i = 0; i < n_items; ++i)
+    {
+        seq[i] = (unsigned int) i;
+    }
+    return queue;                      /* success: queue is initialised */
+}
+
+/*
+ * mpmc_queue_push() --Push an item onto the queue.
+ *
+ * Parameters:
+ * queue --the queue to receive the item
+ * item --the queue item to insert
+ *
+ * Returns:
+ * Success: 1; Failure: 0 (the queue is full).
+ */
+int mpmc_queue_push(MPMCQueuePtr queue, const void *item)
+{
+    unsigned int pos;
+    unsigned int *seq;
+
+    if (queue == NULL || item == NULL)
+    {
+        return 0;                      /* failure: no queue, or no item! */
+    }
+    pos = ATOMIC_LOAD_RELAXED(&queue->n_write);
+    for (;;)
+    {
+        int diff;
+
+        seq = &queue->seq[pos & queue->mask];
+        diff = (int) (ATOMIC_LOAD_ACQUIRE(seq) - pos);
+        if (diff == 0)
+        {                              /* slot is free: try to claim it */
+            if (ATOMIC_CAS(&queue->n_write, &pos, pos + 1))
+            {
+                break;
+            }                          /* (CAS failure reloads pos) */
+        }
+        else if (diff < 0)
+        {
+            ATOMIC_ADD(&queue->n_fail, 1);
+            return 0;                  /* failure: queue is full */
+        }
+        else
+        {                              /* another producer got there first */
+            pos = ATOMIC_LOAD_RELAXED(&queue->n_write);
+        }
+    }
+    memcpy(queue->array.base + queue->array.item_size * (pos & queue->mask),
+           item, queue->array.item_size);
+    ATOMIC_STORE_RELEASE(seq, pos + 1);
+    return 1;                          /* success */
+}
+
+/*
+ * mpmc_queue_pop() --Pop an item from the queue.
+ *
+ * Parameters:
+ * queue --the queue to read from
+ * item --returns the item
+ *
+ * Returns:
+ * Success: 1; Failure: 0 (the queue is empty).
+ */
+int mpmc_queue_pop(MPMCQueuePtr queue, void *item)
+{
+    unsigned int pos;
+    unsigned int *seq;
+
+    if (queue == NULL || item == NULL)
+    {
+        return 0;                      /* failure: no queue, or no item! */
+    }
+    pos = ATOMIC_LOAD_RELAXED(&queue->n_read);
+    for (;;)
+    {
+        int diff;
+
+        seq = &queue->seq[pos & queue->mask];
+        diff = (int) (ATOMIC_LOAD_ACQUIRE(seq) - (pos + 1));
+        if (diff == 0)
+        {                              /* slot is full: try to claim it */
+            if (ATOMIC_CAS(&queue->n_read, &pos, pos + 1))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return 0;                  /* failure: queue is empty */
+        }
+        else
+        {                              /* another consumer got there first */
+            pos = ATOMIC_LOAD_RELAXED(&queue->n_read);
+        }
+    }
+    memcpy(item,
+           queue->array.base + queue->array.item_size * (pos & queue->mask),
+           queue->array.item_size);
+    ATOMIC_STORE_RELEASE(seq, pos + (unsigned int) queue->mask + 1);
+    return 1;                          /* success */
+}
@@ -0,0 +1,505 @@
+/*
+ * PIPELINE.C --A streaming pipeline of stages, run on a task pool.
+ *
+ * Contents:
+ * claim()          --Change a stage's state, if it's in a given state.
+ * is_failed()      --Test if a pipeline has been cancelled.
+ * has_input()      --Test if a stage has items (or the end) to process.
+ * schedule()       --Queue a task to run a stage, if it's idle.
+ * notify()         --Tell a stage that it has new input.
+ * run_stage()      --Process a stage's input, until there's none left.
+ * help()           --Make progress on a stage whose queue is full.
+ * flush_output()   --Hand a stage's output items to the next stage.
+ * end_output()     --Tell the next stage that its input has ended.
+ * stage_task()     --Run a (queued) stage, as a task.
+ * source_task()    --Run the source stage, as a task.
+ * pipeline_new()   --Create an empty pipeline.
+ * pipeline_free()  --Free a pipeline, and its stages' storage.
+ * pipeline_add()   --Add a stage to the end of a pipeline.
+ * pipeline_start() --Start running a pipeline's stages.
+ * pipeline_wait()  --Wait for a pipeline's stages to finish.
+ * pipeline_run()   --Run a pipeline, and wait for it to finish.
+ * pipeline_emit()  --Emit an item for the next stage.
+ * pipeline_cancel() --Stop a pipeline, discarding any queued items.
+ *
+ * Remarks:
+ * Each stage is idle, queued (a task will run it), or running (by
+ * exactly one thread), and only changes state by compare-and-swap,
+ * so each queue between stages has one producer and one consumer at
+ * a time, and can be an AtomicQueue.  A stage that is run by a new
+ * thread acquires the state released by the last one, so the queue's
+ * consumer side (and the stage's data) moves between threads safely.
+ *
+ * After a producer hands items to a stage, it checks whether the
+ * stage is idle; after a stage finishes its input and becomes idle,
+ * it re-checks its queue.  Both sides use a full barrier in between,
+ * so (as in queue_wait_init()) at least one of them sees the other,
+ * and no input is left stranded.
+ *
+ * A producer that finds the next queue full claims the next stage
+ * and runs it on its own thread, even if a task for it is queued
+ * (that task then does nothing).  If the stage is already running
+ * on another thread, that thread is making progress (ultimately the
+ * last stage always can), so the producer just yields.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/pipeline.h>
+
+enum
+{
+    STAGE_IDLE,
+    STAGE_QUEUED,
+    STAGE_RUNNING
+};
+
+/*
+ * claim() --Change a stage's state, if it's in a given state.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (it's in some other state).
+ */
+static int claim(PipelineStagePtr stage, unsigned int from, unsigned int to)
+{
+    unsigned int state = from;
+
+    while (!ATOMIC_CAS(&stage->state, &state, to))
+    {
+        if (state != from)
+        {
+            return 0;
+        }
+        state = from;                  /* (spurious failure) */
+    }
+    return 1;
+}
+
+/*
+ * is_failed() --Test if a pipeline has been cancelled.
+ */
+static int is_failed(PipelinePtr pipeline)
+{
+    return ATOMIC_LOAD_ACQUIRE(&pipeline->failed);
+}
+
+/*
+ * has_input() --Test if a stage has items (or the end) to process.
+ */
+static int has_input(PipelineStagePtr stage)
+{
+    return ATOMIC_LOAD_ACQUIRE(&stage->in.n_write)
+        != ATOMIC_LOAD_ACQUIRE(&stage->in.n_read)
+        || (ATOMIC_LOAD_ACQUIRE(&stage->end)
+            && !ATOMIC_LOAD_RELAXED(&stage->done));
+}
+
+static void stage_task(void *data);
+
+/*
+ * schedule() --Queue a task to run a stage, if it's idle.
+ */
+static void schedule(PipelineStagePtr stage)
+{
+    PipelinePtr pipeline = stage->pipeline;
+
+    if (claim(stage, STAGE_IDLE, STAGE_QUEUED))
+    {
+        task_submit(pipeline->pool, &pipeline->group, stage_task, stage);
+    }
+}
+
+/*
+ * notify() --Tell a stage that it has new input.
+ */
+static void notify(PipelineStagePtr stage)
+{
+    ATOMIC_FENCE();                    /* (see run_stage()) */
+    if (ATOMIC_LOAD_RELAXED(&stage->state) == STAGE_IDLE)
+    {
+        schedule(stage);
+    }
+}
+
+static int flush_output(PipelineStagePtr stage);
+static void end_output(PipelineStagePtr stage);
+
+/*
+ * run_stage() --Process a stage's input, until there's none left.
+ *
+ * Remarks:
+ * The caller has claimed the stage (i.e. it's running).  When the
+ * stage has consumed all its input, and the previous stage has ended,
+ * its proc is called once more (with no items), and then it ends too.
+ */
+static void run_stage(PipelineStagePtr stage)
+{
+    PipelinePtr pipeline = stage->pipeline;
+    size_t n;
+
+    do
+    {
+        while (!is_failed(pipeline)
+               && (n = queue_pop_n(&stage->in, stage->item,
+                                   stage->batch)) > 0)
+        {
+            if (stage->proc(stage, stage->data, stage->item, n) < 0
+                || !flush_output(stage))
+            {
+                pipeline_cancel(pipeline);
+            }
+        }
+        if (!is_failed(pipeline) && !stage->done
+            && ATOMIC_LOAD_ACQUIRE(&stage->end)
+            && queue_peek(&stage->in, NULL) == NULL)
+        {
+            if (stage->proc(stage, stage->data, NULL, 0) < 0
+                || !flush_output(stage))
+            {
+                pipeline_cancel(pipeline);
+            }
+            ATOMIC_STORE_RELAXED(&stage->done, 1);
+            end_output(stage);
+        }
+        ATOMIC_STORE_RELEASE(&stage->state, STAGE_IDLE);
+        ATOMIC_FENCE();                /* (see notify()) */
+    } while (!is_failed(pipeline) && has_input(stage)
+             && claim(stage, STAGE_IDLE, STAGE_RUNNING));
+}
+
+/*
+ * help() --Make progress on a stage whose queue is full.
+ */
+static void help(PipelineStagePtr stage)
+{
+    if (claim(stage, STAGE_IDLE, STAGE_RUNNING)
+        || claim(stage, STAGE_QUEUED, STAGE_RUNNING))
+    {
+        run_stage(stage);
+        return;
+    }
+    sched_yield();                     /* (it's running elsewhere) */
+}
+
+/*
+ * flush_output() --Hand a stage's output items to the next stage.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the pipeline has been cancelled).
+ */
+static int flush_output(PipelineStagePtr stage)
+{
+    PipelineStagePtr next = stage + 1;
+    size_t n_push = 0;
+
+    while (n_push < stage->n_out)
+    {                                  /* (so there is a next stage) */
+        size_t item_size = (size_t) next->in.array.item_size;
+        size_t n;
+
+        if (is_failed(stage->pipeline))
+        {
+            stage->n_out = 0;
+            return 0;
+        }
+        n = queue_push_n(&next->in, stage->out + n_push * item_size,
+                         stage->n_out - n_push);
+        if (n == 0)
+        {
+            help(next);                /* back-pressure */
+            continue;
+        }
+        n_push += n;
+        notify(next);
+    }
+    stage->n_out = 0;
+    return 1;
+}
+
+/*
+ * end_output() --Tell the next stage that its input has ended.
+ */
+static void end_output(PipelineStagePtr stage)
+{
+    PipelineStagePtr next = stage + 1;
+
+    if (stage->id + 1 < stage->pipeline->n_stage)
+    {
+        ATOMIC_STORE_RELEASE(&next->end, 1);
+        notify(next);
+    }
+}
+
+/*
+ * stage_task() --Run a (queued) stage, as a task.
+ *
+ * Remarks:
+ * If the stage has been claimed by a producer meanwhile (see
+ * help()), this does nothing.
+ */
+static void stage_task(void *data)
+{
+    PipelineStagePtr stage = data;
+
+    if (claim(stage, STAGE_QUEUED, STAGE_RUNNING))
+    {
+        run_stage(stage);
+    }
+}
+
+/*
+ * source_task() --Run the source stage, as a task.
+ */
+static void source_task(void *data)
+{
+    PipelineStagePtr stage = data;
+    PipelinePtr pipeline = stage->pipeline;
+
+    while (!is_failed(pipeline))
+    {
+        int status = stage->proc(stage, stage->data, NULL, 0);
+
+        if (status < 0 || !flush_output(stage))
+        {
+            pipeline_cancel(pipeline);
+            break;
+        }
+        if (status > 0)
+        {
+            break;                     /* (the end of its input) */
+        }
+    }
+    stage->done = 1;
+    end_output(stage);
+}
+
+/*
+ * pipeline_new() --Create an empty pipeline.
+ *
+ * Parameters:
+ * pool --the pool to run the stages on (NULL: the default pool)
+ *
+ * Returns: (PipelinePtr)
+ * Success: the pipeline; Failure: NULL.
+ */
+PipelinePtr pipeline_new(TaskPoolPtr pool)
+{
+    PipelinePtr pipeline;
+
+    if (pool == NULL && (pool = task_pool_default()) == NULL)
+    {
+        return NULL;
+    }
+    if ((pipeline = NEW(Pipeline, 1)) == NULL)
+    {
+        return NULL;
+    }
+    pipeline->pool = pool;
+    task_group_init(&pipeline->group);
+    return pipeline;
+}
+
+/*
+ * pipeline_free() --Free a pipeline, and its stages' storage.
+ *
+ * Remarks:
+ * The pipeline mustn't be running (see pipeline_wait()).
+ */
+void pipeline_free(PipelinePtr pipeline)
+{
+    if (pipeline == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < pipeline->n_stage; ++i)
+    {
+        PipelineStagePtr stage = &pipeline->stage[i];
+
+        free(stage->in.array.base);
+        free(stage->item);
+        free(stage->out);
+    }
+    free(pipeline);
+}
+
+/*
+ * pipeline_add() --Add a stage to the end of a pipeline.
+ *
+ * Parameters:
+ * pipeline --the pipeline
+ * proc     --the stage's function
+ * data     --the stage's data (passed to proc)
+ * item_size --the size of the stage's input items
+ * n_items  --the size of its input queue (a power of 2)
+ * batch    --the most items to pass to proc at once (0: n_items/4)
+ *
+ * Returns: (PipelineStagePtr)
+ * Success: the stage; Failure: NULL.
+ *
+ * Remarks:
+ * The first stage added is the source; it has no input, so its
+ * item_size, n_items and batch are ignored.  The previous stage's
+ * output buffer is allocated here, to hold one of this stage's
+ * batches.
+ */
+PipelineStagePtr pipeline_add(PipelinePtr pipeline, PipelineProc proc,
+                              void *data, size_t item_size, int n_items,
+                              size_t batch)
+{
+    PipelineStagePtr stage, prev;
+    void *base;
+    int mask;
+
+    if (pipeline == NULL || proc == NULL
+        || pipeline->n_stage >= PIPELINE_MAX_STAGE)
+    {
+        return NULL;                   /* error: no pipeline, or too long */
+    }
+    stage = &pipeline->stage[pipeline->n_stage];
+    stage->pipeline = pipeline;
+    stage->id = pipeline->n_stage;
+    stage->proc = proc;
+    stage->data = data;
+    if (stage->id == 0)
+    {
+        pipeline->n_stage += 1;
+        return stage;                  /* success: the source */
+    }
+    if (item_size == 0 || n_items <= 0 || !queue_mask(n_items, &mask))
+    {
+        return NULL;                   /* error: bad queue size */
+    }
+    if (batch == 0)
+    {
+        batch = MAX((size_t) n_items / 4, 1);
+    }
+    stage->batch = MIN(batch, (size_t) n_items);
+    prev = stage - 1;
+    base = malloc(item_size * (size_t) n_items);
+    stage->item = malloc(item_size * stage->batch);
+    prev->out = malloc(item_size * stage->batch);
+    if (base == NULL || stage->item == NULL || prev->out == NULL)
+    {
+        free(base);
+        free(stage->item);
+        free(prev->out);
+        stage->item = prev->out = NULL;
+        return NULL;                   /* error: malloc failed */
+    }
+    (void) queue_init(&stage->in, n_items, (int) item_size, base);
+    pipeline->n_stage += 1;
+    return stage;                      /* success */
+}
+
+/*
+ * pipeline_start() --Start running a pipeline's stages.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (there are no stages).
+ *
+ * Remarks:
+ * This returns at once; the stages run on the pool's workers (and
+ * on the thread that waits for them).
+ */
+int pipeline_start(PipelinePtr pipeline)
+{
+    if (pipeline == NULL || pipeline->n_stage == 0)
+    {
+        return 0;
+    }
+    pipeline->failed = 0;
+    for (int i = 0; i < pipeline->n_stage; ++i)
+    {
+        PipelineStagePtr stage = &pipeline->stage[i];
+
+        if (i > 0)
+        {                              /* (discard any cancelled items) */
+            (void) queue_init(&stage->in, stage->in.array.n_items,
+                              stage->in.array.item_size,
+                              stage->in.array.base);
+        }
+        stage->n_out = 0;
+        stage->state = STAGE_IDLE;
+        stage->end = stage->done = 0;
+    }
+    task_submit(pipeline->pool, &pipeline->group, source_task,
+                &pipeline->stage[0]);
+    return 1;
+}
+
+/*
+ * pipeline_wait() --Wait for a pipeline's stages to finish.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (a stage failed, or it was cancelled).
+ */
+int pipeline_wait(PipelinePtr pipeline)
+{
+    task_group_wait(pipeline->pool, &pipeline->group);
+    return !is_failed(pipeline);
+}
+
+/*
+ * pipeline_run() --Run a pipeline, and wait for it to finish.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int pipeline_run(PipelinePtr pipeline)
+{
+    return pipeline_start(pipeline) && pipeline_wait(pipeline);
+}
+
+/*
+ * pipeline_emit() --Emit an item for the next stage.
+ *
+ * Parameters:
+ * stage --the (calling) stage
+ * item  --the item, of the next stage's item_size
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set: EINVAL for the last stage,
+ * ECANCELED if the pipeline has been cancelled).
+ *
+ * Remarks:
+ * The item is copied into the stage's output buffer, which is handed
+ * on when it holds a batch, or the stage's proc returns.  If the next
+ * stage's queue is full, this waits (running that stage meanwhile).
+ */
+int pipeline_emit(PipelineStagePtr stage, const void *item)
+{
+    PipelineStagePtr next = stage + 1;
+    size_t item_size;
+
+    if (stage->id + 1 >= stage->pipeline->n_stage)
+    {
+        errno = EINVAL;
+        return 0;                      /* error: no next stage */
+    }
+    if (stage->n_out == next->batch && !flush_output(stage))
+    {
+        errno = ECANCELED;
+        return 0;                      /* error: cancelled */
+    }
+    item_size = (size_t) next->in.array.item_size;
+    memcpy(stage->out + stage->n_out * item_size, item, item_size);
+    stage->n_out += 1;
+    return 1;
+}
+
+/*
+ * pipeline_cancel() --Stop a pipeline, discarding any queued items.
+ *
+ * Remarks:
+ * This may be called by a stage, or by any other thread.  The stages
+ * stop at their next call to pipeline_emit(), or when their proc
+ * returns, and pipeline_wait() then fails.
+ */
+void pipeline_cancel(PipelinePtr pipeline)
+{
+    ATOMIC_STORE_RELEASE(&pipeline->failed, 1);
+}
@@ -0,0 +1,107 @@
+/*
+ * PIPELINE.H --Definitions for a streaming pipeline of stages.
+ *
+ * Contents:
+ * PipelineStage_t{} --A stage: a function, and its (bounded) input queue.
+ * Pipeline_t{}      --A chain of stages, run on a task pool.
+ *
+ * Remarks:
+ * A pipeline is a chain of stages, e.g. read -> parse -> transform ->
+ * write, each a PipelineProc.  The first stage (the source) is called
+ * repeatedly until it returns 1 (the end of its input); each other
+ * stage is called with batches of the items emitted by the stage
+ * before it, and then once more with no items at the end of its
+ * input, so it can flush any partial state.  A stage emits items for
+ * the next one with pipeline_emit().
+ *
+ * The stages run as tasks on a TaskPool, so they overlap across
+ * cores, but each stage runs on one thread at a time, so it needs no
+ * locking of its own state.  The queues between stages are bounded:
+ * a stage that finds the next queue full runs the next stage itself
+ * (if it's not already running), which stops any stage getting far
+ * ahead of the rest, and means that a pipeline can't deadlock even
+ * on a pool with fewer workers than stages.
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+
+#include <apex/queue.h>
+#include <apex/task-pool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        PIPELINE_MAX_STAGE = 16        /* most stages in a pipeline */
+    };
+
+    struct PipelineStage_t;
+
+    /*
+     * PipelineProc --A stage's function.
+     *
+     * Parameters:
+     * stage --the stage (for pipeline_emit())
+     * data  --the stage's data
+     * items --a batch of input items (NULL for the source)
+     * n_items --the No. of items (0 for the source, and at the end)
+     *
+     * Returns: (int)
+     * 0: OK; 1: (source only) the end of its input; -1: failure, which
+     * cancels the pipeline.
+     */
+    typedef int (*PipelineProc)(struct PipelineStage_t *stage, void *data,
+                                void *items, size_t n_items);
+
+    /*
+     * PipelineStage_t{} --A stage: a function, and its (bounded) input queue.
+     *
+     * Remarks:
+     * Items emitted by a stage are collected in its out[] buffer, and
+     * handed to the next stage's queue a batch at a time.  The queue's
+     * n_fail counts the times the previous stage found it full (see
+     * queue_stats()), i.e. how often this stage held up the pipeline.
+     */
+    typedef struct PipelineStage_t
+    {
+        struct Pipeline_t *pipeline;
+        int id;                        /* 0 (the source)...n_stage-1 */
+        PipelineProc proc;
+        void *data;
+        size_t batch;                  /* most items per call */
+        AtomicQueue in;                /* input items (not the source) */
+        char *item;                    /* a batch of input items */
+        char *out;                     /* items for the next stage */
+        size_t n_out;
+        unsigned int state;            /* idle, queued, or running */
+        int end;                       /* the previous stage has ended */
+        int done;                      /* this stage has ended */
+    } PipelineStage, *PipelineStagePtr;
+
+    typedef struct Pipeline_t
+    {
+        TaskPoolPtr pool;
+        TaskGroup group;               /* the stages' tasks */
+        int failed;                    /* a stage has failed */
+        int n_stage;
+        PipelineStage stage[PIPELINE_MAX_STAGE];
+    } Pipeline, *PipelinePtr;
+
+    PipelinePtr pipeline_new(TaskPoolPtr pool);
+    void pipeline_free(PipelinePtr pipeline);
+    PipelineStagePtr pipeline_add(PipelinePtr pipeline, PipelineProc proc,
+                                  void *data, size_t item_size,
+                                  int n_items, size_t batch);
+    int pipeline_start(PipelinePtr pipeline);
+    int pipeline_wait(PipelinePtr pipeline);
+    int pipeline_run(PipelinePtr pipeline);
+    int pipeline_emit(PipelineStagePtr stage, const void *item);
+    void pipeline_cancel(PipelinePtr pipeline);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* PIPELINE_H */
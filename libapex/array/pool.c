@@ -7,6 +7,12 @@
  * pool_init()   --Initialise a pool structure.
  * pool_new()    --Get a new item from the pool.
  * pool_delete() --Return an item to the pool.
+ * pool_init_slab() --Initialise a pool that allocates its own storage.
+ * pool_init_slab_with() --Initialise a slab pool with a page placement policy.
+ * pool_trim()   --Free a slab pool's unused chunks.
+ * pool_free_slab() --Free all of a slab pool's chunks.
+ * pool_collect() --Report a pool's statistics as metrics.
+ * pool_metrics() --Register a pool's statistics as metrics.
  *
  * Remarks:
  * These routines manage a chunk of storage as an array of fixed size
@@ -21,10 +27,22 @@
  * Pool allocator also has well known (and good!) performance, because
  * it avoids fragmentation and merging etc. that a general purpose
  * allocator must do.
+ *
+ * A slab pool (created by pool_init_slab()) has no fixed storage:
+ * when its current chunk is used up, it allocates another one
+ * (aligned on the chunk size), and so it only fails when malloc()
+ * does.  Each chunk counts its allocated items, so that pool_trim()
+ * can return completely free chunks.  pool_init_slab_with() maps the
+ * chunks with page_alloc() instead, so that they can be placed on a
+ * NUMA node, and/or in huge pages.
  */
 #include <memory.h>
+#include <stdint.h>
 #include <apex/pool.h>
 
+#define CHUNK_HEADER \
+    ((sizeof(PoolChunk) + CACHE_LINE - 1) & ~(size_t) (CACHE_LINE - 1))
+
 /*
  * Link{} --free list record
  */
@@ -75,6 +93,68 @@ PoolPtr pool_init(PoolPtr pool, int n_items, int item_size, void *base)
     return NULL;                       /* failure: assert? */
 }
 
+/*
+ * pool_chunk() --Return the chunk containing a slab pool's item.
+ */
+static inline PoolChunkPtr pool_chunk(PoolPtr pool, void *item)
+{
+    return (PoolChunkPtr) ((uintptr_t) item & ~(pool->chunk_size - 1));
+}
+
+/*
+ * chunk_free() --Release a slab pool's chunk.
+ */
+static void chunk_free(PoolPtr pool, PoolChunkPtr chunk)
+{
+    if (pool->policy.flags != 0)
+    {
+        page_free(chunk, pool->chunk_size, pool->policy.flags);
+    }
+    else
+    {
+        free(chunk);
+    }
+}
+
+/*
+ * pool_grow() --Allocate a new chunk for a slab pool.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The new chunk becomes the pool's array; any items left in the
+ * previous chunk's array have all been allocated when this is called.
+ */
+static int pool_grow(PoolPtr pool)
+{
+    void *mem;
+    PoolChunkPtr chunk;
+
+    if (pool->policy.flags != 0)
+    {
+        if ((mem = page_alloc(pool->chunk_size, pool->chunk_size,
+                              pool->policy.node, pool->policy.flags)) == NULL)
+        {
+            return 0;                  /* failure: no memory */
+        }
+    }
+    else if (posix_memalign(&mem, pool->chunk_size, pool->chunk_size) != 0)
+    {
+        return 0;                      /* failure: no memory */
+    }
+    chunk = (PoolChunkPtr) mem;
+    chunk->next = pool->chunk;
+    chunk->n_live = 0;
+    pool->chunk = chunk;
+    array_init(&pool->array,
+               (int) ((pool->chunk_size - CHUNK_HEADER)
+                      / pool->array.item_size),
+               pool->array.item_size, (char *) chunk + CHUNK_HEADER);
+    pool->n_used = 0;
+    return 1;                          /* success */
+}
+
 /*
  * pool_new() --Get a new item from the pool.
  *
@@ -93,12 +173,25 @@ void *pool_new(PoolPtr pool)
             LinkPtr head = (LinkPtr) pool->free;
 
             pool->free = head->next;
+            ATOMIC_STORE_RELAXED(&pool->n_live, pool->n_live + 1);
+            if (pool->chunk_size != 0)
+            {
+                pool_chunk(pool, head)->n_live += 1;
+            }
             return (void *) head;      /* success: return from free list */
         }
-        if (pool->n_used < pool->array.n_items)
+        if (pool->n_used >= pool->array.n_items
+            && (pool->chunk_size == 0 || !pool_grow(pool)))
+        {
+            ATOMIC_STORE_RELAXED(&pool->n_fail, pool->n_fail + 1);
+            return NULL;               /* failure: the pool is empty! */
+        }
+        ATOMIC_STORE_RELAXED(&pool->n_live, pool->n_live + 1);
+        if (pool->chunk_size != 0)
         {
-            return pool->array.base + pool->array.item_size * pool->n_used++;
+            pool->chunk->n_live += 1;
         }
+        return pool->array.base + pool->array.item_size * pool->n_used++;
     }
     return NULL;                       /* failure: the pool is empty! */
 }
@@ -121,5 +214,213 @@ void pool_delete(PoolPtr pool, void *item)
 
         link->next = (LinkPtr) pool->free;
         pool->free = link;
+        ATOMIC_STORE_RELAXED(&pool->n_live, pool->n_live - 1);
+        if (pool->chunk_size != 0)
+        {
+            pool_chunk(pool, item)->n_live -= 1;
+        }
+    }
+}
+
+/*
+ * pool_init_slab() --Initialise a pool that allocates its own storage.
+ *
+ * Parameters:
+ * pool --specifies and returns the initialised pool
+ * item_size --the size of each item
+ * chunk_size --the size of each chunk (a power of 2, e.g. a page)
+ *
+ * Returns: (Poolptr)
+ * Success: the pool; Failure: NULL.
+ *
+ * Remarks:
+ * No storage is allocated until the first call to pool_new(); the
+ * chunks should eventually be released by pool_free_slab().
+ */
+PoolPtr pool_init_slab(PoolPtr pool, int item_size, size_t chunk_size)
+{
+    if (pool != NULL && item_size >= (int) sizeof(LinkPtr)
+        && (chunk_size & (chunk_size - 1)) == 0
+        && chunk_size >= CHUNK_HEADER + (size_t) item_size)
+    {
+        memset(pool, 0, sizeof(*pool));
+        array_init(&pool->array, 0, item_size, NULL);
+        pool->chunk_size = chunk_size;
+        pool->policy.node = PAGE_NODE_ANY;
+        return pool;
+    }
+    return NULL;                       /* failure: bad sizes */
+}
+
+/*
+ * pool_init_slab_with() --Initialise a slab pool with a page placement policy.
+ *
+ * Parameters:
+ * pool --specifies and returns the initialised pool
+ * item_size --the size of each item
+ * chunk_size --the size of each chunk (a power of 2)
+ * policy --how to allocate chunks (NULL, or no flags: malloc())
+ *
+ * Returns: (Poolptr)
+ * Success: the pool; Failure: NULL.
+ *
+ * Remarks:
+ * Chunks are mapped in whole pages, so chunk_size should be at least
+ * the page size (or the huge page size, with PAGE_HUGE).
+ */
+PoolPtr pool_init_slab_with(PoolPtr pool, int item_size, size_t chunk_size,
+                            const PagePolicy * policy)
+{
+    if (pool_init_slab(pool, item_size, chunk_size) == NULL)
+    {
+        return NULL;                   /* failure: bad sizes */
+    }
+    if (policy != NULL)
+    {
+        pool->policy = *policy;
+    }
+    return pool;
+}
+
+/*
+ * pool_trim() --Free a slab pool's unused chunks.
+ *
+ * Parameters:
+ * pool --the pool
+ *
+ * Returns: (int)
+ * The number of chunks freed.
+ *
+ * Remarks:
+ * This walks the whole free list, removing the items of chunks that
+ * have no allocated items (other than the current chunk, which may
+ * still have never-allocated items), and then frees those chunks.
+ */
+int pool_trim(PoolPtr pool)
+{
+    LinkPtr keep = NULL;
+    LinkPtr next;
+    PoolChunkPtr *chunk_ptr;
+    int n = 0;
+
+    if (pool == NULL || pool->chunk == NULL)
+    {
+        return 0;                      /* (not a slab pool, or no chunks) */
+    }
+    for (LinkPtr link = (LinkPtr) pool->free; link != NULL; link = next)
+    {
+        PoolChunkPtr chunk = pool_chunk(pool, link);
+
+        next = link->next;
+        if (chunk->n_live != 0 || chunk == pool->chunk)
+        {
+            link->next = keep;
+            keep = link;
+        }
+    }
+    pool->free = keep;
+    chunk_ptr = &pool->chunk->next;
+    while (*chunk_ptr != NULL)
+    {
+        PoolChunkPtr chunk = *chunk_ptr;
+
+        if (chunk->n_live == 0)
+        {
+            *chunk_ptr = chunk->next;
+            chunk_free(pool, chunk);
+            ++n;
+        }
+        else
+        {
+            chunk_ptr = &chunk->next;
+        }
+    }
+    return n;
+}
+
+/*
+ * pool_free_slab() --Free all of a slab pool's chunks.
+ *
+ * Remarks:
+ * Any items still allocated from the pool become invalid.
+ */
+void pool_free_slab(PoolPtr pool)
+{
+    PoolChunkPtr next;
+
+    if (pool == NULL)
+    {
+        return;
+    }
+    for (PoolChunkPtr chunk = pool->chunk; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        chunk_free(pool, chunk);
+    }
+    pool->chunk = NULL;
+    pool->free = NULL;
+    array_init(&pool->array, 0, pool->array.item_size, NULL);
+    pool->n_used = 0;
+    pool->n_live = 0;
+}
+
+/*
+ * pool_collect() --Report a pool's statistics as metrics.
+ */
+static void pool_collect(MetricWriterPtr writer, void *data)
+{
+    PoolPtr pool = (PoolPtr) data;
+    int n_chunk = 0;
+
+    metric_write(writer, "apex_pool_items_live",
+                 "Items allocated from the pool.", METRIC_GAUGE,
+                 ATOMIC_LOAD_RELAXED(&pool->n_live));
+    metric_write(writer, "apex_pool_alloc_failures_total",
+                 "Allocations that failed because the pool was empty.",
+                 METRIC_COUNTER, ATOMIC_LOAD_RELAXED(&pool->n_fail));
+    if (pool->chunk_size != 0)
+    {
+        for (PoolChunkPtr chunk = ATOMIC_LOAD_RELAXED(&pool->chunk);
+             chunk != NULL; chunk = chunk->next)
+        {
+            ++n_chunk;
+        }
+        metric_write(writer, "apex_pool_chunk_bytes",
+                     "Memory held in the pool's chunks.", METRIC_GAUGE,
+                     (double) n_chunk * pool->chunk_size);
+    }
+    else
+    {
+        metric_write(writer, "apex_pool_items",
+                     "The pool's capacity.", METRIC_GAUGE,
+                     pool->array.n_items);
+    }
+}
+
+/*
+ * pool_metrics() --Register a pool's statistics as metrics.
+ *
+ * Parameters:
+ * pool --the pool
+ * name --the pool's name, reported as the "pool" label
+ *
+ * Returns: (MetricPtr)
+ * Success: the collector (to be released by metric_free() before the
+ * pool is); Failure: NULL.
+ *
+ * Remarks:
+ * A pool isn't thread-safe, so the pool's owner should not trim or
+ * free a slab pool while its metrics may be formatted.
+ */
+MetricPtr pool_metrics(PoolPtr pool, const char *name)
+{
+    char labels[METRIC_NAME_MAX];
+
+    if (pool == NULL)
+    {
+        return NULL;
     }
+    return metric_collector_new(metric_label(labels, sizeof(labels),
+                                             "pool", name),
+                                pool_collect, pool);
 }
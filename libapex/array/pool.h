@@ -1,34 +1,141 @@
 /*
  * POOL.H --A simple pool allocator, with caller provided item storage.
+ *
+ * Contents:
+ * Pool_t{}       --A (single-threaded) pool of fixed-size items.
+ * PoolChunk_t{}  --The header of a slab pool's chunk of items.
+ * CPool_t{}      --A thread-safe pool of fixed-size items.
+ * CPoolCache_t{} --A thread's cache of free items from a CPool.
+ * BPool_t{}      --A thread-safe pool, with an allocation bitmap.
  */
 #ifndef POOL_H
 #define POOL_H
 
+#include <stdint.h>
 #include <apex/array.h>
+#include <apex/atomic.h>
+#include <apex/bitset.h>
+#include <apex/metrics.h>
+#include <apex/placement.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif                                 /* C++ */
+    /*
+     * PoolChunk_t{} --The header of a slab pool's chunk of items.
+     *
+     * Remarks:
+     * Chunks are aligned on their (power of 2) size, so an item's chunk
+     * is found by masking its address.
+     */
+    typedef struct PoolChunk_t
+    {
+        struct PoolChunk_t *next;      /* list of all the pool's chunks */
+        int n_live;                    /* No. of items allocated */
+    } PoolChunk, *PoolChunkPtr;
+
     typedef struct Pool_t
     {
         ArrayContainer array;
         int n_used;                    /* maximum number of used items */
         void *free;                    /* current list of freed items. */
+        size_t chunk_size;             /* slab chunk size (0: fixed pool) */
+        PoolChunkPtr chunk;            /* slab chunks (newest first) */
+        PagePolicy policy;             /* how slab chunks are allocated */
+        int n_live;                    /* No. of items allocated */
+        int n_fail;                    /* No. of failed allocations */
     } Pool, *PoolPtr;
 
+    /*
+     * CPool_t{} --A thread-safe pool of fixed-size items.
+     *
+     * Remarks:
+     * Free items are kept on a lock-free stack, whose top is an item
+     * index (+1, so that 0 means empty) tagged with a modification
+     * count in the upper 32 bits, so that a pop can't be fooled by an
+     * item being popped and pushed back meanwhile (the ABA problem).
+     */
+    typedef struct CPool_t
+    {
+        ArrayContainer array;
+        char pad_0[CACHE_LINE];
+
+        uint64_t top;                  /* tag<<32 | (index of free item)+1 */
+        char pad_1[CACHE_LINE];
+
+        unsigned int n_used;           /* No. of items taken from array */
+        char pad_2[CACHE_LINE];
+    } CPool, *CPoolPtr;
+
+    /*
+     * CPoolCache_t{} --A thread's cache of free items from a CPool.
+     *
+     * Remarks:
+     * Each thread that allocates from a CPool should have its own
+     * cache, which it uses without synchronisation; the cache
+     * exchanges items with the pool in batches.
+     */
+    typedef struct CPoolCache_t
+    {
+        CPoolPtr pool;
+        void *free;                    /* local list of free items */
+        int n_free;
+    } CPoolCache, *CPoolCachePtr;
+
+    /*
+     * BPool_t{} --A thread-safe pool, with an allocation bitmap.
+     *
+     * Remarks:
+     * Rather than an intrusive free list, items are tracked by a bit
+     * each (set: allocated), which is claimed and released with
+     * atomic operations.  So a free item's contents are left alone,
+     * there's no ABA problem, and the allocated items can be found
+     * (with bitset_next()) without any bookkeeping by the caller.
+     */
+    typedef struct BPool_t
+    {
+        ArrayContainer array;
+        Bitset used;                   /* a bit per item: set if allocated */
+        size_t hint;                   /* where to start looking */
+    } BPool, *BPoolPtr;
+
     PoolPtr pool_alloc(void);
     PoolPtr pool_init(PoolPtr pool, int n_items, int item_size, void *items);
 
     void *pool_new(PoolPtr pool);
     void pool_delete(PoolPtr pool, void *item);
 
+    PoolPtr pool_init_slab(PoolPtr pool, int item_size, size_t chunk_size);
+    PoolPtr pool_init_slab_with(PoolPtr pool, int item_size,
+                                size_t chunk_size, const PagePolicy * policy);
+    int pool_trim(PoolPtr pool);
+    void pool_free_slab(PoolPtr pool);
+    MetricPtr pool_metrics(PoolPtr pool, const char *name);
+
+    CPoolPtr cpool_init(CPoolPtr pool, int n_items, int item_size,
+                        void *items);
+    void *cpool_new(CPoolPtr pool);
+    void cpool_delete(CPoolPtr pool, void *item);
+
+    CPoolCachePtr cpool_cache_init(CPoolCachePtr cache, CPoolPtr pool);
+    void *cpool_cache_new(CPoolCachePtr cache);
+    void cpool_cache_delete(CPoolCachePtr cache, void *item);
+    void cpool_cache_flush(CPoolCachePtr cache);
+
+    BPoolPtr bpool_init(BPoolPtr pool, int n_items, int item_size,
+                        void *items, uint64_t *bits);
+    void *bpool_new(BPoolPtr pool);
+    void bpool_delete(BPoolPtr pool, void *item);
 
     /*
      * Convenience functions for malloc and item-size aware initialisation.
      */
 #define new_pool(items) init_pool(pool_alloc(), items)
 #define init_pool(pool, items) pool_init(pool, NEL(items), sizeof(items[0]), items)
+#define init_cpool(pool, items) cpool_init(pool, NEL(items), sizeof(items[0]), items)
+#define init_bpool(pool, items, bits) \
+    bpool_init(pool, NEL(items), sizeof(items[0]), items, bits)
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
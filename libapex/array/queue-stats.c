@@ -0,0 +1,237 @@
+/*
+ * QUEUE-STATS.C --Optional instrumentation for the atomic queue.
+ *
+ * Contents:
+ * queue_instrument()   --Enable instrumentation of a queue.
+ * queue_record_write() --Timestamp items as they're published.
+ * queue_record_read()  --Record the latency of items as they're removed.
+ * queue_stats()        --Take a snapshot of a queue's statistics.
+ * queue_stats_print()  --Print a queue's statistics in "key=value" form.
+ * queue_collect()      --Report a queue's statistics as metrics.
+ * queue_metrics()      --Register a queue's statistics as metrics.
+ *
+ * Remarks:
+ * The producer and consumer each update only their own statistics
+ * (the producer the timestamps and peak depth, the consumer the
+ * latency histogram), so instrumentation needs no extra
+ * synchronisation.  The timestamps are published (and consumed) with
+ * the items themselves.  queue_stats() may be called from any thread;
+ * its counts are read individually, so they're only approximately
+ * consistent with each other.
+ */
+#include <string.h>
+#include <apex/clock.h>
+#include <apex/queue.h>
+
+/*
+ * latency_bucket() --Return the histogram bucket for a latency.
+ *
+ * Remarks:
+ * Bucket i counts latencies in [2^i, 2^(i+1)) ns (bucket 0 also
+ * counts 0), and the last bucket counts everything larger.
+ */
+static inline int latency_bucket(uint64_t ns)
+{
+    int bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+
+    return bucket < QUEUE_N_LATENCY ? bucket : QUEUE_N_LATENCY - 1;
+}
+
+/*
+ * queue_instrument() --Enable instrumentation of a queue.
+ *
+ * Parameters:
+ * queue    --the queue
+ * instrument --the statistics (owned by caller)
+ * stamp    --storage for the timestamps (one per queue item)
+ *
+ * Returns:
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * This must be called before the queue is shared between threads.
+ */
+int queue_instrument(AtomicQueuePtr queue, QueueInstrumentPtr instrument,
+                     uint64_t *stamp)
+{
+    if (queue == NULL || instrument == NULL || stamp == NULL)
+    {
+        return 0;                      /* failure: no queue/storage */
+    }
+    memset((void *) instrument, 0, sizeof(*instrument));
+    instrument->stamp = stamp;
+    queue->instrument = instrument;
+    return 1;                          /* success */
+}
+
+/*
+ * queue_record_write() --Timestamp items as they're published.
+ *
+ * Parameters:
+ * queue    --the queue
+ * n_write  --the producer's count before the items were written
+ * n        --the number of items written
+ */
+void queue_record_write(AtomicQueuePtr queue, unsigned int n_write,
+                        unsigned int n)
+{
+    QueueInstrumentPtr instrument = queue->instrument;
+    uint64_t now = (uint64_t) ns_monotonic();
+    unsigned int depth = n_write + n - ATOMIC_LOAD_RELAXED(&queue->n_read);
+
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        instrument->stamp[(n_write + i) & queue->mask] = now;
+    }
+    if (depth > instrument->peak)
+    {
+        ATOMIC_STORE_RELAXED(&instrument->peak, depth);
+    }
+}
+
+/*
+ * queue_record_read() --Record the latency of items as they're removed.
+ *
+ * Parameters:
+ * queue    --the queue
+ * n_read   --the consumer's count before the items were read
+ * n        --the number of items read
+ */
+void queue_record_read(AtomicQueuePtr queue, unsigned int n_read,
+                       unsigned int n)
+{
+    QueueInstrumentPtr instrument = queue->instrument;
+    uint64_t now = (uint64_t) ns_monotonic();
+
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        uint64_t stamp = instrument->stamp[(n_read + i) & queue->mask];
+        uint64_t *bucket =
+            &instrument->latency[latency_bucket(now > stamp ? now - stamp : 0)];
+
+        ATOMIC_STORE_RELAXED(bucket, *bucket + 1);
+    }
+}
+
+/*
+ * queue_stats() --Take a snapshot of a queue's statistics.
+ *
+ * Parameters:
+ * queue    --the queue
+ * stats    --returns the statistics
+ *
+ * Remarks:
+ * The peak depth and latency histogram are zero if the queue isn't
+ * instrumented.
+ */
+void queue_stats(AtomicQueuePtr queue, QueueStatsPtr stats)
+{
+    QueueInstrumentPtr instrument = queue->instrument;
+    double n_attempt;
+
+    memset((void *) stats, 0, sizeof(*stats));
+    stats->n_read = ATOMIC_LOAD_ACQUIRE(&queue->n_read);
+    stats->n_write = ATOMIC_LOAD_ACQUIRE(&queue->n_write);
+    stats->n_fail = ATOMIC_LOAD_RELAXED(&queue->n_fail);
+    stats->depth = stats->n_write - stats->n_read;
+    n_attempt = (double) stats->n_write + stats->n_fail;
+    stats->fail_rate = n_attempt > 0 ? stats->n_fail / n_attempt : 0.0;
+    if (instrument != NULL)
+    {
+        stats->peak = ATOMIC_LOAD_RELAXED(&instrument->peak);
+        for (int i = 0; i < QUEUE_N_LATENCY; ++i)
+        {
+            stats->latency[i] = ATOMIC_LOAD_RELAXED(&instrument->latency[i]);
+        }
+    }
+}
+
+/*
+ * queue_stats_print() --Print a queue's statistics in "key=value" form.
+ *
+ * Parameters:
+ * fp   --the file to print to
+ * queue    --the queue
+ *
+ * Returns: (int)
+ * The number of characters printed, as for fprintf().
+ *
+ * Remarks:
+ * The statistics are printed on one line, for easy scraping; the
+ * latency histogram is printed as "latency_<n>ns=<count>" for each
+ * non-empty bucket, where n is the bucket's lower bound.
+ */
+int queue_stats_print(FILE *fp, AtomicQueuePtr queue)
+{
+    QueueStats stats;
+    int n;
+
+    queue_stats(queue, &stats);
+    n = fprintf(fp, "n_write=%u n_read=%u n_fail=%d fail_rate=%g"
+                " depth=%u peak=%u",
+                stats.n_write, stats.n_read, stats.n_fail, stats.fail_rate,
+                stats.depth, stats.peak);
+    for (int i = 0; i < QUEUE_N_LATENCY; ++i)
+    {
+        if (stats.latency[i] != 0)
+        {
+            n += fprintf(fp, " latency_%lluns=%llu", 1ull << i,
+                         (unsigned long long) stats.latency[i]);
+        }
+    }
+    n += fprintf(fp, "\n");
+    return n;
+}
+
+/*
+ * queue_collect() --Report a queue's statistics as metrics.
+ */
+static void queue_collect(MetricWriterPtr writer, void *data)
+{
+    QueueStats stats;
+
+    queue_stats((AtomicQueuePtr) data, &stats);
+    metric_write(writer, "apex_queue_writes_total",
+                 "Items written to the queue.", METRIC_COUNTER,
+                 stats.n_write);
+    metric_write(writer, "apex_queue_reads_total",
+                 "Items read from the queue.", METRIC_COUNTER, stats.n_read);
+    metric_write(writer, "apex_queue_write_failures_total",
+                 "Writes that failed because the queue was full.",
+                 METRIC_COUNTER, stats.n_fail);
+    metric_write(writer, "apex_queue_depth",
+                 "Items in the queue.", METRIC_GAUGE, stats.depth);
+    if (((AtomicQueuePtr) data)->instrument != NULL)
+    {
+        metric_write(writer, "apex_queue_peak_depth",
+                     "The maximum depth of the queue.", METRIC_GAUGE,
+                     stats.peak);
+    }
+}
+
+/*
+ * queue_metrics() --Register a queue's statistics as metrics.
+ *
+ * Parameters:
+ * queue    --the queue
+ * name     --the queue's name, reported as the "queue" label
+ *
+ * Returns: (MetricPtr)
+ * Success: the collector (to be released by metric_free() before the
+ * queue is); Failure: NULL.
+ *
+ * Remarks:
+ * The counts are the queue's own (32 bit) counters, so they wrap.
+ */
+MetricPtr queue_metrics(AtomicQueuePtr queue, const char *name)
+{
+    char labels[METRIC_NAME_MAX];
+
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    return metric_collector_new(metric_label(labels, sizeof(labels),
+                                             "queue", name),
+                                queue_collect, queue);
+}
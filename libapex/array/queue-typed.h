@@ -0,0 +1,103 @@
+/*
+ * QUEUE-TYPED.H --Typed, inline atomic queues generated by a macro.
+ *
+ * Contents:
+ * QUEUE_DEFINE()     --Define a (fixed-size) queue type, and its operations.
+ *
+ * Remarks:
+ * The generic AtomicQueue (queue.h) copies items with a memcpy() of
+ * item_size bytes, masks with a run-time mask, and checks for
+ * instrumentation and blocking on every operation.  A queue defined
+ * by QUEUE_DEFINE() has its item type and size (a power of 2) fixed at
+ * compile time, and its storage built in, so a push or pop is an
+ * inline assignment, a constant mask, and one release store.
+ *
+ * e.g.
+ *     QUEUE_DEFINE(EventQueue, Event, 1024)
+ *
+ * defines the type EventQueue, and EventQueue_init(), EventQueue_push(),
+ * EventQueue_pop(), EventQueue_peek() and EventQueue_len().
+ *
+ * Like AtomicQueue, it's lock-free and safe for one producer and one
+ * consumer thread: the counters overflow harmlessly, each side
+ * publishes its counter with release semantics after copying the
+ * item, and the counters are on separate cache lines.  A failed push
+ * increments n_fail, as queue_push() does.  There's no blocking,
+ * instrumentation, or batching; use AtomicQueue for those.
+ */
+#ifndef QUEUE_TYPED_H
+#define QUEUE_TYPED_H
+
+#include <stddef.h>
+#include <apex/atomic.h>
+
+#define QUEUE_DEFINE(name_, type_, n_items_)                            \
+    typedef struct name_##_t                                            \
+    {                                                                   \
+        unsigned int n_write;          /* No. of successful writes */   \
+        int n_fail;                    /* No. of failed writes */       \
+        char pad_0[CACHE_LINE - 2 * sizeof(int)];                       \
+        unsigned int n_read;           /* No. of successful reads */    \
+        char pad_1[CACHE_LINE - sizeof(int)];                           \
+        type_ item[n_items_];                                           \
+    } name_;                                                            \
+                                                                        \
+    typedef char name_##_size_check_   /* n_items_ must be 2^n */       \
+        [((n_items_) & ((n_items_) - 1)) == 0 ? 1 : -1];                \
+                                                                        \
+    static inline name_ *name_##_init(name_ *queue)                     \
+    {                                                                   \
+        queue->n_write = queue->n_read = 0;                             \
+        queue->n_fail = 0;                                              \
+        return queue;                                                   \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_push(name_ *queue, const type_ *value)    \
+    {                                                                   \
+        unsigned int n_write = queue->n_write;  /* (producer-owned) */  \
+                                                                        \
+        if (n_write - ATOMIC_LOAD_ACQUIRE(&queue->n_read)               \
+            >= (unsigned int) (n_items_))                               \
+        {                                                               \
+            ATOMIC_STORE_RELAXED(&queue->n_fail, queue->n_fail + 1);    \
+            return 0;                                                   \
+        }                                                               \
+        queue->item[n_write & ((n_items_) - 1)] = *value;               \
+        ATOMIC_STORE_RELEASE(&queue->n_write, n_write + 1);             \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline type_ *name_##_peek(name_ *queue)                     \
+    {                                                                   \
+        unsigned int n_read = queue->n_read;  /* (consumer-owned) */    \
+                                                                        \
+        if (ATOMIC_LOAD_ACQUIRE(&queue->n_write) == n_read)             \
+        {                                                               \
+            return NULL;                                                \
+        }                                                               \
+        return &queue->item[n_read & ((n_items_) - 1)];                 \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_pop(name_ *queue, type_ *value)           \
+    {                                                                   \
+        type_ *item = name_##_peek(queue);                              \
+                                                                        \
+        if (item == NULL)                                               \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        if (value != NULL)                                              \
+        {                                                               \
+            *value = *item;                                             \
+        }                                                               \
+        ATOMIC_STORE_RELEASE(&queue->n_read, queue->n_read + 1);        \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline unsigned int name_##_len(name_ *queue)                \
+    {                                                                   \
+        return ATOMIC_LOAD_ACQUIRE(&queue->n_write)                     \
+            - ATOMIC_LOAD_ACQUIRE(&queue->n_read);                      \
+    }
+
+#endif /* QUEUE_TYPED_H */
@@ -0,0 +1,308 @@
+/*
+ * QUEUE-WAIT.C --Blocking push/pop for the atomic queue.
+ *
+ * Contents:
+ * queue_wait_init() --Enable blocking operations on a queue.
+ * queue_wait_free() --Release the resources used for blocking.
+ * queue_wake()      --Wake the other side of the queue, if it's waiting.
+ * queue_pop_wait()  --Pop an item from the queue, waiting if it's empty.
+ * queue_push_wait() --Push an item onto the queue, waiting if it's full.
+ * queue_wait_fd()   --Prepare to wait for items with poll()/select().
+ *
+ * Remarks:
+ * A thread that finds the queue empty (full) sets the read_wait
+ * (write_wait) flag, and then re-checks the queue before sleeping on
+ * the other side's counter with futex(2).  The other side publishes
+ * its counter, and then checks the flag; a full barrier on both sides
+ * guarantees that at least one of them sees the other's store, so a
+ * wake-up can't be lost.  The queue's non-blocking operations only pay
+ * for this (a barrier and a load) if queue_wait_init() has been called.
+ *
+ * The consumer may instead wait on an eventfd, which can be combined
+ * with other file descriptors in wait_input() (i.e. select()).  On
+ * systems without futex(2) the blocking operations poll with a short
+ * sleep, and there is no eventfd.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <apex/queue.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+#define QUEUE_POLL_NSEC 1000000        /* fallback polling interval: 1ms */
+
+/*
+ * futex_wait() --Sleep while *addr == value, or until the deadline.
+ *
+ * Returns:
+ * Success: 1 (woken, or *addr changed); Failure: 0 (timed out).
+ */
+static int futex_wait(unsigned int *addr, unsigned int value,
+                      const struct timespec *deadline)
+{
+    struct timespec now, timeout = { 0, QUEUE_POLL_NSEC };
+
+    if (deadline != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout.tv_sec = deadline->tv_sec - now.tv_sec;
+        timeout.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if (timeout.tv_nsec < 0)
+        {
+            timeout.tv_nsec += 1000000000;
+            timeout.tv_sec -= 1;
+        }
+        if (timeout.tv_sec < 0)
+        {
+            return 0;                  /* failure: deadline has passed */
+        }
+    }
+#ifdef __linux__
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value,
+                deadline != NULL ? &timeout : NULL, NULL, 0) != 0
+        && errno == ETIMEDOUT)
+    {
+        return 0;                      /* failure: timed out */
+    }
+#else
+    if (deadline == NULL || timeout.tv_sec > 0
+        || timeout.tv_nsec > QUEUE_POLL_NSEC)
+    {
+        timeout.tv_sec = 0;
+        timeout.tv_nsec = QUEUE_POLL_NSEC;
+    }
+    if (ATOMIC_LOAD_ACQUIRE(addr) == value)
+    {
+        nanosleep(&timeout, NULL);
+    }
+#endif /* __linux__ */
+    return 1;                          /* success: woken (maybe spuriously) */
+}
+
+/*
+ * get_deadline() --Convert a relative timeout into an absolute deadline.
+ *
+ * Returns: (struct timespec *)
+ * deadline, or NULL if there's no timeout.
+ */
+static struct timespec *get_deadline(TimeValuePtr timeout,
+                                     struct timespec *deadline)
+{
+    if (timeout == NULL)
+    {
+        return NULL;                   /* no timeout: wait forever */
+    }
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout->tv_sec;
+    deadline->tv_nsec += timeout->tv_usec * 1000;
+    if (deadline->tv_nsec >= 1000000000)
+    {
+        deadline->tv_nsec -= 1000000000;
+        deadline->tv_sec += 1;
+    }
+    return deadline;
+}
+
+/*
+ * queue_wait_init() --Enable blocking operations on a queue.
+ *
+ * Parameters:
+ * queue    --the queue
+ * use_fd   --if true, create an eventfd for queue_wait_fd()
+ *
+ * Returns:
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * This must be called before the queue is shared between threads.
+ */
+int queue_wait_init(AtomicQueuePtr queue, int use_fd)
+{
+    if (queue == NULL)
+    {
+        return 0;                      /* failure: no queue! */
+    }
+    if (use_fd && queue->wait_fd < 0)
+    {
+#ifdef __linux__
+        if ((queue->wait_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        {
+            return 0;                  /* failure: no eventfd */
+        }
+#else
+        errno = ENOSYS;
+        return 0;                      /* failure: no eventfd */
+#endif /* __linux__ */
+    }
+    queue->wait = 1;
+    return 1;                          /* success */
+}
+
+/*
+ * queue_wait_free() --Release the resources used for blocking.
+ */
+void queue_wait_free(AtomicQueuePtr queue)
+{
+    if (queue != NULL && queue->wait_fd >= 0)
+    {
+        close(queue->wait_fd);
+        queue->wait_fd = -1;
+    }
+}
+
+/*
+ * queue_wake() --Wake the other side of the queue, if it's waiting.
+ *
+ * Parameters:
+ * queue    --the queue
+ * flag     --the other side's waiting flag
+ * counter  --this side's (just published) counter
+ *
+ * Remarks:
+ * This is called by the queue's push/pop operations when blocking is
+ * enabled; callers don't normally need it.
+ */
+void queue_wake(AtomicQueuePtr queue, unsigned int *flag,
+                unsigned int *counter)
+{
+    ATOMIC_FENCE();                    /* (order counter store/flag load) */
+    if (ATOMIC_LOAD_RELAXED(flag))
+    {
+        ATOMIC_STORE_RELAXED(flag, 0);
+#ifdef __linux__
+        syscall(SYS_futex, counter, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        if (flag == &queue->read_wait && queue->wait_fd >= 0)
+        {
+            uint64_t one = 1;
+
+            if (write(queue->wait_fd, &one, sizeof(one)) < 0)
+            {                          /* (EAGAIN: already signalled) */
+                return;
+            }
+        }
+#else
+        (void) queue;
+        (void) counter;
+#endif /* __linux__ */
+    }
+}
+
+/*
+ * queue_pop_wait() --Pop an item from the queue, waiting if it's empty.
+ *
+ * Parameters:
+ * queue    --the queue to read from
+ * item     --returns the item
+ * timeout  --the maximum time to wait (NULL: wait forever)
+ *
+ * Returns:
+ * Success: 1; Failure: 0 (timed out, or blocking isn't enabled).
+ */
+int queue_pop_wait(AtomicQueuePtr queue, void *item, TimeValuePtr timeout)
+{
+    struct timespec deadline_buf;
+    struct timespec *deadline = get_deadline(timeout, &deadline_buf);
+
+    if (queue == NULL || item == NULL || !queue->wait)
+    {
+        return 0;                      /* failure: no queue/item/blocking */
+    }
+    while (!queue_pop(queue, item))
+    {
+        unsigned int n_write = queue->n_read;  /* (i.e. it was empty) */
+
+        ATOMIC_STORE_RELAXED(&queue->read_wait, 1);
+        ATOMIC_FENCE();
+        if (ATOMIC_LOAD_ACQUIRE(&queue->n_write) == n_write
+            && !futex_wait(&queue->n_write, n_write, deadline))
+        {
+            return 0;                  /* failure: timed out */
+        }
+    }
+    return 1;                          /* success: item copied */
+}
+
+/*
+ * queue_push_wait() --Push an item onto the queue, waiting if it's full.
+ *
+ * Parameters:
+ * queue    --the queue to receive the item
+ * item     --the item to insert
+ * timeout  --the maximum time to wait (NULL: wait forever)
+ *
+ * Returns:
+ * Success: 1; Failure: 0 (timed out, or blocking isn't enabled).
+ *
+ * Remarks:
+ * Each failed attempt is counted in n_fail, as for queue_push().
+ */
+int queue_push_wait(AtomicQueuePtr queue, const void *item,
+                    TimeValuePtr timeout)
+{
+    struct timespec deadline_buf;
+    struct timespec *deadline = get_deadline(timeout, &deadline_buf);
+
+    if (queue == NULL || item == NULL || !queue->wait)
+    {
+        return 0;                      /* failure: no queue/item/blocking */
+    }
+    while (!queue_push(queue, item))
+    {                                  /* full: n_read == n_write - size */
+        unsigned int n_read = queue->n_write - (unsigned int) queue->mask - 1;
+
+        ATOMIC_STORE_RELAXED(&queue->write_wait, 1);
+        ATOMIC_FENCE();
+        if (ATOMIC_LOAD_ACQUIRE(&queue->n_read) == n_read
+            && !futex_wait(&queue->n_read, n_read, deadline))
+        {
+            return 0;                  /* failure: timed out */
+        }
+    }
+    return 1;                          /* success */
+}
+
+/*
+ * queue_wait_fd() --Prepare to wait for items with poll()/select().
+ *
+ * Parameters:
+ * queue    --the queue
+ *
+ * Returns:
+ * Success: the queue's eventfd; Failure: -1 (no eventfd).
+ *
+ * Remarks:
+ * The consumer calls this immediately before waiting (e.g. with
+ * wait_input()), and drains the queue with queue_pop() when the fd
+ * becomes readable.  The fd is reset here, and becomes readable again
+ * when the queue is non-empty (i.e. at once, if it isn't empty now).
+ */
+int queue_wait_fd(AtomicQueuePtr queue)
+{
+    if (queue == NULL || queue->wait_fd < 0)
+    {
+        return -1;                     /* failure: no eventfd */
+    }
+#ifdef __linux__
+    {
+        uint64_t count;
+
+        if (read(queue->wait_fd, &count, sizeof(count)) < 0)
+        {                              /* (EAGAIN: wasn't signalled) */
+            count = 0;
+        }
+        ATOMIC_STORE_RELAXED(&queue->read_wait, 1);
+        ATOMIC_FENCE();
+        if (ATOMIC_LOAD_ACQUIRE(&queue->n_write) != queue->n_read)
+        {                              /* not empty: wake ourselves */
+            queue_wake(queue, &queue->read_wait, &queue->n_write);
+        }
+    }
+#endif /* __linux__ */
+    return queue->wait_fd;
+}
@@ -8,6 +8,22 @@
  * queue_push()  --Push an item onto the queue.
  * queue_pop()   --Pop an item from the queue.
  * queue_peek()  --Read, but do not remove, an item from the queue.
+ * queue_push_n() --Push several items onto the queue.
+ * queue_pop_n()  --Pop several items from the queue.
+ * queue_reserve() --Reserve space for an item in the queue.
+ * queue_commit()  --Publish the item most recently reserved.
+ * queue_acquire() --Get the address of the next item in the queue.
+ * queue_release() --Remove the item most recently acquired.
+ *
+ * Remarks:
+ * These routines are lock-free, and safe for one producer thread
+ * (calling queue_push()) and one consumer thread (calling queue_pop()
+ * and queue_peek()) to use concurrently.  Each side reads its own
+ * counter without synchronisation, and acquires the other side's.
+ *
+ * queue_reserve()/queue_commit() (and queue_acquire()/queue_release())
+ * let the producer (consumer) work on an item in place in the queue's
+ * working storage, avoiding the copy done by queue_push() (queue_pop()).
  */
 #include <errno.h>
 #include <string.h>
@@ -83,9 +99,50 @@ AtomicQueuePtr queue_init(AtomicQueuePtr queue, int n_items,
         return NULL;                   /* error: bad size */
     }
     array_init(&queue->array, n_items, item_size, base);
+    queue->wait_fd = -1;
     return queue;                      /* success: queue is initialised */
 }
 
+/*
+ * queue_publish_write() --Publish n items written by the producer.
+ *
+ * Remarks:
+ * If instrumentation is enabled (see queue_instrument()) this
+ * timestamps the items first; if blocking is enabled (see
+ * queue_wait_init()) it then wakes a consumer that is blocked on an
+ * empty queue.
+ */
+static inline void queue_publish_write(AtomicQueuePtr queue,
+                                       unsigned int n_write, unsigned int n)
+{
+    if (queue->instrument != NULL)
+    {
+        queue_record_write(queue, n_write, n);
+    }
+    ATOMIC_STORE_RELEASE(&queue->n_write, n_write + n);
+    if (queue->wait)
+    {
+        queue_wake(queue, &queue->read_wait, &queue->n_write);
+    }
+}
+
+/*
+ * queue_publish_read() --Publish n items read by the consumer.
+ */
+static inline void queue_publish_read(AtomicQueuePtr queue,
+                                      unsigned int n_read, unsigned int n)
+{
+    if (queue->instrument != NULL)
+    {
+        queue_record_read(queue, n_read, n);
+    }
+    ATOMIC_STORE_RELEASE(&queue->n_read, n_read + n);
+    if (queue->wait)
+    {
+        queue_wake(queue, &queue->write_wait, &queue->n_read);
+    }
+}
+
 /*
  * queue_push() --Push an item onto the queue.
  *
@@ -99,19 +156,23 @@ AtomicQueuePtr queue_init(AtomicQueuePtr queue, int n_items,
  */
 int queue_push(AtomicQueuePtr queue, const void *item)
 {
+    unsigned int n_write;
+
     if (queue == NULL || item == NULL)
     {
         return 0;                      /* failure: no queue, or no item! */
     }
-    if (queue->n_write - queue->n_read > queue->mask)
+    n_write = queue->n_write;          /* (producer-owned) */
+    if (n_write - ATOMIC_LOAD_ACQUIRE(&queue->n_read) >
+        (unsigned int) queue->mask)
     {
-        queue->n_fail++;               /* remember failures */
+        ATOMIC_STORE_RELAXED(&queue->n_fail, queue->n_fail + 1);
         return 0;                      /* failure: queue is full */
     }
     memcpy(queue->array.base
-           + queue->array.item_size * (queue->n_write & queue->mask),
+           + queue->array.item_size * (n_write & queue->mask),
            item, queue->array.item_size);
-    queue->n_write++;
+    queue_publish_write(queue, n_write, 1);
     return 1;                          /* success */
 }
 
@@ -131,7 +192,7 @@ int queue_pop(AtomicQueuePtr queue, void *item)
 {
     if (queue_peek(queue, item))
     {
-        queue->n_read++;
+        queue_publish_read(queue, queue->n_read, 1);
         return 1;                      /* success: item copied */
     }
     return 0;                          /* failure: empty queue */
@@ -155,10 +216,12 @@ void *queue_peek(AtomicQueuePtr queue, void *item)
 
     if (queue != NULL)
     {
-        if (queue->n_write != queue->n_read)
+        unsigned int n_read = queue->n_read;   /* (consumer-owned) */
+
+        if (ATOMIC_LOAD_ACQUIRE(&queue->n_write) != n_read)
         {
             queue_item = queue->array.base
-                + queue->array.item_size * (queue->n_read & queue->mask);
+                + queue->array.item_size * (n_read & queue->mask);
             if (item != NULL)
             {
                 memcpy(item, queue_item, queue->array.item_size);
@@ -167,3 +230,195 @@ void *queue_peek(AtomicQueuePtr queue, void *item)
     }
     return queue_item;                 /* success: item, failure: NULL */
 }
+
+/*
+ * queue_push_n() --Push several items onto the queue.
+ *
+ * Parameters:
+ * queue --the queue to receive the items
+ * items --the (contiguous array of) items to insert
+ * n_items --the number of items to insert
+ *
+ * Returns:
+ * The number of items pushed, which may be less than n_items (or 0)
+ * if the queue is full.
+ *
+ * Remarks:
+ * The items are copied with at most two memcpy()s (the second is
+ * needed only if the free space wraps around the end of the working
+ * storage), and n_write is published once, so the consumer sees the
+ * whole batch at once.
+ */
+size_t queue_push_n(AtomicQueuePtr queue, const void *items, size_t n_items)
+{
+    unsigned int n_write, slot;
+    size_t n, n_tail, item_size;
+
+    if (queue == NULL || items == NULL || n_items == 0)
+    {
+        return 0;                      /* failure: no queue, or no items! */
+    }
+    n_write = queue->n_write;          /* (producer-owned) */
+    n = (size_t) queue->mask + 1
+        - (n_write - ATOMIC_LOAD_ACQUIRE(&queue->n_read));
+    if (n == 0)
+    {
+        ATOMIC_STORE_RELAXED(&queue->n_fail, queue->n_fail + 1);
+        return 0;                      /* failure: queue is full */
+    }
+    if (n > n_items)
+    {
+        n = n_items;
+    }
+    item_size = queue->array.item_size;
+    slot = n_write & queue->mask;
+    n_tail = (size_t) queue->mask + 1 - slot;
+    if (n_tail > n)
+    {
+        n_tail = n;
+    }
+    memcpy(queue->array.base + item_size * slot, items, item_size * n_tail);
+    memcpy(queue->array.base, (const char *) items + item_size * n_tail,
+           item_size * (n - n_tail));
+    queue_publish_write(queue, n_write, (unsigned int) n);
+    return n;                          /* success: some items pushed */
+}
+
+/*
+ * queue_pop_n() --Pop several items from the queue.
+ *
+ * Parameters:
+ * queue --the queue to read from
+ * items --returns the items (space for n_items)
+ * n_items --the maximum number of items to pop
+ *
+ * Returns:
+ * The number of items popped, which may be less than n_items (or 0)
+ * if the queue is empty.
+ */
+size_t queue_pop_n(AtomicQueuePtr queue, void *items, size_t n_items)
+{
+    unsigned int n_read, slot;
+    size_t n, n_tail, item_size;
+
+    if (queue == NULL || items == NULL || n_items == 0)
+    {
+        return 0;                      /* failure: no queue, or no items! */
+    }
+    n_read = queue->n_read;            /* (consumer-owned) */
+    n = ATOMIC_LOAD_ACQUIRE(&queue->n_write) - n_read;
+    if (n == 0)
+    {
+        return 0;                      /* failure: queue is empty */
+    }
+    if (n > n_items)
+    {
+        n = n_items;
+    }
+    item_size = queue->array.item_size;
+    slot = n_read & queue->mask;
+    n_tail = (size_t) queue->mask + 1 - slot;
+    if (n_tail > n)
+    {
+        n_tail = n;
+    }
+    memcpy(items, queue->array.base + item_size * slot, item_size * n_tail);
+    memcpy((char *) items + item_size * n_tail, queue->array.base,
+           item_size * (n - n_tail));
+    queue_publish_read(queue, n_read, (unsigned int) n);
+    return n;                          /* success: some items popped */
+}
+
+/*
+ * queue_reserve() --Reserve space for an item in the queue.
+ *
+ * Parameters:
+ * queue --the queue to receive the item
+ *
+ * Returns:
+ * Success: the address of the item's slot; Failure: NULL (queue full).
+ *
+ * Remarks:
+ * The slot is not visible to the consumer until queue_commit() is
+ * called, and the producer may reserve only one item at a time.
+ */
+void *queue_reserve(AtomicQueuePtr queue)
+{
+    unsigned int n_write;
+
+    if (queue == NULL)
+    {
+        return NULL;                   /* failure: no queue! */
+    }
+    n_write = queue->n_write;          /* (producer-owned) */
+    if (n_write - ATOMIC_LOAD_ACQUIRE(&queue->n_read) >
+        (unsigned int) queue->mask)
+    {
+        ATOMIC_STORE_RELAXED(&queue->n_fail, queue->n_fail + 1);
+        return NULL;                   /* failure: queue is full */
+    }
+    return queue->array.base
+        + queue->array.item_size * (n_write & queue->mask);
+}
+
+/*
+ * queue_commit() --Publish the item most recently reserved.
+ *
+ * Parameters:
+ * queue --the queue
+ *
+ * Returns:
+ * Success: 1; Failure: 0 (no queue, or it's full).
+ *
+ * Remarks:
+ * The space is checked again, as queue_reserve() does, so that a
+ * commit after a failed reservation can't overwrite unread items.
+ */
+int queue_commit(AtomicQueuePtr queue)
+{
+    if (queue == NULL
+        || queue->n_write - ATOMIC_LOAD_ACQUIRE(&queue->n_read) >
+        (unsigned int) queue->mask)
+    {
+        return 0;                      /* failure: no queue, or no space */
+    }
+    queue_publish_write(queue, queue->n_write, 1);
+    return 1;                          /* success */
+}
+
+/*
+ * queue_acquire() --Get the address of the next item in the queue.
+ *
+ * Parameters:
+ * queue --the queue to read from
+ *
+ * Returns:
+ * Success: the address of the item; Failure: NULL (queue empty).
+ *
+ * Remarks:
+ * The item remains in the queue (and its slot won't be re-used by the
+ * producer) until queue_release() is called.
+ */
+void *queue_acquire(AtomicQueuePtr queue)
+{
+    return queue_peek(queue, NULL);
+}
+
+/*
+ * queue_release() --Remove the item most recently acquired.
+ *
+ * Parameters:
+ * queue --the queue
+ *
+ * Returns:
+ * Success: 1; Failure: 0.
+ */
+int queue_release(AtomicQueuePtr queue)
+{
+    if (queue == NULL || ATOMIC_LOAD_ACQUIRE(&queue->n_write) == queue->n_read)
+    {
+        return 0;                      /* failure: no queue, or no item */
+    }
+    queue_publish_read(queue, queue->n_read, 1);
+    return 1;                          /* success */
+}
@@ -3,9 +3,15 @@
  *
  * Contents:
  * AtomicQueue_t{} --The state of a queue and its working storage.
+ * MPMCQueue_t{}   --The state of a multi-producer, multi-consumer queue.
+ * GrowQueue_t{}   --An unbounded queue built from a chain of rings.
+ * QueueInstrument_t{} --Optional depth and latency statistics for a queue.
+ * QueueStats_t{}  --A snapshot of a queue's counters and statistics.
  *
  * Remarks:
- * This queue is thread safe for single-producer, single-consumer.
+ * AtomicQueue is lock-free and thread safe for single-producer,
+ * single-consumer.  MPMCQueue is lock-free for any number of
+ * producers and consumers, at the cost of a sequence number per item.
  */
 #ifndef QUEUE_H
 #define QUEUE_H
@@ -14,27 +20,139 @@ extern "C"
 {
 #endif                                 /* C++ */
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <apex/array.h>
+#include <apex/atomic.h>
+#include <apex/metrics.h>
+#include <apex/timeval.h>
     /*
      * AtomicQueue_t{} --The state of a queue and its working storage.
      *
      * Remarks:
      * The queue counts the No. of reads and writes as simple
-     * integers, allowing them to simply overflow.  This strategy
-     * works if the size of the queue is a power of 2
-     * (guaranteed by `queue_init`), and it relies on "natural"
-     * int arithmetic to be atomic for its thread safety.
+     * unsigned integers, allowing them to simply overflow.  This
+     * strategy works if the size of the queue is a power of 2
+     * (guaranteed by `queue_init`).  The producer publishes n_write
+     * (and the consumer n_read) with release semantics, after the
+     * item has been copied, so the other side never sees a partial
+     * item.  The counters are padded onto separate cache lines so
+     * that the producer and consumer don't contend for them.
+     *
+     * The write_wait/read_wait flags are set by a blocked producer
+     * (consumer), and checked by the other side after it publishes
+     * its counter (only if blocking has been enabled).
      */
+    enum
+    {
+        QUEUE_N_LATENCY = 40           /* latency buckets: [2^i, 2^(i+1)) ns */
+    };
+
+    /*
+     * QueueInstrument_t{} --Optional depth and latency statistics for a queue.
+     *
+     * Remarks:
+     * The producer records each item's enqueue time in stamp[] (one per
+     * item slot, like MPMCQueue's seq[]), and updates peak; the
+     * consumer updates the latency histogram as it removes items.
+     */
+    typedef struct QueueInstrument_t
+    {
+        uint64_t *stamp;               /* enqueue times (ns), per slot */
+        unsigned int peak;             /* maximum depth seen (producer) */
+        char pad_0[CACHE_LINE];
+
+        uint64_t latency[QUEUE_N_LATENCY];     /* (consumer) */
+    } QueueInstrument, *QueueInstrumentPtr;
+
+    typedef struct QueueStats_t
+    {
+        unsigned int n_write;          /* No. of successful writes */
+        unsigned int n_read;           /* No. of successful reads */
+        int n_fail;                    /* No. of failed writes */
+        double fail_rate;              /* n_fail/(n_write + n_fail) */
+        unsigned int depth;            /* No. of items now in the queue */
+        unsigned int peak;             /* maximum depth (if instrumented) */
+        uint64_t latency[QUEUE_N_LATENCY];     /* (if instrumented) */
+    } QueueStats, *QueueStatsPtr;
+
     typedef struct AtomicQueue_t
     {
         ArrayContainer array;          /* Queue contents. */
+        int mask;                      /* True size of working storage, as a mask. */
+        int wait;                      /* blocking push/pop is enabled */
+        int wait_fd;                   /* eventfd signalled for the consumer */
+        QueueInstrumentPtr instrument; /* statistics, or NULL */
+        char pad_0[CACHE_LINE];
 
-        int n_read;                    /* No. of successful reads */
-        int n_write;                   /* No. of successful writes  */
+        unsigned int n_write;          /* No. of successful writes  */
         int n_fail;                    /* No. of failed writes  */
-        int mask;                      /* True size of working storage, as a mask. */
+        unsigned int write_wait;       /* producer is waiting for space */
+        char pad_1[CACHE_LINE];
+
+        unsigned int n_read;           /* No. of successful reads */
+        unsigned int read_wait;        /* consumer is waiting for items */
+        char pad_2[CACHE_LINE];
     } AtomicQueue, *AtomicQueuePtr;
 
+    /*
+     * MPMCQueue_t{} --The state of a multi-producer, multi-consumer queue.
+     *
+     * Remarks:
+     * Each item slot has a sequence number that records whether it is
+     * ready to be written or to be read for the current "lap" of the
+     * queue; producers (consumers) claim a slot by advancing n_write
+     * (n_read) with compare-and-swap.
+     *
+     * See Also:
+     * http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+     */
+    typedef struct MPMCQueue_t
+    {
+        ArrayContainer array;          /* Queue contents. */
+        unsigned int *seq;             /* per-item sequence numbers */
+        int mask;                      /* True size of working storage, as a mask. */
+        char pad_0[CACHE_LINE];
+
+        unsigned int n_write;          /* No. of claimed writes */
+        int n_fail;                    /* No. of failed writes */
+        char pad_1[CACHE_LINE];
+
+        unsigned int n_read;           /* No. of claimed reads */
+        char pad_2[CACHE_LINE];
+    } MPMCQueue, *MPMCQueuePtr;
+
+    /*
+     * GrowQueue_t{} --An unbounded queue built from a chain of rings.
+     *
+     * Remarks:
+     * The queue is a list of segments, each an AtomicQueue with its
+     * own storage.  The producer pushes onto the tail segment, and
+     * when that's full it links a new segment (twice the size) after
+     * it; the consumer pops from the head segment, and frees it once
+     * it's drained and has a successor.  Like AtomicQueue, it's safe
+     * for one producer and one consumer.
+     */
+    typedef struct QueueSegment_t
+    {
+        struct QueueSegment_t *next;   /* next (newer) segment, or NULL */
+        AtomicQueue queue;
+    } QueueSegment, *QueueSegmentPtr;
+
+    typedef struct GrowQueue_t
+    {
+        int n_items;                   /* size of the first segment */
+        int item_size;
+        char pad_0[CACHE_LINE];
+
+        QueueSegmentPtr tail;          /* (producer-owned) */
+        int n_segment;                 /* No. of segments ever allocated */
+        char pad_1[CACHE_LINE];
+
+        QueueSegmentPtr head;          /* (consumer-owned) */
+        char pad_2[CACHE_LINE];
+    } GrowQueue, *GrowQueuePtr;
+
     int queue_mask(int n, int *mask);
     AtomicQueuePtr queue_alloc(void);
     AtomicQueuePtr queue_init(AtomicQueuePtr queue, int n_items,
@@ -43,12 +161,53 @@ extern "C"
     int queue_push(AtomicQueuePtr queue, const void *item);
     int queue_pop(AtomicQueuePtr queue, void *item);
     void *queue_peek(AtomicQueuePtr queue, void *item);
+    size_t queue_push_n(AtomicQueuePtr queue, const void *items,
+                        size_t n_items);
+    size_t queue_pop_n(AtomicQueuePtr queue, void *items, size_t n_items);
+
+    void *queue_reserve(AtomicQueuePtr queue);
+    int queue_commit(AtomicQueuePtr queue);
+    void *queue_acquire(AtomicQueuePtr queue);
+    int queue_release(AtomicQueuePtr queue);
+
+    int queue_wait_init(AtomicQueuePtr queue, int use_fd);
+    void queue_wait_free(AtomicQueuePtr queue);
+    int queue_pop_wait(AtomicQueuePtr queue, void *item, TimeValuePtr timeout);
+    int queue_push_wait(AtomicQueuePtr queue, const void *item,
+                        TimeValuePtr timeout);
+    int queue_wait_fd(AtomicQueuePtr queue);
+    void queue_wake(AtomicQueuePtr queue, unsigned int *flag,
+                    unsigned int *counter);
+
+    int queue_instrument(AtomicQueuePtr queue,
+                         QueueInstrumentPtr instrument, uint64_t *stamp);
+    void queue_record_write(AtomicQueuePtr queue, unsigned int n_write,
+                            unsigned int n);
+    void queue_record_read(AtomicQueuePtr queue, unsigned int n_read,
+                           unsigned int n);
+    void queue_stats(AtomicQueuePtr queue, QueueStatsPtr stats);
+    int queue_stats_print(FILE *fp, AtomicQueuePtr queue);
+    MetricPtr queue_metrics(AtomicQueuePtr queue, const char *name);
+
+    MPMCQueuePtr mpmc_queue_init(MPMCQueuePtr queue, int n_items,
+                                 int item_size, void *items,
+                                 unsigned int *seq);
+    int mpmc_queue_push(MPMCQueuePtr queue, const void *item);
+    int mpmc_queue_pop(MPMCQueuePtr queue, void *item);
+
+    GrowQueuePtr grow_queue_init(GrowQueuePtr queue, int n_items,
+                                 int item_size);
+    void grow_queue_free(GrowQueuePtr queue);
+    int grow_queue_push(GrowQueuePtr queue, const void *item);
+    int grow_queue_pop(GrowQueuePtr queue, void *item);
 
     /*
      * Convenience functions for malloc and item-size aware initialisation.
      */
 #define new_queue(items) init_queue(queue_alloc(), items)
 #define init_queue(queue, items) queue_init(queue, NEL(items), sizeof(items[0]), items)
+#define init_mpmc_queue(queue, items, seq) \
+    mpmc_queue_init(queue, NEL(items), sizeof(items[0]), items, seq)
 
 #ifdef __cplusplus
 }
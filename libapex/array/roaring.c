@@ -0,0 +1,638 @@
+/*
+ * ROARING.C --Compressed ("roaring") bitmaps of 32-bit values.
+ *
+ * Contents:
+ * find()           --Find the first container with a key >= key.
+ * array_find()     --Find the first array slot with a value >= low.
+ * to_bitset()      --Convert an array container to a bitset.
+ * to_array()       --Convert a bitset container to an array.
+ * container_free() --Free a container's members.
+ * container_add()  --Add a (low 16 bit) value to a container.
+ * container_remove() --Remove a (low 16 bit) value from a container.
+ * merge_arrays()   --Combine two array containers.
+ * container_op()   --Combine a container with another, in place.
+ * insert_container() --Insert an empty container.
+ * drop_container() --Remove a container.
+ * roaring_new()    --Create an (empty) roaring bitmap.
+ * roaring_free()   --Free a roaring bitmap.
+ * roaring_clear()  --Remove all the members of a roaring bitmap.
+ * roaring_add()    --Add a value.
+ * roaring_remove() --Remove a value.
+ * roaring_contains() --Test for a value.
+ * roaring_count()  --Return the No. of members.
+ * roaring_next()   --Find the first member >= from.
+ * roaring_op()     --Combine a roaring bitmap with another, in place.
+ * roaring_bytes()  --Return the memory used by a roaring bitmap.
+ *
+ * Remarks:
+ * Two array containers are combined by merging them; otherwise an
+ * array container is expanded into a bitset (on the stack, if it's
+ * src), and the bitsets are combined by bits_op_() (i.e. with AVX2,
+ * where available).  The result is converted back to an array if it
+ * has ROARING_ARRAY_MAX members or fewer.
+ *
+ * See Also:
+ * Chambi, Lemire, Kaser, Godin: Better bitmap performance with
+ * Roaring bitmaps (2016).
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <apex.h>
+#include <apex/atomic.h>               /* CACHE_LINE */
+#include <apex/bitset.h>
+
+#define HIGH(value_) ((uint16_t) ((value_) >> 16))
+#define LOW(value_) ((uint16_t) ((value_) & 0xffff))
+
+/*
+ * find() --Find the first container with a key >= key.
+ */
+static size_t find(const Roaring * r, uint16_t key)
+{
+    size_t lo = 0, hi = r->n_container;
+
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+
+        if (r->container[mid].key < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * array_find() --Find the first array slot with a value >= low.
+ */
+static uint32_t array_find(const RoaringContainer * c, uint16_t low)
+{
+    uint32_t lo = 0, hi = c->n;
+
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (c->array[mid] < low)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * to_bitset() --Convert an array container to a bitset.
+ */
+static int to_bitset(RoaringContainerPtr c)
+{
+    uint64_t *bits;
+
+    if (posix_memalign((void **) &bits, CACHE_LINE,
+                       ROARING_BITSET_WORDS * sizeof(uint64_t)) != 0)
+    {
+        return 0;
+    }
+    memset(bits, 0, ROARING_BITSET_WORDS * sizeof(uint64_t));
+    for (uint32_t i = 0; i < c->n; ++i)
+    {
+        bits[c->array[i] / 64] |= 1ULL << (c->array[i] % 64);
+    }
+    free(c->array);
+    c->bits = bits;
+    c->is_bitset = 1;
+    c->n_alloc = 0;
+    return 1;
+}
+
+/*
+ * to_array() --Convert a bitset container to an array.
+ *
+ * Remarks:
+ * If this fails, the container simply stays a bitset.
+ */
+static int to_array(RoaringContainerPtr c)
+{
+    uint16_t *array = malloc(MAX(c->n, 1) * sizeof(uint16_t));
+    uint32_t n = 0;
+
+    if (array == NULL)
+    {
+        return 0;
+    }
+    for (uint32_t w = 0; w < ROARING_BITSET_WORDS; ++w)
+    {
+        for (uint64_t x = c->bits[w]; x != 0; x &= x - 1)
+        {
+            array[n++] = (uint16_t) (w * 64 + __builtin_ctzll(x));
+        }
+    }
+    free(c->bits);
+    c->array = array;
+    c->is_bitset = 0;
+    c->n_alloc = MAX(c->n, 1);
+    return 1;
+}
+
+/*
+ * container_free() --Free a container's members.
+ */
+static void container_free(RoaringContainerPtr c)
+{
+    if (c->is_bitset)
+    {
+        free(c->bits);
+    }
+    else
+    {
+        free(c->array);
+    }
+}
+
+/*
+ * container_add() --Add a (low 16 bit) value to a container.
+ *
+ * Returns: (int)
+ * 1: added; 0: already a member; -1: no memory.
+ */
+static int container_add(RoaringContainerPtr c, uint16_t low)
+{
+    uint32_t i;
+
+    if (!c->is_bitset)
+    {
+        i = array_find(c, low);
+        if (i < c->n && c->array[i] == low)
+        {
+            return 0;
+        }
+        if (c->n < ROARING_ARRAY_MAX)
+        {
+            if (c->n == c->n_alloc)
+            {
+                uint32_t n_alloc = MIN(MAX(2 * c->n_alloc, 4),
+                                       ROARING_ARRAY_MAX);
+                uint16_t *array = realloc(c->array,
+                                          n_alloc * sizeof(uint16_t));
+
+                if (array == NULL)
+                {
+                    return -1;
+                }
+                c->array = array;
+                c->n_alloc = n_alloc;
+            }
+            memmove(c->array + i + 1, c->array + i,
+                    (c->n - i) * sizeof(uint16_t));
+            c->array[i] = low;
+            c->n += 1;
+            return 1;
+        }
+        if (!to_bitset(c))
+        {
+            return -1;
+        }
+    }
+    if (c->bits[low / 64] & (1ULL << (low % 64)))
+    {
+        return 0;
+    }
+    c->bits[low / 64] |= 1ULL << (low % 64);
+    c->n += 1;
+    return 1;
+}
+
+/*
+ * container_remove() --Remove a (low 16 bit) value from a container.
+ *
+ * Returns: (int)
+ * 1: removed; 0: not a member.
+ */
+static int container_remove(RoaringContainerPtr c, uint16_t low)
+{
+    uint32_t i;
+
+    if (c->is_bitset)
+    {
+        if (!(c->bits[low / 64] & (1ULL << (low % 64))))
+        {
+            return 0;
+        }
+        c->bits[low / 64] &= ~(1ULL << (low % 64));
+        if (--c->n <= ROARING_ARRAY_MAX)
+        {
+            to_array(c);
+        }
+        return 1;
+    }
+    i = array_find(c, low);
+    if (i >= c->n || c->array[i] != low)
+    {
+        return 0;
+    }
+    memmove(c->array + i, c->array + i + 1,
+            (c->n - i - 1) * sizeof(uint16_t));
+    c->n -= 1;
+    return 1;
+}
+
+/*
+ * merge_arrays() --Combine two array containers.
+ */
+static int merge_arrays(RoaringContainerPtr dst, const RoaringContainer * src,
+                        BitsetOp op)
+{
+    uint32_t size = (op == BITSET_OR || op == BITSET_XOR)
+        ? dst->n + src->n : dst->n;
+    uint16_t *out = malloc(MAX(size, 1) * sizeof(uint16_t));
+    uint32_t i = 0, j = 0, n = 0;
+    int keep_a = op != BITSET_AND, keep_b = op == BITSET_OR
+        || op == BITSET_XOR, keep_both = op == BITSET_AND
+        || op == BITSET_OR;
+
+    if (out == NULL)
+    {
+        return 0;
+    }
+    while (i < dst->n && j < src->n)
+    {
+        uint16_t a = dst->array[i], b = src->array[j];
+
+        if (a < b)
+        {
+            if (keep_a)
+            {
+                out[n++] = a;
+            }
+            ++i;
+        }
+        else if (b < a)
+        {
+            if (keep_b)
+            {
+                out[n++] = b;
+            }
+            ++j;
+        }
+        else
+        {
+            if (keep_both)
+            {
+                out[n++] = a;
+            }
+            ++i, ++j;
+        }
+    }
+    for (; keep_a && i < dst->n; ++i)
+    {
+        out[n++] = dst->array[i];
+    }
+    for (; keep_b && j < src->n; ++j)
+    {
+        out[n++] = src->array[j];
+    }
+    free(dst->array);
+    dst->array = out;
+    dst->n = n;
+    dst->n_alloc = MAX(size, 1);
+    return n <= ROARING_ARRAY_MAX || to_bitset(dst);
+}
+
+/*
+ * container_op() --Combine a container with another, in place.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory).
+ */
+static int container_op(RoaringContainerPtr dst, const RoaringContainer * src,
+                        BitsetOp op)
+{
+    uint64_t tmp[ROARING_BITSET_WORDS];
+    const uint64_t *bits = src->bits;
+
+    if (!dst->is_bitset && !src->is_bitset)
+    {
+        return merge_arrays(dst, src, op);
+    }
+    if (!dst->is_bitset && !to_bitset(dst))
+    {
+        return 0;
+    }
+    if (!src->is_bitset)
+    {
+        memset(tmp, 0, sizeof(tmp));
+        for (uint32_t i = 0; i < src->n; ++i)
+        {
+            tmp[src->array[i] / 64] |= 1ULL << (src->array[i] % 64);
+        }
+        bits = tmp;
+    }
+    bits_op_(dst->bits, bits, ROARING_BITSET_WORDS, op);
+    dst->n = (uint32_t) bits_count_(dst->bits, ROARING_BITSET_WORDS);
+    if (dst->n <= ROARING_ARRAY_MAX)
+    {
+        to_array(dst);
+    }
+    return 1;
+}
+
+/*
+ * insert_container() --Insert an empty container.
+ */
+static RoaringContainerPtr insert_container(RoaringPtr r, size_t i,
+                                            uint16_t key)
+{
+    RoaringContainerPtr c;
+
+    if (r->n_container == r->n_alloc)
+    {
+        size_t n_alloc = MAX(2 * r->n_alloc, 4);
+
+        if ((c = realloc(r->container, n_alloc * sizeof(*c))) == NULL)
+        {
+            return NULL;
+        }
+        r->container = c;
+        r->n_alloc = n_alloc;
+    }
+    c = r->container + i;
+    memmove(c + 1, c, (r->n_container - i) * sizeof(*c));
+    memset(c, 0, sizeof(*c));
+    c->key = key;
+    r->n_container += 1;
+    return c;
+}
+
+/*
+ * drop_container() --Remove a container.
+ */
+static void drop_container(RoaringPtr r, size_t i)
+{
+    container_free(&r->container[i]);
+    memmove(r->container + i, r->container + i + 1,
+            (r->n_container - i - 1) * sizeof(RoaringContainer));
+    r->n_container -= 1;
+}
+
+/*
+ * roaring_new() --Create an (empty) roaring bitmap.
+ */
+RoaringPtr roaring_new(void)
+{
+    return NEW(Roaring, 1);
+}
+
+/*
+ * roaring_free() --Free a roaring bitmap.
+ */
+void roaring_free(RoaringPtr r)
+{
+    if (r != NULL)
+    {
+        roaring_clear(r);
+        free(r->container);
+        free(r);
+    }
+}
+
+/*
+ * roaring_clear() --Remove all the members of a roaring bitmap.
+ */
+void roaring_clear(RoaringPtr r)
+{
+    for (size_t i = 0; i < r->n_container; ++i)
+    {
+        container_free(&r->container[i]);
+    }
+    r->n_container = 0;
+}
+
+/*
+ * roaring_add() --Add a value.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory).
+ */
+int roaring_add(RoaringPtr r, uint32_t value)
+{
+    size_t i = find(r, HIGH(value));
+    RoaringContainerPtr c;
+
+    if (i < r->n_container && r->container[i].key == HIGH(value))
+    {
+        c = &r->container[i];
+    }
+    else if ((c = insert_container(r, i, HIGH(value))) == NULL)
+    {
+        return 0;
+    }
+    if (container_add(c, LOW(value)) < 0)
+    {
+        if (c->n == 0)
+        {
+            drop_container(r, i);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * roaring_remove() --Remove a value.
+ *
+ * Returns: (int)
+ * 1: removed; 0: it wasn't a member.
+ */
+int roaring_remove(RoaringPtr r, uint32_t value)
+{
+    size_t i = find(r, HIGH(value));
+
+    if (i >= r->n_container || r->container[i].key != HIGH(value)
+        || !container_remove(&r->container[i], LOW(value)))
+    {
+        return 0;
+    }
+    if (r->container[i].n == 0)
+    {
+        drop_container(r, i);
+    }
+    return 1;
+}
+
+/*
+ * roaring_contains() --Test for a value.
+ */
+int roaring_contains(const Roaring * r, uint32_t value)
+{
+    size_t i = find(r, HIGH(value));
+    const RoaringContainer *c = r->container + i;
+    uint16_t low = LOW(value);
+    uint32_t slot;
+
+    if (i >= r->n_container || c->key != HIGH(value))
+    {
+        return 0;
+    }
+    if (c->is_bitset)
+    {
+        return (c->bits[low / 64] >> (low % 64)) & 1;
+    }
+    slot = array_find(c, low);
+    return slot < c->n && c->array[slot] == low;
+}
+
+/*
+ * roaring_count() --Return the No. of members.
+ */
+size_t roaring_count(const Roaring * r)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < r->n_container; ++i)
+    {
+        count += r->container[i].n;
+    }
+    return count;
+}
+
+/*
+ * roaring_next() --Find the first member >= from.
+ *
+ * Parameters:
+ * r        --the bitmap
+ * from     --the value to start from
+ * value    --returns the member
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (there's none).
+ *
+ * Remarks:
+ * The members are traversed in order by e.g.:
+ *
+ *     for (int ok = roaring_next(r, 0, &v); ok;
+ *          ok = v < UINT32_MAX && roaring_next(r, v + 1, &v))
+ */
+int roaring_next(const Roaring * r, uint32_t from, uint32_t *value)
+{
+    for (size_t i = find(r, HIGH(from)); i < r->n_container; ++i)
+    {
+        const RoaringContainer *c = r->container + i;
+        uint16_t low = c->key == HIGH(from) ? LOW(from) : 0;
+        size_t next;
+
+        if (c->is_bitset)
+        {
+            Bitset bits = {
+                .word = c->bits,.n_bits = 65536,
+                .n_words = ROARING_BITSET_WORDS
+            };
+
+            next = bitset_next(&bits, low);
+            if (next < 65536)
+            {
+                *value = (uint32_t) c->key << 16 | (uint32_t) next;
+                return 1;
+            }
+        }
+        else if ((next = array_find(c, low)) < c->n)
+        {
+            *value = (uint32_t) c->key << 16 | c->array[next];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * roaring_op() --Combine a roaring bitmap with another, in place.
+ *
+ * Parameters:
+ * dst      --the bitmap to update
+ * src      --the other bitmap
+ * op       --the operation
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory: dst is partly updated).
+ *
+ * Remarks:
+ * Only containers with matching keys are combined; for AND, dst's
+ * other containers are dropped, and for OR and XOR, src's other
+ * containers are copied.
+ */
+int roaring_op(RoaringPtr dst, const Roaring * src, BitsetOp op)
+{
+    if (op == BITSET_AND || op == BITSET_ANDNOT)
+    {
+        for (size_t i = dst->n_container; i-- > 0;)
+        {
+            RoaringContainerPtr c = dst->container + i;
+            size_t j = find(src, c->key);
+            int match = j < src->n_container
+                && src->container[j].key == c->key;
+
+            if (match && !container_op(c, src->container + j, op))
+            {
+                return 0;
+            }
+            if ((!match && op == BITSET_AND) || c->n == 0)
+            {
+                drop_container(dst, i);
+            }
+        }
+        return 1;
+    }
+    for (size_t j = 0; j < src->n_container; ++j)
+    {
+        const RoaringContainer *s = src->container + j;
+        size_t i = find(dst, s->key);
+        RoaringContainerPtr c = dst->container + i;
+
+        if (i < dst->n_container && c->key == s->key)
+        {
+            if (!container_op(c, s, op))
+            {
+                return 0;
+            }
+            if (c->n == 0)
+            {
+                drop_container(dst, i);
+            }
+            continue;
+        }
+        if ((c = insert_container(dst, i, s->key)) == NULL)
+        {
+            return 0;
+        }
+        if (!container_op(c, s, BITSET_OR))
+        {
+            drop_container(dst, i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * roaring_bytes() --Return the memory used by a roaring bitmap.
+ */
+size_t roaring_bytes(const Roaring * r)
+{
+    size_t bytes = sizeof(*r) + r->n_alloc * sizeof(RoaringContainer);
+
+    for (size_t i = 0; i < r->n_container; ++i)
+    {
+        bytes += r->container[i].is_bitset
+            ? ROARING_BITSET_WORDS * sizeof(uint64_t)
+            : r->container[i].n_alloc * sizeof(uint16_t);
+    }
+    return bytes;
+}
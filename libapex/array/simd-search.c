@@ -0,0 +1,324 @@
+/*
+ * SIMD-SEARCH.C --Vectorised lower bound for small sorted integer arrays.
+ *
+ * Contents:
+ * lower_bound_small_int()  --Find the first element >= key (int).
+ * lower_bound_small_u32()  --Find the first element >= key (uint32_t).
+ * lower_bound_small_long() --Find the first element >= key (long).
+ *
+ * Remarks:
+ * In a sorted array, the lower bound of key is simply the No. of
+ * elements less than key.  For small arrays it's quicker to count
+ * them all, several at a time with SIMD compares, than to binary
+ * search: there are no unpredictable branches, and the whole array
+ * is a cache line or two.  Bigger arrays are bisected (branch-free, as
+ * lower_bound_*()) until SMALL_MAX elements remain, which are then
+ * counted.
+ *
+ * On x86, the AVX2 or SSE2 version of each count is selected on the
+ * first call, with cpu_has(); on ARM, NEON is used if
+ * the compiler enables it; otherwise it's a scalar loop (which the
+ * compiler may vectorise itself).
+ */
+#include <stdint.h>
+#include <apex/binsearch.h>
+#include <apex/cpu.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define SEARCH_NEON
+#include <arm_neon.h>
+#endif
+
+#define SMALL_MAX 32                   /* count, rather than bisect, below */
+#define SIGN_BIT 0x80000000u
+
+typedef size_t (*CountIntProc)(const int *base, size_t n, int key);
+typedef size_t (*CountU32Proc)(const uint32_t *base, size_t n,
+                               uint32_t key);
+typedef size_t (*CountLongProc)(const long *base, size_t n, long key);
+
+/*
+ * BISECT() --Narrow [p, p+n) to SMALL_MAX elements that bracket key.
+ *
+ * Remarks:
+ * Everything before p is < key, and everything from p+n is >= key.
+ */
+#define BISECT(p_, n_, key_)                                            \
+    while ((n_) > SMALL_MAX)                                            \
+    {                                                                   \
+        size_t half = (n_) / 2;                                         \
+                                                                        \
+        (p_) = ((p_)[half] < (key_)) ? (p_) + half : (p_);              \
+        (n_) -= half;                                                   \
+    }
+
+/*
+ * COUNT() --Define a scalar count of the elements < key.
+ */
+#define COUNT(name_, type_)                                             \
+    static size_t name_(const type_ *base, size_t n, type_ key)         \
+    {                                                                   \
+        size_t count = 0;                                               \
+                                                                        \
+        for (size_t i = 0; i < n; ++i)                                  \
+        {                                                               \
+            count += base[i] < key;                                     \
+        }                                                               \
+        return count;                                                   \
+    }
+
+COUNT(count_int, int)
+COUNT(count_u32, uint32_t)
+COUNT(count_long, long)
+
+#ifdef SEARCH_X86
+/*
+ * count_int_sse2() --Count the elements < key, 4 at a time.
+ *
+ * Remarks:
+ * Each compare returns -1 in the lanes where key > element, so
+ * subtracting the mask counts them.  Unsigned values are compared
+ * by flipping their sign bits (bias != 0).
+ */
+__attribute__((target("sse2")))
+static size_t count_sse2(const int *base, size_t n, int key, int bias)
+{
+    __m128i b = _mm_set1_epi32(bias);
+    __m128i k = _mm_set1_epi32(key ^ bias), sum = _mm_setzero_si128();
+    size_t i = 0;
+    int lane[4];
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (base + i));
+
+        v = _mm_xor_si128(v, b);
+        sum = _mm_sub_epi32(sum, _mm_cmpgt_epi32(k, v));
+    }
+    _mm_storeu_si128((__m128i *) lane, sum);
+    return (size_t) (lane[0] + lane[1] + lane[2] + lane[3])
+        + (bias ? count_u32((const uint32_t *) base + i, n - i,
+                            (uint32_t) key)
+           : count_int(base + i, n - i, key));
+}
+
+/*
+ * count_avx2() --Count the elements < key, 8 at a time.
+ */
+__attribute__((target("avx2")))
+static size_t count_avx2(const int *base, size_t n, int key, int bias)
+{
+    __m256i b = _mm256_set1_epi32(bias);
+    __m256i k = _mm256_set1_epi32(key ^ bias), sum = _mm256_setzero_si256();
+    size_t i = 0;
+    int lane[8], total = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (base + i));
+
+        v = _mm256_xor_si256(v, b);
+        sum = _mm256_sub_epi32(sum, _mm256_cmpgt_epi32(k, v));
+    }
+    _mm256_storeu_si256((__m256i *) lane, sum);
+    for (int j = 0; j < 8; ++j)
+    {
+        total += lane[j];
+    }
+    return (size_t) total
+        + (bias ? count_u32((const uint32_t *) base + i, n - i,
+                            (uint32_t) key)
+           : count_int(base + i, n - i, key));
+}
+
+static size_t count_int_sse2(const int *base, size_t n, int key)
+{
+    return count_sse2(base, n, key, 0);
+}
+
+static size_t count_int_avx2(const int *base, size_t n, int key)
+{
+    return count_avx2(base, n, key, 0);
+}
+
+static size_t count_u32_sse2(const uint32_t *base, size_t n, uint32_t key)
+{
+    return count_sse2((const int *) base, n, (int) key, (int) SIGN_BIT);
+}
+
+static size_t count_u32_avx2(const uint32_t *base, size_t n, uint32_t key)
+{
+    return count_avx2((const int *) base, n, (int) key, (int) SIGN_BIT);
+}
+
+/*
+ * count_long_avx2() --Count the elements < key, 4 at a time.
+ *
+ * Remarks:
+ * SSE2 has no 64-bit compare, so there's no SSE2 version of this.
+ */
+__attribute__((target("avx2")))
+static size_t count_long_avx2(const long *base, size_t n, long key)
+{
+    __m256i k = _mm256_set1_epi64x(key), sum = _mm256_setzero_si256();
+    size_t i = 0;
+    long long lane[4];
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (base + i));
+
+        sum = _mm256_sub_epi64(sum, _mm256_cmpgt_epi64(k, v));
+    }
+    _mm256_storeu_si256((__m256i *) lane, sum);
+    return (size_t) (lane[0] + lane[1] + lane[2] + lane[3])
+        + count_long(base + i, n - i, key);
+}
+#endif /* SEARCH_X86 */
+
+#ifdef SEARCH_NEON
+/*
+ * count_int_neon() --Count the elements < key, 4 at a time.
+ *
+ * Remarks:
+ * The compares return all-1s (i.e. -1) in true lanes, as for SSE2.
+ */
+static size_t count_int_neon(const int *base, size_t n, int key)
+{
+    int32x4_t k = vdupq_n_s32(key);
+    uint32x4_t sum = vdupq_n_u32(0);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        sum = vsubq_u32(sum, vcltq_s32(vld1q_s32(base + i), k));
+    }
+    return (size_t) vaddvq_u32(sum) + count_int(base + i, n - i, key);
+}
+
+/*
+ * count_u32_neon() --Count the elements < key, 4 at a time.
+ */
+static size_t count_u32_neon(const uint32_t *base, size_t n, uint32_t key)
+{
+    uint32x4_t k = vdupq_n_u32(key), sum = vdupq_n_u32(0);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        sum = vsubq_u32(sum, vcltq_u32(vld1q_u32(base + i), k));
+    }
+    return (size_t) vaddvq_u32(sum) + count_u32(base + i, n - i, key);
+}
+#endif /* SEARCH_NEON */
+
+static size_t resolve_int(const int *base, size_t n, int key);
+static size_t resolve_u32(const uint32_t *base, size_t n, uint32_t key);
+static size_t resolve_long(const long *base, size_t n, long key);
+
+static CountIntProc count_int_proc = resolve_int;
+static CountU32Proc count_u32_proc = resolve_u32;
+static CountLongProc count_long_proc = resolve_long;
+
+/*
+ * resolve_int() --Select the best count_int() for this CPU, and call it.
+ */
+static size_t resolve_int(const int *base, size_t n, int key)
+{
+    CountIntProc proc = count_int;
+
+#if defined(SEARCH_X86)
+    proc = cpu_has(CPU_AVX2) ? count_int_avx2
+        : cpu_has(CPU_SSE2) ? count_int_sse2 : proc;
+#elif defined(SEARCH_NEON)
+    proc = count_int_neon;
+#endif
+    CPU_RESOLVE(&count_int_proc, proc);
+    return proc(base, n, key);
+}
+
+/*
+ * resolve_u32() --Select the best count_u32() for this CPU, and call it.
+ */
+static size_t resolve_u32(const uint32_t *base, size_t n, uint32_t key)
+{
+    CountU32Proc proc = count_u32;
+
+#if defined(SEARCH_X86)
+    proc = cpu_has(CPU_AVX2) ? count_u32_avx2
+        : cpu_has(CPU_SSE2) ? count_u32_sse2 : proc;
+#elif defined(SEARCH_NEON)
+    proc = count_u32_neon;
+#endif
+    CPU_RESOLVE(&count_u32_proc, proc);
+    return proc(base, n, key);
+}
+
+/*
+ * resolve_long() --Select the best count_long() for this CPU, and call it.
+ */
+static size_t resolve_long(const long *base, size_t n, long key)
+{
+    CountLongProc proc = count_long;
+
+#if defined(SEARCH_X86)
+    if (sizeof(long) == sizeof(long long) && cpu_has(CPU_AVX2))
+    {
+        proc = count_long_avx2;
+    }
+#endif
+    CPU_RESOLVE(&count_long_proc, proc);
+    return proc(base, n, key);
+}
+
+/*
+ * lower_bound_small_int() --Find the first element >= key (int).
+ *
+ * Parameters:
+ * base --the sorted array
+ * n --the No. of elements in the array
+ * key --the value to search for
+ *
+ * Returns: (size_t)
+ * The offset of the first element >= key (i.e. n, if there isn't one).
+ */
+size_t lower_bound_small_int(const int *base, size_t n, int key)
+{
+    const int *p = base;
+
+    BISECT(p, n, key);
+    return (size_t) (p - base)
+        + __atomic_load_n(&count_int_proc, __ATOMIC_RELAXED) (p, n, key);
+}
+
+/*
+ * lower_bound_small_u32() --Find the first element >= key (uint32_t).
+ *
+ * Remarks:
+ * The x86 SIMD compares are signed, so the elements and key are
+ * biased by 2^31 (i.e. their sign bits are flipped), which maps
+ * unsigned order onto signed order.
+ */
+size_t lower_bound_small_u32(const uint32_t *base, size_t n, uint32_t key)
+{
+    const uint32_t *p = base;
+
+    BISECT(p, n, key);
+    return (size_t) (p - base)
+        + __atomic_load_n(&count_u32_proc, __ATOMIC_RELAXED) (p, n, key);
+}
+
+/*
+ * lower_bound_small_long() --Find the first element >= key (long).
+ */
+size_t lower_bound_small_long(const long *base, size_t n, long key)
+{
+    const long *p = base;
+
+    BISECT(p, n, key);
+    return (size_t) (p - base)
+        + __atomic_load_n(&count_long_proc, __ATOMIC_RELAXED) (p, n, key);
+}
@@ -0,0 +1,315 @@
+/*
+ * SORT.C --Parallel and radix sorts.
+ *
+ * Contents:
+ * parallel_sort()     --Sort an array with several threads.
+ * radix_sort_int()    --Sort an int array with an LSD radix sort.
+ * radix_sort_long()   --Sort a long array with an LSD radix sort.
+ * radix_sort_double() --Sort a double array with an LSD radix sort.
+ *
+ * Remarks:
+ * parallel_sort() is a merge sort: the array is split into one run
+ * per thread, the runs are sorted concurrently with qsort(), and then
+ * merged in pairs (also concurrently) until one run remains.  The
+ * merges alternate between the array and a scratch buffer.  The runs
+ * are tasks on the default task pool, rather than threads of their own.
+ *
+ * The radix sorts map each key onto an unsigned integer with the same
+ * order (flipping the sign bit of integers; for doubles, flipping all
+ * the bits of negatives, and the sign bit of positives), then sort a
+ * byte at a time, least significant first.  Passes where every key
+ * has the same byte are skipped, so (e.g.) small non-negative ints
+ * take only one or two passes.
+ */
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <apex/sort.h>
+#include <apex/task-pool.h>
+
+#define SORT_MIN_PARALLEL 65536        /* below this, just use qsort() */
+#define SORT_MAX_THREAD 64
+
+typedef struct SortRun_t
+{
+    const char *src;                   /* input runs: [lo, mid), [mid, hi) */
+    char *dst;
+    size_t lo, mid, hi;
+    size_t size;
+    CompareProc cmp;
+} SortRun, *SortRunPtr;
+
+/*
+ * sort_run() --Sort a run (in place) with qsort(): a TaskProc.
+ */
+static void sort_run(void *data)
+{
+    SortRunPtr run = data;
+
+    qsort(run->dst + run->lo * run->size, run->hi - run->lo, run->size,
+          run->cmp);
+}
+
+/*
+ * merge_run() --Merge two adjacent sorted runs: a TaskProc.
+ */
+static void merge_run(void *data)
+{
+    SortRunPtr run = data;
+    size_t size = run->size;
+    const char *a = run->src + run->lo * size;
+    const char *a_end = run->src + run->mid * size, *b = a_end;
+    const char *b_end = run->src + run->hi * size;
+    char *dst = run->dst + run->lo * size;
+
+    while (a < a_end && b < b_end)
+    {
+        if (run->cmp(b, a) < 0)
+        {
+            memcpy(dst, b, size);
+            b += size;
+        }
+        else
+        {                              /* (a first, if equal: stable) */
+            memcpy(dst, a, size);
+            a += size;
+        }
+        dst += size;
+    }
+    memcpy(dst, a, (size_t) (a_end - a));
+    memcpy(dst + (a_end - a), b, (size_t) (b_end - b));
+}
+
+/*
+ * run_all() --Run a proc for each of n runs, on the default task pool.
+ *
+ * Remarks:
+ * The last run is done by the calling thread, which then helps with
+ * the others; if there's no pool, it does them all.
+ */
+static void run_all(TaskProc proc, SortRun *run, int n)
+{
+    TaskPoolPtr pool = task_pool_default();
+    TaskGroup group;
+
+    task_group_init(&group);
+    for (int i = 0; i < n - 1; ++i)
+    {
+        if (pool != NULL)
+        {
+            task_submit(pool, &group, proc, &run[i]);
+        }
+        else
+        {
+            proc(&run[i]);
+        }
+    }
+    proc(&run[n - 1]);
+    if (pool != NULL)
+    {
+        task_group_wait(pool, &group);
+    }
+}
+
+/*
+ * parallel_sort() --Sort an array with several threads.
+ *
+ * Parameters:
+ * base --the array to sort
+ * n --the No. of elements in the array
+ * size --the size of each element
+ * cmp --the element comparison function (as for qsort())
+ * n_thread --the No. of threads to use (<= 0: one per online CPU)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory for the scratch buffer).
+ *
+ * Remarks:
+ * The merge phase needs a scratch buffer the size of the array.
+ * Small arrays (or n_thread == 1) are simply sorted with qsort().
+ */
+int parallel_sort(void *base, size_t n, size_t size, CompareProc cmp,
+                  int n_thread)
+{
+    SortRun run[SORT_MAX_THREAD];
+    char *buf[2];
+    int n_run, from = 0;
+
+    if (n_thread <= 0)
+    {
+        n_thread = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (n_thread > SORT_MAX_THREAD)
+    {
+        n_thread = SORT_MAX_THREAD;
+    }
+    if (n_thread <= 1 || n < SORT_MIN_PARALLEL)
+    {
+        qsort(base, n, size, cmp);
+        return 1;                      /* success: (not parallel) */
+    }
+    buf[0] = base;
+    if ((buf[1] = malloc(n * size)) == NULL)
+    {
+        return 0;                      /* failure: no scratch buffer */
+    }
+    n_run = n_thread;
+    for (int i = 0; i < n_run; ++i)
+    {
+        run[i].dst = buf[0];
+        run[i].lo = n * (size_t) i / (size_t) n_run;
+        run[i].hi = n * (size_t) (i + 1) / (size_t) n_run;
+        run[i].size = size;
+        run[i].cmp = cmp;
+    }
+    run_all(sort_run, run, n_run);
+
+    while (n_run > 1)
+    {                                  /* merge pairs of runs */
+        int n_merge = n_run / 2;
+
+        for (int i = 0; i < n_merge; ++i)
+        {
+            run[i].src = buf[from];
+            run[i].dst = buf[!from];
+            run[i].lo = run[2 * i].lo;
+            run[i].mid = run[2 * i].hi;
+            run[i].hi = run[2 * i + 1].hi;
+        }
+        if (n_run % 2 != 0)
+        {                              /* copy the odd run over */
+            SortRunPtr odd = &run[n_run - 1];
+
+            memcpy(buf[!from] + odd->lo * size, buf[from] + odd->lo * size,
+                   (odd->hi - odd->lo) * size);
+        }
+        run_all(merge_run, run, n_merge);
+        if (n_run % 2 != 0)
+        {
+            run[n_merge] = run[n_run - 1];
+            n_merge += 1;
+        }
+        n_run = n_merge;
+        from = !from;
+    }
+    if (from != 0)
+    {
+        memcpy(base, buf[1], n * size);
+    }
+    free(buf[1]);
+    return 1;
+}
+
+/*
+ * RADIX_SORT() --Define an LSD radix sort for some type.
+ *
+ * Remarks:
+ * The keys are converted (in place) to ordered unsigned integers, of
+ * type utype_, sorted, and converted back.  All the byte histograms
+ * are counted in one pass, before sorting.
+ */
+#define RADIX_SORT(name_, type_, utype_, to_key_, from_key_)            \
+    int name_(type_ *base, size_t n)                                    \
+    {                                                                   \
+        enum { N_PASS = sizeof(utype_) };                               \
+        utype_ *a = (utype_ *) base, *b, *tmp;                          \
+        size_t (*count)[256];                                           \
+                                                                        \
+        if (n < 2)                                                      \
+        {                                                               \
+            return 1;                                                   \
+        }                                                               \
+        if ((b = malloc(n * sizeof(utype_))) == NULL                    \
+            || (count = calloc(N_PASS, sizeof(*count))) == NULL)        \
+        {                                                               \
+            free(b);                                                    \
+            return 0;                  /* failure: no memory */         \
+        }                                                               \
+        for (size_t i = 0; i < n; ++i)                                  \
+        {                                                               \
+            utype_ key = to_key_(a[i]);                                 \
+                                                                        \
+            a[i] = key;                                                 \
+            for (int p = 0; p < N_PASS; ++p)                            \
+            {                                                           \
+                count[p][(key >> (8 * p)) & 0xff] += 1;                 \
+            }                                                           \
+        }                                                               \
+        for (int p = 0; p < N_PASS; ++p)                                \
+        {                                                               \
+            size_t offset = 0;                                          \
+                                                                        \
+            if (count[p][(a[0] >> (8 * p)) & 0xff] == n)                \
+            {                                                           \
+                continue;              /* all the same: skip */         \
+            }                                                           \
+            for (int d = 0; d < 256; ++d)                               \
+            {                                                           \
+                size_t c = count[p][d];                                 \
+                                                                        \
+                count[p][d] = offset;                                   \
+                offset += c;                                            \
+            }                                                           \
+            for (size_t i = 0; i < n; ++i)                              \
+            {                                                           \
+                b[count[p][(a[i] >> (8 * p)) & 0xff]++] = a[i];         \
+            }                                                           \
+            tmp = a;                                                    \
+            a = b;                                                      \
+            b = tmp;                                                    \
+        }                                                               \
+        for (size_t i = 0; i < n; ++i)                                  \
+        {                                                               \
+            a[i] = from_key_(a[i]);                                     \
+        }                                                               \
+        if (a != (utype_ *) base)                                       \
+        {                                                               \
+            memcpy(base, a, n * sizeof(utype_));                        \
+            b = a;                                                      \
+        }                                                               \
+        free(b);                                                        \
+        free(count);                                                    \
+        return 1;                                                       \
+    }
+
+#define INT_KEY(x_) ((x_) ^ ((uint32_t) 1 << 31))
+#define LONG_KEY(x_) ((x_) ^ ((uint64_t) 1 << 63))
+#define DOUBLE_TO_KEY(x_) \
+    ((x_) ^ (((x_) >> 63) ? ~(uint64_t) 0 : (uint64_t) 1 << 63))
+#define DOUBLE_FROM_KEY(x_) \
+    ((x_) ^ (((x_) >> 63) ? (uint64_t) 1 << 63 : ~(uint64_t) 0))
+
+/*
+ * radix_sort_int() --Sort an int array with an LSD radix sort.
+ *
+ * Parameters:
+ * base --the array to sort
+ * n --the No. of elements in the array
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory).
+ *
+ * Remarks:
+ * This needs a scratch buffer the size of the array.
+ */
+RADIX_SORT(radix_sort_int, int, uint32_t, INT_KEY, INT_KEY)
+
+/*
+ * radix_sort_long() --Sort a long array with an LSD radix sort.
+ */
+#if LONG_MAX > 0x7fffffffL
+RADIX_SORT(radix_sort_long, long, uint64_t, LONG_KEY, LONG_KEY)
+#else
+RADIX_SORT(radix_sort_long, long, uint32_t, INT_KEY, INT_KEY)
+#endif
+
+/*
+ * radix_sort_double() --Sort a double array with an LSD radix sort.
+ *
+ * Remarks:
+ * NaNs are sorted to the ends (by the sign of the NaN).
+ */
+RADIX_SORT(radix_sort_double, double, uint64_t, DOUBLE_TO_KEY,
+           DOUBLE_FROM_KEY)
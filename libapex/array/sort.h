@@ -0,0 +1,28 @@
+/*
+ * SORT.H --Parallel and radix sorts.
+ *
+ * Remarks:
+ * parallel_sort() is a drop-in replacement for qsort() (it accepts
+ * the same CompareProc, e.g. int_cmp()) that uses several threads;
+ * the radix sorts are specialised for arrays of int/long/double, and
+ * don't compare at all.
+ */
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+#include <apex/compare.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    int parallel_sort(void *base, size_t n, size_t size, CompareProc cmp,
+                      int n_thread);
+    int radix_sort_int(int *base, size_t n);
+    int radix_sort_long(long *base, size_t n);
+    int radix_sort_double(double *base, size_t n);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* SORT_H */
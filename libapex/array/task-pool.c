@@ -0,0 +1,582 @@
+/*
+ * TASK-POOL.C --A work-stealing pool of worker threads.
+ *
+ * Contents:
+ * task_pool_new()     --Create a pool of worker threads.
+ * task_pool_free()    --Stop a pool's workers, and free its resources.
+ * task_pool_default() --Return the (shared) default pool.
+ * task_pool_size()    --Return the No. of workers in a pool.
+ * task_pool_worker()  --Return the calling thread's worker No. in a pool.
+ * task_group_init()   --Initialise an (empty) group of tasks.
+ * task_submit()       --Queue a task for the pool's workers.
+ * task_group_done()   --Test if all of a group's tasks have finished.
+ * task_group_wait()   --Wait for all of a group's tasks to finish.
+ * parallel_for()      --Call a function over an index range, in parallel.
+ *
+ * Remarks:
+ * Each worker has its own deque of tasks: tasks submitted by a worker
+ * (e.g. a parallel_for() range split in two) are pushed onto its
+ * deque, and it takes them back LIFO; an idle worker steals from the
+ * other end of another worker's deque.  Tasks submitted by any other
+ * thread go onto the pool's MPMCQueue.  If the queue is full, the
+ * task is simply run by the submitting thread.
+ *
+ * The deques are Chase-Lev deques, with the C11 orderings of Lê et
+ * al. (2013).  A thief may read a slot that the owner is overwriting,
+ * but only when its CAS on top will fail, so the torn task is never
+ * used; the slots are copied word by word, atomically, so the race
+ * is benign.
+ *
+ * An idle worker sleeps on a condition variable.  It announces itself
+ * (n_sleep) before re-checking n_queued, and a submitter counts its
+ * task (n_queued) before checking n_sleep, both sequentially
+ * consistent, so one of them always sees the other: no wakeup is lost.
+ *
+ * A thread waiting for a group runs queued tasks meanwhile, so tasks
+ * may wait for (nested) groups without deadlock.
+ *
+ * See Also:
+ * N.M. Lê, A. Pop, A. Cohen, F. Zappa Nardelli, "Correct and Efficient
+ * Work-Stealing for Weak Memory Models", PPoPP 2013.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <apex/placement.h>
+#include <apex/task-pool.h>
+
+#define TASK_SPIN 64                   /* steal attempts before sleeping */
+
+typedef struct TaskRange_t
+{
+    TaskRangeProc proc;
+    void *data;
+    size_t grain;                      /* don't split ranges smaller than this */
+} TaskRange;
+
+static THREAD_LOCAL TaskWorkerPtr current_worker;
+static TaskPoolPtr default_pool;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+/*
+ * store_task() --Copy a task into a deque slot (atomically, per word).
+ */
+static void store_task(TaskPtr slot, const Task * task)
+{
+    ATOMIC_STORE_RELAXED(&slot->proc, task->proc);
+    ATOMIC_STORE_RELAXED(&slot->data, task->data);
+    ATOMIC_STORE_RELAXED(&slot->range, task->range);
+    ATOMIC_STORE_RELAXED(&slot->lo, task->lo);
+    ATOMIC_STORE_RELAXED(&slot->hi, task->hi);
+    ATOMIC_STORE_RELAXED(&slot->group, task->group);
+}
+
+/*
+ * load_task() --Copy a task out of a deque slot (atomically, per word).
+ */
+static void load_task(TaskPtr task, TaskPtr slot)
+{
+    task->proc = ATOMIC_LOAD_RELAXED(&slot->proc);
+    task->data = ATOMIC_LOAD_RELAXED(&slot->data);
+    task->range = ATOMIC_LOAD_RELAXED(&slot->range);
+    task->lo = ATOMIC_LOAD_RELAXED(&slot->lo);
+    task->hi = ATOMIC_LOAD_RELAXED(&slot->hi);
+    task->group = ATOMIC_LOAD_RELAXED(&slot->group);
+}
+
+/*
+ * deque_push() --Push a task onto the bottom of a worker's deque (owner).
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the deque is full).
+ */
+static int deque_push(TaskDequePtr deque, const Task * task)
+{
+    int64_t b = ATOMIC_LOAD_RELAXED(&deque->bottom);
+    int64_t t = ATOMIC_LOAD_ACQUIRE(&deque->top);
+
+    if (b - t >= TASK_DEQUE_SIZE)
+    {
+        return 0;
+    }
+    store_task(&deque->task[b & (TASK_DEQUE_SIZE - 1)], task);
+    ATOMIC_STORE_RELEASE(&deque->bottom, b + 1);
+    return 1;
+}
+
+/*
+ * deque_take() --Take a task from the bottom of a worker's deque (owner).
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the deque is empty).
+ */
+static int deque_take(TaskDequePtr deque, TaskPtr task)
+{
+    int64_t b = ATOMIC_LOAD_RELAXED(&deque->bottom) - 1;
+    int64_t t;
+    int status = 1;
+
+    ATOMIC_STORE_RELAXED(&deque->bottom, b);
+    ATOMIC_FENCE();
+    t = ATOMIC_LOAD_RELAXED(&deque->top);
+    if (t > b)
+    {
+        ATOMIC_STORE_RELAXED(&deque->bottom, b + 1);
+        return 0;                      /* (empty) */
+    }
+    load_task(task, &deque->task[b & (TASK_DEQUE_SIZE - 1)]);
+    if (t == b)
+    {                                  /* the last one: race the thieves */
+        status = __atomic_compare_exchange_n(&deque->top, &t, t + 1, 0,
+                                             __ATOMIC_SEQ_CST,
+                                             __ATOMIC_RELAXED);
+        ATOMIC_STORE_RELAXED(&deque->bottom, b + 1);
+    }
+    return status;
+}
+
+/*
+ * deque_steal() --Steal a task from the top of another worker's deque.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (empty, or another thief won).
+ */
+static int deque_steal(TaskDequePtr deque, TaskPtr task)
+{
+    int64_t t = ATOMIC_LOAD_ACQUIRE(&deque->top);
+    int64_t b;
+
+    ATOMIC_FENCE();
+    b = ATOMIC_LOAD_ACQUIRE(&deque->bottom);
+    if (t >= b)
+    {
+        return 0;
+    }
+    load_task(task, &deque->task[t & (TASK_DEQUE_SIZE - 1)]);
+    return __atomic_compare_exchange_n(&deque->top, &t, t + 1, 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+/*
+ * queued() --Count a queued task, and wake a worker if one is idle.
+ */
+static void queued(TaskPoolPtr pool)
+{
+    __atomic_add_fetch(&pool->n_queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->n_sleep, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/*
+ * run_task() --Run a task, and notify its group when it's finished.
+ */
+static void run_task(TaskPoolPtr pool, TaskPtr task);
+
+/*
+ * push_task() --Queue a task, or (if there's no room) run it.
+ */
+static void push_task(TaskPoolPtr pool, Task * task)
+{
+    TaskWorkerPtr worker = current_worker;
+
+    if (worker != NULL && worker->pool == pool
+        && deque_push(&worker->deque, task))
+    {
+        queued(pool);
+    }
+    else if (mpmc_queue_push(&pool->inject, task))
+    {
+        queued(pool);
+    }
+    else
+    {
+        run_task(pool, task);          /* (full: do it ourselves) */
+    }
+}
+
+/*
+ * find_task() --Find a task to run: our own, submitted, or stolen.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (there's nothing to do).
+ */
+static int find_task(TaskPoolPtr pool, TaskWorkerPtr self, TaskPtr task)
+{
+    int n_worker = task_pool_size(pool);
+    int found = (self != NULL && deque_take(&self->deque, task))
+        || mpmc_queue_pop(&pool->inject, task);
+
+    if (!found && n_worker > 0)
+    {
+        unsigned int start = self != NULL
+            ? (self->seed = self->seed * 1103515245u + 12345u) >> 8 : 0;
+
+        for (int i = 0; !found && i < n_worker; ++i)
+        {
+            TaskWorkerPtr victim =
+                &pool->worker[(start + (unsigned int) i) % n_worker];
+
+            found = victim != self && deque_steal(&victim->deque, task);
+        }
+    }
+    if (found)
+    {
+        __atomic_sub_fetch(&pool->n_queued, 1, __ATOMIC_SEQ_CST);
+    }
+    return found;
+}
+
+/*
+ * run_range() --Run a parallel_for() range, splitting off its top halves.
+ */
+static void run_range(TaskPoolPtr pool, const Task * task)
+{
+    const TaskRange *range = task->range;
+    size_t lo = task->lo, hi = task->hi;
+
+    while (hi - lo > range->grain)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        Task half = { NULL, NULL, range, mid, hi, task->group };
+
+        __atomic_add_fetch(&task->group->n_pending, 1, __ATOMIC_RELAXED);
+        push_task(pool, &half);
+        hi = mid;
+    }
+    range->proc(range->data, lo, hi);
+}
+
+static void run_task(TaskPoolPtr pool, TaskPtr task)
+{
+    if (task->range != NULL)
+    {
+        run_range(pool, task);
+    }
+    else
+    {
+        task->proc(task->data);
+    }
+    if (task->group != NULL
+        && __atomic_sub_fetch(&task->group->n_pending, 1,
+                              __ATOMIC_ACQ_REL) == 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/*
+ * worker_main() --Run tasks until the pool stops: a pthread start proc.
+ */
+static void *worker_main(void *data)
+{
+    TaskWorkerPtr self = data;
+    TaskPoolPtr pool = self->pool;
+    Task task;
+
+    current_worker = self;
+    if (pool->flags & TASK_POOL_PIN)
+    {
+        (void) cpu_pin_thread(self->id % cpu_topology()->n_cpu);
+    }
+    for (;;)
+    {
+        int found = 0;
+
+        for (int spin = 0; !found && spin < TASK_SPIN; ++spin)
+        {
+            if (!(found = find_task(pool, self, &task))
+                && __atomic_load_n(&pool->n_queued, __ATOMIC_RELAXED) == 0)
+            {
+                break;                 /* (nothing to steal, either) */
+            }
+        }
+        if (found)
+        {
+            run_task(pool, &task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->n_sleep, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->n_queued, __ATOMIC_SEQ_CST) == 0
+               && !pool->stop)
+        {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->n_sleep, 1, __ATOMIC_SEQ_CST);
+        if (pool->stop && __atomic_load_n(&pool->n_queued,
+                                          __ATOMIC_SEQ_CST) == 0)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    current_worker = NULL;
+    return NULL;
+}
+
+/*
+ * task_pool_new() --Create a pool of worker threads.
+ *
+ * Parameters:
+ * n_worker --the No. of worker threads (<= 0: one per online CPU)
+ * flags    --TASK_POOL_PIN to pin each worker to a CPU
+ *
+ * Returns: (TaskPoolPtr)
+ * Success: the pool; Failure: NULL.
+ *
+ * Remarks:
+ * If some threads can't be started, the pool just has fewer workers
+ * (possibly none: then tasks are run by the threads that wait).
+ */
+TaskPoolPtr task_pool_new(int n_worker, int flags)
+{
+    TaskPoolPtr pool;
+
+    if (n_worker <= 0)
+    {
+        long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+        n_worker = n_cpu > 0 ? (int) n_cpu : 1;
+    }
+    n_worker = MIN(n_worker, TASK_POOL_MAX_WORKER);
+    if ((pool = NEW(TaskPool, 1)) == NULL)
+    {
+        return NULL;
+    }
+    if ((pool->worker = NEW(TaskWorker, n_worker)) == NULL)
+    {
+        free(pool);
+        return NULL;
+    }
+    (void) mpmc_queue_init(&pool->inject, TASK_INJECT_SIZE, sizeof(Task),
+                           pool->inject_task, pool->inject_seq);
+    pool->flags = flags;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int i = 0; i < n_worker; ++i)
+    {
+        TaskWorkerPtr worker = &pool->worker[i];
+
+        worker->pool = pool;
+        worker->id = i;
+        worker->seed = (unsigned int) i * 2654435761u + 1;
+    }
+    for (int i = 0; i < n_worker; ++i)
+    {                                  /* (workers steal from pool->worker[]) */
+        TaskWorkerPtr worker = &pool->worker[pool->n_worker];
+
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0)
+        {
+            break;
+        }
+        ATOMIC_STORE_RELEASE(&pool->n_worker, pool->n_worker + 1);
+    }
+    return pool;
+}
+
+/*
+ * task_pool_free() --Stop a pool's workers, and free its resources.
+ *
+ * Remarks:
+ * The workers finish all the queued tasks first.  The default pool
+ * mustn't be freed.
+ */
+void task_pool_free(TaskPoolPtr pool)
+{
+    if (pool == NULL || pool == default_pool)
+    {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->n_worker; ++i)
+    {
+        pthread_join(pool->worker[i].thread, NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool->worker);
+    free(pool);
+}
+
+/*
+ * default_init() --Create the default pool (once).
+ */
+static void default_init(void)
+{
+    default_pool = task_pool_new(0, 0);
+}
+
+/*
+ * task_pool_default() --Return the (shared) default pool.
+ *
+ * Returns: (TaskPoolPtr)
+ * Success: the pool, with one worker per online CPU; Failure: NULL.
+ *
+ * Remarks:
+ * The library's parallel features use this pool, rather than each
+ * starting its own threads; it's created on first use, and lasts for
+ * the life of the program.
+ */
+TaskPoolPtr task_pool_default(void)
+{
+    pthread_once(&default_once, default_init);
+    return default_pool;
+}
+
+/*
+ * task_pool_size() --Return the No. of workers in a pool.
+ */
+int task_pool_size(const TaskPool * pool)
+{
+    return ATOMIC_LOAD_ACQUIRE(&pool->n_worker);
+}
+
+/*
+ * task_pool_worker() --Return the calling thread's worker No. in a pool.
+ *
+ * Returns: (int)
+ * Success: 0..task_pool_size()-1; Failure: -1 (not one of its workers).
+ *
+ * Remarks:
+ * This lets a task use per-worker state (e.g. an accumulator each)
+ * without locking.
+ */
+int task_pool_worker(const TaskPool * pool)
+{
+    TaskWorkerPtr worker = current_worker;
+
+    return worker != NULL && worker->pool == pool ? worker->id : -1;
+}
+
+/*
+ * task_group_init() --Initialise an (empty) group of tasks.
+ */
+void task_group_init(TaskGroupPtr group)
+{
+    group->n_pending = 0;
+}
+
+/*
+ * task_submit() --Queue a task for the pool's workers.
+ *
+ * Parameters:
+ * pool  --the pool
+ * group --the group to add the task to (or NULL)
+ * proc  --the task's function
+ * data  --the task's data (passed to proc)
+ *
+ * Remarks:
+ * The group's count is increased before the task is queued, so the
+ * task may even finish before this returns.
+ */
+void task_submit(TaskPoolPtr pool, TaskGroupPtr group, TaskProc proc,
+                 void *data)
+{
+    Task task = { proc, data, NULL, 0, 0, group };
+
+    if (group != NULL)
+    {
+        __atomic_add_fetch(&group->n_pending, 1, __ATOMIC_RELAXED);
+    }
+    push_task(pool, &task);
+}
+
+/*
+ * task_group_done() --Test if all of a group's tasks have finished.
+ */
+int task_group_done(const TaskGroup * group)
+{
+    return __atomic_load_n(&group->n_pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+/*
+ * task_group_wait() --Wait for all of a group's tasks to finish.
+ *
+ * Remarks:
+ * The caller runs queued tasks (any group's) while it waits, and
+ * only sleeps when there's nothing left to run.  When this returns,
+ * the tasks' effects are visible to the caller.
+ */
+void task_group_wait(TaskPoolPtr pool, TaskGroupPtr group)
+{
+    TaskWorkerPtr self = current_worker;
+    Task task;
+
+    if (self != NULL && self->pool != pool)
+    {
+        self = NULL;
+    }
+    while (!task_group_done(group))
+    {
+        if (find_task(pool, self, &task))
+        {
+            run_task(pool, &task);
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        if (!task_group_done(group)
+            && __atomic_load_n(&pool->n_queued, __ATOMIC_SEQ_CST) == 0)
+        {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/*
+ * parallel_for() --Call a function over an index range, in parallel.
+ *
+ * Parameters:
+ * pool  --the pool (NULL: the default pool)
+ * lo, hi --the range of indexes, [lo, hi)
+ * grain --the smallest sub-range worth a task (0: choose one)
+ * proc  --the function, called with disjoint sub-ranges covering [lo, hi)
+ * data  --passed to proc
+ *
+ * Remarks:
+ * The range is split in halves recursively, so idle workers steal
+ * big pieces, and the owner works through its own small ones.  The
+ * default grain gives about 8 pieces per worker.  This returns when
+ * the whole range has been done (the caller does its share).
+ */
+void parallel_for(TaskPoolPtr pool, size_t lo, size_t hi, size_t grain,
+                  TaskRangeProc proc, void *data)
+{
+    TaskRange range = { proc, data, grain };
+    TaskGroup group = { 1 };
+    Task task = { NULL, NULL, &range, lo, hi, &group };
+
+    if (hi <= lo)
+    {
+        return;
+    }
+    if (pool == NULL && (pool = task_pool_default()) == NULL)
+    {
+        proc(data, lo, hi);            /* (no threads: do it all here) */
+        return;
+    }
+    if (range.grain == 0)
+    {
+        range.grain = (hi - lo) / (8 * (size_t) (task_pool_size(pool) + 1));
+    }
+    range.grain = MAX(range.grain, 1);
+    run_task(pool, &task);
+    task_group_wait(pool, &group);
+}
@@ -0,0 +1,117 @@
+/*
+ * TASK-POOL.H --Definitions for a work-stealing pool of worker threads.
+ *
+ * Contents:
+ * TaskGroup_t{} --A set of tasks that can be waited for together.
+ * Task_t{}      --A unit of work, as queued.
+ * TaskPool_t{}  --The state of a pool of worker threads.
+ *
+ * Remarks:
+ * A TaskGroup is the pool's "future": it counts the tasks submitted
+ * to it that haven't finished, and task_group_wait() returns when
+ * they all have (running queued tasks itself, meanwhile).  A task's
+ * result is whatever it leaves in its data.
+ */
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <apex/atomic.h>
+#include <apex/queue.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        TASK_POOL_MAX_WORKER = 256,    /* most worker threads in a pool */
+        TASK_DEQUE_SIZE = 1024,        /* per-worker queue (power of 2) */
+        TASK_INJECT_SIZE = 1024,       /* external submissions (power of 2) */
+        TASK_POOL_PIN = 0x1            /* pin worker i to CPU i */
+    };
+
+    typedef void (*TaskProc)(void *data);
+    typedef void (*TaskRangeProc)(void *data, size_t lo, size_t hi);
+
+    typedef struct TaskGroup_t
+    {
+        unsigned int n_pending;        /* No. of unfinished tasks */
+    } TaskGroup, *TaskGroupPtr;
+
+    struct TaskRange_t;
+
+    typedef struct Task_t
+    {
+        TaskProc proc;                 /* a task, or NULL for a range */
+        void *data;
+        const struct TaskRange_t *range;    /* (parallel_for()) */
+        size_t lo, hi;
+        TaskGroupPtr group;            /* ...to be notified, or NULL */
+    } Task, *TaskPtr;
+
+    /*
+     * TaskDeque_t{} --A worker's own tasks (a Chase-Lev deque).
+     *
+     * Remarks:
+     * The owner pushes and takes at the bottom (LIFO, so its tasks
+     * are cache-warm); other workers steal from the top.
+     */
+    typedef struct TaskDeque_t
+    {
+        int64_t top;                   /* (thieves) */
+        char pad_0[CACHE_LINE];
+        int64_t bottom;                /* (owner) */
+        char pad_1[CACHE_LINE];
+        Task task[TASK_DEQUE_SIZE];
+    } TaskDeque, *TaskDequePtr;
+
+    typedef struct TaskWorker_t
+    {
+        struct TaskPool_t *pool;
+        int id;
+        pthread_t thread;
+        unsigned int seed;             /* (for choosing victims) */
+        TaskDeque deque;
+    } TaskWorker, *TaskWorkerPtr;
+
+    typedef struct TaskPool_t
+    {
+        int n_worker;
+        int flags;
+        TaskWorkerPtr worker;
+        MPMCQueue inject;              /* tasks from other threads */
+        Task inject_task[TASK_INJECT_SIZE];
+        unsigned int inject_seq[TASK_INJECT_SIZE];
+        char pad_0[CACHE_LINE];
+
+        unsigned int n_queued;         /* No. of tasks in any queue */
+        unsigned int n_sleep;          /* No. of idle (waiting) workers */
+        int stop;
+        char pad_1[CACHE_LINE];
+
+        pthread_mutex_t lock;
+        pthread_cond_t work;           /* signalled when tasks are queued */
+        pthread_cond_t done;           /* broadcast when a group finishes */
+    } TaskPool, *TaskPoolPtr;
+
+    TaskPoolPtr task_pool_new(int n_worker, int flags);
+    void task_pool_free(TaskPoolPtr pool);
+    TaskPoolPtr task_pool_default(void);
+    int task_pool_size(const TaskPool * pool);
+    int task_pool_worker(const TaskPool * pool);
+
+    void task_group_init(TaskGroupPtr group);
+    void task_submit(TaskPoolPtr pool, TaskGroupPtr group, TaskProc proc,
+                     void *data);
+    int task_group_done(const TaskGroup * group);
+    void task_group_wait(TaskPoolPtr pool, TaskGroupPtr group);
+    void parallel_for(TaskPoolPtr pool, size_t lo, size_t hi, size_t grain,
+                      TaskRangeProc proc, void *data);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* TASK_POOL_H */
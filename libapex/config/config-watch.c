@@ -0,0 +1,513 @@
+/*
+ * CONFIG-WATCH.C --Reload a config file when it changes.
+ *
+ * Contents:
+ * ConfigNotify{}         --A registered change callback.
+ * ConfigWatch{}          --A watched config file, and its current values.
+ * ConfigLoad{}           --The state of loading a config file's values.
+ * load_value_()          --IniProc callback to record an option's value.
+ * load_values_()         --Load the current values of a config file.
+ * new_table_()           --Build a symbol table of some option values.
+ * reload_()              --Reload the values, publish them, and notify.
+ * watcher_()             --The watcher thread: reload after each change.
+ * config_watch_new()     --Load a config file, for watching.
+ * config_watch_free()    --Stop watching a config file, and release it.
+ * config_watch_notify()  --Register a callback for an option's changes.
+ * config_watch_start()   --Start watching the config file for changes.
+ * config_watch_reload()  --Reload the config file now.
+ * config_watch_symbols() --Return the published option values.
+ *
+ * Remarks:
+ * config_load() applies the config file once, at startup.  A
+ * ConfigWatch tracks the same file (as found by config_file_()), and
+ * a background thread waits (with inotify) for it to be rewritten or
+ * replaced, then reloads it.  The directory is watched, rather than
+ * the file, so that editors and deployment tools that rename a new
+ * file into place are seen too.
+ *
+ * Each load produces the text value of every option (from the file,
+ * or its default), which is published as a flat symbol table of
+ * option names (see sym_publish()), so that readers see either the
+ * old or the new values, never a mixture, without locking.  Then the
+ * callbacks registered for the options whose values actually changed
+ * are called, from the watcher thread.  The callbacks are OptionProcs,
+ * so e.g. an option's own proc and data can be registered, although
+ * then the caller must cope with that variable changing underneath
+ * it.  The Option values (and set flags) themselves aren't changed.
+ *
+ * Values are interned (see sym_intern()), so a change is detected by
+ * a pointer comparison.  A file that fails to load (e.g. a syntax
+ * error half-way through an edit) is ignored, and the previous values
+ * stay current.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <apex/config.h>
+#include <apex/estring.h>
+#include <apex/ini.h>
+#include <apex/log.h>
+#include <apex/vector.h>
+
+#define CONFIG_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/*
+ * ConfigNotify{} --A registered change callback.
+ */
+typedef struct ConfigNotify_t
+{
+    const char *name;                  /* the option name, or NULL (all) */
+    OptionProc proc;
+    void *data;
+} ConfigNotify, *ConfigNotifyPtr;
+
+/*
+ * ConfigWatch{} --A watched config file, and its current values.
+ */
+struct ConfigWatch_t
+{
+    char path[FILENAME_MAX];           /* the config file */
+    const char *base;                  /* ...and its name in the directory */
+    OptIndex index;                    /* the options */
+    char **value;                      /* current (interned) values */
+    SymConfig symbols;                 /* ...as published */
+    pthread_mutex_t lock;              /* (serialises reloads, notify) */
+    ConfigNotifyPtr notify;
+    size_t n_notify;
+    int inotify_fd;
+    int stop_fd[2];                    /* pipe to stop the watcher */
+    int running;
+    pthread_t thread;
+};
+
+/*
+ * ConfigLoad{} --The state of loading a config file's values.
+ */
+typedef struct ConfigLoad_t
+{
+    const OptIndex *index;
+    char **value;                      /* the file's values, by option */
+} ConfigLoad, *ConfigLoadPtr;
+
+/*
+ * load_value_() --IniProc callback to record an option's value.
+ *
+ * Remarks:
+ * As for config_load(), unknown names are ignored, and the first
+ * value of an option wins.
+ */
+static int load_value_(IniPtr UNUSED(ini), const char *section,
+                       const char *name, const char *value, void *data)
+{
+    ConfigLoadPtr load = (ConfigLoadPtr) data;
+    char full_name[LINE_MAX];
+    OptionPtr opt;
+    size_t slot;
+
+    config_ini_name_(full_name, section, name);
+    if ((opt = opt_index_find(load->index, full_name)) == NULL)
+    {
+        debug("unknown configuration value \"%s\"", full_name);
+        return 1;                      /* unknown name, that's OK */
+    }
+    slot = (size_t) (opt - load->index->opts);
+    if (load->value[slot] == NULL
+        && (load->value[slot] = sym_intern(value)) == NULL)
+    {
+        return 0;                      /* failure: intern failed */
+    }
+    return 1;
+}
+
+/*
+ * load_values_() --Load the current values of a config file.
+ *
+ * Returns: (char **)
+ * Success: the values (file or default), by option; Failure: NULL.
+ */
+static char **load_values_(ConfigWatchPtr watch)
+{
+    ConfigLoad load = {.index = &watch->index };
+    Option *opts = watch->index.opts;
+    IniPtr ini;
+    int status;
+
+    if ((load.value = NEW(char *, watch->index.n_opt + 1)) == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    if ((ini = ini_fopen(watch->path)) == NULL)
+    {
+        log_sys(LOG_INFO, "cannot load configuration \"%s\"", watch->path);
+        free(load.value);
+        return NULL;                   /* error: can't open file */
+    }
+    status = ini_parse(ini, load_value_, &load);
+    ini_close(ini);
+    for (size_t i = 0; status && i < watch->index.n_opt; ++i)
+    {
+        if (load.value[i] == NULL && opts[i].value != NULL
+            && (load.value[i] = sym_intern(opts[i].value)) == NULL)
+        {
+            status = 0;                /* error: intern failed */
+        }
+    }
+    if (!status)
+    {
+        free(load.value);
+        return NULL;
+    }
+    return load.value;
+}
+
+/*
+ * new_table_() --Build a symbol table of some option values.
+ *
+ * Returns: (SymbolPtr)
+ * Success: the table (of the options that have values); Failure: NULL.
+ */
+static SymbolPtr new_table_(ConfigWatchPtr watch, char **value)
+{
+    SymbolPtr table = NEW_VECTOR(Symbol, watch->index.n_opt + 1, NULL);
+    size_t n = 0;
+
+    if (table == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    for (size_t i = 0; i < watch->index.n_opt; ++i)
+    {
+        if (value[i] != NULL)
+        {
+            table[n].name = sym_intern(watch->index.opts[i].name);
+            table[n].type = STRING_TYPE;
+            table[n].value.string = value[i];
+            if (table[n].name == NULL)
+            {
+                table[n] = null_symbol;
+                ini_sym_free(table);
+                return NULL;           /* error: intern failed */
+            }
+            ++n;
+        }
+    }
+    table[n] = null_symbol;
+    return table;
+}
+
+/*
+ * reload_() --Reload the values, publish them, and notify.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the current values are unchanged).
+ *
+ * Remarks:
+ * The caller must hold watch->lock.
+ */
+static int reload_(ConfigWatchPtr watch)
+{
+    Option *opts = watch->index.opts;
+    char **value = load_values_(watch);
+    SymbolPtr table;
+
+    if (value == NULL)
+    {
+        return 0;                      /* error: can't load file */
+    }
+    if ((table = new_table_(watch, value)) == NULL)
+    {
+        free(value);
+        return 0;                      /* error: malloc failed */
+    }
+    if (sym_publish(&watch->symbols, table) == 0)
+    {
+        ini_sym_free(table);
+        free(value);
+        return 0;                      /* error: malloc failed */
+    }
+    for (size_t i = 0; i < watch->index.n_opt; ++i)
+    {
+        if (value[i] == watch->value[i])
+        {
+            continue;                  /* (interned: unchanged) */
+        }
+        for (size_t j = 0; j < watch->n_notify; ++j)
+        {
+            ConfigNotifyPtr notify = &watch->notify[j];
+
+            if ((notify->name == NULL || strcmp(notify->name,
+                                                opts[i].name) == 0)
+                && !notify->proc(opts[i].name, value[i], notify->data))
+            {
+                err("failed to process %s config value \"%s\"",
+                    opts[i].name, STR_OR_NULL(value[i]));
+            }
+        }
+    }
+    free(watch->value);
+    watch->value = value;
+    return 1;
+}
+
+/*
+ * watcher_() --The watcher thread: reload after each change.
+ */
+static void *watcher_(void *data)
+{
+    ConfigWatchPtr watch = (ConfigWatchPtr) data;
+    union
+    {
+        struct inotify_event event;    /* (for alignment) */
+        char buf[4096];
+    } events;
+    char *buf = events.buf;
+    struct pollfd fds[2];
+
+    fds[0].fd = watch->stop_fd[0];
+    fds[1].fd = watch->inotify_fd;
+    fds[0].events = fds[1].events = POLLIN;
+    for (;;)
+    {
+        int changed = 0, n;
+        ssize_t n_read;
+
+        SYS_RETRY(n, poll(fds, NEL(fds), -1));
+        if (n < 0 || fds[0].revents != 0)
+        {
+            break;                     /* stopped (or poll failed) */
+        }
+        SYS_RETRY(n_read, read(watch->inotify_fd, buf, sizeof(events)));
+        if (n_read <= 0)
+        {
+            break;                     /* error: inotify failed */
+        }
+        for (char *ptr = buf; ptr < buf + n_read;)
+        {
+            struct inotify_event *event = (struct inotify_event *) ptr;
+
+            if (event->len > 0 && strcmp(event->name, watch->base) == 0)
+            {
+                changed = 1;
+            }
+            ptr += sizeof(*event) + event->len;
+        }
+        if (changed && !config_watch_reload(watch))
+        {
+            notice("configuration \"%s\" not reloaded", watch->path);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * config_watch_new() --Load a config file, for watching.
+ *
+ * Parameters:
+ * file     --the configuration file to load (as for config_load())
+ * opts     --specifies the list of opts definitions
+ * n_reader --the maximum No. of threads reading the values at once
+ *
+ * Returns: (ConfigWatchPtr)
+ * Success: the watch; Failure: NULL.
+ *
+ * Remarks:
+ * The file is loaded, and its values published, but it isn't watched
+ * until config_watch_start(), so callbacks can be registered first.
+ * The opts list must outlive the watch.
+ */
+ConfigWatchPtr config_watch_new(const char *file, Option opts[],
+                                size_t n_reader)
+{
+    ConfigWatchPtr watch = NEW(ConfigWatch, 1);
+    SymbolPtr table;
+
+    if (watch == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    watch->inotify_fd = watch->stop_fd[0] = watch->stop_fd[1] = -1;
+    if (!config_file_(file, watch->path)
+        || !opt_index_init(&watch->index, opts))
+    {
+        free(watch);
+        return NULL;                   /* error: no file, malloc */
+    }
+    watch->base = strrchr(watch->path, '/');
+    watch->base = watch->base != NULL ? watch->base + 1 : watch->path;
+    if ((watch->value = load_values_(watch)) == NULL
+        || (table = new_table_(watch, watch->value)) == NULL)
+    {
+        free(watch->value);
+        opt_index_free(&watch->index);
+        free(watch);
+        return NULL;                   /* error: can't load file */
+    }
+    if (sym_config_init(&watch->symbols, table, n_reader,
+                        ini_sym_free) == NULL)
+    {
+        ini_sym_free(table);
+        free(watch->value);
+        opt_index_free(&watch->index);
+        free(watch);
+        return NULL;                   /* error: malloc failed */
+    }
+    pthread_mutex_init(&watch->lock, NULL);
+    return watch;
+}
+
+/*
+ * config_watch_free() --Stop watching a config file, and release it.
+ *
+ * Remarks:
+ * There must be no active readers of the published values.
+ */
+void config_watch_free(ConfigWatchPtr watch)
+{
+    if (watch == NULL)
+    {
+        return;
+    }
+    if (watch->running)
+    {
+        ssize_t n;
+
+        SYS_RETRY(n, write(watch->stop_fd[1], "", 1));
+        pthread_join(watch->thread, NULL);
+    }
+    for (size_t i = 0; i < NEL(watch->stop_fd); ++i)
+    {
+        if (watch->stop_fd[i] >= 0)
+        {
+            close(watch->stop_fd[i]);
+        }
+    }
+    if (watch->inotify_fd >= 0)
+    {
+        close(watch->inotify_fd);
+    }
+    sym_config_free(&watch->symbols);
+    pthread_mutex_destroy(&watch->lock);
+    opt_index_free(&watch->index);
+    free(watch->notify);
+    free(watch->value);
+    free(watch);
+}
+
+/*
+ * config_watch_notify() --Register a callback for an option's changes.
+ *
+ * Parameters:
+ * watch --the watch
+ * name  --the option's name, or NULL (for every option)
+ * proc  --the callback, called with the name and new value
+ * data  --the callback's data
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The callback is called (from the watcher thread, or the caller of
+ * config_watch_reload()) only when the option's value changes; the
+ * value is NULL if the option has neither a config value nor a
+ * default.  Callbacks must not call the config_watch_ routines.
+ */
+int config_watch_notify(ConfigWatchPtr watch, const char *name,
+                        OptionProc proc, void *data)
+{
+    ConfigNotifyPtr notify;
+
+    pthread_mutex_lock(&watch->lock);
+    if ((notify = realloc(watch->notify, (watch->n_notify + 1)
+                          * sizeof(*notify))) == NULL)
+    {
+        pthread_mutex_unlock(&watch->lock);
+        return 0;                      /* error: malloc failed */
+    }
+    watch->notify = notify;
+    notify[watch->n_notify].name = name;
+    notify[watch->n_notify].proc = proc;
+    notify[watch->n_notify++].data = data;
+    pthread_mutex_unlock(&watch->lock);
+    return 1;
+}
+
+/*
+ * config_watch_start() --Start watching the config file for changes.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0, and errno is set.
+ */
+int config_watch_start(ConfigWatchPtr watch)
+{
+    char dir[FILENAME_MAX] = ".";
+
+    if (watch->running)
+    {
+        return 1;                      /* (already started) */
+    }
+    if (watch->base != watch->path)
+    {
+        size_t len = (size_t) (watch->base - watch->path) - 1;
+
+        memcpy(dir, watch->path, len);
+        dir[len != 0 ? len : 1] = '\0'; /* (i.e. "/" for "/file") */
+    }
+    if ((watch->inotify_fd = inotify_init1(IN_CLOEXEC)) < 0
+        || inotify_add_watch(watch->inotify_fd, dir,
+                             CONFIG_WATCH_EVENTS) < 0
+        || pipe2(watch->stop_fd, O_CLOEXEC) < 0)
+    {
+        return 0;                      /* error: can't watch */
+    }
+    if ((errno = pthread_create(&watch->thread, NULL, watcher_,
+                                watch)) != 0)
+    {
+        return 0;                      /* error: no thread */
+    }
+    watch->running = 1;
+    return 1;
+}
+
+/*
+ * config_watch_reload() --Reload the config file now.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the current values are unchanged).
+ *
+ * Remarks:
+ * This does what the watcher does after a change, e.g. for a SIGHUP
+ * handler's thread, or when the watcher can't be started.
+ */
+int config_watch_reload(ConfigWatchPtr watch)
+{
+    int status;
+
+    pthread_mutex_lock(&watch->lock);
+    status = reload_(watch);
+    pthread_mutex_unlock(&watch->lock);
+    return status;
+}
+
+/*
+ * config_watch_symbols() --Return the published option values.
+ *
+ * Remarks:
+ * The values are read with sym_read_begin() etc., e.g.:
+ *
+ *     SymReaderPtr reader = sym_config_reader(symbols);
+ *     SymSnapshotPtr snapshot = sym_read_begin(symbols, reader);
+ *     ...sym_get_str(snapshot->symtab, path, &value)...
+ *     sym_read_end(reader);
+ */
+SymConfigPtr config_watch_symbols(ConfigWatchPtr watch)
+{
+    return &watch->symbols;
+}
@@ -2,11 +2,18 @@
  * CONFIG.C --Program configuration processing facilities.
  *
  * Contents:
- * get_config_path() --Return (and possibly initialise) the config search path.
- * opt_find_name_()  --Find an opts definition by its name.
- * opt_ini_()        --IniProc callback to configure values from ini parsing.
- * config_load()     --Load the program configuration.
- * config_load_ini() --Apply configuration stored in a ".ini" config file
+ * get_config_path()  --Return (and possibly initialise) the config search path.
+ * config_ini_name_() --Return the option name of an ini definition.
+ * config_file_()     --Find a config file on the config search path.
+ * opt_ini_()         --IniProc callback to configure values from ini parsing.
+ * load_ini_()        --Apply a config file, using an index of the options.
+ * config_load()      --Load the program configuration.
+ * config_load_ini()  --Apply configuration stored in a ".ini" config file
+ *
+ * Remarks:
+ * The options are indexed once (see opt_index_init()), and the index
+ * is used for both the command line and the config file, so each
+ * name is found by binary search, rather than a scan of the opts.
  */
 
 #include <apex.h>
@@ -55,25 +62,73 @@ static const char **get_config_path(void)
 }
 
 /*
- * opt_find_name_() --Find an opts definition by its name.
+ * config_ini_name_() --Return the option name of an ini definition.
  *
  * Parameters:
- * opts   --specifies the list of opts definitions
- * name     --specifies the name
+ * full_name --returns the name (LINE_MAX chars)
+ * section  --the current section, or NULL
+ * name     --the name of the "variable" just parsed
+ *
+ * Returns: (char *)
+ * full_name.
  *
- * Returns: (OptionPtr)
- * Success: the opts definition; Failure: NULL.
+ * Remarks:
+ * The name is prefixed with the section name (if any), and
+ * underscores become dashes, e.g.
+ * [foo]
+ * bar_baz=1
+ * ==> will be matched as "foo-bar-baz=1".
  */
-static OptionPtr opt_find_name_(Option opts[], const char *name)
+char *config_ini_name_(char *full_name, const char *section,
+                       const char *name)
 {
-    for (OptionPtr opt = opts; opt != NULL && opt->name != NULL; ++opt)
+    if (section != NULL)
+    {                                  /* add section name as a prefix */
+        vstrcat(full_name, section, "_", name, (char *) NULL);
+    }
+    else
     {
-        if (strcmp(name, opt->name) == 0)
+        strcpy(full_name, name);
+    }
+    estrsub(full_name, '_', '-', 1);
+    return full_name;
+}
+
+/*
+ * config_file_() --Find a config file on the config search path.
+ *
+ * Parameters:
+ * file     --the configuration file's base name
+ * config_path --returns the file's path (FILENAME_MAX chars)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The file is named "<file>.conf", and is searched for in the config
+ * search path, unless it's an absolute (or "./" etc.) path.
+ */
+int config_file_(const char *file, char *config_path)
+{
+    char config_file[FILENAME_MAX];
+
+    vstrcat(config_file, file, ".conf", (char *) NULL);
+
+    if (*file != '.' && *file != '/')
+    {                                  /*  relative path: simply open it */
+        const char *dir;
+
+        if ((dir = resolve_path(get_config_path(), config_file)) == NULL)
         {
-            return opt;                /* success */
+            return 0;                  /* error: can't find file? */
         }
+        vstrcat(config_path, dir, "/", config_file, (char *) NULL);
+    }
+    else
+    {
+        strcpy(config_path, config_file);
     }
-    return NULL;                       /* failure */
+    return 1;
 }
 
 /*
@@ -84,7 +139,7 @@ static OptionPtr opt_find_name_(Option opts[], const char *name)
  * section  --the current section, or NULL
  * name     --the name of the "variable" just parsed
  * value    --the value just parsed
- * data     --caller context  data: (the opts list)
+ * data     --caller context  data: (the opts list's OptIndex)
  *
  * Returns: (int)
  * keep-parsing: 1; abort-parsing: 0.
@@ -94,27 +149,17 @@ static OptionPtr opt_find_name_(Option opts[], const char *name)
  * e.g.
  * [foo]
  * bar=1
- * ==> will be matched as "foo_bar=1".
+ * ==> will be matched as "foo-bar=1" (see config_ini_name_()).
  */
 static int opt_ini_(IniPtr ini, const char *section,
                     const char *name, const char *value, void *data)
 {
-    OptionPtr opts = (OptionPtr) data;
+    const OptIndex *index = (const OptIndex *) data;
     OptionPtr opt;
     char full_name[LINE_MAX];
 
-    if (section != NULL)
-    {                                  /* add section name as a prefix */
-        vstrcat(full_name, section, "_", name, (char *) NULL);
-        name = full_name;
-    }
-    else
-    {
-        strcpy(full_name, name);
-    }
-    estrsub(full_name, '_', '-', 1);
-
-    if ((opt = opt_find_name_(opts, full_name)) == NULL)
+    config_ini_name_(full_name, section, name);
+    if ((opt = opt_index_find(index, full_name)) == NULL)
     {
         info("unknown configuration value \"%s\"", full_name);
         return 1;                      /* unknown name, that's OK */
@@ -132,6 +177,46 @@ static int opt_ini_(IniPtr ini, const char *section,
     return 1;                          /* success */
 }
 
+/*
+ * load_ini_() --Apply a config file, using an index of the options.
+ *
+ * Parameters:
+ * file     --the configuration file to load
+ * index    --the index of the list of opts definitions
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * This routine searches for the filename based on a search path
+ * that is currently hardcoded.  If an absolute path is specified,
+ * it is used unaltered.
+ */
+static int load_ini_(const char *file, const OptIndex * index)
+{
+    char config_path[FILENAME_MAX];
+    IniPtr ini = NULL;
+    int status = 1;                    /* OK so far... */
+
+    if (!config_file_(file, config_path))
+    {
+        return 0;                      /* error: can't find file? */
+    }
+    debug("loading configuration \"%s\"", config_path);
+    if ((ini = ini_fopen(config_path)) != NULL)
+    {
+        status = ini_parse(ini, opt_ini_, (void *) index);
+
+        ini_close(ini);
+    }
+    else
+    {
+        debug("cannot load configuration \"%s\"", config_path);
+        status = 0;
+    }
+    return status;
+}
+
 /*
  * config_load() --Load the program configuration.
  *
@@ -147,33 +232,44 @@ static int opt_ini_(IniPtr ini, const char *section,
 int config_load(int argc, char *argv[], const char *config_file,
                 Option opts[])
 {
+    OptIndex index;
+    int status = 0;
+
     for (int i = 0; opts[i].name != NULL; ++i)
     {                                  /* reset each parameter's "set" flag */
         opts[i].set = 0;
     }
-    if (!opt_getopts_long(argc, argv, opts))
+    if (!opt_index_init(&index, opts))
     {
-        err("failed to process command line arguments");
+        err("failed to index options");
         return 0;
     }
-
-    if (config_file == NULL)
+    if (!opt_getopts_index(argc, argv, &index))
+    {
+        err("failed to process command line arguments");
+    }
+    else if (config_file == NULL)
     {                                  /* fake up file from argv[0] */
-        (void) config_load_ini(path_basename(argv[0]), NULL, opts);
+        (void) load_ini_(path_basename(argv[0]), &index);
+        status = 1;
     }
-    else if (!config_load_ini(config_file, NULL, opts))
+    else if (!load_ini_(config_file, &index))
     {
         log_sys(LOG_ERR, "failed to load configuration file \"%s\"",
                 config_file);
-        return 0;                      /* error: config file */
     }
+    else
+    {
+        status = 1;
+    }
+    opt_index_free(&index);
 
-    if (!opt_defaults(opts))
+    if (status && !opt_defaults(opts))
     {
         err("failed to configure defaults");
-        return 0;
+        status = 0;
     }
-    return 1;
+    return status;
 }
 
 /*
@@ -188,41 +284,19 @@ int config_load(int argc, char *argv[], const char *config_file,
  * Success: 1; Failure: 0.
  *
  * Remarks:
- * This routine searches for the filename based on a search path
- * that is currently hardcoded.  If an absolute path is specified,
- * it is used unaltered.
+ * See load_ini_().
  */
 int config_load_ini(const char *file, const char *UNUSED(section),
                     Option opts[])
 {
-    char config_file[FILENAME_MAX];
-    char config_path[FILENAME_MAX];
-    IniPtr ini = NULL;
-    int status = 1;                    /* OK so far... */
-
-    vstrcat(config_file, file, ".conf", (char *) NULL);
-
-    if (*file != '.' && *file != '/')
-    {                                  /*  relative path: simply open it */
-        const char *dir;
-
-        if ((dir = resolve_path(get_config_path(), config_file)) == NULL)
-        {
-            return 0;                  /* error: can't find file? */
-        }
-        vstrcat(config_path, dir, "/", config_file, (char *) NULL);
-    }
-    debug("loading configuration \"%s\"", config_path);
-    if ((ini = ini_fopen(config_path)) != NULL)
-    {
-        status = ini_parse(ini, opt_ini_, opts);
+    OptIndex index;
+    int status;
 
-        ini_close(ini);
-    }
-    else
+    if (!opt_index_init(&index, opts))
     {
-        debug("cannot load configuration \"%s\"", config_file);
-        status = 0;
+        return 0;                      /* error: malloc failed */
     }
+    status = load_ini_(file, &index);
+    opt_index_free(&index);
     return status;
 }
@@ -13,14 +13,34 @@
 
 #include <apex.h>
 #include <apex/option.h>
+#include <apex/symbol.h>
 #ifdef __cplusplus
 extern "C"
 {
 #endif                                 /* C++ */
+    /*
+     * ConfigWatch --A config file, reloaded when it changes.
+     *
+     * Remarks:
+     * See config-watch.c.
+     */
+    typedef struct ConfigWatch_t ConfigWatch, *ConfigWatchPtr;
 
     int config_load(int argc, char *argv[], const char *config_file,
                     Option opts[]);
     int config_load_ini(const char *file, const char *section, Option opts[]);
+    char *config_ini_name_(char *full_name, const char *section,
+                           const char *name);
+    int config_file_(const char *file, char *config_path);
+
+    ConfigWatchPtr config_watch_new(const char *file, Option opts[],
+                                    size_t n_reader);
+    void config_watch_free(ConfigWatchPtr watch);
+    int config_watch_notify(ConfigWatchPtr watch, const char *name,
+                            OptionProc proc, void *data);
+    int config_watch_start(ConfigWatchPtr watch);
+    int config_watch_reload(ConfigWatchPtr watch);
+    SymConfigPtr config_watch_symbols(ConfigWatchPtr watch);
 
 #ifdef __cplusplus
 }
@@ -7,8 +7,15 @@
  * convert_duration[]   --Convert time/duration to SI: seconds.
  * convert_temperature[] --Convert temperature to SI(ish): Celsius.
  * convert_mass[]       --Convert mass to SI: kg.
+ * unit_hash()          --Hash a unit name, for a ConvertIndex.
+ * convert_index_init() --Build a hashed index of some conversions' units.
+ * convert_index_find() --Find the conversion for a unit.
+ * cached_index()       --Return the (per-thread) index of some conversions.
+ * parse_value()        --Parse the number at the start of a string.
+ * str_convert_index()  --Parse a string and convert it, using an index.
  * str_convert()        --Parse a string as a (double) and convert to SI units.
  * str_convertn()       --Parse a string and convert to some units.
+ * str_convert_n()      --Parse and convert an array of strings.
  * scale()              --Simple scaling conversion function.
  * linear()             --Simple linear (y = mx + c) conversion function.
  *
@@ -18,14 +25,26 @@
  * information in the data to do so.  Maybe one day.  I'm not trying
  * to re-implement units(1), this is intended for parsing command line
  * and configuration file values.
+ *
+ * Units are found by hash lookup in a ConvertIndex (one probe, and a
+ * strcmp() to confirm, for the usual small tables), rather than a
+ * strcmp() scan of the table, since the converters are also used for
+ * parsing telemetry at high rates.  str_convert() and str_convertn()
+ * keep a few indexes per thread, keyed by the table's address, so
+ * the tables must not be changed once they've been used.
  */
 
 #include <stdlib.h>
 #include <errno.h>
+#include <math.h>
+#include <string.h>
 
+#include <apex.h>
 #include <apex/convert.h>
 #include <apex/estring.h>
 
+#define CONVERT_CACHE 4                /* cached indexes per thread */
+
 static double kph_factor = 1 / 3.6;
 static double mph_factor = 1.609344 / 3.6;
 static double inch_factor = 0.0254;
@@ -120,44 +139,181 @@ Conversion convert_mass[] = {
 };
 
 /*
- * str_convert() --Parse a string as a (double) and convert to SI units.
+ * unit_hash() --Hash a unit name, for a ConvertIndex.
+ */
+static size_t unit_hash(const char *unit)
+{
+    size_t hash = 5381;
+
+    while (*unit != '\0')
+    {
+        hash = (hash * 33) ^ (unsigned char) *unit++;
+    }
+    return hash ^ (hash >> 7);
+}
+
+/*
+ * convert_index_init() --Build a hashed index of some conversions' units.
  *
  * Parameters:
- * opt  --the string to convert
- * value_ptr --returns the parsed and converted value
- * conversions --a NULL-terminated list of conversions to try
+ * index --returns the index
+ * conversions --the list of conversions
+ * n_conversion --the number of conversions, or SIZE_MAX (NULL-terminated)
  *
  * Returns: (int)
- * Success: 1; Failure: 0.
+ * Success: 1; Failure: 0 (too many conversions to index).
+ *
+ * Remarks:
+ * The index refers to the conversions, which must outlive it.  As for
+ * a scan, the first conversion of any duplicate units is found.
  */
-int str_convert(const char *opt, double *value_ptr, Conversion conversions[])
+int convert_index_init(ConvertIndexPtr index, Conversion conversions[],
+                       size_t n_conversion)
+{
+    size_t n = 0;
+
+    memset(index, 0, sizeof(*index));
+    index->conversions = conversions;
+    index->n_conversion = n_conversion;
+    for (n = 0; n < n_conversion && conversions[n].name != NULL; ++n)
+    {
+        ConversionPtr conversion = &conversions[n];
+        size_t i = unit_hash(conversion->name);
+
+        if (n >= CONVERT_INDEX_SLOTS / 2)
+        {
+            return 0;                  /* failure: table too big */
+        }
+        for (;; ++i)
+        {
+            ConversionPtr *slot = &index->slot[i % CONVERT_INDEX_SLOTS];
+
+            if (*slot == NULL)
+            {
+                *slot = conversion;
+                break;
+            }
+            if (strcmp((*slot)->name, conversion->name) == 0)
+            {
+                break;                 /* (duplicate: first one wins) */
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * convert_index_find() --Find the conversion for a unit.
+ *
+ * Returns: (ConversionPtr)
+ * Success: the conversion; Failure: NULL.
+ */
+ConversionPtr convert_index_find(const ConvertIndex * index, const char *unit)
+{
+    for (size_t i = unit_hash(unit);; ++i)
+    {
+        ConversionPtr conversion = index->slot[i % CONVERT_INDEX_SLOTS];
+
+        if (conversion == NULL || strcmp(conversion->name, unit) == 0)
+        {
+            return conversion;
+        }
+    }
+}
+
+/*
+ * cached_index() --Return the (per-thread) index of some conversions.
+ *
+ * Returns: (ConvertIndexPtr)
+ * Success: the index; Failure: NULL (the table can't be indexed).
+ */
+static const ConvertIndex *cached_index(Conversion conversions[],
+                                        size_t n_conversion)
+{
+    static THREAD_LOCAL ConvertIndex cache[CONVERT_CACHE];
+    static THREAD_LOCAL size_t next;
+    ConvertIndexPtr index;
+
+    for (size_t i = 0; i < CONVERT_CACHE; ++i)
+    {
+        if (cache[i].conversions == conversions
+            && cache[i].n_conversion == n_conversion)
+        {
+            return &cache[i];
+        }
+    }
+    index = &cache[next++ % CONVERT_CACHE];
+    if (!convert_index_init(index, conversions, n_conversion))
+    {
+        index->conversions = NULL;     /* (don't cache the failure) */
+        return NULL;
+    }
+    return index;
+}
+
+/*
+ * parse_value() --Parse the number at the start of a string.
+ *
+ * Returns: (const char *)
+ * Success: the rest of the string (i.e. the unit); Failure: NULL.
+ */
+static const char *parse_value(const char *opt, double *value_ptr)
 {
-    double value;
     char *end;
-    ConversionPtr conversion;
 
     if (opt == NULL)
     {
-        return 0;
+        return NULL;
     }
     errno = 0;                         /* reset errno! */
-    value = strtof(opt, &end);
-    if (errno != 0)
+    *value_ptr = strtof(opt, &end);
+    return errno == 0 ? end : NULL;
+}
+
+/*
+ * str_convert_index() --Parse a string and convert it, using an index.
+ *
+ * Parameters:
+ * opt  --the string to convert
+ * value_ptr --returns the parsed and converted value
+ * index --the index of the conversions to try
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int str_convert_index(const char *opt, double *value_ptr,
+                      const ConvertIndex * index)
+{
+    const char *unit = parse_value(opt, value_ptr);
+    ConversionPtr conversion;
+
+    if (unit == NULL)
     {
         return 0;
     }
-    *value_ptr = value;
-    for (conversion = conversions; conversion->name != NULL; ++conversion)
+    if ((conversion = convert_index_find(index, unit)) == NULL)
     {
-        if (strcmp(end, conversion->name) == 0)
-        {
-            *value_ptr =
-                conversion->convert(*value_ptr, conversion->caller_data);
-            return 1;                  /* success: apply conversion */
-        }
+        errno = EINVAL;
+        return 0;                      /* error: no conversion */
     }
-    errno = EINVAL;
-    return 0;                          /* error: no conversion */
+    *value_ptr = conversion->convert(*value_ptr, conversion->caller_data);
+    return 1;                          /* success: apply conversion */
+}
+
+/*
+ * str_convert() --Parse a string as a (double) and convert to SI units.
+ *
+ * Parameters:
+ * opt  --the string to convert
+ * value_ptr --returns the parsed and converted value
+ * conversions --a NULL-terminated list of conversions to try
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int str_convert(const char *opt, double *value_ptr, Conversion conversions[])
+{
+    return str_convertn(opt, value_ptr, SIZE_MAX, conversions);
 }
 
 /*
@@ -171,32 +327,30 @@ int str_convert(const char *opt, double *value_ptr, Conversion conversions[])
  *
  * Returns: (int)
  * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * Big tables (that can't be indexed) are scanned.
  */
 int str_convertn(const char *opt, double *value_ptr, size_t n_conversion,
                  Conversion conversions[])
 {
-    double value;
-    char *end;
-    ConversionPtr conversion;
-    ConversionPtr conversion_end = conversions + n_conversion;
+    const ConvertIndex *index = cached_index(conversions, n_conversion);
+    const char *unit;
 
-    if (opt == NULL)
+    if (index != NULL)
     {
-        return 0;
+        return str_convert_index(opt, value_ptr, index);
     }
-    errno = 0;                         /* reset errno! */
-    value = strtof(opt, &end);
-    if (errno != 0)
+    if ((unit = parse_value(opt, value_ptr)) == NULL)
     {
         return 0;
     }
-    *value_ptr = value;
-    for (conversion = conversions; conversion < conversion_end; ++conversion)
+    for (size_t i = 0; i < n_conversion && conversions[i].name != NULL; ++i)
     {
-        if (strcmp(end, conversion->name) == 0)
+        if (strcmp(unit, conversions[i].name) == 0)
         {
-            *value_ptr =
-                conversion->convert(*value_ptr, conversion->caller_data);
+            *value_ptr = conversions[i].convert(*value_ptr,
+                                                conversions[i].caller_data);
             return 1;                  /* success: apply conversion */
         }
     }
@@ -204,6 +358,40 @@ int str_convertn(const char *opt, double *value_ptr, size_t n_conversion,
     return 0;                          /* error: no conversion */
 }
 
+/*
+ * str_convert_n() --Parse and convert an array of strings.
+ *
+ * Parameters:
+ * opt  --the strings to convert
+ * value --returns the parsed and converted values (NAN for failures)
+ * n    --the number of strings
+ * conversions --a NULL-terminated list of conversions to try
+ *
+ * Returns: (size_t)
+ * The number of strings converted successfully.
+ */
+size_t str_convert_n(const char *opt[], double value[], size_t n,
+                     Conversion conversions[])
+{
+    ConvertIndex index;
+    int indexed = convert_index_init(&index, conversions, SIZE_MAX);
+    size_t n_ok = 0;
+
+    for (size_t i = 0; i < n; ++i)
+    {                                  /* (too big to index: scan) */
+        if (indexed ? str_convert_index(opt[i], &value[i], &index)
+            : str_convert(opt[i], &value[i], conversions))
+        {
+            ++n_ok;
+        }
+        else
+        {
+            value[i] = NAN;
+        }
+    }
+    return n_ok;
+}
+
 /*
  * scale() --Simple scaling conversion function.
  */
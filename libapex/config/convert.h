@@ -20,6 +20,18 @@ extern "C"
         void *caller_data;
     } Conversion, *ConversionPtr;
 
+    /*
+     * ConvertIndex --A hashed index of a list of conversions' units.
+     */
+#define CONVERT_INDEX_SLOTS 64         /* (indexes up to half this) */
+
+    typedef struct ConvertIndex_t
+    {
+        ConversionPtr conversions;     /* the indexed conversions */
+        size_t n_conversion;           /* ...and their No. (or SIZE_MAX) */
+        ConversionPtr slot[CONVERT_INDEX_SLOTS];
+    } ConvertIndex, *ConvertIndexPtr;
+
     typedef struct LinearConvertArg_t
     {
         double m, c;
@@ -35,6 +47,15 @@ extern "C"
                     Conversion conversions[]);
     int str_convertn(const char *opt, double *value_ptr,
                      size_t n_conversion, Conversion conversions[]);
+    size_t str_convert_n(const char *opt[], double value[], size_t n,
+                         Conversion conversions[]);
+
+    int convert_index_init(ConvertIndexPtr index, Conversion conversions[],
+                           size_t n_conversion);
+    ConversionPtr convert_index_find(const ConvertIndex * index,
+                                     const char *unit);
+    int str_convert_index(const char *opt, double *value_ptr,
+                          const ConvertIndex * index);
 
     double scale(double val, double *multiplier);
     double linear(double val, LinearConvertArgPtr arg);
@@ -0,0 +1,147 @@
+/*
+ * OPT-INDEX.C --A name (and getopt() character) index of an opts list.
+ *
+ * Contents:
+ * opt_cmp_()         --qsort() comparison for options: by name, then address.
+ * opt_index_init()   --Build the index of an opts list.
+ * opt_index_free()   --Release an index's resources.
+ * opt_index_find()   --Find an opts definition by its name.
+ * opt_index_getopt() --Find an opts definition by its getopt() character.
+ *
+ * Remarks:
+ * Finding an option by scanning the opts list is fine for a handful
+ * of options, but config_load() looks up every name in the config
+ * file, so a tool with hundreds of options and a big config file
+ * spends most of its startup in strcmp().  The index is built once
+ * per opts list: a sorted table of the options (binary-searched by
+ * name), and a table of the options by getopt() character.
+ *
+ * As for a scan, if several options have the same name (or
+ * character), the first one in the list is found.
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/option.h>
+
+/*
+ * opt_cmp_() --qsort() comparison for options: by name, then address.
+ */
+static int opt_cmp_(const void *a, const void *b)
+{
+    const Option *opt_a = *(const OptionPtr *) a;
+    const Option *opt_b = *(const OptionPtr *) b;
+    int cmp = strcmp(opt_a->name, opt_b->name);
+
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+    return (opt_a > opt_b) - (opt_a < opt_b);
+}
+
+/*
+ * opt_index_init() --Build the index of an opts list.
+ *
+ * Parameters:
+ * index --returns the index
+ * opts   --specifies the list of opts definitions
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (malloc failed).
+ *
+ * Remarks:
+ * The index refers to (but doesn't copy) the opts list, which must not
+ * be changed while the index is in use (except for the "set" flags).
+ */
+int opt_index_init(OptIndexPtr index, Option opts[])
+{
+    size_t n_opt = 0;
+
+    while (opts[n_opt].name != NULL)
+    {
+        ++n_opt;
+    }
+    memset(index, 0, sizeof(*index));
+    if ((index->by_name = NEW(OptionPtr, n_opt + 1)) == NULL)
+    {
+        return 0;                      /* error: malloc failed */
+    }
+    index->opts = opts;
+    index->n_opt = n_opt;
+    for (size_t i = n_opt; i-- > 0;)
+    {                                  /* (backwards: first one wins) */
+        index->by_name[i] = &opts[i];
+        if (opts[i].opt != '\0')
+        {
+            index->by_char[(unsigned char) opts[i].opt] = &opts[i];
+        }
+    }
+    qsort(index->by_name, n_opt, sizeof(*index->by_name), opt_cmp_);
+    return 1;
+}
+
+/*
+ * opt_index_free() --Release an index's resources.
+ */
+void opt_index_free(OptIndexPtr index)
+{
+    free(index->by_name);
+    index->by_name = NULL;
+    index->n_opt = 0;
+}
+
+/*
+ * opt_index_find() --Find an opts definition by its name.
+ *
+ * Parameters:
+ * index --the index of the opts list
+ * name  --specifies the name
+ *
+ * Returns: (OptionPtr)
+ * Success: the opts definition; Failure: NULL.
+ */
+OptionPtr opt_index_find(const OptIndex * index, const char *name)
+{
+    size_t lo = 0, hi = index->n_opt;
+
+    while (lo < hi)
+    {                                  /* (lower bound: first of duplicates) */
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(index->by_name[mid]->name, name) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo < index->n_opt && strcmp(index->by_name[lo]->name, name) == 0)
+    {
+        return index->by_name[lo];     /* success */
+    }
+    return NULL;                       /* failure */
+}
+
+/*
+ * opt_index_getopt() --Find an opts definition by its getopt() character.
+ *
+ * Parameters:
+ * index --the index of the opts list
+ * ch    --specifies the getopt() character
+ *
+ * Returns: (OptionPtr)
+ * Success: the opts definition; Failure: NULL.
+ */
+OptionPtr opt_index_getopt(const OptIndex * index, int ch)
+{
+    if (ch <= 0 || ch > UCHAR_MAX)
+    {
+        return NULL;                   /* failure: not a character */
+    }
+    return index->by_char[ch];
+}
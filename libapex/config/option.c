@@ -5,9 +5,9 @@
  * opt_len_()          --Count the number of items in a 0-terminated opts list.
  * compile_opts_()     --Construct a getopt() option string from an opts list.
  * compile_longopts_() --Construct a getopt_long() option string.
- * opt_find_getopt_()  --Find an opts definition by its getopt() character.
  * opt_getopts()       --Process a main-style arglist with some opts options.
  * opt_getopts_long()  --Process a main-style arglist with long options.
+ * opt_getopts_index() --Process a main-style arglist with indexed options.
  * opt_defaults()      --Process the default spec.s for each opts item.
  * opt_usage()         --Print a usage message describing options to stderr.
  *
@@ -94,28 +94,6 @@ static struct option *compile_longopts_(Option opts[])
     return long_opts;
 }
 
-/*
- * opt_find_getopt_() --Find an opts definition by its getopt() character.
- *
- * Parameters:
- * opts   --specifies the list of opts definitions
- * ch       --specifies the getopt() character
- *
- * Returns: (OptionPtr)
- * Success: the opts definition; Failure: NULL.
- */
-static OptionPtr opt_find_getopt_(Option opts[], int ch)
-{
-    for (OptionPtr opt = opts; opt != NULL && opt->name != NULL; ++opt)
-    {
-        if (opt->opt == ch)
-        {
-            return opt;                /* success */
-        }
-    }
-    return NULL;                       /* failure */
-}
-
 /*
  * opt_getopts() --Process a main-style arglist with some opts options.
  *
@@ -136,8 +114,14 @@ int opt_getopts(int argc, char *argv[], Option opts[])
 {
     char getopt_buf[128];
     char *short_opts = compile_opts_(opts, getopt_buf);
+    OptIndex index;
+    int status = 1;
     int ch;
 
+    if (!opt_index_init(&index, opts))
+    {
+        return 0;                      /* failure: malloc failed */
+    }
     while ((ch = getopt(argc, (char **) argv, short_opts)) >= 0)
     {
         const char *value = NULL;
@@ -145,12 +129,14 @@ int opt_getopts(int argc, char *argv[], Option opts[])
 
         if (ch == '?')
         {
-            return 0;                  /* failure: bad option */
+            status = 0;
+            break;                     /* failure: bad option */
         }
-        if ((opt = opt_find_getopt_(opts, ch)) == NULL)
+        if ((opt = opt_index_getopt(&index, ch)) == NULL)
         {
             err("\"-%c\": unrecognised option", ch);
-            return 0;                  /* failure: bad name */
+            status = 0;
+            break;                     /* failure: bad name */
         }
         if (opt->value != NULL)
         {
@@ -162,12 +148,14 @@ int opt_getopts(int argc, char *argv[], Option opts[])
             {
                 err("\"-%c %s\": unrecognised value", ch,
                     (value != NULL) ? value : "");
-                return 0;              /* failure: bad value */
+                status = 0;
+                break;                 /* failure: bad value */
             }
             opt->set = 1;
         }
     }
-    return 1;
+    opt_index_free(&index);
+    return status;
 }
 
 /*
@@ -183,6 +171,37 @@ int opt_getopts(int argc, char *argv[], Option opts[])
  */
 int opt_getopts_long(int argc, char *argv[], Option opts[])
 {
+    OptIndex index;
+    int status;
+
+    if (!opt_index_init(&index, opts))
+    {
+        return 0;                      /* failure: malloc failed */
+    }
+    status = opt_getopts_index(argc, argv, &index);
+    opt_index_free(&index);
+    return status;
+}
+
+/*
+ * opt_getopts_index() --Process a main-style arglist with indexed options.
+ *
+ * Parameters:
+ * argc     --count of the number of arguments to process
+ * argv     --the arguments to process (e.g. from main(...))
+ * index    --the index of the list of opts definitions
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * This is opt_getopts_long(), for callers that have already built an
+ * index of the options (e.g. config_load(), which also uses the index
+ * for the config file).
+ */
+int opt_getopts_index(int argc, char *argv[], const OptIndex * index)
+{
+    Option *opts = index->opts;
     char getopt_buf[128];
     char *short_opts = compile_opts_(opts, getopt_buf);
     struct option *long_opts = compile_longopts_(opts);
@@ -215,7 +234,7 @@ int opt_getopts_long(int argc, char *argv[], Option opts[])
         }
         else
         {                              /* a short option was parsed */
-            if ((opt = opt_find_getopt_(opts, ch)) == NULL)
+            if ((opt = opt_index_getopt(index, ch)) == NULL)
             {
                 if (ch != '?')
                 {
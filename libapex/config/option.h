@@ -12,6 +12,7 @@
 #ifndef OPTION_H
 #define OPTION_H
 
+#include <limits.h>
 #include <apex.h>
 #ifdef __cplusplus
 extern "C"
@@ -41,11 +42,28 @@ extern "C"
         int set;                       /* flag: has this option been set already? */
     } Option, *OptionPtr, *Options;
 
+    /*
+     * OptIndex --An index of an opts list, by name and getopt() char.
+     */
+    typedef struct OptIndex_t
+    {
+        Option *opts;                  /* the indexed opts list */
+        size_t n_opt;
+        OptionPtr *by_name;            /* the options, sorted by name */
+        OptionPtr by_char[UCHAR_MAX + 1];  /* the options, by getopt() char */
+    } OptIndex, *OptIndexPtr;
+
     int opt_defaults(Option opts[]);
     int opt_getopts(int argc, char *argv[], Option opts[]);
     int opt_getopts_long(int argc, char *argv[], Option opts[]);
+    int opt_getopts_index(int argc, char *argv[], const OptIndex * index);
     void opt_usage(const char *prologue, Option opts[], const char *epilogue);
 
+    int opt_index_init(OptIndexPtr index, Option opts[]);
+    void opt_index_free(OptIndexPtr index);
+    OptionPtr opt_index_find(const OptIndex * index, const char *name);
+    OptionPtr opt_index_getopt(const OptIndex * index, int ch);
+
     /*
      * OptProc conversion routines...
      */
@@ -0,0 +1,242 @@
+/*
+ * CSV-BLOCK.C --Read blocks of CSV records into typed columns.
+ *
+ * Contents:
+ * csv_block_init() --Initialise a block of columns for a CSV file.
+ * csv_block_free() --Release a block's columns and text.
+ * csv_read_block() --Read up to a block's worth of records.
+ *
+ * Remarks:
+ * csv_read() returns a record as an array of Atoms, so a column of
+ * values is strided across records, and each value is tagged.  A
+ * CSVBlock instead holds a column per field, as a plain array: numeric
+ * fields are decoded into SYMBOL_INT or double arrays, and anything
+ * else into CSVViews of the text; aggregating a column is then a loop
+ * over contiguous memory.
+ *
+ * Numeric fields are converted with their scan_fmt, as by csv_read();
+ * it should store a whole Value member (e.g. "%ld" or "%lf").  Fields
+ * that fail to convert, or are missing from a short record, are 0 (or
+ * an empty view).
+ *
+ * For a mapped file (mode "m"), the views point into the mapping, and
+ * may need csv_view_copy(); otherwise, the text is copied into the
+ * block's arena, and stays valid until the next csv_read_block().  An
+ * image (mode "b") fills the columns directly (see csv-image.c).
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/csv.h>
+
+#define CSV_BLOCK_ARENA 65536          /* arena block size */
+#define CSV_NUMBER_MAX 64              /* longest number (for views) */
+
+/*
+ * csv_block_init() --Initialise a block of columns for a CSV file.
+ *
+ * Parameters:
+ * block   --the block to initialise (owned by caller)
+ * csv_fp  --the CSV file whose fields define the columns
+ * max_row --the No. of records in a block
+ *
+ * Returns: (CSVBlockPtr)
+ * Success: block; Failure: NULL.
+ *
+ * Remarks:
+ * The columns' types are taken from the file's fields when the block
+ * is initialised, so change the fields (if at all) before this.
+ */
+CSVBlockPtr csv_block_init(CSVBlockPtr block, CSVFilePtr csv_fp,
+                           size_t max_row)
+{
+    if (block == NULL || csv_fp == NULL || max_row == 0)
+    {
+        return NULL;                   /* error: no block/file/rows! */
+    }
+    memset(block, 0, sizeof(*block));
+    arena_init(&block->text, CSV_BLOCK_ARENA);
+    block->max_row = max_row;
+    block->n_column = csv_fp->n_field;
+    if ((block->column = calloc(block->n_column, sizeof(CSVColumn))) == NULL
+        || (block->record = calloc(block->n_column, sizeof(Atom))) == NULL
+        || (block->view = calloc(block->n_column, sizeof(CSVView))) == NULL)
+    {
+        csv_block_free(block);
+        return NULL;                   /* error: calloc failed */
+    }
+    for (size_t i = 0; i < block->n_column; ++i)
+    {
+        CSVColumnPtr column = &block->column[i];
+        size_t size;
+
+        column->type = csv_fp->field[i].item.type;
+        size = column->type == INTEGER_TYPE ? sizeof(SYMBOL_INT)
+            : column->type == REAL_TYPE ? sizeof(double) : sizeof(CSVView);
+        if ((column->data.any = calloc(max_row, size)) == NULL)
+        {
+            csv_block_free(block);
+            return NULL;
+        }
+    }
+    return block;
+}
+
+/*
+ * csv_block_free() --Release a block's columns and text.
+ */
+void csv_block_free(CSVBlockPtr block)
+{
+    if (block != NULL)
+    {
+        if (block->column != NULL)
+        {
+            for (size_t i = 0; i < block->n_column; ++i)
+            {
+                free(block->column[i].data.any);
+            }
+            free(block->column);
+        }
+        free(block->record);
+        free(block->view);
+        arena_free(&block->text);
+        memset(block, 0, sizeof(*block));
+    }
+}
+
+/*
+ * store_value() --Convert a field's text into its column.
+ */
+static void store_value(CSVColumnPtr column, CSVFieldPtr field,
+                        size_t row, const char *text)
+{
+    Value value;
+
+    memset(&value, 0, sizeof(value));
+    csv_scan_value_(field->scan_fmt, text, &value);
+    if (column->type == INTEGER_TYPE)
+    {
+        column->data.integer[row] = value.integer;
+    }
+    else
+    {
+        column->data.real[row] = value.real;
+    }
+}
+
+/*
+ * read_mapped() --Read a record of a mapped file into a block's row.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (EOF).
+ */
+static int read_mapped(CSVFilePtr csv_fp, CSVBlockPtr block, size_t row)
+{
+    size_t n = csv_read_view(csv_fp, block->n_column, block->view);
+
+    if (n == 0)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < block->n_column; ++i)
+    {
+        CSVColumnPtr column = &block->column[i];
+        CSVView view = {.str = "",.len = 0,.quoted = 0 };
+        char text[CSV_NUMBER_MAX];
+
+        if (i < n)
+        {
+            view = block->view[i];
+        }
+        if (column->type == INTEGER_TYPE || column->type == REAL_TYPE)
+        {                              /* (views aren't NUL-terminated) */
+            csv_view_copy(&view, sizeof(text), text);
+            store_value(column, &csv_fp->field[i], row, text);
+        }
+        else
+        {
+            column->data.view[row] = view;
+        }
+    }
+    return 1;
+}
+
+/*
+ * read_buffered() --Read a record of a stdio file into a block's row.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (EOF, or out of memory).
+ */
+static int read_buffered(CSVFilePtr csv_fp, CSVBlockPtr block, size_t row)
+{
+    char bytes[CSV_TEXT_MAX + 1];
+    size_t n = csv_parse_record_(csv_fp, block->n_column, block->record,
+                                 sizeof(bytes), bytes);
+
+    if (n == 0)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < block->n_column; ++i)
+    {
+        CSVColumnPtr column = &block->column[i];
+        const char *text = i < n ? block->record[i].value.string : "";
+
+        if (column->type == INTEGER_TYPE || column->type == REAL_TYPE)
+        {
+            store_value(column, &csv_fp->field[i], row, text);
+        }
+        else
+        {
+            CSVViewPtr view = &column->data.view[row];
+
+            view->len = strlen(text);
+            view->quoted = 0;
+            if ((view->str = arena_alloc(&block->text, view->len + 1))
+                == NULL)
+            {
+                return 0;              /* error: no memory */
+            }
+            memcpy((char *) view->str, text, view->len + 1);
+        }
+    }
+    return 1;
+}
+
+/*
+ * csv_read_block() --Read up to a block's worth of records.
+ *
+ * Parameters:
+ * csv_fp --the CSV file (opened with mode "r", "m" or "b")
+ * block  --the block (initialised for csv_fp) to read into
+ *
+ * Returns: (size_t)
+ * The No. of records read (also block->n_row); 0 at EOF.
+ *
+ * Remarks:
+ * Each call overwrites the previous block's rows (and text).
+ */
+size_t csv_read_block(CSVFilePtr csv_fp, CSVBlockPtr block)
+{
+    int (*read_row)(CSVFilePtr csv_fp, CSVBlockPtr block, size_t row);
+
+    block->n_row = 0;
+    if (csv_fp->mode == 'b')
+    {
+        return csv_image_read_block_(csv_fp, block);
+    }
+    if (csv_fp->mode != 'r' && csv_fp->mode != 'm')
+    {
+        return 0;                      /* error: this mode can't read */
+    }
+    read_row = csv_fp->mode == 'm' ? read_mapped : read_buffered;
+    arena_reset(&block->text);
+    while (block->n_row < block->max_row
+           && read_row(csv_fp, block, block->n_row))
+    {
+        ++block->n_row;
+    }
+    return block->n_row;
+}
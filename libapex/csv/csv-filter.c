@@ -0,0 +1,158 @@
+/*
+ * CSV-FILTER.C --Read and write compressed CSV files via a filter process.
+ *
+ * Contents:
+ * csv_filter_()       --Find the (de)compressor for a CSV file, if any.
+ * csv_filter_open_()  --Open a compressed file through a filter process.
+ * csv_filter_close_() --Wait for a CSV file's filter process to finish.
+ *
+ * Remarks:
+ * A CSV file whose name ends in ".gz" or ".zst" (or opened with a 'z'
+ * in its mode, e.g. "rz") is read or written through gzip(1) or
+ * zstd(1), running as a separate process connected by a pipe.  The
+ * filter (de)compresses concurrently with the caller's parsing or
+ * formatting, and no temporary file is needed.
+ *
+ * The filter is started with posix_spawnp(), with the compressed file
+ * as its stdin (or stdout), so the path is never interpreted by a
+ * shell.  Compressed files can't be appended to, or memory-mapped.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <apex/csv.h>
+#include <apex/log.h>
+
+extern char **environ;
+
+typedef struct CSVFilter_t
+{
+    const char *suffix;
+    const char *program;
+} CSVFilter;
+
+static const CSVFilter filters[] = {
+    {".gz", "gzip"},                   /* (the first is the 'z' default) */
+    {".zst", "zstd"},
+};
+
+/*
+ * csv_filter_() --Find the (de)compressor for a CSV file, if any.
+ *
+ * Returns: (const char *)
+ * Success: the filter program's name; Failure: NULL (not compressed).
+ */
+const char *csv_filter_(const char *path, const char *mode)
+{
+    size_t len = strlen(path);
+
+    for (size_t i = 0; i < NEL(filters); ++i)
+    {
+        size_t suffix_len = strlen(filters[i].suffix);
+
+        if (len > suffix_len
+            && strcmp(path + len - suffix_len, filters[i].suffix) == 0)
+        {
+            return filters[i].program;
+        }
+    }
+    return strchr(mode, 'z') != NULL ? filters[0].program : NULL;
+}
+
+/*
+ * csv_filter_open_() --Open a compressed file through a filter process.
+ *
+ * Parameters:
+ * csv_fp  --the CSV file (mode 'r' or 'w'); returns the filter's pid
+ * path    --the compressed file's path
+ * program --the filter program (see csv_filter_())
+ *
+ * Returns: (FILE *)
+ * Success: a stream of the uncompressed text; Failure: NULL.
+ */
+FILE *csv_filter_open_(CSVFilePtr csv_fp, const char *path,
+                       const char *program)
+{
+    int reading = csv_fp->mode == 'r';
+    char *argv[] = { (char *) program, (char *) (reading ? "-dc" : "-c"),
+        (char *) "-q", NULL
+    };
+    int file_fd = reading ? STDIN_FILENO : STDOUT_FILENO;
+    int file_flags = reading ? O_RDONLY : O_WRONLY | O_CREAT | O_TRUNC;
+    posix_spawn_file_actions_t actions;
+    int pipe_fd[2];                    /* [0]: read end, [1]: write end */
+    int parent_fd, child_fd, status;
+    FILE *fp;
+
+    if (reading && access(path, R_OK) != 0)
+    {
+        return NULL;                   /* error: can't read it */
+    }
+    if (pipe(pipe_fd) != 0)
+    {
+        return NULL;                   /* error: pipe failed */
+    }
+    parent_fd = pipe_fd[reading ? 0 : 1];
+    child_fd = pipe_fd[reading ? 1 : 0];
+    fcntl(parent_fd, F_SETFD, FD_CLOEXEC);     /* (so no child holds it) */
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, child_fd,
+                                     STDIN_FILENO + STDOUT_FILENO - file_fd);
+    posix_spawn_file_actions_addclose(&actions, child_fd);
+    posix_spawn_file_actions_addopen(&actions, file_fd, path, file_flags,
+                                     0666);
+    status = posix_spawnp(&csv_fp->filter_pid, program, &actions, NULL,
+                          argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(child_fd);
+    if (status != 0)
+    {
+        close(parent_fd);
+        csv_fp->filter_pid = 0;
+        trace_debug("cannot run \"%s\"", program);
+        return NULL;                   /* error: spawn failed */
+    }
+    if ((fp = fdopen(parent_fd, reading ? "r" : "w")) == NULL)
+    {
+        close(parent_fd);
+        csv_filter_close_(csv_fp);
+    }
+    return fp;
+}
+
+/*
+ * csv_filter_close_() --Wait for a CSV file's filter process to finish.
+ *
+ * Returns: (int)
+ * Success: 1 (the filter succeeded); Failure: 0.
+ *
+ * Remarks:
+ * The caller must close the pipe (i.e. csv_fp->fp) first, so that a
+ * compressor sees EOF (and a decompressor isn't blocked writing).
+ */
+int csv_filter_close_(CSVFilePtr csv_fp)
+{
+    int status = 0;
+
+    if (csv_fp->filter_pid == 0)
+    {
+        return 1;
+    }
+    while (waitpid(csv_fp->filter_pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            status = -1;
+            break;
+        }
+    }
+    csv_fp->filter_pid = 0;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
@@ -0,0 +1,715 @@
+/*
+ * CSV-IMAGE.C --A binary, columnar image of a CSV file's records.
+ *
+ * Contents:
+ * csv_image_write()       --Convert a CSV file's records into an image file.
+ * csv_image_open_()       --Map an image file, and make its fields.
+ * csv_image_read_()       --Read a record from an image, as Atoms.
+ * csv_image_read_block_() --Read a block of records from an image.
+ * csv_image_range()       --Get the range of a numeric column of an image.
+ *
+ * Remarks:
+ * An image stores each field's values as a column: integers and reals
+ * as arrays of int64_t and double, and anything else as NUL-terminated
+ * strings, indexed by an array of offsets.  The header records the
+ * fields (their names, types and formats), the No. of records, and the
+ * minimum and maximum of each numeric column.
+ *
+ * An image is opened with csv_open(path, "b"): it's mapped read-only,
+ * and csv_read() and csv_read_block() return the same values that
+ * reading the original CSV file (with the same fields) would, without
+ * any text parsing; strings point into the mapping.
+ *
+ * Images use the host's byte order, and are rejected (EINVAL) by a
+ * host with another byte order.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <apex/csv.h>
+
+#define CSV_IMAGE_MAGIC "APEXCSV"      /* (with the NUL: 8 bytes) */
+#define CSV_IMAGE_VERSION 1
+#define CSV_IMAGE_ORDER 0x01020304     /* reads differently if swapped */
+#define CSV_IMAGE_BLOCK 4096           /* rows converted at a time */
+#define CSV_IMAGE_ALIGN(n_) (((n_) + 7) & ~(size_t) 7)
+
+/*
+ * CSVImageColumn{} --The description of a column, in an image's header.
+ */
+typedef struct CSVImageColumn_t
+{
+    uint32_t type;                     /* the field's Type */
+    uint32_t has_range;                /* min, max are valid */
+    uint64_t name;                     /* offset of the field's name */
+    uint64_t scan_fmt;                 /* offset of its scan format */
+    uint64_t print_fmt;                /* offset of its print format */
+    uint64_t data;                     /* offset of the values/offsets */
+    union
+    {
+        int64_t integer;
+        double real;
+    } min, max;
+} CSVImageColumn;
+
+/*
+ * CSVImageHeader{} --The header of a CSV image file.
+ */
+typedef struct CSVImageHeader_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t order;                    /* CSV_IMAGE_ORDER, in host order */
+    uint64_t size;                     /* the size of the whole image */
+    uint64_t n_row;
+    uint64_t n_column;
+    CSVImageColumn column[];
+} CSVImageHeader;
+
+/*
+ * ImageBuffer{} --A growable byte buffer, for building an image.
+ */
+typedef struct ImageBuffer_t
+{
+    char *data;
+    size_t size;
+    size_t max_size;
+} ImageBuffer;
+
+/*
+ * buffer_reserve() --Make room for n more bytes in a buffer.
+ *
+ * Returns: (char *)
+ * Success: the end of the buffer's data; Failure: NULL.
+ */
+static char *buffer_reserve(ImageBuffer *buffer, size_t n)
+{
+    if (buffer->size + n > buffer->max_size)
+    {
+        size_t max_size = MAX(buffer->max_size * 2, buffer->size + n);
+        char *data = realloc(buffer->data, max_size);
+
+        if (data == NULL)
+        {
+            return NULL;               /* error: realloc failed */
+        }
+        buffer->data = data;
+        buffer->max_size = max_size;
+    }
+    return buffer->data + buffer->size;
+}
+
+/*
+ * buffer_append() --Append some bytes to a buffer.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int buffer_append(ImageBuffer *buffer, const void *data, size_t n)
+{
+    char *end = buffer_reserve(buffer, n);
+
+    if (end == NULL)
+    {
+        return 0;
+    }
+    memcpy(end, data, n);
+    buffer->size += n;
+    return 1;
+}
+
+/*
+ * append_string() --Append a NUL-terminated string to a buffer.
+ *
+ * Returns: (uint64_t)
+ * Success: the string's offset in the buffer; Failure: UINT64_MAX.
+ */
+static uint64_t append_string(ImageBuffer *buffer, const char *str)
+{
+    uint64_t offset = buffer->size;
+
+    if (str == NULL)
+    {
+        str = "";
+    }
+    return buffer_append(buffer, str, strlen(str) + 1) ? offset : UINT64_MAX;
+}
+
+/*
+ * append_block() --Append a block's values to the image's columns.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory).
+ */
+static int append_block(CSVBlockPtr block, CSVImageColumn *column,
+                        ImageBuffer *data, ImageBuffer *text)
+{
+    for (size_t c = 0; c < block->n_column; ++c)
+    {
+        CSVColumnPtr col = &block->column[c];
+
+        for (size_t i = 0; i < block->n_row; ++i)
+        {
+            if (col->type == INTEGER_TYPE)
+            {
+                int64_t v = col->data.integer[i];
+
+                if (!column[c].has_range || v < column[c].min.integer)
+                {
+                    column[c].min.integer = v;
+                }
+                if (!column[c].has_range || v > column[c].max.integer)
+                {
+                    column[c].max.integer = v;
+                }
+                column[c].has_range = 1;
+                if (!buffer_append(&data[c], &v, sizeof(v)))
+                {
+                    return 0;
+                }
+            }
+            else if (col->type == REAL_TYPE)
+            {
+                double v = col->data.real[i];
+
+                if (!isnan(v))
+                {
+                    if (!column[c].has_range || v < column[c].min.real)
+                    {
+                        column[c].min.real = v;
+                    }
+                    if (!column[c].has_range || v > column[c].max.real)
+                    {
+                        column[c].max.real = v;
+                    }
+                    column[c].has_range = 1;
+                }
+                if (!buffer_append(&data[c], &v, sizeof(v)))
+                {
+                    return 0;
+                }
+            }
+            else
+            {                          /* (the text, and its end offset) */
+                CSVViewPtr view = &col->data.view[i];
+                size_t len = csv_view_copy(view, 0, NULL);
+                char *str = buffer_reserve(&text[c], len + 1);
+                uint64_t end;
+
+                if (str == NULL)
+                {
+                    return 0;
+                }
+                csv_view_copy(view, len + 1, str);
+                text[c].size += len + 1;
+                end = text[c].size;
+                if (!buffer_append(&data[c], &end, sizeof(end)))
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * write_buffer() --Write a buffer's data, padded to a multiple of 8.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int write_buffer(FILE *fp, const ImageBuffer *buffer)
+{
+    static const char pad[8];
+    size_t n_pad = CSV_IMAGE_ALIGN(buffer->size) - buffer->size;
+
+    return (buffer->size == 0
+            || fwrite(buffer->data, 1, buffer->size, fp) == buffer->size)
+        && fwrite(pad, 1, n_pad, fp) == n_pad;
+}
+
+/*
+ * write_image() --Lay out and write an image's parts.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int write_image(FILE *fp, CSVImageHeader *header,
+                       ImageBuffer *strings, ImageBuffer *data,
+                       ImageBuffer *text)
+{
+    size_t n_column = header->n_column;
+    size_t size = sizeof(*header) + n_column * sizeof(CSVImageColumn);
+    size_t string_base = size;
+
+    size = CSV_IMAGE_ALIGN(size + strings->size);
+    for (size_t c = 0; c < n_column; ++c)
+    {
+        CSVImageColumn *column = &header->column[c];
+
+        column->name += string_base;
+        column->scan_fmt += string_base;
+        column->print_fmt += string_base;
+        column->data = size;
+        size += data[c].size;
+    }
+    for (size_t c = 0; c < n_column; ++c)
+    {                                  /* (text offsets are image offsets) */
+        if (header->column[c].type != INTEGER_TYPE
+            && header->column[c].type != REAL_TYPE)
+        {
+            uint64_t *offset = (uint64_t *) data[c].data;
+
+            for (size_t i = 0; i <= header->n_row; ++i)
+            {
+                offset[i] += size;
+            }
+            size += CSV_IMAGE_ALIGN(text[c].size);
+        }
+    }
+    header->size = size;
+
+    if (fwrite(header, sizeof(*header) + n_column * sizeof(CSVImageColumn),
+               1, fp) != 1 || !write_buffer(fp, strings))
+    {
+        return 0;
+    }
+    for (size_t c = 0; c < n_column; ++c)
+    {
+        if (!write_buffer(fp, &data[c]))
+        {
+            return 0;
+        }
+    }
+    for (size_t c = 0; c < n_column; ++c)
+    {
+        if (!write_buffer(fp, &text[c]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * csv_image_write() --Convert a CSV file's records into an image file.
+ *
+ * Parameters:
+ * path   --the name of the image file to create
+ * csv_fp --the CSV file (mode "r" or "m") to convert
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ *
+ * Remarks:
+ * All of csv_fp's remaining records are converted, using its fields'
+ * types and scan formats (as for csv_read_block()), so set the fields
+ * before converting.  The image is written to "<path>.tmp" and then
+ * renamed, so readers never see a partial image.
+ */
+int csv_image_write(const char *path, CSVFilePtr csv_fp)
+{
+    size_t n_column = csv_fp != NULL ? csv_fp->n_field : 0;
+    CSVImageHeader *header = NULL;
+    ImageBuffer strings = { NULL, 0, 0 };
+    ImageBuffer *data = NULL, *text = NULL;
+    CSVBlock block;
+    int status = 0, have_block = 0;
+    char *tmp_path = NULL;
+    FILE *fp;
+    size_t n;
+
+    if (path == NULL || csv_fp == NULL
+        || (csv_fp->mode != 'r' && csv_fp->mode != 'm'))
+    {
+        errno = EINVAL;
+        return 0;                      /* error: no path/readable file */
+    }
+    if ((header = calloc(1, sizeof(*header)
+                         + n_column * sizeof(CSVImageColumn))) == NULL
+        || (data = calloc(n_column, sizeof(*data))) == NULL
+        || (text = calloc(n_column, sizeof(*text))) == NULL
+        || !(have_block = csv_block_init(&block, csv_fp,
+                                         CSV_IMAGE_BLOCK) != NULL))
+    {
+        goto done;
+    }
+    memcpy(header->magic, CSV_IMAGE_MAGIC, sizeof(header->magic));
+    header->version = CSV_IMAGE_VERSION;
+    header->order = CSV_IMAGE_ORDER;
+    header->n_column = n_column;
+    for (size_t c = 0; c < n_column; ++c)
+    {
+        CSVImageColumn *column = &header->column[c];
+        CSVFieldPtr field = &csv_fp->field[c];
+        uint64_t zero = 0;
+
+        column->type = (uint32_t) field->item.type;
+        if ((column->name = append_string(&strings, field->item.name))
+            == UINT64_MAX
+            || (column->scan_fmt = append_string(&strings, field->scan_fmt))
+            == UINT64_MAX
+            || (column->print_fmt = append_string(&strings,
+                                                  field->print_fmt))
+            == UINT64_MAX)
+        {
+            goto done;
+        }
+        if (column->type != INTEGER_TYPE && column->type != REAL_TYPE
+            && !buffer_append(&data[c], &zero, sizeof(zero)))
+        {
+            goto done;                 /* (the first string's offset) */
+        }
+    }
+    while ((n = csv_read_block(csv_fp, &block)) != 0)
+    {
+        if (!append_block(&block, header->column, data, text))
+        {
+            goto done;
+        }
+        header->n_row += n;
+    }
+
+    if ((tmp_path = malloc(strlen(path) + 5)) == NULL)
+    {
+        goto done;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+    if ((fp = fopen(tmp_path, "wb")) == NULL)
+    {
+        goto done;
+    }
+    if (!write_image(fp, header, &strings, data, text))
+    {
+        fclose(fp);
+        remove(tmp_path);
+        goto done;
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+    {
+        remove(tmp_path);
+        goto done;
+    }
+    status = 1;
+  done:
+    if (have_block)
+    {
+        csv_block_free(&block);
+    }
+    for (size_t c = 0; c < n_column; ++c)
+    {
+        free(data != NULL ? data[c].data : NULL);
+        free(text != NULL ? text[c].data : NULL);
+    }
+    free(strings.data);
+    free(data);
+    free(text);
+    free(header);
+    free(tmp_path);
+    return status;
+}
+
+/*
+ * image_header() --Return a mapped image's header.
+ */
+static const CSVImageHeader *image_header(CSVFilePtr csv_fp)
+{
+    return (const CSVImageHeader *) csv_fp->buf;
+}
+
+/*
+ * check_string() --Test that an image offset addresses a string.
+ */
+static int check_string(const CSVImageHeader *header, size_t size,
+                        size_t base, uint64_t offset)
+{
+    return offset >= base && offset < size
+        && memchr((const char *) header + offset, '\0',
+                  size - offset) != NULL;
+}
+
+/*
+ * check_image() --Test that an image's header and columns are sane.
+ *
+ * Remarks:
+ * The string offsets of each column are only checked at the ends, so
+ * that opening an image doesn't read it all.
+ */
+static int check_image(const CSVImageHeader *header, size_t size)
+{
+    size_t base;
+
+    if (memcmp(header->magic, CSV_IMAGE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != CSV_IMAGE_VERSION
+        || header->order != CSV_IMAGE_ORDER || header->size != size
+        || header->n_column == 0
+        || header->n_column > (size - sizeof(*header))
+        / sizeof(CSVImageColumn) || header->n_row > size / sizeof(uint64_t))
+    {
+        return 0;
+    }
+    base = sizeof(*header) + header->n_column * sizeof(CSVImageColumn);
+    for (size_t c = 0; c < header->n_column; ++c)
+    {
+        const CSVImageColumn *column = &header->column[c];
+        int is_text = column->type != INTEGER_TYPE
+            && column->type != REAL_TYPE;
+        size_t n = header->n_row + (is_text ? 1 : 0);
+
+        if (!check_string(header, size, base, column->name)
+            || !check_string(header, size, base, column->scan_fmt)
+            || !check_string(header, size, base, column->print_fmt)
+            || column->data < base || column->data > size
+            || column->data % 8 != 0 || (size - column->data) / 8 < n)
+        {
+            return 0;
+        }
+        if (is_text)
+        {
+            const uint64_t *offset = (const uint64_t *)
+                ((const char *) header + column->data);
+            uint64_t end = offset[header->n_row];
+
+            if (offset[0] < base || end > size || offset[0] > end
+                || (header->n_row > 0
+                    && ((const char *) header)[end - 1] != '\0'))
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * csv_image_open_() --Map an image file, and make its fields.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ *
+ * Remarks:
+ * The fields are allocated as csv_open() does for "r" mode (so that
+ * csv_close() frees them), but their formats point into the mapping.
+ */
+int csv_image_open_(CSVFilePtr csv_fp, const char *path)
+{
+    const CSVImageHeader *header;
+    struct stat st;
+    size_t name_size = 0;
+    char *name;
+    void *map;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        return 0;                      /* error: open failed */
+    }
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*header)
+        || (map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED,
+                       fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        errno = EINVAL;
+        return 0;                      /* error: stat/mmap failed */
+    }
+    close(fd);                         /* (the mapping stays valid) */
+    csv_fp->buf = map;
+    csv_fp->buf_len = (size_t) st.st_size;
+    csv_fp->buf_pos = 0;               /* (the next row) */
+    header = map;
+    if (!check_image(header, csv_fp->buf_len))
+    {
+        errno = EINVAL;
+        return 0;                      /* error: bad/foreign image */
+    }
+
+    for (size_t c = 0; c < header->n_column; ++c)
+    {
+        name_size += strlen(csv_fp->buf + header->column[c].name) + 1;
+    }
+    if ((csv_fp->field = calloc(header->n_column, sizeof(CSVField))) == NULL
+        || (name = malloc(name_size)) == NULL)
+    {
+        free(csv_fp->field);
+        csv_fp->field = NULL;
+        return 0;                      /* error: malloc failed */
+    }
+    csv_fp->n_field = header->n_column;
+    for (size_t c = 0; c < header->n_column; ++c)
+    {
+        const CSVImageColumn *column = &header->column[c];
+        CSVFieldPtr field = &csv_fp->field[c];
+
+        strcpy(name, csv_fp->buf + column->name);
+        field->item.name = name;
+        field->item.type = (Type) column->type;
+        field->scan_fmt = csv_fp->buf + column->scan_fmt;
+        field->print_fmt = csv_fp->buf + column->print_fmt;
+        name += strlen(name) + 1;
+    }
+    return 1;
+}
+
+/*
+ * image_value() --Get a value from an image column.
+ */
+static Value image_value(CSVFilePtr csv_fp, const CSVImageColumn *column,
+                         size_t row)
+{
+    const char *data = csv_fp->buf + column->data;
+    Value value;
+
+    if (column->type == INTEGER_TYPE)
+    {
+        value.integer = (SYMBOL_INT) ((const int64_t *) data)[row];
+    }
+    else if (column->type == REAL_TYPE)
+    {
+        value.real = ((const double *) data)[row];
+    }
+    else
+    {
+        value.string = (char *) csv_fp->buf
+            + ((const uint64_t *) data)[row];
+    }
+    return value;
+}
+
+/*
+ * csv_image_read_() --Read a record from an image, as Atoms.
+ *
+ * Returns: (size_t)
+ * Success: the No. of fields in the record; Failure: 0 (EOF).
+ *
+ * Remarks:
+ * String values point into the mapping, so they're read-only.
+ */
+size_t csv_image_read_(CSVFilePtr csv_fp, size_t n_value, Atom value[])
+{
+    const CSVImageHeader *header = image_header(csv_fp);
+    size_t row = csv_fp->buf_pos;
+
+    if (row >= header->n_row)
+    {
+        return 0;                      /* EOF */
+    }
+    n_value = MIN(n_value, header->n_column);
+    for (size_t c = 0; c < n_value; ++c)
+    {
+        value[c].type = (Type) header->column[c].type;
+        value[c].value = image_value(csv_fp, &header->column[c], row);
+    }
+    csv_fp->buf_pos = row + 1;
+    return header->n_column;
+}
+
+/*
+ * csv_image_read_block_() --Read a block of records from an image.
+ *
+ * Returns: (size_t)
+ * The No. of records read (also block->n_row); 0 at EOF.
+ *
+ * Remarks:
+ * String views point into the mapping (and are never "quoted").
+ */
+size_t csv_image_read_block_(CSVFilePtr csv_fp, CSVBlockPtr block)
+{
+    const CSVImageHeader *header = image_header(csv_fp);
+    size_t row = csv_fp->buf_pos;
+    size_t n_row = MIN(block->max_row, header->n_row - MIN(row,
+                                                           header->n_row));
+    size_t n_column = MIN(block->n_column, header->n_column);
+
+    for (size_t c = 0; c < n_column; ++c)
+    {
+        const CSVImageColumn *column = &header->column[c];
+        const char *data = csv_fp->buf + column->data;
+        CSVColumnPtr col = &block->column[c];
+
+        if (col->type != (Type) column->type)
+        {
+            continue;                  /* (block isn't for this image) */
+        }
+        if (col->type == INTEGER_TYPE)
+        {
+            const int64_t *integer = (const int64_t *) data + row;
+
+            for (size_t i = 0; i < n_row; ++i)
+            {
+                col->data.integer[i] = (SYMBOL_INT) integer[i];
+            }
+        }
+        else if (col->type == REAL_TYPE)
+        {
+            memcpy(col->data.real, (const double *) data + row,
+                   n_row * sizeof(double));
+        }
+        else
+        {
+            const uint64_t *offset = (const uint64_t *) data + row;
+
+            for (size_t i = 0; i < n_row; ++i)
+            {
+                col->data.view[i].str = csv_fp->buf + offset[i];
+                col->data.view[i].len = offset[i + 1] - offset[i] - 1;
+                col->data.view[i].quoted = 0;
+            }
+        }
+    }
+    csv_fp->buf_pos = row + n_row;
+    block->n_row = n_row;
+    return n_row;
+}
+
+/*
+ * csv_image_range() --Get the range of a numeric column of an image.
+ *
+ * Parameters:
+ * csv_fp --the image (opened with mode "b")
+ * column --the column (i.e. field) number
+ * min    --returns the column's minimum value
+ * max    --returns the column's maximum value
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (not a numeric column, or no values).
+ *
+ * Remarks:
+ * NaNs are ignored, so a REAL column with only NaNs has no range.
+ */
+int csv_image_range(CSVFilePtr csv_fp, size_t column, ValuePtr min,
+                    ValuePtr max)
+{
+    const CSVImageColumn *col;
+
+    if (csv_fp->mode != 'b' || column >= csv_fp->n_field)
+    {
+        return 0;
+    }
+    col = &image_header(csv_fp)->column[column];
+    if (!col->has_range)
+    {
+        return 0;
+    }
+    if (col->type == INTEGER_TYPE)
+    {
+        min->integer = (SYMBOL_INT) col->min.integer;
+        max->integer = (SYMBOL_INT) col->max.integer;
+    }
+    else
+    {
+        min->real = col->min.real;
+        max->real = col->max.real;
+    }
+    return 1;
+}
@@ -0,0 +1,256 @@
+/*
+ * CSV-LOAD.C --Load a whole (mapped) CSV file with several threads.
+ *
+ * Contents:
+ * csv_load()      --Parse a mapped CSV file's records in parallel.
+ * csv_load_free() --Release a loaded file's blocks.
+ *
+ * Remarks:
+ * The file's records are split into one chunk per thread, and each
+ * chunk is parsed by csv_read_block() into its own CSVBlock, so the
+ * blocks (in order) hold the whole file.  The chunks are processed
+ * with parallel_for() on the default task pool, rather than by
+ * threads of our own.
+ *
+ * A chunk must start at a record boundary, which is a newline outside
+ * quotes.  Whether a byte is inside quotes depends on the number of
+ * quotes before it (a '""' escape counts twice, so it doesn't matter),
+ * so the loader first counts the quotes in equal byte ranges (in
+ * parallel), and then scans forward from each range's start, knowing
+ * its quoting state, to the next unquoted newline (which may be past
+ * the end of the range, leaving that chunk empty).  This assumes that
+ * quotes only appear around quoted fields (and doubled inside them),
+ * as RFC4180 requires; a stray quote within an unquoted field will
+ * misplace the chunk boundaries after it.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <apex/csv.h>
+#include <apex/task-pool.h>
+
+#define CSV_LOAD_MAX_THREAD 64
+#define CSV_LOAD_MIN_CHUNK 65536       /* smallest chunk worth a thread */
+
+typedef struct CSVLoadChunk_t
+{
+    CSVFile csv;                       /* a copy, limited to the chunk */
+    size_t lo, hi;                     /* the chunk's byte range */
+    size_t n_quote;                    /* No. of '"' in the range */
+    CSVBlockPtr block;
+    int status;                        /* 1: parsed OK */
+} CSVLoadChunk, *CSVLoadChunkPtr;
+
+typedef void (*CSVChunkProc)(CSVLoadChunkPtr chunk);
+
+typedef struct CSVLoadRun_t
+{
+    CSVChunkProc proc;
+    CSVLoadChunkPtr chunk;
+} CSVLoadRun;
+
+/*
+ * count_quotes() --Count the quotes in a chunk: a CSVChunkProc.
+ */
+static void count_quotes(CSVLoadChunkPtr chunk)
+{
+    const char *s = chunk->csv.buf + chunk->lo;
+    const char *end = chunk->csv.buf + chunk->hi;
+
+    chunk->n_quote = 0;
+    while ((s = memchr(s, '"', (size_t) (end - s))) != NULL)
+    {
+        ++chunk->n_quote;
+        ++s;
+    }
+}
+
+/*
+ * parse_chunk() --Parse a chunk's records into its block: a CSVChunkProc.
+ *
+ * Remarks:
+ * Every record (but the last) ends with a newline, so the No. of
+ * newlines (plus one) is enough rows for the chunk.
+ */
+static void parse_chunk(CSVLoadChunkPtr chunk)
+{
+    const char *s = chunk->csv.buf + chunk->lo;
+    const char *end = chunk->csv.buf + chunk->hi;
+    size_t n_row = 1;
+
+    while ((s = memchr(s, '\n', (size_t) (end - s))) != NULL)
+    {
+        ++n_row;
+        ++s;
+    }
+    chunk->csv.buf_pos = chunk->lo;
+    chunk->csv.buf_len = chunk->hi;
+    chunk->status = csv_block_init(chunk->block, &chunk->csv, n_row) != NULL;
+    if (chunk->status)
+    {
+        csv_read_block(&chunk->csv, chunk->block);
+    }
+}
+
+/*
+ * run_range() --Run a proc for a range of chunks: a TaskRangeProc.
+ */
+static void run_range(void *data, size_t lo, size_t hi)
+{
+    CSVLoadRun *run = data;
+
+    for (size_t i = lo; i < hi; ++i)
+    {
+        run->proc(&run->chunk[i]);
+    }
+}
+
+/*
+ * run_all() --Run a proc for each of n chunks, on the default task pool.
+ *
+ * Remarks:
+ * Each chunk is a task (the chunks are already sized to be worth
+ * one); the calling thread does its share, and if there's no pool,
+ * it does them all.
+ */
+static void run_all(CSVChunkProc proc, CSVLoadChunk *chunk, int n)
+{
+    CSVLoadRun run = { proc, chunk };
+
+    parallel_for(NULL, 0, (size_t) n, 1, run_range, &run);
+}
+
+/*
+ * next_record() --Find the first record boundary at or after an offset.
+ *
+ * Parameters:
+ * str    --the file's text
+ * pos    --the offset to start from
+ * end    --the end of the text
+ * quoted --the quoting state at pos
+ *
+ * Returns: (size_t)
+ * The offset after the first unquoted newline, or end.
+ */
+static size_t next_record(const char *str, size_t pos, size_t end,
+                          int quoted)
+{
+    for (; pos < end; ++pos)
+    {
+        if (str[pos] == '"')
+        {
+            quoted = !quoted;
+        }
+        else if (str[pos] == '\n' && !quoted)
+        {
+            return pos + 1;
+        }
+    }
+    return end;
+}
+
+/*
+ * csv_load() --Parse a mapped CSV file's records in parallel.
+ *
+ * Parameters:
+ * load     --returns the file's blocks (owned by caller)
+ * csv_fp   --the CSV file (opened with mode "m")
+ * n_thread --the No. of chunks to parse in parallel (<= 0: one per CPU)
+ *
+ * Returns: (CSVLoadPtr)
+ * Success: load; Failure: NULL.
+ *
+ * Remarks:
+ * This reads all of csv_fp's remaining records (so csv_read() etc.
+ * will then return EOF), into load->n_block CSVBlocks, in file order;
+ * the blocks' column types are taken from csv_fp's fields, as for
+ * csv_block_init().  Files too small to be worth splitting are parsed
+ * as a single block.
+ */
+CSVLoadPtr csv_load(CSVLoadPtr load, CSVFilePtr csv_fp, int n_thread)
+{
+    CSVLoadChunk chunk[CSV_LOAD_MAX_THREAD];
+    size_t lo, size;
+    int quoted = 0, n_ok = 0;
+
+    if (load == NULL || csv_fp == NULL || csv_fp->mode != 'm')
+    {
+        return NULL;                   /* error: not a mapped file */
+    }
+    lo = MIN(csv_fp->buf_pos, csv_fp->buf_len);
+    size = csv_fp->buf_len - lo;
+    if (n_thread <= 0)
+    {
+        n_thread = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    n_thread = MIN(n_thread, CSV_LOAD_MAX_THREAD);
+    n_thread = (int) MIN((size_t) n_thread, size / CSV_LOAD_MIN_CHUNK);
+    n_thread = MAX(n_thread, 1);
+
+    memset(load, 0, sizeof(*load));
+    if ((load->block = calloc((size_t) n_thread, sizeof(CSVBlock))) == NULL)
+    {
+        return NULL;                   /* error: calloc failed */
+    }
+    load->n_block = (size_t) n_thread;
+    for (int i = 0; i < n_thread; ++i)
+    {
+        chunk[i].csv = *csv_fp;
+        chunk[i].lo = lo + size * (size_t) i / (size_t) n_thread;
+        chunk[i].hi = lo + size * (size_t) (i + 1) / (size_t) n_thread;
+        chunk[i].block = &load->block[i];
+        chunk[i].status = 0;
+    }
+    if (n_thread > 1)
+    {
+        run_all(count_quotes, chunk, n_thread);
+    }
+    for (int i = 1; i < n_thread; ++i)
+    {                                  /* move starts to record boundaries */
+        size_t start;
+
+        quoted ^= (int) (chunk[i - 1].n_quote & 1);
+        start = next_record(csv_fp->buf, chunk[i].lo, csv_fp->buf_len,
+                            quoted);
+        chunk[i].lo = MAX(start, chunk[i - 1].lo);
+        chunk[i - 1].hi = chunk[i].lo;
+        chunk[i].hi = MAX(chunk[i].hi, chunk[i].lo);
+    }
+    run_all(parse_chunk, chunk, n_thread);
+
+    for (int i = 0; i < n_thread; ++i)
+    {
+        n_ok += chunk[i].status;
+        load->n_row += load->block[i].n_row;
+    }
+    csv_fp->buf_pos = csv_fp->buf_len;
+    if (n_ok != n_thread)
+    {
+        csv_load_free(load);
+        return NULL;                   /* error: no memory */
+    }
+    return load;
+}
+
+/*
+ * csv_load_free() --Release a loaded file's blocks.
+ *
+ * Remarks:
+ * String views still point into the CSV file's mapping, so the file
+ * must stay open while they're in use.
+ */
+void csv_load_free(CSVLoadPtr load)
+{
+    if (load != NULL)
+    {
+        for (size_t i = 0; i < load->n_block; ++i)
+        {
+            csv_block_free(&load->block[i]);
+        }
+        free(load->block);
+        memset(load, 0, sizeof(*load));
+    }
+}
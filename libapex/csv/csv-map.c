@@ -0,0 +1,261 @@
+/*
+ * CSV-MAP.C --Zero-copy reading of memory-mapped CSV files.
+ *
+ * Contents:
+ * csv_map_open_()  --Map a CSV file, and parse its header.
+ * csv_map_close_() --Unmap a CSV file.
+ * csv_read_view()  --Split the next record into views of the mapping.
+ * csv_view_copy()  --Copy a view's (unquoted) text into a buffer.
+ *
+ * Remarks:
+ * A CSV file opened with mode "m" is mapped read-only, rather than
+ * read via stdio.  csv_read_view() returns the fields as (pointer,
+ * length) views into the mapping, so no text is copied, and there is
+ * no limit on the length of a record.  csv_read() also works on mapped
+ * files (its "block" is the whole mapping).
+ *
+ * A view can't unquote its field in place, so views are "quoted" when
+ * their text needs unquoting: a quoted field with a doubled quote (or
+ * junk after the closing quote), or an unquoted field containing a lone
+ * CR.  Otherwise (the usual case) the view is just the field's text,
+ * without the surrounding quotes.  csv_view_copy() unquotes either
+ * kind, exactly as csv_read() would.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <apex/csv.h>
+
+/*
+ * csv_map_open_() --Map a CSV file, and parse its header.
+ *
+ * Parameters:
+ * csv_fp   --the CSV file (with mode 'm')
+ * path     --the path of the file to map
+ * header   --returns the header text
+ * n_header --the size of the header buffer
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (e.g. an empty file).
+ *
+ * Remarks:
+ * The mapping becomes csv_fp's read buffer, positioned after the
+ * header line.
+ */
+int csv_map_open_(CSVFilePtr csv_fp, const char *path, char *header,
+                  size_t n_header)
+{
+    struct stat st;
+    const char *eol;
+    size_t len;
+    void *map;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        return 0;                      /* error: open failed */
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0
+        || (map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+                       fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return 0;                      /* error: stat/mmap failed */
+    }
+    close(fd);                         /* (the mapping stays valid) */
+#ifdef MADV_SEQUENTIAL
+    madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+    csv_fp->buf = map;
+    csv_fp->buf_len = (size_t) st.st_size;
+
+    eol = memchr(csv_fp->buf, '\n', csv_fp->buf_len);
+    len = eol != NULL ? (size_t) (eol - csv_fp->buf) + 1 : csv_fp->buf_len;
+    csv_fp->buf_pos = len;
+    len = MIN(len, n_header - 1);
+    memcpy(header, csv_fp->buf, len);
+    header[len] = '\0';
+    return 1;
+}
+
+/*
+ * csv_map_close_() --Unmap a CSV file.
+ */
+void csv_map_close_(CSVFilePtr csv_fp)
+{
+    if (csv_fp->buf != NULL)
+    {
+        munmap(csv_fp->buf, csv_fp->buf_len);
+        csv_fp->buf = NULL;
+    }
+}
+
+/*
+ * scan_quoted() --Find the end of a quoted field's text.
+ *
+ * Returns: (const char *)
+ * The closing quote, or end (if there isn't one); escaped is set if
+ * the text contains any doubled quotes.
+ */
+static const char *scan_quoted(const char *str, const char *end,
+                               int *escaped)
+{
+    const char *q;
+
+    while ((q = memchr(str, '"', (size_t) (end - str))) != NULL)
+    {
+        if (q + 1 == end || q[1] != '"')
+        {
+            return q;                  /* the closing quote */
+        }
+        *escaped = 1;                  /* '""': a literal quote */
+        str = q + 2;
+    }
+    return end;
+}
+
+/*
+ * csv_read_view() --Split the next record into views of the mapping.
+ *
+ * Parameters:
+ * csv_fp --the CSV file (opened with mode "m")
+ * n_view --the size of the view array
+ * view   --returns the fields' views
+ *
+ * Returns: (size_t)
+ * Success: the No. of fields in the record (which may be more than
+ * n_view); Failure: 0 (EOF, or not a mapped file).
+ *
+ * Remarks:
+ * Only the first n_view fields are stored.  The views remain valid
+ * until csv_close().
+ */
+size_t csv_read_view(CSVFilePtr csv_fp, size_t n_view, CSVView view[])
+{
+    const char *str, *end;
+    size_t n_field = 0;
+
+    if (csv_fp->mode != 'm' || csv_fp->buf_pos >= csv_fp->buf_len)
+    {
+        return 0;                      /* EOF (or wrong mode) */
+    }
+    str = csv_fp->buf + csv_fp->buf_pos;
+    end = csv_fp->buf + csv_fp->buf_len;
+    for (;;)
+    {
+        CSVView field = {.str = str,.len = 0,.quoted = 0 };
+        const char *p = str;
+        int escaped = 0, eor;
+
+        if (p < end && *p == '"')
+        {                              /* quoted: try to view just the text */
+            const char *q = scan_quoted(p + 1, end, &escaped);
+
+            p = q < end ? q + 1 : end;
+            if (!escaped && q < end
+                && (p == end || *p == ',' || *p == '\n'
+                    || (*p == '\r' && p + 1 < end && p[1] == '\n')))
+            {
+                field.str = str + 1;
+                field.len = (size_t) (q - field.str);
+                goto delimiter;
+            }
+            field.quoted = 1;          /* (junk after quote: see below) */
+        }
+        for (;;)
+        {                              /* unquoted (or after the quotes) */
+            p += csv_span_(p, (size_t) (end - p));
+            if (p == end || *p == ',' || *p == '\n'
+                || (*p == '\r' && p + 1 < end && p[1] == '\n'))
+            {
+                break;
+            }
+            field.quoted |= *p == '\r';        /* (a lone CR is dropped) */
+            ++p;                       /* '"' or CR: keep going */
+        }
+        field.len = (size_t) (p - str);
+        field.quoted |= escaped;
+      delimiter:
+        if (n_field < n_view)
+        {
+            view[n_field] = field;
+        }
+        ++n_field;
+        eor = p == end || *p != ',';
+        str = p == end ? end : p + (*p == '\r' ? 2 : 1);
+        if (eor)
+        {
+            break;
+        }
+    }
+    csv_fp->buf_pos = (size_t) (str - csv_fp->buf);
+    return n_field;
+}
+
+/*
+ * csv_view_copy() --Copy a view's (unquoted) text into a buffer.
+ *
+ * Parameters:
+ * view --the field's view
+ * n    --the size of the buffer
+ * str  --returns the field's text (NUL-terminated)
+ *
+ * Returns: (size_t)
+ * The length of the field's text (which may be more than n - 1, if it
+ * was truncated).
+ */
+size_t csv_view_copy(const CSVView *view, size_t n, char *str)
+{
+    const char *s = view->str, *end = view->str + view->len;
+    size_t len = 0;
+    int in_quotes = 0;
+
+    if (!view->quoted)
+    {
+        len = view->len;
+        if (n > 0)
+        {
+            size_t n_copy = MIN(len, n - 1);
+
+            memcpy(str, view->str, n_copy);
+            str[n_copy] = '\0';
+        }
+        return len;
+    }
+    if (s < end && *s == '"')
+    {
+        in_quotes = 1;
+        ++s;
+    }
+    for (; s < end; ++s)
+    {
+        if (in_quotes && *s == '"')
+        {
+            if (s + 1 == end || s[1] != '"')
+            {
+                in_quotes = 0;         /* closing quote */
+                continue;
+            }
+            ++s;                       /* '""': a literal quote */
+        }
+        else if (!in_quotes && *s == '\r')
+        {
+            continue;                  /* (as csv_read() does) */
+        }
+        if (len + 1 < n)
+        {
+            str[len] = *s;
+        }
+        ++len;
+    }
+    if (n > 0)
+    {
+        str[MIN(len, n - 1)] = '\0';
+    }
+    return len;
+}
@@ -0,0 +1,431 @@
+/*
+ * CSV-PARSE.C --An RFC4180 record parser, and fast field conversions.
+ *
+ * Contents:
+ * fill_buffer()       --Refill a CSV file's read buffer.
+ * csv_parse_record_() --Read and split a record, handling quotes.
+ * csv_scan_value_()   --Convert a field's text, as sscanf(fmt) would.
+ *
+ * Remarks:
+ * The record parser is a small state machine that reads the file in
+ * blocks (see CSVFile's buf), and unquotes the fields in place into
+ * the caller's buffer:
+ *  * a field that starts with '"' is quoted, and ends at the next
+ *    lone '"'; it may contain ',', newlines, and '""' (a '"')
+ *  * records end at LF or CRLF (or EOF) outside quotes.
+ * It's lenient about malformed input: text after a closing quote is
+ * kept, and a record that ends inside quotes (at EOF) is accepted.
+ *
+ * csv_scan_value_() recognises the common scanf conversions ("%d",
+ * "%ld", "%f", "%lf", and their "%e"/"%g" synonyms), and converts
+ * them without the overhead of sscanf().  Decimal numbers whose
+ * digits fit in 2^53, with small exponents, are converted exactly
+ * (the "Clinger fast path"); other numbers are passed to strtol() or
+ * strtod(), and any other format to sscanf() itself, so the results
+ * are identical to sscanf()'s.
+ *
+ * See Also:
+ * https://tools.ietf.org/html/rfc4180
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/csv.h>
+#include <apex/log.h>
+
+#define CSV_EXACT_MAX (1ull << 53)     /* mantissas exactly representable */
+
+typedef enum ParseState_t
+{
+    FIELD_START,                       /* at the start of a field */
+    UNQUOTED,                          /* in an unquoted field */
+    QUOTED,                            /* inside quotes */
+    QUOTED_QUOTE                       /* a '"' inside quotes: end, or '""'? */
+} ParseState;
+
+/*
+ * fill_buffer() --Refill a CSV file's read buffer.
+ *
+ * Returns: (size_t)
+ * The No. of bytes now available (0 at EOF or on error).
+ *
+ * Remarks:
+ * A mapped file's buffer is the whole mapping, so it's never refilled.
+ */
+static size_t fill_buffer(CSVFilePtr csv_fp)
+{
+    if (csv_fp->mode == 'm')
+    {
+        return 0;                      /* (the mapping is the only block) */
+    }
+    if (csv_fp->buf == NULL
+        && (csv_fp->buf = malloc(CSV_BUFFER_SIZE)) == NULL)
+    {
+        return 0;                      /* error: malloc failed */
+    }
+    csv_fp->buf_pos = 0;
+    csv_fp->buf_len = fread(csv_fp->buf, 1, CSV_BUFFER_SIZE, csv_fp->fp);
+    return csv_fp->buf_len;
+}
+
+/*
+ * csv_parse_record_() --Read and split a record, handling quotes.
+ *
+ * Parameters:
+ * csv_fp  --the CSV file to read
+ * n_value --the size of the value array
+ * value    --returns the fields (as strings in bytes[])
+ * n_byte --the size of the bytes buffer
+ * bytes   --the buffer for the (unquoted) field text
+ *
+ * Returns: (size_t)
+ * Success: the No. of fields in the record (which may be more than
+ * n_value); Failure: 0 (EOF).
+ *
+ * Remarks:
+ * Only the first n_value fields are stored.  If the record's text
+ * doesn't fit in bytes[], the fields are truncated (and an error is
+ * logged), but the whole record is consumed.
+ *
+ * The text between delimiters is found by csv_span_() and copied in
+ * bulk; only the delimiters themselves go through the state machine.
+ */
+size_t csv_parse_record_(CSVFilePtr csv_fp, size_t n_value, Atom value[],
+                         size_t n_byte, char bytes[])
+{
+    ParseState state = FIELD_START;
+    char *out = bytes, *end = bytes + n_byte - 1;
+    char *field = bytes;
+    size_t n_field = 0;
+    int n_char = 0;                    /* (to distinguish EOF) */
+    int truncated = 0;
+
+    if (n_byte == 0)
+    {
+        return 0;
+    }
+    for (;;)
+    {
+        int c;
+
+        if (csv_fp->buf_pos == csv_fp->buf_len && fill_buffer(csv_fp) == 0)
+        {
+            c = EOF;
+        }
+        else if (state == UNQUOTED || state == QUOTED)
+        {                              /* copy up to the next delimiter */
+            const char *text = csv_fp->buf + csv_fp->buf_pos;
+            size_t n = csv_span_(text, csv_fp->buf_len - csv_fp->buf_pos);
+            size_t n_copy = MIN(n, (size_t) (end - out));
+
+            memcpy(out, text, n_copy);
+            out += n_copy;
+            truncated |= n_copy < n;
+            csv_fp->buf_pos += n;
+            if (csv_fp->buf_pos == csv_fp->buf_len)
+            {
+                continue;              /* (refill, and keep copying) */
+            }
+            c = (unsigned char) csv_fp->buf[csv_fp->buf_pos++];
+        }
+        else
+        {
+            c = (unsigned char) csv_fp->buf[csv_fp->buf_pos++];
+        }
+
+        if (c == EOF && n_char == 0 && out == bytes)
+        {
+            return 0;                  /* EOF: no record */
+        }
+        ++n_char;
+        switch (state)
+        {
+        case FIELD_START:
+            if (c == '"')
+            {
+                state = QUOTED;
+                continue;
+            }
+            state = UNQUOTED;
+            break;
+        case QUOTED:
+            if (c == '"')
+            {
+                state = QUOTED_QUOTE;
+                continue;
+            }
+            if (c != EOF)
+            {
+                goto append;           /* (anything else is text) */
+            }
+            break;
+        case QUOTED_QUOTE:
+            if (c == '"')
+            {                          /* '""': a literal quote */
+                state = QUOTED;
+                goto append;
+            }
+            state = UNQUOTED;          /* closing quote */
+            break;
+        case UNQUOTED:
+            break;
+        }
+        /* UNQUOTED (or just after a field's quotes) */
+        if (c == '\r')
+        {
+            continue;                  /* (CRLF) */
+        }
+        if (c == ',' || c == '\n' || c == EOF)
+        {
+            if (n_field < n_value)
+            {
+                value[n_field].type = STRING_TYPE;
+                value[n_field].value.string = field;
+            }
+            ++n_field;
+            if (out < end)
+            {
+                *out++ = '\0';
+            }
+            else
+            {
+                *end = '\0';
+            }
+            field = out;
+            if (c != ',')
+            {
+                break;                 /* end of record */
+            }
+            state = FIELD_START;
+            continue;
+        }
+      append:
+        if (out < end)
+        {
+            *out++ = (char) c;
+        }
+        else
+        {
+            truncated = 1;
+        }
+    }
+    if (truncated)
+    {
+        err("CSV record truncated to %zu bytes", n_byte - 1);
+    }
+    return n_field;
+}
+
+/*
+ * pow10_exact[] --The powers of 10 that are exact doubles.
+ */
+static const double pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * scan_long() --Convert a decimal integer (like "%ld").
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no digits).
+ */
+static int scan_long(const char *str, long *value)
+{
+    const char *s = str;
+    unsigned long n = 0;
+    int negative = 0;
+
+    while (*s == ' ' || *s == '\t')
+    {
+        ++s;
+    }
+    if (*s == '-' || *s == '+')
+    {
+        negative = *s++ == '-';
+    }
+    if (*s < '0' || *s > '9')
+    {
+        return 0;                      /* failure: not a number */
+    }
+    for (; *s >= '0' && *s <= '9'; ++s)
+    {
+        if (n > (ULONG_MAX - 9) / 10)
+        {                              /* (may overflow: ask strtol()) */
+            *value = strtol(str, NULL, 10);
+            return 1;
+        }
+        n = n * 10 + (unsigned long) (*s - '0');
+    }
+    if (n > (unsigned long) LONG_MAX + negative)
+    {
+        *value = strtol(str, NULL, 10);
+        return 1;
+    }
+    *value = negative ? (long) (0 - n) : (long) n;
+    return 1;
+}
+
+/*
+ * scan_double() --Convert a floating-point number (like "%lf").
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (not a number).
+ */
+static int scan_double(const char *str, double *value)
+{
+    const char *s = str;
+    uint64_t mantissa = 0;
+    int n_digit = 0, exponent = 0, negative = 0;
+    char *end;
+
+    while (*s == ' ' || *s == '\t')
+    {
+        ++s;
+    }
+    if (*s == '-' || *s == '+')
+    {
+        negative = *s++ == '-';
+    }
+    for (; *s >= '0' && *s <= '9'; ++s, ++n_digit)
+    {
+        if (mantissa >= CSV_EXACT_MAX / 10)
+        {
+            goto slow;
+        }
+        mantissa = mantissa * 10 + (uint64_t) (*s - '0');
+    }
+    if (*s == '.')
+    {
+        for (++s; *s >= '0' && *s <= '9'; ++s, ++n_digit)
+        {
+            if (mantissa >= CSV_EXACT_MAX / 10)
+            {
+                goto slow;
+            }
+            mantissa = mantissa * 10 + (uint64_t) (*s - '0');
+            --exponent;
+        }
+    }
+    if (n_digit == 0)
+    {
+        goto slow;                     /* (e.g. "inf", "nan", or nothing) */
+    }
+    if (*s == 'e' || *s == 'E')
+    {
+        int e = 0, e_negative = 0;
+
+        ++s;
+        if (*s == '-' || *s == '+')
+        {
+            e_negative = *s++ == '-';
+        }
+        if (*s < '0' || *s > '9')
+        {
+            goto slow;
+        }
+        for (; *s >= '0' && *s <= '9' && e < 1000; ++s)
+        {
+            e = e * 10 + (*s - '0');
+        }
+        exponent += e_negative ? -e : e;
+    }
+    if (*s == 'x' || *s == 'X' || exponent > 22 || exponent < -22)
+    {
+        goto slow;
+    }
+    *value = exponent >= 0
+        ? (double) mantissa * pow10_exact[exponent]
+        : (double) mantissa / pow10_exact[-exponent];
+    if (negative)
+    {
+        *value = -*value;
+    }
+    return 1;
+  slow:
+    *value = strtod(str, &end);
+    return end != str;
+}
+
+/*
+ * csv_scan_value_() --Convert a field's text, as sscanf(fmt) would.
+ *
+ * Parameters:
+ * fmt  --the field's scanf format
+ * str  --the field's text
+ * value --returns the converted value
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (as for sscanf(), value is unchanged).
+ *
+ * Remarks:
+ * The value is stored as sscanf() would store it: e.g. "%f" and "%d"
+ * store a float and an int in the first bytes of the Value.
+ */
+int csv_scan_value_(const char *fmt, const char *str, ValuePtr value)
+{
+    int is_long = 0;
+    const char *f = fmt;
+
+    if (*f++ != '%')
+    {
+        return sscanf(str, fmt, value) == 1;
+    }
+    if (*f == 'l')
+    {
+        is_long = 1;
+        ++f;
+    }
+    if (f[0] == '\0' || f[1] != '\0')
+    {
+        return sscanf(str, fmt, value) == 1;   /* (not a simple format) */
+    }
+    switch (*f)
+    {
+    case 'd':
+    {
+        long i;
+
+        if (!scan_long(str, &i))
+        {
+            return 0;
+        }
+        if (is_long)
+        {
+            *(long *) value = i;
+        }
+        else
+        {
+            *(int *) value = (int) i;
+        }
+        return 1;
+    }
+    case 'e':
+    case 'f':
+    case 'g':
+    {
+        double r;
+
+        if (!scan_double(str, &r))
+        {
+            return 0;
+        }
+        if (is_long)
+        {
+            *(double *) value = r;
+        }
+        else
+        {
+            *(float *) value = (float) r;
+        }
+        return 1;
+    }
+    default:
+        return sscanf(str, fmt, value) == 1;
+    }
+}
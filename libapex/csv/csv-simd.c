@@ -0,0 +1,194 @@
+/*
+ * CSV-SIMD.C --Vectorised scanning for CSV delimiters.
+ *
+ * Contents:
+ * csv_span_()        --Return the length of a prefix with no CSV delimiters.
+ * csv_span_scalar_() --csv_span_(), without SIMD (for testing).
+ *
+ * Remarks:
+ * The record parser copies the text between delimiters (',', '"',
+ * CR and LF) in bulk, so most of its time is spent finding the next
+ * delimiter.  The SIMD versions compare 16 (SSE2, NEON) or 32 (AVX2)
+ * bytes at a time against each delimiter, and combine the results
+ * into a bitmask whose lowest set bit is the first delimiter.
+ *
+ * On x86, the AVX2 or SSE2 version is selected on the first call,
+ * with cpu_has(); on ARM, NEON is used if the compiler enables it;
+ * otherwise it's a scalar loop.  (See also simd-search.c, which does
+ * the same for integer searches.)
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <apex/cpu.h>
+#include <apex/csv.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CSV_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define CSV_NEON
+#include <arm_neon.h>
+#endif
+
+typedef size_t (*SpanProc)(const char *str, size_t n);
+
+/*
+ * IS_DELIMITER() --Test if a character is a CSV delimiter.
+ */
+#define IS_DELIMITER(c_) \
+    ((c_) == ',' || (c_) == '"' || (c_) == '\n' || (c_) == '\r')
+
+/*
+ * span_scalar() --Find the first delimiter, a byte at a time.
+ */
+static size_t span_scalar(const char *str, size_t n)
+{
+    size_t i = 0;
+
+    while (i < n && !IS_DELIMITER(str[i]))
+    {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef CSV_X86
+/*
+ * span_sse2() --Find the first delimiter, 16 bytes at a time.
+ */
+__attribute__((target("sse2")))
+static size_t span_sse2(const char *str, size_t n)
+{
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+        __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, comma),
+                                               _mm_cmpeq_epi8(v, quote)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, lf),
+                                               _mm_cmpeq_epi8(v, cr)));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(eq);
+
+        if (mask != 0)
+        {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+    return i + span_scalar(str + i, n - i);
+}
+
+/*
+ * span_avx2() --Find the first delimiter, 32 bytes at a time.
+ */
+__attribute__((target("avx2")))
+static size_t span_avx2(const char *str, size_t n)
+{
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (str + i));
+        __m256i eq =
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, comma),
+                                            _mm256_cmpeq_epi8(v, quote)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, lf),
+                                            _mm256_cmpeq_epi8(v, cr)));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(eq);
+
+        if (mask != 0)
+        {
+            return i + (size_t) __builtin_ctz(mask);
+        }
+    }
+    return i + span_sse2(str + i, n - i);
+}
+#endif /* CSV_X86 */
+
+#ifdef CSV_NEON
+/*
+ * span_neon() --Find the first delimiter, 16 bytes at a time.
+ *
+ * Remarks:
+ * NEON has no movemask, but shifting each 16-bit lane right by 4 and
+ * narrowing packs the compare result into 4 bits per byte.
+ */
+static size_t span_neon(const char *str, size_t n)
+{
+    const uint8x16_t comma = vdupq_n_u8(',');
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v = vld1q_u8((const uint8_t *) str + i);
+        uint8x16_t eq = vorrq_u8(vorrq_u8(vceqq_u8(v, comma),
+                                          vceqq_u8(v, quote)),
+                                 vorrq_u8(vceqq_u8(v, lf),
+                                          vceqq_u8(v, cr)));
+        uint64_t mask =
+            vget_lane_u64(vreinterpret_u64_u8
+                          (vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+        if (mask != 0)
+        {
+            return i + (size_t) (__builtin_ctzll(mask) >> 2);
+        }
+    }
+    return i + span_scalar(str + i, n - i);
+}
+#endif /* CSV_NEON */
+
+static size_t resolve_span(const char *str, size_t n);
+
+static SpanProc span_proc = resolve_span;
+
+/*
+ * resolve_span() --Select the best csv_span_() for this CPU, and call it.
+ */
+static size_t resolve_span(const char *str, size_t n)
+{
+    SpanProc proc = span_scalar;
+
+#if defined(CSV_X86)
+    proc = cpu_has(CPU_AVX2) ? span_avx2
+        : cpu_has(CPU_SSE2) ? span_sse2 : proc;
+#elif defined(CSV_NEON)
+    proc = span_neon;
+#endif
+    CPU_RESOLVE(&span_proc, proc);
+    return proc(str, n);
+}
+
+/*
+ * csv_span_() --Return the length of a prefix with no CSV delimiters.
+ *
+ * Parameters:
+ * str  --the text to scan
+ * n    --the length of the text
+ *
+ * Returns: (size_t)
+ * The offset of the first ',', '"', CR or LF in str, or n if none.
+ */
+size_t csv_span_(const char *str, size_t n)
+{
+    return __atomic_load_n(&span_proc, __ATOMIC_RELAXED) (str, n);
+}
+
+/*
+ * csv_span_scalar_() --csv_span_(), without SIMD (for testing).
+ */
+size_t csv_span_scalar_(const char *str, size_t n)
+{
+    return span_scalar(str, n);
+}
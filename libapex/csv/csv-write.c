@@ -0,0 +1,298 @@
+/*
+ * CSV-WRITE.C --Buffered CSV output, with fast number formatting.
+ *
+ * Contents:
+ * csv_flush()         --Write out a CSV file's buffered records.
+ * csv_put_bytes_()    --Append some text to a CSV file's output.
+ * csv_put_string_()   --Write a string field, quoting it if necessary.
+ * csv_format_value_() --Format a value, as snprintf(fmt) would.
+ * csv_put_value_()    --Write a field's value, with its print_fmt.
+ *
+ * Remarks:
+ * csv_write() appends each record to the CSVFile's buffer (the same
+ * buf that csv_read() uses for input), which is written with write()
+ * when it fills, and by csv_flush() or csv_close().
+ *
+ * csv_format_value_() formats the simplest (and commonest) formats
+ * directly: "%d" and "%ld" (and "%i"), and "%f" with an optional
+ * precision (e.g. "%.6f", "%.2lf").  Doubles are converted from their
+ * exact binary value, rounding ties to even, so the text is identical
+ * to printf()'s.  Anything else (flags, widths, other conversions,
+ * large numbers) is passed to snprintf().
+ *
+ * A field (of any type, once formatted) is quoted if it contains a
+ * ',', '"' or line-break, and the quotes within it are doubled, as per
+ * RFC4180.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <apex/csv.h>
+#include <apex/strbuf.h>
+
+#define CSV_PRECISION_MAX STRBUF_PRECISION_MAX
+
+/*
+ * csv_flush() --Write out a CSV file's buffered records.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (a write error: see errno).
+ */
+int csv_flush(CSVFilePtr csv_fp)
+{
+    const char *s = csv_fp->buf;
+    size_t n = csv_fp->buf_len;
+    int fd;
+
+    if (csv_fp->mode == 'r' || csv_fp->mode == 'm' || csv_fp->mode == 'b'
+        || csv_fp->fp == NULL)
+    {
+        return 0;                      /* error: not an output file */
+    }
+    if (n == 0)
+    {
+        return 1;
+    }
+    fflush(csv_fp->fp);                /* (the header was written by stdio) */
+    fd = fileno(csv_fp->fp);
+    while (n > 0)
+    {
+        ssize_t n_write = write(fd, s, n);
+
+        if (n_write < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 0;                  /* error: write failed */
+        }
+        s += n_write;
+        n -= (size_t) n_write;
+    }
+    csv_fp->buf_len = 0;
+    return 1;
+}
+
+/*
+ * reserve() --Make room for some text in a CSV file's output buffer.
+ *
+ * Returns: (char *)
+ * Success: the end of the buffered text; Failure: NULL.
+ */
+static char *reserve(CSVFilePtr csv_fp, size_t n)
+{
+    if (csv_fp->buf == NULL
+        && (csv_fp->buf = malloc(CSV_BUFFER_SIZE)) == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    if (CSV_BUFFER_SIZE - csv_fp->buf_len < n && !csv_flush(csv_fp))
+    {
+        return NULL;
+    }
+    return csv_fp->buf + csv_fp->buf_len;
+}
+
+/*
+ * csv_put_bytes_() --Append some text to a CSV file's output.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int csv_put_bytes_(CSVFilePtr csv_fp, const char *str, size_t n)
+{
+    while (n > 0)
+    {
+        size_t n_copy;
+
+        if (reserve(csv_fp, 1) == NULL)
+        {
+            return 0;
+        }
+        n_copy = MIN(n, CSV_BUFFER_SIZE - csv_fp->buf_len);
+        memcpy(csv_fp->buf + csv_fp->buf_len, str, n_copy);
+        csv_fp->buf_len += n_copy;
+        str += n_copy;
+        n -= n_copy;
+    }
+    return 1;
+}
+
+/*
+ * csv_put_string_() --Write a string field, quoting it if necessary.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int csv_put_string_(CSVFilePtr csv_fp, const char *str)
+{
+    const char *quote;
+
+    if (strpbrk(str, ",\"\r\n") == NULL)
+    {
+        return csv_put_bytes_(csv_fp, str, strlen(str));
+    }
+    if (!csv_put_bytes_(csv_fp, "\"", 1))
+    {
+        return 0;
+    }
+    while ((quote = strchr(str, '"')) != NULL)
+    {                                  /* (copy it, and the quote, twice) */
+        if (!csv_put_bytes_(csv_fp, str, (size_t) (quote - str) + 1)
+            || !csv_put_bytes_(csv_fp, "\"", 1))
+        {
+            return 0;
+        }
+        str = quote + 1;
+    }
+    return csv_put_bytes_(csv_fp, str, strlen(str))
+        && csv_put_bytes_(csv_fp, "\"", 1);
+}
+
+/*
+ * csv_format_value_() --Format a value, as snprintf(fmt) would.
+ *
+ * Parameters:
+ * out   --returns the formatted text (NUL-terminated)
+ * n     --the size of out (at least CSV_FORMAT_MIN)
+ * fmt   --the printf format, with one conversion
+ * type  --the value's type
+ * value --the value to format
+ *
+ * Returns: (size_t)
+ * The length of the formatted text (as snprintf(): if it's n or more,
+ * the text was truncated).
+ *
+ * Remarks:
+ * The argument passed to snprintf() is the Value member for type
+ * (integer, real or string), so it matches the field's conversion.
+ */
+size_t csv_format_value_(char *out, size_t n, const char *fmt, Type type,
+                         Value value)
+{
+    const char *f = fmt;
+    int precision = -1, is_long = 0, len;
+
+    if (*f++ == '%')
+    {
+        if (*f == '.')
+        {
+            for (precision = 0, ++f; *f >= '0' && *f <= '9'; ++f)
+            {
+                precision = precision * 10 + (*f - '0');
+                if (precision > CSV_PRECISION_MAX)
+                {
+                    break;
+                }
+            }
+        }
+        if (*f == 'l')
+        {
+            is_long = 1;
+            ++f;
+        }
+        if (f[0] != '\0' && f[1] == '\0')
+        {
+            if (type == INTEGER_TYPE && precision < 0
+                && (*f == 'd' || *f == 'i'))
+            {
+                SYMBOL_INT i = is_long ? value.integer
+                    : (SYMBOL_INT) (int) value.integer;
+                uint64_t u = i < 0 ? 0 - (uint64_t) i : (uint64_t) i;
+                size_t n_char = (i < 0);
+
+                out[0] = '-';
+                n_char += format_uint_(out + n_char, u, 1);
+                out[n_char] = '\0';
+                return n_char;
+            }
+            if (type == REAL_TYPE && *f == 'f'
+                && precision <= CSV_PRECISION_MAX)
+            {
+                size_t n_char = format_fixed_(out, value.real,
+                                             precision < 0 ? 6 : precision);
+
+                if (n_char != 0)
+                {
+                    out[n_char] = '\0';
+                    return n_char;
+                }
+            }
+        }
+    }
+    switch (type)
+    {
+    case INTEGER_TYPE:
+        if (strchr(fmt, 'l') == NULL)
+        {                              /* (e.g. "%5d" expects an int) */
+            len = snprintf(out, n, fmt, (int) value.integer);
+        }
+        else
+        {
+            len = snprintf(out, n, fmt, value.integer);
+        }
+        break;
+    case REAL_TYPE:
+        len = snprintf(out, n, fmt, value.real);
+        break;
+    default:
+        len = snprintf(out, n, fmt, value.string);
+        break;
+    }
+    return len < 0 ? 0 : (size_t) len;
+}
+
+/*
+ * csv_put_value_() --Write a field's value, with its print_fmt.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The formatted text is quoted if necessary, like a string field.
+ */
+int csv_put_value_(CSVFilePtr csv_fp, CSVFieldPtr field, AtomPtr value)
+{
+    char *out = reserve(csv_fp, CSV_FORMAT_MIN);
+    size_t n;
+
+    if (out == NULL)
+    {
+        return 0;
+    }
+    n = csv_format_value_(out, CSV_FORMAT_MIN, field->print_fmt,
+                          field->item.type, value->value);
+    if (n < CSV_FORMAT_MIN)
+    {
+        char text[CSV_FORMAT_MIN];
+
+        if (strpbrk(out, ",\"\r\n") == NULL)
+        {
+            csv_fp->buf_len += n;      /* (it's already in the buffer) */
+            return 1;
+        }
+        memcpy(text, out, n + 1);
+        return csv_put_string_(csv_fp, text);
+    }
+    else
+    {                                  /* (too long for the buffer) */
+        char *text = malloc(n + 1);
+        int status = 0;
+
+        if (text != NULL)
+        {
+            csv_format_value_(text, n + 1, field->print_fmt,
+                              field->item.type, value->value);
+            status = csv_put_string_(csv_fp, text);
+            free(text);
+        }
+        return status;
+    }
+}
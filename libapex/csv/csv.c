@@ -18,9 +18,15 @@
  * This module provides a simple open/close/read/write API for
  * CSV files.  Note that there's no seek (yet), as CSV files
  * are typically read in their entirety, and only appended to.
+ * Files opened in mode "m" are memory-mapped (see csv-map.c), and
+ * binary images (see csv-image.c) are read in mode "b".
  *
- * The CSV processing is currently a little simplistic: it doesn't
- * handle any quoting or escaping in the manner of Excel.
+ * Records are parsed by csv_parse_record_() (see csv-parse.c), which
+ * handles RFC4180 quoting: quoted fields may contain commas, newlines
+ * and doubled quotes, and csv_write() quotes string fields that need
+ * it.  The header is still split simply, at commas.  Records are
+ * written through a buffer, with fast number formatting (see
+ * csv-write.c).
  *
  * See Also:
  * https://tools.ietf.org/html/rfc4180
@@ -37,6 +43,7 @@
 #include <apex/estring.h>
 #include <apex/strparse.h>
 #include <apex/log.h>
+#include <apex/profile.h>
 
 static char csv_str_fmt[] = "%s";
 
@@ -182,7 +189,7 @@ static void csv_write_header_(CSVFilePtr csv_fp)
  *
  * Parameters:
  * path --specifies the path of the file to open
- * mode --specifies the file opening mode: one of "r", "w", "a"
+ * mode --specifies the file opening mode: one of "r", "w", "a", "m", "b"
  * ...  --other parameters, but only for "w", "a" modes
  *
  * Returns: (CSVFilePtr)
@@ -201,14 +208,26 @@ static void csv_write_header_(CSVFilePtr csv_fp)
  * and compared to the provided data, and it must match EXACTLY.  However,
  * the caller-provided header is used, and is assumed to be managed by
  * the caller (i.e. csv_close() will not free it).
+ *
+ * Mode "m" is like "r", but the file is memory-mapped, and its records
+ * can also be read without copying by csv_read_view() (see csv-map.c).
+ *
+ * Mode "b" opens a binary image written by csv_image_write(); its
+ * fields (with their types and formats) come from the image.
+ *
+ * Files named "*.gz" or "*.zst" (or opened with a 'z' in the mode, as
+ * in "rz", for gzip) are (de)compressed on the fly, in modes "r" and
+ * "w" only (see csv-filter.c).
  */
 CSVFilePtr csv_open(const char *path, const char *mode, ...)
 {
     va_list ap;
     CSVFilePtr csv_fp;
+    const char *filter;
     char header[CSV_TEXT_MAX + 1] = "";
 
-    if (!(*mode == 'a' || *mode == 'r' || *mode == 'w'))
+    if (!(*mode == 'a' || *mode == 'r' || *mode == 'w' || *mode == 'm'
+          || *mode == 'b'))
     {
         return NULL;                   /* error: invalid mode */
     }
@@ -219,16 +238,44 @@ CSVFilePtr csv_open(const char *path, const char *mode, ...)
         return NULL;                   /* error: malloc failed */
     }
 
-    if ((csv_fp->fp = fopen(path, mode)) == NULL)
+    csv_fp->mode = *mode;
+    if ((filter = csv_filter_(path, mode)) != NULL)
+    {
+        if ((*mode != 'r' && *mode != 'w')
+            || (csv_fp->fp = csv_filter_open_(csv_fp, path, filter)) == NULL)
+        {
+            csv_close(csv_fp);
+            trace_debug("cannot open compressed file \"%s\"", path);
+            return NULL;               /* error: bad mode, or no filter */
+        }
+    }
+    else if (*mode == 'm')
+    {
+        if (!csv_map_open_(csv_fp, path, header, sizeof(header)))
+        {
+            csv_close(csv_fp);
+            trace_debug("cannot map file \"%s\"", path);
+            return NULL;               /* error: open/mmap failed */
+        }
+    }
+    else if (*mode == 'b')
+    {
+        if (!csv_image_open_(csv_fp, path))
+        {
+            csv_close(csv_fp);
+            trace_debug("cannot open image \"%s\"", path);
+            return NULL;               /* error: open/mmap/bad image */
+        }
+        return csv_fp;                 /* (the image has the fields) */
+    }
+    else if ((csv_fp->fp = fopen(path, mode)) == NULL)
     {
         csv_close(csv_fp);
         trace_debug("cannot open file \"%s\"", path);
         return NULL;                   /* error: fopen failed */
     }
 
-    csv_fp->mode = *mode;
-
-    if (*mode != 'r')
+    if (*mode != 'r' && *mode != 'm')
     {
         va_start(ap, mode);
         csv_fp->n_field = (size_t) va_arg(ap, int);
@@ -254,7 +301,10 @@ CSVFilePtr csv_open(const char *path, const char *mode, ...)
     }
     else
     {
-        fgets(header, sizeof(header), csv_fp->fp);
+        if (*mode == 'r')
+        {
+            fgets(header, sizeof(header), csv_fp->fp);
+        }
         if ((csv_fp->n_field = csv_mk_header_(header, &csv_fp->field)) == 0)
         {
             csv_close(csv_fp);
@@ -282,13 +332,28 @@ void csv_close(CSVFilePtr csv_fp)
 {
     if (csv_fp->fp != NULL)
     {
+        if (csv_fp->mode == 'w' || csv_fp->mode == 'a')
+        {
+            csv_flush(csv_fp);
+        }
         fclose(csv_fp->fp);
     }
-    if (csv_fp->field != NULL && csv_fp->mode == 'r')
+    csv_filter_close_(csv_fp);         /* (after EOF on its pipe) */
+    if (csv_fp->field != NULL
+        && (csv_fp->mode == 'r' || csv_fp->mode == 'm'
+            || csv_fp->mode == 'b'))
     {
         free(csv_fp->field[0].item.name);
         free(csv_fp->field);
     }
+    if (csv_fp->mode == 'm' || csv_fp->mode == 'b')
+    {
+        csv_map_close_(csv_fp);
+    }
+    else
+    {
+        free(csv_fp->buf);
+    }
     free(csv_fp);
 }
 
@@ -306,8 +371,10 @@ void csv_close(CSVFilePtr csv_fp)
  * Success: 1; Failure: 0.
  *
  * Remarks:
- * This raw record is read by fgets into the bytes buffer, and from
- * there it is processed into the values array.  Note that (for string
+ * This raw record is parsed (and unquoted) into the bytes buffer, and
+ * from there it is processed into the values array; numeric fields
+ * are converted by csv_scan_value_(), which gives the same results as
+ * sscanf() with the field's scan_fmt.  Note that (for string
  * values at least) values.item.value will address bytes[] storage.
  * This is OK, since it's all the callers data-space from csv_read's POV.
  *
@@ -319,39 +386,46 @@ void csv_close(CSVFilePtr csv_fp)
 int csv_read(CSVFilePtr csv_fp, size_t n_value, Atom value[],
              size_t n_byte, char bytes[])
 {
-    char *cp = bytes;
     size_t n_fields;
     CSVFieldPtr fld = csv_fp->field;
     AtomPtr val = value;
 
-    if (csv_fp->mode != 'r')
+    PROFILE_FUNCTION();
+    if (csv_fp->mode == 'b')
+    {                                  /* (already typed: no text) */
+        if ((n_fields = csv_image_read_(csv_fp, n_value, value)) == 0)
+        {
+            return 0;                  /* eof */
+        }
+        for (size_t i = 0; i < MIN(n_value, n_fields); ++i)
+        {
+            fld[i].item.value = value[i].value;
+        }
+        return 1;
+    }
+    if (csv_fp->mode != 'r' && csv_fp->mode != 'm')
     {
         return 0;
     }
 
-    if (fgets(bytes, n_byte, csv_fp->fp) == NULL)
+    n_value = MIN(n_value, csv_fp->n_field);
+    if ((n_fields = csv_parse_record_(csv_fp, n_value, value,
+                                      n_byte, bytes)) == 0)
     {
         return 0;                      /* eof */
     }
-
-    n_fields = strsplit(bytes, ',');
     n_value = MIN(n_value, n_fields);
 
     for (; n_value > 0; ++fld, ++val, --n_value)
     {
+        if (fld->scan_fmt != csv_str_fmt)
+        {                              /* (val is the field's text) */
+            const char *text = val->value.string;
 
-        if (fld->scan_fmt == csv_str_fmt)
-        {
-            val->value.string = cp;
-            csv_strip_eol_(cp);
-        }
-        else
-        {
-            sscanf(cp, fld->scan_fmt, &val->value);
+            csv_scan_value_(fld->scan_fmt, text, &val->value);
         }
         val->type = fld->item.type;
         fld->item.value = val->value;  /* remember last read value */
-        cp += strlen(cp) + 1;
     }
     return 1;
 }
@@ -368,31 +442,36 @@ int csv_read(CSVFilePtr csv_fp, size_t n_value, Atom value[],
  * Success: 1; Failure: 0.
  *
  * Remarks:
- * The values are printed with the field's "print_fmt" specifier.
- * That's OK for now, but one day I'll need to deal with escaping
- * characters (e.g. "\n" etc.) and possibly quoting the whole field in
- * the way that excel does.
+ * The values are printed with the field's "print_fmt" specifier, and
+ * quoted if necessary (see csv_put_string_()).  The record is buffered
+ * (see csv-write.c), and written when the buffer fills, or by
+ * csv_flush() or csv_close().
  */
 int csv_write(CSVFilePtr csv_fp, size_t n_value, Atom value[])
 {
     CSVFieldPtr fld = csv_fp->field;
     AtomPtr val = value;
 
-    if (csv_fp->mode == 'r')
+    if (csv_fp->mode == 'r' || csv_fp->mode == 'm' || csv_fp->mode == 'b')
     {
         return 0;                      /* error: this mode can't write */
     }
 
-    n_value = MIN(n_value, csv_fp->n_field) - 1;
-    fprintf(csv_fp->fp, fld->print_fmt, val->value);
-
-    for (++fld, ++val; n_value > 0; ++fld, ++val, --n_value)
+    n_value = MIN(n_value, csv_fp->n_field);
+    for (size_t i = 0; i < n_value; ++fld, ++val, ++i)
     {
-        fputs(",", csv_fp->fp);
-        fprintf(csv_fp->fp, fld->print_fmt, val->value);
+        if (i > 0 && !csv_put_bytes_(csv_fp, ",", 1))
+        {
+            return 0;
+        }
+        if (fld->print_fmt == csv_str_fmt
+            ? !csv_put_string_(csv_fp, val->value.string)
+            : !csv_put_value_(csv_fp, fld, val))
+        {
+            return 0;                  /* error: write failed */
+        }
     }
-    fputs("\n", csv_fp->fp);
-    return 1;
+    return csv_put_bytes_(csv_fp, "\n", 1);
 }
 
 /*
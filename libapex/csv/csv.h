@@ -12,7 +12,9 @@
 #define CSV_H
 
 #include <stdio.h>
+#include <sys/types.h>
 #include <apex.h>
+#include <apex/arena.h>                 /* CSVBlock's text */
 #include <apex/symbol.h>
 #include <apex/vector.h>                /* csv_parse_fields() returns vector */
 
@@ -23,6 +25,8 @@ extern "C"
     enum CSVfileConsts
     {
         CSV_TEXT_MAX = 4096,           /* max 4K text per record */
+        CSV_BUFFER_SIZE = 65536,       /* csv_read()/csv_write() buffer */
+        CSV_FORMAT_MIN = 512           /* buffer for a formatted value */
     };
     typedef struct CSVField_t
     {
@@ -31,21 +35,95 @@ extern "C"
         const char *print_fmt;         /* used by csv_write() */
     } CSVField, *CSVFieldPtr;
 
+    typedef struct CSVView_t
+    {
+        const char *str;               /* the field's text (no NUL!) */
+        size_t len;
+        int quoted;                    /* unquote with csv_view_copy() */
+    } CSVView, *CSVViewPtr;
+
     typedef struct CSVFile_t
     {
         FILE *fp;
-        char mode;                     /* "r", "w", "a" */
+        char mode;                     /* "r", "w", "a", "m", "b" */
         size_t n_field;
         CSVFieldPtr field;             /* vector of fields */
+        char *buf;                     /* I/O buffer, or the mapping */
+        size_t buf_pos;                /* next unread byte (or "b" row) */
+        size_t buf_len;                /* No. of bytes in buf */
+        pid_t filter_pid;              /* (de)compressor process, or 0 */
     } CSVFile, *CSVFilePtr;
 
+    typedef struct CSVColumn_t
+    {
+        Type type;                     /* the field's type */
+        union
+        {
+            void *any;
+            SYMBOL_INT *integer;       /* INTEGER_TYPE */
+            double *real;              /* REAL_TYPE */
+            CSVViewPtr view;           /* anything else */
+        } data;
+    } CSVColumn, *CSVColumnPtr;
+
+    typedef struct CSVBlock_t
+    {
+        size_t max_row;                /* the size of each column */
+        size_t n_row;                  /* No. of rows read */
+        size_t n_column;
+        CSVColumnPtr column;           /* one per field */
+        Arena text;                    /* string text (mode "r") */
+        AtomPtr record;                /* (a record, for parsing) */
+        CSVViewPtr view;               /* (a record's views, for parsing) */
+    } CSVBlock, *CSVBlockPtr;
+
+    typedef struct CSVLoad_t
+    {
+        size_t n_block;
+        CSVBlockPtr block;             /* the file's records, in order */
+        size_t n_row;                  /* total No. of rows */
+    } CSVLoad, *CSVLoadPtr;
+
     CSVFilePtr csv_open(const char *path, const char *mode, ...);
     void csv_close(CSVFilePtr csv_fp);
     int csv_read(CSVFilePtr csv_fp, size_t n_values, Atom values[],
                  size_t n_bytes, char bytes[]);
     int csv_write(CSVFilePtr csv_fp, size_t n_values, Atom values[]);
+    int csv_flush(CSVFilePtr csv_fp);
+    size_t csv_read_view(CSVFilePtr csv_fp, size_t n_view, CSVView view[]);
+    size_t csv_view_copy(const CSVView * view, size_t n, char *str);
+    CSVBlockPtr csv_block_init(CSVBlockPtr block, CSVFilePtr csv_fp,
+                               size_t max_row);
+    void csv_block_free(CSVBlockPtr block);
+    size_t csv_read_block(CSVFilePtr csv_fp, CSVBlockPtr block);
+    CSVLoadPtr csv_load(CSVLoadPtr load, CSVFilePtr csv_fp, int n_thread);
+    void csv_load_free(CSVLoadPtr load);
+    int csv_image_write(const char *path, CSVFilePtr csv_fp);
+    int csv_image_range(CSVFilePtr csv_fp, size_t column, ValuePtr min,
+                        ValuePtr max);
     CSVFieldPtr csv_field(CSVFilePtr csv_fp, const char *name);
     CSVFieldPtr *csv_parse_fields(CSVFilePtr csv_fp, char *fields);
+
+    const char *csv_filter_(const char *path, const char *mode);
+    FILE *csv_filter_open_(CSVFilePtr csv_fp, const char *path,
+                           const char *program);
+    int csv_filter_close_(CSVFilePtr csv_fp);
+    int csv_map_open_(CSVFilePtr csv_fp, const char *path, char *header,
+                      size_t n_header);
+    void csv_map_close_(CSVFilePtr csv_fp);
+    int csv_image_open_(CSVFilePtr csv_fp, const char *path);
+    size_t csv_image_read_(CSVFilePtr csv_fp, size_t n_value, Atom value[]);
+    size_t csv_image_read_block_(CSVFilePtr csv_fp, CSVBlockPtr block);
+    size_t csv_parse_record_(CSVFilePtr csv_fp, size_t n_value,
+                             Atom value[], size_t n_byte, char bytes[]);
+    size_t csv_span_(const char *str, size_t n);
+    size_t csv_span_scalar_(const char *str, size_t n);
+    int csv_scan_value_(const char *fmt, const char *str, ValuePtr value);
+    int csv_put_bytes_(CSVFilePtr csv_fp, const char *str, size_t n);
+    int csv_put_string_(CSVFilePtr csv_fp, const char *str);
+    size_t csv_format_value_(char *out, size_t n, const char *fmt,
+                             Type type, Value value);
+    int csv_put_value_(CSVFilePtr csv_fp, CSVFieldPtr field, AtomPtr value);
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
@@ -0,0 +1,246 @@
+/*
+ * BLOOM.C --A split-block Bloom filter.
+ *
+ * Contents:
+ * block_mask()     --Compute the bit (in each word of a block) for a hash.
+ * block_check()    --Check a block for a hash's bits (scalar).
+ * block_check_avx2() --Check a block for a hash's bits (AVX2).
+ * resolve_check()  --Select the best block_check() for this CPU, and call it.
+ * bloom_new()      --Create a Bloom filter sized for n_items keys.
+ * bloom_free()     --Free a Bloom filter.
+ * block_index()    --Select a hash's block.
+ * bloom_add_hash() --Add a (hashed) key to a Bloom filter.
+ * bloom_check_hash() --Check for a (hashed) key in a Bloom filter.
+ * bloom_add()      --Add a key to a Bloom filter.
+ * bloom_check()    --Check for a key in a Bloom filter.
+ * bloom_clear()    --Remove all the keys from a Bloom filter.
+ *
+ * Remarks:
+ * This is the "split block" Bloom filter used by Impala and Parquet:
+ * a key's hash selects a block of 8 32-bit words, and sets one bit
+ * in each word, chosen by multiplying the hash's low 32 bits by a
+ * different odd constant per word, and taking the top 5 bits.  The
+ * 8 multiplies, shifts and tests are one AVX2 sequence each; on
+ * other CPUs it's a scalar loop (which the compiler may vectorise
+ * itself).  The false positive rate is a little worse than a
+ * classic Bloom filter with the same bits per key, but every check
+ * costs one cache miss at most.
+ *
+ * See Also:
+ * Putze, Sanders, Singler: Cache-, Hash- and Space-Efficient Bloom
+ * Filters (2007).
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apex.h>
+#include <apex/cpu.h>
+#include <apex/filter.h>
+#include <apex/hash.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOOM_X86
+#include <immintrin.h>
+#endif
+
+typedef int (*BlockCheckProc)(const uint32_t *block, uint32_t hash);
+
+static const uint32_t salt[BLOOM_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/*
+ * block_mask() --Compute the bit (in each word of a block) for a hash.
+ */
+static inline void block_mask(uint32_t hash, uint32_t mask[])
+{
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; ++i)
+    {
+        mask[i] = 1U << ((hash * salt[i]) >> 27);
+    }
+}
+
+/*
+ * block_check() --Check a block for a hash's bits (scalar).
+ */
+static int block_check(const uint32_t *block, uint32_t hash)
+{
+    uint32_t mask[BLOOM_BLOCK_WORDS];
+    uint32_t missing = 0;
+
+    block_mask(hash, mask);
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; ++i)
+    {
+        missing |= mask[i] & ~block[i];
+    }
+    return missing == 0;
+}
+
+#ifdef BLOOM_X86
+/*
+ * block_check_avx2() --Check a block for a hash's bits (AVX2).
+ */
+__attribute__((target("avx2")))
+static int block_check_avx2(const uint32_t *block, uint32_t hash)
+{
+    __m256i h = _mm256_set1_epi32((int) hash);
+    __m256i s = _mm256_loadu_si256((const __m256i *) salt);
+    __m256i bit = _mm256_srli_epi32(_mm256_mullo_epi32(h, s), 27);
+    __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), bit);
+    __m256i b = _mm256_load_si256((const __m256i *) block);
+
+    return _mm256_testc_si256(b, mask);    /* (all mask bits set in b) */
+}
+#endif /* BLOOM_X86 */
+
+static int resolve_check(const uint32_t *block, uint32_t hash);
+
+static BlockCheckProc block_check_proc = resolve_check;
+
+/*
+ * resolve_check() --Select the best block_check() for this CPU, and call it.
+ */
+static int resolve_check(const uint32_t *block, uint32_t hash)
+{
+    BlockCheckProc proc = block_check;
+
+#ifdef BLOOM_X86
+    if (cpu_has(CPU_AVX2))
+    {
+        proc = block_check_avx2;
+    }
+#endif
+    CPU_RESOLVE(&block_check_proc, proc);
+    return proc(block, hash);
+}
+
+/*
+ * bloom_new() --Create a Bloom filter sized for n_items keys.
+ *
+ * Parameters:
+ * n_items  --the expected No. of keys
+ * fp_rate  --the acceptable false positive rate (e.g. 0.01)
+ * hash     --the key hash function (NULL: hash_keyn_wy())
+ *
+ * Returns: (BloomFilterPtr)
+ * Success: the (empty) filter; Failure: NULL.
+ *
+ * Remarks:
+ * The filter is sized as a classic Bloom filter would be (about 10
+ * bits per key for 1%), with 1/8 more to allow for the blocking.
+ * Adding more than n_items keys still works, but the false positive
+ * rate grows.
+ */
+BloomFilterPtr bloom_new(size_t n_items, double fp_rate, HashNProc hash)
+{
+    BloomFilterPtr filter;
+    double n_bit;
+
+    if (fp_rate <= 0.0 || fp_rate >= 1.0
+        || (filter = NEW(BloomFilter, 1)) == NULL)
+    {
+        return NULL;
+    }
+    n_bit = -(double) MAX(n_items, 1) * log(fp_rate) / (M_LN2 * M_LN2);
+    filter->n_block = (size_t) ceil(n_bit * 9 / 8
+                                    / (BLOOM_BLOCK_WORDS * 32));
+    filter->hash = hash != NULL ? hash : hash_keyn_wy;
+    if (posix_memalign((void **) &filter->block, CACHE_LINE,
+                       filter->n_block * sizeof(*filter->block)) != 0)
+    {
+        free(filter);
+        return NULL;
+    }
+    bloom_clear(filter);
+    return filter;
+}
+
+/*
+ * bloom_free() --Free a Bloom filter.
+ */
+void bloom_free(BloomFilterPtr filter)
+{
+    if (filter != NULL)
+    {
+        free(filter->block);
+        free(filter);
+    }
+}
+
+/*
+ * block_index() --Select a hash's block.
+ *
+ * Remarks:
+ * The block is chosen by the hash's top 32 bits (scaled, rather than
+ * remaindered), and the bits within it by the low 32.
+ */
+static inline size_t block_index(const BloomFilter * filter, uint64_t hash)
+{
+    return (size_t) (((hash >> 32) * (uint64_t) filter->n_block) >> 32);
+}
+
+/*
+ * bloom_add_hash() --Add a (hashed) key to a Bloom filter.
+ *
+ * Remarks:
+ * The hash should have 64 well-mixed bits (see filter_mix_()).
+ */
+void bloom_add_hash(BloomFilterPtr filter, uint64_t hash)
+{
+    uint32_t *block = filter->block[block_index(filter, hash)];
+    uint32_t mask[BLOOM_BLOCK_WORDS];
+
+    block_mask((uint32_t) hash, mask);
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; ++i)
+    {
+        block[i] |= mask[i];
+    }
+    filter->n_items += 1;
+}
+
+/*
+ * bloom_check_hash() --Check for a (hashed) key in a Bloom filter.
+ *
+ * Returns: (int)
+ * 0: the key is definitely not in the filter; 1: it probably is.
+ */
+int bloom_check_hash(const BloomFilter * filter, uint64_t hash)
+{
+    return block_check_proc(filter->block[block_index(filter, hash)],
+                            (uint32_t) hash);
+}
+
+/*
+ * bloom_add() --Add a key to a Bloom filter.
+ *
+ * Parameters:
+ * filter   --the filter
+ * key      --the key's bytes
+ * n        --the No. of bytes
+ */
+void bloom_add(BloomFilterPtr filter, const void *key, size_t n)
+{
+    bloom_add_hash(filter, filter_mix_(filter->hash((char *) key, n)));
+}
+
+/*
+ * bloom_check() --Check for a key in a Bloom filter.
+ *
+ * Returns: (int)
+ * 0: the key is definitely not in the filter; 1: it probably is.
+ */
+int bloom_check(const BloomFilter * filter, const void *key, size_t n)
+{
+    return bloom_check_hash(filter,
+                            filter_mix_(filter->hash((char *) key, n)));
+}
+
+/*
+ * bloom_clear() --Remove all the keys from a Bloom filter.
+ */
+void bloom_clear(BloomFilterPtr filter)
+{
+    memset(filter->block, 0, filter->n_block * sizeof(*filter->block));
+    filter->n_items = 0;
+}
@@ -0,0 +1,379 @@
+/*
+ * CACHE.C --A bounded cache, with CLOCK eviction and optional TTLs.
+ *
+ * Contents:
+ * entry_hash()     --Hash a cache entry's key.
+ * entry_cmp()      --Compare a cache entry's key.
+ * entry_same()     --Compare a cache entry itself (not just its key).
+ * ttl_ns()         --Convert a TTL to nanoseconds.
+ * cache_new()      --Create a cache.
+ * cache_free()     --Free a cache, releasing all its entries.
+ * ring_unlink()    --Remove an entry from the CLOCK ring.
+ * entry_drop()     --Remove an entry from the cache, and release it.
+ * find()           --Find a key's entry.
+ * expired()        --Check if an entry's TTL has passed.
+ * cache_get()      --Get a key's value, if it's cached.
+ * evict_one()      --Evict the entry under the CLOCK hand.
+ * cache_put()      --Add or replace a key's value.
+ * cache_put_ttl()  --Add or replace a key's value, with its own TTL.
+ * cache_remove()   --Remove a key's value.
+ * cache_clear()    --Remove all the cache's entries.
+ * cache_stats()    --Return a cache's counters.
+ *
+ * Remarks:
+ * Each entry is one allocation, holding the ring links and a copy
+ * of its key, and the Hash indexes the entries themselves, so a hit
+ * is one hash_find() and an update of the entry's referenced flag;
+ * nothing is allocated, and no list is re-ordered.
+ *
+ * Eviction is by the CLOCK algorithm (an approximation of LRU): the
+ * entries form a ring, and the hand sweeps it, clearing referenced
+ * entries' flags and evicting the first entry that hasn't been used
+ * since the hand last passed it (or whose TTL has passed).  New
+ * entries are added behind the hand, so they survive a whole sweep.
+ *
+ * Each entry is charged its value's (caller-specified) size, plus
+ * the entry and its key, against max_bytes.  Expired entries are
+ * removed when they're looked up, or when the hand reaches them.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <apex.h>
+#include <apex/cache.h>
+
+enum
+{
+    CACHE_MIN_SLOT = 64
+};
+
+#define CACHE_MAX_LOAD 1.0
+
+/*
+ * entry_hash() --Hash a cache entry's key.
+ */
+static unsigned long entry_hash(char *data)
+{
+    return hash_key_wy((char *) ((CacheEntryPtr) data)->key);
+}
+
+/*
+ * entry_cmp() --Compare a cache entry's key.
+ */
+static int entry_cmp(const void *data, const void *key)
+{
+    return strcmp(((const CacheEntry *) data)->key,
+                  ((const CacheEntry *) key)->key);
+}
+
+/*
+ * entry_same() --Compare a cache entry itself (not just its key).
+ */
+static int entry_same(const void *data, const void *key)
+{
+    return data != key;
+}
+
+/*
+ * ttl_ns() --Convert a TTL to nanoseconds.
+ */
+static TimeNs ttl_ns(const TimeValue *ttl)
+{
+    return ttl != NULL ? ns_from_tv(ttl) : 0;
+}
+
+/*
+ * cache_new() --Create a cache.
+ *
+ * Parameters:
+ * max_bytes    --the most memory that the entries may be charged
+ * ttl      --the entries' default time to live (NULL: forever)
+ * evict    --called to release values as they leave (or NULL)
+ * evict_data   --evict's context
+ *
+ * Returns: (CachePtr)
+ * Success: the cache; Failure: NULL.
+ */
+CachePtr cache_new(size_t max_bytes, const TimeValue *ttl,
+                   CacheEvictProc evict, void *evict_data)
+{
+    CachePtr cache;
+
+    if (max_bytes == 0 || (cache = NEW(Cache, 1)) == NULL)
+    {
+        return NULL;
+    }
+    if ((cache->index = hash_new(entry_hash, CACHE_MIN_SLOT)) == NULL)
+    {
+        free(cache);
+        return NULL;
+    }
+    hash_set_growth(cache->index, CACHE_MAX_LOAD);
+    cache->max_bytes = max_bytes;
+    cache->ttl = ttl_ns(ttl);
+    cache->evict = evict;
+    cache->evict_data = evict_data;
+    cache->now = ns_monotonic;
+    return cache;
+}
+
+/*
+ * cache_free() --Free a cache, releasing all its entries.
+ *
+ * Remarks:
+ * The entries' values are released as if by cache_clear().
+ */
+void cache_free(CachePtr cache)
+{
+    if (cache != NULL)
+    {
+        cache_clear(cache);
+        hash_free(cache->index);
+        free(cache);
+    }
+}
+
+/*
+ * ring_unlink() --Remove an entry from the CLOCK ring.
+ */
+static void ring_unlink(CachePtr cache, CacheEntryPtr entry)
+{
+    if (entry->next == entry)
+    {
+        cache->hand = NULL;            /* (the last entry) */
+    }
+    else
+    {
+        if (cache->hand == entry)
+        {
+            cache->hand = entry->next;
+        }
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+    }
+}
+
+/*
+ * entry_drop() --Remove an entry from the cache, and release it.
+ */
+static void entry_drop(CachePtr cache, CacheEntryPtr entry,
+                       CacheReason reason)
+{
+    hash_remove(cache->index, entry_same, entry);
+    ring_unlink(cache, entry);
+    cache->stats.n_items -= 1;
+    cache->stats.n_bytes -= entry->size;
+    cache->stats.n_evict += reason == CACHE_EVICTED;
+    cache->stats.n_expire += reason == CACHE_EXPIRED;
+    if (cache->evict != NULL && entry->value != NULL)
+    {
+        cache->evict(entry->key, entry->value, reason, cache->evict_data);
+    }
+    free(entry);
+}
+
+/*
+ * find() --Find a key's entry.
+ */
+static CacheEntryPtr find(CachePtr cache, const char *key)
+{
+    CacheEntry probe = {.key = key };
+
+    return hash_find(cache->index, entry_cmp, &probe);
+}
+
+/*
+ * expired() --Check if an entry's TTL has passed.
+ */
+static int expired(CachePtr cache, const CacheEntry * entry)
+{
+    return entry->expires != 0 && cache->now() >= entry->expires;
+}
+
+/*
+ * cache_get() --Get a key's value, if it's cached.
+ *
+ * Parameters:
+ * cache    --the cache
+ * key      --the key
+ *
+ * Returns: (void *)
+ * Success: the value; Failure: NULL (not cached, or expired).
+ *
+ * Remarks:
+ * The value remains owned by the cache: it's only valid until the
+ * next cache_put(), cache_remove() or cache_clear().
+ */
+void *cache_get(CachePtr cache, const char *key)
+{
+    CacheEntryPtr entry = find(cache, key);
+
+    if (entry != NULL && expired(cache, entry))
+    {
+        entry_drop(cache, entry, CACHE_EXPIRED);
+        entry = NULL;
+    }
+    if (entry == NULL)
+    {
+        cache->stats.n_miss += 1;
+        return NULL;
+    }
+    cache->stats.n_hit += 1;
+    entry->referenced = 1;
+    return entry->value;
+}
+
+/*
+ * evict_one() --Evict the entry under the CLOCK hand.
+ *
+ * Remarks:
+ * The hand skips (and clears) referenced entries, so this makes at
+ * most one lap of the ring, plus one entry.
+ */
+static void evict_one(CachePtr cache)
+{
+    CacheEntryPtr entry = cache->hand;
+
+    while (entry->referenced && !expired(cache, entry))
+    {
+        entry->referenced = 0;
+        entry = cache->hand = entry->next;
+    }
+    entry_drop(cache, entry,
+               expired(cache, entry) ? CACHE_EXPIRED : CACHE_EVICTED);
+}
+
+/*
+ * cache_put() --Add or replace a key's value.
+ *
+ * Parameters:
+ * cache    --the cache
+ * key      --the key (copied)
+ * value    --the value (not NULL; owned by the cache, if this succeeds)
+ * size     --the value's size, in bytes, for the cache's accounting
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no memory, or the entry can never fit).
+ *
+ * Remarks:
+ * The entry has the cache's default TTL; other entries are evicted
+ * as needed to make room for it.
+ */
+int cache_put(CachePtr cache, const char *key, void *value, size_t size)
+{
+    TimeValue ttl;
+
+    if (cache->ttl == 0)
+    {
+        return cache_put_ttl(cache, key, value, size, NULL);
+    }
+    return cache_put_ttl(cache, key, value, size,
+                         ns_to_tv(cache->ttl, &ttl));
+}
+
+/*
+ * cache_put_ttl() --Add or replace a key's value, with its own TTL.
+ *
+ * Parameters:
+ * cache, key, value, size  --as for cache_put()
+ * ttl      --the entry's time to live (NULL: forever)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The new entry is indexed before the old one is dropped, or others
+ * evicted, so a failure leaves the cache unchanged.  (entry_drop()
+ * removes entries by identity, so the two briefly share a key.)
+ */
+int cache_put_ttl(CachePtr cache, const char *key, void *value,
+                  size_t size, const TimeValue *ttl)
+{
+    size_t key_len = strlen(key) + 1;
+    CacheEntryPtr old = find(cache, key);
+    CacheEntryPtr entry;
+
+    size += sizeof(CacheEntry) + key_len;
+    if (size > cache->max_bytes)
+    {
+        return 0;                      /* failure: too big */
+    }
+    if ((entry = malloc(sizeof(CacheEntry) + key_len)) == NULL)
+    {
+        return 0;                      /* failure: no memory */
+    }
+    entry->key = memcpy(entry + 1, key, key_len);
+    entry->value = value;
+    entry->size = size;
+    entry->expires = (ttl != NULL) ? cache->now() + ttl_ns(ttl) : 0;
+    entry->referenced = old != NULL && old->referenced;
+
+    if (!hash_insert(cache->index, entry))
+    {
+        free(entry);
+        return 0;                      /* failure: no memory */
+    }
+    if (old != NULL)
+    {
+        if (old->value == value)
+        {
+            old->value = NULL;         /* (not released: it's still used) */
+        }
+        entry_drop(cache, old, CACHE_REPLACED);
+    }
+    while (cache->stats.n_bytes + size > cache->max_bytes)
+    {
+        evict_one(cache);              /* (entry isn't in the ring yet) */
+    }
+    if (cache->hand == NULL)
+    {
+        entry->next = entry->prev = entry;
+        cache->hand = entry;
+    }
+    else
+    {                                  /* (behind the hand) */
+        entry->next = cache->hand;
+        entry->prev = cache->hand->prev;
+        entry->prev->next = entry;
+        cache->hand->prev = entry;
+    }
+    cache->stats.n_items += 1;
+    cache->stats.n_bytes += size;
+    return 1;                          /* success */
+}
+
+/*
+ * cache_remove() --Remove a key's value.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (it wasn't cached).
+ */
+int cache_remove(CachePtr cache, const char *key)
+{
+    CacheEntryPtr entry = find(cache, key);
+
+    if (entry == NULL)
+    {
+        return 0;
+    }
+    entry_drop(cache, entry, CACHE_REMOVED);
+    return 1;
+}
+
+/*
+ * cache_clear() --Remove all the cache's entries.
+ */
+void cache_clear(CachePtr cache)
+{
+    while (cache->hand != NULL)
+    {
+        entry_drop(cache, cache->hand, CACHE_REMOVED);
+    }
+}
+
+/*
+ * cache_stats() --Return a cache's counters.
+ */
+void cache_stats(CachePtr cache, CacheStatsPtr stats)
+{
+    *stats = cache->stats;
+}
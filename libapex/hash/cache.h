@@ -0,0 +1,97 @@
+/*
+ * CACHE.H --Definitions for a bounded (CLOCK) cache, indexed by a Hash.
+ *
+ * Contents:
+ * CacheReason      --Why an entry left the cache.
+ * CacheEvictProc() --Release an entry's value as it leaves the cache.
+ * CacheEntry_t{}   --A cached value, on the CLOCK ring.
+ * CacheStats_t{}   --A cache's counters, for monitoring.
+ * Cache_t{}        --The cache: its index, ring and limits.
+ *
+ * Remarks:
+ * A cache is not thread-safe; each thread should have its own, or
+ * serialise access to a shared one.
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <apex/clock.h>
+#include <apex/hash.h>
+#include <apex/timeval.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    /*
+     * CacheReason --Why an entry left the cache.
+     */
+    typedef enum CacheReason_t
+    {
+        CACHE_EVICTED,                 /* to make room for another */
+        CACHE_EXPIRED,                 /* its TTL passed */
+        CACHE_REPLACED,                /* cache_put() of the same key */
+        CACHE_REMOVED                  /* cache_remove(), cache_clear() */
+    } CacheReason;
+
+    /*
+     * CacheEvictProc() --Release an entry's value as it leaves the cache.
+     *
+     * Parameters:
+     * key      --the entry's key (valid only during the call)
+     * value    --the entry's value
+     * reason   --why it left
+     * data     --the cache's evict_data
+     */
+    typedef void (*CacheEvictProc)(const char *key, void *value,
+                                   CacheReason reason, void *data);
+
+    typedef struct CacheEntry_t
+    {
+        struct CacheEntry_t *next;     /* the CLOCK ring */
+        struct CacheEntry_t *prev;
+        const char *key;               /* (the entry's own copy) */
+        void *value;
+        size_t size;                   /* bytes charged to the cache */
+        TimeNs expires;                /* (0: never) */
+        int referenced;                /* used since the hand passed */
+    } CacheEntry, *CacheEntryPtr;
+
+    typedef struct CacheStats_t
+    {
+        size_t n_items;
+        size_t n_bytes;                /* bytes charged, incl. overhead */
+        uint64_t n_hit;
+        uint64_t n_miss;
+        uint64_t n_evict;              /* CACHE_EVICTED */
+        uint64_t n_expire;             /* CACHE_EXPIRED */
+    } CacheStats, *CacheStatsPtr;
+
+    typedef struct Cache_t
+    {
+        HashPtr index;                 /* CacheEntry, by key */
+        CacheEntryPtr hand;            /* next eviction candidate */
+        size_t max_bytes;
+        TimeNs ttl;                    /* default time to live (0: none) */
+        CacheEvictProc evict;          /* (optional) */
+        void *evict_data;
+        TimeNs (*now)(void);           /* the TTL clock (ns_monotonic()) */
+        CacheStats stats;
+    } Cache, *CachePtr;
+
+    CachePtr cache_new(size_t max_bytes, const TimeValue *ttl,
+                       CacheEvictProc evict, void *evict_data);
+    void cache_free(CachePtr cache);
+    void *cache_get(CachePtr cache, const char *key);
+    int cache_put(CachePtr cache, const char *key, void *value, size_t size);
+    int cache_put_ttl(CachePtr cache, const char *key, void *value,
+                      size_t size, const TimeValue *ttl);
+    int cache_remove(CachePtr cache, const char *key);
+    void cache_clear(CachePtr cache);
+    void cache_stats(CachePtr cache, CacheStatsPtr stats);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* CACHE_H */
@@ -0,0 +1,240 @@
+/*
+ * CHASH.C --A concurrent (lock-striped) hash table.
+ *
+ * Contents:
+ * chash_new()        --Create a new concurrent hash table.
+ * chash_free()       --Free a concurrent hash table, releasing all resources.
+ * chash_insert()     --Insert an item into a concurrent hash table.
+ * chash_remove()     --Remove an item from a concurrent hash table.
+ * chash_find()       --Find a particular item in a concurrent hash table.
+ * chash_visit()      --Visit all the items in a concurrent hash table.
+ * chash_set_growth() --Enable/disable automatic growth of the table.
+ *
+ * Remarks:
+ * A CHash is a set of independent Hash tables ("stripes"), each
+ * protected by its own mutex.  Items are assigned to a stripe by the
+ * high bits of (a mix of) their hash value, so threads working on
+ * different keys rarely contend for the same lock.  Because every
+ * stripe is a complete Hash, it can grow (and rehash incrementally)
+ * without stopping the other stripes.
+ *
+ * A mutex (rather than a reader/writer lock) is used because it is
+ * cheaper for the short critical sections here.
+ *
+ * The table protects its own structure, not the items in it: an item
+ * returned by chash_find() may be removed by another thread at any
+ * time, so the caller must arrange that removed items are not freed
+ * while other threads may still be using them.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <apex.h>
+#include <apex/hash.h>
+
+/*
+ * chash_stripe() --Select the stripe for a particular hash value.
+ */
+static CHashStripePtr chash_stripe(CHashPtr chash, unsigned long hash)
+{
+    uint64_t mix = (uint64_t) hash * 0x9e3779b97f4a7c15ull;
+
+    return &chash->stripe[chash->stripe_bits == 0 ? 0 :
+                          mix >> (64 - chash->stripe_bits)];
+}
+
+/*
+ * chash_new() --Create a new concurrent hash table.
+ *
+ * Parameters:
+ * hash_proc --the hash function, used to allocate items to slots
+ * nslot    --the total number of slots in the hashtable
+ * n_stripe --the number of independently locked stripes
+ *
+ * Returns: (CHashPtr)
+ * Success: the hash table; Failure: NULL.
+ *
+ * Remarks:
+ * The number of stripes is rounded up to a power of 2, and the slots
+ * are divided evenly between them.  A few stripes per thread is usually
+ * enough to make lock contention negligible.
+ */
+CHashPtr chash_new(HashProc hash_proc, size_t nslot, size_t n_stripe)
+{
+    CHashPtr chash;
+    size_t stripe_nslot;
+    int bits = 0;
+
+    if (nslot == 0 || n_stripe == 0)
+    {
+        return NULL;                   /* failure: bad parameters */
+    }
+    while (((size_t) 1 << bits) < n_stripe)
+    {
+        ++bits;
+    }
+    n_stripe = (size_t) 1 << bits;
+    stripe_nslot = MAX(nslot / n_stripe, (size_t) 1);
+
+    if ((chash = (CHashPtr) malloc(sizeof(CHash))) == NULL)
+    {
+        return NULL;                   /* failure: malloc */
+    }
+    chash->hash = hash_proc;
+    chash->stripe_bits = bits;
+    chash->n_stripe = 0;
+    if ((chash->stripe = NEW(CHashStripe, n_stripe)) == NULL)
+    {
+        free(chash);
+        return NULL;                   /* failure: malloc */
+    }
+    for (; chash->n_stripe < n_stripe; ++chash->n_stripe)
+    {
+        CHashStripePtr stripe = &chash->stripe[chash->n_stripe];
+
+        if ((stripe->hash = hash_new(hash_proc, stripe_nslot)) == NULL)
+        {
+            chash_free(chash);
+            return NULL;               /* failure: malloc */
+        }
+        pthread_mutex_init(&stripe->lock, NULL);
+    }
+    return chash;
+}
+
+/*
+ * chash_free() --Free a concurrent hash table, releasing all resources.
+ *
+ * Parameters:
+ * chash    --the hash table to free
+ *
+ * Remarks:
+ * The caller must ensure that no other thread is using the table.
+ */
+void chash_free(CHashPtr chash)
+{
+    for (size_t i = 0; i < chash->n_stripe; ++i)
+    {
+        pthread_mutex_destroy(&chash->stripe[i].lock);
+        hash_free(chash->stripe[i].hash);
+    }
+    free(chash->stripe);
+    free(chash);
+}
+
+/*
+ * chash_insert() --Insert an item into a concurrent hash table.
+ *
+ * Parameters:
+ * chash    --the hash table
+ * data --the data to insert
+ *
+ * Returns: (bool)
+ * Success: true; Failure: false.
+ */
+bool chash_insert(CHashPtr chash, void *data)
+{
+    CHashStripePtr stripe = chash_stripe(chash, chash->hash(data));
+    bool status;
+
+    pthread_mutex_lock(&stripe->lock);
+    status = hash_insert(stripe->hash, data);
+    pthread_mutex_unlock(&stripe->lock);
+    return status;
+}
+
+/*
+ * chash_remove() --Remove an item from a concurrent hash table.
+ *
+ * Parameters:
+ * chash    --the hash table
+ * cmp  --the comparison function to find the item
+ * key  --a key describing the item to be removed
+ *
+ * Returns: (void *)
+ * Success: the removed item; Failure: NULL.
+ */
+void *chash_remove(CHashPtr chash, CompareProc cmp, void *key)
+{
+    CHashStripePtr stripe = chash_stripe(chash, chash->hash(key));
+    void *value;
+
+    pthread_mutex_lock(&stripe->lock);
+    value = hash_remove(stripe->hash, cmp, key);
+    pthread_mutex_unlock(&stripe->lock);
+    return value;
+}
+
+/*
+ * chash_find() --Find a particular item in a concurrent hash table.
+ *
+ * Parameters:
+ * chash    --specifies the hash table
+ * cmp  --the comparison function used to match the item
+ * key  --the key value similar to the item sought
+ *
+ * Returns: (void *)
+ * Success: the item; Failure: NULL.
+ */
+void *chash_find(CHashPtr chash, CompareProc cmp, void *key)
+{
+    CHashStripePtr stripe = chash_stripe(chash, chash->hash(key));
+    void *value;
+
+    pthread_mutex_lock(&stripe->lock);
+    value = hash_find(stripe->hash, cmp, key);
+    pthread_mutex_unlock(&stripe->lock);
+    return value;
+}
+
+/*
+ * chash_visit() --Visit all the items in a concurrent hash table.
+ *
+ * Parameters:
+ * chash    --specifies the hash table
+ * visit    --the visit function to call on every item
+ * user_data  --miscellaneous data to call visit with.
+ *
+ * Returns: (void *)
+ * The item "selected" by visit(), or NULL.
+ *
+ * Remarks:
+ * Each stripe is locked while it is being visited, so the visit
+ * function must not call back into this table.  The table as a whole
+ * is not "frozen", so items inserted/removed by other threads during
+ * the visit may or may not be seen.
+ */
+void *chash_visit(CHashPtr chash, VisitProc visit, void *user_data)
+{
+    void *value = NULL;
+
+    for (size_t i = 0; i < chash->n_stripe && value == NULL; ++i)
+    {
+        CHashStripePtr stripe = &chash->stripe[i];
+
+        pthread_mutex_lock(&stripe->lock);
+        value = hash_visit(stripe->hash, visit, user_data);
+        pthread_mutex_unlock(&stripe->lock);
+    }
+    return value;
+}
+
+/*
+ * chash_set_growth() --Enable/disable automatic growth of the table.
+ *
+ * Parameters:
+ * chash    --specifies the hash table
+ * max_load --the load factor (items/slot) that triggers growth
+ *
+ * See Also: hash_set_growth()
+ */
+void chash_set_growth(CHashPtr chash, double max_load)
+{
+    for (size_t i = 0; i < chash->n_stripe; ++i)
+    {
+        CHashStripePtr stripe = &chash->stripe[i];
+
+        pthread_mutex_lock(&stripe->lock);
+        hash_set_growth(stripe->hash, max_load);
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
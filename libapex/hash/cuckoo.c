@@ -0,0 +1,313 @@
+/*
+ * CUCKOO.C --A cuckoo filter, with 4 16-bit fingerprints per bucket.
+ *
+ * Contents:
+ * has_lane()       --Test whether a bucket holds a fingerprint.
+ * find_lane()      --Return the lane holding a fingerprint, or -1.
+ * set_lane()       --Store a fingerprint in a bucket's lane.
+ * fingerprint()    --Return a hash's (non-zero) fingerprint.
+ * alt_index()      --Return a fingerprint's other bucket.
+ * next_random()    --Return a pseudo-random number, for kicks.
+ * cuckoo_new()     --Create a cuckoo filter sized for n_items keys.
+ * cuckoo_free()    --Free a cuckoo filter.
+ * put_empty()      --Store a fingerprint in an empty lane of a bucket.
+ * insert()         --Store a fingerprint in either bucket, kicking if needed.
+ * cuckoo_add()     --Add a key to a cuckoo filter.
+ * cuckoo_check()   --Check for a key in a cuckoo filter.
+ * cuckoo_remove()  --Remove a key from a cuckoo filter.
+ * cuckoo_clear()   --Remove all the keys from a cuckoo filter.
+ *
+ * Remarks:
+ * A key's hash gives a 16-bit fingerprint and a bucket; its other
+ * bucket is the first XOR a hash of the fingerprint, so either
+ * bucket can be found from the other and the fingerprint alone
+ * (which is what lets a full bucket's entries be moved, or
+ * "kicked", to make room).  A bucket is a 64-bit word of 4 lanes,
+ * and it's searched with the "has a zero lane" trick, so a check is
+ * two (independent) loads and a few word operations.
+ *
+ * With 16-bit fingerprints the false positive rate is about
+ * 8/65536 (0.012%), and the filter can be filled to about 95%.  Only
+ * keys that were added may be removed: removing any other key might
+ * remove a different key with the same fingerprint.
+ *
+ * See Also:
+ * Fan, Andersen, Kaminsky, Mitzenmacher: Cuckoo Filter: Practically
+ * Better Than Bloom (CoNEXT 2014).
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <apex.h>
+#include <apex/filter.h>
+#include <apex/hash.h>
+
+#define LANE_ONES 0x0001000100010001ULL
+#define LANE_HIGH 0x8000800080008000ULL
+#define MAX_LOAD 0.95
+
+/*
+ * has_lane() --Test whether a bucket holds a fingerprint.
+ */
+static inline int has_lane(uint64_t bucket, uint16_t fp)
+{
+    uint64_t x = bucket ^ (fp * LANE_ONES);
+
+    return ((x - LANE_ONES) & ~x & LANE_HIGH) != 0;
+}
+
+/*
+ * find_lane() --Return the lane holding a fingerprint, or -1.
+ */
+static inline int find_lane(uint64_t bucket, uint16_t fp)
+{
+    for (int i = 0; i < CUCKOO_BUCKET_SIZE; ++i)
+    {
+        if ((uint16_t) (bucket >> (16 * i)) == fp)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * set_lane() --Store a fingerprint in a bucket's lane.
+ */
+static inline void set_lane(uint64_t *bucket, int lane, uint16_t fp)
+{
+    *bucket = (*bucket & ~(0xffffULL << (16 * lane)))
+        | ((uint64_t) fp << (16 * lane));
+}
+
+/*
+ * fingerprint() --Return a hash's (non-zero) fingerprint.
+ */
+static inline uint16_t fingerprint(uint64_t hash)
+{
+    uint16_t fp = (uint16_t) (hash >> 48);
+
+    return fp != 0 ? fp : 1;           /* (0 marks an empty lane) */
+}
+
+/*
+ * alt_index() --Return a fingerprint's other bucket.
+ */
+static inline size_t alt_index(const CuckooFilter * filter, size_t index,
+                               uint16_t fp)
+{
+    return (index ^ (size_t) (fp * 0x5bd1e995U)) & filter->mask;
+}
+
+/*
+ * next_random() --Return a pseudo-random number, for kicks.
+ */
+static inline uint64_t next_random(CuckooFilterPtr filter)
+{
+    uint64_t x = filter->random;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return filter->random = x;
+}
+
+/*
+ * cuckoo_new() --Create a cuckoo filter sized for n_items keys.
+ *
+ * Parameters:
+ * n_items  --the most keys that will be added
+ * hash     --the key hash function (NULL: hash_keyn_wy())
+ *
+ * Returns: (CuckooFilterPtr)
+ * Success: the (empty) filter; Failure: NULL.
+ */
+CuckooFilterPtr cuckoo_new(size_t n_items, HashNProc hash)
+{
+    CuckooFilterPtr filter;
+    size_t n_bucket = 1;
+
+    while (n_bucket * CUCKOO_BUCKET_SIZE * MAX_LOAD < (double) n_items)
+    {
+        n_bucket <<= 1;
+    }
+    if ((filter = NEW(CuckooFilter, 1)) == NULL)
+    {
+        return NULL;
+    }
+    if ((filter->bucket = NEW(uint64_t, n_bucket)) == NULL)
+    {
+        free(filter);
+        return NULL;
+    }
+    filter->mask = n_bucket - 1;
+    filter->hash = hash != NULL ? hash : hash_keyn_wy;
+    filter->random = 0x2545f4914f6cdd1dULL;
+    return filter;
+}
+
+/*
+ * cuckoo_free() --Free a cuckoo filter.
+ */
+void cuckoo_free(CuckooFilterPtr filter)
+{
+    if (filter != NULL)
+    {
+        free(filter->bucket);
+        free(filter);
+    }
+}
+
+/*
+ * put_empty() --Store a fingerprint in an empty lane of a bucket.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the bucket is full).
+ */
+static int put_empty(CuckooFilterPtr filter, size_t index, uint16_t fp)
+{
+    int lane = find_lane(filter->bucket[index], 0);
+
+    if (lane < 0)
+    {
+        return 0;
+    }
+    set_lane(&filter->bucket[index], lane, fp);
+    return 1;
+}
+
+/*
+ * insert() --Store a fingerprint in either bucket, kicking if needed.
+ *
+ * Remarks:
+ * If the kicks run out, the fingerprint left over becomes the
+ * victim (which may not be the one being inserted).
+ */
+static void insert(CuckooFilterPtr filter, size_t index, uint16_t fp)
+{
+    size_t alt = alt_index(filter, index, fp);
+
+    if (put_empty(filter, index, fp) || put_empty(filter, alt, fp))
+    {
+        return;
+    }
+    index = (next_random(filter) & 1) ? alt : index;
+    for (int kick = 0; kick < CUCKOO_MAX_KICKS; ++kick)
+    {
+        int lane = (int) (next_random(filter) % CUCKOO_BUCKET_SIZE);
+        uint16_t old = (uint16_t) (filter->bucket[index] >> (16 * lane));
+
+        set_lane(&filter->bucket[index], lane, fp);
+        fp = old;
+        index = alt_index(filter, index, fp);
+        if (put_empty(filter, index, fp))
+        {
+            return;
+        }
+    }
+    filter->victim = fp;
+    filter->victim_index = index;
+}
+
+/*
+ * cuckoo_add() --Add a key to a cuckoo filter.
+ *
+ * Parameters:
+ * filter   --the filter
+ * key      --the key's bytes
+ * n        --the No. of bytes
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the filter is full).
+ *
+ * Remarks:
+ * Adding a key twice stores its fingerprint twice (so it must then
+ * be removed twice).
+ */
+int cuckoo_add(CuckooFilterPtr filter, const void *key, size_t n)
+{
+    uint64_t hash = filter_mix_(filter->hash((char *) key, n));
+
+    if (filter->victim != 0)
+    {
+        return 0;                      /* failure: full */
+    }
+    insert(filter, hash & filter->mask, fingerprint(hash));
+    filter->n_items += 1;
+    return 1;
+}
+
+/*
+ * cuckoo_check() --Check for a key in a cuckoo filter.
+ *
+ * Returns: (int)
+ * 0: the key is definitely not in the filter; 1: it probably is.
+ */
+int cuckoo_check(const CuckooFilter * filter, const void *key, size_t n)
+{
+    uint64_t hash = filter_mix_(filter->hash((char *) key, n));
+    uint16_t fp = fingerprint(hash);
+    size_t index = hash & filter->mask;
+    size_t alt = alt_index(filter, index, fp);
+
+    return has_lane(filter->bucket[index], fp)
+        || has_lane(filter->bucket[alt], fp)
+        || (filter->victim == fp
+            && (filter->victim_index == index
+                || filter->victim_index == alt));
+}
+
+/*
+ * cuckoo_remove() --Remove a key from a cuckoo filter.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the key isn't in the filter).
+ *
+ * Remarks:
+ * Only keys that were added should be removed.  Removing a key makes
+ * room for the victim (if any), so a full filter can take more keys.
+ */
+int cuckoo_remove(CuckooFilterPtr filter, const void *key, size_t n)
+{
+    uint64_t hash = filter_mix_(filter->hash((char *) key, n));
+    uint16_t fp = fingerprint(hash);
+    size_t index[2];
+
+    index[0] = hash & filter->mask;
+    index[1] = alt_index(filter, index[0], fp);
+    for (size_t i = 0; i < NEL(index); ++i)
+    {
+        int lane = find_lane(filter->bucket[index[i]], fp);
+
+        if (lane >= 0)
+        {
+            set_lane(&filter->bucket[index[i]], lane, 0);
+            filter->n_items -= 1;
+            if (filter->victim != 0)
+            {                          /* (re-insert it in the space) */
+                fp = filter->victim;
+                filter->victim = 0;
+                insert(filter, filter->victim_index, fp);
+            }
+            return 1;
+        }
+    }
+    if (filter->victim == fp
+        && (filter->victim_index == index[0]
+            || filter->victim_index == index[1]))
+    {
+        filter->victim = 0;
+        filter->n_items -= 1;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * cuckoo_clear() --Remove all the keys from a cuckoo filter.
+ */
+void cuckoo_clear(CuckooFilterPtr filter)
+{
+    memset(filter->bucket, 0, (filter->mask + 1) * sizeof(uint64_t));
+    filter->n_items = 0;
+    filter->victim = 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * FILTER.H --Definitions for approximate membership (Bloom, cuckoo) filters.
+ *
+ * Contents:
+ * HashNProc        --A hash function for n bytes (e.g. hash_keyn_wy()).
+ * BloomFilter_t{}  --A split-block Bloom filter.
+ * CuckooFilter_t{} --A cuckoo filter, which supports removal.
+ *
+ * Remarks:
+ * A filter answers "is this key in the set?" with either "definitely
+ * not" or "probably", so a lookup that's expected to miss can check
+ * the filter before doing the expensive lookup.  Filters are not
+ * thread-safe for updates; concurrent checks are OK.
+ */
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        BLOOM_BLOCK_WORDS = 8,         /* 32-bit words (256 bits) per block */
+        CUCKOO_BUCKET_SIZE = 4,        /* fingerprints per bucket */
+        CUCKOO_MAX_KICKS = 500
+    };
+
+    typedef unsigned long (*HashNProc)(char *data, size_t n);
+
+    /*
+     * BloomFilter_t{} --A split-block Bloom filter.
+     *
+     * Remarks:
+     * Each key sets one bit in each word of one block, so a check
+     * reads one block (half a cache line, which never straddles a
+     * line), and the 8 bit tests are a single AVX2 operation.
+     */
+    typedef struct BloomFilter_t
+    {
+        uint32_t (*block)[BLOOM_BLOCK_WORDS];
+        size_t n_block;
+        size_t n_items;                /* No. of keys added */
+        HashNProc hash;
+    } BloomFilter, *BloomFilterPtr;
+
+    /*
+     * CuckooFilter_t{} --A cuckoo filter, which supports removal.
+     *
+     * Remarks:
+     * Each key is stored as a 16-bit fingerprint, in one of two
+     * buckets of 4 (which are one 64-bit word, so a bucket is
+     * searched with a few word operations).  If a key can't be
+     * placed after CUCKOO_MAX_KICKS relocations, the last displaced
+     * fingerprint is kept aside as the "victim", and the filter is
+     * full.
+     */
+    typedef struct CuckooFilter_t
+    {
+        uint64_t *bucket;
+        size_t mask;                   /* No. of buckets - 1 */
+        size_t n_items;
+        HashNProc hash;
+        uint16_t victim;               /* (0: none) */
+        size_t victim_index;
+        uint64_t random;               /* (for choosing kicks) */
+    } CuckooFilter, *CuckooFilterPtr;
+
+    BloomFilterPtr bloom_new(size_t n_items, double fp_rate, HashNProc hash);
+    void bloom_free(BloomFilterPtr filter);
+    void bloom_add(BloomFilterPtr filter, const void *key, size_t n);
+    int bloom_check(const BloomFilter * filter, const void *key, size_t n);
+    void bloom_add_hash(BloomFilterPtr filter, uint64_t hash);
+    int bloom_check_hash(const BloomFilter * filter, uint64_t hash);
+    void bloom_clear(BloomFilterPtr filter);
+
+    /*
+     * filter_mix_() --Spread a hash's bits over all 64 (murmur3's fmix64).
+     *
+     * Remarks:
+     * This lets the filters use hashes with a 32-bit range, such as
+     * hash_keyn_pjw()'s.
+     */
+    static inline uint64_t filter_mix_(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        return hash ^ (hash >> 33);
+    }
+
+    CuckooFilterPtr cuckoo_new(size_t n_items, HashNProc hash);
+    void cuckoo_free(CuckooFilterPtr filter);
+    int cuckoo_add(CuckooFilterPtr filter, const void *key, size_t n);
+    int cuckoo_check(const CuckooFilter * filter, const void *key, size_t n);
+    int cuckoo_remove(CuckooFilterPtr filter, const void *key, size_t n);
+    void cuckoo_clear(CuckooFilterPtr filter);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* FILTER_H */
@@ -0,0 +1,223 @@
+/*
+ * HASH-TYPED.H --Typed, inline hash tables generated by a macro.
+ *
+ * Contents:
+ * HASH_DEFINE()      --Define a hash table (map) type, and its operations.
+ *
+ * Remarks:
+ * The generic tables (Hash, OHash in hash.h) store void pointers, and
+ * call their HashProc and CompareProc through pointers.  A table
+ * defined by HASH_DEFINE() stores its keys and values in its slots,
+ * and knows their types, and its hash and equality functions, at
+ * compile time, so they can be inlined, and a lookup touches only
+ * the slot array.
+ *
+ * e.g.
+ *     static inline unsigned long id_hash(const long *id)
+ *     {
+ *         return hash_keyn_wy((char *) id, sizeof(*id));
+ *     }
+ *     #define id_equal(a_, b_) (*(a_) == *(b_))
+ *     HASH_DEFINE(SessionMap, long, Session, id_hash, id_equal)
+ *
+ * defines the type SessionMap, and SessionMap_init(), SessionMap_free(),
+ * SessionMap_put(), SessionMap_get(), SessionMap_remove(), and
+ * SessionMap_visit().  The hash and equality functions (or macros)
+ * are called with key pointers.
+ *
+ * The table works as OHash does: linear probing in a power-of-2
+ * array of slots, each caching its key's full hash, doubling when
+ * more than 3/4 full, and "backward shift" removal (so there are no
+ * tombstones).  An empty slot has a hash of 0, so a key that hashes
+ * to 0 is stored as 1.  Unlike OHash, it's a map: put() replaces the
+ * value of a key that's already present.
+ */
+#ifndef HASH_TYPED_H
+#define HASH_TYPED_H
+
+#include <stdlib.h>
+
+#define HASH_DEFINE(name_, key_type_, value_type_, hash_, equal_)       \
+    typedef struct name_##Slot_t                                        \
+    {                                                                   \
+        unsigned long hash;            /* (0: empty) */                 \
+        key_type_ key;                                                  \
+        value_type_ value;                                              \
+    } name_##Slot;                                                      \
+                                                                        \
+    typedef struct name_##_t                                            \
+    {                                                                   \
+        name_##Slot *slot;                                              \
+        size_t nslot;                  /* (a power of 2) */             \
+        size_t n_items;                                                 \
+    } name_;                                                            \
+                                                                        \
+    static inline unsigned long name_##_hash_(const key_type_ *key)     \
+    {                                                                   \
+        unsigned long hash = hash_(key);                                \
+                                                                        \
+        return hash != 0 ? hash : 1;                                    \
+    }                                                                   \
+                                                                        \
+    static inline name_ *name_##_init(name_ *table, size_t nslot)       \
+    {                                                                   \
+        size_t n = 8;                                                   \
+                                                                        \
+        while (n < nslot)                                               \
+        {                                                               \
+            n *= 2;                                                     \
+        }                                                               \
+        if ((table->slot = calloc(n, sizeof(name_##Slot))) == NULL)     \
+        {                                                               \
+            return NULL;                                                \
+        }                                                               \
+        table->nslot = n;                                               \
+        table->n_items = 0;                                             \
+        return table;                                                   \
+    }                                                                   \
+                                                                        \
+    static inline void name_##_free(name_ *table)                       \
+    {                                                                   \
+        free(table->slot);                                              \
+        table->slot = NULL;                                             \
+        table->nslot = table->n_items = 0;                              \
+    }                                                                   \
+                                                                        \
+    static inline name_##Slot *name_##_find_(const name_ *table,        \
+                                             unsigned long hash,        \
+                                             const key_type_ *key)      \
+    {                                                                   \
+        size_t mask = table->nslot - 1;                                 \
+                                                                        \
+        for (size_t i = hash & mask; table->slot[i].hash != 0;          \
+             i = (i + 1) & mask)                                        \
+        {                                                               \
+            if (table->slot[i].hash == hash                             \
+                && equal_(&table->slot[i].key, key))                    \
+            {                                                           \
+                return &table->slot[i];                                 \
+            }                                                           \
+        }                                                               \
+        return NULL;                                                    \
+    }                                                                   \
+                                                                        \
+    static inline name_##Slot *name_##_place_(name_##Slot *slot,        \
+                                              size_t nslot,             \
+                                              unsigned long hash)       \
+    {                                                                   \
+        size_t i = hash & (nslot - 1);                                  \
+                                                                        \
+        while (slot[i].hash != 0)                                       \
+        {                                                               \
+            i = (i + 1) & (nslot - 1);                                  \
+        }                                                               \
+        slot[i].hash = hash;                                            \
+        return &slot[i];                                                \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_grow_(name_ *table)                       \
+    {                                                                   \
+        size_t nslot = table->nslot * 2;                                \
+        name_##Slot *slot = calloc(nslot, sizeof(name_##Slot));         \
+                                                                        \
+        if (slot == NULL)                                               \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        for (size_t i = 0; i < table->nslot; ++i)                       \
+        {                                                               \
+            if (table->slot[i].hash != 0)                               \
+            {                          /* rehash from cached value */   \
+                *name_##_place_(slot, nslot, table->slot[i].hash)       \
+                    = table->slot[i];                                   \
+            }                                                           \
+        }                                                               \
+        free(table->slot);                                              \
+        table->slot = slot;                                             \
+        table->nslot = nslot;                                           \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline value_type_ *name_##_get(const name_ *table,          \
+                                           const key_type_ *key)        \
+    {                                                                   \
+        name_##Slot *slot = name_##_find_(table, name_##_hash_(key),    \
+                                          key);                         \
+                                                                        \
+        return slot != NULL ? &slot->value : NULL;                      \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_put(name_ *table, const key_type_ *key,   \
+                                  const value_type_ *value)             \
+    {                                                                   \
+        unsigned long hash = name_##_hash_(key);                        \
+        name_##Slot *slot = name_##_find_(table, hash, key);            \
+                                                                        \
+        if (slot == NULL)                                               \
+        {                                                               \
+            if ((table->n_items + 1) * 4 > table->nslot * 3             \
+                && !name_##_grow_(table))                               \
+            {                                                           \
+                return 0;                                               \
+            }                                                           \
+            slot = name_##_place_(table->slot, table->nslot, hash);     \
+            slot->key = *key;                                           \
+            table->n_items += 1;                                        \
+        }                                                               \
+        slot->value = *value;                                           \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_remove(name_ *table,                      \
+                                     const key_type_ *key,              \
+                                     value_type_ *value)                \
+    {                                                                   \
+        name_##Slot *found = name_##_find_(table, name_##_hash_(key),   \
+                                           key);                        \
+        size_t mask = table->nslot - 1;                                 \
+        size_t hole, i;                                                 \
+                                                                        \
+        if (found == NULL)                                              \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        if (value != NULL)                                              \
+        {                                                               \
+            *value = found->value;                                      \
+        }                                                               \
+        hole = (size_t) (found - table->slot);                          \
+        for (i = (hole + 1) & mask; table->slot[i].hash != 0;           \
+             i = (i + 1) & mask)                                        \
+        {                                                               \
+            size_t home = table->slot[i].hash & mask;                   \
+                                                                        \
+            if (((i - home) & mask) >= ((i - hole) & mask))             \
+            {                          /* home is at/before hole */     \
+                table->slot[hole] = table->slot[i];                     \
+                hole = i;                                               \
+            }                                                           \
+        }                                                               \
+        table->slot[hole].hash = 0;                                     \
+        table->n_items -= 1;                                            \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline value_type_ *name_##_visit(                           \
+        const name_ *table,                                             \
+        int (*visit)(const key_type_ *key, value_type_ *value,          \
+                     void *user_data),                                  \
+        void *user_data)                                                \
+    {                                                                   \
+        for (size_t i = 0; i < table->nslot; ++i)                       \
+        {                                                               \
+            if (table->slot[i].hash != 0                                \
+                && visit(&table->slot[i].key, &table->slot[i].value,    \
+                         user_data) != 0)                               \
+            {                                                           \
+                return &table->slot[i].value;                           \
+            }                                                           \
+        }                                                               \
+        return NULL;                                                    \
+    }
+
+#endif /* HASH_TYPED_H */
@@ -2,17 +2,39 @@
  * HASH.C --A simple hash table implementation, and some sample hashing functions.
  *
  * Contents:
- * hash_new()    --Create a new hash table.
- * hash_free()   --Free a hash table, releasing all resources.
- * hash_insert() --Insert an item into a hash table.
- * hash_remove() --Remove an item from a hash table.
- * hash_find()   --Find a particular item in a hash table.
- * hash_visit()  --Visit all the items in a hash table.
+ * hash_new()        --Create a new hash table.
+ * hash_free()       --Free a hash table, releasing all resources.
+ * hash_insert()     --Insert an item into a hash table.
+ * hash_remove()     --Remove an item from a hash table.
+ * hash_find()       --Find a particular item in a hash table.
+ * hash_find_many()  --Find a batch of items in a hash table.
+ * hash_visit()      --Visit all the items in a hash table.
+ * hash_set_growth() --Enable/disable automatic growth of a hash table.
+ * hash_cursor_init() --Start a traversal of a hash table.
+ * hash_cursor_next_() --Move a hash table traversal to the next item.
+ * hash_stats()      --Report the load factor and resize statistics.
+ * hash_collect()    --Report a hash table's statistics as metrics.
+ * hash_metrics()    --Register a hash table's statistics as metrics.
  *
  * Remarks:
- * This hash table implementation constructs a fixed-size array of
- * hash slots when the hash is initialised.  It handles collisions by
- * storing user data in a linked list, one list per slot.
+ * This hash table implementation constructs an array of hash slots
+ * when the hash is initialised.  It handles collisions by storing
+ * user data in a linked list, one list per slot.  Each entry caches
+ * the full hash value of its data, and this is compared before calling
+ * the CompareProc, so items that merely share a slot are rejected
+ * cheaply.  The entries are WideLinks, allocated (like Links) from
+ * per-thread free-lists backed by a shared pool (see link_new_wide()),
+ * so entries freed by one thread can be reused by another.
+ *
+ * If growth is enabled, the slot array is doubled when the load
+ * factor exceeds a threshold.  The items are not rehashed all at
+ * once; instead each subsequent insert/remove moves a few of the old
+ * slots' lists into the new array, so the cost of resizing is spread
+ * evenly over many operations.  While a resize is in progress, items
+ * may be in either the old or the new slot array.  Lookups
+ * (hash_find(), hash_find_many(), hash_visit() etc.) don't rehash, so
+ * they only read the table, and several threads may look up items
+ * concurrently, as long as none is modifying it.
  *
  * References:
  * Andrew Binstock: Hashing Rehashed.
@@ -20,8 +42,178 @@
  *
  */
 #include <stdlib.h>
+#include <apex.h>
 #include <apex/hash.h>
 
+#define HASH_REHASH_STEP 4             /* old slots rehashed per operation */
+#define HASH_BATCH 32                  /* keys resolved together by find_many */
+
+#ifdef __GNUC__
+#define hash_prefetch(addr_) __builtin_prefetch(addr_)
+#else
+#define hash_prefetch(addr_)
+#endif /* __GNUC__ */
+
+/*
+ * hash_link_new() --Get a new hash entry, and initialise it.
+ *
+ * Returns: (HashLinkPtr)
+ * Success: the entry; Failure: NULL (malloc failure).
+ */
+static HashLinkPtr hash_link_new(HashLinkPtr next, unsigned long hash,
+                                 void *data)
+{
+    WideLinkPtr l = link_new_wide((LinkPtr) next, data);
+
+    if (l == NULL)
+    {
+        return NULL;                   /* failure: malloc */
+    }
+    l->extra = hash;
+    return (HashLinkPtr) l;            /* success */
+}
+
+/*
+ * hash_link_free() --Return a list of hash entries to the free-list.
+ */
+static void hash_link_free(HashLinkPtr head)
+{
+    link_free_wide((WideLinkPtr) head);
+}
+
+/*
+ * hash_slots() --Allocate an array of empty slots.
+ */
+static HashLinkPtr *hash_slots(size_t nslot)
+{
+    return (HashLinkPtr *) calloc(nslot, sizeof(HashLinkPtr));
+}
+
+/*
+ * hash_free_slots() --Free the entries of an array of slots.
+ */
+static void hash_free_slots(HashLinkPtr *slot, size_t start, size_t n_slot)
+{
+    for (size_t i = start; i < n_slot; ++i)
+    {                                  /* free up each list */
+        hash_link_free(slot[i]);
+    }
+}
+
+/*
+ * hash_slot_find() --Find the entry matching a key in a slot's list.
+ *
+ * Returns: (HashLinkPtr *)
+ * Success: the pointer referring to the entry; Failure: NULL.
+ */
+static HashLinkPtr *hash_slot_find(HashLinkPtr *slot, unsigned long key_hash,
+                                   CompareProc cmp, void *key)
+{
+    for (; *slot != NULL; slot = &(*slot)->next)
+    {
+        if ((*slot)->hash == key_hash && cmp((*slot)->data, key) == 0)
+        {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * hash_rehash() --Move some of the old slots' items into the new slots.
+ *
+ * Parameters:
+ * hash    --the hash table
+ * n_step --the maximum number of old slots to rehash
+ *
+ * Remarks:
+ * The entries themselves are moved, using their cached hash value,
+ * so this never allocates or calls the HashProc.
+ */
+static void hash_rehash(HashPtr hash, size_t n_step)
+{
+    if (hash->old_slot == NULL)
+    {
+        return;                        /* not resizing */
+    }
+    for (; n_step > 0 && hash->rehash_slot < hash->old_nslot; --n_step)
+    {
+        HashLinkPtr l = hash->old_slot[hash->rehash_slot];
+
+        while (l != NULL)
+        {
+            HashLinkPtr next = l->next;
+            size_t i = l->hash % hash->nslot;
+
+            l->next = hash->slot[i];
+            hash->slot[i] = l;
+            l = next;
+        }
+        hash->old_slot[hash->rehash_slot] = NULL;
+        hash->rehash_slot += 1;
+        hash->generation += 1;
+    }
+    if (hash->rehash_slot >= hash->old_nslot)
+    {                                  /* done: release the old slots */
+        free(hash->old_slot);
+        hash->old_slot = NULL;
+        hash->old_nslot = hash->rehash_slot = 0;
+    }
+}
+
+/*
+ * hash_grow() --Start resizing a hash table, if it's overloaded.
+ *
+ * Remarks:
+ * If the new slots can't be allocated, the table simply stays at
+ * its current size (and will try again on the next insert).
+ */
+static void hash_grow(HashPtr hash)
+{
+    size_t nslot = hash->nslot * 2;
+    HashLinkPtr *slot;
+
+    if (hash->max_load <= 0 || hash->old_slot != NULL ||
+        (double) hash->n_items <= hash->max_load * (double) hash->nslot)
+    {
+        return;                        /* fixed, busy, or not overloaded */
+    }
+    if ((slot = hash_slots(nslot)) != NULL)
+    {
+        hash->old_slot = hash->slot;
+        hash->old_nslot = hash->nslot;
+        hash->rehash_slot = 0;
+        hash->slot = slot;
+        hash->nslot = nslot;
+        hash->n_resize += 1;
+        hash->generation += 1;
+    }
+}
+
+/*
+ * hash_old_slot() --Find the old slot that may contain an item.
+ *
+ * Returns: (HashLinkPtr *)
+ * The old slot that may contain key, or NULL if it's in the new slots.
+ *
+ * Remarks:
+ * This returns the slot in the old array if the key's old slot hasn't
+ * been rehashed yet.
+ */
+static HashLinkPtr *hash_old_slot(HashPtr hash, unsigned long key_hash)
+{
+    if (hash->old_slot != NULL)
+    {
+        size_t i = key_hash % hash->old_nslot;
+
+        if (i >= hash->rehash_slot)
+        {
+            return &hash->old_slot[i];
+        }
+    }
+    return NULL;
+}
+
 /*
  * hash_new() --Create a new hash table.
  *
@@ -38,14 +230,15 @@ HashPtr hash_new(HashProc hash_proc, size_t nslot)
 
     if (nslot > 0)
     {
-        hash = (HashPtr) malloc(sizeof(Hash) + nslot * sizeof(LinkPtr));
+        hash = (HashPtr) calloc(1, sizeof(Hash));
         if (hash != NULL)
         {
             hash->hash = hash_proc;
             hash->nslot = nslot;
-            for (size_t i = 0; i < nslot; ++i)
-            {                          /* mark all slots as empty */
-                hash->slot[i] = NULL;
+            if ((hash->slot = hash_slots(nslot)) == NULL)
+            {                          /* failure: malloc */
+                free(hash);
+                hash = NULL;
             }
         }
     }
@@ -74,15 +267,13 @@ HashPtr hash_new(HashProc hash_proc, size_t nslot)
  */
 void hash_free(HashPtr hash)
 {
-    size_t n_slot = hash->nslot;
-
-    for (size_t i = 0; i < n_slot; ++i)
+    hash_free_slots(hash->slot, 0, hash->nslot);
+    if (hash->old_slot != NULL)
     {
-        if (hash->slot[i] != NULL)
-        {                              /* free up each list */
-            link_free_links(hash->slot[i]->next, hash->slot[i]);
-        }
+        hash_free_slots(hash->old_slot, hash->rehash_slot, hash->old_nslot);
+        free(hash->old_slot);
     }
+    free(hash->slot);
     free(hash);                        /* free the whole table */
 }
 
@@ -98,15 +289,21 @@ void hash_free(HashPtr hash)
  */
 bool hash_insert(HashPtr hash, void *data)
 {
-    size_t i = hash->hash(data) % hash->nslot;
-    LinkPtr tail = hash->slot[i];
-    LinkPtr l;
+    unsigned long data_hash;
+    size_t i;
+    HashLinkPtr l;
 
-    if ((l = link_new(tail, data)) == NULL)
+    hash_rehash(hash, HASH_REHASH_STEP);
+    data_hash = hash->hash(data);
+    i = data_hash % hash->nslot;
+    if ((l = hash_link_new(hash->slot[i], data_hash, data)) == NULL)
     {
         return false;                  /* failure: malloc */
     }
-    hash->slot[i] = clink_add(tail == NULL ? l : tail, l);
+    hash->slot[i] = l;
+    hash->n_items += 1;
+    hash->generation += 1;
+    hash_grow(hash);
     return true;                       /* success */
 }
 
@@ -123,19 +320,28 @@ bool hash_insert(HashPtr hash, void *data)
  */
 void *hash_remove(HashPtr hash, CompareProc cmp, void *key)
 {
-    size_t key_slot = hash->hash(key) % hash->nslot;
-    LinkPtr tail = hash->slot[key_slot];
+    unsigned long key_hash;
+    HashLinkPtr *slot[2];
 
-    if (tail != NULL)
+    hash_rehash(hash, HASH_REHASH_STEP);
+    key_hash = hash->hash(key);
+    slot[0] = &hash->slot[key_hash % hash->nslot];
+    slot[1] = hash_old_slot(hash, key_hash);
+
+    for (size_t i = 0; i < NEL(slot) && slot[i] != NULL; ++i)
     {
-        LinkPtr rlink;
+        HashLinkPtr *ref = hash_slot_find(slot[i], key_hash, cmp, key);
 
-        hash->slot[key_slot] = clink_remove(tail, cmp, key, &rlink);
-        if (rlink != NULL)
+        if (ref != NULL)
         {
-            void *value = rlink->data;
+            HashLinkPtr l = *ref;
+            void *value = l->data;
 
-            link_free(rlink);
+            *ref = l->next;            /* unlink */
+            l->next = NULL;
+            hash_link_free(l);
+            hash->n_items -= 1;
+            hash->generation += 1;
             return value;              /* success */
         }
     }
@@ -155,14 +361,83 @@ void *hash_remove(HashPtr hash, CompareProc cmp, void *key)
  */
 void *hash_find(HashPtr hash, CompareProc cmp, void *key)
 {
-    size_t key_slot = hash->hash(key) % hash->nslot;
-    LinkPtr tail = hash->slot[key_slot];
+    unsigned long key_hash;
+    HashLinkPtr *ref;
+    HashLinkPtr *old;
+
+    key_hash = hash->hash(key);
+    ref = hash_slot_find(&hash->slot[key_hash % hash->nslot],
+                         key_hash, cmp, key);
+    if (ref == NULL && (old = hash_old_slot(hash, key_hash)) != NULL)
+    {
+        ref = hash_slot_find(old, key_hash, cmp, key);
+    }
+    return ref != NULL ? (*ref)->data : NULL;
+}
+
+/*
+ * hash_find_many() --Find a batch of items in a hash table.
+ *
+ * Parameters:
+ * hash    --specifies the hash table
+ * cmp  --the comparison function used to match the items
+ * key  --an array of key values similar to the items sought
+ * n_key --the number of keys
+ * result --returns the item found for each key (or NULL)
+ *
+ * Returns: (size_t)
+ * The number of keys that were found.
+ *
+ * Remarks:
+ * This is equivalent to calling hash_find() for each key, but the
+ * work is staged: all the keys in a batch are hashed first, and their
+ * slots (and then the slots' first entries) are prefetched before any
+ * list is searched.  This lets the cache misses for the whole batch
+ * overlap, rather than paying for each one in turn.
+ */
+size_t hash_find_many(HashPtr hash, CompareProc cmp,
+                      void **key, size_t n_key, void **result)
+{
+    size_t n_found = 0;
 
-    if (tail != NULL)
+    for (size_t base = 0; base < n_key; base += HASH_BATCH)
     {
-        return clink_find(tail, cmp, key);
+        unsigned long key_hash[HASH_BATCH];
+        size_t n = MIN(n_key - base, (size_t) HASH_BATCH);
+
+        for (size_t i = 0; i < n; ++i)
+        {                              /* stage 1: hash, prefetch slot */
+            key_hash[i] = hash->hash(key[base + i]);
+            hash_prefetch(&hash->slot[key_hash[i] % hash->nslot]);
+        }
+        for (size_t i = 0; i < n; ++i)
+        {                              /* stage 2: prefetch first entry */
+            HashLinkPtr l = hash->slot[key_hash[i] % hash->nslot];
+
+            if (l != NULL)
+            {
+                hash_prefetch(l);
+            }
+        }
+        for (size_t i = 0; i < n; ++i)
+        {                              /* stage 3: resolve */
+            HashLinkPtr *ref, *old;
+
+            ref = hash_slot_find(&hash->slot[key_hash[i] % hash->nslot],
+                                 key_hash[i], cmp, key[base + i]);
+            if (ref == NULL
+                && (old = hash_old_slot(hash, key_hash[i])) != NULL)
+            {
+                ref = hash_slot_find(old, key_hash[i], cmp, key[base + i]);
+            }
+            if ((result[base + i] = ref != NULL ? (*ref)->data : NULL)
+                != NULL)
+            {
+                n_found += 1;
+            }
+        }
     }
-    return NULL;                       /* failure: empty slot */
+    return n_found;
 }
 
 /*
@@ -185,18 +460,205 @@ void *hash_find(HashPtr hash, CompareProc cmp, void *key)
  */
 void *hash_visit(HashPtr hash, VisitProc visit, void *user_data)
 {
-    size_t nslot = hash->nslot;
-
-    for (size_t i = 0; i < nslot; ++i)
-    {                                  /* for each slot... */
-        void *value;
-        LinkPtr tail = hash->slot[i];
+    HashLinkPtr *slot = hash->slot;
+    size_t start = 0, nslot = hash->nslot;
 
-        if (tail != NULL &&
-            (value = clink_visit(tail, visit, user_data)) != NULL)
-        {                              /* LinkVisit() wants us to stop */
-            return value;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (size_t i = start; i < nslot; ++i)
+        {                              /* for each slot... */
+            for (HashLinkPtr l = slot[i]; l != NULL; l = l->next)
+            {
+                if (visit(l->data, user_data) != NULL)
+                {                      /* visit() wants us to stop */
+                    return l->data;
+                }
+            }
+        }
+        if ((slot = hash->old_slot) == NULL)
+        {
+            break;
         }
+        start = hash->rehash_slot;     /* ...and each un-rehashed slot */
+        nslot = hash->old_nslot;
     }
     return NULL;
 }
+
+/*
+ * hash_set_growth() --Enable/disable automatic growth of a hash table.
+ *
+ * Parameters:
+ * hash    --specifies the hash table
+ * max_load --the load factor (items/slot) that triggers growth
+ *
+ * Remarks:
+ * A max_load of zero (the default) disables growth, and the table
+ * will stay at its initial size.  A value of 1.0 or so is a sensible
+ * choice for a chained table.
+ */
+void hash_set_growth(HashPtr hash, double max_load)
+{
+    hash->max_load = max_load > 0 ? max_load : 0;
+    hash_grow(hash);
+}
+
+/*
+ * hash_cursor_init() --Start a traversal of a hash table.
+ *
+ * Parameters:
+ * cursor --returns the initialised cursor
+ * hash    --specifies the hash table
+ *
+ * Remarks:
+ * Unlike hash_visit(), a cursor lets the caller step through the
+ * table in its own loop, stop, and resume later:
+ *
+ *     HashCursor c;
+ *     void *item;
+ *
+ *     hash_cursor_init(&c, h);
+ *     while ((item = hash_cursor_next(&c)) != NULL)
+ *     {
+ *         ...
+ *     }
+ */
+void hash_cursor_init(HashCursorPtr cursor, HashPtr hash)
+{
+    cursor->hash = hash;
+    cursor->generation = hash->generation;
+    cursor->pass = 0;
+    cursor->slot = 0;
+    cursor->n_link = 0;
+    cursor->link = hash->slot[0];
+}
+
+/*
+ * hash_cursor_next_() --Move a hash table traversal to the next item.
+ *
+ * Parameters:
+ * cursor --the cursor
+ *
+ * Returns: (void *)
+ * The next item; NULL if the traversal is complete.
+ *
+ * Remarks:
+ * This handles the "slow" cases of hash_cursor_next(): re-finding
+ * the cursor's position if the table has changed, and moving on to
+ * the next non-empty slot.
+ */
+void *hash_cursor_next_(HashCursorPtr cursor)
+{
+    HashPtr hash = cursor->hash;
+    HashLinkPtr l = cursor->link;
+
+    if (cursor->generation != hash->generation)
+    {                                  /* table changed: re-find position */
+        if (cursor->pass == 1 && hash->old_slot == NULL)
+        {
+            cursor->pass = 2;          /* rehash finished */
+        }
+        l = NULL;
+        if (cursor->pass < 2)
+        {
+            l = (cursor->pass == 0 ? hash->slot : hash->old_slot)[cursor->slot];
+            for (size_t i = 0; i < cursor->n_link && l != NULL; ++i)
+            {
+                l = l->next;
+            }
+        }
+        cursor->generation = hash->generation;
+    }
+    while (l == NULL && cursor->pass < 2)
+    {                                  /* advance to the next slot */
+        cursor->slot += 1;
+        cursor->n_link = 0;
+        if (cursor->pass == 0 && cursor->slot >= hash->nslot)
+        {
+            cursor->pass = hash->old_slot != NULL ? 1 : 2;
+            cursor->slot = hash->rehash_slot;
+            if (cursor->pass == 1 && cursor->slot < hash->old_nslot)
+            {
+                l = hash->old_slot[cursor->slot];
+            }
+            continue;
+        }
+        if (cursor->pass == 1 && cursor->slot >= hash->old_nslot)
+        {
+            cursor->pass = 2;
+            break;
+        }
+        l = (cursor->pass == 0 ? hash->slot : hash->old_slot)[cursor->slot];
+    }
+    if (l == NULL)
+    {
+        cursor->link = NULL;
+        return NULL;                   /* traversal complete */
+    }
+    cursor->link = l->next;
+    cursor->n_link += 1;
+    return l->data;
+}
+
+/*
+ * hash_stats() --Report the load factor and resize statistics.
+ *
+ * Parameters:
+ * hash    --specifies the hash table
+ * stats --returns the statistics
+ */
+void hash_stats(HashPtr hash, HashStatsPtr stats)
+{
+    stats->nslot = hash->nslot;
+    stats->n_items = hash->n_items;
+    stats->load = (double) hash->n_items / (double) hash->nslot;
+    stats->n_resize = hash->n_resize;
+    stats->rehashing = hash->old_slot != NULL;
+}
+
+/*
+ * hash_collect() --Report a hash table's statistics as metrics.
+ */
+static void hash_collect(MetricWriterPtr writer, void *data)
+{
+    HashStats stats;
+
+    hash_stats((HashPtr) data, &stats);
+    metric_write(writer, "apex_hash_items",
+                 "Items in the hash table.", METRIC_GAUGE, stats.n_items);
+    metric_write(writer, "apex_hash_slots",
+                 "Slots in the hash table.", METRIC_GAUGE, stats.nslot);
+    metric_write(writer, "apex_hash_load",
+                 "The hash table's load factor.", METRIC_GAUGE, stats.load);
+    metric_write(writer, "apex_hash_resizes_total",
+                 "Times the hash table has grown.", METRIC_COUNTER,
+                 stats.n_resize);
+}
+
+/*
+ * hash_metrics() --Register a hash table's statistics as metrics.
+ *
+ * Parameters:
+ * h    --the hash table
+ * name --the table's name, reported as the "hash" label
+ *
+ * Returns: (MetricPtr)
+ * Success: the collector (to be released by metric_free() before the
+ * table is); Failure: NULL.
+ *
+ * Remarks:
+ * The statistics are read without the table's owner's co-operation,
+ * so they're only approximately consistent with each other.
+ */
+MetricPtr hash_metrics(HashPtr h, const char *name)
+{
+    char labels[METRIC_NAME_MAX];
+
+    if (h == NULL)
+    {
+        return NULL;
+    }
+    return metric_collector_new(metric_label(labels, sizeof(labels),
+                                             "hash", name),
+                                hash_collect, h);
+}
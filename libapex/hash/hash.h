@@ -6,8 +6,10 @@
 #define HASH_H
 
 #include <stdbool.h>
+#include <pthread.h>
 
 #include <apex/clink.h>
+#include <apex/metrics.h>
 #ifdef __cplusplus
 extern "C"
 {
@@ -23,26 +25,191 @@ extern "C"
     typedef unsigned long (*HashProc)(char *data);
 
     /*
-     * Hash     --Fixed size hash table structure.
+     * HashLink --A hash table entry, on a slot's collision list.
+     *
+     * Fields:
+     * next --the next entry in this slot (or NULL)
+     * data --the user data
+     * hash --the full (unremaindered) hash value of data
+     *
+     * Remarks:
+     * The hash value is cached so that it can be checked before calling
+     * the (possibly expensive) CompareProc, and so that rehashing the
+     * table doesn't need to call the HashProc again.  A HashLink has
+     * the same layout as a WideLink, which is how it's allocated.
+     */
+    typedef struct HashLink_t
+    {
+        struct HashLink_t *next;
+        void *data;
+        unsigned long hash;
+    } HashLink, *HashLinkPtr;
+
+    /*
+     * Hash     --Chained hash table structure.
      *
      * Fields:
      * hash -- the hashing function used to spread items into the hash table slots.
      * nslot --the number of slots in the hash table
+     * n_items --the number of items stored in the hash table
+     * max_load --the load factor that triggers growth (0: fixed size)
+     * n_resize --the number of times the table has been resized
+     * old_nslot --the number of slots in the table being rehashed
+     * rehash_slot --the next slot of old_slot to be rehashed
+     * old_slot --the slots being rehashed into slot (or NULL)
      * slot --  an array of slots for holding user data
+     * generation --incremented whenever the table's links change
+     *
+     * Remarks:
+     * By default the table has a fixed number of slots.  If growth is
+     * enabled by hash_set_growth(), the table doubles its slots when
+     * the load factor exceeds max_load, and the items are moved to the
+     * new slots a few at a time by subsequent inserts and removes.
+     * Lookups never modify the table, so several threads may look up
+     * items at once, provided no thread is inserting or removing.
      */
     typedef struct Hash_t              /* Hash table housekeeping data */
     {                                  /* (this should prob. be private */
         HashProc hash;
         size_t nslot;
-        LinkPtr slot[];                /* collision handled by linked list */
+        size_t n_items;
+        double max_load;
+        size_t n_resize;
+        size_t old_nslot;
+        size_t rehash_slot;
+        HashLinkPtr *old_slot;
+        HashLinkPtr *slot;             /* collision handled by linked list */
+        unsigned long generation;
     } Hash, *HashPtr;
 
+    /*
+     * HashCursor --The state of an iteration over a hash table.
+     *
+     * Fields:
+     * hash --the hash table being traversed
+     * generation --the table's generation when link was saved
+     * pass --0: slot, 1: old_slot (if rehashing), 2: finished
+     * slot --the index of the current slot
+     * n_link --the number of items already returned from this slot
+     * link --the next link in the current slot (NULL: next slot)
+     *
+     * Remarks:
+     * A cursor holds no resources, so it can simply be discarded.
+     * The table may be modified between steps: the cursor will detect
+     * this and re-position itself by slot/count, rather than follow
+     * a (possibly freed) link.  Items inserted or moved by rehashing
+     * during the traversal may be missed or returned twice.
+     */
+    typedef struct HashCursor_t
+    {
+        HashPtr hash;
+        unsigned long generation;
+        int pass;
+        size_t slot;
+        size_t n_link;
+        HashLinkPtr link;
+    } HashCursor, *HashCursorPtr;
+
+    /*
+     * HashStats --Hash table statistics, for monitoring.
+     *
+     * Fields:
+     * nslot --the number of slots in the hash table
+     * n_items --the number of items stored in the hash table
+     * load --the current load factor (n_items/nslot)
+     * n_resize --the number of times the table has been resized
+     * rehashing --true if the table is part-way through a resize
+     */
+    typedef struct HashStats_t
+    {
+        size_t nslot;
+        size_t n_items;
+        double load;
+        size_t n_resize;
+        bool rehashing;
+    } HashStats, *HashStatsPtr;
+
+    /*
+     * CHash    --Concurrent (lock-striped) hash table structure.
+     *
+     * Fields:
+     * hash -- the hashing function used to spread items into the hash table slots.
+     * stripe_bits --log2 of the number of stripes
+     * n_stripe --the number of stripes
+     * stripe --an array of independently locked hash tables
+     */
+    typedef struct CHashStripe_t
+    {
+        pthread_mutex_t lock;
+        HashPtr hash;
+    } CHashStripe, *CHashStripePtr;
+
+    typedef struct CHash_t
+    {
+        HashProc hash;
+        int stripe_bits;
+        size_t n_stripe;
+        CHashStripePtr stripe;
+    } CHash, *CHashPtr;
+
+    /*
+     * OHashSlot --A slot in an open-addressing hash table.
+     *
+     * Fields:
+     * hash --the full (unremaindered) hash value of data
+     * data --the user data stored in this slot, or NULL if it is empty
+     */
+    typedef struct OHashSlot_t
+    {
+        unsigned long hash;
+        void *data;
+    } OHashSlot, *OHashSlotPtr;
+
+    /*
+     * OHash    --Open-addressing (linear probing) hash table structure.
+     *
+     * Fields:
+     * hash --the hashing function used to spread items into the hash table slots.
+     * nslot --the number of slots in the hash table (a power of 2)
+     * n_items --the number of items stored in the hash table
+     * slot --  an array of slots for holding user data (and its hash)
+     */
+    typedef struct OHash_t
+    {
+        HashProc hash;
+        size_t nslot;
+        size_t n_items;
+        OHashSlotPtr slot;             /* collision handled by probing */
+    } OHash, *OHashPtr;
+
     HashPtr hash_new(HashProc hash, size_t nslot);
     void hash_free(HashPtr h);
     bool hash_insert(HashPtr h, void *data);
     void *hash_remove(HashPtr h, CompareProc cmp, void *key);
     void *hash_find(HashPtr h, CompareProc cmp, void *key);
+    size_t hash_find_many(HashPtr h, CompareProc cmp,
+                          void **key, size_t n_key, void **result);
     void *hash_visit(HashPtr h, VisitProc visit, void *user_data);
+    void hash_set_growth(HashPtr h, double max_load);
+    void hash_cursor_init(HashCursorPtr cursor, HashPtr h);
+    void *hash_cursor_next_(HashCursorPtr cursor);
+    void hash_stats(HashPtr h, HashStatsPtr stats);
+    MetricPtr hash_metrics(HashPtr h, const char *name);
+
+    CHashPtr chash_new(HashProc hash, size_t nslot, size_t n_stripe);
+    void chash_free(CHashPtr h);
+    bool chash_insert(CHashPtr h, void *data);
+    void *chash_remove(CHashPtr h, CompareProc cmp, void *key);
+    void *chash_find(CHashPtr h, CompareProc cmp, void *key);
+    void *chash_visit(CHashPtr h, VisitProc visit, void *user_data);
+    void chash_set_growth(CHashPtr h, double max_load);
+
+    OHashPtr ohash_new(HashProc hash, size_t nslot);
+    void ohash_free(OHashPtr h);
+    bool ohash_insert(OHashPtr h, void *data);
+    void *ohash_remove(OHashPtr h, CompareProc cmp, void *key);
+    void *ohash_find(OHashPtr h, CompareProc cmp, void *key);
+    void *ohash_visit(OHashPtr h, VisitProc visit, void *user_data);
 
     unsigned long hash_key_pjw(char *data);
     unsigned long hash_keyn_pjw(char *data, size_t n);
@@ -50,7 +217,41 @@ extern "C"
     unsigned long hash_keyn_elf(char *data, size_t n);
     unsigned long hash_key_jenkins(char *data);
     unsigned long hash_keyn_jenkins(char *data, size_t n);
+    unsigned long hash_key_wy(char *data);
+    unsigned long hash_keyn_wy(char *data, size_t n);
+    unsigned long hash_keyn_wy_seed(char *data, size_t n, unsigned long seed);
+
+    void hash_set_seed(unsigned long seed);
+    unsigned long hash_key_seeded(char *data);
+    unsigned long hash_keyn_seeded(char *data, size_t n);
+
+
+    /*
+     * hash_cursor_next() --Return the next item of a hash table traversal.
+     *
+     * Parameters:
+     * cursor --the cursor, initialised by hash_cursor_init()
+     *
+     * Returns: (void *)
+     * The next item; NULL if the traversal is complete.
+     *
+     * Remarks:
+     * The common case of stepping along a slot's list is inline;
+     * moving between slots is done by hash_cursor_next_().
+     */
+    static inline void *hash_cursor_next(HashCursorPtr cursor);
+    static inline void *hash_cursor_next(HashCursorPtr cursor)
+    {
+        HashLinkPtr l = cursor->link;
 
+        if (l != NULL && cursor->generation == cursor->hash->generation)
+        {
+            cursor->link = l->next;
+            cursor->n_link += 1;
+            return l->data;
+        }
+        return hash_cursor_next_(cursor);
+    }
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
@@ -0,0 +1,42 @@
+/*
+ * key-wy.c --NUL-terminated entry points for the wyhash functions.
+ */
+#include <string.h>
+#include <apex/hash.h>
+
+/*
+ * hash_key_wy() --Wang Yi's wyhash (unseeded).
+ *
+ * Parameters:
+ * data --the (NUL-terminated) data to be hashed
+ *
+ * Returns: (unsigned long)
+ * The hash value.
+ *
+ * Remarks:
+ * The string length is found first (strlen() is itself word-at-a-time),
+ * so the hash can consume the data in whole words.
+ *
+ * See Also:
+ * https://github.com/wangyi-fudan/wyhash
+ */
+unsigned long hash_key_wy(char *data)
+{
+    return hash_keyn_wy(data, strlen(data));
+}
+
+/*
+ * hash_key_seeded() --wyhash, with the process-wide seed.
+ *
+ * Parameters:
+ * data --the (NUL-terminated) data to be hashed
+ *
+ * Returns: (unsigned long)
+ * The hash value.
+ *
+ * See Also: hash_set_seed()
+ */
+unsigned long hash_key_seeded(char *data)
+{
+    return hash_keyn_seeded(data, strlen(data));
+}
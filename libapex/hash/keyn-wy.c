@@ -0,0 +1,203 @@
+/*
+ * keyn-wy.c --An implementation of Wang Yi's "wyhash" hashing algorithm.
+ *
+ * Contents:
+ * hash_keyn_wy_seed() --Wang Yi's wyhash, with an explicit seed.
+ * hash_keyn_wy()      --Wang Yi's wyhash (unseeded).
+ * hash_set_seed()     --Set the seed used by the "seeded" hash functions.
+ * hash_keyn_seeded()  --wyhash, with the process-wide seed.
+ *
+ * Remarks:
+ * Unlike the PJW, ELF and Jenkins hashes, wyhash consumes its input
+ * 8 or 16 bytes at a time, mixing with a 64x64->128 bit multiply.  It
+ * is considerably faster for keys longer than a few bytes, and has
+ * much better distribution.
+ *
+ * The input words are read in native byte order, so the hash values
+ * differ between little- and big-endian hosts.
+ *
+ * The "seeded" variants use a process-wide seed (see hash_set_seed());
+ * if the seed is chosen randomly at startup, an attacker cannot easily
+ * construct a set of keys that all collide (i.e. "hash flooding").
+ *
+ * See Also:
+ * https://github.com/wangyi-fudan/wyhash
+ */
+#include <stdint.h>
+#include <string.h>
+#include <apex/hash.h>
+
+static const uint64_t wy_secret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static unsigned long hash_seed;
+
+/*
+ * wy_mum() --Multiply two 64 bit values, returning the 128 bit result.
+ */
+static inline void wy_mum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t) *a * *b;
+
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t) *a, lb = (uint32_t) *b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif /* __SIZEOF_INT128__ */
+}
+
+/*
+ * wy_mix() --Multiply two 64 bit values, and fold the result.
+ */
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    wy_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wy_r8(const uint8_t * p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t wy_r4(const uint8_t * p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t wy_r3(const uint8_t * p, size_t k)
+{
+    return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+/*
+ * hash_keyn_wy_seed() --Wang Yi's wyhash, with an explicit seed.
+ *
+ * Parameters:
+ * data --the data to be hashed
+ * n    --the number of bytes of data
+ * seed --the seed value
+ *
+ * Returns: (unsigned long)
+ * The hash value.
+ */
+unsigned long hash_keyn_wy_seed(char *data, size_t n, unsigned long seed)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    uint64_t s = seed;
+    uint64_t a, b;
+
+    s ^= wy_mix(s ^ wy_secret[0], wy_secret[1]);
+    if (n <= 16)
+    {
+        if (n >= 4)
+        {
+            a = (wy_r4(p) << 32) | wy_r4(p + ((n >> 3) << 2));
+            b = (wy_r4(p + n - 4) << 32) | wy_r4(p + n - 4 - ((n >> 3) << 2));
+        }
+        else if (n > 0)
+        {
+            a = wy_r3(p, n);
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = n;
+
+        if (i > 48)
+        {                              /* three independent lanes */
+            uint64_t s1 = s, s2 = s;
+
+            do
+            {
+                s = wy_mix(wy_r8(p) ^ wy_secret[1], wy_r8(p + 8) ^ s);
+                s1 = wy_mix(wy_r8(p + 16) ^ wy_secret[2], wy_r8(p + 24) ^ s1);
+                s2 = wy_mix(wy_r8(p + 32) ^ wy_secret[3], wy_r8(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            s ^= s1 ^ s2;
+        }
+        while (i > 16)
+        {
+            s = wy_mix(wy_r8(p) ^ wy_secret[1], wy_r8(p + 8) ^ s);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_r8(p + i - 16);
+        b = wy_r8(p + i - 8);
+    }
+    a ^= wy_secret[1];
+    b ^= s;
+    wy_mum(&a, &b);
+    return (unsigned long) wy_mix(a ^ wy_secret[0] ^ n, b ^ wy_secret[1]);
+}
+
+/*
+ * hash_keyn_wy() --Wang Yi's wyhash (unseeded).
+ *
+ * Parameters:
+ * data --the data to be hashed
+ * n    --the number of bytes of data
+ *
+ * Returns: (unsigned long)
+ * The hash value.
+ */
+unsigned long hash_keyn_wy(char *data, size_t n)
+{
+    return hash_keyn_wy_seed(data, n, 0);
+}
+
+/*
+ * hash_set_seed() --Set the seed used by the "seeded" hash functions.
+ *
+ * Parameters:
+ * seed --the new seed value
+ *
+ * Remarks:
+ * This should be called (with some random value) before any hash
+ * tables using the seeded functions are populated; changing the seed
+ * invalidates any hash values already computed.
+ */
+void hash_set_seed(unsigned long seed)
+{
+    hash_seed = seed;
+}
+
+/*
+ * hash_keyn_seeded() --wyhash, with the process-wide seed.
+ *
+ * Parameters:
+ * data --the data to be hashed
+ * n    --the number of bytes of data
+ *
+ * Returns: (unsigned long)
+ * The hash value.
+ */
+unsigned long hash_keyn_seeded(char *data, size_t n)
+{
+    return hash_keyn_wy_seed(data, n, hash_seed);
+}
@@ -0,0 +1,284 @@
+/*
+ * OHASH.C --An open-addressing hash table implementation.
+ *
+ * Contents:
+ * ohash_new()    --Create a new open-addressing hash table.
+ * ohash_free()   --Free a hash table, releasing all resources.
+ * ohash_insert() --Insert an item into a hash table.
+ * ohash_remove() --Remove an item from a hash table.
+ * ohash_find()   --Find a particular item in a hash table.
+ * ohash_visit()  --Visit all the items in a hash table.
+ *
+ * Remarks:
+ * This hash table stores user data directly in an array of slots,
+ * together with the full hash value of the data.  Collisions are
+ * resolved by linear probing, so a lookup scans a contiguous run of
+ * slots rather than chasing list pointers, and the cached hash value
+ * means the CompareProc is only called for likely matches.
+ *
+ * The number of slots is always a power of 2, and the table doubles
+ * in size when it becomes more than 3/4 full.  Removal uses
+ * "backward shift" deletion, so there are no tombstones and lookups
+ * stay short even after many removals.
+ *
+ * Because an empty slot is marked by NULL data, NULL cannot be
+ * stored in the table (which is consistent with ohash_find()
+ * returning NULL on failure).
+ *
+ * See Also:
+ * Knuth, The Art of Computer Programming Vol. 3, Section 6.4, Algorithm R
+ */
+#include <stdlib.h>
+#include <apex/hash.h>
+
+#define OHASH_MIN_SLOT 8
+
+/*
+ * ohash_slots() --Allocate an array of empty slots.
+ */
+static OHashSlotPtr ohash_slots(size_t nslot)
+{
+    return (OHashSlotPtr) calloc(nslot, sizeof(OHashSlot));
+}
+
+/*
+ * ohash_place() --Place some data in the first free slot of its probe sequence.
+ */
+static void ohash_place(OHashSlotPtr slot, size_t nslot,
+                        unsigned long hash, void *data)
+{
+    size_t mask = nslot - 1;
+    size_t i = hash & mask;
+
+    while (slot[i].data != NULL)
+    {
+        i = (i + 1) & mask;
+    }
+    slot[i].hash = hash;
+    slot[i].data = data;
+}
+
+/*
+ * ohash_grow() --Double the number of slots in a hash table.
+ *
+ * Returns: (bool)
+ * Success: true; Failure: false.
+ */
+static bool ohash_grow(OHashPtr hash)
+{
+    size_t nslot = hash->nslot * 2;
+    OHashSlotPtr slot = ohash_slots(nslot);
+
+    if (slot == NULL)
+    {
+        return false;                  /* failure: malloc */
+    }
+    for (size_t i = 0; i < hash->nslot; ++i)
+    {
+        if (hash->slot[i].data != NULL)
+        {                              /* rehash from cached value */
+            ohash_place(slot, nslot, hash->slot[i].hash, hash->slot[i].data);
+        }
+    }
+    free(hash->slot);
+    hash->slot = slot;
+    hash->nslot = nslot;
+    return true;
+}
+
+/*
+ * ohash_lookup() --Find the slot index of a particular item.
+ *
+ * Returns: (long)
+ * Success: the slot index; Failure: -1.
+ */
+static long ohash_lookup(OHashPtr hash, CompareProc cmp, void *key)
+{
+    unsigned long key_hash = hash->hash(key);
+    size_t mask = hash->nslot - 1;
+    size_t i = key_hash & mask;
+    OHashSlotPtr slot = hash->slot;
+
+    for (; slot[i].data != NULL; i = (i + 1) & mask)
+    {
+        if (slot[i].hash == key_hash && cmp(slot[i].data, key) == 0)
+        {
+            return (long) i;           /* success */
+        }
+    }
+    return -1;                         /* failure: not found */
+}
+
+/*
+ * ohash_new() --Create a new open-addressing hash table.
+ *
+ * Parameters:
+ * hash_proc --the hash function, used to allocate items to slots
+ * nslot    -- the initial number of slots (rounded up to a power of 2)
+ *
+ * Returns: (OHashPtr)
+ * Success: the hash table; Failure: NULL.
+ */
+OHashPtr ohash_new(HashProc hash_proc, size_t nslot)
+{
+    OHashPtr hash = NULL;
+
+    if (nslot > 0)
+    {
+        size_t n = OHASH_MIN_SLOT;
+
+        while (n < nslot)
+        {
+            n *= 2;
+        }
+        if ((hash = (OHashPtr) malloc(sizeof(OHash))) != NULL)
+        {
+            hash->hash = hash_proc;
+            hash->nslot = n;
+            hash->n_items = 0;
+            if ((hash->slot = ohash_slots(n)) == NULL)
+            {
+                free(hash);
+                hash = NULL;           /* failure: malloc */
+            }
+        }
+    }
+    return hash;
+}
+
+/*
+ * ohash_free() --Free a hash table, releasing all resources.
+ *
+ * Parameters:
+ * hash    --the hash table to free
+ *
+ * Remarks:
+ * As with hash_free(), it is the caller's responsibility to free any
+ * resources associated with the data stored in the hash table itself.
+ */
+void ohash_free(OHashPtr hash)
+{
+    free(hash->slot);
+    free(hash);
+}
+
+/*
+ * ohash_insert() --Insert an item into a hash table.
+ *
+ * Parameters:
+ * hash    --the hash table
+ * data --the data to insert
+ *
+ * Returns: (bool)
+ * Success: true; Failure: false.
+ *
+ * Remarks:
+ * Like hash_insert(), this doesn't check for duplicate items.
+ */
+bool ohash_insert(OHashPtr hash, void *data)
+{
+    if (data == NULL)
+    {
+        return false;                  /* failure: can't store NULL */
+    }
+    if ((hash->n_items + 1) * 4 > hash->nslot * 3 && !ohash_grow(hash))
+    {
+        return false;                  /* failure: malloc */
+    }
+    ohash_place(hash->slot, hash->nslot, hash->hash(data), data);
+    hash->n_items += 1;
+    return true;                       /* success */
+}
+
+/*
+ * ohash_remove() --Remove an item from a hash table.
+ *
+ * Parameters:
+ * hash    --the hash table
+ * cmp  --the comparison function to find the item
+ * key  --a key describing the item to be removed
+ *
+ * Returns: (void *)
+ * Success: the removed item; Failure: NULL.
+ *
+ * Remarks:
+ * The items following the removed slot in its probe run are shifted
+ * back as far as their home slot allows, which keeps the run unbroken.
+ */
+void *ohash_remove(OHashPtr hash, CompareProc cmp, void *key)
+{
+    long found = ohash_lookup(hash, cmp, key);
+    size_t mask = hash->nslot - 1;
+    OHashSlotPtr slot = hash->slot;
+    void *value;
+    size_t hole, i;
+
+    if (found < 0)
+    {
+        return NULL;                   /* failure: not found */
+    }
+    hole = (size_t) found;
+    value = slot[hole].data;
+    for (i = (hole + 1) & mask; slot[i].data != NULL; i = (i + 1) & mask)
+    {
+        size_t home = slot[i].hash & mask;
+
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {                              /* home is at/before hole: move it */
+            slot[hole] = slot[i];
+            hole = i;
+        }
+    }
+    slot[hole].data = NULL;
+    hash->n_items -= 1;
+    return value;                      /* success */
+}
+
+/*
+ * ohash_find() --Find a particular item in a hash table.
+ *
+ * Parameters:
+ * hash    --specifies the hash table
+ * cmp  --the comparison function used to match the item
+ * key  --the key value similar to the item sought
+ *
+ * Returns: (void *)
+ * Success: the item; Failure: NULL.
+ */
+void *ohash_find(OHashPtr hash, CompareProc cmp, void *key)
+{
+    long i = ohash_lookup(hash, cmp, key);
+
+    return i < 0 ? NULL : hash->slot[i].data;
+}
+
+/*
+ * ohash_visit() --Visit all the items in a hash table.
+ *
+ * Parameters:
+ * hash    --specifies the hash table
+ * visit    --the visit function to call on every item
+ * user_data  --miscellaneous data to call visit with.
+ *
+ * Returns: (void *)
+ * The item "selected" by visit(), or NULL.
+ *
+ * Remarks:
+ * Items are visited in slot order, which is not particularly useful.
+ * The visit function must not insert or remove items.
+ */
+void *ohash_visit(OHashPtr hash, VisitProc visit, void *user_data)
+{
+    size_t nslot = hash->nslot;
+
+    for (size_t i = 0; i < nslot; ++i)
+    {
+        void *data = hash->slot[i].data;
+
+        if (data != NULL && visit(data, user_data) != NULL)
+        {
+            return data;
+        }
+    }
+    return NULL;
+}
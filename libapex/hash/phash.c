@@ -0,0 +1,697 @@
+/*
+ * PHASH.C --A persistent (file-backed) hash table.
+ *
+ * Contents:
+ * preallocate()   --Extend a file's allocated (and visible) size.
+ * entry_value()   --Return an entry's value (after its padded key).
+ * commit_check()  --Calculate a commit's check value.
+ * entry_check()   --Calculate an entry's check value.
+ * entry_at()      --Return the (valid-looking) entry at some offset.
+ * current_commit() --Return the index of a table's current commit.
+ * commit()        --Write the next commit, and sync the header.
+ * find()          --Find the link to a key's (live) entry.
+ * apply()         --Update the slots (and counts) for a new log entry.
+ * grow()          --Extend a table's file (and mapping) to fit n more bytes.
+ * append()        --Append an entry to the log, and apply it.
+ * rebuild()       --Rebuild the slots by replaying the log.
+ * map()           --Map a table's (open) file.
+ * unmap()         --Release a table's mapping and file.
+ * phash_create()  --Create (or truncate) a table file, and open it.
+ * phash_open()    --Open an existing table file.
+ * phash_close()   --Commit and unmap a table.
+ * phash_sync()    --Flush a table to disk, and commit its state.
+ * phash_put()     --Set a key's value.
+ * phash_get()     --Find a key's value.
+ * phash_remove()  --Remove a key.
+ *
+ * Remarks:
+ * The file is a header page, the slots (fixed when the table is
+ * created), and a log of entries that's only ever appended to: a
+ * put appends the new value, and a remove appends a tombstone.  The
+ * slots index the log, each chaining (by offset) the live entries
+ * that hash to it.  Replaced values and tombstones are garbage:
+ * they stay in the log, but aren't linked.
+ *
+ * A writer marks the table dirty (in a new commit) when it opens it,
+ * and clean when it closes it.  Opening a clean table costs only a
+ * check of its header; a dirty one was abandoned (by a crash), so
+ * its slots may be half-updated, and open rebuilds them by replaying
+ * the log up to the first torn (or missing) entry.  That recovers
+ * everything written before a process crash, and everything before
+ * the last phash_sync() if the machine crashed.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <apex/hash.h>
+#include <apex/phash.h>
+
+#define PHASH_MAGIC "APEXPHT"          /* (with the NUL: 8 bytes) */
+#define PHASH_ORDER 0x01020304         /* reads differently if swapped */
+
+enum
+{
+    HEADER_SIZE = 4096,                /* the slots start on a new page */
+    MIN_SIZE = 64 * 1024
+};
+
+#define ALIGN8(n_) (((n_) + 7) & ~(uint64_t) 7)
+#define ENTRY_SIZE(key_len_, value_len_) \
+    ALIGN8(sizeof(PHashEntry) + ALIGN8(key_len_) + (value_len_))
+
+/*
+ * entry_value() --Return an entry's value (after its padded key).
+ */
+static char *entry_value(const PHashEntry * e)
+{
+    return (char *) (e + 1) + ALIGN8(e->key_len);
+}
+
+/*
+ * preallocate() --Extend a file's allocated (and visible) size.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int preallocate(int fd, off_t offset, off_t len)
+{
+    int status = posix_fallocate(fd, offset, len);
+
+    if (status == EINVAL || status == EOPNOTSUPP)
+    {                                  /* (e.g. tmpfs, or NFS) */
+        status = ftruncate(fd, offset + len) == 0 ? 0 : errno;
+    }
+    errno = status;
+    return status == 0;
+}
+
+/*
+ * commit_check() --Calculate a commit's check value.
+ */
+static uint32_t commit_check(const PHashCommit * c)
+{
+    return (uint32_t) hash_keyn_wy((char *) c, offsetof(PHashCommit, check));
+}
+
+/*
+ * entry_check() --Calculate an entry's check value.
+ *
+ * Remarks:
+ * This covers the entry's fields (except its link, which changes)
+ * and its key and value.
+ */
+static uint32_t entry_check(const PHashEntry * e)
+{
+    unsigned long seed = hash_keyn_wy((char *) &e->hash,
+                                      offsetof(PHashEntry, check)
+                                      - offsetof(PHashEntry, hash));
+
+    seed = hash_keyn_wy_seed((char *) (e + 1), e->key_len, seed);
+    return (uint32_t) hash_keyn_wy_seed(entry_value(e), e->value_len, seed);
+}
+
+/*
+ * entry_at() --Return the (valid-looking) entry at some offset.
+ *
+ * Remarks:
+ * This checks that the entry fits within limit, but not its check
+ * value (which is only needed when replaying the log).
+ *
+ * Returns: (PHashEntryPtr)
+ * Success: the entry; Failure: NULL.
+ */
+static PHashEntryPtr entry_at(PHashPtr h, uint64_t offset, uint64_t limit)
+{
+    PHashEntryPtr e;
+
+    if (offset < h->header->log || offset + sizeof(*e) > limit)
+    {
+        return NULL;
+    }
+    e = (PHashEntryPtr) (h->base + offset);
+    if ((e->type != PHASH_PUT && e->type != PHASH_DEL)
+        || offset + ENTRY_SIZE(e->key_len, e->value_len) > limit)
+    {
+        return NULL;
+    }
+    return e;
+}
+
+/*
+ * current_commit() --Return the index of a table's current commit.
+ *
+ * Returns: (int)
+ * Success: 0 or 1; Failure: -1 (neither commit is valid).
+ */
+static int current_commit(const PHashHeader * header)
+{
+    int current = -1;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        const PHashCommit *c = &header->commit[i];
+
+        if (c->generation != 0 && c->check == commit_check(c)
+            && (current < 0
+                || c->generation > header->commit[current].generation))
+        {
+            current = i;
+        }
+    }
+    return current;
+}
+
+/*
+ * commit() --Write the next commit, and sync the header.
+ *
+ * Remarks:
+ * The next commit overwrites the older of the two, so the current
+ * one survives a crash part-way through.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int commit(PHashPtr h, uint32_t state)
+{
+    PHashHeaderPtr header = h->header;
+    int current = current_commit(header);
+    uint64_t generation =
+        current < 0 ? 1 : header->commit[current].generation + 1;
+    PHashCommitPtr c = &header->commit[current == 0 ? 1 : 0];
+
+    c->generation = generation;
+    c->used = header->used;
+    c->n_items = header->n_items;
+    c->state = state;
+    c->check = commit_check(c);
+    return msync(h->base, HEADER_SIZE, MS_SYNC) == 0;
+}
+
+/*
+ * find() --Find the link to a key's (live) entry.
+ *
+ * Returns: (uint64_t *)
+ * Success: the link (slot or next field) to the entry; Failure: NULL.
+ *
+ * Remarks:
+ * The header is shared with any writer, which may have grown the
+ * file (and the log) beyond this process's mapping, so entries are
+ * bounded by the mapping too.
+ */
+static uint64_t *find(PHashPtr h, uint64_t hash, const void *key,
+                      size_t key_len)
+{
+    uint64_t *link = &h->slot[hash & (h->header->nslot - 1)];
+    uint64_t limit = MIN(h->header->used, (uint64_t) h->size);
+    PHashEntryPtr e;
+
+    while ((e = entry_at(h, *link, limit)) != NULL)
+    {
+        if (e->hash == hash && e->key_len == key_len
+            && memcmp(e + 1, key, key_len) == 0)
+        {
+            return link;
+        }
+        link = &e->next;
+    }
+    return NULL;
+}
+
+/*
+ * apply() --Update the slots (and counts) for a new log entry.
+ *
+ * Remarks:
+ * A put replaces (and unlinks) any older value; a remove just
+ * unlinks it.
+ */
+static void apply(PHashPtr h, uint64_t offset)
+{
+    PHashHeaderPtr header = h->header;
+    PHashEntryPtr e = (PHashEntryPtr) (h->base + offset);
+    uint64_t *link = find(h, e->hash, e + 1, e->key_len);
+
+    if (link != NULL)
+    {                                  /* unlink the old value */
+        PHashEntryPtr old = (PHashEntryPtr) (h->base + *link);
+
+        *link = old->next;
+        header->n_garbage += 1;
+        header->n_items -= 1;
+    }
+    if (e->type == PHASH_PUT)
+    {
+        uint64_t *slot = &h->slot[e->hash & (header->nslot - 1)];
+
+        e->next = *slot;
+        *slot = offset;
+        header->n_items += 1;
+    }
+    else
+    {
+        header->n_garbage += 1;        /* (tombstones are never linked) */
+    }
+}
+
+/*
+ * grow() --Extend a table's file (and mapping) to fit n more bytes.
+ *
+ * Remarks:
+ * All the links are offsets, so the mapping can move.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int grow(PHashPtr h, size_t n)
+{
+    size_t size = h->size;
+    void *base;
+
+    while (size < h->header->used + n)
+    {
+        size *= 2;
+    }
+    if (!preallocate(h->fd, (off_t) h->size, (off_t) (size - h->size)))
+    {
+        return 0;
+    }
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, h->fd, 0);
+    if (base == MAP_FAILED)
+    {
+        return 0;
+    }
+    munmap(h->base, h->size);
+    h->base = base;
+    h->size = size;
+    h->header = base;
+    h->slot = (uint64_t *) (h->base + HEADER_SIZE);
+    return 1;
+}
+
+/*
+ * append() --Append an entry to the log, and apply it.
+ *
+ * Remarks:
+ * The entry (and its check) is complete before the log's end moves
+ * past it, and linked only after that.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int append(PHashPtr h, uint32_t type, uint64_t hash,
+                  const void *key, size_t key_len,
+                  const void *value, size_t value_len)
+{
+    uint64_t size = ENTRY_SIZE(key_len, value_len);
+    uint64_t offset;
+    PHashEntryPtr e;
+
+    if (h->header->used + size > h->size && !grow(h, size))
+    {
+        return 0;
+    }
+    offset = h->header->used;
+    e = (PHashEntryPtr) (h->base + offset);
+    e->next = 0;
+    e->hash = hash;
+    e->key_len = (uint32_t) key_len;
+    e->value_len = (uint32_t) value_len;
+    e->type = type;
+    memcpy(e + 1, key, key_len);
+    if (value_len > 0)
+    {
+        memcpy(entry_value(e), value, value_len);
+    }
+    e->check = entry_check(e);
+    h->header->used = offset + size;
+    apply(h, offset);
+    return 1;
+}
+
+/*
+ * rebuild() --Rebuild the slots by replaying the log.
+ *
+ * Remarks:
+ * The replay stops at the first entry that's torn (or was never
+ * written), which becomes the end of the log; anything past that
+ * is cleared, so a later crash can't resurrect it.
+ */
+static void rebuild(PHashPtr h)
+{
+    PHashHeaderPtr header = h->header;
+    uint64_t offset = header->log;
+    PHashEntryPtr e;
+
+    memset(h->slot, 0, header->nslot * sizeof(*h->slot));
+    header->used = offset;
+    header->n_items = 0;
+    header->n_garbage = 0;
+    while ((e = entry_at(h, offset, h->size)) != NULL
+           && e->check == entry_check(e))
+    {
+        uint64_t size = ENTRY_SIZE(e->key_len, e->value_len);
+
+        header->used = offset + size;
+        apply(h, offset);
+        offset += size;
+    }
+    memset(h->base + header->used, 0, h->size - header->used);
+    h->recovered = 1;
+}
+
+/*
+ * map() --Map a table's (open) file.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+static int map(PHashPtr h, size_t size)
+{
+    int prot = (h->flags & PHASH_RDONLY) ? PROT_READ : PROT_READ | PROT_WRITE;
+    void *base = mmap(NULL, size, prot, MAP_SHARED, h->fd, 0);
+
+    if (base == MAP_FAILED)
+    {
+        return 0;
+    }
+    h->base = base;
+    h->size = size;
+    h->header = base;
+    h->slot = (uint64_t *) (h->base + HEADER_SIZE);
+    return 1;
+}
+
+/*
+ * unmap() --Release a table's mapping and file.
+ */
+static void unmap(PHashPtr h)
+{
+    if (h->base != NULL)
+    {
+        munmap(h->base, h->size);
+    }
+    if (h->fd >= 0)
+    {
+        close(h->fd);
+    }
+    h->base = NULL;
+    h->header = NULL;
+    h->slot = NULL;
+    h->size = 0;
+    h->fd = -1;
+}
+
+/*
+ * phash_create() --Create (or truncate) a table file, and open it.
+ *
+ * Parameters:
+ * h    --returns the table (owned by caller)
+ * path --the name of the table file
+ * nslot --the No. of slots (rounded up to a power of 2)
+ * size --the file's initial size (it grows as needed)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+int phash_create(PHashPtr h, const char *path, size_t nslot, size_t size)
+{
+    uint64_t log;
+    size_t n = 1;
+
+    if (h == NULL || path == NULL)
+    {
+        errno = EINVAL;
+        return 0;                      /* error: no table/path! */
+    }
+    while (n < nslot)
+    {
+        n *= 2;
+    }
+    log = HEADER_SIZE + n * sizeof(uint64_t);
+    size = MAX(size, log + MIN_SIZE);
+    memset(h, 0, sizeof(*h));
+    if ((h->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        return 0;
+    }
+    if (!preallocate(h->fd, 0, (off_t) size) || !map(h, size))
+    {
+        int status = errno;
+
+        unmap(h);
+        errno = status;
+        return 0;
+    }
+    memcpy(h->header->magic, PHASH_MAGIC, sizeof(h->header->magic));
+    h->header->version = PHASH_VERSION;
+    h->header->order = PHASH_ORDER;
+    h->header->nslot = n;
+    h->header->log = log;
+    h->header->used = log;
+    if (!commit(h, PHASH_DIRTY))
+    {
+        int status = errno;
+
+        unmap(h);
+        errno = status;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * phash_open() --Open an existing table file.
+ *
+ * Parameters:
+ * h    --returns the table (owned by caller)
+ * path --the name of the table file
+ * flags --PHASH_RDONLY, or 0
+ *
+ * Remarks:
+ * If the table wasn't closed cleanly, a writer rebuilds its slots
+ * (and sets h->recovered); a reader can't, and fails with EBUSY
+ * (the table may still be open for writing).  If it was, the live
+ * end of the log must match the current commit's: a writer restores
+ * it from the commit, and a reader fails with EINVAL.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+int phash_open(PHashPtr h, const char *path, int flags)
+{
+    struct stat st;
+    PHashHeaderPtr header;
+    int current;
+
+    if (h == NULL || path == NULL)
+    {
+        errno = EINVAL;
+        return 0;                      /* error: no table/path! */
+    }
+    memset(h, 0, sizeof(*h));
+    h->flags = flags;
+    if ((h->fd = open(path, (flags & PHASH_RDONLY) ? O_RDONLY : O_RDWR)) < 0)
+    {
+        return 0;
+    }
+    if (fstat(h->fd, &st) != 0)
+    {
+        unmap(h);
+        return 0;
+    }
+    if ((size_t) st.st_size < HEADER_SIZE)
+    {
+        unmap(h);
+        errno = EINVAL;
+        return 0;                      /* error: not a table */
+    }
+    if (!map(h, (size_t) st.st_size))
+    {
+        int status = errno;
+
+        unmap(h);
+        errno = status;
+        return 0;
+    }
+    header = h->header;
+    if (memcmp(header->magic, PHASH_MAGIC, sizeof(header->magic)) != 0
+        || header->version != PHASH_VERSION
+        || header->order != PHASH_ORDER
+        || header->nslot == 0 || (header->nslot & (header->nslot - 1)) != 0
+        || header->log != HEADER_SIZE + header->nslot * sizeof(uint64_t)
+        || header->log > h->size
+        || (current = current_commit(header)) < 0
+        || header->commit[current].used < header->log
+        || header->commit[current].used > h->size)
+    {
+        unmap(h);
+        errno = EINVAL;
+        return 0;                      /* error: bad/foreign table */
+    }
+    if (header->commit[current].state == PHASH_DIRTY)
+    {
+        if (flags & PHASH_RDONLY)
+        {
+            unmap(h);
+            errno = EBUSY;
+            return 0;                  /* error: not closed cleanly */
+        }
+        rebuild(h);
+    }
+    else if (header->used != header->commit[current].used)
+    {                                  /* (clean: they must agree) */
+        if (flags & PHASH_RDONLY)
+        {
+            unmap(h);
+            errno = EINVAL;
+            return 0;                  /* error: corrupt header */
+        }
+        header->used = header->commit[current].used;
+    }
+    if (!(flags & PHASH_RDONLY)
+        && (msync(h->base, h->size, MS_SYNC) != 0 || !commit(h, PHASH_DIRTY)))
+    {
+        int status = errno;
+
+        unmap(h);
+        errno = status;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * phash_sync() --Flush a table to disk, and commit its state.
+ *
+ * Remarks:
+ * The commit is written (and synced) after the data, so it never
+ * describes entries that aren't on disk.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+int phash_sync(PHashPtr h)
+{
+    if (h->flags & PHASH_RDONLY)
+    {
+        return 1;                      /* (nothing to do) */
+    }
+    return msync(h->base, h->size, MS_SYNC) == 0 && commit(h, PHASH_DIRTY);
+}
+
+/*
+ * phash_close() --Commit and unmap a table.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set; the table is still closed).
+ */
+int phash_close(PHashPtr h)
+{
+    int status = 1;
+
+    if (h == NULL || h->base == NULL)
+    {
+        return 1;                      /* (already closed) */
+    }
+    if (!(h->flags & PHASH_RDONLY))
+    {
+        status = msync(h->base, h->size, MS_SYNC) == 0
+            && commit(h, PHASH_CLEAN);
+    }
+    if (!status)
+    {
+        int error = errno;
+
+        unmap(h);
+        errno = error;
+        return 0;
+    }
+    unmap(h);
+    return 1;
+}
+
+/*
+ * phash_put() --Set a key's value.
+ *
+ * Remarks:
+ * This may remap the table, invalidating any values returned by
+ * phash_get().
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+int phash_put(PHashPtr h, const void *key, size_t key_len,
+              const void *value, size_t value_len)
+{
+    if (h->flags & PHASH_RDONLY)
+    {
+        errno = EBADF;
+        return 0;                      /* error: read-only */
+    }
+    if (key_len > UINT32_MAX || value_len > UINT32_MAX)
+    {
+        errno = EFBIG;
+        return 0;                      /* error: too big */
+    }
+    return append(h, PHASH_PUT, hash_keyn_wy((char *) key, key_len),
+                  key, key_len, value, value_len);
+}
+
+/*
+ * phash_get() --Find a key's value.
+ *
+ * Parameters:
+ * h    --the table
+ * key, key_len --the key
+ * value_len --returns the value's length (may be NULL)
+ *
+ * Returns: (const void *)
+ * Success: the value (in the mapping); Failure: NULL.
+ */
+const void *phash_get(PHashPtr h, const void *key, size_t key_len,
+                      size_t *value_len)
+{
+    uint64_t *link = find(h, hash_keyn_wy((char *) key, key_len),
+                          key, key_len);
+    PHashEntryPtr e;
+
+    if (link == NULL)
+    {
+        return NULL;
+    }
+    e = (PHashEntryPtr) (h->base + *link);
+    if (value_len != NULL)
+    {
+        *value_len = e->value_len;
+    }
+    return entry_value(e);
+}
+
+/*
+ * phash_remove() --Remove a key.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the key isn't in the table, or errno is set).
+ */
+int phash_remove(PHashPtr h, const void *key, size_t key_len)
+{
+    uint64_t hash = hash_keyn_wy((char *) key, key_len);
+
+    if (h->flags & PHASH_RDONLY)
+    {
+        errno = EBADF;
+        return 0;                      /* error: read-only */
+    }
+    if (find(h, hash, key, key_len) == NULL)
+    {
+        return 0;
+    }
+    return append(h, PHASH_DEL, hash, key, key_len, NULL, 0);
+}
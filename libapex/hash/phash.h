@@ -0,0 +1,114 @@
+/*
+ * PHASH.H --Definitions for a persistent (file-backed) hash table.
+ *
+ * Contents:
+ * PHashCommit_t{}  --A durable snapshot of the table's state.
+ * PHashHeader_t{}  --The header of a table file (at the start of its mapping).
+ * PHashEntry_t{}   --A record in the table's log.
+ * PHash_t{}        --A process's handle on a table.
+ *
+ * Remarks:
+ * A PHash maps byte-string keys to byte-string values, and lives
+ * entirely in a memory-mapped file: the header, then the slots (the
+ * offset of each slot's first entry), then a log of entries.  All
+ * the links are file offsets, so a restarted process can map the
+ * file anywhere and serve lookups straight away.
+ *
+ * A table is not thread-safe, and only one process may have it open
+ * for writing.
+ */
+#ifndef PHASH_H
+#define PHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        PHASH_VERSION = 1,
+        PHASH_RDONLY = 0x1,            /* phash_open(): don't modify the file */
+        PHASH_CLEAN = 0,               /* commit state: closed cleanly */
+        PHASH_DIRTY = 1,               /* ...: open (or crashed) */
+        PHASH_PUT = 0x50,              /* entry type: a key's (new) value */
+        PHASH_DEL = 0x44               /* ...: a key's removal */
+    };
+
+    /*
+     * PHashCommit_t{} --A durable snapshot of the table's state.
+     *
+     * Remarks:
+     * The header holds two commits, which are written alternately
+     * (and each synced), so that a crash while writing one leaves
+     * the other intact.  The one with a valid check and the higher
+     * generation is current.
+     */
+    typedef struct PHashCommit_t
+    {
+        uint64_t generation;
+        uint64_t used;                 /* the end of the log */
+        uint64_t n_items;
+        uint32_t state;                /* PHASH_CLEAN, PHASH_DIRTY */
+        uint32_t check;                /* hash of the fields above */
+    } PHashCommit, *PHashCommitPtr;
+
+    typedef struct PHashHeader_t
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t order;                /* detects a foreign byte order */
+        uint64_t nslot;                /* (a power of 2) */
+        uint64_t log;                  /* offset of the first entry */
+        uint64_t used;                 /* (live) the end of the log */
+        uint64_t n_items;              /* (live) No. of keys */
+        uint64_t n_garbage;            /* (live) No. of dead entries */
+        PHashCommit commit[2];
+    } PHashHeader, *PHashHeaderPtr;
+
+    /*
+     * PHashEntry_t{} --A record in the table's log.
+     *
+     * Remarks:
+     * The key follows the entry, and then the value, each padded to
+     * 8 bytes (so values are aligned).  The check covers everything
+     * but the link, so a torn entry can be detected, and the links
+     * rebuilt from the log.
+     */
+    typedef struct PHashEntry_t
+    {
+        uint64_t next;                 /* next entry in the slot (0: none) */
+        uint64_t hash;
+        uint32_t key_len;
+        uint32_t value_len;
+        uint32_t type;                 /* PHASH_PUT, PHASH_DEL */
+        uint32_t check;
+    } PHashEntry, *PHashEntryPtr;
+
+    typedef struct PHash_t
+    {
+        char *base;                    /* the mapping */
+        size_t size;                   /* ...and its size */
+        PHashHeaderPtr header;         /* (== base) */
+        uint64_t *slot;
+        int fd;
+        int flags;
+        int recovered;                 /* the log was replayed by open */
+    } PHash, *PHashPtr;
+
+    int phash_create(PHashPtr h, const char *path, size_t nslot,
+                     size_t size);
+    int phash_open(PHashPtr h, const char *path, int flags);
+    int phash_close(PHashPtr h);
+    int phash_sync(PHashPtr h);
+    int phash_put(PHashPtr h, const void *key, size_t key_len,
+                  const void *value, size_t value_len);
+    const void *phash_get(PHashPtr h, const void *key, size_t key_len,
+                          size_t *value_len);
+    int phash_remove(PHashPtr h, const void *key, size_t key_len);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* PHASH_H */
@@ -7,6 +7,8 @@
  * clink_rotate()  --Rotate a linked-list.
  * clink_add()     --Add a single link to the head of an existing linked list.
  * clink_insert()  --Insert an item into an ordered list.
+ * clink_merge()   --Merge two ordered lists.
+ * clink_sort()    --Sort a linked-list.
  * clink_remove()  --Remove a single link from a linked-list.
  * clink_find()    --Find a particular item in a linked-list.
  * clink_visit()   --Visit all the items in a linked-list.
@@ -36,6 +38,11 @@
  *  * clink_len() calculates the length by scanning the list (i.e.
  *    it takes O(n) time)
  *  * clink_rotate() rotates backwards by rotating n % clink_len() steps forward.
+ *
+ * Ordered lists can be built by clink_insert(), but this is O(n) per
+ * item; it's much cheaper to build the list in any order and
+ * clink_sort() it (a merge sort, O(n log n)), or to clink_merge()
+ * two ordered lists (O(n)).
  */
 
 #include <stdio.h>
@@ -228,6 +235,178 @@ LinkPtr clink_insert(LinkPtr tail, CompareProc cmp, void *value,
     return NULL;                       /* failure */
 }
 
+/*
+ * merge_() --Merge two ordered, NULL-terminated lists.
+ *
+ * Parameters:
+ * a, b --the heads of the lists to merge
+ * cmp  --the comparison function used to order the items
+ * mode --how to treat items of a that compare equal to items of b
+ *
+ * Returns: (LinkPtr)
+ * The head of the merged (NULL-terminated) list.
+ *
+ * Remarks:
+ * The merge is stable: for equal items, those of a precede those of b.
+ */
+static LinkPtr merge_(LinkPtr a, LinkPtr b, CompareProc cmp,
+                      LinkInsertMode mode)
+{
+    Link head = { NULL, NULL };
+    LinkPtr tail = &head;
+
+    while (a != NULL && b != NULL)
+    {
+        int diff = cmp(a->data, b->data);
+
+        if (diff == 0 && mode != LINK_INSERT_DUPLICATE)
+        {                              /* resolve the duplicate now */
+            LinkPtr dup = b;
+
+            if (mode == LINK_INSERT_REPLACE)
+            {
+                a->data = b->data;
+            }
+            b = b->next;
+            link_free(dup);
+            continue;
+        }
+        if (diff <= 0)
+        {
+            tail->next = a;
+            a = a->next;
+        }
+        else
+        {
+            tail->next = b;
+            b = b->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = (a != NULL) ? a : b;
+    return head.next;
+}
+
+/*
+ * linear_() --Convert a circular list to a NULL-terminated one.
+ *
+ * Returns: (LinkPtr)
+ * The head of the list.
+ */
+static LinkPtr linear_(LinkPtr tail)
+{
+    LinkPtr head = NULL;
+
+    if (tail != NULL)
+    {
+        head = tail->next;
+        tail->next = NULL;
+    }
+    return head;
+}
+
+/*
+ * circular_() --Convert a NULL-terminated list to a circular one.
+ *
+ * Returns: (LinkPtr)
+ * The tail of the list.
+ */
+static LinkPtr circular_(LinkPtr head)
+{
+    LinkPtr tail = head;
+
+    if (head == NULL)
+    {
+        return NULL;
+    }
+    while (tail->next != NULL)
+    {
+        tail = tail->next;
+    }
+    tail->next = head;
+    return tail;
+}
+
+/*
+ * clink_merge() --Merge two ordered lists.
+ *
+ * Parameters:
+ * l1   --the tail of the first (ordered) list
+ * l2   --the tail of the second (ordered) list
+ * cmp  --the comparison function used to order the items
+ * mode --the handling of items of l2 that are equal to items in l1
+ *
+ * Returns: (LinkPtr)
+ * The tail of the merged list.
+ *
+ * Remarks:
+ * Both lists are consumed by the merge; no new links are allocated.
+ * If an item of l2 compares equal to an item of l1, then according to
+ * mode:
+ *  * LINK_INSERT_FAIL: the l2 item's link is discarded
+ *  * LINK_INSERT_REPLACE: the l2 item replaces the l1 item's data
+ *  * LINK_INSERT_DUPLICATE: both are kept (the l1 item first)
+ *
+ * Note that the discarded item's data is not freed, that's the
+ * caller's responsibility.  Duplicates within a single list are
+ * always kept.
+ */
+LinkPtr clink_merge(LinkPtr l1, LinkPtr l2, CompareProc cmp,
+                    LinkInsertMode mode)
+{
+    return circular_(merge_(linear_(l1), linear_(l2), cmp, mode));
+}
+
+/*
+ * clink_sort() --Sort a linked-list.
+ *
+ * Parameters:
+ * tail --the tail of the list to sort
+ * cmp  --the comparison function used to order the items
+ * mode --the handling of equal items
+ *
+ * Returns: (LinkPtr)
+ * The tail of the sorted list.
+ *
+ * Remarks:
+ * This is a stable, bottom-up merge sort that takes O(n log n)
+ * comparisons and O(log n) space.  If mode is LINK_INSERT_FAIL, only
+ * the first of a run of equal items is kept; LINK_INSERT_REPLACE keeps
+ * the last; LINK_INSERT_DUPLICATE keeps them all.  As for
+ * clink_merge(), the discarded links are freed, but not their data.
+ */
+LinkPtr clink_sort(LinkPtr tail, CompareProc cmp, LinkInsertMode mode)
+{
+    LinkPtr bin[sizeof(size_t) * 8] = { NULL };  /* bin[i]: 2^i items */
+    LinkPtr l = linear_(tail);
+    LinkPtr sorted = NULL;
+    size_t n_bin = 0;
+
+    while (l != NULL)
+    {                                  /* add each link, carrying merges */
+        LinkPtr run = l;
+        size_t i;
+
+        l = l->next;
+        run->next = NULL;
+        for (i = 0; i < n_bin && bin[i] != NULL; ++i)
+        {
+            run = merge_(bin[i], run, cmp, mode);
+            bin[i] = NULL;
+        }
+        if (i == n_bin)
+        {
+            ++n_bin;
+        }
+        bin[i] = run;
+    }
+    for (size_t i = 0; i < n_bin; ++i)
+    {                                  /* merge the bins, older first */
+        sorted = (bin[i] == NULL) ? sorted : merge_(bin[i], sorted, cmp, mode);
+    }
+    return circular_(sorted);
+}
+
 /*
  * clink_remove() --Remove a single link from a linked-list.
  *
@@ -18,8 +18,9 @@ extern "C"
 
     LinkPtr clink_insert(LinkPtr tail, CompareProc cmp, void *value,
                          LinkInsertMode mode);
-    /* REVISIT: clink_merge() not implemented yet */
-    LinkPtr clink_merge(LinkPtr l1, LinkPtr l2, LinkInsertMode mode);
+    LinkPtr clink_merge(LinkPtr l1, LinkPtr l2, CompareProc cmp,
+                        LinkInsertMode mode);
+    LinkPtr clink_sort(LinkPtr tail, CompareProc cmp, LinkInsertMode mode);
     LinkPtr clink_remove(LinkPtr tail, CompareProc cmp, void *key,
                          LinkPtr * rlink);
     void *clink_find(LinkPtr tail, CompareProc cmp, void *key);
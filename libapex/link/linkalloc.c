@@ -2,21 +2,106 @@
  * LINKALLOC.C --Linked-list allocation routines.
  *
  * Contents:
- * link_block_new()  --Allocate a block of links.
- * link_new()        --Get a new link record and initialise it for the caller.
- * link_free()       --Return a link record to the free-list.
- * link_free_links() --Return an entire list of links to the free-list.
+ * link_at()             --Return the i'th link of a block.
+ * link_block_new()      --Allocate a block of links.
+ * link_local_exit()     --Return an exiting thread's free-lists to the pool.
+ * link_key_init()       --Create the key that calls link_local_exit().
+ * link_local_init()     --Initialise the thread's notion of the block size.
+ * link_refill()         --Renew the calling thread's free-list.
+ * link_spill()          --Hand some of the thread's free-list back to the pool.
+ * link_get()            --Take a link record from a free-list.
+ * link_put()            --Return a list of link records to a free-list.
+ * link_new()            --Get a new link record and initialise it for the caller.
+ * link_free()           --Return a link record to the free-list.
+ * link_free_links()     --Return an entire list of links to the free-list.
+ * link_new_wide()       --Get a new WideLink record, and initialise its Link.
+ * link_free_wide()      --Return a list of WideLinks to the free-list.
+ * link_set_block_size() --Set the size of the blocks allocated for links.
+ * link_rebuild()        --Rebuild a pool's chunks, without the links of free blocks.
+ * link_trim()           --Release completely free blocks back to the system.
+ *
+ * Remarks:
+ * Each thread has its own (circular) free-list of links, so link_new()
+ * and link_free() need no locking.  When a thread's free-list grows too
+ * long (e.g. one thread frees links that another allocated), blocks of
+ * links are handed back to a global, mutex-protected pool, from which
+ * any thread can refill its list before it resorts to mem_alloc().
+ * When a thread exits, its whole free-list is returned to the pool.
+ *
+ * WideLinks (a Link with an extra word, e.g. a Hash entry's cached
+ * hash value) are managed in exactly the same way, but with their
+ * own blocks, free-lists and pool; the code below is parameterised
+ * by the "kind" of link.
  *
+ * The pool is kept as a stack of "chunks": each chunk is a circular
+ * list of links, and the chunks are chained through the data field of
+ * their tail link.
+ *
+ * Every block allocated is recorded (in a list of LinkBlock headers),
+ * so that link_trim() can find blocks whose links are all free, and
+ * release them.
  */
+#include <stdint.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include <apex.h>
 #include <apex/clink.h>
+#include <apex/mem.h>
+
+
+#define LINK_BLOCK_SIZE 4096           /* default block size (bytes) */
+#define LINK_LOCAL_BLOCKS 4            /* free blocks' worth kept per thread */
+
+typedef enum
+{
+    LINK_PLAIN,                        /* Link */
+    LINK_WIDE,                         /* WideLink */
+    LINK_N_KIND
+} LinkKind;
+
+/*
+ * LinkBlock --The header of a block of links (all of one kind).
+ */
+typedef struct LinkBlock_t
+{
+    struct LinkBlock_t *next;          /* all blocks, in no order */
+    size_t n_link;                     /* No. of links in this block */
+    size_t n_found;                    /* (scratch, for link_trim()) */
+    size_t link_size;                  /* sizeof(Link) or sizeof(WideLink) */
+    Link link[];
+} LinkBlock, *LinkBlockPtr;
+
+/*
+ * LinkLocal --A thread's free-list of one kind of link.
+ */
+typedef struct LinkLocal_t
+{
+    LinkPtr free_list;                 /* tail of the (circular) free list */
+    size_t n_free;                     /* No. of links on free_list */
+    size_t n_block;                    /* links per block, for this thread */
+} LinkLocal;
 
+static const size_t link_size[LINK_N_KIND] = {
+    sizeof(Link), sizeof(WideLink)
+};
 
-#define LINK_BLOCK	((4096-24)/sizeof(Link))
+static THREAD_LOCAL LinkLocal local[LINK_N_KIND];
 
-static LinkPtr free_list;              /* tail of the (circular) free list */
+static pthread_once_t local_once = PTHREAD_ONCE_INIT;
+static pthread_key_t local_key;        /* (calls link_local_exit()) */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static LinkPtr pool[LINK_N_KIND];      /* stacks of free chunks */
+static LinkBlockPtr block_list;        /* all allocated blocks */
+static size_t block_size = LINK_BLOCK_SIZE;
+
+/*
+ * link_at() --Return the i'th link of a block.
+ */
+static LinkPtr link_at(LinkBlockPtr b, size_t i)
+{
+    return (LinkPtr) ((char *) b->link + i * b->link_size);
+}
 
 /*
  * link_block_new() --Allocate a block of links.
@@ -26,51 +111,241 @@ static LinkPtr free_list;              /* tail of the (circular) free list */
  *
  * Remarks:
  * This routine is used to allocate new links in bulk so as to avoid
- * a per-link malloc overhead.
+ * a per-link malloc overhead.  It must be called with pool_lock held.
  */
-static LinkPtr _link_block_new(void)
+static LinkPtr _link_block_new(LinkKind kind)
 {
-    LinkPtr l = (LinkPtr) malloc(LINK_BLOCK * sizeof(Link));
+    LinkBlockPtr b = (LinkBlockPtr) mem_alloc(MEM_LINK, block_size);
+    size_t n = (block_size - sizeof(LinkBlock)) / link_size[kind];
 
-    if (l)
+    if (b)
     {
-        for (size_t i = 0; i < LINK_BLOCK; ++i)
+        b->n_link = n;
+        b->n_found = 0;
+        b->link_size = link_size[kind];
+        b->next = block_list;
+        block_list = b;
+        for (size_t i = 0; i < n; ++i)
         {                              /* create a circular list */
-            l[i].next = &l[(i + 1) % LINK_BLOCK];
+            link_at(b, i)->next = link_at(b, (i + 1) % n);
         }
+        return link_at(b, n - 1);
     }
-    return l;
+    return NULL;
 }
 
 /*
- * link_new() --Get a new link record and initialise it for the caller.
+ * link_local_exit() --Return an exiting thread's free-lists to the pool.
  *
- * Parameters:
- * next --ptr to the next link in the chain.
- * value    --the thing being linked.
+ * Remarks:
+ * This is the destructor of local_key, so it's called as each thread
+ * (that has used links) exits.  Each whole list becomes one chunk, so
+ * that link_trim() can find its links.
+ */
+static void link_local_exit(void *UNUSED(value))
+{
+    pthread_mutex_lock(&pool_lock);
+    for (int kind = 0; kind < LINK_N_KIND; ++kind)
+    {
+        LinkLocal *list = &local[kind];
+
+        if (list->free_list != NULL)
+        {
+            list->free_list->data = pool[kind];
+            pool[kind] = list->free_list;
+            list->free_list = NULL;
+            list->n_free = 0;
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * link_key_init() --Create the key that calls link_local_exit().
+ */
+static void link_key_init(void)
+{
+    (void) pthread_key_create(&local_key, link_local_exit);
+}
+
+/*
+ * link_local_init() --Initialise the thread's notion of the block size.
+ *
+ * Returns: (size_t)
+ * The number of links in a block.
+ *
+ * Remarks:
+ * This also arranges for link_local_exit() to be called when the
+ * thread exits (the key's value just needs to be non-NULL).
+ */
+static size_t link_local_init(LinkKind kind)
+{
+    LinkLocal *list = &local[kind];
+
+    (void) pthread_once(&local_once, link_key_init);
+    (void) pthread_setspecific(local_key, local);
+    pthread_mutex_lock(&pool_lock);
+    list->n_block = (block_size - sizeof(LinkBlock)) / link_size[kind];
+    pthread_mutex_unlock(&pool_lock);
+    return list->n_block;
+}
+
+/*
+ * link_refill() --Renew the calling thread's free-list.
  *
  * Returns: (LinkPtr)
- * Success: an initialised Link record; Failure: NULL (malloc failure).
+ * Success: the new free-list; Failure: NULL.
  *
  * Remarks:
- * This calls _link_block_new() as necessary to renew the free-list.
+ * A chunk is taken from the global pool if possible, otherwise a new
+ * block is allocated.
  */
-LinkPtr link_new(LinkPtr next, void *value)
+static LinkPtr link_refill(LinkKind kind)
+{
+    LinkLocal *list = &local[kind];
+    LinkPtr chunk;
+
+    if (list->n_block == 0)
+    {
+        link_local_init(kind);
+    }
+    pthread_mutex_lock(&pool_lock);
+    list->n_block = (block_size - sizeof(LinkBlock)) / link_size[kind];
+    if ((chunk = pool[kind]) != NULL)
+    {
+        pool[kind] = (LinkPtr) chunk->data;
+    }
+    else
+    {
+        chunk = _link_block_new(kind);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    list->n_free = 0;
+    if (chunk != NULL)
+    {
+        LinkPtr l = chunk;
+
+        do
+        {                              /* chunks vary in size: count it */
+            ++list->n_free;
+            l = l->next;
+        } while (l != chunk);
+    }
+    return chunk;
+}
+
+/*
+ * link_spill() --Hand some of the thread's free-list back to the pool.
+ *
+ * Remarks:
+ * A chunk of one block's worth of links is split off the free-list
+ * and pushed onto the global pool.
+ */
+static void link_spill(LinkKind kind)
+{
+    LinkLocal *list = &local[kind];
+    LinkPtr head = list->free_list->next;
+    LinkPtr tail = head;
+
+    for (size_t i = 1; i < list->n_block; ++i)
+    {
+        tail = tail->next;
+    }
+    list->free_list->next = tail->next;        /* unlink head..tail */
+    tail->next = head;                 /* ...as a circular chunk */
+    list->n_free -= list->n_block;
+
+    pthread_mutex_lock(&pool_lock);
+    tail->data = pool[kind];
+    pool[kind] = tail;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * link_get() --Take a link record from a free-list.
+ *
+ * Returns: (LinkPtr)
+ * Success: the (uninitialised) link; Failure: NULL (malloc failure).
+ *
+ * Remarks:
+ * This calls link_refill() as necessary to renew the free-list.
+ */
+static LinkPtr link_get(LinkKind kind)
 {
+    LinkLocal *list = &local[kind];
     LinkPtr new;
 
-    if (free_list == NULL && (free_list = _link_block_new()) == NULL)
+    if (list->free_list == NULL
+        && (list->free_list = link_refill(kind)) == NULL)
     {
         return NULL;                   /* failure: malloc failed */
     }
-    new = free_list->next;
-    if (new == free_list)
+    new = list->free_list->next;
+    if (new == list->free_list)
     {                                  /* that was the last link! */
-        free_list = (LinkPtr) NULL;
+        list->free_list = (LinkPtr) NULL;
     }
     else
     {
-        free_list->next = new->next;
+        list->free_list->next = new->next;
+    }
+    list->n_free -= 1;
+    return new;
+}
+
+/*
+ * link_put() --Return a list of link records to a free-list.
+ *
+ * Parameters:
+ * kind --the kind of links
+ * head, tail --the first and last links of the list
+ * n    --the number of links in the list
+ */
+static void link_put(LinkKind kind, LinkPtr head, LinkPtr tail, size_t n)
+{
+    LinkLocal *list = &local[kind];
+
+    if (list->free_list)
+    {                                  /* splice in this list */
+        tail->next = list->free_list->next;
+        list->free_list->next = head;
+    }
+    else
+    {                                  /* no free-list? */
+        list->free_list = tail;        /* ...tail becomes entire free-list */
+        tail->next = head;             /* make sure it's circular */
+    }
+    if (list->n_block == 0)
+    {
+        link_local_init(kind);
+    }
+    for (list->n_free += n; list->n_free > LINK_LOCAL_BLOCKS * list->n_block;)
+    {
+        link_spill(kind);
+    }
+}
+
+/*
+ * link_new() --Get a new link record and initialise it for the caller.
+ *
+ * Parameters:
+ * next --ptr to the next link in the chain.
+ * value    --the thing being linked.
+ *
+ * Returns: (LinkPtr)
+ * Success: an initialised Link record; Failure: NULL (malloc failure).
+ *
+ * Remarks:
+ * This calls link_refill() as necessary to renew the free-list.
+ */
+LinkPtr link_new(LinkPtr next, void *value)
+{
+    LinkPtr new = link_get(LINK_PLAIN);
+
+    if (new == NULL)
+    {
+        return NULL;                   /* failure: malloc failed */
     }
     new->next = next;
     new->data = value;
@@ -89,16 +364,7 @@ void link_free(LinkPtr l)
     {
         return;
     }
-
-    if (free_list)
-    {
-        l->next = free_list->next;
-    }
-    else
-    {
-        free_list = l;
-    }
-    free_list->next = l;
+    link_put(LINK_PLAIN, l, l, 1);
 }
 
 /*
@@ -109,18 +375,270 @@ void link_free(LinkPtr l)
  */
 void link_free_links(LinkPtr head, LinkPtr tail)
 {
+    size_t n = 1;
+
     if (head == NULL || tail == NULL)
     {
         return;
     }
-    if (free_list)
-    {                                  /* splice in this list */
-        tail->next = free_list->next;
-        free_list->next = head;
+    for (LinkPtr l = head; l != tail; l = l->next)
+    {
+        ++n;
     }
-    else
-    {                                  /* no free-list? */
-        free_list = tail;              /* ...tail becomes entire free-list */
-        tail->next = head;             /* make sure it's circular */
+    link_put(LINK_PLAIN, head, tail, n);
+}
+
+/*
+ * link_new_wide() --Get a new WideLink record, and initialise its Link.
+ *
+ * Parameters:
+ * next --ptr to the next link in the chain.
+ * value    --the thing being linked.
+ *
+ * Returns: (WideLinkPtr)
+ * Success: the WideLink (whose extra field is for the caller to
+ * set); Failure: NULL (malloc failure).
+ */
+WideLinkPtr link_new_wide(LinkPtr next, void *value)
+{
+    LinkPtr new = link_get(LINK_WIDE);
+
+    if (new == NULL)
+    {
+        return NULL;                   /* failure: malloc failed */
+    }
+    new->next = next;
+    new->data = value;
+    return (WideLinkPtr) new;          /* success */
+}
+
+/*
+ * link_free_wide() --Return a list of WideLinks to the free-list.
+ *
+ * Parameters:
+ * head --the first WideLink of a NULL-terminated list (or NULL)
+ */
+void link_free_wide(WideLinkPtr head)
+{
+    LinkPtr tail;
+    size_t n = 1;
+
+    if (head == NULL)
+    {
+        return;
+    }
+    for (tail = &head->link; tail->next != NULL; tail = tail->next)
+    {
+        ++n;
+    }
+    link_put(LINK_WIDE, &head->link, tail, n);
+}
+
+/*
+ * link_set_block_size() --Set the size of the blocks allocated for links.
+ *
+ * Parameters:
+ * size --the size of each block, in bytes
+ *
+ * Returns: (size_t)
+ * The previous block size.
+ *
+ * Remarks:
+ * The new size applies to blocks allocated from now on; existing
+ * blocks are unaffected.  Large blocks (e.g. 2MiB, to suit huge pages)
+ * reduce malloc calls, but are less likely to become completely free,
+ * and so can't be released by link_trim() as readily.  Sizes too small
+ * to hold a few links are silently increased.
+ */
+size_t link_set_block_size(size_t size)
+{
+    size_t old_size;
+
+    size = MAX(size, sizeof(LinkBlock) + 4 * sizeof(WideLink));
+    pthread_mutex_lock(&pool_lock);
+    old_size = block_size;
+    block_size = size;
+    pthread_mutex_unlock(&pool_lock);
+    return old_size;
+}
+
+/*
+ * block_cmp() --Compare two LinkBlock pointers, by address.
+ */
+static int block_cmp(const void *v_1, const void *v_2)
+{
+    uintptr_t b_1 = (uintptr_t) * (LinkBlockPtr *) v_1;
+    uintptr_t b_2 = (uintptr_t) * (LinkBlockPtr *) v_2;
+
+    return (b_1 > b_2) - (b_1 < b_2);
+}
+
+/*
+ * link_owner() --Find the block that a link belongs to.
+ *
+ * Parameters:
+ * block --the blocks, sorted by address
+ * n_block --the number of blocks
+ * l --the link
+ */
+static LinkBlockPtr link_owner(LinkBlockPtr *block, size_t n_block, LinkPtr l)
+{
+    size_t lo = 0, hi = n_block;
+
+    while (hi - lo > 1)
+    {                                  /* find last block <= l */
+        size_t mid = lo + (hi - lo) / 2;
+
+        if ((uintptr_t) block[mid] <= (uintptr_t) l)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return block[lo];
+}
+
+/*
+ * link_rebuild() --Rebuild a pool's chunks, without the links of free blocks.
+ *
+ * Parameters:
+ * chunk --the pool (a stack of chunks)
+ * block --the blocks, sorted by address (with n_found set)
+ * n_block --the number of blocks
+ *
+ * Returns: (LinkPtr)
+ * The new pool.
+ */
+static LinkPtr link_rebuild(LinkPtr chunk, LinkBlockPtr *block,
+                            size_t n_block)
+{
+    LinkPtr new_pool = NULL, new_chunk = NULL;
+    size_t chunk_len = 0;
+
+    while (chunk != NULL)
+    {                                  /* rebuild chunks of kept links */
+        LinkPtr next_chunk = (LinkPtr) chunk->data;
+        LinkPtr l = chunk->next;
+        LinkPtr end = chunk;
+
+        for (bool done = false; !done;)
+        {
+            LinkPtr next = l->next;
+            LinkBlockPtr b = link_owner(block, n_block, l);
+
+            done = (l == end);
+            if (b->n_found < b->n_link)
+            {                          /* keep this link */
+                if (new_chunk == NULL)
+                {
+                    new_chunk = l->next = l;
+                }
+                else
+                {
+                    l->next = new_chunk->next;
+                    new_chunk->next = l;
+                }
+                if (++chunk_len >= b->n_link)
+                {                      /* push completed chunk */
+                    new_chunk->data = new_pool;
+                    new_pool = new_chunk;
+                    new_chunk = NULL;
+                    chunk_len = 0;
+                }
+            }
+            l = next;
+        }
+        chunk = next_chunk;
+    }
+    if (new_chunk != NULL)
+    {
+        new_chunk->data = new_pool;
+        new_pool = new_chunk;
+    }
+    return new_pool;
+}
+
+/*
+ * link_trim() --Release completely free blocks back to the system.
+ *
+ * Returns: (size_t)
+ * The number of bytes released.
+ *
+ * Remarks:
+ * The calling thread's free-list is first returned to the global pool,
+ * then any block whose links are all in the pool is freed, and the
+ * remaining free links are rebuilt into chunks.  Links cached in other
+ * threads' free-lists are not examined, so their blocks are retained
+ * (until those threads exit).
+ *
+ * This takes O(n log n) time in the number of free links, and holds
+ * the pool lock throughout, so it's intended to be called
+ * occasionally (e.g. when a burst of activity has subsided).
+ */
+size_t link_trim(void)
+{
+    LinkBlockPtr *block;
+    size_t n_block = 0, n_released = 0;
+
+    link_local_exit(NULL);             /* return local links to pool */
+    pthread_mutex_lock(&pool_lock);
+    for (LinkBlockPtr b = block_list; b != NULL; b = b->next)
+    {
+        ++n_block;
+    }
+    if (n_block == 0
+        || (block = MEM_NEW(MEM_LINK, LinkBlockPtr, n_block)) == NULL)
+    {
+        pthread_mutex_unlock(&pool_lock);
+        return 0;                      /* nothing to do, or malloc failure */
+    }
+    n_block = 0;
+    for (LinkBlockPtr b = block_list; b != NULL; b = b->next)
+    {
+        block[n_block++] = b;
+    }
+    qsort(block, n_block, sizeof(block[0]), block_cmp);
+
+    for (int kind = 0; kind < LINK_N_KIND; ++kind)
+    {
+        for (LinkPtr chunk = pool[kind]; chunk != NULL;
+             chunk = (LinkPtr) chunk->data)
+        {                              /* count free links per block */
+            LinkPtr l = chunk;
+
+            do
+            {
+                link_owner(block, n_block, l)->n_found += 1;
+                l = l->next;
+            } while (l != chunk);
+        }
+    }
+    for (int kind = 0; kind < LINK_N_KIND; ++kind)
+    {
+        pool[kind] = link_rebuild(pool[kind], block, n_block);
+    }
+
+    block_list = NULL;
+    for (size_t i = 0; i < n_block; ++i)
+    {                                  /* release entirely free blocks */
+        LinkBlockPtr b = block[i];
+
+        if (b->n_found == b->n_link)
+        {
+            n_released += sizeof(LinkBlock) + b->n_link * b->link_size;
+            mem_free(MEM_LINK, b);
+        }
+        else
+        {
+            b->n_found = 0;
+            b->next = block_list;
+            block_list = b;
+        }
     }
+    pthread_mutex_unlock(&pool_lock);
+    mem_free(MEM_LINK, block);
+    return n_released;
 }
@@ -37,9 +37,26 @@ extern "C"
 
     } Link, *LinkPtr;
 
+    /*
+     * WideLink --A Link with an extra word (e.g. a cached hash value).
+     *
+     * Remarks:
+     * WideLinks come from their own blocks, so they must be freed by
+     * link_free_wide(), not link_free().
+     */
+    typedef struct WideLink_t
+    {
+        Link link;
+        unsigned long extra;
+    } WideLink, *WideLinkPtr;
+
     LinkPtr link_new(LinkPtr next, void *data); /* (CONS!) */
     void link_free(LinkPtr link);
     void link_free_links(LinkPtr head, LinkPtr tail);
+    WideLinkPtr link_new_wide(LinkPtr next, void *data);
+    void link_free_wide(WideLinkPtr head);
+    size_t link_set_block_size(size_t size);
+    size_t link_trim(void);
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
@@ -0,0 +1,447 @@
+/*
+ * ASYNC.C --A log-handler that writes log messages from a background thread.
+ *
+ * Contents:
+ * log_async_start()   --Start the background log writer.
+ * log_async_stop()    --Write any queued messages, and stop the writer.
+ * log_async_dropped() --Return the No. of messages dropped so far.
+ * log_async()         --Output handler that queues a message for stderr.
+ * log_deferred()      --Output handler that queues a message's arguments.
+ *
+ * Remarks:
+ * log_async() formats the message just as log_stderr() does, but
+ * then only copies it into a lock-free ring (an MPMCQueue, since any
+ * thread may log); a dedicated writer thread takes the messages
+ * from the ring and prints them, so a slow terminal or pipe doesn't
+ * stall the logging threads.
+ *
+ * When the ring is full, the policy given to log_async_start()
+ * decides what happens: LOG_ASYNC_DROP discards the message,
+ * LOG_ASYNC_COUNT discards it too but the writer reports the No. of
+ * dropped messages, and LOG_ASYNC_BLOCK makes the caller wait for
+ * space.  If log_async() is used (e.g. via LOG_OUTPUT=async) before
+ * log_async_start(), it starts the writer with LOG_ASYNC_COUNT.
+ *
+ * log_deferred() shares the ring and writer, but queues the format
+ * and a binary copy of the arguments instead of the text, so that the
+ * writer does the formatting too (see deferred.c).
+ *
+ * log_async_stop() is registered with atexit(), so messages queued
+ * before exit() are always written.  Messages logged after the writer
+ * has stopped are printed directly, by log_stderr().
+ *
+ * The writer sleeps on a condition variable when the ring is empty;
+ * it sets "idle" and re-checks the ring first, and a producer checks
+ * "idle" after pushing (with a full barrier on both sides), so a
+ * wake-up can't be lost, and a busy producer doesn't touch the mutex.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include SYSLOG
+
+#include <apex/log.h>
+#include <apex/queue.h>
+
+#define LOG_ASYNC_MESSAGES 1024        /* ring size when auto-started */
+
+#ifndef CLOCK_REALTIME_COARSE
+#define CLOCK_REALTIME_COARSE CLOCK_REALTIME   /* (Linux-specific) */
+#endif /* CLOCK_REALTIME_COARSE */
+
+enum LogAsyncState
+{
+    LOG_ASYNC_IDLE,                    /* not (yet) started */
+    LOG_ASYNC_RUNNING,
+    LOG_ASYNC_STOPPED
+};
+
+typedef struct LogRecord_t
+{
+    size_t priority;
+    const char *fmt;                   /* deferred: the caller's format */
+    LogConfig config;                  /* (deferred) */
+    LogContext caller;                 /* (deferred, if has_caller) */
+    int has_caller;
+    int sys_errno;
+    struct timespec when;              /* (deferred, if timestamped) */
+    char text[LOG_LINE_MAX + 2];       /* the message, or packed args */
+} LogRecord, *LogRecordPtr;
+
+static struct
+{
+    MPMCQueue queue;
+    LogRecordPtr record;               /* the ring's storage */
+    unsigned int *seq;
+    LogAsyncPolicy policy;
+    pthread_t thread;
+    pthread_mutex_t lock;              /* (for wake) */
+    pthread_cond_t wake;
+    unsigned int state;                /* a LogAsyncState */
+    unsigned int n_active;             /* No. of threads queueing */
+    unsigned int idle;                 /* the writer is (nearly) asleep */
+    size_t n_dropped;
+} async = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER
+};
+
+static pthread_mutex_t control = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+/*
+ * format_text() --Format a deferred record's message, as log_stderr().
+ */
+static int format_text(LogRecordPtr record, char *text, const char *fmt,
+                       ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = log_stderr_format_(&record->config,
+                           record->has_caller ? &record->caller : NULL,
+                           record->sys_errno, record->priority,
+                           &record->when, fmt, args, text);
+    va_end(args);
+    return n;
+}
+
+/*
+ * put_record() --Print a queued message, or syslog it if stderr fails.
+ */
+static void put_record(LogRecordPtr record)
+{
+    const char *text = record->text;
+    char message[LOG_LINE_MAX + 1];
+    char deferred_text[LOG_LINE_MAX + 2];
+
+    if (record->fmt != NULL)
+    {                                  /* (format it now) */
+        log_unpack_args_(message, sizeof(message), record->fmt,
+                         record->text);
+        if (format_text(record, deferred_text, "%s", message) < 0)
+        {
+            return;
+        }
+        text = deferred_text;
+    }
+    if (log_stderr_put_(record->priority, text) < 0)
+    {
+        syslog((int) record->priority, "%s", text);
+    }
+}
+
+/*
+ * writer() --Print the queued messages: a pthread start proc.
+ */
+static void *writer(void *UNUSED(data))
+{
+    size_t n_reported = 0;
+    LogRecord record;
+
+    for (;;)
+    {
+        size_t n_dropped;
+
+        while (mpmc_queue_pop(&async.queue, &record))
+        {
+            put_record(&record);
+        }
+        n_dropped = ATOMIC_LOAD_RELAXED(&async.n_dropped);
+        if (async.policy == LOG_ASYNC_COUNT && n_dropped != n_reported)
+        {
+            record.priority = LOG_WARNING;
+            record.fmt = NULL;
+            snprintf(record.text, sizeof(record.text),
+                     "warning: %zu log messages dropped",
+                     n_dropped - n_reported);
+            put_record(&record);
+            n_reported = n_dropped;
+        }
+
+        pthread_mutex_lock(&async.lock);
+        ATOMIC_STORE_RELAXED(&async.idle, 1);
+        ATOMIC_FENCE();
+        if (mpmc_queue_pop(&async.queue, &record))
+        {
+            ATOMIC_STORE_RELAXED(&async.idle, 0);
+            pthread_mutex_unlock(&async.lock);
+            put_record(&record);
+            continue;
+        }
+        if (ATOMIC_LOAD_ACQUIRE(&async.state) != LOG_ASYNC_RUNNING
+            && ATOMIC_LOAD_ACQUIRE(&async.n_active) == 0)
+        {
+            pthread_mutex_unlock(&async.lock);
+            break;                     /* stopped, and drained */
+        }
+        pthread_cond_wait(&async.wake, &async.lock);
+        ATOMIC_STORE_RELAXED(&async.idle, 0);
+        pthread_mutex_unlock(&async.lock);
+    }
+    return NULL;
+}
+
+/*
+ * wake_writer() --Wake the writer thread, if it's asleep.
+ */
+static void wake_writer(void)
+{
+    ATOMIC_FENCE();                    /* (order the push before the load) */
+    if (ATOMIC_LOAD_RELAXED(&async.idle))
+    {
+        pthread_mutex_lock(&async.lock);
+        pthread_cond_signal(&async.wake);
+        pthread_mutex_unlock(&async.lock);
+    }
+}
+
+/*
+ * log_async_start() --Start the background log writer.
+ *
+ * Parameters:
+ * n_message --the size of the ring (a power of 2)
+ * policy    --what to do with a message when the ring is full
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (already running, bad size, or no memory).
+ *
+ * Remarks:
+ * This only starts the writer: select log_async() (or log_deferred())
+ * as the output handler (e.g. with log_config()) to use it.
+ */
+int log_async_start(size_t n_message, LogAsyncPolicy policy)
+{
+    static int registered;
+    int status = 0;
+
+    pthread_mutex_lock(&control);
+    if (async.state == LOG_ASYNC_RUNNING)
+    {
+        pthread_mutex_unlock(&control);
+        return 0;                      /* error: already running */
+    }
+    async.record = calloc(n_message, sizeof(LogRecord));
+    async.seq = calloc(n_message, sizeof(unsigned int));
+    if (async.record != NULL && async.seq != NULL
+        && mpmc_queue_init(&async.queue, (int) n_message, sizeof(LogRecord),
+                           async.record, async.seq) != NULL)
+    {
+        async.policy = policy;
+        async.idle = 0;
+        async.n_dropped = 0;
+        ATOMIC_STORE_RELEASE(&async.state, LOG_ASYNC_RUNNING);
+        if (pthread_create(&async.thread, NULL, writer, NULL) == 0)
+        {
+            status = 1;
+        }
+        else
+        {
+            ATOMIC_STORE_RELEASE(&async.state, LOG_ASYNC_STOPPED);
+        }
+    }
+    if (!status)
+    {
+        free(async.record);
+        free(async.seq);
+        async.record = NULL;
+        async.seq = NULL;
+    }
+    else if (!registered)
+    {
+        atexit(log_async_stop);       /* (flush on exit) */
+        registered = 1;
+    }
+    pthread_mutex_unlock(&control);
+    return status;
+}
+
+/*
+ * log_async_stop() --Write any queued messages, and stop the writer.
+ *
+ * Remarks:
+ * This waits for any threads that are queueing a message, and then
+ * for the writer to print everything in the ring.
+ */
+void log_async_stop(void)
+{
+    pthread_mutex_lock(&control);
+    if (async.state != LOG_ASYNC_RUNNING)
+    {
+        pthread_mutex_unlock(&control);
+        return;
+    }
+    ATOMIC_STORE_RELEASE(&async.state, LOG_ASYNC_STOPPED);
+    ATOMIC_FENCE();
+    while (ATOMIC_LOAD_ACQUIRE(&async.n_active) != 0)
+    {
+        sched_yield();                 /* (they're nearly done) */
+    }
+    pthread_mutex_lock(&async.lock);
+    pthread_cond_signal(&async.wake);
+    pthread_mutex_unlock(&async.lock);
+    pthread_join(async.thread, NULL);
+    free(async.record);
+    free(async.seq);
+    async.record = NULL;
+    async.seq = NULL;
+    pthread_mutex_unlock(&control);
+}
+
+/*
+ * log_async_dropped() --Return the No. of messages dropped so far.
+ *
+ * Remarks:
+ * This counts the messages dropped since log_async_start(), by either
+ * the LOG_ASYNC_DROP or LOG_ASYNC_COUNT policies.
+ */
+size_t log_async_dropped(void)
+{
+    return ATOMIC_LOAD_RELAXED(&async.n_dropped);
+}
+
+/*
+ * auto_start() --Start the writer for log_async()'s first message.
+ */
+static void auto_start(void)
+{
+    if (ATOMIC_LOAD_ACQUIRE(&async.state) == LOG_ASYNC_IDLE)
+    {
+        log_async_start(LOG_ASYNC_MESSAGES, LOG_ASYNC_COUNT);
+    }
+}
+
+/*
+ * enter() --Start queueing a message, if the writer is running.
+ *
+ * Returns: (int)
+ * Success: 1 (call leave() after queueing); Failure: 0 (not running).
+ */
+static int enter(void)
+{
+    pthread_once(&once, auto_start);
+    ATOMIC_ADD(&async.n_active, 1);
+    ATOMIC_FENCE();                    /* (see log_async_stop()) */
+    if (ATOMIC_LOAD_ACQUIRE(&async.state) != LOG_ASYNC_RUNNING)
+    {
+        ATOMIC_ADD(&async.n_active, -1);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * push_record() --Queue a record for the writer, as per the policy.
+ *
+ * Returns: (int)
+ * Success: n; Failure: -1 (the record was dropped).
+ */
+static int push_record(LogRecordPtr record, int n)
+{
+    int status;
+
+    while (!(status = mpmc_queue_push(&async.queue, record))
+           && async.policy == LOG_ASYNC_BLOCK)
+    {
+        wake_writer();
+        sched_yield();
+    }
+    if (!status)
+    {
+        ATOMIC_ADD(&async.n_dropped, 1);
+        n = -1;
+    }
+    else
+    {
+        wake_writer();
+    }
+    ATOMIC_ADD(&async.n_active, -1);  /* (leave) */
+    return n;
+}
+
+/*
+ * log_async() --Output handler that queues a message for stderr.
+ *
+ * Returns: (int)
+ * Success: the length of the message; Failure: -1 (bad format, or
+ * the message was dropped).
+ */
+int log_async(const LogConfig * config, const LogContext * caller,
+              int sys_errno, size_t priority, const char *fmt, va_list args)
+{
+    LogRecord record;
+    int n;
+
+    if (!enter())
+    {
+        return log_stderr(config, caller, sys_errno, priority, fmt, args);
+    }
+    record.priority = priority;
+    record.fmt = NULL;
+    if ((n = log_stderr_format_(config, caller, sys_errno, priority, NULL,
+                                fmt, args, record.text)) < 0)
+    {
+        ATOMIC_ADD(&async.n_active, -1);
+        return -1;
+    }
+    return push_record(&record, n);
+}
+
+/*
+ * log_deferred() --Output handler that queues a message's arguments.
+ *
+ * Returns: (int)
+ * Success: 0 (the length isn't known until the writer formats it);
+ * Failure: -1 (the message was dropped).
+ *
+ * Remarks:
+ * The writer formats the message from the format and a binary copy of
+ * the arguments (see deferred.c), so the caller only pays for copying
+ * them.  fmt must outlive the message (e.g. be a string constant).
+ * Messages whose arguments can't be captured are formatted now, as by
+ * log_async().
+ */
+int log_deferred(const LogConfig * config, const LogContext * caller,
+                 int sys_errno, size_t priority, const char *fmt,
+                 va_list args)
+{
+    LogRecord record;
+
+    if (!enter())
+    {
+        return log_stderr(config, caller, sys_errno, priority, fmt, args);
+    }
+    record.priority = priority;
+    if (log_pack_args_(record.text, sizeof(record.text), fmt, args) < 0)
+    {
+        int n;
+
+        record.fmt = NULL;
+        if ((n = log_stderr_format_(config, caller, sys_errno, priority,
+                                    NULL, fmt, args, record.text)) < 0)
+        {
+            ATOMIC_ADD(&async.n_active, -1);
+            return -1;
+        }
+        return push_record(&record, n);
+    }
+    record.fmt = fmt;
+    record.config = *config;
+    record.has_caller = caller != NULL;
+    if (caller != NULL)
+    {
+        record.caller = *caller;
+    }
+    record.sys_errno = sys_errno;
+    if (config->timestamp != NULL)
+    {
+        clock_gettime(CLOCK_REALTIME_COARSE, &record.when);
+    }
+    return push_record(&record, 0) < 0 ? -1 : 0;
+}
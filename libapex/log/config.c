@@ -4,6 +4,8 @@
  * Contents:
  * log_config[]  --Current log configuration state.
  * log_getenv_() --Load the logging parameters from the environment.
+ * store_config() --Publish a configuration (with config_lock held).
+ * load_config()  --Copy the current configuration.
  * log_config()  --Set the current logging parameters, return the old ones..
  *
  * Remarks:
@@ -22,9 +24,11 @@
  */
 #include <apex.h>                       /* Windows_NT requires this before system headers */
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 
+#include <apex/atomic.h>
 #include <apex/log.h>
 #include <apex/sysenum.h>
 #include <apex/estring.h>
@@ -42,7 +46,9 @@ static LogConfig log_state = {
     .facility = LOG_USER,
 };
 
-static const LogConfig *config = NULL; /* Yow! are we initialised yet!!? */
+static unsigned long config_seq;       /* odd: log_state is being written */
+static int config_loaded;              /* Yow! are we initialised yet!!? */
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * log_getenv_() --Load the logging parameters from the environment.
@@ -87,6 +93,52 @@ static LogConfig *log_getenv_(LogConfig * conf)
     return conf;
 }
 
+/*
+ * store_config() --Publish a configuration (with config_lock held).
+ *
+ * Remarks:
+ * The fields are stored (and loaded) atomically, one at a time; the
+ * sequence count, odd while they're being written, lets a reader
+ * detect a mixture and retry.
+ */
+static void store_config(const LogConfig * conf)
+{
+    unsigned long seq = config_seq;
+
+    ATOMIC_STORE_RELAXED(&config_seq, seq + 1);
+    ATOMIC_FENCE();                    /* (order seq/field stores) */
+    ATOMIC_STORE_RELAXED(&log_state.threshold_priority,
+                         conf->threshold_priority);
+    ATOMIC_STORE_RELAXED(&log_state.identity, conf->identity);
+    ATOMIC_STORE_RELAXED(&log_state.facility, conf->facility);
+    ATOMIC_STORE_RELAXED(&log_state.timestamp, conf->timestamp);
+    ATOMIC_STORE_RELAXED(&log_state.output, conf->output);
+    ATOMIC_STORE_RELEASE(&config_seq, seq + 2);
+}
+
+/*
+ * load_config() --Copy the current configuration.
+ */
+static void load_config(LogConfig * conf)
+{
+    unsigned long seq;
+
+    do
+    {
+        while ((seq = ATOMIC_LOAD_ACQUIRE(&config_seq)) & 1)
+        {
+            ;                          /* (a writer is storing it) */
+        }
+        conf->threshold_priority =
+            ATOMIC_LOAD_RELAXED(&log_state.threshold_priority);
+        conf->identity = ATOMIC_LOAD_RELAXED(&log_state.identity);
+        conf->facility = ATOMIC_LOAD_RELAXED(&log_state.facility);
+        conf->timestamp = ATOMIC_LOAD_RELAXED(&log_state.timestamp);
+        conf->output = ATOMIC_LOAD_RELAXED(&log_state.output);
+        ATOMIC_FENCE();                /* (order field/seq loads) */
+    } while (ATOMIC_LOAD_RELAXED(&config_seq) != seq);
+}
+
 /*
  * log_config() --Set the current logging parameters, return the old ones..
  *
@@ -94,22 +146,47 @@ static LogConfig *log_getenv_(LogConfig * conf)
  * new_config  --the new parameters
  *
  * Returns: (LogConfigPtr)
- * The old parameters.
+ * The old parameters (if new_config is set), or the current ones.
+ *
+ * Remarks:
+ * The configuration is kept in static storage, and copied in and out
+ * under a sequence count, so a thread that's logging sees either the
+ * old or the new configuration, never a mixture, and changing it
+ * allocates nothing.  Readers take no locks; writers are serialised
+ * by a mutex.
+ *
+ * The returned parameters are the calling thread's own copy, valid
+ * until its next call to log_config() (as in the original, where the
+ * old parameters were a static copy).
  */
 const LogConfig *log_config(const LogConfig * new_config)
 {
-    if (new_config != NULL)
+    static THREAD_LOCAL LogConfig current;
+
+    if (new_config != NULL || !ATOMIC_LOAD_ACQUIRE(&config_loaded))
     {
-        static LogConfig old_config;
+        LogConfig conf;
 
-        old_config = log_state;
-        log_state = *new_config;
-        config = &log_state;
-        return &old_config;
-    }
-    if (config == NULL)
-    {                                  /* first time: load from environment */
-        config = log_config(log_getenv_(&log_state));
+        pthread_mutex_lock(&config_lock);
+        if (!config_loaded)
+        {                              /* first time: load from environment */
+            conf = log_state;
+            if (new_config == NULL)
+            {
+                store_config(log_getenv_(&conf));
+            }
+            ATOMIC_STORE_RELEASE(&config_loaded, 1);
+        }
+        if (new_config != NULL)
+        {
+            conf = *new_config;        /* (new_config may be &current) */
+            current = log_state;       /* (stable: we're the writer) */
+            store_config(&conf);
+            pthread_mutex_unlock(&config_lock);
+            return &current;
+        }
+        pthread_mutex_unlock(&config_lock);
     }
-    return config;
+    load_config(&current);
+    return &current;
 }
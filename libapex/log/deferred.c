@@ -0,0 +1,375 @@
+/*
+ * DEFERRED.C --Capture a log message's arguments, and format them later.
+ *
+ * Contents:
+ * LogArg{}           --A captured printf() argument.
+ * parse_spec()       --Parse a printf() conversion specification.
+ * log_pack_args_()   --Capture a message's arguments, as binary.
+ * log_unpack_args_() --Format a message from its captured arguments.
+ *
+ * Remarks:
+ * The deferred log handler (see async.c) doesn't format messages on
+ * the logging thread: it saves the format string's address and a
+ * binary copy of the arguments, and the writer thread formats them.
+ * log_pack_args_() walks the format's conversions, and copies each
+ * argument (with va_arg(), by the conversion's type) into a LogArg;
+ * "%s" arguments are copied inline, since the caller's string might
+ * not outlive the call.  log_unpack_args_() walks the format again,
+ * and prints each conversion with snprintf(), so the text is exactly
+ * what vsnprintf() would have produced.
+ *
+ * The format must be a string constant (or at least outlive the
+ * message), which is true of almost all log calls.  Conversions that
+ * can't be captured ("%n", "%m", long doubles, wide strings and
+ * characters, unknown ones) make log_pack_args_() fail, and the caller
+ * formats the message normally.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <apex/log.h>
+
+#define LOG_SPEC_MAX 32                /* longest conversion we handle */
+
+/*
+ * LogArg{} --A captured printf() argument.
+ */
+typedef union LogArg_t
+{
+    long long integer;                 /* (any integer conversion) */
+    double real;
+    const void *pointer;
+} LogArg;
+
+/*
+ * LogSpec{} --A parsed printf() conversion specification.
+ */
+typedef struct LogSpec_t
+{
+    size_t len;                        /* the length of the spec text */
+    int star_width;                    /* width is a "*" argument */
+    int star_precision;                /* precision is a "*" argument */
+    char length[3];                    /* "", "hh", "h", "l", "ll", ... */
+    char conversion;
+} LogSpec;
+
+/*
+ * parse_spec() --Parse a printf() conversion specification.
+ *
+ * Parameters:
+ * fmt  --the conversion (starting at the '%')
+ * spec --returns the parsed conversion
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (a conversion we can't capture).
+ */
+static int parse_spec(const char *fmt, LogSpec * spec)
+{
+    const char *f = fmt + 1;
+    size_t n_length = 0;
+
+    memset(spec, 0, sizeof(*spec));
+    f += strspn(f, "-+ #0'");
+    if (*f == '*')
+    {
+        spec->star_width = 1;
+        ++f;
+    }
+    f += strspn(f, "0123456789");
+    if (*f == '.')
+    {
+        if (*++f == '*')
+        {
+            spec->star_precision = 1;
+            ++f;
+        }
+        f += strspn(f, "0123456789");
+    }
+    while (*f != '\0' && strchr("hlzjt", *f) != NULL && n_length < 2)
+    {
+        spec->length[n_length++] = *f++;
+    }
+    spec->conversion = *f;
+    spec->len = (size_t) (f - fmt) + 1;
+    if ((*f == 's' || *f == 'c') && n_length > 0)
+    {
+        return 0;                      /* wide strings/chars: format now */
+    }
+    return *f != '\0' && strchr("diouxXcfFeEgGaAsp%", *f) != NULL
+        && spec->len < LOG_SPEC_MAX;
+}
+
+/*
+ * get_integer() --Fetch an integer argument of a length modifier's type.
+ */
+static long long get_integer(const char *length, char conversion,
+                             va_list * args)
+{
+    int is_signed = conversion == 'd' || conversion == 'i';
+
+    if (strcmp(length, "l") == 0)
+    {
+        return is_signed ? va_arg(*args, long)
+            : (long long) va_arg(*args, unsigned long);
+    }
+    if (strcmp(length, "ll") == 0 || strcmp(length, "j") == 0)
+    {
+        return va_arg(*args, long long);      /* (intmax_t is the same) */
+    }
+    if (strcmp(length, "z") == 0)
+    {
+        return (long long) va_arg(*args, size_t);
+    }
+    if (strcmp(length, "t") == 0)
+    {
+        return (long long) va_arg(*args, ptrdiff_t);
+    }
+    return is_signed ? va_arg(*args, int)
+        : (long long) va_arg(*args, unsigned int);
+}
+
+/*
+ * log_pack_args_() --Capture a message's arguments, as binary.
+ *
+ * Parameters:
+ * buf  --returns the packed arguments
+ * size --the size of buf
+ * fmt  --the message's printf() format
+ * args --the message's arguments
+ *
+ * Returns: (int)
+ * Success: the No. of bytes used; Failure: -1 (the arguments can't be
+ * captured, or don't fit).
+ */
+int log_pack_args_(char *buf, size_t size, const char *fmt, va_list args)
+{
+    size_t pos = 0;
+    va_list ap;
+    int status = 0;
+
+    va_copy(ap, args);
+    for (const char *f = fmt; (f = strchr(f, '%')) != NULL && status == 0;)
+    {
+        LogSpec spec;
+        LogArg arg[3];                 /* (width, precision, value) */
+        size_t n_arg = 0;
+        const char *str = NULL;
+
+        if (!parse_spec(f, &spec))
+        {
+            status = -1;               /* error: can't capture it */
+            break;
+        }
+        f += spec.len;
+        if (spec.conversion == '%')
+        {
+            continue;
+        }
+        if (spec.star_width)
+        {
+            arg[n_arg++].integer = va_arg(ap, int);
+        }
+        if (spec.star_precision)
+        {
+            arg[n_arg++].integer = va_arg(ap, int);
+        }
+        switch (spec.conversion)
+        {
+        case 's':
+            str = va_arg(ap, const char *);
+            arg[n_arg++].pointer = str;
+            break;
+        case 'p':
+            arg[n_arg++].pointer = va_arg(ap, const void *);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            arg[n_arg++].real = va_arg(ap, double);
+            break;
+        default:
+            arg[n_arg++].integer = get_integer(spec.length,
+                                               spec.conversion, &ap);
+            break;
+        }
+        if (size - pos < n_arg * sizeof(LogArg))
+        {
+            status = -1;               /* error: too big */
+            break;
+        }
+        memcpy(buf + pos, arg, n_arg * sizeof(LogArg));
+        pos += n_arg * sizeof(LogArg);
+        if (str != NULL)
+        {                              /* copy the string, NUL-padded */
+            size_t len = strlen(str) + 1;
+            size_t n_pad = (sizeof(LogArg) - len % sizeof(LogArg))
+                % sizeof(LogArg);
+
+            if (size - pos < len + n_pad)
+            {
+                status = -1;
+                break;
+            }
+            memcpy(buf + pos, str, len);
+            memset(buf + pos + len, 0, n_pad);
+            pos += len + n_pad;
+        }
+    }
+    va_end(ap);
+    return status < 0 ? -1 : (int) pos;
+}
+
+/*
+ * put_spec() --Format one captured conversion with snprintf().
+ *
+ * Returns: (int)
+ * The snprintf()-style length of the formatted text.
+ */
+static int put_spec(char *str, size_t len, const char *text,
+                    const LogSpec * spec, const LogArg * arg,
+                    const char *string)
+{
+    char fmt[LOG_SPEC_MAX + 2 * 12];   /* (room for "*" values) */
+    char *out = fmt;
+    int n_star = 0;
+
+    for (size_t i = 0; i < spec->len; ++i)
+    {                                  /* (replace "*"s with their values) */
+        if (text[i] == '*')
+        {
+            long long value = arg[n_star++].integer;
+
+            if (i > 0 && text[i - 1] == '.' && value < 0)
+            {
+                --out;                 /* (negative precision: omitted) */
+            }
+            else
+            {
+                out += sprintf(out, "%lld", value);
+            }
+        }
+        else
+        {
+            *out++ = text[i];
+        }
+    }
+    *out = '\0';
+    arg += n_star;
+
+    switch (spec->conversion)
+    {
+    case 's':
+        return snprintf(str, len, fmt, arg->pointer != NULL ? string : NULL);
+    case 'p':
+        return snprintf(str, len, fmt, arg->pointer);
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        return snprintf(str, len, fmt, arg->real);
+    default:
+        break;
+    }
+    if (strcmp(spec->length, "l") == 0)
+    {
+        return snprintf(str, len, fmt, (long) arg->integer);
+    }
+    if (strcmp(spec->length, "ll") == 0 || strcmp(spec->length, "j") == 0)
+    {
+        return snprintf(str, len, fmt, arg->integer);
+    }
+    if (strcmp(spec->length, "z") == 0)
+    {
+        return snprintf(str, len, fmt, (size_t) arg->integer);
+    }
+    if (strcmp(spec->length, "t") == 0)
+    {
+        return snprintf(str, len, fmt, (ptrdiff_t) arg->integer);
+    }
+    return snprintf(str, len, fmt, (int) arg->integer);
+}
+
+/*
+ * log_unpack_args_() --Format a message from its captured arguments.
+ *
+ * Parameters:
+ * str  --returns the formatted message
+ * len  --the size of str
+ * fmt  --the message's printf() format
+ * buf  --the arguments, as packed by log_pack_args_()
+ *
+ * Returns: (int)
+ * The vsnprintf()-style length of the formatted message.
+ */
+int log_unpack_args_(char *str, size_t len, const char *fmt,
+                     const char *buf)
+{
+    const char *f = fmt;
+    int total = 0;
+
+    while (*f != '\0')
+    {
+        const char *percent = strchr(f, '%');
+        size_t n_text = percent != NULL ? (size_t) (percent - f) : strlen(f);
+        LogSpec spec;
+        LogArg arg[3];
+        size_t n_arg;
+        int n;
+
+        if (n_text > 0)
+        {                              /* (plain text, up to the next '%') */
+            if ((size_t) total < len)
+            {
+                size_t n_copy = MIN(n_text, len - (size_t) total - 1);
+
+                memcpy(str + total, f, n_copy);
+                str[(size_t) total + n_copy] = '\0';
+            }
+            total += (int) n_text;
+            f += n_text;
+            continue;
+        }
+        parse_spec(f, &spec);          /* (it parsed when it was packed) */
+        if (spec.conversion == '%')
+        {
+            n = snprintf(str + MIN((size_t) total, len),
+                         len - MIN((size_t) total, len), "%%");
+        }
+        else
+        {
+            n_arg = (size_t) (spec.star_width + spec.star_precision + 1);
+            memcpy(arg, buf, n_arg * sizeof(LogArg));
+            buf += n_arg * sizeof(LogArg);
+            n = put_spec(str + MIN((size_t) total, len),
+                         len - MIN((size_t) total, len), f, &spec, arg,
+                         buf);
+            if (spec.conversion == 's' && arg[n_arg - 1].pointer != NULL)
+            {                          /* (skip the inline copy) */
+                size_t n_str = strlen(buf) + 1;
+
+                buf += n_str + (sizeof(LogArg) - n_str % sizeof(LogArg))
+                    % sizeof(LogArg);
+            }
+        }
+        total += MAX(n, 0);
+        f += spec.len;
+    }
+    if (len > 0 && (size_t) total < len)
+    {
+        str[total] = '\0';
+    }
+    return total;
+}
@@ -22,6 +22,11 @@ typedef struct LogAlias_t
 LogAlias log_alias[] = {
     {"syslog", log_syslog},
     {"stderr", log_stderr},
+    {"async", log_async},
+    {"deferred", log_deferred},
+    {"journal", log_journal},
+    {"json", log_json},
+    {"logfmt", log_logfmt},
     {NULL, NULL}
 };
 
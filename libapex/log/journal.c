@@ -0,0 +1,227 @@
+/*
+ * JOURNAL.C --A log-handler that sends messages directly to journald.
+ *
+ * Contents:
+ * LogJournalHeader{} --A thread's cached identity/facility fields.
+ * open_journal()     --Connect to the journal socket: a pthread_once() proc.
+ * get_header()       --Return the (cached) fields common to every message.
+ * log_journal()      --Output handler that logs a message to journald.
+ *
+ * Remarks:
+ * This handler sends each message as one datagram, in journald's
+ * native protocol ("FIELD=value" lines), on a connected Unix socket.
+ * Unlike syslog(3), it doesn't reformat the message as RFC 3164 text,
+ * or take a lock: the datagram is assembled from an iovec of the
+ * priority field (a constant), the identity/facility fields (cached
+ * per thread), and the message, and sent with one sendmsg().  The
+ * caller context (for trace messages) becomes the CODE_FUNC,
+ * CODE_FILE and CODE_LINE fields, and the errno the ERRNO field, so
+ * journalctl can filter on them.
+ *
+ * The socket is LOG_JOURNAL_SOCKET, or the environment variable of the
+ * same name.  If it can't be reached (e.g. there's no journald), the
+ * message is sent to log_syslog() instead.
+ *
+ * Messages aren't batched (e.g. with sendmmsg()): a handler only ever
+ * has one message, and it's already sent with a single system call.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <apex/log.h>
+
+#define LOG_JOURNAL_SOCKET "/run/systemd/journal/socket"
+#define LOG_JOURNAL_MAX 2048           /* longer messages are truncated */
+
+#ifndef LOG_FAC
+#define LOG_FAC(facility_) ((facility_) >> 3)
+#endif /* LOG_FAC */
+
+/*
+ * LogJournalHeader{} --A thread's cached identity/facility fields.
+ */
+typedef struct LogJournalHeader_t
+{
+    const char *identity;              /* the config's fields */
+    size_t facility;
+    size_t len;
+    char text[LOG_LINE_MAX];
+} LogJournalHeader;
+
+static const char *priority_field[] = {
+    "PRIORITY=0\n", "PRIORITY=1\n", "PRIORITY=2\n", "PRIORITY=3\n",
+    "PRIORITY=4\n", "PRIORITY=5\n", "PRIORITY=6\n", "PRIORITY=7\n"
+};
+
+static int journal_fd = -1;
+
+/*
+ * open_journal() --Connect to the journal socket: a pthread_once() proc.
+ */
+static void open_journal(void)
+{
+    const char *path = getenv("LOG_JOURNAL_SOCKET");
+    struct sockaddr_un addr;
+    int fd;
+
+    if (path == NULL)
+    {
+        path = LOG_JOURNAL_SOCKET;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)
+        || (fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+    {
+        return;                        /* error: no journal */
+    }
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return;                        /* error: no journal */
+    }
+    journal_fd = fd;
+}
+
+/*
+ * get_header() --Return the (cached) fields common to every message.
+ *
+ * Remarks:
+ * The fields are only re-formatted when the configuration's identity
+ * or facility changes.
+ */
+static const LogJournalHeader *get_header(const LogConfig * config)
+{
+    static THREAD_LOCAL LogJournalHeader header;
+    int n;
+
+    if (header.len != 0 && header.identity == config->identity
+        && header.facility == config->facility)
+    {
+        return &header;
+    }
+    n = snprintf(header.text, sizeof(header.text), "SYSLOG_FACILITY=%zu\n",
+                 (size_t) LOG_FAC(config->facility));
+    if (config->identity != NULL)
+    {                                  /* (the facility always fits) */
+        n += snprintf(header.text + n, sizeof(header.text) - (size_t) n,
+                      "SYSLOG_IDENTIFIER=%s\n", config->identity);
+    }
+    header.identity = config->identity;
+    header.facility = config->facility;
+    header.len = MIN((size_t) n, sizeof(header.text) - 1);
+    return &header;
+}
+
+/*
+ * log_journal() --Output handler that logs a message to journald.
+ *
+ * Returns: (int)
+ * Success: the No. of characters in the message; Failure: -1.
+ *
+ * Remarks:
+ * A message containing newlines is sent in the protocol's binary form
+ * ("MESSAGE\n", a 64-bit little-endian length, then the text).
+ */
+int log_journal(const LogConfig * config, const LogContext * caller,
+                int sys_errno, size_t priority, const char *fmt,
+                va_list args)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    const LogJournalHeader *header = get_header(config);
+    char text[LOG_JOURNAL_MAX], code[LOG_LINE_MAX];
+    char binary[sizeof("MESSAGE\n") - 1 + 8];
+    struct iovec iov[6];
+    struct msghdr msg;
+    va_list args_copy;
+    size_t n_text, n_code = 0;
+    int n, n_iov = 0;
+
+    pthread_once(&once, open_journal);
+    va_copy(args_copy, args);          /* (in case of fallback to syslog) */
+    n = vsnprintf(text, sizeof(text), fmt, args_copy);
+    va_end(args_copy);
+    if (n < 0)
+    {
+        return -1;                     /* error: bad sprintf format */
+    }
+    n_text = MIN((size_t) n, sizeof(text) - 1);
+    if (journal_fd < 0)
+    {
+        return log_syslog(config, caller, sys_errno, priority, fmt, args);
+    }
+    if (sys_errno != 0 && n_text < sizeof(text) - 1)
+    {                                  /* append errno-related message */
+        n = snprintf(text + n_text, sizeof(text) - n_text, ": %s",
+                     strerror(sys_errno));
+        n_text = MIN(n_text + (size_t) MAX(n, 0), sizeof(text) - 1);
+    }
+    if (caller != NULL)
+    {
+        n = snprintf(code, sizeof(code), "CODE_FILE=%s\nCODE_LINE=%d\n",
+                     caller->file != NULL ? caller->file : "",
+                     caller->line);
+        n_code = MIN((size_t) MAX(n, 0), sizeof(code) - 1);
+        if (caller->function != NULL)
+        {
+            n = snprintf(code + n_code, sizeof(code) - n_code,
+                         "CODE_FUNC=%s\n", caller->function);
+            n_code = MIN(n_code + (size_t) MAX(n, 0), sizeof(code) - 1);
+        }
+    }
+    if (sys_errno != 0)
+    {
+        n = snprintf(code + n_code, sizeof(code) - n_code, "ERRNO=%d\n",
+                     sys_errno);
+        n_code = MIN(n_code + (size_t) MAX(n, 0), sizeof(code) - 1);
+    }
+
+    iov[n_iov].iov_base = (char *) priority_field[priority & 7];
+    iov[n_iov++].iov_len = strlen(priority_field[priority & 7]);
+    iov[n_iov].iov_base = (char *) header->text;
+    iov[n_iov++].iov_len = header->len;
+    if (memchr(text, '\n', n_text) == NULL)
+    {
+        iov[n_iov].iov_base = (char *) "MESSAGE=";
+        iov[n_iov++].iov_len = sizeof("MESSAGE=") - 1;
+    }
+    else
+    {                                  /* (binary form) */
+        uint64_t len = n_text;
+
+        memcpy(binary, "MESSAGE\n", sizeof("MESSAGE\n") - 1);
+        for (size_t i = 0; i < 8; ++i)
+        {
+            binary[sizeof("MESSAGE\n") - 1 + i] = (char) (len >> (8 * i));
+        }
+        iov[n_iov].iov_base = binary;
+        iov[n_iov++].iov_len = sizeof(binary);
+    }
+    iov[n_iov].iov_base = text;
+    iov[n_iov++].iov_len = n_text;
+    iov[n_iov].iov_base = (char *) "\n";
+    iov[n_iov++].iov_len = 1;
+    iov[n_iov].iov_base = code;
+    iov[n_iov++].iov_len = n_code;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t) n_iov;
+    SYS_RETRY(n, (int) sendmsg(journal_fd, &msg, MSG_NOSIGNAL));
+    if (n < 0)
+    {                                  /* journal failed: use syslog! */
+        return log_syslog(config, caller, sys_errno, priority, fmt, args);
+    }
+    return (int) n_text;
+}
@@ -0,0 +1,159 @@
+/*
+ * LIMIT.C --Rate-limited and sampled log messages.
+ *
+ * Contents:
+ * log_limit_()       --Decide if a rate-limited message can be logged.
+ * log_sample_()      --Decide if a sampled message is logged.
+ * log_allowed()      --Log a message that passed its limit, and the count.
+ * log_limit_msg()    --Log a message, subject to a rate limit.
+ * log_sample_msg()   --Log every n'th message.
+ *
+ * Remarks:
+ * The rate limit is a token bucket of burst tokens, refilled at rate
+ * tokens/second, implemented as the "generic cell rate algorithm": the
+ * state is a single "theoretical arrival time" (tat), the time at
+ * which the bucket will be full again.  A message is allowed if tat is
+ * less than burst intervals in the future, and then tat is advanced by
+ * one interval.  That's one compare-and-swap, so concurrent callers of
+ * the same site (whose state is shared) need no lock.
+ *
+ * Both limits are checked only after the message's priority has been
+ * checked, so disabled messages don't consume the budget.  When a
+ * message is allowed, the No. of messages suppressed since the
+ * previous one is logged after it (at the same priority).
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <stdint.h>
+
+#include <apex/atomic.h>
+#include <apex/clock.h>
+#include <apex/log.h>
+
+/*
+ * log_limit_() --Decide if a rate-limited message can be logged.
+ *
+ * Parameters:
+ * limit        --the call site's rate limit
+ * n_suppressed --returns the No. of messages suppressed before this one
+ *
+ * Returns: (int)
+ * 1: log the message; 0: suppress it.
+ */
+int log_limit_(LogLimit * limit, size_t *n_suppressed)
+{
+    uint64_t interval = NS_PER_SEC / MAX(limit->rate, 1);
+    uint64_t tolerance = interval * MAX(limit->burst, 1);
+    uint64_t now = (uint64_t) ns_monotonic();
+    uint64_t tat = ATOMIC_LOAD_RELAXED(&limit->tat);
+
+    do
+    {
+        if (tat > now + tolerance - interval)
+        {                              /* bucket is empty */
+            ATOMIC_ADD(&limit->n_suppressed, 1);
+            return 0;
+        }
+    } while (!ATOMIC_CAS(&limit->tat, &tat, MAX(tat, now) + interval));
+    *n_suppressed = ATOMIC_EXCHANGE(&limit->n_suppressed, 0);
+    return 1;
+}
+
+/*
+ * log_sample_() --Decide if a sampled message is logged.
+ *
+ * Parameters:
+ * sample       --the call site's sampling state
+ * n_suppressed --returns the No. of messages skipped before this one
+ *
+ * Returns: (int)
+ * 1: log the message; 0: skip it.
+ *
+ * Remarks:
+ * The first message is always logged, then every n'th one.
+ */
+int log_sample_(LogSample * sample, size_t *n_suppressed)
+{
+    size_t n = MAX(sample->n, 1);
+    size_t count = ATOMIC_ADD(&sample->count, 1);
+
+    if (count % n != 0)
+    {
+        return 0;
+    }
+    *n_suppressed = count == 0 ? 0 : n - 1;
+    return 1;
+}
+
+/*
+ * log_allowed() --Log a message that passed its limit, and the count.
+ */
+static int log_allowed(const LogConfig * config, size_t priority,
+                       size_t n_suppressed, const char *fmt, va_list args)
+{
+    int status = config->output(config, NULL, 0, priority, fmt, args);
+
+    if (n_suppressed > 0)
+    {
+        log_msg(priority, "%zu similar messages suppressed", n_suppressed);
+    }
+    return status;
+}
+
+/*
+ * log_limit_msg() --Log a message, subject to a rate limit.
+ *
+ * Parameters:
+ * limit    --the call site's rate limit (see LOG_LIMIT_INIT())
+ * priority --the message priority
+ * fmt...   --printf-style argument list
+ *
+ * Returns: (int)
+ * The No. of characters written (0 if the message was suppressed).
+ */
+int log_limit_msg(LogLimit * limit, size_t priority, const char *fmt, ...)
+{
+    const LogConfig *config = log_config(NULL);
+    size_t n_suppressed;
+    va_list args;
+    int status;
+
+    if (priority > config->threshold_priority
+        || !log_limit_(limit, &n_suppressed))
+    {
+        return 0;
+    }
+    va_start(args, fmt);
+    status = log_allowed(config, priority, n_suppressed, fmt, args);
+    va_end(args);
+    return status;
+}
+
+/*
+ * log_sample_msg() --Log every n'th message.
+ *
+ * Parameters:
+ * sample   --the call site's sampling state (see LOG_SAMPLE_INIT())
+ * priority --the message priority
+ * fmt...   --printf-style argument list
+ *
+ * Returns: (int)
+ * The No. of characters written (0 if the message was skipped).
+ */
+int log_sample_msg(LogSample * sample, size_t priority, const char *fmt, ...)
+{
+    const LogConfig *config = log_config(NULL);
+    size_t n_suppressed;
+    va_list args;
+    int status;
+
+    if (priority > config->threshold_priority
+        || !log_sample_(sample, &n_suppressed))
+    {
+        return 0;
+    }
+    va_start(args, fmt);
+    status = log_allowed(config, priority, n_suppressed, fmt, args);
+    va_end(args);
+    return status;
+}
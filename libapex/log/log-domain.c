@@ -6,36 +6,74 @@
  * VA_DOMAIN_LOG()      --Boilerplate var-args processing and logging behaviour.
  * VA_DOMAIN_VOID_LOG() --Boilerplate var-args processing for void functions.
  * vlog_msg()           --Log a message with fmt, va_list arguments.
+ * domain_cmp()         --Compare a domain pattern with a key.
+ * free_config()        --Free a domain configuration.
  * log_domain_init()    --Intialise the logging state from a domain specification.
+ * domain_match()       --Test if a domain name matches the configured list.
  * log_domain_status()  --Return (and initialise, if needed) a domain's log status.
  * log_domain_msg()     --Conditionally log a message based on domain.
+ * log_domain_limit_msg() --Log a domain's message, subject to a rate limit.
+ * log_domain_sample_msg() --Log every n'th domain message.
  *
  * Remarks:
  * This module extends the basic logging, which restricts output by
  * priority, with per-domain filtering.  The domain filtering is
  * controlled by a list of domain names, which is either interpreted as
  * a list of domains to include (excluding all others), or exclude (and
- * thereby include all others).
+ * thereby include all others).  The list may contain prefix patterns
+ * (e.g. "net.*", matching "net.tcp", "net.tcp.conn", ...), and "*"
+ * matches everything.
  *
  * The default configuration is to log everything, but this can be
  * explicitly overridden by initialising with an explicit list.
+ *
+ * The list is stored in a hash table, so a domain's status is found
+ * with one lookup per component of its name.  The status is cached in
+ * the LogDomain, together with the configuration's generation; each
+ * log_domain_init() bumps the generation, so every domain re-checks
+ * its status (once) after the list changes.  The hot path is a single
+ * comparison of the domain's generation with the current one.
+ *
+ * Only that (rare) re-check reads the configuration itself, so it
+ * does so holding domain_lock; log_domain_init() swaps the
+ * configuration under the same lock, and can then free the old one,
+ * since no thread can still be using it.
  */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/atomic.h>
+#include <apex/hash.h>
 #include <apex/log-domain.h>
 #include <apex/estring.h>
 
+#define LOG_DOMAIN_NAME_MAX 128        /* longest prefix we'll match */
+
 static char all_domains[] = "*";
 static char *default_domains[] = { all_domains, NULL };
 
 typedef struct LogDomainConfig_t
 {
     char **domains;                    /* list of domain names */
+    OHashPtr patterns;                 /* domains, hashed (NULL: all) */
     LogDomainStatus mode;              /* logging status of domains in list */
 } LogDomainConfig;
 
 /*
  * domain_config[] --the current domain logging state.
+ *
+ * Remarks:
+ * log_domain_init() replaces the configuration, and then bumps
+ * domain_generation; both domain_config and the configuration it
+ * points to are only accessed with domain_lock held.
  */
-LogDomainConfig domain_config = { default_domains, LOG_DOMAIN_PRINT };
+static LogDomainConfig default_config = {
+    default_domains, NULL, LOG_DOMAIN_PRINT
+};
+static LogDomainConfig *domain_config = &default_config;
+static unsigned int domain_generation = 1;
+static pthread_mutex_t domain_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * VA_DOMAIN_LOG() --Boilerplate var-args processing and logging behaviour.
@@ -80,6 +118,34 @@ static inline int vlog_msg(size_t priority, int log_errno, const char *fmt,
     return 0;
 }
 
+/*
+ * domain_cmp() --Compare a domain pattern with a key: a CompareProc.
+ */
+static int domain_cmp(const void *data, const void *key)
+{
+    return strcmp((const char *) data, (const char *) key);
+}
+
+/*
+ * free_config() --Free a domain configuration.
+ */
+static void free_config(LogDomainConfig * config)
+{
+    if (config == NULL || config == &default_config)
+    {
+        return;
+    }
+    if (config->domains != NULL)
+    {
+        free_str_list(config->domains);
+    }
+    if (config->patterns != NULL)
+    {
+        ohash_free(config->patterns);
+    }
+    free(config);
+}
+
 /*
  * log_domain_init() --Intialise the logging state from a domain specification.
  *
@@ -95,33 +161,85 @@ static inline int vlog_msg(size_t priority, int log_errno, const char *fmt,
  * which specifies that only the listed domains are to be printed.  If
  * the specification starts with the character "!"
  * (e.g. "!this,that,other") the config is treated as excluding the
- * listed domains, and printing everything else.
+ * listed domains, and printing everything else.  A domain ending in
+ * ".*" (e.g. "net.*") matches every domain with that prefix.
  *
  * If domain_spec is NULL, this routine uses the environment
  * variable LOG_DOMAINS to define the domain_spec.
  *
- * If this routine is never called, all domains are logged.
+ * If this routine is never called, all domains are logged.  It can be
+ * called again at any time (from any thread) to change the domains;
+ * the change takes effect immediately, and the replaced
+ * configuration is freed.
  */
 void log_domain_init(const char *domain_spec)
 {
-    domain_config.mode = LOG_DOMAIN_PRINT;
+    LogDomainConfig *config = &default_config;
 
-    if (domain_spec == NULL && (domain_spec = getenv("LOG_DOMAINS")) == NULL)
+    if (domain_spec != NULL || (domain_spec = getenv("LOG_DOMAINS")) != NULL)
     {
-        domain_config.domains = (char **) default_domains;
-        return;
+        if ((config = calloc(1, sizeof(*config))) == NULL)
+        {
+            return;                    /* error: malloc failed */
+        }
+        config->mode = LOG_DOMAIN_PRINT;
+        if (*domain_spec == '!')
+        {                              /* negated list */
+            config->mode = LOG_DOMAIN_SUPPRESS;
+            ++domain_spec;
+        }
+        config->domains = new_str_list(domain_spec, ',');
+        config->patterns = ohash_new(hash_key_wy, 16);
+        if (config->domains == NULL || config->patterns == NULL)
+        {
+            free_config(config);
+            return;                    /* error: malloc failed */
+        }
+        for (char **g = config->domains; *g != NULL; ++g)
+        {
+            if (ohash_find(config->patterns, domain_cmp, *g) == NULL)
+            {
+                ohash_insert(config->patterns, *g);
+            }
+        }
     }
+    pthread_mutex_lock(&domain_lock);
+    free_config(domain_config);
+    domain_config = config;
+    ATOMIC_ADD(&domain_generation, 1);
+    pthread_mutex_unlock(&domain_lock);
+}
 
-    if (*domain_spec == '!')
-    {                                  /* negated list */
-        domain_config.mode = LOG_DOMAIN_SUPPRESS;
-        ++domain_spec;
+/*
+ * domain_match() --Test if a domain name matches the configured list.
+ *
+ * Remarks:
+ * The name itself is looked up, then each of its prefix patterns
+ * (for "net.tcp.conn": "net.tcp.*", "net.*"), and finally "*".
+ */
+static int domain_match(const LogDomainConfig * config, const char *name)
+{
+    char pattern[LOG_DOMAIN_NAME_MAX + 2];
+
+    if (config->patterns == NULL
+        || ohash_find(config->patterns, domain_cmp, (void *) name) != NULL)
+    {
+        return 1;
     }
-    if (domain_config.domains != default_domains)
-    {                                  /* release previous domain list */
-        free_str_list(domain_config.domains);
+    for (size_t i = strnlen(name, LOG_DOMAIN_NAME_MAX); i-- > 0;)
+    {
+        if (name[i] == '.')
+        {
+            memcpy(pattern, name, i + 1);
+            pattern[i + 1] = '*';
+            pattern[i + 2] = '\0';
+            if (ohash_find(config->patterns, domain_cmp, pattern) != NULL)
+            {
+                return 1;
+            }
+        }
     }
-    domain_config.domains = new_str_list(domain_spec, ',');
+    return ohash_find(config->patterns, domain_cmp, all_domains) != NULL;
 }
 
 /*
@@ -134,26 +252,33 @@ void log_domain_init(const char *domain_spec)
  * The logging status of this domain, possibly freshly set.
  *
  * Remarks:
- * If the domain is uninitialised, this routine scans for it in the
- * list of domains created by log_domain_init(), and updates the domain's
- * status.
+ * If the domain's status is stale (the domain is uninitialised, or the
+ * configuration has changed since it was set), this routine looks it
+ * up in the configuration created by log_domain_init(), and updates
+ * the domain's status.  The generation is read before the
+ * configuration, so a concurrent change is noticed on the next call.
+ * The configuration is read with domain_lock held, so that it can't
+ * be freed meanwhile.
  */
 static LogDomainStatus log_domain_status(LogDomain * domain)
 {
-    if (domain->status == LOG_DOMAIN_UNDEFINED)
+    unsigned int generation = ATOMIC_LOAD_ACQUIRE(&domain_generation);
+    const LogDomainConfig *config;
+    LogDomainStatus status;
+
+    if (ATOMIC_LOAD_ACQUIRE(&domain->generation) == generation)
     {
-        for (char **g = domain_config.domains; *g != NULL; ++g)
-        {
-            if (*g == all_domains || strcmp(domain->name, *g) == 0)
-            {                          /* linear scan: assume a small list */
-                return domain->status = domain_config.mode;
-            }
-        }
-        domain->status =
-            (domain_config.mode == LOG_DOMAIN_PRINT)
-            ? LOG_DOMAIN_SUPPRESS : LOG_DOMAIN_PRINT;
+        return ATOMIC_LOAD_RELAXED(&domain->status);
     }
-    return domain->status;
+    pthread_mutex_lock(&domain_lock);
+    config = domain_config;
+    status = domain_match(config, domain->name) ? config->mode
+        : (config->mode == LOG_DOMAIN_PRINT)
+        ? LOG_DOMAIN_SUPPRESS : LOG_DOMAIN_PRINT;
+    pthread_mutex_unlock(&domain_lock);
+    ATOMIC_STORE_RELAXED(&domain->status, status);
+    ATOMIC_STORE_RELEASE(&domain->generation, generation);
+    return status;
 }
 
 /*
@@ -247,3 +372,61 @@ void log_domain_sys_abort(LogDomain * domain, const char *fmt, ...)
     abort();
     exit(1);                           /* NOTREACHED */
 }
+
+/*
+ * log_domain_limit_msg() --Log a domain's message, subject to a rate limit.
+ *
+ * Remarks:
+ * This is log_limit_msg(), filtered by domain first, so a suppressed
+ * domain doesn't use up the rate limit.
+ */
+int log_domain_limit_msg(LogDomain * domain, LogLimit * limit,
+                         size_t priority, const char *fmt, ...)
+{
+    size_t n_suppressed;
+    va_list args;
+    int status;
+
+    if (log_domain_status(domain) != LOG_DOMAIN_PRINT
+        || priority > log_config(NULL)->threshold_priority
+        || !log_limit_(limit, &n_suppressed))
+    {
+        return 0;
+    }
+    va_start(args, fmt);
+    status = vlog_msg(priority, 0, fmt, args);
+    va_end(args);
+    if (n_suppressed > 0)
+    {
+        log_domain_msg(domain, priority, "%zu similar messages suppressed",
+                       n_suppressed);
+    }
+    return status;
+}
+
+/*
+ * log_domain_sample_msg() --Log every n'th domain message.
+ */
+int log_domain_sample_msg(LogDomain * domain, LogSample * sample,
+                          size_t priority, const char *fmt, ...)
+{
+    size_t n_suppressed;
+    va_list args;
+    int status;
+
+    if (log_domain_status(domain) != LOG_DOMAIN_PRINT
+        || priority > log_config(NULL)->threshold_priority
+        || !log_sample_(sample, &n_suppressed))
+    {
+        return 0;
+    }
+    va_start(args, fmt);
+    status = vlog_msg(priority, 0, fmt, args);
+    va_end(args);
+    if (n_suppressed > 0)
+    {
+        log_domain_msg(domain, priority, "%zu similar messages suppressed",
+                       n_suppressed);
+    }
+    return status;
+}
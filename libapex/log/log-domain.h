@@ -8,7 +8,8 @@
  * routine is called, the domain is queried/initialised.
  *
  * The configuration controlling which domains are printed is changeable
- * by the user via log_domain_init().  By default all domains are printed.
+ * by the user via log_domain_init(), at any time.  By default all
+ * domains are printed.
  */
 #ifndef LOG_DOMAIN_H
 #define LOG_DOMAIN_H
@@ -28,9 +29,12 @@ extern "C"
     typedef struct LogDomain_t
     {
         const char *name;
-        LogDomainStatus status;
+        LogDomainStatus status;        /* (cached) */
+        unsigned int generation;       /* the configuration status is from */
     } LogDomain, *LogDomainPtr;
 
+#define LOG_DOMAIN_INIT(name_) { (name_), LOG_DOMAIN_UNDEFINED, 0 }
+
     void log_domain_init(const char *domain_spec);
 
     /*
@@ -65,6 +69,30 @@ extern "C"
     void log_domain_sys_abort(LogDomainPtr domain, const char *fmt,
                               ...) PRINTF_ATTRIBUTE(2, 3);
 
+    /*
+     * These routines are rate-limited/sampled versions of
+     * log_domain_msg() (see log_limit_msg(), log_sample_msg()).
+     */
+    int log_domain_limit_msg(LogDomainPtr domain, LogLimit * limit,
+                             size_t priority, const char *fmt, ...)
+        PRINTF_ATTRIBUTE(4, 5);
+    int log_domain_sample_msg(LogDomainPtr domain, LogSample * sample,
+                              size_t priority, const char *fmt, ...)
+        PRINTF_ATTRIBUTE(4, 5);
+
+#define log_domain_ratelimit(domain, rate, burst, priority, fmt, ...) \
+    do { \
+        static LogLimit log_limit_state_ = LOG_LIMIT_INIT(rate, burst); \
+        log_domain_limit_msg(domain, &log_limit_state_, priority, \
+                             fmt, ##__VA_ARGS__); \
+    } while (0)
+#define log_domain_sample(domain, n, priority, fmt, ...) \
+    do { \
+        static LogSample log_sample_state_ = LOG_SAMPLE_INIT(n); \
+        log_domain_sample_msg(domain, &log_sample_state_, priority, \
+                              fmt, ##__VA_ARGS__); \
+    } while (0)
+
     /*
      * These routines provide log caller information.
      */
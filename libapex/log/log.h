@@ -8,6 +8,9 @@
 #include <stdarg.h>
 #include SYSLOG
 #include <errno.h>
+#include <stdint.h>
+#include <time.h>                       /* struct timespec */
+#include <apex/metrics.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -66,6 +69,56 @@ extern "C"
 #define trace_debug(fmt, ...) \
     trace_msg(__func__, __FILE__, __LINE__, LOG_DEBUG, fmt, ##__VA_ARGS__)
 
+    /*
+     * LogLimit --A call site's rate limit (a token bucket).
+     */
+    typedef struct LogLimit_t
+    {
+        unsigned int rate;             /* messages per second (> 0) */
+        unsigned int burst;            /* messages allowed at once */
+        uint64_t tat;                  /* "theoretical arrival time" (nsec) */
+        size_t n_suppressed;           /* messages since the last one logged */
+    } LogLimit;
+
+    /*
+     * LogSample --A call site's 1-in-N sampling state.
+     */
+    typedef struct LogSample_t
+    {
+        unsigned int n;                /* log every n'th message (> 0) */
+        size_t count;                  /* messages so far */
+    } LogSample;
+
+#define LOG_LIMIT_INIT(rate_, burst_) { (rate_), (burst_), 0, 0 }
+#define LOG_SAMPLE_INIT(n_) { (n_), 0 }
+
+    int log_limit_(LogLimit * limit, size_t *n_suppressed);
+    int log_sample_(LogSample * sample, size_t *n_suppressed);
+    int log_limit_msg(LogLimit * limit, size_t priority, const char *fmt,
+                      ...) PRINTF_ATTRIBUTE(3, 4);
+    int log_sample_msg(LogSample * sample, size_t priority,
+                       const char *fmt, ...) PRINTF_ATTRIBUTE(3, 4);
+
+/*
+ * log_ratelimit() --Log at most rate messages/second (after a burst).
+ * log_sample()    --Log every n'th message.
+ *
+ * Remarks:
+ * Each call site has its own (static) state, so a flood of one message
+ * doesn't silence the others.  When a message is logged after some
+ * were suppressed, the count is logged too.
+ */
+#define log_ratelimit(rate, burst, priority, fmt, ...) \
+    do { \
+        static LogLimit log_limit_state_ = LOG_LIMIT_INIT(rate, burst); \
+        log_limit_msg(&log_limit_state_, priority, fmt, ##__VA_ARGS__); \
+    } while (0)
+#define log_sample(n, priority, fmt, ...) \
+    do { \
+        static LogSample log_sample_state_ = LOG_SAMPLE_INIT(n); \
+        log_sample_msg(&log_sample_state_, priority, fmt, ##__VA_ARGS__); \
+    } while (0)
+
     typedef struct LogConfig_t LogConfig;
     typedef struct LogContext_t LogContext;
 
@@ -85,6 +138,11 @@ extern "C"
      *
      *  * log_stderr --log the message to the stderr stream with a timestamp
      *  * log_syslog --log the message to the syslog service.
+     *  * log_async  --log to stderr from a background thread (see async.c).
+     *  * log_deferred --like log_async, but formatted by the thread too.
+     *  * log_journal --send the message to journald's socket directly
+     *  * log_json   --log the message to stderr as a JSON object
+     *  * log_logfmt --log the message to stderr as logfmt key=value pairs
      *
      *  Custom handlers can be defined by log_config(), log_handler().
      */
@@ -103,6 +161,90 @@ extern "C"
                    int sys_errno,
                    size_t priority, const char *fmt, va_list args)
         PRINTF_ATTRIBUTE(5, 0);
+    int log_async(const LogConfig * config, const LogContext * caller,
+                  int sys_errno,
+                  size_t priority, const char *fmt, va_list args)
+        PRINTF_ATTRIBUTE(5, 0);
+    int log_deferred(const LogConfig * config, const LogContext * caller,
+                     int sys_errno,
+                     size_t priority, const char *fmt, va_list args)
+        PRINTF_ATTRIBUTE(5, 0);
+
+    int log_journal(const LogConfig * config, const LogContext * caller,
+                    int sys_errno,
+                    size_t priority, const char *fmt, va_list args)
+        PRINTF_ATTRIBUTE(5, 0);
+    int log_json(const LogConfig * config, const LogContext * caller,
+                 int sys_errno,
+                 size_t priority, const char *fmt, va_list args)
+        PRINTF_ATTRIBUTE(5, 0);
+    int log_logfmt(const LogConfig * config, const LogContext * caller,
+                   int sys_errno,
+                   size_t priority, const char *fmt, va_list args)
+        PRINTF_ATTRIBUTE(5, 0);
+
+    /*
+     * LogField --A typed key/value field of a structured message.
+     *
+     * Remarks:
+     * The key is printed verbatim (it should be a constant that needs
+     * no escaping); string values are escaped as necessary.
+     */
+    typedef enum LogFieldType_t
+    {
+        LOG_FIELD_STRING,
+        LOG_FIELD_INTEGER,
+        LOG_FIELD_REAL
+    } LogFieldType;
+
+    typedef struct LogField_t
+    {
+        const char *key;
+        LogFieldType type;
+        union
+        {
+            const char *string;
+            long long integer;
+            double real;
+        } value;
+    } LogField;
+
+#define LOG_STRING(key_, value_) \
+    { (key_), LOG_FIELD_STRING, { .string = (value_) } }
+#define LOG_INTEGER(key_, value_) \
+    { (key_), LOG_FIELD_INTEGER, { .integer = (value_) } }
+#define LOG_REAL(key_, value_) \
+    { (key_), LOG_FIELD_REAL, { .real = (value_) } }
+
+    int log_fields(size_t priority, const LogField * field, size_t n_field,
+                   const char *fmt, ...) PRINTF_ATTRIBUTE(4, 5);
+
+    /*
+     * LogAsyncPolicy --what log_async() does when its ring is full.
+     */
+    typedef enum LogAsyncPolicy_t
+    {
+        LOG_ASYNC_DROP,                /* discard the message */
+        LOG_ASYNC_COUNT,               /* discard it, and report the count */
+        LOG_ASYNC_BLOCK                /* wait for the writer */
+    } LogAsyncPolicy;
+
+    int log_async_start(size_t n_message, LogAsyncPolicy policy);
+    void log_async_stop(void);
+    size_t log_async_dropped(void);
+    MetricPtr log_metrics(void);
+    void log_count_(size_t priority);
+
+    int log_stderr_format_(const LogConfig * config,
+                           const LogContext * caller, int sys_errno,
+                           size_t priority, const struct timespec *when,
+                           const char *fmt, va_list args, char *text)
+        PRINTF_ATTRIBUTE(6, 0);
+    int log_stderr_put_(size_t priority, const char *text);
+    int log_pack_args_(char *buf, size_t size, const char *fmt,
+                       va_list args);
+    int log_unpack_args_(char *str, size_t len, const char *fmt,
+                         const char *buf);
 
     const LogConfig *log_init(const char *identity);
     LogOutputProc log_handler(const char *name);
@@ -137,17 +279,86 @@ extern "C"
 }
 #endif                                 /* C++ */
 
+/*
+ * LOG_COMPILE_LEVEL --the lowest priority compiled in.
+ *
+ * Remarks:
+ * Messages of lower priority than LOG_COMPILE_LEVEL (e.g. LOG_INFO,
+ * LOG_DEBUG for -DLOG_COMPILE_LEVEL=LOG_NOTICE) are expanded to NOPs,
+ * so their arguments aren't even evaluated.  The default is LOG_DEBUG
+ * (everything), or LOG_INFO if NDEBUG is defined.  This only affects
+ * the eponymous-priority routines and the trace_* macros; log_msg()
+ * and log_if() can check any priority (see log_enabled()).
+ */
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL LOG_INFO
+#else
+#define LOG_COMPILE_LEVEL LOG_DEBUG
+#endif                                 /* NDEBUG */
+#endif                                 /* LOG_COMPILE_LEVEL */
+
+#if LOG_COMPILE_LEVEL < LOG_DEBUG
+#undef trace_debug
+#define debug(fmt, ...) ((void) 0)
+#define trace_debug(fmt, ...) ((void) 0)
+#endif
+#if LOG_COMPILE_LEVEL < LOG_INFO
+#undef trace_info
+#define info(fmt, ...) ((void) 0)
+#define trace_info(fmt, ...) ((void) 0)
+#endif
+#if LOG_COMPILE_LEVEL < LOG_NOTICE
+#undef trace_notice
+#define notice(fmt, ...) ((void) 0)
+#define trace_notice(fmt, ...) ((void) 0)
+#endif
+#if LOG_COMPILE_LEVEL < LOG_WARNING
+#undef trace_warning
+#define warning(fmt, ...) ((void) 0)
+#define trace_warning(fmt, ...) ((void) 0)
+#endif
+#if LOG_COMPILE_LEVEL < LOG_ERR
+#undef trace_err
+#define err(fmt, ...) ((void) 0)
+#define trace_err(fmt, ...) ((void) 0)
+#endif
+#if LOG_COMPILE_LEVEL < LOG_CRIT
+#undef trace_crit
+#define crit(fmt, ...) ((void) 0)
+#define trace_crit(fmt, ...) ((void) 0)
+#endif
+#if LOG_COMPILE_LEVEL < LOG_ALERT
+#undef trace_alert
+#define alert(fmt, ...) ((void) 0)
+#define trace_alert(fmt, ...) ((void) 0)
+#endif
+
+/*
+ * log_enabled() --Test if a message of some priority would be logged.
+ * log_if()      --Log a message, evaluating its arguments only if enabled.
+ *
+ * Remarks:
+ * log_if() is log_msg() with the priority check hoisted into the
+ * caller, so that expensive arguments (e.g. a function that builds a
+ * string) aren't evaluated for a message that would be dropped.
+ */
+#define log_enabled(priority) \
+    ((size_t) (priority) <= LOG_COMPILE_LEVEL \
+     && (size_t) (priority) <= log_config(NULL)->threshold_priority)
+#define log_if(priority, fmt, ...) \
+    (log_enabled(priority) ? log_msg(priority, fmt, ##__VA_ARGS__) : 0)
+
 /*
  * NDEBUG --simulate assert()'s behaviour.
  *
  * Remarks:
- * If NDEBUG is defined, the "debug" log functions are expanded to NOPs,
- * and likewise the assert macro.  Note that we hijack the well-known
- * assert macro to integrate it with this logging framework.
+ * If NDEBUG is defined, the "debug" log functions are expanded to NOPs
+ * (by the default LOG_COMPILE_LEVEL), and likewise the assert macro.
+ * Note that we hijack the well-known assert macro to integrate it with
+ * this logging framework.
  */
 #ifdef NDEBUG
-#define debug(fmt, ...)
-#define trace_debug(__func__, __FILE__, __LINE__, fmt, ...)
 #define assert(test) (void) 0
 #else
 #define assert(test) \
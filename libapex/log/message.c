@@ -10,10 +10,19 @@
  * log_quit()      --Fatal error unrelated to system call.
  * trace_msg()     --Output a message with caller context.
  * STD_LOG()       --Boilerplate/macro for eponymous syslog priority messages.
+ * log_count_()    --Count a message that passed the threshold.
+ * log_collect()   --Report the message counts as metrics.
+ * log_metrics()   --Register the message counts as metrics.
  */
+#undef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_DEBUG    /* (define all the routines) */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <apex/log.h>
+#include <apex/metrics.h>
+
+static MetricCounter message_count[LOG_DEBUG + 1];
 
 /*
  * VA_LOG() --Boilerplate var-args processing and logging behaviour.
@@ -27,6 +36,7 @@
     int status = 0; \
     const LogConfig *config = log_config(NULL); \
     if (_log_priority <= config->threshold_priority) { \
+        log_count_(_log_priority); \
         va_start(args, _log_fmt); \
         status = config->output(config, NULL, \
                                 _log_errno, _log_priority, fmt, args); \
@@ -94,6 +104,7 @@ int trace_msg(const char *func, const char *file, int line, size_t priority,
 
     if (priority <= config->threshold_priority)
     {
+        log_count_(priority);
         va_start(args, fmt);
         status = config->output(config, &caller_context,
                                 0, priority, fmt, args);
@@ -114,8 +125,52 @@ STD_LOG(LOG_ALERT, alert)
 STD_LOG(LOG_CRIT, crit)
 STD_LOG(LOG_ERR, err)
 STD_LOG(LOG_WARNING, warning)
-STD_LOG(LOG_NOTICE, notice) STD_LOG(LOG_INFO, info)
-#ifdef debug
-#undef debug                           /* remove any macro definition */
-#endif
-    STD_LOG(LOG_DEBUG, debug)
+STD_LOG(LOG_NOTICE, notice)
+STD_LOG(LOG_INFO, info)
+STD_LOG(LOG_DEBUG, debug)
+
+/*
+ * log_count_() --Count a message that passed the threshold.
+ */
+void log_count_(size_t priority)
+{
+    metric_counter_add(&message_count[MIN(priority, LOG_DEBUG)], 1);
+}
+
+/*
+ * log_collect() --Report the message counts as metrics.
+ */
+static void log_collect(MetricWriterPtr writer, void *UNUSED(data))
+{
+    static const char *priority_label[] = {
+        "priority=\"emerg\"", "priority=\"alert\"", "priority=\"crit\"",
+        "priority=\"err\"", "priority=\"warning\"", "priority=\"notice\"",
+        "priority=\"info\"", "priority=\"debug\""
+    };
+
+    for (int i = 0; i < (int) NEL(priority_label); ++i)
+    {
+        metric_write_labelled(writer, "apex_log_messages_total",
+                              "Messages logged, by priority.",
+                              METRIC_COUNTER, priority_label[i],
+                              metric_counter_value(&message_count[i]));
+    }
+    metric_write(writer, "apex_log_async_dropped_total",
+                 "Messages dropped because the async log ring was full.",
+                 METRIC_COUNTER, log_async_dropped());
+}
+
+/*
+ * log_metrics() --Register the message counts as metrics.
+ *
+ * Returns: (MetricPtr)
+ * Success: the collector; Failure: NULL.
+ *
+ * Remarks:
+ * The messages are counted whether or not this is called; it just
+ * makes metrics_format() report them.
+ */
+MetricPtr log_metrics(void)
+{
+    return metric_collector_new(NULL, log_collect, NULL);
+}
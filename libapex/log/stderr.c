@@ -4,25 +4,52 @@
  * Contents:
  * fallback_colours[] --fallback values for tty colour styles.
  * init()             --Initialise stderr logging state.
+ * find_fraction()    --Find the "%N" (sub-second) conversion in a timestamp.
+ * format_timestamp() --Format a message's timestamp, caching the text.
+ * log_stderr_format_() --Format a log message as log_stderr() prints it.
+ * log_stderr_put_()  --Print a formatted log message on stderr.
  * log_stderr()       --Output handler that logs a message to stderr.
  *
  * Remarks:
  * The stderr handler prefixes the log message with a strftime()-specified
  * timestamp, and can conditionaly print the text with some cheezy
- * ANSI styles based on the priority.
+ * ANSI styles based on the priority.  The timestamp may also include
+ * the fraction of a second, as "%N" (or "%3N" for milliseconds, etc.).
  */
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>                    /* isatty */
+#include <sys/stat.h>
+#include <sys/uio.h>                   /* writev */
 
 #include <apex/log.h>
 #include <apex/sysenum.h>
 #include <apex/estring.h>
 #include <apex/strparse.h>
+#include <apex/date.h>
 
-#ifdef __WINNT__
-#define localtime_r(timep_, result_) localtime(timep_)
-#endif /* __WINNT__ */
+#ifndef CLOCK_REALTIME_COARSE
+#define CLOCK_REALTIME_COARSE CLOCK_REALTIME   /* (Linux-specific) */
+#endif /* CLOCK_REALTIME_COARSE */
+
+#define LOG_STAMP_MAX 64               /* longest (cached) timestamp */
+
+/*
+ * LogStamp{} --A thread's cached timestamp text, for one second.
+ */
+typedef struct LogStamp_t
+{
+    const char *spec;                  /* the strftime() spec cached */
+    time_t second;                     /* the second it's formatted for */
+    int n_digit;                       /* "%N" digits, or 0 (no "%N") */
+    size_t n_char;                     /* length of the "%N" conversion */
+    char before[LOG_STAMP_MAX];        /* the text before "%N" (or all) */
+    char after[LOG_STAMP_MAX];         /* the text after "%N" */
+} LogStamp;
 
 /*
  * fallback_colours[] --fallback values for tty colour styles.
@@ -39,24 +66,27 @@ static const char fallback_colours[] = "debug=36"   /* cyan */
     ":alert=1;5;33;41"                 /* bold + flashing + yellow/red */
     ":emerg=1;5;37;41";                /* bold + flashing + white/red */
 
-static char *log_colour[8];
-static char **priority_colour;         /* initialised values */
+static char *log_colour[8];            /* SGR prefix, per priority */
+static int stdout_is_stderr;           /* (so stdout must be flushed) */
 
 /*
  * init() --Initialise stderr logging state.
  *
  * Remarks:
  * The main work here is building a set of ASCII escapes for styling
- * the output, but only if stderr is a real tty.
+ * the output, but only if stderr is a real tty.  This is called
+ * (once) via pthread_once(), so it's safe for concurrent loggers.
  * REVISIT: consider refactoring to avoid new/free_str_list.
  */
-static char **init(void)
+static void init(void)
 {
-    priority_colour = log_colour;      /* mark initialised */
+    struct stat out, err;
 
+    stdout_is_stderr = fstat(1, &out) == 0 && fstat(2, &err) == 0
+        && out.st_dev == err.st_dev && out.st_ino == err.st_ino;
     if (!isatty(2))
     {
-        return priority_colour;
+        return;
     }
 
     const char *colour_spec;
@@ -76,49 +106,159 @@ static char **init(void)
         char priority_spec[20 + 1];
 
         if (sscanf(item, "%10[^=]=%20s", name, priority_spec) == 2
-            && (priority = sysenum_find_name(syslog_priority, name)) != NULL)
-        {
-            log_colour[priority->value] = strdup(priority_spec);
+            && (priority = sysenum_find_name(syslog_priority, name)) != NULL
+            && (log_colour[priority->value] =
+                malloc(strlen(priority_spec) + 4)) != NULL)
+        {                              /* (hard-coded) SGR to set colours */
+            sprintf(log_colour[priority->value], "\033[%sm", priority_spec);
         }
     }
     free_str_list(list);
+}
 
-    return priority_colour;
+/*
+ * find_fraction() --Find the "%N" (sub-second) conversion in a timestamp.
+ *
+ * Returns: (const char *)
+ * Success: the "%N" conversion (n_digit, n_char are set); Failure:
+ * NULL (there isn't one).
+ */
+static const char *find_fraction(const char *spec, int *n_digit,
+                                 size_t *n_char)
+{
+    for (const char *s = spec; (s = strchr(s, '%')) != NULL; ++s)
+    {
+        if (s[1] == '%')
+        {
+            ++s;                       /* (a literal "%") */
+        }
+        else if (s[1] == 'N')
+        {
+            *n_digit = 9;
+            *n_char = 2;
+            return s;
+        }
+        else if (s[1] >= '1' && s[1] <= '9' && s[2] == 'N')
+        {
+            *n_digit = s[1] - '0';
+            *n_char = 3;
+            return s;
+        }
+    }
+    return NULL;
 }
 
 /*
- * log_stderr() --Output handler that logs a message to stderr.
+ * format_timestamp() --Format a message's timestamp, caching the text.
+ *
+ * Parameters:
+ * spec --the strftime() spec, which may contain a "%N" conversion
+ * when --the time (or NULL, for now)
+ * str  --returns the formatted timestamp
+ * n    --the size of str
+ *
+ * Returns: (size_t)
+ * The length of the timestamp (0 if it's empty, or doesn't fit).
  *
  * Remarks:
- * If stderr appears to be closed, this routine will automatically
- * reconfigure the logger to use syslog.  This is typical behaviour
- * if a program runs as a daemon.
+ * The strftime() text only changes once a second, so it's cached (per
+ * thread), as the text before and after the "%N", if any; it's
+ * formatted with date_strftime()'s precompiled specs.  "%N" (or
+ * "%3N" etc.) is the fraction of a second, to 9 (or 3, etc.) digits;
+ * the time comes from the coarse real-time clock, so it's only as
+ * precise as the kernel's tick.
+ */
+static size_t format_timestamp(const char *spec, const struct timespec *when,
+                               char *str, size_t n)
+{
+    static THREAD_LOCAL LogStamp cache;
+    const char *cache_spec = spec;
+    struct timespec now;
+    size_t len;
+
+    if (when == NULL)
+    {
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        when = &now;
+    }
+    if (cache.spec != spec || cache.second != when->tv_sec)
+    {
+        char before_spec[LOG_STAMP_MAX];
+        const char *fraction = find_fraction(spec, &cache.n_digit,
+                                             &cache.n_char);
+        struct tm local_time;
+
+        date_localtime(when->tv_sec, &local_time);
+        cache.after[0] = '\0';
+        if (fraction != NULL)
+        {
+            snprintf(before_spec, sizeof(before_spec), "%.*s",
+                     (int) (fraction - spec), spec);
+            date_strftime(cache.after, sizeof(cache.after),
+                          fraction + cache.n_char, &local_time);
+            spec = before_spec;
+        }
+        else
+        {
+            cache.n_digit = 0;
+        }
+        if (date_strftime(cache.before, sizeof(cache.before), spec,
+                          &local_time) == 0)
+        {
+            cache.before[0] = '\0';
+        }
+        cache.spec = cache_spec;
+        cache.second = when->tv_sec;
+    }
+
+    len = (size_t) snprintf(str, n, "%s", cache.before);
+    if (cache.n_digit > 0 && len < n)
+    {
+        long fraction = when->tv_nsec;
+
+        for (int i = cache.n_digit; i < 9; ++i)
+        {
+            fraction /= 10;
+        }
+        len += (size_t) snprintf(str + len, n - len, "%0*ld", cache.n_digit,
+                                 fraction);
+    }
+    if (len < n)
+    {
+        len += (size_t) snprintf(str + len, n - len, "%s", cache.after);
+    }
+    return len < n ? len : 0;
+}
+
+/*
+ * log_stderr_format_() --Format a log message as log_stderr() prints it.
  *
- * log_stderr() goes to some trouble to ensure that the message is
- * output with a single fputs(), and won't be comingled/corrupted by
- * other processes writing to the same effective file.  However, it
- * doesn't care so much about the colour codes. which are in separate
- * calls to fputs().
+ * Parameters:
+ * when --the message's time (or NULL, for now)
+ * text --returns the message (size >= LOG_LINE_MAX + 1)
+ *
+ * Returns: (int)
+ * Success: the length of the message (as snprintf(): it may have been
+ * truncated); Failure: -1.
+ *
+ * Remarks:
+ * The message has the (optional) timestamp and identity prefixes, but
+ * no newline.
  */
-int log_stderr(const LogConfig * config, const LogContext * caller,
-               int sys_errno, size_t priority, const char *fmt, va_list args)
+int log_stderr_format_(const LogConfig * config, const LogContext * caller,
+                       int sys_errno, size_t priority,
+                       const struct timespec *when, const char *fmt,
+                       va_list args, char *text)
 {
-    char eol[] = "\n";
-    char text[LOG_LINE_MAX + NEL(eol)];
     char *str = text;
     char *end = text + LOG_LINE_MAX;
-    char **colour = priority_colour ? priority_colour : init();
     int n;
-    int status = 0;
 
+    *str = '\0';
     if (config->timestamp != NULL)
     {
-        time_t now = time(0);
-        struct tm local_time;
-
-        localtime_r(&now, &local_time);
-        if ((n = strftime(str, (size_t) (end - str),
-                          config->timestamp, &local_time)))
+        if ((n = (int) format_timestamp(config->timestamp, when, str,
+                                        (size_t) (end - str))))
         {
             str += n;
             if (str < end)
@@ -134,35 +274,111 @@ int log_stderr(const LogConfig * config, const LogContext * caller,
     }
 
     if ((n = log_vsprintf(caller, str, (size_t) MAX(end - str + 1, 0),
-                          sys_errno, priority, fmt, args)) >= 0)
-    {
-        str += n;
-    }
-    else
+                          sys_errno, priority, fmt, args)) < 0)
     {
         return -1;
     }
+    str += n;
+    return (int) (str - text);
+}
 
-    fflush(stdout);                    /* in case stdout == stderr */
+/*
+ * log_stderr_put_() --Print a formatted log message on stderr.
+ *
+ * Returns: (int)
+ * Success: the No. of bytes written; Failure: < 0 (stderr failed).
+ *
+ * Remarks:
+ * The message (with the priority's colours, if any, and a newline) is
+ * written with a single writev(), bypassing stdio, so concurrent
+ * messages don't tear or interleave (for lines up to PIPE_BUF, even
+ * on a pipe), and loggers don't contend for stderr's lock.  stdout is
+ * flushed first, but only if it's the same file as stderr.
+ */
+int log_stderr_put_(size_t priority, const char *text)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    struct iovec iov[3];
+    int n_iov = 0;
+    ssize_t n_write, total = 0;
 
-    if (colour[priority])
-    {                                  /* (hard-coded) SGR to set colours */
-        status =
-            fprintf(stderr, "\033[%sm%s\033[m\n",
-                    priority_colour[priority], text);
+    pthread_once(&once, init);
+    if (stdout_is_stderr)
+    {
+        fflush(stdout);                /* in case stdout == stderr */
+    }
+    if (priority < NEL(log_colour) && log_colour[priority] != NULL)
+    {
+        iov[n_iov].iov_base = log_colour[priority];
+        iov[n_iov++].iov_len = strlen(log_colour[priority]);
+    }
+    iov[n_iov].iov_base = (char *) text;
+    iov[n_iov++].iov_len = strlen(text);
+    iov[n_iov].iov_base = (char *) (n_iov > 1 ? "\033[m\n" : "\n");
+    iov[n_iov].iov_len = strlen(iov[n_iov].iov_base);
+    ++n_iov;
+
+    while (n_iov > 0)
+    {
+        SYS_RETRY(n_write, writev(2, iov, n_iov));
+        if (n_write < 0)
+        {
+            return -1;                 /* error: stderr failed */
+        }
+        total += n_write;
+        while (n_iov > 0 && (size_t) n_write >= iov[0].iov_len)
+        {                              /* (skip what was written) */
+            n_write -= (ssize_t) iov[0].iov_len;
+            memmove(iov, iov + 1, (size_t) --n_iov * sizeof(iov[0]));
+        }
+        if (n_iov > 0)
+        {
+            iov[0].iov_base = (char *) iov[0].iov_base + n_write;
+            iov[0].iov_len -= (size_t) n_write;
+        }
     }
-    else
+    return (int) total;
+}
+
+/*
+ * log_stderr() --Output handler that logs a message to stderr.
+ *
+ * Remarks:
+ * If stderr appears to be closed, this routine will automatically
+ * reconfigure the logger to use syslog.  This is typical behaviour
+ * if a program runs as a daemon.
+ *
+ * log_stderr() goes to some trouble to ensure that the message is
+ * output with a single writev() (colour codes and all), and won't be
+ * comingled/corrupted by other threads or processes writing to the
+ * same effective file (see log_stderr_put_()).  The message is
+ * formatted in a buffer on the caller's stack, so there's no shared
+ * state to contend for.
+ */
+int log_stderr(const LogConfig * config, const LogContext * caller,
+               int sys_errno, size_t priority, const char *fmt, va_list args)
+{
+    char eol[] = "\n";
+    char text[LOG_LINE_MAX + NEL(eol)];
+    va_list args_copy;
+    int n;
+
+    va_copy(args_copy, args);          /* (in case of fallback to syslog) */
+    n = log_stderr_format_(config, caller, sys_errno, priority, NULL, fmt,
+                           args_copy, text);
+    va_end(args_copy);
+    if (n < 0)
     {
-        status = fprintf(stderr, "%s\n", text);
+        return -1;
     }
-    if (status < 0)
+    if (log_stderr_put_(priority, text) < 0)
     {                                  /* stderr failed: fallback to syslog! */
         LogConfig syslog_config = *config;
 
         syslog_config.output = log_syslog;
-        config = log_config(&syslog_config);
-        return log_syslog(config, caller, sys_errno, priority, fmt, args);
+        log_config(&syslog_config);
+        return log_syslog(&syslog_config, caller, sys_errno, priority,
+                          fmt, args);
     }
-    fflush(stderr);
-    return str - text;
+    return n;
 }
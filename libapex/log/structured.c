@@ -0,0 +1,389 @@
+/*
+ * STRUCTURED.C --Structured (JSON, logfmt) log messages.
+ *
+ * Contents:
+ * LogBuffer{}      --A fixed-size output buffer, truncated when full.
+ * put_bytes()      --Append some bytes to a LogBuffer.
+ * put_escaped()    --Append a string, escaped JSON-style.
+ * put_value()      --Append a field's value, in some style.
+ * put_field()      --Append a key and value, in some style.
+ * put_fields()     --Append the current message's fields.
+ * put_line()       --Write a buffer's line to stderr.
+ * log_structured() --Format and print a structured message.
+ * log_json()       --Output handler that logs a message as a JSON object.
+ * log_logfmt()     --Output handler that logs a message as logfmt pairs.
+ * log_fields()     --Log a message with some typed key/value fields.
+ *
+ * Remarks:
+ * The structured handlers print each message as one line on stderr,
+ * either a JSON object:
+ *
+ *     {"time":"2026-01-02T03:04:05.678Z","level":"notice","msg":"..."}
+ *
+ * or logfmt pairs ("time=... level=notice msg=..."), followed by the
+ * caller context (for trace messages), the system error (if any), and
+ * the fields passed to log_fields().  So that ingestion needs no
+ * parsing heuristics, the message text and string values are escaped,
+ * but keys are copied verbatim: they're expected to be constants that
+ * need no escaping (e.g. "user_id").
+ *
+ * log_fields() passes its fields to the structured handlers via
+ * thread-local variables, so the LogOutputProc signature is unchanged.
+ * Other handlers get the fields appended to the message as logfmt
+ * pairs.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <apex/date.h>
+#include <apex/estring.h>
+#include <apex/log.h>
+#include <apex/sysenum.h>
+
+#define LOG_STRUCTURED_MAX 4096        /* longer records are truncated */
+
+typedef enum LogStyle_t
+{
+    LOG_STYLE_JSON,
+    LOG_STYLE_LOGFMT
+} LogStyle;
+
+/*
+ * LogBuffer{} --A fixed-size output buffer, truncated when full.
+ */
+typedef struct LogBuffer_t
+{
+    char *str;
+    size_t len;
+    size_t size;                       /* (less room for the line's end) */
+} LogBuffer;
+
+static THREAD_LOCAL const LogField *current_field;
+static THREAD_LOCAL size_t n_current_field;
+
+/*
+ * put_bytes() --Append some bytes to a LogBuffer.
+ */
+static void put_bytes(LogBuffer * buf, const char *str, size_t len)
+{
+    len = MIN(len, buf->size - buf->len);
+    memcpy(buf->str + buf->len, str, len);
+    buf->len += len;
+}
+
+#define put_str(buf_, str_) put_bytes(buf_, str_, strlen(str_))
+
+/*
+ * put_escaped() --Append a string, escaped JSON-style.
+ *
+ * Remarks:
+ * Quotes, backslashes and control characters are escaped; other text
+ * (including UTF-8) is copied in runs.
+ */
+static void put_escaped(LogBuffer * buf, const char *str)
+{
+    while (*str != '\0')
+    {
+        size_t n = strcspn(str, "\"\\\001\002\003\004\005\006\007\010\011"
+                           "\012\013\014\015\016\017\020\021\022\023\024"
+                           "\025\026\027\030\031\032\033\034\035\036\037");
+        char escape[8];
+
+        put_bytes(buf, str, n);
+        if ((str += n)[0] == '\0')
+        {
+            break;
+        }
+        switch (*str)
+        {
+        case '"':
+        case '\\':
+            sprintf(escape, "\\%c", *str);
+            break;
+        case '\n':
+            strcpy(escape, "\\n");
+            break;
+        case '\t':
+            strcpy(escape, "\\t");
+            break;
+        case '\r':
+            strcpy(escape, "\\r");
+            break;
+        default:
+            sprintf(escape, "\\u%04x", (unsigned char) *str);
+            break;
+        }
+        put_str(buf, escape);
+        ++str;
+    }
+}
+
+/*
+ * put_value() --Append a field's value, in some style.
+ *
+ * Remarks:
+ * logfmt values are only quoted if they need it.  JSON has no NaN or
+ * infinity, so they're printed as null.
+ */
+static void put_value(LogBuffer * buf, LogStyle style, const LogField * field)
+{
+    char number[32];
+    const char *str;
+
+    switch (field->type)
+    {
+    case LOG_FIELD_INTEGER:
+        snprintf(number, sizeof(number), "%lld", field->value.integer);
+        put_str(buf, number);
+        return;
+    case LOG_FIELD_REAL:
+        if (style == LOG_STYLE_JSON && !isfinite(field->value.real))
+        {
+            put_str(buf, "null");
+            return;
+        }
+        snprintf(number, sizeof(number), "%.17g", field->value.real);
+        put_str(buf, number);
+        return;
+    default:
+        break;
+    }
+    str = STR_OR_NULL(field->value.string);
+    if (style == LOG_STYLE_LOGFMT && *str != '\0'
+        && strpbrk(str, " =\"\\\t\n\r") == NULL)
+    {
+        put_str(buf, str);             /* (no quotes needed) */
+        return;
+    }
+    put_bytes(buf, "\"", 1);
+    put_escaped(buf, str);
+    put_bytes(buf, "\"", 1);
+}
+
+/*
+ * put_field() --Append a key and value, in some style.
+ */
+static void put_field(LogBuffer * buf, LogStyle style, const LogField * field)
+{
+    if (style == LOG_STYLE_JSON)
+    {
+        put_bytes(buf, ",\"", 2);
+        put_str(buf, field->key);
+        put_bytes(buf, "\":", 2);
+    }
+    else
+    {
+        if (buf->len > 0)
+        {
+            put_bytes(buf, " ", 1);
+        }
+        put_str(buf, field->key);
+        put_bytes(buf, "=", 1);
+    }
+    put_value(buf, style, field);
+}
+
+/*
+ * put_fields() --Append the current message's fields.
+ */
+static void put_fields(LogBuffer * buf, LogStyle style,
+                       const LogField * field, size_t n_field)
+{
+    for (size_t i = 0; i < n_field; ++i)
+    {
+        put_field(buf, style, &field[i]);
+    }
+}
+
+/*
+ * put_line() --Write a buffer's line to stderr.
+ *
+ * Returns: (int)
+ * Success: the No. of bytes written; Failure: -1.
+ *
+ * Remarks:
+ * The line is written with a single write() (if possible), so that
+ * concurrent messages don't interleave.
+ */
+static int put_line(const char *str, size_t len)
+{
+    size_t total = 0;
+
+    while (total < len)
+    {
+        ssize_t n_write;
+
+        SYS_RETRY(n_write, write(2, str + total, len - total));
+        if (n_write < 0)
+        {
+            return -1;                 /* error: stderr failed */
+        }
+        total += (size_t) n_write;
+    }
+    return (int) total;
+}
+
+/*
+ * log_structured() --Format and print a structured message.
+ *
+ * Returns: (int)
+ * Success: the No. of bytes written; Failure: -1.
+ */
+static int log_structured(LogStyle style, const LogConfig * config,
+                          const LogContext * caller, int sys_errno,
+                          size_t priority, const char *fmt, va_list args)
+{
+    char text[LOG_STRUCTURED_MAX], msg[LOG_STRUCTURED_MAX];
+    char stamp[40];
+    LogBuffer buf = { text, 0, sizeof(text) - 2 };  /* (room for "}\n") */
+    SysEnumPtr level = sysenum_find_number(syslog_priority, priority);
+    struct timespec now;
+    struct tm tm;
+    LogField field;
+    size_t n;
+
+    if (vsnprintf(msg, sizeof(msg), fmt, args) < 0)
+    {
+        return -1;                     /* error: bad sprintf format */
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    date_gmtime(now.tv_sec, &tm);
+    n = date_strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(stamp + n, sizeof(stamp) - n, ".%03ldZ", now.tv_nsec / 1000000);
+
+    if (style == LOG_STYLE_JSON)
+    {
+        put_str(&buf, "{\"time\":\"");
+        put_str(&buf, stamp);
+        put_bytes(&buf, "\"", 1);
+    }
+    else
+    {
+        put_str(&buf, "time=");
+        put_str(&buf, stamp);
+    }
+    field = (LogField) LOG_STRING("level", level != NULL
+                                  ? level->name : "unknown");
+    put_field(&buf, style, &field);
+    if (config->identity != NULL)
+    {
+        field = (LogField) LOG_STRING("ident", config->identity);
+        put_field(&buf, style, &field);
+    }
+    field = (LogField) LOG_STRING("msg", msg);
+    put_field(&buf, style, &field);
+    if (caller != NULL)
+    {
+        if (caller->function != NULL)
+        {
+            field = (LogField) LOG_STRING("func", caller->function);
+            put_field(&buf, style, &field);
+        }
+        field = (LogField) LOG_STRING("file", caller->file);
+        put_field(&buf, style, &field);
+        field = (LogField) LOG_INTEGER("line", caller->line);
+        put_field(&buf, style, &field);
+    }
+    if (sys_errno != 0)
+    {
+        field = (LogField) LOG_STRING("error", strerror(sys_errno));
+        put_field(&buf, style, &field);
+    }
+    put_fields(&buf, style, current_field, n_current_field);
+
+    if (style == LOG_STYLE_JSON)
+    {
+        buf.str[buf.len++] = '}';
+    }
+    buf.str[buf.len++] = '\n';
+    return put_line(buf.str, buf.len);
+}
+
+/*
+ * log_json() --Output handler that logs a message as a JSON object.
+ *
+ * Remarks:
+ * This handler is selected by the name "json" (e.g. LOG_OUTPUT=json).
+ */
+int log_json(const LogConfig * config, const LogContext * caller,
+             int sys_errno, size_t priority, const char *fmt, va_list args)
+{
+    return log_structured(LOG_STYLE_JSON, config, caller, sys_errno,
+                          priority, fmt, args);
+}
+
+/*
+ * log_logfmt() --Output handler that logs a message as logfmt pairs.
+ *
+ * Remarks:
+ * This handler is selected by the name "logfmt".
+ */
+int log_logfmt(const LogConfig * config, const LogContext * caller,
+               int sys_errno, size_t priority, const char *fmt,
+               va_list args)
+{
+    return log_structured(LOG_STYLE_LOGFMT, config, caller, sys_errno,
+                          priority, fmt, args);
+}
+
+/*
+ * log_fields() --Log a message with some typed key/value fields.
+ *
+ * Parameters:
+ * priority --the message priority
+ * field    --the fields (see LOG_STRING() etc.)
+ * n_field  --the No. of fields
+ * fmt...   --printf-style argument list
+ *
+ * Returns: (int)
+ * The output handler's result (0 if the message isn't logged).
+ *
+ * Remarks:
+ * The structured handlers print the fields as JSON/logfmt values; for
+ * any other handler, the fields are appended to the message text as
+ * logfmt pairs.
+ */
+int log_fields(size_t priority, const LogField * field, size_t n_field,
+               const char *fmt, ...)
+{
+    const LogConfig *config = log_config(NULL);
+    va_list args;
+    int status;
+
+    if (priority > config->threshold_priority)
+    {
+        return 0;
+    }
+    va_start(args, fmt);
+    if (config->output == log_json || config->output == log_logfmt)
+    {
+        current_field = field;
+        n_current_field = n_field;
+        log_count_(priority);
+        status = config->output(config, NULL, 0, priority, fmt, args);
+        current_field = NULL;
+        n_current_field = 0;
+    }
+    else
+    {
+        char text[LOG_STRUCTURED_MAX];
+        LogBuffer buf = { text, 0, sizeof(text) - 1 };
+        int n = vsnprintf(text, sizeof(text), fmt, args);
+
+        buf.len = n < 0 ? 0 : MIN((size_t) n, buf.size);
+        for (size_t i = 0; i < n_field; ++i)
+        {
+            put_field(&buf, LOG_STYLE_LOGFMT, &field[i]);
+        }
+        buf.str[buf.len] = '\0';
+        status = log_msg(priority, "%s", text);
+    }
+    va_end(args);
+    return status;
+}
@@ -0,0 +1,471 @@
+/*
+ * INI-LOAD.C --Load an INI file into a symbol table, in a single pass.
+ *
+ * Contents:
+ * IniDef{}         --A definition (or section), in file order.
+ * IniScan{}        --The state of a single-pass load.
+ * def_hash()       --HashProc for definitions: hash the section and name.
+ * def_cmp()        --CompareProc for definitions.
+ * read_text()      --Read the rest of a file into a buffer.
+ * scan_define()    --Record a definition, replacing any earlier value.
+ * scan_section()   --Return the current section's index, creating it.
+ * scan_line()      --Tokenise a single (NUL-terminated) line.
+ * new_table()      --Allocate an empty symbol table of some size.
+ * build_table()    --Build the symbol tree from the recorded definitions.
+ * ini_load_text()  --Load INI text into a new symbol table.
+ * ini_load_file()  --Load the rest of an INI file into a new symbol table.
+ *
+ * Remarks:
+ * ini_load() with the callback parser reads each line with stdio,
+ * matches it with sscanf(), and grows the symbol table one entry at a
+ * time (looking up every name with sym_get()), which dominates the
+ * startup of programs with big, generated INI files.  This loader
+ * reads the whole file into one buffer, and tokenises it in place in
+ * a single pass: the names and values are NUL-terminated within the
+ * buffer, and recorded in file order, with a hash table (of section
+ * and name) to find earlier definitions.  Then each table is
+ * allocated once, at its final size, and filled.
+ *
+ * The syntax (and the resulting tree, including the order of the
+ * symbols, and which definitions are errors) is the same as for the
+ * callback loader; see ini_parse().  The file is read rather than
+ * mmap()ed: it's modified in place, which would copy every page of a
+ * private mapping anyway.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <apex/hash.h>
+#include <apex/ini.h>
+#include <apex/mem.h>
+#include <apex/vector.h>
+
+#define INI_READ_MIN 4096              /* minimum read buffer size */
+#define INI_ROOT 0                     /* the root table's section index */
+
+/*
+ * IniDef{} --A definition (or section), in file order.
+ *
+ * Remarks:
+ * A section is recorded as a definition in the root table, with a
+ * NULL value, when its first definition is seen (as in the callback
+ * loader, which creates the section then).
+ */
+typedef struct IniDef_t
+{
+    size_t section;                    /* the defining section's index */
+    char *name;
+    char *value;                       /* (or NULL for a section) */
+    size_t child;                      /* (the section's index) */
+} IniDef, *IniDefPtr;
+
+/*
+ * IniScan{} --The state of a single-pass load.
+ */
+typedef struct IniScan_t
+{
+    IniPtr ini;
+    IniDefPtr def;                     /* the definitions, in file order */
+    size_t n_def;
+    size_t *n_field;                   /* No. of fields, by section index */
+    size_t n_section;
+    OHashPtr lookup;                   /* the definitions, by section/name */
+    char *section_name;                /* the current section's name */
+    size_t section;                    /* ...and index (or SIZE_MAX) */
+} IniScan, *IniScanPtr;
+
+/*
+ * def_hash() --HashProc for definitions: hash the section and name.
+ */
+static unsigned long def_hash(char *data)
+{
+    IniDefPtr def = (IniDefPtr) data;
+
+    return hash_key_wy(def->name)
+        ^ (unsigned long) (def->section * 0x9e3779b97f4a7c15ull);
+}
+
+/*
+ * def_cmp() --CompareProc for definitions.
+ */
+static int def_cmp(const void *data, const void *key)
+{
+    const IniDef *def = (const IniDef *) data;
+    const IniDef *key_def = (const IniDef *) key;
+
+    return def->section != key_def->section
+        || strcmp(def->name, key_def->name) != 0;
+}
+
+/*
+ * read_text() --Read the rest of a file into a buffer.
+ *
+ * Returns: (char *)
+ * Success: the (NUL-terminated) text; Failure: NULL.
+ *
+ * Remarks:
+ * The file's size is only a hint, so that pipes etc. are read too.
+ */
+static char *read_text(FILE * fp)
+{
+    struct stat info;
+    size_t size = INI_READ_MIN, len = 0;
+    char *text = NULL;
+
+    if (fstat(fileno(fp), &info) == 0 && info.st_size > 0)
+    {
+        size = MAX(size, (size_t) info.st_size + 1);
+    }
+    for (;;)
+    {
+        char *new_text = mem_realloc(MEM_PARSE, text, size + 1);
+
+        if (new_text == NULL)
+        {
+            mem_free(MEM_PARSE, text);
+            return NULL;               /* error: malloc failed */
+        }
+        text = new_text;
+        len += fread(text + len, 1, size - len, fp);
+        if (len < size)
+        {
+            break;
+        }
+        size *= 2;
+    }
+    if (ferror(fp))
+    {
+        mem_free(MEM_PARSE, text);
+        return NULL;                   /* error: read failed */
+    }
+    text[len] = '\0';
+    return text;
+}
+
+/*
+ * scan_define() --Record a definition, replacing any earlier value.
+ *
+ * Returns: (IniDefPtr)
+ * Success: the definition; Failure: NULL (malloc failed).
+ *
+ * Remarks:
+ * If there's an earlier definition of the name, it's returned
+ * unchanged: the caller decides whether to replace its value.
+ */
+static IniDefPtr scan_define(IniScanPtr scan, size_t section, char *name,
+                             char *value)
+{
+    IniDef key = {.section = section,.name = name };
+    IniDefPtr def = ohash_find(scan->lookup, def_cmp, &key);
+
+    if (def != NULL)
+    {
+        return def;                    /* (already defined) */
+    }
+    def = &scan->def[scan->n_def];
+    def->section = section;
+    def->name = name;
+    def->value = value;
+    def->child = 0;
+    if (!ohash_insert(scan->lookup, def))
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    scan->n_def += 1;
+    scan->n_field[section] += 1;
+    return def;
+}
+
+/*
+ * scan_section() --Return the current section's index, creating it.
+ *
+ * Returns: (size_t)
+ * Success: the section index; Failure: SIZE_MAX.
+ */
+static size_t scan_section(IniScanPtr scan)
+{
+    IniDefPtr def;
+
+    if (scan->section != SIZE_MAX)
+    {
+        return scan->section;
+    }
+    if ((def = scan_define(scan, INI_ROOT, scan->section_name, NULL)) == NULL)
+    {
+        return SIZE_MAX;               /* error: malloc failed */
+    }
+    if (def->value != NULL)
+    {
+        ini_err(scan->ini,
+                "cannot create section \"%s\": it already has a %s value",
+                scan->section_name, sym_type_name[STRING_TYPE]);
+        return SIZE_MAX;               /* error: bad section name */
+    }
+    if (def->child == 0)
+    {                                  /* new section */
+        def->child = scan->n_section;
+        scan->n_field[scan->n_section++] = 0;
+    }
+    return scan->section = def->child;
+}
+
+/*
+ * scan_line() --Tokenise a single (NUL-terminated) line.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * This matches ini_parse()'s sscanf() patterns: "[ %[^]] ]" for a
+ * section, and " %[^= ] = %[^\n]" for a definition.
+ */
+static int scan_line(IniScanPtr scan, char *line)
+{
+    char *name, *name_end, *value, *end;
+    size_t section;
+    IniDefPtr def;
+
+    while (*line == ' ' || *line == '\t')
+    {                                  /* skip whitespace */
+        ++line;
+    }
+    if (*line == '#' || *line == ';')
+    {
+        ini_pragma_(scan->ini, line + 1);
+        return 1;                      /* (comment) */
+    }
+    if ((end = strchr(line, '\r')) != NULL)
+    {                                  /* hello windows! */
+        *end = '\0';
+    }
+    if (*line == '\0')
+    {
+        return 1;                      /* (blank line) */
+    }
+    if (*line == '[')
+    {
+        for (name = line + 1; isspace((unsigned char) *name); ++name)
+        {
+            ;
+        }
+        if (*name != '\0' && *name != ']')
+        {                              /* (re)new section name */
+            if ((end = strchr(name, ']')) != NULL)
+            {
+                *end = '\0';
+            }
+            scan->section_name = name;
+            scan->section = SIZE_MAX;
+            return 1;
+        }
+    }
+    name = line;
+    name_end = name + strcspn(name, "= ");
+    for (value = name_end; isspace((unsigned char) *value); ++value)
+    {
+        ;
+    }
+    if (name_end == name || *value++ != '=')
+    {
+        ini_err(scan->ini, "unrecognised line: \"%s\"", line);
+        return 1;
+    }
+    while (isspace((unsigned char) *value))
+    {
+        ++value;
+    }
+    if (*value == '\0')
+    {
+        ini_err(scan->ini, "unrecognised line: \"%s\"", line);
+        return 1;
+    }
+    *name_end = '\0';
+    end = value + strlen(value) - 1;
+    while (*end == ' ')
+    {                                  /* trim trailing space from value */
+        *end-- = '\0';
+    }
+    if ((*value == '"' && *end == '"') || (*value == '\'' && *end == '\''))
+    {                                  /* naive quote stripping */
+        value += 1;
+        *end = '\0';
+    }
+    section = scan->section_name == NULL ? INI_ROOT : scan_section(scan);
+    if (section == SIZE_MAX
+        || (def = scan_define(scan, section, name, value)) == NULL)
+    {
+        return 0;                      /* error: bad section, malloc */
+    }
+    def->value = value;                /* (replace any earlier value) */
+    return 1;
+}
+
+/*
+ * new_table() --Allocate an empty symbol table of some size.
+ *
+ * Returns: (SymbolPtr)
+ * Success: the table (n_field null symbols, and a terminator);
+ * Failure: NULL.
+ */
+static SymbolPtr new_table(size_t n_field)
+{
+    SymbolPtr table = NEW_VECTOR(Symbol, n_field + 1, NULL);
+
+    for (size_t i = 0; table != NULL && i <= n_field; ++i)
+    {
+        table[i] = null_symbol;
+    }
+    return table;
+}
+
+/*
+ * build_table() --Build the symbol tree from the recorded definitions.
+ *
+ * Returns: (SymbolPtr)
+ * Success: the symbol table; Failure: NULL.
+ *
+ * Remarks:
+ * The tables are allocated in the order the definitions are visited,
+ * and every symbol is complete before the next is stored, so if this
+ * fails, the partial tree can be freed with sym_free_value().
+ */
+static SymbolPtr build_table(IniScanPtr scan)
+{
+    SymbolPtr *table = mem_calloc(MEM_PARSE, scan->n_section, sizeof(*table));
+    size_t *n_used = mem_calloc(MEM_PARSE, scan->n_section, sizeof(*n_used));
+    SymbolPtr root = NULL;
+    int status = 0;
+
+    if (table == NULL || n_used == NULL
+        || (root = table[INI_ROOT] =
+            new_table(scan->n_field[INI_ROOT])) == NULL)
+    {
+        goto done;                     /* error: malloc failed */
+    }
+    for (size_t i = 0; i < scan->n_def; ++i)
+    {
+        IniDefPtr def = &scan->def[i];
+        Symbol node = {.type = STRING_TYPE };
+
+        if ((node.name = sym_intern(def->name)) == NULL)
+        {
+            goto done;                 /* error: intern failed */
+        }
+        if (def->value != NULL)
+        {
+            if ((node.value.string = sym_intern(def->value)) == NULL)
+            {
+                sym_free_string_(node.name);
+                goto done;             /* error: intern failed */
+            }
+        }
+        else
+        {
+            node.type = STRUCT_TYPE;
+            if ((node.value.field = table[def->child] =
+                 new_table(scan->n_field[def->child])) == NULL)
+            {
+                sym_free_string_(node.name);
+                goto done;             /* error: malloc failed */
+            }
+        }
+        table[def->section][n_used[def->section]++] = node;
+    }
+    status = 1;
+done:
+    if (!status && root != NULL)
+    {
+        Value value = {.field = root };
+
+        sym_free_value(STRUCT_TYPE, value);
+        root = NULL;
+    }
+    mem_free(MEM_PARSE, table);
+    mem_free(MEM_PARSE, n_used);
+    sym_changed();
+    return root;
+}
+
+/*
+ * ini_load_text() --Load INI text into a new symbol table.
+ *
+ * Parameters:
+ * ini  --the ini parser object (for error reporting)
+ * text --the (NUL-terminated) text of the file
+ *
+ * Returns: (SymbolPtr)
+ * Success: the symbol table; Failure: NULL.
+ *
+ * Remarks:
+ * The text is modified in place, but the tree doesn't refer to it
+ * (its names and values are interned), so it can be freed
+ * afterwards.  As for ini_load(), text with no definitions loads as
+ * NULL.
+ */
+SymbolPtr ini_load_text(IniPtr ini, char *text)
+{
+    IniScan scan = {.ini = ini,.section = SIZE_MAX };
+    SymbolPtr root = NULL;
+    size_t n_line = 1;
+    int status = 1;
+
+    for (char *s = text; (s = strchr(s, '\n')) != NULL; ++s)
+    {
+        n_line += 1;
+    }
+    scan.def = mem_alloc(MEM_PARSE, (2 * n_line) * sizeof(*scan.def));
+    scan.n_field = mem_alloc(MEM_PARSE, (n_line + 1) * sizeof(*scan.n_field));
+    scan.lookup = ohash_new(def_hash, 2 * n_line);
+    if (scan.def == NULL || scan.n_field == NULL || scan.lookup == NULL)
+    {
+        goto done;                     /* error: malloc failed */
+    }
+    scan.n_field[INI_ROOT] = 0;
+    scan.n_section = 1;
+    for (char *line = text, *eol; status && line != NULL; line = eol)
+    {
+        if ((eol = strchr(line, '\n')) != NULL)
+        {
+            *eol++ = '\0';
+        }
+        ini->line += 1;                /* count every line */
+        status = scan_line(&scan, line);
+    }
+    if (status && scan.n_def > 0)
+    {
+        root = build_table(&scan);
+    }
+done:
+    mem_free(MEM_PARSE, scan.def);
+    mem_free(MEM_PARSE, scan.n_field);
+    if (scan.lookup != NULL)
+    {
+        ohash_free(scan.lookup);
+    }
+    return root;
+}
+
+/*
+ * ini_load_file() --Load the rest of an INI file into a new symbol table.
+ *
+ * Returns: (SymbolPtr)
+ * Success: the symbol table; Failure: NULL.
+ */
+SymbolPtr ini_load_file(IniPtr ini)
+{
+    char *text = read_text(ini->fp);
+    SymbolPtr root;
+
+    if (text == NULL)
+    {
+        return NULL;                   /* error: can't read file */
+    }
+    root = ini_load_text(ini, text);
+    mem_free(MEM_PARSE, text);
+    return root;
+}
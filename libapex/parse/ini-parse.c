@@ -38,6 +38,7 @@
 #include <string.h>
 
 #include <apex/ini.h>
+#include <apex/mem.h>
 #include <apex/vector.h>
 #include <apex/log.h>
 
@@ -47,7 +48,7 @@
  * Remarks:
  * Actually, I'm only handling "#line" at the moment.
  */
-static void ini_pragma_(IniPtr ini, char *line)
+void ini_pragma_(IniPtr ini, char *line)
 {
     char filename[LINE_MAX] = "";
     int number;
@@ -57,8 +58,8 @@ static void ini_pragma_(IniPtr ini, char *line)
         ini->line = number;
         if (*filename != '\0')
         {
-            free((void *) ini->name);
-            ini->name = strdup(filename);
+            mem_free(MEM_PARSE, (void *) ini->name);
+            ini->name = mem_strdup(MEM_PARSE, filename);
         }
     }
 }
@@ -215,10 +216,10 @@ IniPtr ini_fopen(const char *filename)
     {
         return NULL;                   /* error: no such file */
     }
-    if ((ini = NEW(Ini, 1)) != NULL)
+    if ((ini = MEM_NEW(MEM_PARSE, Ini, 1)) != NULL)
     {
         ini->fp = fp;
-        ini->name = strdup(filename);
+        ini->name = mem_strdup(MEM_PARSE, filename);
         return ini;                    /* success: return w/ open file */
     }
 
@@ -235,7 +236,7 @@ void ini_close(IniPtr ini)
     {
         fclose(ini->fp);
         ini->fp = NULL;
-        free((void *) ini->name);
+        mem_free(MEM_PARSE, (void *) ini->name);
     }
-    free(ini);
+    mem_free(MEM_PARSE, ini);
 }
@@ -2,9 +2,12 @@
  * INI-SYMBOL.C --Routines for manipulating ini-definitions as symbols.
  *
  * Contents:
- * load_()       --Callback proc for loading a INI file into a symbol table.
- * ini_load()    --Load an ini file into a symbol table.
- * ini_sym_get() --Get a value, or some default.
+ * load_()         --Callback proc for loading a INI file into a symbol table.
+ * ini_load()      --Load an ini file into a symbol table.
+ * ini_sym_get()   --Get a value, or some default.
+ * resolve()       --Resolve a binding's section/name, as ini_sym_get().
+ * ini_sym_bind()  --Bind a section/name to its value, or some default.
+ * ini_sym_bound() --Get a bound value, re-resolving it if necessary.
  *
  * Remarks:
  * Information recorded as INI-syntax files can be loaded into
@@ -15,6 +18,16 @@
  * Consistent with the shell and perl implementations of INI files,
  * these routines allow for a "default" section, which will provide
  * values if a name is not present in a section.
+ *
+ * Names and values are interned (see sym_intern()), so that tables
+ * loaded from many similar files share their strings; they must not
+ * be modified in place.
+ *
+ * Services that look up the same values repeatedly can load the file
+ * with the INI_INDEX flag, so that the tables are hashed by name (see
+ * sym_index()), and bind each value once with ini_sym_bind(): a bound
+ * lookup is then just a generation compare, even if it resolves to
+ * the "default" section or the default value.
  */
 #include <apex.h>                       /* Windows_NT requires this before system headers */
 
@@ -23,9 +36,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <apex/atomic.h>
 #include <apex/ini.h>
 #include <apex/vector.h>
 #include <apex/log.h>
+#include <apex/profile.h>
 
 /*
  * load_() --Callback proc for loading a INI file into a symbol table.
@@ -65,18 +80,19 @@ static int load_(IniPtr ini, const char *section, const char *name,
                 size_t slot = (size_t) vector_len(*sym_ptr) - 1;
 
                 debug("load_: adding section %s", section);
-                if ((node.name = strdup(section)) == NULL)
+                if ((node.name = sym_intern(section)) == NULL)
                 {
-                    return 0;          /* error: strdup failed */
+                    return 0;          /* error: intern failed */
                 }
                 node.type = STRUCT_TYPE;
                 if ((node.value.field =
                      NEW_VECTOR(Symbol, 1, &null_symbol)) == NULL)
                 {
-                    free(node.name);
                     return 0;          /* error: malloc failed */
                 }
+                sym_index_drop_(*sym_ptr);  /* (table may move) */
                 *sym_ptr = vector_insert(*sym_ptr, slot, 1, &node);
+                sym_changed();
                 section_vptr = &(*sym_ptr)[slot].value;
                 sym_ptr = &section_vptr->field;
             }
@@ -100,13 +116,16 @@ static int load_(IniPtr ini, const char *section, const char *name,
         {
             size_t slot = (size_t) vector_len(*sym_ptr) - 1;
 
-            if ((node.name = strdup(name)) == NULL)
+            if ((node.name = sym_intern(name)) == NULL)
             {
-                return 0;              /* error: strdup failed */
+                return 0;              /* error: intern failed */
             }
             node.type = STRING_TYPE;
-            node.value.string = strdup(value);
-            if ((*sym_ptr = vector_insert(*sym_ptr, slot, 1, &node)) == NULL)
+            node.value.string = sym_intern(value);
+            sym_index_drop_(*sym_ptr);  /* (table may move) */
+            *sym_ptr = vector_insert(*sym_ptr, slot, 1, &node);
+            sym_changed();
+            if (*sym_ptr == NULL)
             {
                 return 0;              /* error: malloc failed */
             }
@@ -114,8 +133,8 @@ static int load_(IniPtr ini, const char *section, const char *name,
         while (0);
         break;
     case STRING_TYPE:                 /* replace existing */
-        free(node_vptr->string);
-        node_vptr->string = strdup(value);
+        sym_free_string_(node_vptr->string);
+        node_vptr->string = sym_intern(value);
         break;
     default:
         ini_err(ini, "cannot overwrite \"%s\": it already has a %s value",
@@ -135,19 +154,33 @@ static int load_(IniPtr ini, const char *section, const char *name,
  * Remarks:
  * The symbol table will be allocated as needed by the ini-proc, however
  * if an initialised symbol table is passed, the ini-proc will replace
- * existing values.
+ * existing values.  A new table (i.e. symtab is NULL) is loaded by
+ * ini_load_file(), which is much faster for big files.  If the ini's
+ * INI_INDEX flag is set, the loaded tables are indexed by name.
  */
 SymbolPtr ini_load(IniPtr ini, SymbolPtr sym)
 {
-    if (ini_parse(ini, load_, &sym))
+    PROFILE_FUNCTION();
+    if (sym == NULL)
+    {
+        sym = ini_load_file(ini);
+    }
+    else if (!ini_parse(ini, load_, &sym))
+    {
+        return NULL;
+    }
+    if (sym != NULL && (ini->flags & INI_INDEX))
     {
-        return sym;
+        (void) sym_index(sym, 0);      /* (unindexed tables still work) */
     }
-    return NULL;
+    return sym;
 }
 
 /*
  * ini_sym_get() --Get a value, or some default.
+ * resolve()     --Resolve a binding's section/name, as ini_sym_get().
+ * ini_sym_bind()  --Bind a section/name to its value, or some default.
+ * ini_sym_bound() --Get a bound value, re-resolving it if necessary.
  *
  * Parameters:
  * sym  --the symbol tree loaded by ini_load()
@@ -195,6 +228,85 @@ Type ini_sym_get(SymbolPtr sym, const char *section,
     return VOID_TYPE;
 }
 
+/*
+ * resolve() --Resolve a binding's section/name, as ini_sym_get().
+ */
+static void resolve(IniBindingPtr binding)
+{
+    binding->generation = ATOMIC_LOAD_ACQUIRE(&sym_generation);
+    if ((binding->type = sym_get(binding->sym, binding->path,
+                                 &binding->value)) != VOID_TYPE
+        || (binding->type = sym_get(binding->sym, binding->default_path,
+                                    &binding->value)) != VOID_TYPE)
+    {
+        return;
+    }
+    if (binding->default_value.string != NULL)
+    {
+        binding->type = STRING_TYPE;
+        binding->value = &binding->default_value;
+        return;
+    }
+    binding->value = NULL;
+}
+
+/*
+ * ini_sym_bind() --Bind a section/name to its value, or some default.
+ *
+ * Parameters:
+ * binding  --returns the binding
+ * sym  --the symbol tree loaded by ini_load()
+ * section  --the name of the section to search
+ * name --the variable name to search
+ * default_value    --specifies a default value, or NULL
+ *
+ * Returns: (Type)
+ * Success: the type of the found value; Failure: VOID_TYPE.
+ *
+ * Remarks:
+ * The section, name and default value aren't copied: they must
+ * outlive the binding.
+ */
+Type ini_sym_bind(IniBindingPtr binding, SymbolPtr sym, const char *section,
+                  const char *name, char *default_value)
+{
+    binding->sym = sym;
+    binding->path[0].type = binding->path[1].type = STRING_TYPE;
+    binding->path[0].value.string = (char *) section;
+    binding->path[1].value.string = (char *) name;
+    binding->path[2].type = VOID_TYPE;
+    binding->default_path[0] = binding->path[0];
+    binding->default_path[0].value.string = (char *) "default";
+    binding->default_path[1] = binding->path[1];
+    binding->default_path[2] = binding->path[2];
+    binding->default_value.string = default_value;
+    resolve(binding);
+    return binding->type;
+}
+
+/*
+ * ini_sym_bound() --Get a bound value, re-resolving it if necessary.
+ *
+ * Parameters:
+ * binding  --the binding
+ * value    --returns the value
+ *
+ * Returns: (Type)
+ * Success: the type of the found value; Failure: VOID_TYPE.
+ */
+Type ini_sym_bound(IniBindingPtr binding, ValuePtr value)
+{
+    if (binding->generation != ATOMIC_LOAD_ACQUIRE(&sym_generation))
+    {
+        resolve(binding);
+    }
+    if (binding->type != VOID_TYPE)
+    {
+        *value = *binding->value;
+    }
+    return binding->type;
+}
+
 void ini_sym_free(SymbolPtr sym)
 {
     Value value = {.field = sym };
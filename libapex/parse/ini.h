@@ -18,13 +18,36 @@
 extern "C"
 {
 #endif                                 /* C++ */
+#define INI_INDEX 0x1                  /* ini_load(): index the tables */
+
     typedef struct Ini_t
     {
         char *name;                    /* file being parsed */
         int line;                      /* current line number in file */
         FILE *fp;
+        unsigned int flags;            /* INI_INDEX... */
     } Ini, *IniPtr;
 
+    /*
+     * IniBinding --A section/name, bound to its value (or default).
+     *
+     * Remarks:
+     * ini_sym_bind() resolves the name as ini_sym_get() does, i.e. in
+     * the section, then the "default" section, then the default value,
+     * and ini_sym_bound() only re-resolves it if some table has changed
+     * since (see sym_changed()).
+     */
+    typedef struct IniBinding_t
+    {
+        SymbolPtr sym;                 /* the table the name is bound in */
+        Atom path[3];                  /* section.name */
+        Atom default_path[3];          /* default.name */
+        Value default_value;           /* (string), or NULL */
+        unsigned int generation;       /* sym_generation when resolved */
+        Type type;                     /* the value's type (or VOID_TYPE) */
+        ValuePtr value;                /* the value, or NULL */
+    } IniBinding, *IniBindingPtr;
+
     /*
      * IniProc() --Ini Parser action routine.
      *
@@ -52,11 +75,18 @@ extern "C"
     int ini_parse(IniPtr ini, IniProc proc, void *data);
     IniPtr ini_fopen(const char *filename);
     void ini_close(IniPtr ini);
+    void ini_pragma_(IniPtr ini, char *line);
 
     SymbolPtr ini_load(IniPtr ini, SymbolPtr symtab);
+    SymbolPtr ini_load_text(IniPtr ini, char *text);
+    SymbolPtr ini_load_file(IniPtr ini);
     Type ini_sym_get(SymbolPtr sym, const char *section,
                      const char *name, char *default_value, ValuePtr value);
     void ini_sym_free(SymbolPtr sym);
+    Type ini_sym_bind(IniBindingPtr binding, SymbolPtr sym,
+                      const char *section, const char *name,
+                      char *default_value);
+    Type ini_sym_bound(IniBindingPtr binding, ValuePtr value);
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
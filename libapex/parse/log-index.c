@@ -0,0 +1,280 @@
+/*
+ * LOG-INDEX.C --A sparse time index of a syslog file.
+ *
+ * Contents:
+ * index_add()       --Append an entry to an index.
+ * log_index_build() --Build a time index of a syslog file.
+ * log_index_save()  --Save an index to a file.
+ * log_index_load()  --Load an index from a file.
+ * log_index_open()  --Return a syslog file's index, building it if needed.
+ * log_index_free()  --Release an index's resources.
+ * log_seek_time()   --Seek a syslog file to (just before) some time.
+ *
+ * Remarks:
+ * The index records the timestamp and offset of the first record in
+ * each interval (bytes) of the file, so to find the records from some
+ * time, log_seek_time() binary-searches the timestamps (with
+ * lower_bound_long()), and seeks to the entry before the first one at
+ * or after that time.  The caller then reads forward (e.g. with
+ * log_fgets()), skipping at most interval bytes of earlier records.
+ *
+ * This relies on the file's timestamps being (roughly) in order, as
+ * syslog writes them; an index of a file whose timestamps go
+ * backwards may seek past some records.
+ *
+ * The index can be persisted as a text file, conventionally next to
+ * the log file (log_index_open() uses "<file>.idx"): a header line
+ * ("log-index <interval> <size> <mtime>"), then one "<time> <offset>"
+ * line per entry.  The log file's size and mtime are recorded so that
+ * a stale index (e.g. after rotation) is rebuilt.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <apex.h>
+#include <apex/binsearch.h>
+#include <apex/log-parse.h>
+
+#define LOG_INDEX_SUFFIX ".idx"
+
+/*
+ * index_add() --Append an entry to an index.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (malloc failed).
+ */
+static int index_add(LogIndexPtr index, long timestamp, long offset)
+{
+    if (index->n_entry == index->n_alloc)
+    {
+        size_t n_alloc = MAX(index->n_alloc * 2, 64);
+        long *t = realloc(index->timestamp, n_alloc * sizeof(*t));
+        long *o;
+
+        if (t == NULL)
+        {
+            return 0;                  /* error: malloc failed */
+        }
+        index->timestamp = t;
+        if ((o = realloc(index->offset, n_alloc * sizeof(*o))) == NULL)
+        {
+            return 0;                  /* error: malloc failed */
+        }
+        index->offset = o;
+        index->n_alloc = n_alloc;
+    }
+    index->timestamp[index->n_entry] = timestamp;
+    index->offset[index->n_entry++] = offset;
+    return 1;
+}
+
+/*
+ * log_index_build() --Build a time index of a syslog file.
+ *
+ * Parameters:
+ * fp       --the syslog file, open for reading (it's read from the start)
+ * interval --the No. of bytes between index entries
+ * tm_base  --the base timestamp for decoding syslog's ambiguous format
+ *
+ * Returns: (LogIndexPtr)
+ * Success: the index; Failure: NULL.
+ */
+LogIndexPtr log_index_build(FILE * fp, size_t interval,
+                            const struct tm *tm_base)
+{
+    LogIndexPtr index = calloc(1, sizeof(*index));
+    struct tm base = *tm_base;
+    long offset, mark = 0;
+    struct stat info;
+    LogRecord record;
+
+    if (index == NULL || fseek(fp, 0L, SEEK_SET) != 0
+        || fstat(fileno(fp), &info) != 0)
+    {
+        free(index);
+        return NULL;                   /* error: can't read file */
+    }
+    index->interval = MAX(interval, 1);
+    index->size = (long) info.st_size;
+    index->mtime = info.st_mtime;
+    while ((offset = ftell(fp)) >= 0 && !feof(fp))
+    {
+        if (log_fgets(&record, fp, &base) == NULL || offset < mark)
+        {
+            continue;
+        }
+        if (!index_add(index, (long) record.timestamp, offset))
+        {
+            log_index_free(index);
+            return NULL;               /* error: malloc failed */
+        }
+        mark = offset + (long) index->interval;
+    }
+    return index;
+}
+
+/*
+ * log_index_save() --Save an index to a file.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0, and errno is set.
+ *
+ * Remarks:
+ * The index is written to a temporary file, and renamed, so that a
+ * concurrent reader never sees a partial index.
+ */
+int log_index_save(const LogIndex * index, const char *path)
+{
+    char tmp_path[FILENAME_MAX];
+    FILE *fp;
+    int status;
+
+    if ((size_t) snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path)
+        >= sizeof(tmp_path))
+    {
+        errno = ENAMETOOLONG;
+        return 0;                      /* error: path too long */
+    }
+    if ((fp = fopen(tmp_path, "w")) == NULL)
+    {
+        return 0;                      /* error: can't create file */
+    }
+    status = fprintf(fp, "log-index %zu %ld %ld\n", index->interval,
+                     index->size, (long) index->mtime) > 0;
+    for (size_t i = 0; status && i < index->n_entry; ++i)
+    {
+        status = fprintf(fp, "%ld %ld\n", index->timestamp[i],
+                         index->offset[i]) > 0;
+    }
+    if (fclose(fp) != 0 || !status || rename(tmp_path, path) != 0)
+    {
+        int sys_errno = errno;
+
+        remove(tmp_path);
+        errno = sys_errno;
+        return 0;                      /* error: can't write file */
+    }
+    return 1;
+}
+
+/*
+ * log_index_load() --Load an index from a file.
+ *
+ * Returns: (LogIndexPtr)
+ * Success: the index; Failure: NULL.
+ */
+LogIndexPtr log_index_load(const char *path)
+{
+    LogIndexPtr index;
+    long timestamp, offset, mtime;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL)
+    {
+        return NULL;                   /* error: no index */
+    }
+    if ((index = calloc(1, sizeof(*index))) == NULL
+        || fscanf(fp, "log-index %zu %ld %ld\n", &index->interval,
+                  &index->size, &mtime) != 3)
+    {
+        free(index);
+        fclose(fp);
+        return NULL;                   /* error: not an index */
+    }
+    index->mtime = (time_t) mtime;
+    while (fscanf(fp, "%ld %ld\n", &timestamp, &offset) == 2)
+    {
+        if (!index_add(index, timestamp, offset))
+        {
+            log_index_free(index);
+            index = NULL;
+            break;                     /* error: malloc failed */
+        }
+    }
+    fclose(fp);
+    return index;
+}
+
+/*
+ * log_index_open() --Return a syslog file's index, building it if needed.
+ *
+ * Parameters:
+ * fp       --the syslog file, open for reading
+ * path     --the syslog file's name
+ * interval --the No. of bytes between index entries (for a new index)
+ * tm_base  --the base timestamp for decoding syslog's ambiguous format
+ *
+ * Returns: (LogIndexPtr)
+ * Success: the index; Failure: NULL.
+ *
+ * Remarks:
+ * The index "<path>.idx" is loaded if it matches the file's current
+ * size and mtime; otherwise it's (re-)built, and saved if possible.
+ */
+LogIndexPtr log_index_open(FILE * fp, const char *path, size_t interval,
+                           const struct tm *tm_base)
+{
+    char index_path[FILENAME_MAX];
+    LogIndexPtr index = NULL;
+    struct stat info;
+    int has_path = (size_t) snprintf(index_path, sizeof(index_path), "%s%s",
+                                     path, LOG_INDEX_SUFFIX)
+        < sizeof(index_path);
+
+    if (fstat(fileno(fp), &info) != 0)
+    {
+        return NULL;                   /* error: can't stat file */
+    }
+    if (has_path && (index = log_index_load(index_path)) != NULL
+        && index->size == (long) info.st_size
+        && index->mtime == info.st_mtime)
+    {
+        return index;                  /* success: index is current */
+    }
+    log_index_free(index);
+    if ((index = log_index_build(fp, interval, tm_base)) != NULL && has_path)
+    {
+        (void) log_index_save(index, index_path);
+    }
+    return index;
+}
+
+/*
+ * log_index_free() --Release an index's resources.
+ */
+void log_index_free(LogIndexPtr index)
+{
+    if (index != NULL)
+    {
+        free(index->timestamp);
+        free(index->offset);
+        free(index);
+    }
+}
+
+/*
+ * log_seek_time() --Seek a syslog file to (just before) some time.
+ *
+ * Parameters:
+ * fp       --the syslog file, open for reading
+ * index    --the file's index
+ * t        --the time to seek to
+ *
+ * Returns: (long)
+ * Success: the new offset of fp; Failure: -1, and errno is set.
+ *
+ * Remarks:
+ * The offset is the start of a record before the first record at or
+ * after t (or the start of the file), so the caller must skip records
+ * before t.
+ */
+long log_seek_time(FILE * fp, const LogIndex * index, time_t t)
+{
+    size_t i = lower_bound_long(index->timestamp, index->n_entry, (long) t);
+    long offset = i > 0 ? index->offset[i - 1] : 0L;
+
+    return fseek(fp, offset, SEEK_SET) == 0 ? offset : -1L;
+}
@@ -0,0 +1,555 @@
+/*
+ * LOG-MERGE.C --Parse syslog files in parallel, and merge their records.
+ *
+ * Contents:
+ * LogMergeItem{}   --A parsed record, whose strings are in its batch.
+ * LogMergeBatch{}  --A block of records parsed by a worker.
+ * LogMergeSource{} --A file (or a chunk of one), and its worker's queue.
+ * LogMergeHead{}   --The heap entry for a source's next record.
+ * LogMerge{}       --The merge state.
+ * source_put()     --Queue a worker's batch, waiting while the queue is full.
+ * source_get()     --Return a source's next batch, waiting for the worker.
+ * skip_partial()   --Skip to the start of the first line in a chunk.
+ * worker()         --Parse a source into batches: the worker thread.
+ * source_advance() --Move a source on to its next record.
+ * log_merge_new()  --Start parsing some syslog files in parallel.
+ * log_merge_next() --Return the next record, in timestamp order.
+ * log_merge_free() --Stop the workers, and release a merge's resources.
+ *
+ * Remarks:
+ * Each source (a file, or one of n_chunk byte ranges of it) is parsed
+ * by its own thread, with decode_syslog_() (like log_parse_r(), but
+ * in place: the lines are read directly into a batch's text, so they
+ * needn't be copied again).  The records of each source are in time
+ * order, so the records of all sources are merged by a heap holding
+ * each source's next record; ties are broken by the source's position
+ * in the path list, so the stream is deterministic.
+ *
+ * A chunk starts at the first line that starts in its byte range, and
+ * ends with the last one (i.e. the line straddling its end), so every
+ * line belongs to exactly one chunk.
+ *
+ * Each worker parses up to LOG_MERGE_DEPTH batches ahead of the
+ * reader, so memory is bounded; when the files are rotated logs
+ * (disjoint in time), the later files' workers wait after their
+ * read-ahead, while the earliest file is drained.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <apex.h>
+#include <apex/heap-typed.h>
+#include <apex/log-parse.h>
+
+#define LOG_MERGE_TEXT (64 * 1024)     /* a batch's line storage */
+#define LOG_MERGE_ITEMS 1024           /* a batch's max. No. of records */
+#define LOG_MERGE_DEPTH 4              /* batches parsed ahead per source */
+
+/*
+ * LogMergeItem{} --A parsed record, whose strings are in its batch.
+ */
+typedef struct LogMergeItem_t
+{
+    time_t timestamp;
+    char *host;
+    char *tag;
+    pid_t pid;
+    int facility;
+    int priority;
+    char *message;
+} LogMergeItem;
+
+/*
+ * LogMergeBatch{} --A block of records parsed by a worker.
+ */
+typedef struct LogMergeBatch_t
+{
+    struct LogMergeBatch_t *next;      /* (the source's queue/free list) */
+    size_t n_item;
+    size_t n_line;                     /* lines read for this batch */
+    size_t n_error;                    /* lines that didn't parse */
+    LogMergeItem item[LOG_MERGE_ITEMS];
+    char text[LOG_MERGE_TEXT];
+} LogMergeBatch;
+
+/*
+ * LogMergeSource{} --A file (or a chunk of one), and its worker's queue.
+ */
+typedef struct LogMergeSource_t
+{
+    FILE *fp;
+    long start, end;                   /* the chunk's byte range */
+    struct tm tm_base;
+    pthread_t thread;
+    pthread_mutex_t lock;              /* protects the fields below */
+    pthread_cond_t changed;
+    LogMergeBatch *head, *tail;        /* the queue of parsed batches */
+    LogMergeBatch *free;               /* consumed batches, for re-use */
+    int n_queued;
+    int done;                          /* the worker has finished */
+    int quit;                          /* the reader has stopped */
+    LogMergeBatch *batch;              /* (reader) the current batch */
+    size_t next;                       /* (reader) its next item */
+} LogMergeSource;
+
+/*
+ * LogMergeHead{} --The heap entry for a source's next record.
+ */
+typedef struct LogMergeHead_t
+{
+    time_t timestamp;
+    size_t source;
+} LogMergeHead;
+
+static inline int head_before(const LogMergeHead * a, const LogMergeHead * b)
+{
+    return a->timestamp < b->timestamp
+        || (a->timestamp == b->timestamp && a->source < b->source);
+}
+
+HEAP_DEFINE(LogMergeHeap, LogMergeHead, head_before)
+
+/*
+ * LogMerge{} --The merge state.
+ */
+struct LogMerge_t
+{
+    size_t n_source;
+    LogMergeSource *source;
+    LogMergeHeap heap;
+    LogMergeHead *head;                /* the heap's storage */
+    int started;                       /* the heap has been filled */
+    int finished;                      /* all sources are exhausted */
+    size_t current;                    /* the source of the last record */
+    LogRecord record;                  /* the last record returned */
+    size_t n_line;                     /* lines read so far */
+    size_t n_error;                    /* lines that didn't parse */
+};
+
+/*
+ * source_put() --Queue a worker's batch, waiting while the queue is full.
+ *
+ * Parameters:
+ * source   --the source
+ * batch    --the batch to queue, or NULL
+ *
+ * Returns: (LogMergeBatch *)
+ * Success: an empty batch to fill; Failure: NULL (the reader quit, or
+ * malloc failed).
+ */
+static LogMergeBatch *source_put(LogMergeSource * source,
+                                 LogMergeBatch * batch)
+{
+    LogMergeBatch *empty;
+
+    pthread_mutex_lock(&source->lock);
+    if (batch != NULL)
+    {
+        batch->next = NULL;
+        if (source->tail != NULL)
+        {
+            source->tail->next = batch;
+        }
+        else
+        {
+            source->head = batch;
+        }
+        source->tail = batch;
+        source->n_queued += 1;
+        pthread_cond_broadcast(&source->changed);
+    }
+    while (source->n_queued >= LOG_MERGE_DEPTH && !source->quit)
+    {
+        pthread_cond_wait(&source->changed, &source->lock);
+    }
+    if (source->quit)
+    {
+        pthread_mutex_unlock(&source->lock);
+        return NULL;
+    }
+    if ((empty = source->free) != NULL)
+    {
+        source->free = empty->next;
+    }
+    pthread_mutex_unlock(&source->lock);
+    if (empty == NULL && (empty = malloc(sizeof(*empty))) == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    empty->n_item = empty->n_line = empty->n_error = 0;
+    return empty;
+}
+
+/*
+ * source_get() --Return a source's next batch, waiting for the worker.
+ *
+ * Parameters:
+ * source   --the source
+ * used     --the batch the reader has finished with, or NULL
+ *
+ * Returns: (LogMergeBatch *)
+ * Success: the next batch; Failure: NULL (the source is exhausted).
+ */
+static LogMergeBatch *source_get(LogMergeSource * source,
+                                 LogMergeBatch * used)
+{
+    LogMergeBatch *batch;
+
+    pthread_mutex_lock(&source->lock);
+    if (used != NULL)
+    {
+        used->next = source->free;
+        source->free = used;
+    }
+    while (source->head == NULL && !source->done)
+    {
+        pthread_cond_wait(&source->changed, &source->lock);
+    }
+    if ((batch = source->head) != NULL)
+    {
+        if ((source->head = batch->next) == NULL)
+        {
+            source->tail = NULL;
+        }
+        source->n_queued -= 1;
+        pthread_cond_broadcast(&source->changed);
+    }
+    pthread_mutex_unlock(&source->lock);
+    return batch;
+}
+
+/*
+ * skip_partial() --Skip to the start of the first line in a chunk.
+ *
+ * Returns: (long)
+ * The offset of the chunk's first line.
+ *
+ * Remarks:
+ * The line that straddles the chunk's start belongs to the previous
+ * chunk, so it's skipped (by checking the byte before the start).
+ */
+static long skip_partial(FILE * fp, long start)
+{
+    int c;
+
+    if (start == 0 || fseek(fp, start - 1, SEEK_SET) != 0)
+    {
+        return start;
+    }
+    while ((c = getc(fp)) != EOF && c != '\n')
+    {
+        ;
+    }
+    return ftell(fp);
+}
+
+/*
+ * worker() --Parse a source into batches: the worker thread.
+ */
+static void *worker(void *arg)
+{
+    LogMergeSource *source = arg;
+    LogMergeBatch *batch = source_put(source, NULL);
+    long offset = skip_partial(source->fp, source->start);
+    size_t used = 0;
+    LogRecord record;
+
+    while (batch != NULL && offset < source->end)
+    {
+        char *line = batch->text + used;
+        size_t len;
+
+        if (fgets(line, SYSLOG_LINE_MAX, source->fp) == NULL)
+        {
+            break;                     /* end of file (or error) */
+        }
+        len = strlen(line);
+        offset += (long) len;
+        if (len > 0 && line[len - 1] == '\n')
+        {
+            line[--len] = '\0';
+        }
+        batch->n_line += 1;
+        if (decode_syslog_(&record, line, &source->tm_base) == NULL)
+        {
+            batch->n_error += 1;
+        }
+        else
+        {
+            LogMergeItem *item = &batch->item[batch->n_item++];
+
+            item->timestamp = record.timestamp;
+            item->host = record.host;
+            item->tag = record.tag;
+            item->pid = record.pid;
+            item->facility = record.facility;
+            item->priority = record.priority;
+            item->message = record.message;
+            used += len + 1;
+        }
+        if (batch->n_item == LOG_MERGE_ITEMS
+            || used > LOG_MERGE_TEXT - SYSLOG_LINE_MAX)
+        {
+            batch = source_put(source, batch);
+            used = 0;
+        }
+    }
+    pthread_mutex_lock(&source->lock);
+    if (batch != NULL && batch->n_line > 0 && !source->quit)
+    {                                  /* (queue the partial batch) */
+        batch->next = NULL;
+        if (source->tail != NULL)
+        {
+            source->tail->next = batch;
+        }
+        else
+        {
+            source->head = batch;
+        }
+        source->tail = batch;
+        source->n_queued += 1;
+        batch = NULL;
+    }
+    source->done = 1;
+    pthread_cond_broadcast(&source->changed);
+    pthread_mutex_unlock(&source->lock);
+    free(batch);
+    return NULL;
+}
+
+/*
+ * source_advance() --Move a source on to its next record.
+ *
+ * Returns: (int)
+ * Success: 1, and the source's next record is pushed on the heap;
+ * Failure: 0 (the source is exhausted).
+ */
+static int source_advance(LogMergePtr merge, size_t i)
+{
+    LogMergeSource *source = &merge->source[i];
+    LogMergeHead head;
+
+    while (source->batch == NULL || source->next >= source->batch->n_item)
+    {
+        if ((source->batch = source_get(source, source->batch)) == NULL)
+        {
+            return 0;
+        }
+        source->next = 0;
+        merge->n_line += source->batch->n_line;
+        merge->n_error += source->batch->n_error;
+    }
+    head.timestamp = source->batch->item[source->next].timestamp;
+    head.source = i;
+    LogMergeHeap_push(&merge->heap, &head);
+    return 1;
+}
+
+/*
+ * log_merge_new() --Start parsing some syslog files in parallel.
+ *
+ * Parameters:
+ * path     --the files to parse
+ * n_path   --the No. of files
+ * n_chunk  --the No. of chunks (threads) to split each file into
+ * tm_base  --the base timestamp for decoding syslog's ambiguous format
+ *
+ * Returns: (LogMergePtr)
+ * Success: the merge; Failure: NULL, and errno is set.
+ *
+ * Remarks:
+ * A thread is started for each chunk of each file, so n_path*n_chunk
+ * should be about the No. of cores.
+ */
+LogMergePtr log_merge_new(const char *path[], size_t n_path,
+                          size_t n_chunk, const struct tm *tm_base)
+{
+    LogMergePtr merge;
+    size_t n_source, n_started = 0;
+    int status = 0;
+
+    n_chunk = MAX(n_chunk, 1);
+    n_source = n_path * n_chunk;
+    if ((merge = calloc(1, sizeof(*merge))) == NULL
+        || (merge->source = calloc(MAX(n_source, 1),
+                                   sizeof(*merge->source))) == NULL
+        || (merge->head = calloc(MAX(n_source, 1),
+                                 sizeof(*merge->head))) == NULL)
+    {
+        log_merge_free(merge);
+        return NULL;                   /* error: malloc failed */
+    }
+    merge->n_source = n_source;
+    tzset();                           /* (before the workers' mktime()) */
+    LogMergeHeap_init(&merge->heap, (int) n_source, merge->head);
+
+    for (size_t i = 0; i < n_path && status == 0; ++i)
+    {
+        struct stat info;
+        FILE *fp = fopen(path[i], "r");
+
+        if (fp == NULL || fstat(fileno(fp), &info) != 0)
+        {
+            status = errno;
+            if (fp != NULL)
+            {
+                fclose(fp);
+            }
+            break;                     /* error: can't read file */
+        }
+        for (size_t j = 0; j < n_chunk && status == 0; ++j)
+        {
+            LogMergeSource *source = &merge->source[i * n_chunk + j];
+
+            if (j > 0 && (fp = fopen(path[i], "r")) == NULL)
+            {
+                status = errno;
+                break;
+            }
+            source->fp = fp;
+            source->start = (long) (info.st_size * (off_t) j
+                                    / (off_t) n_chunk);
+            source->end = j + 1 == n_chunk ? (long) info.st_size
+                : (long) (info.st_size * (off_t) (j + 1) / (off_t) n_chunk);
+            source->tm_base = *tm_base;
+            pthread_mutex_init(&source->lock, NULL);
+            pthread_cond_init(&source->changed, NULL);
+            if ((status = pthread_create(&source->thread, NULL,
+                                         worker, source)) != 0)
+            {
+                pthread_mutex_destroy(&source->lock);
+                pthread_cond_destroy(&source->changed);
+                fclose(fp);
+                source->fp = NULL;
+                break;
+            }
+            ++n_started;
+        }
+    }
+    merge->n_source = n_started;
+    if (status != 0)
+    {
+        log_merge_free(merge);
+        errno = status;
+        return NULL;                   /* error: can't start workers */
+    }
+    return merge;
+}
+
+/*
+ * log_merge_next() --Return the next record, in timestamp order.
+ *
+ * Parameters:
+ * merge    --the merge
+ * n_line   --if not NULL, returns the No. of lines read so far
+ * n_error  --if not NULL, returns the No. of lines that didn't parse
+ *
+ * Returns: (LogRecordPtr)
+ * Success: the record; Failure: NULL (all the sources are exhausted).
+ *
+ * Remarks:
+ * The record's fields point into a worker's batch, and are valid
+ * until the next call; its text isn't used.
+ */
+LogRecordPtr log_merge_next(LogMergePtr merge, size_t *n_line,
+                            size_t *n_error)
+{
+    LogMergeHead head;
+    LogMergeItem *item;
+    LogMergeSource *source;
+
+    if (merge->finished)
+    {
+        return NULL;
+    }
+    if (!merge->started)
+    {
+        for (size_t i = 0; i < merge->n_source; ++i)
+        {
+            source_advance(merge, i);
+        }
+        merge->started = 1;
+    }
+    else
+    {                                  /* move on from the last record */
+        merge->source[merge->current].next += 1;
+        source_advance(merge, merge->current);
+    }
+    if (n_line != NULL)
+    {
+        *n_line = merge->n_line;
+    }
+    if (n_error != NULL)
+    {
+        *n_error = merge->n_error;
+    }
+    if (!LogMergeHeap_pop(&merge->heap, &head))
+    {
+        merge->finished = 1;
+        return NULL;                   /* end of all sources */
+    }
+    merge->current = head.source;
+    source = &merge->source[head.source];
+    item = &source->batch->item[source->next];
+
+    merge->record.timestamp = item->timestamp;
+    merge->record.host = item->host;
+    merge->record.tag = item->tag;
+    merge->record.pid = item->pid;
+    merge->record.facility = item->facility;
+    merge->record.priority = item->priority;
+    merge->record.message = item->message;
+    merge->record.text[0] = '\0';
+    return &merge->record;
+}
+
+/*
+ * log_merge_free() --Stop the workers, and release a merge's resources.
+ *
+ * Remarks:
+ * This may be called before all the records have been read.
+ */
+void log_merge_free(LogMergePtr merge)
+{
+    if (merge == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; merge->source != NULL && i < merge->n_source; ++i)
+    {
+        LogMergeSource *source = &merge->source[i];
+        LogMergeBatch *batch;
+
+        if (source->fp == NULL)
+        {
+            continue;
+        }
+        pthread_mutex_lock(&source->lock);
+        source->quit = 1;
+        pthread_cond_broadcast(&source->changed);
+        pthread_mutex_unlock(&source->lock);
+        pthread_join(source->thread, NULL);
+
+        free(source->batch);
+        while ((batch = source->head) != NULL)
+        {
+            source->head = batch->next;
+            free(batch);
+        }
+        while ((batch = source->free) != NULL)
+        {
+            source->free = batch->next;
+            free(batch);
+        }
+        pthread_mutex_destroy(&source->lock);
+        pthread_cond_destroy(&source->changed);
+        fclose(source->fp);
+    }
+    free(merge->head);
+    free(merge->source);
+    free(merge);
+}
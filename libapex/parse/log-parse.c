@@ -6,6 +6,13 @@
  * log_parse()         --Parse a syslog line, and return the parsed elements.
  * log_fgets()         --Read a line from a file, and parse it into a log-record.
  * decode_syslog_()    --decode a syslog text record into its pieces.
+ * match_name_()       --Check if a name is in a filter's list.
+ * decode_syslog_filter_() --decode a syslog record, if it matches a filter.
+ * match_pattern_()    --Check that some text matches a "dd:dd"-style pattern.
+ * decode_2digit_()    --decode a two-digit decimal field.
+ * days_from_civil_()  --Return the No. of days from 1970-01-01 to a date.
+ * decode_rfc3339_()   --decode an RFC 3339 timestamp (fast path).
+ * decode_bsd_()       --decode a "Mmm dd hh:mm:ss" timestamp (fast path).
  * decode_timestamp_() --decode the timestamp part of a syslog message.
  * decode_ident_()     --decode the "<tag>[<pid>]" part of a syslog message.
  *
@@ -13,6 +20,14 @@
  * This module parses a single syslog text line into component pieces
  * (timestamp, host, ident, pid, message, etc.)
  *
+ * Timestamps in the two fixed formats ("Feb  1 00:00:00", and RFC 3339's
+ * "2001-02-01T00:00:00.123+10:00") are decoded by hand, rather than by
+ * strptime(), and the time_t is cached per minute (local time) or per
+ * day (UTC), so mktime() is only called when the minute changes: log
+ * records arrive in order, so that's rare.  Anything else (e.g. full
+ * month names) falls back to date_parse_fmt().  The caches are
+ * thread-local, so log_parse_r() stays re-entrant; they assume the
+ * timezone doesn't change while parsing.
  */
 #include <string.h>
 
@@ -24,9 +39,8 @@
 #include <apex/sysenum.h>
 #include <apex/log-parse.h>
 
-static LogRecordPtr decode_syslog_(LogRecordPtr log_record,
-                                   struct tm *tm_base);
-static char *decode_timestamp_(LogRecordPtr log_record, struct tm *tm_base);
+static char *decode_timestamp_(LogRecordPtr log_record, char *text,
+                               struct tm *tm_base, int convert);
 static int decode_ident_(LogRecordPtr log_record, char *end);
 
 static const char *ts_fmt[] = {        /* list of allowed timestamp formats */
@@ -51,7 +65,7 @@ LogRecordPtr log_parse_r(LogRecordPtr log_record, const char *str,
     strncpy(log_record->text, str, sizeof(log_record->text));
     log_record->text[sizeof(log_record->text) - 1] = '\0';
 
-    return decode_syslog_(log_record, tm_base);
+    return decode_syslog_(log_record, log_record->text, tm_base);
 }
 
 /*
@@ -99,7 +113,7 @@ LogRecordPtr log_fgets(LogRecordPtr log_record, FILE * fp, struct tm *tm_base)
         {
             log_record->text[sizeof(log_record->text) - 1] = '\0';
         }
-        return decode_syslog_(log_record, tm_base);
+        return decode_syslog_(log_record, log_record->text, tm_base);
     }
     return NULL;                       /* error: fgets() failed */
 }
@@ -108,19 +122,70 @@ LogRecordPtr log_fgets(LogRecordPtr log_record, FILE * fp, struct tm *tm_base)
  * decode_syslog_() --decode a syslog text record into its pieces.
  *
  * Parameters:
- * log_record   --specifies and returns the syslog record
+ * log_record   --returns the syslog record
+ * text     --the raw text to be parsed (e.g. log_record->text)
  * tm_base  --the base timestamp for decoding syslog's ambiguous format
  *
  * Returns: (LogRecordPtr)
  * Success: an initialised log record; Failure: NULL.
  *
  * Remarks:
- * On entry, the log_record->text contains the raw text to be parsed.
- * On successful return, the other fields will be initialised with
- * fragments of the raw text.
+ * The text is munged (NUL-terminating its fragments), and on successful
+ * return, the other fields will be initialised with fragments of it.
+ * log_scan_next() passes lines in its own buffer, so they needn't be
+ * copied into log_record->text.
  */
-static LogRecordPtr decode_syslog_(LogRecordPtr log_record,
-                                   struct tm *tm_base)
+LogRecordPtr decode_syslog_(LogRecordPtr log_record, char *text,
+                            struct tm *tm_base)
+{
+    return decode_syslog_filter_(log_record, text, tm_base, NULL, NULL);
+}
+
+/*
+ * match_name_() --Check if a name is in a filter's list.
+ *
+ * Remarks:
+ * An empty list matches any name.
+ */
+static int match_name_(const char *name, const char *list[], size_t n)
+{
+    if (n == 0)
+    {
+        return 1;
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (name[0] == list[i][0] && strcmp(name, list[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * decode_syslog_filter_() --decode a syslog record, if it matches a filter.
+ *
+ * Parameters:
+ * log_record   --returns the syslog record
+ * text     --the raw text to be parsed (e.g. log_record->text)
+ * tm_base  --the base timestamp for decoding syslog's ambiguous format
+ * filter   --the records to keep (NULL: all of them)
+ * filtered --if not NULL, returns 1 if the record was rejected by filter
+ *
+ * Returns: (LogRecordPtr)
+ * Success: an initialised log record; Failure: NULL (the record is
+ * invalid, or doesn't match).
+ *
+ * Remarks:
+ * Each test is made as soon as its field is decoded, cheapest first:
+ * the message substring is first searched for in the whole line, the
+ * timestamp is only skipped (not converted), and it's only converted
+ * once the record has passed all the other tests.
+ */
+LogRecordPtr decode_syslog_filter_(LogRecordPtr log_record, char *text,
+                                   struct tm *tm_base,
+                                   const LogFilter * filter, int *filtered)
 {
     char *str;
     char *end;
@@ -133,7 +198,17 @@ static LogRecordPtr decode_syslog_(LogRecordPtr log_record,
     log_record->facility = -1;
     log_record->priority = -1;
 
-    if ((str = decode_timestamp_(log_record, &log_base)) == NULL)
+    if (filtered != NULL)
+    {
+        *filtered = 0;
+    }
+    if (filter != NULL && filter->message != NULL
+        && strstr(text, filter->message) == NULL)
+    {
+        goto reject;                   /* (not even in the line) */
+    }
+    if ((str = decode_timestamp_(log_record, text, &log_base,
+                                 filter == NULL)) == NULL)
     {
         return NULL;
     }
@@ -148,6 +223,12 @@ static LogRecordPtr decode_syslog_(LogRecordPtr log_record,
     {
         return NULL;
     }
+    if (filter != NULL
+        && (!match_name_(log_record->host, filter->host, filter->n_host)
+            || !match_name_(log_record->tag, filter->tag, filter->n_tag)))
+    {
+        goto reject;
+    }
     while (*str == ' ')
     {
         ++str;                         /* skip whitespace */
@@ -174,24 +255,289 @@ static LogRecordPtr decode_syslog_(LogRecordPtr log_record,
             }
         }
     }
+    if (filter == NULL)
+    {
+        return log_record;             /* success: (already converted) */
+    }
+    if (filter->priority_mask != 0
+        && (filter->priority_mask
+            & (log_record->priority < 0 ? LOG_FILTER_UNKNOWN
+               : LOG_MASK(log_record->priority))) == 0)
+    {
+        goto reject;
+    }
+    if (filter->message != NULL
+        && strstr(log_record->message, filter->message) == NULL)
+    {
+        goto reject;
+    }
+    if (decode_timestamp_(log_record, text, &log_base, 1) == NULL)
+    {
+        return NULL;                   /* (can't happen) */
+    }
     return log_record;
+
+  reject:
+    if (filtered != NULL)
+    {
+        *filtered = 1;
+    }
+    return NULL;
+}
+
+/*
+ * match_pattern_() --Check that some text matches a "dd:dd"-style pattern.
+ *
+ * Remarks:
+ * In the pattern, "d" matches a digit, and anything else itself.  The
+ * text is checked in order, so it's never read past its end.
+ */
+static int match_pattern_(const char *text, const char *pattern)
+{
+    for (; *pattern != '\0'; ++text, ++pattern)
+    {
+        if (*pattern == 'd' ? (*text < '0' || *text > '9') : *text != *pattern)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * decode_2digit_() --decode a two-digit decimal field.
+ *
+ * Remarks:
+ * The digits must already have been checked by match_pattern_().
+ */
+static int decode_2digit_(const char *text)
+{
+    return (text[0] - '0') * 10 + (text[1] - '0');
+}
+
+/*
+ * days_from_civil_() --Return the No. of days from 1970-01-01 to a date.
+ *
+ * Parameters:
+ * year     --the (full) year
+ * month    --the month (1..12)
+ * day      --the day of the month (1..31)
+ *
+ * Remarks:
+ * This is H. Hinnant's algorithm, for the proleptic Gregorian calendar.
+ */
+static long days_from_civil_(long year, int month, int day)
+{
+    long era, year_of_era, day_of_year;
+
+    year -= month <= 2;
+    era = (year >= 0 ? year : year - 399) / 400;
+    year_of_era = year - era * 400;
+    day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    return era * 146097 + year_of_era * 365 + year_of_era / 4
+        - year_of_era / 100 + day_of_year - 719468;
+}
+
+/*
+ * decode_rfc3339_() --decode an RFC 3339 timestamp (fast path).
+ *
+ * Parameters:
+ * text     --the text to decode
+ * t        --returns the timestamp (NULL: just find its end)
+ *
+ * Returns: (char *)
+ * Success: the text after the timestamp; Failure: NULL.
+ *
+ * Remarks:
+ * Fractional seconds are accepted, but ignored.
+ */
+static char *decode_rfc3339_(char *text, time_t * t)
+{
+    static THREAD_LOCAL struct
+    {
+        int year, month, day;
+        long days;
+    } cache = {
+        -1, -1, -1, 0
+    };
+    int year, month, day, hour, min, sec, offset = 0;
+
+    if (!match_pattern_(text, "dddd-dd-dd")
+        || (text[10] != 'T' && text[10] != 't')
+        || !match_pattern_(text + 11, "dd:dd:dd"))
+    {
+        return NULL;
+    }
+    year = decode_2digit_(text) * 100 + decode_2digit_(text + 2);
+    month = decode_2digit_(text + 5);
+    day = decode_2digit_(text + 8);
+    hour = decode_2digit_(text + 11);
+    min = decode_2digit_(text + 14);
+    sec = decode_2digit_(text + 17);
+    if (month < 1 || month > 12 || day < 1 || day > 31
+        || hour > 23 || min > 59 || sec > 60)
+    {
+        return NULL;                   /* error: field out of range */
+    }
+    text += 19;
+    if (*text == '.')
+    {
+        while (*++text >= '0' && *text <= '9')
+        {
+            ;                          /* skip fractional seconds */
+        }
+    }
+    if (*text == 'Z' || *text == 'z')
+    {
+        ++text;
+    }
+    else if ((*text == '+' || *text == '-')
+             && match_pattern_(text + 1, "dd:dd"))
+    {
+        offset = (decode_2digit_(text + 1) * 60
+                  + decode_2digit_(text + 4)) * 60;
+        offset = *text == '-' ? -offset : offset;
+        text += 6;
+    }
+    else
+    {
+        return NULL;                   /* error: no offset */
+    }
+    if (t == NULL)
+    {
+        return text;                   /* success: (not converted) */
+    }
+    if (year != cache.year || month != cache.month || day != cache.day)
+    {
+        cache.year = year;
+        cache.month = month;
+        cache.day = day;
+        cache.days = days_from_civil_(year, month, day);
+    }
+    *t = (time_t) cache.days * 86400
+        + (hour * 60 + min) * 60 + sec - offset;
+    return text;
+}
+
+/*
+ * decode_bsd_() --decode a "Mmm dd hh:mm:ss" timestamp (fast path).
+ *
+ * Parameters:
+ * text     --the text to decode
+ * tm_base  --the base timestamp (i.e. the year)
+ * t        --returns the timestamp (NULL: just find its end)
+ *
+ * Returns: (char *)
+ * Success: the text after the timestamp; Failure: NULL.
+ *
+ * Remarks:
+ * The timestamp is local time, so the time_t of its minute is found by
+ * mktime(), and cached: DST changes happen on minute boundaries, so the
+ * seconds can be added to it.
+ */
+static char *decode_bsd_(char *text, const struct tm *tm_base, time_t * t)
+{
+    static const char month_name[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    static THREAD_LOCAL struct tm cache = {.tm_year = -1 };
+    static THREAD_LOCAL time_t cache_minute;
+    const char *name = month_name;
+    int month, day, hour, min, sec;
+
+    for (month = 0; month < 12; ++month, name += 3)
+    {
+        if (text[0] == name[0] && text[1] == name[1] && text[2] == name[2])
+        {
+            break;
+        }
+    }
+    if (month == 12 || text[3] != ' ')
+    {
+        return NULL;                   /* (e.g. a full month name) */
+    }
+    text += 4;
+    if (*text == ' ')
+    {
+        ++text;                        /* (day is space-padded) */
+    }
+    if (match_pattern_(text, "dd "))
+    {
+        day = decode_2digit_(text);
+        text += 3;
+    }
+    else if (match_pattern_(text, "d "))
+    {
+        day = text[0] - '0';
+        text += 2;
+    }
+    else
+    {
+        return NULL;
+    }
+    if (!match_pattern_(text, "dd:dd:dd"))
+    {
+        return NULL;
+    }
+    hour = decode_2digit_(text);
+    min = decode_2digit_(text + 3);
+    sec = decode_2digit_(text + 6);
+    if (day < 1 || day > 31 || hour > 23 || min > 59 || sec > 60)
+    {
+        return NULL;                   /* error: field out of range */
+    }
+    if (t == NULL)
+    {
+        return text + 8;               /* success: (not converted) */
+    }
+    if (min != cache.tm_min || hour != cache.tm_hour || day != cache.tm_mday
+        || month != cache.tm_mon || tm_base->tm_year != cache.tm_year)
+    {
+        struct tm tm = {.tm_isdst = -1 };
+
+        tm.tm_year = tm_base->tm_year;
+        tm.tm_mon = month;
+        tm.tm_mday = day;
+        tm.tm_hour = hour;
+        tm.tm_min = min;
+        cache_minute = mktime(&tm);
+        cache.tm_year = tm_base->tm_year;
+        cache.tm_mon = month;
+        cache.tm_mday = day;
+        cache.tm_hour = hour;
+        cache.tm_min = min;
+    }
+    *t = cache_minute + sec;
+    return text + 8;
 }
 
 /*
  * decode_timestamp_() --decode the timestamp part of a syslog message.
+ *
+ * Remarks:
+ * The fixed formats are tried first; date_parse_fmt() (and mktime())
+ * handles anything else.  If convert is false, the timestamp is only
+ * checked (and skipped), and log_record->timestamp isn't set.
  */
-static char *decode_timestamp_(LogRecordPtr log_record, struct tm *tm_base)
+static char *decode_timestamp_(LogRecordPtr log_record, char *text,
+                               struct tm *tm_base, int convert)
 {
-    struct tm tm_syslog = *tm_base;
+    time_t *t = convert ? &log_record->timestamp : NULL;
     char *str;
 
-    if ((str = (char *)
-         date_parse_fmt(log_record->text, &tm_syslog,
-                        ts_fmt, 1, NULL)) == NULL)
+    if ((str = decode_bsd_(text, tm_base, t)) == NULL
+        && (str = decode_rfc3339_(text, t)) == NULL)
     {
-        return NULL;                   /* error: bad timestamp */
+        struct tm tm_syslog = *tm_base;
+
+        if ((str = (char *)
+             date_parse_fmt(text, &tm_syslog, ts_fmt, 1, NULL)) == NULL)
+        {
+            return NULL;               /* error: bad timestamp */
+        }
+        if (convert)
+        {
+            log_record->timestamp = mktime(&tm_syslog);
+        }
     }
-    log_record->timestamp = mktime(&tm_syslog);
 
     while (*str == ' ')
     {
@@ -35,11 +35,118 @@ extern "C"
         char text[SYSLOG_LINE_MAX];    /* original text, munged */
     } LogRecord, *LogRecordPtr;
 
+    /*
+     * LogFilter --The records to keep, checked while decoding.
+     *
+     * Remarks:
+     * A zero/NULL field matches anything.  priority_mask is a set of
+     * LOG_MASK()s, and LOG_FILTER_UNKNOWN for records that have no
+     * "priority:" prefix.  The host and tag lists are searched
+     * linearly, so they're expected to be short.
+     */
+    typedef struct LogFilter_t
+    {
+        unsigned int priority_mask;    /* priorities to keep */
+        const char **host;             /* hosts to keep */
+        size_t n_host;
+        const char **tag;              /* tags to keep */
+        size_t n_tag;
+        const char *message;           /* a substring of the message */
+    } LogFilter, *LogFilterPtr;
+
+#define LOG_FILTER_UNKNOWN (1u << 8)   /* (after LOG_MASK(LOG_DEBUG)) */
+
     LogRecordPtr log_parse_r(LogRecordPtr log_record,
                              const char *str, struct tm *tm_base);
     LogRecordPtr log_parse(const char *str, struct tm *tm_base);
     LogRecordPtr log_fgets(LogRecordPtr log_record, FILE * fp,
                            struct tm *tm_base);
+    LogRecordPtr decode_syslog_(LogRecordPtr log_record, char *text,
+                                struct tm *tm_base);
+    LogRecordPtr decode_syslog_filter_(LogRecordPtr log_record, char *text,
+                                       struct tm *tm_base,
+                                       const LogFilter * filter,
+                                       int *filtered);
+
+    /*
+     * LogScan --The state of a bulk scan of a syslog file.
+     *
+     * Remarks:
+     * The file is read in blocks of size bytes; the records returned by
+     * log_scan_next() point into the block, so they're only valid until
+     * the next call.  Lines that don't parse (or are longer than a
+     * block) are skipped, and counted in n_error.  If filter is set
+     * (after log_scan_new()), records it rejects are skipped too, and
+     * counted in n_filtered.
+     */
+    typedef struct LogScan_t
+    {
+        int fd;
+        char *buf;                     /* the current block */
+        size_t size;                   /* the size of buf */
+        size_t start;                  /* the next line's offset in buf */
+        size_t end;                    /* the end of the data in buf */
+        int eof;                       /* the file has been read */
+        int skip;                      /* skipping the rest of a long line */
+        struct tm tm_base;
+        size_t n_line;                 /* lines read so far */
+        size_t n_error;                /* lines that didn't parse */
+        const LogFilter *filter;       /* records to keep, or NULL */
+        size_t n_filtered;             /* records rejected by filter */
+    } LogScan, *LogScanPtr;
+
+    enum log_scan_consts
+    {
+        LOG_SCAN_BLOCK = 1 << 20,      /* default block size */
+    };
+
+    LogScanPtr log_scan_new(int fd, size_t size, const struct tm *tm_base);
+    void log_scan_free(LogScanPtr scan);
+    LogRecordPtr log_scan_next(LogScanPtr scan, LogRecordPtr log_record);
+
+    /*
+     * LogMerge --Syslog files parsed in parallel, merged by timestamp.
+     */
+    typedef struct LogMerge_t LogMerge, *LogMergePtr;
+
+    LogMergePtr log_merge_new(const char *path[], size_t n_path,
+                              size_t n_chunk, const struct tm *tm_base);
+    LogRecordPtr log_merge_next(LogMergePtr merge, size_t *n_line,
+                                size_t *n_error);
+    void log_merge_free(LogMergePtr merge);
+
+    /*
+     * LogIndex --A sparse index of a syslog file's timestamps.
+     *
+     * Remarks:
+     * Entry i is the timestamp and offset of the first record in some
+     * interval of the file; the timestamps are a separate array, so
+     * they can be searched by lower_bound_long().
+     */
+    typedef struct LogIndex_t
+    {
+        size_t interval;               /* bytes between entries */
+        long size;                     /* the file's size when indexed */
+        time_t mtime;                  /* the file's mtime when indexed */
+        size_t n_entry;
+        size_t n_alloc;
+        long *timestamp;               /* entry timestamps (ascending) */
+        long *offset;                  /* entry record offsets */
+    } LogIndex, *LogIndexPtr;
+
+    enum log_index_consts
+    {
+        LOG_INDEX_INTERVAL = 64 * 1024, /* default entry spacing */
+    };
+
+    LogIndexPtr log_index_build(FILE * fp, size_t interval,
+                                const struct tm *tm_base);
+    int log_index_save(const LogIndex * index, const char *path);
+    LogIndexPtr log_index_load(const char *path);
+    LogIndexPtr log_index_open(FILE * fp, const char *path,
+                               size_t interval, const struct tm *tm_base);
+    void log_index_free(LogIndexPtr index);
+    long log_seek_time(FILE * fp, const LogIndex * index, time_t t);
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
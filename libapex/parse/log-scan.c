@@ -0,0 +1,182 @@
+/*
+ * LOG-SCAN.C --Bulk scanning of syslog files.
+ *
+ * Contents:
+ * log_scan_new()  --Create a scanner for a syslog file.
+ * log_scan_free() --Release a scanner's resources.
+ * fill()          --Read more of the file, keeping the partial line.
+ * log_scan_next() --Return the next (parseable) record of a syslog file.
+ *
+ * Remarks:
+ * log_fgets() copies each line into the LogRecord's text (via stdio's
+ * buffer), which dominates the cost of grepping big files.  The
+ * scanner read()s big blocks instead, finds each line with memchr(),
+ * and parses it in place (decode_syslog_() NUL-terminates the fields
+ * within the block), so the returned record's fields are views of the
+ * block, and no line is copied.  Only the partial line at the end of a
+ * block is moved, to the start of the buffer, before the next read.
+ *
+ * The block is read() rather than mmap()ed: parsing writes into the
+ * text, which would copy every page of a private mapping anyway.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <apex.h>
+#include <apex/log-parse.h>
+
+/*
+ * log_scan_new() --Create a scanner for a syslog file.
+ *
+ * Parameters:
+ * fd      --the file to scan (open for reading)
+ * size    --the block size (0: LOG_SCAN_BLOCK)
+ * tm_base --the base timestamp for decoding syslog's ambiguous format
+ *
+ * Returns: (LogScanPtr)
+ * Success: the scanner; Failure: NULL.
+ *
+ * Remarks:
+ * The caller still owns fd: log_scan_free() doesn't close it.
+ */
+LogScanPtr log_scan_new(int fd, size_t size, const struct tm *tm_base)
+{
+    LogScanPtr scan = malloc(sizeof(*scan));
+
+    if (size == 0)
+    {
+        size = LOG_SCAN_BLOCK;
+    }
+    if (scan == NULL || (scan->buf = malloc(size + 1)) == NULL)
+    {
+        free(scan);
+        return NULL;                   /* error: malloc failed */
+    }
+    scan->fd = fd;
+    scan->size = size;
+    scan->start = scan->end = 0;
+    scan->eof = scan->skip = 0;
+    scan->tm_base = *tm_base;
+    scan->n_line = scan->n_error = 0;
+    scan->filter = NULL;
+    scan->n_filtered = 0;
+    return scan;
+}
+
+/*
+ * log_scan_free() --Release a scanner's resources.
+ */
+void log_scan_free(LogScanPtr scan)
+{
+    if (scan != NULL)
+    {
+        free(scan->buf);
+        free(scan);
+    }
+}
+
+/*
+ * fill() --Read more of the file, keeping the partial line.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the end of the file, or an error).
+ */
+static int fill(LogScanPtr scan)
+{
+    ssize_t n;
+
+    if (scan->eof)
+    {
+        return 0;
+    }
+    if (scan->start > 0)
+    {                                  /* (move the partial line down) */
+        memmove(scan->buf, scan->buf + scan->start, scan->end - scan->start);
+        scan->end -= scan->start;
+        scan->start = 0;
+    }
+    if (scan->end == scan->size)
+    {                                  /* no room: skip the long line */
+        scan->end = 0;
+        scan->n_error += 1;
+        scan->skip = 1;
+    }
+    SYS_RETRY(n, read(scan->fd, scan->buf + scan->end,
+                      scan->size - scan->end));
+    if (n <= 0)
+    {
+        scan->eof = 1;
+        return 0;
+    }
+    scan->end += (size_t) n;
+    return 1;
+}
+
+/*
+ * log_scan_next() --Return the next (parseable) record of a syslog file.
+ *
+ * Parameters:
+ * scan       --the scanner
+ * log_record --returns the record
+ *
+ * Returns: (LogRecordPtr)
+ * Success: log_record; Failure: NULL (the end of the file).
+ *
+ * Remarks:
+ * The record's fields point into the scanner's block, and are valid
+ * until the next call; log_record->text isn't used.  A partial last
+ * line (with no newline) is parsed too.  Records rejected by the
+ * scanner's filter are skipped.
+ */
+LogRecordPtr log_scan_next(LogScanPtr scan, LogRecordPtr log_record)
+{
+    int filtered;
+
+    for (;;)
+    {
+        char *line = scan->buf + scan->start;
+        char *eol = memchr(line, '\n', scan->end - scan->start);
+
+        if (eol == NULL)
+        {
+            if (fill(scan))
+            {
+                continue;
+            }
+            if (scan->start == scan->end)
+            {
+                return NULL;           /* end of file */
+            }
+            eol = scan->buf + scan->end; /* (last line, unterminated) */
+            line = scan->buf + scan->start;
+        }
+        *eol = '\0';
+        scan->start = (size_t) (eol - scan->buf) + 1;
+        if (scan->start > scan->end)
+        {
+            scan->start = scan->end;
+        }
+        if (scan->skip)
+        {                              /* (the rest of a long line) */
+            scan->skip = 0;
+            continue;
+        }
+        scan->n_line += 1;
+        if (decode_syslog_filter_(log_record, line, &scan->tm_base,
+                                  scan->filter, &filtered) != NULL)
+        {
+            log_record->text[0] = '\0';
+            return log_record;
+        }
+        if (filtered)
+        {
+            scan->n_filtered += 1;
+        }
+        else
+        {
+            scan->n_error += 1;
+        }
+    }
+}
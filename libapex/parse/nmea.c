@@ -3,38 +3,308 @@
  *
  * Contents:
  * nmea_checksum() --Return the nmea_checksum for some text.
+ * nmea_field()    --Return a message's i'th value ("" if it's missing).
+ * nmea_real()     --Convert a decimal field, without strtod().
+ * nmea_int()      --Convert an integer field.
+ * nmea_angle()    --Convert a "dddmm.mmmm" field and its hemisphere.
+ * nmea_time()     --Convert an "hhmmss[.sss]" field to milliseconds.
+ * nmea_decode_fix() --Decode a GGA/RMC/VTG message's values into a struct.
+ * nmea_values()   --Split a (mung-able) payload into an NMEA message's values.
  * nmea_parse()    --Parse an NMEA message specified as a string.
  * nmea_fget()     --Read a line from a file, and parse it as an NMEA message.
  * nmea_fmt()      --Format an NMEA message to the wire protocol.
  * nmea_fputs()    --Print a NMEA message to a file.
+ * nmea_stream_init() --Initialise an incremental NMEA decoder.
+ * nmea_sentence() --Decode a complete sentence in a stream's buffer.
+ * nmea_stream_next() --Decode the next NMEA sentence in a chunk of input.
  *
  * Remarks:
  * This module provides processing routines for NMEA-0183 format messages.
  * NMEA is commonly used by GPS equipment.
  *
+ * nmea_stream_next() decodes sentences from arbitrary chunks of bytes
+ * (e.g. from read() or recvmmsg()), so a feed needn't be wrapped in
+ * stdio: each stream keeps the partial sentence at the end of a chunk,
+ * and resynchronises at the next '$' or '!' after noise, a truncated
+ * sentence, or a checksum error.  One NmeaStream is needed per feed
+ * (talker/socket) being multiplexed.
  */
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#include <apex.h>
 #include <apex/log.h>
 #include <apex/estring.h>
 #include <apex/nmea.h>
 
 /*
  * nmea_checksum() --Return the nmea_checksum for some text.
+ *
+ * Remarks:
+ * The checksum is the XOR of the bytes, so it's computed 8 bytes at
+ * a time (XOR-ing words, then folding the word's bytes together),
+ * then byte-by-byte for the tail.
  */
 unsigned int nmea_checksum(const char *str, const char *end)
 {
-    unsigned long check = 0;
+    uint64_t word = 0;
+    unsigned int check;
+
+    while (end - str >= 8)
+    {
+        uint64_t chunk;
 
+        memcpy(&chunk, str, sizeof(chunk));    /* (may be unaligned) */
+        word ^= chunk;
+        str += 8;
+    }
+    word ^= word >> 32;
+    word ^= word >> 16;
+    word ^= word >> 8;
+    check = (unsigned int) (word & 0xff);
     while (str < end)
     {                                  /* calculate checksum from data */
-        check ^= (unsigned long) *str++;    /* simple XOR */
+        check ^= (unsigned char) *str++;    /* simple XOR */
     }
     return check;
 }
 
+/*
+ * nmea_field() --Return a message's i'th value ("" if it's missing).
+ */
+static const char *nmea_field(const Nmea * nmea, size_t i)
+{
+    return i < nmea->n_values ? nmea->value[i] : "";
+}
+
+/*
+ * nmea_real() --Convert a decimal field, without strtod().
+ *
+ * Returns: (double)
+ * Success: the value; Failure: NAN (an empty or invalid field).
+ *
+ * Remarks:
+ * The digits are accumulated as an integer, and scaled once by an
+ * exact power of ten, so the result is correctly rounded (for the
+ * field widths NMEA uses).
+ */
+static double nmea_real(const char *str)
+{
+    static const double scale[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15
+    };
+    uint64_t mantissa = 0;
+    int negative = 0, n_digit = 0, n_frac = -1;
+
+    if (*str == '-' || *str == '+')
+    {
+        negative = *str++ == '-';
+    }
+    for (; *str != '\0'; ++str)
+    {
+        if (*str == '.' && n_frac < 0)
+        {
+            n_frac = 0;
+        }
+        else if (*str >= '0' && *str <= '9' && n_digit < 15)
+        {
+            mantissa = mantissa * 10 + (uint64_t) (*str - '0');
+            ++n_digit;
+            n_frac += n_frac >= 0;
+        }
+        else
+        {
+            return NAN;                /* error: bad/too many digits */
+        }
+    }
+    if (n_digit == 0)
+    {
+        return NAN;                    /* (missing value) */
+    }
+    return (negative ? -1.0 : 1.0) * (double) mantissa
+        / scale[MAX(n_frac, 0)];
+}
+
+/*
+ * nmea_int() --Convert an integer field.
+ *
+ * Returns: (int)
+ * Success: the value; Failure: -1 (an empty or invalid field).
+ */
+static int nmea_int(const char *str)
+{
+    int value = 0;
+
+    if (*str == '\0')
+    {
+        return -1;
+    }
+    for (; *str != '\0'; ++str)
+    {
+        if (*str < '0' || *str > '9' || value > 99999)
+        {
+            return -1;
+        }
+        value = value * 10 + (*str - '0');
+    }
+    return value;
+}
+
+/*
+ * nmea_angle() --Convert a "dddmm.mmmm" field and its hemisphere.
+ *
+ * Parameters:
+ * str      --the angle field
+ * hemi     --the hemisphere field ("N", "S", "E" or "W")
+ *
+ * Returns: (double)
+ * Success: signed degrees (south/west negative); Failure: NAN.
+ */
+static double nmea_angle(const char *str, const char *hemi)
+{
+    double value = nmea_real(str);
+    double degrees;
+
+    if (isnan(value) || value < 0 || hemi[1] != '\0'
+        || (hemi[0] != 'N' && hemi[0] != 'S' && hemi[0] != 'E'
+            && hemi[0] != 'W'))
+    {
+        return NAN;
+    }
+    degrees = (double) (long) (value / 100);
+    degrees += (value - degrees * 100) / 60;
+    return hemi[0] == 'S' || hemi[0] == 'W' ? -degrees : degrees;
+}
+
+/*
+ * nmea_time() --Convert an "hhmmss[.sss]" field to milliseconds.
+ *
+ * Returns: (long)
+ * Success: milliseconds since midnight (UTC); Failure: -1.
+ */
+static long nmea_time(const char *str)
+{
+    long ms = 0;
+    int i;
+
+    for (i = 0; i < 6; ++i)
+    {
+        if (str[i] < '0' || str[i] > '9')
+        {
+            return -1;
+        }
+    }
+    ms = (((str[0] - '0') * 10 + (str[1] - '0')) * 3600
+          + ((str[2] - '0') * 10 + (str[3] - '0')) * 60
+          + (str[4] - '0') * 10 + (str[5] - '0')) * 1000L;
+    if (str[6] == '.')
+    {
+        long scale = 100;
+
+        for (i = 7; str[i] >= '0' && str[i] <= '9'; ++i, scale /= 10)
+        {
+            ms += (str[i] - '0') * scale;
+        }
+        if (str[i] != '\0')
+        {
+            return -1;
+        }
+    }
+    else if (str[6] != '\0')
+    {
+        return -1;
+    }
+    return ms;
+}
+
+/*
+ * nmea_decode_fix() --Decode a GGA/RMC/VTG message's values into a struct.
+ *
+ * Remarks:
+ * Missing or invalid values are NAN (or -1 for integers).  Any other
+ * message (or one from a sentence type this module doesn't know) has
+ * type NMEA_TYPE_OTHER, and only its string values.
+ */
+static void nmea_decode_fix(NmeaPtr nmea)
+{
+    if (strcmp(nmea->msg, "GGA") == 0)
+    {
+        NmeaGGA *gga = &nmea->fix.gga;
+
+        nmea->type = NMEA_TYPE_GGA;
+        gga->time_ms = nmea_time(nmea_field(nmea, 1));
+        gga->latitude = nmea_angle(nmea_field(nmea, 2), nmea_field(nmea, 3));
+        gga->longitude = nmea_angle(nmea_field(nmea, 4),
+                                    nmea_field(nmea, 5));
+        gga->quality = nmea_int(nmea_field(nmea, 6));
+        gga->n_satellites = nmea_int(nmea_field(nmea, 7));
+        gga->hdop = nmea_real(nmea_field(nmea, 8));
+        gga->altitude = nmea_real(nmea_field(nmea, 9));
+        gga->geoid_separation = nmea_real(nmea_field(nmea, 11));
+    }
+    else if (strcmp(nmea->msg, "RMC") == 0)
+    {
+        NmeaRMC *rmc = &nmea->fix.rmc;
+        int date = nmea_int(nmea_field(nmea, 9));
+
+        nmea->type = NMEA_TYPE_RMC;
+        rmc->time_ms = nmea_time(nmea_field(nmea, 1));
+        rmc->valid = nmea_field(nmea, 2)[0] == 'A';
+        rmc->latitude = nmea_angle(nmea_field(nmea, 3), nmea_field(nmea, 4));
+        rmc->longitude = nmea_angle(nmea_field(nmea, 5),
+                                    nmea_field(nmea, 6));
+        rmc->speed_knots = nmea_real(nmea_field(nmea, 7));
+        rmc->course = nmea_real(nmea_field(nmea, 8));
+        rmc->day = date < 0 ? -1 : date / 10000;
+        rmc->month = date < 0 ? -1 : date / 100 % 100;
+        rmc->year = date < 0 ? -1 : 2000 + date % 100;
+        rmc->variation = nmea_real(nmea_field(nmea, 10));
+        if (nmea_field(nmea, 11)[0] == 'W')
+        {                              /* (plain degrees, not "dddmm") */
+            rmc->variation = -rmc->variation;
+        }
+    }
+    else if (strcmp(nmea->msg, "VTG") == 0)
+    {
+        NmeaVTG *vtg = &nmea->fix.vtg;
+
+        nmea->type = NMEA_TYPE_VTG;
+        vtg->course_true = nmea_real(nmea_field(nmea, 1));
+        vtg->course_magnetic = nmea_real(nmea_field(nmea, 3));
+        vtg->speed_knots = nmea_real(nmea_field(nmea, 5));
+        vtg->speed_kmh = nmea_real(nmea_field(nmea, 7));
+    }
+    else
+    {
+        nmea->type = NMEA_TYPE_OTHER;
+    }
+}
+
+/*
+ * nmea_values() --Split a (mung-able) payload into an NMEA message's values.
+ *
+ * Remarks:
+ * The values are NUL-terminated in place, so nmea->value[] points
+ * into text.  Known sentence types are also decoded into nmea->fix.
+ */
+static void nmea_values(NmeaPtr nmea, char *text)
+{
+    char *ptr = text;
+
+    nmea->n_values = strsplit(text, ',');
+    for (size_t i = 0; i < nmea->n_values; ++i)
+    {                                  /* gather all the pieces... */
+        nmea->value[i] = ptr;
+        ptr += strlen(ptr) + 1;
+    }
+    nmea_decode_fix(nmea);
+}
+
 /*
  * nmea_parse() --Parse an NMEA message specified as a string.
  *
@@ -47,9 +317,8 @@ unsigned int nmea_checksum(const char *str, const char *end)
  */
 int nmea_parse(NmeaPtr nmea, const char *str)
 {
-    char *ptr, *end;
+    char *end;
     unsigned check;
-    size_t i;
 
     if (str == NULL || *str++ != '$' || (end = strchr(str, '\n')) == NULL)
     {
@@ -84,13 +353,7 @@ int nmea_parse(NmeaPtr nmea, const char *str)
 
     estrncpy(nmea->text, str, (size_t) (end - str));    /* take mung-able copy */
     nmea->text[end - str] = '\0';
-
-    nmea->n_values = strsplit(nmea->text, ',');
-    for (ptr = nmea->text, i = 0; i < nmea->n_values; ++i)
-    {                                  /* gather all the pieces... */
-        nmea->value[i] = ptr;
-        ptr += strlen(ptr) + 1;
-    }
+    nmea_values(nmea, nmea->text);
 
     return NMEA_OK;                    /* success */
 }
@@ -171,3 +434,127 @@ int nmea_fputs(NmeaPtr nmea, FILE * fp)
 
     return fputs(nmea_fmt(nmea, text), fp);
 }
+
+/*
+ * nmea_stream_init() --Initialise an incremental NMEA decoder.
+ */
+NmeaStreamPtr nmea_stream_init(NmeaStreamPtr stream)
+{
+    stream->len = 0;
+    stream->in_sentence = 0;
+    stream->n_sentence = stream->n_error = 0;
+    return stream;
+}
+
+/*
+ * nmea_sentence() --Decode a complete sentence in a stream's buffer.
+ *
+ * Returns: (int)
+ * Success: NMEA_OK; Failure: NMEA_ERR.
+ *
+ * Remarks:
+ * The stream's text is split in place, so the message's values point
+ * into it.
+ */
+static int nmea_sentence(NmeaStreamPtr stream, NmeaPtr nmea)
+{
+    char *str = stream->text, *end = str + stream->len;
+
+    *end = '\0';
+    if (stream->len >= 3 && end[-3] == '*')
+    {                                  /* check the checksum */
+        unsigned long check = strtoul(end - 2, NULL, 16);
+
+        end -= 3;
+        if (!isxdigit((unsigned char) end[1])
+            || !isxdigit((unsigned char) end[2])
+            || check != nmea_checksum(str, end))
+        {
+            return NMEA_ERR;           /* error: checksum failure */
+        }
+    }
+    if (end - str < 5)
+    {
+        return NMEA_ERR;               /* error: no talker/message ID */
+    }
+    *end = '\0';
+    memcpy(nmea->id, str, sizeof(nmea->id) - 1);
+    nmea->id[sizeof(nmea->id) - 1] = '\0';
+    str += sizeof(nmea->id) - 1;
+    memcpy(nmea->msg, str, sizeof(nmea->msg) - 1);
+    nmea->msg[sizeof(nmea->msg) - 1] = '\0';
+    str += sizeof(nmea->msg) - 1;
+    nmea_values(nmea, str);
+    return NMEA_OK;
+}
+
+/*
+ * nmea_stream_next() --Decode the next NMEA sentence in a chunk of input.
+ *
+ * Parameters:
+ * stream   --the stream's decoder state
+ * nmea     --returns the decoded message
+ * data     --specifies and returns (advances) the input chunk
+ * n_data   --specifies and returns the No. of bytes left in the chunk
+ *
+ * Returns: (int)
+ * NMEA_OK: a sentence was decoded; NMEA_EOF: the chunk is consumed
+ * (a partial sentence is kept); NMEA_ERR: a bad sentence was dropped.
+ *
+ * Remarks:
+ * Call this repeatedly until it returns NMEA_EOF, then read the next
+ * chunk.  The message's values point into the stream, so they're only
+ * valid until the next call.  A sentence may start with '$', or '!'
+ * (e.g. AIS's "!AIVDM"); any other bytes between sentences are skipped.
+ */
+int nmea_stream_next(NmeaStreamPtr stream, NmeaPtr nmea,
+                     const char **data, size_t *n_data)
+{
+    const char *str = *data, *end = str + *n_data;
+    int status = NMEA_EOF;
+
+    while (str < end && status == NMEA_EOF)
+    {
+        int c = (unsigned char) *str++;
+
+        if (c == '$' || c == '!')
+        {                              /* (re-)start a sentence */
+            if (stream->in_sentence)
+            {
+                stream->n_error += 1;  /* (the last one was truncated) */
+                status = NMEA_ERR;
+            }
+            stream->in_sentence = 1;
+            stream->len = 0;
+        }
+        else if (!stream->in_sentence || c == '\r')
+        {
+            continue;                  /* (noise, or DOS <cr>) */
+        }
+        else if (c == '\n')
+        {
+            stream->in_sentence = 0;
+            if ((status = nmea_sentence(stream, nmea)) == NMEA_OK)
+            {
+                stream->n_sentence += 1;
+            }
+            else
+            {
+                stream->n_error += 1;
+            }
+        }
+        else if (c < ' ' || c > '~' || stream->len >= NMEA_LINE_MAX + 3)
+        {
+            stream->in_sentence = 0;   /* error: not printable/too long */
+            stream->n_error += 1;
+            status = NMEA_ERR;
+        }
+        else
+        {
+            stream->text[stream->len++] = (char) c;
+        }
+    }
+    *n_data -= (size_t) (str - *data);
+    *data = str;
+    return status;
+}
@@ -35,6 +35,57 @@ extern "C"
         NMEA_ERR = -2,                 /* miscellaneous failure */
     };
 
+    /*
+     * NmeaType --The sentence types that are decoded into Nmea.fix.
+     */
+    typedef enum NmeaType_t
+    {
+        NMEA_TYPE_OTHER,               /* (only the string values) */
+        NMEA_TYPE_GGA,                 /* GPS fix data */
+        NMEA_TYPE_RMC,                 /* recommended minimum data */
+        NMEA_TYPE_VTG                  /* course and speed */
+    } NmeaType;
+
+    /*
+     * NmeaGGA, NmeaRMC, NmeaVTG --Decoded sentence values.
+     *
+     * Remarks:
+     * Times are milliseconds since midnight (UTC), and angles are
+     * signed degrees (south/west negative).  Missing values are NAN,
+     * or -1 for integers.
+     */
+    typedef struct NmeaGGA_t
+    {
+        long time_ms;
+        double latitude;
+        double longitude;
+        int quality;                   /* 0: no fix, 1: GPS, 2: DGPS... */
+        int n_satellites;
+        double hdop;                   /* horizontal dilution of precision */
+        double altitude;               /* metres above mean sea level */
+        double geoid_separation;       /* metres */
+    } NmeaGGA;
+
+    typedef struct NmeaRMC_t
+    {
+        long time_ms;
+        int valid;                     /* status was "A" */
+        double latitude;
+        double longitude;
+        double speed_knots;
+        double course;                 /* degrees true */
+        int day, month, year;
+        double variation;              /* magnetic (west negative) */
+    } NmeaRMC;
+
+    typedef struct NmeaVTG_t
+    {
+        double course_true;
+        double course_magnetic;
+        double speed_knots;
+        double speed_kmh;
+    } NmeaVTG;
+
     typedef struct Nmea_t
     {
         char id[3];                    /* talker ID */
@@ -42,14 +93,37 @@ extern "C"
         size_t n_values;               /* No. used slots in value[] */
         char *value[NMEA_LINE_MAX];    /* CSV values */
         char text[NMEA_LINE_MAX + 3];
+        NmeaType type;                 /* selects fix's member */
+        union
+        {
+            NmeaGGA gga;
+            NmeaRMC rmc;
+            NmeaVTG vtg;
+        } fix;
     } Nmea, *NmeaPtr;
 
+    /*
+     * NmeaStream --The state of an incremental (chunk-fed) decoder.
+     */
+    typedef struct NmeaStream_t
+    {
+        int in_sentence;               /* a sentence has been started */
+        size_t len;                    /* the length of text so far */
+        size_t n_sentence;             /* sentences decoded */
+        size_t n_error;                /* sentences dropped */
+        char text[NMEA_LINE_MAX + 4];  /* sentence (after the '$') */
+    } NmeaStream, *NmeaStreamPtr;
+
     unsigned int nmea_checksum(const char *str, const char *end);
     int nmea_parse(NmeaPtr nmea_buf, const char *str);
     int nmea_fget(NmeaPtr nmea_buf, FILE * fp);
     char *nmea_fmt(NmeaPtr nmea_buf, char *str);
     int nmea_fputs(NmeaPtr nmea_buf, FILE * fp);
 
+    NmeaStreamPtr nmea_stream_init(NmeaStreamPtr stream);
+    int nmea_stream_next(NmeaStreamPtr stream, NmeaPtr nmea,
+                         const char **data, size_t *n_data);
+
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
@@ -0,0 +1,660 @@
+/*
+ * HTTP-CLIENT.C --An asynchronous HTTP client, driven by an EventLoop.
+ *
+ * Contents:
+ * call_free()          --Free a call, and its request text.
+ * call_complete()      --Complete a call (i.e. run its callback), and free it.
+ * response_*()         --Parser callbacks that build an HTTPResponse.
+ * conn_close()         --Close a connection, re-queueing (or failing) its calls.
+ * conn_flush()         --Write as much of the connection's output as possible.
+ * conn_read()          --Read and parse responses from a connection.
+ * conn_event()         --Handle events on a connection.
+ * conn_new()           --Open a new connection for a call's host.
+ * conn_send()          --Send a call on a connection.
+ * dispatch()           --Assign the pending calls to connections.
+ * http_client_new()    --Create a new asynchronous HTTP client.
+ * http_client_free()   --Close a client's connections, and free it.
+ * http_client_submit() --Submit a request, to be completed by callback.
+ * http_client_pending() --Return the number of calls not yet completed.
+ *
+ * Remarks:
+ * The client keeps many requests in flight on one thread: sockets
+ * are non-blocking and serviced by an EventLoop, and each request's
+ * callback is called with its response when it's complete.  Calls
+ * to the same scheme/host/port share persistent connections (up to
+ * max_per_host of them); once a connection has proven persistent
+ * (i.e. a response said so), idempotent requests (GET, HEAD) are
+ * pipelined on it, up to depth at a time.
+ *
+ * If a connection closes with calls still in flight (e.g. after a
+ * "Connection: close" response, or an idle timeout on the server),
+ * its idempotent calls are re-queued once; others fail.
+ *
+ * Failed calls' callbacks are passed a NULL response.  Responses are
+ * built as for http_request(), and must be freed by the callback (or
+ * later) with http_free_response().
+ */
+#include <apex.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <apex/http.h>
+#include <apex/mem.h>
+#include <apex/protocol.h>
+#include <apex/vector.h>
+
+#define CONN_READ_SIZE (2 * HTTP_LINE_MAX)
+
+typedef struct HTTPCall
+{
+    struct HTTPCall *next;
+    const char *method;
+    char key[FILENAME_MAX];            /* "scheme://domain:port" */
+    char address[FILENAME_MAX];        /* "domain:port" */
+    char *text;                        /* the request's text */
+    size_t len;
+    int retried;
+    HTTPCallbackProc proc;
+    void *data;
+} HTTPCall;
+
+typedef struct HTTPClientConn
+{
+    struct HTTPClientConn *next;
+    HTTPClientPtr client;
+    char key[FILENAME_MAX];
+    int fd;
+    int connected;
+    int n_done;                        /* No. of responses completed */
+    int keep_alive;                    /* last response allows re-use? */
+    HTTPCall *head, *tail;             /* calls in flight, in order */
+    int n_call;
+    char *out;                         /* unsent request text */
+    size_t n_out, max_out;
+    char in[CONN_READ_SIZE];           /* unparsed response text */
+    size_t n_in;
+    HTTPParser parser;
+    HTTPResponsePtr response;          /* response being parsed */
+} HTTPClientConn;
+
+struct HTTPClient_t
+{
+    EventLoopPtr loop;
+    int max_per_host;
+    int depth;
+    HTTPCall *pending, *pending_tail;
+    HTTPClientConn *conn;
+    int n_pending;                     /* No. of calls not completed */
+};
+
+static void dispatch(HTTPClientPtr client);
+
+/*
+ * call_free() --Free a call, and its request text.
+ */
+static void call_free(HTTPCall * call)
+{
+    free(call->text);
+    mem_free(MEM_PROTOCOL, call);
+}
+
+/*
+ * call_complete() --Complete a call (i.e. run its callback), and free it.
+ */
+static void call_complete(HTTPClientPtr client, HTTPCall * call,
+                          HTTPResponsePtr response)
+{
+    client->n_pending -= 1;
+    if (call->proc != NULL)
+    {
+        call->proc(response, call->data);
+    }
+    else if (response != NULL)
+    {
+        http_free_response(response);
+    }
+    call_free(call);
+}
+
+/*
+ * idempotent() --Test if a call can be safely repeated (or pipelined).
+ */
+static int idempotent(const HTTPCall * call)
+{
+    return strcmp(call->method, HTTP_GET) == 0
+        || strcmp(call->method, HTTP_HEAD) == 0;
+}
+
+/*
+ * response_*() --Parser callbacks that build an HTTPResponse.
+ */
+static int response_status(void *data, int status,
+                           const char *UNUSED(reason), size_t UNUSED(len))
+{
+    HTTPClientConn *conn = data;
+
+    return (conn->response = MEM_NEW(MEM_PROTOCOL, HTTPResponse, 1)) != NULL
+        && (conn->response->status = status) != 0;
+}
+
+static int response_header(void *data, const char *name, size_t name_len,
+                           const char *value, size_t value_len)
+{
+    HTTPResponsePtr r = ((HTTPClientConn *) data)->response;
+    Symbol sym = {.type = STRING_TYPE };
+    char *text;
+
+    if (r->header == NULL
+        && (r->header = NEW_VECTOR(Symbol, 0, NULL)) == NULL)
+    {
+        return 0;
+    }
+    if ((text = mem_alloc(MEM_PROTOCOL, name_len + value_len + 2)) == NULL)
+    {
+        return 0;
+    }
+    memcpy(text, name, name_len);      /* (as http_read_response()) */
+    text[name_len] = '\0';
+    memcpy(text + name_len + 1, value, value_len);
+    text[name_len + 1 + value_len] = '\0';
+    sym.name = text;
+    sym.value.string = text + name_len + 1;
+    r->header = vector_add(r->header, 1, &sym);
+    return 1;
+}
+
+static int response_body(void *data, const char *ptr, size_t len)
+{
+    HTTPResponsePtr r = ((HTTPClientConn *) data)->response;
+
+    if (r->content == NULL
+        && (r->content = NEW_VECTOR(char, 0, NULL)) == NULL)
+    {
+        return 0;
+    }
+    r->content = vector_add((void *) r->content, len, (void *) ptr);
+    return 1;
+}
+
+static const HTTPParserProcs response_procs = {
+    response_status, response_header, NULL, response_body, NULL
+};
+
+/*
+ * conn_close() --Close a connection, re-queueing (or failing) its calls.
+ */
+static void conn_close(HTTPClientConn * conn)
+{
+    HTTPClientPtr client = conn->client;
+    HTTPCall *call, *next, **requeue = &client->pending;
+
+    for (HTTPClientConn ** link = &client->conn; *link != NULL;
+         link = &(*link)->next)
+    {
+        if (*link == conn)
+        {
+            *link = conn->next;
+            break;
+        }
+    }
+    event_loop_remove(client->loop, conn->fd);
+    close(conn->fd);
+    if (conn->response != NULL)
+    {
+        http_free_response(conn->response);
+    }
+    for (call = conn->head; call != NULL; call = next)
+    {
+        next = call->next;
+        if (idempotent(call) && !call->retried)
+        {                              /* re-queue (in order, at the front) */
+            call->retried = 1;
+            call->next = *requeue;
+            *requeue = call;
+            if (call->next == NULL)
+            {
+                client->pending_tail = call;
+            }
+            requeue = &call->next;
+        }
+        else
+        {
+            call_complete(client, call, NULL);
+        }
+    }
+    mem_free(MEM_PROTOCOL, conn->out);
+    mem_free(MEM_PROTOCOL, conn);
+}
+
+/*
+ * conn_flush() --Write as much of the connection's output as possible.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (write error).
+ */
+static int conn_flush(HTTPClientConn * conn)
+{
+    while (conn->n_out > 0)
+    {
+        ssize_t n = send(conn->fd, conn->out, conn->n_out, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;                 /* wait for EVENT_WRITE */
+            }
+            return 0;
+        }
+        memmove(conn->out, conn->out + n, conn->n_out - (size_t) n);
+        conn->n_out -= (size_t) n;
+    }
+    return event_loop_modify(conn->client->loop, conn->fd,
+                             EVENT_READ | (conn->n_out > 0 ? EVENT_WRITE
+                                           : 0));
+}
+
+/*
+ * conn_parse() --Parse the buffered input, completing calls.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (parse error, or the connection must close).
+ */
+static int conn_parse(HTTPClientConn * conn)
+{
+    size_t used = 0;
+
+    while (conn->head != NULL && used < conn->n_in)
+    {
+        ssize_t n = http_parse(&conn->parser, conn->in + used,
+                               conn->n_in - used);
+        HTTPCall *call;
+
+        if (n < 0)
+        {
+            return 0;                  /* error: bad response */
+        }
+        used += (size_t) n;
+        if (!http_parse_done(&conn->parser))
+        {
+            break;                     /* need more input */
+        }
+        call = conn->head;             /* complete the oldest call */
+        conn->head = call->next;
+        conn->tail = conn->head != NULL ? conn->tail : NULL;
+        conn->n_call -= 1;
+        conn->n_done += 1;
+        conn->keep_alive = conn->parser.keep_alive;
+        call_complete(conn->client, call, conn->response);
+        conn->response = NULL;
+        if (!conn->keep_alive)
+        {
+            return 0;                  /* server will close */
+        }
+        if (conn->head != NULL)
+        {
+            http_parser_init(&conn->parser, conn->head->method,
+                             &response_procs, conn);
+        }
+    }
+    memmove(conn->in, conn->in + used, conn->n_in - used);
+    conn->n_in -= used;
+    return conn->head != NULL || conn->n_in == 0;
+}
+
+/*
+ * conn_read() --Read and parse responses from a connection.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the connection must be closed).
+ */
+static int conn_read(HTTPClientConn * conn)
+{
+    for (;;)
+    {
+        ssize_t n = read(conn->fd, conn->in + conn->n_in,
+                         sizeof(conn->in) - conn->n_in);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        if (n == 0)
+        {                              /* EOF: maybe the end of a body */
+            if (conn->head != NULL && http_parse_eof(&conn->parser))
+            {
+                HTTPCall *call = conn->head;
+
+                conn->head = call->next;
+                conn->n_call -= 1;
+                call_complete(conn->client, call, conn->response);
+                conn->response = NULL;
+            }
+            return 0;
+        }
+        conn->n_in += (size_t) n;
+        if (!conn_parse(conn))
+        {
+            return 0;
+        }
+        if (conn->n_in == sizeof(conn->in))
+        {
+            return 0;                  /* error: can't make progress */
+        }
+    }
+}
+
+/*
+ * conn_event() --Handle events on a connection.
+ */
+static void conn_event(EventLoopPtr UNUSED(loop), int UNUSED(fd),
+                       int events, void *data)
+{
+    HTTPClientConn *conn = data;
+    HTTPClientPtr client = conn->client;
+    int status = 1;
+
+    if (!conn->connected && (events & (EVENT_WRITE | EVENT_ERROR)))
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+
+        getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0)
+        {
+            for (HTTPCall * call = conn->head; call != NULL;
+                 call = call->next)
+            {
+                call->retried = 1;     /* (don't retry a refused connect) */
+            }
+            conn_close(conn);
+            dispatch(client);
+            return;
+        }
+        conn->connected = 1;
+    }
+    if (events & EVENT_WRITE)
+    {
+        status = conn_flush(conn);
+    }
+    if (status && (events & (EVENT_READ | EVENT_HANGUP | EVENT_ERROR)))
+    {
+        status = conn_read(conn);
+    }
+    if (!status)
+    {
+        conn_close(conn);
+    }
+    dispatch(client);
+}
+
+/*
+ * conn_new() --Open a new connection for a call's host.
+ */
+static HTTPClientConn *conn_new(HTTPClientPtr client, HTTPCall * call)
+{
+    HTTPClientConn *conn = MEM_NEW(MEM_PROTOCOL, HTTPClientConn, 1);
+
+    if (conn == NULL)
+    {
+        return NULL;
+    }
+    if ((conn->fd = open_connect_async(call->address, PF_UNSPEC,
+                                       SOCK_STREAM)) < 0)
+    {
+        mem_free(MEM_PROTOCOL, conn);
+        return NULL;
+    }
+    if (!event_loop_add(client->loop, conn->fd, EVENT_READ | EVENT_WRITE,
+                        conn_event, conn))
+    {
+        close(conn->fd);
+        mem_free(MEM_PROTOCOL, conn);
+        return NULL;
+    }
+    conn->client = client;
+    conn->keep_alive = 1;
+    strcpy(conn->key, call->key);
+    conn->next = client->conn;
+    client->conn = conn;
+    return conn;
+}
+
+/*
+ * conn_send() --Send a call on a connection.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (malloc failed).
+ */
+static int conn_send(HTTPClientConn * conn, HTTPCall * call)
+{
+    if (conn->n_out + call->len > conn->max_out)
+    {
+        size_t max_out = MAX(conn->n_out + call->len, 2 * conn->max_out);
+        char *out = mem_realloc(MEM_PROTOCOL, conn->out, max_out);
+
+        if (out == NULL)
+        {
+            return 0;
+        }
+        conn->out = out;
+        conn->max_out = max_out;
+    }
+    memcpy(conn->out + conn->n_out, call->text, call->len);
+    conn->n_out += call->len;
+    if (conn->head == NULL)
+    {
+        http_parser_init(&conn->parser, call->method, &response_procs, conn);
+        conn->head = call;
+    }
+    else
+    {
+        conn->tail->next = call;
+    }
+    call->next = NULL;
+    conn->tail = call;
+    conn->n_call += 1;
+    return !conn->connected || conn_flush(conn);
+}
+
+/*
+ * dispatch() --Assign the pending calls to connections.
+ *
+ * Remarks:
+ * A call goes on an idle connection to its host if there is one,
+ * else it's pipelined (if it's allowed), else a new connection is
+ * made (if there are fewer than max_per_host); otherwise it stays
+ * pending.
+ */
+static void dispatch(HTTPClientPtr client)
+{
+    HTTPCall **link = &client->pending, *tail = NULL;
+
+    while (*link != NULL)
+    {
+        HTTPCall *call = *link;
+        HTTPClientConn *conn, *best = NULL;
+        int n_host = 0;
+
+        for (conn = client->conn; conn != NULL; conn = conn->next)
+        {
+            if (strcmp(conn->key, call->key) != 0)
+            {
+                continue;
+            }
+            ++n_host;
+            if (conn->n_call == 0 && conn->keep_alive)
+            {
+                best = conn;
+                break;
+            }
+            if (idempotent(call) && idempotent(conn->tail)
+                && conn->n_done > 0 && conn->keep_alive
+                && conn->n_call < client->depth
+                && (best == NULL || conn->n_call < best->n_call))
+            {
+                best = conn;           /* pipeline */
+            }
+        }
+        if (best == NULL && n_host < client->max_per_host
+            && (best = conn_new(client, call)) == NULL)
+        {
+            *link = call->next;        /* failure: can't connect */
+            call_complete(client, call, NULL);
+            continue;
+        }
+        if (best == NULL)
+        {
+            tail = call;
+            link = &call->next;        /* wait for a connection */
+            continue;
+        }
+        *link = call->next;
+        if (!conn_send(best, call))
+        {
+            conn_close(best);
+            link = &client->pending;   /* (closing re-queues calls) */
+            tail = NULL;
+        }
+    }
+    client->pending_tail = tail;
+    for (HTTPCall * call = client->pending; call != NULL; call = call->next)
+    {
+        client->pending_tail = call;
+    }
+}
+
+/*
+ * http_client_new() --Create a new asynchronous HTTP client.
+ *
+ * Parameters:
+ * loop     --the event loop to run the connections on
+ * max_per_host --the maximum number of connections to a host
+ * depth    --the maximum number of requests pipelined on a connection
+ *
+ * Returns: (HTTPClientPtr)
+ * Success: the new client; Failure: NULL.
+ */
+HTTPClientPtr http_client_new(EventLoopPtr loop, int max_per_host,
+                              int depth)
+{
+    HTTPClientPtr client = MEM_NEW(MEM_PROTOCOL, HTTPClient, 1);
+
+    if (client != NULL)
+    {
+        client->loop = loop;
+        client->max_per_host = MAX(max_per_host, 1);
+        client->depth = MAX(depth, 1);
+    }
+    return client;
+}
+
+/*
+ * http_client_free() --Close a client's connections, and free it.
+ *
+ * Remarks:
+ * Calls that haven't completed are failed (i.e. their callbacks are
+ * passed NULL).
+ */
+void http_client_free(HTTPClientPtr client)
+{
+    HTTPCall *call;
+
+    if (client == NULL)
+    {
+        return;
+    }
+    while (client->conn != NULL)
+    {
+        for (call = client->conn->head; call != NULL; call = call->next)
+        {
+            call->retried = 1;         /* fail, don't re-queue */
+        }
+        conn_close(client->conn);
+    }
+    while ((call = client->pending) != NULL)
+    {
+        client->pending = call->next;
+        call_complete(client, call, NULL);
+    }
+    mem_free(MEM_PROTOCOL, client);
+}
+
+/*
+ * http_client_submit() --Submit a request, to be completed by callback.
+ *
+ * Parameters:
+ * client   --the client
+ * method   --specifies the protocol method (e.g. "GET")
+ * http_req --specifies the details of the HTTP request
+ * version  --specifies the version of HTTP protocol to use
+ * proc     --called with the response (or NULL) when the call completes
+ * data     --caller data passed to proc
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The request is formatted immediately, so http_req needn't outlive
+ * this call.  The callback is called from the event loop (or, if
+ * the request can't be sent at all, from here).
+ */
+int http_client_submit(HTTPClientPtr client, const char *method,
+                       HTTPRequestPtr http_req, const char *version,
+                       HTTPCallbackProc proc, void *data)
+{
+    HTTPCall *call = MEM_NEW(MEM_PROTOCOL, HTTPCall, 1);
+    URLPtr url = &http_req->url;
+
+    if (call == NULL)
+    {
+        return 0;
+    }
+    if ((call->text = http_format(method, http_req, version,
+                                  &call->len)) == NULL)
+    {
+        mem_free(MEM_PROTOCOL, call);
+        return 0;
+    }
+    call->method = method;
+    call->proc = proc;
+    call->data = data;
+    snprintf(call->key, sizeof(call->key), "%s://%s:%d",
+             url->scheme != NULL ? url->scheme : "http", url->domain,
+             url->port);
+    snprintf(call->address, sizeof(call->address),
+             strchr(url->domain, ':') != NULL ? "[%s]:%d" : "%s:%d",
+             url->domain, url->port);
+    if (client->pending_tail != NULL)
+    {
+        client->pending_tail->next = call;
+    }
+    else
+    {
+        client->pending = call;
+    }
+    client->pending_tail = call;
+    client->n_pending += 1;
+    dispatch(client);
+    return 1;
+}
+
+/*
+ * http_client_pending() --Return the number of calls not yet completed.
+ */
+int http_client_pending(const HTTPClient * client)
+{
+    return client->n_pending;
+}
@@ -0,0 +1,362 @@
+/*
+ * HTTP-PARSE.C --An incremental, allocation-free HTTP response parser.
+ *
+ * Contents:
+ * http_parser_init()   --Initialise a parser for a new response.
+ * view_eq()            --Compare a view with a string (ignoring case).
+ * parse_status()       --Parse the status line.
+ * parse_header()       --Parse a header line, and note the body's framing.
+ * start_body()         --Choose the body state, after the headers.
+ * finish()             --Mark the response complete.
+ * parse_line()         --Parse a line in a line-oriented state.
+ * http_parse()         --Parse (some more of) a response.
+ * http_parse_eof()     --Tell the parser that the input has ended.
+ * http_parse_done()    --Test if the parser has seen the whole response.
+ *
+ * Remarks:
+ * The parser works on the caller's buffers, and calls back with
+ * views (pointer, length) into them, so nothing is copied or
+ * allocated: the status line and headers are reported line by
+ * line, and the body as it arrives (de-chunked), so a large body can
+ * be streamed to disk without being held in memory.
+ *
+ * http_parse() consumes as much of the buffer as it can, and returns
+ * how much that was: a header line is consumed only once it's
+ * complete, so the caller must present any unconsumed bytes again
+ * (followed by more input) in the next call.  Body bytes are always
+ * consumed, so only a partial line ever needs to be kept.
+ *
+ * The views are only valid during the callback.
+ */
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#include <apex.h>
+#include <apex/http.h>
+
+enum
+{
+    HTTP_STATUS_LINE,
+    HTTP_HEADER_LINE,
+    HTTP_BODY_LENGTH,                  /* Content-Length body */
+    HTTP_BODY_EOF,                     /* body delimited by EOF */
+    HTTP_CHUNK_SIZE,
+    HTTP_CHUNK_DATA,
+    HTTP_CHUNK_END,                    /* CRLF after the chunk's data */
+    HTTP_TRAILER_LINE,
+    HTTP_DONE,
+    HTTP_ERROR
+};
+
+/*
+ * http_parser_init() --Initialise a parser for a new response.
+ *
+ * Parameters:
+ * parser   --the parser
+ * method   --the request's method (HEAD responses have no body)
+ * procs    --the callbacks (any may be NULL)
+ * data     --caller data passed to the callbacks
+ *
+ * Returns: (HTTPParserPtr)
+ * The initialised parser.
+ */
+HTTPParserPtr http_parser_init(HTTPParserPtr parser, const char *method,
+                               const HTTPParserProcs * procs, void *data)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->state = HTTP_STATUS_LINE;
+    parser->head = method != NULL && strcmp(method, HTTP_HEAD) == 0;
+    parser->content_length = -1;
+    parser->procs = procs;
+    parser->data = data;
+    return parser;
+}
+
+/*
+ * view_eq() --Compare a view with a string (ignoring case).
+ */
+static int view_eq(const char *view, size_t len, const char *str)
+{
+    return strlen(str) == len && strncasecmp(view, str, len) == 0;
+}
+
+/*
+ * parse_status() --Parse the status line.
+ *
+ * Remarks:
+ * The syntax is "HTTP/1.x ddd reason".
+ */
+static int parse_status(HTTPParserPtr parser, const char *line, size_t len)
+{
+    const char *reason;
+
+    if (len < 12 || strncmp(line, "HTTP/1.", 7) != 0
+        || line[7] < '0' || line[7] > '9' || line[8] != ' '
+        || line[9] < '1' || line[9] > '5'
+        || line[10] < '0' || line[10] > '9'
+        || line[11] < '0' || line[11] > '9' || (len > 12 && line[12] != ' '))
+    {
+        return 0;                      /* error: bad status line */
+    }
+    parser->minor_version = line[7] - '0';
+    parser->status = (line[9] - '0') * 100 + (line[10] - '0') * 10
+        + (line[11] - '0');
+    parser->keep_alive = parser->minor_version >= 1;
+    reason = line + MIN(len, 13);
+    return parser->procs == NULL || parser->procs->status == NULL
+        || parser->procs->status(parser->data, parser->status, reason,
+                                 (size_t) (line + len - reason));
+}
+
+/*
+ * parse_header() --Parse a header line, and note the body's framing.
+ */
+static int parse_header(HTTPParserPtr parser, const char *line, size_t len)
+{
+    const char *colon = memchr(line, ':', len), *value, *end = line + len;
+    size_t name_len;
+
+    if (colon == NULL || colon == line)
+    {
+        return 0;                      /* error: bad header */
+    }
+    name_len = (size_t) (colon - line);
+    for (value = colon + 1; value < end && (*value == ' ' || *value == '\t');
+         ++value)
+    {
+        ;
+    }
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+        --end;
+    }
+    if (parser->state == HTTP_HEADER_LINE)
+    {
+        size_t value_len = (size_t) (end - value);
+
+        if (view_eq(line, name_len, "Content-Length"))
+        {
+            char *num_end;
+
+            parser->content_length = (long long) strtoull(value, &num_end,
+                                                          10);
+            if (num_end == value || num_end != end)
+            {
+                return 0;              /* error: bad Content-Length */
+            }
+        }
+        else if (view_eq(line, name_len, "Transfer-Encoding"))
+        {
+            parser->chunked = !view_eq(value, value_len, "identity");
+        }
+        else if (view_eq(line, name_len, "Connection"))
+        {
+            if (view_eq(value, value_len, "close"))
+            {
+                parser->keep_alive = 0;
+            }
+            else if (view_eq(value, value_len, "keep-alive"))
+            {
+                parser->keep_alive = 1;
+            }
+        }
+    }
+    return parser->procs == NULL || parser->procs->header == NULL
+        || parser->procs->header(parser->data, line, name_len,
+                                 value, (size_t) (end - value));
+}
+
+/*
+ * finish() --Mark the response complete.
+ */
+static int finish(HTTPParserPtr parser)
+{
+    parser->state = HTTP_DONE;
+    return parser->procs == NULL || parser->procs->done == NULL
+        || parser->procs->done(parser->data);
+}
+
+/*
+ * start_body() --Choose the body state, after the headers.
+ */
+static int start_body(HTTPParserPtr parser)
+{
+    if (parser->procs != NULL && parser->procs->headers_done != NULL
+        && !parser->procs->headers_done(parser->data))
+    {
+        return 0;
+    }
+    if (parser->head || parser->status / 100 == 1
+        || parser->status == 204 || parser->status == 304)
+    {
+        return finish(parser);         /* no body */
+    }
+    if (parser->chunked)
+    {
+        parser->state = HTTP_CHUNK_SIZE;
+    }
+    else if (parser->content_length >= 0)
+    {
+        parser->remain = (unsigned long long) parser->content_length;
+        parser->state = HTTP_BODY_LENGTH;
+        if (parser->remain == 0)
+        {
+            return finish(parser);
+        }
+    }
+    else
+    {
+        parser->keep_alive = 0;
+        parser->state = HTTP_BODY_EOF;
+    }
+    return 1;
+}
+
+/*
+ * parse_line() --Parse a line in a line-oriented state.
+ */
+static int parse_line(HTTPParserPtr parser, const char *line, size_t len)
+{
+    char *end;
+
+    switch (parser->state)
+    {
+    case HTTP_STATUS_LINE:
+        if (!parse_status(parser, line, len))
+        {
+            return 0;
+        }
+        parser->state = HTTP_HEADER_LINE;
+        return 1;
+    case HTTP_HEADER_LINE:
+        return len == 0 ? start_body(parser)
+            : parse_header(parser, line, len);
+    case HTTP_CHUNK_SIZE:
+        parser->remain = strtoull(line, &end, 16);
+        if (end == line || (end < line + len && *end != ';' && *end != ' '))
+        {
+            return 0;                  /* error: bad chunk size */
+        }
+        parser->state = parser->remain == 0
+            ? HTTP_TRAILER_LINE : HTTP_CHUNK_DATA;
+        return 1;
+    case HTTP_CHUNK_END:
+        parser->state = HTTP_CHUNK_SIZE;
+        return len == 0;               /* (must be empty) */
+    case HTTP_TRAILER_LINE:
+        return len == 0 ? finish(parser) : parse_header(parser, line, len);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * http_parse() --Parse (some more of) a response.
+ *
+ * Parameters:
+ * parser   --the parser
+ * buf      --the input
+ * len      --the number of bytes of input
+ *
+ * Returns: (ssize_t)
+ * Success: the number of bytes consumed; Failure: -1 (syntax error,
+ * a line longer than HTTP_LINE_MAX, or a callback failed).
+ *
+ * Remarks:
+ * Parsing stops at the end of the response (parser->state is then
+ * HTTP_DONE, and http_parse_done() is true), so any bytes after it
+ * (i.e. the next response) are not consumed.
+ */
+ssize_t http_parse(HTTPParserPtr parser, const char *buf, size_t len)
+{
+    const char *ptr = buf, *end = buf + len;
+
+    while (ptr < end && parser->state != HTTP_DONE)
+    {
+        if (parser->state == HTTP_ERROR)
+        {
+            return -1;
+        }
+        if (parser->state == HTTP_BODY_LENGTH
+            || parser->state == HTTP_CHUNK_DATA
+            || parser->state == HTTP_BODY_EOF)
+        {
+            size_t n = (size_t) (end - ptr);
+
+            if (parser->state != HTTP_BODY_EOF && parser->remain < n)
+            {
+                n = (size_t) parser->remain;
+            }
+            if (parser->procs != NULL && parser->procs->body != NULL
+                && !parser->procs->body(parser->data, ptr, n))
+            {
+                parser->state = HTTP_ERROR;
+                return -1;
+            }
+            ptr += n;
+            if (parser->state != HTTP_BODY_EOF && (parser->remain -= n) == 0)
+            {
+                if (parser->state == HTTP_CHUNK_DATA)
+                {
+                    parser->state = HTTP_CHUNK_END;
+                }
+                else if (!finish(parser))
+                {
+                    parser->state = HTTP_ERROR;
+                    return -1;
+                }
+            }
+        }
+        else
+        {
+            const char *nl = memchr(ptr, '\n', (size_t) (end - ptr));
+            size_t line_len;
+
+            if (nl == NULL)
+            {
+                if ((size_t) (end - ptr) > HTTP_LINE_MAX)
+                {
+                    parser->state = HTTP_ERROR;
+                    return -1;         /* error: line too long */
+                }
+                break;                 /* incomplete line */
+            }
+            line_len = (size_t) (nl - ptr);
+            if (line_len > 0 && ptr[line_len - 1] == '\r')
+            {
+                --line_len;
+            }
+            if (!parse_line(parser, ptr, line_len))
+            {
+                parser->state = HTTP_ERROR;
+                return -1;
+            }
+            ptr = nl + 1;
+        }
+    }
+    return (ssize_t) (ptr - buf);
+}
+
+/*
+ * http_parse_eof() --Tell the parser that the input has ended.
+ *
+ * Returns: (int)
+ * Success: 1 (the response is complete); Failure: 0 (it's truncated).
+ */
+int http_parse_eof(HTTPParserPtr parser)
+{
+    if (parser->state == HTTP_BODY_EOF)
+    {
+        return finish(parser);
+    }
+    return parser->state == HTTP_DONE;
+}
+
+/*
+ * http_parse_done() --Test if the parser has seen the whole response.
+ */
+int http_parse_done(const HTTPParser * parser)
+{
+    return parser->state == HTTP_DONE;
+}
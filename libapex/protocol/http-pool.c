@@ -0,0 +1,291 @@
+/*
+ * HTTP-POOL.C --A pool of persistent (keep-alive) HTTP connections.
+ *
+ * Contents:
+ * msec_now()          --Get the monotonic time in milliseconds.
+ * close_idle()        --Close the connections that have been idle too long.
+ * acquire()           --Get a connection to a URL's host, making one if needed.
+ * release()           --Return a connection to the pool (or close it).
+ * http_pool_new()     --Create a new connection pool.
+ * http_pool_free()    --Close all of a pool's connections, and free it.
+ * http_pool_request() --Perform an HTTP request on a pooled connection.
+ *
+ * Remarks:
+ * http_request() makes (and closes) a connection for every request;
+ * a pool keeps connections open after their response (if the server
+ * allows it), and re-uses them for the next request to the same
+ * scheme/host/port.  A connection is used by one request at a time,
+ * and at most max_per_host connections are made to each host: when
+ * they're all busy, requests wait for one to be released.
+ * Connections idle for longer than idle_timeout are closed.
+ *
+ * A server may close an idle connection at any time, so if a re-used
+ * connection fails before a response is read, the request is retried
+ * (once) on a new connection.
+ *
+ * The pool is thread-safe; requests block, and run in parallel on
+ * different connections.
+ */
+#include <apex.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <apex/http.h>
+#include <apex/mem.h>
+
+typedef struct HTTPConnection
+{
+    struct HTTPConnection *next;
+    char key[FILENAME_MAX];            /* "scheme://domain:port" */
+    FILE *fp;                          /* (NULL while connecting) */
+    long long idle_since;              /* (ms) */
+    int busy;
+} HTTPConnection;
+
+struct HTTPPool_t
+{
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+    HTTPConnection *conn;
+    int max_per_host;
+    int idle_timeout;                  /* (ms) */
+};
+
+static void release(HTTPPoolPtr pool, HTTPConnection * conn, int keep);
+
+/*
+ * msec_now() --Get the monotonic time in milliseconds.
+ */
+static long long msec_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*
+ * close_idle() --Close the connections that have been idle too long.
+ *
+ * Remarks:
+ * The caller must hold the pool's lock.
+ */
+static void close_idle(HTTPPoolPtr pool, long long now)
+{
+    for (HTTPConnection ** link = &pool->conn; *link != NULL;)
+    {
+        HTTPConnection *conn = *link;
+
+        if (!conn->busy && now - conn->idle_since >= pool->idle_timeout)
+        {
+            *link = conn->next;
+            fclose(conn->fp);
+            mem_free(MEM_PROTOCOL, conn);
+        }
+        else
+        {
+            link = &conn->next;
+        }
+    }
+}
+
+/*
+ * acquire() --Get a connection to a URL's host, making one if needed.
+ *
+ * Parameters:
+ * pool     --the pool
+ * url      --the URL
+ * reused   --returns true if the connection was already open
+ *
+ * Returns: (HTTPConnection *)
+ * Success: a (busy) connection; Failure: NULL.
+ */
+static HTTPConnection *acquire(HTTPPoolPtr pool, URLPtr url, int *reused)
+{
+    char key[FILENAME_MAX];
+    HTTPConnection *conn;
+
+    snprintf(key, sizeof(key), "%s://%s:%d",
+             url->scheme != NULL ? url->scheme : "http", url->domain,
+             url->port);
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        int n_host = 0;
+
+        close_idle(pool, msec_now());
+        for (conn = pool->conn; conn != NULL; conn = conn->next)
+        {
+            if (strcmp(conn->key, key) == 0)
+            {
+                if (!conn->busy)
+                {
+                    conn->busy = 1;
+                    pthread_mutex_unlock(&pool->lock);
+                    *reused = 1;
+                    return conn;       /* success: idle connection */
+                }
+                ++n_host;
+            }
+        }
+        if (n_host < pool->max_per_host)
+        {
+            break;
+        }
+        pthread_cond_wait(&pool->released, &pool->lock);
+    }
+    if ((conn = MEM_NEW(MEM_PROTOCOL, HTTPConnection, 1)) != NULL)
+    {                                  /* reserve a slot, then connect */
+        strcpy(conn->key, key);
+        conn->busy = 1;
+        conn->next = pool->conn;
+        pool->conn = conn;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (conn != NULL && (conn->fp = http_connect(url)) == NULL)
+    {
+        release(pool, conn, 0);
+        return NULL;                   /* failure: can't connect */
+    }
+    *reused = 0;
+    return conn;
+}
+
+/*
+ * release() --Return a connection to the pool (or close it).
+ *
+ * Parameters:
+ * pool     --the pool
+ * conn     --the connection
+ * keep     --true if the connection can be re-used
+ */
+static void release(HTTPPoolPtr pool, HTTPConnection * conn, int keep)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (keep)
+    {
+        conn->busy = 0;
+        conn->idle_since = msec_now();
+    }
+    else
+    {
+        for (HTTPConnection ** link = &pool->conn; *link != NULL;
+             link = &(*link)->next)
+        {
+            if (*link == conn)
+            {
+                *link = conn->next;
+                break;
+            }
+        }
+        if (conn->fp != NULL)
+        {
+            fclose(conn->fp);
+        }
+        mem_free(MEM_PROTOCOL, conn);
+    }
+    pthread_cond_broadcast(&pool->released);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * http_pool_new() --Create a new connection pool.
+ *
+ * Parameters:
+ * max_per_host --the maximum number of connections to each host
+ * idle_timeout --the time (ms) to keep an idle connection open
+ *
+ * Returns: (HTTPPoolPtr)
+ * Success: the new pool; Failure: NULL.
+ */
+HTTPPoolPtr http_pool_new(int max_per_host, int idle_timeout)
+{
+    HTTPPoolPtr pool = MEM_NEW(MEM_PROTOCOL, HTTPPool, 1);
+
+    if (pool != NULL)
+    {
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->released, NULL);
+        pool->max_per_host = MAX(max_per_host, 1);
+        pool->idle_timeout = idle_timeout;
+    }
+    return pool;
+}
+
+/*
+ * http_pool_free() --Close all of a pool's connections, and free it.
+ *
+ * Remarks:
+ * There must be no requests in progress.
+ */
+void http_pool_free(HTTPPoolPtr pool)
+{
+    if (pool != NULL)
+    {
+        HTTPConnection *conn, *next;
+
+        for (conn = pool->conn; conn != NULL; conn = next)
+        {
+            next = conn->next;
+            if (conn->fp != NULL)
+            {
+                fclose(conn->fp);
+            }
+            mem_free(MEM_PROTOCOL, conn);
+        }
+        pthread_cond_destroy(&pool->released);
+        pthread_mutex_destroy(&pool->lock);
+        mem_free(MEM_PROTOCOL, pool);
+    }
+}
+
+/*
+ * http_pool_request() --Perform an HTTP request on a pooled connection.
+ *
+ * Parameters:
+ * pool     --the connection pool
+ * method   --specifies the protocol method (e.g. "GET")
+ * http_req --specifies the details of the HTTP request
+ * version  --specifies the version of HTTP protocol to use
+ *
+ * Returns: (HTTPResponsePtr)
+ * Success: a malloc'd HTTP response; Failure: NULL.
+ *
+ * Remarks:
+ * This is http_request(), but with connection re-use.  HTTP/1.1
+ * connections are persistent by default; HTTP/1.0 ones only if the
+ * server says so.
+ */
+HTTPResponsePtr http_pool_request(HTTPPoolPtr pool, const char *method,
+                                  HTTPRequestPtr http_req,
+                                  const char *version)
+{
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        int reused, keep_alive = 0;
+        HTTPConnection *conn;
+        HTTPResponsePtr r;
+
+        if ((conn = acquire(pool, &http_req->url, &reused)) == NULL)
+        {
+            return NULL;               /* failure: can't connect */
+        }
+        if (http_send(conn->fp, method, http_req, version)
+            && (r = http_read_response(conn->fp, method, &keep_alive))
+            != NULL)
+        {
+            release(pool, conn, keep_alive);
+            return r;                  /* success */
+        }
+        release(pool, conn, 0);
+        if (!reused)
+        {
+            break;                     /* failure: a new connection failed */
+        }
+    }
+    return NULL;
+}
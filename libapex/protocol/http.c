@@ -3,9 +3,18 @@
  *
  * Contents:
  * http_connect()       --Connect to a host specified by a URL.
+ * add_iov()            --Append a string to a list of buffers.
+ * request_line()       --Describe a request line as a list of buffers.
+ * request_iov()        --Describe a whole request as a list of buffers.
  * http_send_request()  --Send a request line to an open HTTP session.
  * http_send_header()   --Send a list of HTTP headers to an open HTTP session.
+ * http_format()        --Format a whole request (request line, headers) as text.
+ * http_header()        --Find the value of a response header.
+ * read_content()       --Read some bytes of the response body into its content.
+ * read_chunked()       --Read a "chunked" response body into its content.
+ * http_read_response() --Read a response (status, headers and body).
  * http_request()       --Perform an HTTP request on a url, and get the response.
+ * http_send()          --Send a request (request line, headers) to an open HTTP session.
  * http_free_response() --Free the memory resources of an HTTP response.
  *
  * Remarks:
@@ -17,14 +26,24 @@
 #include <apex.h>                       /* Windows_NT requires this before system headers */
 
 #include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/uio.h>
 
 #include <apex/http.h>
+#include <apex/mem.h>
 #include <apex/estring.h>
 #include <apex/protocol.h>
+#include <apex/strbuf.h>
 #include <apex/vector.h>
 #include <apex/log.h>
+#include <apex/profile.h>
 
 
+#define REQUEST_LINE_IOV 16            /* most buffers in a request line */
+
 static const char *rfc_eol = "\r\n";
 
 /*
@@ -36,11 +55,19 @@ static const char *rfc_eol = "\r\n";
 FILE *http_connect(URLPtr url)
 {
     int fd;
-    char host[FILENAME_MAX];
+    StrBuf host;
     FILE *fp;
 
-    sprintf(host, "%s:%d", url->domain, url->port);
-    if ((fd = open_connect(host, AF_INET, SOCK_STREAM)) == -1)
+    strbuf_init(&host);
+    if (!strbuf_str(&host, url->domain) || !strbuf_char(&host, ':')
+        || !strbuf_int(&host, url->port))
+    {
+        strbuf_free(&host);
+        return NULL;                   /* error: malloc failed */
+    }
+    fd = open_connect(host.str, AF_INET, SOCK_STREAM);
+    strbuf_free(&host);
+    if (fd == -1)
     {
         return NULL;
     }
@@ -49,46 +76,135 @@ FILE *http_connect(URLPtr url)
 }
 
 /*
- * http_send_request() --Send a request line to an open HTTP session.
+ * add_iov() --Append a string to a list of buffers.
+ */
+static int add_iov(struct iovec *iov, int n_iov, const char *str)
+{
+    iov[n_iov].iov_base = (void *) str;
+    iov[n_iov].iov_len = strlen(str);
+    return n_iov + 1;
+}
+
+/*
+ * request_line() --Describe a request line as a list of buffers.
+ *
+ * Parameters:
+ * iov      --returns the buffers (at least REQUEST_LINE_IOV of them)
+ * method   --the request method
+ * url      --the URL
+ * version  --the HTTP version
+ * port     --a buffer for the port's text
  *
  * Returns: (int)
- * Success: No. of bytes written; Failure: 0.
+ * Success: the number of buffers; Failure: 0 (unknown version).
+ *
+ * Remarks:
+ * The buffers point into url (and port), so nothing is copied,
+ * and there's no limit on the line's length.
  */
-size_t http_send_request(FILE * fp, const char *method,
-                         URLPtr url, const char *version)
+static int request_line(struct iovec *iov, const char *method, URLPtr url,
+                        const char *version, char port[20])
 {
-    char buf[FILENAME_MAX];
-    char *end;
+    int n = 0;
 
-    if (strcmp(version, "1.0") == 0)
+    if (strcmp(version, HTTP_V1_0) != 0 && strcmp(version, HTTP_V1_1) != 0)
     {
-        end = vstrcat(buf, method, " /", url->path,
-                      (url->query != NULL) ? "?" : "",
-                      (url->query != NULL) ? url->query : "",
-                      (url->anchor != NULL) ? "#" : "",
-                      (url->anchor != NULL) ? url->anchor : "", NULL);
+        debug("unrecognised HTTP version: \"%s\"", version);
+        errno = EINVAL;
+        return 0;                      /* failure: unknown protocol version */
     }
-    else if (strcmp(version, "1.1") == 0)
+    n = add_iov(iov, n, method);
+    n = add_iov(iov, n, " ");
+    if (strcmp(version, HTTP_V1_1) == 0)
     {
-        end = vstrcat(buf, method, " ",
-                      url->scheme, "://",
-                      url->domain, ":", url->port, "/", url->path,
-                      (url->query != NULL) ? "?" : "",
-                      (url->query != NULL) ? url->query : "",
-                      (url->anchor != NULL) ? "#" : "",
-                      (url->anchor != NULL) ? url->anchor : "", NULL);
+        snprintf(port, 20, "%d", url->port);
+        n = add_iov(iov, n, url->scheme != NULL ? url->scheme : "http");
+        n = add_iov(iov, n, "://");
+        n = add_iov(iov, n, url->domain);
+        n = add_iov(iov, n, ":");
+        n = add_iov(iov, n, port);
     }
-    else
+    n = add_iov(iov, n, "/");
+    n = add_iov(iov, n, url->path != NULL ? url->path : "");
+    if (url->query != NULL)
     {
-        debug("unrecognised HTTP version: \"%s\"", version);
-        errno = EINVAL;
-        return 0;                      /* failure: unknown protocol version */
+        n = add_iov(iov, n, "?");
+        n = add_iov(iov, n, url->query);
     }
-    debug("http_send_request: \"%s\"", buf);
+    if (url->anchor != NULL)
+    {
+        n = add_iov(iov, n, "#");
+        n = add_iov(iov, n, url->anchor);
+    }
+    n = add_iov(iov, n, " HTTP/");
+    n = add_iov(iov, n, version);
+    return add_iov(iov, n, rfc_eol);
+}
 
-    end = vstrcat(end, " HTTP/", version, rfc_eol, NULL);
-    return fwrite(buf, 1, (size_t) (end - buf), fp) == (size_t) (end - buf)
-        ? (size_t) (end - buf) : 0;
+/*
+ * request_iov() --Describe a whole request as a list of buffers.
+ *
+ * Returns: (struct iovec *)
+ * Success: a malloc'd list of buffers; Failure: NULL.
+ *
+ * Remarks:
+ * The list is: the request line, a "name: value" line for each
+ * header, and the empty line that ends the request.
+ */
+static struct iovec *request_iov(const char *method,
+                                 HTTPRequestPtr http_req,
+                                 const char *version, char port[20],
+                                 int *n_iov)
+{
+    int n_header = http_req->header != NULL
+        ? vector_len(http_req->header) : 0;
+    struct iovec *iov = MEM_NEW(MEM_PROTOCOL, struct iovec,
+                                REQUEST_LINE_IOV + 4 * n_header + 1);
+    int n;
+
+    if (iov == NULL)
+    {
+        return NULL;
+    }
+    if ((n = request_line(iov, method, &http_req->url, version, port)) == 0)
+    {
+        mem_free(MEM_PROTOCOL, iov);
+        return NULL;
+    }
+    for (int i = 0; i < n_header; ++i)
+    {
+        n = add_iov(iov, n, http_req->header[i].name);
+        n = add_iov(iov, n, ": ");
+        n = add_iov(iov, n, http_req->header[i].value.string);
+        n = add_iov(iov, n, rfc_eol);
+    }
+    *n_iov = add_iov(iov, n, rfc_eol);
+    return iov;
+}
+
+/*
+ * http_send_request() --Send a request line to an open HTTP session.
+ *
+ * Returns: (int)
+ * Success: No. of bytes written; Failure: 0.
+ */
+size_t http_send_request(FILE * fp, const char *method,
+                         URLPtr url, const char *version)
+{
+    struct iovec iov[REQUEST_LINE_IOV];
+    char port[20];
+    size_t total = 0;
+    int n = request_line(iov, method, url, version, port);
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (fwrite(iov[i].iov_base, 1, iov[i].iov_len, fp) != iov[i].iov_len)
+        {
+            return 0;                  /* failure: write failed somehow */
+        }
+        total += iov[i].iov_len;
+    }
+    return total;
 }
 
 /*
@@ -112,48 +228,185 @@ size_t http_send_header(FILE * fp, int n_header, SymbolPtr header)
 }
 
 /*
- * http_request() --Perform an HTTP request on a url, and get the response.
+ * http_format() --Format a whole request (request line, headers) as text.
  *
  * Parameters:
  * method   --specifies the protocol method (e.g. "GET")
  * http_req --specifies the details of the HTTP request
  * version  --specifies the version of HTTP protocol to use
+ * len      --returns the text's length
  *
- * Returns: (HTTPResponsePtr)
- * Success: a malloc'd HTTP response; Failure: NULL.
+ * Returns: (char *)
+ * Success: the malloc'd (and NUL-terminated) text; Failure: NULL.
  *
  * Remarks:
- * Note that the HTTP may "successfully" respond with a HTTP error.
- * In such cases, the http_get() succeeds, and returns the error response.
+ * This is the text that http_send() sends, for callers that manage
+ * their own output (e.g. HTTPClient, which re-sends it on retry).
  */
-HTTPResponsePtr http_request(const char *method,
-                             HTTPRequestPtr http_req, const char *version)
+char *http_format(const char *method, HTTPRequestPtr http_req,
+                  const char *version, size_t *len)
 {
-    char buf[FILENAME_MAX];
-    char *end;
-    int n;
-    FILE *fp;
-    HTTPResponsePtr r;
-    URLPtr url = &http_req->url;
+    char port[20];
+    struct iovec *iov;
+    size_t total = 0;
+    StrBuf text;
+    int n_iov;
 
-    if ((fp = http_connect(url)) == NULL)
+    if ((iov = request_iov(method, http_req, version, port, &n_iov)) == NULL)
     {
         return NULL;
     }
-    if (!http_send_request(fp, method, url, version))
+    for (int i = 0; i < n_iov; ++i)
     {
-        return NULL;
+        total += iov[i].iov_len;
+    }
+    strbuf_init(&text);
+    (void) strbuf_reserve(&text, total);
+    for (int i = 0; i < n_iov; ++i)
+    {
+        (void) strbuf_add(&text, iov[i].iov_base, iov[i].iov_len);
+    }
+    mem_free(MEM_PROTOCOL, iov);
+    return strbuf_detach(&text, len);   /* (NULL if malloc failed) */
+}
+
+/*
+ * http_header() --Find the value of a response header.
+ *
+ * Parameters:
+ * r    --the response
+ * name --the header name (matched case-insensitively)
+ *
+ * Returns: (const char *)
+ * Success: the (first) header's value; Failure: NULL.
+ */
+const char *http_header(HTTPResponsePtr r, const char *name)
+{
+    if (r->header != NULL)
+    {
+        int n = vector_len(r->header);
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (strcasecmp(r->header[i].name, name) == 0)
+            {
+                return r->header[i].value.string;
+            }
+        }
     }
-    if (http_req->header != NULL && (n = vector_len(http_req->header)) != 0)
+    return NULL;
+}
+
+/*
+ * read_content() --Read some bytes of the response body into its content.
+ *
+ * Parameters:
+ * fp   --the HTTP session
+ * r    --the response
+ * n    --the number of bytes to read (SIZE_MAX: until EOF)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (short read, or malloc error).
+ */
+static int read_content(FILE * fp, HTTPResponsePtr r, size_t n)
+{
+    char buf[FILENAME_MAX];
+
+    while (n > 0)
     {
-        if (!http_send_header(fp, n, http_req->header))
+        size_t nr = fread(buf, 1, MIN(n, sizeof(buf)), fp);
+
+        if (nr == 0)
         {
-            return NULL;
+            return n == SIZE_MAX;      /* EOF: OK, unless a short read */
+        }
+        if (r->content == NULL
+            && (r->content = NEW_VECTOR(char, 0, NULL)) == NULL)
+        {
+            return 0;                  /* failure: malloc error */
+        }
+        r->content = vector_add((void *) r->content, nr, buf);
+        if (n != SIZE_MAX)
+        {
+            n -= nr;
         }
     }
+    return 1;
+}
 
-    fprintf(fp, "%s", rfc_eol);        /* blank line at end */
-    fflush(fp);
+/*
+ * read_chunked() --Read a "chunked" response body into its content.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * Chunk extensions and trailer headers are read, and ignored.
+ */
+static int read_chunked(FILE * fp, HTTPResponsePtr r)
+{
+    char line[FILENAME_MAX];
+
+    for (;;)
+    {
+        char *end;
+        unsigned long size;
+
+        if (fgets(line, sizeof(line), fp) == NULL)
+        {
+            return 0;                  /* failure: EOF in chunk size */
+        }
+        size = strtoul(line, &end, 16);
+        if (end == line)
+        {
+            return 0;                  /* failure: bad chunk size */
+        }
+        if (size == 0)
+        {
+            break;
+        }
+        if (!read_content(fp, r, size)
+            || fgets(line, sizeof(line), fp) == NULL)
+        {
+            return 0;                  /* failure: short chunk */
+        }
+    }
+    while (fgets(line, sizeof(line), fp) != NULL
+           && strcmp(line, rfc_eol) != 0 && *line != '\n')
+    {
+        ;                              /* skip trailers */
+    }
+    return 1;
+}
+
+/*
+ * http_read_response() --Read a response (status, headers and body).
+ *
+ * Parameters:
+ * fp       --the HTTP session
+ * method   --the request's method (HEAD responses have no body)
+ * keep_alive --returns true if the session can be re-used (may be NULL)
+ *
+ * Returns: (HTTPResponsePtr)
+ * Success: a malloc'd HTTP response; Failure: NULL.
+ *
+ * Remarks:
+ * The body is read according to the response's framing (i.e.
+ * Content-Length, or chunked transfer encoding), so the session
+ * is left at the start of the next response.  If the response has
+ * neither, the body extends to EOF, and the session can't be
+ * re-used.  An HTTP/1.1 session is persistent unless the server
+ * says "Connection: close"; an HTTP/1.0 one only if it says
+ * "Connection: keep-alive".
+ */
+HTTPResponsePtr http_read_response(FILE * fp, const char *method,
+                                   int *keep_alive)
+{
+    char buf[FILENAME_MAX];
+    char *end;
+    HTTPResponsePtr r;
+    const char *value;
+    int persistent;
 
     if (fgets(buf, NEL(buf) - 1, fp))
     {
@@ -163,17 +416,18 @@ HTTPResponsePtr http_request(const char *method,
         int code;
 
         buf[NEL(buf) - 1] = '\0';
-        if (sscanf(buf, "%[^/]/%s %d %[^\r]", protocol, v, &code, msg) != 4)
+        if (sscanf(buf, "%[^/]/%s %d %[^\r]", protocol, v, &code, msg) < 3)
         {
             debug("unrecognised HTTP header: \"%s\"", buf);
             errno = EINVAL;
             return NULL;               /* failure: unrecognised heaeder */
         }
-        if ((r = NEW(HTTPResponse, 1)) == NULL)
+        if ((r = MEM_NEW(MEM_PROTOCOL, HTTPResponse, 1)) == NULL)
         {
             return NULL;               /* failure: malloc error */
         }
         r->status = code;
+        persistent = strcmp(v, "1.0") != 0;
     }
     else
     {
@@ -191,13 +445,14 @@ HTTPResponsePtr http_request(const char *method,
         if (r->header == NULL
             && (r->header = NEW_VECTOR(Symbol, 0, NULL)) == NULL)
         {
+            http_free_response(r);
             return NULL;               /* failure: malloc error */
         }
         if ((end = strstr(buf, rfc_eol)) != NULL || (end = strchr(buf, '\n')))
         {
             *end = '\0';               /* zap EOL */
         }
-        sym.name = strdup(buf);
+        sym.name = mem_strdup(MEM_PROTOCOL, buf);
         if ((end = strchr(sym.name, ':')) != NULL)
         {
             *end++ = '\0';
@@ -207,25 +462,136 @@ HTTPResponsePtr http_request(const char *method,
             }
             sym.value.string = end;
         }
+        else
+        {
+            sym.value.string = (char *) "";
+        }
         r->header = vector_add(r->header, 1, &sym);
     }
+    if ((value = http_header(r, "Connection")) != NULL)
+    {
+        persistent = persistent ? strcasecmp(value, "close") != 0
+            : strcasecmp(value, "keep-alive") == 0;
+    }
+
     /*
      * process body
      */
-    while ((n = fread(buf, 1, NEL(buf), fp)) > 0)
+    if (strcmp(method, HTTP_HEAD) == 0 || r->status / 100 == 1
+        || r->status == 204 || r->status == 304)
     {
-        if (r->content == NULL
-            && (r->content = NEW_VECTOR(char, 0, NULL)) == NULL)
+        ;                              /* no body */
+    }
+    else if ((value = http_header(r, "Transfer-Encoding")) != NULL
+             && strcasecmp(value, "identity") != 0)
+    {
+        if (!read_chunked(fp, r))
         {
             http_free_response(r);
-            return NULL;               /* failure: malloc error */
+            return NULL;               /* failure: bad/short body */
         }
-        r->content = vector_add((void *) r->content, (size_t) n, buf);
+    }
+    else if ((value = http_header(r, "Content-Length")) != NULL)
+    {
+        if (!read_content(fp, r, (size_t) strtoull(value, NULL, 10)))
+        {
+            http_free_response(r);
+            return NULL;               /* failure: short body */
+        }
+    }
+    else
+    {
+        persistent = 0;                /* body is delimited by EOF */
+        if (!read_content(fp, r, SIZE_MAX))
+        {
+            http_free_response(r);
+            return NULL;
+        }
+    }
+    if (keep_alive != NULL)
+    {
+        *keep_alive = persistent;
+    }
+    return r;
+}
+
+/*
+ * http_request() --Perform an HTTP request on a url, and get the response.
+ *
+ * Parameters:
+ * method   --specifies the protocol method (e.g. "GET")
+ * http_req --specifies the details of the HTTP request
+ * version  --specifies the version of HTTP protocol to use
+ *
+ * Returns: (HTTPResponsePtr)
+ * Success: a malloc'd HTTP response; Failure: NULL.
+ *
+ * Remarks:
+ * Note that the HTTP may "successfully" respond with a HTTP error.
+ * In such cases, the http_get() succeeds, and returns the error response.
+ *
+ * This makes a new connection for each request; see http_pool_request()
+ * for re-using connections.
+ */
+HTTPResponsePtr http_request(const char *method,
+                             HTTPRequestPtr http_req, const char *version)
+{
+    FILE *fp;
+    HTTPResponsePtr r = NULL;
+
+    PROFILE_FUNCTION();
+    if ((fp = http_connect(&http_req->url)) == NULL)
+    {
+        return NULL;
+    }
+    if (http_send(fp, method, http_req, version))
+    {
+        r = http_read_response(fp, method, NULL);
     }
     fclose(fp);
     return r;
 }
 
+/*
+ * http_send() --Send a request (request line, headers) to an open HTTP session.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The request goes out in a single writev() call (so typically in
+ * one packet), gathered from the request's own strings; fp is
+ * flushed first.  Streams without a descriptor (e.g. memory
+ * streams) are written with stdio instead.
+ */
+int http_send(FILE * fp, const char *method, HTTPRequestPtr http_req,
+              const char *version)
+{
+    char port[20];
+    struct iovec *iov;
+    int n_iov, fd, status;
+
+    if ((iov = request_iov(method, http_req, version, port, &n_iov)) == NULL)
+    {
+        return 0;
+    }
+    if ((status = fflush(fp) == 0) && (fd = fileno(fp)) >= 0)
+    {
+        status = fdwritev(fd, iov, n_iov) >= 0;
+    }
+    else
+    {
+        for (int i = 0; status && i < n_iov; ++i)
+        {
+            status = fwrite(iov[i].iov_base, 1, iov[i].iov_len, fp)
+                == iov[i].iov_len;
+        }
+        status = status && fflush(fp) == 0;
+    }
+    mem_free(MEM_PROTOCOL, iov);
+    return status;
+}
+
 /*
  * http_free_response() --Free the memory resources of an HTTP response.
  *
@@ -245,7 +611,7 @@ void http_free_response(HTTPResponsePtr r)
         int n = vector_len(r->header);
         for (int i = 0; i < n; ++i)
         {
-            free((void *) r->header[i].name);
+            mem_free(MEM_PROTOCOL, (void *) r->header[i].name);
         }
         free_vector(r->header);
     }
@@ -253,5 +619,5 @@ void http_free_response(HTTPResponsePtr r)
     {
         free_vector((void *) r->content);
     }
-    free(r);
+    mem_free(MEM_PROTOCOL, r);
 }
@@ -8,8 +8,10 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include <sys/types.h>
 #include <apex/symbol.h>
 #include <apex/url.h>
+#include <apex/event-loop.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -43,15 +45,101 @@ extern "C"
         const char *content;
     } HTTPResponse, *HTTPResponsePtr;
 
+#define HTTP_LINE_MAX	8192          /* longest status/header line */
+
+    /*
+     * HTTPParserProcs --Callbacks for the parts of a response.
+     *
+     * Remarks:
+     * Each returns 1 to continue parsing, or 0 to stop it (with an
+     * error).  The text views are only valid during the call.
+     */
+    typedef struct HTTPParserProcs_t
+    {
+        int (*status)(void *data, int status,
+                      const char *reason, size_t reason_len);
+        int (*header)(void *data, const char *name, size_t name_len,
+                      const char *value, size_t value_len);
+        int (*headers_done)(void *data);
+        int (*body)(void *data, const char *ptr, size_t len);
+        int (*done)(void *data);
+    } HTTPParserProcs;
+
+    /*
+     * HTTPParser --The state of an incremental response parser.
+     *
+     * Remarks:
+     * See http-parse.c.
+     */
+    typedef struct HTTPParser_t
+    {
+        int state;
+        int status;                    /* status code (once parsed) */
+        int minor_version;             /* HTTP/1.x */
+        int keep_alive;                /* connection is re-usable? */
+        int chunked;                   /* chunked transfer encoding? */
+        int head;                      /* response to HEAD (no body)? */
+        long long content_length;      /* (-1: none) */
+        unsigned long long remain;     /* bytes left in body/chunk */
+        const HTTPParserProcs *procs;
+        void *data;
+    } HTTPParser, *HTTPParserPtr;
+
+    /*
+     * HTTPPool --A pool of persistent HTTP connections.
+     *
+     * Remarks:
+     * See http-pool.c.
+     */
+    typedef struct HTTPPool_t HTTPPool, *HTTPPoolPtr;
+
+    /*
+     * HTTPClient --An asynchronous (event loop) HTTP client.
+     *
+     * Remarks:
+     * See http-client.c.  The callback is passed the response (which
+     * it must free), or NULL if the request failed.
+     */
+    typedef struct HTTPClient_t HTTPClient, *HTTPClientPtr;
+    typedef void (*HTTPCallbackProc)(HTTPResponsePtr r, void *data);
+
     FILE *http_connect(URLPtr url);
     size_t http_send_request(FILE * fp, const char *method,
                              URLPtr url, const char *version);
     size_t http_send_header(FILE * fp, int n_header, SymbolPtr header);
+    char *http_format(const char *method, HTTPRequestPtr http_req,
+                      const char *version, size_t *len);
+    int http_send(FILE * fp, const char *method, HTTPRequestPtr http_req,
+                  const char *version);
+    HTTPResponsePtr http_read_response(FILE * fp, const char *method,
+                                       int *keep_alive);
+    const char *http_header(HTTPResponsePtr r, const char *name);
 
     HTTPResponsePtr http_request(const char *method,
                                  HTTPRequestPtr http_req,
                                  const char *version);
     void http_free_response(HTTPResponsePtr r);
+
+    HTTPParserPtr http_parser_init(HTTPParserPtr parser, const char *method,
+                                   const HTTPParserProcs * procs,
+                                   void *data);
+    ssize_t http_parse(HTTPParserPtr parser, const char *buf, size_t len);
+    int http_parse_eof(HTTPParserPtr parser);
+    int http_parse_done(const HTTPParser * parser);
+
+    HTTPPoolPtr http_pool_new(int max_per_host, int idle_timeout);
+    void http_pool_free(HTTPPoolPtr pool);
+    HTTPResponsePtr http_pool_request(HTTPPoolPtr pool, const char *method,
+                                      HTTPRequestPtr http_req,
+                                      const char *version);
+
+    HTTPClientPtr http_client_new(EventLoopPtr loop, int max_per_host,
+                                  int depth);
+    void http_client_free(HTTPClientPtr client);
+    int http_client_submit(HTTPClientPtr client, const char *method,
+                           HTTPRequestPtr http_req, const char *version,
+                           HTTPCallbackProc proc, void *data);
+    int http_client_pending(const HTTPClient * client);
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
@@ -0,0 +1,318 @@
+/*
+ * INET4.C --A longest-prefix-match table of inet4 networks.
+ *
+ * Contents:
+ * inet4_table_new()     --Create a new, empty network table.
+ * inet4_table_free()    --Free a network table, and all its resources.
+ * new_chunk()           --Allocate a chunk of slots, all set to some entry.
+ * expand_slot()         --Make sure a slot refers to a chunk of slots.
+ * set_slots()           --Set a range of slots to a rule, if it's longer.
+ * inet4_table_add()     --Add a network (and its value) to a table.
+ * inet4_table_add_str() --Add a "host[/bits]" network to a table.
+ * inet4_table_find()    --Find the value of an address's longest network.
+ *
+ * Remarks:
+ * The table is a three level (16-8-8 bit) multibit trie, in the
+ * style of DIR-24-8: the top level has a slot for every value of an
+ * address's first 16 bits, and a slot either holds a rule (i.e. a
+ * network and its value), or refers to a chunk of 256 slots for the
+ * next 8 bits.  Networks are "expanded" to cover all the slots of
+ * their level, so a lookup is (at most) three array references,
+ * whatever the number of networks.
+ *
+ * A slot holds the index of a rule (+1, so that 0 is "no rule"), or
+ * the index of a chunk (with CHUNK_BIT set); a rule is just the
+ * network's length and value.  Chunks are only made for the /16s
+ * (and /24s) that have more specific networks, and a new chunk
+ * inherits its parent slot's rule, so the top level is the only big
+ * allocation (256KB).
+ *
+ * Networks may be added in any order: a rule only replaces a slot's
+ * rule if it's at least as long (so a later definition of the same
+ * network replaces the earlier one).
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/inet4.h>
+#include <apex/strparse.h>
+
+#define TOP_BITS 16
+#define CHUNK_BITS 8
+#define CHUNK_SLOTS (1u << CHUNK_BITS)
+#define CHUNK_BIT 0x80000000u          /* slot refers to a chunk */
+
+typedef struct Inet4Rule
+{
+    unsigned int n_bit;                /* prefix length */
+    unsigned int value;
+} Inet4Rule;
+
+struct Inet4Table_t
+{
+    uint32_t *top;                     /* 2^TOP_BITS slots */
+    uint32_t *chunk;                   /* n_chunk * CHUNK_SLOTS slots */
+    size_t n_chunk, max_chunk;
+    Inet4Rule *rule;
+    size_t n_rule, max_rule;
+};
+
+/*
+ * inet4_table_new() --Create a new, empty network table.
+ *
+ * Returns: (Inet4TablePtr)
+ * Success: the new table; Failure: NULL (malloc failed).
+ */
+Inet4TablePtr inet4_table_new(void)
+{
+    Inet4TablePtr table = NEW(Inet4Table, 1);
+
+    if (table != NULL
+        && (table->top = NEW(uint32_t, 1u << TOP_BITS)) == NULL)
+    {
+        free(table);
+        table = NULL;
+    }
+    return table;
+}
+
+/*
+ * inet4_table_free() --Free a network table, and all its resources.
+ */
+void inet4_table_free(Inet4TablePtr table)
+{
+    if (table != NULL)
+    {
+        free(table->top);
+        free(table->chunk);
+        free(table->rule);
+        free(table);
+    }
+}
+
+/*
+ * new_chunk() --Allocate a chunk of slots, all set to some entry.
+ *
+ * Returns: (uint32_t)
+ * Success: the chunk's slot entry; Failure: 0 (malloc failed).
+ *
+ * Remarks:
+ * Chunks live in a single array (so they're referred to by index),
+ * which may move when a chunk is allocated.
+ */
+static uint32_t new_chunk(Inet4TablePtr table, uint32_t entry)
+{
+    uint32_t *slot;
+
+    if (table->n_chunk == table->max_chunk)
+    {
+        size_t max_chunk = MAX(16, table->max_chunk * 2);
+
+        if (max_chunk >= CHUNK_BIT
+            || (slot = realloc(table->chunk, max_chunk * CHUNK_SLOTS
+                               * sizeof(*slot))) == NULL)
+        {
+            return 0;                  /* error: malloc failed */
+        }
+        table->chunk = slot;
+        table->max_chunk = max_chunk;
+    }
+    slot = table->chunk + table->n_chunk * CHUNK_SLOTS;
+    for (size_t i = 0; i < CHUNK_SLOTS; ++i)
+    {
+        slot[i] = entry;
+    }
+    return (uint32_t) table->n_chunk++ | CHUNK_BIT;
+}
+
+/*
+ * expand_slot() --Make sure a slot refers to a chunk of slots.
+ *
+ * Parameters:
+ * table --the table
+ * slot  --specifies the slot's offset in the table's top level or
+ *         chunk array
+ * top   --specifies if the slot is in the top level
+ *
+ * Returns: (uint32_t *)
+ * Success: the slot's chunk; Failure: NULL (malloc failed).
+ */
+static uint32_t *expand_slot(Inet4TablePtr table, size_t slot, int top)
+{
+    uint32_t entry = top ? table->top[slot] : table->chunk[slot];
+
+    if (!(entry & CHUNK_BIT))
+    {
+        if ((entry = new_chunk(table, entry)) == 0)
+        {
+            return NULL;
+        }
+        *(top ? &table->top[slot] : &table->chunk[slot]) = entry;
+    }
+    return table->chunk + (entry & ~CHUNK_BIT) * CHUNK_SLOTS;
+}
+
+/*
+ * set_slots() --Set a range of slots to a rule, if it's longer.
+ *
+ * Remarks:
+ * A slot that refers to a chunk has (potentially) some longer rules,
+ * so the new rule is pushed down into that chunk's slots.
+ */
+static void set_slots(Inet4TablePtr table, uint32_t *slot, size_t n_slot,
+                      uint32_t entry)
+{
+    unsigned int n_bit = table->rule[entry - 1].n_bit;
+
+    for (size_t i = 0; i < n_slot; ++i)
+    {
+        if (slot[i] & CHUNK_BIT)
+        {
+            set_slots(table, table->chunk + (slot[i] & ~CHUNK_BIT)
+                      * CHUNK_SLOTS, CHUNK_SLOTS, entry);
+        }
+        else if (slot[i] == 0 || table->rule[slot[i] - 1].n_bit <= n_bit)
+        {
+            slot[i] = entry;
+        }
+    }
+}
+
+/*
+ * inet4_table_add() --Add a network (and its value) to a table.
+ *
+ * Parameters:
+ * table   --the table
+ * address --specifies the network's address (host bits are ignored)
+ * netmask --specifies the network mask, which must be contiguous
+ * value   --specifies the network's value
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (bad netmask, or malloc failed).
+ */
+int inet4_table_add(Inet4TablePtr table, uint32_t address,
+                    uint32_t netmask, unsigned int value)
+{
+    unsigned int n_bit = 0;
+    uint32_t entry, *slot;
+    size_t top = address >> TOP_BITS;
+    size_t mid = (address >> CHUNK_BITS) & (CHUNK_SLOTS - 1);
+
+    while (n_bit < 32 && (netmask & (0x80000000u >> n_bit)))
+    {
+        ++n_bit;
+    }
+    if (netmask != (n_bit == 0 ? 0 : 0xffffffffu << (32 - n_bit)))
+    {
+        return 0;                      /* error: non-contiguous mask */
+    }
+    if (table->n_rule == table->max_rule)
+    {
+        size_t max_rule = MAX(16, table->max_rule * 2);
+        Inet4Rule *rule;
+
+        if (max_rule >= CHUNK_BIT
+            || (rule = realloc(table->rule,
+                               max_rule * sizeof(*rule))) == NULL)
+        {
+            return 0;                  /* error: malloc failed */
+        }
+        table->rule = rule;
+        table->max_rule = max_rule;
+    }
+    table->rule[table->n_rule].n_bit = n_bit;
+    table->rule[table->n_rule].value = value;
+    entry = (uint32_t) ++table->n_rule;
+
+    if (n_bit <= TOP_BITS)
+    {
+        top &= ~(((size_t) 1 << (TOP_BITS - n_bit)) - 1);
+        set_slots(table, table->top + top,
+                  (size_t) 1 << (TOP_BITS - n_bit), entry);
+        return 1;
+    }
+    if ((slot = expand_slot(table, top, 1)) == NULL)
+    {
+        return 0;                      /* error: malloc failed */
+    }
+    if (n_bit <= TOP_BITS + CHUNK_BITS)
+    {
+        mid &= ~(((size_t) 1 << (TOP_BITS + CHUNK_BITS - n_bit)) - 1);
+        set_slots(table, slot + mid,
+                  (size_t) 1 << (TOP_BITS + CHUNK_BITS - n_bit), entry);
+        return 1;
+    }
+    if ((slot = expand_slot(table, (size_t) (slot - table->chunk) + mid,
+                            0)) == NULL)
+    {
+        return 0;                      /* error: malloc failed */
+    }
+    set_slots(table, slot + ((address & netmask) & (CHUNK_SLOTS - 1)),
+              (size_t) 1 << (32 - n_bit), entry);
+    return 1;
+}
+
+/*
+ * inet4_table_add_str() --Add a "host[/bits]" network to a table.
+ *
+ * Parameters:
+ * table --the table
+ * text  --the network, as accepted by str_inet4_address()
+ * value --specifies the network's value
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * A bare address is a /32 network.
+ */
+#ifndef NO_INET
+int inet4_table_add_str(Inet4TablePtr table, const char *text,
+                        unsigned int value)
+{
+    uint32_t address, netmask = 0xffffffffu;
+
+    if (!str_inet4_address(text, &address, &netmask))
+    {
+        return 0;                      /* error: bad address */
+    }
+    return inet4_table_add(table, address, netmask, value);
+}
+#endif /* NO_INET */
+
+/*
+ * inet4_table_find() --Find the value of an address's longest network.
+ *
+ * Parameters:
+ * table   --the table
+ * address --specifies the address to check
+ * value   --returns the value of the longest network containing
+ *           the address
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the address isn't in any network).
+ */
+int inet4_table_find(const Inet4Table * table, uint32_t address,
+                     unsigned int *value)
+{
+    uint32_t entry = table->top[address >> TOP_BITS];
+
+    if (entry & CHUNK_BIT)
+    {
+        entry = table->chunk[(entry & ~CHUNK_BIT) * CHUNK_SLOTS
+                             + ((address >> CHUNK_BITS)
+                                & (CHUNK_SLOTS - 1))];
+        if (entry & CHUNK_BIT)
+        {
+            entry = table->chunk[(entry & ~CHUNK_BIT) * CHUNK_SLOTS
+                                 + (address & (CHUNK_SLOTS - 1))];
+        }
+    }
+    if (entry == 0)
+    {
+        return 0;                      /* failure: no network */
+    }
+    *value = table->rule[entry - 1].value;
+    return 1;
+}
@@ -0,0 +1,40 @@
+/*
+ * INET4.H --Definitions for inet4 network (prefix) tables.
+ *
+ * Remarks:
+ * An Inet4Table maps networks (as parsed by str_inet4_address())
+ * to values, and finds the value of the longest (i.e. most specific)
+ * network that contains an address, in constant time.  It's intended
+ * for ACL checks and the like, where the table is built once, and
+ * then searched for every packet.
+ *
+ */
+#ifndef INET4_H
+#define INET4_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    /*
+     * Inet4Table --A longest-prefix-match table of inet4 networks.
+     *
+     * Remarks:
+     * See inet4.c.
+     */
+    typedef struct Inet4Table_t Inet4Table, *Inet4TablePtr;
+
+    Inet4TablePtr inet4_table_new(void);
+    void inet4_table_free(Inet4TablePtr table);
+    int inet4_table_add(Inet4TablePtr table, uint32_t address,
+                        uint32_t netmask, unsigned int value);
+    int inet4_table_add_str(Inet4TablePtr table, const char *text,
+                            unsigned int value);
+    int inet4_table_find(const Inet4Table * table, uint32_t address,
+                         unsigned int *value);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* INET4_H */
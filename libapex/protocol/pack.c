@@ -0,0 +1,529 @@
+/*
+ * PACK.C --Compiled pack/unpack formats for structs, and arrays of them.
+ *
+ * Contents:
+ * bswap16_scalar()     --Byte-swap an array of 16-bit values.
+ * bswap32_scalar()     --Byte-swap an array of 32-bit values.
+ * bswap_ssse3()        --Byte-swap an array of values, 16 bytes at a time.
+ * bswap_neon()         --Byte-swap an array of values, 16 bytes at a time.
+ * resolve_bswap16()    --Select the best bswap16() for this CPU, and call it.
+ * resolve_bswap32()    --Select the best bswap32() for this CPU, and call it.
+ * copy_field()         --Copy a field's values, byte-swapping if needed.
+ * pack_format()        --Compile a pack format string.
+ * pack_format_free()   --Free a compiled pack format.
+ * pack_format_size()   --Return the size of the struct a format describes.
+ * pack_n()             --Pack an array of structs into a buffer.
+ * unpack_n()           --Unpack an array of structs from a buffer.
+ *
+ * Remarks:
+ * A format is the list of pack() codes for a struct's members, in
+ * order, each optionally followed by a count for array members:
+ *
+ *     struct { uint16_t id; uint32_t addr[2]; char name[16]; }
+ *
+ * is "nN2Z16".  The struct's layout is computed as the C compiler
+ * does it (each member aligned to its size, and the struct padded to
+ * its largest member), so members must be uint8_t/uint16_t/uint32_t
+ * (or the signed types) and char arrays.  A Z member is a char array
+ * holding a NUL-terminated string, and is packed as just the string
+ * and its NUL.
+ *
+ * Packing then needs no parsing or per-item calls: a format with no
+ * strings and no padding is packed as one memcpy(), or (if all its
+ * members are the same network-order type) as one byte-swap of the
+ * whole array, which is done 16 bytes at a time with SSSE3/NEON.
+ * Both pack_n() and unpack_n() check the buffer's bounds (unlike
+ * pack()/unpack()).
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/cpu.h>
+#include <apex/protocol.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PACK_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define PACK_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NETWORK_SWAP 0                 /* network order is native */
+#else
+#define NETWORK_SWAP 1
+#endif
+
+typedef void (*BswapProc)(void *dst, const void *src, size_t n);
+
+typedef struct PackField
+{
+    char code;                         /* pack() format code */
+    unsigned char width;               /* bytes per value (Z: 1) */
+    unsigned char swap;                /* byte-swap (network order)? */
+    size_t offset;                     /* offset in the struct */
+    size_t count;                      /* No. of values (Z: array size) */
+} PackField;
+
+struct PackFormat_t
+{
+    size_t n_field;
+    size_t size;                       /* sizeof the struct */
+    size_t packed_size;                /* packed size (if fixed) */
+    int has_string;                    /* has Z fields (variable size)? */
+    int swap_width;                    /* packed by one bswap (or 0) */
+    int plain;                         /* packed by one memcpy() */
+    PackField field[];
+};
+
+/*
+ * bswap16_scalar() --Byte-swap an array of 16-bit values.
+ * bswap32_scalar() --Byte-swap an array of 32-bit values.
+ *
+ * Remarks:
+ * src and dst needn't be aligned, and may be the same.
+ */
+static void bswap16_scalar(void *dst, const void *src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint16_t v;
+
+        memcpy(&v, (const char *) src + i * 2, 2);
+        v = __builtin_bswap16(v);
+        memcpy((char *) dst + i * 2, &v, 2);
+    }
+}
+
+static void bswap32_scalar(void *dst, const void *src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint32_t v;
+
+        memcpy(&v, (const char *) src + i * 4, 4);
+        v = __builtin_bswap32(v);
+        memcpy((char *) dst + i * 4, &v, 4);
+    }
+}
+
+#ifdef PACK_X86
+/*
+ * bswap_ssse3() --Byte-swap an array of values, 16 bytes at a time.
+ *
+ * Remarks:
+ * pshufb reverses each value's bytes (per the shuffle mask); any
+ * remainder is swapped by the scalar code.
+ */
+__attribute__((target("ssse3")))
+static size_t bswap_ssse3(void *dst, const void *src, size_t n_byte,
+                          int width)
+{
+    __m128i mask = width == 4
+        ? _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12)
+        : _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15,
+                        14);
+    size_t i = 0;
+
+    for (; i + 16 <= n_byte; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) ((const char *) src
+                                                       + i));
+
+        _mm_storeu_si128((__m128i *) ((char *) dst + i),
+                         _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+static void bswap16_ssse3(void *dst, const void *src, size_t n)
+{
+    size_t done = bswap_ssse3(dst, src, n * 2, 2);
+
+    bswap16_scalar((char *) dst + done, (const char *) src + done,
+                   n - done / 2);
+}
+
+static void bswap32_ssse3(void *dst, const void *src, size_t n)
+{
+    size_t done = bswap_ssse3(dst, src, n * 4, 4);
+
+    bswap32_scalar((char *) dst + done, (const char *) src + done,
+                   n - done / 4);
+}
+#endif /* PACK_X86 */
+
+#ifdef PACK_NEON
+/*
+ * bswap_neon() --Byte-swap an array of values, 16 bytes at a time.
+ */
+static void bswap16_neon(void *dst, const void *src, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        vst1q_u8((uint8_t *) dst + i * 2,
+                 vrev16q_u8(vld1q_u8((const uint8_t *) src + i * 2)));
+    }
+    bswap16_scalar((char *) dst + i * 2, (const char *) src + i * 2, n - i);
+}
+
+static void bswap32_neon(void *dst, const void *src, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        vst1q_u8((uint8_t *) dst + i * 4,
+                 vrev32q_u8(vld1q_u8((const uint8_t *) src + i * 4)));
+    }
+    bswap32_scalar((char *) dst + i * 4, (const char *) src + i * 4, n - i);
+}
+#endif /* PACK_NEON */
+
+static void resolve_bswap16(void *dst, const void *src, size_t n);
+static void resolve_bswap32(void *dst, const void *src, size_t n);
+
+static BswapProc bswap16 = resolve_bswap16;
+static BswapProc bswap32 = resolve_bswap32;
+
+/*
+ * resolve_bswap16() --Select the best bswap16() for this CPU, and call it.
+ */
+static void resolve_bswap16(void *dst, const void *src, size_t n)
+{
+    BswapProc proc = bswap16_scalar;
+
+#if defined(PACK_X86)
+    proc = cpu_has(CPU_SSSE3) ? bswap16_ssse3 : proc;
+#elif defined(PACK_NEON)
+    proc = bswap16_neon;
+#endif
+    CPU_RESOLVE(&bswap16, proc);
+    proc(dst, src, n);
+}
+
+/*
+ * resolve_bswap32() --Select the best bswap32() for this CPU, and call it.
+ */
+static void resolve_bswap32(void *dst, const void *src, size_t n)
+{
+    BswapProc proc = bswap32_scalar;
+
+#if defined(PACK_X86)
+    proc = cpu_has(CPU_SSSE3) ? bswap32_ssse3 : proc;
+#elif defined(PACK_NEON)
+    proc = bswap32_neon;
+#endif
+    CPU_RESOLVE(&bswap32, proc);
+    proc(dst, src, n);
+}
+
+/*
+ * copy_field() --Copy a field's values, byte-swapping if needed.
+ */
+static void copy_field(const PackField * field, void *dst, const void *src)
+{
+    if (!field->swap)
+    {
+        memcpy(dst, src, field->count * field->width);
+    }
+    else if (field->width == 2)
+    {
+        bswap16(dst, src, field->count);
+    }
+    else
+    {
+        bswap32(dst, src, field->count);
+    }
+}
+
+/*
+ * pack_format() --Compile a pack format string.
+ *
+ * Parameters:
+ * fmt      --the format (see above)
+ *
+ * Returns: (PackFormatPtr)
+ * Success: the compiled format; Failure: NULL (invalid format, or
+ * malloc failed).
+ */
+PackFormatPtr pack_format(const char *fmt)
+{
+    size_t n_field = strlen(fmt), offset = 0, align = 1;
+    PackFormatPtr format;
+    PackField *field;
+
+    if ((format = malloc(sizeof(*format) + n_field * sizeof(*field)))
+        == NULL)
+    {
+        return NULL;
+    }
+    memset(format, 0, sizeof(*format));
+    format->plain = 1;
+    field = format->field;
+
+    while (*fmt != '\0')
+    {
+        char *end;
+        unsigned long count = 1;
+
+        field->code = *fmt++;
+        field->swap = 0;
+        switch (field->code)
+        {
+        case 'c':
+        case 'C':
+        case 'Z':
+            field->width = 1;
+            break;
+        case 's':
+        case 'S':
+            field->width = 2;
+            break;
+        case 'l':
+        case 'L':
+            field->width = 4;
+            break;
+        case 'n':
+            field->width = 2;
+            field->swap = NETWORK_SWAP;
+            break;
+        case 'N':
+            field->width = 4;
+            field->swap = NETWORK_SWAP;
+            break;
+        default:
+            free(format);
+            return NULL;               /* error: unknown code */
+        }
+        if (*fmt >= '0' && *fmt <= '9')
+        {
+            count = strtoul(fmt, &end, 10);
+            fmt = end;
+        }
+        else if (field->code == 'Z')
+        {
+            count = 0;                 /* Z needs its array size */
+        }
+        if (count == 0)
+        {
+            free(format);
+            return NULL;               /* error: empty array */
+        }
+        offset = (offset + field->width - 1) / field->width * field->width;
+        if (offset != format->packed_size)
+        {
+            format->plain = 0;         /* padding: not a plain copy */
+        }
+        field->offset = offset;
+        field->count = count;
+        offset += count * field->width;
+        align = MAX(align, field->width);
+
+        if (field->code == 'Z')
+        {
+            format->has_string = 1;
+            format->plain = 0;
+        }
+        else
+        {
+            format->packed_size += count * field->width;
+        }
+        if (field->swap)
+        {
+            format->plain = 0;
+        }
+        ++field;
+    }
+    format->n_field = (size_t) (field - format->field);
+    format->size = (offset + align - 1) / align * align;
+    if (format->size != format->packed_size)
+    {
+        format->plain = 0;             /* trailing padding */
+    }
+    if (format->n_field > 0 && !format->has_string
+        && format->size == format->packed_size)
+    {
+        format->swap_width = format->field[0].swap
+            ? format->field[0].width : 0;
+        for (size_t i = 1; i < format->n_field; ++i)
+        {
+            if (!format->field[i].swap
+                || format->field[i].width != format->swap_width)
+            {
+                format->swap_width = 0;
+            }
+        }
+    }
+    return format;
+}
+
+/*
+ * pack_format_free() --Free a compiled pack format.
+ */
+void pack_format_free(PackFormatPtr format)
+{
+    free(format);
+}
+
+/*
+ * pack_format_size() --Return the size of the struct a format describes.
+ */
+size_t pack_format_size(const PackFormat * format)
+{
+    return format->size;
+}
+
+/*
+ * pack_n() --Pack an array of structs into a buffer.
+ *
+ * Parameters:
+ * format   --the compiled format of the structs
+ * buf      --the buffer to pack into
+ * size     --the size of buf
+ * item     --the array of structs
+ * n_item   --the number of structs
+ *
+ * Returns: (size_t)
+ * Success: the number of bytes packed; Failure: 0 (buf is too small,
+ * or a Z field isn't NUL-terminated).
+ */
+size_t pack_n(const PackFormat * format, uint8_t * buf, size_t size,
+              const void *item, size_t n_item)
+{
+    const char *src = item;
+    uint8_t *ptr = buf, *end = buf + size;
+
+    if (!format->has_string)
+    {
+        if (format->packed_size != 0
+            && n_item > size / format->packed_size)
+        {
+            return 0;                  /* error: buffer too small */
+        }
+        if (format->plain)
+        {
+            memcpy(buf, item, n_item * format->size);
+            return n_item * format->size;
+        }
+        if (format->swap_width != 0)
+        {
+            BswapProc swap = (format->swap_width == 2) ? bswap16 : bswap32;
+
+            swap(buf, item,
+                 n_item * format->size / (size_t) format->swap_width);
+            return n_item * format->size;
+        }
+    }
+    for (size_t i = 0; i < n_item; ++i, src += format->size)
+    {
+        for (const PackField * field = format->field;
+             field < format->field + format->n_field; ++field)
+        {
+            size_t len = field->count * field->width;
+
+            if (field->code == 'Z')
+            {
+                const char *str = src + field->offset;
+
+                if ((len = strnlen(str, field->count)) == field->count)
+                {
+                    return 0;          /* error: unterminated string */
+                }
+                if ((size_t) (end - ptr) < len + 1)
+                {
+                    return 0;          /* error: buffer too small */
+                }
+                memcpy(ptr, str, len + 1);
+                ptr += len + 1;
+                continue;
+            }
+            if ((size_t) (end - ptr) < len)
+            {
+                return 0;              /* error: buffer too small */
+            }
+            copy_field(field, ptr, src + field->offset);
+            ptr += len;
+        }
+    }
+    return (size_t) (ptr - buf);
+}
+
+/*
+ * unpack_n() --Unpack an array of structs from a buffer.
+ *
+ * Parameters:
+ * format   --the compiled format of the structs
+ * buf      --the buffer to unpack from
+ * size     --the size of buf
+ * item     --returns the array of structs
+ * n_item   --the number of structs
+ *
+ * Returns: (size_t)
+ * Success: the number of bytes unpacked; Failure: 0 (buf is too
+ * short, or a string is too long for its Z field).
+ *
+ * Remarks:
+ * Padding bytes in the structs are left unchanged.
+ */
+size_t unpack_n(const PackFormat * format, const uint8_t * buf,
+                size_t size, void *item, size_t n_item)
+{
+    char *dst = item;
+    const uint8_t *ptr = buf, *end = buf + size;
+
+    if (!format->has_string)
+    {
+        if (format->packed_size != 0
+            && n_item > size / format->packed_size)
+        {
+            return 0;                  /* error: buffer too short */
+        }
+        if (format->plain)
+        {
+            memcpy(item, buf, n_item * format->size);
+            return n_item * format->size;
+        }
+        if (format->swap_width != 0)
+        {
+            BswapProc swap = (format->swap_width == 2) ? bswap16 : bswap32;
+
+            swap(item, buf,
+                 n_item * format->size / (size_t) format->swap_width);
+            return n_item * format->size;
+        }
+    }
+    for (size_t i = 0; i < n_item; ++i, dst += format->size)
+    {
+        for (const PackField * field = format->field;
+             field < format->field + format->n_field; ++field)
+        {
+            size_t len = field->count * field->width;
+
+            if (field->code == 'Z')
+            {
+                const uint8_t *nul = memchr(ptr, '\0', (size_t) (end - ptr));
+
+                if (nul == NULL || (size_t) (nul - ptr) >= field->count)
+                {
+                    return 0;          /* error: short/long string */
+                }
+                len = (size_t) (nul - ptr) + 1;
+                memcpy(dst + field->offset, ptr, len);
+                ptr += len;
+                continue;
+            }
+            if ((size_t) (end - ptr) < len)
+            {
+                return 0;              /* error: buffer too short */
+            }
+            copy_field(field, dst + field->offset, ptr);
+            ptr += len;
+        }
+    }
+    return (size_t) (ptr - buf);
+}
@@ -2,43 +2,76 @@
  * PROTOCOL.C --Various utilities for implementing protocols.
  *
  * Contents:
- * open_connect()   --Open a socket, and "connect" to it.
- * open_listen()    --Open a socket, bind and "listen" to it.
- * fdread()         --Read some bytes from a descriptor.
- * fdwrite()        --Write some bytes to a descriptor.
- * pack()           --Pack a value into a memory buffer.
- * unpack()         --Unpack a value from a memory buffer.
- * _setup_address() --setup the sockaddr structure for a socket.
+ * open_connect()         --Open a socket, and "connect" to it.
+ * open_connect_timeout() --Connect to any of an address's hosts, with a timeout.
+ * open_connect_async()   --Start a non-blocking connect to an address.
+ * open_listen()          --Open a socket, bind and "listen" to it.
+ * open_listen_opt()      --Open a listening socket, with options.
+ * fdread()               --Read some bytes from a descriptor.
+ * fdwrite()              --Write some bytes to a descriptor.
+ * fdio_vector()          --Read/write a vector of buffers, until done.
+ * fdreadv()              --Read into a vector of buffers.
+ * fdwritev()             --Write a vector of buffers.
+ * fdsend_batch()         --Send a batch of datagrams.
+ * fdrecv_batch()         --Receive a batch of datagrams.
+ * fdcopy()               --Copy bytes between descriptors via a buffer.
+ * fdsendfile()           --Copy bytes from a file to a descriptor (zero-copy).
+ * pack()                 --Pack a value into a memory buffer.
+ * unpack()               --Unpack a value from a memory buffer.
+ * msec_now()             --Get the monotonic time in milliseconds.
+ * start_connect()        --Start a non-blocking connect to an address.
+ * interleave_address()   --Order addresses, alternating address families.
+ * split_address()        --Split "host:port" into its host and service.
+ * resolve_address()      --Resolve an address to a list of socket addresses.
  *
  * Remarks:
  * Low-level protocol functions typically need to do system calls
  * and bash bytes in/out buffers.  This module provides some convenience
  * functions for that purpose.
+ *
+ * Addresses have the syntax "host:port", where host may be a name,
+ * an inet4 address, or a bracketed inet6 address (e.g. "[::1]:80").
+ * An empty host (or "*") means the wildcard address for listening
+ * sockets, and the loopback address otherwise.
  */
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <time.h>
 #include <sys/types.h>
 #include <stdlib.h>
 #include <limits.h>
 #ifndef __WINNT__
 #include <sys/un.h>
+#include <sys/uio.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif /* __linux__ */
 #include <arpa/inet.h>
+#include <netinet/in.h>
 #include <netdb.h>
 #endif /* __WINNT__ */
 #include <apex.h>
 #include <apex/protocol.h>
 
-static size_t _setup_address(const char *address, int domain,
-                             int type, struct sockaddr_storage *addr);
+#define CONNECT_MAX_ADDR 16            /* addresses tried per connect */
+#define CONNECT_ATTEMPT_DELAY 250      /* ms between attempts (RFC 8305) */
+#define FDIO_MAX_IOV 64                /* iovecs per readv/writev call */
+#define FDIO_MAX_MSG 64                /* datagrams per sendmmsg/recvmmsg */
+#define FDCOPY_BUF_SIZE 65536          /* fdcopy() buffer size */
+
+static int resolve_address(const char *address, int domain,
+                           int type, int flags, struct addrinfo **info);
 
 /*
  * open_connect() --Open a socket, and "connect" to it.
  *
  * Parameters:
  * address  --the socket (address-family dependent) address
- * domain   --the protocol domain/address family (e.g. PF_INET, PF_LOCAL)
+ * domain   --the protocol domain/address family (e.g. PF_INET, PF_UNSPEC)
  * type     --the socket type
  *
  * Returns: (int)
@@ -47,27 +80,295 @@ static size_t _setup_address(const char *address, int domain,
  * Remarks:
  * This is a convenience routine for client code.  In particular, the
  * "address" is intended to contain all that's required to setup the
- * connection, which for AF_INET domain is the IP address and port w/
- * the usual syntax "hostname:port".  For AF_LOCAL domains, the
- * address is the filesystem pathname.
+ * connection, which for the inet domains is the host and port w/
+ * the usual syntax "hostname:port".
+ *
+ * This is open_connect_timeout() without a timeout, so it tries all
+ * the host's addresses (of the domain) until one connects.
  */
 int open_connect(const char *address, int domain, int type)
+{
+    return open_connect_timeout(address, domain, type, -1);
+}
+
+/*
+ * msec_now() --Get the monotonic time in milliseconds.
+ */
+static long long msec_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/*
+ * start_connect() --Start a non-blocking connect to an address.
+ *
+ * Parameters:
+ * addr     --the address to connect to
+ * done     --returns 1 if the connect completed immediately
+ *
+ * Returns: (int)
+ * Success: the (non-blocking) socket descriptor; Failure: -1.
+ */
+static int start_connect(const struct addrinfo *addr, int *done)
 {
     int sfd;
-    struct sockaddr_storage addr_buf = {.ss_family = 0 };
-    size_t len;
 
-    sfd = -1;
-    len = _setup_address(address, domain, type, &addr_buf);
+    *done = 0;
+    if ((sfd = socket(addr->ai_family, addr->ai_socktype,
+                      addr->ai_protocol)) < 0)
+    {
+        return -1;
+    }
+    if (fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        close(sfd);
+        return -1;
+    }
+    if (connect(sfd, addr->ai_addr, addr->ai_addrlen) == 0)
+    {
+        *done = 1;
+    }
+    else if (errno != EINPROGRESS)
+    {
+        int err = errno;
+
+        close(sfd);
+        errno = err;
+        return -1;                     /* error: connect failed */
+    }
+    return sfd;
+}
+
+/*
+ * interleave_address() --Order addresses, alternating address families.
+ *
+ * Parameters:
+ * info     --the list of addresses returned by getaddrinfo()
+ * addr     --returns the addresses, in the order to try them
+ * max_addr --the size of addr
+ *
+ * Returns: (size_t)
+ * The number of addresses saved in addr.
+ *
+ * Remarks:
+ * The first address is (still) the resolver's preferred one, but
+ * the following addresses alternate between the other family and
+ * the first one, so a broken inet6 (or inet4) route only delays
+ * things by one attempt (RFC 8305, section 4).
+ */
+static size_t interleave_address(struct addrinfo *info,
+                                 struct addrinfo **addr, size_t max_addr)
+{
+    struct addrinfo *same = info, *other = NULL;
+    size_t n = 0;
 
-    if (len != 0 && (sfd = socket(domain, type, 0)) >= 0)
+    if (info == NULL)
     {
-        if (connect(sfd, (struct sockaddr *) &addr_buf, len) < 0)
+        return 0;
+    }
+    for (other = info; other != NULL; other = other->ai_next)
+    {
+        if (other->ai_family != info->ai_family)
         {
-            close(sfd);
-            sfd = -1;                  /* error: connect failed */
+            break;
+        }
+    }
+    while (n < max_addr && (same != NULL || other != NULL))
+    {
+        while (same != NULL && same->ai_family != info->ai_family)
+        {
+            same = same->ai_next;
+        }
+        if (same != NULL)
+        {
+            addr[n++] = same;
+            same = same->ai_next;
+        }
+        while (other != NULL && other->ai_family == info->ai_family)
+        {
+            other = other->ai_next;
+        }
+        if (other != NULL && n < max_addr)
+        {
+            addr[n++] = other;
+            other = other->ai_next;
         }
     }
+    return n;
+}
+
+/*
+ * open_connect_timeout() --Connect to any of an address's hosts, with a timeout.
+ *
+ * Parameters:
+ * address  --the socket address, "host:port"
+ * domain   --the address family (PF_INET, PF_INET6, or PF_UNSPEC for both)
+ * type     --the socket type
+ * timeout  --the maximum time to wait, in milliseconds (-1: forever)
+ *
+ * Returns: (int)
+ * Success: the (blocking) socket descriptor; Failure: -1, with errno
+ * set to ETIMEDOUT, or the last connect error.
+ *
+ * Remarks:
+ * The host's addresses are tried "happy eyeballs" style: connects
+ * are non-blocking, and if an attempt hasn't completed after
+ * CONNECT_ATTEMPT_DELAY ms, the next address is started alongside
+ * it.  The first connection to complete wins, and the others are
+ * closed; an attempt that fails starts the next address immediately.
+ */
+int open_connect_timeout(const char *address, int domain, int type,
+                         int timeout)
+{
+    struct addrinfo *info, *addr[CONNECT_MAX_ADDR];
+    struct pollfd pending[CONNECT_MAX_ADDR];
+    size_t n_addr, n_started = 0, n_pending = 0;
+    long long now, deadline, next_start;
+    int sfd = -1, err = ECONNREFUSED;
+
+    if (resolve_address(address, domain, type, 0, &info) != 0)
+    {
+        return -1;                     /* error: can't resolve address */
+    }
+    n_addr = interleave_address(info, addr, NEL(addr));
+    now = next_start = msec_now();
+    deadline = (timeout < 0) ? -1 : now + timeout;
+
+    while (sfd < 0)
+    {
+        int wait = -1;
+
+        if (n_started < n_addr && (n_pending == 0 || now >= next_start))
+        {
+            int done, fd = start_connect(addr[n_started++], &done);
+
+            if (fd < 0)
+            {
+                err = errno;
+                continue;              /* try the next address now */
+            }
+            if (done)
+            {
+                sfd = fd;
+                break;
+            }
+            pending[n_pending].fd = fd;
+            pending[n_pending].events = POLLOUT;
+            pending[n_pending++].revents = 0;
+            next_start = now + CONNECT_ATTEMPT_DELAY;
+        }
+        if (n_pending == 0)
+        {
+            break;                     /* error: all addresses failed */
+        }
+        if (n_started < n_addr)
+        {
+            wait = (int) (next_start - now);
+        }
+        if (deadline >= 0)
+        {
+            if (now >= deadline)
+            {
+                err = ETIMEDOUT;
+                break;                 /* error: timed out */
+            }
+            if (wait < 0 || deadline - now < wait)
+            {
+                wait = (int) (deadline - now);
+            }
+        }
+        if (poll(pending, n_pending, wait) < 0 && errno != EINTR)
+        {
+            err = errno;
+            break;
+        }
+        now = msec_now();
+        for (size_t i = 0; i < n_pending;)
+        {
+            int status = 0;
+            socklen_t len = sizeof(status);
+
+            if (pending[i].revents == 0)
+            {
+                ++i;
+                continue;
+            }
+            if (getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR,
+                           &status, &len) < 0)
+            {
+                status = errno;
+            }
+            if (status == 0 && sfd < 0)
+            {
+                sfd = pending[i].fd;   /* success: first to complete */
+            }
+            else
+            {
+                err = (status != 0) ? status : err;
+                close(pending[i].fd);
+                next_start = now;      /* start the next one now */
+            }
+            pending[i] = pending[--n_pending];
+        }
+    }
+    for (size_t i = 0; i < n_pending; ++i)
+    {
+        close(pending[i].fd);          /* abandon the slower attempts */
+    }
+    freeaddrinfo(info);
+
+    if (sfd < 0)
+    {
+        errno = err;
+        return -1;
+    }
+    fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) & ~O_NONBLOCK);
+    return sfd;
+}
+
+/*
+ * open_connect_async() --Start a non-blocking connect to an address.
+ *
+ * Parameters:
+ * address  --the socket address, "host:port"
+ * domain   --the address family
+ * type     --the socket type
+ *
+ * Returns: (int)
+ * Success: the (non-blocking) socket descriptor; Failure: -1.
+ *
+ * Remarks:
+ * This is for event loops: the connect may still be in progress, so
+ * the caller waits for the socket to become writable, and then
+ * checks its SO_ERROR.  Each of the host's addresses is tried until
+ * one starts (or completes) its connect.  Note that resolving the
+ * host name may block.
+ */
+int open_connect_async(const char *address, int domain, int type)
+{
+    struct addrinfo *info;
+    int sfd = -1, done, err = ECONNREFUSED;
+
+    if (resolve_address(address, domain, type, 0, &info) != 0)
+    {
+        return -1;                     /* error: can't resolve address */
+    }
+    for (struct addrinfo * ai = info; ai != NULL && sfd < 0;
+         ai = ai->ai_next)
+    {
+        if ((sfd = start_connect(ai, &done)) < 0)
+        {
+            err = errno;
+        }
+    }
+    freeaddrinfo(info);
+    if (sfd < 0)
+    {
+        errno = err;
+    }
     return sfd;
 }
 
@@ -83,26 +384,84 @@ int open_connect(const char *address, int domain, int type)
  * Success: the socket descriptor; Failure: -1.
  *
  * Remarks:
- * This is a convenience routine for server code.
+ * This is a convenience routine for server code; it's
+ * open_listen_opt() with a backlog of 1, and no options.
  */
 int open_listen(const char *address, int domain, int type)
 {
-    int sfd;
-    struct sockaddr_storage addr_buf = {.ss_family = 0 };
-    size_t len;
+    return open_listen_opt(address, domain, type, 1, 0);
+}
 
-    sfd = -1;
-    len = _setup_address(address, domain, type, &addr_buf);
+/*
+ * open_listen_opt() --Open a listening socket, with options.
+ *
+ * Parameters:
+ * address  --the socket address, "host:port"
+ * domain   --the address family
+ * type     --the socket type
+ * backlog  --the listen() backlog (ignored for datagram sockets)
+ * flags    --a bitmask of LISTEN_* options (see protocol.h)
+ *
+ * Returns: (int)
+ * Success: the socket descriptor; Failure: -1.
+ *
+ * Remarks:
+ * With LISTEN_REUSEPORT, several sockets (e.g. one per thread, or
+ * per process) can listen on the same port, and the kernel spreads
+ * the incoming connections between them, so each can run its own
+ * accept loop without contending on a shared socket.
+ *
+ * The socket is bound to the first of the resolved addresses that
+ * will bind; datagram sockets are bound, but not "listened".
+ */
+int open_listen_opt(const char *address, int domain, int type,
+                    int backlog, int flags)
+{
+    struct addrinfo *info;
+    int sfd = -1, err = EADDRNOTAVAIL;
+    int on = 1;
 
-    if (len != 0 && (sfd = socket(domain, type, 0)) >= 0)
+    if (resolve_address(address, domain, type, AI_PASSIVE, &info) != 0)
+    {
+        return -1;                     /* error: can't resolve address */
+    }
+    for (struct addrinfo * ai = info; ai != NULL && sfd < 0;
+         ai = ai->ai_next)
     {
-        if (bind(sfd, (struct sockaddr *) &addr_buf, len) < 0
-            || listen(sfd, 1) < 0)
+        if ((sfd = socket(ai->ai_family, ai->ai_socktype,
+                          ai->ai_protocol)) < 0)
+        {
+            err = errno;
+            continue;
+        }
+        if (((flags & LISTEN_REUSEADDR)
+             && setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR,
+                           &on, sizeof(on)) < 0)
+#ifdef SO_REUSEPORT
+            || ((flags & LISTEN_REUSEPORT)
+                && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT,
+                              &on, sizeof(on)) < 0)
+#endif /* SO_REUSEPORT */
+            || (ai->ai_family == AF_INET6 && (flags & LISTEN_V6ONLY)
+                && setsockopt(sfd, IPPROTO_IPV6, IPV6_V6ONLY,
+                              &on, sizeof(on)) < 0)
+            || ((flags & LISTEN_NONBLOCK)
+                && fcntl(sfd, F_SETFL,
+                         fcntl(sfd, F_GETFL) | O_NONBLOCK) < 0)
+            || bind(sfd, ai->ai_addr, ai->ai_addrlen) < 0
+            || ((type == SOCK_STREAM || type == SOCK_SEQPACKET)
+                && listen(sfd, backlog) < 0))
         {
+            err = errno;
             close(sfd);
             sfd = -1;                  /* error: bind/listen failed */
         }
     }
+    freeaddrinfo(info);
+    if (sfd < 0)
+    {
+        errno = err;
+    }
     return sfd;
 }
 
@@ -193,6 +552,393 @@ ssize_t fdwrite(int fd, const void *vptr, size_t n)
     return (ssize_t) n;
 }
 
+/*
+ * fdio_vector() --Read/write a vector of buffers, until done.
+ *
+ * Parameters:
+ * fd       --the descriptor
+ * iov      --the buffers
+ * n_iov    --the number of buffers
+ * writing  --true for writev(), false for readv()
+ *
+ * Returns: (ssize_t)
+ * Success: the number of bytes transferred; Failure: -1.
+ *
+ * Remarks:
+ * The caller's iov is not modified: each call passes (up to
+ * FDIO_MAX_IOV of) the remaining buffers in a local copy, with the
+ * first one adjusted past any partial transfer.
+ */
+static ssize_t fdio_vector(int fd, const struct iovec *iov, int n_iov,
+                           int writing)
+{
+    struct iovec part[FDIO_MAX_IOV];
+    size_t total = 0, offset = 0;      /* offset into iov[0] */
+
+    while (n_iov > 0)
+    {
+        int n_part = MIN(n_iov, FDIO_MAX_IOV);
+        ssize_t n;
+        size_t nleft;
+
+        if (iov->iov_len == offset)
+        {
+            ++iov, --n_iov, offset = 0;
+            continue;                  /* skip empty/finished buffers */
+        }
+        memcpy(part, iov, (size_t) n_part * sizeof(*iov));
+        part[0].iov_base = (char *) part[0].iov_base + offset;
+        part[0].iov_len -= offset;
+
+        n = writing ? writev(fd, part, n_part) : readv(fd, part, n_part);
+        if (n < 0 || (n == 0 && writing))
+        {
+            if (n < 0 && errno == EINTR)
+            {
+                continue;              /* retry */
+            }
+            return -1;                 /* error */
+        }
+        if (n == 0)
+        {
+            break;                     /* EOF */
+        }
+        total += (size_t) n;
+        for (nleft = (size_t) n; nleft > 0;)
+        {                              /* advance past the transfer */
+            size_t len = iov->iov_len - offset;
+
+            if (nleft < len)
+            {
+                offset += nleft;
+                break;
+            }
+            nleft -= len;
+            ++iov, --n_iov, offset = 0;
+        }
+    }
+    return (ssize_t) total;
+}
+
+/*
+ * fdreadv() --Read into a vector of buffers.
+ *
+ * Parameters:
+ * fd       --the descriptor to read from
+ * iov      --the buffers to fill, in order
+ * n_iov    --the number of buffers
+ *
+ * Returns: (ssize_t)
+ * Success: the number of bytes read (less than the total only at
+ * EOF); Failure: -1.
+ *
+ * Remarks:
+ * This is fdread() for scattered buffers (e.g. a fixed-size header,
+ * and the payload's buffer), read with as few readv() calls as
+ * possible.
+ */
+ssize_t fdreadv(int fd, const struct iovec *iov, int n_iov)
+{
+    return fdio_vector(fd, iov, n_iov, 0);
+}
+
+/*
+ * fdwritev() --Write a vector of buffers.
+ *
+ * Parameters:
+ * fd       --the descriptor to write to
+ * iov      --the buffers to write, in order
+ * n_iov    --the number of buffers
+ *
+ * Returns: (ssize_t)
+ * Success: the number of bytes written (i.e. all of them); Failure: -1.
+ *
+ * Remarks:
+ * This is fdwrite() for gathered buffers, so a header and payload
+ * go out in one writev() call (and one packet), without copying
+ * them together first.
+ */
+ssize_t fdwritev(int fd, const struct iovec *iov, int n_iov)
+{
+    return fdio_vector(fd, iov, n_iov, 1);
+}
+
+/*
+ * fdsend_batch() --Send a batch of datagrams.
+ *
+ * Parameters:
+ * fd       --a datagram socket (connected, or with a default address)
+ * msg      --the datagrams to send
+ * n_msg    --the number of datagrams
+ *
+ * Returns: (ssize_t)
+ * Success: the number of datagrams sent; Failure: -1 (nothing sent).
+ *
+ * Remarks:
+ * On Linux, the datagrams are sent FDIO_MAX_MSG at a time with
+ * sendmmsg(); elsewhere (or if sendmmsg() isn't supported) they're
+ * sent one at a time.  If an error occurs after some datagrams have
+ * been sent, the count so far is returned.
+ */
+ssize_t fdsend_batch(int fd, const struct iovec *msg, size_t n_msg)
+{
+    size_t n_sent = 0;
+
+#ifdef __linux__
+    while (n_sent < n_msg)
+    {
+        struct mmsghdr hdr[FDIO_MAX_MSG];
+        unsigned int n_batch = (unsigned int) MIN(n_msg - n_sent,
+                                                  FDIO_MAX_MSG);
+        int n;
+
+        memset(hdr, 0, n_batch * sizeof(*hdr));
+        for (unsigned int i = 0; i < n_batch; ++i)
+        {
+            hdr[i].msg_hdr.msg_iov = (struct iovec *) &msg[n_sent + i];
+            hdr[i].msg_hdr.msg_iovlen = 1;
+        }
+        if ((n = sendmmsg(fd, hdr, n_batch, 0)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;              /* retry */
+            }
+            if (errno == ENOSYS && n_sent == 0)
+            {
+                break;                 /* no sendmmsg(): send() them */
+            }
+            return n_sent > 0 ? (ssize_t) n_sent : -1;
+        }
+        n_sent += (size_t) n;
+    }
+#endif /* __linux__ */
+    while (n_sent < n_msg)
+    {
+        if (send(fd, msg[n_sent].iov_base, msg[n_sent].iov_len, 0) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;              /* retry */
+            }
+            return n_sent > 0 ? (ssize_t) n_sent : -1;
+        }
+        ++n_sent;
+    }
+    return (ssize_t) n_sent;
+}
+
+/*
+ * fdrecv_batch() --Receive a batch of datagrams.
+ *
+ * Parameters:
+ * fd       --a datagram socket
+ * msg      --the buffers to receive into (lengths are updated)
+ * from     --returns each datagram's source address (may be NULL)
+ * n_msg    --the number of buffers
+ * flags    --recv() flags (e.g. MSG_DONTWAIT)
+ *
+ * Returns: (ssize_t)
+ * Success: the number of datagrams received; Failure: -1.
+ *
+ * Remarks:
+ * This waits (unless flags has MSG_DONTWAIT) for the first datagram,
+ * and then collects any others already queued, up to n_msg of them
+ * (using recvmmsg() on Linux, FDIO_MAX_MSG at a time).  Each
+ * received buffer's iov_len is set to its datagram's length;
+ * datagrams longer than their buffer are truncated.
+ */
+ssize_t fdrecv_batch(int fd, struct iovec *msg,
+                     struct sockaddr_storage *from, size_t n_msg,
+                     int flags)
+{
+    size_t n_recv = 0;
+
+#ifdef __linux__
+    while (n_recv < n_msg)
+    {
+        struct mmsghdr hdr[FDIO_MAX_MSG];
+        unsigned int n_batch = (unsigned int) MIN(n_msg - n_recv,
+                                                  FDIO_MAX_MSG);
+        int n;
+
+        memset(hdr, 0, n_batch * sizeof(*hdr));
+        for (unsigned int i = 0; i < n_batch; ++i)
+        {
+            hdr[i].msg_hdr.msg_iov = &msg[n_recv + i];
+            hdr[i].msg_hdr.msg_iovlen = 1;
+            if (from != NULL)
+            {
+                hdr[i].msg_hdr.msg_name = &from[n_recv + i];
+                hdr[i].msg_hdr.msg_namelen = sizeof(*from);
+            }
+        }
+        if ((n = recvmmsg(fd, hdr, n_batch,
+                          flags | (n_recv > 0 ? MSG_DONTWAIT
+                                   : MSG_WAITFORONE), NULL)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;              /* retry */
+            }
+            if (errno == ENOSYS && n_recv == 0)
+            {
+                break;                 /* no recvmmsg(): recv() them */
+            }
+            return n_recv > 0 ? (ssize_t) n_recv : -1;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            msg[n_recv + (size_t) i].iov_len = hdr[i].msg_len;
+        }
+        n_recv += (size_t) n;
+        if ((unsigned int) n < n_batch)
+        {
+            return (ssize_t) n_recv;   /* no more queued */
+        }
+    }
+#endif /* __linux__ */
+    while (n_recv < n_msg)
+    {
+        socklen_t len = sizeof(*from);
+        ssize_t n = recvfrom(fd, msg[n_recv].iov_base, msg[n_recv].iov_len,
+                             flags | (n_recv > 0 ? MSG_DONTWAIT : 0),
+                             from != NULL
+                             ? (struct sockaddr *) &from[n_recv] : NULL,
+                             from != NULL ? &len : NULL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;              /* retry */
+            }
+            if (n_recv > 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;                 /* no more queued */
+            }
+            return n_recv > 0 ? (ssize_t) n_recv : -1;
+        }
+        msg[n_recv++].iov_len = (size_t) n;
+    }
+    return (ssize_t) n_recv;
+}
+
+/*
+ * fdcopy() --Copy bytes between descriptors via a buffer.
+ *
+ * Parameters:
+ * out_fd   --the descriptor to write to
+ * in_fd    --the descriptor to read from
+ * offset   --the offset to read from (NULL: the current position)
+ * n        --the number of bytes to copy
+ *
+ * Returns: (ssize_t)
+ * Success: the number of bytes copied; Failure: -1.
+ *
+ * Remarks:
+ * This is the portable fallback for fdsendfile().
+ */
+static ssize_t fdcopy(int out_fd, int in_fd, off_t * offset, size_t n)
+{
+    char buf[FDCOPY_BUF_SIZE];
+    size_t nleft = n;
+
+    while (nleft > 0)
+    {
+        size_t size = MIN(nleft, sizeof(buf));
+        ssize_t nr = (offset != NULL)
+            ? pread(in_fd, buf, size, *offset) : read(in_fd, buf, size);
+
+        if (nr < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;              /* retry */
+            }
+            return n == nleft ? -1 : (ssize_t) (n - nleft);
+        }
+        if (nr == 0)
+        {
+            break;                     /* EOF */
+        }
+        if (fdwrite(out_fd, buf, (size_t) nr) < 0)
+        {
+            return -1;                 /* error: write failed */
+        }
+        if (offset != NULL)
+        {
+            *offset += nr;
+        }
+        nleft -= (size_t) nr;
+    }
+    return (ssize_t) (n - nleft);
+}
+
+/*
+ * fdsendfile() --Copy bytes from a file to a descriptor (zero-copy).
+ *
+ * Parameters:
+ * out_fd   --the descriptor to write to (typically a socket)
+ * in_fd    --the file to read from
+ * offset   --the file offset to read from, updated by the number of
+ *             bytes sent (NULL: use, and advance, the file position)
+ * n        --the number of bytes to send
+ *
+ * Returns: (ssize_t)
+ * Success: the number of bytes sent (less than n only at EOF);
+ * Failure: -1.
+ *
+ * Remarks:
+ * This is for serving files (e.g. logs, CSV) over a socket: on Linux
+ * the data goes from the page cache to the socket with sendfile(),
+ * without being copied through user space.  Like fdwrite(), partial
+ * transfers and EINTR are retried until all n bytes are sent.  If
+ * sendfile() can't handle the descriptors (e.g. in_fd is a pipe), or
+ * on other systems, the bytes are copied through a buffer instead.
+ */
+ssize_t fdsendfile(int out_fd, int in_fd, off_t * offset, size_t n)
+{
+    size_t nleft = n;
+
+#ifdef __linux__
+    while (nleft > 0)
+    {
+        ssize_t ns = sendfile(out_fd, in_fd, offset,
+                              MIN(nleft, (size_t) SSIZE_MAX));
+
+        if (ns < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;              /* retry */
+            }
+            if ((errno == EINVAL || errno == ENOSYS) && nleft == n)
+            {
+                break;                 /* unsupported: use fdcopy() */
+            }
+            return -1;                 /* error */
+        }
+        if (ns == 0)
+        {
+            return (ssize_t) (n - nleft);      /* EOF */
+        }
+        nleft -= (size_t) ns;
+    }
+#endif /* __linux__ */
+    if (nleft > 0)
+    {
+        ssize_t nc = fdcopy(out_fd, in_fd, offset, nleft);
+
+        if (nc < 0)
+        {
+            return -1;
+        }
+        nleft -= (size_t) nc;
+    }
+    return (ssize_t) (n - nleft);
+}
+
 /*
  * pack() --Pack a value into a memory buffer.
  *
@@ -220,7 +966,8 @@ ssize_t fdwrite(int fd, const void *vptr, size_t n)
  *
  * This routine (and its counterpart, unpack()), take care to avoid
  * misaligned memory accesses, so it can be used to create a packed
- * byte stream.
+ * byte stream.  To pack whole structs (with bounds checking), see
+ * pack_n() in pack.c.
  */
 size_t pack(int fmt, uint8_t * ptr, void *item)
 {
@@ -306,47 +1053,92 @@ size_t unpack(int fmt, uint8_t * ptr, void *item)
 }
 
 /*
- * _setup_address() --setup the sockaddr structure for a socket.
+ * split_address() --Split "host:port" into its host and service.
  *
  * Parameters:
- * address  --the socket (address-family dependent) address
+ * address  --the address text
+ * host     --returns the host part (size FILENAME_MAX)
+ * service  --returns the service/port part (size FILENAME_MAX)
+ *
+ * Returns: (int)
+ * Success: 0; Failure: -1.
+ *
+ * Remarks:
+ * The port follows the last ":", so an inet6 host must be
+ * bracketed (i.e. "[::1]:80"); an unbracketed host with a ":" in
+ * it is ambiguous, and rejected.
+ */
+static int split_address(const char *address, char *host, char *service)
+{
+    const char *colon, *host_end;
+
+    if (*address == '[')
+    {
+        if ((host_end = strchr(++address, ']')) == NULL
+            || *(colon = host_end + 1) != ':')
+        {
+            return -1;                 /* error: "[host]:port" expected */
+        }
+    }
+    else
+    {
+        if ((colon = strrchr(address, ':')) == NULL
+            || memchr(address, ':', (size_t) (colon - address)) != NULL)
+        {
+            return -1;                 /* error: "host:port" expected */
+        }
+        host_end = colon;
+    }
+    if ((size_t) (host_end - address) >= FILENAME_MAX
+        || strlen(colon + 1) >= FILENAME_MAX || colon[1] == '\0')
+    {
+        return -1;
+    }
+    memcpy(host, address, (size_t) (host_end - address));
+    host[host_end - address] = '\0';
+    strcpy(service, colon + 1);
+    return 0;
+}
+
+/*
+ * resolve_address() --Resolve an address to a list of socket addresses.
+ *
+ * Parameters:
+ * address  --the socket address, "host:port"
  * domain   --the protocol domain/address family
  * type     --the socket type
- * addr     --a caller-supplied sockaddr to be initialised
+ * flags    --getaddrinfo() flags (e.g. AI_PASSIVE)
+ * info     --returns the list of addresses (caller must freeaddrinfo())
  *
  * Returns: (int)
- * Success: the size of the "true" sockaddr; Failure: 0.
+ * Success: 0; Failure: -1.
  *
  * Remarks:
  * This routine encapsulates the protocol-specific processing
- * for initialising the sockaddr structure.
- *
- * TODO: add AF_INET6 support.
+ * for initialising the sockaddr structures.
  */
-static size_t _setup_address(const char *address, int domain,
-                             int type, struct sockaddr_storage *addr)
+static int resolve_address(const char *address, int domain,
+                           int type, int flags, struct addrinfo **info)
 {
     char host[FILENAME_MAX];
     char service[FILENAME_MAX];
-    size_t addr_len;
-
-    struct addrinfo *info;
     struct addrinfo hint = {.ai_family = 0 };
+    int status;
 
-    if (sscanf(address, "%[^:]:%s", host, service) != 2)
+    if (split_address(address, host, service) != 0)
     {
-        return 0;                      /* error: can't parse "host:port" */
+        errno = EINVAL;
+        return -1;                     /* error: can't parse "host:port" */
     }
-    hint.ai_flags = AI_CANONNAME;
+    hint.ai_flags = flags;
     hint.ai_family = domain;
     hint.ai_socktype = type;
 
-    if (getaddrinfo(host, service, &hint, &info) == 0)
+    if ((status = getaddrinfo((*host == '\0' || strcmp(host, "*") == 0)
+                              ? NULL : host, service, &hint, info)) != 0)
     {
-        addr_len = info->ai_addrlen;
-        memcpy(addr, info->ai_addr, addr_len);
-        freeaddrinfo(info);
-        return addr_len;
+        errno = (status == EAI_SYSTEM) ? errno : EADDRNOTAVAIL;
+        return -1;                     /* error: unsupported family? */
     }
-    return 0;                          /* error: unsupported family? */
+    return 0;
 }
@@ -6,6 +6,10 @@
  * manipulating packets.  In particular, pack(), unpack() are
  * inspired by their Perl namesakes.
  *
+ * Socket addresses are "host:port", with inet6 hosts bracketed
+ * (e.g. "[::1]:8080"); use PF_UNSPEC to connect to whichever of a
+ * host's inet4/inet6 addresses answers first.
+ *
  */
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
@@ -14,19 +18,59 @@
 #include <sys/types.h>
 #ifndef __WINNT__
 #include <sys/socket.h>
+#include <sys/uio.h>
 #endif /* __WINNT__ */
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif                                 /* C++ */
+    /*
+     * open_listen_opt() flags
+     */
+    enum
+    {
+        LISTEN_REUSEADDR = 0x1,        /* set SO_REUSEADDR */
+        LISTEN_REUSEPORT = 0x2,        /* set SO_REUSEPORT (if available) */
+        LISTEN_V6ONLY = 0x4,           /* inet6 sockets don't accept inet4 */
+        LISTEN_NONBLOCK = 0x8          /* make the socket non-blocking */
+    };
+
     int open_connect(const char *address, int domain, int type);
+    int open_connect_timeout(const char *address, int domain, int type,
+                             int timeout);
+    int open_connect_async(const char *address, int domain, int type);
     int open_listen(const char *address, int domain, int type);
+    int open_listen_opt(const char *address, int domain, int type,
+                        int backlog, int flags);
     ssize_t fdread(int fd, void *vptr, size_t n);
     ssize_t fdwrite(int fd, const void *vptr, size_t n);
+    ssize_t fdreadv(int fd, const struct iovec *iov, int n_iov);
+    ssize_t fdwritev(int fd, const struct iovec *iov, int n_iov);
+    ssize_t fdsend_batch(int fd, const struct iovec *msg, size_t n_msg);
+    ssize_t fdrecv_batch(int fd, struct iovec *msg,
+                         struct sockaddr_storage *from, size_t n_msg,
+                         int flags);
+    ssize_t fdsendfile(int out_fd, int in_fd, off_t * offset, size_t n);
     size_t pack(int fmt, uint8_t * ptr, void *item);
     size_t unpack(int fmt, uint8_t * ptr, void *item);
 
+    /*
+     * PackFormat --A compiled pack format for a struct.
+     *
+     * Remarks:
+     * See pack.c.
+     */
+    typedef struct PackFormat_t PackFormat, *PackFormatPtr;
+
+    PackFormatPtr pack_format(const char *fmt);
+    void pack_format_free(PackFormatPtr format);
+    size_t pack_format_size(const PackFormat * format);
+    size_t pack_n(const PackFormat * format, uint8_t * buf, size_t size,
+                  const void *item, size_t n_item);
+    size_t unpack_n(const PackFormat * format, const uint8_t * buf,
+                    size_t size, void *item, size_t n_item);
+
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
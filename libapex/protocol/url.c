@@ -2,13 +2,25 @@
  * URL.C --URL manipulation routines.
  *
  * Contents:
- * service[]         --A list of well-known services and their associated ports.
  * encode_tab[]      --A list of characters that must be encoded in URLs
+ * is_safe()         --Test if a character needn't be encoded.
+ * safe_lo_tab[]     --The safe characters, as a bitmap by low nibble.
+ * safe_run_none()   --Find nothing (the caller's scalar loop does the work).
  * parse_url_path_() --Parse the "path" part of a URL.
+ * url_scheme_port() --Get the well-known port of a URL scheme.
  * adjust_port_()    --Adjust the port based on well-known schemes.
  * str_url()         --(Destructively) parse a URL string into a URL structure.
+ * span()            --Set a span to a part of a URL string.
+ * scheme_end()      --Find the end of a URL's scheme (if it has one).
+ * url_parse()       --Parse a URL string into spans, without modifying it.
  * sprint_url()      --Format a URL into text buffer.
+ * safe_run_*()      --Find the length of a run of safe characters, 16 at a time.
+ * resolve_safe_run() --Select the best safe_run() for this CPU, and call it.
+ * safe_run()        --Find the length of a run of characters that needn't be encoded.
  * url_encode()      --Escape a string with the URL encoding scheme.
+ * hex_value()       --Get the value of a hex digit.
+ * url_decode()      --Decode a URL-encoded string.
+ * url_query_split() --Split a query string into key/value views.
  *
  * Remarks:
  * I'm sure this has been done better, elswhere by others, but here's
@@ -16,30 +28,31 @@
  *
  */
 #include <stdio.h>
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include <strings.h>
+#include <apex.h>
+#include <apex/cpu.h>
 #include <apex/symbol.h>
 #include <apex/strparse.h>
 #include <apex/estring.h>
 #include <apex/url.h>
 
-URL null_url = NULL_URL;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define URL_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define URL_NEON
+#include <arm_neon.h>
+#endif
 
-/*
- * service[] --A list of well-known services and their associated ports.
- *
- * This is used by adjust_port_() to fill in the default port.
- */
-static Enum service[] = {              /* REVISIT: use getservbyname(3)? */
-    {(char *) "mailto", 25},           /* hmmm. mailto is "unofficial" */
-    {(char *) "ftp", 21},
-    {(char *) "http", 80},
-    {(char *) "https", 443},
-    {NULL, 0}
-};
+URL null_url = NULL_URL;
 
 /*
  * encode_tab[] --A list of characters that must be encoded in URLs
  *
- * This is used by url_encode().
+ * This is used by url_encode(), via is_safe() (and safe_lo_tab[]).
  */
 static char encode_tab[127] = {
     /* ASCII control characters */
@@ -60,6 +73,37 @@ static char encode_tab[127] = {
     ['~'] = 1,['['] = 1,[']'] = 1,['`'] = 1
 };
 
+/*
+ * is_safe() --Test if a character needn't be encoded.
+ */
+static inline int is_safe(unsigned char c)
+{
+    return c < 127 && !encode_tab[c];
+}
+
+/*
+ * safe_lo_tab[] --The safe characters, as a bitmap by low nibble.
+ *
+ * Bit h of entry l is set if the character 0xhl is safe (i.e. this
+ * is encode_tab[] transposed for a pshufb/tbl lookup); test-url
+ * checks it against encode_tab[].
+ */
+static const unsigned char safe_lo_tab[16] = {
+    0xa8, 0xfc, 0xfc, 0xf8, 0xf8, 0xf8, 0xf8, 0xfc,
+    0xfc, 0xfc, 0xf4, 0x50, 0x50, 0x54, 0x54, 0x70
+};
+
+typedef size_t(*SafeRunProc) (const unsigned char *text, size_t len);
+
+/*
+ * safe_run_none() --Find nothing (the caller's scalar loop does the work).
+ */
+static size_t safe_run_none(const unsigned char *UNUSED(text),
+                            size_t UNUSED(len))
+{
+    return 0;
+}
+
 /*
  * parse_url_path_() --Parse the "path" part of a URL.
  */
@@ -77,24 +121,64 @@ static inline void parse_url_path_(char *opt, URLPtr url)
 }
 
 /*
- * adjust_port_() --Adjust the port based on well-known schemes.
+ * url_scheme_port() --Get the well-known port of a URL scheme.
+ *
+ * Parameters:
+ * scheme   --the scheme (not necessarily NUL-terminated)
+ * len      --the scheme's length
+ *
+ * Returns: (int)
+ * Success: the port; Failure: 0 (unknown scheme).
+ *
+ * Remarks:
+ * Schemes are case-insensitive.  The lookup switches on the
+ * scheme's length and first character, so it costs at most one
+ * comparison (this is called for every URL parsed, so it mustn't
+ * scan a list, or call getservbyname(3)).
  */
-static inline void adjust_port_(URLPtr url)
+int url_scheme_port(const char *scheme, size_t len)
 {
-    EnumPtr s = service;
-
-    if (url->port != 0 || url->scheme == NULL)
+#define SCHEME(_name_, _port_) \
+    ((len == sizeof(_name_) - 1 && strncasecmp(scheme, _name_, len) == 0) \
+     ? (_port_) : 0)
+    if (len < 2)
     {
-        return;
+        return 0;
     }
+    switch (tolower((unsigned char) scheme[0]))
+    {
+    case 'f':
+        return SCHEME("ftp", 21);
+    case 'h':
+        return len == 4 ? SCHEME("http", 80) : SCHEME("https", 443);
+    case 'i':
+        return SCHEME("imap", 143);
+    case 'l':
+        return len == 4 ? SCHEME("ldap", 389) : SCHEME("ldaps", 636);
+    case 'm':
+        return SCHEME("mailto", 25);   /* hmmm. mailto is "unofficial" */
+    case 'p':
+        return SCHEME("pop3", 110);
+    case 's':
+        return len == 3 ? SCHEME("ssh", 22) : SCHEME("smtp", 25);
+    case 't':
+        return SCHEME("telnet", 23);
+    case 'w':
+        return len == 2 ? SCHEME("ws", 80) : SCHEME("wss", 443);
+    default:
+        return 0;
+    }
+#undef SCHEME
+}
 
-    for (s = service; s->name != NULL; ++s)
+/*
+ * adjust_port_() --Adjust the port based on well-known schemes.
+ */
+static inline void adjust_port_(URLPtr url)
+{
+    if (url->port == 0 && url->scheme != NULL)
     {
-        if (strcmp(url->scheme, s->name) == 0)
-        {
-            url->port = s->value;
-            break;
-        }
+        url->port = url_scheme_port(url->scheme, strlen(url->scheme));
     }
 }
 
@@ -179,6 +263,178 @@ int str_url(char *opt, URLPtr url)
     return 1;
 }
 
+/*
+ * span() --Set a span to a part of a URL string.
+ */
+static inline void span(URLSpan * sp, const char *str, const char *start,
+                        const char *end)
+{
+    sp->offset = (int) (start - str);
+    sp->len = (int) (end - start);
+}
+
+/*
+ * scheme_end() --Find the end of a URL's scheme (if it has one).
+ *
+ * Returns: (const char *)
+ * Success: the ":" after the scheme; Failure: NULL (no scheme).
+ */
+static const char *scheme_end(const char *str, const char *end)
+{
+    const char *ptr = str;
+
+    if (ptr == end || !isalpha((unsigned char) *ptr))
+    {
+        return NULL;
+    }
+    while (ptr < end && (isalnum((unsigned char) *ptr)
+                         || *ptr == '+' || *ptr == '-' || *ptr == '.'))
+    {
+        ++ptr;
+    }
+    return ptr < end && *ptr == ':' ? ptr : NULL;
+}
+
+/*
+ * url_parse() --Parse a URL string into spans, without modifying it.
+ *
+ * Parameters:
+ * str  --the URL string (not necessarily NUL-terminated)
+ * len  --the string's length
+ * view --returns the spans of the URL's parts
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (bad port, unterminated "[").
+ *
+ * Remarks:
+ * This is str_url() for callers that parse a URL per request: it
+ * doesn't copy or modify str, it just records the offset/length of
+ * each part (absent parts have offset -1), so the string can be
+ * const (e.g. in an I/O buffer).  It accepts the same syntax as
+ * str_url(), and also:
+ * * bracketed inet6 hosts (the brackets aren't part of the domain)
+ * * an anchor without a query ("path#anchor")
+ * * "://" later in the URL (e.g. in the query) isn't a scheme
+ *
+ * As in str_url(), the path doesn't include its leading "/", and
+ * the port defaults to the scheme's well-known port (or 0).
+ */
+int url_parse(const char *str, size_t len, URLViewPtr view)
+{
+    static const URLSpan none = {.offset = -1 };
+    const char *ptr = str, *end = str + len, *auth, *at, *host_end, *sep;
+
+    if (len > INT_MAX)
+    {
+        return 0;                      /* error: too long for a span */
+    }
+    view->scheme = view->user = view->password = view->domain = none;
+    view->path = view->query = view->anchor = none;
+    view->port = 0;
+
+    if ((sep = scheme_end(str, end)) != NULL)
+    {
+        if (end - sep >= 3 && sep[1] == '/' && sep[2] == '/')
+        {
+            span(&view->scheme, str, str, sep);
+            ptr = sep + 3;
+        }
+        else if (sep - str == 6 && strncasecmp(str, "mailto", 6) == 0)
+        {                              /* "mailto:" lacks "//" */
+            span(&view->scheme, str, str, sep);
+            ptr = sep + 1;
+        }
+    }
+    for (auth = ptr; ptr < end && *ptr != '/' && *ptr != '?' && *ptr != '#';
+         ++ptr)
+    {
+        ;                              /* find the authority's end */
+    }
+    host_end = ptr;
+    for (at = host_end; at > auth && at[-1] != '@'; --at)
+    {
+        ;                              /* find the (last) "@" */
+    }
+    if (at > auth)
+    {                                  /* user[:password]@ */
+        if ((sep = memchr(auth, ':', (size_t) (at - 1 - auth))) != NULL)
+        {
+            span(&view->user, str, auth, sep);
+            span(&view->password, str, sep + 1, at - 1);
+        }
+        else
+        {
+            span(&view->user, str, auth, at - 1);
+        }
+        auth = at;
+    }
+    if (auth < host_end && *auth == '[')
+    {                                  /* [inet6] */
+        if ((sep = memchr(auth, ']', (size_t) (host_end - auth))) == NULL)
+        {
+            return 0;                  /* error: unterminated "[" */
+        }
+        span(&view->domain, str, auth + 1, sep);
+        sep += 1;
+        if (sep < host_end && *sep != ':')
+        {
+            return 0;                  /* error: junk after "]" */
+        }
+    }
+    else
+    {
+        sep = memchr(auth, ':', (size_t) (host_end - auth));
+        span(&view->domain, str, auth, sep != NULL ? sep : host_end);
+    }
+    if (sep != NULL && sep < host_end)
+    {                                  /* :port */
+        const char *digit = sep + 1;
+
+        if (digit == host_end || host_end - digit > 5)
+        {
+            return 0;                  /* error: bad port */
+        }
+        for (; digit < host_end; ++digit)
+        {
+            if (*digit < '0' || *digit > '9')
+            {
+                return 0;              /* error: bad port */
+            }
+            view->port = view->port * 10 + (*digit - '0');
+        }
+        if (view->port > 65535)
+        {
+            return 0;
+        }
+    }
+    if (ptr < end && *ptr == '/')
+    {
+        for (sep = ++ptr; ptr < end && *ptr != '?' && *ptr != '#'; ++ptr)
+        {
+            ;
+        }
+        span(&view->path, str, sep, ptr);
+    }
+    if (ptr < end && *ptr == '?')
+    {
+        for (sep = ++ptr; ptr < end && *ptr != '#'; ++ptr)
+        {
+            ;
+        }
+        span(&view->query, str, sep, ptr);
+    }
+    if (ptr < end && *ptr == '#')
+    {
+        span(&view->anchor, str, ptr + 1, end);
+    }
+    if (view->port == 0 && view->scheme.offset >= 0)
+    {
+        view->port = url_scheme_port(str + view->scheme.offset,
+                                     (size_t) view->scheme.len);
+    }
+    return 1;
+}
+
 /*
  * sprint_url() --Format a URL into text buffer.
  *
@@ -237,6 +493,114 @@ int snprint_url(char *str, size_t n, URLPtr url)
     return str - start;
 }
 
+#ifdef URL_X86
+/*
+ * safe_run_ssse3() --Find the length of a run of safe characters, 16 at a time.
+ *
+ * Remarks:
+ * Each byte is classified with two pshufb lookups: safe_lo[] (by
+ * its low nibble) has bit h set if the character 0xhl is safe, and
+ * hi_bit[] (by its high nibble) selects bit h (or nothing, for
+ * bytes >= 0x80).  The tail (< 16 bytes) is left to the caller.
+ */
+__attribute__((target("ssse3")))
+static size_t safe_run_ssse3(const unsigned char *text, size_t len)
+{
+    const __m128i safe_lo = _mm_loadu_si128((const __m128i *) safe_lo_tab);
+    const __m128i hi_bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64,
+                                         (char) 128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (text + i));
+        __m128i lo = _mm_shuffle_epi8(safe_lo, _mm_and_si128(v, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_bit,
+                                      _mm_and_si128(_mm_srli_epi16(v, 4),
+                                                    nibble));
+        int unsafe = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+                                                      _mm_setzero_si128()));
+
+        if (unsafe != 0)
+        {
+            return i + (size_t) __builtin_ctz((unsigned int) unsafe);
+        }
+    }
+    return i;
+}
+#endif /* URL_X86 */
+
+#ifdef URL_NEON
+/*
+ * safe_run_neon() --Find the length of a run of safe characters, 16 at a time.
+ *
+ * Remarks:
+ * As safe_run_ssse3(), with tbl lookups (which give 0 for
+ * out-of-range indices, i.e. high nibbles >= 8).
+ */
+static size_t safe_run_neon(const unsigned char *text, size_t len)
+{
+    static const uint8_t hi_bit_tab[16] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t safe_lo = vld1q_u8(safe_lo_tab);
+    const uint8x16_t hi_bit = vld1q_u8(hi_bit_tab);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(text + i);
+        uint8x16_t ok = vtstq_u8(vqtbl1q_u8(safe_lo, vandq_u8(v,
+                                                              vdupq_n_u8
+                                                              (0x0f))),
+                                 vqtbl1q_u8(hi_bit, vshrq_n_u8(v, 4)));
+
+        if (vminvq_u8(ok) == 0)
+        {
+            while (is_safe(text[i]))
+            {
+                ++i;                   /* (find it in the block) */
+            }
+            return i;
+        }
+    }
+    return i;
+}
+#endif /* URL_NEON */
+
+static size_t resolve_safe_run(const unsigned char *text, size_t len);
+
+static SafeRunProc safe_run_simd = resolve_safe_run;
+
+/*
+ * resolve_safe_run() --Select the best safe_run() for this CPU, and call it.
+ */
+static size_t resolve_safe_run(const unsigned char *text, size_t len)
+{
+    SafeRunProc proc = safe_run_none;
+
+#if defined(URL_X86)
+    proc = cpu_has(CPU_SSSE3) ? safe_run_ssse3 : proc;
+#elif defined(URL_NEON)
+    proc = safe_run_neon;
+#endif
+    CPU_RESOLVE(&safe_run_simd, proc);
+    return proc(text, len);
+}
+
+/*
+ * safe_run() --Find the length of a run of characters that needn't be encoded.
+ */
+static size_t safe_run(const unsigned char *text, size_t len)
+{
+    size_t i = len >= 16 ? safe_run_simd(text, len) : 0;
+
+    while (i < len && is_safe(text[i]))
+    {
+        ++i;
+    }
+    return i;
+}
+
 /*
  * url_encode() --Escape a string with the URL encoding scheme.
  *
@@ -251,34 +615,168 @@ int snprint_url(char *str, size_t n, URLPtr url)
  * Remarks:
  * This routine will return the number of characters required to
  * encode, and will encode as much as it can.  It is up to the caller
- * to check that the return value is less than n.
+ * to check that the return value is less than n (if it isn't, buf
+ * holds the encoding of a prefix of text, without a partial escape).
  *
  * Note that not all parts of a URL need to be encoded; it is up to the
  * caller to decide which parts require it (e.g. path, query, anchor)
+ *
+ * Runs of characters that needn't be encoded are found 16 at a time
+ * (with SSSE3/NEON, if available) and copied in bulk.
  */
 size_t url_encode(const char *text, size_t n, char *buf)
 {
-    int n_used = 0;
-    int c;
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *ptr = (const unsigned char *) text;
+    const unsigned char *end = ptr + strlen(text);
+    size_t n_used = 0, n_out = 0;      /* n_out: bytes actually written */
 
-    while ((c = *text++) != '\0')
+    while (ptr < end)
     {
-        int encode = c >= 127 || encode_tab[c];
-        size_t n_needed = 1 + 2 * (size_t) encode;
+        size_t run = safe_run(ptr, (size_t) (end - ptr));
 
-        if (n - (size_t) n_used > n_needed)
+        if (n_out == n_used && n_used < n)
+        {                              /* copy what fits (and a NUL) */
+            n_out += MIN(run, n - n_used - 1);
+            memcpy(buf + n_used, ptr, n_out - n_used);
+        }
+        n_used += run;
+        ptr += run;
+        if (ptr < end)
         {
-            if (encode)
+            if (n_out == n_used && n_used + 3 < n)
             {
-                buf += sprintf(buf, "%%%x", c);
+                buf[n_out++] = '%';
+                buf[n_out++] = hex[*ptr >> 4];
+                buf[n_out++] = hex[*ptr & 0x0f];
+            }
+            n_used += 3;
+            ptr += 1;
+        }
+    }
+    if (n > 0)
+    {
+        buf[n_out] = '\0';
+    }
+    return n_used;
+}
+
+/*
+ * hex_value() --Get the value of a hex digit.
+ *
+ * Returns: (int)
+ * Success: 0..15; Failure: -1 (not a hex digit).
+ */
+static inline int hex_value(int c)
+{
+    return (c >= '0' && c <= '9') ? c - '0'
+        : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+        : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+}
+
+/*
+ * url_decode() --Decode a URL-encoded string.
+ *
+ * Parameters:
+ * text --the encoded text (not necessarily NUL-terminated)
+ * len  --the text's length
+ * buf  --returns the decoded (and NUL-terminated) text
+ * form --if true, "+" decodes to " " (as in query strings)
+ *
+ * Returns: (size_t)
+ * The length of the decoded text.
+ *
+ * Remarks:
+ * The decoded text is never longer than the encoded text, so buf
+ * needs len + 1 bytes; it may be text itself (i.e. decode in place).
+ * A "%" that isn't followed by two hex digits is copied as is.
+ * Runs without escapes are found with memchr() and copied in bulk.
+ */
+size_t url_decode(const char *text, size_t len, char *buf, int form)
+{
+    const char *ptr = text, *end = text + len;
+    char *out = buf;
+
+    while (ptr < end)
+    {
+        const char *esc = memchr(ptr, '%', (size_t) (end - ptr));
+        const char *run_end = esc != NULL ? esc : end;
+        char *out_end = out + (run_end - ptr);
+
+        memmove(out, ptr, (size_t) (run_end - ptr));
+        for (char *plus = out;
+             form && (plus = memchr(plus, '+', (size_t) (out_end - plus)))
+             != NULL; ++plus)
+        {
+            *plus = ' ';
+        }
+        out = out_end;
+        ptr = run_end;
+        if (ptr < end)
+        {
+            int hi = end - ptr > 2 ? hex_value((unsigned char) ptr[1]) : -1;
+            int lo = hi >= 0 ? hex_value((unsigned char) ptr[2]) : -1;
+
+            if (lo >= 0)
+            {
+                *out++ = (char) (hi << 4 | lo);
+                ptr += 3;
             }
             else
             {
-                *buf++ = c;
+                *out++ = *ptr++;       /* (not an escape) */
+            }
+        }
+    }
+    *out = '\0';
+    return (size_t) (out - buf);
+}
+
+/*
+ * url_query_split() --Split a query string into key/value views.
+ *
+ * Parameters:
+ * query    --the query string (not necessarily NUL-terminated)
+ * len      --the query's length
+ * param    --returns the parameters
+ * max_param --the number of parameters param can hold
+ *
+ * Returns: (size_t)
+ * The number of parameters in the query (which may be more than
+ * max_param, in which case only the first max_param are returned).
+ *
+ * Remarks:
+ * Parameters are separated by "&" (empty ones are skipped), and
+ * split at their first "=".  The views point into query, and are
+ * still encoded (see url_decode()); a parameter without "=" has a
+ * NULL value.
+ */
+size_t url_query_split(const char *query, size_t len, URLParamPtr param,
+                       size_t max_param)
+{
+    const char *ptr = query, *end = query + len;
+    size_t n = 0;
+
+    while (ptr < end)
+    {
+        const char *amp = memchr(ptr, '&', (size_t) (end - ptr));
+        const char *param_end = amp != NULL ? amp : end;
+
+        if (param_end > ptr)
+        {
+            if (n < max_param)
+            {
+                const char *eq = memchr(ptr, '=', (size_t) (param_end - ptr));
+                URLParamPtr p = &param[n];
+
+                p->key = ptr;
+                p->key_len = (size_t) ((eq != NULL ? eq : param_end) - ptr);
+                p->value = eq != NULL ? eq + 1 : NULL;
+                p->value_len = eq != NULL ? (size_t) (param_end - eq - 1) : 0;
             }
+            ++n;
         }
-        n_used += n_needed;
+        ptr = param_end + 1;
     }
-    *buf = '\0';
-    return (size_t) n_used;
+    return n;
 }
@@ -29,12 +29,55 @@ extern "C"
 
 #define NULL_URL { .scheme = 0 }
 
+    /*
+     * URLSpan --A part of a URL string, as an offset and length.
+     */
+    typedef struct URLSpan_t
+    {
+        int offset;                    /* (-1: absent) */
+        int len;
+    } URLSpan;
+
+    /*
+     * URLView --The parts of a URL string, as spans into it.
+     *
+     * Remarks:
+     * See url_parse().
+     */
+    typedef struct URLView_t
+    {
+        URLSpan scheme;
+        URLSpan user;
+        URLSpan password;
+        URLSpan domain;
+        int port;
+        URLSpan path;
+        URLSpan query;
+        URLSpan anchor;
+    } URLView, *URLViewPtr;
+
+    /*
+     * URLParam --A query parameter, as (still encoded) views.
+     */
+    typedef struct URLParam_t
+    {
+        const char *key;
+        size_t key_len;
+        const char *value;             /* (NULL: no "=") */
+        size_t value_len;
+    } URLParam, *URLParamPtr;
+
     extern URL null_url;
 
     int getopt_url(char *opt, URLPtr url);
     int snprint_url(char *str, size_t n, URLPtr url);
     size_t url_encode(const char *text, size_t n, char *buf);
+    size_t url_decode(const char *text, size_t len, char *buf, int form);
+    size_t url_query_split(const char *query, size_t len, URLParamPtr param,
+                           size_t max_param);
     int str_url(char *opt, URLPtr url);
+    int url_parse(const char *str, size_t len, URLViewPtr view);
+    int url_scheme_port(const char *scheme, size_t len);
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
@@ -0,0 +1,160 @@
+/*
+ * STATELY-INBOX.C --A lock-free event inbox for a Stately statechart.
+ *
+ * Contents:
+ * stately_inbox_init() --Initialise an (empty) inbox.
+ * push()               --Append a message to the inbox.
+ * pop()                --Remove the first message from the inbox.
+ * stately_post()       --Post an event to a statechart's inbox.
+ * stately_drain()      --Process a statechart's posted events.
+ *
+ * Remarks:
+ * stately_event() must be serialised per statechart; events posted
+ * from other threads go through an inbox instead.  The inbox is an
+ * intrusive multi-producer, single-consumer queue (D. Vyukov's):
+ * posting is an atomic exchange and a store, and never waits.
+ *
+ * The inbox also counts its pending messages: the poster that
+ * finds it empty is told to drain it (or to hand it to some worker
+ * thread that will), and the drain runs until the count falls back
+ * to zero.  So exactly one thread runs the statechart at a time,
+ * each event runs to completion, and no thread waits on a lock.
+ *
+ * A message whose producer has swapped itself in as the tail, but
+ * not yet linked it to its predecessor, is briefly invisible; the
+ * drain spins until the link appears.
+ */
+#include <apex.h>
+#include <sched.h>
+#include <apex/log.h>
+#include <apex/stately.h>
+
+/*
+ * stately_inbox_init() --Initialise an (empty) inbox.
+ *
+ * Parameters:
+ * inbox    --specifies the inbox
+ */
+void stately_inbox_init(StatelyInbox* inbox)
+{
+    inbox->stub.next = NULL;
+    inbox->head      = &inbox->stub;
+    inbox->tail      = &inbox->stub;
+    inbox->pending   = 0;
+}
+
+/*
+ * push() --Append a message to the inbox.
+ */
+static void push(StatelyInbox* inbox, StatelyMessage* msg)
+{
+    StatelyMessage* prev;
+
+    __atomic_store_n(&msg->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&inbox->tail, msg, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, msg, __ATOMIC_RELEASE);
+}
+
+/*
+ * pop() --Remove the first message from the inbox.
+ *
+ * Returns: (StatelyMessage *)
+ * Success: the message; Failure: NULL (empty, or a push in progress).
+ */
+static StatelyMessage* pop(StatelyInbox* inbox)
+{
+    StatelyMessage* head = inbox->head;
+    StatelyMessage* next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+    if (head == &inbox->stub)
+    { /* skip the stub */
+        if (next == NULL)
+        {
+            return NULL;
+        }
+        inbox->head = head = next;
+        next               = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL)
+    {
+        inbox->head = next;
+        return head;
+    }
+    if (head != __atomic_load_n(&inbox->tail, __ATOMIC_ACQUIRE))
+    {
+        return NULL; /* a push is in progress */
+    }
+    push(inbox, &inbox->stub); /* head is the last one: put the stub back */
+    if ((next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE)) != NULL)
+    {
+        inbox->head = next;
+        return head;
+    }
+    return NULL;
+}
+
+/*
+ * stately_post() --Post an event to a statechart's inbox.
+ *
+ * Parameters:
+ * stc  --specifies the statechart
+ * msg  --specifies the event (and its release procedure)
+ *
+ * Returns: (int)
+ * 1: the caller must now drain the inbox (see stately_drain()),
+ * or arrange for it to be drained; 0: another thread is draining
+ * it, and will process this event.
+ *
+ * Remarks:
+ * This may be called from any thread; it never blocks.
+ */
+int stately_post(Stately* stc, StatelyMessage* msg)
+{
+    StatelyInbox* inbox = stc->inbox;
+
+    push(inbox, msg);
+    return __atomic_fetch_add(&inbox->pending, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+/*
+ * stately_drain() --Process a statechart's posted events.
+ *
+ * Parameters:
+ * stc  --specifies the statechart
+ *
+ * Returns: (size_t)
+ * The number of events processed.
+ *
+ * Remarks:
+ * This must only be called by the thread that stately_post() told
+ * to; it returns when there are no more pending events, including
+ * any posted while it ran.
+ */
+size_t stately_drain(Stately* stc)
+{
+    StatelyInbox* inbox = stc->inbox;
+    size_t        n     = 0;
+
+    for (;;)
+    {
+        StatelyMessage* msg = pop(inbox);
+
+        if (msg == NULL)
+        {
+            sched_yield(); /* pending, but not linked in yet */
+            continue;
+        }
+        stately_event(stc, msg->event_id, msg->event_ctx);
+        if (msg->release != NULL)
+        {
+            msg->release(msg);
+        }
+        ++n;
+        if (__atomic_fetch_sub(&inbox->pending, 1, __ATOMIC_ACQ_REL) == 1)
+        {
+            break; /* the last one (for now) */
+        }
+    }
+    debug("%s(): processed %zu events", __func__, n);
+    return n;
+}
@@ -0,0 +1,201 @@
+/*
+ * STATELY-TRACE.C --Optional tracing and per-state timing for statecharts.
+ *
+ * Contents:
+ * stately_trace_new()         --Create a trace, for statecharts with n_states.
+ * stately_trace_free()        --Free a trace's resources.
+ * stately_trace_event_()      --Count an event dispatched in some state.
+ * stately_trace_transition_() --Record a transition, and the time in the old state.
+ * stately_trace_read()        --Copy out the most recent records, oldest first.
+ * stately_trace_print()       --Print a trace's per-state counters.
+ *
+ * Remarks:
+ * This is only compiled if STATELY_TRACE is defined; otherwise
+ * stately.c's trace hooks compile to nothing, and Stately has no
+ * trace fields.
+ *
+ * Each transition (including initialisation, from -1, and any
+ * failure, to -1) is written as a binary record into a ring buffer
+ * shared by all the instances using the trace, and passed to the
+ * hook procedure (if any).  Each state counts its events and the
+ * total time instances spent in it, so slow (or busy) states stand
+ * out.  Slots and counters are claimed with atomic adds, so
+ * instances may run on different threads; a record being
+ * overwritten while it's read may be inconsistent.
+ */
+#include <apex.h>
+#include <apex/clock.h>
+#include <apex/stately.h>
+
+#ifdef STATELY_TRACE
+#include <inttypes.h>
+#include <string.h>
+
+/*
+ * stately_trace_new() --Create a trace, for statecharts with n_states.
+ *
+ * Parameters:
+ * n_states     --specifies the number of states
+ * n_ring       --specifies the number of records to keep
+ *
+ * Returns: (StatelyTrace *)
+ * Success: the trace; Failure: NULL.
+ */
+StatelyTrace* stately_trace_new(int n_states, size_t n_ring)
+{
+    StatelyTrace* trace = NEW(StatelyTrace, 1);
+
+    if (trace == NULL || n_states <= 0 || n_ring == 0)
+    {
+        free(trace);
+        return NULL;
+    }
+    trace->n_states      = n_states;
+    trace->n_ring        = n_ring;
+    trace->ring          = NEW(StatelyTraceRecord, n_ring);
+    trace->n_event       = NEW(uint64_t, n_states);
+    trace->time_in_state = NEW(uint64_t, n_states);
+    if (trace->ring == NULL || trace->n_event == NULL
+        || trace->time_in_state == NULL)
+    {
+        stately_trace_free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+/*
+ * stately_trace_free() --Free a trace's resources.
+ */
+void stately_trace_free(StatelyTrace* trace)
+{
+    if (trace != NULL)
+    {
+        free(trace->ring);
+        free(trace->n_event);
+        free(trace->time_in_state);
+        free(trace);
+    }
+}
+
+/*
+ * stately_trace_event_() --Count an event dispatched in some state.
+ */
+void stately_trace_event_(Stately* stc, int state_id)
+{
+    StatelyTrace* trace = stc->trace;
+
+    if (trace != NULL && state_id >= 0 && state_id < trace->n_states)
+    {
+        __atomic_fetch_add(&trace->n_event[state_id], 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * stately_trace_transition_() --Record a transition, and the time in the old state.
+ *
+ * Parameters:
+ * stc  --specifies the statechart (now in its new state)
+ * from         --specifies the old state (-1: none)
+ * event_id     --specifies the event (-1: none)
+ */
+void stately_trace_transition_(Stately* stc, int from, int event_id)
+{
+    StatelyTrace*       trace = stc->trace;
+    StatelyTraceRecord* record;
+    uint64_t            now, i;
+
+    if (trace == NULL)
+    {
+        return;
+    }
+    now = (uint64_t)ns_monotonic();
+    if (from >= 0 && from < trace->n_states)
+    {
+        __atomic_fetch_add(
+            &trace->time_in_state[from], now - stc->entered, __ATOMIC_RELAXED);
+    }
+    stc->entered = now;
+
+    i                = __atomic_fetch_add(&trace->n_record, 1, __ATOMIC_RELAXED);
+    record           = &trace->ring[i % trace->n_ring];
+    record->stc      = stc;
+    record->from     = from;
+    record->to       = stc->state_id;
+    record->event_id = event_id;
+    record->when     = now;
+    if (trace->proc != NULL)
+    {
+        trace->proc(record, trace->data);
+    }
+}
+
+/*
+ * stately_trace_read() --Copy out the most recent records, oldest first.
+ *
+ * Parameters:
+ * trace        --specifies the trace
+ * record       --returns the records
+ * n_record     --specifies the number of records wanted
+ *
+ * Returns: (size_t)
+ * The number of records copied.
+ */
+size_t stately_trace_read(const StatelyTrace* trace,
+                          StatelyTraceRecord* record,
+                          size_t              n_record)
+{
+    uint64_t end   = __atomic_load_n(&trace->n_record, __ATOMIC_ACQUIRE);
+    uint64_t n     = end < trace->n_ring ? end : trace->n_ring;
+    uint64_t start = end - (n < n_record ? n : n_record);
+
+    for (uint64_t i = start; i < end; ++i)
+    {
+        record[i - start] = trace->ring[i % trace->n_ring];
+    }
+    return (size_t)(end - start);
+}
+
+/*
+ * stately_trace_print() --Print a trace's per-state counters.
+ *
+ * Parameters:
+ * fp   --the file to print to
+ * trace        --specifies the trace
+ *
+ * Returns: (int)
+ * The number of characters printed, as for fprintf().
+ *
+ * Remarks:
+ * Each state that has seen any activity is printed on its own line,
+ * in "key=value" form.
+ */
+int stately_trace_print(FILE* fp, const StatelyTrace* trace)
+{
+    int n = 0;
+
+    for (int i = 0; i < trace->n_states; ++i)
+    {
+        uint64_t n_event = __atomic_load_n(&trace->n_event[i], __ATOMIC_RELAXED);
+        uint64_t time_ns =
+            __atomic_load_n(&trace->time_in_state[i], __ATOMIC_RELAXED);
+
+        if (n_event != 0 || time_ns != 0)
+        {
+            int status = fprintf(fp,
+                                 "state=%d events=%" PRIu64 " time_ns=%" PRIu64
+                                 "\n",
+                                 i,
+                                 n_event,
+                                 time_ns);
+
+            if (status < 0)
+            {
+                return status;
+            }
+            n += status;
+        }
+    }
+    return n;
+}
+#endif /* STATELY_TRACE */
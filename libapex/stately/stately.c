@@ -2,13 +2,21 @@
  * STATELY.C --A simple restricted Harel statechart.
  *
  * Contents:
- * stately_init()     --Initialise a Stately statechart.
- * stately_reset()    --Reset a Stately statechart.
- * stately_event()    --Process an event.
- * stately_enter()    --Enter a new state, follow its init_state.
- * stately_exit()     --Exit substates of a target state.
- * stately_ancestor() --Return the shared ancestor of two states.
- * stately_action()   --Find the action for this event.
+ * stately_init()          --Initialise a Stately statechart.
+ * stately_reset()         --Reset a Stately statechart.
+ * stately_event()         --Process an event.
+ * compare_key()           --Order batched events by state (then arrival).
+ * stately_event_batch()   --Process a batch of events, grouped by state.
+ * stately_compile()       --Flatten a statechart into dispatch tables.
+ * stately_free_table()    --Free a statechart's dispatch tables.
+ * stately_transition()    --Make a (planned) transition.
+ * stately_plan()          --Plan the transition between two states.
+ * stately_enter()         --Enter a new state, follow its init_state.
+ * stately_enter_parents() --Enter a state's ancestors, below some ancestor.
+ * stately_exit()          --Exit substates of a target state.
+ * stately_depth()         --Return the depth of a state in the hierarchy.
+ * stately_lca()           --Return the least common ancestor of two states.
+ * stately_action()        --Find the action for an event in some state.
  *
  * Remarks:
  * This module implements a really simple statechart, i.e. an hierarchic
@@ -19,7 +27,6 @@
  *
  * It does not implement:
  * * transition actions
- * * direct transition to substates (but maybe one day)
  * * history
  * * deferred actions
  * * regions.
@@ -27,11 +34,28 @@
  * Also it does not implement timeouts or event queues; if you want those
  * things, they are easy to incorporate from pre-existing frameworks,
  * please use them.
+ *
+ * By default, each event walks up the parent chain to find its
+ * action, and each transition walks it again to find the common
+ * ancestor.  stately_compile() does both walks once, for every
+ * [state][event] and [from][to] pair, so that a Stately with a
+ * table dispatches an event with an indexed load, and plans its
+ * transition with another.
  */
 #include <apex.h>
 #include <apex/log.h>
+#include <apex/profile.h>
 #include <apex/stately.h>
 
+#ifdef STATELY_TRACE /* (see stately-trace.c) */
+#define TRACE_EVENT(stc_, state_id_) stately_trace_event_(stc_, state_id_)
+#define TRACE_TRANSITION(stc_, from_, event_id_) \
+    stately_trace_transition_(stc_, from_, event_id_)
+#else /* (no code, but no unused variables either) */
+#define TRACE_EVENT(stc_, state_id_) ((void)(state_id_))
+#define TRACE_TRANSITION(stc_, from_, event_id_) ((void)(from_))
+#endif /* STATELY_TRACE */
+
 static int  stately_enter(Stately* stc,
                           int      state_id,
                           int      event_id,
@@ -41,8 +65,23 @@ static void stately_exit(Stately* stc,
                          int      event_id,
                          void*    event_ctx);
 
-static StatelyActionProc stately_action(Stately* stc, int event_id);
-static int stately_ancestor(Stately* stc, int target_id, int state_id);
+static int stately_transition(Stately*    stc,
+                              StatelyPlan plan,
+                              int         event_id,
+                              void*       event_ctx);
+static StatelyPlan stately_plan(const StatelyState* state,
+                                int                 state_id,
+                                int                 new_state_id);
+static StatelyActionProc stately_action(const StatelyState* state,
+                                        int                 state_id,
+                                        int                 event_id);
+static void stately_enter_parents(Stately* stc,
+                                  int      ancestor_id,
+                                  int      state_id,
+                                  int      event_id,
+                                  void*    event_ctx);
+static int  stately_depth(const StatelyState* state, int state_id);
+static int  stately_lca(const StatelyState* state, int state_id, int other_id);
 
 /*
  * stately_init() --Initialise a Stately statechart.
@@ -57,6 +96,7 @@ Stately* stately_init(Stately* stc, void* context)
 {
     stc->context  = context;
     stc->state_id = stately_enter(stc, 0, -1, NULL);
+    TRACE_TRANSITION(stc, -1, -1);
     return stc;
 }
 
@@ -71,8 +111,11 @@ Stately* stately_init(Stately* stc, void* context)
  */
 void stately_reset(Stately* stc)
 {
+    int state_id = stc->state_id;
+
     stately_exit(stc, 0, -1, NULL);
     stc->state_id = stately_enter(stc, 0, -1, NULL);
+    TRACE_TRANSITION(stc, state_id, -1);
 }
 
 /*
@@ -90,26 +133,35 @@ void stately_reset(Stately* stc)
  * This routine applies an action associated with the event in
  * the current state of the statechart.  It is the action's
  * responsibility to specify the next state, and the transition
- * is done here.
+ * is done here (see stately_plan()).
  *
- * If a transition is made, the stc leaves all the substates of
- * the current state to a common ancestor of the new state.
- * Effectively this means that a transition can traverse outwards
- * from substates to some eventual sibling with a common ancestor.
- *
- * REVISIT: implement direct transitions to substates, LCA.
+ * If the statechart has a table (see stately_compile()), the
+ * action and transition are looked up in it.
  */
 int stately_event(Stately* stc, int event_id, void* event_ctx)
 {
-    int state_id     = stc->state_id;
-    int new_state_id = state_id;
+    const StatelyTable* table        = stc->table;
+    int                 state_id     = stc->state_id;
+    int                 new_state_id = state_id;
+    StatelyActionProc   action;
 
+    PROFILE_FUNCTION();
     debug("%s(): state_id=%d, event_id=%d", __func__, state_id, event_id);
     if (state_id < 0)
     {
         return 0; /* failure: invalid state */
     }
-    StatelyActionProc action = stately_action(stc, event_id);
+    TRACE_EVENT(stc, state_id);
+    if (table != NULL)
+    {
+        action = (event_id >= 0 && event_id < table->n_events)
+                     ? table->action[state_id * table->n_events + event_id]
+                     : NULL;
+    }
+    else
+    {
+        action = stately_action(stc->state, state_id, event_id);
+    }
 
     if (action)
     {
@@ -118,56 +170,234 @@ int stately_event(Stately* stc, int event_id, void* event_ctx)
     }
     if (new_state_id != state_id)
     { /* transition */
-        StatelyState const* state       = &stc->state[state_id];
-        StatelyState const* new_state   = &stc->state[new_state_id];
-        int                 ancestor_id = 0;
-
-        debug(
-            "%s(): current(state=%d, parent=%d), new(state=%d, parent=%d), "
-            "ancestor_id=%d",
-            __func__,
-            state_id,
-            state->parent_id,
-            new_state_id,
-            new_state->parent_id,
-            ancestor_id);
-
-        if (new_state->parent_id == state_id)
+        StatelyPlan plan = {.exit_to = -1, .enter_id = -1};
+        int         status;
+
+        if (table == NULL)
         {
-            debug("%s(): enter child state %d", __func__, new_state_id);
-            stc->state_id =
-                stately_enter(stc, new_state_id, event_id, event_ctx);
-            return 1; /* success: new state is a direct substate */
+            plan = stately_plan(stc->state, state_id, new_state_id);
         }
+        else if (new_state_id >= 0 && new_state_id < table->n_states)
+        {
+            plan = table->plan[state_id * table->n_states + new_state_id];
+        }
+        status = stately_transition(stc, plan, event_id, event_ctx);
+        TRACE_TRANSITION(stc, state_id, event_id);
+        return status;
+    }
+    return 1; /* success: event was actioned */
+}
+
+typedef struct BatchKey
+{
+    int    state_id;                    /* the instance's state, at the start */
+    size_t index;                       /* the event's position in the batch */
+} BatchKey;
+
+/*
+ * compare_key() --Order batched events by state (then arrival).
+ */
+static int compare_key(const void* a, const void* b)
+{
+    const BatchKey* key_a = a;
+    const BatchKey* key_b = b;
+
+    if (key_a->state_id != key_b->state_id)
+    {
+        return key_a->state_id < key_b->state_id ? -1 : 1;
+    }
+    return key_a->index < key_b->index ? -1 : key_a->index > key_b->index;
+}
+
+/*
+ * stately_event_batch() --Process a batch of events, grouped by state.
+ *
+ * Parameters:
+ * event        --specifies the events (and their instances)
+ * n_events     --specifies the number of events
+ *
+ * Returns: (size_t)
+ * The number of events processed successfully.
+ *
+ * Remarks:
+ * The events are dispatched grouped by their instance's state (as
+ * at the start of the batch), so that consecutive dispatches use
+ * the same actions and table rows.  The events for any one
+ * instance have the same key, so they're still processed in
+ * order; only the order between instances changes.
+ *
+ * The instances are independent, so a caller with several threads
+ * can partition its instances between them (e.g. by instance id),
+ * and call this with each partition's events.
+ */
+size_t stately_event_batch(const StatelyEvent* event, size_t n_events)
+{
+    BatchKey* key = n_events > 1 ? NEW(BatchKey, n_events) : NULL;
+    size_t    n_ok = 0;
 
-        ancestor_id = stately_ancestor(stc, new_state_id, state_id);
-        if (ancestor_id == new_state_id)
+    if (key == NULL)
+    { /* (one event, or no memory): just process them in order */
+        for (size_t i = 0; i < n_events; ++i)
         {
-            debug("%s(): exit to state %d", __func__, ancestor_id);
-            stately_exit(stc, ancestor_id, event_id, event_ctx);
-            stc->state_id = ancestor_id;
-            return 1; /* success: old state is a substate */
+            n_ok += stately_event(
+                        event[i].stc, event[i].event_id, event[i].event_ctx)
+                    != 0;
         }
+        return n_ok;
+    }
+    for (size_t i = 0; i < n_events; ++i)
+    {
+        key[i].state_id = event[i].stc->state_id;
+        key[i].index    = i;
+    }
+    qsort(key, n_events, sizeof(*key), compare_key);
+    for (size_t i = 0; i < n_events; ++i)
+    {
+        const StatelyEvent* e = &event[key[i].index];
 
-        ancestor_id = stately_ancestor(stc, new_state->parent_id, state_id);
-        if (ancestor_id >= 0)
+        n_ok += stately_event(e->stc, e->event_id, e->event_ctx) != 0;
+    }
+    free(key);
+    return n_ok;
+}
+
+/*
+ * stately_compile() --Flatten a statechart into dispatch tables.
+ *
+ * Parameters:
+ * state        --specifies the state definitions
+ * n_states     --specifies the number of states
+ * n_events     --specifies the number of events
+ *
+ * Returns: (StatelyTable *)
+ * Success: the dispatch tables; Failure: NULL.
+ *
+ * Remarks:
+ * The caller attaches the tables to (any number of) Stately
+ * instances that use these state definitions, and frees them with
+ * stately_free_table() when they're all done.
+ */
+StatelyTable* stately_compile(const StatelyState* state,
+                              int                 n_states,
+                              int                 n_events)
+{
+    StatelyTable* table = NEW(StatelyTable, 1);
+
+    if (table == NULL || n_states <= 0 || n_events <= 0)
+    {
+        free(table);
+        return NULL; /* failure: allocation, or bad sizes */
+    }
+    table->n_states = n_states;
+    table->n_events = n_events;
+    table->action = NEW(StatelyActionProc, (size_t)n_states * n_events);
+    table->plan   = NEW(StatelyPlan, (size_t)n_states * n_states);
+    if (table->action == NULL || table->plan == NULL)
+    {
+        stately_free_table(table);
+        return NULL;
+    }
+    for (int from = 0; from < n_states; ++from)
+    {
+        for (int event_id = 0; event_id < n_events; ++event_id)
         {
-            debug("%s(): exit to state %d, enter state %d",
-                  __func__,
-                  ancestor_id,
-                  new_state_id);
-            stately_exit(stc, ancestor_id, event_id, event_ctx);
-            stc->state_id =
-                stately_enter(stc, new_state_id, event_id, event_ctx);
-            return 1; /* success: states with common parents */
+            table->action[from * n_events + event_id] =
+                stately_action(state, from, event_id);
         }
-        else
+        for (int to = 0; to < n_states; ++to)
         {
-            stc->state_id = -1; /* invalid state */
-            return 0;           /* failure: no common ancestor!? */
+            table->plan[from * n_states + to] = stately_plan(state, from, to);
         }
     }
-    return 1; /* success: event was actioned */
+    return table;
+}
+
+/*
+ * stately_free_table() --Free a statechart's dispatch tables.
+ */
+void stately_free_table(StatelyTable* table)
+{
+    if (table != NULL)
+    {
+        free(table->action);
+        free(table->plan);
+        free(table);
+    }
+}
+
+/*
+ * stately_transition() --Make a (planned) transition.
+ *
+ * Parameters:
+ * stc  --specifies the statechart
+ * plan         --specifies the transition
+ * event_id     --specifies the event
+ * event_ctx    --specifies additional event context/values
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int stately_transition(Stately*    stc,
+                              StatelyPlan plan,
+                              int         event_id,
+                              void*       event_ctx)
+{
+    debug("%s(): state_id=%d, exit_to=%d, enter_id=%d",
+          __func__,
+          stc->state_id,
+          plan.exit_to,
+          plan.enter_id);
+    if (plan.exit_to < 0)
+    {
+        stc->state_id = -1; /* invalid state */
+        return 0;           /* failure: no common ancestor!? */
+    }
+    stately_exit(stc, plan.exit_to, event_id, event_ctx);
+    if (plan.enter_id < 0)
+    {
+        stc->state_id = plan.exit_to; /* (old state was a substate) */
+        return 1;
+    }
+    stately_enter_parents(
+        stc, plan.exit_to, plan.enter_id, event_id, event_ctx);
+    stc->state_id = stately_enter(stc, plan.enter_id, event_id, event_ctx);
+    return 1;
+}
+
+/*
+ * stately_plan() --Plan the transition between two states.
+ *
+ * Parameters:
+ * state        --specifies the state definitions
+ * state_id     --specifies the current state
+ * new_state_id --specifies the next state
+ *
+ * Returns: (StatelyPlan)
+ * The transition plan; exit_to is -1 if there isn't one.
+ *
+ * Remarks:
+ * A transition exits the current state and its ancestors up to
+ * (but not including) the least common ancestor (LCA) of the two
+ * states, and then enters the new state's ancestors below the LCA,
+ * and the new state itself.  So a transition can go outwards to an
+ * ancestor, inwards to any substate, or across to any other state.
+ */
+static StatelyPlan stately_plan(const StatelyState* state,
+                                int                 state_id,
+                                int                 new_state_id)
+{
+    StatelyPlan plan = {.exit_to = -1, .enter_id = -1};
+
+    if (new_state_id < 0)
+    {
+        return plan; /* failure: invalid state */
+    }
+    plan.exit_to = stately_lca(state, state_id, new_state_id);
+    if (plan.exit_to != new_state_id)
+    {
+        plan.enter_id = new_state_id; /* (else: old state is a substate) */
+    }
+    return plan;
 }
 
 /*
@@ -210,6 +440,41 @@ static int stately_enter(Stately* stc,
     return state_id;
 }
 
+/*
+ * stately_enter_parents() --Enter a state's ancestors, below some ancestor.
+ *
+ * Parameters:
+ * stc  --specifies the state machine
+ * ancestor_id  --specifies the (already entered) ancestor
+ * state_id     --specifies the state being entered
+ * event_id     --specifies the event
+ * event_ctx    --specifies additional event context/values
+ *
+ * Remarks:
+ * The ancestors are entered outermost first; their init_states
+ * are ignored, since the transition is to state_id.
+ */
+static void stately_enter_parents(Stately* stc,
+                                  int      ancestor_id,
+                                  int      state_id,
+                                  int      event_id,
+                                  void*    event_ctx)
+{
+    int           parent_id = stc->state[state_id].parent_id;
+    StatelyState* parent    = &stc->state[parent_id];
+
+    if (state_id == 0 || parent_id == ancestor_id)
+    {
+        return;
+    }
+    stately_enter_parents(stc, ancestor_id, parent_id, event_id, event_ctx);
+    if (parent->enter)
+    {
+        debug("%s(): enter=0x%p", __func__, (void*)parent->enter);
+        parent->enter(parent_id, event_id, event_ctx, stc->context);
+    }
+}
+
 /*
  * stately_exit() --Exit substates of a target state.
  *
@@ -242,60 +507,86 @@ static void stately_exit(Stately* stc,
 }
 
 /*
- * stately_ancestor() --Return the shared ancestor of two states.
+ * stately_depth() --Return the depth of a state in the hierarchy.
  *
  * Parameters:
- * stc  --specifies the state machine
- * target_id --specifies the expected ancestor state
- * state_id	--specifies the child substate
+ * state     --specifies the state definitions
+ * state_id  --specifies the state
  *
  * Returns: (int)
- * Success: the ancestor state; Failure: -1.
+ * The number of ancestors of the state (state 0 has none).
+ */
+static int stately_depth(const StatelyState* state, int state_id)
+{
+    int depth = 0;
+
+    for (; state_id != 0; state_id = state[state_id].parent_id)
+    {
+        ++depth;
+    }
+    return depth;
+}
+
+/*
+ * stately_lca() --Return the least common ancestor of two states.
  *
- * Remarks:
- * This just confirms (or confutes) that the posited ancestor
- * is truly an ancestor of the specified state.
+ * Parameters:
+ * state     --specifies the state definitions
+ * state_id  --specifies one state
+ * other_id  --specifies the other state
  *
- * REVISIT: Least Common Ancestor (LCA) for direct substate transitions.
+ * Returns: (int)
+ * The LCA; note that a state is its own ancestor, and state 0 is
+ * an ancestor of every state.
  */
-static int stately_ancestor(Stately* stc, int target_id, int state_id)
+static int stately_lca(const StatelyState* state, int state_id, int other_id)
 {
-    while (state_id != target_id)
+    int depth       = stately_depth(state, state_id);
+    int other_depth = stately_depth(state, other_id);
+
+    for (; depth > other_depth; --depth)
     {
-        if (state_id == 0)
-        {
-            return -1; /* failure: state 0 has no parents */
-        }
-        state_id = stc->state[state_id].parent_id;
+        state_id = state[state_id].parent_id;
+    }
+    for (; other_depth > depth; --other_depth)
+    {
+        other_id = state[other_id].parent_id;
+    }
+    while (state_id != other_id)
+    {
+        state_id = state[state_id].parent_id;
+        other_id = state[other_id].parent_id;
     }
-    return state_id; /* success: return common ancestor */
+    return state_id;
 }
 
 /*
- * stately_action() --Find the action for this event.
+ * stately_action() --Find the action for an event in some state.
  *
  * Parameters:
- * stc  --specifies the statechart
+ * state        --specifies the state definitions
+ * state_id     --specifies the state
  * event_id     --specifies the event
  *
  * Returns: (StatelyActionProc)
  * Success: a pointer to the action function; Failure: NULL.
  */
-static StatelyActionProc stately_action(Stately* stc, int event_id)
+static StatelyActionProc stately_action(const StatelyState* state,
+                                        int                 state_id,
+                                        int                 event_id)
 {
-    StatelyState* state; /* initialised in loop */
+    const StatelyState* s; /* initialised in loop */
 
     if (event_id < 0)
     {
         return NULL; /* failure: no such event */
     }
-    for (state = &stc->state[stc->state_id]; state != &stc->state[0];
-         state = &stc->state[state->parent_id])
+    for (s = &state[state_id]; s != &state[0]; s = &state[s->parent_id])
     {
-        if (state->action != NULL && state->action[event_id] != NULL)
+        if (s->action != NULL && s->action[event_id] != NULL)
         {
             break;
         }
     }
-    return state->action[event_id]; /* success: possibly NULL */
+    return s->action != NULL ? s->action[event_id] : NULL; /* possibly NULL */
 }
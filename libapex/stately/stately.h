@@ -4,11 +4,28 @@
  * Contents:
  * StatelyActionProc() --The stately action procedure.
  * StatelyState{}      --The stately machine state.
+ * StatelyPlan{}       --A precomputed transition between two states.
+ * StatelyTable{}      --The flattened dispatch tables of a statechart.
+ * StatelyMessage{}    --An event posted to a Stately's inbox.
+ * StatelyInbox{}      --A multi-producer, single-consumer event queue.
+ * StatelyTraceRecord{} --A traced transition.
+ * StatelyTrace{}      --Transition records, and per-state counters.
  * Stately{}           --The stately state machine object.
+ * StatelyEvent{}      --An event for some Stately instance.
+ *
+ * Remarks:
+ * Tracing is only compiled in if STATELY_TRACE is defined (for
+ * both the library and its callers).
  */
 #ifndef STATELY_H
 #define STATELY_H
 
+#include <stddef.h>
+#ifdef STATELY_TRACE
+#include <stdint.h>
+#include <stdio.h>
+#endif /* STATELY_TRACE */
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -36,6 +53,104 @@ typedef struct StatelyState
     StatelyActionProc enter, exit, *action;
 } StatelyState;
 
+/*
+ * StatelyPlan{} --A precomputed transition between two states.
+ *
+ * Remarks:
+ * A transition exits the current state (and its ancestors) up to,
+ * but not including, exit_to, and then (maybe) enters enter_id.
+ */
+typedef struct StatelyPlan
+{
+    int exit_to;                        /* common ancestor (-1: invalid) */
+    int enter_id;                       /* state to enter (-1: none) */
+} StatelyPlan;
+
+/*
+ * StatelyTable{} --The flattened dispatch tables of a statechart.
+ *
+ * Remarks:
+ * Built by stately_compile(): the inherited action for each
+ * [state][event], and the transition plan for each [from][to]
+ * pair, so that dispatch doesn't walk the parent chain.  A table
+ * is read-only, and may be shared by any number of Stately
+ * instances of the same statechart.
+ */
+typedef struct StatelyTable
+{
+    int                n_states;
+    int                n_events;
+    StatelyActionProc* action;          /* [state][event] */
+    StatelyPlan*       plan;            /* [from][to] */
+} StatelyTable;
+
+/*
+ * StatelyMessage{} --An event posted to a Stately's inbox.
+ *
+ * Remarks:
+ * Messages are owned by the poster: a message mustn't be re-used
+ * until it's been processed, when its release procedure (if any) is
+ * called.
+ */
+typedef struct StatelyMessage
+{
+    struct StatelyMessage* next;        /* (internal) */
+    int                    event_id;
+    void*                  event_ctx;
+    void (*release)(struct StatelyMessage* msg);
+} StatelyMessage;
+
+/*
+ * StatelyInbox{} --A multi-producer, single-consumer event queue.
+ *
+ * Remarks:
+ * See stately_post().  Initialise with stately_inbox_init().
+ */
+typedef struct StatelyInbox
+{
+    StatelyMessage* tail;               /* last posted (producers) */
+    StatelyMessage* head;               /* next to process (consumer) */
+    StatelyMessage  stub;               /* (the empty queue's node) */
+    long            pending;            /* posted, and not yet processed */
+} StatelyInbox;
+
+#ifdef STATELY_TRACE
+struct Stately;
+
+/*
+ * StatelyTraceRecord{} --A traced transition.
+ */
+typedef struct StatelyTraceRecord
+{
+    const struct Stately* stc;          /* the instance */
+    int                   from, to;     /* states (to: -1 if it failed) */
+    int                   event_id;
+    uint64_t              when;         /* monotonic time, ns */
+} StatelyTraceRecord;
+
+typedef void (*StatelyTraceProc)(const StatelyTraceRecord* record, void* data);
+
+/*
+ * StatelyTrace{} --Transition records, and per-state counters.
+ *
+ * Remarks:
+ * Created by stately_trace_new(), and shared by any number of
+ * instances (which may run on different threads).  The ring holds
+ * the last n_ring transitions; record i is at ring[i % n_ring].
+ */
+typedef struct StatelyTrace
+{
+    int                 n_states;
+    size_t              n_ring;
+    StatelyTraceRecord* ring;
+    uint64_t            n_record;       /* records written (ever) */
+    uint64_t*           n_event;        /* [state]: events dispatched */
+    uint64_t*           time_in_state;  /* [state]: ns, up to the last exit */
+    StatelyTraceProc    proc;           /* hook: called per record (optional) */
+    void*               data;           /* proc's data */
+} StatelyTrace;
+#endif /* STATELY_TRACE */
+
 /*
  * Stately{} --The stately state machine object.
  *
@@ -44,14 +159,51 @@ typedef struct StatelyState
  */
 typedef struct Stately
 {
-    int           state_id;             /* current state */
-    void*         context;              /* extended/external state */
-    StatelyState* state;                /* state definitions */
+    int                 state_id;       /* current state */
+    void*               context;        /* extended/external state */
+    StatelyState*       state;          /* state definitions */
+    const StatelyTable* table;          /* compiled state definitions (optional) */
+    StatelyInbox*       inbox;          /* cross-thread events (optional) */
+#ifdef STATELY_TRACE
+    StatelyTrace* trace;                /* (optional) */
+    uint64_t      entered;              /* time the state was entered */
+#endif /* STATELY_TRACE */
 } Stately;
 
-Stately* stately_init(Stately* stc, void* context);
-int      stately_event(Stately* stc, int event_id, void* event_ctx);
-void     stately_reset(Stately* stc);
+/*
+ * StatelyEvent{} --An event for some Stately instance.
+ *
+ * Remarks:
+ * See stately_event_batch().
+ */
+typedef struct StatelyEvent
+{
+    Stately* stc;                       /* the instance */
+    int      event_id;
+    void*    event_ctx;
+} StatelyEvent;
+
+Stately*      stately_init(Stately* stc, void* context);
+int           stately_event(Stately* stc, int event_id, void* event_ctx);
+size_t        stately_event_batch(const StatelyEvent* event, size_t n_events);
+void          stately_reset(Stately* stc);
+StatelyTable* stately_compile(const StatelyState* state,
+                              int                 n_states,
+                              int                 n_events);
+void          stately_free_table(StatelyTable* table);
+void          stately_inbox_init(StatelyInbox* inbox);
+int           stately_post(Stately* stc, StatelyMessage* msg);
+size_t        stately_drain(Stately* stc);
+#ifdef STATELY_TRACE
+StatelyTrace* stately_trace_new(int n_states, size_t n_ring);
+void          stately_trace_free(StatelyTrace* trace);
+size_t        stately_trace_read(const StatelyTrace* trace,
+                                 StatelyTraceRecord* record,
+                                 size_t              n_record);
+int           stately_trace_print(FILE* fp, const StatelyTrace* trace);
+void          stately_trace_event_(Stately* stc, int state_id);
+void          stately_trace_transition_(Stately* stc, int from, int event_id);
+#endif /* STATELY_TRACE */
 #ifdef __cplusplus
 }
 #endif /* C++ */
@@ -10,6 +10,7 @@
 #include <stdbool.h>
 
 #include <apex.h>
+#include <apex/arena.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -42,12 +43,15 @@ extern "C"
     size_t strsplit(char *str, int delimter);
     char **new_str_list(const char *str, int delimiter);
     void free_str_list(char **list);
+    char **arena_str_list(ArenaPtr arena, const char *str, int delimiter);
     int vstrmatch(const char *target, const char *candidate, ...);
     int vstrcasematch(const char *target, const char *candidate, ...);
 #ifdef NO_ASPRINTF
     int asprintf(char **str, const char *fmt, ...) PRINTF_ATTRIBUTE(2, 3);
     int vasprintf(char **str, const char *fmt, va_list args);
 #endif                                 /* NO_ASPRINTF */
+    char *str_sub_(char *str, int match, int replace, size_t *n_sub);
+    char *str_tr_(char *str, const char *match, const char *replace);
     void memswap(void *m1, void *m2, size_t n);
     void memswap_int(int *i1, int *i2, size_t n);
 #ifdef __cplusplus
@@ -6,13 +6,17 @@
  * memswap_int() --swap integer-aligned memory.
  *
  * Remarks:
- * This implements a basic fallback for memswap().
- * Hopefully your stdlib implements something better.
+ * memswap() swaps 32 bytes at a time, then 8, then single bytes for
+ * the tail.  The words are loaded and stored with memcpy() into
+ * local variables, which compiles to plain (unaligned) register loads
+ * and stores, with no alignment restrictions on the caller; the
+ * compiler typically uses vector registers for the 32-byte blocks.
  */
 #include <apex.h>                       /* Windows_NT requires this before system headers */
+#include <stdint.h>
+#include <string.h>
 
 #include <apex/estring.h>
-#define INT_SWAP_THRESHOLD 4*sizeof(int)
 
 /*
  * memswap() --swap memory.
@@ -22,28 +26,37 @@
  * n    --the number of bytes to swap
  *
  * Remarks:
- * This routine checks to see if it can use memswap_int().
+ * The memory cells must not overlap (unless they're identical).
  */
 void memswap(void *m1, void *m2, size_t n)
 {
     char *c1 = m1, *c2 = m2;
 
-    if (n > INT_SWAP_THRESHOLD         /* big enough to bother */
-        && n % sizeof(int) == 0        /* size is alignment compatible */
-        && (unsigned long int) c1 % sizeof(int) == 0    /* addresses are aligned */
-        && (unsigned long int) c2 % sizeof(int) == 0)
+    for (; n >= 32; n -= 32, c1 += 32, c2 += 32)
     {
-        memswap_int(m1, m2, n / sizeof(int));
-        return;
+        uint64_t a[4], b[4];
+
+        memcpy(a, c1, sizeof(a));
+        memcpy(b, c2, sizeof(b));
+        memcpy(c1, b, sizeof(b));
+        memcpy(c2, a, sizeof(a));
     }
+    for (; n >= 8; n -= 8, c1 += 8, c2 += 8)
+    {
+        uint64_t a, b;
 
-    do
+        memcpy(&a, c1, sizeof(a));
+        memcpy(&b, c2, sizeof(b));
+        memcpy(c1, &b, sizeof(b));
+        memcpy(c2, &a, sizeof(a));
+    }
+    for (; n > 0; --n)
     {
         char ch = *c1;
 
         *c1++ = *c2;
         *c2++ = ch;
-    } while (--n > 0);
+    }
 }
 
 /*
@@ -54,15 +67,10 @@ void memswap(void *m1, void *m2, size_t n)
  * n    --the number of integer-sized chunks to swap
  *
  * Remarks:
- * This is a slightly faster version of memswap that is suitable
- * for integer-aligned+sized data, a common occurance in practice.
+ * This is retained for compatibility; memswap() is now at least as
+ * fast for integer-aligned+sized data.
  */
 void memswap_int(int *i1, int *i2, size_t n)
 {
-    do
-    {
-        int tmp = *i1;
-        *i1++ = *i2;
-        *i2++ = tmp;
-    } while (--n > 0);
+    memswap(i1, i2, n * sizeof(int));
 }
@@ -0,0 +1,399 @@
+/*
+ * SIMD-STRING.C --Vectorised character substitution and translation.
+ *
+ * Contents:
+ * str_sub_() --Substitute all occurrences of a character, in-place.
+ * str_tr_()  --Translate a string's characters, in-place.
+ *
+ * Remarks:
+ * These are the inner loops of estrsub(), estrtr() and strsplit().
+ * The vector versions compare 16 (SSE2) or 32 (AVX2) bytes at a
+ * time against the match character(s) and the terminating NUL, and
+ * use the movemask of the compares to skip blocks with nothing to do.
+ * Only aligned blocks are loaded, so a load never crosses a page
+ * beyond the string; the unaligned head, and the block containing the
+ * NUL, are done by the scalar loop.  The last block loaded does read
+ * past the NUL (and so past the end of the string's allocation), which
+ * is harmless, but the sanitizers can't know that, so the vector
+ * loops are marked NO_SANITIZE.
+ *
+ * Translation blends each of (up to) TR_VECTOR_MAX match characters
+ * into a block; larger sets just use the table.
+ *
+ * On x86, the AVX2 or SSE2 version is selected on the first call, with
+ * cpu_has(); otherwise it's the scalar loop.
+ */
+#include <stdint.h>
+#include <apex/cpu.h>
+#include <apex/estring.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STRING_X86
+#include <immintrin.h>
+#endif
+
+#define TR_VECTOR_MAX 16               /* max. match chars to blend */
+
+typedef struct TrTable
+{
+    unsigned char map[256];            /* the full translation */
+    size_t n;                          /* No. of chars that change */
+    unsigned char match[TR_VECTOR_MAX];
+    unsigned char replace[TR_VECTOR_MAX];
+} TrTable;
+
+typedef char *(*SubProc)(char *str, int match, int replace, size_t *n_sub);
+typedef char *(*TrProc)(char *str, const TrTable * tr);
+
+/*
+ * sub_scalar() --Substitute a character, one byte at a time.
+ *
+ * Parameters:
+ * str     --the string
+ * match   --the character to replace
+ * replace --the character to replace it with
+ * n_sub   --updates the No. of substitutions
+ *
+ * Returns: (char *)
+ * The end of the string.
+ *
+ * Remarks:
+ * Each byte is tested for NUL before it's (maybe) replaced, so the
+ * replacement may itself be '\0' (as for strsplit()).
+ */
+static char *sub_scalar(char *str, int match, int replace, size_t *n_sub)
+{
+    unsigned char *s = (unsigned char *) str;
+
+    for (; *s != '\0'; ++s)
+    {
+        if (*s == (unsigned char) match)
+        {
+            *s = (unsigned char) replace;
+            *n_sub += 1;
+        }
+    }
+    return (char *) s;
+}
+
+/*
+ * tr_table() --Build a translation table from match and replace sets.
+ *
+ * Remarks:
+ * As in the original estrtr(), the first occurrence of a character in
+ * match wins; match characters beyond the end of replace map to '\0'.
+ */
+static void tr_table(TrTable * tr, const char *match, const char *replace)
+{
+    bool seen[256] = { false };
+    size_t n_replace = strlen(replace);
+
+    for (int c = 0; c < 256; ++c)
+    {
+        tr->map[c] = (unsigned char) c;
+    }
+    tr->n = 0;
+    for (size_t i = 0; match[i] != '\0'; ++i)
+    {
+        unsigned char c = (unsigned char) match[i];
+        unsigned char r = i < n_replace ? (unsigned char) replace[i] : '\0';
+
+        if (seen[c])
+        {
+            continue;
+        }
+        seen[c] = true;
+        tr->map[c] = r;
+        if (r != c)
+        {
+            if (tr->n < TR_VECTOR_MAX)
+            {
+                tr->match[tr->n] = c;
+                tr->replace[tr->n] = r;
+            }
+            tr->n += 1;
+        }
+    }
+}
+
+/*
+ * tr_scalar() --Translate a string via its table, one byte at a time.
+ */
+static char *tr_scalar(char *str, const TrTable * tr)
+{
+    unsigned char *s = (unsigned char *) str;
+
+    for (; *s != '\0'; ++s)
+    {
+        *s = tr->map[*s];
+    }
+    return (char *) s;
+}
+
+#ifdef STRING_X86
+/*
+ * sub_sse2() --Substitute a character, 16 bytes at a time.
+ */
+__attribute__((target("sse2"))) NO_SANITIZE
+static char *sub_sse2(char *str, int match, int replace, size_t *n_sub)
+{
+    __m128i m = _mm_set1_epi8((char) match);
+    __m128i r = _mm_set1_epi8((char) replace), zero = _mm_setzero_si128();
+    unsigned char *s = (unsigned char *) str;
+
+    for (; ((uintptr_t) s & 15) != 0; ++s)
+    {
+        if (*s == '\0')
+        {
+            return (char *) s;
+        }
+        if (*s == (unsigned char) match)
+        {
+            *s = (unsigned char) replace;
+            *n_sub += 1;
+        }
+    }
+    for (;; s += 16)
+    {
+        __m128i v = _mm_load_si128((const __m128i *) s);
+        __m128i eq = _mm_cmpeq_epi8(v, m);
+        unsigned int hit;
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0)
+        {
+            break;                     /* (the scalar loop finishes) */
+        }
+        if ((hit = (unsigned int) _mm_movemask_epi8(eq)) != 0)
+        {
+            v = _mm_or_si128(_mm_andnot_si128(eq, v), _mm_and_si128(eq, r));
+            _mm_store_si128((__m128i *) s, v);
+            *n_sub += (size_t) __builtin_popcount(hit);
+        }
+    }
+    return sub_scalar((char *) s, match, replace, n_sub);
+}
+
+/*
+ * sub_avx2() --Substitute a character, 32 bytes at a time.
+ */
+__attribute__((target("avx2"))) NO_SANITIZE
+static char *sub_avx2(char *str, int match, int replace, size_t *n_sub)
+{
+    __m256i m = _mm256_set1_epi8((char) match);
+    __m256i r = _mm256_set1_epi8((char) replace);
+    __m256i zero = _mm256_setzero_si256();
+    unsigned char *s = (unsigned char *) str;
+
+    for (; ((uintptr_t) s & 31) != 0; ++s)
+    {
+        if (*s == '\0')
+        {
+            return (char *) s;
+        }
+        if (*s == (unsigned char) match)
+        {
+            *s = (unsigned char) replace;
+            *n_sub += 1;
+        }
+    }
+    for (;; s += 32)
+    {
+        __m256i v = _mm256_load_si256((const __m256i *) s);
+        __m256i eq = _mm256_cmpeq_epi8(v, m);
+        unsigned int hit;
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) != 0)
+        {
+            break;
+        }
+        if ((hit = (unsigned int) _mm256_movemask_epi8(eq)) != 0)
+        {
+            _mm256_store_si256((__m256i *) s, _mm256_blendv_epi8(v, r, eq));
+            *n_sub += (size_t) __builtin_popcount(hit);
+        }
+    }
+    return sub_scalar((char *) s, match, replace, n_sub);
+}
+
+/*
+ * tr_sse2() --Translate a string, 16 bytes at a time.
+ */
+__attribute__((target("sse2"))) NO_SANITIZE
+static char *tr_sse2(char *str, const TrTable * tr)
+{
+    __m128i m[TR_VECTOR_MAX], r[TR_VECTOR_MAX];
+    __m128i zero = _mm_setzero_si128();
+    unsigned char *s = (unsigned char *) str;
+
+    for (size_t k = 0; k < tr->n; ++k)
+    {
+        m[k] = _mm_set1_epi8((char) tr->match[k]);
+        r[k] = _mm_set1_epi8((char) tr->replace[k]);
+    }
+    for (; ((uintptr_t) s & 15) != 0; ++s)
+    {
+        if (*s == '\0')
+        {
+            return (char *) s;
+        }
+        *s = tr->map[*s];
+    }
+    for (;; s += 16)
+    {
+        __m128i v = _mm_load_si128((const __m128i *) s), out = v;
+        __m128i any = zero;
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0)
+        {
+            break;
+        }
+        for (size_t k = 0; k < tr->n; ++k)
+        {
+            __m128i eq = _mm_cmpeq_epi8(v, m[k]);
+
+            out = _mm_or_si128(_mm_andnot_si128(eq, out),
+                               _mm_and_si128(eq, r[k]));
+            any = _mm_or_si128(any, eq);
+        }
+        if (_mm_movemask_epi8(any) != 0)
+        {
+            _mm_store_si128((__m128i *) s, out);
+        }
+    }
+    return tr_scalar((char *) s, tr);
+}
+
+/*
+ * tr_avx2() --Translate a string, 32 bytes at a time.
+ */
+__attribute__((target("avx2"))) NO_SANITIZE
+static char *tr_avx2(char *str, const TrTable * tr)
+{
+    __m256i m[TR_VECTOR_MAX], r[TR_VECTOR_MAX];
+    __m256i zero = _mm256_setzero_si256();
+    unsigned char *s = (unsigned char *) str;
+
+    for (size_t k = 0; k < tr->n; ++k)
+    {
+        m[k] = _mm256_set1_epi8((char) tr->match[k]);
+        r[k] = _mm256_set1_epi8((char) tr->replace[k]);
+    }
+    for (; ((uintptr_t) s & 31) != 0; ++s)
+    {
+        if (*s == '\0')
+        {
+            return (char *) s;
+        }
+        *s = tr->map[*s];
+    }
+    for (;; s += 32)
+    {
+        __m256i v = _mm256_load_si256((const __m256i *) s), out = v;
+        __m256i any = zero;
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) != 0)
+        {
+            break;
+        }
+        for (size_t k = 0; k < tr->n; ++k)
+        {
+            __m256i eq = _mm256_cmpeq_epi8(v, m[k]);
+
+            out = _mm256_blendv_epi8(out, r[k], eq);
+            any = _mm256_or_si256(any, eq);
+        }
+        if (_mm256_movemask_epi8(any) != 0)
+        {
+            _mm256_store_si256((__m256i *) s, out);
+        }
+    }
+    return tr_scalar((char *) s, tr);
+}
+#endif /* STRING_X86 */
+
+static char *resolve_sub(char *str, int match, int replace, size_t *n_sub);
+static char *resolve_tr(char *str, const TrTable * tr);
+
+static SubProc sub_proc = resolve_sub;
+static TrProc tr_proc = resolve_tr;
+
+/*
+ * resolve_sub() --Select the best sub_*() for this CPU, and call it.
+ */
+static char *resolve_sub(char *str, int match, int replace, size_t *n_sub)
+{
+    SubProc proc = sub_scalar;
+
+#ifdef STRING_X86
+    proc = cpu_has(CPU_AVX2) ? sub_avx2 : cpu_has(CPU_SSE2) ? sub_sse2 : proc;
+#endif
+    CPU_RESOLVE(&sub_proc, proc);
+    return proc(str, match, replace, n_sub);
+}
+
+/*
+ * resolve_tr() --Select the best tr_*() for this CPU, and call it.
+ */
+static char *resolve_tr(char *str, const TrTable * tr)
+{
+    TrProc proc = tr_scalar;
+
+#ifdef STRING_X86
+    proc = cpu_has(CPU_AVX2) ? tr_avx2 : cpu_has(CPU_SSE2) ? tr_sse2 : proc;
+#endif
+    CPU_RESOLVE(&tr_proc, proc);
+    return proc(str, tr);
+}
+
+/*
+ * str_sub_() --Substitute all occurrences of a character, in-place.
+ *
+ * Parameters:
+ * str     --the string
+ * match   --the character to replace (not '\0')
+ * replace --the character to replace it with (may be '\0')
+ * n_sub   --returns the No. of substitutions (or NULL)
+ *
+ * Returns: (char *)
+ * The end of the (original) string.
+ */
+char *str_sub_(char *str, int match, int replace, size_t *n_sub)
+{
+    size_t n = 0;
+    char *end = (match & 0xff) == '\0' ? str + strlen(str)
+        : __atomic_load_n(&sub_proc, __ATOMIC_RELAXED) (str, match, replace,
+                                                        &n);
+
+    if (n_sub != NULL)
+    {
+        *n_sub = n;
+    }
+    return end;
+}
+
+/*
+ * str_tr_() --Translate a string's characters, in-place.
+ *
+ * Parameters:
+ * str     --the string
+ * match   --the characters to replace
+ * replace --the corresponding replacement characters
+ *
+ * Returns: (char *)
+ * The end of the (original) string.
+ */
+char *str_tr_(char *str, const char *match, const char *replace)
+{
+    TrTable tr;
+
+    tr_table(&tr, match, replace);
+    if (tr.n == 0)
+    {
+        return str + strlen(str);      /* (nothing to do) */
+    }
+    if (tr.n > TR_VECTOR_MAX)
+    {
+        return tr_scalar(str, &tr);
+    }
+    return __atomic_load_n(&tr_proc, __ATOMIC_RELAXED) (str, &tr);
+}
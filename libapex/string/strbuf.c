@@ -0,0 +1,491 @@
+/*
+ * STRBUF.C --Growable string buffers.
+ *
+ * Contents:
+ * strbuf_init()    --Initialise an empty string buffer.
+ * strbuf_free()    --Free a string buffer's heap text (if any).
+ * strbuf_clear()   --Empty a string buffer (keeping its space).
+ * strbuf_ok()      --Test that every append to a string buffer succeeded.
+ * strbuf_reserve() --Make room for some more text in a string buffer.
+ * strbuf_add()     --Append some text to a string buffer.
+ * strbuf_str()     --Append a string to a string buffer.
+ * strbuf_char()    --Append a character to a string buffer.
+ * strbuf_view()    --Append a string view to a string buffer.
+ * strbuf_int()     --Append a signed integer, in decimal.
+ * strbuf_uint()    --Append an unsigned integer, in decimal.
+ * strbuf_fixed()   --Append a double, as "%.<precision>f" would.
+ * strbuf_printf()  --Append printf-formatted text to a string buffer.
+ * strbuf_vprintf() --Append formatted text to a string buffer (stdarg version).
+ * strbuf_join()    --Append an array of strings, with a delimiter.
+ * strbuf_detach()  --Return a string buffer's text as a malloc'd string.
+ * format_uint_()   --Format an unsigned integer in decimal.
+ * format_fixed_()  --Format a double like "%.<precision>f".
+ *
+ * Remarks:
+ * The space grows by doubling, so n appends cost O(n) copying in all.
+ * The number formats don't go via snprintf(): integers are converted
+ * two digits at a time, and doubles (up to 1e18, with at most
+ * STRBUF_PRECISION_MAX decimals) are converted exactly from their
+ * binary value, so the text is identical to printf()'s.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/strbuf.h>
+
+#define FIXED_MAX 1e18                 /* larger numbers use snprintf() */
+
+static const uint64_t pow10_int[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000
+};
+
+static const char digit_pair[] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+/*
+ * strbuf_init() --Initialise an empty string buffer.
+ */
+void strbuf_init(StrBuf * buf)
+{
+    buf->str = buf->small;
+    buf->str[0] = '\0';
+    buf->len = 0;
+    buf->size = sizeof(buf->small);
+    buf->failed = 0;
+}
+
+/*
+ * strbuf_free() --Free a string buffer's heap text (if any).
+ *
+ * Remarks:
+ * The buffer is left empty (and usable).
+ */
+void strbuf_free(StrBuf * buf)
+{
+    if (buf->str != buf->small)
+    {
+        free(buf->str);
+    }
+    strbuf_init(buf);
+}
+
+/*
+ * strbuf_clear() --Empty a string buffer (keeping its space).
+ */
+void strbuf_clear(StrBuf * buf)
+{
+    buf->len = 0;
+    buf->str[0] = '\0';
+    buf->failed = 0;
+}
+
+/*
+ * strbuf_ok() --Test that every append to a string buffer succeeded.
+ */
+int strbuf_ok(const StrBuf * buf)
+{
+    return !buf->failed;
+}
+
+/*
+ * strbuf_reserve() --Make room for some more text in a string buffer.
+ *
+ * Parameters:
+ * buf  --the string buffer
+ * n    --the No. of characters to be appended (excluding the NUL)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (malloc failed, or the buffer has failed).
+ */
+int strbuf_reserve(StrBuf * buf, size_t n)
+{
+    size_t size = buf->size;
+    char *str;
+
+    if (buf->failed)
+    {
+        return 0;
+    }
+    if (buf->size - buf->len > n)
+    {
+        return 1;                      /* (the common case) */
+    }
+    if (n >= SIZE_MAX / 2 - buf->len)
+    {
+        buf->failed = 1;
+        return 0;                      /* error: (absurdly) too big */
+    }
+    while (size - buf->len <= n)
+    {
+        size *= 2;
+    }
+    if (buf->str == buf->small)
+    {
+        if ((str = malloc(size)) != NULL)
+        {
+            memcpy(str, buf->small, buf->len + 1);
+        }
+    }
+    else
+    {
+        str = realloc(buf->str, size);
+    }
+    if (str == NULL)
+    {
+        buf->failed = 1;
+        return 0;                      /* error: malloc failed */
+    }
+    buf->str = str;
+    buf->size = size;
+    return 1;
+}
+
+/*
+ * strbuf_add() --Append some text to a string buffer.
+ *
+ * Parameters:
+ * buf  --the string buffer
+ * text --the text to append (not necessarily NUL-terminated)
+ * len  --the text's length
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int strbuf_add(StrBuf * buf, const char *text, size_t len)
+{
+    if (!strbuf_reserve(buf, len))
+    {
+        return 0;
+    }
+    memcpy(buf->str + buf->len, text, len);
+    buf->len += len;
+    buf->str[buf->len] = '\0';
+    return 1;
+}
+
+/*
+ * strbuf_str() --Append a string to a string buffer.
+ */
+int strbuf_str(StrBuf * buf, const char *str)
+{
+    return strbuf_add(buf, str, strlen(str));
+}
+
+/*
+ * strbuf_char() --Append a character to a string buffer.
+ */
+int strbuf_char(StrBuf * buf, int ch)
+{
+    if (!strbuf_reserve(buf, 1))
+    {
+        return 0;
+    }
+    buf->str[buf->len++] = (char) ch;
+    buf->str[buf->len] = '\0';
+    return 1;
+}
+
+/*
+ * strbuf_view() --Append a string view to a string buffer.
+ */
+int strbuf_view(StrBuf * buf, StrView view)
+{
+    return strbuf_add(buf, view.str, view.len);
+}
+
+/*
+ * strbuf_int() --Append a signed integer, in decimal.
+ */
+int strbuf_int(StrBuf * buf, long long value)
+{
+    uint64_t u = value < 0 ? 0 - (uint64_t) value : (uint64_t) value;
+
+    if (!strbuf_reserve(buf, STRBUF_NUMBER_MAX))
+    {
+        return 0;
+    }
+    if (value < 0)
+    {
+        buf->str[buf->len++] = '-';
+    }
+    buf->len += format_uint_(buf->str + buf->len, u, 1);
+    buf->str[buf->len] = '\0';
+    return 1;
+}
+
+/*
+ * strbuf_uint() --Append an unsigned integer, in decimal.
+ */
+int strbuf_uint(StrBuf * buf, unsigned long long value)
+{
+    if (!strbuf_reserve(buf, STRBUF_NUMBER_MAX))
+    {
+        return 0;
+    }
+    buf->len += format_uint_(buf->str + buf->len, value, 1);
+    buf->str[buf->len] = '\0';
+    return 1;
+}
+
+/*
+ * strbuf_fixed() --Append a double, as "%.<precision>f" would.
+ *
+ * Remarks:
+ * Numbers that format_fixed_() can't do (huge, infinite, NaN, or
+ * with more than STRBUF_PRECISION_MAX decimals) use snprintf().
+ */
+int strbuf_fixed(StrBuf * buf, double value, int precision)
+{
+    size_t n = 0;
+
+    precision = MAX(precision, 0);
+    if (!strbuf_reserve(buf, STRBUF_NUMBER_MAX))
+    {
+        return 0;
+    }
+    if (precision <= STRBUF_PRECISION_MAX
+        && (n = format_fixed_(buf->str + buf->len, value, precision)) > 0)
+    {
+        buf->len += n;
+        buf->str[buf->len] = '\0';
+        return 1;
+    }
+    return strbuf_printf(buf, "%.*f", precision, value);
+}
+
+/*
+ * strbuf_printf() --Append printf-formatted text to a string buffer.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int strbuf_printf(StrBuf * buf, const char *fmt, ...)
+{
+    va_list args;
+    int status;
+
+    va_start(args, fmt);
+    status = strbuf_vprintf(buf, fmt, args);
+    va_end(args);
+    return status;
+}
+
+/*
+ * strbuf_vprintf() --Append formatted text to a string buffer (stdarg version).
+ *
+ * Remarks:
+ * The text is formatted straight into the buffer's free space; only
+ * if it doesn't fit is the buffer grown, and the text formatted again.
+ */
+int strbuf_vprintf(StrBuf * buf, const char *fmt, va_list args)
+{
+    va_list args_copy;
+    int n;
+
+    if (buf->failed)
+    {
+        return 0;
+    }
+    va_copy(args_copy, args);
+    n = vsnprintf(buf->str + buf->len, buf->size - buf->len, fmt, args_copy);
+    va_end(args_copy);
+    if (n < 0)
+    {
+        buf->str[buf->len] = '\0';
+        buf->failed = 1;
+        return 0;                      /* error: bad format */
+    }
+    if ((size_t) n >= buf->size - buf->len)
+    {
+        buf->str[buf->len] = '\0';     /* (discard the partial text) */
+        if (!strbuf_reserve(buf, (size_t) n))
+        {
+            return 0;
+        }
+        va_copy(args_copy, args);
+        (void) vsnprintf(buf->str + buf->len, buf->size - buf->len, fmt,
+                         args_copy);
+        va_end(args_copy);
+    }
+    buf->len += (size_t) n;
+    return 1;
+}
+
+/*
+ * strbuf_join() --Append an array of strings, with a delimiter.
+ *
+ * Remarks:
+ * This is estrjoin(), without the risk of overflow.
+ */
+int strbuf_join(StrBuf * buf, int delim, size_t n, const char *str[])
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if ((i > 0 && !strbuf_char(buf, delim)) || !strbuf_str(buf, str[i]))
+        {
+            return 0;
+        }
+    }
+    return strbuf_ok(buf);
+}
+
+/*
+ * strbuf_detach() --Return a string buffer's text as a malloc'd string.
+ *
+ * Parameters:
+ * buf  --the string buffer
+ * len  --returns the text's length (or NULL)
+ *
+ * Returns: (char *)
+ * Success: the text, which the caller must free(); Failure: NULL
+ * (an append failed, or malloc failed).
+ *
+ * Remarks:
+ * The buffer is left empty (and usable), either way.
+ */
+char *strbuf_detach(StrBuf * buf, size_t *len)
+{
+    char *str = NULL;
+
+    if (!buf->failed)
+    {
+        if (buf->str != buf->small)
+        {
+            str = buf->str;            /* (just hand it over) */
+            buf->str = buf->small;
+        }
+        else if ((str = malloc(buf->len + 1)) != NULL)
+        {
+            memcpy(str, buf->small, buf->len + 1);
+        }
+        if (str != NULL && len != NULL)
+        {
+            *len = buf->len;
+        }
+    }
+    strbuf_free(buf);
+    return str;
+}
+
+/*
+ * format_uint_() --Format an unsigned integer in decimal.
+ *
+ * Parameters:
+ * out       --returns the digits (not NUL-terminated; 20 at most)
+ * n         --the value
+ * min_digit --the minimum No. of digits (padded with leading zeros)
+ *
+ * Returns: (size_t)
+ * The No. of characters written.
+ */
+size_t format_uint_(char *out, uint64_t n, size_t min_digit)
+{
+    char digit[24], *s = digit + sizeof(digit);
+    size_t len;
+
+    while (n >= 100)
+    {
+        const char *pair = digit_pair + 2 * (n % 100);
+
+        n /= 100;
+        *--s = pair[1];
+        *--s = pair[0];
+    }
+    if (n >= 10)
+    {
+        *--s = digit_pair[2 * n + 1];
+        *--s = digit_pair[2 * n];
+    }
+    else
+    {
+        *--s = (char) ('0' + n);
+    }
+    while ((size_t) (digit + sizeof(digit) - s) < min_digit && s > digit)
+    {
+        *--s = '0';
+    }
+    len = (size_t) (digit + sizeof(digit) - s);
+    memcpy(out, s, len);
+    return len;
+}
+
+/*
+ * format_fixed_() --Format a double like "%.<precision>f".
+ *
+ * Parameters:
+ * out       --returns the text (not NUL-terminated)
+ * x         --the value
+ * precision --the No. of decimals (0..STRBUF_PRECISION_MAX)
+ *
+ * Returns: (size_t)
+ * Success: the No. of characters written; Failure: 0 (the number is
+ * too large, or not finite).
+ *
+ * Remarks:
+ * The value is m/2^k exactly, so the result is m * 10^precision / 2^k,
+ * rounded (half to even) by the remainder of the shift.
+ */
+size_t format_fixed_(char *out, double x, int precision)
+{
+#ifdef __SIZEOF_INT128__
+    char *s = out;
+    uint64_t mantissa, i_part, f_part = 0;
+    int exponent, shift;
+
+    if (!isfinite(x) || fabs(x) >= FIXED_MAX || precision < 0
+        || precision > STRBUF_PRECISION_MAX)
+    {
+        return 0;
+    }
+    if (signbit(x))
+    {
+        *s++ = '-';                    /* (printf() shows "-0.00" too) */
+        x = -x;
+    }
+    mantissa = (uint64_t) ldexp(frexp(x, &exponent), 53);
+    shift = 53 - exponent;             /* x == mantissa / 2^shift */
+    if (shift <= 0)
+    {
+        i_part = mantissa << -shift;
+    }
+    else
+    {
+        unsigned __int128 p = (unsigned __int128) mantissa
+            * pow10_int[precision];
+        unsigned __int128 q = 0;
+
+        if (shift < 128)
+        {
+            unsigned __int128 half = (unsigned __int128) 1 << (shift - 1);
+            unsigned __int128 rem;
+
+            q = p >> shift;
+            rem = p - (q << shift);
+            if (rem > half || (rem == half && (q & 1) != 0))
+            {
+                ++q;
+            }
+        }
+        i_part = (uint64_t) (q / pow10_int[precision]);
+        f_part = (uint64_t) (q % pow10_int[precision]);
+    }
+    s += format_uint_(s, i_part, 1);
+    if (precision > 0)
+    {
+        *s++ = '.';
+        s += format_uint_(s, f_part, (size_t) precision);
+    }
+    return (size_t) (s - out);
+#else
+    return 0;                          /* (no 128-bit arithmetic) */
+#endif /* __SIZEOF_INT128__ */
+}
@@ -0,0 +1,71 @@
+/*
+ * STRBUF.H --Definitions for growable string buffers.
+ *
+ * Contents:
+ * StrBuf{} --A NUL-terminated string that grows as it's appended to.
+ *
+ * Remarks:
+ * A StrBuf starts with its text in a small internal buffer, and moves
+ * it to the heap (doubling each time) only if it outgrows it, so most
+ * short strings never call malloc().  Because str may point into the
+ * StrBuf itself, a StrBuf mustn't be copied (by assignment or memcpy())
+ * once it's initialised.
+ *
+ * If an append fails (i.e. malloc() fails), the buffer is marked as
+ * failed, and all further appends are ignored; so a sequence of
+ * appends can be checked once, at the end, with strbuf_ok().
+ */
+#ifndef STRBUF_H
+#define STRBUF_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <apex.h>
+#include <apex/strview.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        STRBUF_SMALL = 128,            /* text kept within the StrBuf */
+        STRBUF_NUMBER_MAX = 32,        /* room for a (fast) formatted number */
+        STRBUF_PRECISION_MAX = 9       /* most digits strbuf_fixed() does */
+    };
+
+    typedef struct StrBuf_t
+    {
+        char *str;                     /* the text (always NUL-terminated) */
+        size_t len;                    /* the text's length */
+        size_t size;                   /* allocated size of str */
+        int failed;                    /* an append has failed */
+        char small[STRBUF_SMALL];
+    } StrBuf, *StrBufPtr;
+
+    void strbuf_init(StrBuf * buf);
+    void strbuf_free(StrBuf * buf);
+    void strbuf_clear(StrBuf * buf);
+    int strbuf_ok(const StrBuf * buf);
+    int strbuf_reserve(StrBuf * buf, size_t n);
+    int strbuf_add(StrBuf * buf, const char *text, size_t len);
+    int strbuf_str(StrBuf * buf, const char *str);
+    int strbuf_char(StrBuf * buf, int ch);
+    int strbuf_view(StrBuf * buf, StrView view);
+    int strbuf_int(StrBuf * buf, long long value);
+    int strbuf_uint(StrBuf * buf, unsigned long long value);
+    int strbuf_fixed(StrBuf * buf, double value, int precision);
+    int strbuf_printf(StrBuf * buf, const char *fmt, ...)
+        PRINTF_ATTRIBUTE(2, 3);
+    int strbuf_vprintf(StrBuf * buf, const char *fmt, va_list args);
+    int strbuf_join(StrBuf * buf, int delim, size_t n, const char *str[]);
+    char *strbuf_detach(StrBuf * buf, size_t *len);
+
+    size_t format_uint_(char *out, uint64_t n, size_t min_digit);
+    size_t format_fixed_(char *out, double x, int precision);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* STRBUF_H */
@@ -134,14 +134,13 @@ char *estrsub(char *str, int match, int replace, bool all)
 {
     char *chptr;
 
-    for (chptr = strchr(str, match); chptr != NULL;
-         chptr = strchr(str, match))
+    if (all)
     {
-        *chptr = replace;
-        if (!all)
-        {
-            break;                     /* once is enough */
-        }
+        return str_sub_(str, match, replace, NULL);
+    }
+    if ((chptr = strchr(str, match)) != NULL)
+    {
+        *chptr = replace;              /* once is enough */
         str = chptr + 1;
     }
     return (str + strlen(str));        /* end of string */
@@ -152,35 +151,24 @@ char *estrsub(char *str, int match, int replace, bool all)
  *
  * Parameters:
  * str  --the string to be transformed
+ * match    --the characters to replace
+ * replace  --the corresponding replacement characters
  *
  * Returns: (char *)
  * The end of the string.
  *
  * Remarks:
- * This routine isn't very efficient (yet), because it scans the
- * match set for every character.  A better scheme would build
- * a translation table from match+replace, and use that to direct
- * the transformation.
- * TODO: make estrtr() work with a translation table.
+ * The match and replace sets are compiled into a translation table,
+ * so the cost doesn't depend on the size of the set; if only a few
+ * characters change, whole blocks are translated at once (see
+ * simd-string.c).  If a character appears more than once in match,
+ * the first one wins.
  */
 char *estrtr(char *str, const char *match, const char *replace)
 {
-    int c;
-
-    for (c = *str; c != '\0'; c = *str)
-    {
-        char *chptr;
-
-        if ((chptr = strchr(match, c)) != NULL)
-        {
-            *str = replace[chptr - match];
-        }
-        ++str;
-    }
-    return str;
+    return str_tr_(str, match, replace);
 }
 
-
 /*
  * estrmap() --Apply a function to every character in a string.
  *
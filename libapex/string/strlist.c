@@ -2,11 +2,38 @@
  * STRLIST.C --Some routines for handling lists of strings.
  *
  * Contents:
+ * fill_str_list() --Split a (copied) string into a list, in place.
  * strsplit()      --Split a string into components based on a delimiter.
  * new_str_list()  --Return a list of strings by splitting a string.
  * free_str_list() --Free the resources for a string list.
+ * arena_str_list() --Return a list of strings, allocated from an arena.
  */
 #include <apex/estring.h>
+#include <apex/strview.h>
+
+/*
+ * fill_str_list() --Split a (copied) string into a list, in place.
+ *
+ * Parameters:
+ * s    --the string (i.e. a copy, which is modified)
+ * len  --its length
+ * delimiter --the delimiter character
+ * list --returns the strings (the caller provides the NULL at the end)
+ *
+ * Remarks:
+ * This finds each delimiter once, without a separate strsplit()
+ * and strlen() pass.
+ */
+static void fill_str_list(char *s, size_t len, int delimiter, char **list)
+{
+    StrView rest = strview_n(s, len), field;
+
+    for (size_t i = 0; strview_split(&rest, delimiter, &field); ++i)
+    {
+        list[i] = (char *) field.str;
+        list[i][field.len] = '\0';
+    }
+}
 
 /*
  * strsplit() --Split a string into components based on a delimiter.
@@ -21,17 +48,13 @@
 size_t strsplit(char *str, int delimiter)
 {
     size_t n;
-    char *end;
 
     if (str == NULL || delimiter == '\0')
     {
         return 0;                      /* error: bad args */
     }
-    for (n = 1; (end = strchr(str, delimiter)); ++n, str = end)
-    {
-        *end++ = '\0';                 /* terminate str and skip null */
-    }
-    return n;                          /* return No. substrings */
+    (void) str_sub_(str, delimiter, '\0', &n);  /* terminate each substring */
+    return n + 1;                      /* return No. substrings */
 }
 
 /*
@@ -46,7 +69,7 @@ size_t strsplit(char *str, int delimiter)
  */
 char **new_str_list(const char *str, int delimiter)
 {
-    size_t n;
+    size_t n, len;
     char **list;
     char *s;
 
@@ -55,22 +78,20 @@ char **new_str_list(const char *str, int delimiter)
         return NULL;                   /* error: bad args */
     }
 
-    if ((s = strdup(str)) == NULL)
+    len = strlen(str);
+    if ((s = malloc(len + 1)) == NULL)
     {
-        return NULL;                   /* error: strdup failed */
+        return NULL;                   /* error: malloc failed */
     }
-    n = strsplit(s, delimiter);
+    memcpy(s, str, len + 1);
+    n = strview_count(strview_n(s, len), delimiter) + 1;
     if ((list = NEW(char *, n + 1)) == NULL)
     {
         free((void *) s);
         return NULL;                   /* error: malloc failed */
     }
-    for (size_t i = 0; i < n; ++i)
-    {
-        list[i] = s;
-        s += strlen(s) + 1;
-    }                                  /* note: last item in list is naturally NULL */
-    return list;                       /* success */
+    fill_str_list(s, len, delimiter, list);
+    return list;                       /* success: (NEW() NULL-terminates it) */
 }
 
 /*
@@ -81,3 +102,44 @@ void free_str_list(char **list)
     free(list[0]);
     free(list);
 }
+
+/*
+ * arena_str_list() --Return a list of strings, allocated from an arena.
+ *
+ * Parameters:
+ * arena --the arena to allocate from
+ * str  --the string to split
+ * delimiter --the delimiter character
+ *
+ * Returns: (char **)
+ * Success: the string list; Failure: NULL.
+ *
+ * Remarks:
+ * This is like new_str_list(), but the list is released with the
+ * arena (i.e. by arena_release() or arena_reset()), not
+ * free_str_list().
+ */
+char **arena_str_list(ArenaPtr arena, const char *str, int delimiter)
+{
+    size_t n, len;
+    char **list;
+    char *s;
+
+    if (arena == NULL || str == NULL || delimiter == '\0')
+    {
+        return NULL;                   /* error: bad args */
+    }
+    if ((s = arena_strdup(arena, str)) == NULL)
+    {
+        return NULL;                   /* error: no memory */
+    }
+    len = strlen(s);
+    n = strview_count(strview_n(s, len), delimiter) + 1;
+    if ((list = arena_alloc(arena, (n + 1) * sizeof(char *))) == NULL)
+    {
+        return NULL;                   /* error: no memory */
+    }
+    fill_str_list(s, len, delimiter, list);
+    list[n] = NULL;
+    return list;                       /* success */
+}
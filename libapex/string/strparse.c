@@ -3,27 +3,52 @@
  *
  * Contents:
  * str_inet4_address() --Parse a "host[/bits]" inet4 address.
+ * is_8_digits()       --Test if eight (little-endian) bytes are all digits.
+ * value_8_digits()    --Convert eight (little-endian) digits to a value.
+ * scan_digits()       --Accumulate a run of decimal digits.
+ * scan_decimal()      --Scan a plain decimal number, without strto*().
+ * exact_double()      --Compute a decimal number exactly as a double.
+ * exact_float()       --Compute a decimal number exactly as a float.
  * str_int()           --Parse a number, as a natural int value.
  * str_uint()          --Parse a number, as a natural unsigned int value.
  * str_uint16()        --Parse a number, as an unsigned 16-bit value.
  * str_int16()         --Parse a number as a 16-bit value.
  * str_double()        --Parse a number, as a double-precision float value.
  * str_float()         --Parse a number, as a float value.
+ * view_text()         --Copy a view's text for strto*(), if it's small enough.
+ * strview_int()       --Parse a view's text, as a natural int value.
+ * strview_uint()      --Parse a view's text, as a natural unsigned int value.
+ * strview_double()    --Parse a view's text, as a double-precision float value.
  * parse_int_range()   --Parse an integer range of the form "a-b".
  * str_int_list()      --Parse a list of integers.
  * str_str_list()      --Parse a list of strings.
  * str_int_in_range()  --Parse an int, and validate its value wrt boundaries.
  *
+ * Remarks:
+ * The number parsers handle the common case (plain decimal text,
+ * such as "8080", "-12" or "0.25e3") themselves, and only call
+ * strtol()/strtod() etc. for everything else (hex, octal, leading
+ * space, "inf", long mantissas, big exponents...), so the results
+ * and the failures are the same as strto*()'s.  The fast paths
+ * don't consult the locale, but the fallbacks do.
+ *
+ * Floating point values are only computed directly when the
+ * result is exact (Clinger's fast path): the mantissa fits in the
+ * float type's precision, and the power of ten is exactly
+ * representable, so the single multiply/divide is correctly rounded.
  */
 #include <apex.h>                       /* Windows_NT requires this before system headers */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include <limits.h>
+#include <float.h>
 #include <errno.h>
 
 #include <apex/strparse.h>
+#include <apex/strview.h>
 #include <apex/estring.h>
 
 /*
@@ -52,6 +77,7 @@ int str_inet4_address(const char *text, uint32_t * address,
         return 0;                      /* error: nothing specified */
     }
 
+    *mask = '\0';                      /* (no "/bits": no netmask) */
     if (sscanf(text, "%[^/]/%s", host, mask) == 2)
     {
         text = host;
@@ -69,7 +95,8 @@ int str_inet4_address(const char *text, uint32_t * address,
         if (str_int(mask, &mask_bits))
         {
             mask_bits = 32 - mask_bits;
-            *netmask = (0xffffffff >> mask_bits) << mask_bits;
+            *netmask = mask_bits >= 32 ? 0 /* (i.e. "/0") */
+                : (0xffffffff >> mask_bits) << mask_bits;
         }
         else
         {
@@ -83,6 +110,279 @@ int str_inet4_address(const char *text, uint32_t * address,
 }
 #endif /* NO_INET */
 
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SWAR_DIGITS 1                  /* parse digits 8 at a time */
+#endif
+
+/* (16: AVX512-FP16, where only _Float16 is evaluated wider) */
+#if defined(FLT_EVAL_METHOD) \
+    && (FLT_EVAL_METHOD == 0 || FLT_EVAL_METHOD == 16)
+#define EXACT_FLOAT 1                  /* no excess (e.g. x87) precision */
+#endif
+
+#define DECIMAL_DIGITS 19              /* (always fits in a uint64_t) */
+#define DECIMAL_EXP_MAX 9999           /* (else: let strtod() decide) */
+#define VIEW_NUMBER_MAX 64             /* max. view text for strto*() */
+
+/*
+ * Decimal --A plain decimal number: [-]mantissa * 10^exponent.
+ */
+typedef struct Decimal
+{
+    uint64_t mantissa;
+    int exponent;
+    int negative;
+    int n_digit;                       /* significant digits */
+} Decimal;
+
+#ifdef EXACT_FLOAT
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const float exact_pow10f[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+#endif /* EXACT_FLOAT */
+
+#ifdef SWAR_DIGITS
+/*
+ * is_8_digits() --Test if eight (little-endian) bytes are all digits.
+ */
+static inline int is_8_digits(uint64_t chunk)
+{
+    return ((chunk & 0xF0F0F0F0F0F0F0F0u)
+            | (((chunk + 0x0606060606060606u) & 0xF0F0F0F0F0F0F0F0u) >> 4))
+        == 0x3333333333333333u;
+}
+
+/*
+ * value_8_digits() --Convert eight (little-endian) digits to a value.
+ *
+ * Remarks:
+ * The digits are combined in pairs, then quads, then the whole lot,
+ * with three multiplies rather than eight.
+ */
+static inline uint64_t value_8_digits(uint64_t chunk)
+{
+    const uint64_t mask = 0x000000FF000000FFu;
+    const uint64_t mul1 = 100 + (1000000ull << 32);
+    const uint64_t mul2 = 1 + (10000ull << 32);
+
+    chunk -= 0x3030303030303030u;
+    chunk = (chunk * 10) + (chunk >> 8);
+    return (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2))
+        >> 32;
+}
+#endif /* SWAR_DIGITS */
+
+/*
+ * scan_digits() --Accumulate a run of decimal digits.
+ *
+ * Parameters:
+ * str   --the start of the digits
+ * end   --the end of the text (i.e. its NUL)
+ * value --specifies/returns the accumulated value
+ *
+ * Returns: (const char *)
+ * The first non-digit character.
+ *
+ * Remarks:
+ * The value silently wraps if there are too many digits; the caller
+ * checks the number of digits scanned.
+ */
+static const char *scan_digits(const char *str, const char *end,
+                               uint64_t * value)
+{
+    uint64_t v = *value;
+
+#ifdef SWAR_DIGITS
+    while (end - str >= 8)
+    {
+        uint64_t chunk;
+
+        memcpy(&chunk, str, sizeof(chunk));
+        if (!is_8_digits(chunk))
+        {
+            break;
+        }
+        v = v * 100000000u + value_8_digits(chunk);
+        str += 8;
+    }
+#endif /* SWAR_DIGITS */
+    while (str < end && (unsigned char) (*str - '0') < 10)
+    {
+        v = v * 10 + (uint64_t) (*str - '0');
+        ++str;
+    }
+    *value = v;
+    return str;
+}
+
+/*
+ * scan_decimal() --Scan a plain decimal number, without strto*().
+ *
+ * Parameters:
+ * text    --the text to be scanned
+ * end     --the end of the text
+ * decimal --returns the number's parts
+ * real    --allow a fraction and exponent
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (not a plain decimal number, or too many
+ * digits: the caller must use strto*()).
+ *
+ * Remarks:
+ * An integer must not have a leading zero (which would make it octal
+ * for strtol()); the number must be the whole of the text (which
+ * needn't be NUL-terminated).
+ */
+static int scan_decimal(const char *text, const char *end,
+                        Decimal * decimal, int real)
+{
+    const char *str = text, *digits;
+    int n_seen;
+
+    decimal->mantissa = 0;
+    decimal->exponent = 0;
+    decimal->negative = 0;
+    decimal->n_digit = 0;
+    if (str < end && (*str == '-' || *str == '+'))
+    {
+        decimal->negative = (*str++ == '-');
+    }
+    if (!real && str < end && *str == '0')
+    {
+        return str + 1 == end;         /* only "0" itself (not octal/hex) */
+    }
+    digits = str;
+    while (str < end && *str == '0')
+    {
+        ++str;                         /* skip (insignificant) zeros */
+    }
+    n_seen = (int) (str - digits);
+    digits = str;
+    str = scan_digits(str, end, &decimal->mantissa);
+    decimal->n_digit = (int) (str - digits);
+    if (real && str < end && *str == '.')
+    {
+        const char *fraction = ++str;
+
+        str = scan_digits(str, end, &decimal->mantissa);
+        decimal->exponent = -(int) (str - fraction);
+        if (decimal->n_digit == 0)
+        {                              /* (fraction's leading zeros) */
+            for (digits = fraction; digits < str && *digits == '0';
+                 ++digits)
+            {
+                continue;
+            }
+            decimal->n_digit = (int) (str - digits);
+        }
+        else
+        {
+            decimal->n_digit += (int) (str - fraction);
+        }
+        n_seen += (int) (str - fraction);
+    }
+    n_seen += (int) (str - digits);
+    if (n_seen == 0 || decimal->n_digit > DECIMAL_DIGITS)
+    {
+        return 0;                      /* no digits, or too many */
+    }
+    if (real && str < end && (*str == 'e' || *str == 'E'))
+    {
+        uint64_t exponent = 0;
+        int negative = 0;
+
+        ++str;
+        if (str < end && (*str == '-' || *str == '+'))
+        {
+            negative = (*str++ == '-');
+        }
+        digits = str;
+        str = scan_digits(str, end, &exponent);
+        if (str == digits || str - digits > 4 || exponent > DECIMAL_EXP_MAX)
+        {
+            return 0;                  /* no (or a huge) exponent */
+        }
+        decimal->exponent += negative ? -(int) exponent : (int) exponent;
+    }
+    return str == end;
+}
+
+#ifdef EXACT_FLOAT
+/*
+ * exact_double() --Compute a decimal number exactly as a double.
+ */
+static int exact_double(const Decimal * decimal, double *result)
+{
+    uint64_t mantissa = decimal->mantissa;
+    int exponent = decimal->exponent;
+    double value;
+
+    if (mantissa == 0)
+    {
+        *result = decimal->negative ? -0.0 : 0.0;
+        return 1;
+    }
+    while (exponent > 22 && mantissa <= (UINT64_C(1) << 53) / 10)
+    {                                  /* (shift zeros into the mantissa) */
+        mantissa *= 10;
+        --exponent;
+    }
+    if (mantissa > (UINT64_C(1) << 53) || exponent < -22 || exponent > 22)
+    {
+        return 0;
+    }
+    value = (double) mantissa;
+    value = exponent < 0 ? value / exact_pow10[-exponent]
+        : value * exact_pow10[exponent];
+    *result = decimal->negative ? -value : value;
+    return 1;
+}
+
+/*
+ * exact_float() --Compute a decimal number exactly as a float.
+ */
+static int exact_float(const Decimal * decimal, float *result)
+{
+    uint64_t mantissa = decimal->mantissa;
+    int exponent = decimal->exponent;
+    float value;
+
+    if (mantissa == 0)
+    {
+        *result = decimal->negative ? -0.0f : 0.0f;
+        return 1;
+    }
+    if (mantissa > (UINT64_C(1) << 24) || exponent < -10 || exponent > 10)
+    {
+        return 0;
+    }
+    value = (float) mantissa;
+    value = exponent < 0 ? value / exact_pow10f[-exponent]
+        : value * exact_pow10f[exponent];
+    *result = decimal->negative ? -value : value;
+    return 1;
+}
+#else
+/*
+ * exact_double(), exact_float() --Defer to strtod() (excess precision).
+ */
+static int exact_double(const Decimal * UNUSED(decimal),
+                        double *UNUSED(result))
+{
+    return 0;
+}
+
+static int exact_float(const Decimal * UNUSED(decimal), float *UNUSED(result))
+{
+    return 0;
+}
+#endif /* EXACT_FLOAT */
+
 /*
  * str_int() --Parse a number, as a natural int value.
  *
@@ -97,11 +397,19 @@ int str_int(const char *text, int *result)
 {
     int value;
     char *end;
+    Decimal decimal;
 
     if (text == NULL)
     {
         return 0;
     }
+    if (scan_decimal(text, text + strlen(text), &decimal, 0)
+        && decimal.mantissa <= (uint64_t) INT_MAX + decimal.negative)
+    {
+        *result = decimal.negative ? (int) -(int64_t) decimal.mantissa
+            : (int) decimal.mantissa;
+        return 1;                      /* success: (fast path) */
+    }
     errno = 0;                         /* reset errno! */
     value = strtol(text, &end, 0);
     if (errno == 0 && *end == '\0')
@@ -126,11 +434,19 @@ int str_uint(const char *text, unsigned int *result)
 {
     unsigned int value;
     char *end;
+    Decimal decimal;
 
     if (text == NULL)
     {
         return 0;
     }
+    if (scan_decimal(text, text + strlen(text), &decimal, 0)
+        && !decimal.negative
+        && decimal.mantissa <= UINT_MAX)
+    {
+        *result = (unsigned int) decimal.mantissa;
+        return 1;                      /* success: (fast path) */
+    }
     errno = 0;                         /* reset errno! */
     value = strtoul(text, &end, 0);
     if (errno == 0 && *end == '\0')
@@ -199,13 +515,19 @@ int str_double(const char *text, double *result)
 {
     double value;
     char *end;
+    Decimal decimal;
 
     if (text == NULL)
     {
         return 0;
     }
+    if (scan_decimal(text, text + strlen(text), &decimal, 1)
+        && exact_double(&decimal, result))
+    {
+        return 1;                      /* success: (fast path) */
+    }
     errno = 0;                         /* reset errno! */
-    value = strtof(text, &end);
+    value = strtod(text, &end);
     if (errno == 0 && *end == '\0')
     {
         *result = value;
@@ -226,14 +548,120 @@ int str_double(const char *text, double *result)
  */
 int str_float(const char *text, float *result)
 {
-    double value;
-    int status;
+    float value;
+    char *end;
+    Decimal decimal;
 
-    if ((status = str_double(text, &value)))
+    if (text == NULL)
+    {
+        return 0;
+    }
+    if (scan_decimal(text, text + strlen(text), &decimal, 1)
+        && exact_float(&decimal, result))
+    {
+        return 1;                      /* success: (fast path) */
+    }
+    errno = 0;                         /* reset errno! */
+    value = strtof(text, &end);
+    if (errno == 0 && *end == '\0')
     {
         *result = value;
+        return 1;
     }
-    return status;
+    return 0;
+}
+
+/*
+ * view_text() --Copy a view's text for strto*(), if it's small enough.
+ *
+ * Returns: (const char *)
+ * Success: the (NUL-terminated) text; Failure: NULL (it's too long).
+ */
+static const char *view_text(StrView view, char *text, size_t size)
+{
+    if (view.str == NULL || view.len >= size)
+    {
+        return NULL;
+    }
+    return strview_copy(view, text, size);
+}
+
+/*
+ * strview_int() --Parse a view's text, as a natural int value.
+ *
+ * Parameters:
+ * view  --the text containing a parseable value
+ * result --returns the parsed value, if it succeeds
+ *
+ * Return: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * This accepts the same text as str_int().  Plain decimal numbers
+ * are parsed in place; anything else is copied to a small buffer
+ * for strtol() (and fails if it's longer than VIEW_NUMBER_MAX).
+ */
+int strview_int(StrView view, int *result)
+{
+    char text[VIEW_NUMBER_MAX];
+    const char *str;
+    Decimal decimal;
+
+    if (view.str != NULL
+        && scan_decimal(view.str, view.str + view.len, &decimal, 0)
+        && decimal.mantissa <= (uint64_t) INT_MAX + decimal.negative)
+    {
+        *result = decimal.negative ? (int) -(int64_t) decimal.mantissa
+            : (int) decimal.mantissa;
+        return 1;
+    }
+    return (str = view_text(view, text, sizeof(text))) != NULL
+        && strlen(str) == view.len && str_int(str, result);
+}
+
+/*
+ * strview_uint() --Parse a view's text, as a natural unsigned int value.
+ *
+ * Return: (int)
+ * Success: 1; Failure: 0.
+ */
+int strview_uint(StrView view, unsigned int *result)
+{
+    char text[VIEW_NUMBER_MAX];
+    const char *str;
+    Decimal decimal;
+
+    if (view.str != NULL
+        && scan_decimal(view.str, view.str + view.len, &decimal, 0)
+        && !decimal.negative && decimal.mantissa <= UINT_MAX)
+    {
+        *result = (unsigned int) decimal.mantissa;
+        return 1;
+    }
+    return (str = view_text(view, text, sizeof(text))) != NULL
+        && strlen(str) == view.len && str_uint(str, result);
+}
+
+/*
+ * strview_double() --Parse a view's text, as a double-precision float value.
+ *
+ * Return: (int)
+ * Success: 1; Failure: 0.
+ */
+int strview_double(StrView view, double *result)
+{
+    char text[VIEW_NUMBER_MAX];
+    const char *str;
+    Decimal decimal;
+
+    if (view.str != NULL
+        && scan_decimal(view.str, view.str + view.len, &decimal, 1)
+        && exact_double(&decimal, result))
+    {
+        return 1;
+    }
+    return (str = view_text(view, text, sizeof(text))) != NULL
+        && strlen(str) == view.len && str_double(str, result);
 }
 
 /*
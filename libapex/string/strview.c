@@ -0,0 +1,241 @@
+/*
+ * STRVIEW.C --Operations on (pointer, length) string views.
+ *
+ * Contents:
+ * strview()        --Make a view of a NUL-terminated string.
+ * strview_n()      --Make a view of some text.
+ * strview_ltrim()  --Remove leading whitespace from a view.
+ * strview_rtrim()  --Remove trailing whitespace from a view.
+ * strview_trim()   --Remove leading and trailing whitespace from a view.
+ * strview_cmp()    --Compare two views, as strcmp() would.
+ * strview_eq()     --Test if two views have the same text.
+ * strview_eq_str() --Test if a view has the same text as a string.
+ * strview_prefix() --Test if a view starts with some text.
+ * strview_suffix() --Test if a view ends with some text.
+ * strview_chr()    --Find the first occurrence of a character in a view.
+ * strview_count()  --Count the occurrences of a character in a view.
+ * strview_split()  --Split the next field from a view.
+ * strview_copy()   --Copy a view into a NUL-terminated buffer.
+ *
+ * Remarks:
+ * The number conversions (strview_int() etc.) are in strparse.c,
+ * alongside their NUL-terminated equivalents.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <ctype.h>
+#include <string.h>
+
+#include <apex/strview.h>
+
+/*
+ * strview() --Make a view of a NUL-terminated string.
+ *
+ * Remarks:
+ * A NULL string gives a NULL view, of length 0.
+ */
+StrView strview(const char *str)
+{
+    StrView view = { str, str != NULL ? strlen(str) : 0 };
+
+    return view;
+}
+
+/*
+ * strview_n() --Make a view of some text.
+ */
+StrView strview_n(const char *str, size_t len)
+{
+    StrView view = { str, len };
+
+    return view;
+}
+
+/*
+ * strview_ltrim() --Remove leading whitespace from a view.
+ */
+StrView strview_ltrim(StrView view)
+{
+    while (view.len > 0 && isspace((unsigned char) *view.str))
+    {
+        ++view.str;
+        --view.len;
+    }
+    return view;
+}
+
+/*
+ * strview_rtrim() --Remove trailing whitespace from a view.
+ */
+StrView strview_rtrim(StrView view)
+{
+    while (view.len > 0 && isspace((unsigned char) view.str[view.len - 1]))
+    {
+        --view.len;
+    }
+    return view;
+}
+
+/*
+ * strview_trim() --Remove leading and trailing whitespace from a view.
+ */
+StrView strview_trim(StrView view)
+{
+    return strview_rtrim(strview_ltrim(view));
+}
+
+/*
+ * strview_cmp() --Compare two views, as strcmp() would.
+ *
+ * Returns: (int)
+ * <0, 0, >0: a is less than, equal to, or greater than b.
+ *
+ * Remarks:
+ * A view that's a prefix of the other sorts first.
+ */
+int strview_cmp(StrView a, StrView b)
+{
+    size_t n = MIN(a.len, b.len);
+    int cmp = n > 0 ? memcmp(a.str, b.str, n) : 0;
+
+    if (cmp == 0)
+    {
+        cmp = (a.len > b.len) - (a.len < b.len);
+    }
+    return cmp;
+}
+
+/*
+ * strview_eq() --Test if two views have the same text.
+ */
+int strview_eq(StrView a, StrView b)
+{
+    return a.len == b.len && (a.len == 0 || memcmp(a.str, b.str, a.len) == 0);
+}
+
+/*
+ * strview_eq_str() --Test if a view has the same text as a string.
+ *
+ * Remarks:
+ * This doesn't need the string's length, so it's cheaper than
+ * strview_eq(view, strview(str)).
+ */
+int strview_eq_str(StrView view, const char *str)
+{
+    return strncmp(view.str, str, view.len) == 0 && str[view.len] == '\0';
+}
+
+/*
+ * strview_prefix() --Test if a view starts with some text.
+ */
+int strview_prefix(StrView view, StrView prefix)
+{
+    return view.len >= prefix.len
+        && memcmp(view.str, prefix.str, prefix.len) == 0;
+}
+
+/*
+ * strview_suffix() --Test if a view ends with some text.
+ */
+int strview_suffix(StrView view, StrView suffix)
+{
+    return view.len >= suffix.len
+        && memcmp(view.str + view.len - suffix.len, suffix.str,
+                  suffix.len) == 0;
+}
+
+/*
+ * strview_chr() --Find the first occurrence of a character in a view.
+ *
+ * Returns: (const char *)
+ * Success: the character; Failure: NULL.
+ */
+const char *strview_chr(StrView view, int ch)
+{
+    return view.len > 0 ? memchr(view.str, ch, view.len) : NULL;
+}
+
+/*
+ * strview_count() --Count the occurrences of a character in a view.
+ */
+size_t strview_count(StrView view, int ch)
+{
+    size_t n = 0;
+    const char *s;
+
+    while ((s = strview_chr(view, ch)) != NULL)
+    {
+        ++n;
+        view.len -= (size_t) (s - view.str) + 1;
+        view.str = s + 1;
+    }
+    return n;
+}
+
+/*
+ * strview_split() --Split the next field from a view.
+ *
+ * Parameters:
+ * rest      --specifies/updates the text remaining to be split
+ * delimiter --the delimiter character
+ * field     --returns the next field (without its delimiter)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (there are no more fields).
+ *
+ * Remarks:
+ * This splits the text as strsplit() does: n delimiters give n+1
+ * fields (some of which may be empty), so "a,,b," gives "a", "",
+ * "b" and "".  After the last field, rest's str is NULL:
+ *
+ *     StrView rest = strview(text), field;
+ *
+ *     while (strview_split(&rest, ',', &field))
+ *     {
+ *         ...
+ *     }
+ */
+int strview_split(StrView * rest, int delimiter, StrView * field)
+{
+    const char *end;
+
+    if (rest->str == NULL)
+    {
+        return 0;
+    }
+    field->str = rest->str;
+    if ((end = strview_chr(*rest, delimiter)) == NULL)
+    {
+        field->len = rest->len;
+        rest->str = NULL;              /* (that was the last field) */
+        rest->len = 0;
+        return 1;
+    }
+    field->len = (size_t) (end - rest->str);
+    rest->len -= field->len + 1;
+    rest->str = end + 1;
+    return 1;
+}
+
+/*
+ * strview_copy() --Copy a view into a NUL-terminated buffer.
+ *
+ * Parameters:
+ * view --specifies the text
+ * str  --returns the text, truncated (and NUL-terminated) to fit
+ * size --specifies the size of str
+ *
+ * Returns: (char *)
+ * str.
+ */
+char *strview_copy(StrView view, char *str, size_t size)
+{
+    if (size > 0)
+    {
+        size_t n = MIN(view.len, size - 1);
+
+        memcpy(str, view.str, n);
+        str[n] = '\0';
+    }
+    return str;
+}
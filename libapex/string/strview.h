@@ -0,0 +1,53 @@
+/*
+ * STRVIEW.H --Definitions for (pointer, length) string views.
+ *
+ * Contents:
+ * StrView{} --A span of text, not necessarily NUL-terminated.
+ *
+ * Remarks:
+ * A StrView refers to someone else's text: none of these functions
+ * allocate, copy (except strview_copy()) or modify it, so a parser
+ * can split, trim and convert a buffer in place, without strdup()
+ * or strlen().
+ */
+#ifndef STRVIEW_H
+#define STRVIEW_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    typedef struct StrView_t
+    {
+        const char *str;               /* the text (no NUL!) */
+        size_t len;
+    } StrView, *StrViewPtr;
+
+#define STRVIEW_LITERAL(str_) ((StrView) { (str_), sizeof(str_) - 1 })
+#define PRI_STRVIEW	"%.*s"
+#define STRVIEW_ARG(view_)	(int) (view_).len, (view_).str
+
+    StrView strview(const char *str);
+    StrView strview_n(const char *str, size_t len);
+    StrView strview_ltrim(StrView view);
+    StrView strview_rtrim(StrView view);
+    StrView strview_trim(StrView view);
+    int strview_cmp(StrView a, StrView b);
+    int strview_eq(StrView a, StrView b);
+    int strview_eq_str(StrView view, const char *str);
+    int strview_prefix(StrView view, StrView prefix);
+    int strview_suffix(StrView view, StrView suffix);
+    const char *strview_chr(StrView view, int ch);
+    size_t strview_count(StrView view, int ch);
+    int strview_split(StrView * rest, int delimiter, StrView * field);
+    char *strview_copy(StrView view, char *str, size_t size);
+
+    int strview_int(StrView view, int *result);
+    int strview_uint(StrView view, unsigned int *result);
+    int strview_double(StrView view, double *result);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* STRVIEW_H */
@@ -0,0 +1,404 @@
+/*
+ * ENUM-INDEX.C --Perfect-hash indexes for Enum lists.
+ *
+ * Contents:
+ * hash()                --Hash a name, with some seed.
+ * pow2()                --Return the smallest power of 2 >= n.
+ * place_bucket()        --Find a seed that places a bucket's names in free slots.
+ * build_hash()          --Build the two-level (perfect) name hash.
+ * build_names()         --Build the dense value->name table, if it's worth it.
+ * free_index()          --Free an index's resources.
+ * enum_index()          --Build (and register) the index for an Enum list.
+ * enum_index_lookup_()  --Find the registered index for an Enum list.
+ * enum_index_find()     --Find a name's item in an indexed Enum list.
+ * enum_index_name()     --Return the name of an Enum value, via its index.
+ *
+ * Remarks:
+ * The names are indexed with "hash and displace": each name's first
+ * hash selects a bucket, and each bucket has a seed, chosen when the
+ * index is built, for which the second hash sends all the bucket's
+ * names to distinct free slots.  So a lookup is two hashes, and one
+ * strcmp() to confirm the match.  The buckets are placed largest
+ * first, which (with twice as many slots as names) finds seeds
+ * quickly.
+ *
+ * If the values are dense enough, they also index a table of names.
+ *
+ * An Enum list is indexed once (typically at startup), by
+ * enum_index(); the index is registered (for the life of the
+ * program), and str_enum(), enum_value() and enum_name() use it
+ * whenever they're passed that list.  Lookups in the registry take
+ * no lock.  Duplicate names and values resolve to the first item,
+ * as for the linear scans.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/mem.h>
+#include <apex/symbol.h>
+
+enum
+{
+    ENUM_INDEX_MAX = 64,               /* max. registered indexes */
+    BUCKET_SEED = 0x2545f491,          /* seed for the first-level hash */
+    SEED_MAX = 1 << 20                 /* give up (and don't index) */
+};
+
+static const EnumIndex *registry[ENUM_INDEX_MAX];
+static size_t n_registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * hash() --Hash a name, with some seed.
+ *
+ * Remarks:
+ * This is FNV-1a, with the seed folded into the initial state, and
+ * a final avalanche so that the low bits are usable as-is.
+ */
+static inline uint64_t hash(const char *name, uint64_t seed)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+
+    for (const unsigned char *s = (const unsigned char *) name; *s != '\0';
+         ++s)
+    {
+        h = (h ^ *s) * 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * pow2() --Return the smallest power of 2 >= n.
+ */
+static size_t pow2(size_t n)
+{
+    size_t p = 1;
+
+    while (p < n)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+/*
+ * place_bucket() --Find a seed that places a bucket's names in free slots.
+ *
+ * Parameters:
+ * index    --the index being built
+ * bucket   --specifies the bucket
+ * member   --specifies the bucket's items
+ * n_member --specifies the number of items
+ * pos      --scratch space for the slots (n_member)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int place_bucket(EnumIndex * index, size_t bucket,
+                        const int *member, size_t n_member, size_t *pos)
+{
+    size_t mask = index->n_slot - 1;
+
+    for (unsigned int seed = 0; seed < SEED_MAX; ++seed)
+    {
+        size_t i, j = 0;
+
+        for (i = 0; i < n_member; ++i)
+        {
+            pos[i] = hash(index->item[member[i]].name, seed) & mask;
+            if (index->slot[pos[i]] >= 0)
+            {
+                break;                 /* occupied */
+            }
+            for (j = 0; j < i && pos[j] != pos[i]; ++j)
+            {
+                ;
+            }
+            if (j < i)
+            {
+                break;                 /* clashes within the bucket */
+            }
+        }
+        if (i == n_member)
+        {
+            for (i = 0; i < n_member; ++i)
+            {
+                index->slot[pos[i]] = member[i];
+            }
+            index->seed[bucket] = seed;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * build_hash() --Build the two-level (perfect) name hash.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The items are distributed into buckets by a counting sort (so
+ * each bucket lists its items in order, and any later duplicate
+ * names can be dropped), then the buckets are placed, largest first.
+ */
+static int build_hash(EnumIndex * index)
+{
+    size_t n = index->n_item;
+    size_t *start = MEM_NEW(MEM_SYMBOL, size_t, index->n_bucket + 1);
+    size_t *order = MEM_NEW(MEM_SYMBOL, size_t, index->n_bucket);
+    size_t *fill = MEM_NEW(MEM_SYMBOL, size_t, index->n_bucket);
+    size_t *pos = MEM_NEW(MEM_SYMBOL, size_t, n + 1);
+    int *member = MEM_NEW(MEM_SYMBOL, int, n + 1);
+    size_t *bucket_of = MEM_NEW(MEM_SYMBOL, size_t, n + 1);
+    int status = start != NULL && order != NULL && fill != NULL
+        && pos != NULL && member != NULL && bucket_of != NULL;
+
+    for (size_t i = 0; status && i < n; ++i)
+    {
+        bucket_of[i] = hash(index->item[i].name, BUCKET_SEED)
+            & (index->n_bucket - 1);
+        start[bucket_of[i] + 1] += 1;
+    }
+    for (size_t b = 0; status && b < index->n_bucket; ++b)
+    {
+        start[b + 1] += start[b];
+        order[b] = b;
+    }
+    for (size_t i = 0; status && i < n; ++i)
+    {
+        member[start[bucket_of[i]] + fill[bucket_of[i]]++] = (int) i;
+    }
+    /* insertion sort, by size (Enum lists are small) */
+    for (size_t i = 1; status && i < index->n_bucket; ++i)
+    {
+        size_t b = order[i], size = start[b + 1] - start[b], j;
+
+        for (j = i; j > 0 && start[order[j - 1] + 1] - start[order[j - 1]]
+             < size; --j)
+        {
+            order[j] = order[j - 1];
+        }
+        order[j] = b;
+    }
+    for (size_t i = 0; status && i < index->n_bucket; ++i)
+    {
+        size_t b = order[i];
+        int *m = member + start[b];
+        size_t n_member = 0;
+
+        for (size_t k = 0; k < start[b + 1] - start[b]; ++k)
+        {                              /* drop duplicate names */
+            size_t d;
+
+            for (d = 0; d < n_member
+                 && strcmp(index->item[m[d]].name, index->item[m[k]].name)
+                 != 0; ++d)
+            {
+                ;
+            }
+            if (d == n_member)
+            {
+                m[n_member++] = m[k];
+            }
+        }
+        status = n_member == 0 || place_bucket(index, b, m, n_member, pos);
+    }
+    mem_free(MEM_SYMBOL, start);
+    mem_free(MEM_SYMBOL, order);
+    mem_free(MEM_SYMBOL, fill);
+    mem_free(MEM_SYMBOL, pos);
+    mem_free(MEM_SYMBOL, member);
+    mem_free(MEM_SYMBOL, bucket_of);
+    return status;
+}
+
+/*
+ * build_names() --Build the dense value->name table, if it's worth it.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The table is only built if the range of values is no more than
+ * about twice the number of items.
+ */
+static int build_names(EnumIndex * index)
+{
+    long long min = 0, max = -1;
+
+    for (size_t i = 0; i < index->n_item; ++i)
+    {
+        int value = index->item[i].value;
+
+        if (i == 0 || value < min)
+        {
+            min = value;
+        }
+        if (i == 0 || value > max)
+        {
+            max = value;
+        }
+    }
+    if (max < min || (unsigned long long) (max - min)
+        >= 2 * (unsigned long long) index->n_item + 8)
+    {
+        return 1;                      /* (empty, or too sparse) */
+    }
+    index->min_value = (int) min;
+    index->n_name = (size_t) (max - min + 1);
+    if ((index->name = MEM_NEW(MEM_SYMBOL, const char *,
+                               index->n_name)) == NULL)
+    {
+        return 0;
+    }
+    for (size_t i = index->n_item; i-- > 0;)
+    {                                  /* (backwards: first one wins) */
+        index->name[index->item[i].value - index->min_value] =
+            index->item[i].name;
+    }
+    return 1;
+}
+
+/*
+ * free_index() --Free an index's resources.
+ */
+static void free_index(EnumIndex * index)
+{
+    if (index != NULL)
+    {
+        mem_free(MEM_SYMBOL, index->seed);
+        mem_free(MEM_SYMBOL, index->slot);
+        mem_free(MEM_SYMBOL, index->name);
+        mem_free(MEM_SYMBOL, index);
+    }
+}
+
+/*
+ * enum_index() --Build (and register) the index for an Enum list.
+ *
+ * Parameters:
+ * item --specifies the Enum list (NULL-terminated)
+ *
+ * Returns: (const EnumIndex *)
+ * Success: the index; Failure: NULL.
+ *
+ * Remarks:
+ * If the list is already indexed, its index is returned.  The list
+ * must not be changed once it's indexed.  If the index can't be
+ * built (or there are too many), the Enum functions just fall back
+ * to scanning the list.
+ */
+const EnumIndex *enum_index(const Enum item[])
+{
+    EnumIndex *index;
+
+    pthread_mutex_lock(&registry_lock);
+    if ((index = (EnumIndex *) enum_index_lookup_(item)) != NULL
+        || n_registry >= ENUM_INDEX_MAX)
+    {
+        pthread_mutex_unlock(&registry_lock);
+        return index;
+    }
+    if ((index = MEM_NEW(MEM_SYMBOL, EnumIndex, 1)) != NULL)
+    {
+        index->item = item;
+        while (item[index->n_item].name != NULL)
+        {
+            ++index->n_item;
+        }
+        index->n_bucket = pow2(index->n_item / 2 + 1);
+        index->n_slot = pow2(2 * index->n_item + 1);
+        index->seed = MEM_NEW(MEM_SYMBOL, unsigned int, index->n_bucket);
+        index->slot = mem_alloc(MEM_SYMBOL, index->n_slot * sizeof(int));
+        if (index->seed == NULL || index->slot == NULL)
+        {
+            free_index(index);
+            index = NULL;
+        }
+        else
+        {
+            memset(index->slot, 0xff, index->n_slot * sizeof(int));   /* -1 */
+            if (!build_hash(index) || !build_names(index))
+            {
+                free_index(index);
+                index = NULL;
+            }
+        }
+    }
+    if (index != NULL)
+    {
+        registry[n_registry] = index;
+        __atomic_store_n(&n_registry, n_registry + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return index;
+}
+
+/*
+ * enum_index_lookup_() --Find the registered index for an Enum list.
+ *
+ * Returns: (const EnumIndex *)
+ * Success: the index; Failure: NULL (the list isn't indexed).
+ */
+const EnumIndex *enum_index_lookup_(const Enum item[])
+{
+    size_t n = __atomic_load_n(&n_registry, __ATOMIC_ACQUIRE);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (registry[i]->item == item)
+        {
+            return registry[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * enum_index_find() --Find a name's item in an indexed Enum list.
+ *
+ * Returns: (int)
+ * Success: the item's offset in the list; Failure: -1.
+ */
+int enum_index_find(const EnumIndex * index, const char *name)
+{
+    size_t bucket = hash(name, BUCKET_SEED) & (index->n_bucket - 1);
+    size_t slot = hash(name, index->seed[bucket]) & (index->n_slot - 1);
+    int i = index->slot[slot];
+
+    return i >= 0 && strcmp(index->item[i].name, name) == 0 ? i : -1;
+}
+
+/*
+ * enum_index_name() --Return the name of an Enum value, via its index.
+ *
+ * Returns: (const char *)
+ * Success: the (first) name with that value; Failure: NULL.
+ */
+const char *enum_index_name(const EnumIndex * index, int value)
+{
+    if (index->n_name > 0)
+    {
+        long long offset = (long long) value - index->min_value;
+
+        return offset >= 0 && (unsigned long long) offset < index->n_name
+            ? index->name[offset] : NULL;
+    }
+    for (size_t i = 0; i < index->n_item; ++i)
+    {
+        if (index->item[i].value == value)
+        {
+            return index->item[i].name;
+        }
+    }
+    return NULL;
+}
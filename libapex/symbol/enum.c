@@ -10,10 +10,14 @@
  * Remarks:
  * Just some lookup convenience functions.
  * These rely/assume that the Enum array is well/NULL terminated.
+ * Lists that have been indexed by enum_index() are looked up via
+ * their (perfect hash) index; others are scanned.
  *
  */
 #include <apex.h>                       /* Windows_NT requires this before system headers */
 
+#include <stdint.h>
+
 #include <apex/estring.h>
 #include <apex/symbol.h>
 
@@ -44,6 +48,19 @@ int enum_cmp(const Enum * a, const Enum * b)
  */
 int str_enum(const char *name, size_t n_items, Enum item[], int *valp)
 {
+    const EnumIndex *index = enum_index_lookup_(item);
+
+    if (index != NULL)
+    {
+        int i = enum_index_find(index, name);
+
+        if (i >= 0 && (size_t) i < n_items)
+        {
+            *valp = item[i].value;
+            return 1;
+        }
+        return 0;
+    }
     for (size_t i = 0; i < n_items; ++i)
     {
         if (item[i].name == NULL)
@@ -66,7 +83,7 @@ int enum_value(const char *name, const EnumPtr item)
 {
     int value = -1;
 
-    str_enum(name, 1000, item, &value);
+    str_enum(name, SIZE_MAX, item, &value);
     return value;
 }
 
@@ -82,11 +99,17 @@ int enum_value(const char *name, const EnumPtr item)
  *
  * Remarks:
  * This does a simple linear scan, because the tables are known to be
- * small.  binsearch() could work for larger tables.  I'm not assuming
- * the IDs are consecutive ints, so direct addressing is not used.
+ * small.  I'm not assuming the IDs are consecutive ints, so direct
+ * addressing is only used by indexed tables (see enum_index()).
  */
 const char *enum_name(int value, EnumPtr item)
 {
+    const EnumIndex *index = enum_index_lookup_(item);
+
+    if (index != NULL)
+    {
+        return enum_index_name(index, value);
+    }
     for (size_t i = 0; item[i].name != NULL; ++i)
     {
         if (item[i].value == value)
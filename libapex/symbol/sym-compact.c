@@ -0,0 +1,185 @@
+/*
+ * SYM-COMPACT.C --Copy a symbol tree into a single allocation.
+ *
+ * Contents:
+ * sym_compact()      --Copy a symbol tree into a single contiguous block.
+ * sym_compact_free() --Free a compact symbol tree.
+ *
+ * Remarks:
+ * A compact tree is laid out depth-first: each table (a NULL_SYMBOL-
+ * or NULL_ATOM-terminated array) is followed immediately by the
+ * subtrees of its struct and list members, in order, so a sym_get()
+ * walk moves forward through memory.  All the strings (names and
+ * values) follow the tables, so they don't dilute them.
+ *
+ * A compact tree is a plain block (not a vector), so it's freed with a
+ * single sym_compact_free(), and can't be grown with vector_insert()
+ * (e.g. by ini_load()); to change it, modify the original tree and
+ * compact it again.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/symbol.h>
+
+/*
+ * CompactLayout --The state of a compaction in progress.
+ */
+typedef struct CompactLayout_t
+{
+    size_t table_size;                 /* bytes of tables */
+    size_t string_size;                /* bytes of strings */
+    char *table;                       /* next table */
+    char *string;                      /* next string */
+} CompactLayout, *CompactLayoutPtr;
+
+/*
+ * size_value() --Count the space needed for a value's children.
+ */
+static void size_value(CompactLayoutPtr layout, Type type, Value value)
+{
+    size_t n = 0;
+
+    switch (type)
+    {
+    case STRING_TYPE:
+        layout->string_size += strlen(value.string) + 1;
+        break;
+    case STRUCT_TYPE:
+        for (; value.field[n].type != VOID_TYPE; ++n)
+        {
+            layout->string_size += strlen(value.field[n].name) + 1;
+            size_value(layout, value.field[n].type, value.field[n].value);
+        }
+        layout->table_size += (n + 1) * sizeof(Symbol);
+        break;
+    case LIST_TYPE:
+        for (; value.list[n].type != VOID_TYPE; ++n)
+        {
+            size_value(layout, value.list[n].type, value.list[n].value);
+        }
+        layout->table_size += (n + 1) * sizeof(Atom);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * copy_string() --Copy a string into the layout's string area.
+ */
+static char *copy_string(CompactLayoutPtr layout, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = layout->string;
+
+    memcpy(copy, str, len);
+    layout->string += len;
+    return copy;
+}
+
+/*
+ * copy_value() --Copy a value (and its children) into the layout.
+ *
+ * Returns: (Value)
+ * The value, with its pointers into the layout.
+ */
+static Value copy_value(CompactLayoutPtr layout, Type type, Value value)
+{
+    Value copy = value;
+    size_t n = 0;
+
+    switch (type)
+    {
+    case STRING_TYPE:
+        copy.string = copy_string(layout, value.string);
+        break;
+    case STRUCT_TYPE:
+        while (value.field[n].type != VOID_TYPE)
+        {
+            ++n;
+        }
+        copy.field = (SymbolPtr) layout->table;
+        layout->table += (n + 1) * sizeof(Symbol);
+        copy.field[n] = value.field[n];        /* (the terminator) */
+        for (size_t i = 0; i < n; ++i)
+        {
+            SymbolPtr sym = &value.field[i];
+
+            copy.field[i].type = sym->type;
+            copy.field[i].name = copy_string(layout, sym->name);
+            copy.field[i].value = copy_value(layout, sym->type, sym->value);
+        }
+        break;
+    case LIST_TYPE:
+        while (value.list[n].type != VOID_TYPE)
+        {
+            ++n;
+        }
+        copy.list = (AtomPtr) layout->table;
+        layout->table += (n + 1) * sizeof(Atom);
+        copy.list[n] = value.list[n];
+        for (size_t i = 0; i < n; ++i)
+        {
+            AtomPtr atom = &value.list[i];
+
+            copy.list[i].type = atom->type;
+            copy.list[i].value = copy_value(layout, atom->type, atom->value);
+        }
+        break;
+    default:
+        break;
+    }
+    return copy;
+}
+
+/*
+ * sym_compact() --Copy a symbol tree into a single contiguous block.
+ *
+ * Parameters:
+ * symtab --the symbol tree to copy
+ *
+ * Returns: (SymbolPtr)
+ * Success: the compact copy; Failure: NULL.
+ *
+ * Remarks:
+ * The original tree is unchanged (and still owned by the caller).
+ */
+SymbolPtr sym_compact(SymbolPtr symtab)
+{
+    CompactLayout layout = { 0 };
+    Value value = {.field = symtab };
+    char *block;
+
+    if (symtab == NULL)
+    {
+        return NULL;                   /* error: no symtab! */
+    }
+    size_value(&layout, STRUCT_TYPE, value);
+    if ((block = malloc(layout.table_size + layout.string_size)) == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    layout.table = block;
+    layout.string = block + layout.table_size;
+    return copy_value(&layout, STRUCT_TYPE, value).field;
+}
+
+/*
+ * sym_compact_free() --Free a compact symbol tree.
+ *
+ * Remarks:
+ * This also drops any name indexes (see sym_index()) built on the
+ * tree, and invalidates bound paths.
+ */
+void sym_compact_free(SymbolPtr symtab)
+{
+    if (symtab != NULL)
+    {
+        sym_unindex(symtab);
+        sym_changed();
+        free(symtab);
+    }
+}
@@ -0,0 +1,644 @@
+/*
+ * SYM-IMAGE.C --Flat, relocatable binary images of symbol trees.
+ *
+ * Contents:
+ * SymImageHeader{}  --The header of a symbol image file.
+ * SymImageEntry{}   --A symbol (or list item) in an image.
+ * SymImageNode{}    --A struct or list in an image.
+ * sym_image_write() --Write a symbol tree to an image file.
+ * sym_image_open()  --Map an image file (read-only) for querying.
+ * sym_image_close() --Unmap an image file.
+ * sym_image_get()   --Find a value in an image by a (compiled) symbol path.
+ *
+ * Remarks:
+ * An image is a symbol tree flattened into a single block of memory,
+ * with offsets (from the start of the image) instead of pointers, so
+ * that it can be mapped anywhere, and shared by any number of
+ * processes via the page cache.  Opening an image only checks its
+ * header; queries walk the mapped image directly, and return strings
+ * that point into it.
+ *
+ * Each struct (or list) is a node: a count and the offset of a sorted
+ * index, followed by its entries in their original order.  The index
+ * lists the entries sorted by name (and then position), so struct
+ * lookups are a binary search that finds the first of any duplicate
+ * names, as sym_get() does.  Strings are stored once, however many
+ * times they're used.
+ *
+ * Images use the host's byte order, and the header records it;
+ * sym_image_open() rejects images written by another byte order (or
+ * version) with EINVAL.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <apex/hash.h>
+#include <apex/symbol.h>
+
+#define SYM_IMAGE_MAGIC "APEXSYM"      /* (with the NUL: 8 bytes) */
+#define SYM_IMAGE_VERSION 1
+#define SYM_IMAGE_ORDER 0x01020304     /* reads differently if swapped */
+#define SYM_IMAGE_ALIGN 8              /* all nodes are aligned to this */
+
+/*
+ * SymImageHeader{} --The header of a symbol image file.
+ */
+typedef struct SymImageHeader_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t order;                    /* SYM_IMAGE_ORDER, in host order */
+    uint64_t size;                     /* the size of the whole image */
+    uint64_t root;                     /* offset of the root struct node */
+} SymImageHeader;
+
+/*
+ * SymImageEntry{} --A symbol (or list item) in an image.
+ */
+typedef struct SymImageEntry_t
+{
+    uint32_t type;                     /* Type */
+    uint32_t name;                     /* offset of the name (0: none) */
+    union
+    {
+        double real;
+        int64_t integer;
+        uint64_t offset;               /* string or node offset */
+    } value;
+} SymImageEntry;
+
+/*
+ * SymImageNode{} --A struct or list in an image.
+ */
+typedef struct SymImageNode_t
+{
+    uint32_t n_entry;
+    uint32_t index;                    /* offset of the sorted index */
+    SymImageEntry entry[];
+} SymImageNode;
+
+/*
+ * ImageBuffer --The image, while it's being built.
+ */
+typedef struct ImageBuffer_t
+{
+    char *base;
+    size_t size;
+    size_t max_size;
+    OHashPtr strings;                  /* ImageString, by content */
+} ImageBuffer, *ImageBufferPtr;
+
+typedef struct ImageString_t
+{
+    const char *str;
+    uint64_t offset;
+} ImageString, *ImageStringPtr;
+
+typedef struct IndexItem_t
+{
+    const char *name;
+    uint32_t slot;
+} IndexItem;
+
+static uint64_t write_struct(ImageBufferPtr image, SymbolPtr symtab);
+static uint64_t write_list(ImageBufferPtr image, AtomPtr list);
+
+/*
+ * image_alloc() --Allocate some (zeroed, aligned) space in the image.
+ *
+ * Returns: (uint64_t)
+ * Success: the offset of the space; Failure: 0.
+ */
+static uint64_t image_alloc(ImageBufferPtr image, size_t size)
+{
+    size_t offset = (image->size + SYM_IMAGE_ALIGN - 1)
+        & ~(size_t) (SYM_IMAGE_ALIGN - 1);
+
+    if (offset + size > UINT32_MAX)
+    {
+        errno = EFBIG;
+        return 0;                      /* error: too big for 32-bit offsets */
+    }
+    if (offset + size > image->max_size)
+    {
+        size_t max_size = image->max_size * 2;
+        char *base;
+
+        while (max_size < offset + size)
+        {
+            max_size *= 2;
+        }
+        if ((base = realloc(image->base, max_size)) == NULL)
+        {
+            return 0;                  /* error: realloc failed */
+        }
+        image->base = base;
+        image->max_size = max_size;
+    }
+    memset(image->base + image->size, 0, offset + size - image->size);
+    image->size = offset + size;
+    return offset;
+}
+
+static unsigned long string_hash(char *data)
+{
+    return hash_key_wy((char *) ((ImageStringPtr) data)->str);
+}
+
+static int string_cmp(const void *data, const void *key)
+{
+    return strcmp(((const ImageString *) data)->str,
+                  ((const ImageString *) key)->str);
+}
+
+static void *free_string(void *data, void *UNUSED(user_data))
+{
+    free(data);
+    return NULL;                       /* (visit them all) */
+}
+
+/*
+ * write_string() --Add a string to the image (once).
+ *
+ * Returns: (uint64_t)
+ * Success: the offset of the string; Failure: 0.
+ */
+static uint64_t write_string(ImageBufferPtr image, const char *str)
+{
+    ImageString key = {.str = str };
+    ImageStringPtr item;
+    size_t len = strlen(str) + 1;
+
+    if ((item = ohash_find(image->strings, string_cmp, &key)) != NULL)
+    {
+        return item->offset;
+    }
+    if ((item = malloc(sizeof(*item))) == NULL)
+    {
+        return 0;
+    }
+    item->str = str;
+    if ((item->offset = image_alloc(image, len)) == 0
+        || !ohash_insert(image->strings, item))
+    {
+        free(item);
+        return 0;
+    }
+    memcpy(image->base + item->offset, str, len);
+    return item->offset;
+}
+
+/*
+ * index_cmp() --Compare index items by name, then position.
+ */
+static int index_cmp(const void *a, const void *b)
+{
+    const IndexItem *ia = a;
+    const IndexItem *ib = b;
+    int cmp = strcmp(ia->name, ib->name);
+
+    if (cmp != 0)
+    {
+        return cmp;
+    }
+    return (ia->slot > ib->slot) - (ia->slot < ib->slot);
+}
+
+/*
+ * write_value() --Write a value (and its children) into an entry.
+ *
+ * Remarks:
+ * The entry is addressed by offset, because writing the children
+ * may move the image.
+ */
+static int write_value(ImageBufferPtr image, uint64_t entry_offset,
+                       Type type, Value value)
+{
+    uint64_t offset = 0;
+    SymImageEntry *entry;
+
+    switch (type)
+    {
+    case STRING_TYPE:
+        offset = write_string(image, value.string);
+        break;
+    case STRUCT_TYPE:
+        offset = write_struct(image, value.field);
+        break;
+    case LIST_TYPE:
+        offset = write_list(image, value.list);
+        break;
+    default:
+        break;
+    }
+    entry = (SymImageEntry *) (image->base + entry_offset);
+    entry->type = (uint32_t) type;
+    switch (type)
+    {
+    case REAL_TYPE:
+        entry->value.real = value.real;
+        return 1;
+    case INTEGER_TYPE:
+        entry->value.integer = (int64_t) value.integer;
+        return 1;
+    case STRING_TYPE:
+    case STRUCT_TYPE:
+    case LIST_TYPE:
+        entry->value.offset = offset;
+        return offset != 0;
+    default:
+        return 1;
+    }
+}
+
+/*
+ * write_node() --Allocate a node of n entries.
+ */
+static uint64_t write_node(ImageBufferPtr image, size_t n)
+{
+    uint64_t offset = image_alloc(image, sizeof(SymImageNode)
+                                  + n * sizeof(SymImageEntry));
+
+    if (offset != 0)
+    {
+        ((SymImageNode *) (image->base + offset))->n_entry = (uint32_t) n;
+    }
+    return offset;
+}
+
+/*
+ * write_struct() --Write a struct node (and its children).
+ *
+ * Returns: (uint64_t)
+ * Success: the offset of the node; Failure: 0.
+ */
+static uint64_t write_struct(ImageBufferPtr image, SymbolPtr symtab)
+{
+    size_t n = 0;
+    uint64_t node, index;
+    IndexItem *item;
+
+    while (symtab[n].type != VOID_TYPE)
+    {
+        ++n;
+    }
+    if ((node = write_node(image, n)) == 0
+        || (index = image_alloc(image, (n + 1) * sizeof(uint32_t))) == 0
+        || (item = malloc((n + 1) * sizeof(*item))) == NULL)
+    {
+        return 0;                      /* error: allocation failed */
+    }
+    ((SymImageNode *) (image->base + node))->index = (uint32_t) index;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t entry = node + offsetof(SymImageNode, entry)
+            + i * sizeof(SymImageEntry);
+        uint64_t name = write_string(image, symtab[i].name);
+
+        if (name == 0
+            || !write_value(image, entry, symtab[i].type, symtab[i].value))
+        {
+            free(item);
+            return 0;
+        }
+        ((SymImageEntry *) (image->base + entry))->name = (uint32_t) name;
+        item[i].name = symtab[i].name;
+        item[i].slot = (uint32_t) i;
+    }
+    qsort(item, n, sizeof(*item), index_cmp);
+    for (size_t i = 0; i < n; ++i)
+    {
+        ((uint32_t *) (image->base + index))[i] = item[i].slot;
+    }
+    free(item);
+    return node;
+}
+
+/*
+ * write_list() --Write a list node (and its children).
+ *
+ * Returns: (uint64_t)
+ * Success: the offset of the node; Failure: 0.
+ */
+static uint64_t write_list(ImageBufferPtr image, AtomPtr list)
+{
+    size_t n = 0;
+    uint64_t node;
+
+    while (list[n].type != VOID_TYPE)
+    {
+        ++n;
+    }
+    if ((node = write_node(image, n)) == 0)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t entry = node + offsetof(SymImageNode, entry)
+            + i * sizeof(SymImageEntry);
+
+        if (!write_value(image, entry, list[i].type, list[i].value))
+        {
+            return 0;
+        }
+    }
+    return node;
+}
+
+/*
+ * sym_image_write() --Write a symbol tree to an image file.
+ *
+ * Parameters:
+ * path --the name of the file to create
+ * symtab --the symbol tree
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ *
+ * Remarks:
+ * The file is written to a temporary name and then renamed, so that
+ * processes that have the old image mapped keep a consistent copy.
+ */
+int sym_image_write(const char *path, SymbolPtr symtab)
+{
+    ImageBuffer image = {.max_size = 4096 };
+    SymImageHeader *header;
+    uint64_t root = 0;
+    char *tmp_path = NULL;
+    FILE *fp = NULL;
+    int status = 0;
+
+    if (path == NULL || symtab == NULL)
+    {
+        errno = EINVAL;
+        return 0;                      /* error: no path/symtab! */
+    }
+    if ((image.base = calloc(1, image.max_size)) == NULL
+        || (image.strings = ohash_new(string_hash, 256)) == NULL)
+    {
+        goto done;
+    }
+    image.size = sizeof(*header);      /* (offset 0 means "failed") */
+    if ((root = write_struct(&image, symtab)) == 0)
+    {
+        goto done;
+    }
+    header = (SymImageHeader *) image.base;
+    memcpy(header->magic, SYM_IMAGE_MAGIC, sizeof(header->magic));
+    header->version = SYM_IMAGE_VERSION;
+    header->order = SYM_IMAGE_ORDER;
+    header->size = image.size;
+    header->root = root;
+
+    if ((tmp_path = malloc(strlen(path) + 5)) == NULL)
+    {
+        goto done;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+    if ((fp = fopen(tmp_path, "wb")) == NULL)
+    {
+        goto done;
+    }
+    if (fwrite(image.base, 1, image.size, fp) != image.size)
+    {
+        fclose(fp);
+        remove(tmp_path);
+        goto done;
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+    {
+        remove(tmp_path);
+        goto done;
+    }
+    status = 1;
+  done:
+    if (image.strings != NULL)
+    {
+        ohash_visit(image.strings, free_string, NULL);
+        ohash_free(image.strings);
+    }
+    free(tmp_path);
+    free(image.base);
+    return status;
+}
+
+/*
+ * sym_image_open() --Map an image file (read-only) for querying.
+ *
+ * Parameters:
+ * image --returns the image (owned by caller)
+ * path --the name of the image file
+ *
+ * Returns: (SymImagePtr)
+ * Success: image; Failure: NULL (errno is set).
+ */
+SymImagePtr sym_image_open(SymImagePtr image, const char *path)
+{
+    struct stat st;
+    const SymImageHeader *header;
+    void *base;
+    int fd;
+
+    if (image == NULL || path == NULL)
+    {
+        errno = EINVAL;
+        return NULL;                   /* error: no image/path! */
+    }
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    if ((size_t) st.st_size < sizeof(*header))
+    {
+        close(fd);
+        errno = EINVAL;
+        return NULL;                   /* error: not an image */
+    }
+    base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);                         /* (the mapping keeps the file) */
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+    header = base;
+    if (memcmp(header->magic, SYM_IMAGE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SYM_IMAGE_VERSION
+        || header->order != SYM_IMAGE_ORDER
+        || header->size != (uint64_t) st.st_size
+        || header->root < sizeof(*header)
+        || header->root + sizeof(SymImageNode) > header->size)
+    {
+        munmap(base, (size_t) st.st_size);
+        errno = EINVAL;
+        return NULL;                   /* error: bad/foreign image */
+    }
+    image->base = base;
+    image->size = (size_t) st.st_size;
+    return image;
+}
+
+/*
+ * sym_image_close() --Unmap an image file.
+ */
+void sym_image_close(SymImagePtr image)
+{
+    if (image != NULL && image->base != NULL)
+    {
+        munmap(image->base, image->size);
+        image->base = NULL;
+        image->size = 0;
+    }
+}
+
+/*
+ * image_node() --Return the node at some offset, if it's in bounds.
+ */
+static const SymImageNode *image_node(SymImagePtr image, uint64_t offset)
+{
+    const SymImageNode *node;
+
+    if (offset < sizeof(SymImageHeader)
+        || offset + sizeof(SymImageNode) > image->size)
+    {
+        return NULL;
+    }
+    node = (const SymImageNode *) ((const char *) image->base + offset);
+    if (offset + sizeof(SymImageNode)
+        + node->n_entry * sizeof(SymImageEntry) > image->size)
+    {
+        return NULL;                   /* error: corrupt image */
+    }
+    return node;
+}
+
+/*
+ * find_name() --Find the first entry of a struct node with some name.
+ */
+static const SymImageEntry *find_name(SymImagePtr image,
+                                      const SymImageNode *node,
+                                      const char *name)
+{
+    const char *base = image->base;
+    const uint32_t *index = (const uint32_t *) (base + node->index);
+    size_t lo = 0, hi = node->n_entry;
+
+    if (node->index + (uint64_t) node->n_entry * sizeof(*index)
+        > image->size)
+    {
+        return NULL;                   /* error: corrupt image */
+    }
+    while (lo < hi)
+    {                                  /* lower bound of name */
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(base + node->entry[index[mid]].name, name) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo < node->n_entry
+        && strcmp(base + node->entry[index[lo]].name, name) == 0)
+    {
+        return &node->entry[index[lo]];
+    }
+    return NULL;
+}
+
+/*
+ * sym_image_get() --Find a value in an image by a (compiled) symbol path.
+ *
+ * Parameters:
+ * image --the mapped image
+ * path --the path of the symbol to find
+ * value --returns the symbol's value
+ *
+ * Returns: (Type)
+ * Success: the type of symbol; Failure: VOID_TYPE.
+ *
+ * Remarks:
+ * String values point into the image, and are valid until it's
+ * closed.  Struct and list values can't be returned as pointers (the
+ * image has no Symbol arrays), so for these only the type is set.
+ */
+Type sym_image_get(SymImagePtr image, AtomPtr path, ValuePtr value)
+{
+    const SymImageHeader *header = image->base;
+    const SymImageNode *node = image_node(image, header->root);
+    Type type = STRUCT_TYPE;           /* (the root) */
+
+    if (path->type == VOID_TYPE)
+    {
+        return VOID_TYPE;              /* error: empty path */
+    }
+    for (; path->type != VOID_TYPE; ++path)
+    {
+        const SymImageEntry *entry = NULL;
+
+        if (node == NULL)
+        {
+            return VOID_TYPE;          /* error: at a leaf, or corrupt */
+        }
+        if (type == STRUCT_TYPE && path->type == STRING_TYPE)
+        {
+            entry = find_name(image, node, path->value.string);
+        }
+        else if (type == LIST_TYPE && path->type == INTEGER_TYPE
+                 && path->value.integer >= 0
+                 && (uint64_t) path->value.integer < node->n_entry)
+        {
+            entry = &node->entry[path->value.integer];
+        }
+        if (entry == NULL)
+        {
+            return VOID_TYPE;          /* error: no such name/item */
+        }
+        type = (Type) entry->type;
+        switch (type)
+        {
+        case STRUCT_TYPE:
+        case LIST_TYPE:
+            node = image_node(image, entry->value.offset);
+            value->field = NULL;
+            break;
+        case STRING_TYPE:
+            if (entry->value.offset >= image->size)
+            {
+                return VOID_TYPE;      /* error: corrupt image */
+            }
+            value->string = (char *) image->base + entry->value.offset;
+            node = NULL;
+            break;
+        case REAL_TYPE:
+            value->real = entry->value.real;
+            node = NULL;
+            break;
+        case INTEGER_TYPE:
+            value->integer = (SYMBOL_INT) entry->value.integer;
+            node = NULL;
+            break;
+        default:
+            return VOID_TYPE;          /* error: corrupt image */
+        }
+    }
+    return type;
+}
@@ -0,0 +1,283 @@
+/*
+ * SYM-INDEX.C --Hashed name lookup for large symbol tables.
+ *
+ * Contents:
+ * sym_index()        --Build name indexes for a symbol table (recursively).
+ * sym_unindex()      --Remove a symbol table's name indexes (recursively).
+ * sym_index_drop_()  --Remove a single table's index.
+ * sym_index_find_()  --Find a named symbol in a table.
+ *
+ * Remarks:
+ * A symbol table is a plain NULL_SYMBOL-terminated array (often a
+ * static one), so there's nowhere in the table itself to keep an
+ * index.  Instead, each indexed table has an OHash of its symbols by
+ * name, and a registry (another OHash) maps the table's address to
+ * that index.  sym_get() checks the registry, if any table has been
+ * indexed, and falls back to a linear scan otherwise; the registry
+ * lookup is a pointer hash, which is much cheaper than scanning a
+ * table of more than a few entries.
+ *
+ * Indexes are built once, after the table is loaded: a table that is
+ * modified (e.g. by vector_insert()) must be unindexed first, and
+ * re-indexed afterwards.  sym_free_value() removes the index of any
+ * table it frees.  Building and removing indexes is not thread-safe,
+ * but indexed lookups are (as for unindexed ones).
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <apex/hash.h>
+#include <apex/mem.h>
+#include <apex/symbol.h>
+
+#define SYM_INDEX_MIN 16               /* smaller tables are just scanned */
+
+typedef struct SymbolIndex_t
+{
+    SymbolPtr symtab;                  /* the indexed table */
+    OHashPtr name;                     /* the table's symbols, by name */
+} SymbolIndex, *SymbolIndexPtr;
+
+static OHashPtr sym_registry;          /* SymbolIndex, by table address */
+
+/*
+ * index_hash() --HashProc for the registry: hash the table address.
+ */
+static unsigned long index_hash(char *data)
+{
+    uintptr_t x = (uintptr_t) ((SymbolIndexPtr) data)->symtab;
+
+    x ^= x >> 17;                      /* (mix the pointer bits) */
+    x *= (uintptr_t) 0x9e3779b97f4a7c15ull;
+    return (unsigned long) (x ^ (x >> 29));
+}
+
+/*
+ * index_cmp() --CompareProc for the registry.
+ */
+static int index_cmp(const void *data, const void *key)
+{
+    return ((const SymbolIndex *) data)->symtab
+        != ((const SymbolIndex *) key)->symtab;
+}
+
+/*
+ * name_hash() --HashProc for a table's index: hash the symbol name.
+ */
+static unsigned long name_hash(char *data)
+{
+    return hash_key_wy(((SymbolPtr) data)->name);
+}
+
+/*
+ * name_cmp() --CompareProc for a table's index.
+ */
+static int name_cmp(const void *data, const void *key)
+{
+    const char *name = ((const Symbol *) data)->name;
+    const char *key_name = ((const Symbol *) key)->name;
+
+    return name != key_name && strcmp(name, key_name) != 0;
+}
+
+/*
+ * index_table() --Build the index for a single table.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int index_table(SymbolPtr symtab, size_t n)
+{
+    SymbolIndex key = {.symtab = symtab };
+    SymbolIndexPtr index;
+
+    if (sym_registry == NULL
+        && (sym_registry = ohash_new(index_hash, 64)) == NULL)
+    {
+        return 0;                      /* failure: no registry */
+    }
+    if (ohash_find(sym_registry, index_cmp, &key) != NULL)
+    {
+        return 1;                      /* success: already indexed */
+    }
+    if ((index = mem_alloc(MEM_SYMBOL, sizeof(*index))) == NULL)
+    {
+        return 0;
+    }
+    index->symtab = symtab;
+    if ((index->name = ohash_new(name_hash, n * 2)) == NULL)
+    {
+        mem_free(MEM_SYMBOL, index);
+        return 0;                      /* failure: no index */
+    }
+    for (size_t i = 0; i < n; ++i)
+    {                                  /* (first of any duplicates wins) */
+        if (ohash_find(index->name, name_cmp, &symtab[i]) == NULL
+            && !ohash_insert(index->name, &symtab[i]))
+        {
+            ohash_free(index->name);
+            mem_free(MEM_SYMBOL, index);
+            return 0;
+        }
+    }
+    if (!ohash_insert(sym_registry, index))
+    {
+        ohash_free(index->name);
+        mem_free(MEM_SYMBOL, index);
+        return 0;
+    }
+    return 1;
+}
+
+static int index_list(AtomPtr list, size_t min_size, int add);
+
+/*
+ * index_tree() --Add or remove the indexes of a table and its children.
+ */
+static int index_tree(SymbolPtr symtab, size_t min_size, int add)
+{
+    size_t n = 0;
+    int status = 1;
+
+    for (; symtab[n].type != VOID_TYPE; ++n)
+    {
+        if (symtab[n].type == STRUCT_TYPE)
+        {
+            status &= index_tree(symtab[n].value.field, min_size, add);
+        }
+        else if (symtab[n].type == LIST_TYPE)
+        {
+            status &= index_list(symtab[n].value.list, min_size, add);
+        }
+    }
+    if (!add)
+    {
+        sym_index_drop_(symtab);
+    }
+    else if (n >= min_size)
+    {
+        status &= index_table(symtab, n);
+    }
+    return status;
+}
+
+/*
+ * index_list() --Add or remove the indexes of the tables in a list.
+ */
+static int index_list(AtomPtr list, size_t min_size, int add)
+{
+    int status = 1;
+
+    for (; list->type != VOID_TYPE; ++list)
+    {
+        if (list->type == STRUCT_TYPE)
+        {
+            status &= index_tree(list->value.field, min_size, add);
+        }
+        else if (list->type == LIST_TYPE)
+        {
+            status &= index_list(list->value.list, min_size, add);
+        }
+    }
+    return status;
+}
+
+/*
+ * sym_index() --Build name indexes for a symbol table (recursively).
+ *
+ * Parameters:
+ * symtab --the symbol table
+ * min_size --the smallest table to index (0: a default of 16)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (some tables couldn't be indexed).
+ *
+ * Remarks:
+ * Every table in the tree (including the tables of structs in lists)
+ * with at least min_size symbols is indexed; sym_get() then finds
+ * names in those tables by hash lookup, rather than strcmp() scan.
+ * Tables that couldn't be indexed are still searched correctly.
+ */
+int sym_index(SymbolPtr symtab, size_t min_size)
+{
+    if (symtab == NULL)
+    {
+        return 0;                      /* failure: no table! */
+    }
+    return index_tree(symtab, min_size != 0 ? min_size : SYM_INDEX_MIN, 1);
+}
+
+/*
+ * sym_unindex() --Remove a symbol table's name indexes (recursively).
+ *
+ * Parameters:
+ * symtab --the symbol table
+ */
+void sym_unindex(SymbolPtr symtab)
+{
+    if (symtab != NULL && sym_registry != NULL)
+    {
+        index_tree(symtab, 0, 0);
+    }
+}
+
+/*
+ * sym_index_drop_() --Remove a single table's index.
+ *
+ * Remarks:
+ * When the last index is removed, the registry is freed, so that
+ * sym_get() goes back to a simple scan.
+ */
+void sym_index_drop_(SymbolPtr symtab)
+{
+    SymbolIndex key = {.symtab = symtab };
+    SymbolIndexPtr index;
+
+    if (sym_registry != NULL
+        && (index = ohash_remove(sym_registry, index_cmp, &key)) != NULL)
+    {
+        ohash_free(index->name);
+        mem_free(MEM_SYMBOL, index);
+        if (sym_registry->n_items == 0)
+        {
+            ohash_free(sym_registry);
+            sym_registry = NULL;
+        }
+    }
+}
+
+/*
+ * sym_index_find_() --Find a named symbol in a table.
+ *
+ * Parameters:
+ * symtab --the symbol table
+ * name --the name to find
+ *
+ * Returns: (SymbolPtr)
+ * Success: the (first) symbol with that name; Failure: NULL.
+ */
+SymbolPtr sym_index_find_(SymbolPtr symtab, const char *name)
+{
+    if (sym_registry != NULL)
+    {
+        SymbolIndex key = {.symtab = symtab };
+        SymbolIndexPtr index = ohash_find(sym_registry, index_cmp, &key);
+
+        if (index != NULL)
+        {
+            Symbol sym_key = {.name = (char *) name };
+
+            return ohash_find(index->name, name_cmp, &sym_key);
+        }
+    }
+    for (; symtab->type != VOID_TYPE; ++symtab)
+    {
+        if (symtab->name == name || strcmp(symtab->name, name) == 0)
+        {
+            return symtab;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,143 @@
+/*
+ * SYM-INTERN.C --Shared storage for symbol names and string values.
+ *
+ * Contents:
+ * sym_intern()       --Return the shared copy of a string.
+ * sym_interned()     --Test if a string is a shared (interned) copy.
+ * sym_intern_free()  --Release all interned strings.
+ * sym_free_string_() --Free a symbol string, unless it's interned.
+ *
+ * Remarks:
+ * Interned strings are allocated from an arena, and stay valid until
+ * sym_intern_free(); identical strings share a single copy, and so
+ * can be compared by pointer (sym_get() tries that before strcmp()).
+ * sym_free_value() knows not to free() interned strings, so a table
+ * can freely mix interned and strdup()'d names and values.
+ *
+ * The table is guarded by a mutex, so strings can be interned by
+ * several threads (e.g. loading different files) at once.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/arena.h>
+#include <apex/hash.h>
+#include <apex/symbol.h>
+
+#define SYM_INTERN_BLOCK 16384         /* arena block size */
+#define SYM_INTERN_SLOTS 256           /* initial hash table size */
+
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+static OHashPtr intern_table;          /* the canonical copies */
+static Arena intern_arena;             /* ...and their storage */
+
+/*
+ * intern_hash() --HashProc for the intern table.
+ */
+static unsigned long intern_hash(char *data)
+{
+    return hash_key_wy(data);
+}
+
+/*
+ * intern_cmp() --CompareProc for the intern table.
+ */
+static int intern_cmp(const void *data, const void *key)
+{
+    return strcmp((const char *) data, (const char *) key);
+}
+
+/*
+ * sym_intern() --Return the shared copy of a string.
+ *
+ * Parameters:
+ * str  --the string to intern
+ *
+ * Returns: (char *)
+ * Success: the interned copy of str; Failure: NULL.
+ *
+ * Remarks:
+ * The result must not be modified or passed to free().
+ */
+char *sym_intern(const char *str)
+{
+    char *copy = NULL;
+
+    if (str == NULL)
+    {
+        return NULL;                   /* error: no string! */
+    }
+    pthread_mutex_lock(&intern_lock);
+    if (intern_table == NULL)
+    {
+        if ((intern_table = ohash_new(intern_hash, SYM_INTERN_SLOTS)) == NULL)
+        {
+            pthread_mutex_unlock(&intern_lock);
+            return NULL;               /* error: no table */
+        }
+        arena_init(&intern_arena, SYM_INTERN_BLOCK);
+    }
+    if ((copy = ohash_find(intern_table, intern_cmp, (void *) str)) == NULL
+        && (copy = arena_strdup(&intern_arena, str)) != NULL
+        && !ohash_insert(intern_table, copy))
+    {
+        copy = NULL;                   /* error: insert failed */
+    }
+    pthread_mutex_unlock(&intern_lock);
+    return copy;
+}
+
+/*
+ * sym_interned() --Test if a string is a shared (interned) copy.
+ *
+ * Returns: (int)
+ * True if str is the interned copy (not just equal to one).
+ */
+int sym_interned(const char *str)
+{
+    int status = 0;
+
+    if (str == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&intern_lock);
+    if (intern_table != NULL)
+    {
+        status = ohash_find(intern_table, intern_cmp, (void *) str) == str;
+    }
+    pthread_mutex_unlock(&intern_lock);
+    return status;
+}
+
+/*
+ * sym_intern_free() --Release all interned strings.
+ *
+ * Remarks:
+ * This must only be called when no symbol table refers to them.
+ */
+void sym_intern_free(void)
+{
+    pthread_mutex_lock(&intern_lock);
+    if (intern_table != NULL)
+    {
+        ohash_free(intern_table);
+        arena_free(&intern_arena);
+        intern_table = NULL;
+    }
+    pthread_mutex_unlock(&intern_lock);
+}
+
+/*
+ * sym_free_string_() --Free a symbol string, unless it's interned.
+ */
+void sym_free_string_(char *str)
+{
+    if (str != NULL && !sym_interned(str))
+    {
+        free(str);
+    }
+}
@@ -0,0 +1,320 @@
+/*
+ * SYM-MATCH.C --Match symbol paths against a set of patterns at once.
+ *
+ * Contents:
+ * SymMatchSet_t{}  --A compiled set of path patterns.
+ * new_sym_match()  --Create an empty pattern set.
+ * free_sym_match() --Free a pattern set.
+ * sym_match_add()  --Add a pattern to a set.
+ * sym_match()      --Find all the patterns that match a path.
+ *
+ * Remarks:
+ * The patterns are compiled into a trie over path elements: each node
+ * has an edge for each distinct name (or index) that follows it, and
+ * up to two wildcard edges ("*" names and "[*]" indices), with the
+ * same meaning as for sym_path_match().  Matching follows the exact
+ * and wildcard edges from each node in a single walk of the path, so
+ * its cost depends on the path and the trie's fan-out, not on the
+ * number of patterns.
+ *
+ * All the exact edges of the trie are kept in a single OHash, keyed
+ * by the parent node and the path element, and the nodes, edges and
+ * names are allocated from an arena, so the whole set is released at
+ * once by free_sym_match().
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/arena.h>
+#include <apex/hash.h>
+#include <apex/mem.h>
+#include <apex/symbol.h>
+
+#define SYM_MATCH_BLOCK 8192           /* arena block size */
+#define SYM_MATCH_WILD "*"             /* (as parsed by new_sym_path()) */
+
+typedef struct SymMatchEntry_t
+{
+    struct SymMatchEntry_t *next;
+    void *data;                        /* the pattern's user data */
+} SymMatchEntry, *SymMatchEntryPtr;
+
+typedef struct SymMatchNode_t
+{
+    struct SymMatchNode_t *any_name;   /* wildcard name edge, or NULL */
+    struct SymMatchNode_t *any_index;  /* wildcard index edge, or NULL */
+    SymMatchEntryPtr entry;            /* the patterns that end here */
+} SymMatchNode, *SymMatchNodePtr;
+
+typedef struct SymMatchEdge_t
+{
+    SymMatchNodePtr parent;
+    Atom key;                          /* a name or an index */
+    SymMatchNodePtr child;
+} SymMatchEdge, *SymMatchEdgePtr;
+
+/*
+ * SymMatchSet_t{} --A compiled set of path patterns.
+ */
+struct SymMatchSet_t
+{
+    Arena arena;                       /* nodes, edges and names */
+    OHashPtr edge;                     /* SymMatchEdge, by parent and key */
+    SymMatchNodePtr root;
+    size_t n_pattern;
+};
+
+/*
+ * edge_hash() --HashProc for the edges: combine the parent and key.
+ */
+static unsigned long edge_hash(char *data)
+{
+    SymMatchEdgePtr edge = (SymMatchEdgePtr) data;
+    uint64_t x = (uint64_t) (uintptr_t) edge->parent;
+
+    if (edge->key.type == STRING_TYPE)
+    {
+        x ^= hash_key_wy(edge->key.value.string);
+    }
+    else
+    {
+        x ^= (uint64_t) edge->key.value.integer * 0x9e3779b97f4a7c15ull;
+    }
+    x ^= x >> 31;                      /* (mix the pointer bits) */
+    x *= 0xbf58476d1ce4e5b9ull;
+    return (unsigned long) (x ^ (x >> 29));
+}
+
+/*
+ * edge_cmp() --CompareProc for the edges.
+ */
+static int edge_cmp(const void *data, const void *key)
+{
+    const SymMatchEdge *a = data;
+    const SymMatchEdge *b = key;
+
+    if (a->parent != b->parent || a->key.type != b->key.type)
+    {
+        return 1;
+    }
+    if (a->key.type == STRING_TYPE)
+    {
+        return strcmp(a->key.value.string, b->key.value.string);
+    }
+    return a->key.value.integer != b->key.value.integer;
+}
+
+/*
+ * is_wild() --Test if a path element is a wildcard.
+ */
+static int is_wild(AtomPtr element)
+{
+    return element->type == STRING_TYPE
+        ? strcmp(element->value.string, SYM_MATCH_WILD) == 0
+        : element->type == INTEGER_TYPE && element->value.integer == -1;
+}
+
+/*
+ * new_node() --Allocate a (zeroed) trie node.
+ */
+static SymMatchNodePtr new_node(SymMatchSetPtr set)
+{
+    SymMatchNodePtr node = arena_alloc(&set->arena, sizeof(*node));
+
+    if (node != NULL)
+    {
+        memset(node, 0, sizeof(*node));
+    }
+    return node;
+}
+
+/*
+ * new_sym_match() --Create an empty pattern set.
+ *
+ * Returns: (SymMatchSetPtr)
+ * Success: the pattern set; Failure: NULL.
+ */
+SymMatchSetPtr new_sym_match(void)
+{
+    SymMatchSetPtr set = mem_alloc(MEM_SYMBOL, sizeof(*set));
+
+    if (set == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    arena_init(&set->arena, SYM_MATCH_BLOCK);
+    set->n_pattern = 0;
+    if ((set->edge = ohash_new(edge_hash, 64)) == NULL
+        || (set->root = new_node(set)) == NULL)
+    {
+        free_sym_match(set);
+        return NULL;                   /* error: no memory */
+    }
+    return set;
+}
+
+/*
+ * free_sym_match() --Free a pattern set.
+ */
+void free_sym_match(SymMatchSetPtr set)
+{
+    if (set != NULL)
+    {
+        if (set->edge != NULL)
+        {
+            ohash_free(set->edge);
+        }
+        arena_free(&set->arena);
+        mem_free(MEM_SYMBOL, set);
+    }
+}
+
+/*
+ * sym_match_add() --Add a pattern to a set.
+ *
+ * Parameters:
+ * set --the pattern set
+ * pattern --the (compiled) pattern path, possibly with wildcards
+ * data --user data, passed to the SymMatchProc for matches
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The pattern is copied, so it may be freed afterwards.  The same
+ * pattern may be added more than once (with different data).
+ */
+int sym_match_add(SymMatchSetPtr set, AtomPtr pattern, void *data)
+{
+    SymMatchNodePtr node;
+    SymMatchEntryPtr entry;
+
+    if (set == NULL || pattern == NULL)
+    {
+        return 0;                      /* error: no set/pattern! */
+    }
+    node = set->root;
+    for (; pattern->type != VOID_TYPE; ++pattern)
+    {
+        SymMatchNodePtr *wild = NULL;
+
+        if (pattern->type != STRING_TYPE && pattern->type != INTEGER_TYPE)
+        {
+            return 0;                  /* error: bad path element */
+        }
+        if (is_wild(pattern))
+        {
+            wild = pattern->type == STRING_TYPE
+                ? &node->any_name : &node->any_index;
+            if (*wild == NULL && (*wild = new_node(set)) == NULL)
+            {
+                return 0;
+            }
+            node = *wild;
+        }
+        else
+        {
+            SymMatchEdge key = {.parent = node,.key = *pattern };
+            SymMatchEdgePtr edge = ohash_find(set->edge, edge_cmp, &key);
+
+            if (edge == NULL)
+            {
+                if ((edge = arena_alloc(&set->arena, sizeof(*edge))) == NULL
+                    || (edge->child = new_node(set)) == NULL)
+                {
+                    return 0;
+                }
+                edge->parent = node;
+                edge->key = *pattern;
+                if (pattern->type == STRING_TYPE
+                    && (edge->key.value.string =
+                        arena_strdup(&set->arena,
+                                     pattern->value.string)) == NULL)
+                {
+                    return 0;
+                }
+                if (!ohash_insert(set->edge, edge))
+                {
+                    return 0;
+                }
+            }
+            node = edge->child;
+        }
+    }
+    if ((entry = arena_alloc(&set->arena, sizeof(*entry))) == NULL)
+    {
+        return 0;
+    }
+    entry->data = data;
+    entry->next = node->entry;
+    node->entry = entry;
+    set->n_pattern += 1;
+    return 1;
+}
+
+/*
+ * match_() --Match the rest of a path from some trie node.
+ */
+static size_t match_(SymMatchSetPtr set, SymMatchNodePtr node,
+                     AtomPtr path, SymMatchProc proc, void *context)
+{
+    size_t n = 0;
+    SymMatchEdge key = {.parent = node };
+    SymMatchEdgePtr edge;
+    SymMatchNodePtr wild;
+
+    if (path->type == VOID_TYPE)
+    {
+        for (SymMatchEntryPtr entry = node->entry; entry != NULL;
+             entry = entry->next, ++n)
+        {
+            if (proc != NULL)
+            {
+                proc(entry->data, context);
+            }
+        }
+        return n;
+    }
+    key.key = *path;
+    if ((edge = ohash_find(set->edge, edge_cmp, &key)) != NULL)
+    {
+        n += match_(set, edge->child, path + 1, proc, context);
+    }
+    wild = path->type == STRING_TYPE ? node->any_name
+        : path->type == INTEGER_TYPE ? node->any_index : NULL;
+    if (wild != NULL)
+    {
+        n += match_(set, wild, path + 1, proc, context);
+    }
+    return n;
+}
+
+/*
+ * sym_match() --Find all the patterns that match a path.
+ *
+ * Parameters:
+ * set --the pattern set
+ * path --the (compiled) path to match
+ * proc --called with each matching pattern's data (may be NULL)
+ * context --passed to proc
+ *
+ * Returns: (size_t)
+ * The number of matching patterns.
+ *
+ * Remarks:
+ * A pattern matches if it has the same length as the path, and each
+ * element is equal or a wildcard of the same kind, as for
+ * sym_path_match().
+ */
+size_t sym_match(SymMatchSetPtr set, AtomPtr path, SymMatchProc proc,
+                 void *context)
+{
+    if (set == NULL || path == NULL)
+    {
+        return 0;
+    }
+    return match_(set, set->root, path, proc, context);
+}
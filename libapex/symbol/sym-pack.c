@@ -0,0 +1,637 @@
+/*
+ * SYM-PACK.C --Binary (MessagePack) encoding of symbol values.
+ *
+ * Contents:
+ * put_byte()         --Append a byte to the packed output.
+ * put_be()           --Append an n-byte big-endian number.
+ * put_header()       --Append a string/list/struct header for n items.
+ * pack_value()       --Append a value (recursively).
+ * sym_pack()         --Encode a value as MessagePack.
+ * get_be()           --Read an n-byte big-endian number.
+ * next_token()       --Read the next item's header (and scalar value).
+ * size_value()       --Check a packed value, and count the space it needs.
+ * unpack_string()    --Return a (NUL-terminated) copy of a packed string.
+ * unpack_value()     --Decode a (checked) packed value.
+ * sym_unpack()       --Decode MessagePack into a (compact) value tree.
+ * sym_unpack_free()  --Free an unpacked value tree.
+ *
+ * Remarks:
+ * The types map onto MessagePack directly: integers and reals are
+ * ints and float 64s, strings are strs, lists are arrays, and structs
+ * are maps with str keys (in their original order, duplicates and
+ * all).  Integers are packed in their smallest form.  Unpacking also
+ * accepts float 32s, and booleans (as 1 and 0), but not nil (except
+ * as the whole value), bin or ext items, or ints beyond SYMBOL_INT.
+ *
+ * Like sym_compact(), sym_unpack() checks and measures its input in
+ * one pass, and then builds the tree in a single allocation.  With
+ * SYM_UNPACK_INSITU, strings aren't copied: each is moved down over
+ * its own header and NUL-terminated, so the tree's strings point
+ * into (the now-mangled) input buffer, which must outlive it.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/symbol.h>
+
+enum
+{
+    DEPTH_MAX = 64                     /* max. nesting of lists/structs */
+};
+
+/*
+ * PackBuffer --The output of sym_pack(), in progress.
+ */
+typedef struct PackBuffer_t
+{
+    unsigned char *buf;
+    size_t size;
+    size_t len;                        /* (may exceed size) */
+} PackBuffer, *PackBufferPtr;
+
+/*
+ * Unpack --The state of sym_unpack(), in progress.
+ */
+typedef struct Unpack_t
+{
+    unsigned char *p;                  /* next input byte */
+    unsigned char *end;
+    int flags;
+    size_t table_size;                 /* bytes of tables */
+    size_t string_size;                /* bytes of (copied) strings */
+    char *table;                       /* next table */
+    char *string;                      /* next string */
+} Unpack, *UnpackPtr;
+
+/*
+ * Token --A packed item's header, and its value if it's a scalar.
+ */
+typedef struct Token_t
+{
+    Type type;
+    size_t n;                          /* string length, list/struct items */
+    Value value;                       /* (string: the unterminated data) */
+} Token, *TokenPtr;
+
+/*
+ * put_byte() --Append a byte to the packed output.
+ */
+static void put_byte(PackBufferPtr out, unsigned int byte)
+{
+    if (out->len < out->size)
+    {
+        out->buf[out->len] = (unsigned char) byte;
+    }
+    ++out->len;
+}
+
+/*
+ * put_be() --Append an n-byte big-endian number.
+ */
+static void put_be(PackBufferPtr out, uint64_t value, int n)
+{
+    while (--n >= 0)
+    {
+        put_byte(out, (unsigned int) (value >> (n * 8)) & 0xff);
+    }
+}
+
+/*
+ * put_header() --Append a string/list/struct header for n items.
+ *
+ * Parameters:
+ * out  --the packed output
+ * fix  --the "fix" format's tag (e.g. 0xa0 for fixstr)
+ * fix_max --the most items the fix format can hold
+ * tag8 --the 8-bit format's tag (or 0 if there isn't one)
+ * n    --the No. of items (or string length)
+ *
+ * Remarks:
+ * The 16- and 32-bit formats always follow the 8-bit one (or, if
+ * there isn't one, the fix format) in MessagePack's tag order.
+ */
+static int put_header(PackBufferPtr out, unsigned int fix, size_t fix_max,
+                      unsigned int tag8, size_t n)
+{
+    unsigned int tag16 = tag8 != 0 ? tag8 + 1 : (fix == 0x90 ? 0xdc : 0xde);
+
+    if (n <= fix_max)
+    {
+        put_byte(out, fix | (unsigned int) n);
+    }
+    else if (tag8 != 0 && n <= UINT8_MAX)
+    {
+        put_byte(out, tag8);
+        put_be(out, n, 1);
+    }
+    else if (n <= UINT16_MAX)
+    {
+        put_byte(out, tag16);
+        put_be(out, n, 2);
+    }
+    else if (n <= UINT32_MAX)
+    {
+        put_byte(out, tag16 + 1);
+        put_be(out, n, 4);
+    }
+    else
+    {
+        errno = EINVAL;
+        return 0;                      /* error: too long for MessagePack */
+    }
+    return 1;
+}
+
+/*
+ * pack_value() --Append a value (recursively).
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int pack_value(PackBufferPtr out, Type type, Value value, int depth)
+{
+    size_t n = 0;
+    uint64_t bits;
+
+    if (depth > DEPTH_MAX)
+    {
+        errno = EINVAL;
+        return 0;                      /* error: too deep */
+    }
+    switch (type)
+    {
+    case VOID_TYPE:
+        put_byte(out, 0xc0);           /* nil */
+        return depth == 0;             /* (only at the top level) */
+    case INTEGER_TYPE:
+        if (value.integer >= 0)
+        {
+            uint64_t u = (uint64_t) value.integer;
+
+            if (u < 0x80)
+            {
+                put_byte(out, (unsigned int) u);
+            }
+            else
+            {
+                int n_byte = u <= UINT8_MAX ? 1 : u <= UINT16_MAX ? 2
+                    : u <= UINT32_MAX ? 4 : 8;
+
+                put_byte(out, 0xcc + (n_byte == 8 ? 3 : n_byte / 2));
+                put_be(out, u, n_byte);
+            }
+        }
+        else if (value.integer >= -32)
+        {
+            put_byte(out, (unsigned int) (value.integer & 0xff));
+        }
+        else
+        {
+            int64_t i = value.integer;
+            int n_byte = i >= INT8_MIN ? 1 : i >= INT16_MIN ? 2
+                : i >= INT32_MIN ? 4 : 8;
+
+            put_byte(out, 0xd0 + (n_byte == 8 ? 3 : n_byte / 2));
+            put_be(out, (uint64_t) i, n_byte);
+        }
+        return 1;
+    case REAL_TYPE:
+        memcpy(&bits, &value.real, sizeof(bits));
+        put_byte(out, 0xcb);
+        put_be(out, bits, 8);
+        return 1;
+    case STRING_TYPE:
+        n = strlen(value.string);
+        if (!put_header(out, 0xa0, 31, 0xd9, n))
+        {
+            return 0;
+        }
+        if (out->len + n <= out->size)
+        {
+            memcpy(out->buf + out->len, value.string, n);
+        }
+        out->len += n;
+        return 1;
+    case LIST_TYPE:
+        while (value.list[n].type != VOID_TYPE)
+        {
+            ++n;
+        }
+        if (!put_header(out, 0x90, 15, 0, n))
+        {
+            return 0;
+        }
+        for (AtomPtr atom = value.list; atom->type != VOID_TYPE; ++atom)
+        {
+            if (!pack_value(out, atom->type, atom->value, depth + 1))
+            {
+                return 0;
+            }
+        }
+        return 1;
+    case STRUCT_TYPE:
+        while (value.field[n].type != VOID_TYPE)
+        {
+            ++n;
+        }
+        if (!put_header(out, 0x80, 15, 0, n))
+        {
+            return 0;
+        }
+        for (SymbolPtr sym = value.field; sym->type != VOID_TYPE; ++sym)
+        {
+            Value name = {.string = sym->name };
+
+            if (sym->name == NULL
+                || !pack_value(out, STRING_TYPE, name, depth + 1)
+                || !pack_value(out, sym->type, sym->value, depth + 1))
+            {
+                errno = EINVAL;
+                return 0;              /* error: unnamed field, etc. */
+            }
+        }
+        return 1;
+    default:
+        errno = EINVAL;
+        return 0;                      /* error: unknown type */
+    }
+}
+
+/*
+ * sym_pack() --Encode a value as MessagePack.
+ *
+ * Parameters:
+ * buf  --the buffer to write to
+ * size --the buffer's size
+ * type, value --the value to encode
+ *
+ * Returns: (size_t)
+ * Success: the encoded length; Failure: 0 (errno is set).
+ *
+ * Remarks:
+ * Like snprintf(), this returns the length needed even if the buffer
+ * is too small (in which case its contents are incomplete), so
+ * sym_pack(NULL, 0, ...) measures a value.
+ */
+size_t sym_pack(char *buf, size_t size, Type type, Value value)
+{
+    PackBuffer out = {.buf = (unsigned char *) buf,.size = size };
+
+    if (buf == NULL)
+    {
+        out.size = 0;
+    }
+    return pack_value(&out, type, value, 0) ? out.len : 0;
+}
+
+/*
+ * get_be() --Read an n-byte big-endian number.
+ */
+static uint64_t get_be(const unsigned char *p, int n)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+/*
+ * next_token() --Read the next item's header (and scalar value).
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (truncated, or not representable).
+ *
+ * Remarks:
+ * A string's data is skipped (and returned in token->value.string);
+ * list and struct items aren't.
+ */
+static int next_token(UnpackPtr u, TokenPtr token)
+{
+    static const unsigned char width[] = {  /* 0xc0..0xdf: data bytes */
+        0, 0, 0, 0, 1, 2, 4, 0, 0, 0, 4, 8, 1, 2, 4, 8,
+        1, 2, 4, 8, 0, 0, 0, 0, 0, 1, 2, 4, 2, 4, 2, 4
+    };
+    unsigned int tag;
+    uint64_t x = 0;
+    uint32_t bits32;
+    float f;
+    size_t avail;
+
+    if (u->p >= u->end)
+    {
+        return 0;                      /* error: truncated */
+    }
+    tag = *u->p++;
+    avail = (size_t) (u->end - u->p);
+    if (tag >= 0xc0 && tag <= 0xdf)
+    {
+        if (width[tag - 0xc0] > avail)
+        {
+            return 0;                  /* error: truncated */
+        }
+        x = get_be(u->p, width[tag - 0xc0]);
+        u->p += width[tag - 0xc0];
+        avail -= width[tag - 0xc0];
+    }
+    token->n = 0;
+    if (tag < 0x80)
+    {
+        token->type = INTEGER_TYPE;
+        token->value.integer = (SYMBOL_INT) tag;
+    }
+    else if (tag >= 0xe0)
+    {
+        token->type = INTEGER_TYPE;
+        token->value.integer = (SYMBOL_INT) tag - 0x100;
+    }
+    else if (tag < 0x90 || tag == 0xde || tag == 0xdf)
+    {
+        token->type = STRUCT_TYPE;
+        token->n = tag < 0x90 ? tag & 0x0f : (size_t) x;
+    }
+    else if (tag < 0xa0 || tag == 0xdc || tag == 0xdd)
+    {
+        token->type = LIST_TYPE;
+        token->n = tag < 0xa0 ? tag & 0x0f : (size_t) x;
+    }
+    else if (tag < 0xc0 || (tag >= 0xd9 && tag <= 0xdb))
+    {
+        token->type = STRING_TYPE;
+        token->n = tag < 0xc0 ? tag & 0x1f : (size_t) x;
+        if (token->n > avail)
+        {
+            return 0;                  /* error: truncated */
+        }
+        token->value.string = (char *) u->p;
+        u->p += token->n;
+    }
+    else
+    {
+        switch (tag)
+        {
+        case 0xc0:                     /* nil */
+            token->type = VOID_TYPE;
+            break;
+        case 0xc2:                     /* false */
+        case 0xc3:                     /* true */
+            token->type = INTEGER_TYPE;
+            token->value.integer = tag == 0xc3;
+            break;
+        case 0xca:                     /* float 32 */
+            bits32 = (uint32_t) x;
+            memcpy(&f, &bits32, sizeof(f));
+            token->type = REAL_TYPE;
+            token->value.real = f;
+            break;
+        case 0xcb:                     /* float 64 */
+            token->type = REAL_TYPE;
+            memcpy(&token->value.real, &x, sizeof(x));
+            break;
+        case 0xcc:                     /* uint 8..64 */
+        case 0xcd:
+        case 0xce:
+        case 0xcf:
+            if (x > (uint64_t) SYMBOL_INT_MAX)
+            {
+                return 0;              /* error: out of range */
+            }
+            token->type = INTEGER_TYPE;
+            token->value.integer = (SYMBOL_INT) x;
+            break;
+        case 0xd0:                     /* int 8..64 */
+            token->type = INTEGER_TYPE;
+            token->value.integer = (int8_t) x;
+            break;
+        case 0xd1:
+            token->type = INTEGER_TYPE;
+            token->value.integer = (int16_t) x;
+            break;
+        case 0xd2:
+            token->type = INTEGER_TYPE;
+            token->value.integer = (int32_t) x;
+            break;
+        case 0xd3:
+            if ((int64_t) x < SYMBOL_INT_MIN || (int64_t) x > SYMBOL_INT_MAX)
+            {
+                return 0;              /* error: out of range */
+            }
+            token->type = INTEGER_TYPE;
+            token->value.integer = (SYMBOL_INT) (int64_t) x;
+            break;
+        default:
+            return 0;                  /* error: bin, ext, or unused */
+        }
+    }
+    return 1;
+}
+
+/*
+ * size_value() --Check a packed value, and count the space it needs.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int size_value(UnpackPtr u, int depth)
+{
+    Token token;
+
+    if (depth > DEPTH_MAX || !next_token(u, &token))
+    {
+        return 0;
+    }
+    switch (token.type)
+    {
+    case VOID_TYPE:
+        return depth == 0;             /* (only at the top level) */
+    case STRING_TYPE:
+        u->string_size += token.n + 1;
+        return 1;
+    case LIST_TYPE:
+        if (token.n > (size_t) (u->end - u->p))
+        {
+            return 0;                  /* error: truncated */
+        }
+        u->table_size += (token.n + 1) * sizeof(Atom);
+        for (size_t i = 0; i < token.n; ++i)
+        {
+            if (!size_value(u, depth + 1))
+            {
+                return 0;
+            }
+        }
+        return 1;
+    case STRUCT_TYPE:
+        if (token.n > (size_t) (u->end - u->p) / 2)
+        {
+            return 0;                  /* error: truncated */
+        }
+        u->table_size += (token.n + 1) * sizeof(Symbol);
+        for (size_t i = 0; i < token.n; ++i)
+        {
+            Token name;
+
+            if (!next_token(u, &name) || name.type != STRING_TYPE
+                || !size_value(u, depth + 1))
+            {
+                return 0;              /* error: non-string name, etc. */
+            }
+            u->string_size += name.n + 1;
+        }
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+/*
+ * unpack_string() --Return a (NUL-terminated) copy of a packed string.
+ *
+ * Remarks:
+ * With SYM_UNPACK_INSITU, the string is moved down over its header
+ * (which is at least a byte), so there's room for the NUL.
+ */
+static char *unpack_string(UnpackPtr u, unsigned char *header,
+                           const Token * token)
+{
+    char *str;
+
+    if (u->flags & SYM_UNPACK_INSITU)
+    {
+        str = (char *) header;
+    }
+    else
+    {
+        str = u->string;
+        u->string += token->n + 1;
+    }
+    memmove(str, token->value.string, token->n);
+    str[token->n] = '\0';
+    return str;
+}
+
+/*
+ * unpack_value() --Decode a (checked) packed value.
+ *
+ * Remarks:
+ * Each table is allocated before its members' subtrees, so the
+ * layout is depth-first, as for sym_compact().
+ */
+static void unpack_value(UnpackPtr u, TypePtr type, ValuePtr value)
+{
+    unsigned char *header = u->p;
+    Token token;
+
+    next_token(u, &token);             /* (already checked) */
+    *type = token.type;
+    switch (token.type)
+    {
+    case STRING_TYPE:
+        value->string = unpack_string(u, header, &token);
+        break;
+    case LIST_TYPE:
+        value->list = (AtomPtr) u->table;
+        u->table += (token.n + 1) * sizeof(Atom);
+        for (size_t i = 0; i < token.n; ++i)
+        {
+            unpack_value(u, &value->list[i].type, &value->list[i].value);
+        }
+        value->list[token.n] = null_atom;
+        break;
+    case STRUCT_TYPE:
+        value->field = (SymbolPtr) u->table;
+        u->table += (token.n + 1) * sizeof(Symbol);
+        for (size_t i = 0; i < token.n; ++i)
+        {
+            SymbolPtr sym = &value->field[i];
+            Token name;
+
+            header = u->p;
+            next_token(u, &name);
+            sym->name = unpack_string(u, header, &name);
+            unpack_value(u, &sym->type, &sym->value);
+        }
+        value->field[token.n] = null_symbol;
+        break;
+    default:
+        *value = token.value;
+        break;
+    }
+}
+
+/*
+ * sym_unpack() --Decode MessagePack into a (compact) value tree.
+ *
+ * Parameters:
+ * buf  --the packed value
+ * n    --the length of buf
+ * flags --SYM_UNPACK_INSITU, or 0
+ * used --returns the length decoded (if NULL, it must be all of buf)
+ *
+ * Returns: (AtomPtr)
+ * Success: the value (free it with sym_unpack_free()); Failure: NULL
+ * (errno is set).
+ *
+ * Remarks:
+ * buf is only modified with SYM_UNPACK_INSITU (and then only once
+ * the whole value has been checked).  The tree is a compact tree (see
+ * sym_compact()), and should be treated as read-only.
+ */
+AtomPtr sym_unpack(char *buf, size_t n, int flags, size_t *used)
+{
+    Unpack u = {
+        .p = (unsigned char *) buf,.end = (unsigned char *) buf + n,
+        .flags = flags
+    };
+    AtomPtr atom;
+
+    if (buf == NULL || !size_value(&u, 0)
+        || (used == NULL && u.p != u.end))
+    {
+        errno = EINVAL;
+        return NULL;                   /* error: malformed/unsupported */
+    }
+    if (used != NULL)
+    {
+        *used = (size_t) ((char *) u.p - buf);
+    }
+    if (flags & SYM_UNPACK_INSITU)
+    {
+        u.string_size = 0;
+    }
+    if ((atom = malloc(sizeof(Atom) + u.table_size + u.string_size)) == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    u.p = (unsigned char *) buf;
+    u.table = (char *) (atom + 1);
+    u.string = u.table + u.table_size;
+    unpack_value(&u, &atom->type, &atom->value);
+    return atom;
+}
+
+/*
+ * sym_unpack_free() --Free an unpacked value tree.
+ *
+ * Remarks:
+ * Like sym_compact_free(), this drops any name index on a top-level
+ * struct, and invalidates bound paths.
+ */
+void sym_unpack_free(AtomPtr atom)
+{
+    if (atom != NULL)
+    {
+        if (atom->type == STRUCT_TYPE)
+        {
+            sym_unindex(atom->value.field);
+        }
+        sym_changed();
+        free(atom);
+    }
+}
@@ -0,0 +1,361 @@
+/*
+ * SYM-SNAPSHOT.C --Immutable symbol table snapshots, for lock-free reload.
+ *
+ * Contents:
+ * sym_copy()            --Make a deep (vector-based) copy of a symbol tree.
+ * sym_config_init()     --Initialise a published configuration.
+ * sym_config_free()     --Release a configuration and all its snapshots.
+ * sym_config_reader()   --Claim a reader slot for the calling thread.
+ * sym_config_unreader() --Release a reader slot.
+ * sym_read_begin()      --Start reading the current snapshot.
+ * sym_read_end()        --Finish reading a snapshot.
+ * sym_publish()         --Replace the current snapshot.
+ * sym_config_reclaim()  --Free the retired snapshots that no reader can see.
+ *
+ * Remarks:
+ * A SymConfig publishes a pointer to the current snapshot of a symbol
+ * table, which readers never modify.  To reload, the (single) writer
+ * builds a new table, typically by loading into a sym_copy() of the
+ * current one, and calls sym_publish() to swap it in atomically; the
+ * old snapshot is retired, and freed later when no reader can still
+ * be using it.
+ *
+ * Reclamation is epoch-based: each reader thread has a slot, where
+ * sym_read_begin() records the global epoch before loading the
+ * current pointer, and sym_read_end() clears it.  sym_publish() swaps
+ * the pointer, then advances the epoch, and tags the old snapshot with
+ * the new epoch; any reader that could have seen it must have recorded
+ * an older epoch, so it's freed once all active readers have recorded
+ * the tag (or later).  Readers take no locks, and only write to their
+ * own (cache-line padded) slot.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apex/vector.h>
+#include <apex/symbol.h>
+
+/*
+ * copy_value() --Make a deep copy of a value.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int copy_value(Type type, Value value, ValuePtr copy)
+{
+    size_t n = 0;
+
+    *copy = value;
+    switch (type)
+    {
+    case STRING_TYPE:
+        copy->string = sym_interned(value.string)
+            ? value.string : strdup(value.string);
+        return copy->string != NULL;
+    case STRUCT_TYPE:
+        copy->field = sym_copy(value.field);
+        return copy->field != NULL;
+    case LIST_TYPE:
+        while (value.list[n].type != VOID_TYPE)
+        {
+            ++n;
+        }
+        if ((copy->list = NEW_VECTOR(Atom, n + 1, value.list)) == NULL)
+        {
+            return 0;                  /* error: malloc failed */
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (!copy_value(value.list[i].type, value.list[i].value,
+                            &copy->list[i].value))
+            {
+                copy->list[i].type = VOID_TYPE;        /* (truncate) */
+                sym_free_value(LIST_TYPE, *copy);
+                return 0;
+            }
+        }
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+/*
+ * sym_copy() --Make a deep (vector-based) copy of a symbol tree.
+ *
+ * Parameters:
+ * symtab --the symbol tree to copy
+ *
+ * Returns: (SymbolPtr)
+ * Success: the copy; Failure: NULL.
+ *
+ * Remarks:
+ * The copy can be modified (e.g. by ini_load()) and freed with
+ * sym_free_value() as usual.  Interned strings are shared, rather
+ * than copied.
+ */
+SymbolPtr sym_copy(SymbolPtr symtab)
+{
+    SymbolPtr copy;
+    size_t n = 0;
+
+    if (symtab == NULL)
+    {
+        return NULL;                   /* error: no symtab! */
+    }
+    while (symtab[n].type != VOID_TYPE)
+    {
+        ++n;
+    }
+    if ((copy = NEW_VECTOR(Symbol, n + 1, symtab)) == NULL)
+    {
+        return NULL;                   /* error: malloc failed */
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        SymbolPtr sym = &copy[i];
+
+        sym->name = sym_interned(sym->name) ? sym->name : strdup(sym->name);
+        if (sym->name == NULL
+            || !copy_value(sym->type, symtab[i].value, &sym->value))
+        {
+            Value value = {.field = copy };
+
+            if (sym->name != NULL)
+            {
+                sym_free_string_(sym->name);
+            }
+            sym->name = NULL;
+            sym->type = VOID_TYPE;     /* (truncate) */
+            sym_free_value(STRUCT_TYPE, value);
+            return NULL;
+        }
+    }
+    return copy;
+}
+
+/*
+ * new_snapshot() --Allocate a snapshot of a symbol table.
+ */
+static SymSnapshotPtr new_snapshot(SymConfigPtr config, SymbolPtr symtab)
+{
+    SymSnapshotPtr snapshot = malloc(sizeof(*snapshot));
+
+    if (snapshot != NULL)
+    {
+        snapshot->symtab = symtab;
+        snapshot->version = ++config->version;
+        snapshot->retire_epoch = 0;
+        snapshot->next = NULL;
+    }
+    return snapshot;
+}
+
+/*
+ * free_snapshot() --Free a snapshot, and its symbol table.
+ */
+static void free_snapshot(SymConfigPtr config, SymSnapshotPtr snapshot)
+{
+    if (snapshot->symtab != NULL && config->free_symtab != NULL)
+    {
+        config->free_symtab(snapshot->symtab);
+    }
+    free(snapshot);
+}
+
+/*
+ * sym_config_init() --Initialise a published configuration.
+ *
+ * Parameters:
+ * config --the configuration to initialise (owned by caller)
+ * symtab --the initial symbol table (may be NULL)
+ * n_reader --the maximum No. of concurrent reader threads
+ * free_symtab --frees retired tables (e.g. ini_sym_free()), or NULL
+ *
+ * Returns: (SymConfigPtr)
+ * Success: config; Failure: NULL.
+ */
+SymConfigPtr sym_config_init(SymConfigPtr config, SymbolPtr symtab,
+                             size_t n_reader, SymFreeProc free_symtab)
+{
+    if (config == NULL || n_reader == 0)
+    {
+        return NULL;                   /* error: no config/readers! */
+    }
+    memset(config, 0, sizeof(*config));
+    config->epoch = 1;                 /* (0 means "not reading") */
+    config->free_symtab = free_symtab;
+    config->n_reader = n_reader;
+    if ((config->reader = calloc(n_reader, sizeof(*config->reader))) == NULL
+        || (config->current = new_snapshot(config, symtab)) == NULL)
+    {
+        free(config->reader);
+        return NULL;                   /* error: malloc failed */
+    }
+    return config;
+}
+
+/*
+ * sym_config_free() --Release a configuration and all its snapshots.
+ *
+ * Remarks:
+ * There must be no active readers.
+ */
+void sym_config_free(SymConfigPtr config)
+{
+    if (config != NULL)
+    {
+        SymSnapshotPtr next;
+
+        for (SymSnapshotPtr s = config->retired; s != NULL; s = next)
+        {
+            next = s->next;
+            free_snapshot(config, s);
+        }
+        if (config->current != NULL)
+        {
+            free_snapshot(config, config->current);
+        }
+        free(config->reader);
+        memset(config, 0, sizeof(*config));
+    }
+}
+
+/*
+ * sym_config_reader() --Claim a reader slot for the calling thread.
+ *
+ * Returns: (SymReaderPtr)
+ * Success: the thread's reader slot; Failure: NULL (all in use).
+ */
+SymReaderPtr sym_config_reader(SymConfigPtr config)
+{
+    for (size_t i = 0; i < config->n_reader; ++i)
+    {
+        unsigned int free_slot = 0;
+
+        while (ATOMIC_LOAD_RELAXED(&config->reader[i].in_use) == 0)
+        {                              /* (ATOMIC_CAS may fail spuriously) */
+            if (ATOMIC_CAS(&config->reader[i].in_use, &free_slot, 1))
+            {
+                return &config->reader[i];
+            }
+            free_slot = 0;
+        }
+    }
+    return NULL;                       /* failure: no free slots */
+}
+
+/*
+ * sym_config_unreader() --Release a reader slot.
+ */
+void sym_config_unreader(SymReaderPtr reader)
+{
+    ATOMIC_STORE_RELEASE(&reader->epoch, 0);
+    ATOMIC_STORE_RELEASE(&reader->in_use, 0);
+}
+
+/*
+ * sym_read_begin() --Start reading the current snapshot.
+ *
+ * Parameters:
+ * config --the configuration
+ * reader --the calling thread's reader slot
+ *
+ * Returns: (SymSnapshotPtr)
+ * The current snapshot, which stays valid until sym_read_end().
+ */
+SymSnapshotPtr sym_read_begin(SymConfigPtr config, SymReaderPtr reader)
+{
+    ATOMIC_STORE_RELAXED(&reader->epoch,
+                         ATOMIC_LOAD_RELAXED(&config->epoch));
+    ATOMIC_FENCE();                    /* (order epoch store/pointer load) */
+    return ATOMIC_LOAD_ACQUIRE(&config->current);
+}
+
+/*
+ * sym_read_end() --Finish reading a snapshot.
+ */
+void sym_read_end(SymReaderPtr reader)
+{
+    ATOMIC_STORE_RELEASE(&reader->epoch, 0);
+}
+
+/*
+ * sym_publish() --Replace the current snapshot.
+ *
+ * Parameters:
+ * config --the configuration
+ * symtab --the new symbol table; readers must not see it modified
+ *
+ * Returns: (unsigned long)
+ * Success: the new snapshot's version; Failure: 0.
+ *
+ * Remarks:
+ * Only one thread may publish at a time.  The old snapshot is freed
+ * (by config's free_symtab) once the last reader who might see it
+ * has finished.
+ */
+unsigned long sym_publish(SymConfigPtr config, SymbolPtr symtab)
+{
+    SymSnapshotPtr snapshot = new_snapshot(config, symtab);
+    SymSnapshotPtr old = config->current;
+
+    if (snapshot == NULL)
+    {
+        return 0;                      /* error: malloc failed */
+    }
+    ATOMIC_STORE_RELEASE(&config->current, snapshot);
+    ATOMIC_FENCE();
+    old->retire_epoch = ATOMIC_ADD(&config->epoch, 1) + 1;
+    old->next = config->retired;
+    config->retired = old;
+    sym_config_reclaim(config);
+    return snapshot->version;
+}
+
+/*
+ * sym_config_reclaim() --Free the retired snapshots that no reader can see.
+ *
+ * Returns: (size_t)
+ * The No. of snapshots freed.
+ *
+ * Remarks:
+ * This is called by sym_publish(); the writer may also call it
+ * periodically, to release snapshots held up by slow readers.
+ */
+size_t sym_config_reclaim(SymConfigPtr config)
+{
+    unsigned long min_epoch = ULONG_MAX;
+    SymSnapshotPtr *prev = &config->retired;
+    size_t n = 0;
+
+    ATOMIC_FENCE();                    /* (order epoch update/reader loads) */
+    for (size_t i = 0; i < config->n_reader; ++i)
+    {
+        unsigned long epoch = ATOMIC_LOAD_ACQUIRE(&config->reader[i].epoch);
+
+        if (epoch != 0 && epoch < min_epoch)
+        {
+            min_epoch = epoch;
+        }
+    }
+    while (*prev != NULL)
+    {
+        SymSnapshotPtr snapshot = *prev;
+
+        if (snapshot->retire_epoch <= min_epoch)
+        {
+            *prev = snapshot->next;
+            free_snapshot(config, snapshot);
+            ++n;
+        }
+        else
+        {
+            prev = &snapshot->next;
+        }
+    }
+    return n;
+}
@@ -17,9 +17,25 @@
  * sym_get_int()     --Return a symbol's value coerced to an int.
  * sym_get_real()    --Return a symbol's value coerced to a real.
  * sym_get_str()     --Return a symbol's value coerced to a string.
+ * sym_changed()     --Invalidate all bound paths.
+ * sym_bind()        --Bind a path to its value in a symbol table.
+ * sym_bound()       --Return the value of a bound path.
+ * sym_bound_int()   --Return a bound path's value coerced to an int.
+ * sym_bound_real()  --Return a bound path's value coerced to a real.
+ * sym_bound_str()   --Return a bound path's value coerced to a string.
  *
  * Remarks:
- * TBD
+ * sym_get() finds names with sym_index_find_(), which uses a hashed
+ * index for tables that have been indexed by sym_index() (see
+ * sym-index.c), and a linear scan otherwise.  Names are compared by
+ * pointer before strcmp(), which is usually enough if the names (and
+ * path) were interned by sym_intern() (see sym-intern.c).
+ *
+ * A SymBinding resolves a path once, and thereafter costs a compare
+ * of sym_generation (and a pointer load) per query.  Any code that
+ * adds symbols to, or frees, a table must call sym_changed(), because
+ * either may move or release the values that bindings point to;
+ * sym_free_value() and ini_load() do this themselves.
  *
  */
 #include <apex.h>                       /* Windows_NT requires this before system headers */
@@ -27,6 +43,7 @@
 #include <stdlib.h>
 #include <errno.h>
 
+#include <apex/atomic.h>
 #include <apex/estring.h>
 #include <apex/strparse.h>
 #include <apex/vector.h>
@@ -41,6 +58,8 @@ const char *sym_type_name[] = {
     "void", "real", "integer", "string", "list", "struct"
 };
 
+unsigned int sym_generation;           /* see sym_changed() */
+
 static const char *sym_match_any_name = "*";
 
 /*
@@ -48,20 +67,22 @@ static const char *sym_match_any_name = "*";
  */
 void sym_free_value(Type type, Value value)
 {
+    sym_changed();
     switch (type)
     {
     default:
         break;
     case STRING_TYPE:
-        free(value.string);
+        sym_free_string_(value.string);
         break;
     case STRUCT_TYPE:
         for (SymbolPtr symbol = value.field; symbol->type != VOID_TYPE;
              ++symbol)
         {
-            free(symbol->name);
+            sym_free_string_(symbol->name);
             sym_free_value(symbol->type, symbol->value);
         }
+        sym_index_drop_(value.field);
         free_vector(value.field);
         break;
     case LIST_TYPE:
@@ -453,33 +474,30 @@ static Type list_get_(AtomPtr list, AtomPtr path, ValuePtr * vptr)
  */
 Type sym_get(SymbolPtr symtab, AtomPtr path, ValuePtr * vptr)
 {
+    SymbolPtr sym;
+
     if (path->type != STRING_TYPE)
     {
         return VOID_TYPE;              /* error: path isn't a name */
     }
-    for (size_t i = 0; symtab[i].type != VOID_TYPE; ++i)
+    if ((sym = sym_index_find_(symtab, path->value.string)) == NULL)
     {
-        SymbolPtr sym = &symtab[i];
-
-        if (strcmp(sym->name, path->value.string) == 0)
-        {
-            if (path[1].type == VOID_TYPE)
-            {                          /* plugh! you're at end of road again */
-                *vptr = &sym->value;
-                return sym->type;
-            }
-            switch (sym->type)
-            {
-            case STRUCT_TYPE:
-                return sym_get(sym->value.field, path + 1, vptr);
-            case LIST_TYPE:
-                return list_get_(sym->value.list, path + 1, vptr);
-            default:
-                return VOID_TYPE;      /* error: at a leaf */
-            }
-        }
+        return VOID_TYPE;              /* error: no such name */
+    }
+    if (path[1].type == VOID_TYPE)
+    {                                  /* plugh! you're at end of road again */
+        *vptr = &sym->value;
+        return sym->type;
+    }
+    switch (sym->type)
+    {
+    case STRUCT_TYPE:
+        return sym_get(sym->value.field, path + 1, vptr);
+    case LIST_TYPE:
+        return list_get_(sym->value.list, path + 1, vptr);
+    default:
+        return VOID_TYPE;              /* error: at a leaf */
     }
-    return VOID_TYPE;                  /* UNREACHED */
 }
 
 /*
@@ -506,20 +524,14 @@ Type sym_get_value(SymbolPtr symtab, AtomPtr path, ValuePtr value)
 }
 
 /*
- * sym_get_int() --Return a symbol's value coerced to an int.
- *
- * Parameters:
- * symtab  --the dom to be searched
- * path --the path of the symbol to find
+ * value_int_() --Coerce a value to an int.
  *
  * Returns: (int)
  * Success: 1; Failure: 0.
  */
-int sym_get_int(SymbolPtr symtab, AtomPtr path, SYMBOL_INT * value)
+static int value_int_(Type type, Value v, SYMBOL_INT * value)
 {
-    Value v;
-
-    switch (sym_get_value(symtab, path, &v))
+    switch (type)
     {
     default:
         break;
@@ -546,20 +558,14 @@ int sym_get_int(SymbolPtr symtab, AtomPtr path, SYMBOL_INT * value)
 }
 
 /*
- * sym_get_real() --Return a symbol's value coerced to a real.
- *
- * Parameters:
- * symtab  --the dom to be searched
- * path --the path of the symbol to find
+ * value_real_() --Coerce a value to a real.
  *
  * Returns: (int)
  * Success: 1; Failure: 0.
  */
-int sym_get_real(SymbolPtr symtab, AtomPtr path, double *value)
+static int value_real_(Type type, Value v, double *value)
 {
-    Value v;
-
-    switch (sym_get_value(symtab, path, &v))
+    switch (type)
     {
     default:
         break;
@@ -586,6 +592,40 @@ int sym_get_real(SymbolPtr symtab, AtomPtr path, double *value)
     return 0;
 }
 
+/*
+ * sym_get_int() --Return a symbol's value coerced to an int.
+ *
+ * Parameters:
+ * symtab  --the dom to be searched
+ * path --the path of the symbol to find
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int sym_get_int(SymbolPtr symtab, AtomPtr path, SYMBOL_INT * value)
+{
+    Value v;
+
+    return value_int_(sym_get_value(symtab, path, &v), v, value);
+}
+
+/*
+ * sym_get_real() --Return a symbol's value coerced to a real.
+ *
+ * Parameters:
+ * symtab  --the dom to be searched
+ * path --the path of the symbol to find
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int sym_get_real(SymbolPtr symtab, AtomPtr path, double *value)
+{
+    Value v;
+
+    return value_real_(sym_get_value(symtab, path, &v), v, value);
+}
+
 /*
  * sym_get_str() --Return a symbol's value coerced to a string.
  *
@@ -607,3 +647,115 @@ int sym_get_str(SymbolPtr symtab, AtomPtr path, char **value)
     }
     return 0;
 }
+
+/*
+ * sym_changed() --Invalidate all bound paths.
+ *
+ * Remarks:
+ * This must be called after symbols are added to (or removed from)
+ * any table, so that bindings re-resolve their paths; it's cheaper to
+ * invalidate every binding than to track which tables they use.
+ */
+void sym_changed(void)
+{
+    ATOMIC_ADD(&sym_generation, 1);
+}
+
+/*
+ * sym_bind() --Bind a path to its value in a symbol table.
+ *
+ * Parameters:
+ * binding --the binding to initialise (owned by caller)
+ * symtab  --the dom to be searched
+ * path --the path of the symbol to find (must outlive the binding)
+ *
+ * Returns: (Type)
+ * Success: the type of symbol; Failure: VOID_TYPE.
+ *
+ * Remarks:
+ * The binding is initialised even if the path isn't found (yet), so
+ * that sym_bound() finds it if it's added later.
+ */
+Type sym_bind(SymBindingPtr binding, SymbolPtr symtab, AtomPtr path)
+{
+    binding->symtab = symtab;
+    binding->path = path;
+    binding->generation = ATOMIC_LOAD_ACQUIRE(&sym_generation);
+    binding->value = NULL;
+    if ((binding->type = sym_get(symtab, path, &binding->value)) == VOID_TYPE)
+    {
+        binding->value = NULL;
+    }
+    return binding->type;
+}
+
+/*
+ * sym_bound() --Return the value of a bound path.
+ *
+ * Parameters:
+ * binding --the binding
+ * value_ptr --returns the address of the symbol's value
+ *
+ * Returns: (Type)
+ * Success: the type of symbol; Failure: VOID_TYPE.
+ *
+ * Remarks:
+ * If no table has changed since the path was resolved, this is just
+ * a load of the cached value; otherwise the path is re-resolved (the
+ * symtab itself must be the same table, i.e. not reallocated).
+ */
+Type sym_bound(SymBindingPtr binding, ValuePtr * value_ptr)
+{
+    if (binding->generation != ATOMIC_LOAD_ACQUIRE(&sym_generation))
+    {
+        sym_bind(binding, binding->symtab, binding->path);
+    }
+    *value_ptr = binding->value;
+    return binding->type;
+}
+
+/*
+ * sym_bound_int() --Return a bound path's value coerced to an int.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int sym_bound_int(SymBindingPtr binding, SYMBOL_INT * value)
+{
+    ValuePtr vptr;
+    Type type = sym_bound(binding, &vptr);
+
+    return type != VOID_TYPE && value_int_(type, *vptr, value);
+}
+
+/*
+ * sym_bound_real() --Return a bound path's value coerced to a real.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int sym_bound_real(SymBindingPtr binding, double *value)
+{
+    ValuePtr vptr;
+    Type type = sym_bound(binding, &vptr);
+
+    return type != VOID_TYPE && value_real_(type, *vptr, value);
+}
+
+/*
+ * sym_bound_str() --Return a bound path's value coerced to a string.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int sym_bound_str(SymBindingPtr binding, char **value)
+{
+    ValuePtr vptr;
+
+    if (sym_bound(binding, &vptr) == STRING_TYPE)
+    {
+        *value = vptr->string;
+        return 1;
+    }
+    return 0;
+}
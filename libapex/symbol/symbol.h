@@ -20,6 +20,7 @@
 #define SYMBOL_H
 #include <limits.h>
 #include <stdio.h>
+#include <apex/atomic.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -46,6 +47,11 @@ extern "C"
 #define NULL_ENUM {.name = NULL}
 #define NULL_SYMBOL {.type = VOID_TYPE}
 
+    /*
+     * sym_unpack() flags: decode strings in place (see sym-pack.c).
+     */
+#define SYM_UNPACK_INSITU 0x1
+
     /*
      * Type --The various types understood by the SYMBOL ADT.
      */
@@ -100,6 +106,27 @@ extern "C"
         int value;
     } Enum, *EnumPtr;
 
+    /*
+     * EnumIndex --A perfect-hash (and dense value) index of an Enum list.
+     *
+     * Remarks:
+     * Built (and registered) by enum_index(); thereafter the Enum
+     * functions look names up in it with two hashes and one strcmp(),
+     * and values by direct addressing (if they're dense enough).
+     */
+    typedef struct EnumIndex_t
+    {
+        const Enum *item;              /* the Enum list indexed */
+        size_t n_item;
+        size_t n_bucket;               /* hash buckets (first level) */
+        unsigned int *seed;            /* per-bucket displacement seed */
+        size_t n_slot;                 /* hash slots (second level) */
+        int *slot;                     /* item index, per slot (-1: none) */
+        int min_value;                 /* value of name[0] */
+        size_t n_name;                 /* dense value->name (0: sparse) */
+        const char **name;
+    } EnumIndex, *EnumIndexPtr;
+
     /*
      * Symbol --A complete symbol: name, type, value.
      */
@@ -110,6 +137,76 @@ extern "C"
         Value value;
     } Symbol, *SymbolPtr;
 
+    /*
+     * SymBinding --A symbol path, bound to its value in a symbol table.
+     *
+     * Remarks:
+     * The binding caches the ValuePtr that the path resolves to, and
+     * the symbol generation at the time; sym_bound() re-resolves the
+     * path only if some table has changed since (see sym_changed()).
+     */
+    typedef struct SymBinding_t
+    {
+        SymbolPtr symtab;              /* the table the path is bound in */
+        AtomPtr path;                  /* the (compiled) path */
+        unsigned int generation;       /* sym_generation when resolved */
+        Type type;                     /* the value's type (or VOID_TYPE) */
+        ValuePtr value;                /* the value, or NULL */
+    } SymBinding, *SymBindingPtr;
+
+    /*
+     * SymImage --A symbol tree image, mapped read-only from a file.
+     */
+    typedef struct SymImage_t
+    {
+        void *base;                    /* the mapped image */
+        size_t size;                   /* ...and its size */
+    } SymImage, *SymImagePtr;
+
+    /*
+     * SymMatchSet --A compiled set of path patterns (see sym-match.c).
+     */
+    typedef struct SymMatchSet_t SymMatchSet, *SymMatchSetPtr;
+    typedef void (*SymMatchProc)(void *data, void *context);
+
+    /*
+     * SymConfig --A published, reloadable symbol table (see sym-snapshot.c).
+     *
+     * Remarks:
+     * Readers get the current snapshot with sym_read_begin(), without
+     * locking; the writer replaces it with sym_publish(), and retired
+     * snapshots are freed when no reader can still see them.
+     */
+    typedef void (*SymFreeProc)(SymbolPtr symtab);
+
+    typedef struct SymSnapshot_t
+    {
+        SymbolPtr symtab;              /* the (immutable) symbol table */
+        unsigned long version;         /* 1, 2, ... in publish order */
+        unsigned long retire_epoch;    /* epoch when it was replaced */
+        struct SymSnapshot_t *next;    /* next retired snapshot */
+    } SymSnapshot, *SymSnapshotPtr;
+
+    typedef struct SymReader_t
+    {
+        unsigned long epoch;           /* epoch at sym_read_begin(), or 0 */
+        unsigned int in_use;           /* slot is claimed by a thread */
+        char pad[CACHE_LINE - sizeof(unsigned long) - sizeof(unsigned int)];
+    } SymReader, *SymReaderPtr;
+
+    typedef struct SymConfig_t
+    {
+        SymSnapshotPtr current;        /* the published snapshot */
+        unsigned long epoch;           /* advanced by each sym_publish() */
+        unsigned long version;         /* the last version published */
+        SymFreeProc free_symtab;       /* releases retired tables */
+        SymSnapshotPtr retired;        /* (writer-owned) */
+        size_t n_reader;
+        SymReaderPtr reader;           /* per-thread reader slots */
+    } SymConfig, *SymConfigPtr;
+
+    extern unsigned int sym_generation;
+
     extern Atom null_atom;
     extern Enum null_enum;
     extern Symbol null_symbol;
@@ -128,17 +225,68 @@ extern "C"
     int fprint_sym_path(FILE * fp, AtomPtr path);
     int print_sym_path(AtomPtr path);
 
+    SymMatchSetPtr new_sym_match(void);
+    void free_sym_match(SymMatchSetPtr set);
+    int sym_match_add(SymMatchSetPtr set, AtomPtr pattern, void *data);
+    size_t sym_match(SymMatchSetPtr set, AtomPtr path, SymMatchProc proc,
+                     void *context);
+
     Type sym_get(SymbolPtr symtab, AtomPtr path, ValuePtr * value_ptr);
     Type sym_get_value(SymbolPtr symtab, AtomPtr path, ValuePtr value);
     int sym_get_int(SymbolPtr symtab, AtomPtr path, SYMBOL_INT * value);
     int sym_get_real(SymbolPtr symtab, AtomPtr path, double *value);
     int sym_get_str(SymbolPtr symtab, AtomPtr path, char **value);
+
+    void sym_changed(void);
+    Type sym_bind(SymBindingPtr binding, SymbolPtr symtab, AtomPtr path);
+    Type sym_bound(SymBindingPtr binding, ValuePtr * value_ptr);
+    int sym_bound_int(SymBindingPtr binding, SYMBOL_INT * value);
+    int sym_bound_real(SymBindingPtr binding, double *value);
+    int sym_bound_str(SymBindingPtr binding, char **value);
+
+    char *sym_intern(const char *str);
+    int sym_interned(const char *str);
+    void sym_intern_free(void);
+    void sym_free_string_(char *str);
+
+    SymbolPtr sym_copy(SymbolPtr symtab);
+    SymConfigPtr sym_config_init(SymConfigPtr config, SymbolPtr symtab,
+                                 size_t n_reader, SymFreeProc free_symtab);
+    void sym_config_free(SymConfigPtr config);
+    SymReaderPtr sym_config_reader(SymConfigPtr config);
+    void sym_config_unreader(SymReaderPtr reader);
+    SymSnapshotPtr sym_read_begin(SymConfigPtr config, SymReaderPtr reader);
+    void sym_read_end(SymReaderPtr reader);
+    unsigned long sym_publish(SymConfigPtr config, SymbolPtr symtab);
+    size_t sym_config_reclaim(SymConfigPtr config);
+
+    SymbolPtr sym_compact(SymbolPtr symtab);
+    void sym_compact_free(SymbolPtr symtab);
+
+    int sym_image_write(const char *path, SymbolPtr symtab);
+    SymImagePtr sym_image_open(SymImagePtr image, const char *path);
+    void sym_image_close(SymImagePtr image);
+    Type sym_image_get(SymImagePtr image, AtomPtr path, ValuePtr value);
+
+    size_t sym_pack(char *buf, size_t size, Type type, Value value);
+    AtomPtr sym_unpack(char *buf, size_t n, int flags, size_t *used);
+    void sym_unpack_free(AtomPtr atom);
+
+    int sym_index(SymbolPtr symtab, size_t min_size);
+    void sym_unindex(SymbolPtr symtab);
+    void sym_index_drop_(SymbolPtr symtab);
+    SymbolPtr sym_index_find_(SymbolPtr symtab, const char *name);
+
     int sym_get_enum(SymbolPtr symtab, size_t n_enum, EnumPtr enums, AtomPtr path, int **value);    /* not implemented yet! */
 
     int enum_cmp(const Enum * a, const Enum * b);
     int str_enum(const char *name, size_t n_items, Enum item[], int *valp);
     int enum_value(const char *name, const EnumPtr item);
     const char *enum_name(int value, const EnumPtr item);
+    const EnumIndex *enum_index(const Enum item[]);
+    int enum_index_find(const EnumIndex * index, const char *name);
+    const char *enum_index_name(const EnumIndex * index, int value);
+    const EnumIndex *enum_index_lookup_(const Enum item[]);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,448 @@
+/*
+ * EVENT-LOOP.C --An event loop that dispatches fd events and timers.
+ *
+ * Contents:
+ * event_loop_new()    --Create a new event loop.
+ * event_loop_free()   --Close an event loop, and free its resources.
+ * grow_handlers()     --Make sure the handler table covers some fd.
+ * backend_mask()      --Convert an event mask to the backend's flags.
+ * event_loop_add()    --Add a handler for events on a file descriptor.
+ * event_loop_modify() --Change the events a file descriptor is waiting for.
+ * event_loop_remove() --Remove a file descriptor's handler.
+ * wait_msec()         --Calculate the wait time (ms) for the next wait.
+ * backend_wait()      --Wait for events, and dispatch them to their handlers.
+ * event_loop_wait()   --Wait for (and dispatch) events, and expire timers.
+ * event_loop_run()    --Dispatch events until stopped, or nothing to wait for.
+ * event_loop_stop()   --Make event_loop_run() return.
+ *
+ * Remarks:
+ * On Linux the loop uses epoll, so the cost of a wait is proportional
+ * to the number of ready descriptors, not the number being watched;
+ * elsewhere it falls back to poll(), which is O(n) but has no
+ * FD_SETSIZE limit.  (EVENT_EDGE is ignored by the poll() backend, so
+ * edge-triggered handlers must still drain their fd until EAGAIN.)
+ *
+ * Handlers are kept in a table indexed by fd.  A handler may add,
+ * modify or remove any handler (including its own) while being
+ * dispatched; a removed handler won't be called for events already
+ * collected in the same wait.
+ *
+ * An AtomicQueue's eventfd (see queue_wait_fd()) can be added like any
+ * other fd: its handler drains the queue with queue_pop(), and then
+ * calls queue_wait_fd() to re-arm it.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#define USE_EPOLL
+#else
+#include <poll.h>
+#endif /* __linux__ */
+
+#include <apex.h>
+#include <apex/event-loop.h>
+
+#define MAX_READY 256                  /* events collected per wait */
+
+typedef struct EventHandler
+{
+    EventProc proc;                    /* NULL: fd not registered */
+    void *data;
+    int events;
+} EventHandler;
+
+struct EventLoop_t
+{
+    int backend_fd;                    /* epoll fd (or -1) */
+    EventHandler *handler;             /* indexed by fd */
+    int n_handler;                     /* size of handler[] */
+    int n_fd;                          /* No. of registered fds */
+    TimerWheelPtr wheel;               /* timers to expire (or NULL) */
+    int stop;
+};
+
+/*
+ * event_loop_new() --Create a new event loop.
+ *
+ * Parameters:
+ * wheel    --a timing wheel to expire timers from (may be NULL)
+ *
+ * Returns: (EventLoopPtr)
+ * Success: the new loop; Failure: NULL.
+ */
+EventLoopPtr event_loop_new(TimerWheelPtr wheel)
+{
+    EventLoopPtr loop = NEW(EventLoop, 1);
+
+    if (loop == NULL)
+    {
+        return NULL;
+    }
+    loop->wheel = wheel;
+    loop->backend_fd = -1;
+#ifdef USE_EPOLL
+    if ((loop->backend_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        free(loop);
+        return NULL;
+    }
+#endif /* USE_EPOLL */
+    return loop;
+}
+
+/*
+ * event_loop_free() --Close an event loop, and free its resources.
+ *
+ * Remarks:
+ * The registered file descriptors are not closed.
+ */
+void event_loop_free(EventLoopPtr loop)
+{
+    if (loop != NULL)
+    {
+        if (loop->backend_fd >= 0)
+        {
+            close(loop->backend_fd);
+        }
+        free(loop->handler);
+        free(loop);
+    }
+}
+
+/*
+ * grow_handlers() --Make sure the handler table covers some fd.
+ */
+static int grow_handlers(EventLoopPtr loop, int fd)
+{
+    if (fd >= loop->n_handler)
+    {
+        int n = MAX(fd + 1, loop->n_handler * 2);
+        EventHandler *handler = realloc(loop->handler,
+                                        (size_t) n * sizeof(*handler));
+
+        if (handler == NULL)
+        {
+            return 0;                  /* failure: realloc failed */
+        }
+        memset(handler + loop->n_handler, 0,
+               (size_t) (n - loop->n_handler) * sizeof(*handler));
+        loop->handler = handler;
+        loop->n_handler = n;
+    }
+    return 1;
+}
+
+#ifdef USE_EPOLL
+/*
+ * backend_mask() --Convert an event mask to the backend's flags.
+ */
+static uint32_t backend_mask(int events)
+{
+    return ((events & EVENT_READ) ? EPOLLIN | EPOLLRDHUP : 0)
+        | ((events & EVENT_WRITE) ? EPOLLOUT : 0)
+        | ((events & EVENT_EDGE) ? EPOLLET : 0);
+}
+#endif /* USE_EPOLL */
+
+/*
+ * event_loop_add() --Add a handler for events on a file descriptor.
+ *
+ * Parameters:
+ * loop     --the event loop
+ * fd       --the file descriptor to watch
+ * events   --the events to wait for (EVENT_READ, EVENT_WRITE, EVENT_EDGE)
+ * proc     --the handler, called with the events that occurred
+ * data     --handler-specific data
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is EEXIST if fd is already added).
+ */
+int event_loop_add(EventLoopPtr loop, int fd, int events,
+                   EventProc proc, void *data)
+{
+    if (fd < 0 || proc == NULL)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+    if (!grow_handlers(loop, fd))
+    {
+        return 0;
+    }
+    if (loop->handler[fd].proc != NULL)
+    {
+        errno = EEXIST;
+        return 0;
+    }
+#ifdef USE_EPOLL
+    {
+        struct epoll_event event = {.events = backend_mask(events) };
+
+        event.data.fd = fd;
+        if (epoll_ctl(loop->backend_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            return 0;
+        }
+    }
+#endif /* USE_EPOLL */
+    loop->handler[fd].proc = proc;
+    loop->handler[fd].data = data;
+    loop->handler[fd].events = events;
+    loop->n_fd += 1;
+    return 1;
+}
+
+/*
+ * event_loop_modify() --Change the events a file descriptor is waiting for.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int event_loop_modify(EventLoopPtr loop, int fd, int events)
+{
+    if (fd < 0 || fd >= loop->n_handler || loop->handler[fd].proc == NULL)
+    {
+        errno = ENOENT;
+        return 0;
+    }
+#ifdef USE_EPOLL
+    {
+        struct epoll_event event = {.events = backend_mask(events) };
+
+        event.data.fd = fd;
+        if (epoll_ctl(loop->backend_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+        {
+            return 0;
+        }
+    }
+#endif /* USE_EPOLL */
+    loop->handler[fd].events = events;
+    return 1;
+}
+
+/*
+ * event_loop_remove() --Remove a file descriptor's handler.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The fd must be removed before it's closed.
+ */
+int event_loop_remove(EventLoopPtr loop, int fd)
+{
+    if (fd < 0 || fd >= loop->n_handler || loop->handler[fd].proc == NULL)
+    {
+        errno = ENOENT;
+        return 0;
+    }
+#ifdef USE_EPOLL
+    epoll_ctl(loop->backend_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif /* USE_EPOLL */
+    loop->handler[fd].proc = NULL;
+    loop->handler[fd].data = NULL;
+    loop->n_fd -= 1;
+    return 1;
+}
+
+/*
+ * wait_msec() --Calculate the wait time (ms) for the next wait.
+ *
+ * Remarks:
+ * This is the earlier of the caller's timeout and the next timer's
+ * expiry, rounded up (so we don't wake just before a timer, and spin).
+ */
+static int wait_msec(EventLoopPtr loop, TimeValuePtr timeout)
+{
+    TimeValue now, timer_tv;
+    TimeValuePtr tv = timeout;
+    long long msec;
+
+    if (loop->wheel != NULL)
+    {
+        gettimeofday(&now, NULL);
+        if (timer_wheel_timeout(loop->wheel, &now, &timer_tv) != NULL
+            && (tv == NULL || tv_cmp(&timer_tv, tv) < 0))
+        {
+            tv = &timer_tv;
+        }
+    }
+    if (tv == NULL)
+    {
+        return -1;                     /* wait forever */
+    }
+    if (tv->tv_sec < 0)
+    {
+        return 0;
+    }
+    msec = (long long) tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+    return msec > INT_MAX ? INT_MAX : (int) msec;
+}
+
+#ifdef USE_EPOLL
+/*
+ * backend_wait() --Wait for events, and dispatch them to their handlers.
+ */
+static int backend_wait(EventLoopPtr loop, int msec)
+{
+    struct epoll_event ready[MAX_READY];
+    int n_ready, n = 0;
+
+    if ((n_ready = epoll_wait(loop->backend_fd, ready,
+                              (int) NEL(ready), msec)) < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < n_ready; ++i)
+    {
+        int fd = ready[i].data.fd;
+        uint32_t flags = ready[i].events;
+        EventHandler *handler = &loop->handler[fd];
+
+        if (handler->proc != NULL)     /* (removed by an earlier handler?) */
+        {
+            handler->proc(loop, fd,
+                          ((flags & EPOLLIN) ? EVENT_READ : 0)
+                          | ((flags & EPOLLOUT) ? EVENT_WRITE : 0)
+                          | ((flags & EPOLLERR) ? EVENT_ERROR : 0)
+                          | ((flags & (EPOLLHUP | EPOLLRDHUP))
+                             ? EVENT_HANGUP : 0), handler->data);
+            ++n;
+        }
+    }
+    return n;
+}
+#else
+/*
+ * backend_wait() --Wait for events, and dispatch them to their handlers.
+ */
+static int backend_wait(EventLoopPtr loop, int msec)
+{
+    struct pollfd *pfd;
+    int n_ready, n_pfd = 0, n = 0;
+
+    if ((pfd = NEW(struct pollfd, (size_t) loop->n_fd + 1)) == NULL)
+    {
+        return -1;
+    }
+    for (int fd = 0; fd < loop->n_handler; ++fd)
+    {
+        if (loop->handler[fd].proc != NULL)
+        {
+            int events = loop->handler[fd].events;
+
+            pfd[n_pfd].fd = fd;
+            pfd[n_pfd++].events =
+                (short) (((events & EVENT_READ) ? POLLIN : 0)
+                         | ((events & EVENT_WRITE) ? POLLOUT : 0));
+        }
+    }
+    if ((n_ready = poll(pfd, (nfds_t) n_pfd, msec)) < 0)
+    {
+        free(pfd);
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < n_pfd && n_ready > 0; ++i)
+    {
+        int fd = pfd[i].fd;
+        short flags = pfd[i].revents;
+        EventHandler *handler = &loop->handler[fd];
+
+        if (flags != 0)
+        {
+            --n_ready;
+            if (handler->proc != NULL)
+            {
+                handler->proc(loop, fd,
+                              ((flags & POLLIN) ? EVENT_READ : 0)
+                              | ((flags & POLLOUT) ? EVENT_WRITE : 0)
+                              | ((flags & (POLLERR | POLLNVAL))
+                                 ? EVENT_ERROR : 0)
+                              | ((flags & POLLHUP) ? EVENT_HANGUP : 0),
+                              handler->data);
+                ++n;
+            }
+        }
+    }
+    free(pfd);
+    return n;
+}
+#endif /* USE_EPOLL */
+
+/*
+ * event_loop_wait() --Wait for (and dispatch) events, and expire timers.
+ *
+ * Parameters:
+ * loop     --the event loop
+ * timeout  --the maximum time to wait (NULL: until an event or timer)
+ *
+ * Returns: (int)
+ * Success: the number of handlers and timers called; Failure: -1.
+ */
+int event_loop_wait(EventLoopPtr loop, TimeValuePtr timeout)
+{
+    int n;
+
+    if ((n = backend_wait(loop, wait_msec(loop, timeout))) < 0)
+    {
+        return -1;
+    }
+    if (loop->wheel != NULL)
+    {
+        TimeValue now;
+
+        gettimeofday(&now, NULL);
+        n += timer_wheel_advance(loop->wheel, &now);
+    }
+    return n;
+}
+
+/*
+ * event_loop_run() --Dispatch events until stopped, or nothing to wait for.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The loop returns when a handler calls event_loop_stop(), or when
+ * there are no fds registered and no timers pending.
+ */
+int event_loop_run(EventLoopPtr loop)
+{
+    TimeValue now, tv;
+
+    loop->stop = 0;
+    while (!loop->stop)
+    {
+        if (loop->n_fd == 0)
+        {
+            gettimeofday(&now, NULL);
+            if (loop->wheel == NULL
+                || timer_wheel_timeout(loop->wheel, &now, &tv) == NULL)
+            {
+                break;                 /* nothing left to wait for */
+            }
+        }
+        if (event_loop_wait(loop, NULL) < 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * event_loop_stop() --Make event_loop_run() return.
+ *
+ * Remarks:
+ * This is intended to be called from a handler (or timer); the loop
+ * returns after the current wait's events have been dispatched.
+ */
+void event_loop_stop(EventLoopPtr loop)
+{
+    loop->stop = 1;
+}
@@ -0,0 +1,50 @@
+/*
+ * EVENT-LOOP.H --An event loop that dispatches fd events and timers.
+ *
+ * Remarks:
+ * An EventLoop calls a handler procedure when its file descriptor
+ * becomes readable/writable, and expires the timers of an (optional)
+ * TimerWheel, so one thread can service thousands of sockets without
+ * the FD_SETSIZE limit (and O(n) scan) of wait_input().
+ *
+ */
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <apex/timeval.h>
+#include <apex/timer-wheel.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    /*
+     * event masks: requested (READ, WRITE, EDGE) and reported
+     * (READ, WRITE, ERROR, HANGUP).
+     */
+    enum
+    {
+        EVENT_READ = 0x1,              /* fd is readable */
+        EVENT_WRITE = 0x2,             /* fd is writable */
+        EVENT_ERROR = 0x4,             /* fd has an error condition */
+        EVENT_HANGUP = 0x8,            /* peer closed the connection */
+        EVENT_EDGE = 0x10              /* edge-triggered (if supported) */
+    };
+
+    typedef struct EventLoop_t EventLoop, *EventLoopPtr;
+    typedef void (*EventProc)(EventLoopPtr loop, int fd, int events,
+                              void *data);
+
+    EventLoopPtr event_loop_new(TimerWheelPtr wheel);
+    void event_loop_free(EventLoopPtr loop);
+    int event_loop_add(EventLoopPtr loop, int fd, int events,
+                       EventProc proc, void *data);
+    int event_loop_modify(EventLoopPtr loop, int fd, int events);
+    int event_loop_remove(EventLoopPtr loop, int fd);
+    int event_loop_wait(EventLoopPtr loop, TimeValuePtr timeout);
+    int event_loop_run(EventLoopPtr loop);
+    void event_loop_stop(EventLoopPtr loop);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* EVENT_LOOP_H */
@@ -0,0 +1,700 @@
+/*
+ * METRICS.C --A registry of counters, gauges and histograms.
+ *
+ * Contents:
+ * Sample{}          --One value (or histogram) being formatted.
+ * MetricWriter_t{}  --The samples collected for metrics_format().
+ * thread_shard()    --Return the calling thread's counter shard.
+ * metric_new_()     --Allocate and register a metric.
+ * metric_counter_new() --Create and register a counter.
+ * metric_counter_add() --Add to a counter.
+ * metric_counter_value() --Return a counter's total.
+ * metric_gauge_new() --Create and register a gauge.
+ * metric_gauge_set() --Set a gauge's value.
+ * metric_gauge_add() --Add to (or subtract from) a gauge.
+ * metric_gauge_value() --Return a gauge's value.
+ * metric_bucket()   --Return the histogram bucket of a value.
+ * metric_bucket_min() --Return the smallest value in a histogram bucket.
+ * metric_histogram_new() --Create and register a histogram.
+ * metric_histogram_record() --Record a value in a histogram.
+ * metric_histogram_count() --Return the No. of values in a histogram.
+ * metric_histogram_quantile() --Estimate a quantile of a histogram's values.
+ * metric_collector_new() --Register a collector callback.
+ * metric_free()     --Unregister and free a metric.
+ * metric_label()    --Format a label, escaping its value.
+ * add_sample()      --Add a sample to a writer.
+ * metric_write()    --Report a collector's value.
+ * metric_write_labelled() --Report a collector's value, with extra labels.
+ * sample_cmp()      --Order samples by name (then registration).
+ * format_labels()   --Format a sample's labels, with an optional extra one.
+ * format_histogram() --Format a histogram's cumulative buckets, sum and count.
+ * metrics_format()  --Format the registered metrics in Prometheus text format.
+ * metrics_print()   --Print the registered metrics in Prometheus text format.
+ *
+ * Remarks:
+ * The histogram is log-linear, as in HdrHistogram: values below
+ * 2*METRIC_SUB have a bucket each, and each power-of-2 range above
+ * that is divided into METRIC_SUB equal buckets, so a bucket's width
+ * is at most 1/METRIC_SUB (12.5%) of its values.  The exposition
+ * collapses these to one (cumulative) bucket per power of 2, but
+ * metric_histogram_quantile() uses them all.
+ *
+ * The registry's lock is only taken to register, free and format
+ * metrics, never to update them.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <apex.h>
+#include <apex/estring.h>
+#include <apex/metrics.h>
+
+/*
+ * Sample --One value (or histogram) being formatted.
+ */
+typedef struct Sample_t
+{
+    char name[METRIC_NAME_MAX];
+    const char *help;
+    MetricType type;
+    char labels[METRIC_LABELS_MAX];
+    double value;
+    int integer;                       /* value is exactly ivalue */
+    long long ivalue;
+    const MetricHistogram *histogram;
+    size_t order;                      /* (for a stable sort) */
+} Sample;
+
+/*
+ * MetricWriter_t --The samples collected for metrics_format().
+ */
+struct MetricWriter_t
+{
+    Sample *sample;
+    size_t n_sample;
+    size_t max_sample;
+    const char *labels;                /* the current collector's labels */
+    int failed;
+};
+
+static MetricPtr registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int next_shard;
+static THREAD_LOCAL int shard_plus_1;  /* (0: not yet assigned) */
+
+static const char *type_name[] = {
+    "counter", "gauge", "histogram", "untyped"
+};
+
+/*
+ * thread_shard() --Return the calling thread's counter shard.
+ *
+ * Remarks:
+ * Threads are given shards round-robin, as they first use a counter.
+ */
+static inline int thread_shard(void)
+{
+    if (shard_plus_1 == 0)
+    {
+        shard_plus_1 = (int) (ATOMIC_ADD(&next_shard, 1)
+                              & (METRIC_N_SHARD - 1)) + 1;
+    }
+    return shard_plus_1 - 1;
+}
+
+/*
+ * metric_new_() --Allocate and register a metric.
+ *
+ * Parameters:
+ * size     --the size of the metric's structure
+ * type     --the metric's type
+ * name, help, labels   --its description (copied)
+ *
+ * Returns: (MetricPtr)
+ * Success: the (zeroed) metric; Failure: NULL.
+ */
+static MetricPtr metric_new_(size_t size, MetricType type, const char *name,
+                             const char *help, const char *labels)
+{
+    MetricPtr metric, *link;
+
+    if ((metric = calloc(1, size)) == NULL)
+    {
+        return NULL;
+    }
+    metric->type = type;
+    if ((name != NULL && (metric->name = strdup(name)) == NULL)
+        || (help != NULL && (metric->help = strdup(help)) == NULL)
+        || (labels != NULL && (metric->labels = strdup(labels)) == NULL))
+    {
+        free(metric->name);
+        free(metric->help);
+        free(metric);
+        return NULL;
+    }
+    pthread_mutex_lock(&registry_lock);
+    for (link = &registry; *link != NULL; link = &(*link)->next)
+    {
+        ;                              /* (keep registration order) */
+    }
+    *link = metric;
+    pthread_mutex_unlock(&registry_lock);
+    return metric;
+}
+
+/*
+ * metric_counter_new() --Create and register a counter.
+ *
+ * Parameters:
+ * name     --the metric's name (e.g. "requests_total")
+ * help     --a description of the metric, or NULL
+ * labels   --the metric's labels (e.g. "method=\"get\""), or NULL
+ *
+ * Returns: (MetricCounterPtr)
+ * Success: the counter; Failure: NULL.
+ */
+MetricCounterPtr metric_counter_new(const char *name, const char *help,
+                                    const char *labels)
+{
+    return (MetricCounterPtr) metric_new_(sizeof(MetricCounter),
+                                          METRIC_COUNTER, name, help,
+                                          labels);
+}
+
+/*
+ * metric_counter_add() --Add to a counter.
+ *
+ * Remarks:
+ * A zeroed MetricCounter can be used without registering it, e.g.
+ * as a static that a collector reports.
+ */
+void metric_counter_add(MetricCounterPtr counter, uint64_t n)
+{
+    ATOMIC_ADD_RELAXED(&counter->shard[thread_shard()].value, n);
+}
+
+/*
+ * metric_counter_value() --Return a counter's total.
+ */
+uint64_t metric_counter_value(const MetricCounter * counter)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < METRIC_N_SHARD; ++i)
+    {
+        total += ATOMIC_LOAD_RELAXED(&counter->shard[i].value);
+    }
+    return total;
+}
+
+/*
+ * metric_gauge_new() --Create and register a gauge.
+ */
+MetricGaugePtr metric_gauge_new(const char *name, const char *help,
+                                const char *labels)
+{
+    return (MetricGaugePtr) metric_new_(sizeof(MetricGauge), METRIC_GAUGE,
+                                        name, help, labels);
+}
+
+/*
+ * metric_gauge_set() --Set a gauge's value.
+ */
+void metric_gauge_set(MetricGaugePtr gauge, int64_t value)
+{
+    ATOMIC_STORE_RELAXED(&gauge->value, value);
+}
+
+/*
+ * metric_gauge_add() --Add to (or subtract from) a gauge.
+ */
+void metric_gauge_add(MetricGaugePtr gauge, int64_t n)
+{
+    ATOMIC_ADD_RELAXED(&gauge->value, n);
+}
+
+/*
+ * metric_gauge_value() --Return a gauge's value.
+ */
+int64_t metric_gauge_value(const MetricGauge * gauge)
+{
+    return ATOMIC_LOAD_RELAXED(&gauge->value);
+}
+
+/*
+ * metric_bucket() --Return the histogram bucket of a value.
+ */
+int metric_bucket(uint64_t value)
+{
+    int shift;
+
+    if (value < 2 * METRIC_SUB)
+    {
+        return (int) value;
+    }
+    shift = 63 - __builtin_clzll(value) - METRIC_SUB_BITS;
+    return shift * METRIC_SUB + (int) (value >> shift);
+}
+
+/*
+ * metric_bucket_min() --Return the smallest value in a histogram bucket.
+ */
+uint64_t metric_bucket_min(int bucket)
+{
+    int shift;
+
+    if (bucket < 2 * METRIC_SUB)
+    {
+        return (uint64_t) bucket;
+    }
+    shift = bucket / METRIC_SUB - 1;
+    return (uint64_t) (bucket - shift * METRIC_SUB) << shift;
+}
+
+/*
+ * metric_histogram_new() --Create and register a histogram.
+ *
+ * Parameters:
+ * name, help, labels   --as for metric_counter_new()
+ * scale    --the exposition's unit, per recorded unit (e.g. 1e-9 to
+ *            report values recorded in nanoseconds as seconds)
+ *
+ * Returns: (MetricHistogramPtr)
+ * Success: the histogram; Failure: NULL.
+ */
+MetricHistogramPtr metric_histogram_new(const char *name, const char *help,
+                                        const char *labels, double scale)
+{
+    MetricHistogramPtr histogram;
+
+    histogram = (MetricHistogramPtr) metric_new_(sizeof(MetricHistogram),
+                                                 METRIC_HISTOGRAM, name, help,
+                                                 labels);
+    if (histogram != NULL)
+    {
+        histogram->scale = scale > 0.0 ? scale : 1.0;
+    }
+    return histogram;
+}
+
+/*
+ * metric_histogram_record() --Record a value in a histogram.
+ */
+void metric_histogram_record(MetricHistogramPtr histogram, uint64_t value)
+{
+    ATOMIC_ADD_RELAXED(&histogram->bucket[metric_bucket(value)], 1);
+    ATOMIC_ADD_RELAXED(&histogram->count, 1);
+    ATOMIC_ADD_RELAXED(&histogram->sum, value);
+}
+
+/*
+ * metric_histogram_count() --Return the No. of values in a histogram.
+ */
+uint64_t metric_histogram_count(const MetricHistogram * histogram)
+{
+    return ATOMIC_LOAD_RELAXED(&histogram->count);
+}
+
+/*
+ * metric_histogram_quantile() --Estimate a quantile of a histogram's values.
+ *
+ * Parameters:
+ * histogram    --the histogram
+ * q        --the quantile, in [0, 1] (e.g. 0.99)
+ *
+ * Returns: (uint64_t)
+ * The largest value in the bucket holding the q'th value (so it
+ * over-estimates by less than a bucket's width), or 0 if the
+ * histogram is empty.
+ */
+uint64_t metric_histogram_quantile(const MetricHistogram * histogram,
+                                   double q)
+{
+    uint64_t total = 0, rank, n = 0;
+
+    for (int i = 0; i < METRIC_N_BUCKET; ++i)
+    {
+        total += ATOMIC_LOAD_RELAXED(&histogram->bucket[i]);
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    rank = (uint64_t) ceil(MIN(MAX(q, 0.0), 1.0) * (double) total);
+    rank = MAX(rank, 1);
+    for (int i = 0; i < METRIC_N_BUCKET; ++i)
+    {
+        if ((n += ATOMIC_LOAD_RELAXED(&histogram->bucket[i])) >= rank)
+        {
+            return i + 1 < METRIC_N_BUCKET ?
+                metric_bucket_min(i + 1) - 1 : UINT64_MAX;
+        }
+    }
+    return UINT64_MAX;                 /* (not reached) */
+}
+
+/*
+ * metric_collector_new() --Register a collector callback.
+ *
+ * Parameters:
+ * labels   --labels added to all the collector's values, or NULL
+ * collect  --the callback, which calls metric_write() for each value
+ * data     --the callback's context
+ *
+ * Returns: (MetricPtr)
+ * Success: the collector; Failure: NULL.
+ *
+ * Remarks:
+ * The callback is called (with the registry locked) by
+ * metrics_format(), from whichever thread that runs in; the data
+ * must stay valid until metric_free().
+ */
+MetricPtr metric_collector_new(const char *labels,
+                               MetricCollectProc collect, void *data)
+{
+    MetricPtr metric;
+
+    if (collect == NULL)
+    {
+        return NULL;
+    }
+    if ((metric = metric_new_(sizeof(Metric), METRIC_COLLECTOR, NULL, NULL,
+                              labels)) != NULL)
+    {
+        metric->collect = collect;     /* (first formatted after unlock) */
+        metric->data = data;
+    }
+    return metric;
+}
+
+/*
+ * metric_free() --Unregister and free a metric.
+ *
+ * Parameters:
+ * metric   --any metric returned by a metric_*_new() function, or NULL
+ */
+void metric_free(void *metric)
+{
+    MetricPtr m = metric;
+
+    if (m == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&registry_lock);
+    for (MetricPtr * link = &registry; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == m)
+        {
+            *link = m->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    free(m->name);
+    free(m->help);
+    free(m->labels);
+    free(m);
+}
+
+/*
+ * metric_label() --Format a label, escaping its value.
+ *
+ * Parameters:
+ * labels   --returns the label (e.g. queue="input")
+ * size     --the size of labels
+ * key      --the label's name
+ * value    --the label's value
+ *
+ * Returns: (char *)
+ * The label (truncated if necessary).
+ */
+char *metric_label(char *labels, size_t size, const char *key,
+                   const char *value)
+{
+    size_t n = (size_t) snprintf(labels, size, "%s=\"", key);
+
+    for (; value != NULL && *value != '\0' && n + 4 < size; ++value)
+    {
+        if (*value == '\\' || *value == '"' || *value == '\n')
+        {
+            labels[n++] = '\\';
+        }
+        labels[n++] = *value == '\n' ? 'n' : *value;
+    }
+    if (n + 2 <= size)
+    {
+        labels[n++] = '"';
+        labels[n] = '\0';
+    }
+    return labels;
+}
+
+/*
+ * add_sample() --Add a sample to a writer.
+ *
+ * Returns: (Sample *)
+ * Success: the new (zeroed) sample; Failure: NULL.
+ */
+static Sample *add_sample(MetricWriterPtr writer, const char *name,
+                          const char *help, MetricType type,
+                          const char *labels, const char *extra)
+{
+    Sample *sample;
+
+    if (writer->n_sample == writer->max_sample)
+    {
+        size_t max_sample = MAX(writer->max_sample * 2, 64);
+
+        if ((sample = realloc(writer->sample,
+                              max_sample * sizeof(*sample))) == NULL)
+        {
+            writer->failed = 1;
+            return NULL;
+        }
+        writer->sample = sample;
+        writer->max_sample = max_sample;
+    }
+    sample = writer->sample + writer->n_sample;
+    memset(sample, 0, sizeof(*sample));
+    snprintf(sample->name, sizeof(sample->name), "%s", name);
+    sample->help = help;
+    sample->type = type;
+    snprintf(sample->labels, sizeof(sample->labels), "%s%s%s",
+             STREMPTY(labels) ? "" : labels,
+             !STREMPTY(labels) && !STREMPTY(extra) ? "," : "",
+             STREMPTY(extra) ? "" : extra);
+    sample->order = writer->n_sample++;
+    return sample;
+}
+
+/*
+ * metric_write() --Report a collector's value.
+ *
+ * Parameters:
+ * writer   --the writer passed to the collector
+ * name     --the value's metric name
+ * help     --a description of the metric (must be static), or NULL
+ * type     --METRIC_COUNTER or METRIC_GAUGE
+ * value    --the value
+ */
+void metric_write(MetricWriterPtr writer, const char *name,
+                  const char *help, MetricType type, double value)
+{
+    metric_write_labelled(writer, name, help, type, NULL, value);
+}
+
+/*
+ * metric_write_labelled() --Report a collector's value, with extra labels.
+ *
+ * Parameters:
+ * writer, name, help, type --as for metric_write()
+ * labels   --labels added to the collector's (e.g. priority="err")
+ * value    --the value
+ */
+void metric_write_labelled(MetricWriterPtr writer, const char *name,
+                           const char *help, MetricType type,
+                           const char *labels, double value)
+{
+    Sample *sample;
+
+    if ((sample = add_sample(writer, name, help, type,
+                             writer->labels, labels)) != NULL)
+    {
+        sample->value = value;
+    }
+}
+
+/*
+ * sample_cmp() --Order samples by name (then registration).
+ */
+static int sample_cmp(const void *a, const void *b)
+{
+    const Sample *sa = a, *sb = b;
+    int cmp = strcmp(sa->name, sb->name);
+
+    return cmp != 0 ? cmp : (sa->order > sb->order) - (sa->order < sb->order);
+}
+
+/*
+ * format_labels() --Format a sample's labels, with an optional extra one.
+ */
+static void format_labels(StrBuf * buf, const char *labels,
+                          const char *extra)
+{
+    int n = (!STREMPTY(labels)) + (extra != NULL);
+
+    if (n > 0)
+    {
+        strbuf_printf(buf, "{%s%s%s}", STREMPTY(labels) ? "" : labels,
+                      n == 2 ? "," : "", extra != NULL ? extra : "");
+    }
+}
+
+/*
+ * format_histogram() --Format a histogram's cumulative buckets, sum and count.
+ *
+ * Remarks:
+ * There is a bucket for each power of 2 up to the largest value;
+ * its "le" bound is exclusive (in the recorded units).
+ */
+static void format_histogram(StrBuf * buf, const Sample * sample)
+{
+    const MetricHistogram *histogram = sample->histogram;
+    uint64_t bucket[METRIC_N_BUCKET];
+    uint64_t total = 0;
+    int last = -1;
+    char le[64];
+
+    for (int i = 0; i < METRIC_N_BUCKET; ++i)
+    {
+        if ((bucket[i] = ATOMIC_LOAD_RELAXED(&histogram->bucket[i])) != 0)
+        {
+            last = i;
+        }
+    }
+    for (int i = 0; i + 1 < METRIC_N_BUCKET; ++i)
+    {
+        uint64_t bound = metric_bucket_min(i + 1);
+
+        total += bucket[i];
+        if ((bound & (bound - 1)) == 0)
+        {                              /* a power of 2 */
+            snprintf(le, sizeof(le), "le=\"%.15g\"",
+                     (double) bound * histogram->scale);
+            strbuf_printf(buf, "%s_bucket", sample->name);
+            format_labels(buf, sample->labels, le);
+            strbuf_printf(buf, " %llu\n", (unsigned long long) total);
+            if (i >= last)
+            {
+                break;
+            }
+        }
+    }
+    if (last == METRIC_N_BUCKET - 1)
+    {
+        total += bucket[last];
+    }
+    strbuf_printf(buf, "%s_bucket", sample->name);
+    format_labels(buf, sample->labels, "le=\"+Inf\"");
+    strbuf_printf(buf, " %llu\n", (unsigned long long) total);
+    strbuf_printf(buf, "%s_sum", sample->name);
+    format_labels(buf, sample->labels, NULL);
+    strbuf_printf(buf, " %.15g\n",
+                  (double) ATOMIC_LOAD_RELAXED(&histogram->sum)
+                  * histogram->scale);
+    strbuf_printf(buf, "%s_count", sample->name);
+    format_labels(buf, sample->labels, NULL);
+    strbuf_printf(buf, " %llu\n", (unsigned long long) total);
+}
+
+/*
+ * metrics_format() --Format the registered metrics in Prometheus text format.
+ *
+ * Parameters:
+ * buf  --returns the text (appended)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The metrics are sorted by name (so that each name's HELP and TYPE
+ * are written once, before all its labelled values), then by the
+ * order in which they were collected.
+ */
+int metrics_format(StrBuf * buf)
+{
+    MetricWriter writer = { NULL, 0, 0, NULL, 0 };
+    const char *last_name = NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    for (MetricPtr m = registry; m != NULL; m = m->next)
+    {
+        Sample *sample;
+
+        if (m->type == METRIC_COLLECTOR)
+        {
+            writer.labels = m->labels;
+            m->collect(&writer, m->data);
+            continue;
+        }
+        if ((sample = add_sample(&writer, m->name, m->help, m->type,
+                                 m->labels, NULL)) == NULL)
+        {
+            continue;
+        }
+        sample->integer = 1;
+        switch (m->type)
+        {
+        case METRIC_COUNTER:
+            sample->ivalue = (long long)
+                metric_counter_value((MetricCounterPtr) m);
+            break;
+        case METRIC_GAUGE:
+            sample->ivalue = metric_gauge_value((MetricGaugePtr) m);
+            break;
+        default:
+            sample->histogram = (MetricHistogramPtr) m;
+            break;
+        }
+    }
+    if (writer.n_sample > 0)
+    {
+        qsort(writer.sample, writer.n_sample, sizeof(Sample), sample_cmp);
+    }
+
+    for (size_t i = 0; i < writer.n_sample; ++i)
+    {
+        const Sample *sample = writer.sample + i;
+
+        if (last_name == NULL || strcmp(last_name, sample->name) != 0)
+        {
+            if (sample->help != NULL)
+            {
+                strbuf_printf(buf, "# HELP %s %s\n", sample->name,
+                              sample->help);
+            }
+            strbuf_printf(buf, "# TYPE %s %s\n", sample->name,
+                          type_name[sample->type]);
+            last_name = sample->name;
+        }
+        if (sample->histogram != NULL)
+        {
+            format_histogram(buf, sample);
+            continue;
+        }
+        strbuf_str(buf, sample->name);
+        format_labels(buf, sample->labels, NULL);
+        if (sample->integer)
+        {
+            strbuf_printf(buf, " %lld\n", sample->ivalue);
+        }
+        else
+        {
+            strbuf_printf(buf, " %.15g\n", sample->value);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    free(writer.sample);
+    return !writer.failed && strbuf_ok(buf);
+}
+
+/*
+ * metrics_print() --Print the registered metrics in Prometheus text format.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int metrics_print(FILE * fp)
+{
+    StrBuf buf;
+    int status;
+
+    strbuf_init(&buf);
+    status = metrics_format(&buf)
+        && fwrite(buf.str, 1, buf.len, fp) == buf.len;
+    strbuf_free(&buf);
+    return status;
+}
@@ -0,0 +1,139 @@
+/*
+ * METRICS.H --Definitions for a registry of counters, gauges and histograms.
+ *
+ * Contents:
+ * MetricType        --The kinds of metric.
+ * Metric_t{}        --The registry's header of a metric.
+ * MetricCounter_t{} --A counter, sharded by thread.
+ * MetricGauge_t{}   --A value that goes up and down.
+ * MetricHistogram_t{} --A log-linear histogram of (e.g. latency) values.
+ * MetricCollectProc() --Report some other module's statistics.
+ *
+ * Remarks:
+ * Counters, gauges and histograms are updated with relaxed atomic
+ * operations, and a counter's threads each add to their own (cache
+ * line) shard, so they can be updated on a hot path.  A collector is a
+ * callback that reads statistics that a module keeps anyway (e.g. a
+ * queue's n_write), so that registering them costs nothing until the
+ * metrics are read.  metrics_format() writes all the registered
+ * metrics in the Prometheus text exposition format.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <apex/atomic.h>
+#include <apex/strbuf.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        METRIC_N_SHARD = 16,           /* counter shards (a power of 2) */
+        METRIC_SUB_BITS = 3,           /* histogram: 8 buckets per octave */
+        METRIC_SUB = 1 << METRIC_SUB_BITS,
+        METRIC_N_BUCKET = (64 - METRIC_SUB_BITS + 1) * METRIC_SUB,
+        METRIC_NAME_MAX = 128,
+        METRIC_LABELS_MAX = 256
+    };
+
+    typedef enum MetricType
+    {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM,
+        METRIC_COLLECTOR
+    } MetricType;
+
+    typedef struct MetricWriter_t MetricWriter, *MetricWriterPtr;
+
+    /*
+     * MetricCollectProc() --Report some other module's statistics.
+     *
+     * Parameters:
+     * writer   --where to report them, with metric_write()
+     * data     --the collector's context
+     */
+    typedef void (*MetricCollectProc)(MetricWriterPtr writer, void *data);
+
+    typedef struct Metric_t
+    {
+        struct Metric_t *next;         /* (the registry's list) */
+        MetricType type;
+        char *name;
+        char *help;
+        char *labels;                  /* e.g. queue="input", or NULL */
+        MetricCollectProc collect;     /* (METRIC_COLLECTOR) */
+        void *data;
+    } Metric, *MetricPtr;
+
+    typedef struct MetricShard_t
+    {
+        uint64_t value;
+        char pad[CACHE_LINE - sizeof(uint64_t)];
+    } MetricShard;
+
+    typedef struct MetricCounter_t
+    {
+        Metric metric;
+        MetricShard shard[METRIC_N_SHARD];
+    } MetricCounter, *MetricCounterPtr;
+
+    typedef struct MetricGauge_t
+    {
+        Metric metric;
+        int64_t value;
+    } MetricGauge, *MetricGaugePtr;
+
+    typedef struct MetricHistogram_t
+    {
+        Metric metric;
+        double scale;                  /* exposition units per value unit */
+        uint64_t count;
+        uint64_t sum;
+        uint64_t bucket[METRIC_N_BUCKET];
+    } MetricHistogram, *MetricHistogramPtr;
+
+    MetricCounterPtr metric_counter_new(const char *name, const char *help,
+                                        const char *labels);
+    void metric_counter_add(MetricCounterPtr counter, uint64_t n);
+    uint64_t metric_counter_value(const MetricCounter * counter);
+
+    MetricGaugePtr metric_gauge_new(const char *name, const char *help,
+                                    const char *labels);
+    void metric_gauge_set(MetricGaugePtr gauge, int64_t value);
+    void metric_gauge_add(MetricGaugePtr gauge, int64_t n);
+    int64_t metric_gauge_value(const MetricGauge * gauge);
+
+    MetricHistogramPtr metric_histogram_new(const char *name,
+                                            const char *help,
+                                            const char *labels,
+                                            double scale);
+    void metric_histogram_record(MetricHistogramPtr histogram,
+                                 uint64_t value);
+    uint64_t metric_histogram_count(const MetricHistogram * histogram);
+    uint64_t metric_histogram_quantile(const MetricHistogram * histogram,
+                                       double q);
+    int metric_bucket(uint64_t value);
+    uint64_t metric_bucket_min(int bucket);
+
+    MetricPtr metric_collector_new(const char *labels,
+                                   MetricCollectProc collect, void *data);
+    void metric_write(MetricWriterPtr writer, const char *name,
+                      const char *help, MetricType type, double value);
+    void metric_write_labelled(MetricWriterPtr writer, const char *name,
+                               const char *help, MetricType type,
+                               const char *labels, double value);
+    void metric_free(void *metric);
+    char *metric_label(char *labels, size_t size, const char *key,
+                       const char *value);
+
+    int metrics_format(StrBuf * buf);
+    int metrics_print(FILE * fp);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* METRICS_H */
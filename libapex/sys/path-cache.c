@@ -0,0 +1,1017 @@
+/*
+ * PATH-CACHE.C --Path resolution, with cached directories and results.
+ *
+ * Contents:
+ * resolve_path()     --Resolve a filename against a list of paths.
+ * open_path_fd()     --Open a file descriptor using path resolution.
+ * open_path()        --Open a file using path resolution.
+ * open_env_path()    --Open a file with an environment-specified path.
+ * make_path()        --Create the directory for a path.
+ * link_path()        --Link one path to another, creating directories as needed.
+ * path_cache_clear() --Close and forget all the cached directories.
+ *
+ * Remarks:
+ * Each search directory is opened once (O_DIRECTORY), and files are
+ * then found with fstatat() and opened with openat() relative to it,
+ * so there's no path formatting, and the kernel doesn't re-walk the
+ * directory's path every time.  A directory that can't be opened is
+ * retried on each use (it may have been created since).
+ *
+ * On Linux, each cached directory is also watched with inotify, and
+ * the result of each lookup (found, or not) is remembered until the
+ * directory changes: so repeated resolutions, and especially the
+ * misses in the earlier directories of a search path, cost no more
+ * than a (non-blocking) read of the inotify descriptor.  Lookups of
+ * bases that contain a "/" (i.e. are in a subdirectory) aren't
+ * remembered, because the watch wouldn't see their changes.  Without
+ * inotify (or if a watch can't be added), the results aren't cached.
+ *
+ * open_env_path() also remembers the split list for each environment
+ * variable, re-splitting it only if the variable's value changes.
+ *
+ * make_path() remembers the directories it has made (or found), with
+ * an fd for each, and creates new ones relative to the nearest, with
+ * mkdirat().  A cached directory that's removed is noticed (its link
+ * count is 0, or mkdirat() within it fails); one that's renamed isn't,
+ * so call path_cache_clear() after moving directories that make_path()
+ * has used.
+ *
+ * Both caches are keyed by absolute path: a relative directory (e.g.
+ * ".") is prefixed with the current directory each time it's used,
+ * so a chdir() doesn't leave it pointing at the old directory.
+ *
+ * The caches are fixed-size, and protected by a single mutex; when
+ * they're full, lookups fall back to formatting the full path, as
+ * before.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#define PATH_INOTIFY
+#include <sys/inotify.h>
+#endif /* __linux__ */
+
+#include <apex/systools.h>
+#include <apex/estring.h>
+
+#ifdef O_PATH
+#define DIR_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+#else
+#define DIR_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+#endif /* O_PATH */
+
+enum
+{
+    DIR_CACHE_MAX = 32,                /* max. cached directories */
+    ENTRY_CACHE_MAX = 256,             /* max. cached lookups */
+    ENV_CACHE_MAX = 8,                 /* max. cached environment paths */
+    MADE_CACHE_MAX = 16,               /* max. cached made directories */
+    NOTIFY_BUFFER_SIZE = 4096
+};
+
+typedef struct PathDir
+{
+    char *path;                        /* the directory, as given */
+    int fd;                            /* O_DIRECTORY fd, or -1 */
+    int wd;                            /* inotify watch, or -1 */
+    unsigned int generation;           /* bumped when the directory changes */
+} PathDir;
+
+typedef struct PathEntry
+{
+    PathDir *dir;                      /* NULL: unused */
+    unsigned int generation;           /* ...of dir, when this was found */
+    int exists;
+    char *base;
+} PathEntry;
+
+typedef struct MadeDir
+{
+    char *path;                        /* the directory (NULL: unused) */
+    size_t len;
+    int fd;                            /* O_PATH (or O_RDONLY) fd */
+} MadeDir;
+
+typedef struct EnvPath
+{
+    char *name;
+    char *value;
+    char **list;
+} EnvPath;
+
+static PathDir dir_cache[DIR_CACHE_MAX];
+static size_t n_dir;
+static PathEntry entry_cache[ENTRY_CACHE_MAX];
+static size_t next_entry;              /* (round-robin replacement) */
+static EnvPath env_cache[ENV_CACHE_MAX];
+static size_t n_env;
+static MadeDir made_cache[MADE_CACHE_MAX];
+static size_t next_made;
+static int notify_fd = -2;             /* -2: not yet opened; -1: none */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * mode_flags() --Convert an fopen() mode to open() flags.
+ *
+ * Returns: (int)
+ * Success: the flags; Failure: -1 (EINVAL).
+ */
+static int mode_flags(const char *mode)
+{
+    int flags;
+
+    switch (*mode)
+    {
+    case 'r':
+        flags = O_RDONLY;
+        break;
+    case 'w':
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+        break;
+    case 'a':
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+    for (++mode; *mode != '\0'; ++mode)
+    {
+        switch (*mode)
+        {
+        case '+':
+            flags = (flags & ~(O_RDONLY | O_WRONLY)) | O_RDWR;
+            break;
+        case 'x':
+            flags |= O_EXCL;
+            break;
+        case 'e':
+            flags |= O_CLOEXEC;
+            break;
+        default:
+            break;                     /* e.g. 'b' */
+        }
+    }
+    return flags;
+}
+
+/*
+ * absolute_path() --Prefix a relative path with the current directory.
+ *
+ * Parameters:
+ * buf  --returns the absolute path (if path is relative)
+ * size --the size of buf
+ * path --the path
+ *
+ * Returns: (const char *)
+ * Success: path (if it's absolute) or buf; Failure: NULL (e.g. the
+ * current directory has been removed, or ENAMETOOLONG).
+ */
+static const char *absolute_path(char *buf, size_t size, const char *path)
+{
+    size_t len;
+
+    if (*path == '/')
+    {
+        return path;
+    }
+    if (getcwd(buf, size) == NULL)
+    {
+        return NULL;
+    }
+    if (strcmp(path, ".") == 0)
+    {
+        return buf;
+    }
+    len = strlen(buf);
+    if ((size_t) snprintf(buf + len, size - len, "%s%s",
+                          len > 1 ? "/" : "", path) >= size - len)
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    return buf;
+}
+
+/*
+ * open_dir() --(Re-)open a cached directory, and watch it.
+ */
+static void open_dir(PathDir * dir)
+{
+    dir->fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    dir->wd = -1;
+    dir->generation += 1;              /* (forget anything already found) */
+#ifdef PATH_INOTIFY
+    if (dir->fd >= 0 && notify_fd >= 0)
+    {
+        dir->wd = inotify_add_watch(notify_fd, dir->path,
+                                    IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                                    | IN_MOVED_TO | IN_DELETE_SELF
+                                    | IN_MOVE_SELF | IN_ONLYDIR);
+    }
+#endif /* PATH_INOTIFY */
+}
+
+/*
+ * close_dir() --Close a cached directory (which will be re-opened).
+ */
+static void close_dir(PathDir * dir)
+{
+#ifdef PATH_INOTIFY
+    if (dir->wd >= 0)
+    {
+        for (size_t i = 0; i < n_dir; ++i)
+        {
+            if (&dir_cache[i] != dir && dir_cache[i].wd == dir->wd)
+            {
+                dir->wd = -1;          /* (shared: leave it watched) */
+            }
+        }
+        if (dir->wd >= 0)
+        {
+            (void) inotify_rm_watch(notify_fd, dir->wd);
+        }
+    }
+#endif /* PATH_INOTIFY */
+    if (dir->fd >= 0)
+    {
+        close(dir->fd);
+    }
+    dir->fd = dir->wd = -1;
+    dir->generation += 1;
+}
+
+/*
+ * refresh_dirs() --Note the changes in the watched directories.
+ *
+ * Remarks:
+ * Two paths to the same directory share a watch, so each event
+ * invalidates every directory with its descriptor.  If the watched
+ * directory itself goes away, it's closed, and re-opened (by path)
+ * on its next use.
+ */
+static void refresh_dirs(void)
+{
+#ifdef PATH_INOTIFY
+    char buf[NOTIFY_BUFFER_SIZE]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+
+    if (notify_fd == -2)
+    {
+        notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    while (notify_fd >= 0 && (n = read(notify_fd, buf, sizeof(buf))) > 0)
+    {
+        for (char *p = buf; p < buf + n;)
+        {
+            const struct inotify_event *event =
+                (const struct inotify_event *) p;
+
+            for (size_t i = 0; i < n_dir; ++i)
+            {
+                PathDir *dir = &dir_cache[i];
+
+                if ((event->mask & IN_Q_OVERFLOW) != 0)
+                {
+                    dir->generation += 1;
+                }
+                else if (dir->wd == event->wd)
+                {
+                    if ((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF
+                                        | IN_IGNORED)) != 0)
+                    {
+                        close_dir(dir);
+                    }
+                    dir->generation += 1;
+                }
+            }
+            p += sizeof(*event) + event->len;
+        }
+    }
+#endif /* PATH_INOTIFY */
+}
+
+/*
+ * find_dir() --Find (or add) a cached directory.
+ *
+ * Returns: (PathDir *)
+ * Success: the directory (whose fd may be -1); Failure: NULL (the
+ * cache is full, or a relative path can't be made absolute).
+ */
+static PathDir *find_dir(const char *path)
+{
+    char buf[FILENAME_MAX + 1];
+    PathDir *dir;
+
+    if ((path = absolute_path(buf, sizeof(buf), path)) == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < n_dir; ++i)
+    {
+        if (strcmp(dir_cache[i].path, path) == 0)
+        {
+            if ((dir = &dir_cache[i])->fd < 0)
+            {
+                open_dir(dir);         /* (try again: it may exist now) */
+            }
+            return dir;
+        }
+    }
+    if (n_dir >= DIR_CACHE_MAX)
+    {
+        return NULL;
+    }
+    dir = &dir_cache[n_dir];
+    if ((dir->path = strdup(path)) == NULL)
+    {
+        return NULL;
+    }
+    ++n_dir;
+    open_dir(dir);
+    return dir;
+}
+
+/*
+ * find_entry() --Find a remembered lookup.
+ *
+ * Returns: (PathEntry *)
+ * Success: the (still valid) entry; Failure: NULL.
+ */
+static PathEntry *find_entry(const PathDir * dir, const char *base)
+{
+    if (dir->wd < 0)
+    {
+        return NULL;                   /* (unwatched: not remembered) */
+    }
+    for (size_t i = 0; i < ENTRY_CACHE_MAX; ++i)
+    {
+        PathEntry *entry = &entry_cache[i];
+
+        if (entry->dir == dir && entry->generation == dir->generation
+            && strcmp(entry->base, base) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * save_entry() --Remember the result of a lookup.
+ */
+static void save_entry(PathDir * dir, const char *base, int exists)
+{
+    PathEntry *entry = &entry_cache[next_entry];
+    char *copy;
+
+    if (dir->wd < 0 || strchr(base, '/') != NULL
+        || (copy = strdup(base)) == NULL)
+    {
+        return;
+    }
+    next_entry = (next_entry + 1) % ENTRY_CACHE_MAX;
+    free(entry->base);
+    entry->dir = dir;
+    entry->generation = dir->generation;
+    entry->exists = exists;
+    entry->base = copy;
+}
+
+/*
+ * full_path() --Format a directory and base as a path.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (ENAMETOOLONG).
+ */
+static int full_path(char *file, size_t size, const char *dir,
+                     const char *base)
+{
+    if ((size_t) snprintf(file, size, "%s/%s", dir, base) >= size)
+    {
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * path_exists() --Test if a file exists in a directory.
+ */
+static int path_exists(const char *path, const char *base)
+{
+    PathDir *dir = *base != '/' ? find_dir(path) : NULL;
+    PathEntry *entry;
+    struct stat status;
+    int exists;
+
+    if (dir == NULL)
+    {
+        char file[FILENAME_MAX + 1];
+
+        return full_path(file, sizeof(file), path, base)
+            && stat(file, &status) == 0;
+    }
+    if (dir->fd < 0)
+    {
+        return 0;                      /* (no such directory) */
+    }
+    if ((entry = find_entry(dir, base)) != NULL)
+    {
+        return entry->exists;
+    }
+    exists = fstatat(dir->fd, base, &status, 0) == 0;
+    save_entry(dir, base, exists);
+    return exists;
+}
+
+/*
+ * open_dirs() --Open a file in the first directory that allows it.
+ *
+ * Remarks:
+ * This assumes the lock is held.  A read-only open is skipped in
+ * the directories where the file is known not to exist.
+ */
+static int open_dirs(const char *path[], const char *base, int flags,
+                     mode_t mode)
+{
+    int read_only = (flags & O_ACCMODE) == O_RDONLY
+        && (flags & O_CREAT) == 0;
+
+    for (int i = 0; path[i] != NULL; ++i)
+    {
+        PathDir *dir = *base != '/' ? find_dir(path[i]) : NULL;
+        PathEntry *entry;
+        int fd;
+
+        if (dir == NULL)
+        {
+            char file[FILENAME_MAX + 1];
+
+            if (full_path(file, sizeof(file), path[i], base)
+                && (fd = open(file, flags, mode)) >= 0)
+            {
+                return fd;
+            }
+            continue;
+        }
+        if (dir->fd < 0)
+        {
+            continue;                  /* (no such directory) */
+        }
+        if (read_only && (entry = find_entry(dir, base)) != NULL
+            && !entry->exists)
+        {
+            continue;                  /* (known not to exist) */
+        }
+        if ((fd = openat(dir->fd, base, flags, mode)) >= 0)
+        {
+            return fd;
+        }
+        if (errno == ENOENT && read_only)
+        {
+            save_entry(dir, base, 0);
+        }
+    }
+    return -1;
+}
+
+/*
+ * resolve_path() --Resolve a filename against a list of paths.
+ *
+ * Parameters:
+ * paths    --specifies the paths as a NULL terminated list
+ * base     --the basename
+ *
+ * Returns: (char *)
+ * Success: the path element that matched; Failure: NULL.
+ *
+ * Remarks:
+ * This routine will return successfully for the first path for which
+ * stat returns OK.
+ */
+const char *resolve_path(const char *path[], const char *base)
+{
+    const char *found = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    refresh_dirs();
+    for (int i = 0; found == NULL && path[i] != NULL; ++i)
+    {
+        if (path_exists(path[i], base))
+        {
+            found = path[i];
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return found;
+}
+
+/*
+ * open_path_fd() --Open a file descriptor using path resolution.
+ *
+ * Parameters:
+ * path     --specifies the path as a NULL terminated list
+ * base     --the basename part of the file
+ * flags    --the open(2) flags
+ * mode     --the permissions, for a created file
+ *
+ * Returns: (int)
+ * Success: the file descriptor; Failure: -1.
+ *
+ * Remarks:
+ * This routine will return successfully for the first path for which
+ * open succeeds.
+ */
+int open_path_fd(const char *path[], const char *base, int flags,
+                 mode_t mode)
+{
+    int fd;
+
+    pthread_mutex_lock(&cache_lock);
+    refresh_dirs();
+    fd = open_dirs(path, base, flags, mode);
+    pthread_mutex_unlock(&cache_lock);
+    return fd;
+}
+
+/*
+ * open_path() --Open a file using path resolution.
+ *
+ * Parameters:
+ * path    --specifies the path as a NULL terminated list
+ * base     --the basename part of the file
+ * mode     --the file mode
+ *
+ * Returns: (FILE *)
+ * Success: the file pointer; Failure: NULL.
+ *
+ * Remarks:
+ * This routine will return successfully for the first path for which
+ * fopen succeeds.
+ */
+FILE *open_path(const char *path[], const char *base, const char *mode)
+{
+    int flags = mode_flags(mode), fd;
+    FILE *fp;
+
+    if (flags < 0 || (fd = open_path_fd(path, base, flags, 0666)) < 0)
+    {
+        return NULL;
+    }
+    if ((fp = fdopen(fd, mode)) == NULL)
+    {
+        close(fd);
+    }
+    return fp;
+}
+
+/*
+ * env_path() --Return the (cached) split value of an environment path.
+ *
+ * Returns: (const char **)
+ * Success: the path list; Failure: NULL.
+ *
+ * Remarks:
+ * This assumes the lock is held.
+ */
+static const char **env_path(const char *name, const char *value)
+{
+    EnvPath *env = NULL;
+    char *copy;
+    char **list;
+
+    for (size_t i = 0; i < n_env; ++i)
+    {
+        if (strcmp(env_cache[i].name, name) == 0)
+        {
+            if (strcmp((env = &env_cache[i])->value, value) == 0)
+            {
+                return (const char **) env->list;
+            }
+            break;
+        }
+    }
+    if ((list = new_str_list(value, ':')) == NULL)
+    {
+        return NULL;
+    }
+    if ((copy = strdup(value)) == NULL)
+    {
+        free_str_list(list);
+        return NULL;
+    }
+    if (env == NULL)
+    {
+        char *name_copy = strdup(name);
+
+        if (name_copy == NULL)
+        {
+            free_str_list(list);
+            free(copy);
+            return NULL;
+        }
+        env = &env_cache[n_env < ENV_CACHE_MAX ? n_env++ : ENV_CACHE_MAX - 1];
+        free(env->name);               /* (full: re-use the last) */
+        env->name = name_copy;
+    }
+    if (env->list != NULL)
+    {
+        free_str_list(env->list);
+    }
+    free(env->value);
+    env->value = copy;
+    env->list = list;
+    return (const char **) list;
+}
+
+/*
+ * open_env_path() --Open a file with an environment-specified path.
+ *
+ * Parameters:
+ * env      --specifies the environment variable containing the path
+ * base     --the basename part of the file
+ * mode     --the file mode
+ *
+ * Returns: (FILE *)
+ * Success: the file pointer; Failure: NULL.
+ */
+FILE *open_env_path(const char *env, const char *base, const char *mode)
+{
+    const char *value, **path;
+    int flags = mode_flags(mode), fd = -1;
+    FILE *fp;
+
+    if (env == NULL || (value = getenv(env)) == NULL)
+    {
+        return NULL;                   /* error: no environment */
+    }
+    if (flags < 0)
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&cache_lock);
+    refresh_dirs();
+    if ((path = env_path(env, value)) != NULL)
+    {
+        fd = open_dirs(path, base, flags, 0666);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if ((fp = fdopen(fd, mode)) == NULL)
+    {
+        close(fd);
+    }
+    return fp;
+}
+
+/*
+ * forget_made() --Forget (and close) a cached directory.
+ */
+static void forget_made(MadeDir * made)
+{
+    if (made->path != NULL)
+    {
+        close(made->fd);
+        free(made->path);
+        made->path = NULL;
+    }
+}
+
+/*
+ * find_made() --Find the longest cached directory that prefixes a path.
+ *
+ * Parameters:
+ * path --the path
+ * len  --its length (without trailing "/"s)
+ *
+ * Returns: (MadeDir *)
+ * Success: the cached directory; Failure: NULL.
+ *
+ * Remarks:
+ * An exact match is checked (with fstat()) to be sure the directory
+ * still exists; if it's been removed, it's forgotten.  A prefix isn't
+ * checked here: the mkdirat() within it will fail instead.
+ */
+static MadeDir *find_made(const char *path, size_t len)
+{
+    MadeDir *best = NULL;
+
+    for (size_t i = 0; i < MADE_CACHE_MAX; ++i)
+    {
+        MadeDir *made = &made_cache[i];
+
+        if (made->path != NULL && made->len <= len
+            && (best == NULL || made->len > best->len)
+            && memcmp(made->path, path, made->len) == 0
+            && (made->len == len || path[made->len] == '/'))
+        {
+            if (made->len == len)
+            {
+                struct stat status;
+
+                if (fstat(made->fd, &status) < 0 || status.st_nlink == 0)
+                {
+                    forget_made(made);
+                    continue;          /* (removed: look for a prefix) */
+                }
+            }
+            best = made;
+        }
+    }
+    return best;
+}
+
+/*
+ * save_made() --Remember a directory that's been made (or found).
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (malloc failed).
+ *
+ * Remarks:
+ * The cache takes ownership of fd (closing it if it can't be saved).
+ */
+static int save_made(const char *path, size_t len, int fd)
+{
+    MadeDir *made = &made_cache[next_made];
+    char *copy = malloc(len + 1);
+
+    if (copy == NULL)
+    {
+        close(fd);
+        return 0;
+    }
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    next_made = (next_made + 1) % MADE_CACHE_MAX;
+    forget_made(made);
+    made->path = copy;
+    made->len = len;
+    made->fd = fd;
+    return 1;
+}
+
+/*
+ * release() --Close a directory fd, unless it's AT_FDCWD or cached.
+ */
+static void release(int fd, const MadeDir * made)
+{
+    if (fd >= 0 && (made == NULL || fd != made->fd))
+    {
+        close(fd);
+    }
+}
+
+/*
+ * walk_dir() --Make the rest of a path, from a cached prefix.
+ *
+ * Parameters:
+ * made --the longest cached prefix (or NULL: start from the cwd)
+ * path --the path
+ * len  --its length (without trailing "/"s)
+ *
+ * Returns: (int)
+ * Success: the directory's fd (now cached); Failure: -1.
+ */
+static int walk_dir(const MadeDir * made, const char *path, size_t len)
+{
+    char name[FILENAME_MAX + 1];
+    int dir_fd = made != NULL ? made->fd : AT_FDCWD, parent_fd = -1;
+    size_t pos = made != NULL ? made->len : 0, dir_end = pos, parent_end = 0;
+    int error;
+
+    while (pos < len)
+    {
+        size_t start = pos, end;
+        int fd;
+
+        while (pos < len && path[pos] == '/')
+        {
+            ++pos;
+        }
+        if (start != 0)
+        {
+            start = pos;               /* (else keep the leading "/") */
+        }
+        for (end = pos; end < len && path[end] != '/'; ++end)
+        {
+            ;
+        }
+        if (end - start >= sizeof(name))
+        {
+            errno = ENAMETOOLONG;
+            break;
+        }
+        memcpy(name, path + start, end - start);
+        name[end - start] = '\0';
+        if ((mkdirat(dir_fd, name, (mode_t) 0755) < 0 && errno != EEXIST)
+            || (fd = openat(dir_fd, name, DIR_FLAGS)) < 0)
+        {
+            break;                     /* failure: (e.g. EACCES, ENOTDIR) */
+        }
+        release(parent_fd, made);
+        parent_fd = dir_fd;
+        parent_end = dir_end;
+        dir_fd = fd;
+        dir_end = pos = end;
+    }
+    if (pos < len)
+    {
+        error = errno;
+        release(parent_fd, made);
+        release(dir_fd, made);
+        errno = error;
+        return -1;
+    }
+    if (parent_fd >= 0 && (made == NULL || parent_fd != made->fd))
+    {
+        if (parent_end > 0)
+        {
+            (void) save_made(path, parent_end, parent_fd);
+        }
+        else
+        {
+            close(parent_fd);
+        }
+    }
+    return save_made(path, len, dir_fd) ? dir_fd : -1;
+}
+
+/*
+ * make_dir() --Make a directory (and its parents), returning its fd.
+ *
+ * Returns: (int)
+ * Success: the directory's fd (which belongs to the cache); Failure: -1.
+ *
+ * Remarks:
+ * This assumes the lock is held.  A relative path is made absolute
+ * (so it's cached correctly across a chdir()).  An uncached path is
+ * first opened whole (it usually exists); otherwise it's walked a
+ * component at a time from its longest cached prefix, with mkdirat(),
+ * where EEXIST just means there's nothing to do, and openat(O_DIRECTORY)
+ * checks that it's a directory.  The new directory and its parent are both
+ * cached, so the next sibling (e.g. a log file's next day) is a
+ * single mkdirat() and openat().  If the prefix has been removed
+ * (mkdirat() fails with ENOENT), it's forgotten, and the walk restarts.
+ */
+static int make_dir(const char *path)
+{
+    char buf[FILENAME_MAX + 1];
+    size_t len;
+
+    if ((path = absolute_path(buf, sizeof(buf), path)) == NULL)
+    {
+        return -1;
+    }
+    len = strlen(path);
+    while (len > 1 && path[len - 1] == '/')
+    {
+        --len;
+    }
+    if (len == 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    for (;;)
+    {
+        MadeDir *made = find_made(path, len);
+        int fd;
+
+        if (made != NULL && made->len == len)
+        {
+            return made->fd;           /* success: already made */
+        }
+        if (made == NULL && (fd = open(path, DIR_FLAGS)) >= 0)
+        {
+            return save_made(path, len, fd) ? fd : -1;
+        }
+        if ((fd = walk_dir(made, path, len)) >= 0)
+        {
+            return fd;
+        }
+        if (made == NULL || errno != ENOENT)
+        {
+            return -1;
+        }
+        forget_made(made);             /* (stale: try a shorter prefix) */
+    }
+}
+
+/*
+ * make_path() --Create the directory for a path.
+ *
+ * Parameters:
+ * path --the path containing possibly non-existing components.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * This routine creates a full directory path, ala "mkdir -p".  The
+ * directories it makes (or finds) are cached, see make_dir().
+ */
+int make_path(const char *path)
+{
+    int fd;
+
+    pthread_mutex_lock(&cache_lock);
+    fd = make_dir(path);
+    pthread_mutex_unlock(&cache_lock);
+    return fd >= 0;
+}
+
+/*
+ * link_path() --Link one path to another, creating directories as needed.
+ *
+ * Parameters:
+ * src --the path to link from
+ * dst --the path to link to
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The link is made relative to the (cached) directory's fd, so dst's
+ * directory isn't looked up again.
+ */
+int link_path(const char *src, const char *dst)
+{
+    const char *base = path_basename(dst);
+    int status;
+
+    if (base == dst)
+    {
+        return link(src, dst) == 0;    /* (no directory to make) */
+    }
+    pthread_mutex_lock(&cache_lock);
+    {
+        char *dir = strndup(dst, (size_t) (base - dst));
+        int dir_fd = dir != NULL ? make_dir(dir) : -1;
+
+        status = dir_fd >= 0 && linkat(AT_FDCWD, src, dir_fd, base, 0) == 0;
+        free(dir);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return status;
+}
+
+/*
+ * path_cache_clear() --Close and forget all the cached directories.
+ *
+ * Remarks:
+ * This releases the cache's file descriptors (e.g. before closing
+ * all fds, or after a chroot()); the cache is rebuilt as it's used.
+ */
+void path_cache_clear(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    for (size_t i = 0; i < ENTRY_CACHE_MAX; ++i)
+    {
+        free(entry_cache[i].base);
+        entry_cache[i].base = NULL;
+        entry_cache[i].dir = NULL;
+    }
+    next_entry = 0;
+    for (size_t i = 0; i < MADE_CACHE_MAX; ++i)
+    {
+        forget_made(&made_cache[i]);
+    }
+    next_made = 0;
+    for (size_t i = 0; i < n_dir; ++i)
+    {
+        if (dir_cache[i].fd >= 0)
+        {
+            close(dir_cache[i].fd);
+        }
+        free(dir_cache[i].path);
+        dir_cache[i].path = NULL;
+    }
+    n_dir = 0;
+    for (size_t i = 0; i < n_env; ++i)
+    {
+        free(env_cache[i].name);
+        free(env_cache[i].value);
+        free_str_list(env_cache[i].list);  /* (never NULL, if cached) */
+        env_cache[i] = (EnvPath) { NULL, NULL, NULL };
+    }
+    n_env = 0;
+    if (notify_fd >= 0)
+    {
+        close(notify_fd);              /* (which removes all the watches) */
+    }
+    notify_fd = -2;
+    pthread_mutex_unlock(&cache_lock);
+}
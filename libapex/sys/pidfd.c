@@ -0,0 +1,233 @@
+/*
+ * PIDFD.C --Signal (and wait for) processes via process file descriptors.
+ *
+ * Contents:
+ * open_pidfd()    --Open a file descriptor that refers to a process.
+ * signal_pidfd()  --Send a signal to a process via its pidfd.
+ * open_pidfds()   --Open pidfds for several processes.
+ * signal_pidfds() --Send a signal to several processes.
+ * remaining_ms()  --Return the milliseconds left before a deadline.
+ * wait_pidfds()   --Wait for several processes to exit.
+ * close_pidfds()  --Close several pidfds.
+ *
+ * Remarks:
+ * A pidfd (Linux 5.3 and later) refers to one process, not to its
+ * pid, so signals sent through it can't reach some other process
+ * that has since been given the same pid.  Opening the pidfds for a
+ * batch of processes first, and then signalling them, means each
+ * signal goes to the process that was identified (e.g. from its pid
+ * file), however long the batch takes.
+ *
+ * A pidfd becomes readable when its process exits, so wait_pidfds()
+ * waits for a whole batch with poll().
+ *
+ * Where there are no pidfds, open_pidfd() fails with ENOSYS; callers
+ * can fall back to kill(2).
+ */
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <apex.h>
+#include <apex/systools.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+/*
+ * open_pidfd() --Open a file descriptor that refers to a process.
+ *
+ * Parameters:
+ * pid  --the process ID
+ *
+ * Returns: (int)
+ * Success: the pidfd; Failure: -1 (errno is set, e.g. ESRCH, ENOSYS).
+ */
+int open_pidfd(pid_t pid)
+{
+    if (pid <= 0)
+    {
+        errno = EINVAL;
+        return -1;                     /* error: not a single process */
+    }
+#ifdef SYS_pidfd_open
+    return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif /* SYS_pidfd_open */
+}
+
+/*
+ * signal_pidfd() --Send a signal to a process via its pidfd.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set, e.g. ESRCH if it has exited).
+ */
+int signal_pidfd(int pidfd, int sig)
+{
+#ifdef SYS_pidfd_send_signal
+    return syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0) == 0;
+#else
+    (void) pidfd;
+    (void) sig;
+    errno = ENOSYS;
+    return 0;
+#endif /* SYS_pidfd_send_signal */
+}
+
+/*
+ * open_pidfds() --Open pidfds for several processes.
+ *
+ * Parameters:
+ * n    --the No. of processes
+ * pid  --the process IDs
+ * pidfd --returns the pidfds (-1 for those that couldn't be opened)
+ *
+ * Returns: (size_t)
+ * The No. of pidfds opened.
+ */
+size_t open_pidfds(size_t n, const pid_t pid[], int pidfd[])
+{
+    size_t n_open = 0;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if ((pidfd[i] = open_pidfd(pid[i])) >= 0)
+        {
+            ++n_open;
+        }
+    }
+    return n_open;
+}
+
+/*
+ * signal_pidfds() --Send a signal to several processes.
+ *
+ * Parameters:
+ * n    --the No. of pidfds
+ * pidfd --the pidfds (those < 0 are skipped)
+ * sig  --the signal to send
+ *
+ * Returns: (size_t)
+ * The No. of processes signalled.
+ */
+size_t signal_pidfds(size_t n, const int pidfd[], int sig)
+{
+    size_t n_signal = 0;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (pidfd[i] >= 0 && signal_pidfd(pidfd[i], sig))
+        {
+            ++n_signal;
+        }
+    }
+    return n_signal;
+}
+
+/*
+ * remaining_ms() --Return the milliseconds left before a deadline.
+ */
+static int remaining_ms(const struct timespec *deadline)
+{
+    struct timespec now;
+    long ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (deadline->tv_sec - now.tv_sec) * 1000
+        + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+    return ms < 0 ? 0 : ms > INT_MAX ? INT_MAX : (int) ms;
+}
+
+/*
+ * wait_pidfds() --Wait for several processes to exit.
+ *
+ * Parameters:
+ * n    --the No. of pidfds
+ * pidfd --the pidfds (those < 0 are skipped)
+ * timeout --the longest to wait (NULL: until they've all exited)
+ *
+ * Returns: (size_t)
+ * Success: the No. of processes still running; Failure: (size_t) -1.
+ *
+ * Remarks:
+ * The pidfd of each process that has exited is closed, and set to -1,
+ * so pidfd is left listing the processes still running.  Note that
+ * (unlike waitpid(2)) this doesn't reap child processes.
+ */
+size_t wait_pidfds(size_t n, int pidfd[], TimeValuePtr timeout)
+{
+    struct pollfd *fds;
+    struct timespec deadline;
+    size_t n_running = 0;
+
+    if ((fds = malloc((n + 1) * sizeof(*fds))) == NULL)
+    {
+        return (size_t) -1;            /* error: malloc failed */
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        fds[i].fd = pidfd[i];          /* (poll() ignores fds < 0) */
+        fds[i].events = POLLIN;
+        n_running += pidfd[i] >= 0;
+    }
+    if (timeout != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout->tv_sec;
+        deadline.tv_nsec += timeout->tv_usec * 1000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_nsec -= 1000000000;
+            deadline.tv_sec += 1;
+        }
+    }
+    while (n_running > 0)
+    {
+        int n_ready = poll(fds, (nfds_t) n,
+                           timeout != NULL ? remaining_ms(&deadline) : -1);
+
+        if (n_ready < 0 && errno != EINTR)
+        {
+            free(fds);
+            return (size_t) -1;        /* error: poll() failed */
+        }
+        if (n_ready == 0)
+        {
+            break;                     /* (timed out) */
+        }
+        for (size_t i = 0; n_ready > 0 && i < n; ++i)
+        {
+            if (fds[i].fd >= 0 && fds[i].revents != 0)
+            {
+                close(pidfd[i]);
+                pidfd[i] = fds[i].fd = -1;
+                --n_running;
+                --n_ready;
+            }
+        }
+    }
+    free(fds);
+    return n_running;
+}
+
+/*
+ * close_pidfds() --Close several pidfds.
+ */
+void close_pidfds(size_t n, int pidfd[])
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (pidfd[i] >= 0)
+        {
+            close(pidfd[i]);
+            pidfd[i] = -1;
+        }
+    }
+}
@@ -4,14 +4,23 @@
  * Contents:
  * unlink_pidfile() --Remove the pidfile we created at startup, if any.
  * create_pidfile() --Create a file containing the current process ID.
+ * read_pidfile()   --Read the process ID from a pid file.
+ * check_pidfile()  --Check if a pid file's process is still running.
  *
  * Remarks:
  * TODO: add singleton handling.
  *
+ * Pid files are written in the HDB UUCP lock file format (the pid,
+ * right-aligned in 10 columns, and a newline).
+ *
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
 
 #include <apex.h>
 #include <apex/systools.h>
@@ -59,7 +68,7 @@ int create_pidfile(const char *path)
     {
         return 0;                      /* failure: cannot open pidfile */
     }
-    sprintf(pid, "10%d\n", getpid());  /* HBP UUCP lock file format */
+    sprintf(pid, "%10d\n", (int) getpid());   /* HDB UUCP lock file format */
     SYS_RETRY(status, write(pid_fd, pid, strlen(pid)));
     if (status < 0)
     {
@@ -70,3 +79,81 @@ int create_pidfile(const char *path)
     atexit(unlink_pidfile);
     return 1;
 }
+
+/*
+ * read_pidfile() --Read the process ID from a pid file.
+ *
+ * Parameters:
+ * path --the pid file
+ * pid  --returns the process ID
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set; EINVAL if it's not a pid file).
+ */
+int read_pidfile(const char *path, pid_t *pid)
+{
+    char text[32];
+    char *end;
+    long value;
+    int fd;
+    ssize_t n;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        return 0;                      /* failure: cannot open pidfile */
+    }
+    SYS_RETRY(n, read(fd, text, sizeof(text) - 1));
+    close(fd);
+    if (n < 0)
+    {
+        return 0;                      /* failure: cannot read pidfile */
+    }
+    text[n] = '\0';
+    value = strtol(text, &end, 10);
+    if (end == text || value <= 0 || value > INT_MAX
+        || (*end != '\0' && *end != '\n'))
+    {
+        errno = EINVAL;
+        return 0;                      /* failure: not a pid */
+    }
+    *pid = (pid_t) value;
+    return 1;
+}
+
+/*
+ * check_pidfile() --Check if a pid file's process is still running.
+ *
+ * Parameters:
+ * path --the pid file
+ *
+ * Returns: (pid_t)
+ * Success: the running process's ID; Failure: 0.
+ *
+ * Remarks:
+ * This checks the process via a pidfd if it can (see pidfd.c), so an
+ * exited (but unreaped) process isn't counted as running; otherwise
+ * it falls back to kill(2) with signal 0.
+ */
+pid_t check_pidfile(const char *path)
+{
+    pid_t pid;
+    int pidfd;
+
+    if (!read_pidfile(path, &pid))
+    {
+        return 0;
+    }
+    if ((pidfd = open_pidfd(pid)) >= 0)
+    {
+        struct pollfd fds = {.fd = pidfd,.events = POLLIN };
+        int n_exited = poll(&fds, 1, 0);
+
+        close(pidfd);
+        return n_exited == 0 ? pid : 0;
+    }
+    if (errno == ENOSYS && (kill(pid, 0) == 0 || errno == EPERM))
+    {
+        return pid;
+    }
+    return 0;
+}
@@ -0,0 +1,716 @@
+/*
+ * PLACEMENT.C --CPU affinity, NUMA topology and huge-page memory.
+ *
+ * Contents:
+ * cpu_topology()   --Return the machine's CPU/cache/NUMA topology.
+ * cpu_node()       --Return the NUMA node of a CPU.
+ * cpu_current()    --Return the CPU the calling thread is running on.
+ * node_current()   --Return the NUMA node the calling thread is running on.
+ * cpu_pin_thread() --Pin the calling thread to a CPU.
+ * cpu_pin_node()   --Pin the calling thread to the CPUs of a NUMA node.
+ * page_round()     --Round a size up to a whole No. of pages.
+ * page_alloc()     --Map some (aligned) pages, with a NUMA/huge-page policy.
+ * page_realloc()   --Resize some mapped pages, keeping their policy.
+ * page_free()      --Unmap pages allocated by page_alloc().
+ *
+ * Remarks:
+ * The topology is read once, from /sys/devices/system (Linux); on
+ * other systems, or if sysfs isn't mounted, it's a single node with
+ * one core per online CPU, and the cache sizes are 0.
+ *
+ * NUMA placement uses mbind() directly (via syscall()), so there's no
+ * dependency on libnuma.  The policy is MPOL_PREFERRED, i.e. pages
+ * come from the requested node if it has any free, and elsewhere
+ * otherwise; and if mbind() isn't allowed (e.g. in a container), the
+ * memory is simply allocated without a policy.
+ *
+ * PAGE_HUGE aligns the mapping on the huge page size and asks for
+ * transparent huge pages with madvise(MADV_HUGEPAGE).  PAGE_HUGETLB
+ * asks for reserved (hugetlbfs) pages, and falls back to PAGE_HUGE
+ * if there aren't enough.  Either way, sizes are rounded up to whole
+ * huge pages, so page_free() must be given the same flags.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE                    /* for sched_getcpu(), mremap() */
+#endif /* __linux__ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+#include <apex/atomic.h>
+#include <apex/placement.h>
+
+#define CPU_SYSFS "/sys/devices/system/cpu"
+#define NODE_SYSFS "/sys/devices/system/node"
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)    /* (unless /proc/meminfo says) */
+#define MPOL_PREFERRED_ 1              /* (from <linux/mempolicy.h>) */
+
+enum
+{
+    NODE_MAX = 1024,                   /* most NUMA nodes handled */
+    TOPOLOGY_CPU_MAX = 4096            /* most CPUs examined */
+};
+
+static CpuTopology topology;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+/*
+ * read_line() --Read the first line of a (sysfs) file.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int read_line(const char *path, char *buf, size_t size)
+{
+    FILE *fp = fopen(path, "r");
+    int status = 0;
+
+    if (fp != NULL)
+    {
+        if (fgets(buf, (int) size, fp) != NULL)
+        {
+            buf[strcspn(buf, "\n")] = '\0';
+            status = 1;
+        }
+        fclose(fp);
+    }
+    return status;
+}
+
+/*
+ * read_long() --Read a number from a (sysfs) file.
+ *
+ * Returns: (long)
+ * Success: the number; Failure: -1.
+ */
+static long read_long(const char *path)
+{
+    char buf[64];
+
+    return read_line(path, buf, sizeof(buf)) ? strtol(buf, NULL, 10) : -1;
+}
+
+/*
+ * read_size() --Read a size (e.g. "32K") from a (sysfs) file.
+ *
+ * Returns: (size_t)
+ * Success: the size, in bytes; Failure: 0.
+ */
+static size_t read_size(const char *path)
+{
+    char buf[64], *end;
+    unsigned long n;
+
+    if (!read_line(path, buf, sizeof(buf)))
+    {
+        return 0;
+    }
+    n = strtoul(buf, &end, 10);
+    switch (toupper((unsigned char) *end))
+    {
+    case 'K':
+        return n * 1024;
+    case 'M':
+        return n * 1024 * 1024;
+    case 'G':
+        return n * 1024 * 1024 * 1024;
+    default:
+        return n;
+    }
+}
+
+/*
+ * read_caches() --Find the sizes of cpu0's data caches.
+ */
+static void read_caches(CpuTopologyPtr topo)
+{
+    char path[128], type[32];
+
+    for (int i = 0;; ++i)
+    {
+        long level;
+
+        snprintf(path, sizeof(path), CPU_SYSFS "/cpu0/cache/index%d/level",
+                 i);
+        if ((level = read_long(path)) < 0)
+        {
+            break;
+        }
+        snprintf(path, sizeof(path), CPU_SYSFS "/cpu0/cache/index%d/type",
+                 i);
+        if (!read_line(path, type, sizeof(type))
+            || strcmp(type, "Instruction") == 0)
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path),
+                 CPU_SYSFS "/cpu0/cache/index%d/coherency_line_size", i);
+        topo->cache_line = MAX(topo->cache_line, read_size(path));
+        snprintf(path, sizeof(path), CPU_SYSFS "/cpu0/cache/index%d/size",
+                 i);
+        switch (level)
+        {
+        case 1:
+            topo->l1d_size = read_size(path);
+            break;
+        case 2:
+            topo->l2_size = read_size(path);
+            break;
+        case 3:
+            topo->l3_size = read_size(path);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+ * count_ids() --Count the distinct values among n ids.
+ */
+static int count_ids(long id[], int n)
+{
+    int n_distinct = 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        int j;
+
+        for (j = 0; j < i && id[j] != id[i]; ++j)
+        {
+            continue;
+        }
+        n_distinct += j == i;
+    }
+    return n_distinct;
+}
+
+/*
+ * read_cores() --Count the physical cores and packages of the online CPUs.
+ */
+static void read_cores(CpuTopologyPtr topo)
+{
+    long *core = NEW(long, TOPOLOGY_CPU_MAX);
+    long *package = NEW(long, TOPOLOGY_CPU_MAX);
+    char path[128];
+    int n = 0;
+
+    if (core == NULL || package == NULL)
+    {
+        free(core);
+        free(package);
+        return;
+    }
+    for (int cpu = 0; cpu < TOPOLOGY_CPU_MAX && n < topo->n_cpu; ++cpu)
+    {
+        snprintf(path, sizeof(path),
+                 CPU_SYSFS "/cpu%d/topology/physical_package_id", cpu);
+        if ((package[n] = read_long(path)) < 0)
+        {
+            continue;                  /* (offline, or absent) */
+        }
+        snprintf(path, sizeof(path), CPU_SYSFS "/cpu%d/topology/core_id",
+                 cpu);
+        core[n] = package[n] << 32 | (read_long(path) & 0xffffffff);
+        ++n;
+    }
+    if (n > 0)
+    {
+        topo->n_core = count_ids(core, n);
+        topo->n_package = count_ids(package, n);
+    }
+    free(core);
+    free(package);
+}
+
+/*
+ * read_nodes() --Count the NUMA nodes.
+ */
+static void read_nodes(CpuTopologyPtr topo)
+{
+    DIR *dir = opendir(NODE_SYSFS);
+    struct dirent *entry;
+    int n = 0;
+
+    if (dir == NULL)
+    {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0
+            && isdigit((unsigned char) entry->d_name[4]))
+        {
+            ++n;
+        }
+    }
+    closedir(dir);
+    topo->n_node = MAX(n, 1);
+}
+
+/*
+ * read_huge_page_size() --Find the default huge page size.
+ */
+static size_t read_huge_page_size(void)
+{
+    FILE *fp = fopen("/proc/meminfo", "r");
+    char line[128];
+    unsigned long kb = 0;
+
+    if (fp != NULL)
+    {
+        while (fgets(line, sizeof(line), fp) != NULL)
+        {
+            if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+            {
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    return kb != 0 ? kb * 1024 : HUGE_PAGE_SIZE;
+}
+
+/*
+ * topology_init() --Read the topology (once).
+ */
+static void topology_init(void)
+{
+    long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    topology.n_cpu = n_cpu > 0 ? (int) n_cpu : 1;
+    topology.n_core = topology.n_cpu;
+    topology.n_package = 1;
+    topology.n_node = 1;
+    topology.page_size = (size_t) sysconf(_SC_PAGESIZE);
+    topology.huge_page_size = read_huge_page_size();
+    read_cores(&topology);
+    read_nodes(&topology);
+    read_caches(&topology);
+    if (topology.cache_line == 0)
+    {
+        topology.cache_line = CACHE_LINE;
+    }
+}
+
+/*
+ * cpu_topology() --Return the machine's CPU/cache/NUMA topology.
+ *
+ * Returns: (const CpuTopology *)
+ * The topology (which is read on the first call).
+ */
+const CpuTopology *cpu_topology(void)
+{
+    pthread_once(&topology_once, topology_init);
+    return &topology;
+}
+
+/*
+ * cpu_node() --Return the NUMA node of a CPU.
+ *
+ * Returns: (int)
+ * Success: the node; Failure: -1 (no such CPU).
+ *
+ * Remarks:
+ * A machine without NUMA support has everything on node 0.
+ */
+int cpu_node(int cpu)
+{
+    char path[64];
+    DIR *dir;
+    struct dirent *entry;
+    int node = 0;
+
+    if (cpu < 0)
+    {
+        return -1;
+    }
+    snprintf(path, sizeof(path), CPU_SYSFS "/cpu%d", cpu);
+    if ((dir = opendir(path)) == NULL)
+    {
+        return cpu < cpu_topology()->n_cpu ? 0 : -1;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0
+            && isdigit((unsigned char) entry->d_name[4]))
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/*
+ * cpu_current() --Return the CPU the calling thread is running on.
+ *
+ * Returns: (int)
+ * Success: the CPU; Failure: -1.
+ *
+ * Remarks:
+ * Unless the thread is pinned, this may be out of date as soon as
+ * it's returned; it's a hint for choosing (e.g.) a per-CPU cache.
+ */
+int cpu_current(void)
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif /* __linux__ */
+}
+
+/*
+ * node_current() --Return the NUMA node the calling thread is running on.
+ *
+ * Returns: (int)
+ * Success: the node; Failure: -1.
+ */
+int node_current(void)
+{
+    int cpu = cpu_current();
+
+    return cpu >= 0 ? cpu_node(cpu) : -1;
+}
+
+/*
+ * cpu_pin_thread() --Pin the calling thread to a CPU.
+ *
+ * Parameters:
+ * cpu --the CPU No. (0..n_cpu-1)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+int cpu_pin_thread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    int status;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if ((status = pthread_setaffinity_np(pthread_self(), sizeof(set),
+                                         &set)) != 0)
+    {
+        errno = status;
+        return 0;
+    }
+    return 1;
+#else
+    (void) cpu;
+    errno = ENOSYS;
+    return 0;
+#endif /* __linux__ */
+}
+
+/*
+ * cpu_pin_node() --Pin the calling thread to the CPUs of a NUMA node.
+ *
+ * Parameters:
+ * node --the node No.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ *
+ * Remarks:
+ * The thread can still migrate between the node's CPUs, but its
+ * (first-touch) memory will be local.
+ */
+int cpu_pin_node(int node)
+{
+#ifdef __linux__
+    char path[64], list[1024];
+    const char *s = list;
+    cpu_set_t set;
+    int status;
+
+    snprintf(path, sizeof(path), NODE_SYSFS "/node%d/cpulist", node);
+    if (node < 0 || !read_line(path, list, sizeof(list)))
+    {
+        if (node != 0)
+        {
+            errno = EINVAL;
+            return 0;
+        }
+        snprintf(list, sizeof(list), "0-%d", cpu_topology()->n_cpu - 1);
+    }
+    CPU_ZERO(&set);
+    while (isdigit((unsigned char) *s))
+    {                                  /* e.g. "0-3,8-11" */
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+
+        if (*end == '-')
+        {
+            hi = strtol(end + 1, &end, 10);
+        }
+        for (long cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; ++cpu)
+        {
+            CPU_SET((int) cpu, &set);
+        }
+        s = *end == ',' ? end + 1 : end;
+    }
+    if (CPU_COUNT(&set) == 0)
+    {
+        errno = EINVAL;
+        return 0;                      /* (a memory-only node) */
+    }
+    if ((status = pthread_setaffinity_np(pthread_self(), sizeof(set),
+                                         &set)) != 0)
+    {
+        errno = status;
+        return 0;
+    }
+    return 1;
+#else
+    (void) node;
+    errno = ENOSYS;
+    return 0;
+#endif /* __linux__ */
+}
+
+/*
+ * page_unit() --Return the page size used for some PAGE_* flags.
+ */
+static size_t page_unit(int flags)
+{
+    const CpuTopology *topo = cpu_topology();
+
+    return flags & (PAGE_HUGE | PAGE_HUGETLB)
+        ? topo->huge_page_size : topo->page_size;
+}
+
+/*
+ * page_round() --Round a size up to a whole No. of pages.
+ *
+ * Parameters:
+ * size  --the size
+ * flags --PAGE_* flags (which determine the page size)
+ *
+ * Returns: (size_t)
+ * The size that page_alloc() actually maps.
+ */
+size_t page_round(size_t size, int flags)
+{
+    size_t unit = page_unit(flags);
+
+    return (size + unit - 1) & ~(unit - 1);
+}
+
+/*
+ * bind_node() --Set the preferred NUMA node of some pages.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no such node).
+ */
+static int bind_node(void *mem, size_t size, int node)
+{
+    if (node == PAGE_NODE_LOCAL)
+    {
+        node = node_current();
+    }
+    if (node < 0)
+    {
+        return 1;                      /* (no policy) */
+    }
+    if (node >= cpu_topology()->n_node || node >= NODE_MAX)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+#if defined(__linux__) && defined(SYS_mbind)
+    {
+        unsigned long mask[NODE_MAX / (8 * sizeof(unsigned long))] = { 0 };
+        int saved_errno = errno;
+
+        mask[node / (8 * sizeof(unsigned long))] |=
+            1ul << (node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_mbind, mem, size, MPOL_PREFERRED_, mask,
+                    (unsigned long) NODE_MAX + 1, 0) != 0)
+        {
+            errno = saved_errno;       /* (not allowed: no policy) */
+        }
+    }
+#else
+    (void) mem;
+    (void) size;
+#endif /* __linux__ */
+    return 1;
+}
+
+/*
+ * map_aligned() --Map some anonymous pages at an aligned address.
+ *
+ * Returns: (void *)
+ * Success: the memory; Failure: NULL.
+ *
+ * Remarks:
+ * If the alignment is more than a page, this maps enough extra to
+ * find an aligned start, and unmaps the excess at each end.
+ */
+static void *map_aligned(size_t size, size_t align)
+{
+    size_t page = cpu_topology()->page_size;
+    size_t extra = align > page ? align - page : 0;
+    char *map = mmap(NULL, size + extra, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char *mem;
+    size_t head;
+
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+    mem = (char *) (((uintptr_t) map + align - 1) & ~(uintptr_t) (align - 1));
+    if ((head = (size_t) (mem - map)) != 0)
+    {
+        munmap(map, head);
+    }
+    if (extra > head)
+    {
+        munmap(mem + size, extra - head);
+    }
+    return mem;
+}
+
+/*
+ * page_alloc() --Map some (aligned) pages, with a NUMA/huge-page policy.
+ *
+ * Parameters:
+ * size  --the size required (rounded up by page_round())
+ * align --the alignment required (a power of 2; 0: a page)
+ * node  --the preferred NUMA node, or PAGE_NODE_ANY, PAGE_NODE_LOCAL
+ * flags --PAGE_HUGE and/or PAGE_HUGETLB (PAGE_MAP is implied)
+ *
+ * Returns: (void *)
+ * Success: the (zeroed) memory; Failure: NULL.
+ *
+ * Remarks:
+ * Huge pages are always aligned on the huge page size.
+ */
+void *page_alloc(size_t size, size_t align, int node, int flags)
+{
+    size_t unit = page_unit(flags);
+    void *mem = NULL;
+
+    if (size == 0 || (align & (align - 1)) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    size = page_round(size, flags);
+    align = MAX(align, unit);
+#ifdef MAP_HUGETLB
+    if ((flags & PAGE_HUGETLB) && align == unit)
+    {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        mem = mem != MAP_FAILED ? mem : NULL;
+    }
+#endif /* MAP_HUGETLB */
+    if (mem == NULL)
+    {
+        if ((mem = map_aligned(size, align)) == NULL)
+        {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (flags & (PAGE_HUGE | PAGE_HUGETLB))
+        {
+            (void) madvise(mem, size, MADV_HUGEPAGE);
+        }
+#endif /* MADV_HUGEPAGE */
+    }
+    if (!bind_node(mem, size, node))
+    {
+        munmap(mem, size);
+        return NULL;
+    }
+    return mem;
+}
+
+/*
+ * page_realloc() --Resize some mapped pages, keeping their policy.
+ *
+ * Parameters:
+ * ptr      --the pages (from page_alloc()), or NULL
+ * old_size --their size
+ * new_size --the size required
+ * node, flags --as for page_alloc() (and as ptr was allocated)
+ *
+ * Returns: (void *)
+ * Success: the (possibly moved) memory; Failure: NULL (ptr is unchanged).
+ *
+ * Remarks:
+ * On Linux, mremap() moves the page tables rather than the data, and
+ * the mapping keeps its NUMA policy and huge-page advice.  Reserved
+ * huge pages can't be remapped, so they (and everything, elsewhere)
+ * are copied.
+ */
+void *page_realloc(void *ptr, size_t old_size, size_t new_size,
+                   int node, int flags)
+{
+    void *mem;
+
+    if (ptr == NULL)
+    {
+        return page_alloc(new_size, 0, node, flags);
+    }
+    old_size = page_round(old_size, flags);
+    new_size = page_round(new_size, flags);
+    if (new_size == old_size)
+    {
+        return ptr;
+    }
+#ifdef MREMAP_MAYMOVE
+    if (!(flags & PAGE_HUGETLB))
+    {
+        mem = mremap(ptr, old_size, new_size, MREMAP_MAYMOVE);
+        return mem != MAP_FAILED ? mem : NULL;
+    }
+#endif /* MREMAP_MAYMOVE */
+    if ((mem = page_alloc(new_size, 0, node, flags)) == NULL)
+    {
+        return NULL;
+    }
+    memcpy(mem, ptr, MIN(old_size, new_size));
+    munmap(ptr, old_size);
+    return mem;
+}
+
+/*
+ * page_free() --Unmap pages allocated by page_alloc().
+ *
+ * Parameters:
+ * ptr   --the pages, or NULL
+ * size  --the size requested when they were allocated
+ * flags --the flags they were allocated with
+ */
+void page_free(void *ptr, size_t size, int flags)
+{
+    if (ptr != NULL)
+    {
+        munmap(ptr, page_round(size, flags));
+    }
+}
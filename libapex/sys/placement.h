@@ -0,0 +1,67 @@
+/*
+ * PLACEMENT.H --Definitions for CPU, NUMA and page placement.
+ *
+ * Contents:
+ * CpuTopology_t{} --The shape of the machine: CPUs, cores, nodes, caches.
+ * PagePolicy_t{}  --Where (and in what size pages) to allocate memory.
+ *
+ * Remarks:
+ * A PagePolicy is a value that containers (arenas, slab pools,
+ * vectors) copy, so that all their memory is allocated the same way.
+ * A zero PagePolicy means "just use malloc()".
+ */
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        PAGE_MAP = 0x1,                /* mmap() whole pages (not malloc()) */
+        PAGE_HUGE = 0x2,               /* ...in transparent huge pages */
+        PAGE_HUGETLB = 0x4,            /* ...in reserved huge pages, if any */
+        PAGE_NODE_ANY = -1,            /* no NUMA policy (first touch) */
+        PAGE_NODE_LOCAL = -2           /* the calling thread's node */
+    };
+
+    typedef struct CpuTopology_t
+    {
+        int n_cpu;                     /* No. of online CPUs (threads) */
+        int n_core;                    /* No. of physical cores */
+        int n_package;                 /* No. of sockets */
+        int n_node;                    /* No. of NUMA nodes (at least 1) */
+        size_t cache_line;
+        size_t l1d_size;               /* (per core) */
+        size_t l2_size;
+        size_t l3_size;                /* (shared; 0 if there isn't one) */
+        size_t page_size;
+        size_t huge_page_size;
+    } CpuTopology, *CpuTopologyPtr;
+
+    typedef struct PagePolicy_t
+    {
+        int flags;                     /* PAGE_* flags, or 0 for malloc() */
+        int node;                      /* preferred node, or PAGE_NODE_* */
+    } PagePolicy, *PagePolicyPtr;
+
+    const CpuTopology *cpu_topology(void);
+    int cpu_node(int cpu);
+    int cpu_current(void);
+    int node_current(void);
+    int cpu_pin_thread(int cpu);
+    int cpu_pin_node(int node);
+
+    size_t page_round(size_t size, int flags);
+    void *page_alloc(size_t size, size_t align, int node, int flags);
+    void *page_realloc(void *ptr, size_t old_size, size_t new_size,
+                       int node, int flags);
+    void page_free(void *ptr, size_t size, int flags);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* PLACEMENT_H */
@@ -0,0 +1,315 @@
+/*
+ * PROFILE.C --Per-thread rings of profiling zones, and a Chrome trace writer.
+ *
+ * Contents:
+ * ProfileRing_t{}        --A thread's ring of recorded zones.
+ * profile_start()        --Start recording zones.
+ * profile_stop()         --Stop recording zones.
+ * profile_reset()        --Discard all the recorded zones.
+ * thread_ring()          --Return the calling thread's ring (allocating it).
+ * profile_thread_name()  --Name the calling thread, for the trace.
+ * profile_now_()         --Return the time, for a zone.
+ * profile_record_()      --Record a closed zone in the thread's ring.
+ * profile_dropped()      --Return the No. of zones overwritten in the rings.
+ * put_json_string()      --Print a string as a JSON string.
+ * profile_write_chrome() --Write the recorded zones as a Chrome trace.
+ *
+ * Remarks:
+ * Each thread records its zones in its own ring (so recording needs
+ * no synchronisation), which it allocates on its first zone after
+ * profile_start().  The rings are kept on a list until
+ * profile_reset(), so the zones of threads that have exited are
+ * still written.  When a ring is full, the oldest zones are
+ * overwritten (and counted by profile_dropped()).
+ *
+ * profile_write_chrome() writes the Chrome "trace_event" JSON format,
+ * as complete ("X") events, which chrome://tracing, Perfetto
+ * (ui.perfetto.dev) and speedscope all load.  It may be called while
+ * zones are being recorded, but a zone being overwritten as it's
+ * read may be garbled; profile_reset() must only be called when no
+ * zones are open.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <apex.h>
+#include <apex/clock.h>
+#include <apex/profile.h>
+
+enum
+{
+    PROFILE_NAME_MAX = 64
+};
+
+/*
+ * ProfileRing_t{} --A thread's ring of recorded zones.
+ */
+typedef struct ProfileRing_t
+{
+    struct ProfileRing_t *next;        /* (the list of all rings) */
+    int tid;                           /* (the trace's thread id) */
+    char name[PROFILE_NAME_MAX];       /* thread name (or "") */
+    size_t mask;                       /* No. of events - 1 */
+    uint64_t n_record;                 /* zones recorded (ever) */
+    ProfileEvent event[];
+} ProfileRing;
+
+int profile_enabled_;
+
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileRing *ring_list;
+static size_t ring_size = PROFILE_RING_SIZE;
+static int next_tid;
+static unsigned int generation;        /* (incremented by profile_reset()) */
+static int64_t base_time;              /* profile_start()'s first time */
+
+static THREAD_LOCAL ProfileRing *my_ring;
+static THREAD_LOCAL unsigned int my_generation;
+static THREAD_LOCAL char my_name[PROFILE_NAME_MAX];
+
+/*
+ * profile_start() --Start recording zones.
+ *
+ * Parameters:
+ * n_event  --the size of each thread's ring (0: PROFILE_RING_SIZE),
+ *            rounded up to a power of 2
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The ring size only affects rings allocated after this call, i.e.
+ * after a profile_reset().
+ */
+int profile_start(size_t n_event)
+{
+    size_t size = 1;
+
+    n_event = n_event != 0 ? n_event : PROFILE_RING_SIZE;
+    while (size < n_event)
+    {
+        size <<= 1;
+    }
+    pthread_mutex_lock(&profile_lock);
+    if (ring_list == NULL)
+    {
+        ring_size = size;
+    }
+    if (base_time == 0)
+    {
+        base_time = profile_now_();
+    }
+    pthread_mutex_unlock(&profile_lock);
+    ATOMIC_STORE_RELEASE(&profile_enabled_, 1);
+    return 1;
+}
+
+/*
+ * profile_stop() --Stop recording zones.
+ *
+ * Remarks:
+ * Zones that are already open are still recorded when they close.
+ */
+void profile_stop(void)
+{
+    ATOMIC_STORE_RELEASE(&profile_enabled_, 0);
+}
+
+/*
+ * profile_reset() --Discard all the recorded zones.
+ */
+void profile_reset(void)
+{
+    ProfileRing *next;
+
+    pthread_mutex_lock(&profile_lock);
+    for (ProfileRing * ring = ring_list; ring != NULL; ring = next)
+    {
+        next = ring->next;
+        free(ring);
+    }
+    ring_list = NULL;
+    base_time = 0;
+    ATOMIC_ADD(&generation, 1);
+    pthread_mutex_unlock(&profile_lock);
+}
+
+/*
+ * thread_ring() --Return the calling thread's ring (allocating it).
+ *
+ * Returns: (ProfileRing *)
+ * Success: the ring; Failure: NULL.
+ */
+static ProfileRing *thread_ring(void)
+{
+    ProfileRing *ring;
+
+    if (my_ring != NULL
+        && my_generation == ATOMIC_LOAD_ACQUIRE(&generation))
+    {
+        return my_ring;
+    }
+    pthread_mutex_lock(&profile_lock);
+    if ((ring = malloc(sizeof(ProfileRing)
+                       + ring_size * sizeof(ProfileEvent))) != NULL)
+    {
+        ring->tid = ++next_tid;
+        memcpy(ring->name, my_name, sizeof(ring->name));
+        ring->mask = ring_size - 1;
+        ring->n_record = 0;
+        ring->next = ring_list;
+        ring_list = ring;
+    }
+    my_ring = ring;
+    my_generation = generation;
+    pthread_mutex_unlock(&profile_lock);
+    return ring;
+}
+
+/*
+ * profile_thread_name() --Name the calling thread, for the trace.
+ */
+void profile_thread_name(const char *name)
+{
+    snprintf(my_name, sizeof(my_name), "%s", name != NULL ? name : "");
+    if (my_ring != NULL
+        && my_generation == ATOMIC_LOAD_ACQUIRE(&generation))
+    {
+        pthread_mutex_lock(&profile_lock);
+        memcpy(my_ring->name, my_name, sizeof(my_ring->name));
+        pthread_mutex_unlock(&profile_lock);
+    }
+}
+
+/*
+ * profile_now_() --Return the time, for a zone.
+ */
+int64_t profile_now_(void)
+{
+    return (int64_t) ns_monotonic();
+}
+
+/*
+ * profile_record_() --Record a closed zone in the thread's ring.
+ *
+ * Remarks:
+ * This is called by PROFILE_ZONE()'s cleanup, via profile_zone_end_().
+ */
+void profile_record_(const ProfileZone * zone)
+{
+    int64_t now = profile_now_();
+    ProfileRing *ring = thread_ring();
+    ProfileEvent *event;
+    uint64_t n;
+
+    if (ring == NULL)
+    {
+        return;                        /* (no memory: the zone is lost) */
+    }
+    n = ring->n_record;
+    event = &ring->event[n & ring->mask];
+    event->name = zone->name;
+    event->start = zone->start;
+    event->duration = now - zone->start;
+    ATOMIC_STORE_RELEASE(&ring->n_record, n + 1);
+}
+
+/*
+ * profile_dropped() --Return the No. of zones overwritten in the rings.
+ */
+uint64_t profile_dropped(void)
+{
+    uint64_t n_dropped = 0;
+
+    pthread_mutex_lock(&profile_lock);
+    for (ProfileRing * ring = ring_list; ring != NULL; ring = ring->next)
+    {
+        uint64_t n = ATOMIC_LOAD_ACQUIRE(&ring->n_record);
+
+        n_dropped += n > ring->mask + 1 ? n - (ring->mask + 1) : 0;
+    }
+    pthread_mutex_unlock(&profile_lock);
+    return n_dropped;
+}
+
+/*
+ * put_json_string() --Print a string as a JSON string.
+ */
+static void put_json_string(FILE *fp, const char *str)
+{
+    putc('"', fp);
+    for (; *str != '\0'; ++str)
+    {
+        unsigned char ch = (unsigned char) *str;
+
+        if (ch == '"' || ch == '\\')
+        {
+            putc('\\', fp);
+            putc(ch, fp);
+        }
+        else if (ch < ' ')
+        {
+            fprintf(fp, "\\u%04x", ch);
+        }
+        else
+        {
+            putc(ch, fp);
+        }
+    }
+    putc('"', fp);
+}
+
+/*
+ * profile_write_chrome() --Write the recorded zones as a Chrome trace.
+ *
+ * Parameters:
+ * fp   --the file to write to
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * Times are written in microseconds since profile_start(), as the
+ * format requires; each thread is named by a metadata ("M") event,
+ * if profile_thread_name() was called.
+ */
+int profile_write_chrome(FILE *fp)
+{
+    int pid = (int) getpid();
+    const char *sep = "\n";
+
+    pthread_mutex_lock(&profile_lock);
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (ProfileRing * ring = ring_list; ring != NULL; ring = ring->next)
+    {
+        uint64_t n = ATOMIC_LOAD_ACQUIRE(&ring->n_record);
+        uint64_t first = n > ring->mask + 1 ? n - (ring->mask + 1) : 0;
+
+        if (ring->name[0] != '\0')
+        {
+            fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+                    "\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                    sep, pid, ring->tid);
+            put_json_string(fp, ring->name);
+            fprintf(fp, "}}");
+            sep = ",\n";
+        }
+        for (uint64_t i = first; i < n; ++i)
+        {
+            const ProfileEvent *event = &ring->event[i & ring->mask];
+
+            fprintf(fp, "%s{\"name\":", sep);
+            put_json_string(fp, event->name);
+            fprintf(fp, ",\"cat\":\"apex\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    (double) (event->start - base_time) / 1e3,
+                    (double) event->duration / 1e3, pid, ring->tid);
+            sep = ",\n";
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    pthread_mutex_unlock(&profile_lock);
+    return !ferror(fp);
+}
@@ -0,0 +1,101 @@
+/*
+ * PROFILE.H --Definitions for scoped profiling zones, and their trace.
+ *
+ * Contents:
+ * ProfileZone_t{}  --An open zone: its name and start time.
+ * ProfileEvent_t{} --A closed zone, as recorded in a thread's ring.
+ * PROFILE_ZONE()   --Time the rest of the enclosing scope.
+ * PROFILE_FUNCTION() --Time the rest of the enclosing function.
+ *
+ * Remarks:
+ * PROFILE_ZONE() declares a variable whose cleanup (GCC/clang's
+ * "cleanup" attribute) records the zone when it goes out of scope,
+ * however the scope is left.  Zones are only compiled in if
+ * PROFILE_TRACE is defined (for the library, to instrument its own
+ * functions, and/or for its callers); otherwise the macros expand to
+ * nothing.  When compiled in, a zone costs one (well predicted) test
+ * until profile_start() is called.
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <apex/atomic.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        PROFILE_RING_SIZE = 1 << 16    /* default events per thread */
+    };
+
+    typedef struct ProfileZone_t
+    {
+        const char *name;              /* (NULL: not recording) */
+        int64_t start;                 /* monotonic time, ns */
+    } ProfileZone;
+
+    typedef struct ProfileEvent_t
+    {
+        const char *name;
+        int64_t start;                 /* monotonic time, ns */
+        int64_t duration;              /* ns */
+    } ProfileEvent;
+
+#if defined(PROFILE_TRACE) && (defined(__GNUC__) || defined(__clang__))
+#define PROFILE_CAT_(a_, b_) a_ ## b_
+#define PROFILE_VAR_(line_) PROFILE_CAT_(profile_zone_, line_)
+#define PROFILE_ZONE(name_) \
+    ProfileZone PROFILE_VAR_(__LINE__) \
+    __attribute__((cleanup(profile_zone_end_), unused)) = \
+        profile_zone_begin_(name_)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#else
+#define PROFILE_ZONE(name_) ((void) 0)
+#define PROFILE_FUNCTION() ((void) 0)
+#endif                                 /* PROFILE_TRACE */
+
+    extern int profile_enabled_;
+
+    int profile_start(size_t n_event);
+    void profile_stop(void);
+    void profile_reset(void);
+    void profile_thread_name(const char *name);
+    uint64_t profile_dropped(void);
+    int profile_write_chrome(FILE *fp);
+    int64_t profile_now_(void);
+    void profile_record_(const ProfileZone * zone);
+
+    /*
+     * profile_zone_begin_() --Open a zone (if profiling is running).
+     */
+    static inline ProfileZone profile_zone_begin_(const char *name)
+    {
+        ProfileZone zone = { NULL, 0 };
+
+        if (ATOMIC_LOAD_RELAXED(&profile_enabled_))
+        {
+            zone.name = name;
+            zone.start = profile_now_();
+        }
+        return zone;
+    }
+
+    /*
+     * profile_zone_end_() --Close a zone, recording it if it was opened.
+     */
+    static inline void profile_zone_end_(ProfileZone * zone)
+    {
+        if (zone->name != NULL)
+        {
+            profile_record_(zone);
+        }
+    }
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* PROFILE_H */
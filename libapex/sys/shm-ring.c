@@ -0,0 +1,760 @@
+/*
+ * SHM-RING.C --A shared-memory ring of fixed-size records, between processes.
+ *
+ * Contents:
+ * shm_ring_create()       --Create a ring (named, or anonymous).
+ * shm_ring_open()         --Open a named ring created by another process.
+ * shm_ring_attach()       --Map a ring from its file descriptor(s).
+ * shm_ring_close()        --Unmap a ring, and close its descriptors.
+ * shm_ring_unlink()       --Remove a named ring's name.
+ * shm_ring_send()         --Pass a ring's descriptors over a Unix socket.
+ * shm_ring_receive()      --Receive (and map) a ring from a Unix socket.
+ * shm_ring_reserve()      --Get the producer's next free slot.
+ * shm_ring_commit()       --Publish the slot most recently reserved.
+ * shm_ring_acquire()      --Get the consumer's next record.
+ * shm_ring_release()      --Free the record most recently acquired.
+ * shm_ring_push()         --Copy a record into the ring.
+ * shm_ring_pop()          --Copy a record out of the ring.
+ * shm_ring_reserve_wait() --Reserve a slot, waiting if the ring is full.
+ * shm_ring_acquire_wait() --Acquire a record, waiting if the ring is empty.
+ * shm_ring_wait_fd()      --Prepare to wait for records with poll()/select().
+ * shm_ring_depth()        --Return the No. of records in the ring.
+ *
+ * Remarks:
+ * This is AtomicQueue (see queue.c) laid out in a MAP_SHARED mapping:
+ * one producer process writes records in place (reserve/commit), and
+ * one consumer process reads them in place (acquire/release), so a
+ * record is never copied, and the ring's fast path makes no system
+ * calls.  Each side also caches its last view of the other side's
+ * counter, and re-reads the shared one only when the ring looks full
+ * (empty), so the counters' cache lines move between the CPUs only
+ * once per batch, rather than once per record.
+ *
+ * The ring is a memfd (anonymous: shared by fork(), or passed over a
+ * Unix socket with shm_ring_send()), or a POSIX shm object (named:
+ * opened by name).  The blocking protocol is queue-wait.c's, but with
+ * shared (not process-private) futexes on the counters; the consumer
+ * may instead wait on an eventfd, which is passed along with the
+ * memfd (it can't be opened by name).
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE                    /* for memfd_create() */
+#endif /* __linux__ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+#include <apex/shm-ring.h>
+
+#define SHM_RING_POLL_NSEC 1000000     /* fallback polling interval: 1ms */
+#define HEADER_SIZE \
+    ((sizeof(ShmRingHeader) + CACHE_LINE - 1) & ~(size_t) (CACHE_LINE - 1))
+
+/*
+ * ring_reset() --Set a handle to its closed state.
+ */
+static void ring_reset(ShmRingPtr ring)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    ring->event_fd = -1;
+}
+
+/*
+ * slot() --Return the address of a ring's slot for a counter value.
+ */
+static inline void *slot(ShmRingPtr ring, uint32_t n)
+{
+    return ring->items + (size_t) ring->item_size * (n & ring->mask);
+}
+
+/*
+ * map_ring() --Map (and check) a ring's shared memory.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+static int map_ring(ShmRingPtr ring, int fd, int event_fd)
+{
+    struct stat st;
+    ShmRingHeaderPtr header;
+    size_t size;
+
+    if (fstat(fd, &st) != 0)
+    {
+        return 0;
+    }
+    if ((size_t) st.st_size < HEADER_SIZE)
+    {
+        errno = EINVAL;
+        return 0;                      /* failure: too small */
+    }
+    size = (size_t) st.st_size;
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED)
+    {
+        return 0;
+    }
+    if (ATOMIC_LOAD_ACQUIRE(&header->magic) != SHM_RING_MAGIC
+        || header->version != SHM_RING_VERSION
+        || header->n_items == 0
+        || (header->n_items & (header->n_items - 1)) != 0
+        || header->item_size == 0
+        || HEADER_SIZE + (size_t) header->n_items * header->item_size > size)
+    {
+        munmap(header, size);
+        errno = EINVAL;
+        return 0;                      /* failure: not a (valid) ring */
+    }
+    ring->header = header;
+    ring->items = (char *) header + HEADER_SIZE;
+    ring->size = size;
+    ring->mask = header->n_items - 1;
+    ring->item_size = header->item_size;
+    ring->fd = fd;
+    ring->event_fd = event_fd;
+    ring->cached_read = ATOMIC_LOAD_ACQUIRE(&header->n_read);
+    ring->cached_write = ATOMIC_LOAD_ACQUIRE(&header->n_write);
+    return 1;
+}
+
+/*
+ * shm_ring_create() --Create a ring (named, or anonymous).
+ *
+ * Parameters:
+ * ring      --returns the ring
+ * name      --the shm name (e.g. "/my-ring"), or NULL for a memfd
+ * n_items   --the No. of slots (a power of 2)
+ * item_size --the size of each record (rounded up to a multiple of 8)
+ * flags     --SHM_RING_EVENT to create an eventfd, for shm_ring_wait_fd()
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ *
+ * Remarks:
+ * A named ring must not already exist.  An anonymous ring is shared
+ * with a child process by fork() (both use the same handle), or with
+ * any process by shm_ring_send().
+ */
+int shm_ring_create(ShmRingPtr ring, const char *name, int n_items,
+                    int item_size, int flags)
+{
+    uint32_t slot_size = ((uint32_t) item_size + 7) & ~(uint32_t) 7;
+    size_t size = HEADER_SIZE + (size_t) n_items * slot_size;
+    ShmRingHeader header;
+    int fd, event_fd = -1;
+
+    ring_reset(ring);
+    if (n_items <= 0 || (n_items & (n_items - 1)) != 0 || item_size <= 0)
+    {
+        errno = EINVAL;
+        return 0;                      /* failure: bad sizes */
+    }
+    if (name != NULL)
+    {
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    }
+    else
+    {
+#ifdef MFD_CLOEXEC
+        fd = memfd_create("apex-shm-ring", MFD_CLOEXEC);
+#else
+        errno = ENOSYS;
+        fd = -1;
+#endif /* MFD_CLOEXEC */
+    }
+    if (fd < 0)
+    {
+        return 0;                      /* failure: can't create the memory */
+    }
+    memset(&header, 0, sizeof(header));
+    header.magic = SHM_RING_MAGIC;
+    header.version = SHM_RING_VERSION;
+    header.n_items = (uint32_t) n_items;
+    header.item_size = slot_size;
+    if (ftruncate(fd, (off_t) size) != 0
+        || pwrite(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header))
+    {
+        goto fail;
+    }
+#ifdef __linux__
+    if ((flags & SHM_RING_EVENT)
+        && (event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    {
+        goto fail;
+    }
+#else
+    if (flags & SHM_RING_EVENT)
+    {
+        errno = ENOSYS;
+        goto fail;
+    }
+#endif /* __linux__ */
+    if (map_ring(ring, fd, event_fd))
+    {
+        return 1;                      /* success */
+    }
+  fail:
+    {
+        int saved_errno = errno;
+
+        if (event_fd >= 0)
+        {
+            close(event_fd);
+        }
+        close(fd);
+        if (name != NULL)
+        {
+            shm_unlink(name);
+        }
+        errno = saved_errno;
+    }
+    return 0;                          /* failure: errno is set */
+}
+
+/*
+ * shm_ring_open() --Open a named ring created by another process.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+int shm_ring_open(ShmRingPtr ring, const char *name)
+{
+    int fd;
+
+    ring_reset(ring);
+    if ((fd = shm_open(name, O_RDWR | O_CLOEXEC, 0)) < 0)
+    {
+        return 0;
+    }
+    if (!shm_ring_attach(ring, fd, -1))
+    {
+        int saved_errno = errno;
+
+        close(fd);
+        errno = saved_errno;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * shm_ring_attach() --Map a ring from its file descriptor(s).
+ *
+ * Parameters:
+ * ring     --returns the ring
+ * fd       --the ring's memfd (or shm) descriptor
+ * event_fd --its eventfd, or -1
+ *
+ * Returns: (int)
+ * Success: 1 (the ring now owns the descriptors); Failure: 0.
+ */
+int shm_ring_attach(ShmRingPtr ring, int fd, int event_fd)
+{
+    ring_reset(ring);
+    return map_ring(ring, fd, event_fd);
+}
+
+/*
+ * shm_ring_close() --Unmap a ring, and close its descriptors.
+ *
+ * Remarks:
+ * The ring's memory is freed when the last process closes it (and,
+ * for a named ring, its name has been removed).
+ */
+void shm_ring_close(ShmRingPtr ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    if (ring->header != NULL)
+    {
+        munmap(ring->header, ring->size);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+    if (ring->event_fd >= 0)
+    {
+        close(ring->event_fd);
+    }
+    ring_reset(ring);
+}
+
+/*
+ * shm_ring_unlink() --Remove a named ring's name.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+int shm_ring_unlink(const char *name)
+{
+    return shm_unlink(name) == 0;
+}
+
+/*
+ * shm_ring_send() --Pass a ring's descriptors over a Unix socket.
+ *
+ * Parameters:
+ * sock --a connected Unix-domain socket (e.g. from open_connect())
+ * ring --the ring
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ *
+ * Remarks:
+ * The descriptors are sent as SCM_RIGHTS, with a 1-byte message;
+ * the other process maps the ring with shm_ring_receive().
+ */
+int shm_ring_send(int sock, const ShmRing * ring)
+{
+    int fds[2] = { ring->fd, ring->event_fd };
+    size_t n_fd = ring->event_fd >= 0 ? 2 : 1;
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    char tag = (char) n_fd;
+    struct iovec iov = { &tag, 1 };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(n_fd * sizeof(int));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(n_fd * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, n_fd * sizeof(int));
+    return sendmsg(sock, &msg, 0) == 1;
+}
+
+/*
+ * shm_ring_receive() --Receive (and map) a ring from a Unix socket.
+ *
+ * Parameters:
+ * ring --returns the ring
+ * sock --the socket that shm_ring_send() was called with
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (errno is set).
+ */
+int shm_ring_receive(ShmRingPtr ring, int sock)
+{
+    int fds[2] = { -1, -1 };
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    char tag;
+    struct iovec iov = { &tag, 1 };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    ring_reset(ring);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+    {
+        if (errno == 0)
+        {
+            errno = EPIPE;
+        }
+        return 0;                      /* failure: no message */
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+            memcpy(fds, CMSG_DATA(cmsg), MIN(n, NEL(fds)) * sizeof(int));
+        }
+    }
+    if (fds[0] < 0 || !shm_ring_attach(ring, fds[0], fds[1]))
+    {
+        int saved_errno = fds[0] < 0 ? EBADMSG : errno;
+
+        for (size_t i = 0; i < NEL(fds); ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                close(fds[i]);
+            }
+        }
+        errno = saved_errno;
+        return 0;                      /* failure: no (valid) ring */
+    }
+    return 1;
+}
+
+/*
+ * ring_wake() --Wake the other side of the ring, if it's waiting.
+ *
+ * Parameters:
+ * flag     --the other side's waiting flag
+ * counter  --this side's (just published) counter
+ * event_fd --an eventfd to signal too, or -1
+ */
+static void ring_wake(uint32_t *flag, uint32_t *counter, int event_fd)
+{
+    ATOMIC_FENCE();                    /* (order counter store/flag load) */
+    if (ATOMIC_LOAD_RELAXED(flag))
+    {
+        ATOMIC_STORE_RELAXED(flag, 0);
+#ifdef __linux__
+        syscall(SYS_futex, counter, FUTEX_WAKE, 1, NULL, NULL, 0);
+        if (event_fd >= 0)
+        {
+            uint64_t one = 1;
+
+            if (write(event_fd, &one, sizeof(one)) < 0)
+            {                          /* (EAGAIN: already signalled) */
+                return;
+            }
+        }
+#else
+        (void) counter;
+        (void) event_fd;
+#endif /* __linux__ */
+    }
+}
+
+/*
+ * shm_ring_reserve() --Get the producer's next free slot.
+ *
+ * Returns: (void *)
+ * Success: the slot (item_size bytes); Failure: NULL (the ring is full).
+ *
+ * Remarks:
+ * The record isn't visible to the consumer until shm_ring_commit().
+ */
+void *shm_ring_reserve(ShmRingPtr ring)
+{
+    ShmRingHeaderPtr header = ring->header;
+    uint32_t n_write = header->n_write;        /* (producer-owned) */
+
+    if (n_write - ring->cached_read > ring->mask)
+    {
+        ring->cached_read = ATOMIC_LOAD_ACQUIRE(&header->n_read);
+        if (n_write - ring->cached_read > ring->mask)
+        {
+            ATOMIC_STORE_RELAXED(&header->n_fail, header->n_fail + 1);
+            return NULL;               /* failure: the ring is full */
+        }
+    }
+    return slot(ring, n_write);
+}
+
+/*
+ * shm_ring_commit() --Publish the slot most recently reserved.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no slot was reserved).
+ */
+int shm_ring_commit(ShmRingPtr ring)
+{
+    ShmRingHeaderPtr header = ring->header;
+    uint32_t n_write = header->n_write;
+
+    if (n_write - ring->cached_read > ring->mask)
+    {
+        return 0;                      /* failure: nothing reserved */
+    }
+    ATOMIC_STORE_RELEASE(&header->n_write, n_write + 1);
+    ring_wake(&header->read_wait, &header->n_write, ring->event_fd);
+    return 1;
+}
+
+/*
+ * shm_ring_acquire() --Get the consumer's next record.
+ *
+ * Returns: (void *)
+ * Success: the record; Failure: NULL (the ring is empty).
+ *
+ * Remarks:
+ * The record stays in the ring (and its slot isn't reused) until
+ * shm_ring_release().
+ */
+void *shm_ring_acquire(ShmRingPtr ring)
+{
+    ShmRingHeaderPtr header = ring->header;
+    uint32_t n_read = header->n_read;  /* (consumer-owned) */
+
+    if (ring->cached_write == n_read)
+    {
+        ring->cached_write = ATOMIC_LOAD_ACQUIRE(&header->n_write);
+        if (ring->cached_write == n_read)
+        {
+            return NULL;               /* failure: the ring is empty */
+        }
+    }
+    return slot(ring, n_read);
+}
+
+/*
+ * shm_ring_release() --Free the record most recently acquired.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (no record was acquired).
+ */
+int shm_ring_release(ShmRingPtr ring)
+{
+    ShmRingHeaderPtr header = ring->header;
+    uint32_t n_read = header->n_read;
+
+    if (ring->cached_write == n_read)
+    {
+        return 0;                      /* failure: nothing acquired */
+    }
+    ATOMIC_STORE_RELEASE(&header->n_read, n_read + 1);
+    ring_wake(&header->write_wait, &header->n_read, -1);
+    return 1;
+}
+
+/*
+ * shm_ring_push() --Copy a record into the ring.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the ring is full).
+ */
+int shm_ring_push(ShmRingPtr ring, const void *item)
+{
+    void *mem = shm_ring_reserve(ring);
+
+    if (mem == NULL)
+    {
+        return 0;
+    }
+    memcpy(mem, item, ring->item_size);
+    return shm_ring_commit(ring);
+}
+
+/*
+ * shm_ring_pop() --Copy a record out of the ring.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the ring is empty).
+ */
+int shm_ring_pop(ShmRingPtr ring, void *item)
+{
+    void *mem = shm_ring_acquire(ring);
+
+    if (mem == NULL)
+    {
+        return 0;
+    }
+    memcpy(item, mem, ring->item_size);
+    return shm_ring_release(ring);
+}
+
+/*
+ * get_deadline() --Convert a relative timeout into an absolute deadline.
+ *
+ * Returns: (struct timespec *)
+ * deadline, or NULL if there's no timeout.
+ */
+static struct timespec *get_deadline(TimeValuePtr timeout,
+                                     struct timespec *deadline)
+{
+    if (timeout == NULL)
+    {
+        return NULL;                   /* no timeout: wait forever */
+    }
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout->tv_sec;
+    deadline->tv_nsec += timeout->tv_usec * 1000;
+    if (deadline->tv_nsec >= 1000000000)
+    {
+        deadline->tv_nsec -= 1000000000;
+        deadline->tv_sec += 1;
+    }
+    return deadline;
+}
+
+/*
+ * futex_wait() --Sleep while *addr == value, or until the deadline.
+ *
+ * Returns: (int)
+ * Success: 1 (woken, or *addr changed); Failure: 0 (timed out).
+ *
+ * Remarks:
+ * The futex is shared (not FUTEX_PRIVATE), because the other side is
+ * another process.
+ */
+static int futex_wait(uint32_t *addr, uint32_t value,
+                      const struct timespec *deadline)
+{
+    struct timespec now, timeout = { 0, SHM_RING_POLL_NSEC };
+
+    if (deadline != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout.tv_sec = deadline->tv_sec - now.tv_sec;
+        timeout.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if (timeout.tv_nsec < 0)
+        {
+            timeout.tv_nsec += 1000000000;
+            timeout.tv_sec -= 1;
+        }
+        if (timeout.tv_sec < 0)
+        {
+            return 0;                  /* failure: deadline has passed */
+        }
+    }
+#ifdef __linux__
+    if (syscall(SYS_futex, addr, FUTEX_WAIT, value,
+                deadline != NULL ? &timeout : NULL, NULL, 0) != 0
+        && errno == ETIMEDOUT)
+    {
+        return 0;                      /* failure: timed out */
+    }
+#else
+    if (deadline == NULL || timeout.tv_sec > 0
+        || timeout.tv_nsec > SHM_RING_POLL_NSEC)
+    {
+        timeout.tv_sec = 0;
+        timeout.tv_nsec = SHM_RING_POLL_NSEC;
+    }
+    if (ATOMIC_LOAD_ACQUIRE(addr) == value)
+    {
+        nanosleep(&timeout, NULL);
+    }
+#endif /* __linux__ */
+    return 1;                          /* success: woken (maybe spuriously) */
+}
+
+/*
+ * shm_ring_reserve_wait() --Reserve a slot, waiting if the ring is full.
+ *
+ * Parameters:
+ * ring    --the ring
+ * timeout --the maximum time to wait (NULL: wait forever)
+ *
+ * Returns: (void *)
+ * Success: the slot; Failure: NULL (timed out).
+ */
+void *shm_ring_reserve_wait(ShmRingPtr ring, TimeValuePtr timeout)
+{
+    ShmRingHeaderPtr header = ring->header;
+    struct timespec deadline_buf;
+    struct timespec *deadline = get_deadline(timeout, &deadline_buf);
+    void *mem;
+
+    while ((mem = shm_ring_reserve(ring)) == NULL)
+    {                                  /* full: n_read == n_write - size */
+        uint32_t n_read = header->n_write - ring->mask - 1;
+
+        ATOMIC_STORE_RELAXED(&header->write_wait, 1);
+        ATOMIC_FENCE();
+        if (ATOMIC_LOAD_ACQUIRE(&header->n_read) == n_read
+            && !futex_wait(&header->n_read, n_read, deadline))
+        {
+            return NULL;               /* failure: timed out */
+        }
+    }
+    return mem;
+}
+
+/*
+ * shm_ring_acquire_wait() --Acquire a record, waiting if the ring is empty.
+ *
+ * Parameters:
+ * ring    --the ring
+ * timeout --the maximum time to wait (NULL: wait forever)
+ *
+ * Returns: (void *)
+ * Success: the record; Failure: NULL (timed out).
+ */
+void *shm_ring_acquire_wait(ShmRingPtr ring, TimeValuePtr timeout)
+{
+    ShmRingHeaderPtr header = ring->header;
+    struct timespec deadline_buf;
+    struct timespec *deadline = get_deadline(timeout, &deadline_buf);
+    void *mem;
+
+    while ((mem = shm_ring_acquire(ring)) == NULL)
+    {
+        uint32_t n_write = header->n_read;     /* (i.e. it was empty) */
+
+        ATOMIC_STORE_RELAXED(&header->read_wait, 1);
+        ATOMIC_FENCE();
+        if (ATOMIC_LOAD_ACQUIRE(&header->n_write) == n_write
+            && !futex_wait(&header->n_write, n_write, deadline))
+        {
+            return NULL;               /* failure: timed out */
+        }
+    }
+    return mem;
+}
+
+/*
+ * shm_ring_wait_fd() --Prepare to wait for records with poll()/select().
+ *
+ * Returns: (int)
+ * Success: the ring's eventfd; Failure: -1 (it has none).
+ *
+ * Remarks:
+ * As for queue_wait_fd(): the consumer calls this immediately before
+ * waiting, and drains the ring when the fd becomes readable.
+ */
+int shm_ring_wait_fd(ShmRingPtr ring)
+{
+    if (ring->event_fd < 0)
+    {
+        return -1;                     /* failure: no eventfd */
+    }
+#ifdef __linux__
+    {
+        ShmRingHeaderPtr header = ring->header;
+        uint64_t count;
+
+        if (read(ring->event_fd, &count, sizeof(count)) < 0)
+        {                              /* (EAGAIN: wasn't signalled) */
+            count = 0;
+        }
+        ATOMIC_STORE_RELAXED(&header->read_wait, 1);
+        ATOMIC_FENCE();
+        if (ATOMIC_LOAD_ACQUIRE(&header->n_write) != header->n_read)
+        {                              /* not empty: wake ourselves */
+            ring_wake(&header->read_wait, &header->n_write, ring->event_fd);
+        }
+    }
+#endif /* __linux__ */
+    return ring->event_fd;
+}
+
+/*
+ * shm_ring_depth() --Return the No. of records in the ring.
+ */
+unsigned int shm_ring_depth(const ShmRing * ring)
+{
+    return ATOMIC_LOAD_ACQUIRE(&ring->header->n_write)
+        - ATOMIC_LOAD_ACQUIRE(&ring->header->n_read);
+}
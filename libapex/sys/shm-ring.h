@@ -0,0 +1,86 @@
+/*
+ * SHM-RING.H --Definitions for a shared-memory ring between processes.
+ *
+ * Contents:
+ * ShmRingHeader_t{} --The shared state of a ring (at the start of its mapping).
+ * ShmRing_t{}       --A process's handle on a ring.
+ *
+ * Remarks:
+ * The shared header has AtomicQueue's single-producer, single-consumer
+ * layout (free-running n_write/n_read counters, and the waiting flags,
+ * on separate cache lines), but it holds no pointers, because each
+ * process maps the ring at a different address.
+ */
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <apex/atomic.h>
+#include <apex/timeval.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    enum
+    {
+        SHM_RING_MAGIC = 0x41505852,   /* "APXR" */
+        SHM_RING_VERSION = 1,
+        SHM_RING_EVENT = 0x1           /* create an eventfd for the consumer */
+    };
+
+    typedef struct ShmRingHeader_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t n_items;              /* (a power of 2) */
+        uint32_t item_size;            /* slot size (a multiple of 8) */
+        char pad_0[CACHE_LINE];
+
+        uint32_t n_write;              /* No. of committed writes */
+        uint32_t n_fail;               /* No. of failed writes */
+        uint32_t write_wait;           /* producer is waiting for space */
+        char pad_1[CACHE_LINE];
+
+        uint32_t n_read;               /* No. of released reads */
+        uint32_t read_wait;            /* consumer is waiting for items */
+        char pad_2[CACHE_LINE];
+    } ShmRingHeader, *ShmRingHeaderPtr;
+
+    typedef struct ShmRing_t
+    {
+        ShmRingHeaderPtr header;       /* the mapping */
+        char *items;                   /* ...and its item slots */
+        size_t size;                   /* size of the mapping */
+        uint32_t mask;
+        uint32_t item_size;
+        int fd;                        /* the memfd/shm object */
+        int event_fd;                  /* eventfd for the consumer, or -1 */
+        uint32_t cached_read;          /* producer's last view of n_read */
+        uint32_t cached_write;         /* consumer's last view of n_write */
+    } ShmRing, *ShmRingPtr;
+
+    int shm_ring_create(ShmRingPtr ring, const char *name, int n_items,
+                        int item_size, int flags);
+    int shm_ring_open(ShmRingPtr ring, const char *name);
+    int shm_ring_attach(ShmRingPtr ring, int fd, int event_fd);
+    void shm_ring_close(ShmRingPtr ring);
+    int shm_ring_unlink(const char *name);
+    int shm_ring_send(int sock, const ShmRing * ring);
+    int shm_ring_receive(ShmRingPtr ring, int sock);
+
+    void *shm_ring_reserve(ShmRingPtr ring);
+    int shm_ring_commit(ShmRingPtr ring);
+    void *shm_ring_acquire(ShmRingPtr ring);
+    int shm_ring_release(ShmRingPtr ring);
+    int shm_ring_push(ShmRingPtr ring, const void *item);
+    int shm_ring_pop(ShmRingPtr ring, void *item);
+    void *shm_ring_reserve_wait(ShmRingPtr ring, TimeValuePtr timeout);
+    void *shm_ring_acquire_wait(ShmRingPtr ring, TimeValuePtr timeout);
+    int shm_ring_wait_fd(ShmRingPtr ring);
+    unsigned int shm_ring_depth(const ShmRing * ring);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* SHM_RING_H */
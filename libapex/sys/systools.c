@@ -6,14 +6,12 @@
  * wait_input()       --Wait for input being available on some file descriptors
  * path_basename()    --Return the basename part of a path.
  * path_dirname()     --Return a copy of the directory part of a path.
- * make_path()        --Create the directory for a path.
- * link_path()        --Link one path to another, creating directories as needed.
- * resolve_path()     --Resolve a filename against a list of paths.
- * open_path()        --Open a file using path resolution.
- * open_env_path()    --Open a file with an environment-specified path.
  * touch()            --touch the specified file.
  *
  * Remarks:
+ * make_path(), link_path(), resolve_path(), open_path() etc. are in
+ * path-cache.c.
+ *
  * "systools" is a kinda lame name for this stuff, but I guess it's no
  * worse than the usual "miscutils" library, and if you believe some,
  * there's an inevitability about it all:
@@ -34,11 +32,6 @@
 #include <apex/systools.h>
 #include <apex/estring.h>
 
-#ifdef __WINNT__
-#define MKDIR(path_, permissions_) mkdir(path_)
-#else
-#define MKDIR(path_, permissions_) mkdir(path_, permissions_)
-#endif /* __WINNT__ */
 /*
  * get_env_variable() --Return the value of an environment variable, or a default.
  *
@@ -73,7 +66,9 @@ char *get_env_variable(const char *name, char *default_value)
  *
  * Remarks:
  * This is a convenience function for the common case of using
- * select to wait for one or more inputs.
+ * select to wait for one or more inputs.  It's limited to fds below
+ * FD_SETSIZE; for many fds (or callbacks and timers), use an EventLoop
+ * (see event-loop.c).
  */
 int wait_input(fd_set * input_set, fd_set * err_set, TimeValuePtr tv,
                size_t n_fd, int fd[])
@@ -151,180 +146,6 @@ const char *path_dirname(const char *path, size_t n, char dir_buf[])
     return NULL;                       /* failure: buffer too small */
 }
 
-/*
- * make_path() --Create the directory for a path.
- *
- * Parameters:
- * path --the path containing possibly non-existing components.
- *
- * Returns: (int)
- * Success: 1; Failure: 0.
- *
- * Remarks:
- * This routine creates a full directory path, ala "mkdir -p".  It recurses
- * from the leaf to the root of the directory tree.
- */
-int make_path(const char *path)
-{
-    struct stat path_info;
-    char parent[FILENAME_MAX + 1];
-    char *end;
-
-    if (stat(path, &path_info) >= 0)
-    {
-        if ((path_info.st_mode & S_IFDIR))
-        {
-            return 1;                  /* success: already exists */
-        }
-        return 0;                      /* failure: exists, but not a dir */
-    }
-
-    if ((end = strrchr(path, '/')) != NULL)
-    {
-        size_t n = (size_t) (end - path);
-
-        if (n >= NEL(parent))
-        {
-            errno = EINVAL;
-            return 0;                  /* failure: path too big (for now!) */
-        }
-        strncpy(parent, path, n);
-        parent[n] = '\0';
-
-        if (!make_path(parent))
-        {
-            return 0;                  /* error: can't make parent */
-        }
-    }
-    if (MKDIR(path, (mode_t) 0755) < 0)
-    {
-        return 0;                      /* failure: mkdir sets errno! */
-    }
-    return 1;                          /* success: mkdir succeeded */
-}
-
-/*
- * link_path() --Link one path to another, creating directories as needed.
- *
- * Parameters:
- * src --the path to link from
- * dst --the path to link to
- *
- * Returns: (int)
- * Success: 1; Failure: 0.
- *
- * TODO: handle arbitrary length paths...
- */
-int link_path(const char *src, const char *dst)
-{
-    char path[FILENAME_MAX + 1];
-    char *end = strrchr(dst, '/');
-
-    if (end != NULL)
-    {
-        size_t n = (size_t) (end - dst);
-
-        if (n >= NEL(path))
-        {
-            errno = EINVAL;
-            return 0;                  /* failure: path too big (for now!) */
-        }
-        strncpy(path, dst, n);
-        path[n] = '\0';
-        if (!make_path(path))
-        {
-            return 0;                  /* failure: cannot make path */
-        }
-    }
-    return link(src, dst) == 0;        /* success? --depends on link(2) */
-}
-
-/*
- * resolve_path() --Resolve a filename against a list of paths.
- *
- * Parameters:
- * paths    --specifies the paths as a NULL terminated list
- * base     --the basename
- *
- * Returns: (char *)
- * Success: the path element that matched; Failure: NULL.
- *
- * Remarks:
- * This routine will return successfully for the first path for which
- * stat returns OK.
- */
-const char *resolve_path(const char *path[], const char *base)
-{
-    for (int i = 0; path[i] != NULL; ++i)
-    {
-        char file[FILENAME_MAX + 1];
-        struct stat status;
-
-        sprintf(file, "%s/%s", path[i], base);
-        if (stat(file, &status) == 0)
-        {
-            return path[i];
-        }
-    }
-    return NULL;
-}
-
-/*
- * open_path() --Open a file using path resolution.
- *
- * Parameters:
- * path    --specifies the path as a NULL terminated list
- * base     --the basename part of the file
- * mode     --the file mode
- *
- * Returns: (FILE *)
- * Success: the file pointer; Failure: NULL.
- *
- * Remarks:
- * This routine will return successfully for the first path for which
- * fopen succeeds.
- */
-FILE *open_path(const char *path[], const char *base, const char *mode)
-{
-    for (int i = 0; path[i] != NULL; ++i)
-    {
-        char file[FILENAME_MAX + 1];
-        FILE *fp;
-
-        sprintf(file, "%s/%s", path[i], base);
-        if ((fp = fopen(file, mode)) != NULL)
-        {
-            return fp;
-        }
-    }
-    return NULL;
-}
-
-/*
- * open_env_path() --Open a file with an environment-specified path.
- *
- * Parameters:
- * env      --specifies the environment variable containing the path
- * base     --the basename part of the file
- * mode     --the file mode
- *
- * Returns: (FILE *)
- * Success: the file pointer; Failure: NULL.
- */
-FILE *open_env_path(const char *env, const char *base, const char *mode)
-{
-    if (env == NULL || (env = getenv(env)) == NULL)
-    {
-        return NULL;                   /* error: no environment */
-    }
-
-    char **path = new_str_list(env, ':');
-    FILE *fp = open_path((const char **) path, base, mode);
-
-    free_str_list(path);
-    return fp;
-}
-
 /*
  * touch() --touch the specified file.
  *
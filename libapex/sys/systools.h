@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/types.h>
 #include <apex/timeval.h>
 
 #ifdef __cplusplus
@@ -15,6 +16,14 @@ extern "C"
     char *get_env_variable(const char *name, char *default_value);
     int create_pidfile(const char *path);
     void unlink_pidfile(void);
+    int read_pidfile(const char *path, pid_t *pid);
+    pid_t check_pidfile(const char *path);
+    int open_pidfd(pid_t pid);
+    int signal_pidfd(int pidfd, int sig);
+    size_t open_pidfds(size_t n, const pid_t pid[], int pidfd[]);
+    size_t signal_pidfds(size_t n, const int pidfd[], int sig);
+    size_t wait_pidfds(size_t n, int pidfd[], TimeValuePtr timeout);
+    void close_pidfds(size_t n, int pidfd[]);
     int wait_input(fd_set * input_set, fd_set * err_set, TimeValuePtr tv,
                    size_t n_fd, int fd[]);
     const char *path_basename(const char *path);
@@ -22,8 +31,11 @@ extern "C"
     int make_path(const char *path);
     int link_path(const char *src, const char *dst);
     const char *resolve_path(const char *paths[], const char *file);
+    int open_path_fd(const char *paths[], const char *base, int flags,
+                     mode_t mode);
     FILE *open_path(const char *paths[], const char *base, const char *mode);
     FILE *open_env_path(const char *env, const char *base, const char *mode);
+    void path_cache_clear(void);
     int touch(const char *path);
 #ifdef __cplusplus
 }
@@ -0,0 +1,307 @@
+/*
+ * BENCH.C --Microbenchmarks, reported alongside TAP.
+ *
+ * Contents:
+ * BenchState       --The configuration of a benchmark program.
+ * bench_init_()    --Read the benchmark configuration from the environment.
+ * bench_clock_ns() --Return a monotonic time in nanoseconds.
+ * bench_time_()    --Time one run of a benchmark.
+ * bench_calibrate_() --Warm up a benchmark, and choose its No. of iterations.
+ * double_cmp_()    --Compare two doubles for qsort().
+ * bench_emit_()    --Print a benchmark's result.
+ * bench_plan()     --Plan to run some benchmarks.
+ * bench_run()      --Run a benchmark, and report its timings.
+ * bench_run_bytes() --Run a benchmark, and report its timings and throughput.
+ * bench_done()     --Finish a benchmark program.
+ * bench_sink_()    --An opaque function, for compilers without asm.
+ *
+ * Remarks:
+ * The environment variables APEX_BENCH_SAMPLES and APEX_BENCH_SAMPLE_MS
+ * change the No. of samples and the (minimum) time of each, and
+ * APEX_BENCH_FORMAT=json selects JSON output.  Like the TAP routines,
+ * this doesn't malloc; the samples are kept in a static array.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/bench.h>
+
+/*
+ * BenchState --The configuration of a benchmark program.
+ */
+typedef struct BenchState_t
+{
+    int initialised;
+    int json;                          /* print JSON, not TAP */
+    int n_sample;
+    uint64_t sample_ns;                /* minimum time of one sample */
+    int n_fail;
+    double sample[BENCH_SAMPLES_MAX];  /* time per operation (ns) */
+} BenchState;
+
+static BenchState bench;
+
+/*
+ * bench_init_() --Read the benchmark configuration from the environment.
+ */
+static void bench_init_(void)
+{
+    const char *env;
+
+    if (bench.initialised)
+    {
+        return;
+    }
+    bench.initialised = 1;
+    bench.n_sample = BENCH_SAMPLES;
+    bench.sample_ns = BENCH_SAMPLE_MS * 1000000ull;
+
+    if ((env = getenv("APEX_BENCH_SAMPLES")) != NULL && atoi(env) > 0)
+    {
+        bench.n_sample = MIN(atoi(env), BENCH_SAMPLES_MAX);
+    }
+    if ((env = getenv("APEX_BENCH_SAMPLE_MS")) != NULL && atoi(env) > 0)
+    {
+        bench.sample_ns = (uint64_t) atoi(env) * 1000000ull;
+    }
+    if ((env = getenv("APEX_BENCH_FORMAT")) != NULL
+        && strcmp(env, "json") == 0)
+    {
+        bench.json = 1;
+    }
+}
+
+/*
+ * bench_clock_ns() --Return a monotonic time in nanoseconds.
+ */
+uint64_t bench_clock_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+/*
+ * bench_time_() --Time one run of a benchmark.
+ *
+ * Returns: (uint64_t)
+ * The elapsed time of proc(data, n_iter), in nanoseconds.
+ */
+static uint64_t bench_time_(BenchProc proc, void *data, size_t n_iter)
+{
+    uint64_t start = bench_clock_ns();
+
+    proc(data, n_iter);
+    clobber_memory();
+    return bench_clock_ns() - start;
+}
+
+/*
+ * bench_calibrate_() --Warm up a benchmark, and choose its No. of iterations.
+ *
+ * Returns: (size_t)
+ * The No. of iterations that makes one sample take at least sample_ns.
+ *
+ * Remarks:
+ * The benchmark is run with a growing No. of iterations until it
+ * has been running for the warm-up time (so that caches, branch
+ * predictors and the CPU's clock have settled) and a run takes
+ * at least sample_ns.  The growth is estimated from the last run,
+ * but clamped to 10x to recover from a run that was "too quick"
+ * to be measured.
+ */
+static size_t bench_calibrate_(BenchProc proc, void *data)
+{
+    uint64_t warmup_ns = BENCH_WARMUP_MS * 1000000ull;
+    uint64_t start = bench_clock_ns();
+    size_t n_iter = 1;
+
+    for (;;)
+    {
+        uint64_t t = bench_time_(proc, data, n_iter);
+
+        if (t >= bench.sample_ns && bench_clock_ns() - start >= warmup_ns)
+        {
+            return n_iter;
+        }
+        if (t < bench.sample_ns)
+        {
+            double scale = t > 0 ? 1.2 * bench.sample_ns / t : 10.0;
+
+            n_iter = (size_t) (n_iter * MIN(MAX(scale, 2.0), 10.0));
+        }
+    }
+}
+
+/*
+ * double_cmp_() --Compare two doubles for qsort().
+ */
+static int double_cmp_(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * bench_emit_() --Print a benchmark's result.
+ */
+static void bench_emit_(const BenchResult * result)
+{
+    if (bench.json)
+    {
+        printf("{\"name\": \"%s\", \"n_iter\": %zu, \"n_sample\": %d, "
+               "\"min_ns\": %.3f, \"median_ns\": %.3f, \"p99_ns\": %.3f, "
+               "\"mean_ns\": %.3f, \"ops_per_sec\": %.0f, "
+               "\"n_bytes\": %zu, \"mb_per_sec\": %.3f}\n",
+               result->name, result->n_iter, result->n_sample,
+               result->min_ns, result->median_ns, result->p99_ns,
+               result->mean_ns, result->ops_per_sec, result->n_bytes,
+               result->mb_per_sec);
+        fflush(stdout);
+        return;
+    }
+    if (result->n_bytes != 0)
+    {
+        ok(1, "%s: %.1f MB/s, %.3g op/s (%.2f ns/op, p99 %.2f)",
+           result->name, result->mb_per_sec, result->ops_per_sec,
+           result->median_ns, result->p99_ns);
+    }
+    else
+    {
+        ok(1, "%s: %.2f ns/op (min %.2f, p99 %.2f), %.3g op/s",
+           result->name, result->median_ns, result->min_ns, result->p99_ns,
+           result->ops_per_sec);
+    }
+    diag("    %d samples of %zu iterations", result->n_sample,
+         result->n_iter);
+}
+
+/*
+ * bench_plan() --Plan to run some benchmarks.
+ *
+ * Parameters:
+ * n_bench  --the No. of bench_run() calls to follow
+ *
+ * Remarks:
+ * In TAP mode, each benchmark is a test, so this plans n_bench tests.
+ */
+void bench_plan(int n_bench)
+{
+    bench_init_();
+    if (!bench.json)
+    {
+        plan_tests(n_bench);
+    }
+}
+
+/*
+ * bench_run() --Run a benchmark, and report its timings.
+ *
+ * Parameters:
+ * name     --the benchmark's name (for the report)
+ * proc     --the benchmark procedure
+ * data     --the procedure's context
+ * result   --optionally returns the timings
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The time per operation of each sample is sample time / n_iter,
+ * so the benchmark's own loop overhead is included; keep it small.
+ */
+int bench_run(const char *name, BenchProc proc, void *data,
+              BenchResultPtr result)
+{
+    return bench_run_bytes(name, proc, data, 0, result);
+}
+
+/*
+ * bench_run_bytes() --Run a benchmark, and report its timings and throughput.
+ *
+ * Parameters:
+ * name     --the benchmark's name (for the report)
+ * proc     --the benchmark procedure
+ * data     --the procedure's context
+ * n_bytes  --the (average) No. of bytes processed by one operation
+ * result   --optionally returns the timings
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int bench_run_bytes(const char *name, BenchProc proc, void *data,
+                    size_t n_bytes, BenchResultPtr result)
+{
+    BenchResult local;
+    size_t n_iter;
+    double total = 0.0;
+    int n = 0;
+
+    bench_init_();
+    if (result == NULL)
+    {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->n_bytes = n_bytes;
+
+    if (proc == NULL)
+    {
+        ++bench.n_fail;
+        if (!bench.json)
+        {
+            fail("%s: no benchmark procedure", name);
+        }
+        return 0;
+    }
+
+    n_iter = bench_calibrate_(proc, data);
+    for (n = 0; n < bench.n_sample; ++n)
+    {
+        bench.sample[n] = (double) bench_time_(proc, data, n_iter) / n_iter;
+        total += bench.sample[n];
+    }
+    qsort(bench.sample, (size_t) n, sizeof(bench.sample[0]), double_cmp_);
+
+    result->n_iter = n_iter;
+    result->n_sample = n;
+    result->min_ns = bench.sample[0];
+    result->median_ns = bench.sample[n / 2];
+    result->p99_ns = bench.sample[(99 * n + 99) / 100 - 1];
+    result->mean_ns = total / n;
+    result->ops_per_sec = result->median_ns > 0.0 ?
+        1e9 / result->median_ns : 0.0;
+    result->mb_per_sec = result->ops_per_sec * n_bytes / 1e6;
+    bench_emit_(result);
+    return 1;
+}
+
+/*
+ * bench_done() --Finish a benchmark program.
+ *
+ * Returns: (int)
+ * The program's exit status (0 if all benchmarks ran).
+ */
+int bench_done(void)
+{
+    bench_init_();
+    return bench.json ? bench.n_fail : exit_status();
+}
+
+/*
+ * bench_sink_() --An opaque function, for compilers without asm.
+ */
+void bench_sink_(const void *ptr)
+{
+    static const void *volatile sink;
+
+    sink = ptr;
+    (void) sink;
+}
@@ -0,0 +1,73 @@
+/*
+ * BENCH.H --Definitions for microbenchmarks, reported alongside TAP.
+ *
+ * Contents:
+ * BenchResult_t{}      --The timing statistics of one benchmark.
+ * do_not_optimise()    --Stop the compiler discarding a computed value.
+ * clobber_memory()     --Stop the compiler caching memory across a point.
+ *
+ * Remarks:
+ * A benchmark is a BenchProc that runs its operation n_iter times;
+ * bench_run() warms it up, calibrates n_iter so that one sample takes
+ * a measurable time, and then reports the min/median/p99 time per
+ * operation over a number of samples (and the throughput, if
+ * bench_run_bytes() is told how many bytes an operation processes).
+ * The results are printed as TAP "ok" records (so a bench program
+ * can be run like a test), or as one JSON object per line if
+ * APEX_BENCH_FORMAT=json.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+#if defined(__GNUC__) || defined(__clang__)
+#define do_not_optimise(value_) \
+    __asm__ volatile("" : : "g"(value_) : "memory")
+#define clobber_memory() __asm__ volatile("" : : : "memory")
+#else
+#define do_not_optimise(value_) bench_sink_((const void *) &(value_))
+#define clobber_memory() bench_sink_(NULL)
+#endif                                 /* GNU C */
+
+    enum
+    {
+        BENCH_SAMPLES = 31,            /* default No. of samples */
+        BENCH_SAMPLES_MAX = 1001,
+        BENCH_SAMPLE_MS = 10,          /* default (minimum) sample time */
+        BENCH_WARMUP_MS = 50
+    };
+
+    typedef void (*BenchProc)(void *data, size_t n_iter);
+
+    typedef struct BenchResult_t
+    {
+        const char *name;
+        size_t n_iter;                 /* operations per sample */
+        int n_sample;
+        double min_ns;                 /* time per operation... */
+        double median_ns;
+        double p99_ns;
+        double mean_ns;
+        double ops_per_sec;            /* ...and its median rate */
+        size_t n_bytes;                /* bytes processed per operation */
+        double mb_per_sec;             /* median throughput (if n_bytes) */
+    } BenchResult, *BenchResultPtr;
+
+    void bench_plan(int n_bench);
+    int bench_run(const char *name, BenchProc proc, void *data,
+                  BenchResultPtr result);
+    int bench_run_bytes(const char *name, BenchProc proc, void *data,
+                        size_t n_bytes, BenchResultPtr result);
+    int bench_done(void);
+    uint64_t bench_clock_ns(void);
+    void bench_sink_(const void *ptr);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* BENCH_H */
@@ -1,4 +1,6 @@
 build@array: build@string
+build@array: build@sys
+build@array: build@time
 build@config: build@log
 build@config: build@parse
 build@config: build@string
@@ -8,22 +10,30 @@ build@config: build@time
 build@csv: build@log
 build@csv: build@string
 build@csv: build@symbol
+build@csv: build@sys
 build@csv: build@vector
 build@hash: build@link
+build@hash: build@sys
+build@hash: build@time
 build@link: build@array
 build@log: build@string
 build@log: build@sys
+build@log: build@time
 build@parse: build@array
 build@parse: build@log
 build@parse: build@string
 build@parse: build@symbol
+build@parse: build@sys
 build@parse: build@time
 build@parse: build@vector
 build@protocol: build@log
 build@protocol: build@string
 build@protocol: build@symbol
+build@protocol: build@sys
 build@protocol: build@vector
 build@stately: build@log
+build@stately: build@sys
+build@stately: build@time
 build@symbol: build@log
 build@symbol: build@string
 build@symbol: build@vector
@@ -0,0 +1,217 @@
+/*
+ * TFILE-APPEND.C --Atomic records for TFILEs shared by several writers.
+ *
+ * Contents:
+ * write_all()              --Write a buffer with (normally) one write(2).
+ * create_with_prologue()   --Create a file with its prologue, atomically.
+ * tfile_append_open_()     --Open a TFILE's file for atomic appends.
+ * tfile_append_()          --Append a record with one write(2).
+ * tfile_append_vprintf_()  --Format a record, and append it with one write(2).
+ * tfile_append_close_()    --Append the epilogue, and close the file.
+ *
+ * Remarks:
+ * With TFILE_APPEND, a TFILE writes to an O_APPEND descriptor, with
+ * no stdio buffering: each record is formatted completely, and then
+ * written with a single write(2).  The kernel appends each write
+ * as a unit, so records from any number of processes or threads
+ * (each with their own TFILE) never interleave, and no locking is
+ * needed.  (This holds for local file systems; NFS doesn't support
+ * O_APPEND properly.)
+ *
+ * The prologue must appear exactly once, before any records, so a
+ * new file is created under a temporary name with its prologue
+ * already written, and then link(2)ed into place: whoever wins the
+ * link has created the file; everyone else just opens it.
+ *
+ * Each writer appends the epilogue (as one record) when it closes
+ * the file; with several writers, the file will contain several
+ * epilogues.
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <apex/tfile.h>
+#include <apex/estring.h>
+#include <apex/systools.h>
+#include <apex/date.h>
+#include <apex/log.h>
+
+enum
+{
+    RECORD_MAX = 4096                  /* (formatted on the stack) */
+};
+
+/*
+ * write_all() --Write a buffer with (normally) one write(2).
+ *
+ * Returns: (ssize_t)
+ * Success: n; Failure: -1.
+ *
+ * Remarks:
+ * A short write (e.g. a full disk) is continued, although the
+ * record is then no longer atomic.
+ */
+static ssize_t write_all(int fd, const void *buf, size_t n)
+{
+    const char *ptr = buf;
+    size_t n_left = n;
+
+    while (n_left > 0)
+    {
+        ssize_t nw = write(fd, ptr, n_left);
+
+        if (nw < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        n_left -= (size_t) nw;
+        ptr += nw;
+    }
+    return (ssize_t) n;
+}
+
+/*
+ * create_with_prologue() --Create a file with its prologue, atomically.
+ *
+ * Returns: (int)
+ * Success: 1 (created, or already exists); Failure: 0.
+ */
+static int create_with_prologue(TFILE * tfp, const char *prologue)
+{
+    char tmp_path[FILENAME_MAX + 64];
+    int fd, status = 1;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.%p.tmp", tfp->path,
+             (long) getpid(), (void *) tfp);
+    if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0666)) < 0)
+    {
+        return 0;
+    }
+    if (write_all(fd, prologue, strlen(prologue)) < 0)
+    {
+        status = 0;
+    }
+    close(fd);
+    if (status && link(tmp_path, tfp->path) != 0 && errno != EEXIST)
+    {
+        status = 0;                    /* error: (e.g. no hard links) */
+    }
+    unlink(tmp_path);
+    return status;
+}
+
+/*
+ * tfile_append_open_() --Open a TFILE's file for atomic appends.
+ *
+ * Returns: (int)
+ * Success: the (O_APPEND) descriptor; Failure: -1.
+ */
+int tfile_append_open_(TFILE * tfp, time_t t)
+{
+    char dir[FILENAME_MAX + 1], prologue[RECORD_MAX];
+    int fd;
+
+    if (!make_path(path_dirname(tfp->path, NEL(dir), dir)))
+    {
+        return -1;
+    }
+    info("opening file \"%s\"", tfp->path);
+    if ((fd = open(tfp->path, O_WRONLY | O_APPEND)) >= 0)
+    {
+        return fd;                     /* (already exists) */
+    }
+    fmt_time(prologue, NEL(prologue), tfp->prologue, t);
+    if (STREMPTY(prologue) || !create_with_prologue(tfp, prologue))
+    {                                  /* (no prologue, or no links) */
+        if ((fd = open(tfp->path, O_WRONLY | O_APPEND | O_CREAT | O_EXCL,
+                       0666)) >= 0)
+        {
+            write_all(fd, prologue, strlen(prologue));
+            return fd;
+        }
+    }
+    if ((fd = open(tfp->path, O_WRONLY | O_APPEND)) < 0)
+    {
+        log_sys(LOG_ERR, "cannot open file \"%s\"", tfp->path);
+    }
+    return fd;
+}
+
+/*
+ * tfile_append_() --Append a record with one write(2).
+ */
+ssize_t tfile_append_(TFILE * tfp, const void *buf, size_t n)
+{
+    return write_all(tfp->fd, buf, n);
+}
+
+/*
+ * tfile_append_vprintf_() --Format a record, and append it with one write(2).
+ *
+ * Returns: (int)
+ * Success: the number of characters written; Failure: -1.
+ */
+int tfile_append_vprintf_(TFILE * tfp, const char *fmt, va_list ap)
+{
+    char text[RECORD_MAX], *buf = text;
+    va_list ap2;
+    int n;
+
+    va_copy(ap2, ap);
+    if ((n = vsnprintf(text, sizeof(text), fmt, ap)) >= (int) sizeof(text))
+    {                                  /* (too big for the stack) */
+        if ((buf = malloc((size_t) n + 1)) == NULL)
+        {
+            va_end(ap2);
+            return -1;
+        }
+        vsnprintf(buf, (size_t) n + 1, fmt, ap2);
+    }
+    va_end(ap2);
+    if (n > 0 && write_all(tfp->fd, buf, (size_t) n) < 0)
+    {
+        n = -1;
+    }
+    if (buf != text)
+    {
+        free(buf);
+    }
+    return n;
+}
+
+/*
+ * tfile_append_close_() --Append the epilogue, and close the file.
+ *
+ * Returns: (int)
+ * Success: 0; Failure: EOF.
+ */
+int tfile_append_close_(TFILE * tfp, time_t t)
+{
+    char epilogue[RECORD_MAX];
+    int status = 0;
+
+    info("closing output file \"%s\"", tfp->path);
+    fmt_time(epilogue, NEL(epilogue), tfp->epilogue, t);
+    if (!STREMPTY(epilogue)
+        && write_all(tfp->fd, epilogue, strlen(epilogue)) < 0)
+    {
+        status = EOF;
+    }
+    if (close(tfp->fd) != 0)
+    {
+        status = EOF;
+    }
+    tfp->fd = -1;
+    return status;
+}
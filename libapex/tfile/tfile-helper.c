@@ -0,0 +1,409 @@
+/*
+ * TFILE-HELPER.C --Close, compress and pre-open TFILE files in the background.
+ *
+ * Contents:
+ * tfile_compress_()       --Compress a finished file (replacing it).
+ * close_file()            --Write a file's epilogue, close it, and compress it.
+ * discard_file()          --Close a pre-opened file (removing it, if unused).
+ * open_file()             --Open a file for appending (making its directory).
+ * helper()                --Run the queued jobs: a pthread start proc.
+ * queue_job()             --Queue a job for the helper thread.
+ * tfile_helper_start_()   --Start a TFILE's helper thread.
+ * tfile_helper_stop_()    --Finish a TFILE's queued jobs, and stop its helper.
+ * tfile_retire_()         --Close (and compress) a TFILE's finished file.
+ * tfile_preopen_()        --Open the next interval's file in the background.
+ * tfile_open_()           --Open a TFILE's file (taking a pre-opened one if possible).
+ *
+ * Remarks:
+ * With TFILE_BACKGROUND, rotating to a new file doesn't stall the
+ * writer: the finished file's epilogue, fclose() and (optional)
+ * compression are done by a helper thread, which also opens the
+ * next interval's file (making its directory) ahead of time, so the
+ * writer just swaps it in at the boundary.
+ *
+ * Compression runs gzip(1) or zstd(1) on the finished file (as for
+ * compressed CSV files), replacing it with e.g. "file.gz".
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <apex/tfile.h>
+#include <apex/systools.h>
+#include <apex/log.h>
+
+extern char **environ;
+
+typedef enum TFileJobType
+{
+    JOB_CLOSE,
+    JOB_OPEN
+} TFileJobType;
+
+typedef struct TFileJob_t
+{
+    struct TFileJob_t *next;
+    TFileJobType type;
+    FILE *fp;                          /* (JOB_CLOSE) */
+    char *buf;                         /* fp's stdio buffer, if any */
+    char *epilogue;                    /* (formatted) */
+    char path[FILENAME_MAX];
+} TFileJob;
+
+struct TFileHelper_t
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;               /* a job was queued (or stop) */
+    pthread_cond_t done;               /* a job was finished */
+    TFileJob *head, *tail;
+    const TFileJob *running;           /* the job being run, if any */
+    int stop;
+    const char *compress;
+    FILE *next_fp;                     /* the pre-opened file */
+    char next_path[FILENAME_MAX];
+};
+
+/*
+ * tfile_compress_() --Compress a finished file (replacing it).
+ *
+ * Parameters:
+ * path     --the file to compress
+ * program  --the compressor: "gzip" or "zstd"
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int tfile_compress_(const char *path, const char *program)
+{
+    char *argv[] = { (char *) program, (char *) "-q", (char *) "-f",
+        (char *) path, NULL, NULL
+    };
+    pid_t pid;
+    int status;
+
+    if (strcmp(program, "zstd") == 0)
+    {                                  /* (gzip removes the original) */
+        argv[3] = (char *) "--rm";
+        argv[4] = (char *) path;
+    }
+    if (posix_spawnp(&pid, program, NULL, NULL, argv, environ) != 0)
+    {
+        log_sys(LOG_ERR, "cannot run \"%s\"", program);
+        return 0;
+    }
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return 0;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+ * close_file() --Write a file's epilogue, close it, and compress it.
+ */
+static int close_file(TFileJob * job, const char *compress)
+{
+    int status;
+
+    info("closing output file \"%s\"", job->path);
+    if (job->epilogue != NULL)
+    {
+        fputs(job->epilogue, job->fp);
+    }
+    status = fclose(job->fp);
+    if (compress != NULL)
+    {
+        tfile_compress_(job->path, compress);
+    }
+    return status;
+}
+
+/*
+ * discard_file() --Close a pre-opened file (removing it, if unused).
+ */
+static void discard_file(FILE * fp, const char *path)
+{
+    struct stat stat_buf;
+
+    if (fstat(fileno(fp), &stat_buf) == 0 && stat_buf.st_size == 0)
+    {
+        unlink(path);                  /* (we probably created it) */
+    }
+    fclose(fp);
+}
+
+/*
+ * open_file() --Open a file for appending (making its directory).
+ */
+static FILE *open_file(const char *path)
+{
+    char dir[FILENAME_MAX + 1];
+    FILE *fp = NULL;
+
+    if (make_path(path_dirname(path, NEL(dir), dir)))
+    {
+        info("opening file \"%s\"", path);
+        if ((fp = fopen(path, "a")) == NULL)
+        {
+            log_sys(LOG_ERR, "cannot open file \"%s\"", path);
+        }
+    }
+    return fp;
+}
+
+/*
+ * helper() --Run the queued jobs: a pthread start proc.
+ */
+static void *helper(void *data)
+{
+    TFileHelper *h = data;
+
+    pthread_mutex_lock(&h->lock);
+    for (;;)
+    {
+        TFileJob *job;
+        FILE *fp;
+
+        while (h->head == NULL && !h->stop)
+        {
+            pthread_cond_wait(&h->wake, &h->lock);
+        }
+        if ((job = h->head) == NULL)
+        {
+            break;                     /* stopped, and idle */
+        }
+        h->head = job->next;
+        h->tail = h->head != NULL ? h->tail : NULL;
+        h->running = job;
+        pthread_mutex_unlock(&h->lock);
+
+        if (job->type == JOB_CLOSE)
+        {
+            close_file(job, h->compress);
+            free(job->buf);
+            free(job->epilogue);
+            fp = NULL;
+        }
+        else
+        {
+            fp = open_file(job->path);
+        }
+
+        pthread_mutex_lock(&h->lock);
+        if (fp != NULL)
+        {
+            if (h->next_fp != NULL)
+            {                          /* (an unclaimed earlier one) */
+                discard_file(h->next_fp, h->next_path);
+            }
+            h->next_fp = fp;
+            strcpy(h->next_path, job->path);
+        }
+        free(job);
+        h->running = NULL;
+        pthread_cond_broadcast(&h->done);
+    }
+    pthread_mutex_unlock(&h->lock);
+    return NULL;
+}
+
+/*
+ * queue_job() --Queue a job for the helper thread.
+ */
+static void queue_job(TFileHelper * h, TFileJob * job)
+{
+    pthread_mutex_lock(&h->lock);
+    if (h->tail != NULL)
+    {
+        h->tail->next = job;
+    }
+    else
+    {
+        h->head = job;
+    }
+    h->tail = job;
+    pthread_cond_signal(&h->wake);
+    pthread_mutex_unlock(&h->lock);
+}
+
+/*
+ * tfile_helper_start_() --Start a TFILE's helper thread.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+int tfile_helper_start_(TFILE * tfp)
+{
+    TFileHelper *h = NEW(TFileHelper, 1);
+
+    if (h == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_init(&h->lock, NULL);
+    pthread_cond_init(&h->wake, NULL);
+    pthread_cond_init(&h->done, NULL);
+    h->compress = tfp->opt.compress;
+    if (pthread_create(&h->thread, NULL, helper, h) != 0)
+    {
+        pthread_cond_destroy(&h->done);
+        pthread_cond_destroy(&h->wake);
+        pthread_mutex_destroy(&h->lock);
+        free(h);
+        return 0;
+    }
+    tfp->helper = h;
+    return 1;
+}
+
+/*
+ * tfile_helper_stop_() --Finish a TFILE's queued jobs, and stop its helper.
+ *
+ * Remarks:
+ * Any unclaimed pre-opened file is closed (and removed, if empty).
+ */
+void tfile_helper_stop_(TFILE * tfp)
+{
+    TFileHelper *h = tfp->helper;
+
+    if (h == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&h->lock);
+    h->stop = 1;
+    pthread_cond_signal(&h->wake);
+    pthread_mutex_unlock(&h->lock);
+    pthread_join(h->thread, NULL);
+    if (h->next_fp != NULL)
+    {
+        discard_file(h->next_fp, h->next_path);
+    }
+    pthread_cond_destroy(&h->done);
+    pthread_cond_destroy(&h->wake);
+    pthread_mutex_destroy(&h->lock);
+    free(h);
+    tfp->helper = NULL;
+}
+
+/*
+ * tfile_retire_() --Close (and compress) a TFILE's finished file.
+ *
+ * Parameters:
+ * tfp      --the timestamp file handle
+ * epilogue --the (formatted) epilogue text, or NULL
+ *
+ * Remarks:
+ * With a helper, the file (and its stdio buffer) are handed over to
+ * it, and the TFILE gets a new buffer for the next file; otherwise,
+ * the file's closed (and compressed) here.
+ */
+void tfile_retire_(TFILE * tfp, const char *epilogue)
+{
+    TFileJob *job = NEW(TFileJob, 1);
+
+    if (job == NULL)
+    {
+        return;
+    }
+    job->type = JOB_CLOSE;
+    job->fp = tfp->fp;
+    job->epilogue = epilogue != NULL ? strdup(epilogue) : NULL;
+    strcpy(job->path, tfp->path);
+    tfp->fp = NULL;
+    if (tfp->helper == NULL
+        || (tfp->buf != NULL
+            && (job->buf = malloc(tfp->opt.buf_size)) == NULL))
+    {
+        close_file(job, tfp->opt.compress);
+        free(job->buf);
+        free(job->epilogue);
+        free(job);
+        return;
+    }
+    if (tfp->buf != NULL)
+    {                                  /* (swap: fp keeps its buffer) */
+        char *buf = tfp->buf;
+
+        tfp->buf = job->buf;
+        job->buf = buf;
+    }
+    queue_job(tfp->helper, job);
+}
+
+/*
+ * tfile_preopen_() --Open the next interval's file in the background.
+ */
+void tfile_preopen_(TFILE * tfp, const char *path)
+{
+    TFileJob *job;
+
+    if (tfp->helper != NULL && (job = NEW(TFileJob, 1)) != NULL)
+    {
+        job->type = JOB_OPEN;
+        strncpy(job->path, path, NEL(job->path) - 1);
+        queue_job(tfp->helper, job);
+    }
+}
+
+/*
+ * tfile_open_() --Open a TFILE's file (taking a pre-opened one if possible).
+ *
+ * Returns: (FILE *)
+ * Success: the open file; Failure: NULL.
+ *
+ * Remarks:
+ * If the helper is still opening this path, this waits for it
+ * (rather than opening the file twice).
+ */
+FILE *tfile_open_(TFILE * tfp)
+{
+    TFileHelper *h = tfp->helper;
+    FILE *fp = NULL;
+
+    if (h != NULL)
+    {
+        pthread_mutex_lock(&h->lock);
+        for (;;)
+        {
+            int pending = h->running != NULL
+                && h->running->type == JOB_OPEN
+                && strcmp(h->running->path, tfp->path) == 0;
+
+            if (h->next_fp != NULL && strcmp(h->next_path, tfp->path) == 0)
+            {
+                fp = h->next_fp;
+                h->next_fp = NULL;
+                break;
+            }
+            for (TFileJob * job = h->head; job != NULL; job = job->next)
+            {
+                pending |= job->type == JOB_OPEN
+                    && strcmp(job->path, tfp->path) == 0;
+            }
+            if (!pending)
+            {
+                break;
+            }
+            pthread_cond_wait(&h->done, &h->lock);
+        }
+        pthread_mutex_unlock(&h->lock);
+        if (fp != NULL)
+        {
+            return fp;
+        }
+    }
+    return open_file(tfp->path);
+}
@@ -0,0 +1,302 @@
+/*
+ * TFILE-MMAP.C --Write a TFILE's records into a memory-mapped file.
+ *
+ * Contents:
+ * preallocate()           --Extend a file's allocated (and visible) size.
+ * map_file()              --(re)map a TFILE's file, at its allocated size.
+ * grow()                  --Extend a TFILE's mapping to fit n more bytes.
+ * data_end()              --Find the end of the data in a (mapped) file.
+ * tfile_mmap_open_()      --Open and map a TFILE's file.
+ * tfile_mmap_write_()     --Append a record to the mapped file.
+ * tfile_mmap_vprintf_()   --Format a record directly into the mapped file.
+ * tfile_mmap_sync_()      --msync(2) the records written since the last sync.
+ * tfile_mmap_close_()     --Write the epilogue, truncate, and unmap the file.
+ *
+ * Remarks:
+ * With TFILE_MMAP, a TFILE preallocates its file in map_size chunks
+ * (posix_fallocate(3), or ftruncate(2) where that's not supported),
+ * maps it, and appends records with memcpy(): there's no stdio, and
+ * no system call per record (or per buffer-full).  When the file
+ * is closed (by tfclose(), or by rotation) it's unmapped and
+ * truncated to the length actually written.
+ *
+ * The kernel writes the dirty pages back in its own time; the
+ * flush_interval option (and tfflush()) msync(2) the new records
+ * explicitly.
+ *
+ * If the process dies without closing the file, it's left with
+ * zero padding at the end; this is trimmed when the file is
+ * re-opened (so records shouldn't end with NUL bytes).
+ */
+#include <apex.h>                       /* Windows_NT requires this before system headers */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <apex/tfile.h>
+#include <apex/estring.h>
+#include <apex/systools.h>
+#include <apex/date.h>
+#include <apex/log.h>
+
+enum
+{
+    TEXT_MAX = 4096,                   /* max 4K prologue/epilogue */
+    MAP_SIZE = 64 * 1024 * 1024        /* default preallocation chunk */
+};
+
+/*
+ * preallocate() --Extend a file's allocated (and visible) size.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int preallocate(int fd, off_t offset, off_t len)
+{
+    int status = posix_fallocate(fd, offset, len);
+
+    if (status == EINVAL || status == EOPNOTSUPP)
+    {                                  /* (e.g. tmpfs, or NFS) */
+        status = ftruncate(fd, offset + len) == 0 ? 0 : errno;
+    }
+    errno = status;
+    return status == 0;
+}
+
+/*
+ * map_file() --(re)map a TFILE's file, at its allocated size.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int map_file(TFILE * tfp, size_t map_len)
+{
+    void *map;
+
+    if (tfp->map != NULL)
+    {
+        munmap(tfp->map, tfp->map_len);
+        tfp->map = NULL;
+    }
+    map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, tfp->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        log_sys(LOG_ERR, "cannot map file \"%s\"", tfp->path);
+        return 0;
+    }
+    tfp->map = map;
+    tfp->map_len = map_len;
+    return 1;
+}
+
+/*
+ * grow() --Extend a TFILE's mapping to fit n more bytes.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ */
+static int grow(TFILE * tfp, size_t n)
+{
+    size_t chunk = tfp->opt.map_size > 0 ? tfp->opt.map_size : MAP_SIZE;
+    size_t map_len = tfp->map_len;
+
+    while (map_len < tfp->map_used + n)
+    {
+        map_len += chunk;
+    }
+    if (!preallocate(tfp->fd, (off_t) tfp->map_len,
+                     (off_t) (map_len - tfp->map_len)))
+    {
+        log_sys(LOG_ERR, "cannot extend file \"%s\"", tfp->path);
+        return 0;
+    }
+    return map_file(tfp, map_len);
+}
+
+/*
+ * data_end() --Find the end of the data in a (mapped) file.
+ *
+ * Remarks:
+ * This skips back over any preallocated (zero) bytes, left by a
+ * writer that didn't close the file.
+ */
+static size_t data_end(const TFILE * tfp, size_t size)
+{
+    while (size > 0 && tfp->map[size - 1] == '\0')
+    {
+        --size;
+    }
+    return size;
+}
+
+/*
+ * tfile_mmap_open_() --Open and map a TFILE's file.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * The prologue is written if the file is new (or empty).
+ */
+int tfile_mmap_open_(TFILE * tfp, time_t t)
+{
+    char dir[FILENAME_MAX + 1], prologue[TEXT_MAX];
+    struct stat stat_buf;
+
+    if (!make_path(path_dirname(tfp->path, NEL(dir), dir)))
+    {
+        return 0;
+    }
+    info("opening file \"%s\"", tfp->path);
+    if ((tfp->fd = open(tfp->path, O_RDWR | O_CREAT, 0666)) < 0)
+    {
+        log_sys(LOG_ERR, "cannot open file \"%s\"", tfp->path);
+        return 0;
+    }
+    tfp->map_used = 0;
+    if (fstat(tfp->fd, &stat_buf) == 0 && stat_buf.st_size > 0)
+    {
+        if (!map_file(tfp, (size_t) stat_buf.st_size))
+        {
+            close(tfp->fd);
+            tfp->fd = -1;
+            return 0;
+        }
+        tfp->map_used = data_end(tfp, tfp->map_len);
+    }
+    if (tfp->map_used == tfp->map_len && !grow(tfp, 1))
+    {
+        if (tfp->map != NULL)
+        {
+            munmap(tfp->map, tfp->map_len);
+            tfp->map = NULL;
+        }
+        close(tfp->fd);
+        tfp->fd = -1;
+        return 0;
+    }
+    tfp->map_synced = tfp->map_used;
+    if (tfp->map_used == 0)
+    {
+        fmt_time(prologue, NEL(prologue), tfp->prologue, t);
+        tfile_mmap_write_(tfp, prologue, strlen(prologue));
+    }
+    return 1;
+}
+
+/*
+ * tfile_mmap_write_() --Append a record to the mapped file.
+ *
+ * Returns: (ssize_t)
+ * Success: n; Failure: -1.
+ */
+ssize_t tfile_mmap_write_(TFILE * tfp, const void *buf, size_t n)
+{
+    if (tfp->map_used + n > tfp->map_len && !grow(tfp, n))
+    {
+        return -1;
+    }
+    memcpy(tfp->map + tfp->map_used, buf, n);
+    tfp->map_used += n;
+    return (ssize_t) n;
+}
+
+/*
+ * tfile_mmap_vprintf_() --Format a record directly into the mapped file.
+ *
+ * Returns: (int)
+ * Success: the number of characters written; Failure: -1.
+ *
+ * Remarks:
+ * The record is formatted in place; if it doesn't fit, the mapping
+ * is extended and it's formatted again.
+ */
+int tfile_mmap_vprintf_(TFILE * tfp, const char *fmt, va_list ap)
+{
+    size_t n_left = tfp->map_len - tfp->map_used;
+    va_list ap2;
+    int n;
+
+    va_copy(ap2, ap);
+    n = vsnprintf(tfp->map + tfp->map_used, n_left, fmt, ap);
+    if (n >= 0 && (size_t) n >= n_left)
+    {                                  /* (+1: vsnprintf()'s NUL) */
+        if (!grow(tfp, (size_t) n + 1))
+        {
+            va_end(ap2);
+            return -1;
+        }
+        n = vsnprintf(tfp->map + tfp->map_used, (size_t) n + 1, fmt, ap2);
+    }
+    va_end(ap2);
+    if (n > 0)
+    {                                  /* (the NUL is overwritten next time) */
+        tfp->map_used += (size_t) n;
+    }
+    return n;
+}
+
+/*
+ * tfile_mmap_sync_() --msync(2) the records written since the last sync.
+ *
+ * Returns: (int)
+ * Success: 0; Failure: EOF.
+ */
+int tfile_mmap_sync_(TFILE * tfp)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start = tfp->map_synced / page * page;
+
+    if (tfp->map == NULL || tfp->map_used == tfp->map_synced)
+    {
+        return 0;
+    }
+    if (msync(tfp->map + start, tfp->map_used - start, MS_SYNC) != 0)
+    {
+        return EOF;
+    }
+    tfp->map_synced = tfp->map_used;
+    return 0;
+}
+
+/*
+ * tfile_mmap_close_() --Write the epilogue, truncate, and unmap the file.
+ *
+ * Returns: (int)
+ * Success: 0; Failure: EOF.
+ */
+int tfile_mmap_close_(TFILE * tfp, time_t t)
+{
+    char epilogue[TEXT_MAX];
+    int status = 0;
+
+    info("closing output file \"%s\"", tfp->path);
+    if (tfp->map != NULL)
+    {
+        fmt_time(epilogue, NEL(epilogue), tfp->epilogue, t);
+        if (!STREMPTY(epilogue)
+            && tfile_mmap_write_(tfp, epilogue, strlen(epilogue)) < 0)
+        {
+            status = EOF;
+        }
+        munmap(tfp->map, tfp->map_len);
+        tfp->map = NULL;
+        tfp->map_len = 0;
+    }
+    if (ftruncate(tfp->fd, (off_t) tfp->map_used) != 0)
+    {
+        status = EOF;
+    }
+    if (close(tfp->fd) != 0)
+    {
+        status = EOF;
+    }
+    tfp->fd = -1;
+    return status;
+}
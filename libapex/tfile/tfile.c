@@ -3,14 +3,22 @@
  *
  * Contents:
  * tfopen()         --Open a timestamp-named file.
+ * tfopen_opt()     --Open a timestamp-named file, with buffering options.
  * tfwrite()        --Write some bytes to a timestamp file.
  * tfwrite_time()   --Write a strftime template to a timestamp file.
  * tfprintf()       --Write some formatted text to a timestamp file.
+ * tfflush()        --Flush a timestamp file's buffered output.
  * tfclose()        --Close a timestamp file.
  * new_tfile()      --Allocate the resources for a TFILE structure.
  * free_tfile()     --Free the resources associated with a TFILE structure.
  * write_template() --Write some timestamp-templated text to a file.
+ * template_unit()  --Find the finest time unit that a name template uses.
+ * set_window()     --Find the time window [start, end) of the current path.
+ * flush_gate_()    --Flush the output if the flush interval has passed.
+ * set_buffer()     --Set an output file's buffering, per the TFILE's options.
  * reopen_tfile_()  --(re)open a timestamp-named file.
+ * tfile_collect()  --Report a timestamp file's statistics as metrics.
+ * tfile_metrics()  --Register a timestamp file's statistics as metrics.
  *
  * Remarks:
  * This module extends the API for writing files to allow the name of
@@ -29,14 +37,21 @@
  * so they will be expanded with the timestamp provided by the
  * tfwrite().
  *
- * The file is always opened in "append" mode, and is set to be
- * line-buffered.
+ * The file is always opened in "append" mode, and is (by default)
+ * line-buffered.  tfopen_opt() can instead make it fully buffered
+ * (so records are written in batches, not one write(2) each), and
+ * optionally flushed when the record time passes a flush interval.
+ *
+ * The path's time window (e.g. the day, for a daily file name) is
+ * cached, so the name template is only re-expanded (and the path
+ * compared) when a write's timestamp falls outside it.
  *
  */
 #include <apex.h>                       /* Windows_NT requires this before system headers */
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <libgen.h>
 
 #include <apex/tfile.h>
@@ -45,7 +60,6 @@
 #include <apex/date.h>
 #include <apex/log.h>
 
-
 enum TfileConsts
 {
     TEXT_MAX = 4096,                   /* max 4K text per write */
@@ -56,7 +70,19 @@ static TFILE *new_tfile(const char *name_template,
 static void free_tfile(TFILE * tfp);
 static size_t write_template(const char *record_template, FILE * fp,
                              time_t t);
-static FILE *reopen_tfile_(TFILE * tfp, time_t t);
+static int reopen_tfile_(TFILE * tfp, time_t t);
+static void flush_gate_(TFILE * tfp, time_t t);
+
+enum TimeUnit
+{                                      /* (coarsest last) */
+    UNIT_SECOND,
+    UNIT_MINUTE,
+    UNIT_HOUR,
+    UNIT_DAY,
+    UNIT_MONTH,
+    UNIT_YEAR,
+    UNIT_NONE                          /* no time conversions */
+};
 
 /*
  * tfopen() --Open a timestamp-named file.
@@ -72,16 +98,82 @@ static FILE *reopen_tfile_(TFILE * tfp, time_t t);
  */
 TFILE *tfopen(const char *name_template, time_t t,
               const char *prologue, const char *epilogue)
+{
+    return tfopen_opt(name_template, t, prologue, epilogue, NULL);
+}
+
+/*
+ * tfopen_opt() --Open a timestamp-named file, with buffering options.
+ *
+ * Parameters:
+ * name_template --the strftime(3) template used to generate the filename
+ * t        --the timestamp used to expand the template
+ * prologue --a prologue (template!) that is written when opening a file
+ * epilogue --a epilogue (template!) that is written when closing a file
+ * opt      --the buffering options (NULL: line-buffered)
+ *
+ * Return: (TFILE *)
+ * Success: the TFILE structure; Failure: NULL.
+ *
+ * Remarks:
+ * With a buf_size, output is written when the buffer fills (and
+ * when the file rotates, or is flushed or closed); with a
+ * flush_interval too, it's also flushed by the first write whose
+ * timestamp is flush_interval seconds past the last flush.  Note
+ * that this is only checked when writing: a quiet file stays
+ * buffered until tfflush() is called.
+ *
+ * With TFILE_BACKGROUND, finished files are closed (and compressed)
+ * by a helper thread, which also pre-opens the next interval's file
+ * (see tfile-helper.c).  With compress, files are compressed when
+ * the TFILE rotates away from them (but not by tfclose(), since the
+ * interval may not be finished).
+ *
+ * With TFILE_APPEND, each record is written with one write(2) on an
+ * O_APPEND descriptor, so several writers (processes or threads,
+ * each with their own TFILE) can share the file without their
+ * records interleaving (see tfile-append.c).  buf_size and
+ * flush_interval don't apply, and TFILE_BACKGROUND and compress are
+ * ignored (other writers may still be appending to a finished file).
+ *
+ * With TFILE_MMAP, the file is preallocated in map_size chunks and
+ * mapped, and records are copied into it (see tfile-mmap.c).  It's
+ * truncated to its real length when it's closed; flush_interval
+ * msync(2)s it.  buf_size and TFILE_BACKGROUND don't apply (and
+ * TFILE_APPEND takes precedence).
+ */
+TFILE *tfopen_opt(const char *name_template, time_t t,
+                  const char *prologue, const char *epilogue,
+                  const TFileOptions * opt)
 {
     TFILE *tfp = NULL;
 
     if ((tfp = new_tfile(name_template, prologue, epilogue)) != NULL)
     {
+        if (opt != NULL)
+        {
+            tfp->opt = *opt;
+            if (opt->buf_size > 0
+                && (tfp->buf = malloc(opt->buf_size)) == NULL)
+            {
+                free_tfile(tfp);
+                return (TFILE *) NULL;
+            }
+        }
+        if ((tfp->opt.flags & TFILE_BACKGROUND)
+            && !(tfp->opt.flags & (TFILE_APPEND | TFILE_MMAP))
+            && !tfile_helper_start_(tfp))
+        {
+            free_tfile(tfp);
+            return (TFILE *) NULL;
+        }
         if (!reopen_tfile_(tfp, t))
         {
+            tfile_helper_stop_(tfp);
             free_tfile(tfp);
             return (TFILE *) NULL;
         }
+        tfp->flushed = t != 0 ? t : time(NULL);
     }
     return tfp;
 }
@@ -94,7 +186,22 @@ size_t tfwrite(const void *ptr, size_t size, size_t nitems,
 {
     if (reopen_tfile_(tfp, t))
     {
-        return fwrite(ptr, size, nitems, tfp->fp);
+        size_t n;
+
+        ATOMIC_ADD_RELAXED(&tfp->n_record, 1);
+        if (tfp->map != NULL)
+        {
+            n = tfile_mmap_write_(tfp, ptr, size * nitems) < 0 ? 0 : nitems;
+            flush_gate_(tfp, t);
+            return n;
+        }
+        if (tfp->fd >= 0)
+        {                              /* (one record: one write) */
+            return tfile_append_(tfp, ptr, size * nitems) < 0 ? 0 : nitems;
+        }
+        n = fwrite(ptr, size, nitems, tfp->fp);
+        flush_gate_(tfp, t);
+        return n;
     }
     return 0;                          /* error: no file open!? */
 }
@@ -106,7 +213,27 @@ size_t tfwrite_time(const char *record_template, TFILE * tfp, time_t t)
 {
     if (reopen_tfile_(tfp, t) && record_template != NULL)
     {
-        return write_template(record_template, tfp->fp, t);
+        size_t n;
+
+        ATOMIC_ADD_RELAXED(&tfp->n_record, 1);
+        if (tfp->fd >= 0)
+        {
+            char text[TEXT_MAX];
+
+            fmt_time(text, NEL(text), record_template, t);
+            if (tfp->map == NULL)
+            {
+                return tfile_append_(tfp, text, strlen(text)) < 0 ? 0 : 1;
+            }
+            n = tfile_mmap_write_(tfp, text, strlen(text)) < 0 ? 0 : 1;
+        }
+        else
+        {
+            n = write_template(record_template, tfp->fp, t);
+        }
+
+        flush_gate_(tfp, t);
+        return n;
     }
     return 0;                          /* error: no file open!? */
 }
@@ -121,13 +248,33 @@ int tfprintf(TFILE * tfp, time_t t, const char *fmt, ...)
 
     if (reopen_tfile_(tfp, t))
     {
+        ATOMIC_ADD_RELAXED(&tfp->n_record, 1);
         va_start(ap, fmt);
-        nchar = vfprintf(tfp->fp, fmt, ap);
+        nchar = (tfp->map != NULL) ? tfile_mmap_vprintf_(tfp, fmt, ap)
+            : (tfp->fd >= 0) ? tfile_append_vprintf_(tfp, fmt, ap)
+            : vfprintf(tfp->fp, fmt, ap);
         va_end(ap);
+        flush_gate_(tfp, t);
     }
     return nchar;
 }
 
+/*
+ * tfflush() --Flush a timestamp file's buffered output.
+ *
+ * Returns: (int)
+ * Success: 0; Failure: EOF (i.e. same as fflush(3))
+ */
+int tfflush(TFILE * tfp)
+{
+    tfp->flushed = time(NULL);
+    if (tfp->map != NULL)
+    {
+        return tfile_mmap_sync_(tfp);
+    }
+    return tfp->fp != NULL ? fflush(tfp->fp) : 0;
+}
+
 /*
  * tfclose() --Close a timestamp file.
  *
@@ -145,6 +292,14 @@ int tfclose(TFILE * tfp, time_t t)
 {
     int status;
 
+    tfile_helper_stop_(tfp);           /* (finish rotations first) */
+    if (tfp->fd >= 0)
+    {
+        status = (tfp->map != NULL) ? tfile_mmap_close_(tfp, t)
+            : tfile_append_close_(tfp, t);
+        free_tfile(tfp);
+        return status;
+    }
     info("closing output file \"%s\"", tfp->path);
     (void) write_template(tfp->epilogue, tfp->fp, t);
     status = fclose(tfp->fp);
@@ -163,6 +318,7 @@ static TFILE *new_tfile(const char *name_template,
 
     if ((tfp = calloc(1, sizeof(TFILE))) != NULL)
     {
+        tfp->fd = -1;
         tfp->name_template = empty_str;
         if (name_template != NULL)
         {
@@ -199,6 +355,7 @@ static void free_tfile(TFILE * tfp)
     {
         free((void *) tfp->epilogue);
     }
+    free(tfp->buf);
     free(tfp);
 }
 
@@ -234,6 +391,197 @@ static size_t write_template(const char *record_template, FILE * fp, time_t t)
     return fwrite(text, strlen(text), 1, fp);
 }
 
+/*
+ * template_unit() --Find the finest time unit that a name template uses.
+ *
+ * Remarks:
+ * e.g. "log-%Y-%m-%d" changes daily, "log-%Y%m%d%H" hourly.
+ * Conversions that aren't recognised are assumed to change every
+ * second (which is safe, if not very useful).
+ */
+static enum TimeUnit template_unit(const char *name_template)
+{
+    enum TimeUnit unit = UNIT_NONE, u;
+
+    for (const char *s = strchr(name_template, '%'); s != NULL;
+         s = strchr(s, '%'))
+    {
+        ++s;
+        while (*s == 'E' || *s == 'O' || *s == '_' || *s == '-'
+               || *s == '0' || *s == '^' || *s == '#')
+        {
+            ++s;                       /* skip modifiers/flags */
+        }
+        if (*s == '\0')
+        {
+            break;
+        }
+        switch (*s++)
+        {
+        case '%':
+        case 'n':
+        case 't':
+            continue;                  /* (not a time) */
+        case 'Y':
+        case 'y':
+        case 'C':
+            u = UNIT_YEAR;
+            break;
+        case 'm':
+        case 'b':
+        case 'B':
+        case 'h':
+            u = UNIT_MONTH;
+            break;
+        case 'd':
+        case 'e':
+        case 'j':
+        case 'a':
+        case 'A':
+        case 'u':
+        case 'w':
+        case 'U':
+        case 'W':
+        case 'V':
+        case 'G':
+        case 'g':
+        case 'D':
+        case 'F':
+        case 'x':
+            u = UNIT_DAY;
+            break;
+        case 'H':
+        case 'I':
+        case 'k':
+        case 'l':
+        case 'p':
+        case 'P':
+            u = UNIT_HOUR;
+            break;
+        case 'M':
+        case 'R':
+            u = UNIT_MINUTE;
+            break;
+        default:
+            u = UNIT_SECOND;
+            break;
+        }
+        unit = MIN(unit, u);
+    }
+    return unit;
+}
+
+/*
+ * set_window() --Find the time window [start, end) of the current path.
+ *
+ * Remarks:
+ * The window is the name template's finest time unit containing t
+ * (in local time, as for fmt_time()), so every timestamp in it
+ * expands to the same path.  If mktime(3) gets confused (e.g. by a
+ * DST change), the window is just the second containing t.
+ */
+static void set_window(TFILE * tfp, time_t t)
+{
+    enum TimeUnit unit = template_unit(tfp->name_template);
+    struct tm tm;
+
+    if (unit == UNIT_NONE)
+    {
+        tfp->start = t;
+        tfp->end = t + 1;              /* (odd, but "%%" is a template) */
+        return;
+    }
+    date_localtime(t, &tm);
+    switch (unit)
+    {
+    case UNIT_YEAR:
+        tm.tm_mon = 0;                 /* FALLTHROUGH */
+    case UNIT_MONTH:
+        tm.tm_mday = 1;                /* FALLTHROUGH */
+    case UNIT_DAY:
+        tm.tm_hour = 0;                /* FALLTHROUGH */
+    case UNIT_HOUR:
+        tm.tm_min = 0;                 /* FALLTHROUGH */
+    case UNIT_MINUTE:
+        tm.tm_sec = 0;                 /* FALLTHROUGH */
+    default:
+        break;
+    }
+    tm.tm_isdst = -1;
+    tfp->start = mktime(&tm);
+    switch (unit)
+    {
+    case UNIT_YEAR:
+        tm.tm_year += 1;
+        break;
+    case UNIT_MONTH:
+        tm.tm_mon += 1;
+        break;
+    case UNIT_DAY:
+        tm.tm_mday += 1;
+        break;
+    case UNIT_HOUR:
+        tm.tm_hour += 1;
+        break;
+    case UNIT_MINUTE:
+        tm.tm_min += 1;
+        break;
+    default:
+        tm.tm_sec += 1;
+        break;
+    }
+    tm.tm_isdst = -1;
+    tfp->end = mktime(&tm);
+    if (tfp->start == (time_t) - 1 || tfp->end == (time_t) - 1
+        || t < tfp->start || t >= tfp->end)
+    {
+        tfp->start = t;
+        tfp->end = t + 1;
+    }
+}
+
+/*
+ * flush_gate_() --Flush the output if the flush interval has passed.
+ */
+static void flush_gate_(TFILE * tfp, time_t t)
+{
+    if (tfp->opt.flush_interval > 0
+        && (tfp->fp != NULL || tfp->map != NULL))
+    {
+        if (t == 0)
+        {
+            time(&t);
+        }
+        if (t - tfp->flushed >= tfp->opt.flush_interval)
+        {
+            if (tfp->map != NULL)
+            {
+                tfile_mmap_sync_(tfp);
+            }
+            else
+            {
+                fflush(tfp->fp);
+            }
+            tfp->flushed = t;
+        }
+    }
+}
+
+/*
+ * set_buffer() --Set an output file's buffering, per the TFILE's options.
+ */
+static void set_buffer(TFILE * tfp)
+{
+    if (tfp->buf != NULL)
+    {
+        setvbuf(tfp->fp, tfp->buf, _IOFBF, tfp->opt.buf_size);
+    }
+    else
+    {
+        setlinebuf(tfp->fp);
+    }
+}
+
 /*
  * reopen_tfile_() --(re)open a timestamp-named file.
  *
@@ -241,41 +589,68 @@ static size_t write_template(const char *record_template, FILE * fp, time_t t)
  * tfp  --the timestamp file handle
  * t    --a timestamp that controls the name of the output file.
  *
- * Returns: (FILE *)
- * Success: the open file descriptor; Failure: dies!
+ * Returns: (int)
+ * Success: 1 (the output is open); Failure: 0.
  *
  * Remarks:
  * The output file is specified by a strftime() string that can
  * change at any time.  This routine handles closing and re-opening
- * the file as needed.
+ * the file as needed.  The path is only re-generated when t is
+ * outside the current path's time window.
  */
-static FILE *reopen_tfile_(TFILE * tfp, time_t t)
+static int reopen_tfile_(TFILE * tfp, time_t t)
 {
     char new_path[FILENAME_MAX + 1];
-    char dir[FILENAME_MAX + 1];
+    char text[TEXT_MAX];
 
     if (t == 0)
     {
         time(&t);                      /* default time: now! */
     }
 
-    if (!STREMPTY(tfp->name_template))
+    if (!STREMPTY(tfp->name_template)
+        && ((tfp->fp == NULL && tfp->fd < 0)
+            || t < tfp->start || t >= tfp->end))
     {                                  /* regenerate path */
         fmt_time(new_path, NEL(new_path), tfp->name_template, t);
+        set_window(tfp, t);
         if (strcmp(new_path, tfp->path) != 0)
         {                              /* close output if path changed */
-            if (tfp->fp != NULL && tfp->fp != stdout)
+            if (tfp->map != NULL)
+            {
+                tfile_mmap_close_(tfp, t);
+                if (tfp->opt.compress != NULL)
+                {
+                    tfile_compress_(tfp->path, tfp->opt.compress);
+                }
+            }
+            else if (tfp->fd >= 0)
+            {
+                tfile_append_close_(tfp, t);
+            }
+            else if (tfp->fp != NULL && tfp->fp != stdout)
             {
-                info("closing output file \"%s\"", tfp->path);
-                write_template(tfp->epilogue, tfp->fp, t);
-                fclose(tfp->fp);
+                fmt_time(text, NEL(text), tfp->epilogue, t);
+                tfile_retire_(tfp, STREMPTY(tfp->epilogue) ? NULL : text);
+            }
+            if (!STREMPTY(tfp->path))
+            {
+                ATOMIC_ADD_RELAXED(&tfp->n_rotate, 1);
             }
             strncpy((char *) tfp->path, new_path, NEL(tfp->path) - 1);
             tfp->fp = (FILE *) NULL;
         }
     }
-    if (tfp->fp == NULL)
+    if (tfp->fp == NULL && tfp->fd < 0)
     {                                  /* open output, or die in the attempt */
+        if ((tfp->opt.flags & TFILE_APPEND) && !STREMPTY(tfp->path))
+        {
+            return (tfp->fd = tfile_append_open_(tfp, t)) >= 0;
+        }
+        if ((tfp->opt.flags & TFILE_MMAP) && !STREMPTY(tfp->path))
+        {
+            return tfile_mmap_open_(tfp, t);
+        }
         if (STREMPTY(tfp->path))
         {
             tfp->fp = stdout;
@@ -283,21 +658,65 @@ static FILE *reopen_tfile_(TFILE * tfp, time_t t)
         }
         else
         {
-            if (make_path(path_dirname(tfp->path, NEL(dir), dir)))
+            if ((tfp->fp = tfile_open_(tfp)) == NULL)
             {
-                info("opening file \"%s\"", tfp->path);
-                if ((tfp->fp = fopen(tfp->path, "a")) == NULL)
+                return 0;
+            }
+            set_buffer(tfp);
+            if (ftell(tfp->fp) == 0)
+            {                          /* at start of file... */
+                write_template(tfp->prologue, tfp->fp, t);
+            }
+            if (tfp->helper != NULL && !STREMPTY(tfp->name_template))
+            {                          /* open the next file early */
+                fmt_time(new_path, NEL(new_path), tfp->name_template,
+                         tfp->end);
+                if (strcmp(new_path, tfp->path) != 0)
                 {
-                    log_sys(LOG_ERR, "cannot open file \"%s\"", tfp->path);
-                    /* REVISIT: return? */
-                }
-                setlinebuf(tfp->fp);
-                if (ftell(tfp->fp) == 0)
-                {                      /* at start of file... */
-                    write_template(tfp->prologue, tfp->fp, t);
+                    tfile_preopen_(tfp, new_path);
                 }
             }
         }
     }
-    return tfp->fp;
+    return tfp->fp != NULL || tfp->fd >= 0;
+}
+
+/*
+ * tfile_collect() --Report a timestamp file's statistics as metrics.
+ */
+static void tfile_collect(MetricWriterPtr writer, void *data)
+{
+    TFILE *tfp = data;
+
+    metric_write(writer, "apex_tfile_records_total",
+                 "Records written to the timestamp file.", METRIC_COUNTER,
+                 (double) ATOMIC_LOAD_RELAXED(&tfp->n_record));
+    metric_write(writer, "apex_tfile_rotations_total",
+                 "Times the timestamp file has moved to a new path.",
+                 METRIC_COUNTER,
+                 (double) ATOMIC_LOAD_RELAXED(&tfp->n_rotate));
+}
+
+/*
+ * tfile_metrics() --Register a timestamp file's statistics as metrics.
+ *
+ * Parameters:
+ * tfp  --the timestamp file handle
+ * name --the file's name, reported as the "tfile" label
+ *
+ * Returns: (MetricPtr)
+ * Success: the collector (to be released by metric_free() before
+ * tfclose()); Failure: NULL.
+ */
+MetricPtr tfile_metrics(TFILE * tfp, const char *name)
+{
+    char labels[METRIC_NAME_MAX];
+
+    if (tfp == NULL)
+    {
+        return NULL;
+    }
+    return metric_collector_new(metric_label(labels, sizeof(labels),
+                                             "tfile", name),
+                                tfile_collect, tfp);
 }
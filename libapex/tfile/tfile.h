@@ -6,13 +6,40 @@
 #define TFILE_H
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <time.h>
+#include <sys/types.h>
 #include <apex.h>
+#include <apex/metrics.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif                                 /* C++ */
+    enum
+    {
+        TFILE_BACKGROUND = 0x1,        /* rotate on a helper thread */
+        TFILE_APPEND = 0x2,            /* atomic records (multiple writers) */
+        TFILE_MMAP = 0x4               /* memcpy() records into a mapped file */
+    };
+
+    /*
+     * TFileOptions --How a TFILE buffers, flushes and rotates its output.
+     *
+     * Remarks:
+     * The defaults (all zero) give a line-buffered file, as tfopen().
+     */
+    typedef struct TFileOptions_t
+    {
+        size_t buf_size;               /* stdio buffer size (0: line-buffered) */
+        int flush_interval;            /* max. seconds between flushes (0: none) */
+        int flags;                     /* TFILE_BACKGROUND, ... */
+        const char *compress;          /* "gzip"/"zstd" rotated files (or NULL) */
+        size_t map_size;               /* preallocation chunk (TFILE_MMAP) */
+    } TFileOptions;
+
+    typedef struct TFileHelper_t TFileHelper;
+
     typedef struct TFILE_t
     {
         FILE *fp;                      /* current open file pointer, if any */
@@ -20,12 +47,28 @@ extern "C"
         const char *name_template;     /* strftime(3) spec */
         const char *prologue;          /* strftime(3) spec */
         const char *epilogue;          /* strftime(3) spec */
+        time_t start, end;             /* path's time window: [start, end) */
+        TFileOptions opt;
+        char *buf;                     /* stdio buffer (if fully buffered) */
+        time_t flushed;                /* time of the last flush */
+        TFileHelper *helper;           /* (TFILE_BACKGROUND) */
+        int fd;                        /* (TFILE_APPEND, TFILE_MMAP) */
+        char *map;                     /* the mapped file (TFILE_MMAP) */
+        size_t map_len, map_used;      /* mapped, and written, length */
+        size_t map_synced;             /* length as of the last msync(2) */
+        uint64_t n_record;             /* No. of records written */
+        uint64_t n_rotate;             /* No. of times the path has changed */
     } TFILE;
 
     TFILE *tfopen(const char *name_template, time_t t,
                   const char *prologue, const char *epilogue)
         STRFTIME_ATTRIBUTE(1) STRFTIME_ATTRIBUTE(3) STRFTIME_ATTRIBUTE(4);
 
+    TFILE *tfopen_opt(const char *name_template, time_t t,
+                      const char *prologue, const char *epilogue,
+                      const TFileOptions * opt)
+        STRFTIME_ATTRIBUTE(1) STRFTIME_ATTRIBUTE(3) STRFTIME_ATTRIBUTE(4);
+
     size_t tfwrite(const void *ptr, size_t size, size_t nitems,
                    TFILE * tfp, time_t t);
     size_t tfwrite_time(const char *record_template, TFILE * tfp, time_t t)
@@ -33,7 +76,25 @@ extern "C"
 
     int tfprintf(TFILE * tfp, time_t t, const char *format, ...)
         PRINTF_ATTRIBUTE(3, 4);
+    int tfflush(TFILE * tfp);
     int tfclose(TFILE * tfp, time_t t);
+    MetricPtr tfile_metrics(TFILE * tfp, const char *name);
+
+    int tfile_compress_(const char *path, const char *program);
+    int tfile_helper_start_(TFILE * tfp);
+    void tfile_helper_stop_(TFILE * tfp);
+    void tfile_retire_(TFILE * tfp, const char *epilogue);
+    void tfile_preopen_(TFILE * tfp, const char *path);
+    FILE *tfile_open_(TFILE * tfp);
+    int tfile_append_open_(TFILE * tfp, time_t t);
+    ssize_t tfile_append_(TFILE * tfp, const void *buf, size_t n);
+    int tfile_append_vprintf_(TFILE * tfp, const char *fmt, va_list ap);
+    int tfile_append_close_(TFILE * tfp, time_t t);
+    int tfile_mmap_open_(TFILE * tfp, time_t t);
+    ssize_t tfile_mmap_write_(TFILE * tfp, const void *buf, size_t n);
+    int tfile_mmap_vprintf_(TFILE * tfp, const char *fmt, va_list ap);
+    int tfile_mmap_sync_(TFILE * tfp);
+    int tfile_mmap_close_(TFILE * tfp, time_t t);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,320 @@
+/*
+ * CLOCK.C --Nanosecond clocks, and TimeNs arithmetic.
+ *
+ * Contents:
+ * read_clock()         --Read a POSIX clock, in nanoseconds.
+ * ns_monotonic()       --Return the monotonic clock time.
+ * ns_coarse()          --Return the (cheaper, tick-resolution) coarse clock time.
+ * rdtsc()              --Read the CPU's timestamp counter.
+ * tsc_invariant()      --Check that the TSC runs at a constant rate.
+ * ns_tsc_calibrate()   --Measure the TSC's rate against the monotonic clock.
+ * default_calibrate()  --Calibrate the TSC over the default interval.
+ * ns_tsc()             --Return the monotonic time, derived from the TSC.
+ * ns_tsc_hz()          --Return the TSC's (calibrated) rate.
+ * ns_now()             --Return the time from a selected clock source.
+ * ns_set()             --Convert seconds (as a double) to a TimeNs.
+ * ns_double()          --Convert a TimeNs to seconds (as a double).
+ * ns_scale()           --Multiply a TimeNs duration by a scale factor.
+ * ns_from_tv()         --Convert a TimeValue to a TimeNs.
+ * ns_to_tv()           --Convert a TimeNs to a (normalised) TimeValue.
+ * ns_from_ts()         --Convert a timespec to a TimeNs.
+ * ns_to_ts()           --Convert a TimeNs to a (normalised) timespec.
+ *
+ * Remarks:
+ * All three sources count from the same (arbitrary) epoch as
+ * CLOCK_MONOTONIC, so their times can be compared and subtracted,
+ * but not converted to dates.
+ *
+ * The coarse clock is updated once per kernel tick (typically 1-4ms),
+ * and is cheap where the precise one isn't (e.g. in virtual machines
+ * without a usable vDSO clock).  The TSC source reads the CPU's
+ * timestamp counter directly; it's calibrated against CLOCK_MONOTONIC
+ * (over 10ms, the first time it's used), and is only used if the CPU
+ * says the counter is "invariant" (i.e. constant rate, and
+ * synchronised across cores).  Otherwise, or on non-x86 CPUs, it
+ * falls back to the monotonic clock.
+ */
+#include <apex.h>
+#include <errno.h>
+#include <pthread.h>
+#include <apex/clock.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define HAVE_TSC
+#endif
+
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC
+#endif
+
+enum
+{
+    TSC_INTERVAL = 10 * NS_PER_MSEC    /* default calibration interval */
+};
+
+static struct
+{
+    int state;                         /* 1: calibrated, -1: unusable */
+    uint64_t tick0;                    /* TSC at calibration... */
+    TimeNs ns0;                        /* ...and the equivalent time */
+    double ns_per_tick;
+} tsc;
+
+static pthread_once_t tsc_once = PTHREAD_ONCE_INIT;
+
+/*
+ * read_clock() --Read a POSIX clock, in nanoseconds.
+ */
+static inline TimeNs read_clock(clockid_t id)
+{
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+    return (TimeNs) ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * ns_monotonic() --Return the monotonic clock time.
+ */
+TimeNs ns_monotonic(void)
+{
+    return read_clock(CLOCK_MONOTONIC);
+}
+
+/*
+ * ns_coarse() --Return the (cheaper, tick-resolution) coarse clock time.
+ */
+TimeNs ns_coarse(void)
+{
+    return read_clock(CLOCK_MONOTONIC_COARSE);
+}
+
+/*
+ * rdtsc() --Read the CPU's timestamp counter.
+ */
+static inline uint64_t rdtsc(void)
+{
+#ifdef HAVE_TSC
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif /* HAVE_TSC */
+}
+
+/*
+ * tsc_invariant() --Check that the TSC runs at a constant rate.
+ */
+static int tsc_invariant(void)
+{
+#ifdef HAVE_TSC
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    {
+        return (edx & (1u << 8)) != 0;
+    }
+#endif /* HAVE_TSC */
+    return 0;
+}
+
+/*
+ * ns_tsc_calibrate() --Measure the TSC's rate against the monotonic clock.
+ *
+ * Parameters:
+ * interval --specifies the time to measure over (0: 10ms)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the TSC isn't usable).
+ *
+ * Remarks:
+ * This busy-waits for the interval.  It's called implicitly by the
+ * first ns_tsc(); a program that wants a longer (more accurate)
+ * calibration should call it before starting any threads that use
+ * the TSC clock.
+ */
+int ns_tsc_calibrate(TimeNs interval)
+{
+    uint64_t tick0, tick1;
+    TimeNs ns0, ns1;
+
+    if (!tsc_invariant())
+    {
+        tsc.state = -1;
+        return 0;
+    }
+    if (interval <= 0)
+    {
+        interval = TSC_INTERVAL;
+    }
+    ns0 = ns_monotonic();
+    tick0 = rdtsc();
+    do
+    {
+        ns1 = ns_monotonic();
+    } while (ns1 - ns0 < interval);
+    tick1 = rdtsc();
+
+    if (tick1 <= tick0)
+    {
+        tsc.state = -1;
+        return 0;
+    }
+    tsc.tick0 = tick0;
+    tsc.ns0 = ns0;
+    tsc.ns_per_tick = (double) (ns1 - ns0) / (double) (tick1 - tick0);
+    tsc.state = 1;
+    return 1;
+}
+
+/*
+ * default_calibrate() --Calibrate the TSC over the default interval.
+ */
+static void default_calibrate(void)
+{
+    if (tsc.state == 0)
+    {
+        ns_tsc_calibrate(0);
+    }
+}
+
+/*
+ * ns_tsc() --Return the monotonic time, derived from the TSC.
+ *
+ * Remarks:
+ * The result is accurate to the calibration (typically within a few
+ * parts per million), so it will drift slowly from ns_monotonic().
+ */
+TimeNs ns_tsc(void)
+{
+    pthread_once(&tsc_once, default_calibrate);
+    if (tsc.state > 0)
+    {
+        int64_t ticks = (int64_t) (rdtsc() - tsc.tick0);
+
+        return tsc.ns0 + (TimeNs) ((double) ticks * tsc.ns_per_tick);
+    }
+    return ns_monotonic();
+}
+
+/*
+ * ns_tsc_hz() --Return the TSC's (calibrated) rate.
+ *
+ * Returns: (double)
+ * Success: the TSC's frequency, in Hz; Failure: 0 (no usable TSC).
+ */
+double ns_tsc_hz(void)
+{
+    pthread_once(&tsc_once, default_calibrate);
+    return tsc.state > 0 ? NS_PER_SEC / tsc.ns_per_tick : 0.0;
+}
+
+/*
+ * ns_now() --Return the time from a selected clock source.
+ */
+TimeNs ns_now(ClockSource source)
+{
+    switch (source)
+    {
+    case CLOCK_SOURCE_COARSE:
+        return ns_coarse();
+    case CLOCK_SOURCE_TSC:
+        return ns_tsc();
+    case CLOCK_SOURCE_MONOTONIC:
+    default:
+        return ns_monotonic();
+    }
+}
+
+/*
+ * ns_set() --Convert seconds (as a double) to a TimeNs.
+ *
+ * Returns: (TimeNs)
+ * Success: the time; Failure: 0, and errno is set to EDOM.
+ *
+ * Remarks:
+ * A TimeNs covers roughly +/-292 years.
+ */
+TimeNs ns_set(double t)
+{
+    double ns = t * NS_PER_SEC;
+
+    if (ns >= (double) INT64_MAX || ns <= (double) INT64_MIN)
+    {
+        errno = EDOM;
+        return 0;
+    }
+    return (TimeNs) (ns < 0 ? ns - 0.5 : ns + 0.5);
+}
+
+/*
+ * ns_double() --Convert a TimeNs to seconds (as a double).
+ */
+double ns_double(TimeNs t)
+{
+    return (double) t / NS_PER_SEC;
+}
+
+/*
+ * ns_scale() --Multiply a TimeNs duration by a scale factor.
+ */
+TimeNs ns_scale(TimeNs t, double scale)
+{
+    return (TimeNs) ((double) t * scale);
+}
+
+/*
+ * ns_from_tv() --Convert a TimeValue to a TimeNs.
+ */
+TimeNs ns_from_tv(const TimeValue *tv)
+{
+    return (TimeNs) tv->tv_sec * NS_PER_SEC + (TimeNs) tv->tv_usec * NS_PER_USEC;
+}
+
+/*
+ * ns_to_tv() --Convert a TimeNs to a (normalised) TimeValue.
+ *
+ * Remarks:
+ * The result is truncated to microseconds (towards -infinity), so
+ * tv_usec is always in the range 0..999999.
+ */
+TimeValuePtr ns_to_tv(TimeNs t, TimeValuePtr tv)
+{
+    TimeNs sec = t / NS_PER_SEC;
+    TimeNs rem = t % NS_PER_SEC;
+
+    if (rem < 0)
+    {
+        sec -= 1;
+        rem += NS_PER_SEC;
+    }
+    tv->tv_sec = (time_t) sec;
+    tv->tv_usec = (suseconds_t) (rem / NS_PER_USEC);
+    return tv;
+}
+
+/*
+ * ns_from_ts() --Convert a timespec to a TimeNs.
+ */
+TimeNs ns_from_ts(const struct timespec *ts)
+{
+    return (TimeNs) ts->tv_sec * NS_PER_SEC + ts->tv_nsec;
+}
+
+/*
+ * ns_to_ts() --Convert a TimeNs to a (normalised) timespec.
+ */
+struct timespec *ns_to_ts(TimeNs t, struct timespec *ts)
+{
+    TimeNs sec = t / NS_PER_SEC;
+    TimeNs rem = t % NS_PER_SEC;
+
+    if (rem < 0)
+    {
+        sec -= 1;
+        rem += NS_PER_SEC;
+    }
+    ts->tv_sec = (time_t) sec;
+    ts->tv_nsec = (long) rem;
+    return ts;
+}
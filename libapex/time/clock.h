@@ -0,0 +1,56 @@
+/*
+ * CLOCK.H --Definitions for the (nanosecond) clock functions.
+ *
+ * Contents:
+ * TimeNs         --A time (or duration) in nanoseconds.
+ * ClockSource{}  --The clocks available to ns_now().
+ *
+ * Remarks:
+ * A TimeNs is a signed 64-bit count of nanoseconds, so (unlike a
+ * TimeValue) it needs no normalising: sums, differences and
+ * comparisons are plain integer arithmetic.  The ns_*() functions
+ * are the TimeNs equivalents of the tv_*() ones.
+ */
+#ifndef APEX_CLOCK_H
+#define APEX_CLOCK_H
+
+#include <inttypes.h>
+#include <time.h>
+#include <apex/timeval.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+#define PRI_TIMENS	PRId64
+#define NS_PER_USEC	1000LL
+#define NS_PER_MSEC	1000000LL
+#define NS_PER_SEC	1000000000LL
+
+    typedef int64_t TimeNs;
+
+    typedef enum ClockSource
+    {
+        CLOCK_SOURCE_MONOTONIC,        /* clock_gettime(CLOCK_MONOTONIC) */
+        CLOCK_SOURCE_COARSE,           /* ...the coarse (tick) variant */
+        CLOCK_SOURCE_TSC               /* calibrated CPU timestamp counter */
+    } ClockSource;
+
+    TimeNs ns_now(ClockSource source);
+    TimeNs ns_monotonic(void);
+    TimeNs ns_coarse(void);
+    TimeNs ns_tsc(void);
+    int ns_tsc_calibrate(TimeNs interval);
+    double ns_tsc_hz(void);
+
+    TimeNs ns_set(double t);
+    double ns_double(TimeNs t);
+    TimeNs ns_scale(TimeNs t, double scale);
+    TimeNs ns_from_tv(const TimeValue *tv);
+    TimeValuePtr ns_to_tv(TimeNs t, TimeValuePtr tv);
+    TimeNs ns_from_ts(const struct timespec *ts);
+    struct timespec *ns_to_ts(TimeNs t, struct timespec *ts);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* APEX_CLOCK_H */
@@ -0,0 +1,540 @@
+/*
+ * DATE-FORMAT.C --Format times with precompiled strftime() specs.
+ *
+ * Contents:
+ * add_op()              --Append an op to a compiled format.
+ * add_text()            --Append literal text (or a fallback spec) to a format.
+ * minute_stable()       --Check if a (fallback) conversion is constant within a minute.
+ * date_format_compile() --Compile a strftime() spec into a list of ops.
+ * put_number()          --Format a number, padded to some width.
+ * render()              --Render a compiled format for a broken-down time.
+ * date_format_tm()      --Format a broken-down time with a compiled format.
+ * date_format()         --Format a time_t (as local time) with a compiled format.
+ * date_format_find_()   --Find (or compile) the thread's format for a spec.
+ * date_strftime()       --strftime(), using the thread's compiled formats.
+ *
+ * Remarks:
+ * fmt_time(), tfile and the stderr log handler format the same few
+ * specs over and over.  A spec is compiled once into a list of ops:
+ * literal text, numeric conversions (which are rendered directly),
+ * and anything else (names, locale-specific formats, glibc's flags),
+ * which is passed to strftime() one conversion at a time.
+ *
+ * date_format() also caches the rendered text for the current minute
+ * (if nothing but "%S" can change within it): the next call in the
+ * same minute copies the text and patches the seconds.  That's only
+ * done if the local zone's offset is a whole number of minutes.
+ *
+ * The formats used by fmt_time() and date_strftime() are compiled on
+ * demand, and kept per thread (the last few specs), so there's no
+ * locking.  Specs that are too long to compile are just passed to
+ * strftime().
+ */
+#include <apex.h>
+#include <string.h>
+#include <apex/date.h>
+
+enum
+{
+    N_FORMAT = 4,                      /* compiled specs kept per thread */
+    FALLBACK_MAX = 256                 /* max. single-conversion text */
+};
+
+typedef enum FormatCode
+{
+    OP_TEXT,                           /* literal text */
+    OP_STRFTIME,                       /* fallback: one strftime() conversion */
+    OP_YEAR,                           /* %Y */
+    OP_CENTURY,                        /* %C */
+    OP_YEAR2,                          /* %y */
+    OP_MONTH,                          /* %m */
+    OP_MDAY,                           /* %d */
+    OP_MDAY_SPACE,                     /* %e */
+    OP_HOUR,                           /* %H */
+    OP_HOUR12,                         /* %I */
+    OP_MINUTE,                         /* %M */
+    OP_SECOND,                         /* %S */
+    OP_YDAY,                           /* %j */
+    OP_WDAY,                           /* %w */
+    OP_WDAY_ISO,                       /* %u */
+    OP_ZONE                            /* %z */
+} FormatCode;
+
+static THREAD_LOCAL DateFormat format_cache[N_FORMAT];
+static THREAD_LOCAL unsigned int n_compiled;
+
+/*
+ * add_op() --Append an op to a compiled format.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (too many ops).
+ */
+static int add_op(DateFormat * format, FormatCode code)
+{
+    if (format->n_op >= DATE_FORMAT_OP_MAX)
+    {
+        return 0;
+    }
+    format->op[format->n_op].code = (unsigned char) code;
+    format->op[format->n_op].len = 0;
+    format->op[format->n_op].offset = 0;
+    format->n_op += 1;
+    return 1;
+}
+
+/*
+ * add_text() --Append literal text (or a fallback spec) to a format.
+ *
+ * Parameters:
+ * format   --the format being compiled
+ * code     --OP_TEXT or OP_STRFTIME
+ * text     --the text
+ * len      --its length
+ * n_text   --updates the space used in format->text[]
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (not enough space).
+ *
+ * Remarks:
+ * Adjacent literals are merged into one op.  Fallback specs are
+ * NUL-terminated, for strftime().
+ */
+static int add_text(DateFormat * format, FormatCode code,
+                    const char *text, size_t len, size_t *n_text)
+{
+    DateFormatOp *last = format->n_op > 0
+        ? &format->op[format->n_op - 1] : NULL;
+
+    if (*n_text + len + 1 > DATE_FORMAT_TEXT_MAX)
+    {
+        return 0;
+    }
+    memcpy(format->text + *n_text, text, len);
+    if (code == OP_TEXT && last != NULL && last->code == OP_TEXT
+        && last->offset + last->len == *n_text)
+    {
+        last->len += (unsigned char) len;
+        *n_text += len;
+        return 1;
+    }
+    if (!add_op(format, code))
+    {
+        return 0;
+    }
+    last = &format->op[format->n_op - 1];
+    last->len = (unsigned char) len;
+    last->offset = (unsigned short) *n_text;
+    *n_text += len;
+    if (code == OP_STRFTIME)
+    {
+        format->text[(*n_text)++] = '\0';
+    }
+    return 1;
+}
+
+/*
+ * minute_stable() --Check if a (fallback) conversion is constant within a minute.
+ */
+static int minute_stable(int conversion)
+{
+    return conversion != '\0' && strchr("aAbBhpPZxGgVUWkl", conversion) != NULL;
+}
+
+/*
+ * date_format_compile() --Compile a strftime() spec into a list of ops.
+ *
+ * Parameters:
+ * format   --returns the compiled format
+ * spec     --specifies the strftime(3) spec
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the spec is too long/complex to compile).
+ */
+int date_format_compile(DateFormat * format, const char *spec)
+{
+    size_t len = strlen(spec);
+    size_t n_text = 0;
+    int status = 1;
+
+    if (len >= DATE_FORMAT_TEXT_MAX)
+    {
+        return 0;
+    }
+    memcpy(format->spec, spec, len + 1);
+    format->n_op = 0;
+    format->cacheable = 1;
+    format->n_cached = 0;
+
+    for (const char *s = spec; *s != '\0' && status;)
+    {
+        const char *start = s;
+
+        if (*s != '%')
+        {
+            while (*s != '\0' && *s != '%')
+            {
+                ++s;
+            }
+            status = add_text(format, OP_TEXT, start, (size_t) (s - start),
+                              &n_text);
+            continue;
+        }
+        switch (*++s)
+        {
+        case 'Y':
+            status = add_op(format, OP_YEAR);
+            break;
+        case 'C':
+            status = add_op(format, OP_CENTURY);
+            break;
+        case 'y':
+            status = add_op(format, OP_YEAR2);
+            break;
+        case 'm':
+            status = add_op(format, OP_MONTH);
+            break;
+        case 'd':
+            status = add_op(format, OP_MDAY);
+            break;
+        case 'e':
+            status = add_op(format, OP_MDAY_SPACE);
+            break;
+        case 'H':
+            status = add_op(format, OP_HOUR);
+            break;
+        case 'I':
+            status = add_op(format, OP_HOUR12);
+            break;
+        case 'M':
+            status = add_op(format, OP_MINUTE);
+            break;
+        case 'S':
+            status = add_op(format, OP_SECOND);
+            break;
+        case 'j':
+            status = add_op(format, OP_YDAY);
+            break;
+        case 'w':
+            status = add_op(format, OP_WDAY);
+            break;
+        case 'u':
+            status = add_op(format, OP_WDAY_ISO);
+            break;
+#ifndef __WINNT__                      /* (Windows doesn't have gmtoff) */
+        case 'z':
+            status = add_op(format, OP_ZONE);
+            break;
+#endif /* __WINNT__ */
+        case 'F':                      /* %Y-%m-%d */
+            status = add_op(format, OP_YEAR)
+                && add_text(format, OP_TEXT, "-", 1, &n_text)
+                && add_op(format, OP_MONTH)
+                && add_text(format, OP_TEXT, "-", 1, &n_text)
+                && add_op(format, OP_MDAY);
+            break;
+        case 'T':                      /* %H:%M:%S */
+            status = add_op(format, OP_HOUR)
+                && add_text(format, OP_TEXT, ":", 1, &n_text)
+                && add_op(format, OP_MINUTE)
+                && add_text(format, OP_TEXT, ":", 1, &n_text)
+                && add_op(format, OP_SECOND);
+            break;
+        case 'R':                      /* %H:%M */
+            status = add_op(format, OP_HOUR)
+                && add_text(format, OP_TEXT, ":", 1, &n_text)
+                && add_op(format, OP_MINUTE);
+            break;
+        case 'D':                      /* %m/%d/%y */
+            status = add_op(format, OP_MONTH)
+                && add_text(format, OP_TEXT, "/", 1, &n_text)
+                && add_op(format, OP_MDAY)
+                && add_text(format, OP_TEXT, "/", 1, &n_text)
+                && add_op(format, OP_YEAR2);
+            break;
+        case '%':
+            status = add_text(format, OP_TEXT, "%", 1, &n_text);
+            break;
+        case 'n':
+            status = add_text(format, OP_TEXT, "\n", 1, &n_text);
+            break;
+        case 't':
+            status = add_text(format, OP_TEXT, "\t", 1, &n_text);
+            break;
+        case '\0':                     /* (trailing "%") */
+            status = add_text(format, OP_TEXT, "%", 1, &n_text);
+            continue;
+        default:                       /* flags, modifiers, names, etc. */
+            while (*s != '\0' && strchr("_-0^#EO123456789", *s) != NULL)
+            {
+                ++s;
+            }
+            if (!minute_stable(*s))
+            {
+                format->cacheable = 0;
+            }
+            if (*s == '\0')
+            {
+                status = add_text(format, OP_STRFTIME, start,
+                                  (size_t) (s - start), &n_text);
+                continue;
+            }
+            status = add_text(format, OP_STRFTIME, start,
+                              (size_t) (s - start + 1), &n_text);
+            break;
+        }
+        ++s;
+    }
+    if (!status)
+    {
+        format->spec[0] = '\0';        /* (so it's never found) */
+        format->n_op = 0;
+    }
+    return status;
+}
+
+/*
+ * put_number() --Format a number, padded to some width.
+ *
+ * Returns: (size_t)
+ * The number of characters written (at most 21).
+ */
+static size_t put_number(char *str, long value, int width, char pad)
+{
+    char digits[24];
+    int n = 0;
+    size_t len = 0;
+    unsigned long u = value < 0 ? -(unsigned long) value : (unsigned long) value;
+
+    do
+    {
+        digits[n++] = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (value < 0)
+    {
+        str[len++] = '-';
+    }
+    for (int i = n; i < width; ++i)
+    {
+        str[len++] = pad;
+    }
+    while (n > 0)
+    {
+        str[len++] = digits[--n];
+    }
+    return len;
+}
+
+/*
+ * render() --Render a compiled format for a broken-down time.
+ *
+ * Parameters:
+ * format   --the compiled format
+ * str      --returns the text
+ * size     --specifies the size of str
+ * tm       --specifies the time
+ * sec      --returns the offsets of the "%S" text (or NULL)
+ * n_sec    --returns the number of "%S" conversions (or NULL)
+ *
+ * Returns: (size_t)
+ * Success: the length of the text; Failure: 0 (as for strftime()).
+ */
+static size_t render(const DateFormat * format, char *str, size_t size,
+                     const struct tm *tm, unsigned short *sec, int *n_sec)
+{
+    char buf[FALLBACK_MAX];
+    size_t n = 0;
+    long year = tm->tm_year + 1900L;
+
+    if (n_sec != NULL)
+    {
+        *n_sec = 0;
+    }
+    for (int i = 0; i < format->n_op; ++i)
+    {
+        const DateFormatOp *op = &format->op[i];
+        const char *text = buf;
+        size_t len = 0;
+
+        switch ((FormatCode) op->code)
+        {
+        case OP_TEXT:
+            text = format->text + op->offset;
+            len = op->len;
+            break;
+        case OP_STRFTIME:
+            len = strftime(buf, sizeof(buf), format->text + op->offset, tm);
+            break;
+        case OP_YEAR:
+            len = put_number(buf, year, 1, '0');
+            break;
+        case OP_CENTURY:
+            len = put_number(buf, year / 100, 2, '0');
+            break;
+        case OP_YEAR2:
+            len = put_number(buf, (year % 100 + 100) % 100, 2, '0');
+            break;
+        case OP_MONTH:
+            len = put_number(buf, tm->tm_mon + 1, 2, '0');
+            break;
+        case OP_MDAY:
+            len = put_number(buf, tm->tm_mday, 2, '0');
+            break;
+        case OP_MDAY_SPACE:
+            len = put_number(buf, tm->tm_mday, 2, ' ');
+            break;
+        case OP_HOUR:
+            len = put_number(buf, tm->tm_hour, 2, '0');
+            break;
+        case OP_HOUR12:
+            len = put_number(buf, (tm->tm_hour + 11) % 12 + 1, 2, '0');
+            break;
+        case OP_MINUTE:
+            len = put_number(buf, tm->tm_min, 2, '0');
+            break;
+        case OP_SECOND:
+            if (n_sec != NULL && (*n_sec)++ < DATE_FORMAT_SEC_MAX)
+            {
+                sec[*n_sec - 1] = (unsigned short) n;
+            }
+            len = put_number(buf, tm->tm_sec, 2, '0');
+            break;
+        case OP_YDAY:
+            len = put_number(buf, tm->tm_yday + 1, 3, '0');
+            break;
+        case OP_WDAY:
+            len = put_number(buf, tm->tm_wday, 1, '0');
+            break;
+        case OP_WDAY_ISO:
+            len = put_number(buf, tm->tm_wday == 0 ? 7 : tm->tm_wday, 1, '0');
+            break;
+        case OP_ZONE:
+#ifndef __WINNT__
+            {
+                long offset = tm->tm_gmtoff / 60;
+
+                buf[0] = offset < 0 ? '-' : '+';
+                offset = ABS(offset);
+                len = 1 + put_number(buf + 1, offset / 60 * 100 + offset % 60,
+                                     4, '0');
+            }
+#endif /* __WINNT__ */
+            break;
+        }
+        if (n + len >= size)
+        {
+            return 0;
+        }
+        memcpy(str + n, text, len);
+        n += len;
+    }
+    str[n] = '\0';
+    return n;
+}
+
+/*
+ * date_format_tm() --Format a broken-down time with a compiled format.
+ *
+ * Returns: (size_t)
+ * Success: the length of the text; Failure: 0 (as for strftime()).
+ */
+size_t date_format_tm(const DateFormat * format, char *str, size_t size,
+                      const struct tm *tm)
+{
+    return size > 0 ? render(format, str, size, tm, NULL, NULL) : 0;
+}
+
+/*
+ * date_format() --Format a time_t (as local time) with a compiled format.
+ *
+ * Returns: (size_t)
+ * Success: the length of the text; Failure: 0 (as for strftime()).
+ *
+ * Remarks:
+ * The text is cached for the rest of the minute, if that's possible.
+ */
+size_t date_format(DateFormat * format, char *str, size_t size, time_t t)
+{
+    time_t minute = (t >= 0 ? t : t - 59) / 60;
+    struct tm tm;
+    size_t n;
+
+    if (format->n_cached > 0 && minute == format->minute)
+    {
+        int sec = (int) (t - minute * 60);
+
+        if (format->n_cached >= size)
+        {
+            return 0;
+        }
+        memcpy(str, format->cached, format->n_cached + 1);
+        for (int i = 0; i < format->n_sec; ++i)
+        {
+            str[format->sec[i]] = (char) ('0' + sec / 10);
+            str[format->sec[i] + 1] = (char) ('0' + sec % 10);
+        }
+        return format->n_cached;
+    }
+
+    date_localtime(t, &tm);
+    format->n_cached = 0;
+    if (size == 0)
+    {
+        return 0;
+    }
+    n = render(format, str, size, &tm, format->sec, &format->n_sec);
+#ifndef __WINNT__
+    if (format->cacheable && n > 0 && n < DATE_FORMAT_TEXT_MAX
+        && format->n_sec <= DATE_FORMAT_SEC_MAX && tm.tm_gmtoff % 60 == 0)
+    {
+        memcpy(format->cached, str, n + 1);
+        format->n_cached = n;
+        format->minute = minute;
+    }
+#endif /* __WINNT__ */
+    return n;
+}
+
+/*
+ * date_format_find_() --Find (or compile) the thread's format for a spec.
+ *
+ * Returns: (DateFormat *)
+ * Success: the compiled format; Failure: NULL (it can't be compiled).
+ *
+ * Remarks:
+ * The specs are matched by value, not address, so callers may pass
+ * specs from a (reused) buffer.
+ */
+DateFormat *date_format_find_(const char *spec)
+{
+    unsigned int n = MIN(n_compiled, N_FORMAT);
+    DateFormat *format;
+
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        if (strcmp(format_cache[i].spec, spec) == 0)
+        {
+            return &format_cache[i];
+        }
+    }
+    format = &format_cache[n_compiled++ % N_FORMAT];
+    return date_format_compile(format, spec) ? format : NULL;
+}
+
+/*
+ * date_strftime() --strftime(), using the thread's compiled formats.
+ *
+ * Returns: (size_t)
+ * Success: the length of the text; Failure: 0 (as for strftime()).
+ */
+size_t date_strftime(char *str, size_t size, const char *spec,
+                     const struct tm *tm)
+{
+    DateFormat *format = date_format_find_(spec);
+
+    if (format == NULL)
+    {
+        return strftime(str, size, spec, tm);
+    }
+    return date_format_tm(format, str, size, tm);
+}
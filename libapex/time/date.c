@@ -2,7 +2,16 @@
  * DATE.C --Date and time manipulation and parsing functions.
  *
  * Contents:
- * timegm_()            --Process a tm struct as if it was a UTC time spec.
+ * days_from_civil()    --Return the days since 1970-01-01 of a (proleptic) date.
+ * date_timegm()        --Process a tm struct as if it was a UTC time spec.
+ * date_gmtime()        --Convert a time_t to UTC calendar time.
+ * date_localtime()     --Convert a time_t to local calendar time (cached).
+ * parse_digits()       --Parse a fixed number of decimal digits.
+ * parse_month()        --Parse an English month abbreviation.
+ * parse_hms()          --Parse "HH:MM:SS", and an optional zone.
+ * parse_ymd()          --Parse an ISO8601 "YYYY-MM-DD" date.
+ * parse_syslog()       --Parse a syslog "Mmm dd" date.
+ * parse_fast()         --Parse the common timestamp formats directly.
  * date_parse_fmt()     --Parse (part of) a timestamp using a list of formats.
  * date_parse_date()    --Parse the "date" part only of a timestamp.
  * date_parse_time()    --Parse the "time" part only of a timestamp.
@@ -14,13 +23,27 @@
  * common formats that are defined by ISO8601, and that can be
  * processed via strptime().
  *
+ * The common formats (ISO8601 dates and timestamps, with an optional
+ * "Z" or "+hh:mm" zone, and syslog timestamps) are parsed directly,
+ * choosing the parser by the first character of the text; only the
+ * rest go through the strptime() format lists.
+ *
+ * UTC conversions are done arithmetically, with H. Hinnant's
+ * days-from-civil algorithms.  Local-time conversions cache the
+ * current (local) day, per thread: within it, a conversion is just
+ * a few divisions, and only a new day (or a DST-change day) calls
+ * localtime_r(3).
+ *
  * See Also:
  * http://en.wikipedia.org/wiki/ISO_8601
+ * http://howardhinnant.github.io/date_algorithms.html
  *
  * REVISIT: implement RFC-3339: "%Y-%m-%d %H:%M:%S-hh:mm"
  * (e.g. 2006-08-07 12:34:56-06:00)
  */
 #include <apex.h>
+#include <ctype.h>
+#include <string.h>
 #include <apex/date.h>
 #include <apex/estring.h>
 
@@ -56,36 +79,371 @@ static const char *date_time_list[] = {
     "%H%M%S",
 };
 
+typedef struct DayCache
+{
+    time_t start, end;                 /* the cached local day: [start, end) */
+    struct tm tm;                      /* ...and its midnight */
+} DayCache;
+
+static THREAD_LOCAL DayCache day_cache;
+
 /*
- * timegm_() --Process a tm struct as if it was a UTC time spec.
+ * days_from_civil() --Return the days since 1970-01-01 of a (proleptic) date.
+ *
+ * Parameters:
+ * year     --the (full) year
+ * mon      --the month: 1..12
+ * mday     --the day of the month: 1..31
+ */
+static long days_from_civil(long year, int mon, int mday)
+{
+    long era, yoe, doy, doe;
+
+    year -= mon <= 2;
+    era = (year >= 0 ? year : year - 399) / 400;
+    yoe = year - era * 400;            /* [0, 399] */
+    doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/*
+ * date_timegm() --Process a tm struct as if it was a UTC time spec.
  *
  * Remarks:
- * This function is copied/adapted from the GNU timegm(3) manual page.
- * Note that this is a *private* implementation,
+ * As for timegm(3), the fields may be out of their normal ranges
+ * (e.g. tm_mday = 0, or tm_sec = 90); tm_wday, tm_yday and tm_isdst
+ * are ignored, and tm isn't changed.
  */
-static time_t timegm_(struct tm *tm)
+time_t date_timegm(const struct tm *tm)
 {
-    time_t t = 0;
+    long year = tm->tm_year + 1900L + tm->tm_mon / 12;
+    int mon = tm->tm_mon % 12;
+    long days;
 
-#ifdef __WINNT__                       /* Windows doesn't have gmtoff */
+    if (mon < 0)
     {
-        char *tz;
-
-        tz = getenv("TZ");             /* save current TZ, set to UTC */
-        setenv("TZ", "", 1);
-        tzset();
-        t = mktime(tm);
-        if (tz != NULL)                /* revert original TZ state */
-            setenv("TZ", tz, 1);
-        else
-            unsetenv("TZ");
-        tzset();
-    }
-#else
-    t = mktime(tm);
-    t += tm->tm_gmtoff;
-#endif /* WINNT */
-    return t;
+        mon += 12;
+        year -= 1;
+    }
+    days = days_from_civil(year, mon + 1, 1) + tm->tm_mday - 1;
+    return (time_t) days * 86400 + tm->tm_hour * 3600L
+        + tm->tm_min * 60L + tm->tm_sec;
+}
+
+/*
+ * date_gmtime() --Convert a time_t to UTC calendar time.
+ *
+ * Returns: (struct tm *)
+ * tm.
+ */
+struct tm *date_gmtime(time_t t, struct tm *tm)
+{
+    long days = (long) (t / 86400), sec = (long) (t % 86400);
+    long z, era, doe, yoe, doy, mp, year;
+
+    if (sec < 0)
+    {
+        sec += 86400;
+        days -= 1;
+    }
+    z = days + 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;            /* [0, 146096] */
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;          /* March-based month: [0, 11] */
+    year = yoe + era * 400;
+
+    memset(tm, 0, sizeof(*tm));
+    tm->tm_mday = (int) (doy - (153 * mp + 2) / 5 + 1);
+    tm->tm_mon = (int) (mp < 10 ? mp + 2 : mp - 10);
+    tm->tm_year = (int) (year + (tm->tm_mon <= 1) - 1900);
+    tm->tm_yday = (int) (days - days_from_civil(tm->tm_year + 1900L, 1, 1));
+    tm->tm_wday = (int) ((days % 7 + 11) % 7); /* (1970-01-01: Thursday) */
+    tm->tm_hour = (int) (sec / 3600);
+    tm->tm_min = (int) (sec / 60 % 60);
+    tm->tm_sec = (int) (sec % 60);
+#ifndef __WINNT__
+    tm->tm_zone = "UTC";
+#endif /* __WINNT__ */
+    return tm;
+}
+
+/*
+ * date_localtime() --Convert a time_t to local calendar time (cached).
+ *
+ * Returns: (struct tm *)
+ * tm.
+ *
+ * Remarks:
+ * This is localtime_r(3), but caches the (local) day containing t,
+ * per thread.  A day is only cached if its UTC offset is the same
+ * all day (i.e. not on DST-change days).  A change of timezone
+ * (e.g. by tzset(3)) is only noticed on the next day.
+ */
+struct tm *date_localtime(time_t t, struct tm *tm)
+{
+    DayCache *cache = &day_cache;
+    long sec;
+
+    if (t >= cache->start && t < cache->end)
+    {
+        sec = (long) (t - cache->start);
+        *tm = cache->tm;
+        tm->tm_hour = (int) (sec / 3600);
+        tm->tm_min = (int) (sec / 60 % 60);
+        tm->tm_sec = (int) (sec % 60);
+        return tm;
+    }
+    localtime_r(&t, tm);
+#ifndef __WINNT__                      /* (Windows doesn't have gmtoff) */
+    {
+        time_t start = t - (tm->tm_hour * 3600L + tm->tm_min * 60L
+                            + tm->tm_sec);
+        time_t last = start + 86400 - 1;
+        struct tm start_tm, last_tm;
+
+        localtime_r(&start, &start_tm);
+        localtime_r(&last, &last_tm);
+        if (start_tm.tm_gmtoff == tm->tm_gmtoff
+            && last_tm.tm_gmtoff == tm->tm_gmtoff
+            && start_tm.tm_hour == 0 && last_tm.tm_mday == tm->tm_mday)
+        {
+            cache->start = start;
+            cache->end = start + 86400;
+            cache->tm = start_tm;
+        }
+    }
+#endif /* __WINNT__ */
+    return tm;
+}
+
+/*
+ * parse_digits() --Parse a fixed number of decimal digits.
+ *
+ * Returns: (const char *)
+ * Success: the end of the digits; Failure: NULL.
+ */
+static const char *parse_digits(const char *text, int n_digit, int *value)
+{
+    int v = 0;
+
+    for (int i = 0; i < n_digit; ++i)
+    {
+        unsigned digit = (unsigned char) text[i] - '0';
+
+        if (digit > 9)
+        {
+            return NULL;               /* (includes '\0') */
+        }
+        v = v * 10 + (int) digit;
+    }
+    *value = v;
+    return text + n_digit;
+}
+
+/*
+ * parse_month() --Parse an English month abbreviation.
+ *
+ * Returns: (const char *)
+ * Success: the end of the abbreviation; Failure: NULL.
+ *
+ * Remarks:
+ * This matches strptime(3)'s "%b" in the C locale, but only for
+ * the abbreviation (so "July" fails, and is left to strptime()).
+ */
+static const char *parse_month(const char *text, int *mon)
+{
+    static const char month[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    for (int i = 0; i < 12; ++i)
+    {
+        const char *m = month + 3 * i;
+
+        if (text[0] == m[0] && text[1] == m[1] && text[2] == m[2]
+            && !isalpha((unsigned char) text[3]))
+        {
+            *mon = i;
+            return text + 3;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * parse_hms() --Parse "HH:MM:SS", and an optional zone.
+ *
+ * Parameters:
+ * text     --the text to parse
+ * tm       --returns the time fields
+ * gmtoff   --returns the zone's offset (seconds east of UTC)
+ * utc      --returns 1 if there was a zone, 0 for local time
+ *
+ * Returns: (const char *)
+ * Success: the end of the time; Failure: NULL.
+ */
+static const char *parse_hms(const char *text, struct tm *tm,
+                             long *gmtoff, int *utc)
+{
+    int hour, min, sec, zh, zm;
+
+    if ((text = parse_digits(text, 2, &hour)) == NULL || *text++ != ':'
+        || (text = parse_digits(text, 2, &min)) == NULL || *text++ != ':'
+        || (text = parse_digits(text, 2, &sec)) == NULL
+        || hour > 23 || min > 59 || sec > 61)
+    {
+        return NULL;
+    }
+    tm->tm_hour = hour;
+    tm->tm_min = min;
+    tm->tm_sec = sec;
+    *gmtoff = 0;
+    *utc = 0;
+    if (*text == 'Z')
+    {
+        *utc = 1;
+        return text + 1;
+    }
+    if ((*text == '+' || *text == '-')
+        && parse_digits(text + 1, 2, &zh) != NULL)
+    {                                  /* "+hh", "+hhmm", "+hh:mm" */
+        const char *end = text + 3;
+
+        zm = 0;
+        if (*end == ':' && parse_digits(end + 1, 2, &zm) != NULL)
+        {
+            end += 3;
+        }
+        else if (parse_digits(end, 2, &zm) != NULL)
+        {
+            end += 2;
+        }
+        *gmtoff = (zh * 60L + zm) * 60 * (*text == '-' ? -1 : 1);
+        *utc = 1;
+        return end;
+    }
+    return text;
+}
+
+/*
+ * parse_ymd() --Parse an ISO8601 "YYYY-MM-DD" date.
+ */
+static const char *parse_ymd(const char *text, struct tm *tm)
+{
+    int year, mon, mday;
+
+    if ((text = parse_digits(text, 4, &year)) == NULL || *text++ != '-'
+        || (text = parse_digits(text, 2, &mon)) == NULL || *text++ != '-'
+        || (text = parse_digits(text, 2, &mday)) == NULL
+        || isdigit((unsigned char) *text)
+        || mon < 1 || mon > 12 || mday < 1 || mday > 31)
+    {
+        return NULL;
+    }
+    tm->tm_year = year - 1900;
+    tm->tm_mon = mon - 1;
+    tm->tm_mday = mday;
+    return text;
+}
+
+/*
+ * parse_syslog() --Parse a syslog "Mmm dd" date.
+ *
+ * Remarks:
+ * The day may be space-padded ("%e"), or not.
+ */
+static const char *parse_syslog(const char *text, struct tm *tm)
+{
+    int mon, mday;
+
+    if ((text = parse_month(text, &mon)) == NULL)
+    {
+        return NULL;
+    }
+    while (*text == ' ')
+    {
+        ++text;
+    }
+    if (parse_digits(text, 2, &mday) != NULL)
+    {
+        text += 2;
+    }
+    else if (parse_digits(text, 1, &mday) != NULL)
+    {
+        text += 1;
+    }
+    else
+    {
+        return NULL;
+    }
+    if (mday < 1 || mday > 31)
+    {
+        return NULL;
+    }
+    tm->tm_mon = mon;
+    tm->tm_mday = mday;
+    return text;
+}
+
+/*
+ * parse_fast() --Parse the common timestamp formats directly.
+ *
+ * Parameters:
+ * text     --the text to parse
+ * base_tm  --specifies the base timestamp, returns the parsed timestamp
+ * t        --returns the timestamp
+ *
+ * Returns: (const char *)
+ * Success: the end of the timestamp; Failure: NULL (try strptime()).
+ *
+ * Remarks:
+ * The first character chooses the parser: a digit for ISO8601
+ * ("YYYY-MM-DD", optionally followed by "T" or spaces and
+ * "HH:MM:SS[zone]"), or a letter for syslog ("Mmm dd HH:MM:SS").
+ * As for the strptime() path, fields that aren't in the text keep
+ * their base_tm values.
+ */
+static const char *parse_fast(const char *text, struct tm *base_tm,
+                              time_t * t)
+{
+    struct tm tm = *base_tm;
+    const char *end, *time_end;
+    long gmtoff = 0;
+    int utc = 0;
+
+    if (isdigit((unsigned char) *text))
+    {
+        end = parse_ymd(text, &tm);
+    }
+    else if (isupper((unsigned char) *text))
+    {
+        end = parse_syslog(text, &tm);
+    }
+    else
+    {
+        return NULL;
+    }
+    if (end == NULL)
+    {
+        return NULL;
+    }
+    if (*end == 'T')
+    {
+        end += 1;
+    }
+    while (*end == ' ')
+    {
+        end += 1;
+    }
+    if ((time_end = parse_hms(end, &tm, &gmtoff, &utc)) != NULL)
+    {
+        end = time_end;
+    }
+    tm.tm_isdst = -1;                  /* force recalculation of dst */
+    *base_tm = tm;
+    *t = utc ? date_timegm(&tm) - gmtoff : mktime(base_tm);
+    return end;
 }
 
 /*
@@ -186,7 +544,7 @@ const char *date_parse_time(const char *text, struct tm *base_tm, time_t * t)
     {
         if (*parse_end == 'Z')
         {
-            *t = timegm_(base_tm);
+            *t = date_timegm(base_tm);
             parse_end += 1;
         }
         else
@@ -210,9 +568,13 @@ const char *date_parse_time(const char *text, struct tm *base_tm, time_t * t)
 const char *date_parse_timestamp(const char *text, struct tm *base_tm,
                                  time_t * t)
 {
-    const char *parse_end = date_parse_date(text, base_tm, t);
+    const char *parse_end = parse_fast(text, base_tm, t);
 
     if (parse_end != NULL)
+    {
+        return parse_end;              /* success: a common format */
+    }
+    if ((parse_end = date_parse_date(text, base_tm, t)) != NULL)
     {
         const char *time_end;
 
@@ -259,17 +621,24 @@ const char *date_parse_timestamp(const char *text, struct tm *base_tm,
  *
  * Remarks:
  * strftime()'s wonderful, but it needs a tm struct to do its
- * magic.  This routine creates one on-the-fly.
+ * magic.  This routine creates one on-the-fly.  The spec is
+ * compiled (once per thread) by date_format_find_(), so repeated
+ * calls with the same spec are much cheaper than strftime().
  */
 char *fmt_time(char *str, size_t size, const char *fmt, time_t t)
 {
+    DateFormat *format = date_format_find_(fmt);
     struct tm tm;
 
     if (t == 0)
     {
         time(&t);                      /* default time: now! */
     }
-    localtime_r(&t, &tm);
+    if (format != NULL)
+    {
+        return str + date_format(format, str, size, t);
+    }
+    date_localtime(t, &tm);
 
     return str + strftime(str, size, fmt, &tm);
 }
@@ -20,6 +20,40 @@ extern "C"
         TIME_T_MAX = 0x7fffffff        /* bit of a hack, but hey... */
     };
 
+    enum date_format_consts
+    {
+        DATE_FORMAT_OP_MAX = 32,       /* max. conversions+literals */
+        DATE_FORMAT_TEXT_MAX = 128,    /* max. spec (and cached text) */
+        DATE_FORMAT_SEC_MAX = 4        /* max. "%S" (etc.) conversions */
+    };
+
+    /*
+     * DateFormatOp{} --A compiled strftime() conversion (or literal).
+     */
+    typedef struct DateFormatOp
+    {
+        unsigned char code;            /* the conversion */
+        unsigned char len;             /* literal/fallback text length */
+        unsigned short offset;         /* ...and its offset in text[] */
+    } DateFormatOp;
+
+    /*
+     * DateFormat{} --A compiled strftime() spec, and its cached text.
+     */
+    typedef struct DateFormat
+    {
+        char spec[DATE_FORMAT_TEXT_MAX];       /* the original spec */
+        char text[DATE_FORMAT_TEXT_MAX];       /* literals, fallback specs */
+        int n_op;
+        DateFormatOp op[DATE_FORMAT_OP_MAX];
+        int cacheable;                 /* only "%S" changes within a minute */
+        time_t minute;                 /* the minute cached[] is for */
+        size_t n_cached;
+        int n_sec;                     /* the "%S" positions in cached[] */
+        unsigned short sec[DATE_FORMAT_SEC_MAX];
+        char cached[DATE_FORMAT_TEXT_MAX];
+    } DateFormat;
+
     extern struct tm null_tm;
     extern const char date_syslog_timestamp[];
     extern const char date_ISO8601_timestamp[];
@@ -36,8 +70,19 @@ extern "C"
                                 time_t * t);
     const char *date_parse_timestamp(const char *text, struct tm *base_tm,
                                      time_t * t);
+    time_t date_timegm(const struct tm *tm);
+    struct tm *date_gmtime(time_t t, struct tm *tm);
+    struct tm *date_localtime(time_t t, struct tm *tm);
     char *fmt_time(char *str, size_t size, const char *fmt, time_t t)
         STRFTIME_ATTRIBUTE(3);
+    int date_format_compile(DateFormat * format, const char *spec);
+    size_t date_format_tm(const DateFormat * format, char *str, size_t size,
+                          const struct tm *tm);
+    size_t date_format(DateFormat * format, char *str, size_t size,
+                       time_t t);
+    size_t date_strftime(char *str, size_t size, const char *spec,
+                         const struct tm *tm) STRFTIME_ATTRIBUTE(3);
+    DateFormat *date_format_find_(const char *spec);
     int adjust_ut(time_t * t, int delta, char *unit);
 #ifdef __cplusplus
 }
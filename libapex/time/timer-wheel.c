@@ -0,0 +1,368 @@
+/*
+ * TIMER-WHEEL.C --A hashed timing wheel, for many short timeouts.
+ *
+ * Contents:
+ * timer_wheel_init()    --Initialise a timing wheel.
+ * timer_wheel_free()    --Release the wheel's storage.
+ * timer_init()          --Initialise a timer.
+ * timer_schedule()      --Schedule (or reschedule) a timer.
+ * timer_cancel()        --Cancel a scheduled timer.
+ * timer_pending()       --Test if a timer is scheduled.
+ * timer_wheel_advance() --Expire all the timers due by some time.
+ * timer_wheel_timeout() --Calculate the timeout until the next expiry.
+ *
+ * Remarks:
+ * Time is measured in ticks since the wheel's start time.  A timer
+ * for tick t is kept on slot list t%n_slot, which is valid because
+ * every timer on the wheel is within n_slot ticks of "now"; timers
+ * further out wait in the far heap (ordered by tick), and are moved
+ * onto the wheel as the wheel advances.  The slot lists are circular
+ * and doubly linked, with the slot itself as sentinel, so a timer
+ * can be removed without knowing which slot it's on.
+ *
+ * A typical event loop is:
+ *
+ *     gettimeofday(&now, NULL);
+ *     timer_wheel_advance(&wheel, &now);
+ *     wait_input(&in, &err, timer_wheel_timeout(&wheel, &now, &tv), ...);
+ *
+ * Expiry callbacks may schedule or cancel any timers, including the
+ * one being expired.
+ */
+#include <stdlib.h>
+#include <apex/timer-wheel.h>
+
+#define USEC 1000000L
+
+/*
+ * tv_usec_since() --Return the time since the wheel's start, in usec.
+ */
+static int64_t tv_usec_since(TimerWheelPtr wheel, TimeValuePtr tv)
+{
+    return (int64_t) (tv->tv_sec - wheel->start.tv_sec) * USEC
+        + (tv->tv_usec - wheel->start.tv_usec);
+}
+
+/*
+ * tv_tick() --Convert a time into a tick (rounding up).
+ */
+static uint64_t tv_tick(TimerWheelPtr wheel, TimeValuePtr tv)
+{
+    int64_t usec = tv_usec_since(wheel, tv);
+
+    return usec <= 0 ? 0 : (uint64_t) ((usec + wheel->tick_usec - 1)
+                                       / wheel->tick_usec);
+}
+
+/*
+ * far_cmp() --Compare two timers (via pointers) in the far heap.
+ */
+static int far_cmp(const void *v_1, const void *v_2)
+{
+    uint64_t t_1 = (*(TimerPtr const *) v_1)->tick;
+    uint64_t t_2 = (*(TimerPtr const *) v_2)->tick;
+
+    return t_1 < t_2 ? -1 : t_1 > t_2;
+}
+
+/*
+ * far_min() --Return the earliest timer in the far heap, or NULL.
+ */
+static TimerPtr far_min(TimerWheelPtr wheel)
+{
+    int handle = iheap_peek(&wheel->far);
+
+    return handle < 0 ? NULL : *(TimerPtr *) iheap_item(&wheel->far, handle);
+}
+
+/*
+ * wheel_insert() --Add a timer to its slot's list.
+ */
+static void wheel_insert(TimerWheelPtr wheel, TimerPtr timer)
+{
+    TimerPtr head = &wheel->slot[timer->tick & (uint64_t) wheel->mask];
+
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+    wheel->n_wheel += 1;
+}
+
+/*
+ * wheel_remove() --Remove a timer from its slot's list.
+ */
+static void wheel_remove(TimerWheelPtr wheel, TimerPtr timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+    wheel->n_wheel -= 1;
+}
+
+/*
+ * timer_wheel_init() --Initialise a timing wheel.
+ *
+ * Parameters:
+ * wheel --specifies and returns the initialised wheel
+ * start --the wheel's start time (e.g. now)
+ * tick --the wheel's resolution
+ * n_slot --the No. of slots (a power of 2); the horizon is n_slot ticks
+ * n_far --the maximum No. of timers beyond the horizon
+ *
+ * Returns: (TimerWheelPtr)
+ * Success: the wheel; Failure: NULL.
+ */
+TimerWheelPtr timer_wheel_init(TimerWheelPtr wheel, TimeValuePtr start,
+                               TimeValuePtr tick, int n_slot, int n_far)
+{
+    if (wheel == NULL || start == NULL || tick == NULL
+        || n_slot <= 0 || (n_slot & (n_slot - 1)) != 0 || n_far <= 0
+        || (wheel->tick_usec = tick->tv_sec * USEC + tick->tv_usec) <= 0)
+    {
+        return NULL;                   /* failure: bad args */
+    }
+    wheel->start = *start;
+    wheel->now = 0;
+    wheel->mask = n_slot - 1;
+    wheel->n_wheel = 0;
+    wheel->slot = malloc(n_slot * sizeof(*wheel->slot));
+    wheel->far_item = malloc(n_far * sizeof(*wheel->far_item));
+    wheel->far_index = malloc(2 * n_far * sizeof(*wheel->far_index));
+    if (wheel->slot == NULL || wheel->far_item == NULL
+        || wheel->far_index == NULL)
+    {
+        timer_wheel_free(wheel);
+        return NULL;                   /* failure: no memory */
+    }
+    for (int i = 0; i < n_slot; ++i)
+    {
+        wheel->slot[i].next = wheel->slot[i].prev = &wheel->slot[i];
+    }
+    iheap_init(&wheel->far, far_cmp, n_far, sizeof(TimerPtr),
+               wheel->far_item, wheel->far_index);
+    return wheel;
+}
+
+/*
+ * timer_wheel_free() --Release the wheel's storage.
+ *
+ * Remarks:
+ * Any scheduled timers are abandoned (and are left "pending").
+ */
+void timer_wheel_free(TimerWheelPtr wheel)
+{
+    free(wheel->slot);
+    free(wheel->far_item);
+    free(wheel->far_index);
+    wheel->slot = NULL;
+    wheel->far_item = NULL;
+    wheel->far_index = NULL;
+}
+
+/*
+ * timer_init() --Initialise a timer.
+ *
+ * Parameters:
+ * timer --specifies and returns the initialised timer
+ * proc --the function to call when the timer expires
+ * data --the data to pass to proc
+ *
+ * Returns: (TimerPtr)
+ * Success: the timer; Failure: NULL.
+ */
+TimerPtr timer_init(TimerPtr timer, TimerProc proc, void *data)
+{
+    if (timer == NULL)
+    {
+        return NULL;                   /* failure: no timer! */
+    }
+    timer->next = timer->prev = NULL;
+    timer->tick = 0;
+    timer->handle = -1;
+    timer->proc = proc;
+    timer->data = data;
+    return timer;
+}
+
+/*
+ * timer_pending() --Test if a timer is scheduled.
+ */
+int timer_pending(TimerPtr timer)
+{
+    return timer->next != NULL || timer->handle >= 0;
+}
+
+/*
+ * timer_cancel() --Cancel a scheduled timer.
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the timer wasn't scheduled).
+ */
+int timer_cancel(TimerWheelPtr wheel, TimerPtr timer)
+{
+    if (timer->next != NULL)
+    {
+        wheel_remove(wheel, timer);
+        return 1;                      /* success: O(1) */
+    }
+    if (timer->handle >= 0)
+    {
+        iheap_remove(&wheel->far, timer->handle);
+        timer->handle = -1;
+        return 1;                      /* success: O(log n) */
+    }
+    return 0;                          /* failure: not scheduled */
+}
+
+/*
+ * timer_schedule() --Schedule (or reschedule) a timer.
+ *
+ * Parameters:
+ * wheel --the wheel
+ * timer --the timer
+ * when --the (absolute) time when the timer should expire
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0 (the far heap is full).
+ *
+ * Remarks:
+ * The expiry time is rounded up to the next tick; times in the past
+ * expire at the next call to timer_wheel_advance().
+ */
+int timer_schedule(TimerWheelPtr wheel, TimerPtr timer, TimeValuePtr when)
+{
+    uint64_t tick = tv_tick(wheel, when);
+
+    timer_cancel(wheel, timer);
+    timer->tick = tick > wheel->now ? tick : wheel->now;
+    if (timer->tick - wheel->now <= (uint64_t) wheel->mask)
+    {
+        wheel_insert(wheel, timer);
+        return 1;                      /* success: on the wheel */
+    }
+    if ((timer->handle = iheap_push(&wheel->far, &timer)) < 0)
+    {
+        return 0;                      /* failure: far heap is full */
+    }
+    return 1;                          /* success: in the far heap */
+}
+
+/*
+ * timer_wheel_advance() --Expire all the timers due by some time.
+ *
+ * Parameters:
+ * wheel --the wheel
+ * now --the current time
+ *
+ * Returns: (int)
+ * The number of timers expired.
+ *
+ * Remarks:
+ * Each tick's slot is detached before its callbacks are run, and
+ * "now" is advanced past it, so a callback that reschedules a
+ * timer for an expired time gets the next tick.  If the wheel is
+ * empty, the wheel jumps straight to the earliest far timer.
+ */
+int timer_wheel_advance(TimerWheelPtr wheel, TimeValuePtr now)
+{
+    int64_t usec = tv_usec_since(wheel, now);
+    uint64_t target = usec < 0 ? 0 : (uint64_t) (usec / wheel->tick_usec);
+    int n = 0;
+
+    while (wheel->now <= target)
+    {
+        TimerPtr far, head, timer;
+        Timer expired;
+
+        if (wheel->n_wheel == 0)
+        {
+            if ((far = far_min(wheel)) == NULL || far->tick > target)
+            {
+                wheel->now = target + 1;
+                break;                 /* nothing (more) due */
+            }
+            if (far->tick > wheel->now)
+            {
+                wheel->now = far->tick;
+            }
+        }
+        while ((far = far_min(wheel)) != NULL
+               && far->tick - wheel->now <= (uint64_t) wheel->mask)
+        {                              /* migrate into the horizon */
+            iheap_remove(&wheel->far, far->handle);
+            far->handle = -1;
+            wheel_insert(wheel, far);
+        }
+        head = &wheel->slot[wheel->now & (uint64_t) wheel->mask];
+        wheel->now += 1;
+        if (head->next == head)
+        {
+            continue;
+        }
+        expired.next = head->next;     /* detach the slot's list */
+        expired.prev = head->prev;
+        expired.next->prev = expired.prev->next = &expired;
+        head->next = head->prev = head;
+        while ((timer = expired.next) != &expired)
+        {
+            wheel_remove(wheel, timer);
+            ++n;
+            if (timer->proc != NULL)
+            {
+                timer->proc(timer, timer->data);
+            }
+        }
+    }
+    return n;
+}
+
+/*
+ * timer_wheel_timeout() --Calculate the timeout until the next expiry.
+ *
+ * Parameters:
+ * wheel --the wheel
+ * now --the current time
+ * timeout --returns the time until the next timer is due
+ *
+ * Returns: (TimeValuePtr)
+ * timeout, or NULL if no timers are scheduled (i.e. suitable for
+ * passing to select(), or wait_input()).
+ *
+ * Remarks:
+ * This scans the wheel's slots from "now", so it's O(n_slot) if the
+ * next timer is far away.
+ */
+TimeValuePtr timer_wheel_timeout(TimerWheelPtr wheel, TimeValuePtr now,
+                                 TimeValuePtr timeout)
+{
+    TimerPtr far = far_min(wheel);
+    uint64_t next = far != NULL ? far->tick : UINT64_MAX;
+    int64_t usec;
+
+    if (wheel->n_wheel > 0)
+    {
+        for (uint64_t t = wheel->now; t < next; ++t)
+        {
+            TimerPtr head = &wheel->slot[t & (uint64_t) wheel->mask];
+
+            if (head->next != head)
+            {
+                next = t;
+                break;
+            }
+        }
+    }
+    if (next == UINT64_MAX)
+    {
+        return NULL;                   /* no timers: wait forever */
+    }
+    usec = (int64_t) next * wheel->tick_usec - tv_usec_since(wheel, now);
+    if (usec < 0)
+    {
+        usec = 0;
+    }
+    timeout->tv_sec = (time_t) (usec / USEC);
+    timeout->tv_usec = (suseconds_t) (usec % USEC);
+    return timeout;
+}
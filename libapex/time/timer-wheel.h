@@ -0,0 +1,65 @@
+/*
+ * TIMER-WHEEL.H --A hashed timing wheel, for many short timeouts.
+ *
+ * Contents:
+ * Timer_t{}      --A timer, owned by the caller.
+ * TimerWheel_t{} --The state of a timing wheel.
+ *
+ * Remarks:
+ * Timers that expire within the wheel's horizon (n_slot ticks) are
+ * kept on the list for their tick's slot, so scheduling and
+ * cancelling them is O(1).  Timers beyond the horizon are kept in an
+ * IndexedHeap, and moved onto the wheel as time reaches them.
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <apex/timeval.h>
+#include <apex/heap.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif                                 /* C++ */
+    struct Timer_t;
+    typedef void (*TimerProc)(struct Timer_t *timer, void *data);
+
+    typedef struct Timer_t
+    {
+        struct Timer_t *next;          /* slot list (NULL: not on wheel) */
+        struct Timer_t *prev;
+        uint64_t tick;                 /* expiry time, in ticks */
+        int handle;                    /* far heap handle, or -1 */
+        TimerProc proc;                /* called when the timer expires */
+        void *data;
+    } Timer, *TimerPtr;
+
+    typedef struct TimerWheel_t
+    {
+        TimeValue start;               /* time of tick 0 */
+        long tick_usec;                /* wheel resolution */
+        uint64_t now;                  /* next tick to be expired */
+        int mask;                      /* n_slot - 1 */
+        int n_wheel;                   /* No. of timers on the wheel */
+        Timer *slot;                   /* slot list heads (sentinels) */
+        IndexedHeap far;               /* timers beyond the horizon */
+        TimerPtr *far_item;
+        int *far_index;
+    } TimerWheel, *TimerWheelPtr;
+
+    TimerWheelPtr timer_wheel_init(TimerWheelPtr wheel, TimeValuePtr start,
+                                   TimeValuePtr tick, int n_slot, int n_far);
+    void timer_wheel_free(TimerWheelPtr wheel);
+    TimerPtr timer_init(TimerPtr timer, TimerProc proc, void *data);
+    int timer_schedule(TimerWheelPtr wheel, TimerPtr timer,
+                       TimeValuePtr when);
+    int timer_cancel(TimerWheelPtr wheel, TimerPtr timer);
+    int timer_pending(TimerPtr timer);
+    int timer_wheel_advance(TimerWheelPtr wheel, TimeValuePtr now);
+    TimeValuePtr timer_wheel_timeout(TimerWheelPtr wheel, TimeValuePtr now,
+                                     TimeValuePtr timeout);
+#ifdef __cplusplus
+}
+#endif                                 /* C++ */
+#endif                                 /* TIMER_WHEEL_H */
@@ -0,0 +1,156 @@
+/*
+ * VECTOR-TYPED.H --Typed, inline vectors generated by a macro.
+ *
+ * Contents:
+ * VECTOR_DEFINE()    --Define a vector type, and its operations.
+ *
+ * Remarks:
+ * The generic vector (vector.h) knows only its elements' size, so
+ * every insert or delete is a memmove() of some No. of bytes, through
+ * a function call.  A vector defined by VECTOR_DEFINE() knows its
+ * element type at compile time, so appending an element is an inline
+ * bounds check and a (fixed-size) assignment, and loops over the
+ * elements can be vectorised.
+ *
+ * e.g.
+ *     VECTOR_DEFINE(LongVector, long)
+ *
+ * defines the type LongVector, and LongVector_init(),
+ * LongVector_free(), LongVector_reserve(), LongVector_push(),
+ * LongVector_add(), LongVector_insert(), LongVector_delete() and
+ * LongVector_shrink().  The elements are item[0...n_used-1], and may
+ * be accessed directly.
+ *
+ * The semantics follow vector_insert() etc.: the storage grows by
+ * (at least) 1.5x, so appending is amortised O(1); inserting past
+ * the end zero-fills the gap; deleting beyond the end is clipped;
+ * and NULL elements for add/insert leave the new slots zeroed.
+ * However, a typed vector is a struct rather than a bare pointer,
+ * and it can't be used with the vector.h functions.
+ */
+#ifndef VECTOR_TYPED_H
+#define VECTOR_TYPED_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#define VECTOR_DEFINE(name_, type_)                                     \
+    typedef struct name_##_t                                            \
+    {                                                                   \
+        type_ *item;                   /* the elements */               \
+        size_t n_used;                 /* No. of elements in use */     \
+        size_t n_el;                   /* No. of elements allocated */  \
+    } name_;                                                            \
+                                                                        \
+    static inline name_ *name_##_init(name_ *vector)                    \
+    {                                                                   \
+        vector->item = NULL;                                            \
+        vector->n_used = vector->n_el = 0;                              \
+        return vector;                                                  \
+    }                                                                   \
+                                                                        \
+    static inline void name_##_free(name_ *vector)                      \
+    {                                                                   \
+        free(vector->item);                                             \
+        name_##_init(vector);                                           \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_resize_(name_ *vector, size_t n_el)       \
+    {                                                                   \
+        type_ *item = realloc(vector->item, n_el * sizeof(type_));      \
+                                                                        \
+        if (item == NULL && n_el > 0)                                   \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        vector->item = item;                                            \
+        vector->n_el = n_el;                                            \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_reserve(name_ *vector, size_t n_el)       \
+    {                                                                   \
+        if (n_el <= vector->n_el)                                       \
+        {                                                               \
+            return 1;                                                   \
+        }                                                               \
+        if (n_el < vector->n_el + vector->n_el / 2)                     \
+        {                                                               \
+            n_el = vector->n_el + vector->n_el / 2;  /* geometric */    \
+        }                                                               \
+        return name_##_resize_(vector, n_el + 16 - n_el % 16);          \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_push(name_ *vector, const type_ *value)   \
+    {                                                                   \
+        if (vector->n_used == vector->n_el                              \
+            && !name_##_reserve(vector, vector->n_used + 1))            \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        vector->item[vector->n_used++] = *value;                        \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_insert(name_ *vector, size_t offset,      \
+                                     size_t n, const type_ *value)      \
+    {                                                                   \
+        size_t end = offset > vector->n_used ? offset : vector->n_used; \
+                                                                        \
+        if (!name_##_reserve(vector, end + n))                          \
+        {                                                               \
+            return 0;                                                   \
+        }                                                               \
+        if (offset > vector->n_used)                                    \
+        {                              /* zero-fill the gap */          \
+            memset(vector->item + vector->n_used, 0,                    \
+                   (offset - vector->n_used) * sizeof(type_));          \
+        }                                                               \
+        else                                                            \
+        {                                                               \
+            memmove(vector->item + offset + n, vector->item + offset,   \
+                    (vector->n_used - offset) * sizeof(type_));         \
+        }                                                               \
+        if (value != NULL)                                              \
+        {                                                               \
+            for (size_t i = 0; i < n; ++i)                              \
+            {                                                           \
+                vector->item[offset + i] = value[i];                    \
+            }                                                           \
+        }                                                               \
+        else                                                            \
+        {                                                               \
+            memset(vector->item + offset, 0, n * sizeof(type_));        \
+        }                                                               \
+        vector->n_used = end + n;                                       \
+        return 1;                                                       \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_add(name_ *vector, size_t n,              \
+                                  const type_ *value)                   \
+    {                                                                   \
+        return name_##_insert(vector, vector->n_used, n, value);        \
+    }                                                                   \
+                                                                        \
+    static inline void name_##_delete(name_ *vector, size_t offset,     \
+                                      size_t n)                         \
+    {                                                                   \
+        if (offset >= vector->n_used)                                   \
+        {                                                               \
+            return;                                                     \
+        }                                                               \
+        if (n > vector->n_used - offset)                                \
+        {                                                               \
+            n = vector->n_used - offset;                                \
+        }                                                               \
+        memmove(vector->item + offset, vector->item + offset + n,       \
+                (vector->n_used - offset - n) * sizeof(type_));         \
+        vector->n_used -= n;                                            \
+    }                                                                   \
+                                                                        \
+    static inline int name_##_shrink(name_ *vector)                     \
+    {                                                                   \
+        return name_##_resize_(vector, vector->n_used);                 \
+    }
+
+#endif /* VECTOR_TYPED_H */
@@ -4,6 +4,10 @@
  * Contents:
  * GET_VECTOR()    --Macro to get back to base of Vector struct.
  * new_vector()    --Allocate a new Vector structure.
+ * new_vector_with() --Allocate a new Vector using a custom allocator.
+ * vector_arena_allocator() --Initialise an allocator that uses an arena.
+ * vector_mmap_allocator() --Initialise an allocator for huge vectors.
+ * vector_page_allocator() --Initialise an allocator with a page policy.
  * free_vector()   --Free an existing Vector structure.
  * vector_info()   --Get the private information about a vector structure.
  * vector_len()    --Return the usable length of a Vector.
@@ -12,6 +16,11 @@
  * vector_add()    --Add some elements to a vector's array.
  * vector_insert() --Add some elements to a vector at a specific offset.
  * vector_delete() --Delete items from a Vector's array.
+ * vector_sort()   --Sort a vector's elements.
+ * vector_merge_sorted() --Add a batch of elements to a sorted vector.
+ * vector_reserve() --Ensure a vector has space for some No. of elements.
+ * vector_shrink() --Release a vector's unused space.
+ * vector_set_growth() --Set the factor by which a vector expands.
  *
  * Remarks:
  * The vector module provides a simple implementation of dynamically
@@ -24,17 +33,30 @@
  *
  * Calls to vector_add() and vector_insert() will extend the allocated
  * size of the vector as required.  To minimise malloc() thrashing,
- * vector-arrays are extended in geometrically increasing chunks.
+ * vector-arrays are extended in geometrically increasing chunks
+ * (by 1.5x, or the factor set by vector_set_growth()).  If the final
+ * size is known in advance, vector_reserve() allocates it in one step,
+ * and vector_shrink() can trim the excess when loading is done.
+ *
+ * By default, vectors are managed with mem_realloc()/mem_free() (so
+ * they're counted in the "vector" module's memory statistics),
+ * but new_vector_with() accepts an alternative allocator, such as
+ * the arena allocator initialised by vector_arena_allocator(), or
+ * the page-mapping allocator of vector_mmap_allocator(), which grows
+ * multi-gigabyte vectors without copying them, or its NUMA/huge-page
+ * variant, vector_page_allocator().
  *
  */
 #include <stddef.h>
 #include <string.h>
 
 #include <apex/log.h>
+#include <apex/mem.h>
 #include <apex/binsearch.h>
 #include <apex/vector.h>
 
 #define VECTOR_ALIGN	8              /* alignment in bytes */
+#define VECTOR_GROWTH	1.5            /* default expansion factor */
 
 /*
  * GET_VECTOR() --Macro to get back to base of Vector struct.
@@ -51,6 +73,37 @@ typedef struct Vector_t
     char vector[];                     /* the actual array */
 } Vector, *VectorPtr;
 
+/*
+ * vector_realloc() --Resize a vector's memory, with its allocator.
+ */
+static void *vector_realloc(VectorAllocatorPtr allocator, void *ptr,
+                            size_t old_size, size_t new_size)
+{
+    if (allocator == NULL)
+    {
+        return mem_realloc(MEM_VECTOR, ptr, new_size);
+    }
+    return allocator->resize(allocator->context, ptr, old_size, new_size);
+}
+
+/*
+ * vector_release() --Release a vector's memory, with its allocator.
+ */
+static void vector_release(VectorPtr v)
+{
+    VectorAllocatorPtr allocator = v->info.allocator;
+
+    if (allocator == NULL)
+    {
+        mem_free(MEM_VECTOR, v);
+    }
+    else if (allocator->release != NULL)
+    {
+        allocator->release(allocator->context, v,
+                           sizeof(Vector) + v->info.n_el * v->info.el_size);
+    }
+}
+
 /*
  * new_vector() --Allocate a new Vector structure.
  *
@@ -67,6 +120,27 @@ typedef struct Vector_t
  * hidden from the caller.
  */
 void *new_vector(size_t el_size, size_t n_el, void *new_el)
+{
+    return new_vector_with(NULL, el_size, n_el, new_el);
+}
+
+/*
+ * new_vector_with() --Allocate a new Vector using a custom allocator.
+ *
+ * Parameters:
+ * allocator --the allocator (NULL: use mem_realloc())
+ * el_size   --the size of each element
+ * n_el  -- an initial allocation of elements
+ * new_el    --the elements to initialise with, or NULL
+ *
+ * Returns: (void *)
+ * Success: pointer to the array part of the Vector; Failure: NULL.
+ *
+ * Remarks:
+ * All subsequent (re-)allocation of the vector uses the allocator.
+ */
+void *new_vector_with(VectorAllocatorPtr allocator, size_t el_size,
+                      size_t n_el, void *new_el)
 {
     VectorPtr vector;
     size_t n_allocated = n_el;         /* No. allocated elements */
@@ -75,15 +149,17 @@ void *new_vector(size_t el_size, size_t n_el, void *new_el)
     {
         n_allocated = 8;               /* require at least 8 elements */
     }
-    if ((vector =
-         (VectorPtr) malloc(sizeof(Vector) + n_allocated * el_size)) ==
-        (VectorPtr) NULL)
+    if ((vector = (VectorPtr) vector_realloc(
+             allocator, NULL, 0, sizeof(Vector) + n_allocated * el_size))
+        == (VectorPtr) NULL)
     {
         return NULL;
     }
     vector->info.n_el = n_allocated;
     vector->info.n_used = n_el;
     vector->info.el_size = el_size;
+    vector->info.growth = VECTOR_GROWTH;
+    vector->info.allocator = allocator;
     if (n_el && new_el)
     {
         memcpy(vector->vector, new_el, n_el * el_size);
@@ -91,6 +167,146 @@ void *new_vector(size_t el_size, size_t n_el, void *new_el)
     return (vector->vector);
 }
 
+/*
+ * arena_resize() --VectorResizeProc for arena-allocated vectors.
+ */
+static void *arena_resize(void *context, void *ptr, size_t old_size,
+                          size_t new_size)
+{
+    return arena_realloc((ArenaPtr) context, ptr, old_size, new_size);
+}
+
+/*
+ * vector_arena_allocator() --Initialise an allocator that uses an arena.
+ * vector_mmap_allocator() --Initialise an allocator for huge vectors.
+ *
+ * Parameters:
+ * allocator --returns the initialised allocator
+ * arena --the arena to allocate from
+ *
+ * Returns: (VectorAllocatorPtr)
+ * Success: allocator; Failure: NULL.
+ *
+ * Remarks:
+ * free_vector() does nothing for arena vectors; the memory is
+ * reclaimed by arena_release() or arena_reset().  A vector that
+ * grows while it's the arena's most recent allocation is extended
+ * in place.
+ */
+VectorAllocatorPtr vector_arena_allocator(VectorAllocatorPtr allocator,
+                                          ArenaPtr arena)
+{
+    if (allocator == NULL || arena == NULL)
+    {
+        return NULL;                   /* failure: bad arguments */
+    }
+    allocator->resize = arena_resize;
+    allocator->release = NULL;
+    allocator->context = arena;
+    return allocator;
+}
+
+/*
+ * mmap_resize() --VectorResizeProc for page-mapped vectors.
+ *
+ * Remarks:
+ * On Linux, page_realloc() uses mremap(), which moves the pages (if
+ * it must move at all) by updating the page tables, so growth doesn't
+ * copy the data.  Elsewhere, the data is copied into a new mapping.
+ */
+static void *mmap_resize(void *UNUSED(context), void *ptr,
+                         size_t old_size, size_t new_size)
+{
+    return page_realloc(ptr, old_size, new_size, PAGE_NODE_ANY, PAGE_MAP);
+}
+
+/*
+ * mmap_release() --VectorReleaseProc for page-mapped vectors.
+ */
+static void mmap_release(void *UNUSED(context), void *ptr, size_t size)
+{
+    page_free(ptr, size, PAGE_MAP);
+}
+
+/*
+ * vector_mmap_allocator() --Initialise an allocator for huge vectors.
+ *
+ * Parameters:
+ * allocator --returns the initialised allocator
+ *
+ * Returns: (VectorAllocatorPtr)
+ * Success: allocator; Failure: NULL.
+ *
+ * Remarks:
+ * The vector is kept in its own anonymous mapping, which is grown (on
+ * Linux) with mremap(), with no copying.  Each vector occupies at
+ * least a page, so this is only worthwhile for very large vectors.
+ * A higher growth factor (e.g. 2.0) also helps, by reducing the
+ * No. of system calls.
+ */
+VectorAllocatorPtr vector_mmap_allocator(VectorAllocatorPtr allocator)
+{
+    if (allocator == NULL)
+    {
+        return NULL;                   /* failure: bad arguments */
+    }
+    allocator->resize = mmap_resize;
+    allocator->release = mmap_release;
+    allocator->context = NULL;
+    return allocator;
+}
+
+/*
+ * page_resize() --VectorResizeProc for vectors with a page policy.
+ */
+static void *page_resize(void *context, void *ptr, size_t old_size,
+                         size_t new_size)
+{
+    const PagePolicy *policy = context;
+
+    return page_realloc(ptr, old_size, new_size, policy->node,
+                        policy->flags | PAGE_MAP);
+}
+
+/*
+ * page_release() --VectorReleaseProc for vectors with a page policy.
+ */
+static void page_release(void *context, void *ptr, size_t size)
+{
+    const PagePolicy *policy = context;
+
+    page_free(ptr, size, policy->flags | PAGE_MAP);
+}
+
+/*
+ * vector_page_allocator() --Initialise an allocator with a page policy.
+ *
+ * Parameters:
+ * allocator --returns the initialised allocator
+ * policy --the NUMA node and page flags (this must outlive the allocator)
+ *
+ * Returns: (VectorAllocatorPtr)
+ * Success: allocator; Failure: NULL.
+ *
+ * Remarks:
+ * This is like vector_mmap_allocator(), but the mapping is placed
+ * according to policy: e.g. on the node of the threads that will
+ * scan it, and/or in huge pages, so that a big vector costs fewer
+ * TLB misses.  (Growth keeps the policy.)
+ */
+VectorAllocatorPtr vector_page_allocator(VectorAllocatorPtr allocator,
+                                         const PagePolicy * policy)
+{
+    if (allocator == NULL || policy == NULL)
+    {
+        return NULL;                   /* failure: bad arguments */
+    }
+    allocator->resize = page_resize;
+    allocator->release = page_release;
+    allocator->context = (void *) policy;
+    return allocator;
+}
+
 /*
  * free_vector() --Free an existing Vector structure.
  *
@@ -101,7 +317,7 @@ void free_vector(void *vector)
 {
     if (vector)
     {
-        free((void *) GET_VECTOR(vector));
+        vector_release(GET_VECTOR(vector));
     }
 }
 
@@ -203,6 +419,33 @@ void *visit_vector(void *vector, VisitProc visit, void *usrdata)
     return NULL;
 }
 
+/*
+ * vector_resize() --Change the allocated No. of elements in a vector.
+ *
+ * Returns: (VectorPtr)
+ * Success: The (possibly realloc'd) vector; Failure: NULL.
+ *
+ * Remarks:
+ * On failure, the original vector is released (as for vector_insert()).
+ */
+static VectorPtr vector_resize(VectorPtr v, size_t n)
+{
+    VectorPtr new_vector;
+
+    debug("realloc(): was %zu, now %zu", v->info.n_el, n);
+    if ((new_vector = vector_realloc(v->info.allocator, v,
+                                     sizeof(Vector)
+                                     + v->info.n_el * v->info.el_size,
+                                     sizeof(Vector) + n * v->info.el_size))
+        == NULL)
+    {
+        vector_release(v);
+        return NULL;                   /* failure: realloc() problem */
+    }
+    new_vector->info.n_el = n;
+    return new_vector;
+}
+
 /*
  * vector_add() --Add some elements to a vector's array.
  *
@@ -234,13 +477,14 @@ void *vector_add(void *vector, size_t n_el, void *new_el)
  * Remarks:
  * vector_insert() inserts items into the vector, expanding it as
  * necessary.  Expansion is done geometrically:  The size of the
- * malloc'd buffer is increased by at least 50% each time.  This is
+ * malloc'd buffer is increased by the vector's growth factor (by
+ * default, at least 50%) each time.  This is
  * important, because linear expansion would lead to malloc-thrashing
  * and O(n^2) performance for some applications of Vector.
  */
 void *vector_insert(void *vector, size_t offset, size_t n_el, void *new_el)
 {
-    VectorPtr v = GET_VECTOR(vector), new_vector;
+    VectorPtr v = GET_VECTOR(vector);
 
     if (vector == NULL)
     {
@@ -249,21 +493,17 @@ void *vector_insert(void *vector, size_t offset, size_t n_el, void *new_el)
 
     if (v->info.n_used + n_el > v->info.n_el)
     {                                  /* not enough slots for n_el items */
-        size_t n = (v->info.n_el / 2) * 3;  /* geometric expansion... */
+        size_t n = (size_t) (v->info.n_el * v->info.growth);   /* geometric... */
+
         if (n < v->info.n_used + n_el)
-        {                              /* ...but caller wants more */
+        {                              /* ...unless caller wants more */
             n = v->info.n_used + n_el;
         }
         n += 16 - n % 16;              /* increment in modulo 16 chunks */
-        debug("realloc(): was %zu, now %zu", v->info.n_el, n);
-        if ((new_vector = realloc(v, sizeof(Vector) + n * v->info.el_size))
-            == NULL)
+        if ((v = vector_resize(v, n)) == NULL)
         {
-            free(v);
             return NULL;               /* failure: realloc() problem */
         }
-        v = new_vector;
-        v->info.n_el = n;
         vector = v->vector;
     }
 
@@ -327,15 +567,198 @@ void *vector_delete(void *vector, size_t offset, size_t n_el)
     v->info.n_used -= n_el;
     if (v->info.n_used < v->info.n_el / 2)
     {                                  /* shrink allocation */
-        VectorPtr new_vector
-            = realloc(v, sizeof(Vector) + v->info.n_used * v->info.el_size);
-        if (new_vector == NULL)
+        if ((v = vector_resize(v, v->info.n_used)) == NULL)
         {
-            free(v);
             return NULL;               /* failure: realloc */
         }
-        v = new_vector;
-        v->info.n_el = v->info.n_used;
     }
     return v->vector;
 }
+
+/*
+ * vector_sort() --Sort a vector's elements.
+ *
+ * Parameters:
+ * vector   -- pointer to the array part of a vector
+ * el_cmp   -- an element comparison function
+ *
+ * Remarks:
+ * This is a convenience wrapper for qsort(); a sorted vector can then
+ * be searched with search_vector(), and maintained with
+ * vector_merge_sorted().
+ */
+void vector_sort(void *vector, CompareProc el_cmp)
+{
+    VectorPtr v = GET_VECTOR(vector);
+
+    if (vector != NULL && v->info.n_used > 1)
+    {
+        qsort(v->vector, v->info.n_used, v->info.el_size, el_cmp);
+    }
+}
+
+/*
+ * vector_merge_sorted() --Add a batch of elements to a sorted vector.
+ *
+ * Parameters:
+ * vector   -- pointer to the array part of a (sorted) vector
+ * n_el  -- the number of elements to add
+ * new_el    -- the new elements to add (in any order)
+ * el_cmp   -- an element comparison function
+ *
+ * Returns: (void *)
+ * Success: The (possibly realloc'd) vector; Failure: NULL.
+ *
+ * Remarks:
+ * The batch is copied and sorted (O(k log k)), then merged into the
+ * vector from the back (O(n + k)), so adding k items to a vector of n
+ * costs much less than k calls to vector_insert() (O(n k)).  The
+ * merge is stable: new elements are placed after equal old ones.
+ * If the sort buffer can't be allocated, the vector is unchanged and
+ * NULL is returned.
+ */
+void *vector_merge_sorted(void *vector, size_t n_el, void *new_el,
+                          CompareProc el_cmp)
+{
+    VectorPtr v = GET_VECTOR(vector);
+    size_t el_size, n;
+    char *batch, *src, *dst, *old;
+
+    if (vector == NULL || (n_el != 0 && new_el == NULL))
+    {
+        return NULL;                   /* failure: bad arguments */
+    }
+    if (n_el == 0)
+    {
+        return vector;                 /* success: nothing to add */
+    }
+    el_size = v->info.el_size;
+    if ((batch = mem_alloc(MEM_VECTOR, n_el * el_size)) == NULL)
+    {
+        return NULL;                   /* failure: no sort buffer */
+    }
+    memcpy(batch, new_el, n_el * el_size);
+    qsort(batch, n_el, el_size, el_cmp);
+
+    n = (size_t) (v->info.n_el * v->info.growth);
+    if (n < v->info.n_used + n_el)
+    {                                  /* (grow geometrically, as insert) */
+        n = v->info.n_used + n_el;
+    }
+    if (v->info.n_used + n_el > v->info.n_el
+        && (vector = vector_reserve(vector, n)) == NULL)
+    {
+        mem_free(MEM_VECTOR, batch);
+        return NULL;                   /* failure: realloc() problem */
+    }
+    v = GET_VECTOR(vector);
+    old = v->vector + v->info.n_used * el_size;        /* (one past) */
+    src = batch + n_el * el_size;
+    dst = old + n_el * el_size;
+    while (src > batch)
+    {                                  /* merge from the back */
+        dst -= el_size;
+        if (old > v->vector && el_cmp(old - el_size, src - el_size) > 0)
+        {
+            old -= el_size;
+            memcpy(dst, old, el_size);
+        }
+        else
+        {
+            src -= el_size;
+            memcpy(dst, src, el_size);
+        }
+    }                                  /* (remaining old items are in place) */
+    v->info.n_used += n_el;
+    mem_free(MEM_VECTOR, batch);
+    return vector;
+}
+
+/*
+ * vector_reserve() --Ensure a vector has space for some No. of elements.
+ *
+ * Parameters:
+ * vector   -- pointer to the array part of a vector
+ * n_el  -- the total number of elements required
+ *
+ * Returns: (void *)
+ * Success: The (possibly realloc'd) vector; Failure: NULL.
+ *
+ * Remarks:
+ * The vector's allocation is set to at least n_el elements, so that
+ * adding up to n_el - n_used elements won't need to realloc().  Note
+ * that vector_delete() may still shrink the allocation.
+ */
+void *vector_reserve(void *vector, size_t n_el)
+{
+    VectorPtr v = GET_VECTOR(vector);
+
+    if (vector == NULL)
+    {
+        return NULL;                   /* failure: bad arguments */
+    }
+    if (n_el <= v->info.n_el)
+    {
+        return vector;                 /* success: already big enough */
+    }
+    if ((v = vector_resize(v, n_el)) == NULL)
+    {
+        return NULL;                   /* failure: realloc() problem */
+    }
+    return v->vector;
+}
+
+/*
+ * vector_shrink() --Release a vector's unused space.
+ *
+ * Parameters:
+ * vector   -- pointer to the array part of a vector
+ *
+ * Returns: (void *)
+ * Success: The (possibly realloc'd) vector; Failure: NULL.
+ */
+void *vector_shrink(void *vector)
+{
+    VectorPtr v = GET_VECTOR(vector);
+
+    if (vector == NULL)
+    {
+        return NULL;                   /* failure: bad arguments */
+    }
+    if (v->info.n_used == v->info.n_el)
+    {
+        return vector;                 /* success: nothing to release */
+    }
+    if ((v = vector_resize(v, v->info.n_used)) == NULL)
+    {
+        return NULL;                   /* failure: realloc() problem */
+    }
+    return v->vector;
+}
+
+/*
+ * vector_set_growth() --Set the factor by which a vector expands.
+ *
+ * Parameters:
+ * vector   -- pointer to the array part of a vector
+ * growth   -- the expansion factor (must be > 1.0)
+ *
+ * Returns: (int)
+ * Success: 1; Failure: 0.
+ *
+ * Remarks:
+ * Larger factors mean fewer realloc() copies, at the cost of more
+ * unused space; 2.0 is a reasonable choice for vectors that grow to
+ * a large, unknown size.
+ */
+int vector_set_growth(void *vector, double growth)
+{
+    VectorPtr v = GET_VECTOR(vector);
+
+    if (vector == NULL || !(growth > 1.0))
+    {
+        return 0;                      /* failure: bad arguments */
+    }
+    v->info.growth = growth;
+    return 1;
+}
@@ -6,6 +6,8 @@
 
 #include <apex.h>
 #include <apex/slink.h>                 /* VisitProc */
+#include <apex/arena.h>
+#include <apex/placement.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -13,6 +15,28 @@ extern "C"
 #endif                                 /* C++ */
 #define NEW_VECTOR(_type_, _n_el_, _new_el_) \
     new_vector(sizeof(_type_), (_n_el_), (_new_el_))
+    /*
+     * VectorAllocator --The memory management functions for a vector.
+     *
+     * Remarks:
+     * resize() is called like realloc() (ptr may be NULL, and new_size
+     * may be smaller), but is also passed the current size; release()
+     * is passed the size too, and may be NULL if the memory is reclaimed
+     * some other way (e.g. by arena_reset()).  The allocator must
+     * outlive its vectors.
+     */
+    typedef void *(*VectorResizeProc)(void *context, void *ptr,
+                                      size_t old_size, size_t new_size);
+    typedef void (*VectorReleaseProc)(void *context, void *ptr,
+                                      size_t size);
+
+    typedef struct VectorAllocator_t
+    {
+        VectorResizeProc resize;
+        VectorReleaseProc release;
+        void *context;                 /* passed to resize(), release() */
+    } VectorAllocator, *VectorAllocatorPtr;
+
     /*
      * VectorInfo   --Housekeeping data used to manage vectors.
      */
@@ -21,9 +45,18 @@ extern "C"
         size_t n_el;                   /* No. allocated elements in the vector */
         size_t n_used;                 /* No. elements actually being used */
         size_t el_size;                /* size of each element */
+        double growth;                 /* expansion factor (default 1.5) */
+        VectorAllocatorPtr allocator;  /* memory management, or NULL */
     } VectorInfo, *VectorInfoPtr;
 
     void *new_vector(size_t elsize, size_t n_el, void *new_el) WARN_UNUSED;
+    void *new_vector_with(VectorAllocatorPtr allocator, size_t el_size,
+                          size_t n_el, void *new_el) WARN_UNUSED;
+    VectorAllocatorPtr vector_arena_allocator(VectorAllocatorPtr allocator,
+                                              ArenaPtr arena);
+    VectorAllocatorPtr vector_mmap_allocator(VectorAllocatorPtr allocator);
+    VectorAllocatorPtr vector_page_allocator(VectorAllocatorPtr allocator,
+                                             const PagePolicy * policy);
     void free_vector(void *vp);
     VectorInfoPtr vector_info(void *vector, VectorInfoPtr viptr);
     int vector_len(void *vp);
@@ -34,6 +67,12 @@ extern "C"
     void *vector_insert(void *vector, size_t offset, size_t n_el,
                         void *new_el) WARN_UNUSED;
     void *vector_delete(void *vector, size_t offset, size_t n_el) WARN_UNUSED;
+    void vector_sort(void *vector, CompareProc el_cmp);
+    void *vector_merge_sorted(void *vector, size_t n_el, void *new_el,
+                              CompareProc el_cmp) WARN_UNUSED;
+    void *vector_reserve(void *vector, size_t n_el) WARN_UNUSED;
+    void *vector_shrink(void *vector) WARN_UNUSED;
+    int vector_set_growth(void *vector, double growth);
 #ifdef __cplusplus
 }
 #endif                                 /* C++ */
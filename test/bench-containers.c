@@ -0,0 +1,507 @@
+/*
+ * BENCH-CONTAINERS.C --Microbenchmarks for the container modules.
+ *
+ * Contents:
+ * compare_str()     --Compare two string items.
+ * compare_long()    --Compare two longs.
+ * compare_link()    --Compare two list items (longs, cast to pointers).
+ * make_keys()       --Create the benchmark's string keys.
+ * bench_hash_churn() --Insert a key into a table, and remove an old one.
+ * bench_hash_find() --Find keys in a table, half of them missing.
+ * bench_vector_add() --Append to a vector.
+ * bench_vector_insert() --Insert into (and delete from) a vector's middle.
+ * bench_search_vector() --Binary-search a sorted vector.
+ * bench_heap()      --Push a random item onto a heap, and pop the least.
+ * bench_queue()     --Push and pop a queue in the same thread.
+ * producer()        --Push items for the cross-thread queue benchmark.
+ * bench_queue_thread() --Pop items pushed by another thread.
+ * bench_pool()      --Allocate and free items from a pool.
+ * bench_malloc()    --Allocate and free items with malloc().
+ * make_list()       --Create an ordered list of the even numbers < 2*N_LINK.
+ * free_list()       --Free an ordered list's links.
+ * bench_clink_insert() --Insert into (and remove from) an ordered list.
+ * bench_clink_find() --Find items in an ordered list.
+ *
+ * Remarks:
+ * Each benchmark runs in a steady state (e.g. the hash table holds
+ * N_KEY/2 keys throughout), so that the time per operation doesn't
+ * depend on how many iterations bench_run() chooses.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/bench.h>
+#include <apex/hash.h>
+#include <apex/vector.h>
+#include <apex/heap.h>
+#include <apex/queue.h>
+#include <apex/pool.h>
+#include <apex/clink.h>
+
+enum
+{
+    N_KEY = 64 * 1024,                 /* (a power of 2) */
+    KEY_SIZE = 16,
+    N_VECTOR = 1000,                   /* vector_insert()'s vector */
+    N_SEARCH = 64 * 1024,              /* search_vector()'s vector */
+    N_HEAP = 1024,
+    N_QUEUE = 1024,
+    N_LIVE = 256,                      /* items allocated at once */
+    ITEM_SIZE = 64,
+    N_LINK = 256
+};
+
+typedef struct HashBench_t
+{
+    HashProc hash;
+    HashPtr table;
+    size_t k;                          /* the oldest key in the table */
+} HashBench;
+
+static char keys[N_KEY][KEY_SIZE];
+
+static void bench_hash_churn(void *data, size_t n_iter);
+static void bench_hash_find(void *data, size_t n_iter);
+static void bench_vector_add(void *data, size_t n_iter);
+static void bench_vector_insert(void *data, size_t n_iter);
+static void bench_search_vector(void *data, size_t n_iter);
+static void bench_heap(void *data, size_t n_iter);
+static void bench_queue(void *data, size_t n_iter);
+static void bench_queue_thread(void *data, size_t n_iter);
+static void bench_pool(void *data, size_t n_iter);
+static void bench_malloc(void *data, size_t n_iter);
+static void bench_clink_insert(void *data, size_t n_iter);
+static void bench_clink_find(void *data, size_t n_iter);
+
+/*
+ * compare_str() --Compare two string items.
+ */
+static int compare_str(const void *data, const void *key)
+{
+    return strcmp((const char *) data, (const char *) key);
+}
+
+/*
+ * compare_long() --Compare two longs.
+ */
+static int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * compare_link() --Compare two list items (longs, cast to pointers).
+ */
+static int compare_link(const void *a, const void *b)
+{
+    return compare_long(&a, &b);
+}
+
+/*
+ * make_keys() --Create the benchmark's string keys.
+ */
+static void make_keys(void)
+{
+    unsigned long x = 88172645463325252ul;
+
+    for (int i = 0; i < N_KEY; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        snprintf(keys[i], KEY_SIZE, "key-%010lu", x % 10000000000ul);
+    }
+}
+
+int main(void)
+{
+    static const struct
+    {
+        const char *name;
+        HashProc hash;
+    } hash_proc[] = {
+        {"pjw", hash_key_pjw},
+        {"elf", hash_key_elf},
+        {"jenkins", hash_key_jenkins},
+        {"wy", hash_key_wy},
+        {"seeded", hash_key_seeded},
+    };
+    char name[64];
+    Heap heap;
+    long heap_items[N_HEAP];
+    AtomicQueue queue;
+    long queue_items[N_QUEUE];
+    Pool pool;
+    static char pool_items[N_LIVE][ITEM_SIZE];
+
+    make_keys();
+    bench_plan(2 * (int) NEL(hash_proc) + 10);
+    for (size_t i = 0; i < NEL(hash_proc); ++i)
+    {
+        HashBench hb = { hash_proc[i].hash, NULL, 0 };
+
+        hb.table = hash_new(hb.hash, N_KEY);
+        for (int k = 0; k < N_KEY / 2; ++k)
+        {
+            hash_insert(hb.table, keys[k]);
+        }
+        snprintf(name, sizeof(name), "hash_insert()+remove() (%s)",
+                 hash_proc[i].name);
+        bench_run(name, bench_hash_churn, &hb, NULL);
+        snprintf(name, sizeof(name), "hash_find() (%s)", hash_proc[i].name);
+        bench_run(name, bench_hash_find, &hb, NULL);
+        hash_free(hb.table);
+    }
+
+    bench_run("vector_add()", bench_vector_add, NULL, NULL);
+    bench_run("vector_insert()+delete() (1000)", bench_vector_insert,
+              NULL, NULL);
+    bench_run("search_vector() (64K)", bench_search_vector, NULL, NULL);
+
+    init_heap(&heap, compare_long, heap_items);
+    bench_run("heap_push()+pop() (512)", bench_heap, &heap, NULL);
+
+    init_queue(&queue, queue_items);
+    bench_run("queue_push()+pop()", bench_queue, &queue, NULL);
+    queue_wait_init(&queue, 0);
+    bench_run("queue_push_wait()/pop_wait() (2 threads)",
+              bench_queue_thread, &queue, NULL);
+    queue_wait_free(&queue);
+
+    init_pool(&pool, pool_items);
+    bench_run("pool_new()+delete()", bench_pool, &pool, NULL);
+    bench_run("malloc()+free()", bench_malloc, NULL, NULL);
+
+    bench_run("clink_insert()+remove() (256)", bench_clink_insert,
+              NULL, NULL);
+    bench_run("clink_find() (256)", bench_clink_find, NULL, NULL);
+    return bench_done();
+}
+
+/*
+ * bench_hash_churn() --Insert a key into a table, and remove an old one.
+ *
+ * Remarks:
+ * The table holds keys [k, k+N_KEY/2) (mod N_KEY) throughout.
+ */
+static void bench_hash_churn(void *data, size_t n_iter)
+{
+    HashBench *hb = data;
+
+    for (size_t i = 0; i < n_iter; ++i, ++hb->k)
+    {
+        hash_insert(hb->table, keys[(hb->k + N_KEY / 2) % N_KEY]);
+        hash_remove(hb->table, compare_str, keys[hb->k % N_KEY]);
+    }
+    do_not_optimise(hb->table);
+}
+
+/*
+ * bench_hash_find() --Find keys in a table, half of them missing.
+ */
+static void bench_hash_find(void *data, size_t n_iter)
+{
+    HashBench *hb = data;
+    size_t n_found = 0;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        n_found += hash_find(hb->table, compare_str,
+                             keys[(i * 7919) % N_KEY]) != NULL;
+    }
+    do_not_optimise(n_found);
+}
+
+/*
+ * bench_vector_add() --Append to a vector.
+ *
+ * Remarks:
+ * The vector is restarted every 1M items, so this includes the
+ * (amortised) cost of growing it.
+ */
+static void bench_vector_add(void *UNUSED(data), size_t n_iter)
+{
+    long *lv = NULL;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        long value = (long) i;
+
+        if ((i & ((1 << 20) - 1)) == 0)
+        {
+            free_vector(lv);
+            lv = NEW_VECTOR(long, 0, NULL);
+        }
+        lv = vector_add(lv, 1, &value);
+    }
+    do_not_optimise(lv);
+    free_vector(lv);
+}
+
+/*
+ * bench_vector_insert() --Insert into (and delete from) a vector's middle.
+ */
+static void bench_vector_insert(void *UNUSED(data), size_t n_iter)
+{
+    long *lv = NEW_VECTOR(long, 0, NULL);
+
+    for (long i = 0; i < N_VECTOR; ++i)
+    {
+        lv = vector_add(lv, 1, &i);
+    }
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        long value = (long) i;
+        size_t offset = (i * 7919) % N_VECTOR;
+
+        lv = vector_insert(lv, offset, 1, &value);
+        lv = vector_delete(lv, (offset + N_VECTOR / 2) % N_VECTOR, 1);
+    }
+    do_not_optimise(lv);
+    free_vector(lv);
+}
+
+/*
+ * bench_search_vector() --Binary-search a sorted vector.
+ */
+static void bench_search_vector(void *UNUSED(data), size_t n_iter)
+{
+    static long *lv = NULL;
+    size_t n_found = 0;
+
+    if (lv == NULL)
+    {                                  /* even numbers: half the keys miss */
+        lv = NEW_VECTOR(long, 0, NULL);
+        for (long i = 0; i < N_SEARCH; ++i)
+        {
+            long value = 2 * i;
+
+            lv = vector_add(lv, 1, &value);
+        }
+    }
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        long key = (long) ((i * 7919) % (2 * N_SEARCH));
+        bool found;
+
+        search_vector(lv, &key, compare_long, &found);
+        n_found += found;
+    }
+    do_not_optimise(n_found);
+}
+
+/*
+ * bench_heap() --Push a random item onto a heap, and pop the least.
+ */
+static void bench_heap(void *data, size_t n_iter)
+{
+    HeapPtr heap = data;
+    unsigned long x = 2463534242ul;
+    long item;
+
+    while (heap->n_used < N_HEAP / 2)
+    {
+        item = (long) heap->n_used;
+        heap_push(heap, &item);
+    }
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        item = (long) (x & 0xffffff);
+        heap_push(heap, &item);
+        heap_pop(heap, &item);
+    }
+    do_not_optimise(item);
+}
+
+/*
+ * bench_queue() --Push and pop a queue in the same thread.
+ */
+static void bench_queue(void *data, size_t n_iter)
+{
+    AtomicQueuePtr queue = data;
+    long item = 0;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        item = (long) i;
+        queue_push(queue, &item);
+        queue_pop(queue, &item);
+    }
+    do_not_optimise(item);
+}
+
+typedef struct Producer_t
+{
+    AtomicQueuePtr queue;
+    size_t n_item;
+} Producer;
+
+/*
+ * producer() --Push items for the cross-thread queue benchmark.
+ */
+static void *producer(void *data)
+{
+    Producer *p = data;
+
+    for (size_t i = 0; i < p->n_item; ++i)
+    {
+        long item = (long) i;
+
+        queue_push_wait(p->queue, &item, NULL);
+    }
+    return NULL;
+}
+
+/*
+ * bench_queue_thread() --Pop items pushed by another thread.
+ *
+ * Remarks:
+ * This uses the blocking calls, so that it measures a hand-off
+ * rather than two spinning threads (which may share a CPU).  The
+ * thread's creation is amortised over n_iter items.
+ */
+static void bench_queue_thread(void *data, size_t n_iter)
+{
+    Producer p = { data, n_iter };
+    pthread_t thread;
+    long item = 0, sum = 0;
+
+    pthread_create(&thread, NULL, producer, &p);
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        queue_pop_wait(p.queue, &item, NULL);
+        sum += item;
+    }
+    pthread_join(thread, NULL);
+    do_not_optimise(sum);
+}
+
+/*
+ * bench_pool() --Allocate and free items from a pool.
+ */
+static void bench_pool(void *data, size_t n_iter)
+{
+    PoolPtr pool = data;
+    void *live[N_LIVE] = { NULL };
+
+    for (size_t i = 0; i < N_LIVE / 2; ++i)
+    {
+        live[i] = pool_new(pool);
+    }
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        size_t slot = (i * 7) % N_LIVE;
+
+        if (live[slot] != NULL)
+        {
+            pool_delete(pool, live[slot]);
+        }
+        live[slot] = pool_new(pool);
+        do_not_optimise(live[slot]);
+    }
+    for (size_t i = 0; i < N_LIVE; ++i)
+    {
+        if (live[i] != NULL)
+        {
+            pool_delete(pool, live[i]);
+        }
+    }
+}
+
+/*
+ * bench_malloc() --Allocate and free items with malloc().
+ */
+static void bench_malloc(void *UNUSED(data), size_t n_iter)
+{
+    void *live[N_LIVE] = { NULL };
+
+    for (size_t i = 0; i < N_LIVE / 2; ++i)
+    {
+        live[i] = malloc(ITEM_SIZE);
+    }
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        size_t slot = (i * 7) % N_LIVE;
+
+        free(live[slot]);
+        live[slot] = malloc(ITEM_SIZE);
+        do_not_optimise(live[slot]);
+    }
+    for (size_t i = 0; i < N_LIVE; ++i)
+    {
+        free(live[i]);
+    }
+}
+
+/*
+ * make_list() --Create an ordered list of the even numbers < 2*N_LINK.
+ */
+static LinkPtr make_list(void)
+{
+    LinkPtr tail = NULL;
+
+    for (long i = N_LINK - 1; i >= 0; --i)
+    {
+        tail = clink_add(tail, link_new(NULL, (void *) (2 * i)));
+    }
+    return tail;
+}
+
+/*
+ * free_list() --Free an ordered list's links.
+ */
+static void free_list(LinkPtr tail)
+{
+    if (tail != NULL)
+    {
+        link_free_links(tail->next, tail);
+    }
+}
+
+/*
+ * bench_clink_insert() --Insert into (and remove from) an ordered list.
+ */
+static void bench_clink_insert(void *UNUSED(data), size_t n_iter)
+{
+    LinkPtr tail = make_list();
+    LinkPtr link;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        long value = (long) ((i * 7919) % (2 * N_LINK)) | 1;
+
+        tail = clink_insert(tail, compare_link, (void *) value,
+                            LINK_INSERT_DUPLICATE);
+        tail = clink_remove(tail, compare_link, (void *) value, &link);
+        link_free(link);
+    }
+    do_not_optimise(tail);
+    free_list(tail);
+}
+
+/*
+ * bench_clink_find() --Find items in an ordered list.
+ */
+static void bench_clink_find(void *UNUSED(data), size_t n_iter)
+{
+    LinkPtr tail = make_list();
+    size_t n_found = 0;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        long key = (long) ((i * 7919) % (2 * N_LINK));
+
+        n_found += clink_find(tail, compare_link, (void *) key) != NULL;
+    }
+    do_not_optimise(n_found);
+    free_list(tail);
+}
@@ -0,0 +1,653 @@
+/*
+ * BENCH-PARSE.C --Throughput benchmarks for the parsers.
+ *
+ * Contents:
+ * Corpus{}          --A generated input, and its records.
+ * rand_next()       --Return the next pseudo-random number.
+ * corpus_split()    --Index a corpus's records (lines).
+ * corpus_free()     --Release a corpus.
+ * corpus_bytes()    --Return a corpus's average record size.
+ * corpus_check()    --Report any records that failed to parse.
+ * make_csv()        --Generate CSV records with mixed types.
+ * make_syslog()     --Generate syslog lines.
+ * nmea_add()        --Add a sentence (after the "$"), with its checksum.
+ * make_nmea()       --Generate NMEA sentences, with checksums.
+ * make_ini()        --Generate an INI file.
+ * make_url()        --Generate URLs.
+ * make_timestamp()  --Generate timestamps in the common formats.
+ * bench_csv_read()  --Read CSV records from a file.
+ * bench_log_fgets() --Read and parse syslog lines from a stream.
+ * bench_log_parse() --Parse syslog lines.
+ * bench_nmea_parse() --Parse NMEA sentences.
+ * bench_ini_load()  --Load an INI file into a symbol table.
+ * bench_str_url()   --Parse URLs.
+ * bench_date_parse() --Parse timestamps.
+ *
+ * Remarks:
+ * Each operation parses one record (or, for ini_load(), one file),
+ * so "op/s" is records per second, and MB/s is computed from the
+ * corpus's average record size.  The corpora are generated from a
+ * fixed seed, so runs are comparable.  BENCH_RECORDS changes the
+ * No. of records in each corpus.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/bench.h>
+#include <apex/strbuf.h>
+#include <apex/csv.h>
+#include <apex/log-parse.h>
+#include <apex/nmea.h>
+#include <apex/ini.h>
+#include <apex/url.h>
+#include <apex/date.h>
+
+#define BENCH_PATH_MAX 4096
+
+/*
+ * Corpus --A generated input, and its records.
+ */
+typedef struct Corpus_t
+{
+    StrBuf text;                       /* the whole input */
+    char *lines;                       /* a copy, split into records */
+    char **record;
+    size_t n_record;
+    size_t next;                       /* the next record to parse */
+    size_t n_fail;                     /* records that failed to parse */
+    FILE *fp;                          /* (for stream-reading parsers) */
+    const char *path;                  /* (for file-reading parsers) */
+    CSVFilePtr csv;
+} Corpus;
+
+static const char *host[] = { "alpha", "bravo", "charlie", "delta" };
+static const char *tag[] = { "kernel", "sshd", "cron", "postfix/smtpd" };
+static const char *word[] = {
+    "connection", "from", "accepted", "closed", "user", "session",
+    "timeout", "queue", "message", "status", "sent", "deferred"
+};
+static const char *month[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static void bench_csv_read(void *data, size_t n_iter);
+static void bench_log_fgets(void *data, size_t n_iter);
+static void bench_log_parse(void *data, size_t n_iter);
+static void bench_nmea_parse(void *data, size_t n_iter);
+static void bench_ini_load(void *data, size_t n_iter);
+static void bench_str_url(void *data, size_t n_iter);
+static void bench_date_parse(void *data, size_t n_iter);
+
+/*
+ * rand_next() --Return the next pseudo-random number.
+ */
+static unsigned long rand_next(void)
+{
+    static unsigned long x = 88172645463325252ul;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+/*
+ * corpus_split() --Index a corpus's records (lines).
+ *
+ * Parameters:
+ * corpus   --the corpus, with its text
+ * skip     --the No. of leading lines (e.g. a header) to skip
+ * keep_eol --keep each record's line terminator
+ */
+static void corpus_split(Corpus * corpus, size_t skip, int keep_eol)
+{
+    size_t n = 0;
+    const char *line = corpus->text.str;
+    char *dst;
+
+    for (const char *s = line; *s != '\0'; ++s)
+    {
+        n += *s == '\n';
+    }
+    corpus->lines = dst = malloc(corpus->text.len + n + 1);
+    corpus->record = calloc(n + 1, sizeof(char *));
+    corpus->n_record = 0;
+    for (const char *s = line; *s != '\0'; ++s)
+    {
+        if (*s == '\n')
+        {
+            size_t len = (size_t) (s - line) + (keep_eol ? 1 : 0);
+
+            if (skip > 0)
+            {
+                --skip;
+            }
+            else
+            {
+                memcpy(dst, line, len);
+                dst[len] = '\0';
+                corpus->record[corpus->n_record++] = dst;
+                dst += len + 1;
+            }
+            line = s + 1;
+        }
+    }
+}
+
+/*
+ * corpus_free() --Release a corpus.
+ */
+static void corpus_free(Corpus * corpus)
+{
+    strbuf_free(&corpus->text);
+    free(corpus->lines);
+    free(corpus->record);
+}
+
+/*
+ * corpus_bytes() --Return a corpus's average record size.
+ */
+static size_t corpus_bytes(const Corpus * corpus)
+{
+    return corpus->n_record > 0 ? corpus->text.len / corpus->n_record : 0;
+}
+
+/*
+ * corpus_check() --Report any records that failed to parse.
+ */
+static void corpus_check(const Corpus * corpus, const char *name)
+{
+    if (corpus->n_fail != 0)
+    {
+        diag("    %s: %zu records failed to parse", name, corpus->n_fail);
+    }
+}
+
+/*
+ * make_csv() --Generate CSV records with mixed types.
+ */
+static void make_csv(Corpus * corpus, size_t n_record)
+{
+    StrBuf *buf = &corpus->text;
+
+    strbuf_str(buf, "id,price,qty,symbol,note\n");
+    for (size_t i = 0; i < n_record; ++i)
+    {
+        unsigned long r = rand_next();
+
+        strbuf_printf(buf, "%zu,%.4f,%lu,%s%lu,", 1000000 + i,
+                      (double) (r % 1000000) / 100.0, r % 5000,
+                      host[r % NEL(host)], r % 100);
+        if (r % 4 == 0)
+        {                              /* quoted, with an embedded comma */
+            strbuf_printf(buf, "\"%s, %s\"\n", word[r % NEL(word)],
+                          word[(r >> 8) % NEL(word)]);
+        }
+        else
+        {
+            strbuf_printf(buf, "%s\n", word[(r >> 8) % NEL(word)]);
+        }
+    }
+    corpus_split(corpus, 1, 0);
+}
+
+/*
+ * make_syslog() --Generate syslog lines.
+ */
+static void make_syslog(Corpus * corpus, size_t n_record)
+{
+    static const char *priority[] = { "info: ", "warning: ", "err: ", "" };
+    StrBuf *buf = &corpus->text;
+
+    for (size_t i = 0; i < n_record; ++i)
+    {
+        unsigned long r = rand_next();
+
+        strbuf_printf(buf, "%s %2lu %02lu:%02lu:%02lu %s %s[%lu]: %s%s %s "
+                      "%lu %s\n", month[i / 100000 % NEL(month)],
+                      1 + i / 10000 % 28, i / 3600 % 24, i / 60 % 60,
+                      i % 60, host[r % NEL(host)],
+                      tag[(r >> 4) % NEL(tag)], 100 + (r >> 8) % 30000,
+                      priority[(r >> 16) % NEL(priority)],
+                      word[(r >> 20) % NEL(word)],
+                      word[(r >> 24) % NEL(word)], r % 65536,
+                      word[(r >> 28) % NEL(word)]);
+    }
+    corpus_split(corpus, 0, 0);
+}
+
+/*
+ * nmea_add() --Add a sentence (after the "$"), with its checksum.
+ */
+static void nmea_add(StrBuf * buf, const char *sentence)
+{
+    strbuf_printf(buf, "$%s*%02X\r\n", sentence,
+                  nmea_checksum(sentence, sentence + strlen(sentence)));
+}
+
+/*
+ * make_nmea() --Generate NMEA sentences, with checksums.
+ */
+static void make_nmea(Corpus * corpus, size_t n_record)
+{
+    StrBuf *buf = &corpus->text;
+    char sentence[NMEA_LINE_MAX];
+
+    for (size_t i = 0; i < n_record; ++i)
+    {
+        unsigned long r = rand_next();
+        unsigned long t = i % 86400;
+        double lat = (double) (r % 900000) / 100.0;
+        double lon = (double) ((r >> 20) % 1800000) / 100.0;
+
+        switch (i % 3)
+        {
+        case 0:
+            snprintf(sentence, sizeof(sentence),
+                     "GPGGA,%02lu%02lu%02lu.%lu,%09.4f,%c,%010.4f,%c,1,%02lu,"
+                     "%.1f,%.1f,M,46.9,M,,", t / 3600, t / 60 % 60, t % 60,
+                     r % 10, lat, (r & 1) ? 'N' : 'S', lon,
+                     (r & 2) ? 'E' : 'W', 4 + r % 9,
+                     (double) (r % 30) / 10.0, (double) (r % 5000) / 10.0);
+            break;
+        case 1:
+            snprintf(sentence, sizeof(sentence),
+                     "GPRMC,%02lu%02lu%02lu,A,%09.4f,%c,%010.4f,%c,%05.1f,"
+                     "%05.1f,%02lu%02lu%02lu,003.1,W", t / 3600,
+                     t / 60 % 60, t % 60, lat, (r & 1) ? 'N' : 'S', lon,
+                     (r & 2) ? 'E' : 'W', (double) (r % 999) / 10.0,
+                     (double) (r % 3600) / 10.0, 1 + r % 28, 1 + r % 12,
+                     r % 100);
+            break;
+        default:
+            snprintf(sentence, sizeof(sentence),
+                     "GPVTG,%05.1f,T,,M,%05.1f,N,%05.1f,K",
+                     (double) (r % 3600) / 10.0, (double) (r % 999) / 10.0,
+                     (double) (r % 1850) / 10.0);
+            break;
+        }
+        nmea_add(buf, sentence);
+    }
+    corpus_split(corpus, 0, 1);
+}
+
+/*
+ * make_ini() --Generate an INI file.
+ *
+ * Remarks:
+ * The INI file is a single "record", of n_section sections.
+ */
+static void make_ini(Corpus * corpus, size_t n_section)
+{
+    StrBuf *buf = &corpus->text;
+
+    strbuf_str(buf, "; generated configuration\n[default]\n"
+               "timeout = 30\nretries = 3\n\n");
+    for (size_t i = 0; i < n_section; ++i)
+    {
+        unsigned long r = rand_next();
+
+        strbuf_printf(buf, "[%s-%zu]\n", host[r % NEL(host)], i);
+        strbuf_printf(buf, "address = 10.%lu.%lu.%lu\n", r % 256,
+                      (r >> 8) % 256, (r >> 16) % 256);
+        strbuf_printf(buf, "port = %lu\n", 1024 + r % 60000);
+        strbuf_printf(buf, "name = \"%s %s\"\n", word[r % NEL(word)],
+                      word[(r >> 4) % NEL(word)]);
+        strbuf_printf(buf, "ratio = %.3f\n", (double) (r % 1000) / 1000.0);
+        strbuf_str(buf, "# a comment\nenabled = yes\n\n");
+    }
+    corpus->record = calloc(1, sizeof(char *));
+    corpus->record[0] = corpus->text.str;
+    corpus->n_record = 1;
+}
+
+/*
+ * make_url() --Generate URLs.
+ */
+static void make_url(Corpus * corpus, size_t n_record)
+{
+    static const char *scheme[] = { "http", "https", "ftp" };
+    StrBuf *buf = &corpus->text;
+
+    for (size_t i = 0; i < n_record; ++i)
+    {
+        unsigned long r = rand_next();
+
+        strbuf_printf(buf, "%s://", scheme[r % NEL(scheme)]);
+        if (r & 0x10)
+        {
+            strbuf_printf(buf, "user%lu:secret@", r % 100);
+        }
+        strbuf_printf(buf, "%s.example.com", host[(r >> 8) % NEL(host)]);
+        if (r & 0x20)
+        {
+            strbuf_printf(buf, ":%lu", 1024 + r % 60000);
+        }
+        strbuf_printf(buf, "/%s/%s/%lu", word[(r >> 12) % NEL(word)],
+                      word[(r >> 16) % NEL(word)], r % 100000);
+        if (r & 0x40)
+        {
+            strbuf_printf(buf, "?id=%lu&sort=%s", r % 1000,
+                          word[(r >> 20) % NEL(word)]);
+        }
+        if (r & 0x80)
+        {
+            strbuf_str(buf, "#top");
+        }
+        strbuf_char(buf, '\n');
+    }
+    corpus_split(corpus, 0, 0);
+}
+
+/*
+ * make_timestamp() --Generate timestamps in the common formats.
+ *
+ * Remarks:
+ * Most are ISO8601 or syslog timestamps (which date_parse_timestamp()
+ * parses directly), but 1 in 8 is "%Y%m%d %H:%M:%S" (which it
+ * parses via strptime()).
+ */
+static void make_timestamp(Corpus * corpus, size_t n_record)
+{
+    StrBuf *buf = &corpus->text;
+
+    for (size_t i = 0; i < n_record; ++i)
+    {
+        unsigned long r = rand_next();
+        unsigned long y = 2000 + r % 30, m = 1 + (r >> 8) % 12;
+        unsigned long d = 1 + (r >> 12) % 28, t = (r >> 20) % 86400;
+
+        switch (i % 8)
+        {
+        case 0:
+        case 1:
+        case 2:
+            strbuf_printf(buf, "%lu-%02lu-%02luT%02lu:%02lu:%02luZ\n",
+                          y, m, d, t / 3600, t / 60 % 60, t % 60);
+            break;
+        case 3:
+        case 4:
+            strbuf_printf(buf, "%lu-%02lu-%02lu %02lu:%02lu:%02lu+05:30\n",
+                          y, m, d, t / 3600, t / 60 % 60, t % 60);
+            break;
+        case 5:
+        case 6:
+            strbuf_printf(buf, "%s %2lu %02lu:%02lu:%02lu\n",
+                          month[m - 1], d, t / 3600, t / 60 % 60, t % 60);
+            break;
+        default:
+            strbuf_printf(buf, "%lu%02lu%02lu %02lu:%02lu:%02lu\n",
+                          y, m, d, t / 3600, t / 60 % 60, t % 60);
+            break;
+        }
+    }
+    corpus_split(corpus, 0, 0);
+}
+
+int main(void)
+{
+    const char *n_str = getenv("BENCH_RECORDS");
+    size_t n_record = n_str != NULL ? strtoul(n_str, NULL, 10) : 100000;
+    const char *tmpdir = getenv("TMPDIR");
+    char path[BENCH_PATH_MAX];
+    Corpus corpus;
+    FILE *fp;
+
+    bench_plan(7);
+
+    memset(&corpus, 0, sizeof(corpus));
+    strbuf_init(&corpus.text);
+    make_csv(&corpus, n_record);
+    snprintf(path, sizeof(path), "%s/bench-parse-%ld.csv",
+             tmpdir != NULL ? tmpdir : "/tmp", (long) getpid());
+    if ((fp = fopen(path, "w")) != NULL)
+    {
+        fputs(corpus.text.str, fp);
+        fclose(fp);
+    }
+    corpus.path = path;
+    bench_run_bytes("csv_read()", bench_csv_read, &corpus,
+                    corpus_bytes(&corpus), NULL);
+    corpus_check(&corpus, "csv_read()");
+    csv_close(corpus.csv);
+    unlink(path);
+    corpus_free(&corpus);
+
+    memset(&corpus, 0, sizeof(corpus));
+    strbuf_init(&corpus.text);
+    make_syslog(&corpus, n_record);
+    corpus.fp = fmemopen(corpus.text.str, corpus.text.len, "r");
+    bench_run_bytes("log_fgets()", bench_log_fgets, &corpus,
+                    corpus_bytes(&corpus), NULL);
+    corpus_check(&corpus, "log_fgets()");
+    fclose(corpus.fp);
+    corpus.n_fail = 0;
+    bench_run_bytes("log_parse_r()", bench_log_parse, &corpus,
+                    corpus_bytes(&corpus), NULL);
+    corpus_check(&corpus, "log_parse_r()");
+    corpus_free(&corpus);
+
+    memset(&corpus, 0, sizeof(corpus));
+    strbuf_init(&corpus.text);
+    make_nmea(&corpus, n_record);
+    bench_run_bytes("nmea_parse()", bench_nmea_parse, &corpus,
+                    corpus_bytes(&corpus), NULL);
+    corpus_check(&corpus, "nmea_parse()");
+    corpus_free(&corpus);
+
+    memset(&corpus, 0, sizeof(corpus));
+    strbuf_init(&corpus.text);
+    make_ini(&corpus, 200);
+    bench_run_bytes("ini_load() (200 sections)", bench_ini_load, &corpus,
+                    corpus.text.len, NULL);
+    corpus_check(&corpus, "ini_load()");
+    corpus_free(&corpus);
+
+    memset(&corpus, 0, sizeof(corpus));
+    strbuf_init(&corpus.text);
+    make_url(&corpus, n_record);
+    bench_run_bytes("str_url()", bench_str_url, &corpus,
+                    corpus_bytes(&corpus), NULL);
+    corpus_check(&corpus, "str_url()");
+    corpus_free(&corpus);
+
+    memset(&corpus, 0, sizeof(corpus));
+    strbuf_init(&corpus.text);
+    make_timestamp(&corpus, n_record);
+    bench_run_bytes("date_parse_timestamp()", bench_date_parse, &corpus,
+                    corpus_bytes(&corpus), NULL);
+    corpus_check(&corpus, "date_parse_timestamp()");
+    corpus_free(&corpus);
+
+    return bench_done();
+}
+
+/*
+ * bench_csv_read() --Read CSV records from a file.
+ *
+ * Remarks:
+ * The file is re-opened at EOF, so the (amortised) cost of
+ * csv_open() is included.  The first three columns are typed, so
+ * csv_read() converts them.
+ */
+static void bench_csv_read(void *data, size_t n_iter)
+{
+    Corpus *corpus = data;
+    Atom value[5];
+    char bytes[CSV_TEXT_MAX];
+    size_t n_read = 0;
+
+    while (n_read < n_iter)
+    {
+        if (corpus->csv == NULL)
+        {
+            if ((corpus->csv = csv_open(corpus->path, "r")) == NULL
+                || corpus->csv->n_field != NEL(value))
+            {
+                ++corpus->n_fail;
+                return;
+            }
+            corpus->csv->field[0].item.type = INTEGER_TYPE;
+            corpus->csv->field[0].scan_fmt = "%ld";
+            corpus->csv->field[1].item.type = REAL_TYPE;
+            corpus->csv->field[1].scan_fmt = "%lf";
+            corpus->csv->field[2].item.type = INTEGER_TYPE;
+            corpus->csv->field[2].scan_fmt = "%ld";
+        }
+        if (csv_read(corpus->csv, NEL(value), value, sizeof(bytes), bytes))
+        {
+            ++n_read;
+        }
+        else
+        {
+            csv_close(corpus->csv);
+            corpus->csv = NULL;
+        }
+    }
+    do_not_optimise(value[1].value.real);
+}
+
+/*
+ * bench_log_fgets() --Read and parse syslog lines from a stream.
+ */
+static void bench_log_fgets(void *data, size_t n_iter)
+{
+    Corpus *corpus = data;
+    static LogRecord record;
+    struct tm base_tm = {.tm_year = 124,.tm_mday = 1,.tm_isdst = -1 };
+    size_t n_read = 0;
+
+    while (n_read < n_iter)
+    {
+        if (log_fgets(&record, corpus->fp, &base_tm) != NULL)
+        {
+            ++n_read;
+        }
+        else if (feof(corpus->fp))
+        {
+            rewind(corpus->fp);
+        }
+        else
+        {
+            ++corpus->n_fail;
+        }
+    }
+    do_not_optimise(record.timestamp);
+}
+
+/*
+ * bench_log_parse() --Parse syslog lines.
+ */
+static void bench_log_parse(void *data, size_t n_iter)
+{
+    Corpus *corpus = data;
+    static LogRecord record;
+    struct tm base_tm = {.tm_year = 124,.tm_mday = 1,.tm_isdst = -1 };
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        if (log_parse_r(&record, corpus->record[corpus->next],
+                        &base_tm) == NULL)
+        {
+            ++corpus->n_fail;
+        }
+        corpus->next = (corpus->next + 1) % corpus->n_record;
+    }
+    do_not_optimise(record.timestamp);
+}
+
+/*
+ * bench_nmea_parse() --Parse NMEA sentences.
+ */
+static void bench_nmea_parse(void *data, size_t n_iter)
+{
+    Corpus *corpus = data;
+    Nmea nmea;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        if (nmea_parse(&nmea, corpus->record[corpus->next]) != NMEA_OK)
+        {
+            ++corpus->n_fail;
+        }
+        corpus->next = (corpus->next + 1) % corpus->n_record;
+    }
+    do_not_optimise(nmea.type);
+}
+
+/*
+ * bench_ini_load() --Load an INI file into a symbol table.
+ */
+static void bench_ini_load(void *data, size_t n_iter)
+{
+    Corpus *corpus = data;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        FILE *fp = fmemopen(corpus->text.str, corpus->text.len, "r");
+        Ini ini = {.name = (char *) "bench.ini",.fp = fp };
+        SymbolPtr sym = ini_load(&ini, NULL);
+
+        if (sym == NULL)
+        {
+            ++corpus->n_fail;
+        }
+        do_not_optimise(sym);
+        ini_sym_free(sym);
+        fclose(fp);
+    }
+}
+
+/*
+ * bench_str_url() --Parse URLs.
+ *
+ * Remarks:
+ * str_url() splits the text in place, so this includes copying it.
+ */
+static void bench_str_url(void *data, size_t n_iter)
+{
+    Corpus *corpus = data;
+    char text[BENCH_PATH_MAX];
+    URL url;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        strcpy(text, corpus->record[corpus->next]);
+        url = null_url;
+        if (!str_url(text, &url))
+        {
+            ++corpus->n_fail;
+        }
+        corpus->next = (corpus->next + 1) % corpus->n_record;
+    }
+    do_not_optimise(url.port);
+}
+
+/*
+ * bench_date_parse() --Parse timestamps.
+ */
+static void bench_date_parse(void *data, size_t n_iter)
+{
+    Corpus *corpus = data;
+    time_t t = 0, sum = 0;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        struct tm base_tm = {.tm_year = 124,.tm_mday = 1,.tm_isdst = -1 };
+
+        if (date_parse_timestamp(corpus->record[corpus->next], &base_tm,
+                                 &t) == NULL)
+        {
+            ++corpus->n_fail;
+        }
+        sum += t;
+        corpus->next = (corpus->next + 1) % corpus->n_record;
+    }
+    do_not_optimise(sum);
+}
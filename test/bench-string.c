@@ -0,0 +1,140 @@
+/*
+ * BENCH-STRING.C --Microbenchmarks for the string routines.
+ *
+ * Contents:
+ * bench_strbuf_str()   --Append strings to a StrBuf.
+ * bench_strbuf_int()   --Format integers into a StrBuf.
+ * bench_strview_split() --Split a line into fields.
+ * bench_strview_int()  --Convert a field to an integer.
+ * bench_str_sub()      --Substitute characters in place.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/bench.h>
+#include <apex/estring.h>
+#include <apex/strbuf.h>
+#include <apex/strview.h>
+
+static const char line[] =
+    "2024-01-15,12:34:56.789,GBPUSD,1.27345,1.27350,1000000,ECN-7";
+
+static void bench_strbuf_str(void *data, size_t n_iter);
+static void bench_strbuf_int(void *data, size_t n_iter);
+static void bench_strview_split(void *data, size_t n_iter);
+static void bench_strview_int(void *data, size_t n_iter);
+static void bench_str_sub(void *data, size_t n_iter);
+
+int main(void)
+{
+    StrBuf buf;
+
+    strbuf_init(&buf);
+    bench_plan(5);
+    bench_run("strbuf_str()", bench_strbuf_str, &buf, NULL);
+    bench_run("strbuf_int()", bench_strbuf_int, &buf, NULL);
+    bench_run("strview_split()", bench_strview_split, NULL, NULL);
+    bench_run("strview_int()", bench_strview_int, NULL, NULL);
+    bench_run("str_sub_()", bench_str_sub, NULL, NULL);
+    strbuf_free(&buf);
+    return bench_done();
+}
+
+/*
+ * bench_strbuf_str() --Append strings to a StrBuf.
+ */
+static void bench_strbuf_str(void *data, size_t n_iter)
+{
+    StrBuf *buf = data;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        if ((i & 63) == 0)
+        {
+            strbuf_clear(buf);
+        }
+        strbuf_str(buf, "GBPUSD,");
+    }
+    do_not_optimise(buf->len);
+}
+
+/*
+ * bench_strbuf_int() --Format integers into a StrBuf.
+ */
+static void bench_strbuf_int(void *data, size_t n_iter)
+{
+    StrBuf *buf = data;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        if ((i & 63) == 0)
+        {
+            strbuf_clear(buf);
+        }
+        strbuf_int(buf, (long long) (i * 2654435761u) - 1000000000);
+    }
+    do_not_optimise(buf->len);
+}
+
+/*
+ * bench_strview_split() --Split a line into fields.
+ */
+static void bench_strview_split(void *UNUSED(data), size_t n_iter)
+{
+    size_t n_field = 0;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        StrView rest = strview_n(line, sizeof(line) - 1);
+        StrView field;
+
+        do_not_optimise(rest.str);
+        while (strview_split(&rest, ',', &field))
+        {
+            n_field += field.len != 0;
+        }
+    }
+    do_not_optimise(n_field);
+}
+
+/*
+ * bench_strview_int() --Convert a field to an integer.
+ */
+static void bench_strview_int(void *UNUSED(data), size_t n_iter)
+{
+    StrView field = STRVIEW_LITERAL("1000000");
+    int value, sum = 0;
+
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        do_not_optimise(field.str);
+        strview_int(field, &value);
+        sum += value;
+    }
+    do_not_optimise(sum);
+}
+
+/*
+ * bench_str_sub() --Substitute characters in place.
+ */
+static void bench_str_sub(void *UNUSED(data), size_t n_iter)
+{
+    char text[sizeof(line)];
+    size_t n_sub = 0;
+
+    memcpy(text, line, sizeof(line));
+    for (size_t i = 0; i < n_iter; ++i)
+    {
+        if (i & 1)
+        {
+            str_sub_(text, ';', ',', &n_sub);
+        }
+        else
+        {
+            str_sub_(text, ',', ';', &n_sub);
+        }
+    }
+    do_not_optimise(n_sub);
+}
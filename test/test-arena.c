@@ -0,0 +1,141 @@
+/*
+ * TEST-ARENA.C --Unit tests for the arena allocator.
+ *
+ * Contents:
+ * test_alloc()    --Test simple allocation, and growth by blocks.
+ * test_mark()     --Test arena_mark()/arena_release(), and arena_reset().
+ * test_realloc()  --Test arena_realloc().
+ * test_str_list() --Test arena_str_list().
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/arena.h>
+#include <apex/estring.h>
+
+static void test_alloc(void);
+static void test_mark(void);
+static void test_realloc(void);
+static void test_str_list(void);
+
+int main(void)
+{
+    plan_tests(13);
+    test_alloc();
+    test_mark();
+    test_realloc();
+    test_str_list();
+    return exit_status();
+}
+
+/*
+ * test_alloc() --Test simple allocation, and growth by blocks.
+ */
+static void test_alloc(void)
+{
+    Arena arena;
+    char *a, *b, *big;
+    int status = 1;
+
+    diag("%s()", __func__);
+    ok(arena_init(&arena, 256) == &arena,
+       "arena_init() returns first argument");
+    a = arena_alloc(&arena, 1);
+    b = arena_alloc(&arena, 1);
+    ok(a != NULL && b == a + ARENA_ALIGN,
+       "consecutive allocations are adjacent and aligned");
+    for (int i = 0; i < 100; ++i)
+    {
+        char *p = arena_alloc(&arena, 24);
+
+        if (p == NULL || ((uintptr_t) p % ARENA_ALIGN) != 0)
+        {
+            status = 0;
+        }
+        else
+        {
+            memset(p, i, 24);
+        }
+    }
+    ok(status, "allocations beyond one block succeed");
+    big = arena_alloc(&arena, 1000);
+    ok(big != NULL, "allocations bigger than a block succeed");
+    memset(big, 0, 1000);
+    arena_free(&arena);
+    ok(arena.block == NULL, "arena_free() releases all blocks");
+}
+
+/*
+ * test_mark() --Test arena_mark()/arena_release(), and arena_reset().
+ */
+static void test_mark(void)
+{
+    Arena arena;
+    ArenaMark mark;
+    char *a, *b;
+
+    diag("%s()", __func__);
+    arena_init(&arena, 256);
+    arena_alloc(&arena, 32);
+    arena_mark(&arena, &mark);
+    a = arena_alloc(&arena, 32);
+    for (int i = 0; i < 20; ++i)
+    {
+        arena_alloc(&arena, 64);
+    }
+    arena_release(&arena, &mark);
+    b = arena_alloc(&arena, 32);
+    ok(a == b, "arena_release() winds back to the mark");
+    ok(arena.block->next == NULL, "arena_release() frees newer blocks");
+    arena_alloc(&arena, 1000);
+    arena_reset(&arena);
+    ok(arena.block != NULL && arena.block->next == NULL,
+       "arena_reset() keeps one block");
+    arena_free(&arena);
+}
+
+/*
+ * test_realloc() --Test arena_realloc().
+ */
+static void test_realloc(void)
+{
+    Arena arena;
+    char *a, *b, *c;
+
+    diag("%s()", __func__);
+    arena_init(&arena, 256);
+    a = arena_realloc(&arena, NULL, 0, 16);
+    strcpy(a, "hello");
+    b = arena_realloc(&arena, a, 16, 64);
+    ok(b == a && arena.next == a + 64,
+       "arena_realloc() grows the last allocation in place");
+    arena_alloc(&arena, 16);
+    c = arena_realloc(&arena, b, 64, 128);
+    ok(c != b && strcmp(c, "hello") == 0,
+       "arena_realloc() copies other allocations");
+    arena_free(&arena);
+}
+
+/*
+ * test_str_list() --Test arena_str_list().
+ */
+static void test_str_list(void)
+{
+    Arena arena;
+    char **list;
+
+    diag("%s()", __func__);
+    arena_init(&arena, 0);
+    list = arena_str_list(&arena, "a:bb:ccc", ':');
+    ok(list != NULL && strcmp(list[0], "a") == 0
+       && strcmp(list[1], "bb") == 0 && strcmp(list[2], "ccc") == 0,
+       "arena_str_list() splits the string");
+    ok(list != NULL && list[3] == NULL, "arena_str_list() is NULL-terminated");
+    ok(arena_str_list(&arena, NULL, ':') == NULL,
+       "arena_str_list() fails on a NULL string");
+    arena_free(&arena);
+}
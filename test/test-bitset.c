@@ -0,0 +1,260 @@
+/*
+ * BITSET.C --Unit tests for bitsets, roaring bitmaps and bitmap pools.
+ *
+ * Contents:
+ * test_bitset()    --Set, test, search and count.
+ * test_ops()       --and/or/andnot/xor, against a bit-at-a-time model.
+ * test_roaring()   --Roaring bitmaps, sparse and dense.
+ * churn()          --Allocate and delete bitmap pool items.
+ * test_bpool()     --Bitmap pools, single and multi-threaded.
+ * main()           --Tests entrypoint.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apex/test.h>
+#include <apex/bitset.h>
+#include <apex/pool.h>
+
+enum
+{
+    N_BITS = 10007,                    /* (not a multiple of 64) */
+    N_THREAD = 4,
+    N_ITEM = 256
+};
+
+/*
+ * test_bitset() --Set, test, search and count.
+ */
+static void test_bitset(void)
+{
+    BitsetPtr set = bitset_new(N_BITS);
+    uint64_t word[BITSET_WORDS(100)];
+    Bitset fixed;
+    size_t n = 0, i;
+    int n_wrong = 0;
+
+    ok(set != NULL && bitset_count(set) == 0
+       && bitset_next(set, 0) == N_BITS, "bitset_new()");
+    for (i = 0; i < N_BITS; i += 7)
+    {
+        bitset_set(set, i);
+        n += 1;
+    }
+    ok(bitset_count(set) == n && bitset_test(set, 7) && !bitset_test(set, 8),
+       "bitset_set(), bitset_test(), bitset_count()");
+    for (i = 0; i < N_BITS; ++i)
+    {
+        size_t next = bitset_next(set, i), prev = bitset_prev(set, i);
+
+        n_wrong += next != (i % 7 == 0 ? i : MIN(i + 7 - i % 7, N_BITS));
+        n_wrong += prev != i - i % 7;
+        n_wrong += bitset_next_clear(set, i) != (i % 7 == 0 ? i + 1 : i)
+            && i != N_BITS - 1;
+    }
+    ok(n_wrong == 0, "bitset_next(), bitset_prev(), bitset_next_clear()");
+    bitset_fill(set, 1);
+    ok(bitset_count(set) == N_BITS
+       && bitset_next_clear(set, 0) == N_BITS, "bitset_fill(1)");
+    bitset_unset(set, N_BITS - 1);
+    ok(bitset_prev(set, N_BITS) == N_BITS - 2
+       && bitset_next_clear(set, 0) == N_BITS - 1, "bitset_unset()");
+    ok(bitset_resize(set, 5 * N_BITS) && bitset_count(set) == N_BITS - 1
+       && bitset_next(set, N_BITS - 1) == N_BITS * 5, "grow");
+    ok(bitset_resize(set, 100) && bitset_count(set) == 100, "shrink");
+    bitset_free(set);
+
+    ok(bitset_init(&fixed, 100, word) && bitset_count(&fixed) == 0
+       && !bitset_resize(&fixed, 200), "bitset_init()");
+}
+
+/*
+ * test_ops() --and/or/andnot/xor, against a bit-at-a-time model.
+ */
+static void test_ops(void)
+{
+    BitsetPtr a = bitset_new(N_BITS), b = bitset_new(N_BITS);
+    BitsetPtr small = bitset_new(100);
+    int n_wrong = 0;
+    char model_a[N_BITS], model_b[N_BITS];
+
+    srand(1);
+    for (BitsetOp op = BITSET_AND; op <= BITSET_XOR; ++op)
+    {
+        for (size_t i = 0; i < N_BITS; ++i)
+        {
+            model_a[i] = rand() % 2;
+            model_b[i] = rand() % 3 == 0;
+            (model_a[i] ? bitset_set : bitset_unset) (a, i);
+            (model_b[i] ? bitset_set : bitset_unset) (b, i);
+        }
+        bitset_op(a, b, op);
+        for (size_t i = 0; i < N_BITS; ++i)
+        {
+            int want = op == BITSET_AND ? model_a[i] & model_b[i]
+                : op == BITSET_OR ? model_a[i] | model_b[i]
+                : op == BITSET_ANDNOT ? model_a[i] & !model_b[i]
+                : model_a[i] ^ model_b[i];
+
+            n_wrong += bitset_test(a, i) != want;
+        }
+    }
+    ok(n_wrong == 0, "bitset_op()");
+    bitset_fill(a, 1);
+    bitset_fill(small, 1);
+    bitset_and(a, small);
+    ok(bitset_count(a) == 100, "bitset_and() with a smaller set");
+    bitset_fill(b, 1);
+    bitset_or(small, b);
+    ok(bitset_count(small) == 100, "bitset_or() with a larger set");
+    bitset_free(a);
+    bitset_free(b);
+    bitset_free(small);
+}
+
+/*
+ * test_roaring() --Roaring bitmaps, sparse and dense.
+ */
+static void test_roaring(void)
+{
+    RoaringPtr r = roaring_new(), s = roaring_new();
+    uint32_t v = 0;
+    size_t n = 0;
+    int n_wrong = 0, found;
+
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        roaring_add(r, i * 1000003u);   /* (sparse: arrays) */
+        roaring_add(s, 5000000 + i);    /* (dense: bitsets) */
+    }
+    ok(roaring_count(r) == 100000 && roaring_count(s) == 100000,
+       "roaring_add()");
+    ok(roaring_contains(r, 1000003u * 77) && !roaring_contains(r, 77)
+       && roaring_contains(s, 5000000) && !roaring_contains(s, 4999999),
+       "roaring_contains()");
+    ok(roaring_bytes(s) < 100000 / 8 + 4 * 8192,
+       "dense members take about a bit each (%zu bytes)", roaring_bytes(s));
+    for (found = roaring_next(s, 0, &v); found;
+         found = v < UINT32_MAX && roaring_next(s, v + 1, &v))
+    {
+        n_wrong += v != 5000000 + n;
+        n += 1;
+    }
+    ok(n_wrong == 0 && n == 100000, "roaring_next() traversal");
+
+    for (uint32_t i = 0; i < 100000; i += 2)
+    {
+        roaring_remove(s, 5000000 + i);
+    }
+    ok(roaring_count(s) == 50000 && !roaring_contains(s, 5000000)
+       && roaring_contains(s, 5000001), "roaring_remove()");
+
+    roaring_clear(r);
+    for (uint32_t i = 0; i < 200000; i += 3)
+    {
+        roaring_add(r, 5000000 + i);
+    }
+    roaring_op(r, s, BITSET_AND);      /* (odd multiples of 3) */
+    n = 0;
+    n_wrong = 0;
+    for (found = roaring_next(r, 0, &v); found;
+         found = roaring_next(r, v + 1, &v))
+    {
+        n_wrong += (v - 5000000) % 6 != 3;
+        n += 1;
+    }
+    ok(n_wrong == 0 && n == 16667 && roaring_count(r) == n,
+       "roaring_op(AND)");
+    roaring_op(r, s, BITSET_OR);
+    ok(roaring_count(r) == 50000, "roaring_op(OR)");
+    roaring_add(r, 7);
+    roaring_op(r, s, BITSET_ANDNOT);
+    ok(roaring_count(r) == 1 && roaring_contains(r, 7),
+       "roaring_op(ANDNOT)");
+    roaring_op(r, s, BITSET_XOR);
+    ok(roaring_count(r) == 50001, "roaring_op(XOR)");
+    roaring_free(r);
+    roaring_free(s);
+}
+
+/*
+ * churn() --Allocate and delete bitmap pool items.
+ */
+static void *churn(void *data)
+{
+    BPoolPtr pool = data;
+    long *item[N_ITEM / N_THREAD];
+    long *bad = NULL;
+
+    for (int round = 0; round < 2000; ++round)
+    {
+        for (size_t i = 0; i < NEL(item); ++i)
+        {
+            item[i] = bpool_new(pool);
+            *item[i] = (long) pthread_self();
+        }
+        for (size_t i = 0; i < NEL(item); ++i)
+        {
+            if (*item[i] != (long) pthread_self())
+            {
+                bad = item[i];         /* (shared with another thread) */
+            }
+            bpool_delete(pool, item[i]);
+        }
+    }
+    return bad;
+}
+
+/*
+ * test_bpool() --Bitmap pools, single and multi-threaded.
+ */
+static void test_bpool(void)
+{
+    static long items[N_ITEM];
+    uint64_t bits[BITSET_WORDS(N_ITEM)];
+    BPool pool;
+    pthread_t thread[N_THREAD];
+    void *item[N_ITEM], *result;
+    int n_bad = 0;
+
+    ok(init_bpool(&pool, items, bits) != NULL, "bpool_init()");
+    for (int i = 0; i < N_ITEM; ++i)
+    {
+        item[i] = bpool_new(&pool);
+    }
+    ok(item[N_ITEM - 1] != NULL && bpool_new(&pool) == NULL
+       && bitset_count(&pool.used) == N_ITEM, "bpool_new() until empty");
+    bpool_delete(&pool, item[10]);
+    ok(bpool_new(&pool) == item[10], "bpool_delete() frees the slot");
+    for (int i = 0; i < N_ITEM; ++i)
+    {
+        bpool_delete(&pool, item[i]);
+    }
+
+    for (int i = 0; i < N_THREAD; ++i)
+    {
+        pthread_create(&thread[i], NULL, churn, &pool);
+    }
+    for (int i = 0; i < N_THREAD; ++i)
+    {
+        pthread_join(thread[i], &result);
+        n_bad += result != NULL;
+    }
+    ok(n_bad == 0 && bitset_count(&pool.used) == 0,
+       "concurrent bpool_new()/bpool_delete()");
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(24);
+
+    test_bitset();
+    test_ops();
+    test_roaring();
+    test_bpool();
+
+    return exit_status();
+}
@@ -0,0 +1,296 @@
+/*
+ * BTREE.C --Unit tests for the B+tree ordered map.
+ *
+ * Contents:
+ * str_cmp()        --Compare two string keys.
+ * node_ok()        --Check a subtree's ordering, separators and fill.
+ * tree_ok()        --Check a tree's structure.
+ * test_long()      --Random puts and removes, against a reference array.
+ * test_range()     --Seek, and range traversal.
+ * test_load()      --Bulk loading.
+ * test_strings()   --Pointer keys with a CompareProc.
+ * main()           --Tests entrypoint.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apex/test.h>
+#include <apex/btree.h>
+
+enum
+{
+    N_KEY = 20000
+};
+
+/*
+ * str_cmp() --Compare two string keys.
+ */
+static int str_cmp(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+/*
+ * node_ok() --Check a subtree's ordering, separators and fill.
+ *
+ * Remarks:
+ * Every key in the subtree must be in [lo, hi) (NULL: unbounded),
+ * and every leaf must be at the same depth.
+ */
+static int node_ok(BTreePtr tree, BTreeNodePtr node, const BTreeKey *lo,
+                   const BTreeKey *hi, int depth)
+{
+#define LESS(a_, b_) (tree->cmp != NULL ? tree->cmp((a_).p, (b_).p) < 0 \
+                      : (a_).l < (b_).l)
+    if (node != tree->root && node->n_keys < BTREE_ORDER / 2 - 1)
+    {
+        return 0;
+    }
+    for (int i = 0; i < node->n_keys; ++i)
+    {
+        if ((i > 0 && !LESS(node->key[i - 1], node->key[i]))
+            || (lo != NULL && LESS(node->key[i], *lo))
+            || (hi != NULL && !LESS(node->key[i], *hi)))
+        {
+            return 0;
+        }
+    }
+    if (node->leaf)
+    {
+        return depth == tree->height;
+    }
+    for (int i = 0; i <= node->n_keys; ++i)
+    {
+        if (!node_ok(tree, node->child[i], i > 0 ? &node->key[i - 1] : lo,
+                     i < node->n_keys ? &node->key[i] : hi, depth + 1))
+        {
+            return 0;
+        }
+    }
+    return 1;
+#undef LESS
+}
+
+/*
+ * tree_ok() --Check a tree's structure.
+ */
+static int tree_ok(BTreePtr tree)
+{
+    return tree->root == NULL
+        || node_ok(tree, tree->root, NULL, NULL, 1);
+}
+
+/*
+ * test_long() --Random puts and removes, against a reference array.
+ */
+static void test_long(void)
+{
+    BTreePtr tree = btree_new(NULL);
+    static char present[N_KEY];
+    size_t n_present = 0;
+    int n_wrong = 0;
+    void *old;
+    BTreeCursor cursor;
+    BTreeKey key;
+    void *value;
+    long prev = -1;
+
+    srand(1);
+    for (int i = 0; i < 4 * N_KEY; ++i)
+    {
+        long k = rand() % N_KEY;
+
+        if (rand() % 3 != 0)
+        {
+            btree_put_long(tree, k, (void *) (k + 1), &old);
+            n_wrong += (old != NULL) != present[k];
+            n_present += !present[k];
+            present[k] = 1;
+        }
+        else
+        {
+            n_wrong += (btree_remove_long(tree, k) != NULL) != present[k];
+            n_present -= present[k];
+            present[k] = 0;
+        }
+    }
+    ok(n_wrong == 0 && tree->n_items == n_present,
+       "btree_put_long(), btree_remove_long()");
+    ok(tree_ok(tree), "tree structure is valid (height %d)", tree->height);
+    for (long k = 0; k < N_KEY; ++k)
+    {
+        value = btree_get_long(tree, k);
+        n_wrong += present[k] ? value != (void *) (k + 1) : value != NULL;
+    }
+    ok(n_wrong == 0, "btree_get_long()");
+    n_present = 0;
+    for (btree_first(&cursor, tree); btree_next(&cursor, &key, &value);)
+    {
+        n_wrong += key.l <= prev || !present[key.l];
+        prev = key.l;
+        n_present += 1;
+    }
+    ok(n_wrong == 0 && n_present == tree->n_items, "traversal is in order");
+
+    for (long k = 0; k < N_KEY; ++k)
+    {
+        btree_remove_long(tree, k);
+    }
+    btree_first(&cursor, tree);
+    ok(tree->n_items == 0 && tree->height == 1
+       && !btree_next(&cursor, NULL, NULL), "remove all");
+    btree_free(tree);
+}
+
+/*
+ * test_range() --Seek, and range traversal.
+ */
+static void test_range(void)
+{
+    BTreePtr tree = btree_new(NULL);
+    BTreeCursor cursor;
+    BTreeKey key;
+    long sum = 0;
+    int n = 0;
+
+    for (long k = 0; k < 1000; ++k)
+    {
+        btree_put_long(tree, k * 10, NULL, NULL);
+    }
+    for (btree_seek_long(&cursor, tree, 95);
+         btree_next(&cursor, &key, NULL) && key.l < 200;)
+    {
+        sum += key.l;
+        n += 1;
+    }
+    ok(n == 10 && sum == 1450, "range [95, 200)");
+    btree_seek_long(&cursor, tree, 9990);
+    ok(btree_next(&cursor, &key, NULL) && key.l == 9990
+       && !btree_next(&cursor, &key, NULL), "seek to the last key");
+    btree_seek_long(&cursor, tree, 10000);
+    ok(!btree_next(&cursor, &key, NULL), "seek past the last key");
+    btree_seek_long(&cursor, tree, -5);
+    ok(btree_next(&cursor, &key, NULL) && key.l == 0,
+       "seek before the first key");
+    btree_free(tree);
+}
+
+/*
+ * test_load() --Bulk loading.
+ */
+static void test_load(void)
+{
+    static long keys[N_KEY];
+    BTreePtr tree = btree_new(NULL);
+    BTreeCursor cursor;
+    BTreeKey key;
+    int n_wrong = 0, n_fail = 0;
+    size_t sizes[] = { 1, 20, 25, 33, 500, N_KEY };
+
+    for (size_t i = 0; i < NEL(keys); ++i)
+    {
+        keys[i] = 2 * (long) i;
+    }
+    for (size_t s = 0; s < NEL(sizes); ++s)
+    {
+        long k = 0;
+
+        btree_clear(tree);
+        n_fail += !btree_load_long(tree, keys, NULL, sizes[s])
+            || !tree_ok(tree);
+        for (btree_first(&cursor, tree); btree_next(&cursor, &key, NULL);)
+        {
+            n_wrong += key.l != k;
+            k += 2;
+        }
+        n_wrong += k != 2 * (long) sizes[s];
+    }
+    ok(n_fail == 0 && n_wrong == 0, "btree_load_long()");
+    ok(!btree_load_long(tree, keys, NULL, 10), "load fails if not empty");
+    btree_clear(tree);
+    keys[5] = keys[4];
+    ok(!btree_load_long(tree, keys, NULL, 10),
+       "load fails if not sorted");
+    keys[5] = 10;
+    btree_load_long(tree, keys, NULL, N_KEY);
+    for (long k = 1; k < 2 * N_KEY; k += 2)
+    {
+        btree_put_long(tree, k, NULL, NULL);
+    }
+    for (long k = 0; k < 2 * N_KEY; k += 4)
+    {
+        btree_remove_long(tree, k);
+    }
+    ok(tree->n_items == N_KEY + N_KEY / 2 && tree_ok(tree),
+       "puts and removes after a load");
+    btree_free(tree);
+}
+
+/*
+ * test_strings() --Pointer keys with a CompareProc.
+ */
+static void test_strings(void)
+{
+    BTreePtr tree = btree_new(str_cmp);
+    char *keys[1000];
+    void *old;
+    BTreeCursor cursor;
+    BTreeKey key;
+    int n = 0;
+
+    for (size_t i = 0; i < NEL(keys); ++i)
+    {
+        keys[i] = malloc(8);
+        snprintf(keys[i], 8, "k%04zu", (i * 7) % NEL(keys));
+        btree_put(tree, keys[i], keys[i], NULL);
+    }
+    ok(tree->n_items == NEL(keys) && tree_ok(tree), "btree_put()");
+    string_eq(btree_get(tree, "k0123"), "k0123", "btree_get()");
+    ok(btree_get(tree, "k9999") == NULL, "btree_get(): missing");
+    for (btree_seek(&cursor, tree, "k05"); btree_next(&cursor, &key, NULL)
+         && strcmp(key.p, "k06") < 0;)
+    {
+        n += 1;
+    }
+    ok(n == 100, "btree_seek() range");
+
+    /* (free the keys as they're removed, so stale separators would fail) */
+    for (size_t i = 0; i < NEL(keys); i += 2)
+    {
+        char *k = btree_remove(tree, keys[i]);
+
+        memset(k, 'x', 7);
+        free(k);
+    }
+    {
+        char *k = strdup("k0007");    /* (keys[1]'s key) */
+
+        btree_put(tree, k, k, &old);
+        memset(old, 'x', 7);
+        free(old);
+        keys[1] = k;
+    }
+    ok(tree->n_items == NEL(keys) / 2 && tree_ok(tree),
+       "btree_remove() updates separators");
+    for (size_t i = 1; i < NEL(keys); i += 2)
+    {
+        free(btree_remove(tree, keys[i]));
+    }
+    ok(tree->n_items == 0, "remove all");
+    btree_free(tree);
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(19);
+
+    test_long();
+    test_range();
+    test_load();
+    test_strings();
+
+    return exit_status();
+}
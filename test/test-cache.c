@@ -0,0 +1,144 @@
+/*
+ * CACHE.C --Unit tests for the bounded CLOCK cache.
+ *
+ * Contents:
+ * fake_now()       --A test clock.
+ * on_evict()       --Count (and free) evicted values.
+ * test_basic()     --Put, get, replace and remove.
+ * test_evict()     --Byte-bounded CLOCK eviction.
+ * test_ttl()       --Default and per-entry TTLs.
+ * main()           --Tests entrypoint.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apex/test.h>
+#include <apex/cache.h>
+
+static TimeNs now_ns = 1;
+static int n_reason[CACHE_REMOVED + 1];
+
+/*
+ * fake_now() --A test clock.
+ */
+static TimeNs fake_now(void)
+{
+    return now_ns;
+}
+
+/*
+ * on_evict() --Count (and free) evicted values.
+ */
+static void on_evict(const char *UNUSED(key), void *value,
+                     CacheReason reason, void *data)
+{
+    ++*(int *) data;
+    n_reason[reason] += 1;
+    free(value);
+}
+
+/*
+ * test_basic() --Put, get, replace and remove.
+ */
+static void test_basic(void)
+{
+    int n_evict = 0;
+    CachePtr cache = cache_new(1 << 20, NULL, on_evict, &n_evict);
+    CacheStats stats;
+
+    ok(cache_put(cache, "example.com", strdup("93.184.216.34"), 14),
+       "cache_put()");
+    string_eq(cache_get(cache, "example.com"), "93.184.216.34",
+              "cache_get(): hit");
+    ok(cache_get(cache, "example.org") == NULL, "cache_get(): miss");
+    cache_put(cache, "example.com", strdup("93.184.216.35"), 14);
+    string_eq(cache_get(cache, "example.com"), "93.184.216.35",
+              "cache_put() replaces a value");
+    ok(n_reason[CACHE_REPLACED] == 1, "replaced value is released");
+    ok(cache_remove(cache, "example.com") && !cache_remove(cache, "x")
+       && n_reason[CACHE_REMOVED] == 1, "cache_remove()");
+    cache_stats(cache, &stats);
+    ok(stats.n_hit == 2 && stats.n_miss == 1 && stats.n_items == 0
+       && stats.n_bytes == 0, "cache_stats()");
+    cache_put(cache, "a", strdup("1"), 2);
+    cache_put(cache, "b", strdup("2"), 2);
+    cache_free(cache);
+    ok(n_evict == 4, "cache_free() releases the values");
+}
+
+/*
+ * test_evict() --Byte-bounded CLOCK eviction.
+ */
+static void test_evict(void)
+{
+    size_t entry_size = sizeof(CacheEntry) + 4 + 100;  /* key "kNN" */
+    CachePtr cache = cache_new(10 * entry_size, NULL, on_evict, NULL);
+    int n_evict = 0, n_present = 0;
+    char key[16];
+    CacheStats stats;
+
+    cache->evict_data = &n_evict;
+    for (int i = 0; i < 10; ++i)
+    {
+        snprintf(key, sizeof(key), "k%02d", i);
+        cache_put(cache, key, malloc(100), 100);
+    }
+    cache_get(cache, "k00");           /* (referenced: survives a sweep) */
+    cache_get(cache, "k01");
+    cache_put(cache, "k10", malloc(100), 100);
+    cache_put(cache, "k11", malloc(100), 100);
+    ok(n_evict == 2, "eviction makes room");
+    ok(cache_get(cache, "k00") != NULL && cache_get(cache, "k01") != NULL,
+       "referenced entries are kept");
+    ok(cache_get(cache, "k02") == NULL && cache_get(cache, "k03") == NULL,
+       "unreferenced entries are evicted oldest first");
+    cache_stats(cache, &stats);
+    ok(stats.n_bytes <= 10 * entry_size && stats.n_evict == 2,
+       "cache stays within max_bytes");
+    for (int i = 0; i < 12; ++i)
+    {
+        snprintf(key, sizeof(key), "k%02d", i);
+        n_present += cache_get(cache, key) != NULL;
+    }
+    ok(n_present == 10, "cache is full");
+    ok(!cache_put(cache, "big", NULL, 10 * entry_size),
+       "an entry larger than the cache is refused");
+    cache_free(cache);
+}
+
+/*
+ * test_ttl() --Default and per-entry TTLs.
+ */
+static void test_ttl(void)
+{
+    TimeValue ttl = { 10, 0 }, short_ttl = { 1, 0 };
+    int n_evict = 0;
+    CachePtr cache = cache_new(1 << 20, &ttl, on_evict, &n_evict);
+
+    cache->now = fake_now;
+    cache_put(cache, "long", strdup("l"), 2);
+    cache_put_ttl(cache, "short", strdup("s"), 2, &short_ttl);
+    cache_put_ttl(cache, "forever", strdup("f"), 2, NULL);
+    now_ns += 2 * 1000000000LL;
+    ok(cache_get(cache, "short") == NULL && cache_get(cache, "long") != NULL,
+       "per-entry TTL");
+    now_ns += 10 * 1000000000LL;
+    ok(cache_get(cache, "long") == NULL
+       && cache_get(cache, "forever") != NULL, "default TTL");
+    ok(n_reason[CACHE_EXPIRED] == 2, "expired values are released");
+    cache_free(cache);
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(17);
+
+    test_basic();
+    test_evict();
+    test_ttl();
+
+    return exit_status();
+}
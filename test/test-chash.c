@@ -0,0 +1,302 @@
+/*
+ * TEST-CHASH.C --Unit tests for the concurrent hash table.
+ *
+ * Contents:
+ * hash()         --A hash function for small integer items.
+ * compare_item() --Compare two hash items for equality.
+ * test_basic()   --Test insert/find/remove from a single thread.
+ * test_threads() --Test concurrent inserts, finds and removes.
+ * insert_rounds() --Thread body: insert items, for another thread to remove.
+ * test_handoff() --Test that entries removed by another thread are reused.
+ * elapsed()      --Return the time since some start time, in seconds.
+ * test_scaling() --Report how read throughput scales with threads.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/hash.h>
+#include <apex/mem.h>
+
+enum
+{
+    N_ITEM = 10000,                    /* items per thread */
+    N_THREAD_MAX = 16,
+    N_ROUND = 20,                      /* insert/remove rounds for handoff */
+    LINK_SLACK = 8                     /* link blocks that may be held */
+};
+
+typedef struct Worker_t
+{
+    CHashPtr h;
+    long base;                         /* first item for this thread */
+    long n_op;                         /* No. of operations performed */
+    int status;
+} Worker;
+
+static pthread_barrier_t handoff_barrier;
+
+static void test_basic(void);
+static void test_threads(void);
+static void test_handoff(void);
+static void test_scaling(void);
+
+int main(void)
+{
+    plan_tests(9);
+    test_basic();
+    test_threads();
+    test_handoff();
+    test_scaling();
+    return exit_status();
+}
+
+/*
+ * hash() --A hash function for small integer items.
+ */
+static unsigned long hash(char *data)
+{
+    return (unsigned long) data;
+}
+
+/*
+ * compare_item() --Compare two hash items for equality.
+ */
+static int compare_item(const void *data, const void *key)
+{
+    return (long) data - (long) key;
+}
+
+/*
+ * test_basic() --Test insert/find/remove from a single thread.
+ */
+static void test_basic(void)
+{
+    CHashPtr h;
+
+    diag("%s()", __func__);
+    ok(chash_new(hash, 0, 4) == NULL, "chash_new() bad nslots");
+
+    h = chash_new(hash, 64, 3);
+    ok(h != NULL && h->n_stripe == 4, "chash_new() rounds stripes up");
+
+    chash_insert(h, (void *) 1);
+    chash_insert(h, (void *) 2);
+    ptr_eq(chash_find(h, compare_item, (void *) 2), (void *) 2,
+           "chash_find() existing item");
+    ptr_eq(chash_remove(h, compare_item, (void *) 1), (void *) 1,
+           "chash_remove() existing item");
+    ptr_eq(chash_find(h, compare_item, (void *) 1), NULL,
+           "chash_find() removed item");
+    chash_free(h);
+}
+
+/*
+ * insert_find_remove() --Thread body: insert, find and remove own items.
+ */
+static void *insert_find_remove(void *arg)
+{
+    Worker *w = (Worker *) arg;
+
+    w->status = 1;
+    for (long i = w->base; i < w->base + N_ITEM; ++i)
+    {
+        chash_insert(w->h, (void *) i);
+    }
+    for (long i = w->base; i < w->base + N_ITEM; ++i)
+    {
+        if (chash_find(w->h, compare_item, (void *) i) != (void *) i)
+        {
+            w->status = 0;
+        }
+    }
+    for (long i = w->base; i < w->base + N_ITEM; i += 2)
+    {
+        if (chash_remove(w->h, compare_item, (void *) i) != (void *) i)
+        {
+            w->status = 0;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * count_item() --Count the items visited.
+ */
+static void *count_item(void *UNUSED(data), void *usrdata)
+{
+    *(long *) usrdata += 1;
+    return NULL;
+}
+
+/*
+ * test_threads() --Test concurrent inserts, finds and removes.
+ */
+static void test_threads(void)
+{
+    CHashPtr h = chash_new(hash, 1024, 16);
+    pthread_t thread[4];
+    Worker worker[NEL(thread)];
+    int status = 1;
+    long n = 0;
+
+    diag("%s()", __func__);
+    chash_set_growth(h, 1.0);
+    for (size_t i = 0; i < NEL(thread); ++i)
+    {
+        worker[i].h = h;
+        worker[i].base = 1 + (long) i * N_ITEM;
+        pthread_create(&thread[i], NULL, insert_find_remove, &worker[i]);
+    }
+    for (size_t i = 0; i < NEL(thread); ++i)
+    {
+        pthread_join(thread[i], NULL);
+        status &= worker[i].status;
+    }
+    ok(status, "concurrent insert/find/remove");
+    chash_visit(h, count_item, &n);
+    number_eq(n, (long) NEL(thread) * N_ITEM / 2, "%ld",
+              "chash_visit() finds the remaining items");
+    chash_free(h);
+}
+
+/*
+ * insert_rounds() --Thread body: insert items, for another thread to remove.
+ */
+static void *insert_rounds(void *arg)
+{
+    Worker *w = (Worker *) arg;
+
+    w->status = 1;
+    for (int round = 0; round < N_ROUND; ++round)
+    {
+        for (long i = w->base; i < w->base + N_ITEM; ++i)
+        {
+            w->status &= chash_insert(w->h, (void *) i);
+        }
+        pthread_barrier_wait(&handoff_barrier);    /* (main removes them) */
+        pthread_barrier_wait(&handoff_barrier);
+    }
+    return NULL;
+}
+
+/*
+ * test_handoff() --Test that entries removed by another thread are reused.
+ *
+ * Remarks:
+ * One thread inserts items, and another removes them, so the entries
+ * are freed onto a different thread's free-list than the one they
+ * were allocated from.  They must find their way back (via the
+ * shared pool), or the inserting thread allocates new blocks every
+ * round.
+ */
+static void test_handoff(void)
+{
+    CHashPtr h = chash_new(hash, 1024, 4);
+    Worker worker = { h, 1, 0, 0 };
+    pthread_t thread;
+    MemStats stats;
+    size_t first = 0, last = 0;
+    int status = 1;
+
+    diag("%s()", __func__);
+    pthread_barrier_init(&handoff_barrier, NULL, 2);
+    pthread_create(&thread, NULL, insert_rounds, &worker);
+    for (int round = 0; round < N_ROUND; ++round)
+    {
+        pthread_barrier_wait(&handoff_barrier);
+        for (long i = worker.base; i < worker.base + N_ITEM; ++i)
+        {
+            status &= chash_remove(h, compare_item, (void *) i) == (void *) i;
+        }
+        mem_stats(MEM_LINK, &stats);
+        last = stats.n_alloc - stats.n_free;
+        if (round == 0)
+        {
+            first = last;
+        }
+        pthread_barrier_wait(&handoff_barrier);
+    }
+    pthread_join(thread, NULL);
+    pthread_barrier_destroy(&handoff_barrier);
+    ok(status && worker.status, "insert on one thread, remove on another");
+    ok(last <= first + LINK_SLACK, "link blocks are reused (%zu, then %zu)",
+       first, last);
+    chash_free(h);
+}
+
+/*
+ * find_loop() --Thread body: look up a fixed number of random items.
+ */
+static void *find_loop(void *arg)
+{
+    Worker *w = (Worker *) arg;
+    unsigned int seed = (unsigned int) w->base;
+
+    for (w->n_op = 0; w->n_op < 100 * N_ITEM; ++w->n_op)
+    {
+        long key = 1 + rand_r(&seed) % N_ITEM;
+
+        chash_find(w->h, compare_item, (void *) key);
+    }
+    return NULL;
+}
+
+/*
+ * elapsed() --Return the time since some start time, in seconds.
+ */
+static double elapsed(struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec)
+        + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * test_scaling() --Report how read throughput scales with threads.
+ *
+ * Remarks:
+ * This doesn't test anything, it just reports the results.
+ */
+static void test_scaling(void)
+{
+    CHashPtr h = chash_new(hash, N_ITEM, 64);
+    long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_max = (int) MIN(MAX(n_cpu, 1), N_THREAD_MAX);
+
+    diag("%s()", __func__);
+    for (long i = 1; i <= N_ITEM; ++i)
+    {
+        chash_insert(h, (void *) i);
+    }
+    for (int n_thread = 1; n_thread <= n_max; n_thread *= 2)
+    {
+        pthread_t thread[N_THREAD_MAX];
+        Worker worker[N_THREAD_MAX];
+        long total = 0;
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < n_thread; ++i)
+        {
+            worker[i].h = h;
+            worker[i].base = i + 1;
+            pthread_create(&thread[i], NULL, find_loop, &worker[i]);
+        }
+        for (int i = 0; i < n_thread; ++i)
+        {
+            pthread_join(thread[i], NULL);
+            total += worker[i].n_op;
+        }
+        diag("%2d thread(s): %12.0f finds/s", n_thread,
+             (double) total / elapsed(&start));
+    }
+    chash_free(h);
+}
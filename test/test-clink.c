@@ -0,0 +1,194 @@
+/*
+ * TEST-CLINK.C --Unit tests for the circular linked-list module.
+ *
+ * Contents:
+ * compare_item() --Compare two list items.
+ * list_new()     --Create a list from an array of small integers.
+ * list_str()     --Format a list's items into a (static) string.
+ * test_merge()   --Test clink_merge() with each insert mode.
+ * test_sort()    --Test clink_sort() with each insert mode.
+ * thread_links() --Allocate and free some links: a thread function.
+ * test_thread_exit() --Test that an exiting thread's free links are kept.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/clink.h>
+
+static void test_merge(void);
+static void test_sort(void);
+static void test_thread_exit(void);
+
+int main(void)
+{
+    plan_tests(11);
+    test_merge();
+    test_sort();
+    test_thread_exit();
+    return exit_status();
+}
+
+/*
+ * compare_item() --Compare two list items.
+ *
+ * Remarks:
+ * Items are encoded as value*10 + tag, and only the value is compared,
+ * so that the tag can be used to check stability.
+ */
+static int compare_item(const void *data, const void *key)
+{
+    return (int) ((long) data / 10 - (long) key / 10);
+}
+
+/*
+ * list_new() --Create a list from an array of small integers.
+ */
+static LinkPtr list_new(size_t n, const long *item)
+{
+    LinkPtr tail = NULL;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        LinkPtr l = link_new(NULL, (void *) item[i]);
+
+        tail = clink_append(tail, l);
+    }
+    return tail;
+}
+
+/*
+ * list_str() --Format a list's items into a (static) string.
+ */
+static const char *list_str(LinkPtr tail)
+{
+    static char text[256];
+    LinkPtr l;
+
+    text[0] = '\0';
+    if (tail != NULL)
+    {
+        l = tail;
+        do
+        {
+            l = l->next;
+            sprintf(text + strlen(text), "%s%ld", text[0] ? " " : "",
+                    (long) l->data);
+        } while (l != tail);
+    }
+    return text;
+}
+
+/*
+ * test_merge() --Test clink_merge() with each insert mode.
+ */
+static void test_merge(void)
+{
+    static const long a[] = { 10, 30, 50 };
+    static const long b[] = { 21, 31, 61 };
+    LinkPtr l;
+
+    diag("%s()", __func__);
+    l = clink_merge(list_new(NEL(a), a), list_new(NEL(b), b),
+                    compare_item, LINK_INSERT_DUPLICATE);
+    string_eq(list_str(l), "10 21 30 31 50 61", "merge: duplicate");
+    link_free_links(l->next, l);
+
+    l = clink_merge(list_new(NEL(a), a), list_new(NEL(b), b),
+                    compare_item, LINK_INSERT_FAIL);
+    string_eq(list_str(l), "10 21 30 50 61", "merge: fail");
+    link_free_links(l->next, l);
+
+    l = clink_merge(list_new(NEL(a), a), list_new(NEL(b), b),
+                    compare_item, LINK_INSERT_REPLACE);
+    string_eq(list_str(l), "10 21 31 50 61", "merge: replace");
+    link_free_links(l->next, l);
+
+    l = clink_merge(NULL, list_new(NEL(b), b),
+                    compare_item, LINK_INSERT_FAIL);
+    string_eq(list_str(l), "21 31 61", "merge: empty first list");
+    link_free_links(l->next, l);
+
+    ok(clink_merge(NULL, NULL, compare_item, LINK_INSERT_FAIL) == NULL,
+       "merge: empty lists");
+}
+
+/*
+ * test_sort() --Test clink_sort() with each insert mode.
+ */
+static void test_sort(void)
+{
+    static const long a[] = { 50, 11, 40, 12, 30, 20, 13, 10 };
+    long big[1000];
+    LinkPtr l;
+    int status = 1;
+
+    diag("%s()", __func__);
+    l = clink_sort(list_new(NEL(a), a), compare_item, LINK_INSERT_DUPLICATE);
+    string_eq(list_str(l), "11 12 13 10 20 30 40 50", "sort: duplicate");
+    link_free_links(l->next, l);
+
+    l = clink_sort(list_new(NEL(a), a), compare_item, LINK_INSERT_FAIL);
+    string_eq(list_str(l), "11 20 30 40 50", "sort: fail");
+    link_free_links(l->next, l);
+
+    l = clink_sort(list_new(NEL(a), a), compare_item, LINK_INSERT_REPLACE);
+    string_eq(list_str(l), "10 20 30 40 50", "sort: replace");
+    link_free_links(l->next, l);
+
+    ok(clink_sort(NULL, compare_item, LINK_INSERT_FAIL) == NULL,
+       "sort: empty list");
+
+    for (size_t i = 0; i < NEL(big); ++i)
+    {
+        big[i] = (long) ((i * 7919) % NEL(big)) * 10;
+    }
+    l = clink_sort(list_new(NEL(big), big), compare_item, LINK_INSERT_FAIL);
+    for (LinkPtr p = l->next; p != l; p = p->next)
+    {
+        if ((long) p->data >= (long) p->next->data && p->next != l->next)
+        {
+            status = 0;
+        }
+    }
+    ok(status && clink_len(l) == (int) NEL(big), "sort: 1000 items");
+    link_free_links(l->next, l);
+}
+
+/*
+ * thread_links() --Allocate and free some links: a thread function.
+ */
+static void *thread_links(void *UNUSED(arg))
+{
+    static long item[500];
+    LinkPtr l = list_new(NEL(item), item);
+
+    link_free_links(l->next, l);
+    return NULL;
+}
+
+/*
+ * test_thread_exit() --Test that an exiting thread's free links are kept.
+ *
+ * Remarks:
+ * The thread's links are fewer than it keeps on its own free-list,
+ * so they only reach the pool (where link_trim() can release their
+ * blocks) when it exits.
+ */
+static void test_thread_exit(void)
+{
+    pthread_t thread;
+
+    diag("%s()", __func__);
+    (void) link_trim();
+    if (pthread_create(&thread, NULL, thread_links, NULL) != 0)
+    {
+        skip(1, "cannot create a thread");
+        return;
+    }
+    pthread_join(thread, NULL);
+    ok(link_trim() > 0, "an exited thread's free links are trimmed");
+}
@@ -0,0 +1,69 @@
+/*
+ * TEST-CLOCK.C --Unit tests for the nanosecond clocks.
+ *
+ * Contents:
+ * test_sources()    --Test that each clock source is monotonic and agrees.
+ * test_convert()    --Test conversions to/from TimeValue, timespec, double.
+ */
+#include <apex.h>
+#include <apex/clock.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+
+static void test_sources(void);
+static void test_convert(void);
+
+int main(void)
+{
+    plan_tests(15);
+    test_sources();
+    test_convert();
+    return exit_status();
+}
+
+/*
+ * test_sources() --Test that each clock source is monotonic and agrees.
+ */
+static void test_sources(void)
+{
+    TimeNs mono = ns_monotonic();
+    TimeNs tsc = ns_tsc();
+    TimeNs later = ns_now(CLOCK_SOURCE_MONOTONIC);
+    TimeNs coarse = ns_now(CLOCK_SOURCE_COARSE);
+
+    ok(later >= mono, "monotonic clock doesn't go backwards");
+    ok(ns_tsc() >= tsc, "TSC clock doesn't go backwards");
+    ok(ABS(coarse - later) < 100 * NS_PER_MSEC,
+       "coarse clock is within 100ms of the monotonic clock");
+    ok(ABS(ns_tsc() - ns_monotonic()) < 10 * NS_PER_MSEC,
+       "TSC clock is within 10ms of the monotonic clock");
+    ok(ns_tsc_hz() == 0.0 || ns_tsc_hz() > 1e6,
+       "TSC rate is plausible (or there's no TSC)");
+}
+
+/*
+ * test_convert() --Test conversions to/from TimeValue, timespec, double.
+ */
+static void test_convert(void)
+{
+    TimeValue tv = { 12, 345678 };
+    struct timespec ts;
+
+    number_eq(ns_from_tv(&tv), 12345678000LL, "%" PRI_TIMENS, "ns_from_tv()");
+    ns_to_tv(-1500 * NS_PER_MSEC, &tv);
+    ok(tv.tv_sec == -2 && tv.tv_usec == 500000,
+       "ns_to_tv() normalises negative times");
+    ns_to_ts(3 * NS_PER_SEC + 7, &ts);
+    ok(ts.tv_sec == 3 && ts.tv_nsec == 7, "ns_to_ts()");
+    number_eq(ns_from_ts(&ts), 3000000007LL, "%" PRI_TIMENS, "ns_from_ts()");
+    ns_to_ts(-1, &ts);
+    ok(ts.tv_sec == -1 && ts.tv_nsec == 999999999,
+       "ns_to_ts() normalises negative times");
+
+    number_eq(ns_set(1.5), 1500000000LL, "%" PRI_TIMENS, "ns_set()");
+    number_eq(ns_set(-0.25), -250000000LL, "%" PRI_TIMENS, "ns_set() negative");
+    ok(ns_set(1e300) == 0, "ns_set() rejects out-of-range times");
+    ok(ns_double(2500 * NS_PER_MSEC) == 2.5, "ns_double()");
+    number_eq(ns_scale(NS_PER_SEC, 0.5), 500000000LL, "%" PRI_TIMENS,
+              "ns_scale()");
+}
@@ -0,0 +1,157 @@
+/*
+ * CONFIG.C --Unit tests for the "config" functions.
+ *
+ * Remarks:
+ * The config files are written to a temporary directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/atomic.h>
+#include <apex/config.h>
+
+typedef struct Changes
+{
+    unsigned int n_port;               /* (written by the watcher) */
+    unsigned int n_any;
+    char port[32];
+} Changes;
+
+/*
+ * write_config() --(Re-)write a config file, by renaming a new one.
+ */
+static int write_config(const char *path, const char *text)
+{
+    char tmp_path[FILENAME_MAX + 8];
+    FILE *fp;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if ((fp = fopen(tmp_path, "w")) == NULL)
+    {
+        return 0;
+    }
+    fputs(text, fp);
+    return fclose(fp) == 0 && rename(tmp_path, path) == 0;
+}
+
+/*
+ * port_changed() --OptionProc: record changes to the "port" option.
+ */
+static int port_changed(const char *UNUSED(name), const char *text,
+                        void *data)
+{
+    Changes *changes = (Changes *) data;
+
+    snprintf(changes->port, sizeof(changes->port), "%s",
+             text != NULL ? text : "");
+    ATOMIC_ADD(&changes->n_port, 1);
+    return 1;
+}
+
+/*
+ * any_changed() --OptionProc: count changes to any option.
+ */
+static int any_changed(const char *UNUSED(name), const char *UNUSED(text),
+                       void *data)
+{
+    ATOMIC_ADD(&((Changes *) data)->n_any, 1);
+    return 1;
+}
+
+/*
+ * published() --Return an option's currently published value.
+ */
+static const char *published(ConfigWatchPtr watch, const char *name)
+{
+    SymConfigPtr symbols = config_watch_symbols(watch);
+    SymReaderPtr reader = sym_config_reader(symbols);
+    Atom path[2] = { {.type = STRING_TYPE}, {.type = VOID_TYPE} };
+    char *value = NULL;
+
+    path[0].value.string = (char *) name;
+    if (sym_get_str(sym_read_begin(symbols, reader)->symtab, path, &value)
+        == 0)
+    {
+        value = NULL;
+    }
+    sym_read_end(reader);
+    sym_config_unreader(reader);
+    return value;                      /* (interned: still valid) */
+}
+
+/*
+ * test_watch() --Test reloading a watched config file.
+ */
+static void test_watch(void)
+{
+    char dir[] = "/tmp/test-config-XXXXXX";
+    char file[FILENAME_MAX], path[FILENAME_MAX + 8];
+    Option opts[] = {
+        {'p', "port", "port", "80", NULL, NULL, NULL, 0},
+        {0, "log-dir", "dir", NULL, NULL, NULL, NULL, 0},
+        {0, "name", "name", NULL, NULL, NULL, NULL, 0},
+        {0, NULL, NULL, NULL, NULL, NULL, NULL, 0}
+    };
+    Changes changes = { 0, 0, "" };
+    const char *value;
+    unsigned int n_any;
+    ConfigWatchPtr watch;
+
+    if (mkdtemp(dir) == NULL)
+    {
+        skip(7, "cannot create a temporary directory");
+        return;
+    }
+    snprintf(file, sizeof(file), "%s/app", dir);
+    snprintf(path, sizeof(path), "%s.conf", file);
+    write_config(path, "name = one\n[log]\ndir = /var/log\n");
+
+    watch = config_watch_new(file, opts, 2);
+    ok(watch != NULL, "config_watch_new()");
+    if (watch == NULL)
+    {
+        skip(6, "no watch");
+        return;
+    }
+    ok((value = published(watch, "port")) != NULL
+       && strcmp(value, "80") == 0
+       && (value = published(watch, "log-dir")) != NULL
+       && strcmp(value, "/var/log") == 0,
+       "file and default values are published");
+    config_watch_notify(watch, NULL, any_changed, &changes);
+    config_watch_notify(watch, "port", port_changed, &changes);
+    ok(config_watch_start(watch), "config_watch_start()");
+
+    write_config(path, "name = one\nport = 8080\n[log]\ndir = /var/log\n");
+    for (int i = 0; i < 500 && ATOMIC_LOAD_ACQUIRE(&changes.n_port) == 0;
+         ++i)
+    {
+        usleep(10000);
+    }
+    ok(ATOMIC_LOAD_ACQUIRE(&changes.n_port) == 1
+       && strcmp(changes.port, "8080") == 0,
+       "change is noticed (port=%s)", changes.port);
+    n_any = ATOMIC_LOAD_ACQUIRE(&changes.n_any);  /* (notified first) */
+    ok(n_any == 1, "only the changed option is notified (%u)", n_any);
+    ok((value = published(watch, "port")) != NULL
+       && strcmp(value, "8080") == 0, "new value is published");
+    config_watch_free(watch);
+    watch = NULL;
+
+    write_config(path, "port = 9090\n");
+    ok(changes.n_port == 1, "watch stops when freed");
+    remove(path);
+    rmdir(dir);
+}
+
+int main(void)
+{
+    plan_tests(7);
+    test_watch();
+    return exit_status();
+}
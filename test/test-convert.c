@@ -2,17 +2,43 @@
  * CONVERT.C --Unit tests for unit(!) conversions.
  *
  */
+#include <math.h>
 #include <string.h>
 
 #include <apex/tap.h>
 #include <apex.h>
 #include <apex/convert.h>
 
+/*
+ * test_convert_n() --Test indexed and bulk conversion.
+ */
+static void test_convert_n(void)
+{
+    const char *opt[] = { "1km", "2ft", "3parsecs", "4'", NULL };
+    double value[NEL(opt)];
+    ConvertIndex index;
+
+    ok(convert_index_init(&index, convert_length, SIZE_MAX)
+       && convert_index_find(&index, "inches") == &convert_length[8]
+       && convert_index_find(&index, "parsec") == NULL,
+       "convert_index_find()");
+    ok(str_convert_index("2in", &value[0], &index)
+       && FEQUAL(value[0], 0.0508, 0.00001), "str_convert_index(): 2in");
+    ok(str_convert_n(opt, value, NEL(opt), convert_length) == 3
+       && FEQUAL(value[0], 1000, 0.001) && FEQUAL(value[1], 0.6096, 0.00001)
+       && isnan(value[2]) && FEQUAL(value[3], 1.2192, 0.00001)
+       && isnan(value[4]), "str_convert_n(): converts, NAN for failures");
+    ok(str_convertn("1m", &value[0], 3, convert_length)
+       && !str_convertn("1cm", &value[0], 3, convert_length),
+       "str_convertn(): only the first n units");
+}
+
 int main(void)
 {
     double value;
 
-    plan_tests(17);
+    plan_tests(21);
+    test_convert_n();
 
     ok(str_convert("1m", &value, convert_length), "convert: 1m");
     ok(FEQUAL(1.0, value, 0.00001), "convert: 1m (value)");
@@ -6,12 +6,27 @@
  * csv_copy_file() --Copy a CSV file via the csv_*() API.
  * load_file()     --Slurp a file into a text buffer.
  * cmp_file()      --compare the contents of two files.
+ * test_quoting()  --Test quoted fields are parsed and written back.
+ * test_view()     --Test mapped views agree with csv_read().
+ * test_block()    --Test block reads into typed columns.
+ * test_load()     --Test parallel loading matches a sequential read.
+ * test_compressed() --Test writing and reading compressed files.
+ * test_image()    --Test binary images read back like their CSV file.
+ * test_scan()     --Test field conversions match sscanf().
+ * test_span()     --Test csv_span_() agrees with the scalar version.
+ * test_format()   --Test value formatting matches snprintf().
+ * bench_read()    --Compare csv_read() (etc.) with fgets()/sscanf().
+ * bench_span()    --Compare csv_span_() with a byte-at-a-time loop.
+ * bench_write()   --Compare csv_write() with fprintf().
  *
  * Remarks:
  *
  */
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <apex/tap.h>
@@ -104,6 +119,980 @@ static int cmp_file(const char *path1, const char *path2)
     return strcmp(content1, content2);
 }
 
+/*
+ * test_quoting() --Test quoted fields are parsed and written back.
+ */
+static void test_quoting(const char *path1, const char *path2)
+{
+    const char *quoted =
+        "name,note\r\n"
+        "\"Smith, J\",\"said \"\"hi\"\"\"\r\n"
+        "plain,\"two\nlines\"\n" "\"\",\"\"\"\"\n" "last,no newline";
+    CSVFilePtr in;
+    Atom value[4];
+    char bytes[256];
+    int n_ok = 0;
+
+    create_file(path1, quoted);
+    if ((in = csv_open(path1, "r")) == NULL)
+    {
+        ok(0, "open quoted file");
+        ok(0, "quoted file copy");
+        return;
+    }
+    ok(in->n_field == 2 && strcmp(in->field[1].item.name, "note") == 0,
+       "header with CRLF");
+    if (csv_read(in, in->n_field, value, NEL(bytes), bytes)
+        && strcmp(value[0].value.string, "Smith, J") == 0
+        && strcmp(value[1].value.string, "said \"hi\"") == 0)
+    {
+        ++n_ok;
+    }
+    if (csv_read(in, in->n_field, value, NEL(bytes), bytes)
+        && strcmp(value[0].value.string, "plain") == 0
+        && strcmp(value[1].value.string, "two\nlines") == 0)
+    {
+        ++n_ok;
+    }
+    if (csv_read(in, in->n_field, value, NEL(bytes), bytes)
+        && strcmp(value[0].value.string, "") == 0
+        && strcmp(value[1].value.string, "\"") == 0)
+    {
+        ++n_ok;
+    }
+    if (csv_read(in, in->n_field, value, NEL(bytes), bytes)
+        && strcmp(value[1].value.string, "no newline") == 0
+        && !csv_read(in, in->n_field, value, NEL(bytes), bytes))
+    {
+        ++n_ok;
+    }
+    ok(n_ok == 4,
+       "quoted commas, quotes, newlines and empty fields; %d/4", n_ok);
+    csv_close(in);
+
+    do
+    {
+        CSVFilePtr in2;
+        int same = 0;
+
+        csv_copy_file(path1, path2);
+        if ((in = csv_open(path1, "r")) != NULL
+            && (in2 = csv_open(path2, "r")) != NULL)
+        {
+            char bytes2[256];
+            Atom value2[4];
+
+            same = 1;
+            while (csv_read(in, in->n_field, value, NEL(bytes), bytes))
+            {
+                if (!csv_read(in2, in2->n_field, value2, NEL(bytes2), bytes2)
+                    || strcmp(value[0].value.string,
+                              value2[0].value.string) != 0
+                    || strcmp(value[1].value.string,
+                              value2[1].value.string) != 0)
+                {
+                    same = 0;
+                }
+            }
+            csv_close(in2);
+        }
+        if (in != NULL)
+        {
+            csv_close(in);
+        }
+        ok(same, "quoted fields survive csv_write()");
+    } while (0);
+}
+
+/*
+ * test_view() --Test mapped views agree with csv_read().
+ */
+static void test_view(const char *path)
+{
+    const char *text =
+        "a,b,c\r\n"
+        "\"Smith, J\",\"said \"\"hi\"\"\",plain\r\n"
+        "\"ab\"junk,x\ry,\"two\nlines\"\n"
+        ",,\n" "\n" "1,2,3,4,5\n" "last,\"open quote\nto EOF";
+    CSVFilePtr in, map;
+    CSVView view[8];
+    Atom value[8];
+    char bytes[256], copy[256];
+    size_t n_view;
+    int n_same = 0, n_record = 0, n_zero_copy = 0;
+    char *big;
+    size_t big_len = CSV_TEXT_MAX * 3;
+
+    create_file(path, text);
+    in = csv_open(path, "r");
+    map = csv_open(path, "m");
+    if (in == NULL || map == NULL)
+    {
+        ok(0, "views match csv_read()");
+    }
+    else
+    {
+        while ((n_view = csv_read_view(map, NEL(view), view)) != 0)
+        {
+            size_t n_value = csv_parse_record_(in, NEL(value), value,
+                                               sizeof(bytes), bytes);
+            int same = n_value == n_view;
+
+            for (size_t i = 0; same && i < n_view; ++i)
+            {
+                csv_view_copy(&view[i], sizeof(copy), copy);
+                same = strcmp(copy, value[i].value.string) == 0;
+                n_zero_copy += !view[i].quoted;
+            }
+            n_same += same;
+            ++n_record;
+        }
+        ok(n_same == n_record && n_record == 6
+           && csv_parse_record_(in, NEL(value), value, sizeof(bytes),
+                                bytes) == 0,
+           "views match csv_read(); %d/%d records (%d zero-copy fields)",
+           n_same, n_record, n_zero_copy);
+    }
+    if (in != NULL)
+    {
+        csv_close(in);
+    }
+    if (map != NULL)
+    {
+        csv_close(map);
+    }
+
+    if ((big = malloc(big_len + 16)) == NULL)
+    {
+        ok(0, "records longer than CSV_TEXT_MAX");
+        return;
+    }
+    strcpy(big, "long\n");
+    memset(big + 5, 'x', big_len);
+    strcpy(big + 5 + big_len, "\n");
+    create_file(path, big);
+    n_view = 0;
+    if ((map = csv_open(path, "m")) != NULL)
+    {
+        n_view = csv_read_view(map, NEL(view), view);
+        n_view = n_view == 1 && view[0].len == big_len && !view[0].quoted
+            && csv_read_view(map, NEL(view), view) == 0;
+        csv_close(map);
+    }
+    ok(n_view, "records longer than CSV_TEXT_MAX");
+    free(big);
+}
+
+/*
+ * test_block() --Test block reads into typed columns.
+ */
+static void test_block(const char *path)
+{
+    const char *mode[] = { "r", "m" };
+    CSVField field[] = {
+        {{.name = (char *) "int",.type = INTEGER_TYPE}, "%ld", "%ld"},
+        {{.name = (char *) "real",.type = REAL_TYPE}, "%lf", "%.6f"},
+        {{.name = (char *) "str",.type = STRING_TYPE}, "%s", "%s"}
+    };
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) == NULL)
+    {
+        return;
+    }
+    fputs("int,real,str\n", fp);
+    for (int i = 0; i < 10; ++i)
+    {
+        fprintf(fp, "%d,%d.5,\"row %d\"\n", i - 3, i, i);
+    }
+    fputs("bad\n", fp);               /* (short record, bad number) */
+    fclose(fp);
+
+    for (size_t m = 0; m < NEL(mode); ++m)
+    {
+        CSVFilePtr csv_fp = csv_open(path, mode[m]);
+        CSVBlock block;
+        size_t n, n_row = 0, n_block = 0;
+        long int_sum = 0;
+        double real_sum = 0.0;
+        int n_str = 0;
+
+        if (csv_fp == NULL)
+        {
+            ok(0, "csv_read_block() (mode \"%s\")", mode[m]);
+            continue;
+        }
+        free(csv_fp->field[0].item.name);
+        free(csv_fp->field);
+        csv_fp->field = field;
+        if (csv_block_init(&block, csv_fp, 4) != NULL)
+        {
+            while ((n = csv_read_block(csv_fp, &block)) != 0)
+            {
+                for (size_t i = 0; i < n; ++i, ++n_row)
+                {
+                    char str[16], expect[16];
+
+                    int_sum += block.column[0].data.integer[i];
+                    real_sum += block.column[1].data.real[i];
+                    csv_view_copy(&block.column[2].data.view[i],
+                                  sizeof(str), str);
+                    sprintf(expect, "row %zu", n_row);
+                    n_str += strcmp(str, n_row < 10 ? expect : "") == 0;
+                }
+                ++n_block;
+            }
+            csv_block_free(&block);
+        }
+        ok(n_row == 11 && n_block == 3 && int_sum == 15
+           && real_sum == 50.0 && n_str == 11,
+           "csv_read_block() (mode \"%s\"): %zu rows in %zu blocks",
+           mode[m], n_row, n_block);
+        csv_fp->field = NULL;          /* (so csv_close() won't free it) */
+        csv_close(csv_fp);
+    }
+}
+
+/*
+ * test_load() --Test parallel loading matches a sequential read.
+ */
+static void test_load(const char *path)
+{
+    CSVField field[] = {
+        {{.name = (char *) "int",.type = INTEGER_TYPE}, "%ld", "%ld"},
+        {{.name = (char *) "str",.type = STRING_TYPE}, "%s", "%s"}
+    };
+    size_t n_record = 40000;
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) == NULL)
+    {
+        return;
+    }
+    fputs("int,str\n", fp);
+    for (size_t i = 0; i < n_record; ++i)
+    {                                  /* (quoted newlines, to mislead) */
+        if (i % 7 == 0)
+        {
+            fprintf(fp, "%zu,\"line %zu\n\"\"%zu\"\",\n\"\n", i, i, i);
+        }
+        else
+        {
+            fprintf(fp, "%zu,plain %zu\n", i, i);
+        }
+    }
+    fclose(fp);
+
+    for (int n_thread = 1; n_thread <= 4; n_thread += 3)
+    {
+        CSVFilePtr csv_fp = csv_open(path, "m");
+        CSVLoad load;
+        size_t row = 0, n_same = 0;
+
+        if (csv_fp == NULL)
+        {
+            ok(0, "csv_load() with %d threads", n_thread);
+            continue;
+        }
+        free(csv_fp->field[0].item.name);
+        free(csv_fp->field);
+        csv_fp->field = field;
+        if (csv_load(&load, csv_fp, n_thread) != NULL)
+        {
+            for (size_t b = 0; b < load.n_block; ++b)
+            {
+                CSVBlockPtr block = &load.block[b];
+
+                for (size_t i = 0; i < block->n_row; ++i, ++row)
+                {
+                    char str[64], expect[64];
+
+                    if (row % 7 == 0)
+                    {
+                        sprintf(expect, "line %zu\n\"%zu\",\n", row, row);
+                    }
+                    else
+                    {
+                        sprintf(expect, "plain %zu", row);
+                    }
+                    csv_view_copy(&block->column[1].data.view[i],
+                                  sizeof(str), str);
+                    n_same += block->column[0].data.integer[i]
+                        == (SYMBOL_INT) row && strcmp(str, expect) == 0;
+                }
+            }
+            ok(load.n_row == n_record && n_same == n_record
+               && csv_read_view(csv_fp, 0, NULL) == 0,
+               "csv_load() with %d threads: %zu blocks, %zu/%zu rows",
+               n_thread, load.n_block, n_same, load.n_row);
+            csv_load_free(&load);
+        }
+        else
+        {
+            ok(0, "csv_load() with %d threads", n_thread);
+        }
+        csv_fp->field = NULL;          /* (so csv_close() won't free it) */
+        csv_close(csv_fp);
+    }
+}
+
+/*
+ * test_compressed() --Test writing and reading compressed files.
+ */
+static void test_compressed(void)
+{
+    const char *suffix[] = { ".gz", ".zst" };
+    const unsigned char magic[][4] = {
+        {0x1f, 0x8b}, {0x28, 0xb5, 0x2f, 0xfd}
+    };
+    CSVField field[] = {
+        {{.name = (char *) "int",.type = INTEGER_TYPE}, "%ld", "%ld"},
+        {{.name = (char *) "str",.type = STRING_TYPE}, "%s", "%s"}
+    };
+    size_t n_record = 20000;
+
+    for (size_t s = 0; s < NEL(suffix); ++s)
+    {
+        char path[64];
+        unsigned char head[4] = { 0 };
+        size_t n_same = 0, n_read = 0;
+        CSVFilePtr csv_fp;
+        FILE *fp;
+
+        sprintf(path, "csv-z-%d.csv%s", getpid(), suffix[s]);
+        if ((csv_fp = csv_open(path, "w", (int) NEL(field), field)) == NULL)
+        {
+            skip(1, "can't write \"%s\" files", suffix[s]);
+            continue;
+        }
+        for (size_t i = 0; i < n_record; ++i)
+        {
+            Atom value[2];
+
+            value[0].value.integer = (SYMBOL_INT) i;
+            value[1].value.string = (char *) (i % 2 ? "odd, quoted" : "even");
+            csv_write(csv_fp, NEL(value), value);
+        }
+        csv_close(csv_fp);
+
+        if ((fp = fopen(path, "rb")) != NULL)
+        {
+            fread(head, 1, sizeof(head), fp);
+            fclose(fp);
+        }
+        if ((csv_fp = csv_open(path, "r")) != NULL)
+        {
+            Atom value[2];
+            char bytes[64];
+            char expect[16];
+
+            while (csv_read(csv_fp, NEL(value), value, sizeof(bytes), bytes))
+            {
+                sprintf(expect, "%zu", n_read);
+                n_same += strcmp(value[0].value.string, expect) == 0
+                    && strcmp(value[1].value.string,
+                              n_read % 2 ? "odd, quoted" : "even") == 0;
+                ++n_read;
+            }
+            csv_close(csv_fp);
+        }
+        ok(memcmp(head, magic[s], s == 0 ? 2 : 4) == 0
+           && n_read == n_record && n_same == n_record,
+           "compressed \"%s\" file: %zu/%zu records", suffix[s], n_same,
+           n_read);
+        unlink(path);
+    }
+}
+
+/*
+ * test_image() --Test binary images read back like their CSV file.
+ */
+static void test_image(const char *path, const char *image_path)
+{
+    CSVField field[] = {
+        {{.name = (char *) "int",.type = INTEGER_TYPE}, "%ld", "%ld"},
+        {{.name = (char *) "real",.type = REAL_TYPE}, "%lf", "%.3f"},
+        {{.name = (char *) "str",.type = STRING_TYPE}, "%s", "%s"}
+    };
+    size_t n_record = 10000, n_same = 0, n_read = 0, n_row = 0;
+    CSVFilePtr csv_fp;
+    Value min, max;
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) == NULL)
+    {
+        return;
+    }
+    fputs("int,real,str\n", fp);
+    for (size_t i = 0; i < n_record; ++i)
+    {
+        fprintf(fp, "%ld,%.3f,%s%zu\n", (long) i - 5000, (double) i / 8.0,
+                i % 3 ? "plain " : "\"a, \"\"quoted\"\"\" ", i);
+    }
+    fclose(fp);
+
+    if ((csv_fp = csv_open(path, "m")) != NULL)
+    {
+        free(csv_fp->field[0].item.name);
+        free(csv_fp->field);
+        csv_fp->field = field;
+        ok(csv_image_write(image_path, csv_fp),
+           "convert a CSV file to an image");
+        csv_fp->field = NULL;          /* (so csv_close() won't free it) */
+        csv_close(csv_fp);
+    }
+    else
+    {
+        ok(0, "convert a CSV file to an image");
+    }
+
+    if ((csv_fp = csv_open(image_path, "b")) != NULL)
+    {
+        Atom value[3];
+        CSVBlock block;
+        char expect[64];
+
+        while (csv_read(csv_fp, NEL(value), value, 0, NULL))
+        {
+            sprintf(expect, "%s%zu", n_read % 3 ? "plain " : "a, \"quoted\" ",
+                    n_read);
+            n_same += csv_fp->n_field == 3
+                && strcmp(csv_fp->field[1].item.name, "real") == 0
+                && strcmp(csv_fp->field[1].print_fmt, "%.3f") == 0
+                && value[0].type == INTEGER_TYPE
+                && value[0].value.integer == (SYMBOL_INT) n_read - 5000
+                && value[1].value.real == (double) n_read / 8.0
+                && strcmp(value[2].value.string, expect) == 0;
+            ++n_read;
+        }
+        csv_close(csv_fp);
+
+        if ((csv_fp = csv_open(image_path, "b")) != NULL
+            && csv_block_init(&block, csv_fp, 999) != NULL)
+        {
+            size_t n;
+
+            while ((n = csv_read_block(csv_fp, &block)) != 0)
+            {
+                for (size_t i = 0; i < n; ++i, ++n_row)
+                {
+                    char str[64];
+
+                    sprintf(expect, "%s%zu",
+                            n_row % 3 ? "plain " : "a, \"quoted\" ", n_row);
+                    csv_view_copy(&block.column[2].data.view[i], sizeof(str),
+                                  str);
+                    n_same += block.column[0].data.integer[i]
+                        == (SYMBOL_INT) n_row - 5000
+                        && block.column[1].data.real[i]
+                        == (double) n_row / 8.0
+                        && strcmp(str, expect) == 0;
+                }
+            }
+            n_same += csv_image_range(csv_fp, 0, &min, &max)
+                && min.integer == -5000 && max.integer == 4999
+                && csv_image_range(csv_fp, 1, &min, &max)
+                && min.real == 0.0 && max.real == 9999 / 8.0
+                && !csv_image_range(csv_fp, 2, &min, &max);
+            csv_block_free(&block);
+        }
+        if (csv_fp != NULL)
+        {
+            csv_close(csv_fp);
+        }
+    }
+    ok(n_read == n_record && n_row == n_record
+       && n_same == 2 * n_record + 1,
+       "image reads match the CSV file: %zu/%zu records", n_same, n_read);
+
+    if ((fp = fopen(image_path, "r+")) != NULL)
+    {
+        fseek(fp, 12, SEEK_SET);
+        fputc(0x01, fp);               /* (corrupt the byte order) */
+        fclose(fp);
+    }
+    ok((csv_fp = csv_open(image_path, "b")) == NULL
+       && csv_open(path, "b") == NULL, "reject bad images");
+    unlink(image_path);
+}
+
+/*
+ * test_scan() --Test field conversions match sscanf().
+ */
+static void test_scan(void)
+{
+    const char *fmt[] = { "%d", "%ld", "%f", "%lf", "%lg", "%le", "%x" };
+    const char *text[] = {
+        "0", "123456", "-987654", " 42", "+7", "3.14159e+0", "-.0001",
+        "0.1", "1e22", "1e23", "123456789012345678901234567890",
+        "9223372036854775807", "-9223372036854775808",
+        "9223372036854775808", "2.2250738585072014e-308", "inf", "nan",
+        "0x1p3", "", "abc", "12abc", "1.5e", "4.9406564584124654e-324",
+        "1.7976931348623157e308", "0.000000000000000000001"
+    };
+    int n_same = 0, n_test = 0;
+
+    for (size_t i = 0; i < NEL(fmt); ++i)
+    {
+        for (size_t j = 0; j < NEL(text); ++j)
+        {
+            Value v1, v2;
+            int status1, status2;
+
+            memset(&v1, 0x5a, sizeof(v1));
+            memset(&v2, 0x5a, sizeof(v2));
+            status1 = sscanf(text[j], fmt[i], &v1) == 1;
+            status2 = csv_scan_value_(fmt[i], text[j], &v2);
+            ++n_test;
+            if (status1 == status2
+                && (memcmp(&v1, &v2, sizeof(v1)) == 0
+                    || (v1.real != v1.real && v2.real != v2.real)))
+            {
+                ++n_same;
+            }
+            else
+            {
+                diag("%s \"%s\": sscanf %d, csv_scan_value_ %d",
+                     fmt[i], text[j], status1, status2);
+            }
+        }
+    }
+    ok(n_same == n_test, "csv_scan_value_() matches sscanf(); %d/%d",
+       n_same, n_test);
+}
+
+/*
+ * test_span() --Test csv_span_() agrees with the scalar version.
+ */
+static void test_span(void)
+{
+    const char delimiter[] = { ',', '"', '\n', '\r' };
+    char text[160];
+    int n_same = 0, n_test = 0;
+
+    for (size_t i = 0; i < sizeof(text); ++i)
+    {                                  /* (sparse delimiters, and 0x80+) */
+        text[i] = (char) (i % 13 == 0 ? 'a' + i % 26 : 0x80 + i % 64);
+        if (i % 37 == 36)
+        {
+            text[i] = delimiter[(i / 37) % NEL(delimiter)];
+        }
+    }
+    for (size_t start = 0; start < 64; ++start)
+    {
+        for (size_t n = 0; start + n <= sizeof(text); ++n)
+        {
+            ++n_test;
+            if (csv_span_(text + start, n)
+                == csv_span_scalar_(text + start, n))
+            {
+                ++n_same;
+            }
+        }
+    }
+    ok(n_same == n_test, "csv_span_() matches the scalar version; %d/%d",
+       n_same, n_test);
+}
+
+/*
+ * test_format() --Test value formatting matches snprintf().
+ */
+static void test_format(void)
+{
+    const char *real_fmt[] = {
+        "%f", "%.0f", "%.1f", "%.2lf", "%.6f", "%.9f", "%.12f", "%8.3f",
+        "%g", "%e"
+    };
+    const char *int_fmt[] = { "%d", "%ld", "%i", "%5d", "%lx", "%+ld" };
+    double real[] = {
+        0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.0625, 1.0 / 3.0, -1e-9,
+        3.14159, 123456.789, 0.015, 0.025, 1.005, 2.675, 9.9999995,
+        999999999999.5, 1e17, 1e18, 1e300, 4.9406564584124654e-324,
+        1e-300, 2.2250738585072014e-308, 1e100 / 1e100, 0.1, 0.7
+    };
+    long integer[] = {
+        0, 1, -1, 42, -987654, 2147483647, -2147483647 - 1, 4294967296,
+        LONG_MAX, LONG_MIN
+    };
+    int n_same = 0, n_test = 0;
+
+    for (size_t i = 0; i < NEL(real_fmt); ++i)
+    {
+        for (size_t j = 0; j < NEL(real); ++j)
+        {
+            char out[CSV_FORMAT_MIN], expect[CSV_FORMAT_MIN];
+            Value value = {.real = real[j] };
+
+            csv_format_value_(out, sizeof(out), real_fmt[i], REAL_TYPE,
+                              value);
+            snprintf(expect, sizeof(expect), real_fmt[i], real[j]);
+            ++n_test;
+            if (strcmp(out, expect) == 0)
+            {
+                ++n_same;
+            }
+            else
+            {
+                diag("%s: \"%s\", expected \"%s\"", real_fmt[i], out,
+                     expect);
+            }
+        }
+    }
+    for (size_t i = 0; i < NEL(int_fmt); ++i)
+    {
+        for (size_t j = 0; j < NEL(integer); ++j)
+        {
+            char out[CSV_FORMAT_MIN], expect[CSV_FORMAT_MIN];
+            Value value = {.integer = integer[j] };
+
+            csv_format_value_(out, sizeof(out), int_fmt[i], INTEGER_TYPE,
+                              value);
+            if (strchr(int_fmt[i], 'l') != NULL)
+            {
+                snprintf(expect, sizeof(expect), int_fmt[i], integer[j]);
+            }
+            else
+            {
+                snprintf(expect, sizeof(expect), int_fmt[i],
+                         (int) integer[j]);
+            }
+            ++n_test;
+            if (strcmp(out, expect) == 0)
+            {
+                ++n_same;
+            }
+            else
+            {
+                diag("%s: \"%s\", expected \"%s\"", int_fmt[i], out,
+                     expect);
+            }
+        }
+    }
+    for (int i = 0; i < 100000; ++i)
+    {                                  /* (random values, and precisions) */
+        char out[CSV_FORMAT_MIN], expect[CSV_FORMAT_MIN], fmt[8];
+        Value value;
+
+        value.real = ((double) rand() - RAND_MAX / 2) / (rand() % 1000 + 1);
+        sprintf(fmt, "%%.%df", i % 10);
+        csv_format_value_(out, sizeof(out), fmt, REAL_TYPE, value);
+        snprintf(expect, sizeof(expect), fmt, value.real);
+        ++n_test;
+        n_same += strcmp(out, expect) == 0;
+    }
+    ok(n_same == n_test, "csv_format_value_() matches snprintf(); %d/%d",
+       n_same, n_test);
+}
+
+/*
+ * bench_read() --Compare csv_read() (etc.) with fgets()/sscanf().
+ */
+static void bench_read(const char *path)
+{
+    const char *n_str = getenv("CSV_BENCH_RECORDS");
+    size_t n_record = n_str != NULL ? strtoul(n_str, NULL, 10) : 100000;
+    CSVField field[] = {
+        {{.name = (char *) "int",.type = INTEGER_TYPE}, "%ld", "%ld"},
+        {{.name = (char *) "real",.type = REAL_TYPE}, "%lf", "%.6f"},
+        {{.name = (char *) "str",.type = STRING_TYPE}, "%s", "%s"}
+    };
+    CSVFilePtr csv_fp;
+    FILE *fp;
+    char bytes[256];
+    Atom value[3];
+    CSVView view[3];
+    double sum = 0.0, csv_sum = 0.0, block_sum = 0.0, load_sum = 0.0;
+    double image_sum = 0.0;
+    double t_sscanf, t_csv, t_view, t_block, t_load, t_image;
+    char image_path[CSV_PATH_MAX + 8];
+    size_t n_view = 0, n_block = 0;
+    clock_t start;
+
+    diag("%s()", __func__);
+    if ((fp = fopen(path, "w")) == NULL)
+    {
+        return;
+    }
+    fputs("int,real,str\n", fp);
+    for (size_t i = 0; i < n_record; ++i)
+    {
+        fprintf(fp, "%zu,%.6f,record number %zu\n", i * 7919,
+                (double) i / 3.0, i);
+    }
+    fclose(fp);
+
+    start = clock();
+    if ((fp = fopen(path, "r")) != NULL)
+    {
+        while (fgets(bytes, sizeof(bytes), fp) != NULL)
+        {
+            char *cp = bytes;
+            long i = 0;
+            double r = 0.0;
+
+            strsplit(bytes, ',');
+            sscanf(cp, "%ld", &i);
+            cp += strlen(cp) + 1;
+            sscanf(cp, "%lf", &r);
+            sum += (double) i + r;
+        }
+        fclose(fp);
+    }
+    t_sscanf = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    if ((csv_fp = csv_open(path, "r")) != NULL)
+    {
+        free(csv_fp->field[0].item.name);
+        free(csv_fp->field);
+        csv_fp->field = field;
+        while (csv_read(csv_fp, NEL(value), value, sizeof(bytes), bytes))
+        {
+            csv_sum += (double) value[0].value.integer + value[1].value.real;
+        }
+        csv_fp->field = NULL;          /* (so csv_close() won't free it) */
+        csv_close(csv_fp);
+    }
+    t_csv = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    if ((csv_fp = csv_open(path, "m")) != NULL)
+    {
+        while (csv_read_view(csv_fp, NEL(view), view) != 0)
+        {
+            n_view += view[2].len;     /* (split only: no conversions) */
+        }
+        csv_close(csv_fp);
+    }
+    t_view = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    if ((csv_fp = csv_open(path, "m")) != NULL)
+    {
+        CSVBlock block;
+
+        free(csv_fp->field[0].item.name);
+        free(csv_fp->field);
+        csv_fp->field = field;
+        if (csv_block_init(&block, csv_fp, 1024) != NULL)
+        {
+            size_t n;
+
+            while ((n = csv_read_block(csv_fp, &block)) != 0)
+            {
+                const SYMBOL_INT *integer = block.column[0].data.integer;
+                const double *real = block.column[1].data.real;
+
+                for (size_t i = 0; i < n; ++i)
+                {
+                    block_sum += (double) integer[i] + real[i];
+                }
+            }
+            csv_block_free(&block);
+        }
+        csv_fp->field = NULL;
+        csv_close(csv_fp);
+    }
+    t_block = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    if ((csv_fp = csv_open(path, "m")) != NULL)
+    {
+        CSVLoad load;
+
+        free(csv_fp->field[0].item.name);
+        free(csv_fp->field);
+        csv_fp->field = field;
+        if (csv_load(&load, csv_fp, 0) != NULL)
+        {
+            for (size_t b = 0; b < load.n_block; ++b)
+            {
+                CSVBlockPtr block = &load.block[b];
+
+                for (size_t i = 0; i < block->n_row; ++i)
+                {
+                    load_sum += (double) block->column[0].data.integer[i]
+                        + block->column[1].data.real[i];
+                }
+            }
+            n_block = load.n_block;
+            csv_load_free(&load);
+        }
+        csv_fp->field = NULL;
+        csv_close(csv_fp);
+    }
+    t_load = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    sprintf(image_path, "%s.img", path);
+    if ((csv_fp = csv_open(path, "m")) != NULL)
+    {
+        free(csv_fp->field[0].item.name);
+        free(csv_fp->field);
+        csv_fp->field = field;
+        csv_image_write(image_path, csv_fp);
+        csv_fp->field = NULL;
+        csv_close(csv_fp);
+    }
+    start = clock();
+    if ((csv_fp = csv_open(image_path, "b")) != NULL)
+    {
+        CSVBlock block;
+
+        if (csv_block_init(&block, csv_fp, 1024) != NULL)
+        {
+            size_t n;
+
+            while ((n = csv_read_block(csv_fp, &block)) != 0)
+            {
+                const SYMBOL_INT *integer = block.column[0].data.integer;
+                const double *real = block.column[1].data.real;
+
+                for (size_t i = 0; i < n; ++i)
+                {
+                    image_sum += (double) integer[i] + real[i];
+                }
+            }
+            csv_block_free(&block);
+        }
+        csv_close(csv_fp);
+    }
+    t_image = (double) (clock() - start) / CLOCKS_PER_SEC;
+    diag("%zu records: fgets/sscanf %.1f ns, csv_read %.1f ns per record"
+         " (%s)", n_record, t_sscanf * 1e9 / (double) n_record,
+         t_csv * 1e9 / (double) n_record,
+         sum == csv_sum ? "same values" : "VALUES DIFFER");
+    diag("%zu records: csv_read_view %.1f ns per record (%zu bytes)",
+         n_record, t_view * 1e9 / (double) n_record, n_view);
+    diag("%zu records: csv_read_block %.1f ns per record (%s)",
+         n_record, t_block * 1e9 / (double) n_record,
+         sum == block_sum ? "same values" : "VALUES DIFFER");
+    diag("%zu records: csv_load %.1f ns per record, %zu blocks"
+         " (CPU time; %s)", n_record, t_load * 1e9 / (double) n_record,
+         n_block, sum == load_sum ? "same values" : "VALUES DIFFER");
+    diag("%zu records: csv_read_block (image) %.1f ns per record (%s)",
+         n_record, t_image * 1e9 / (double) n_record,
+         sum == image_sum ? "same values" : "VALUES DIFFER");
+    unlink(image_path);
+    unlink(path);
+}
+
+/*
+ * bench_span() --Compare csv_span_() with a byte-at-a-time loop.
+ */
+static void bench_span(void)
+{
+    const char *n_str = getenv("CSV_BENCH_BYTES");
+    size_t n_byte = n_str != NULL ? strtoul(n_str, NULL, 10) : 1 << 24;
+    size_t field = 24;                 /* typical field length */
+    size_t n_simd = 0, n_scalar = 0;
+    double t_simd, t_scalar;
+    clock_t start;
+    char *text;
+
+    diag("%s()", __func__);
+    if (n_byte == 0 || (text = malloc(n_byte)) == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < n_byte; ++i)
+    {
+        text[i] = (char) (i % field == field - 1 ? ',' : 'a' + i % 26);
+    }
+
+    start = clock();
+    for (size_t i = 0; i < n_byte; ++i)
+    {
+        i += csv_span_(text + i, n_byte - i);
+        ++n_simd;
+    }
+    t_simd = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (size_t i = 0; i < n_byte; ++i)
+    {
+        i += csv_span_scalar_(text + i, n_byte - i);
+        ++n_scalar;
+    }
+    t_scalar = (double) (clock() - start) / CLOCKS_PER_SEC;
+    diag("%zu bytes: scalar %.2f ns, csv_span_ %.2f ns per byte (%s)",
+         n_byte, t_scalar * 1e9 / (double) n_byte,
+         t_simd * 1e9 / (double) n_byte,
+         n_simd == n_scalar ? "same fields" : "FIELDS DIFFER");
+    free(text);
+}
+
+/*
+ * bench_write() --Compare csv_write() with fprintf().
+ */
+static void bench_write(const char *path)
+{
+    const char *n_str = getenv("CSV_BENCH_RECORDS");
+    size_t n_record = n_str != NULL ? strtoul(n_str, NULL, 10) : 100000;
+    CSVField field[] = {
+        {{.name = (char *) "int",.type = INTEGER_TYPE}, "%ld", "%ld"},
+        {{.name = (char *) "real",.type = REAL_TYPE}, "%lf", "%.6f"},
+        {{.name = (char *) "str",.type = STRING_TYPE}, "%s", "%s"}
+    };
+    char path2[CSV_PATH_MAX + 8];
+    double t_fprintf, t_csv;
+    CSVFilePtr csv_fp;
+    clock_t start;
+    FILE *fp, *fp2;
+    int same = 0;
+
+    diag("%s()", __func__);
+    snprintf(path2, sizeof(path2), "%s.2", path);
+    start = clock();
+    if ((fp = fopen(path, "w")) != NULL)
+    {
+        fputs("int,real,str\n", fp);
+        for (size_t i = 0; i < n_record; ++i)
+        {
+            fprintf(fp, "%ld,%.6f,%s\n", (long) (i * 7919),
+                    (double) i / 3.0, "record");
+        }
+        fclose(fp);
+    }
+    t_fprintf = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    if ((csv_fp = csv_open(path2, "w", (int) NEL(field), field)) != NULL)
+    {
+        Atom value[3];
+
+        for (size_t i = 0; i < n_record; ++i)
+        {
+            value[0].value.integer = (SYMBOL_INT) (i * 7919);
+            value[1].value.real = (double) i / 3.0;
+            value[2].value.string = (char *) "record";
+            csv_write(csv_fp, NEL(value), value);
+        }
+        csv_close(csv_fp);
+    }
+    t_csv = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    if ((fp = fopen(path, "r")) != NULL && (fp2 = fopen(path2, "r")) != NULL)
+    {                                  /* (too big for cmp_file()) */
+        int c;
+
+        do
+        {
+            c = getc(fp);
+        } while (c == getc(fp2) && c != EOF);
+        same = c == EOF;
+        fclose(fp2);
+    }
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    diag("%zu records: fprintf %.1f ns, csv_write %.1f ns per record (%s)",
+         n_record, t_fprintf * 1e9 / (double) n_record,
+         t_csv * 1e9 / (double) n_record,
+         same ? "same text" : "TEXT DIFFERS");
+    unlink(path2);
+}
+
 /*
  * main...
  */
@@ -118,7 +1107,7 @@ int main(void)
     sprintf(path1, "csv-1-%d.tmp", getpid());
     sprintf(path2, "csv-2-%d.tmp", getpid());
 
-    plan_tests(7);
+    plan_tests(24);
 
 
     ok(csv_open("bogus/path", "r") == NULL,
@@ -149,6 +1138,19 @@ int main(void)
      */
     csv_copy_file(path1, path2);
     ok(cmp_file(path1, path2) == 0, "simple file copy");
+
+    test_quoting(path1, path2);
+    test_view(path1);
+    test_block(path1);
+    test_load(path1);
+    test_compressed();
+    test_image(path1, path2);
+    test_scan();
+    test_span();
+    test_format();
+    bench_read(path1);
+    bench_span();
+    bench_write(path1);
     unlink(path1);
     unlink(path2);
     return exit_status();
@@ -6,6 +6,9 @@
  * sprint_ut()    --Format a time_t value to a string.
  * parse_test()   --Run a single date-parsing test.
  * tv_tests()     --Tests for timeval operations.
+ * tm_equal()     --Compare the calendar fields of two tm structs.
+ * conversion_tests() --Compare the UTC/local conversions with libc's.
+ * format_tests() --Compare the compiled formats with strftime().
  * main()         --Run some date unit tests.
  */
 #include <string.h>
@@ -124,6 +127,101 @@ static void tv_tests(void)
     } while (0);
 }
 
+/*
+ * tm_equal() --Compare the calendar fields of two tm structs.
+ */
+static int tm_equal(const struct tm *a, const struct tm *b)
+{
+    return a->tm_year == b->tm_year && a->tm_mon == b->tm_mon
+        && a->tm_mday == b->tm_mday && a->tm_hour == b->tm_hour
+        && a->tm_min == b->tm_min && a->tm_sec == b->tm_sec
+        && a->tm_wday == b->tm_wday && a->tm_yday == b->tm_yday;
+}
+
+/*
+ * conversion_tests() --Compare the UTC/local conversions with libc's.
+ *
+ * Remarks:
+ * The times step by a bit less than 5 days from 1900 to 2100, and
+ * then by 13 minutes through 2010 (so the local conversions cross
+ * both DST changes, and re-use the cached day).
+ */
+static void conversion_tests(void)
+{
+    int n_gm = 0, n_timegm = 0, n_local = 0;
+    struct tm have, expected;
+    time_t t;
+
+    for (t = -2208988800L; t < 4102444800L; t += 431999)
+    {
+        gmtime_r(&t, &expected);
+        n_gm += !tm_equal(date_gmtime(t, &have), &expected);
+        n_timegm += date_timegm(&expected) != t;
+    }
+    for (t = 1262304000; t < 1293840000; t += 13 * 60)
+    {
+        localtime_r(&t, &expected);
+        date_localtime(t, &have);
+        n_local += !tm_equal(&have, &expected)
+            || have.tm_isdst != expected.tm_isdst;
+    }
+    number_eq(n_gm, 0, "%d", "date_gmtime() matches gmtime_r()");
+    number_eq(n_timegm, 0, "%d", "date_timegm() inverts gmtime_r()");
+    number_eq(n_local, 0, "%d", "date_localtime() matches localtime_r()");
+
+    expected = (struct tm) {.tm_year = 110, .tm_mon = 13, .tm_mday = 0 };
+    number_eq((long) date_timegm(&expected), 1296432000L, "%ld",
+              "date_timegm() normalises month/day (2011-01-31)");
+}
+
+/*
+ * format_tests() --Compare the compiled formats with strftime().
+ *
+ * Remarks:
+ * Consecutive times mostly fall in the same minute, so this checks
+ * fmt_time()'s cached text as well as its freshly rendered text.
+ */
+static void format_tests(void)
+{
+    static const char *spec[] = {
+        "%Y-%m-%dT%H:%M:%S%z", "%F %T", "%b %e %H:%M:%S", "%D %R %I %p",
+        "%a %A %B %C %y %j %u %w %Z %%", "log-%Y%m%d.%H%M.txt", "%c [%s]"
+    };
+    char have[200], expected[200], long_spec[DATE_FORMAT_TEXT_MAX + 1];
+    DateFormat format;
+    struct tm tm;
+    int n_diff = 0;
+
+    for (size_t i = 0; i < NEL(spec); ++i)
+    {
+        for (time_t t = 1262304000; t < 1293840000; t += 7919)
+        {
+            for (time_t dt = 0; dt < 3; ++dt)
+            {
+                time_t when = t + dt;
+
+                localtime_r(&when, &tm);
+                strftime(expected, sizeof(expected), spec[i], &tm);
+                fmt_time(have, sizeof(have), spec[i], when);
+                n_diff += strcmp(have, expected) != 0;
+            }
+        }
+    }
+    number_eq(n_diff, 0, "%d", "fmt_time() matches strftime()");
+
+    ok(date_format_compile(&format, "%H:%M:%S") == 1, "compile a spec");
+    localtime_r(&(time_t) {1277949600}, &tm);
+    ok(date_format_tm(&format, have, 8, &tm) == 0,
+       "date_format_tm() fails if the text doesn't fit");
+    memset(long_spec, 'x', DATE_FORMAT_TEXT_MAX);
+    long_spec[DATE_FORMAT_TEXT_MAX] = '\0';
+    ok(date_format_compile(&format, long_spec) == 0,
+       "long specs aren't compiled");
+    ok(fmt_time(have, sizeof(have), long_spec, 1)
+       == have + DATE_FORMAT_TEXT_MAX && strcmp(have, long_spec) == 0,
+       "...but fmt_time() passes them to strftime()");
+}
+
 /*
  * main() --Run some date unit tests.
  *
@@ -149,7 +247,7 @@ int main(void)
     jul_t = 1277949600;                /* 2010-07-01 12:00:00 EST */
     localtime_r(&jul_t, &jul_tm);
 
-    plan_tests(42);
+    plan_tests(57);
 
     parse_test("2010-07-01", &jul_t, "%Y-%m-%d");
     parse_test("20100701", &jul_t, "%Y%m%d");
@@ -159,6 +257,7 @@ int main(void)
 
     jul_t += 7200;                     /* change time by two hours */
     parse_test("Jul 1 14:00:00", &jul_t, "syslog");
+    parse_test("Jul  1 14:00:00", &jul_t, "syslog(padded)");
     parse_test("2010-07-01T14:00:00", &jul_t, "ISO8601(T)");
     parse_test("2010-07-01 14:00:00", &jul_t, "ISO8601( )");
 
@@ -166,6 +265,8 @@ int main(void)
     jul_t = mktime(&jul_tm);
     parse_test("2010-07-01 02:00:00Z", &jul_t, "Jul ISO8601(Z)");
     parse_test("2010-01-01 01:00:00Z", &jan_t, "Jan ISO8601(Z)");
+    parse_test("2010-07-01T12:00:00+10:00", &jul_t, "ISO8601(+hh:mm)");
+    parse_test("2010-07-01T01:00:00-0100", &jul_t, "ISO8601(-hhmm)");
 
     parse_test("2010-W26-4", &jul_t, "%Y-W%W-%w");
     parse_test("2010W264", &jul_t, "%YW%W%w");
@@ -180,5 +281,7 @@ int main(void)
     parse_test("@1277949600", &jul_t, "%s");
 
     tv_tests();
+    conversion_tests();
+    format_tests();
     return exit_status();
 }
@@ -10,6 +10,7 @@
  * test_strtoupper() --strtoupper tests.
  * test_strsub()     --strsub tests.
  * test_strtr()      --strtr tests.
+ * test_long()       --estrsub(), estrtr(), strsplit() vector path tests.
  * test_vstrmatch()  --vstrmatch tests.
  * main()            --Tests entrypoint.
  */
@@ -158,6 +159,58 @@ static void test_strtr(void)
               "estrtr() returns end of string");
 }
 
+/*
+ * test_long() --estrsub(), estrtr(), strsplit() vector path tests.
+ *
+ * Remarks:
+ * The strings are long enough (and start at odd offsets) to exercise
+ * the unaligned head, whole blocks and the tail of the SIMD loops.
+ */
+static void test_long(void)
+{
+    char text[300], expect[300];
+    size_t i, n = 0;
+    char *end;
+
+    for (i = 0; i < 257; ++i)
+    {
+        text[i] = (i % 7 == 0) ? ',' : 'a' + (char) (i % 26);
+    }
+    text[i] = '\0';
+
+    (void) estrcpy(expect, text + 3);
+    for (i = 0; expect[i] != '\0'; ++i)
+    {
+        expect[i] = expect[i] == ',' ? ';' : expect[i];
+    }
+    end = estrsub(text + 3, ',', ';', true);
+    string_eq(text + 3, expect, "estrsub() substitutes in long strings");
+    ok(end == text + 257, "estrsub() returns end of long string");
+
+    for (i = 0; expect[i] != '\0'; ++i)
+    {
+        expect[i] = expect[i] == 'a' ? 'A' : expect[i] == ';' ? ' '
+            : expect[i] == 'z' ? 'Z' : expect[i];
+    }
+    end = estrtr(text + 3, ";aaz", " AbZ");
+    string_eq(text + 3, expect, "estrtr() translates long strings");
+    ok(end == text + 257, "estrtr() returns end of long string");
+
+    (void) estrtr(text + 3, "abcdefghijklmnopqrstuvwxyz",
+                  "ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+    ok(strchr(text + 3, 'q') == NULL && strchr(text + 3, 'Q') != NULL,
+       "estrtr() translates large sets");
+
+    for (i = 5; i < 257; ++i)
+    {
+        n += text[i] == ' ';
+    }
+    number_eq(strsplit(text + 5, ' '), n + 1, "%zu",
+              "strsplit() splits long strings");
+    ok(memchr(text + 5, ' ', 257 - 5) == NULL,
+       "strsplit() terminates every field");
+}
+
 /*
  * test_vstrmatch() --vstrmatch tests.
  */
@@ -174,7 +227,7 @@ static void test_vstrmatch(void)
  */
 int main(void)
 {
-    plan_tests(26);
+    plan_tests(33);
 
     test_strempty();
     test_strtrunc();
@@ -184,6 +237,7 @@ int main(void)
     test_strtoupper();
     test_strsub();
     test_strtr();
+    test_long();
     test_vstrmatch();
 
     return exit_status();
@@ -0,0 +1,206 @@
+/*
+ * TEST-EVENT-LOOP.C --Unit tests for the event loop.
+ *
+ * Contents:
+ * test_read()   --Test dispatching a readable pipe.
+ * test_remove() --Test removing a handler from another handler.
+ * test_timer()  --Test expiring timers from the loop.
+ * test_many()   --Test many fds, including some beyond FD_SETSIZE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/event-loop.h>
+
+static void test_read(void);
+static void test_remove(void);
+static void test_timer(void);
+static void test_many(void);
+
+static TimeValue no_wait = { 0, 0 };
+
+int main(void)
+{
+    plan_tests(12);
+    test_read();
+    test_remove();
+    test_timer();
+    test_many();
+    return exit_status();
+}
+
+/*
+ * read_proc() --Read a byte, and count the call.
+ */
+static void read_proc(EventLoopPtr UNUSED(loop), int fd, int events,
+                      void *data)
+{
+    char c;
+
+    if (events & EVENT_READ)
+    {
+        (void) !read(fd, &c, 1);
+        *(int *) data += 1;
+    }
+}
+
+/*
+ * test_read() --Test dispatching a readable pipe.
+ */
+static void test_read(void)
+{
+    EventLoopPtr loop = event_loop_new(NULL);
+    int fd[2], n_read = 0;
+
+    (void) !pipe(fd);
+    ok(event_loop_add(loop, fd[0], EVENT_READ, read_proc, &n_read),
+       "add: pipe");
+    ok(!event_loop_add(loop, fd[0], EVENT_READ, read_proc, &n_read),
+       "add: fd is already added");
+    ok(event_loop_wait(loop, &no_wait) == 0 && n_read == 0,
+       "wait: nothing ready");
+    (void) !write(fd[1], "x", 1);
+    ok(event_loop_wait(loop, &no_wait) == 1 && n_read == 1,
+       "wait: readable pipe is dispatched");
+    event_loop_remove(loop, fd[0]);
+    (void) !write(fd[1], "x", 1);
+    ok(event_loop_wait(loop, &no_wait) == 0 && n_read == 1,
+       "wait: removed fd is not dispatched");
+    event_loop_free(loop);
+    close(fd[0]);
+    close(fd[1]);
+}
+
+/*
+ * remove_proc() --Remove the other pipe's handler.
+ */
+static int remove_fd[2];
+
+static void remove_proc(EventLoopPtr loop, int fd, int UNUSED(events),
+                        void *data)
+{
+    *(int *) data += 1;
+    event_loop_remove(loop, fd == remove_fd[0] ? remove_fd[1] : remove_fd[0]);
+}
+
+/*
+ * test_remove() --Test removing a handler from another handler.
+ */
+static void test_remove(void)
+{
+    EventLoopPtr loop = event_loop_new(NULL);
+    int a[2], b[2], n_call = 0;
+
+    (void) !pipe(a);
+    (void) !pipe(b);
+    remove_fd[0] = a[0];
+    remove_fd[1] = b[0];
+    event_loop_add(loop, a[0], EVENT_READ, remove_proc, &n_call);
+    event_loop_add(loop, b[0], EVENT_READ, remove_proc, &n_call);
+    (void) !write(a[1], "x", 1);
+    (void) !write(b[1], "x", 1);
+    event_loop_wait(loop, &no_wait);
+    ok(n_call == 1, "remove: removed handler isn't called in the same wait");
+    event_loop_free(loop);
+    close(a[0]);
+    close(a[1]);
+    close(b[0]);
+    close(b[1]);
+}
+
+/*
+ * stop_proc() --Stop the loop when a timer expires.
+ */
+static void stop_proc(TimerPtr UNUSED(timer), void *data)
+{
+    event_loop_stop(data);
+}
+
+/*
+ * test_timer() --Test expiring timers from the loop.
+ */
+static void test_timer(void)
+{
+    TimerWheel wheel;
+    TimeValue start, tick = { 0, 1000 }, when, end;
+    Timer timer;
+    EventLoopPtr loop;
+    double elapsed;
+
+    gettimeofday(&start, NULL);
+    timer_wheel_init(&wheel, &start, &tick, 64, 8);
+    loop = event_loop_new(&wheel);
+    when = start;
+    when.tv_usec += 20000;
+    tv_normalise(&when);
+    timer_schedule(&wheel, timer_init(&timer, stop_proc, loop), &when);
+
+    ok(event_loop_run(loop), "timer: run");
+    gettimeofday(&end, NULL);
+    elapsed = (double) (end.tv_sec - start.tv_sec)
+        + (double) (end.tv_usec - start.tv_usec) / 1e6;
+    ok(!timer_pending(&timer) && elapsed >= 0.019,
+       "timer: expired after %.3fs", elapsed);
+    ok(event_loop_run(loop), "timer: run returns with nothing to wait for");
+    event_loop_free(loop);
+    timer_wheel_free(&wheel);
+}
+
+/*
+ * test_many() --Test many fds, including some beyond FD_SETSIZE.
+ */
+static void test_many(void)
+{
+    struct rlimit limit;
+    int n_pipe = 1000, n_read = 0, n_ready = 0, max_fd = 0;
+    int (*fd)[2];
+    EventLoopPtr loop = event_loop_new(NULL);
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+        if ((rlim_t) n_pipe * 2 + 32 > limit.rlim_cur)
+        {
+            n_pipe = (int) (limit.rlim_cur - 32) / 2;
+        }
+    }
+    fd = NEW(int[2], (size_t) n_pipe);
+    for (int i = 0; i < n_pipe; ++i)
+    {
+        if (pipe(fd[i]) < 0)
+        {
+            n_pipe = i;
+            break;
+        }
+        event_loop_add(loop, fd[i][0], EVENT_READ, read_proc, &n_read);
+        max_fd = MAX(max_fd, fd[i][1]);
+    }
+    for (int i = 0; i < n_pipe; i += 7)
+    {
+        (void) !write(fd[i][1], "x", 1);
+        ++n_ready;
+    }
+    while (event_loop_wait(loop, &no_wait) > 0)
+    {
+        ;
+    }
+    ok(n_read == n_ready, "many: %d of %d pipes dispatched", n_read, n_pipe);
+    ok(max_fd >= FD_SETSIZE || n_pipe < 1000,
+       "many: max fd %d (FD_SETSIZE %d)", max_fd, FD_SETSIZE);
+    for (int i = 0; i < n_pipe; ++i)
+    {
+        event_loop_remove(loop, fd[i][0]);
+        close(fd[i][0]);
+        close(fd[i][1]);
+    }
+    ok(event_loop_run(loop), "many: run returns when all fds are removed");
+    free(fd);
+    event_loop_free(loop);
+}
@@ -0,0 +1,161 @@
+/*
+ * FILTER.C --Unit tests for the Bloom and cuckoo filters.
+ *
+ * Contents:
+ * make_key()       --Format a test key.
+ * test_bloom()     --No false negatives, and about the requested FP rate.
+ * test_cuckoo()    --Add, check, remove, and filling up.
+ * main()           --Tests entrypoint.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <apex/test.h>
+#include <apex/filter.h>
+#include <apex/hash.h>
+
+enum
+{
+    N_KEY = 10000
+};
+
+/*
+ * make_key() --Format a test key.
+ */
+static size_t make_key(char *key, size_t size, const char *prefix, int i)
+{
+    return (size_t) snprintf(key, size, "%s-%d", prefix, i);
+}
+
+/*
+ * test_bloom() --No false negatives, and about the requested FP rate.
+ */
+static void test_bloom(void)
+{
+    BloomFilterPtr filter = bloom_new(N_KEY, 0.01, NULL);
+    BloomFilterPtr pjw = bloom_new(N_KEY, 0.01, hash_keyn_pjw);
+    char key[32];
+    int n_missing = 0, n_false = 0, n_pjw = 0;
+    size_t n;
+
+    ok(filter != NULL && pjw != NULL, "bloom_new()");
+    ok(bloom_new(N_KEY, 0.0, NULL) == NULL, "bloom_new(): bad fp_rate");
+    for (int i = 0; i < N_KEY; ++i)
+    {
+        n = make_key(key, sizeof(key), "in", i);
+        bloom_add(filter, key, n);
+        bloom_add(pjw, key, n);
+    }
+    for (int i = 0; i < N_KEY; ++i)
+    {
+        n = make_key(key, sizeof(key), "in", i);
+        n_missing += !bloom_check(filter, key, n) + !bloom_check(pjw, key, n);
+    }
+    ok(n_missing == 0, "bloom_check(): no false negatives");
+    for (int i = 0; i < 10 * N_KEY; ++i)
+    {
+        n = make_key(key, sizeof(key), "out", i);
+        n_false += bloom_check(filter, key, n);
+        n_pjw += bloom_check(pjw, key, n);
+    }
+    ok(n_false < 10 * N_KEY * 0.02,
+       "bloom_check(): false positive rate %.3f%%", n_false / 1000.0);
+    ok(n_pjw < 10 * N_KEY * 0.02,
+       "bloom_check(): false positive rate %.3f%% (pjw)", n_pjw / 1000.0);
+    bloom_clear(filter);
+    ok(!bloom_check(filter, "in-0", 4) && filter->n_items == 0,
+       "bloom_clear()");
+    bloom_free(filter);
+    bloom_free(pjw);
+}
+
+/*
+ * test_cuckoo() --Add, check, remove, and filling up.
+ */
+static void test_cuckoo(void)
+{
+    CuckooFilterPtr filter = cuckoo_new(N_KEY, NULL);
+    char key[32];
+    int n_fail = 0, n_missing = 0, n_false = 0, n_added;
+    size_t n;
+
+    ok(filter != NULL, "cuckoo_new()");
+    for (int i = 0; i < N_KEY; ++i)
+    {
+        n = make_key(key, sizeof(key), "in", i);
+        n_fail += !cuckoo_add(filter, key, n);
+    }
+    ok(n_fail == 0 && filter->n_items == N_KEY, "cuckoo_add()");
+    for (int i = 0; i < N_KEY; ++i)
+    {
+        n = make_key(key, sizeof(key), "in", i);
+        n_missing += !cuckoo_check(filter, key, n);
+    }
+    ok(n_missing == 0, "cuckoo_check(): no false negatives");
+    for (int i = 0; i < 10 * N_KEY; ++i)
+    {
+        n = make_key(key, sizeof(key), "out", i);
+        n_false += cuckoo_check(filter, key, n);
+    }
+    ok(n_false < 10 * N_KEY * 0.001,
+       "cuckoo_check(): false positive rate %.3f%%", n_false / 1000.0);
+
+    for (int i = 0; i < N_KEY; i += 2)
+    {
+        n = make_key(key, sizeof(key), "in", i);
+        n_fail += !cuckoo_remove(filter, key, n);
+    }
+    n_missing = 0;
+    for (int i = 1; i < N_KEY; i += 2)
+    {
+        n = make_key(key, sizeof(key), "in", i);
+        n_missing += !cuckoo_check(filter, key, n);
+    }
+    ok(n_fail == 0 && n_missing == 0 && filter->n_items == N_KEY / 2,
+       "cuckoo_remove() keeps the other keys");
+    n_false = 0;
+    for (int i = 0; i < N_KEY; i += 2)
+    {
+        n = make_key(key, sizeof(key), "in", i);
+        n_false += cuckoo_check(filter, key, n);
+    }
+    ok(n_false < N_KEY / 2 * 0.001, "cuckoo_remove(): removed keys are gone");
+
+    cuckoo_clear(filter);
+    for (n_added = 0; n_added < 4 * N_KEY; ++n_added)
+    {
+        n = make_key(key, sizeof(key), "fill", n_added);
+        if (!cuckoo_add(filter, key, n))
+        {
+            break;
+        }
+    }
+    ok(n_added < 4 * N_KEY
+       && n_added >= (filter->mask + 1) * CUCKOO_BUCKET_SIZE * 0.9,
+       "cuckoo_add() fails when full (load %.1f%%)",
+       100.0 * n_added / ((filter->mask + 1) * CUCKOO_BUCKET_SIZE));
+    n_missing = 0;
+    for (int i = 0; i < n_added; ++i)
+    {
+        n = make_key(key, sizeof(key), "fill", i);
+        n_missing += !cuckoo_check(filter, key, n);
+    }
+    ok(n_missing == 0, "a full filter has no false negatives");
+    n = make_key(key, sizeof(key), "fill", 0);
+    cuckoo_remove(filter, key, n);
+    n = make_key(key, sizeof(key), "fill", n_added);
+    ok(cuckoo_add(filter, key, n), "cuckoo_remove() makes room");
+    cuckoo_free(filter);
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(15);
+
+    test_bloom();
+    test_cuckoo();
+
+    return exit_status();
+}
@@ -3,23 +3,31 @@
  *
  * Contents:
  * test_getopts()    --Test the behaviour of getopts().
+ * test_opt_index()  --Test finding options with an OptIndex.
  * test_str_inet4()  --Test the behaviour of str_inet4_address().
  * test_str_int()    --Test the behaviour of str_int().
  * test_str_int16()  --Test the behaviour of str_int16().
  * test_str_int16()  --Test the behaviour of str_int16().
+ * test_str_exact()  --Test the number parsers agree with strto*().
+ * bench_str_parse() --Compare the number parsers with strto*().
  * array_equal()     --Test if two integer arrays are equal.
  * test_str_list()   --Test integer list parsing.
  * str_array_equal() --Test if two integer arrays are equal.
  * test_str_list()   --Test integer list parsing.
  *
  */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <apex/test.h>
 #include <apex.h>
 #include <apex/estring.h>
 #include <apex/strparse.h>
 #include <apex/getopts.h>
+#include <apex/option.h>
 
 typedef struct Opt
 {
@@ -31,10 +39,13 @@ static Opt null_opt = {.a = 0 };
 
 
 static void test_getopts(void);
+static void test_opt_index(void);
 static void test_str_inet4(void);
 static void test_str_int(void);
 static void test_str_int16(void);
 static void test_str_double(void);
+static void test_str_exact(void);
+static void bench_str_parse(void);
 static int array_equal(size_t n, int a[], int b[]);
 static void test_str_list(void);
 static int str_array_equal(size_t n, char *a[], char *b[]);
@@ -42,13 +53,16 @@ static void test_str_str_list(void);
 
 int main(void)
 {
-    plan_tests(53);
+    plan_tests(65);
 
     test_getopts();
+    test_opt_index();
     test_str_inet4();
     test_str_int();
     test_str_int16();
     test_str_double();
+    test_str_exact();
+    bench_str_parse();
     test_str_list();
     test_str_str_list();
 
@@ -116,6 +130,41 @@ static void test_getopts(void)
     while (0);
 }
 
+/*
+ * test_opt_index() --Test finding options with an OptIndex.
+ */
+static void test_opt_index(void)
+{
+    int flag = 0;
+    Option opts[] = {
+        {'z', "zulu", NULL, NULL, NULL, opt_bool, &flag, 0},
+        {'a', "alpha", "n", "1", NULL, opt_int, NULL, 0},
+        {0, "mike", NULL, NULL, NULL, NULL, NULL, 0},
+        {'a', "mike", NULL, NULL, NULL, NULL, NULL, 0},
+        {0, NULL, NULL, NULL, NULL, NULL, NULL, 0}
+    };
+    char *args[] = { "test", "-z", "--mike" };
+    OptIndex index;
+
+    ok(opt_index_init(&index, opts), "opt_index_init()");
+    ok(opt_index_find(&index, "alpha") == &opts[1]
+       && opt_index_find(&index, "zulu") == &opts[0]
+       && opt_index_find(&index, "bravo") == NULL,
+       "opt_index_find(): finds names");
+    ok(opt_index_find(&index, "mike") == &opts[2]
+       && opt_index_getopt(&index, 'a') == &opts[1],
+       "opt_index_find(): first of duplicates");
+    ok(opt_index_getopt(&index, 'q') == NULL
+       && opt_index_getopt(&index, 0) == NULL,
+       "opt_index_getopt(): unknown characters");
+    optind = 1;
+    ok(opt_getopts_index(NEL(args), args, &index) && flag
+       && opts[0].set && opts[2].set && !opts[3].set,
+       "opt_getopts_index(): sets the options");
+    opt_index_free(&index);
+    optind = 1;
+}
+
 /*
  * test_str_inet4() --Test the behaviour of str_inet4_address().
  */
@@ -185,6 +234,164 @@ static void test_str_double(void)
     ok(!str_double("foobar", &dvalue), "str_double(): bad value");
 }
 
+/*
+ * random_number() --Format a random decimal number.
+ */
+static void random_number(char *text, size_t size, int real)
+{
+    static const uint64_t limit[] = {
+        UINT64_C(10), UINT64_C(1000), UINT64_C(1000000),
+        UINT64_C(1000000000), UINT64_C(100000000000000000)
+    };
+    uint64_t mantissa = ((uint64_t) rand() << 31 | (uint64_t) rand())
+        % (real ? limit[rand() % NEL(limit)] : UINT64_C(2000000000));
+    const char *sign = rand() % 2 ? "-" : "";
+
+    if (!real)
+    {
+        snprintf(text, size, "%s%llu", sign, (unsigned long long) mantissa);
+    }
+    else if (rand() % 2)
+    {
+        snprintf(text, size, "%s%llue%d", sign, (unsigned long long) mantissa,
+                 rand() % 80 - 40);
+    }
+    else
+    {
+        snprintf(text, size, "%s%llu.%03d", sign,
+                 (unsigned long long) (mantissa % 1000000), rand() % 1000);
+    }
+}
+
+/*
+ * test_str_exact() --Test the number parsers agree with strto*().
+ */
+static void test_str_exact(void)
+{
+    char text[64];
+    int value, n_int = 0, n_double = 0, n_float = 0;
+    unsigned int uvalue;
+    double dvalue;
+    float fvalue;
+
+    ok(str_int("2147483647", &value) && value == 2147483647
+       && str_int("-2147483648", &value) && value == -2147483647 - 1,
+       "str_int(): limits");
+    ok(!str_int("99999999999999999999", &value) && !str_int("1 ", &value)
+       && !str_int("-", &value) && !str_int("0x", &value),
+       "str_int(): range and syntax errors");
+    ok(str_int("010", &value) && value == 8 && str_int(" 12", &value)
+       && value == 12 && str_int("+7", &value) && value == 7,
+       "str_int(): octal, spaces, sign (as strtol())");
+    ok(str_uint("4294967295", &uvalue) && uvalue == 4294967295u,
+       "str_uint(): limit");
+    ok(str_double("0.1", &dvalue) && dvalue == 0.1
+       && str_double("1e-400", &dvalue) == 0 && str_double(".5", &dvalue)
+       && dvalue == 0.5 && !str_double("1e", &dvalue),
+       "str_double(): precision, range and syntax");
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        char *end;
+        long lvalue;
+        double dstrto;
+        float fstrto;
+
+        random_number(text, sizeof(text), 0);
+        errno = 0;
+        lvalue = strtol(text, &end, 0);
+        n_int += str_int(text, &value) && value == (int) lvalue;
+        random_number(text, sizeof(text), 1);
+        errno = 0;
+        dstrto = strtod(text, &end);
+        if (str_double(text, &dvalue) ? memcmp(&dvalue, &dstrto,
+                                               sizeof(dvalue)) == 0
+            : errno != 0)
+        {
+            ++n_double;                /* same value, or both fail */
+        }
+        errno = 0;
+        fstrto = strtof(text, &end);
+        if (str_float(text, &fvalue) ? memcmp(&fvalue, &fstrto,
+                                              sizeof(fvalue)) == 0
+            : errno != 0)
+        {
+            ++n_float;
+        }
+    }
+    ok(n_int == 20000, "str_int() matches strtol() (%d)", n_int);
+    ok(n_double + n_float == 40000, "str_double(), str_float() match"
+       " strtod(), strtof() (%d, %d)", n_double, n_float);
+}
+
+/*
+ * bench_str_parse() --Compare the number parsers with strto*().
+ *
+ * Remarks:
+ * The "old" parsers are strtol()/strtod() wrapped as they were.
+ */
+static void bench_str_parse(void)
+{
+    const char *n_str = getenv("STRPARSE_BENCH_VALUES");
+    size_t n_value = n_str != NULL ? strtoul(n_str, NULL, 10) : 100000;
+    char (*text)[32] = calloc(n_value + 1, sizeof(*text));
+    double t_strtol, t_int, t_strtod, t_double, sum = 0;
+    clock_t start;
+    char *end;
+
+    diag("%s()", __func__);
+    if (text == NULL)
+    {
+        return;
+    }
+    srand(1);
+    for (size_t i = 0; i < n_value; ++i)
+    {
+        random_number(text[i], sizeof(text[i]), 0);
+    }
+    start = clock();
+    for (size_t i = 0; i < n_value; ++i)
+    {
+        errno = 0;
+        sum += (int) strtol(text[i], &end, 0) * (errno == 0 && *end == '\0');
+    }
+    t_strtol = (double) (clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (size_t i = 0; i < n_value; ++i)
+    {
+        int value = 0;
+
+        sum += str_int(text[i], &value) * value;
+    }
+    t_int = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    for (size_t i = 0; i < n_value; ++i)
+    {
+        random_number(text[i], sizeof(text[i]), 1);
+    }
+    start = clock();
+    for (size_t i = 0; i < n_value; ++i)
+    {
+        errno = 0;
+        sum += strtod(text[i], &end) * (errno == 0 && *end == '\0');
+    }
+    t_strtod = (double) (clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (size_t i = 0; i < n_value; ++i)
+    {
+        double value = 0;
+
+        sum += str_double(text[i], &value) * value;
+    }
+    t_double = (double) (clock() - start) / CLOCKS_PER_SEC;
+    diag("%zu values: strtol %.1f ns, str_int %.1f ns;"
+         " strtod %.1f ns, str_double %.1f ns (%g)", n_value,
+         t_strtol * 1e9 / (double) n_value, t_int * 1e9 / (double) n_value,
+         t_strtod * 1e9 / (double) n_value,
+         t_double * 1e9 / (double) n_value, sum);
+    free(text);
+}
+
 /*
  * array_equal() --Test if two integer arrays are equal.
  *
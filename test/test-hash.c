@@ -5,12 +5,20 @@
  * hash()         --A dummy hash function that makes tests easier.
  * print_item()   --Print a hash item into the global text string.
  * compare_item() --Compare two hash items for equality.
+ * test_growth()  --Test that a growable table rehashes incrementally.
+ * test_cached_hash() --Test that the cached hash avoids compare calls.
+ * test_find_many() --Test batched lookup.
+ * test_cursor()  --Test traversal with a HashCursor.
+ * test_key_wy()  --Test the wyhash functions.
+ * test_key_throughput() --Compare the throughput of the hash functions.
  *
  */
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <apex.h>
 #include <apex/tap.h>
+#include <apex/test.h>
 #include <apex/log.h>
 #include <apex/hash.h>
 
@@ -47,6 +55,258 @@ static int compare_item(const void *data, const void *key)
     return ((int) data - (int) key);
 }
 
+static int n_compare;
+
+/*
+ * compare_str() --Compare two string items, counting the calls.
+ */
+static int compare_str(const void *data, const void *key)
+{
+    n_compare += 1;
+    return strcmp((const char *) data, (const char *) key);
+}
+
+/*
+ * test_cached_hash() --Test that the cached hash avoids compare calls.
+ */
+static void test_cached_hash(void)
+{
+    static char *words[] = {
+        "alpha", "bravo", "charlie", "delta", "echo", "foxtrot"
+    };
+    HashPtr h = hash_new(hash_key_jenkins, 1);  /* everything collides */
+    char key[] = "delta";
+    void *found;
+
+    for (size_t i = 0; i < NEL(words); ++i)
+    {
+        hash_insert(h, words[i]);
+    }
+    n_compare = 0;
+    found = hash_find(h, compare_str, key);
+    ok(found == words[3] && n_compare == 1,
+       "hash_find() calls compare only for matching hash (%d calls)",
+       n_compare);
+    hash_free(h);
+}
+
+/*
+ * test_find_many() --Test batched lookup.
+ */
+static void test_find_many(void)
+{
+    HashPtr h = hash_new(hash, 37);
+    void *key[100];
+    void *result[NEL(key)];
+    size_t n_found;
+    int status = 1;
+
+    for (long i = 1; i <= 50; ++i)
+    {
+        hash_insert(h, (void *) (i * 2));   /* even numbers only */
+    }
+    for (size_t i = 0; i < NEL(key); ++i)
+    {
+        key[i] = (void *) (i + 1);
+    }
+    n_found = hash_find_many(h, compare_item, key, NEL(key), result);
+    number_eq(n_found, (size_t) 50, "%zu", "hash_find_many() found count");
+    for (size_t i = 0; i < NEL(key); ++i)
+    {
+        if (result[i] != hash_find(h, compare_item, key[i]))
+        {
+            status = 0;
+        }
+    }
+    ok(status, "hash_find_many() agrees with hash_find()");
+    hash_free(h);
+}
+
+/*
+ * test_cursor() --Test traversal with a HashCursor.
+ */
+static void test_cursor(void)
+{
+    HashPtr h = hash_new(hash, 7);
+    HashCursor c;
+    long sum = 0, n = 0;
+    void *item;
+
+    hash_cursor_init(&c, h);
+    ptr_eq(hash_cursor_next(&c), NULL, "hash_cursor_next() empty table");
+
+    for (long i = 1; i <= 100; ++i)
+    {
+        hash_insert(h, (void *) i);
+    }
+    hash_cursor_init(&c, h);
+    while ((item = hash_cursor_next(&c)) != NULL)
+    {
+        sum += (long) item;
+        n += 1;
+    }
+    ok(n == 100 && sum == 5050, "hash_cursor_next() visits all items");
+
+    hash_set_growth(h, 1.0);
+    hash_cursor_init(&c, h);
+    n = 0;
+    while ((item = hash_cursor_next(&c)) != NULL)
+    {                                  /* modify the table as we go */
+        if ((long) item % 2 == 0)
+        {
+            hash_remove(h, compare_item, item);
+        }
+        if ((long) item <= 100)
+        {
+            hash_insert(h, (void *) ((long) item + 1000));
+        }
+        if (++n >= 10000)
+        {
+            break;                     /* runaway: fail */
+        }
+    }
+    ok_number(n, <, 10000L, "%ld",
+              "hash_cursor_next() terminates while table changes");
+    hash_free(h);
+}
+
+/*
+ * test_key_wy() --Test the wyhash functions.
+ */
+static void test_key_wy(void)
+{
+    char text[] = "the quick brown fox jumps over the lazy dog, twice over";
+    size_t counts[64] = { 0 };
+    size_t max_count = 0;
+    char key[20];
+    int status = 1;
+
+    for (size_t n = 0; n <= strlen(text); ++n)
+    {                                  /* test every length path */
+        char c = text[n];
+
+        text[n] = '\0';
+        if (hash_key_wy(text) != hash_keyn_wy(text, n) ||
+            (n > 0 && hash_keyn_wy(text, n) == hash_keyn_wy(text, n - 1)))
+        {
+            status = 0;
+        }
+        text[n] = c;
+    }
+    ok(status, "hash_key_wy() matches hash_keyn_wy() for all lengths");
+
+    ok(hash_keyn_wy_seed(text, 10, 1) != hash_keyn_wy_seed(text, 10, 2),
+       "hash_keyn_wy_seed() depends on the seed");
+    hash_set_seed(42);
+    ok(hash_key_seeded(text) == hash_keyn_wy_seed(text, strlen(text), 42),
+       "hash_key_seeded() uses hash_set_seed()");
+
+    for (int i = 0; i < 6400; ++i)
+    {
+        sprintf(key, "key%d", i);
+        counts[hash_key_wy(key) % NEL(counts)] += 1;
+    }
+    for (size_t i = 0; i < NEL(counts); ++i)
+    {
+        max_count = MAX(max_count, counts[i]);
+    }
+    ok_number(max_count, <, (size_t) 140, "%zu",
+              "hash_key_wy() distributes sequential keys evenly");
+}
+
+/*
+ * test_key_throughput() --Compare the throughput of the hash functions.
+ *
+ * Remarks:
+ * This doesn't test anything, it just reports the results.
+ */
+static void test_key_throughput(void)
+{
+    static struct
+    {
+        const char *name;
+        unsigned long (*hash)(char *data, size_t n);
+    } hash_proc[] = {
+        {"pjw", hash_keyn_pjw},
+        {"elf", hash_keyn_elf},
+        {"jenkins", hash_keyn_jenkins},
+        {"wy", hash_keyn_wy},
+        {"seeded", hash_keyn_seeded},
+    };
+    static char data[64 * 1024];
+    size_t key_len[] = { 8, 32, 256, sizeof(data) };
+    volatile unsigned long sink = 0;
+
+    for (size_t i = 0; i < sizeof(data); ++i)
+    {
+        data[i] = (char) ('a' + i % 26);
+    }
+    for (size_t k = 0; k < NEL(key_len); ++k)
+    {
+        for (size_t i = 0; i < NEL(hash_proc); ++i)
+        {
+            size_t total = 0;
+            clock_t start = clock();
+            double elapsed;
+
+            while (total < 16 * sizeof(data))
+            {
+                for (size_t offset = 0; offset + key_len[k] <= sizeof(data);
+                     offset += key_len[k])
+                {
+                    sink += hash_proc[i].hash(data + offset, key_len[k]);
+                }
+                total += sizeof(data);
+            }
+            elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+            diag("%8s, %6zu byte keys: %8.1f MB/s", hash_proc[i].name,
+                 key_len[k], elapsed > 0 ? total / elapsed / 1e6 : 0.0);
+        }
+    }
+    (void) sink;
+}
+
+/*
+ * test_growth() --Test that a growable table rehashes incrementally.
+ */
+static void test_growth(void)
+{
+    HashPtr h = hash_new(hash, 4);
+    HashStats stats;
+    unsigned long generation;
+    int status = 1;
+
+    hash_set_growth(h, 1.0);
+    for (long i = 1; i <= 1000; ++i)
+    {
+        hash_insert(h, (void *) i);
+        generation = h->generation;
+        if ((long) hash_find(h, compare_item, (void *) (i / 2 + 1)) !=
+            i / 2 + 1 || h->generation != generation)
+        {                              /* check items during rehashing */
+            status = 0;
+        }
+    }
+    ok(status, "hash_find() succeeds while resizing, and is read-only");
+
+    hash_stats(h, &stats);
+    ok(stats.n_items == 1000 && stats.n_resize > 0,
+       "hash_stats() reports %zu items, %zu resizes",
+       stats.n_items, stats.n_resize);
+    ok(stats.load <= 1.0, "hash_stats() load %.2f within limit", stats.load);
+
+    for (long i = 1; i <= 1000; ++i)
+    {
+        if ((long) hash_remove(h, compare_item, (void *) i) != i)
+        {
+            status = 0;
+        }
+    }
+    hash_stats(h, &stats);
+    ok(status && stats.n_items == 0, "hash_remove() all items");
+    hash_free(h);
+}
+
 /*
  * These tests rely on having a "dumb" hash function to order
  * the items in the slot in a particular way.
@@ -55,7 +315,7 @@ int main(void)
 {
     HashPtr h;
 
-    plan_tests(10);
+    plan_tests(24);
 
     ok((int) hash_new(hash, 0) == 0, "hash_new() bad nslots");
 
@@ -99,6 +359,14 @@ int main(void)
 
     ok(hash_remove(h, compare_item, (void *) 0) == 0,
        "hash_remove() non-existent item");
+    hash_free(h);
+
+    test_growth();
+    test_cached_hash();
+    test_find_many();
+    test_cursor();
+    test_key_wy();
+    test_key_throughput();
 
     return exit_status();
 }
@@ -0,0 +1,174 @@
+/*
+ * TEST-HEAP-DARY.C --Tests and benchmark for d-ary typed heaps.
+ *
+ * Contents:
+ * test_order() --Test that a heap of each arity returns items in order.
+ * bench_heap() --Compare the speed of binary, 4-ary and 8-ary heaps.
+ *
+ * Remarks:
+ * The benchmark runs heap sizes from 1K items up to $HEAP_BENCH_MAX
+ * (default 100K, to keep the test quick; set it to 10000000 for a
+ * thorough comparison).  Each size does a "hold" pattern: pop the
+ * minimum, and push a later item, as a timer or event queue would.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/atomic.h>
+#include <apex/heap-typed.h>
+
+typedef struct Event_t
+{
+    uint64_t when;
+    uint64_t data;
+} Event;                               /* (16 bytes: 4 per cache line) */
+
+#define event_before(a_, b_) ((a_)->when < (b_)->when)
+HEAP_DEFINE(Heap2, Event, event_before)
+HEAP_DEFINE_DARY(Heap4, Event, event_before, 4)
+HEAP_DEFINE_DARY(Heap8, Event, event_before, 8)
+
+static void test_order(void);
+static void bench_heap(void);
+
+int main(void)
+{
+    plan_tests(4);
+    test_order();
+    bench_heap();
+    return exit_status();
+}
+
+/*
+ * new_items() --Allocate heap storage, with item[1] cache-line aligned.
+ */
+static Event *new_items(size_t n, void **mem)
+{
+    char *base;
+
+    if (posix_memalign(mem, CACHE_LINE, CACHE_LINE + n * sizeof(Event)) != 0)
+    {
+        return NULL;
+    }
+    base = *mem;
+    return (Event *) (base + CACHE_LINE - sizeof(Event));
+}
+
+/*
+ * random_time() --Return a pseudo-random time (xorshift).
+ */
+static uint64_t random_time(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state % 1000000000u;
+}
+
+#define TEST_HEAP(name_, n_, status_)                                   \
+    do {                                                                \
+        void *mem = NULL;                                               \
+        name_ heap = { NULL, 0, 0 };                                    \
+        Event event = { 0, 0 }, last = { 0, 0 };                        \
+        uint64_t seed = 1;                                              \
+                                                                        \
+        name_##_init(&heap, (n_), new_items((n_), &mem));               \
+        for (int i = 0; i < (n_); ++i)                                  \
+        {                                                               \
+            event.when = random_time(&seed);                            \
+            name_##_push(&heap, &event);                                \
+        }                                                               \
+        name_##_delete(&heap, (n_) / 3);                                \
+        while (name_##_pop(&heap, &event))                              \
+        {                                                               \
+            if (event.when < last.when)                                 \
+            {                                                           \
+                (status_) = 0;                                          \
+            }                                                           \
+            last = event;                                               \
+        }                                                               \
+        free(mem);                                                      \
+    } while (0)
+
+/*
+ * test_order() --Test that a heap of each arity returns items in order.
+ */
+static void test_order(void)
+{
+    Heap4 heap;
+    Event event = { 0, 0 };
+    int status = 1;
+
+    diag("%s()", __func__);
+    TEST_HEAP(Heap2, 1000, status);
+    ok(status, "binary heap returns items in order");
+    TEST_HEAP(Heap4, 1000, status);
+    ok(status, "4-ary heap returns items in order");
+    TEST_HEAP(Heap8, 1000, status);
+    ok(status, "8-ary heap returns items in order");
+
+    Heap4_init(&heap, 1, &event);
+    ok(!Heap4_delete(&heap, 0) && Heap4_push(&heap, &event)
+       && !Heap4_delete(&heap, 1) && heap.n_used == 1,
+       "delete() rejects an empty heap, and a slot not in use");
+}
+
+#define BENCH_HEAP(name_, items_, n_, t_)                               \
+    do {                                                                \
+        name_ heap;                                                     \
+        Event event = { 0, 0 };                                         \
+        uint64_t seed = 1;                                              \
+        clock_t start;                                                  \
+                                                                        \
+        name_##_init(&heap, (int) (n_), (items_));                      \
+        for (size_t i = 0; i < (n_); ++i)                               \
+        {                                                               \
+            event.when = random_time(&seed);                            \
+            name_##_push(&heap, &event);                                \
+        }                                                               \
+        start = clock();                                                \
+        for (size_t i = 0; i < (n_); ++i)                               \
+        {                                                               \
+            name_##_pop(&heap, &event);                                 \
+            event.when += random_time(&seed);                           \
+            name_##_push(&heap, &event);                                \
+        }                                                               \
+        (t_) = (double) (clock() - start) / CLOCKS_PER_SEC;             \
+    } while (0)
+
+/*
+ * bench_heap() --Compare the speed of binary, 4-ary and 8-ary heaps.
+ */
+static void bench_heap(void)
+{
+    const char *max_str = getenv("HEAP_BENCH_MAX");
+    size_t max = max_str != NULL ? strtoul(max_str, NULL, 10) : 100000;
+    void *mem;
+    Event *items = new_items(max, &mem);
+
+    diag("%s()", __func__);
+    if (items == NULL)
+    {
+        diag("cannot allocate %zu items", max);
+        return;
+    }
+    diag("%10s %10s %10s %10s  (ns per pop+push)", "items", "binary",
+         "4-ary", "8-ary");
+    for (size_t n = 1000; n <= max; n *= 10)
+    {
+        double t2, t4, t8;
+
+        BENCH_HEAP(Heap2, items, n, t2);
+        BENCH_HEAP(Heap4, items, n, t4);
+        BENCH_HEAP(Heap8, items, n, t8);
+        diag("%10zu %10.1f %10.1f %10.1f", n, t2 * 1e9 / n, t4 * 1e9 / n,
+             t8 * 1e9 / n);
+    }
+    free(mem);
+}
@@ -5,24 +5,36 @@
  * TBD
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <apex/tap.h>
 #include <apex/test.h>
 #include <apex/heap.h>
 #include <apex/compare.h>
+#include <apex/heap-typed.h>
+#include <time.h>
+
+#define int_before(a_, b_) (*(a_) < *(b_))
+HEAP_DEFINE(IntHeap, int, int_before)
 
 static void print_heap(HeapPtr heap);
 static void test_null(void);
 static void test_int(int n);
+static void test_typed(void);
+static void test_build(void);
+static void test_indexed(void);
 
 int main(void)
 {
-    plan_tests(26);
+    plan_tests(41);
     test_null();
     test_int(0);
     test_int(1);
     test_int(10);
+    test_typed();
+    test_build();
+    test_indexed();
 
     return exit_status();
 }
@@ -136,3 +148,155 @@ static void test_int(int n)
         print_heap(h);
     }
 }
+
+/*
+ * test_typed() --Test a heap defined with HEAP_DEFINE().
+ *
+ * Remarks:
+ * This also reports the relative speed of the typed and
+ * generic heaps.
+ */
+static void test_typed(void)
+{
+    enum { N = 100000 };
+    static int generic_storage[N];
+    int *storage = malloc(N * sizeof(*storage));
+    IntHeap heap = { NULL, 0, 0 };
+    Heap generic;
+    int item, last = -1;
+    int status = 1;
+    clock_t start;
+    double t_typed, t_generic;
+
+    diag("%s()", __func__);
+    ok(IntHeap_init(&heap, N, storage) == &heap,
+       "IntHeap_init() returns first argument");
+    start = clock();
+    for (int i = 0; i < N; ++i)
+    {
+        item = (int) ((i * 7919L) % N);
+        status &= IntHeap_push(&heap, &item);
+    }
+    ok(status && IntHeap_push(&heap, &item) == 0,
+       "IntHeap_push() all items, then overflow fails");
+    IntHeap_delete(&heap, N / 2);
+    for (int i = 0; i < N - 1; ++i)
+    {
+        if (!IntHeap_pop(&heap, &item) || item < last)
+        {
+            status = 0;
+        }
+        last = item;
+    }
+    t_typed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    ok(status, "IntHeap_pop() returns items in order");
+    ok(IntHeap_pop(&heap, &item) == 0 && IntHeap_peek(&heap) == NULL,
+       "IntHeap_pop() underflow returns failure");
+
+    init_heap(&generic, int_cmp, generic_storage);
+    start = clock();
+    for (int i = 0; i < N; ++i)
+    {
+        item = (int) ((i * 7919L) % N);
+        heap_push(&generic, &item);
+    }
+    while (heap_pop(&generic, &item))
+    {
+        ;
+    }
+    t_generic = (double) (clock() - start) / CLOCKS_PER_SEC;
+    diag("%d push/pop: typed %.3fs, generic %.3fs", N, t_typed, t_generic);
+    free(storage);
+}
+
+/*
+ * test_build() --Test heap_build() and heap_push_n().
+ */
+static void test_build(void)
+{
+    int storage[1000];
+    int more[500];
+    Heap heap;
+    int item, last = -1;
+    int status = 1;
+
+    diag("%s()", __func__);
+    for (int i = 0; i < 400; ++i)
+    {
+        storage[i] = (int) ((i * 7919L) % 400);
+    }
+    init_heap(&heap, int_cmp, storage);
+    ok(heap_build(&heap, 400) && heap.n_used == 400,
+       "heap_build() adopts the items in storage");
+    ok(heap_ok(storage, heap.n_used, sizeof(int), int_cmp),
+       "heap_build() creates a heap");
+    for (int i = 0; i < (int) NEL(more); ++i)
+    {
+        more[i] = (int) ((i * 31L) % NEL(more));
+    }
+    number_eq(heap_push_n(&heap, more, 100), 100, "%d",
+              "heap_push_n() (few items) inserts all items");
+    number_eq(heap_push_n(&heap, more, NEL(more)), 500, "%d",
+              "heap_push_n() (many items) inserts up to capacity");
+    while (heap_pop(&heap, &item))
+    {
+        if (item < last)
+        {
+            status = 0;
+        }
+        last = item;
+    }
+    ok(status, "heap_pop() returns items in order");
+}
+
+/*
+ * test_indexed() --Test the indexed heap's update and remove by handle.
+ */
+static void test_indexed(void)
+{
+    int storage[100];
+    int index[2 * NEL(storage)];
+    int handle[NEL(storage)];
+    IndexedHeap heap;
+    int item, last = -1000;
+    int n = 0, status = 1;
+
+    diag("%s()", __func__);
+    ok(init_iheap(&heap, int_cmp, storage, index) == &heap,
+       "init_iheap() returns first argument");
+    for (int i = 0; i < (int) NEL(storage); ++i)
+    {
+        item = (int) ((i * 37L) % NEL(storage));
+        if ((handle[i] = iheap_push(&heap, &item)) < 0)
+        {
+            status = 0;
+        }
+    }
+    ok(status && iheap_push(&heap, &item) == -1,
+       "iheap_push() all items, then overflow fails");
+    for (int i = 0; i < (int) NEL(storage); i += 3)
+    {                                  /* (reschedule every 3rd item) */
+        *(int *) iheap_item(&heap, handle[i]) = 50 - i;
+        status &= iheap_update(&heap, handle[i]);
+    }
+    ok(status, "iheap_update() re-positions items");
+    for (int i = 1; i < (int) NEL(storage); i += 3)
+    {                                  /* (cancel every 3rd item) */
+        status &= iheap_remove(&heap, handle[i]);
+    }
+    ok(status && !iheap_remove(&heap, handle[1]),
+       "iheap_remove() removes items once");
+    ok(*(int *) iheap_item(&heap, iheap_peek(&heap)) == 50 - 99,
+       "iheap_peek() returns the smallest item's handle");
+    while (iheap_pop(&heap, &item))
+    {
+        if (item < last)
+        {
+            status = 0;
+        }
+        last = item;
+        ++n;
+    }
+    ok(status && n == (int) NEL(storage) - 33,
+       "iheap_pop() returns the remaining items in order");
+}
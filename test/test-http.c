@@ -0,0 +1,537 @@
+/*
+ * TEST-HTTP.C --Unit tests for the HTTP client, against a local server.
+ *
+ * Contents:
+ * serve()            --Run a tiny HTTP server (in a child process).
+ * start_server()     --Start the server, and return its port.
+ * get()              --GET a path, and return the body as a string.
+ * test_request()     --Test http_request() (one connection per request),
+ *                      and request formatting.
+ * test_pool()        --Test connection re-use by http_pool_request().
+ * parse_split()      --Parse a response in two parts, split at some offset.
+ * test_parse()       --Test the incremental parser on split/pipelined input.
+ * completed()        --Record an asynchronous response.
+ * submit()           --Submit an asynchronous GET of a path.
+ * test_client()      --Test pipelined/re-queued requests on an event loop.
+ *
+ * Remarks:
+ * The server handles one connection at a time (reading requests
+ * and writing responses through separate streams, so pipelined
+ * requests aren't lost from the input buffer), and its responses
+ * say which connection (and request on that connection) they're for,
+ * e.g. "conn 2 req 3", so the tests can tell when a connection was
+ * re-used.  The path selects the response framing:
+ * * /chunked   --chunked transfer encoding
+ * * /close     --"Connection: close"
+ * * /eof       --no Content-Length (the body ends at EOF)
+ * * /drop      --Content-Length, then the server closes the connection
+ * * (other)    --Content-Length
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/http.h>
+#include <apex/protocol.h>
+#include <apex/vector.h>
+
+static void test_request(void);
+static void test_pool(void);
+static void test_parse(void);
+static void test_client(void);
+
+static int port;
+
+int main(void)
+{
+    plan_tests(31);
+    signal(SIGPIPE, SIG_IGN);
+    test_request();
+    test_pool();
+    test_parse();
+    test_client();
+    return exit_status();
+}
+
+/*
+ * serve() --Run a tiny HTTP server (in a child process).
+ */
+static void serve(int listen_fd)
+{
+    for (int n_conn = 1;; ++n_conn)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        FILE *in = fdopen(fd, "r"), *fp = fdopen(dup(fd), "w");
+        char line[1000], path[1000], body[100];
+        int open = 1;
+
+        for (int n_req = 1; open && fgets(line, sizeof(line), in); ++n_req)
+        {
+            sscanf(line, "%*s %999s", path);
+            while (fgets(line, sizeof(line), in) != NULL
+                   && strcmp(line, "\r\n") != 0)
+            {
+                ;                      /* skip headers */
+            }
+            snprintf(body, sizeof(body), "conn %d req %d", n_conn, n_req);
+            if (strstr(path, "/chunked") != NULL)
+            {
+                fprintf(fp, "HTTP/1.1 200 OK\r\n"
+                        "Transfer-Encoding: chunked\r\n\r\n"
+                        "5;ext=1\r\n%.5s\r\n%zx\r\n%s\r\n0\r\n"
+                        "X-Trailer: yes\r\n\r\n",
+                        body, strlen(body + 5), body + 5);
+            }
+            else if (strstr(path, "/eof") != NULL)
+            {
+                fprintf(fp, "HTTP/1.1 200 OK\r\n\r\n%s", body);
+                open = 0;
+            }
+            else
+            {
+                open = strstr(path, "/close") == NULL;
+                fprintf(fp, "HTTP/1.1 200 OK\r\n"
+                        "Content-Length: %zu\r\n%s\r\n%s",
+                        strlen(body), open ? "" : "Connection: close\r\n",
+                        body);
+                open = open && strstr(path, "/drop") == NULL;
+            }
+            fflush(fp);
+        }
+        fclose(fp);
+        fclose(in);
+    }
+}
+
+/*
+ * start_server() --Start the server, and return its pid.
+ */
+static pid_t start_server(void)
+{
+    int listen_fd = open_listen_opt("127.0.0.1:0", PF_INET, SOCK_STREAM,
+                                    16, LISTEN_REUSEADDR);
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    pid_t pid;
+
+    getsockname(listen_fd, (struct sockaddr *) &addr, &len);
+    port = ntohs(addr.sin_port);
+    if ((pid = fork()) == 0)
+    {
+        serve(listen_fd);
+        _exit(0);
+    }
+    close(listen_fd);
+    return pid;
+}
+
+/*
+ * get() --GET a path, and return the body as a string.
+ */
+static const char *get(HTTPPoolPtr pool, const char *path)
+{
+    static char text[100];
+    HTTPRequest req = {
+        .url = {.scheme = (char *) "http",.domain = (char *) "127.0.0.1"}
+    };
+    HTTPResponsePtr r;
+    int n;
+
+    req.url.port = port;
+    req.url.path = (char *) path;
+    r = (pool != NULL) ? http_pool_request(pool, HTTP_GET, &req, HTTP_V1_1)
+        : http_request(HTTP_GET, &req, HTTP_V1_1);
+    if (r == NULL)
+    {
+        return "(failed)";
+    }
+    n = r->content != NULL ? MIN(vector_len((void *) r->content), 99) : 0;
+    memcpy(text, r->content, (size_t) n);
+    text[n] = '\0';
+    http_free_response(r);
+    return text;
+}
+
+/*
+ * test_request() --Test http_request() (one connection per request).
+ */
+static void test_request(void)
+{
+    pid_t pid = start_server();
+    const char *body;
+
+    body = get(NULL, "hello");
+    ok(strcmp(body, "conn 1 req 1") == 0, "request: %s", body);
+    body = get(NULL, "hello");
+    ok(strcmp(body, "conn 2 req 1") == 0, "request: new connection (%s)",
+       body);
+    body = get(NULL, "chunked");
+    ok(strcmp(body, "conn 3 req 1") == 0, "request: chunked (%s)", body);
+    body = get(NULL, "eof");
+    ok(strcmp(body, "conn 4 req 1") == 0, "request: body to EOF (%s)",
+       body);
+    {
+        static char path[6000];
+
+        memset(path, 'x', sizeof(path) - 1);
+        body = get(NULL, path);
+        ok(strcmp(body, "conn 5 req 1") == 0, "request: long path (%s)",
+           body);
+    }
+    {
+        Symbol header[] = {
+            {.name = "Host",.type = STRING_TYPE,.value.string = "example"},
+            {.name = "X-A",.type = STRING_TYPE,.value.string = "b"}
+        };
+        HTTPRequest req = {
+            .url = {.domain = (char *) "example",.port = 80,
+                    .path = (char *) "p",.query = (char *) "q=1"}
+        };
+        size_t len = 0;
+        char *text;
+
+        req.header = NEW_VECTOR(Symbol, 2, header);
+        text = http_format(HTTP_GET, &req, HTTP_V1_0, &len);
+        ok(text != NULL && strcmp(text, "GET /p?q=1 HTTP/1.0\r\n"
+                                  "Host: example\r\nX-A: b\r\n\r\n") == 0
+           && len == strlen(text), "request: http_format()");
+        free(text);
+        free_vector(req.header);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+/*
+ * test_pool() --Test connection re-use by http_pool_request().
+ */
+static void test_pool(void)
+{
+    pid_t pid = start_server();
+    HTTPPoolPtr pool = http_pool_new(1, 100);
+    const char *body;
+    int n_same = 0;
+
+    for (int i = 1; i <= 5; ++i)
+    {
+        char expected[100];
+
+        snprintf(expected, sizeof(expected), "conn 1 req %d", i);
+        n_same += strcmp(get(pool, "hello"), expected) == 0;
+    }
+    ok(n_same == 5, "pool: 5 requests on one connection");
+    body = get(pool, "chunked");
+    ok(strcmp(body, "conn 1 req 6") == 0, "pool: chunked (%s)", body);
+    body = get(pool, "hello");
+    ok(strcmp(body, "conn 1 req 7") == 0,
+       "pool: re-used after chunked (%s)", body);
+    body = get(pool, "close");
+    ok(strcmp(body, "conn 1 req 8") == 0, "pool: Connection: close (%s)",
+       body);
+    body = get(pool, "hello");
+    ok(strcmp(body, "conn 2 req 1") == 0, "pool: reconnect (%s)", body);
+    body = get(pool, "eof");
+    ok(strcmp(body, "conn 2 req 2") == 0, "pool: body to EOF (%s)", body);
+    body = get(pool, "drop");
+    ok(strcmp(body, "conn 3 req 1") == 0, "pool: reconnect (%s)", body);
+    usleep(20000);                     /* (server has closed conn 3) */
+    body = get(pool, "hello");
+    ok(strcmp(body, "conn 4 req 1") == 0,
+       "pool: retry after a stale connection (%s)", body);
+    get(pool, "hello");
+    usleep(150000);
+    body = get(pool, "hello");
+    ok(strcmp(body, "conn 5 req 1") == 0, "pool: idle timeout (%s)", body);
+    http_pool_free(pool);
+
+    pool = http_pool_new(1, 0);
+    body = get(pool, "hello");
+    ok(strcmp(body, "conn 6 req 1") == 0, "pool: no idle time (%s)", body);
+    http_pool_free(pool);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+/*
+ * Parsed --The parts of a response collected by the parser callbacks.
+ */
+typedef struct Parsed
+{
+    int status, n_header, n_done;
+    char reason[100], last_header[100], body[1000];
+    size_t body_len;
+} Parsed;
+
+static int parsed_status(void *data, int status, const char *reason,
+                         size_t len)
+{
+    Parsed *p = data;
+
+    p->status = status;
+    snprintf(p->reason, sizeof(p->reason), "%.*s", (int) len, reason);
+    return 1;
+}
+
+static int parsed_header(void *data, const char *name, size_t name_len,
+                         const char *value, size_t value_len)
+{
+    Parsed *p = data;
+
+    p->n_header += 1;
+    snprintf(p->last_header, sizeof(p->last_header), "%.*s=%.*s",
+             (int) name_len, name, (int) value_len, value);
+    return 1;
+}
+
+static int parsed_body(void *data, const char *ptr, size_t len)
+{
+    Parsed *p = data;
+
+    memcpy(p->body + p->body_len, ptr, len);
+    p->body_len += len;
+    p->body[p->body_len] = '\0';
+    return 1;
+}
+
+static int parsed_done(void *data)
+{
+    ((Parsed *) data)->n_done += 1;
+    return 1;
+}
+
+static const HTTPParserProcs parsed_procs = {
+    parsed_status, parsed_header, NULL, parsed_body, parsed_done
+};
+
+/*
+ * parse_split() --Parse a response in two parts, split at some offset.
+ *
+ * Remarks:
+ * Unconsumed bytes are kept, and presented again with the rest.
+ * Returns the total number of bytes consumed, or -1.
+ */
+static ssize_t parse_split(HTTPParserPtr parser, Parsed * parsed,
+                           const char *text, size_t split)
+{
+    char buf[1000];
+    size_t len = strlen(text), n_buf, total = 0;
+    ssize_t n;
+
+    memset(parsed, 0, sizeof(*parsed));
+    http_parser_init(parser, HTTP_GET, &parsed_procs, parsed);
+    memcpy(buf, text, split);
+    if ((n = http_parse(parser, buf, split)) < 0)
+    {
+        return -1;
+    }
+    total = (size_t) n;
+    n_buf = split - (size_t) n;
+    memmove(buf, buf + n, n_buf);
+    memcpy(buf + n_buf, text + split, len - split);
+    if ((n = http_parse(parser, buf, n_buf + len - split)) < 0)
+    {
+        return -1;
+    }
+    return (ssize_t) (total + (size_t) n);
+}
+
+/*
+ * test_parse() --Test the incremental parser on split/pipelined input.
+ */
+static void test_parse(void)
+{
+    static const char chunked[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "X-Test:  padded value \r\n\r\n"
+        "4\r\nWiki\r\n6;name=x\r\npedia \r\nE\r\nin \r\n\r\nchunks.\r\n"
+        "0\r\nX-Trailer: t\r\n\r\n";
+    static const char pipelined[] =
+        "HTTP/1.1 404 Not Found\r\nContent-Length: 5\r\n\r\nnope!"
+        "HTTP/1.1 200 OK\r\n\r\n";
+    static const char eof_body[] = "HTTP/1.0 200 OK\r\n\r\nto the end";
+    HTTPParser parser;
+    Parsed parsed;
+    int n_ok = 0;
+    ssize_t n;
+
+    for (size_t split = 0; split <= strlen(chunked); ++split)
+    {
+        n = parse_split(&parser, &parsed, chunked, split);
+        n_ok += (n == (ssize_t) strlen(chunked) && http_parse_done(&parser)
+                 && strcmp(parsed.body,
+                           "Wikipedia in \r\n\r\nchunks.") == 0
+                 && parsed.n_header == 3 && parsed.n_done == 1);
+    }
+    ok(n_ok == (int) strlen(chunked) + 1,
+       "parse: chunked, split at every offset (%d)", n_ok);
+    ok(parsed.status == 200 && strcmp(parsed.reason, "OK") == 0,
+       "parse: status line");
+    ok(strcmp(parsed.last_header, "X-Trailer=t") == 0 && parser.keep_alive,
+       "parse: trailer header, keep-alive");
+
+    parse_split(&parser, &parsed, chunked, 50);
+    n = parse_split(&parser, &parsed, "HTTP/1.1 200 OK\r\nX-Test:  v \r\n"
+                    "Content-Length: 0\r\n\r\n", 10);
+    ok(n > 0 && strcmp(parsed.last_header, "Content-Length=0") == 0
+       && parsed.n_done == 1, "parse: empty body");
+
+    memset(&parsed, 0, sizeof(parsed));
+    http_parser_init(&parser, HTTP_GET, &parsed_procs, &parsed);
+    n = http_parse(&parser, pipelined, strlen(pipelined));
+    ok(n == 50 && http_parse_done(&parser) && parsed.status == 404
+       && strcmp(parsed.body, "nope!") == 0,
+       "parse: stops at the end of the response (%zd)", n);
+
+    memset(&parsed, 0, sizeof(parsed));
+    http_parser_init(&parser, HTTP_GET, &parsed_procs, &parsed);
+    n = http_parse(&parser, eof_body, strlen(eof_body));
+    ok(n == (ssize_t) strlen(eof_body) && !http_parse_done(&parser)
+       && http_parse_eof(&parser) && !parser.keep_alive
+       && strcmp(parsed.body, "to the end") == 0, "parse: body to EOF");
+
+    memset(&parsed, 0, sizeof(parsed));
+    http_parser_init(&parser, HTTP_HEAD, &parsed_procs, &parsed);
+    n = http_parse(&parser, pipelined, strlen(pipelined));
+    ok(n == 45 && http_parse_done(&parser) && parsed.body_len == 0,
+       "parse: HEAD response has no body");
+
+    http_parser_init(&parser, HTTP_GET, NULL, NULL);
+    ok(http_parse(&parser, "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n"
+                  "short", 45) == 45 && !http_parse_eof(&parser),
+       "parse: truncated body");
+    http_parser_init(&parser, HTTP_GET, NULL, NULL);
+    ok(http_parse(&parser, "HTTP/2 200 OK\r\n\r\n", 17) < 0,
+       "parse: bad status line");
+    http_parser_init(&parser, HTTP_GET, NULL, NULL);
+    ok(http_parse(&parser, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked"
+                  "\r\n\r\nzz\r\n", 52) < 0, "parse: bad chunk size");
+    http_parser_init(&parser, HTTP_GET, NULL, NULL);
+    {
+        static char big[HTTP_LINE_MAX + 100];
+
+        memset(big, 'x', sizeof(big));
+        ok(http_parse(&parser, big, sizeof(big)) < 0, "parse: line too long");
+    }
+}
+
+/*
+ * Completed --The responses collected by the asynchronous tests.
+ */
+typedef struct Completed
+{
+    EventLoopPtr loop;
+    int n_submit, n_done;
+    char body[10][100];
+} Completed;
+
+typedef struct Call
+{
+    Completed *completed;
+    int i;
+} Call;
+
+/*
+ * completed() --Record an asynchronous response.
+ */
+static void completed(HTTPResponsePtr r, void *data)
+{
+    Call *call = data;
+    Completed *c = call->completed;
+    char *body = c->body[call->i];
+    size_t n;
+
+    strcpy(body, "(failed)");
+    if (r != NULL)
+    {
+        n = r->content != NULL
+            ? MIN(vector_len((void *) r->content), 99) : 0;
+        memcpy(body, r->content, n);
+        body[n] = '\0';
+        http_free_response(r);
+    }
+    if (++c->n_done == c->n_submit)
+    {
+        event_loop_stop(c->loop);
+    }
+}
+
+/*
+ * submit() --Submit an asynchronous GET of a path.
+ */
+static void submit(HTTPClientPtr client, Completed * c, Call * call,
+                   const char *path, int port)
+{
+    HTTPRequest req = {
+        .url = {.scheme = (char *) "http",.domain = (char *) "127.0.0.1"}
+    };
+
+    req.url.port = port;
+    req.url.path = (char *) path;
+    call->completed = c;
+    call->i = c->n_submit++;
+    http_client_submit(client, HTTP_GET, &req, HTTP_V1_1, completed, call);
+}
+
+/*
+ * test_client() --Test pipelined/re-queued requests on an event loop.
+ */
+static void test_client(void)
+{
+    static const char *paths[] = { "hello", "hello", "close", "hello",
+        "hello"
+    };
+    static const char *expected[] = { "conn 1 req 11", "conn 1 req 12",
+        "conn 1 req 13", "conn 2 req 1", "conn 2 req 2"
+    };
+    pid_t pid = start_server();
+    Completed c = {.loop = event_loop_new(NULL) };
+    HTTPClientPtr client = http_client_new(c.loop, 1, 4);
+    Call call[10];
+    int n_ok = 0;
+
+    for (int i = 0; i < 10; ++i)
+    {
+        submit(client, &c, &call[i], "hello", port);
+    }
+    ok(http_client_pending(client) == 10, "client: 10 requests pending");
+    event_loop_run(c.loop);
+    for (int i = 0; i < 10; ++i)
+    {
+        char text[100];
+
+        snprintf(text, sizeof(text), "conn 1 req %d", i + 1);
+        n_ok += strcmp(c.body[i], text) == 0;
+    }
+    ok(n_ok == 10 && http_client_pending(client) == 0,
+       "client: 10 requests, in order, on one connection");
+
+    memset(c.body, 0, sizeof(c.body));
+    c.n_submit = c.n_done = n_ok = 0;
+    for (int i = 0; i < 5; ++i)
+    {
+        submit(client, &c, &call[i], paths[i], port);
+    }
+    event_loop_run(c.loop);
+    for (int i = 0; i < 5; ++i)
+    {
+        n_ok += strcmp(c.body[i], expected[i]) == 0;
+    }
+    ok(n_ok == 5, "client: pipelined requests re-queued after close");
+    http_client_free(client);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    client = http_client_new(c.loop, 1, 4);
+    c.n_submit = c.n_done = 0;
+    submit(client, &c, &call[0], "hello", port);
+    event_loop_run(c.loop);
+    ok(strcmp(c.body[0], "(failed)") == 0, "client: connect refused");
+    http_client_free(client);
+    event_loop_free(c.loop);
+}
@@ -0,0 +1,180 @@
+/*
+ * INET4.C --Unit tests for the inet4 network table.
+ *
+ * Contents:
+ * linear_find()   --Find an address's longest network by scanning a list.
+ * test_networks() --Test some overlapping networks, added in any order.
+ * test_random()   --Compare the table with a linear scan.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/inet4.h>
+
+typedef struct Network
+{
+    uint32_t address;
+    uint32_t netmask;
+    unsigned int value;
+} Network;
+
+/*
+ * linear_find() --Find an address's longest network by scanning a list.
+ *
+ * Remarks:
+ * As for the table, a later network replaces an earlier, equal one.
+ */
+static int linear_find(const Network *network, size_t n_network,
+                       uint32_t address, unsigned int *value)
+{
+    const Network *best = NULL;
+
+    for (size_t i = 0; i < n_network; ++i)
+    {
+        if ((address & network[i].netmask) == network[i].address
+            && (best == NULL || network[i].netmask >= best->netmask))
+        {
+            best = &network[i];
+        }
+    }
+    if (best != NULL)
+    {
+        *value = best->value;
+    }
+    return best != NULL;
+}
+
+/*
+ * test_networks() --Test some overlapping networks, added in any order.
+ */
+static void test_networks(void)
+{
+    static const char *network[] = {
+        "10.0.0.0/8", "10.1.0.0/16", "10.1.2.0/24", "10.1.2.128/25",
+        "10.1.2.130", "10.1.2.130/32", "0.0.0.0/0"
+    };
+    static const struct
+    {
+        uint32_t address;
+        unsigned int value;
+    } test[] = {
+        {0x0a000001, 0}, {0x0a010001, 1}, {0x0a010201, 2},
+        {0x0a010281, 3}, {0x0a010282, 5}, {0x0b000000, 6}
+    };
+    int n_forward = 0, n_reverse = 0;
+    unsigned int value;
+    Inet4TablePtr forward = inet4_table_new();
+    Inet4TablePtr reverse = inet4_table_new();
+    Inet4TablePtr empty = inet4_table_new();
+
+    for (size_t i = 0; i < NEL(network); ++i)
+    {
+        inet4_table_add_str(forward, network[i], i);
+        inet4_table_add_str(reverse, network[NEL(network) - 1 - i],
+                            NEL(network) - 1 - i);
+    }
+    for (size_t i = 0; i < NEL(test); ++i)
+    {
+        n_forward += inet4_table_find(forward, test[i].address, &value)
+            && value == test[i].value;
+        n_reverse += inet4_table_find(reverse, test[i].address, &value)
+            && value == (test[i].value == 5 ? 4 : test[i].value);
+    }
+    ok(n_forward == (int) NEL(test), "longest network is found (%d)",
+       n_forward);
+    ok(n_reverse == (int) NEL(test), "insertion order doesn't matter (%d)",
+       n_reverse);
+    ok(!inet4_table_find(empty, 0x0a000001, &value),
+       "empty table finds nothing");
+    ok(!inet4_table_add(forward, 0x0a000000, 0xff00ff00, 1)
+       && !inet4_table_add_str(forward, "not-an-address", 1),
+       "bad networks are rejected");
+    inet4_table_free(forward);
+    inet4_table_free(reverse);
+    inet4_table_free(empty);
+}
+
+/*
+ * test_random() --Compare the table with a linear scan.
+ */
+static void test_random(void)
+{
+    const char *n_str = getenv("INET4_BENCH_NETWORKS");
+    size_t n_network = n_str != NULL ? strtoul(n_str, NULL, 10) : 1000;
+    size_t n_address = 100000, n_same = 0;
+    Network *network = NEW(Network, n_network);
+    uint32_t *address = NEW(uint32_t, n_address);
+    Inet4TablePtr table = inet4_table_new();
+    double t_linear, t_table;
+    unsigned int sum = 0;
+    clock_t start;
+
+    if (network == NULL || address == NULL || table == NULL)
+    {
+        skip(1, "malloc failed");
+        return;
+    }
+    srand(1);
+    for (size_t i = 0; i < n_network; ++i)
+    {                                  /* (mostly within 10/8) */
+        unsigned int n_bit = 8 + (unsigned int) rand() % 25;
+        uint32_t base = rand() % 4 ? 0x0a000000 : (uint32_t) rand() << 1;
+
+        network[i].netmask = 0xffffffffu << (32 - n_bit);
+        network[i].address = (base | ((uint32_t) rand() & 0x00ffffff))
+            & network[i].netmask;
+        network[i].value = (unsigned int) i;
+        inet4_table_add(table, network[i].address, network[i].netmask,
+                        network[i].value);
+    }
+    for (size_t i = 0; i < n_address; ++i)
+    {
+        address[i] = (rand() % 2 ? 0x0a000000 : (uint32_t) rand() << 1)
+            | ((uint32_t) rand() & 0x00ffffff);
+    }
+    for (size_t i = 0; i < n_address; ++i)
+    {
+        unsigned int expected = ~0u, value = ~0u;
+        int found = linear_find(network, n_network, address[i], &expected);
+
+        n_same += (inet4_table_find(table, address[i], &value) == found
+                   && value == expected);
+    }
+    ok(n_same == n_address, "table matches a linear scan (%zu of %zu)",
+       n_same, n_address);
+
+    start = clock();
+    for (size_t i = 0; i < n_address; ++i)
+    {
+        unsigned int value = 0;
+
+        sum += linear_find(network, n_network, address[i], &value) * value;
+    }
+    t_linear = (double) (clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (size_t i = 0; i < n_address; ++i)
+    {
+        unsigned int value = 0;
+
+        sum += inet4_table_find(table, address[i], &value) * value;
+    }
+    t_table = (double) (clock() - start) / CLOCKS_PER_SEC;
+    diag("%zu networks: linear scan %.1f ns, table %.1f ns per lookup (%u)",
+         n_network, t_linear * 1e9 / (double) n_address,
+         t_table * 1e9 / (double) n_address, sum);
+    inet4_table_free(table);
+    free(address);
+    free(network);
+}
+
+int main(void)
+{
+    plan_tests(5);
+    test_networks();
+    test_random();
+    return exit_status();
+}
@@ -0,0 +1,123 @@
+/*
+ * INI.C --Unit tests for the "INI" functions.
+ *
+ * Remarks:
+ * The ini files are read from memory streams (which have no file
+ * descriptor, so ini_load() can't use the file's size).
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/ini.h>
+#include <apex/vector.h>
+
+static const char ini_text[] =
+    "# comment\n"
+    "top = 1\n"
+    "dup = a\n"
+    "dup = 'b'  \n"
+    "[ alpha ]\r\n"
+    "x = \"quoted value\"\n"
+    "bad line\n"
+    "[default]\n"
+    "y = fallback\n"
+    "[alpha ]\n"
+    "z = 3\n";
+
+/*
+ * load() --Load some text into a symbol table (or a new one).
+ */
+static SymbolPtr load(const char *text, SymbolPtr sym, unsigned int flags)
+{
+    FILE *fp = fmemopen((void *) text, strlen(text), "r");
+    Ini ini = {.name = (char *) "test.ini",.fp = fp,.flags = flags };
+
+    sym = ini_load(&ini, sym);
+    fclose(fp);
+    return sym;
+}
+
+/*
+ * same_table() --Compare two INI symbol trees.
+ */
+static int same_table(SymbolPtr a, SymbolPtr b)
+{
+    for (; a->type != VOID_TYPE && b->type != VOID_TYPE; ++a, ++b)
+    {
+        if (a->type != b->type || strcmp(a->name, b->name) != 0
+            || (a->type == STRING_TYPE
+                && strcmp(a->value.string, b->value.string) != 0)
+            || (a->type == STRUCT_TYPE
+                && !same_table(a->value.field, b->value.field)))
+        {
+            return 0;
+        }
+    }
+    return a->type == b->type;
+}
+
+/*
+ * test_load() --Test that the fast loader matches the callback loader.
+ */
+static void test_load(void)
+{
+    SymbolPtr fast = load(ini_text, NULL, 0);
+    SymbolPtr slow = load(ini_text, NEW_VECTOR(Symbol, 1, &null_symbol), 0);
+    Value value;
+
+    ok(fast != NULL && slow != NULL && same_table(fast, slow),
+       "fast loader matches the callback loader");
+    ok(ini_sym_get(fast, "alpha ", "x", NULL, &value) == STRING_TYPE
+       && strcmp(value.string, "quoted value") == 0,
+       "quoted value is stripped");
+    ok(strcmp(fast[1].name, "dup") == 0 && fast[1].type == STRING_TYPE
+       && strcmp(fast[1].value.string, "b") == 0,
+       "later definitions replace earlier ones");
+    ok(ini_sym_get(fast, "alpha ", "z", NULL, &value) == STRING_TYPE
+       && strcmp(value.string, "3") == 0, "sections are reopened");
+    ok(load("x = 1\n[x]\ny = 2\n", NULL, 0) == NULL,
+       "section/value conflict fails");
+    ok(load("# nothing\n", NULL, 0) == NULL, "empty file loads as NULL");
+    ini_sym_free(fast);
+    ini_sym_free(slow);
+}
+
+/*
+ * test_bind() --Test bound lookups, with and without indexes.
+ */
+static void test_bind(void)
+{
+    SymbolPtr sym = load(ini_text, NULL, INI_INDEX);
+    IniBinding x, y, none, missing;
+    Value value;
+
+    ok(ini_sym_bind(&x, sym, "alpha ", "x", NULL) == STRING_TYPE
+       && ini_sym_bound(&x, &value) == STRING_TYPE
+       && strcmp(value.string, "quoted value") == 0,
+       "bound value found (indexed)");
+    ok(ini_sym_bind(&y, sym, "alpha ", "y", NULL) == STRING_TYPE
+       && ini_sym_bound(&y, &value) == STRING_TYPE
+       && strcmp(value.string, "fallback") == 0,
+       "bound value found in the default section");
+    ok(ini_sym_bind(&none, sym, "alpha ", "w", (char *) "dflt")
+       == STRING_TYPE && ini_sym_bound(&none, &value) == STRING_TYPE
+       && strcmp(value.string, "dflt") == 0, "bound default value");
+    ok(ini_sym_bind(&missing, sym, "beta", "w", NULL) == VOID_TYPE
+       && ini_sym_bound(&missing, &value) == VOID_TYPE,
+       "unbound name is VOID_TYPE");
+    sym = load("[alpha ]\nw = later\n", sym, 0);
+    ok(ini_sym_bound(&none, &value) == STRING_TYPE
+       && strcmp(value.string, "later") == 0,
+       "binding re-resolves after a change");
+    ini_sym_free(sym);
+}
+
+int main(void)
+{
+    plan_tests(11);
+    test_load();
+    test_bind();
+    return exit_status();
+}
@@ -4,12 +4,22 @@
  * Contents:
  * logrec_cmp_()    --Compare two log records for equality.
  * logrec_sprint_() --Print a log record.
+ * write_log()      --Write a syslog file of n_line lines.
+ * test_scan()      --Test log_scan_next() matches log_fgets().
+ * bench_scan()     --Compare log_fgets() with log_scan_next().
+ * test_timestamp() --Test the fixed-format timestamp decoders.
+ * test_merge()     --Test log_merge_next() merges files in time order.
+ * test_index()     --Test log_seek_time() finds records by time.
+ * test_filter()    --Test a scanner's filter keeps the matching records.
  * main()           --Run some unit tests.
  *
  *
  */
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <apex.h>
 #include <apex/test.h>
@@ -73,6 +83,405 @@ static const char *logrec_sprint_(LogRecordPtr lr)
     return str_buf[slot];
 }
 
+/*
+ * write_log() --Write a syslog file of n_line lines.
+ *
+ * Remarks:
+ * Every 7th line is invalid, and one line is longer than LINE_MAX.
+ */
+static int write_log(const char *path, size_t n_line)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < n_line; ++i)
+    {
+        if (i % 7 == 3)
+        {
+            fprintf(fp, "Xxx 01 00:00:%02zu bad timestamp %zu\n", i % 60, i);
+        }
+        else if (i == 10)
+        {
+            fprintf(fp, "Feb 01 00:00:00 host tag: %*s\n", LINE_MAX, "x");
+        }
+        else
+        {
+            fprintf(fp, "Feb 01 00:%02zu:%02zu host%zu tag[%zu]: info: "
+                    "message %zu\n", i / 60 % 60, i % 60, i % 3, i, i);
+        }
+    }
+    fputs("Feb 01 00:00:00 host tag: unterminated", fp);
+    fclose(fp);
+    return 1;
+}
+
+/*
+ * test_scan() --Test log_scan_next() matches log_fgets().
+ */
+static void test_scan(const char *path, struct tm *base_tm)
+{
+    static LogRecord lr_fgets, lr_scan;
+    LogScanPtr scan;
+    FILE *fp;
+    int fd, n_same = 0, n_fgets = 0, status = 1;
+
+    if (!write_log(path, 100) || (fp = fopen(path, "r")) == NULL)
+    {
+        skip(2, "can't create \"%s\"", path);
+        return;
+    }
+    fd = open(path, O_RDONLY);
+    scan = log_scan_new(fd, 100, base_tm);
+    while (status && !feof(fp))
+    {                                  /* (skip what log_fgets() rejects) */
+        if (log_fgets(&lr_fgets, fp, base_tm) == NULL)
+        {
+            continue;
+        }
+        ++n_fgets;
+        if (log_scan_next(scan, &lr_scan) == NULL
+            || logrec_cmp_(&lr_fgets, &lr_scan) != 0)
+        {
+            diag("line %d: %s", n_fgets, logrec_sprint_(&lr_scan));
+            status = 0;
+            break;
+        }
+        ++n_same;
+    }
+    ok(status && log_scan_next(scan, &lr_scan) == NULL,
+       "log_scan_next() returns the same records as log_fgets() (%d)",
+       n_same);
+    number_eq((int) scan->n_line, 101, "%d",
+              "log_scan_next() counts every line, skipping long ones");
+    log_scan_free(scan);
+    close(fd);
+    fclose(fp);
+}
+
+/*
+ * bench_scan() --Compare log_fgets() with log_scan_next().
+ */
+static void bench_scan(const char *path, struct tm *base_tm)
+{
+    const char *n_str = getenv("LOG_PARSE_BENCH_RECORDS");
+    size_t n_record = n_str != NULL ? strtoul(n_str, NULL, 10) : 20000;
+    static LogRecord lr;
+    size_t n_fgets = 0, n_scan = 0;
+    double t_fgets, t_scan;
+    LogScanPtr scan;
+    clock_t start;
+    FILE *fp;
+    int fd;
+
+    diag("%s()", __func__);
+    if (!write_log(path, n_record) || (fp = fopen(path, "r")) == NULL)
+    {
+        return;
+    }
+    start = clock();
+    while (!feof(fp))
+    {
+        n_fgets += log_fgets(&lr, fp, base_tm) != NULL;
+    }
+    t_fgets = (double) (clock() - start) / CLOCKS_PER_SEC;
+    fclose(fp);
+
+    fd = open(path, O_RDONLY);
+    start = clock();
+    if ((scan = log_scan_new(fd, 0, base_tm)) != NULL)
+    {
+        while (log_scan_next(scan, &lr) != NULL)
+        {
+            ++n_scan;
+        }
+        log_scan_free(scan);
+    }
+    t_scan = (double) (clock() - start) / CLOCKS_PER_SEC;
+    close(fd);
+    diag("%zu records: log_fgets %.1f ns, log_scan_next %.1f ns per line"
+         " (%zu, %zu parsed)", n_record, t_fgets * 1e9 / (double) n_record,
+         t_scan * 1e9 / (double) n_record, n_fgets, n_scan);
+}
+
+/*
+ * test_timestamp() --Test the fixed-format timestamp decoders.
+ * test_merge()     --Test log_merge_next() merges files in time order.
+ * test_index()     --Test log_seek_time() finds records by time.
+ * test_filter()    --Test a scanner's filter keeps the matching records.
+ */
+static void test_timestamp(time_t feb_ut, struct tm *base_tm)
+{
+    static const struct
+    {
+        const char *text;
+        time_t offset;                 /* from feb_ut, or absolute (UTC) */
+        int utc;
+    } test[] = {
+        {"Feb  1 00:00:00 host: x", 0, 0},
+        {"Feb 1 00:01:05 host: x", 65, 0},
+        {"Feb 01 00:01:59 host: x", 119, 0},
+        {"Feb 01 00:00:07 host: x", 7, 0},  /* (back to a cached minute) */
+        {"2001-02-01T00:00:00Z host: x", 980985600, 1},
+        {"2001-02-01T01:02:03.456Z host: x", 980985600 + 3723, 1},
+        {"2001-02-01t00:00:00+10:00 host: x", 980985600 - 36000, 1},
+        {"2001-01-31T22:30:00-01:30 host: x", 980985600, 1},
+    };
+    int n_ok = 0;
+    LogRecordPtr l;
+
+    for (size_t i = 0; i < NEL(test); ++i)
+    {
+        time_t expect = test[i].utc ? test[i].offset
+            : feb_ut + test[i].offset;
+
+        if ((l = log_parse(test[i].text, base_tm)) != NULL
+            && l->timestamp == expect && strcmp(l->host, "host") == 0)
+        {
+            ++n_ok;
+        }
+        else
+        {
+            diag("\"%s\": %s", test[i].text, logrec_sprint_(l));
+        }
+    }
+    number_eq(n_ok, (int) NEL(test), "%d",
+              "fixed-format timestamps decode to the right time");
+    ok(log_parse("February 1 00:00:00 host: x", base_tm) != NULL
+       && log_parse("2001-02-01T00:00:00 host: x", base_tm) == NULL
+       && log_parse("Feb 1 25:00:00 host: x", base_tm) == NULL
+       && log_parse("Feb 1 00:00", base_tm) == NULL,
+       "other formats fall back to strptime()");
+}
+
+/*
+ * test_merge() --Test log_merge_next() merges files in time order.
+ *
+ * Remarks:
+ * The expected stream is each file's records (as parsed by
+ * log_fgets()), in order of timestamp, then file.
+ */
+static void test_merge(struct tm *base_tm)
+{
+    enum
+    { N_FILE = 2, N_RECORD = 256 };
+    static LogRecord record[N_RECORD];
+    LogRecordPtr expect[N_RECORD];
+    static const size_t n_line[N_FILE] = { 100, 150 };
+    char path[N_FILE][64];
+    const char *path_list[N_FILE];
+    size_t n_expect = 0, n_read = 0, n_error = 0;
+    int n_same = 0, status = 1;
+    LogMergePtr merge;
+    LogRecordPtr l;
+
+    for (size_t i = 0; i < N_FILE; ++i)
+    {
+        FILE *fp;
+
+        sprintf(path[i], "log-merge-%d-%zu.tmp", getpid(), i);
+        path_list[i] = path[i];
+        if ((fp = fopen(path[i], "w")) == NULL)
+        {
+            skip(2, "can't create \"%s\"", path[i]);
+            return;
+        }
+        for (size_t j = 0; j < n_line[i]; ++j)
+        {                              /* (in order, with some ties) */
+            size_t t = j * (i + 1) / 2;
+
+            if (j % 10 == 9)
+            {
+                fprintf(fp, "bad line %zu\n", j);
+                continue;
+            }
+            fprintf(fp, "Feb 01 00:%02zu:%02zu host%zu tag: line %zu\n",
+                    t / 60 % 60, t % 60, i, j);
+        }
+        fclose(fp);
+        fp = fopen(path[i], "r");
+        while (!feof(fp) && n_expect < N_RECORD)
+        {
+            size_t j = n_expect;
+
+            if (log_fgets(&record[n_expect], fp, base_tm) == NULL)
+            {
+                continue;
+            }
+            for (; j > 0
+                 && expect[j - 1]->timestamp > record[n_expect].timestamp;
+                 --j)
+            {                          /* (stable insertion sort) */
+                expect[j] = expect[j - 1];
+            }
+            expect[j] = &record[n_expect++];
+        }
+        fclose(fp);
+    }
+
+    merge = log_merge_new(path_list, N_FILE, 3, base_tm);
+    for (size_t i = 0; merge != NULL && status; ++i)
+    {
+        if ((l = log_merge_next(merge, &n_read, &n_error)) == NULL)
+        {
+            status = i == n_expect;
+            break;
+        }
+        if (i >= n_expect || logrec_cmp_(l, expect[i]) != 0)
+        {
+            diag("record %zu: %s", i, logrec_sprint_(l));
+            status = 0;
+        }
+        ++n_same;
+    }
+    ok(merge != NULL && status,
+       "log_merge_next() returns the records in time order (%d)", n_same);
+    ok(merge != NULL && n_read == 250 && n_error == 25,
+       "log_merge_next() counts lines (%zu) and errors (%zu)",
+       n_read, n_error);
+    log_merge_free(merge);
+    for (size_t i = 0; i < N_FILE; ++i)
+    {
+        unlink(path[i]);
+    }
+}
+
+/*
+ * test_index() --Test log_seek_time() finds records by time.
+ */
+static void test_index(time_t feb_ut, struct tm *base_tm)
+{
+    enum
+    { N_LINE = 3000, INTERVAL = 4096 };
+    static LogRecord lr;
+    char path[64], index_path[80];
+    LogIndexPtr index, saved;
+    int n_ok = 0, n_near = 0;
+    FILE *fp;
+
+    sprintf(path, "log-index-%d.tmp", getpid());
+    sprintf(index_path, "%s.idx", path);
+    if ((fp = fopen(path, "w")) == NULL)
+    {
+        skip(3, "can't create \"%s\"", path);
+        return;
+    }
+    for (size_t i = 0; i < N_LINE; ++i)
+    {                                  /* (one record per second) */
+        fprintf(fp, "Feb 01 %02zu:%02zu:%02zu host tag: record %zu\n",
+                i / 3600, i / 60 % 60, i % 60, i);
+    }
+    fclose(fp);
+
+    fp = fopen(path, "r");
+    index = log_index_open(fp, path, INTERVAL, base_tm);
+    saved = log_index_load(index_path);
+    ok(index != NULL && saved != NULL && saved->n_entry == index->n_entry
+       && index->n_entry > 1
+       && memcmp(saved->offset, index->offset,
+                 index->n_entry * sizeof(long)) == 0,
+       "log_index_open() builds and saves an index (%zu entries)",
+       index != NULL ? index->n_entry : 0);
+
+    for (size_t i = 0; index != NULL && i < N_LINE; i += 97)
+    {
+        time_t t = feb_ut + (time_t) i;
+        long offset = log_seek_time(fp, index, t);
+        char expect[32];
+
+        while (log_fgets(&lr, fp, base_tm) != NULL && lr.timestamp < t)
+        {
+            ;                          /* (skip earlier records) */
+        }
+        sprintf(expect, "record %zu", i);
+        n_ok += lr.timestamp == t && strcmp(lr.message, expect) == 0;
+        n_near += ftell(fp) - offset <= INTERVAL + SYSLOG_LINE_MAX;
+    }
+    number_eq(n_ok, (N_LINE + 96) / 97, "%d",
+              "log_seek_time() finds the first record at a time");
+    number_eq(n_near, (N_LINE + 96) / 97, "%d",
+              "log_seek_time() seeks to within an interval of it");
+    log_index_free(saved);
+    log_index_free(index);
+    fclose(fp);
+    unlink(index_path);
+    unlink(path);
+}
+
+/*
+ * test_filter() --Test a scanner's filter keeps the matching records.
+ *
+ * Remarks:
+ * The filtered scan is compared with an unfiltered scan, whose
+ * records are checked "by hand".
+ */
+static void test_filter(struct tm *base_tm)
+{
+    static const char *host[] = { "alpha", "beta", "gamma" };
+    static const char *priority[] = { "info: ", "err: ", "" };
+    static const char *want_host[] = { "alpha", "gamma" };
+    LogFilter filter = {
+        LOG_MASK(LOG_ERR) | LOG_FILTER_UNKNOWN, want_host, NEL(want_host),
+        NULL, 0, "needle"
+    };
+    static LogRecord lr, lr_all;
+    size_t n_expect = 0, n_match = 0;
+    LogScanPtr all, scan;
+    int fd_all, fd, status = 1;
+    char path[64];
+    FILE *fp;
+
+    sprintf(path, "log-filter-%d.tmp", getpid());
+    if ((fp = fopen(path, "w")) == NULL)
+    {
+        skip(2, "can't create \"%s\"", path);
+        return;
+    }
+    for (size_t i = 0; i < 300; ++i)
+    {
+        fprintf(fp, "Feb 01 00:%02zu:%02zu %s tag%zu: %s%s %zu\n",
+                i / 60 % 60, i % 60, host[i % 3], i % 2,
+                priority[i / 3 % 3], i % 5 == 0 ? "hay" : "needle", i);
+    }
+    fputs("Feb 01 00:00:00 invalid needle\n", fp);
+    fclose(fp);
+
+    fd_all = open(path, O_RDONLY);
+    fd = open(path, O_RDONLY);
+    all = log_scan_new(fd_all, 0, base_tm);
+    scan = log_scan_new(fd, 0, base_tm);
+    scan->filter = &filter;
+    while (log_scan_next(all, &lr_all) != NULL)
+    {
+        if (strcmp(lr_all.host, "beta") == 0
+            || (lr_all.priority != -1 && lr_all.priority != LOG_ERR)
+            || strstr(lr_all.message, "needle") == NULL)
+        {
+            continue;
+        }
+        ++n_expect;
+        if (log_scan_next(scan, &lr) == NULL || logrec_cmp_(&lr, &lr_all) != 0)
+        {
+            diag("expected %s", logrec_sprint_(&lr_all));
+            status = 0;
+            break;
+        }
+        ++n_match;
+    }
+    ok(status && log_scan_next(scan, &lr) == NULL && n_match > 0,
+       "a filtered scan returns just the matching records (%zu)", n_match);
+    ok(scan->n_error == 1 && scan->n_filtered == 300 - n_expect,
+       "a filtered scan counts rejected (%zu) and invalid (%zu) lines",
+       scan->n_filtered, scan->n_error);
+    log_scan_free(all);
+    log_scan_free(scan);
+    close(fd_all);
+    close(fd);
+    unlink(path);
+}
+
 /*
  * main() --Run some unit tests.
  *
@@ -98,7 +507,7 @@ int main(void)
     localtime_r(&now_ut, &base_tm);
     base_tm.tm_year = 101;             /* rewind to same day in 2001 */
 
-    plan_tests(12);
+    plan_tests(23);
 
     do
     {                                  /* simple, common case */
@@ -171,5 +580,20 @@ int main(void)
     ok(log_parse("Feb 01 00:00:00 ident[xxx]", &base_tm) == NULL,
        "Return NULL for bad identity (invalid pid)");
 
+    test_timestamp(feb_ut, &base_tm);
+    test_merge(&base_tm);
+    test_index(feb_ut, &base_tm);
+    test_filter(&base_tm);
+
+    do
+    {
+        char path[64];
+
+        sprintf(path, "log-scan-%d.tmp", getpid());
+        test_scan(path, &base_tm);
+        bench_scan(path, &base_tm);
+        unlink(path);
+    } while (0);
+
     return exit_status();
 }
@@ -5,16 +5,43 @@
  * default_log_state[] --Fixture for logging state at start of test.
  * test_log_state[]    --Captures the current state of the logger.
  * mock_log_output()   --A mocked log output routine, for testing.
+ * test_async()        --Test the async handler writes every message.
+ * test_concurrent()   --Test concurrent stderr logging and config swaps.
+ * test_deferred()     --Test deferred formatting matches vsnprintf().
+ * test_timestamp()    --Test (cached) timestamps, with fractions.
+ * test_limit()        --Test rate-limited and sampled messages.
+ * test_log_if()       --Test log_if() evaluates arguments only if enabled.
+ * test_domain()       --Test domain patterns, and changing them at runtime.
+ * test_structured()   --Test JSON/logfmt output of fields.
+ * test_journal()      --Test the journal handler's datagrams.
+ * bench_log()         --Measure the cost of a log call, by handler and threads.
  * main()              --Run some unit tests.
  *
  */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <apex/test.h>
 #include <apex/log.h>
+#include <apex/log-domain.h>
 
 #define LOG_TEXT_MAX 60
+#define ASYNC_THREADS 4
+#define ASYNC_MESSAGES 1000
+#define JOURNAL_HEADER(priority) \
+    "PRIORITY=" priority "\nSYSLOG_FACILITY=1\nSYSLOG_IDENTIFIER=id\n"
+#define JOURNAL_BINARY JOURNAL_HEADER("5") \
+    "MESSAGE\n\011\0\0\0\0\0\0\0two\nlines\n"
 static int mock_log_output(const LogConfig * UNUSED(config),
                            const LogContext * caller,
                            int sys_errno, size_t priority,
@@ -68,6 +95,666 @@ static int mock_log_output(const LogConfig * UNUSED(config),
                         sys_errno, priority, fmt, args);
 }
 
+/*
+ * log_messages() --Log a thread's messages: a pthread start proc.
+ */
+static void *log_messages(void *data)
+{
+    int id = *(int *) data;
+
+    for (int i = 0; i < ASYNC_MESSAGES; ++i)
+    {
+        notice("thread %d message %d", id, i);
+    }
+    return NULL;
+}
+
+/*
+ * count_lines() --Check a log file's messages are complete and in order.
+ *
+ * Returns: (int)
+ * The No. of messages (or -1 if any are out of order); n_report
+ * returns the No. of dropped messages reported.
+ */
+static int count_lines(const char *path, int *n_report)
+{
+    int next[ASYNC_THREADS] = { 0 };
+    int n_line = 0, id, i, n_drop;
+    char line[LOG_TEXT_MAX + 1];
+    FILE *fp = fopen(path, "r");
+
+    *n_report = 0;
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (sscanf(line, "notice: thread %d message %d", &id, &i) == 2
+            && id >= 0 && id < ASYNC_THREADS && i >= next[id])
+        {
+            next[id] = i + 1;
+            ++n_line;
+        }
+        else if (sscanf(line, "warning: %d log messages dropped",
+                        &n_drop) == 1)
+        {
+            *n_report += n_drop;
+        }
+        else
+        {
+            n_line = -1;
+            break;
+        }
+    }
+    fclose(fp);
+    return n_line;
+}
+
+/*
+ * test_async() --Test the async handler writes every message.
+ *
+ * Remarks:
+ * stderr is redirected to a file while the handler is in use.
+ */
+static void test_async(void)
+{
+    LogConfig async_config = {
+        .threshold_priority = LOG_NOTICE,
+        .facility = LOG_USER,
+        .output = log_async
+    };
+    pthread_t thread[ASYNC_THREADS];
+    int id[ASYNC_THREADS];
+    char path[64];
+    int saved_fd, fd, n_line, n_report;
+    size_t n_dropped;
+
+    sprintf(path, "log-async-%d.tmp", getpid());
+    fflush(stderr);
+    saved_fd = dup(2);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        skip(2, "can't create \"%s\"", path);
+        return;
+    }
+    dup2(fd, 2);
+    close(fd);
+    log_config(&async_config);
+
+    log_async_start(64, LOG_ASYNC_BLOCK);
+    for (int i = 0; i < ASYNC_THREADS; ++i)
+    {
+        id[i] = i;
+        pthread_create(&thread[i], NULL, log_messages, &id[i]);
+    }
+    for (int i = 0; i < ASYNC_THREADS; ++i)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    log_async_stop();
+    n_line = count_lines(path, &n_report);
+    number_eq(n_line, ASYNC_THREADS * ASYNC_MESSAGES, "%d",
+              "blocking async log writes every message, in order");
+
+    ftruncate(2, 0);
+    lseek(2, 0, SEEK_SET);
+    log_async_start(2, LOG_ASYNC_COUNT);
+    log_messages(&id[0]);
+    log_async_stop();
+    n_dropped = log_async_dropped();
+    n_line = count_lines(path, &n_report);
+    ok(n_line >= 0 && (size_t) n_line + n_dropped == ASYNC_MESSAGES
+       && (size_t) n_report == n_dropped,
+       "counting async log writes or reports every message"
+       " (%zu dropped)", n_dropped);
+
+    fflush(stderr);
+    dup2(saved_fd, 2);
+    close(saved_fd);
+    unlink(path);
+    log_config(&test_log_state);
+}
+
+/*
+ * test_concurrent() --Test concurrent stderr logging and config swaps.
+ *
+ * Remarks:
+ * Several threads log to stderr (redirected to a file) while this one
+ * swaps the configuration; every line must be whole.
+ */
+static void test_concurrent(void)
+{
+    LogConfig stderr_config[2] = {
+        {.threshold_priority = LOG_NOTICE,.facility = LOG_USER,
+         .output = log_stderr},
+        {.threshold_priority = LOG_INFO,.facility = LOG_USER,
+         .output = log_stderr}
+    };
+    pthread_t thread[ASYNC_THREADS];
+    int id[ASYNC_THREADS];
+    char path[64];
+    int saved_fd, fd, n_line, n_report;
+
+    sprintf(path, "log-stderr-%d.tmp", getpid());
+    fflush(stderr);
+    saved_fd = dup(2);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        skip(1, "can't create \"%s\"", path);
+        return;
+    }
+    dup2(fd, 2);
+    close(fd);
+    log_config(&stderr_config[0]);
+
+    for (int i = 0; i < ASYNC_THREADS; ++i)
+    {
+        id[i] = i;
+        pthread_create(&thread[i], NULL, log_messages, &id[i]);
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        log_config(&stderr_config[i % 2]);
+    }
+    for (int i = 0; i < ASYNC_THREADS; ++i)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    n_line = count_lines(path, &n_report);
+    number_eq(n_line, ASYNC_THREADS * ASYNC_MESSAGES, "%d",
+              "concurrent stderr log lines are whole, despite config swaps");
+
+    dup2(saved_fd, 2);
+    close(saved_fd);
+    unlink(path);
+    log_config(&test_log_state);
+}
+
+/*
+ * same_format() --Test packed/unpacked arguments match vsnprintf().
+ */
+static int same_format(const char *fmt, ...)
+{
+    char buf[LOG_LINE_MAX], expect[LOG_LINE_MAX], text[LOG_LINE_MAX];
+    va_list args;
+    int n_expect, n;
+
+    va_start(args, fmt);
+    n_expect = vsnprintf(expect, sizeof(expect), fmt, args);
+    va_end(args);
+    va_start(args, fmt);
+    n = log_pack_args_(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0)
+    {
+        return 0;
+    }
+    n = log_unpack_args_(text, sizeof(text), fmt, buf);
+    return n == n_expect && strcmp(text, expect) == 0;
+}
+
+/*
+ * can_pack() --Test whether log_pack_args_() captures some arguments.
+ */
+static int can_pack(const char *fmt, ...)
+{
+    char buf[LOG_LINE_MAX];
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = log_pack_args_(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return n >= 0;
+}
+
+/*
+ * test_deferred() --Test deferred formatting matches vsnprintf().
+ */
+static void test_deferred(void)
+{
+    LogConfig deferred_config = {
+        .threshold_priority = LOG_NOTICE,
+        .facility = LOG_USER,
+        .output = log_deferred
+    };
+    char path[64], str[16], line[LOG_TEXT_MAX + 1];
+    int saved_fd, fd, n_same = 0;
+    FILE *fp;
+
+    ok(same_format("%d|%5d|%-5d|%+d|%05d|%hhd|%hd", -1, 2, 3, 4, 5, 6, 7)
+       && same_format("%ld %lu %llx %zu %zd %jd %td %o %#X", -1L, 2UL,
+                      0xabcdefULL, (size_t) 4, (ssize_t) - 5, (intmax_t) 6,
+                      (ptrdiff_t) 7, 8, 255)
+       && same_format("[%s] [%.3s] [%10s] [%-6s]", "abc", "defgh", "ij",
+                      "k")
+       && same_format("%f %.2e %g %10.3f %a", 3.14159, 2.5e10, 1e-5, -1.5,
+                      0.5)
+       && same_format("%*d|%-*d|%.*f|%*.*f|%.*s", 6, 1, 4, 2, 2, 3.14159,
+                      8, 3, 2.5, -1, "all")
+       && same_format("%c%c %% %p", 'o', 'k', (void *) path)
+       && same_format("no conversions")
+       && same_format("%s", ""),
+       "deferred formatting matches vsnprintf()");
+    ok(!can_pack("%ls", L"abc") && !can_pack("%lc", (wint_t) L'd')
+       && !can_pack("[%5ls]", L"abc"),
+       "wide strings and characters aren't captured");
+
+    sprintf(path, "log-deferred-%d.tmp", getpid());
+    fflush(stderr);
+    saved_fd = dup(2);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        skip(1, "can't create \"%s\"", path);
+        return;
+    }
+    dup2(fd, 2);
+    close(fd);
+    log_config(&deferred_config);
+    log_async_start(64, LOG_ASYNC_BLOCK);
+    for (int i = 0; i < 100; ++i)
+    {
+        sprintf(str, "str%d", i);
+        notice("deferred %d %s %.1f", i, str, i / 2.0);
+        strcpy(str, "overwritten");    /* (the message has a copy) */
+    }
+    notice("wide %ls%lc", L"abc", (wint_t) L'd');   /* (formatted now) */
+    log_async_stop();
+    fflush(stderr);
+    dup2(saved_fd, 2);
+    close(saved_fd);
+
+    if ((fp = fopen(path, "r")) != NULL)
+    {
+        for (int i = 0; fgets(line, sizeof(line), fp) != NULL; ++i)
+        {
+            char expect[LOG_TEXT_MAX + 1];
+
+            if (i < 100)
+            {
+                sprintf(expect, "notice: deferred %d str%d %.1f\n", i, i,
+                        i / 2.0);
+            }
+            else
+            {
+                strcpy(expect, "notice: wide abcd\n");
+            }
+            n_same += strcmp(line, expect) == 0;
+        }
+        fclose(fp);
+    }
+    number_eq(n_same, 101, "%d", "deferred log messages are formatted later");
+    unlink(path);
+    log_config(&test_log_state);
+}
+
+/*
+ * same_stamp() --Test log_stderr_format_()'s text for a time.
+ */
+static int same_stamp(const char *spec, time_t second, long nsec,
+                      const char *expect, const char *fmt, ...)
+{
+    LogConfig config = {.threshold_priority = LOG_NOTICE,.timestamp = spec };
+    struct timespec when = {.tv_sec = second,.tv_nsec = nsec };
+    char text[LOG_LINE_MAX + 1];
+    va_list args;
+
+    va_start(args, fmt);
+    log_stderr_format_(&config, NULL, 0, LOG_NOTICE, &when, fmt, args, text);
+    va_end(args);
+    return strcmp(text, expect) == 0;
+}
+
+/*
+ * test_timestamp() --Test (cached) timestamps, with fractions.
+ */
+static void test_timestamp(void)
+{
+    ok(same_stamp("%S.%3N", 61, 123456789, "01.123 notice: x", "x")
+       && same_stamp("%S.%3N", 61, 987000000, "01.987 notice: y", "y")
+       && same_stamp("%S.%3N", 62, 5000000, "02.005 notice: z", "z")
+       && same_stamp("[%%N %S.%6N]", 62, 123456789,
+                     "[%N 02.123456] notice: x", "x")
+       && same_stamp("%S.%N|", 63, 1, "03.000000001| notice: x", "x")
+       && same_stamp("%S", 64, 0, "04 notice: x", "x"),
+       "timestamps are cached per second, with sub-second fractions");
+}
+
+/*
+ * test_limit() --Test rate-limited and sampled messages.
+ */
+static void test_limit(void)
+{
+    LogLimit limit = LOG_LIMIT_INIT(1, 3);
+    int n_logged = 0, n_sampled = 0;
+
+    for (int i = 0; i < 10; ++i)
+    {
+        log_state = default_log_state;
+        log_limit_msg(&limit, LOG_NOTICE, "limited %d", i);
+        n_logged += log_state.text[0] != '\0';
+    }
+    limit.tat = 0;                     /* (as if the bucket had refilled) */
+    log_state = default_log_state;
+    log_limit_msg(&limit, LOG_NOTICE, "limited again");
+    ok(n_logged == 3
+       && strcmp(log_state.text, "notice: 7 similar messages suppressed") == 0,
+       "rate-limited messages allow a burst, and report the suppressed ones");
+
+    for (int i = 0; i < 10; ++i)
+    {
+        log_state = default_log_state;
+        log_sample(4, LOG_NOTICE, "sampled %d", i);
+        n_sampled += log_state.text[0] != '\0';
+        if (i == 4)
+        {
+            string_eq(log_state.text, "notice: 3 similar messages suppressed",
+                      "sampled messages report the skipped ones");
+        }
+    }
+    number_eq(n_sampled, 3, "%d", "sampled messages log 1 in N");
+}
+
+/*
+ * test_log_if() --Test log_if() evaluates arguments only if enabled.
+ */
+static void test_log_if(void)
+{
+    int n_eval = 0;
+
+    log_state = default_log_state;
+    log_if(LOG_INFO, "count %d", ++n_eval);
+    ok(n_eval == 0 && log_state.text[0] == '\0' && !log_enabled(LOG_INFO),
+       "log_if() skips the arguments of disabled messages");
+    log_if(LOG_NOTICE, "count %d", ++n_eval);
+    ok(n_eval == 1 && strcmp(log_state.text, "notice: count 1") == 0
+       && log_enabled(LOG_NOTICE),
+       "log_if() logs enabled messages");
+}
+
+/*
+ * domain_logged() --Test if a domain's message is logged.
+ */
+static int domain_logged(LogDomainPtr domain)
+{
+    log_state = default_log_state;
+    log_domain_notice(domain, "domain message");
+    return log_state.text[0] != '\0';
+}
+
+/*
+ * test_domain() --Test domain patterns, and changing them at runtime.
+ */
+static void test_domain(void)
+{
+    LogDomain net = LOG_DOMAIN_INIT("net");
+    LogDomain tcp = LOG_DOMAIN_INIT("net.tcp");
+    LogDomain conn = LOG_DOMAIN_INIT("net.tcp.conn");
+    LogDomain disk = LOG_DOMAIN_INIT("disk");
+
+    unsetenv("LOG_DOMAINS");
+    log_domain_init("net.*,disk");
+    ok(!domain_logged(&net) && domain_logged(&tcp) && domain_logged(&conn)
+       && domain_logged(&disk), "domain prefix patterns match subdomains");
+    log_domain_init("!net.tcp.*,disk");
+    ok(domain_logged(&net) && domain_logged(&tcp) && !domain_logged(&conn)
+       && !domain_logged(&disk), "domain changes take effect at runtime");
+    log_domain_init(NULL);
+    ok(domain_logged(&net) && domain_logged(&conn) && domain_logged(&disk),
+       "all domains are logged by default");
+}
+
+/*
+ * structured_line() --Log a message with fields to stderr, and read it back.
+ */
+static int structured_line(LogOutputProc output, char *line, size_t len)
+{
+    LogConfig config = {
+        .threshold_priority = LOG_NOTICE,
+        .identity = "id",
+        .facility = LOG_USER,
+        .output = output
+    };
+    LogField field[] = {
+        LOG_STRING("user", "a b"),
+        LOG_INTEGER("n", 42),
+        LOG_REAL("x", 0.5)
+    };
+    char path[64];
+    int saved_fd, fd;
+    FILE *fp;
+
+    sprintf(path, "log-fields-%d.tmp", getpid());
+    saved_fd = dup(2);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        return 0;
+    }
+    dup2(fd, 2);
+    close(fd);
+    log_config(&config);
+    log_fields(LOG_NOTICE, field, NEL(field), "say \"%s\"\n", "hi");
+    log_config(&test_log_state);
+    dup2(saved_fd, 2);
+    close(saved_fd);
+
+    line[0] = '\0';
+    if ((fp = fopen(path, "r")) != NULL)
+    {
+        if (fgets(line, (int) len, fp) == NULL)
+        {
+            line[0] = '\0';
+        }
+        fclose(fp);
+    }
+    unlink(path);
+    return line[0] != '\0';
+}
+
+/*
+ * test_structured() --Test JSON/logfmt output of fields.
+ */
+static void test_structured(void)
+{
+    LogField field[] = { LOG_STRING("user", "a b"), LOG_INTEGER("n", 42) };
+    char line[256];
+
+    ok(structured_line(log_json, line, sizeof(line))
+       && strncmp(line, "{\"time\":\"", 9) == 0
+       && strstr(line, "Z\",\"level\":\"notice\",\"ident\":\"id\","
+                 "\"msg\":\"say \\\"hi\\\"\\n\",\"user\":\"a b\","
+                 "\"n\":42,\"x\":0.5}\n") != NULL,
+       "JSON output escapes the message, and prints typed fields");
+    ok(structured_line(log_logfmt, line, sizeof(line))
+       && strncmp(line, "time=", 5) == 0
+       && strstr(line, "Z level=notice ident=id msg=\"say \\\"hi\\\"\\n\""
+                 " user=\"a b\" n=42 x=0.5\n") != NULL,
+       "logfmt output quotes values only when necessary");
+
+    log_state = default_log_state;
+    log_fields(LOG_NOTICE, field, NEL(field), "hello");
+    string_eq(log_state.text, "notice: hello user=\"a b\" n=42",
+              "other handlers get fields appended as logfmt");
+}
+
+/*
+ * test_journal() --Test the journal handler's datagrams.
+ *
+ * Remarks:
+ * The handler is pointed at a socket of our own (by the environment),
+ * which must happen before its first use.
+ */
+static void test_journal(void)
+{
+    LogConfig journal_config = {
+        .threshold_priority = LOG_NOTICE,
+        .identity = "id",
+        .facility = LOG_USER,
+        .output = log_journal
+    };
+    struct sockaddr_un addr = {.sun_family = AF_UNIX };
+    const char *expect = JOURNAL_HEADER("4") "MESSAGE=disk full\nCODE_FILE=";
+    char dgram[512];
+    ssize_t n, n_multi;
+    int fd;
+
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "log-journal-%d.tmp",
+             getpid());
+    if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0
+        || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+        skip(2, "can't create \"%s\"", addr.sun_path);
+        return;
+    }
+    setenv("LOG_JOURNAL_SOCKET", addr.sun_path, 1);
+    log_config(&journal_config);
+    trace_warning("disk %s", "full");
+    n = recv(fd, dgram, sizeof(dgram) - 1, MSG_DONTWAIT);
+    dgram[MAX(n, 0)] = '\0';
+    ok(n > 0 && strncmp(dgram, expect, strlen(expect)) == 0
+       && strstr(dgram, "CODE_FUNC=test_journal\n") != NULL,
+       "journal datagrams have priority, identity and caller fields");
+
+    notice("two\nlines");
+    n_multi = recv(fd, dgram, sizeof(dgram), MSG_DONTWAIT);
+    ok(n_multi == sizeof(JOURNAL_BINARY) - 1
+       && memcmp(dgram, JOURNAL_BINARY, (size_t) n_multi) == 0,
+       "multi-line messages use the binary form");
+
+    log_config(&test_log_state);
+    close(fd);
+    unlink(addr.sun_path);
+}
+
+/*
+ * LogBench --A benchmark's per-thread parameters.
+ */
+typedef struct LogBench_t
+{
+    size_t priority;
+    size_t n_message;
+} LogBench;
+
+/*
+ * discard_output() --An output handler that discards the message.
+ */
+static int discard_output(const LogConfig * UNUSED(config),
+                          const LogContext * UNUSED(caller),
+                          int UNUSED(sys_errno), size_t UNUSED(priority),
+                          const char *UNUSED(fmt), va_list UNUSED(args))
+{
+    return 0;
+}
+
+/*
+ * bench_messages() --Log a benchmark thread's messages: a pthread proc.
+ */
+static void *bench_messages(void *data)
+{
+    const LogBench *bench = data;
+
+    for (size_t i = 0; i < bench->n_message; ++i)
+    {
+        log_msg(bench->priority, "bench message %zu of %s", i, "many");
+    }
+    return NULL;
+}
+
+/*
+ * bench_log() --Measure the cost of a log call, by handler and threads.
+ *
+ * Remarks:
+ * Each thread logs $LOG_BENCH_MESSAGES messages (default 2000), for
+ * 1, 2, 4 ... $LOG_BENCH_THREADS threads (default 4); the time is the
+ * wall-clock time per call (per thread), so contention shows as an
+ * increase with threads.  stderr is redirected to a file.  syslog is
+ * only measured if $LOG_BENCH_SYSLOG is set, since it really logs.
+ */
+static void bench_log(void)
+{
+    const char *n_str = getenv("LOG_BENCH_MESSAGES");
+    const char *thread_str = getenv("LOG_BENCH_THREADS");
+    size_t n_message = n_str != NULL ? strtoul(n_str, NULL, 10) : 2000;
+    size_t max_thread = thread_str != NULL ? strtoul(thread_str, NULL, 10)
+        : 4;
+    struct
+    {
+        const char *name;
+        LogOutputProc output;
+        size_t priority;
+    } mode[] = {
+        {"suppressed", discard_output, LOG_INFO},
+        {"discarded", discard_output, LOG_NOTICE},
+        {"stderr", log_stderr, LOG_NOTICE},
+        {"json", log_json, LOG_NOTICE},
+        {"async", log_async, LOG_NOTICE},
+        {"deferred", log_deferred, LOG_NOTICE},
+        {"syslog", log_syslog, LOG_NOTICE}
+    };
+    size_t n_mode = NEL(mode) - (getenv("LOG_BENCH_SYSLOG") == NULL);
+    char path[64];
+    int saved_fd, fd;
+
+    diag("%s()", __func__);
+    sprintf(path, "log-bench-%d.tmp", getpid());
+    fflush(stderr);
+    saved_fd = dup(2);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        return;
+    }
+    dup2(fd, 2);
+    close(fd);
+    diag("%10s %8s %12s  (%zu messages per thread)", "handler", "threads",
+         "ns per call", n_message);
+    for (size_t m = 0; m < n_mode; ++m)
+    {
+        LogConfig config = {
+            .threshold_priority = LOG_NOTICE,
+            .identity = "bench",
+            .facility = LOG_USER,
+            .output = mode[m].output
+        };
+        LogBench bench = { mode[m].priority, n_message };
+
+        log_config(&config);
+        for (size_t n_thread = 1; n_thread <= max_thread; n_thread *= 2)
+        {
+            pthread_t thread[64];
+            struct timespec start, end;
+            double t;
+
+            n_thread = MIN(n_thread, NEL(thread));
+            if (config.output == log_async || config.output == log_deferred)
+            {
+                log_async_start(1024, LOG_ASYNC_BLOCK);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (size_t i = 0; i < n_thread; ++i)
+            {
+                pthread_create(&thread[i], NULL, bench_messages, &bench);
+            }
+            for (size_t i = 0; i < n_thread; ++i)
+            {
+                pthread_join(thread[i], NULL);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            log_async_stop();
+            t = (double) (end.tv_sec - start.tv_sec) * 1e9
+                + (double) (end.tv_nsec - start.tv_nsec);
+            diag("%10s %8zu %12.1f", mode[m].name, n_thread,
+                 t / (double) MAX(n_message, 1));
+            ftruncate(2, 0);
+            lseek(2, 0, SEEK_SET);
+        }
+    }
+    log_config(&test_log_state);
+    dup2(saved_fd, 2);
+    close(saved_fd);
+    unlink(path);
+}
+
 /*
  * main() --Run some unit tests.
  */
@@ -76,7 +763,7 @@ int main(void)
     log_init("log-test");
     log_config(&test_log_state);
 
-    plan_tests(8);
+    plan_tests(28);
     log_state = default_log_state;
     notice("test message");
     string_eq(log_state.text, "notice: test message",
@@ -113,5 +800,15 @@ int main(void)
     string_eq(log_state.text,
               "notice: test message: Operation not permitted",
               "log_sys() applies a priority prefix, and appends the system error");
+    test_async();
+    test_concurrent();
+    test_deferred();
+    test_timestamp();
+    test_limit();
+    test_log_if();
+    test_domain();
+    test_structured();
+    test_journal();
+    bench_log();
     return exit_status();
 }
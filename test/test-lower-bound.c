@@ -0,0 +1,314 @@
+/*
+ * TEST-LOWER-BOUND.C --Tests and benchmark for the typed searches.
+ *
+ * Contents:
+ * test_lower_bound() --Test lower_bound_*() against a linear scan.
+ * test_eytzinger()   --Test eytzinger_*() against lower_bound_*().
+ * test_small()       --Test lower_bound_small_*() against a linear scan.
+ * bench_search()     --Compare binsearch(), lower_bound and Eytzinger.
+ * bench_small()      --Compare lower_bound and SIMD search, for small n.
+ *
+ * Remarks:
+ * The benchmark runs array sizes from 1K up to $SEARCH_BENCH_MAX
+ * (default 1M, to keep the test quick; set it to 100000000 for a
+ * thorough comparison), looking up random keys.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/atomic.h>
+#include <apex/binsearch.h>
+
+static void test_lower_bound(void);
+static void test_eytzinger(void);
+static void test_small(void);
+static void bench_search(void);
+static void bench_small(void);
+
+int main(void)
+{
+    plan_tests(8);
+    test_lower_bound();
+    test_eytzinger();
+    test_small();
+    bench_search();
+    bench_small();
+    return exit_status();
+}
+
+/*
+ * random_key() --Return a pseudo-random key (xorshift).
+ */
+static uint64_t random_key(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/*
+ * test_lower_bound() --Test lower_bound_*() against a linear scan.
+ */
+static void test_lower_bound(void)
+{
+    int i_vec[100];
+    long l_vec[100];
+    double d_vec[100];
+    int status = 1;
+
+    diag("%s()", __func__);
+    for (int i = 0; i < 100; ++i)
+    {
+        i_vec[i] = (i / 3) * 2;         /* (with duplicates) */
+        l_vec[i] = i_vec[i];
+        d_vec[i] = i_vec[i];
+    }
+    for (size_t n = 0; n <= 100; ++n)
+    {
+        for (int key = -1; key <= 70; ++key)
+        {
+            size_t expect = 0;
+
+            while (expect < n && i_vec[expect] < key)
+            {
+                ++expect;
+            }
+            if (lower_bound_int(i_vec, n, key) != expect
+                || lower_bound_long(l_vec, n, key) != expect
+                || lower_bound_double(d_vec, n, key - 0.5) != expect)
+            {
+                status = 0;
+            }
+        }
+    }
+    ok(status, "lower_bound_*() matches a linear scan");
+    ok(lower_bound_int(i_vec, 0, 1) == 0, "lower_bound_int() empty array");
+}
+
+/*
+ * test_eytzinger() --Test eytzinger_*() against lower_bound_*().
+ */
+static void test_eytzinger(void)
+{
+    int i_vec[100], i_tree[101];
+    long l_vec[100], l_tree[101];
+    double d_vec[100], d_tree[101];
+    int status = 1;
+
+    diag("%s()", __func__);
+    for (int i = 0; i < 100; ++i)
+    {
+        i_vec[i] = 3 * i;
+        l_vec[i] = 3 * i;
+        d_vec[i] = 3 * i;
+    }
+    for (size_t n = 0; n <= 100; ++n)
+    {
+        eytzinger_build(i_tree, i_vec, n, sizeof(int));
+        eytzinger_build(l_tree, l_vec, n, sizeof(long));
+        eytzinger_build(d_tree, d_vec, n, sizeof(double));
+        for (int key = -1; key <= 300; ++key)
+        {
+            size_t slot = lower_bound_int(i_vec, n, key);
+            size_t k = eytzinger_int(i_tree, n, key);
+
+            if (slot == n ? k != 0 : (k == 0 || i_tree[k] != i_vec[slot]))
+            {
+                status = 0;
+            }
+            if (eytzinger_long(l_tree, n, key) != k
+                || eytzinger_double(d_tree, n, key) != k)
+            {
+                status = 0;
+            }
+        }
+    }
+    ok(status, "eytzinger_*() finds the lower bound");
+    eytzinger_build(i_tree, i_vec, 7, sizeof(int));
+    ok(i_tree[1] == 9 && i_tree[2] == 3 && i_tree[3] == 15
+       && i_tree[4] == 0 && i_tree[7] == 18, "eytzinger_build() layout");
+    ok(eytzinger_int(i_tree, 7, 100) == 0, "eytzinger_int() not found");
+}
+
+/*
+ * test_small() --Test lower_bound_small_*() against a linear scan.
+ */
+static void test_small(void)
+{
+    static int i_vec[600];
+    static uint32_t u_vec[600];
+    static long l_vec[600];
+    int i_status = 1, u_status = 1, l_status = 1;
+
+    diag("%s()", __func__);
+    for (int i = 0; i < 600; ++i)
+    {
+        i_vec[i] = (i - 300) * 3;      /* (negative and positive) */
+        u_vec[i] = (uint32_t) i * 7000000u;     /* (spans 2^31) */
+        l_vec[i] = (long) (i - 300) * 10000000000L;
+    }
+    for (size_t n = 0; n <= 600; n += (n < 40 ? 1 : 37))
+    {
+        for (int j = -2; j < 602; ++j)
+        {
+            size_t expect = j < 0 ? 0 : (size_t) j > n ? n : (size_t) j;
+            int i_key = (j - 300) * 3 - (j & 1);
+            uint32_t u_key = (uint32_t) (j < 0 ? 0 : j) * 7000000u
+                - (j > 0 && (j & 1));
+            long l_key = (long) (j - 300) * 10000000000L - (j & 1);
+
+            if (j < 0)
+            {
+                i_key = INT32_MIN;
+                l_key = -1L - 300L * 10000000000L;
+            }
+            if (lower_bound_small_int(i_vec, n, i_key) != expect)
+            {
+                i_status = 0;
+            }
+            if (j >= 0 && lower_bound_small_u32(u_vec, n, u_key) != expect)
+            {
+                u_status = 0;
+            }
+            if (lower_bound_small_long(l_vec, n, l_key) != expect)
+            {
+                l_status = 0;
+            }
+        }
+    }
+    ok(i_status, "lower_bound_small_int() matches");
+    ok(u_status, "lower_bound_small_u32() matches (values beyond 2^31)");
+    ok(l_status, "lower_bound_small_long() matches");
+}
+
+/*
+ * bench_search() --Compare binsearch(), lower_bound and Eytzinger.
+ */
+static void bench_search(void)
+{
+    const char *max_str = getenv("SEARCH_BENCH_MAX");
+    size_t max = max_str != NULL ? strtoul(max_str, NULL, 10) : 1000000;
+    size_t n_lookup = 1000000;
+    int *vec = malloc(max * sizeof(int));
+    void *mem = NULL;
+    int *tree;
+
+    diag("%s()", __func__);
+    if (vec == NULL
+        || posix_memalign(&mem, CACHE_LINE, (max + 16) * sizeof(int)) != 0)
+    {
+        diag("cannot allocate %zu items", max);
+        free(vec);
+        return;
+    }
+    tree = (int *) mem + 16 - 1;       /* (tree+1 is cache aligned) */
+    for (size_t i = 0; i < max; ++i)
+    {
+        vec[i] = (int) (2 * i);
+    }
+    diag("%10s %10s %10s %10s  (ns per lookup)", "items", "binsearch",
+         "lower", "eytzinger");
+    for (size_t n = 1000; n <= max; n *= 10)
+    {
+        uint64_t seed = 1;
+        size_t sum = 0;
+        clock_t start;
+        double t_bin, t_lower, t_eytz;
+        bool status;
+
+        eytzinger_build(tree, vec, n, sizeof(int));
+        start = clock();
+        for (size_t i = 0; i < n_lookup; ++i)
+        {
+            int key = (int) (random_key(&seed) % (2 * n));
+
+            sum += (size_t) binsearch(&key, vec, (int) n, sizeof(int),
+                                      int_cmp, &status);
+        }
+        t_bin = (double) (clock() - start) / CLOCKS_PER_SEC;
+        seed = 1;
+        start = clock();
+        for (size_t i = 0; i < n_lookup; ++i)
+        {
+            int key = (int) (random_key(&seed) % (2 * n));
+
+            sum += lower_bound_int(vec, n, key);
+        }
+        t_lower = (double) (clock() - start) / CLOCKS_PER_SEC;
+        seed = 1;
+        start = clock();
+        for (size_t i = 0; i < n_lookup; ++i)
+        {
+            int key = (int) (random_key(&seed) % (2 * n));
+
+            sum += eytzinger_int(tree, n, key);
+        }
+        t_eytz = (double) (clock() - start) / CLOCKS_PER_SEC;
+        diag("%10zu %10.1f %10.1f %10.1f  (%zu)", n, t_bin * 1e9 / n_lookup,
+             t_lower * 1e9 / n_lookup, t_eytz * 1e9 / n_lookup, sum % 10);
+    }
+    free(mem);
+    free(vec);
+}
+
+/*
+ * bench_small() --Compare lower_bound and SIMD search, for small n.
+ */
+static void bench_small(void)
+{
+    static int vec[512];
+    size_t n_lookup = 1000000;
+
+    diag("%s()", __func__);
+    for (size_t i = 0; i < NEL(vec); ++i)
+    {
+        vec[i] = (int) (2 * i);
+    }
+    diag("%10s %10s %10s %10s  (ns per lookup)", "items", "binsearch",
+         "lower", "simd");
+    for (size_t n = 8; n <= NEL(vec); n *= 4)
+    {
+        uint64_t seed = 1;
+        size_t sum = 0;
+        clock_t start;
+        double t_bin, t_lower, t_simd;
+        bool status;
+
+        start = clock();
+        for (size_t i = 0; i < n_lookup; ++i)
+        {
+            int key = (int) (random_key(&seed) % (2 * n));
+
+            sum += (size_t) binsearch(&key, vec, (int) n, sizeof(int),
+                                      int_cmp, &status);
+        }
+        t_bin = (double) (clock() - start) / CLOCKS_PER_SEC;
+        seed = 1;
+        start = clock();
+        for (size_t i = 0; i < n_lookup; ++i)
+        {
+            int key = (int) (random_key(&seed) % (2 * n));
+
+            sum += lower_bound_int(vec, n, key);
+        }
+        t_lower = (double) (clock() - start) / CLOCKS_PER_SEC;
+        seed = 1;
+        start = clock();
+        for (size_t i = 0; i < n_lookup; ++i)
+        {
+            int key = (int) (random_key(&seed) % (2 * n));
+
+            sum += lower_bound_small_int(vec, n, key);
+        }
+        t_simd = (double) (clock() - start) / CLOCKS_PER_SEC;
+        diag("%10zu %10.1f %10.1f %10.1f  (%zu)", n, t_bin * 1e9 / n_lookup,
+             t_lower * 1e9 / n_lookup, t_simd * 1e9 / n_lookup, sum % 10);
+    }
+}
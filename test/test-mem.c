@@ -0,0 +1,151 @@
+/*
+ * TEST-MEM.C --Unit tests for the library's tracked memory allocation.
+ *
+ * Contents:
+ * count_malloc()  --A MemBackend that counts calls to malloc().
+ * test_backend()  --Test setting the backend (before allocating).
+ * test_stats()    --Test the per-module statistics.
+ * test_report()   --Test printing the statistics.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#define USABLE_SIZE malloc_usable_size
+#else
+#define USABLE_SIZE NULL
+#endif /* __GLIBC__ */
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/mem.h>
+#include <apex/vector.h>
+
+static void test_backend(void);
+static void test_stats(void);
+static void test_report(void);
+
+int main(void)
+{
+    plan_tests(15);
+    test_backend();
+    test_stats();
+    test_report();
+    return exit_status();
+}
+
+static int n_malloc;
+
+/*
+ * count_malloc() --A MemBackend that counts calls to malloc().
+ */
+static void *count_malloc(size_t size)
+{
+    n_malloc += 1;
+    return malloc(size);
+}
+
+/*
+ * test_backend() --Test setting the backend (before allocating).
+ */
+static void test_backend(void)
+{
+    MemBackend backend = { count_malloc, NULL, realloc, free, USABLE_SIZE };
+    void *ptr;
+
+    diag("%s()", __func__);
+    errno = 0;
+    ok(!mem_set_backend(&backend) && errno == EINVAL,
+       "mem_set_backend() rejects an incomplete backend");
+    backend.calloc_proc = calloc;
+    ok(mem_set_backend(&backend), "mem_set_backend() before allocating");
+    ptr = mem_alloc(MEM_APEX, 100);
+    ok(ptr != NULL && n_malloc == 1, "mem_alloc() uses the backend");
+    mem_free(MEM_APEX, ptr);
+    errno = 0;
+    ok(!mem_set_backend(NULL) && errno == EBUSY,
+       "mem_set_backend() fails after allocating");
+}
+
+/*
+ * test_stats() --Test the per-module statistics.
+ *
+ * Remarks:
+ * Bytes in use are only tracked with a size_proc (i.e. with glibc);
+ * otherwise they stay 0.
+ */
+static void test_stats(void)
+{
+    MemStats before, after;
+    long *lv;
+    char *str;
+
+    diag("%s()", __func__);
+    mem_stats(MEM_VECTOR, &before);
+    lv = new_vector(sizeof(long), 10, NULL);
+    for (long i = 0; i < 1000; ++i)
+    {
+        lv = vector_add(lv, 1, &i);
+    }
+    mem_stats(MEM_VECTOR, &after);
+    number_eq(after.n_alloc - before.n_alloc, 1, "%zu",
+              "a vector is one allocation, however it grows");
+    ok_number(after.total - before.total, >=, 1000 * sizeof(long), "%zu",
+              "its growth is added to the total");
+    free_vector(lv);
+    mem_stats(MEM_VECTOR, &after);
+    ok(after.n_free == before.n_free + 1 && after.size == before.size
+       && (USABLE_SIZE == NULL || after.peak >= 1000 * sizeof(long)),
+       "free_vector() is counted, and its peak size kept");
+
+    mem_stats(MEM_STRING, &before);
+    str = mem_strdup(MEM_STRING, "hello");
+    mem_stats(MEM_STRING, &after);
+    ok(str != NULL && strcmp(str, "hello") == 0
+       && after.n_alloc == before.n_alloc + 1
+       && after.total == before.total + 6, "mem_strdup()");
+    str = mem_realloc(MEM_STRING, str, 100);
+    mem_stats(MEM_STRING, &after);
+    ok(after.n_alloc == before.n_alloc + 1
+       && after.total == before.total + 106,
+       "mem_realloc() adds to the total, but isn't a new allocation");
+    mem_free(MEM_STRING, str);
+
+    mem_track(0);
+    mem_free(MEM_STRING, mem_alloc(MEM_STRING, 10));
+    mem_track(1);
+    mem_stats(MEM_STRING, &before);
+    ok(before.n_alloc == after.n_alloc && before.n_free == after.n_free + 1,
+       "mem_track(0) stops counting");
+
+    ok(mem_stats(MEM_N_MODULE, &after) == NULL
+       && mem_module_name(MEM_N_MODULE) == NULL,
+       "an unknown module has no statistics");
+    ok(strcmp(mem_module_name(MEM_PROTOCOL), "protocol") == 0,
+       "mem_module_name()");
+}
+
+/*
+ * test_report() --Test printing the statistics.
+ */
+static void test_report(void)
+{
+    char buf[1024] = "";
+    FILE *fp = tmpfile();
+    int n;
+
+    diag("%s()", __func__);
+    n = mem_report(fp);
+    rewind(fp);
+    ok(n > 0 && fread(buf, 1, sizeof(buf) - 1, fp) == (size_t) n,
+       "mem_report() prints something");
+    ok(strstr(buf, "module=vector n_alloc=1 n_free=1 live=0") != NULL,
+       "mem_report() prints the vector module");
+    ok(strstr(buf, "module=csv") == NULL,
+       "mem_report() skips modules that haven't allocated");
+    fclose(fp);
+}
@@ -0,0 +1,132 @@
+/*
+ * TEST-MEMSWAP.C --Tests and benchmark for memswap().
+ *
+ * Contents:
+ * test_memswap() --Test memswap() for all sizes and alignments.
+ * bench_swap()   --Compare memswap() with a byte-by-byte swap.
+ *
+ * Remarks:
+ * The benchmark swaps pairs of items in a 64KB buffer (i.e. in L1/L2
+ * cache), for item sizes from 4 to 256 bytes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/estring.h>
+
+static void test_memswap(void);
+static void bench_swap(void);
+
+int main(void)
+{
+    plan_tests(3);
+    test_memswap();
+    bench_swap();
+    return exit_status();
+}
+
+/*
+ * byte_swap() --Swap memory a byte at a time (the reference version).
+ */
+static void byte_swap(void *m1, void *m2, size_t n)
+{
+    char *c1 = m1, *c2 = m2;
+
+    for (; n > 0; --n)
+    {
+        char ch = *c1;
+
+        *c1++ = *c2;
+        *c2++ = ch;
+    }
+}
+
+/*
+ * test_memswap() --Test memswap() for all sizes and alignments.
+ */
+static void test_memswap(void)
+{
+    unsigned char a[300], b[300], a_ref[300], b_ref[300];
+    int status = 1;
+    int ints[2][10];
+
+    diag("%s()", __func__);
+    for (size_t n = 0; n <= 260; ++n)
+    {
+        for (size_t offset = 0; offset < 8; ++offset)
+        {
+            for (size_t i = 0; i < sizeof(a); ++i)
+            {
+                a[i] = a_ref[i] = (unsigned char) i;
+                b[i] = b_ref[i] = (unsigned char) (255 - i);
+            }
+            memswap(a + offset, b + 7 - offset, n);
+            byte_swap(a_ref + offset, b_ref + 7 - offset, n);
+            if (memcmp(a, a_ref, sizeof(a)) != 0
+                || memcmp(b, b_ref, sizeof(b)) != 0)
+            {
+                status = 0;
+            }
+        }
+    }
+    ok(status, "memswap() swaps exactly n bytes, at any alignment");
+
+    for (int i = 0; i < 10; ++i)
+    {
+        ints[0][i] = i;
+        ints[1][i] = -i;
+    }
+    memswap_int(ints[0], ints[1], 10);
+    ok(ints[0][9] == -9 && ints[1][9] == 9 && ints[0][0] == 0,
+       "memswap_int()");
+    memswap(a, b, 0);
+    ok(memcmp(a, a_ref, sizeof(a)) == 0, "memswap() of 0 bytes");
+}
+
+/*
+ * time_swap() --Time n_swap swaps of size-byte items, with some proc.
+ */
+static double time_swap(void (*swap)(void *, void *, size_t), size_t size,
+                        size_t n_swap)
+{
+    static char buf[65536];
+    size_t n_item = sizeof(buf) / size;
+    clock_t start = clock();
+
+    for (size_t i = 0; i < n_swap; ++i)
+    {
+        char *a = buf + (i % n_item) * size;
+        char *b = buf + ((i * 7 + 1) % n_item) * size;
+
+        if (a != b)
+        {
+            swap(a, b, size);
+        }
+    }
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/*
+ * bench_swap() --Compare memswap() with a byte-by-byte swap.
+ */
+static void bench_swap(void)
+{
+    size_t n_swap = 2000000;
+
+    diag("%s()", __func__);
+    diag("%6s %10s %10s  (ns per swap)", "size", "bytes", "memswap");
+    for (size_t size = 4; size <= 256; size *= 2)
+    {
+        double t_byte = time_swap(byte_swap, size, n_swap);
+        double t_swap = time_swap(memswap, size, n_swap);
+
+        diag("%6zu %10.1f %10.1f", size, t_byte * 1e9 / n_swap,
+             t_swap * 1e9 / n_swap);
+    }
+}
@@ -0,0 +1,255 @@
+/*
+ * METRICS.C --Unit tests for the metrics registry.
+ *
+ * Contents:
+ * test_bucket()    --metric_bucket(), metric_bucket_min() tests.
+ * test_counter()   --Sharded counter tests.
+ * test_histogram() --Histogram quantile tests.
+ * test_format()    --Prometheus exposition tests.
+ * test_modules()   --Module collector tests.
+ * main()           --Tests entrypoint.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <apex/test.h>
+#include <apex/metrics.h>
+#include <apex/hash.h>
+#include <apex/log.h>
+#include <apex/pool.h>
+#include <apex/queue.h>
+
+enum
+{
+    N_THREAD = 4,
+    N_ADD = 100000
+};
+
+/*
+ * test_empty() --metrics_format() of an empty registry.
+ */
+static void test_empty(void)
+{
+    StrBuf buf;
+
+    strbuf_init(&buf);
+    ok(metrics_format(&buf) && buf.len == 0,
+       "metrics_format() with no metrics");
+    strbuf_free(&buf);
+}
+
+/*
+ * test_bucket() --metric_bucket(), metric_bucket_min() tests.
+ */
+static void test_bucket(void)
+{
+    int n_bad = 0, last = -1;
+    uint64_t value[] = { 0, 1, 15, 16, 17, 100, 1000, 123456789, UINT64_MAX };
+
+    for (size_t i = 0; i < NEL(value); ++i)
+    {
+        int bucket = metric_bucket(value[i]);
+
+        n_bad += bucket < last || bucket >= METRIC_N_BUCKET
+            || metric_bucket_min(bucket) > value[i]
+            || (bucket + 1 < METRIC_N_BUCKET
+                && metric_bucket_min(bucket + 1) <= value[i]);
+        last = bucket;
+    }
+    ok(n_bad == 0, "values fall within their bucket's bounds");
+    ok(metric_bucket(15) == 15 && metric_bucket(16) == 16
+       && metric_bucket(18) == 17 && metric_bucket_min(17) == 18,
+       "small values are exact, then 8 buckets per octave");
+    ok(metric_bucket(UINT64_MAX) == METRIC_N_BUCKET - 1,
+       "the largest value is in the last bucket");
+}
+
+/*
+ * add_thread() --Add to a counter from several threads.
+ */
+static void *add_thread(void *data)
+{
+    for (int i = 0; i < N_ADD; ++i)
+    {
+        metric_counter_add((MetricCounterPtr) data, 1);
+    }
+    return NULL;
+}
+
+/*
+ * test_counter() --Sharded counter tests.
+ */
+static void test_counter(void)
+{
+    MetricCounterPtr counter = metric_counter_new("test_total", NULL, NULL);
+    MetricGaugePtr gauge = metric_gauge_new("test_gauge", NULL, NULL);
+    pthread_t thread[N_THREAD];
+
+    for (int i = 0; i < N_THREAD; ++i)
+    {
+        pthread_create(&thread[i], NULL, add_thread, counter);
+    }
+    for (int i = 0; i < N_THREAD; ++i)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    ok(metric_counter_value(counter) == (uint64_t) N_THREAD * N_ADD,
+       "counter shards sum to the total");
+    metric_gauge_set(gauge, 10);
+    metric_gauge_add(gauge, -15);
+    ok(metric_gauge_value(gauge) == -5, "gauge goes up and down");
+    metric_free(counter);
+    metric_free(gauge);
+}
+
+/*
+ * test_histogram() --Histogram quantile tests.
+ */
+static void test_histogram(void)
+{
+    MetricHistogramPtr h = metric_histogram_new("test_ns", NULL, NULL, 1.0);
+    uint64_t p50, p99;
+
+    ok(metric_histogram_quantile(h, 0.5) == 0, "empty histogram: 0");
+    for (uint64_t v = 1; v <= 10000; ++v)
+    {
+        metric_histogram_record(h, v);
+    }
+    p50 = metric_histogram_quantile(h, 0.5);
+    p99 = metric_histogram_quantile(h, 0.99);
+    ok(metric_histogram_count(h) == 10000, "histogram counts values");
+    ok(p50 >= 5000 && p50 < 5000 + 5000 / METRIC_SUB,
+       "median within a bucket (%llu)", (unsigned long long) p50);
+    ok(p99 >= 9900 && p99 < 9900 + 9900 / METRIC_SUB,
+       "p99 within a bucket (%llu)", (unsigned long long) p99);
+    metric_free(h);
+}
+
+/*
+ * collect() --A test collector.
+ */
+static void collect(MetricWriterPtr writer, void *data)
+{
+    metric_write(writer, "test_collected", "A collected value.",
+                 METRIC_GAUGE, *(double *) data);
+    metric_write_labelled(writer, "test_collected", "A collected value.",
+                          METRIC_GAUGE, "part=\"b\"", 2.5);
+}
+
+/*
+ * test_format() --Prometheus exposition tests.
+ */
+static void test_format(void)
+{
+    MetricCounterPtr a = metric_counter_new("test_requests_total",
+                                            "Requests.", "method=\"get\"");
+    MetricCounterPtr b = metric_counter_new("test_requests_total",
+                                            "Requests.", "method=\"put\"");
+    MetricHistogramPtr h = metric_histogram_new("test_seconds", "Latency.",
+                                                NULL, 1e-3);
+    double value = 42;
+    MetricPtr c = metric_collector_new("src=\"x\"", collect, &value);
+    char label[64];
+    StrBuf buf;
+    const char *help;
+
+    metric_counter_add(a, 3);
+    metric_counter_add(b, 4);
+    metric_histogram_record(h, 3);
+    metric_histogram_record(h, 100);
+    strbuf_init(&buf);
+    ok(metrics_format(&buf), "metrics_format()");
+    help = strstr(buf.str, "# HELP test_requests_total Requests.\n"
+                  "# TYPE test_requests_total counter\n");
+    ok(help != NULL && strstr(help + 1, "# HELP test_requests_total") == NULL,
+       "HELP and TYPE are written once per name");
+    ok(strstr(buf.str, "test_requests_total{method=\"get\"} 3\n"
+              "test_requests_total{method=\"put\"} 4\n") != NULL,
+       "labelled counters, in registration order");
+    ok(strstr(buf.str, "test_collected{src=\"x\"} 42\n"
+              "test_collected{src=\"x\",part=\"b\"} 2.5\n") != NULL,
+       "collector values and labels");
+    ok(strstr(buf.str, "test_seconds_bucket{le=\"0.004\"} 1\n") != NULL
+       && strstr(buf.str, "test_seconds_bucket{le=\"0.128\"} 2\n") != NULL
+       && strstr(buf.str, "test_seconds_bucket{le=\"+Inf\"} 2\n") != NULL
+       && strstr(buf.str, "test_seconds_sum 0.103\n") != NULL
+       && strstr(buf.str, "test_seconds_count 2\n") != NULL,
+       "histogram buckets are cumulative and scaled");
+    string_eq(metric_label(label, sizeof(label), "k", "a\"b\\c"),
+              "k=\"a\\\"b\\\\c\"", "metric_label() escapes values");
+    metric_free(a);
+    metric_free(b);
+    metric_free(h);
+    metric_free(c);
+
+    strbuf_clear(&buf);
+    metrics_format(&buf);
+    ok(strstr(buf.str, "test_") == NULL, "metric_free() unregisters");
+    strbuf_free(&buf);
+}
+
+/*
+ * test_modules() --Module collector tests.
+ */
+static void test_modules(void)
+{
+    int queue_item[8], pool_item[4];
+    unsigned int pool_slot[4][2];
+    AtomicQueue queue;
+    Pool pool;
+    HashPtr hash = hash_new(hash_key_jenkins, 16);
+    MetricPtr metric[4];
+    StrBuf buf;
+
+    queue_init(&queue, NEL(queue_item), sizeof(queue_item[0]), queue_item);
+    for (int i = 0; i < 3; ++i)
+    {
+        queue_push(&queue, &i);
+    }
+    queue_pop(&queue, &pool_item[0]);
+    init_pool(&pool, pool_slot);
+    for (int i = 0; i < 5; ++i)
+    {
+        pool_new(&pool);
+    }
+    metric[0] = queue_metrics(&queue, "input");
+    metric[1] = pool_metrics(&pool, "slots");
+    metric[2] = hash_metrics(hash, "index");
+    metric[3] = log_metrics();
+    strbuf_init(&buf);
+    metrics_format(&buf);
+    ok(strstr(buf.str, "apex_queue_writes_total{queue=\"input\"} 3\n")
+       && strstr(buf.str, "apex_queue_depth{queue=\"input\"} 2\n"),
+       "queue_metrics()");
+    ok(strstr(buf.str, "apex_pool_items_live{pool=\"slots\"} 4\n")
+       && strstr(buf.str,
+                 "apex_pool_alloc_failures_total{pool=\"slots\"} 1\n"),
+       "pool_metrics()");
+    ok(strstr(buf.str, "apex_hash_slots{hash=\"index\"} 16\n") != NULL,
+       "hash_metrics()");
+    ok(strstr(buf.str, "apex_log_messages_total{priority=\"err\"}") != NULL,
+       "log_metrics()");
+    strbuf_free(&buf);
+    for (size_t i = 0; i < NEL(metric); ++i)
+    {
+        metric_free(metric[i]);
+    }
+    hash_free(hash);
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(21);
+
+    test_empty();
+    test_bucket();
+    test_counter();
+    test_histogram();
+    test_format();
+    test_modules();
+
+    return exit_status();
+}
@@ -4,16 +4,116 @@
  * Remarks:
  *
  */
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <apex.h>
 #include <apex/tap.h>
 #include <apex/estring.h>
 #include <apex/nmea.h>
 
+/*
+ * test_stream() --Test the incremental decoder, with chunked input.
+ */
+static void test_stream(void)
+{
+    static const char feed[] =
+        "noise$GPGGA,1,2,3*7A\r\n"        /* (bad checksum) */
+        "$GPRMC,a,b\r\n"
+        "$GPGLL,trunc$GPZDA,x,y*49\r\n"
+        "\x01\x02!AIVDM,1,1,,A,13aG*1E\n"
+        "$GPVTG,\x7f\n";                  /* (not printable) */
+    const char *expect[] = { "GPRMC", "GPZDA", "AIVDM" };
+    char msg[3][8] = { "", "", "" };
+    char nmea_text[NMEA_LINE_MAX + 3];
+    size_t n_ok = 0, n_err = 0, offset = 0;
+    NmeaStream stream;
+    Nmea nmea;
+
+    nmea_stream_init(&stream);
+    for (size_t chunk = 1; offset < sizeof(feed) - 1; chunk = chunk % 7 + 1)
+    {                                  /* (chunks of 1..7 bytes) */
+        const char *data = feed + offset;
+        size_t n_data = MIN(chunk, sizeof(feed) - 1 - offset);
+        int status;
+
+        offset += n_data;
+        while ((status = nmea_stream_next(&stream, &nmea, &data, &n_data))
+               != NMEA_EOF)
+        {
+            if (status != NMEA_OK)
+            {
+                ++n_err;
+            }
+            else if (n_ok < NEL(msg))
+            {
+                sprintf(msg[n_ok++], "%s%s", nmea.id, nmea.msg);
+            }
+        }
+    }
+    ok(n_ok == 3 && strcmp(msg[0], expect[0]) == 0
+       && strcmp(msg[1], expect[1]) == 0 && strcmp(msg[2], expect[2]) == 0,
+       "stream decodes the valid sentences (%zu)", n_ok);
+    ok(n_err == 3 && stream.n_error == 3 && stream.n_sentence == 3,
+       "stream drops bad, truncated and unprintable sentences (%zu)",
+       n_err);
+    sprintf(nmea_text, "$GPZDA,x,y*49\r\n");
+    ok(nmea_parse(&nmea, nmea_text) == NMEA_OK && nmea.n_values == 3
+       && strcmp(nmea.value[2], "y") == 0,
+       "stream and nmea_parse() agree on the checksum");
+}
+
+/*
+ * test_fix() --Test the typed GGA/RMC/VTG decoders, and the checksum.
+ */
+static void test_fix(void)
+{
+    char text[NMEA_LINE_MAX + 3];
+    Nmea nmea;
+    int n_same = 0;
+
+    ok(nmea_parse(&nmea, "$GPGGA,123519.5,4807.038,N,01131.000,W,1,08,0.9,"
+                  "545.4,M,46.9,M,,*4E\r\n") == NMEA_OK
+       && nmea.type == NMEA_TYPE_GGA
+       && nmea.fix.gga.time_ms == 45319500
+       && fabs(nmea.fix.gga.latitude - (48 + 7.038 / 60)) < 1e-9
+       && fabs(nmea.fix.gga.longitude + (11 + 31.0 / 60)) < 1e-9
+       && nmea.fix.gga.quality == 1 && nmea.fix.gga.n_satellites == 8
+       && nmea.fix.gga.hdop == 0.9 && nmea.fix.gga.altitude == 545.4,
+       "decode GGA values");
+    ok(nmea_parse(&nmea, "$GPRMC,123519,A,4807.038,S,01131.000,E,022.4,"
+                  "084.4,230394,003.1,W*77\r\n") == NMEA_OK
+       && nmea.type == NMEA_TYPE_RMC && nmea.fix.rmc.valid
+       && nmea.fix.rmc.time_ms == 45319000
+       && fabs(nmea.fix.rmc.latitude + (48 + 7.038 / 60)) < 1e-9
+       && nmea.fix.rmc.speed_knots == 22.4 && nmea.fix.rmc.course == 84.4
+       && nmea.fix.rmc.day == 23 && nmea.fix.rmc.month == 3
+       && nmea.fix.rmc.variation == -3.1, "decode RMC values");
+    ok(nmea_parse(&nmea, "$GPVTG,054.7,T,,M,005.5,N,010.2,K*65\r\n")
+       == NMEA_OK && nmea.type == NMEA_TYPE_VTG
+       && nmea.fix.vtg.course_true == 54.7
+       && isnan(nmea.fix.vtg.course_magnetic)
+       && nmea.fix.vtg.speed_kmh == 10.2, "decode VTG, with missing values");
+
+    for (size_t len = 0; len < sizeof(text); ++len)
+    {
+        unsigned int check = 0;
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            text[i] = (char) (' ' + (i * 7 + len) % 95);
+            check ^= (unsigned char) text[i];
+        }
+        n_same += nmea_checksum(text, text + len) == check;
+    }
+    ok(n_same == (int) sizeof(text),
+       "word-wise checksum matches a byte-wise XOR (%d)", n_same);
+}
+
 int main(void)
 {
-    plan_tests(13);
+    plan_tests(20);
     Nmea nmea;
     char text[NMEA_LINE_MAX + 3];
 
@@ -52,6 +152,8 @@ int main(void)
     {
         diag((char *) "format failed: got \"%s\"", text);
     }
+    test_stream();
+    test_fix();
 
     return exit_status();
 }
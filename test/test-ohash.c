@@ -0,0 +1,213 @@
+/*
+ * TEST-OHASH.C --Unit tests for the open-addressing hash table.
+ *
+ * Contents:
+ * hash()         --A dummy hash function that makes collisions easy.
+ * compare_item() --Compare two hash items for equality.
+ * count_item()   --Count the items visited.
+ * test_basic()   --Test insert/find/remove on a small table.
+ * test_grow()    --Test that the table grows, and survives removals.
+ * test_typed()   --Test a table defined with HASH_DEFINE().
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/hash.h>
+#include <apex/hash-typed.h>
+
+static void test_basic(void);
+static void test_grow(void);
+static void test_typed(void);
+
+int main(void)
+{
+    plan_tests(20);
+    test_basic();
+    test_grow();
+    test_typed();
+    return exit_status();
+}
+
+/*
+ * hash() --A dummy hash function that makes collisions easy.
+ *
+ * Remarks:
+ * Items are small integers; values that differ by a multiple of 16
+ * collide in the initial table.
+ */
+static unsigned long hash(char *data)
+{
+    return (unsigned long) data % 16;
+}
+
+/*
+ * compare_item() --Compare two hash items for equality.
+ */
+static int compare_item(const void *data, const void *key)
+{
+    return (long) data - (long) key;
+}
+
+/*
+ * count_item() --Count the items visited.
+ */
+static void *count_item(void *UNUSED(data), void *usrdata)
+{
+    *(size_t *) usrdata += 1;
+    return NULL;
+}
+
+/*
+ * test_basic() --Test insert/find/remove on a small table.
+ */
+static void test_basic(void)
+{
+    OHashPtr h;
+    size_t n = 0;
+
+    diag("%s()", __func__);
+    ok(ohash_new(hash, 0) == NULL, "ohash_new() bad nslots");
+
+    h = ohash_new(hash, 16);
+    ok(h != NULL, "ohash_new() 16 slots");
+
+    ohash_insert(h, (void *) 1);
+    ohash_insert(h, (void *) 17);      /* collides with 1 */
+    ohash_insert(h, (void *) 2);       /* displaced by 17 */
+    ok(!ohash_insert(h, NULL), "ohash_insert() rejects NULL");
+
+    ptr_eq(ohash_find(h, compare_item, (void *) 17), (void *) 17,
+           "ohash_find() colliding item");
+    ptr_eq(ohash_find(h, compare_item, (void *) 33), NULL,
+           "ohash_find() missing colliding item");
+
+    ptr_eq(ohash_remove(h, compare_item, (void *) 1), (void *) 1,
+           "ohash_remove() head of probe run");
+    ptr_eq(ohash_find(h, compare_item, (void *) 17), (void *) 17,
+           "ohash_find() shifted item after removal");
+    ptr_eq(ohash_find(h, compare_item, (void *) 2), (void *) 2,
+           "ohash_find() displaced item after removal");
+    ptr_eq(ohash_remove(h, compare_item, (void *) 1), NULL,
+           "ohash_remove() non-existent item");
+
+    ohash_visit(h, count_item, &n);
+    number_eq(n, 2, "%zu", "ohash_visit() remaining items");
+    ohash_free(h);
+}
+
+/*
+ * test_grow() --Test that the table grows, and survives removals.
+ */
+static void test_grow(void)
+{
+    OHashPtr h = ohash_new(hash, 1);
+    int status = 1;
+    size_t n = 0;
+
+    diag("%s()", __func__);
+    for (long i = 1; i <= 1000; ++i)
+    {
+        if (!ohash_insert(h, (void *) i))
+        {
+            status = 0;
+        }
+    }
+    ok(status && h->n_items == 1000, "ohash_insert() 1000 items");
+    ok_number(h->nslot, >=, (size_t) 1334, "%zu", "table has grown");
+
+    for (long i = 1; i <= 1000; i += 2)
+    {
+        ohash_remove(h, compare_item, (void *) i);
+    }
+    for (long i = 1; i <= 1000; ++i)
+    {
+        void *item = ohash_find(h, compare_item, (void *) i);
+
+        if ((i % 2 == 0) != (item == (void *) i))
+        {
+            diag("ohash_find(%ld) got %p", i, item);
+            status = 0;
+        }
+    }
+    ok(status, "ohash_find() after removing odd items");
+
+    ohash_visit(h, count_item, &n);
+    number_eq(n, 500, "%zu", "ohash_visit() visits 500 items");
+    ohash_free(h);
+}
+
+/*
+ * long_hash() --A dummy hash function for typed tables (as hash() above).
+ */
+static unsigned long long_hash(const long *key)
+{
+    return (unsigned long) *key % 16;
+}
+
+#define long_equal(a_, b_) (*(a_) == *(b_))
+HASH_DEFINE(LongMap, long, double, long_hash, long_equal)
+
+/*
+ * count_long() --Count the items visited in a typed table.
+ */
+static int count_long(const long *UNUSED(key), double *UNUSED(value),
+                      void *user_data)
+{
+    *(size_t *) user_data += 1;
+    return 0;
+}
+
+/*
+ * test_typed() --Test a table defined with HASH_DEFINE().
+ */
+static void test_typed(void)
+{
+    LongMap map;
+    double value;
+    long n_odd = 1;
+    int status = 1;
+    size_t n = 0;
+
+    diag("%s()", __func__);
+    ok(LongMap_init(&map, 10) == &map && map.nslot == 16,
+       "LongMap_init() rounds up to a power of 2");
+    for (long i = 0; i < 1000; ++i)
+    {
+        value = (double) i / 2;
+        status &= LongMap_put(&map, &i, &value);
+    }
+    ok(status && map.n_items == 1000 && map.nslot >= 1334,
+       "LongMap_put() 1000 items, and the table grows");
+
+    for (long i = 0; i < 1000; ++i)
+    {
+        double *found = LongMap_get(&map, &i);
+
+        status &= found != NULL && *found == (double) i / 2;
+    }
+    ok(status, "LongMap_get() finds every item");
+
+    for (long i = 1; i < 1000; i += 2)
+    {
+        status &= LongMap_remove(&map, &i, &value) && value == (double) i / 2;
+    }
+    for (long i = 0; i < 1000; ++i)
+    {
+        status &= (i % 2 == 0) == (LongMap_get(&map, &i) != NULL);
+    }
+    ok(status && map.n_items == 500 && !LongMap_remove(&map, &n_odd, NULL),
+       "LongMap_remove() odd items");
+
+    value = -1.0;
+    n_odd = 0;
+    ok(LongMap_put(&map, &n_odd, &value) && map.n_items == 500
+       && *LongMap_get(&map, &n_odd) == -1.0,
+       "LongMap_put() replaces an existing value");
+
+    LongMap_visit(&map, count_long, &n);
+    number_eq(n, 500, "%zu", "LongMap_visit() visits 500 items");
+    LongMap_free(&map);
+}
@@ -0,0 +1,244 @@
+/*
+ * PHASH.C --Unit tests for the persistent hash table.
+ *
+ * Contents:
+ * make_key()       --Format a test key.
+ * n_found()        --Count the keys that have their expected values.
+ * test_reopen()    --Put, close, and reopen (cleanly).
+ * test_update()    --Replace and remove keys, and grow the file.
+ * test_crash()     --Reopen a table that wasn't closed.
+ * test_stale()     --Bound a reader by its mapping; check the live header.
+ * test_corrupt()   --Reject a damaged (or foreign) file.
+ * main()           --Tests entrypoint.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <apex/test.h>
+#include <apex/phash.h>
+#include <sys/mman.h>
+
+enum
+{
+    N_KEY = 5000
+};
+
+static char path[64];
+
+/*
+ * make_key() --Format a test key.
+ */
+static size_t make_key(char *key, size_t size, const char *prefix, int i)
+{
+    return (size_t) snprintf(key, size, "%s-%d", prefix, i);
+}
+
+/*
+ * n_found() --Count the keys that have their expected values.
+ *
+ * Remarks:
+ * Key "key-i" has the value i * scale.
+ */
+static int n_found(PHashPtr h, int n, int scale)
+{
+    char key[32];
+    int found = 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        size_t len = make_key(key, sizeof(key), "key", i), value_len;
+        const int *value = phash_get(h, key, len, &value_len);
+
+        found += value != NULL && value_len == sizeof(*value)
+            && *value == i * scale;
+    }
+    return found;
+}
+
+/*
+ * test_reopen() --Put, close, and reopen (cleanly).
+ */
+static void test_reopen(void)
+{
+    PHash h;
+    char key[32];
+    int n_put = 0;
+
+    ok(phash_create(&h, path, 1024, 0), "phash_create()");
+    for (int i = 0; i < N_KEY; ++i)
+    {
+        size_t len = make_key(key, sizeof(key), "key", i);
+
+        n_put += phash_put(&h, key, len, &i, sizeof(i));
+    }
+    ok(n_put == N_KEY && h.header->n_items == N_KEY
+       && n_found(&h, N_KEY, 1) == N_KEY, "phash_put(), phash_get()");
+    ok(phash_get(&h, "nothing", 7, NULL) == NULL, "phash_get(): missing key");
+    ok(phash_close(&h), "phash_close()");
+
+    ok(phash_open(&h, path, PHASH_RDONLY) && !h.recovered
+       && n_found(&h, N_KEY, 1) == N_KEY, "phash_open(): read-only");
+    ok(!phash_put(&h, "key", 3, "x", 1) && errno == EBADF,
+       "phash_put(): read-only");
+    phash_close(&h);
+
+    ok(phash_open(&h, path, 0) && !h.recovered
+       && h.header->n_items == N_KEY
+       && n_found(&h, N_KEY, 1) == N_KEY, "phash_open(): clean reopen");
+    phash_close(&h);
+}
+
+/*
+ * test_update() --Replace and remove keys, and grow the file.
+ */
+static void test_update(void)
+{
+    PHash h;
+    char key[32];
+    size_t size;
+    int n_removed = 0;
+
+    phash_open(&h, path, 0);
+    size = h.size;
+    for (int i = 0; i < N_KEY; ++i)
+    {
+        size_t len = make_key(key, sizeof(key), "key", i);
+        int value = i * 2;
+
+        phash_put(&h, key, len, &value, sizeof(value));
+    }
+    ok(h.header->n_items == N_KEY && h.header->n_garbage == N_KEY
+       && n_found(&h, N_KEY, 2) == N_KEY, "phash_put(): replace");
+    ok(h.size > size, "the file grows (%zu -> %zu)", size, h.size);
+    for (int i = 0; i < N_KEY; i += 2)
+    {
+        size_t len = make_key(key, sizeof(key), "key", i);
+
+        n_removed += phash_remove(&h, key, len);
+    }
+    ok(n_removed == N_KEY / 2 && h.header->n_items == N_KEY / 2
+       && n_found(&h, N_KEY, 2) == N_KEY / 2, "phash_remove()");
+    ok(!phash_remove(&h, "key-0", 5), "phash_remove(): missing key");
+    ok(phash_put(&h, "empty", 5, NULL, 0)
+       && phash_get(&h, "empty", 5, &size) != NULL && size == 0,
+       "phash_put(): empty value");
+    phash_close(&h);
+}
+
+/*
+ * test_crash() --Reopen a table that wasn't closed.
+ */
+static void test_crash(void)
+{
+    PHash h;
+    char key[32];
+    size_t len;
+    int value = -1;
+
+    phash_open(&h, path, 0);
+    ok(phash_sync(&h), "phash_sync()");
+    len = make_key(key, sizeof(key), "key", 1);
+    phash_put(&h, key, len, &value, sizeof(value));
+    len = make_key(key, sizeof(key), "key", 3);
+    phash_remove(&h, key, len);
+    munmap(h.base, h.size);            /* (abandon the table) */
+    close(h.fd);
+
+    ok(!phash_open(&h, path, PHASH_RDONLY) && errno == EBUSY,
+       "phash_open(): read-only, dirty");
+    ok(phash_open(&h, path, 0) && h.recovered, "phash_open(): recovered");
+    ok(h.header->n_items == N_KEY / 2
+       && n_found(&h, N_KEY, 2) == N_KEY / 2 - 2
+       && *(const int *) phash_get(&h, "key-1", 5, NULL) == -1
+       && phash_get(&h, "key-3", 5, NULL) == NULL
+       && phash_get(&h, "empty", 5, NULL) != NULL,
+       "the log is replayed");
+    phash_close(&h);
+    ok(phash_open(&h, path, PHASH_RDONLY) && !h.recovered,
+       "phash_open(): clean after recovery");
+    phash_close(&h);
+}
+
+/*
+ * test_stale() --Bound a reader by its mapping; check the live header.
+ *
+ * Remarks:
+ * The reader maps the file before the writer grows it, so entries
+ * the writer appends are (linked from the shared slots, but) beyond
+ * the reader's mapping, and must not be read.
+ */
+static void test_stale(void)
+{
+    PHash reader, writer;
+    static char value[4096];
+    char key[32];
+    size_t len = 0;
+    uint64_t used = UINT64_MAX / 2;
+    int fd;
+
+    ok(phash_open(&reader, path, PHASH_RDONLY) && phash_open(&writer, path, 0),
+       "phash_open(): a reader, then a writer");
+    for (int i = 0; writer.size <= reader.size; ++i)
+    {
+        len = make_key(key, sizeof(key), "big", i);
+        phash_put(&writer, key, len, value, sizeof(value));
+    }
+    ok(phash_get(&reader, key, len, NULL) == NULL,
+       "phash_get(): a reader ignores entries beyond its mapping");
+    phash_close(&reader);
+    phash_close(&writer);
+
+    if ((fd = open(path, O_RDWR)) >= 0)
+    {
+        (void) pwrite(fd, &used, sizeof(used), offsetof(PHashHeader, used));
+        close(fd);
+    }
+    ok(!phash_open(&reader, path, PHASH_RDONLY) && errno == EINVAL,
+       "phash_open(): read-only, bad live header");
+    ok(phash_open(&writer, path, 0) && writer.header->used <= writer.size
+       && n_found(&writer, N_KEY, 2) == N_KEY / 2 - 2,
+       "phash_open(): restores the live header from the commit");
+    phash_close(&writer);
+}
+
+/*
+ * test_corrupt() --Reject a damaged (or foreign) file.
+ */
+static void test_corrupt(void)
+{
+    PHash h;
+    FILE *fp;
+
+    ok(!phash_open(&h, "no-such-file.tmp", 0) && errno == ENOENT,
+       "phash_open(): missing file");
+    if ((fp = fopen(path, "r+")) != NULL)
+    {
+        fseek(fp, 8, SEEK_SET);        /* (the version) */
+        fputc(0xff, fp);
+        fclose(fp);
+    }
+    ok(!phash_open(&h, path, 0) && errno == EINVAL,
+       "phash_open(): bad header");
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(23);
+
+    snprintf(path, sizeof(path), "phash-%d.tmp", getpid());
+    test_reopen();
+    test_update();
+    test_crash();
+    test_stale();
+    test_corrupt();
+    unlink(path);
+
+    return exit_status();
+}
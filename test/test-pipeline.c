@@ -0,0 +1,240 @@
+/*
+ * TEST-PIPELINE.C --Unit tests for the streaming pipeline.
+ *
+ * Contents:
+ * count_source()  --Emit the numbers 1..N_ITEM: a PipelineProc.
+ * square_stage()  --Emit the square of each item: a PipelineProc.
+ * sum_sink()      --Check and sum the items: a PipelineProc.
+ * test_errors()   --Test that bad pipelines are rejected.
+ * test_run()      --Test a three-stage pipeline on a pool.
+ * test_cancel()   --Test that a failing stage cancels the pipeline.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/pipeline.h>
+
+#define N_ITEM 100000L
+#define N_CHUNK 100                    /* items emitted per source call */
+
+typedef struct Count_t
+{
+    long next;                         /* the next No. to emit */
+    long limit;                        /* ...stop after this (0: never) */
+} Count;
+
+typedef struct Square_t
+{
+    int running;                       /* No. of threads in the stage */
+    int overlap;                       /* it ran on two threads at once */
+    long n_call;
+} Square;
+
+typedef struct Sum_t
+{
+    long n_items;
+    long sum;
+    long last;                         /* the last root seen */
+    int in_order;
+    int n_end;                         /* No. of end-of-input calls */
+    long fail_at;                      /* fail at this item (0: never) */
+} Sum;
+
+static void test_errors(void);
+static void test_run(int n_worker);
+static void test_cancel(void);
+
+int main(void)
+{
+    plan_tests(18);
+    test_errors();
+    test_run(1);
+    test_run(4);
+    test_cancel();
+    return exit_status();
+}
+
+/*
+ * count_source() --Emit the numbers 1..N_ITEM: a PipelineProc.
+ */
+static int count_source(PipelineStagePtr stage, void *data,
+                        void *UNUSED(items), size_t UNUSED(n_items))
+{
+    Count *count = data;
+
+    for (int i = 0; i < N_CHUNK; ++i)
+    {
+        if (count->limit != 0 && count->next > count->limit)
+        {
+            return 1;                  /* (the end) */
+        }
+        if (!pipeline_emit(stage, &count->next))
+        {
+            return errno == ECANCELED ? 1 : -1;
+        }
+        count->next += 1;
+    }
+    return 0;
+}
+
+/*
+ * square_stage() --Emit the square of each item: a PipelineProc.
+ *
+ * Remarks:
+ * Each output is a pair (root, square), so the sink can check the
+ * order.
+ */
+static int square_stage(PipelineStagePtr stage, void *data, void *items,
+                        size_t n_items)
+{
+    Square *square = data;
+    long *item = items;
+    int status = 0;
+
+    if (__atomic_add_fetch(&square->running, 1, __ATOMIC_ACQ_REL) != 1)
+    {
+        square->overlap = 1;
+    }
+    square->n_call += 1;
+    for (size_t i = 0; i < n_items && status == 0; ++i)
+    {
+        long pair[2] = { item[i], item[i] * item[i] };
+
+        status = pipeline_emit(stage, pair) ? 0 : -1;
+    }
+    __atomic_sub_fetch(&square->running, 1, __ATOMIC_ACQ_REL);
+    return status;
+}
+
+/*
+ * sum_sink() --Check and sum the items: a PipelineProc.
+ */
+static int sum_sink(PipelineStagePtr UNUSED(stage), void *data, void *items,
+                    size_t n_items)
+{
+    Sum *sum = data;
+    long (*pair)[2] = items;
+
+    if (n_items == 0)
+    {
+        sum->n_end += 1;
+        return 0;
+    }
+    for (size_t i = 0; i < n_items; ++i)
+    {
+        if (pair[i][0] != sum->last + 1
+            || pair[i][1] != pair[i][0] * pair[i][0])
+        {
+            sum->in_order = 0;
+        }
+        sum->last = pair[i][0];
+        sum->sum += pair[i][1];
+        sum->n_items += 1;
+        if (sum->n_items == sum->fail_at)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * test_errors() --Test that bad pipelines are rejected.
+ */
+static void test_errors(void)
+{
+    TaskPoolPtr pool = task_pool_new(1, 0);
+    PipelinePtr pipeline = pipeline_new(pool);
+    PipelineStagePtr stage;
+    Count count = { 1, 10 };
+    long item = 0;
+
+    diag("%s()", __func__);
+    ok(pipeline != NULL && pipeline_start(pipeline) == 0,
+       "pipeline_start() fails with no stages");
+    stage = pipeline_add(pipeline, count_source, &count, 0, 0, 0);
+    ok(stage != NULL && stage->id == 0, "pipeline_add() source");
+    ok(pipeline_add(pipeline, sum_sink, NULL, sizeof(long), 12, 0) == NULL,
+       "pipeline_add() rejects a queue that isn't a power of 2");
+    errno = 0;
+    ok(pipeline_emit(stage, &item) == 0 && errno == EINVAL,
+       "pipeline_emit() fails from the last stage");
+    pipeline_free(pipeline);
+    task_pool_free(pool);
+}
+
+/*
+ * test_run() --Test a three-stage pipeline on a pool.
+ *
+ * Remarks:
+ * The queues are small, so the source is held up by the later
+ * stages, even when there are fewer workers than stages.
+ */
+static void test_run(int n_worker)
+{
+    TaskPoolPtr pool = task_pool_new(n_worker, 0);
+    PipelinePtr pipeline = pipeline_new(pool);
+    Count count = { 1, N_ITEM };
+    Square square = { 0 };
+    Sum sum = { 0 };
+    long expect = 0;
+
+    diag("%s(%d)", __func__, n_worker);
+    sum.in_order = 1;
+    for (long i = 1; i <= N_ITEM; ++i)
+    {
+        expect += i * i;
+    }
+    ok(pipeline_add(pipeline, count_source, &count, 0, 0, 0) != NULL
+       && pipeline_add(pipeline, square_stage, &square,
+                       sizeof(long), 16, 4) != NULL
+       && pipeline_add(pipeline, sum_sink, &sum,
+                       2 * sizeof(long), 64, 0) != NULL,
+       "pipeline_add() three stages");
+    ok(pipeline_run(pipeline), "pipeline_run() succeeds");
+    ok(sum.n_items == N_ITEM && sum.sum == expect && sum.in_order,
+       "all items arrive, in order (sum %ld, expected %ld)", sum.sum,
+       expect);
+    ok(!square.overlap && square.n_call >= N_ITEM / 4,
+       "a stage runs on one thread at a time, in batches");
+    number_eq(sum.n_end, 1, "%d", "the last stage sees the end once");
+    pipeline_free(pipeline);
+    task_pool_free(pool);
+}
+
+/*
+ * test_cancel() --Test that a failing stage cancels the pipeline.
+ *
+ * Remarks:
+ * The source never ends by itself, so this only returns if the
+ * failure stops it.
+ */
+static void test_cancel(void)
+{
+    TaskPoolPtr pool = task_pool_new(2, 0);
+    PipelinePtr pipeline = pipeline_new(pool);
+    Count count = { 1, 0 };
+    Square square = { 0 };
+    Sum sum = { 0 };
+
+    diag("%s()", __func__);
+    sum.fail_at = 500;
+    pipeline_add(pipeline, count_source, &count, 0, 0, 0);
+    pipeline_add(pipeline, square_stage, &square, sizeof(long), 16, 4);
+    pipeline_add(pipeline, sum_sink, &sum, 2 * sizeof(long), 64, 0);
+    ok(pipeline_run(pipeline) == 0, "pipeline_run() fails");
+    number_eq(sum.n_items, 500, "%ld", "the sink stops at the failure");
+    number_eq(sum.n_end, 0, "%d", "a cancelled stage isn't ended");
+
+    count.next = 1;                    /* (run it again, to completion) */
+    count.limit = 1000;
+    sum.fail_at = sum.n_items = sum.last = 0;
+    ok(pipeline_run(pipeline) && sum.n_items == 1000 && sum.n_end == 1,
+       "a cancelled pipeline can be re-run");
+    pipeline_free(pipeline);
+    task_pool_free(pool);
+}
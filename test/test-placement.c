@@ -0,0 +1,157 @@
+/*
+ * TEST-PLACEMENT.C --Unit tests for CPU, NUMA and page placement.
+ *
+ * Contents:
+ * test_topology()  --Test cpu_topology() and cpu_node().
+ * test_pin()       --Test pinning the calling thread.
+ * test_pages()     --Test page_alloc(), page_realloc() and page_free().
+ * test_containers() --Test arenas, slab pools and vectors with a PagePolicy.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/placement.h>
+#include <apex/arena.h>
+#include <apex/pool.h>
+#include <apex/vector.h>
+
+static void test_topology(void);
+static void test_pin(void);
+static void test_pages(void);
+static void test_containers(void);
+
+int main(void)
+{
+    plan_tests(20);
+    test_topology();
+    test_pin();
+    test_pages();
+    test_containers();
+    return exit_status();
+}
+
+/*
+ * test_topology() --Test cpu_topology() and cpu_node().
+ */
+static void test_topology(void)
+{
+    const CpuTopology *topo = cpu_topology();
+
+    diag("%s()", __func__);
+    diag("%d CPUs, %d cores, %d packages, %d nodes", topo->n_cpu,
+         topo->n_core, topo->n_package, topo->n_node);
+    diag("L1d %zu, L2 %zu, L3 %zu, line %zu, huge page %zu",
+         topo->l1d_size, topo->l2_size, topo->l3_size, topo->cache_line,
+         topo->huge_page_size);
+    ok(topo == cpu_topology(), "the topology is read once");
+    ok(topo->n_cpu >= 1 && topo->n_core >= 1 && topo->n_core <= topo->n_cpu
+       && topo->n_package >= 1 && topo->n_node >= 1, "plausible counts");
+    ok(topo->page_size >= 4096 && topo->huge_page_size > topo->page_size
+       && topo->cache_line >= 32, "plausible sizes");
+    ok(cpu_node(0) >= 0 && cpu_node(0) < topo->n_node, "cpu 0 has a node");
+    ok(cpu_node(-1) == -1, "cpu_node() rejects a bad CPU");
+}
+
+/*
+ * test_pin() --Test pinning the calling thread.
+ */
+static void test_pin(void)
+{
+    int cpu = cpu_current();
+
+    diag("%s()", __func__);
+    ok(cpu >= 0 && cpu_pin_thread(cpu) && cpu_current() == cpu,
+       "cpu_pin_thread() keeps the thread on its CPU");
+    ok(node_current() == cpu_node(cpu), "node_current() is the CPU's node");
+    ok(cpu_pin_node(cpu_node(cpu)), "cpu_pin_node() widens to the node");
+    ok(!cpu_pin_thread(-1), "cpu_pin_thread() rejects a bad CPU");
+}
+
+/*
+ * test_pages() --Test page_alloc(), page_realloc() and page_free().
+ */
+static void test_pages(void)
+{
+    const CpuTopology *topo = cpu_topology();
+    size_t huge = topo->huge_page_size;
+    char *mem;
+
+    diag("%s()", __func__);
+    ok(page_round(1, 0) == topo->page_size
+       && page_round(huge + 1, PAGE_HUGE) == 2 * huge,
+       "page_round() rounds to the flags' page size");
+
+    mem = page_alloc(100, 0, PAGE_NODE_LOCAL, 0);
+    ok(mem != NULL && ((uintptr_t) mem & (topo->page_size - 1)) == 0
+       && mem[99] == 0, "page_alloc() maps zeroed local pages");
+    memset(mem, 'x', 100);
+    mem = page_realloc(mem, 100, 10 * topo->page_size, PAGE_NODE_LOCAL, 0);
+    ok(mem != NULL && mem[99] == 'x' && mem[100] == 0,
+       "page_realloc() keeps the contents");
+    page_free(mem, 10 * topo->page_size, 0);
+
+    mem = page_alloc(huge, 0, PAGE_NODE_ANY, PAGE_HUGETLB);
+    ok(mem != NULL && ((uintptr_t) mem & (huge - 1)) == 0,
+       "huge pages are aligned (reserved, or transparent)");
+    memset(mem, 1, huge);
+    page_free(mem, huge, PAGE_HUGETLB);
+
+    mem = page_alloc(4096, 64 * 1024, 0, 0);
+    ok(mem != NULL && ((uintptr_t) mem & (64 * 1024 - 1)) == 0,
+       "page_alloc() honours a bigger alignment");
+    page_free(mem, 4096, 0);
+    ok(page_alloc(4096, 0, topo->n_node, 0) == NULL,
+       "page_alloc() rejects a bad node");
+}
+
+/*
+ * test_containers() --Test arenas, slab pools and vectors with a PagePolicy.
+ */
+static void test_containers(void)
+{
+    PagePolicy policy = { PAGE_MAP, PAGE_NODE_LOCAL };
+    Arena arena;
+    Pool pool;
+    VectorAllocator allocator;
+    long *lv = NULL;
+    void *item;
+    char *a;
+    int status = 1;
+
+    diag("%s()", __func__);
+    arena_init_with(&arena, 1000, &policy);
+    a = arena_alloc(&arena, 100);
+    ok(a != NULL && (size_t) (arena.block->end - (char *) arena.block)
+       == cpu_topology()->page_size, "arena blocks are whole pages");
+    for (int i = 0; i < 100; ++i)
+    {
+        status &= arena_alloc(&arena, 1000) != NULL;
+    }
+    arena_free(&arena);
+    ok(status, "a mapped arena grows, and is freed");
+
+    pool_init_slab_with(&pool, 64, 64 * 1024, &policy);
+    item = pool_new(&pool);
+    ok(item != NULL && ((uintptr_t) item & ~(uintptr_t) (64 * 1024 - 1))
+       == (uintptr_t) pool.chunk, "mapped slab chunks are aligned");
+    pool_free_slab(&pool);
+
+    ok(vector_page_allocator(&allocator, &policy) == &allocator,
+       "vector_page_allocator()");
+    lv = new_vector_with(&allocator, sizeof(*lv), 0, NULL);
+    for (long i = 0; lv != NULL && i < 100000; ++i)
+    {
+        lv = vector_add(lv, 1, &i);
+    }
+    status = lv != NULL;
+    for (long i = 0; status && i < 100000; ++i)
+    {
+        status = lv[i] == i;
+    }
+    ok(status, "page vector: vector_add()");
+    free_vector(lv);
+}
@@ -6,6 +6,8 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include <apex/tap.h>
 #include <apex/test.h>
@@ -13,14 +15,20 @@
 
 static void test_null(void);
 static void test_pool(int n, int prealloc);
+static void test_slab(void);
+static void test_cpool(void);
+static void test_cpool_threads(void);
 
 int main(void)
 {
-    plan_tests(18);
+    plan_tests(29);
     test_null();
     test_pool(1, 0);
     test_pool(10, 0);
     test_pool(10, 5);
+    test_slab();
+    test_cpool();
+    test_cpool_threads();
 
     return exit_status();
 }
@@ -108,3 +116,176 @@ static void test_pool(int n, int prealloc)
     item = pool_new(p);
     ptr_eq(item, NULL, "pool_new() fails on empty pool");
 }
+
+/*
+ * test_slab() --Test a slab pool, that grows (and shrinks) on demand.
+ */
+static void test_slab(void)
+{
+    Pool pool;
+    void *item[1000];
+    int status = 1;
+
+    diag("%s()", __func__);
+    ok(pool_init_slab(&pool, 64, 1000) == NULL,
+       "cannot initialise a slab pool with a non power of 2 chunk");
+    ok(pool_init_slab(&pool, 64, 4096) == &pool,
+       "pool_init_slab() returns first argument");
+    for (size_t i = 0; i < NEL(item); ++i)
+    {
+        item[i] = pool_new(&pool);
+        if (item[i] == NULL || ((uintptr_t) item[i] & 63) != 0)
+        {
+            status = 0;
+        }
+        else
+        {
+            memset(item[i], (int) i, 64);
+        }
+    }
+    ok(status, "slab pool allocates aligned items beyond one chunk");
+    for (size_t i = 0; i < NEL(item); ++i)
+    {
+        pool_delete(&pool, item[i]);
+    }
+    ok(pool_trim(&pool) > 0 && pool.chunk != NULL && pool.chunk->next == NULL,
+       "pool_trim() frees all but the current chunk");
+    item[0] = pool_new(&pool);
+    ok(item[0] != NULL && ((uintptr_t) item[0] & ~(uintptr_t) 4095)
+       == (uintptr_t) pool.chunk, "pool_new() reuses the current chunk");
+    pool_free_slab(&pool);
+}
+
+/*
+ * test_cpool() --Test the concurrent pool (single threaded).
+ */
+static void test_cpool(void)
+{
+    void *storage[100];
+    void *item[NEL(storage)];
+    CPool pool;
+    CPoolCache cache;
+    int status = 1;
+
+    diag("%s()", __func__);
+    ok(init_cpool(&pool, storage) == &pool,
+       "init_cpool() returns first argument");
+    ok(cpool_cache_init(&cache, &pool) == &cache,
+       "cpool_cache_init() returns first argument");
+    for (size_t i = 0; i < NEL(item); ++i)
+    {
+        if ((item[i] = cpool_cache_new(&cache)) == NULL)
+        {
+            status = 0;
+        }
+    }
+    ok(status && cpool_cache_new(&cache) == NULL && cpool_new(&pool) == NULL,
+       "all items allocated, then pool is empty");
+    for (size_t i = 0; i < NEL(item); ++i)
+    {                                  /* (alternate cache and pool frees) */
+        if (i % 2)
+        {
+            cpool_cache_delete(&cache, item[i]);
+        }
+        else
+        {
+            cpool_delete(&pool, item[i]);
+        }
+    }
+    cpool_cache_flush(&cache);
+    for (size_t i = 0; i < NEL(item); ++i)
+    {
+        if (cpool_new(&pool) == NULL)
+        {
+            status = 0;
+        }
+    }
+    ok(status && cpool_new(&pool) == NULL,
+       "deleted items are all returned to the pool");
+}
+
+enum
+{
+    N_THREAD = 4,
+    N_LOOP = 2000,
+    N_HELD = 50                        /* items held per thread at a time */
+};
+
+static CPool shared_pool;
+
+/*
+ * pool_thread() --Thread body: allocate and delete items repeatedly.
+ *
+ * Remarks:
+ * Each item is stamped with the thread's id while it's held; half the
+ * items are freed directly to the pool (as another thread would).
+ */
+static void *pool_thread(void *arg)
+{
+    long id = (long) arg;
+    long *held[N_HELD];
+    CPoolCache cache;
+    long status = 1;
+
+    cpool_cache_init(&cache, &shared_pool);
+    for (int loop = 0; loop < N_LOOP; ++loop)
+    {
+        for (int i = 0; i < N_HELD; ++i)
+        {
+            if ((held[i] = cpool_cache_new(&cache)) == NULL)
+            {
+                status = 0;
+                break;
+            }
+            held[i][1] = id;
+        }
+        for (int i = 0; i < N_HELD && held[i] != NULL; ++i)
+        {
+            if (held[i][1] != id)
+            {
+                status = 0;
+            }
+            if (i % 2)
+            {
+                cpool_delete(&shared_pool, held[i]);
+            }
+            else
+            {
+                cpool_cache_delete(&cache, held[i]);
+            }
+        }
+    }
+    cpool_cache_flush(&cache);
+    return (void *) status;
+}
+
+/*
+ * test_cpool_threads() --Test the concurrent pool with several threads.
+ */
+static void test_cpool_threads(void)
+{
+    static long storage[N_THREAD * (N_HELD + 64 * 2)][2];
+    pthread_t thread[N_THREAD];
+    int status = 1;
+    size_t n = 0;
+
+    diag("%s()", __func__);
+    init_cpool(&shared_pool, storage);
+    for (long i = 0; i < N_THREAD; ++i)
+    {
+        pthread_create(&thread[i], NULL, pool_thread, (void *) i);
+    }
+    for (int i = 0; i < N_THREAD; ++i)
+    {
+        void *result;
+
+        pthread_join(thread[i], &result);
+        status &= result != NULL;
+    }
+    ok(status, "threads never share an item");
+    while (cpool_new(&shared_pool) != NULL)
+    {
+        ++n;
+    }
+    number_eq(n, NEL(storage), "%zu", "no items are lost");
+}
@@ -0,0 +1,181 @@
+/*
+ * PROFILE.C --Unit tests for scoped profiling zones.
+ *
+ * Contents:
+ * zone()           --A function with a profiling zone.
+ * trace_text()     --Return the Chrome trace, as a malloc'd string.
+ * count()          --Count the occurrences of a substring.
+ * test_disabled()  --Zones aren't recorded until profile_start().
+ * test_record()    --Nested zones, and the Chrome trace.
+ * test_threads()   --Each thread has its own (named) ring.
+ * test_overwrite() --A full ring overwrites its oldest zones.
+ * main()           --Tests entrypoint.
+ *
+ * Remarks:
+ * PROFILE_TRACE is defined here, so that this file's own zones are
+ * compiled in whether or not the library's are.
+ */
+#define PROFILE_TRACE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <apex/test.h>
+#include <apex/profile.h>
+
+/*
+ * zone() --A function with a profiling zone.
+ */
+static int zone(int n)
+{
+    PROFILE_FUNCTION();
+    if (n > 0)
+    {
+        PROFILE_ZONE("inner");
+
+        return zone(n - 1) + 1;        /* (both zones close on return) */
+    }
+    return 0;
+}
+
+/*
+ * trace_text() --Return the Chrome trace, as a malloc'd string.
+ */
+static char *trace_text(void)
+{
+    char *text = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&text, &len);
+
+    profile_write_chrome(fp);
+    fclose(fp);
+    return text;
+}
+
+/*
+ * count() --Count the occurrences of a substring.
+ */
+static int count(const char *text, const char *str)
+{
+    int n = 0;
+
+    while ((text = strstr(text, str)) != NULL)
+    {
+        ++n;
+        ++text;
+    }
+    return n;
+}
+
+/*
+ * test_disabled() --Zones aren't recorded until profile_start().
+ */
+static void test_disabled(void)
+{
+    char *text;
+
+    zone(3);
+    text = trace_text();
+    ok(count(text, "\"ph\":\"X\"") == 0, "no zones before profile_start()");
+    free(text);
+}
+
+/*
+ * test_record() --Nested zones, and the Chrome trace.
+ */
+static void test_record(void)
+{
+    char *text, *inner, *outer;
+
+    profile_start(0);
+    profile_thread_name("main \"thread\"");
+    zone(2);
+    profile_stop();
+    zone(2);                           /* (not recorded) */
+    text = trace_text();
+    ok(strncmp(text, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 39) == 0
+       && strstr(text, "\n]}\n") != NULL, "trace is a JSON object");
+    ok(count(text, "\"name\":\"zone\"") == 3
+       && count(text, "\"name\":\"inner\"") == 2,
+       "each zone is recorded once");
+    ok(strstr(text, "\"args\":{\"name\":\"main \\\"thread\\\"\"}") != NULL,
+       "thread name is escaped");
+    inner = strstr(text, "\"name\":\"inner\"");
+    outer = strstr(text, "\"name\":\"zone\"");
+    ok(inner != NULL && outer != NULL && outer < inner,
+       "zones are recorded as they close (innermost first)");
+    ok(profile_dropped() == 0, "nothing dropped");
+    free(text);
+    profile_reset();
+}
+
+/*
+ * thread_main() --Record some zones on a named thread.
+ */
+static void *thread_main(void *data)
+{
+    profile_thread_name((const char *) data);
+    zone(1);
+    return NULL;
+}
+
+/*
+ * test_threads() --Each thread has its own (named) ring.
+ */
+static void test_threads(void)
+{
+    pthread_t thread[2];
+    char *text;
+
+    profile_start(0);
+    pthread_create(&thread[0], NULL, thread_main, "worker-1");
+    pthread_create(&thread[1], NULL, thread_main, "worker-2");
+    pthread_join(thread[0], NULL);
+    pthread_join(thread[1], NULL);
+    text = trace_text();
+    ok(strstr(text, "\"worker-1\"") != NULL
+       && strstr(text, "\"worker-2\"") != NULL,
+       "exited threads' zones are kept");
+    ok(count(text, "\"ph\":\"X\"") == 6, "all the threads' zones");
+    free(text);
+    profile_stop();
+    profile_reset();
+}
+
+/*
+ * test_overwrite() --A full ring overwrites its oldest zones.
+ */
+static void test_overwrite(void)
+{
+    char *text;
+
+    profile_start(5);                  /* (rounded up to 8) */
+    for (int i = 0; i < 10; ++i)
+    {
+        zone(0);
+    }
+    profile_stop();
+    text = trace_text();
+    ok(count(text, "\"ph\":\"X\"") == 8 && profile_dropped() == 2,
+       "ring keeps the newest zones");
+    free(text);
+    profile_reset();
+    text = trace_text();
+    ok(count(text, "\"ph\":\"X\"") == 0, "profile_reset() discards zones");
+    free(text);
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(10);
+
+    test_disabled();
+    test_record();
+    test_threads();
+    test_overwrite();
+
+    return exit_status();
+}
@@ -5,25 +5,54 @@
  * big_endian()  --Test if this program is running on a big-endian machine.
  * test_pack()   --Test the behaviour of pack().
  * test_unpack() --Test the behaviour of unpack().
+ * local_port()  --Get the port number that a socket is bound to.
+ * test_socket() --Test open_listen_opt(), open_connect_timeout() on a family.
+ * test_vector() --Test fdwritev(), fdreadv() with more than FDIO_MAX_IOV buffers.
+ * test_batch()  --Test fdsend_batch(), fdrecv_batch().
+ * test_sendfile() --Test fdsendfile() from a file, and from a pipe.
+ * test_pack_n()  --Test compiled pack formats on structs with strings.
+ * test_pack_bulk() --Test the bulk (byte-swapped array) path of pack_n().
  *
  */
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
-
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <apex.h>
 #include <apex/tap.h>
 #include <apex/protocol.h>
 
 static int big_endian(void);
 static void test_pack(void);
 static void test_unpack(void);
+static void test_socket(const char *host, int domain);
+static void test_vector(void);
+static void test_batch(void);
+static void test_sendfile(void);
+static void test_pack_n(void);
+static void test_pack_bulk(void);
 
 int main(void)
 {
-    plan_tests(32);
+    plan_tests(71);
 
     test_pack();
     test_unpack();
+    test_socket("127.0.0.1", PF_INET);
+    test_socket("[::1]", PF_INET6);
+    test_vector();
+    test_batch();
+    test_sendfile();
+    test_pack_n();
+    test_pack_bulk();
 
     return exit_status();
 }
@@ -196,3 +225,324 @@ static void test_unpack(void)
     n = unpack('Z', (uint8_t *) "hello", buf);
     ok(n == 6 && strcmp((char *) buf, "hello") == 0, "unpack(Z): string");
 }
+
+/*
+ * local_port() --Get the port number that a socket is bound to.
+ */
+static int local_port(int sfd)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+
+    if (getsockname(sfd, (struct sockaddr *) &addr, &len) < 0)
+    {
+        return -1;
+    }
+    if (addr.ss_family == AF_INET6)
+    {
+        return ntohs(((struct sockaddr_in6 *) &addr)->sin6_port);
+    }
+    return ntohs(((struct sockaddr_in *) &addr)->sin_port);
+}
+
+/*
+ * test_socket() --Test open_listen_opt(), open_connect_timeout() on a family.
+ * test_vector() --Test fdwritev(), fdreadv() with more than FDIO_MAX_IOV buffers.
+ * test_batch()  --Test fdsend_batch(), fdrecv_batch().
+ * test_sendfile() --Test fdsendfile() from a file, and from a pipe.
+ * test_pack_n()  --Test compiled pack formats on structs with strings.
+ * test_pack_bulk() --Test the bulk (byte-swapped array) path of pack_n().
+ */
+static void test_socket(const char *host, int domain)
+{
+    char address[100];
+    int listen_fd, other_fd, fd, client_fd, port;
+
+    snprintf(address, sizeof(address), "%s:0", host);
+    listen_fd = open_listen_opt(address, domain, SOCK_STREAM, 8,
+                                LISTEN_REUSEADDR | LISTEN_REUSEPORT);
+    skip_start(listen_fd < 0, 6, "%s: can't listen (%s)",
+               host, strerror(errno));
+    {
+        port = local_port(listen_fd);
+        ok(port > 0, "%s: listen on an ephemeral port", host);
+
+        snprintf(address, sizeof(address), "%s:%d", host, port);
+        other_fd = open_listen_opt(address, domain, SOCK_STREAM, 8,
+                                   LISTEN_REUSEADDR | LISTEN_REUSEPORT);
+        ok(other_fd >= 0, "%s: LISTEN_REUSEPORT shares the port", host);
+
+        client_fd = open_connect_timeout(address, PF_UNSPEC,
+                                         SOCK_STREAM, 1000);
+        ok(client_fd >= 0, "%s: connect (PF_UNSPEC)", host);
+        ok(fdwrite(client_fd, "hello", 5) == 5,
+           "%s: connected socket is writable", host);
+        close(client_fd);
+
+        client_fd = open_connect(address, domain, SOCK_STREAM);
+        ok(client_fd >= 0, "%s: connect (blocking)", host);
+        close(client_fd);
+        close(other_fd);
+        close(listen_fd);
+
+        fd = open_connect_timeout(address, domain, SOCK_STREAM, 1000);
+        ok(fd < 0 && errno == ECONNREFUSED,
+           "%s: connect to a closed port fails", host);
+    }
+    skip_end;
+}
+
+/*
+ * test_vector() --Test fdwritev(), fdreadv() with more than FDIO_MAX_IOV buffers.
+ */
+static void test_vector(void)
+{
+    char out[100][10], in[1000];
+    struct iovec out_iov[101], in_iov[3];
+    char expected[1000];
+    int sv[2];
+
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    for (int i = 0; i < 100; ++i)
+    {
+        memset(out[i], 'a' + i % 26, sizeof(out[i]));
+        memcpy(expected + i * 10, out[i], 10);
+        out_iov[i].iov_base = out[i];
+        out_iov[i].iov_len = sizeof(out[i]);
+    }
+    out_iov[100].iov_base = NULL;      /* (empty buffers are skipped) */
+    out_iov[100].iov_len = 0;
+    ok(fdwritev(sv[0], out_iov, 101) == 1000, "fdwritev: 101 buffers");
+
+    in_iov[0].iov_base = in;
+    in_iov[0].iov_len = 7;
+    in_iov[1].iov_base = in + 7;
+    in_iov[1].iov_len = 500;
+    in_iov[2].iov_base = in + 507;
+    in_iov[2].iov_len = 493;
+    ok(fdreadv(sv[1], in_iov, 3) == 1000, "fdreadv: 3 buffers");
+    ok(memcmp(in, expected, sizeof(in)) == 0, "fdreadv: values");
+    close(sv[0]);
+    ok(fdreadv(sv[1], in_iov, 3) == 0, "fdreadv: EOF");
+    close(sv[1]);
+}
+
+/*
+ * test_batch() --Test fdsend_batch(), fdrecv_batch().
+ */
+static void test_batch(void)
+{
+    uint32_t out[100], in[100];
+    struct iovec out_iov[100], in_iov[100];
+    int sv[2], n, n_ok = 0;
+
+    socketpair(AF_UNIX, SOCK_DGRAM, 0, sv);
+    for (int i = 0; i < 100; ++i)
+    {
+        out[i] = (uint32_t) i * 7;
+        out_iov[i].iov_base = &out[i];
+        out_iov[i].iov_len = (size_t) (i % 4 + 1);
+        in_iov[i].iov_base = &in[i];
+        in_iov[i].iov_len = sizeof(in[i]);
+        in[i] = 0;
+    }
+    ok(fdsend_batch(sv[0], out_iov, 100) == 100, "fdsend_batch: 100 datagrams");
+    n = (int) fdrecv_batch(sv[1], in_iov, NULL, 100, 0);
+    ok(n == 100, "fdrecv_batch: %d datagrams", n);
+    for (int i = 0; i < n; ++i)
+    {
+        n_ok += (in_iov[i].iov_len == (size_t) (i % 4 + 1)
+                 && memcmp(&in[i], &out[i], in_iov[i].iov_len) == 0);
+    }
+    ok(n_ok == 100, "fdrecv_batch: lengths and values");
+    close(sv[0]);
+    close(sv[1]);
+}
+
+/*
+ * test_sendfile() --Test fdsendfile() from a file, and from a pipe.
+ * test_pack_n()  --Test compiled pack formats on structs with strings.
+ * test_pack_bulk() --Test the bulk (byte-swapped array) path of pack_n().
+ */
+static void test_sendfile(void)
+{
+    char in_path[50], out_path[50];
+    size_t size = 200000;
+    char *data = malloc(size), *copy = malloc(size);
+    int in_fd, out_fd, pfd[2];
+    off_t offset = 1000;
+
+    sprintf(in_path, "sendfile-in-%d.tmp", getpid());
+    sprintf(out_path, "sendfile-out-%d.tmp", getpid());
+    for (size_t i = 0; i < size; ++i)
+    {
+        data[i] = (char) (i * 31 + i / 256);
+    }
+    in_fd = open(in_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    out_fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    fdwrite(in_fd, data, size);
+    lseek(in_fd, 0, SEEK_SET);
+
+    ok(fdsendfile(out_fd, in_fd, &offset, 5000) == 5000
+       && offset == 6000 && lseek(in_fd, 0, SEEK_CUR) == 0,
+       "fdsendfile: offset is updated, file position isn't");
+    ok(fdsendfile(out_fd, in_fd, NULL, size) == (ssize_t) size
+       && lseek(in_fd, 0, SEEK_CUR) == (off_t) size,
+       "fdsendfile: whole file, from the file position");
+    ok(fdsendfile(out_fd, in_fd, NULL, 100) == 0, "fdsendfile: EOF");
+    ok(pread(out_fd, copy, 5000, 0) == 5000
+       && memcmp(copy, data + 1000, 5000) == 0
+       && pread(out_fd, copy, size, 5000) == (ssize_t) size
+       && memcmp(copy, data, size) == 0, "fdsendfile: values");
+
+    (void) !pipe(pfd);
+    fdwrite(pfd[1], "hello, pipe", 11);
+    close(pfd[1]);
+    (void) !ftruncate(out_fd, 0);
+    lseek(out_fd, 0, SEEK_SET);
+    ok(fdsendfile(out_fd, pfd[0], NULL, 100) == 11
+       && pread(out_fd, copy, 100, 0) == 11
+       && memcmp(copy, "hello, pipe", 11) == 0,
+       "fdsendfile: pipe input (buffered copy)");
+    close(pfd[0]);
+
+    close(in_fd);
+    close(out_fd);
+    unlink(in_path);
+    unlink(out_path);
+    free(data);
+    free(copy);
+}
+
+/*
+ * test_pack_n() --Test compiled pack formats on structs with strings.
+ */
+static void test_pack_n(void)
+{
+    struct Record
+    {
+        uint16_t id;
+        uint32_t addr[2];
+        char name[16];
+        uint8_t flag;
+    } rec[3] = {
+        {1, {0x01020304, 0x0a0b0c0d}, "one", 'x'},
+        {2, {5, 6}, "", 'y'},
+        {0xbeef, {0xdeadc0de, 7}, "fifteen chars..", 'z'}
+    }, copy[3];
+    PackFormatPtr format = pack_format("nN2Z16C");
+    uint8_t buf[200], expected[200], *ptr = expected;
+    size_t n;
+    int n_same = 0;
+
+    ok(pack_format("Q") == NULL && pack_format("Z") == NULL
+       && pack_format("N0") == NULL, "pack_format: invalid formats");
+    ok(format != NULL && pack_format_size(format) == sizeof(struct Record),
+       "pack_format: struct size %zu", pack_format_size(format));
+    for (size_t i = 0; i < NEL(rec); ++i)
+    {
+        ptr += pack('n', ptr, &rec[i].id);
+        ptr += pack('N', ptr, &rec[i].addr[0]);
+        ptr += pack('N', ptr, &rec[i].addr[1]);
+        ptr += pack('Z', ptr, rec[i].name);
+        ptr += pack('C', ptr, &rec[i].flag);
+    }
+    n = pack_n(format, buf, sizeof(buf), rec, NEL(rec));
+    ok(n == (size_t) (ptr - expected), "pack_n: size %zu", n);
+    ok(memcmp(buf, expected, n) == 0, "pack_n: same bytes as pack()");
+    ok(pack_n(format, buf, n - 1, rec, NEL(rec)) == 0,
+       "pack_n: buffer too small");
+
+    memset(copy, 0, sizeof(copy));
+    ok(unpack_n(format, buf, n, copy, NEL(copy)) == n,
+       "unpack_n: size");
+    for (size_t i = 0; i < NEL(rec); ++i)
+    {
+        n_same += (copy[i].id == rec[i].id
+                   && copy[i].addr[0] == rec[i].addr[0]
+                   && copy[i].addr[1] == rec[i].addr[1]
+                   && strcmp(copy[i].name, rec[i].name) == 0
+                   && copy[i].flag == rec[i].flag);
+    }
+    ok(n_same == NEL(rec), "unpack_n: values");
+    ok(unpack_n(format, buf, n - 1, copy, NEL(copy)) == 0,
+       "unpack_n: buffer too short");
+
+    memset(rec[0].name, 'a', sizeof(rec[0].name));
+    ok(pack_n(format, buf, sizeof(buf), rec, 1) == 0,
+       "pack_n: unterminated string");
+    pack_format_free(format);
+
+    format = pack_format("Z4");
+    ok(unpack_n(format, (const uint8_t *) "hello", 6, copy, 1) == 0,
+       "unpack_n: string too long for its field");
+    pack_format_free(format);
+}
+
+/*
+ * test_pack_bulk() --Test the bulk (byte-swapped array) path of pack_n().
+ */
+static void test_pack_bulk(void)
+{
+    enum
+    { N_ITEM = 10001 };
+    struct Sample
+    {
+        uint32_t t, value;
+    } *sample = malloc(N_ITEM * sizeof(*sample)),
+        *copy = malloc(N_ITEM * sizeof(*sample));
+    uint8_t *buf = malloc(N_ITEM * sizeof(*sample));
+    uint8_t *expected = malloc(N_ITEM * sizeof(*sample));
+    PackFormatPtr format = pack_format("NN");
+    PackFormatPtr plain = pack_format("LL");
+    uint16_t shorts[7] = { 1, 2, 3, 0x1234, 5, 6, 0xabcd }, short_copy[7];
+    PackFormatPtr short_format = pack_format("n7");
+    clock_t t0, t1, t2;
+    uint8_t *ptr;
+
+    for (int i = 0; i < N_ITEM; ++i)
+    {
+        sample[i].t = (uint32_t) i * 1000003u;
+        sample[i].value = (uint32_t) i ^ 0xa5a5a5a5u;
+    }
+    t0 = clock();
+    ptr = expected;
+    for (int i = 0; i < N_ITEM; ++i)
+    {
+        ptr += pack('N', ptr, &sample[i].t);
+        ptr += pack('N', ptr, &sample[i].value);
+    }
+    t1 = clock();
+    ok(pack_n(format, buf, N_ITEM * sizeof(*sample), sample, N_ITEM)
+       == N_ITEM * sizeof(*sample), "pack_n(NN): size");
+    t2 = clock();
+    ok(memcmp(buf, expected, N_ITEM * sizeof(*sample)) == 0,
+       "pack_n(NN): same bytes as pack()");
+    diag("%d items: pack() %.3fms, pack_n() %.3fms", N_ITEM,
+         (double) (t1 - t0) * 1000 / CLOCKS_PER_SEC,
+         (double) (t2 - t1) * 1000 / CLOCKS_PER_SEC);
+    ok(unpack_n(format, buf, N_ITEM * sizeof(*sample), copy, N_ITEM)
+       == N_ITEM * sizeof(*sample)
+       && memcmp(copy, sample, N_ITEM * sizeof(*sample)) == 0,
+       "unpack_n(NN): values");
+
+    ok(pack_n(plain, buf, N_ITEM * sizeof(*sample), sample, N_ITEM)
+       == N_ITEM * sizeof(*sample)
+       && memcmp(buf, sample, N_ITEM * sizeof(*sample)) == 0,
+       "pack_n(LL): native copy");
+
+    ok(pack_n(short_format, buf, sizeof(shorts), shorts, 1) == sizeof(shorts)
+       && buf[6] == 0x12 && buf[7] == 0x34 && buf[12] == 0xab
+       && unpack_n(short_format, buf, sizeof(shorts), short_copy, 1)
+       == sizeof(shorts)
+       && memcmp(short_copy, shorts, sizeof(shorts)) == 0,
+       "pack_n(n7): odd-sized array of shorts");
+
+    pack_format_free(format);
+    pack_format_free(plain);
+    pack_format_free(short_format);
+    free(sample);
+    free(copy);
+    free(buf);
+    free(expected);
+}
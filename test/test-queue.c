@@ -6,22 +6,44 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <apex/tap.h>
 #include <apex/test.h>
 #include <apex/queue.h>
+#include <apex/queue-typed.h>
+#include <apex/systools.h>
+
+QUEUE_DEFINE(IntQueue, int, 8)
 
 static void test_null(void);
 static void test_mask(void);
 static void test_int(int n);
+static void test_bulk(void);
+static void test_in_place(void);
+static void test_grow(void);
+static void test_stats(void);
+static void test_spsc(void);
+static void test_mpmc(void);
+static void test_wait(void);
+static void test_typed(void);
 
 int main(void)
 {
-    plan_tests(28);
+    plan_tests(69);
     test_mask();
     test_null();
     test_int(1);
     test_int(8);
+    test_bulk();
+    test_in_place();
+    test_grow();
+    test_stats();
+    test_spsc();
+    test_mpmc();
+    test_wait();
+    test_typed();
 
     return exit_status();
 }
@@ -145,3 +167,378 @@ static void test_int(int n)
     }
     ok(status, "queue_pop() returns correct items");
 }
+
+/*
+ * test_bulk() --Test queue_push_n() and queue_pop_n(), including wrap-around.
+ */
+static void test_bulk(void)
+{
+    int storage[8];
+    int in[12], out[12];
+    AtomicQueue queue;
+    int status = 1;
+
+    diag("%s()", __func__);
+    for (int i = 0; i < (int) NEL(in); ++i)
+    {
+        in[i] = i;
+    }
+    init_queue(&queue, storage);
+    number_eq(queue_pop_n(&queue, out, NEL(out)), 0, "%zu",
+              "queue_pop_n() underflow: returns 0");
+    number_eq(queue_push_n(&queue, in, 5), 5, "%zu",
+              "queue_push_n() pushes all items that fit");
+    number_eq(queue_pop_n(&queue, out, 3), 3, "%zu",
+              "queue_pop_n() pops no more than requested");
+    number_eq(queue_push_n(&queue, in + 5, NEL(in) - 5), 6, "%zu",
+              "queue_push_n() (wrapping) pushes only what fits");
+    number_eq(queue_push_n(&queue, in, 1), 0, "%zu",
+              "queue_push_n() overflow: returns 0");
+    number_eq(queue_pop_n(&queue, out + 3, NEL(out)), 8, "%zu",
+              "queue_pop_n() (wrapping) pops all items");
+    for (int i = 0; i < 11; ++i)
+    {
+        if (out[i] != i)
+        {
+            status = 0;
+        }
+    }
+    ok(status, "queue_pop_n() returns items in order");
+}
+
+/*
+ * test_in_place() --Test the zero-copy reserve/commit, acquire/release API.
+ */
+static void test_in_place(void)
+{
+    int storage[2];
+    AtomicQueue queue;
+    int *slot;
+
+    diag("%s()", __func__);
+    init_queue(&queue, storage);
+    ok(queue_acquire(&queue) == NULL,
+       "queue_acquire() underflow: returns NULL");
+    slot = queue_reserve(&queue);
+    ok(slot == &storage[0], "queue_reserve() returns address from storage");
+    *slot = 42;
+    ok(queue_acquire(&queue) == NULL,
+       "reserved item is not visible before queue_commit()");
+    queue_commit(&queue);
+    *((int *) queue_reserve(&queue)) = 43;
+    queue_commit(&queue);
+    ok(queue_reserve(&queue) == NULL,
+       "queue_reserve() overflow: returns NULL");
+    ok(queue_commit(&queue) == 0,
+       "queue_commit() without a reservation: returns failure");
+    slot = queue_acquire(&queue);
+    ok(slot != NULL && *slot == 42,
+       "queue_acquire() returns the item in place");
+    ok(queue_release(&queue) && queue_release(&queue),
+       "queue_release() removes items");
+    ok(queue_release(&queue) == 0,
+       "queue_release() underflow: returns failure");
+}
+
+/*
+ * test_grow() --Test the unbounded (segmented) queue.
+ */
+static void test_grow(void)
+{
+    GrowQueue queue;
+    int item = 0;
+    int status = 1;
+
+    diag("%s()", __func__);
+    ok(grow_queue_init(&queue, 3, sizeof(int)) == NULL,
+       "grow_queue_init() fails with invalid size");
+    ok(grow_queue_init(&queue, 2, sizeof(int)) == &queue,
+       "grow_queue_init() returns first argument");
+    ok(grow_queue_pop(&queue, &item) == 0,
+       "grow_queue_pop() underflow: returns failure");
+    for (int i = 0; i < 100; ++i)
+    {
+        status &= grow_queue_push(&queue, &i);
+    }
+    ok(status, "grow_queue_push() never overflows");
+    number_eq(queue.n_segment, 6, "%d", "segments double in size");
+    for (int i = 0; i < 100; ++i)
+    {
+        if (!grow_queue_pop(&queue, &item) || item != i)
+        {
+            status = 0;
+        }
+    }
+    ok(status && queue.head == queue.tail
+       && grow_queue_pop(&queue, &item) == 0,
+       "grow_queue_pop() returns items in order, and frees segments");
+    grow_queue_free(&queue);
+}
+
+/*
+ * test_stats() --Test the queue's instrumentation and statistics.
+ */
+static void test_stats(void)
+{
+    int storage[4], out[4];
+    uint64_t stamp[NEL(storage)];
+    AtomicQueue queue;
+    QueueInstrument instrument;
+    QueueStats stats;
+    uint64_t n_latency = 0;
+
+    diag("%s()", __func__);
+    init_queue(&queue, storage);
+    ok(queue_instrument(&queue, &instrument, stamp),
+       "queue_instrument() succeeds");
+    for (int i = 0; i < 5; ++i)
+    {
+        queue_push(&queue, &i);        /* (the last push fails) */
+    }
+    queue_pop_n(&queue, out, 3);
+    queue_push(&queue, out);
+    queue_stats(&queue, &stats);
+    ok(stats.n_write == 5 && stats.n_read == 3 && stats.depth == 2,
+       "queue_stats() reports counters and depth");
+    ok(stats.peak == 4, "queue_stats() reports peak depth");
+    ok(stats.n_fail == 1 && stats.fail_rate == 1.0 / 6,
+       "queue_stats() reports failure rate");
+    for (int i = 0; i < QUEUE_N_LATENCY; ++i)
+    {
+        n_latency += stats.latency[i];
+    }
+    number_eq(n_latency, 3, "%llu", "latency histogram counts each read");
+}
+
+enum
+{
+    N_PRODUCER = 4,
+    N_ITEM = 100000                    /* items per producer */
+};
+
+static AtomicQueue spsc;
+static MPMCQueue mpmc;
+static long n_consumed;                /* (consumer totals) */
+static long sum_consumed;
+
+/*
+ * spsc_producer() --Thread body: push 0..N_ITEM-1 onto the SPSC queue.
+ */
+static void *spsc_producer(void *UNUSED(arg))
+{
+    for (long i = 0; i < N_ITEM;)
+    {
+        if (queue_push(&spsc, &i))
+        {
+            ++i;
+        }
+        else
+        {
+            sched_yield();             /* (queue full) */
+        }
+    }
+    return NULL;
+}
+
+/*
+ * test_spsc() --Test the AtomicQueue with a producer and consumer thread.
+ */
+static void test_spsc(void)
+{
+    long storage[64];
+    pthread_t producer;
+    int status = 1;
+
+    diag("%s()", __func__);
+    init_queue(&spsc, storage);
+    pthread_create(&producer, NULL, spsc_producer, NULL);
+    for (long expected = 0; expected < N_ITEM;)
+    {
+        long item;
+
+        if (queue_pop(&spsc, &item))
+        {
+            if (item != expected)
+            {
+                status = 0;
+            }
+            ++expected;
+        }
+        else
+        {
+            sched_yield();             /* (queue empty) */
+        }
+    }
+    pthread_join(producer, NULL);
+    ok(status, "SPSC: consumer sees items in order");
+    ok(queue_peek(&spsc, NULL) == NULL, "SPSC: queue is drained");
+}
+
+/*
+ * mpmc_producer() --Thread body: push N_ITEM items onto the MPMC queue.
+ */
+static void *mpmc_producer(void *arg)
+{
+    long base = (long) arg * N_ITEM;
+
+    for (long i = 0; i < N_ITEM;)
+    {
+        long item = base + i;
+
+        if (mpmc_queue_push(&mpmc, &item))
+        {
+            ++i;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/*
+ * mpmc_consumer() --Thread body: pop N_ITEM items from the MPMC queue.
+ */
+static void *mpmc_consumer(void *UNUSED(arg))
+{
+    long n = 0, sum = 0;
+
+    while (n < N_ITEM)
+    {
+        long item;
+
+        if (mpmc_queue_pop(&mpmc, &item))
+        {
+            sum += item;
+            ++n;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    ATOMIC_ADD(&n_consumed, n);
+    ATOMIC_ADD(&sum_consumed, sum);
+    return NULL;
+}
+
+/*
+ * test_mpmc() --Test the MPMCQueue with several producers and consumers.
+ */
+static void test_mpmc(void)
+{
+    long storage[64];
+    unsigned int seq[NEL(storage)];
+    pthread_t producer[N_PRODUCER], consumer[N_PRODUCER];
+    long item = 0;
+    long n = (long) N_PRODUCER * N_ITEM;
+
+    diag("%s()", __func__);
+    ok(init_mpmc_queue(&mpmc, storage, seq) == &mpmc,
+       "init_mpmc_queue() returns first argument");
+    ok(mpmc_queue_pop(&mpmc, &item) == 0, "MPMC: pop from empty queue fails");
+    for (long i = 0; i < N_PRODUCER; ++i)
+    {
+        pthread_create(&producer[i], NULL, mpmc_producer, (void *) i);
+        pthread_create(&consumer[i], NULL, mpmc_consumer, NULL);
+    }
+    for (int i = 0; i < N_PRODUCER; ++i)
+    {
+        pthread_join(producer[i], NULL);
+        pthread_join(consumer[i], NULL);
+    }
+    ok(n_consumed == n && sum_consumed == n * (n - 1) / 2,
+       "MPMC: every item consumed exactly once");
+}
+
+static AtomicQueue wait_queue;
+
+/*
+ * wait_producer() --Thread body: push 0..N_ITEM-1, blocking when full.
+ */
+static void *wait_producer(void *UNUSED(arg))
+{
+    for (long i = 0; i < N_ITEM; ++i)
+    {
+        queue_push_wait(&wait_queue, &i, NULL);
+    }
+    return NULL;
+}
+
+/*
+ * test_wait() --Test the blocking push/pop, and the eventfd.
+ */
+static void test_wait(void)
+{
+    long storage[4];
+    long item = 0;
+    TimeValue timeout = { 0, 10000 };
+    pthread_t producer;
+    int status = 1;
+    int fd;
+    fd_set input, err;
+
+    diag("%s()", __func__);
+    init_queue(&wait_queue, storage);
+    ok(queue_pop_wait(&wait_queue, &item, &timeout) == 0,
+       "queue_pop_wait() fails if blocking isn't enabled");
+    ok(queue_wait_init(&wait_queue, 1), "queue_wait_init() succeeds");
+    ok(queue_pop_wait(&wait_queue, &item, &timeout) == 0,
+       "queue_pop_wait() times out on an empty queue");
+
+    pthread_create(&producer, NULL, wait_producer, NULL);
+    for (long expected = 0; expected < N_ITEM; ++expected)
+    {
+        if (!queue_pop_wait(&wait_queue, &item, NULL) || item != expected)
+        {
+            status = 0;
+        }
+    }
+    pthread_join(producer, NULL);
+    ok(status, "queue_pop_wait()/queue_push_wait() transfer items in order");
+
+    fd = queue_wait_fd(&wait_queue);
+    timeout.tv_usec = 10000;
+    ok(wait_input(&input, &err, &timeout, 1, &fd) == 0,
+       "queue_wait_fd() is not readable while the queue is empty");
+    queue_push(&wait_queue, &item);
+    timeout.tv_usec = 10000;
+    ok(wait_input(&input, &err, &timeout, 1, &fd) == 1
+       && FD_ISSET(fd, &input),
+       "queue_wait_fd() is readable after a push");
+    queue_wait_free(&wait_queue);
+}
+
+/*
+ * test_typed() --Test a queue defined with QUEUE_DEFINE().
+ */
+static void test_typed(void)
+{
+    static IntQueue queue;
+    int item = -1;
+    int status = 1;
+
+    diag("%s()", __func__);
+    ok(IntQueue_init(&queue) == &queue && IntQueue_peek(&queue) == NULL
+       && IntQueue_pop(&queue, &item) == 0, "IntQueue_init() is empty");
+    for (int round = 0; round < 3; ++round)
+    {                                  /* (wraps around) */
+        for (int i = 0; i < 8; ++i)
+        {
+            status &= IntQueue_push(&queue, &i);
+        }
+        status &= !IntQueue_push(&queue, &item) && IntQueue_len(&queue) == 8;
+        for (int i = 0; i < 8; ++i)
+        {
+            status &= IntQueue_pop(&queue, &item) && item == i;
+        }
+    }
+    ok(status, "IntQueue_push(), IntQueue_pop() fill and drain");
+    number_eq(queue.n_fail, 3, "%d", "failed pushes are counted");
+
+    item = 42;
+    IntQueue_push(&queue, &item);
+    ok(*IntQueue_peek(&queue) == 42 && IntQueue_len(&queue) == 1,
+       "IntQueue_peek() doesn't consume");
+}
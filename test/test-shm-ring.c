@@ -0,0 +1,181 @@
+/*
+ * TEST-SHM-RING.C --Unit tests for the shared-memory ring.
+ *
+ * Contents:
+ * test_basic()   --Test push/pop, full/empty, and bad sizes.
+ * test_named()   --Test a named ring, opened twice.
+ * test_send()    --Test passing a ring over a Unix socket, and its eventfd.
+ * test_process() --Test a producer process and a consumer process.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/shm-ring.h>
+
+#define N_RECORD 200000
+
+typedef struct Record_t
+{
+    uint64_t seq;
+    char payload[52];
+} Record;
+
+static void test_basic(void);
+static void test_named(void);
+static void test_send(void);
+static void test_process(void);
+
+int main(void)
+{
+    plan_tests(20);
+    test_basic();
+    test_named();
+    test_send();
+    test_process();
+    return exit_status();
+}
+
+/*
+ * test_basic() --Test push/pop, full/empty, and bad sizes.
+ */
+static void test_basic(void)
+{
+    ShmRing ring;
+    Record record = { 0 };
+    TimeValue timeout = { 0, 10000 };
+    int status = 1;
+
+    diag("%s()", __func__);
+    ok(!shm_ring_create(&ring, NULL, 3, sizeof(Record), 0),
+       "shm_ring_create() fails for a non power of 2");
+    ok(shm_ring_create(&ring, NULL, 4, 5, 0) && ring.item_size == 8,
+       "slots are rounded up to 8 bytes");
+    shm_ring_close(&ring);
+    ok(shm_ring_create(&ring, NULL, 4, sizeof(Record), 0),
+       "shm_ring_create() (anonymous)");
+    for (int i = 0; i < 4; ++i)
+    {
+        record.seq = (uint64_t) i;
+        status &= shm_ring_push(&ring, &record);
+    }
+    ok(status && shm_ring_depth(&ring) == 4, "push until full");
+    ok(!shm_ring_push(&ring, &record) && ring.header->n_fail == 1,
+       "push fails when full, and is counted");
+    ok(!shm_ring_commit(&ring) && shm_ring_depth(&ring) == 4,
+       "commit fails without a reservation");
+    for (int i = 0; i < 4; ++i)
+    {
+        status &= shm_ring_pop(&ring, &record) && record.seq == (uint64_t) i;
+    }
+    ok(status, "pop in order");
+    ok(!shm_ring_pop(&ring, &record) && !shm_ring_release(&ring),
+       "pop/release fail when empty");
+    ok(shm_ring_acquire_wait(&ring, &timeout) == NULL,
+       "shm_ring_acquire_wait() times out");
+    shm_ring_close(&ring);
+}
+
+/*
+ * test_named() --Test a named ring, opened twice.
+ */
+static void test_named(void)
+{
+    char name[64];
+    ShmRing producer, consumer;
+    Record record = { 42, "hello" };
+    Record *in;
+
+    diag("%s()", __func__);
+    snprintf(name, sizeof(name), "/apex-test-%ld", (long) getpid());
+    ok(shm_ring_create(&producer, name, 16, sizeof(Record), 0),
+       "shm_ring_create(\"%s\")", name);
+    ok(!shm_ring_create(&consumer, name, 16, sizeof(Record), 0),
+       "shm_ring_create() fails if the name exists");
+    ok(shm_ring_open(&consumer, name)
+       && consumer.header != producer.header, "shm_ring_open()");
+    memcpy(shm_ring_reserve(&producer), &record, sizeof(record));
+    shm_ring_commit(&producer);
+    in = shm_ring_acquire(&consumer);
+    ok(in != NULL && in->seq == 42 && strcmp(in->payload, "hello") == 0
+       && shm_ring_release(&consumer), "records are shared, in place");
+    ok(shm_ring_unlink(name), "shm_ring_unlink()");
+    shm_ring_close(&consumer);
+    ok(!shm_ring_open(&consumer, name), "an unlinked ring can't be opened");
+    shm_ring_close(&producer);
+}
+
+/*
+ * test_send() --Test passing a ring over a Unix socket, and its eventfd.
+ */
+static void test_send(void)
+{
+    int sock[2];
+    ShmRing ring, remote;
+    Record record = { 7, "" };
+    struct pollfd pfd;
+
+    diag("%s()", __func__);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sock);
+    shm_ring_create(&ring, NULL, 8, sizeof(Record), SHM_RING_EVENT);
+    ok(shm_ring_send(sock[0], &ring) && shm_ring_receive(&remote, sock[1])
+       && remote.event_fd >= 0 && remote.mask == 7,
+       "shm_ring_send()/shm_ring_receive()");
+
+    pfd.fd = shm_ring_wait_fd(&remote);
+    pfd.events = POLLIN;
+    ok(pfd.fd >= 0 && poll(&pfd, 1, 0) == 0, "the eventfd is quiet");
+    shm_ring_push(&ring, &record);
+    ok(poll(&pfd, 1, 1000) == 1 && shm_ring_pop(&remote, &record)
+       && record.seq == 7, "a push signals the consumer's eventfd");
+    shm_ring_close(&remote);
+    shm_ring_close(&ring);
+    close(sock[0]);
+    close(sock[1]);
+}
+
+/*
+ * test_process() --Test a producer process and a consumer process.
+ */
+static void test_process(void)
+{
+    ShmRing ring;
+    pid_t pid;
+    int status = 1, child_status;
+
+    diag("%s()", __func__);
+    shm_ring_create(&ring, NULL, 256, sizeof(Record), 0);
+    if ((pid = fork()) == 0)
+    {                                  /* producer */
+        for (uint64_t i = 0; i < N_RECORD; ++i)
+        {
+            Record *out = shm_ring_reserve_wait(&ring, NULL);
+
+            out->seq = i;
+            out->payload[0] = (char) i;
+            shm_ring_commit(&ring);
+        }
+        _exit(0);
+    }
+    for (uint64_t i = 0; i < N_RECORD; ++i)
+    {                                  /* consumer */
+        Record *in = shm_ring_acquire_wait(&ring, NULL);
+
+        if (in->seq != i || in->payload[0] != (char) i)
+        {
+            status = 0;
+        }
+        shm_ring_release(&ring);
+    }
+    ok(waitpid(pid, &child_status, 0) == pid && WIFEXITED(child_status)
+       && WEXITSTATUS(child_status) == 0, "the producer finished");
+    ok(status, "%d records passed between processes, in order", N_RECORD);
+    shm_ring_close(&ring);
+}
@@ -0,0 +1,181 @@
+/*
+ * TEST-SORT.C --Unit tests for the parallel and radix sorts.
+ *
+ * Contents:
+ * test_parallel() --Test parallel_sort() against qsort().
+ * test_radix()    --Test the radix sorts against qsort().
+ * bench_sort()    --Compare qsort(), parallel_sort() and radix sort.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/sort.h>
+
+typedef struct Record_t
+{
+    int key;
+    char data[20];
+} Record;
+
+static void test_parallel(void);
+static void test_radix(void);
+static void bench_sort(void);
+
+int main(void)
+{
+    plan_tests(8);
+    test_parallel();
+    test_radix();
+    bench_sort();
+    return exit_status();
+}
+
+/*
+ * random_value() --Return a pseudo-random value (xorshift).
+ */
+static uint64_t random_value(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/*
+ * record_cmp() --Compare records by key.
+ */
+static int record_cmp(const void *v_1, const void *v_2)
+{
+    return int_cmp(&((const Record *) v_1)->key,
+                   &((const Record *) v_2)->key);
+}
+
+/*
+ * test_parallel() --Test parallel_sort() against qsort().
+ */
+static void test_parallel(void)
+{
+    size_t n = 200001;
+    Record *rec = malloc(n * sizeof(*rec));
+    int *a = malloc(n * sizeof(*a)), *b = malloc(n * sizeof(*b));
+    uint64_t seed = 1;
+    int status = 1;
+
+    diag("%s()", __func__);
+    for (size_t i = 0; i < n; ++i)
+    {
+        a[i] = b[i] = (int) random_value(&seed);
+        rec[i].key = (int) (random_value(&seed) % 1000);
+        snprintf(rec[i].data, sizeof(rec[i].data), "%d", rec[i].key);
+    }
+    qsort(b, n, sizeof(*b), int_cmp);
+    ok(parallel_sort(a, n, sizeof(*a), int_cmp, 4)
+       && memcmp(a, b, n * sizeof(*a)) == 0, "parallel_sort() (int)");
+
+    ok(parallel_sort(rec, n, sizeof(*rec), record_cmp, 3),
+       "parallel_sort() (records, odd No. of runs)");
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (rec[i].key < rec[i - 1].key || atoi(rec[i].data) != rec[i].key)
+        {
+            status = 0;
+        }
+    }
+    ok(status, "parallel_sort() records are sorted, and intact");
+    ok(parallel_sort(a, 10, sizeof(*a), int_cmp, 0),
+       "parallel_sort() small array");
+    free(rec);
+    free(a);
+    free(b);
+}
+
+/*
+ * test_radix() --Test the radix sorts against qsort().
+ */
+static void test_radix(void)
+{
+    size_t n = 10000;
+    int *ia = malloc(n * sizeof(*ia)), *ib = malloc(n * sizeof(*ib));
+    long *la = malloc(n * sizeof(*la)), *lb = malloc(n * sizeof(*lb));
+    double *da = malloc(n * sizeof(*da)), *db = malloc(n * sizeof(*db));
+    uint64_t seed = 1;
+
+    diag("%s()", __func__);
+    for (size_t i = 0; i < n; ++i)
+    {
+        ia[i] = ib[i] = (int) random_value(&seed);
+        la[i] = lb[i] = (long) random_value(&seed);
+        da[i] = db[i] = ((double) (int64_t) random_value(&seed)) / 1e12;
+    }
+    da[0] = db[0] = 0.0;
+    da[1] = db[1] = -0.5;
+    qsort(ib, n, sizeof(*ib), int_cmp);
+    qsort(lb, n, sizeof(*lb), long_cmp);
+    qsort(db, n, sizeof(*db), double_cmp);
+    ok(radix_sort_int(ia, n) && memcmp(ia, ib, n * sizeof(*ia)) == 0,
+       "radix_sort_int()");
+    ok(radix_sort_long(la, n) && memcmp(la, lb, n * sizeof(*la)) == 0,
+       "radix_sort_long()");
+    ok(radix_sort_double(da, n) && memcmp(da, db, n * sizeof(*da)) == 0,
+       "radix_sort_double()");
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        ia[i] = ib[i] = (int) (random_value(&seed) % 100);
+    }
+    qsort(ib, n, sizeof(*ib), int_cmp);
+    ok(radix_sort_int(ia, n) && memcmp(ia, ib, n * sizeof(*ia)) == 0,
+       "radix_sort_int() (skipped passes)");
+    free(ia);
+    free(ib);
+    free(la);
+    free(lb);
+    free(da);
+    free(db);
+}
+
+/*
+ * bench_sort() --Compare qsort(), parallel_sort() and radix sort.
+ */
+static void bench_sort(void)
+{
+    size_t n = 1000000;
+    int *a = malloc(n * sizeof(*a));
+    uint64_t seed = 1;
+    clock_t start;
+    double t_qsort, t_parallel, t_radix;
+
+    diag("%s()", __func__);
+    for (size_t i = 0; i < n; ++i)
+    {
+        a[i] = (int) random_value(&seed);
+    }
+    start = clock();
+    qsort(a, n, sizeof(*a), int_cmp);
+    t_qsort = (double) (clock() - start) / CLOCKS_PER_SEC;
+    seed = 1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        a[i] = (int) random_value(&seed);
+    }
+    start = clock();                   /* (CPU time: summed over threads) */
+    parallel_sort(a, n, sizeof(*a), int_cmp, 0);
+    t_parallel = (double) (clock() - start) / CLOCKS_PER_SEC;
+    seed = 1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        a[i] = (int) random_value(&seed);
+    }
+    start = clock();
+    radix_sort_int(a, n);
+    t_radix = (double) (clock() - start) / CLOCKS_PER_SEC;
+    diag("%zu ints: qsort %.3fs, parallel_sort %.3fs (CPU), radix %.3fs",
+         n, t_qsort, t_parallel, t_radix);
+    free(a);
+}
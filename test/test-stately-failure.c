@@ -22,6 +22,7 @@ typedef enum TurnstileEvent
     turn,
     refund,
     timeout,
+    jam,
     n_events /* sentinel/size */
 } TurnstileEvent;
 
@@ -40,6 +41,7 @@ static int turn_action(int state_id, int event_id, void* event_ctx, void* ctx);
 static int refund_action(int state_id, int event_id, void* event_ctx, void* ctx);
 static int timeout_action(int state_id, int event_id, void* event_ctx, void* ctx);
 static int error_action(int state_id, int event_id, void* event_ctx, void* ctx);
+static int jam_action(int state_id, int event_id, void* event_ctx, void* ctx);
 static int lock_turnstile(int state_id, int event_id, void* event_ctx, void* ctx);
 static int unlock_turnstile(int state_id, int event_id, void* event_ctx, void* ctx);
 static int enter_sub_lock(int state_id, int event_id, void* event_ctx, void* ctx);
@@ -51,11 +53,12 @@ static StatelyActionProc turnstile_actions[n_states][n_events] = {
     [init] = { 0 },                /* no default actions */
     [locked] = {
         [coin] = coin_action,       /* and go to unlocked state */
-        [refund] = error_action},       /* -> invalid state */
+        [refund] = error_action},       /* -> another's substate */
     [unlocked] = {
         [turn] = turn_action, /* and go to locked state */
         [refund] = refund_action,
-        [timeout] = timeout_action},
+        [timeout] = timeout_action,
+        [jam] = jam_action},            /* -> invalid state */
     [sub_unlocked] = { 
         [timeout] = timeout_action},
 };
@@ -90,9 +93,14 @@ static void test_failure(void);
 
 int main(int UNUSED(argc), char* UNUSED(argv[]))
 {
-    plan_tests(16);
+    plan_tests(37);
 
     test_failure();
+
+    turnstile.table = stately_compile(turnstile_states, n_states, n_events);
+    ok(turnstile.table != NULL, "compile: dispatch tables built");
+    test_failure(); /* (same results, from the tables) */
+    stately_free_table((StatelyTable*)turnstile.table);
     return exit_status();
 }
 
@@ -134,8 +142,15 @@ static void test_failure(void)
 
     actions[0] = '\0';
     stately_event(&turnstile, refund, NULL);
-    string_eq(actions, "2/2: refund-error ", "on locked/refund: refund-error is called");
-    number_eq(turnstile.state_id, -1, "%d", "on locked/refund: transition to error state");
+    string_eq(actions,
+              "2/2: refund-error 1/2: exit locked 3/2: unlocked! 4/2: sub-unlocked! ",
+              "on locked/refund: exit to the LCA, enter unlocked, sub-unlocked");
+    number_eq(turnstile.state_id, sub_unlocked, "%d", "on locked/refund: transition to state %d", sub_unlocked);
+
+    actions[0] = '\0';
+    stately_event(&turnstile, jam, NULL);
+    string_eq(actions, "4/4: jam ", "on jam: jam is called");
+    number_eq(turnstile.state_id, -1, "%d", "on jam: transition to error state");
 
     actions[0] = '\0';
     stately_event(&turnstile, coin, NULL);
@@ -175,6 +190,12 @@ static int error_action(int state_id, int event_id, void* UNUSED(event_ctx), voi
     return sub_unlocked;
 }
 
+static int jam_action(int state_id, int event_id, void* UNUSED(event_ctx), void* UNUSED(ctx))
+{
+    log_event(state_id, event_id, "jam");
+    return -1;
+}
+
 static int timeout_action(int state_id, int event_id, void* UNUSED(event_ctx), void* UNUSED(ctx))
 {
     log_event(state_id, event_id, "timeout");
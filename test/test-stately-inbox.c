@@ -0,0 +1,134 @@
+/*
+ * INBOX.C --Test stately's cross-thread event inbox.
+ *
+ * Remarks:
+ * Several threads post events to one statechart, draining its inbox
+ * whenever stately_post() tells them to.  The action checks that
+ * it's never run by two threads at once, and that each thread's
+ * events arrive in order.
+ */
+/* LCOV_EXCL_START */
+#include <pthread.h>
+#include <apex.h>
+#include <apex/log.h>
+#include <apex/stately.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+
+enum
+{
+    N_THREAD = 4,
+    N_POST   = 20000
+};
+
+typedef enum CounterEvent
+{
+    count,
+    n_events /* sentinel/size */
+} CounterEvent;
+
+typedef enum CounterState
+{
+    init,
+    counting,
+    n_states /* sentinel/size */
+} CounterState;
+
+typedef struct Post
+{
+    StatelyMessage msg;
+    int            thread;
+    int            seq;
+} Post;
+
+typedef struct Counter
+{
+    int  running;         /* (set while the action runs) */
+    long n_count;
+    long n_overlap;       /* actions run concurrently */
+    long n_disorder;      /* events out of order */
+    int  last[N_THREAD];  /* last seq, per thread */
+} Counter;
+
+static int count_action(int state_id, int event_id, void* event_ctx, void* ctx);
+
+static StatelyActionProc counter_actions[n_states][n_events] = {
+    [counting] = {[count] = count_action},
+};
+
+static StatelyState counter_states[n_states] = {
+    [init]     = {.init_state = counting},
+    [counting] = {.action = counter_actions[counting]},
+};
+
+static Counter      counter;
+static StatelyInbox inbox;
+static Stately      machine = {.state = counter_states, .inbox = &inbox};
+static Post         post[N_THREAD][N_POST];
+static long         n_drained[N_THREAD];
+
+static void* poster(void* data)
+{
+    int thread = (int)(long)data;
+
+    for (int i = 0; i < N_POST; ++i)
+    {
+        Post* p = &post[thread][i];
+
+        p->msg.event_id  = count;
+        p->msg.event_ctx = p;
+        p->thread        = thread;
+        p->seq           = i + 1;
+        if (stately_post(&machine, &p->msg))
+        {
+            n_drained[thread] += stately_drain(&machine);
+        }
+    }
+    return NULL;
+}
+
+int main(int UNUSED(argc), char* UNUSED(argv[]))
+{
+    pthread_t thread[N_THREAD];
+    long      n_total = 0;
+
+    plan_tests(5);
+
+    stately_inbox_init(&inbox);
+    stately_init(&machine, &counter);
+    for (long i = 0; i < N_THREAD; ++i)
+    {
+        pthread_create(&thread[i], NULL, poster, (void*)i);
+    }
+    for (int i = 0; i < N_THREAD; ++i)
+    {
+        pthread_join(thread[i], NULL);
+        n_total += n_drained[i];
+    }
+    number_eq(counter.n_count, N_THREAD * N_POST, "%ld", "every event was processed");
+    number_eq(n_total, N_THREAD * N_POST, "%ld", "drains account for every event");
+    number_eq(counter.n_overlap, 0, "%ld", "the machine never ran concurrently");
+    number_eq(counter.n_disorder, 0, "%ld", "each thread's events arrived in order");
+    number_eq(inbox.pending, 0, "%ld", "the inbox is empty");
+    return exit_status();
+}
+
+static int count_action(int state_id, int UNUSED(event_id), void* event_ctx, void* ctx)
+{
+    Counter* c = ctx;
+    Post*    p = event_ctx;
+
+    if (__atomic_exchange_n(&c->running, 1, __ATOMIC_ACQUIRE))
+    {
+        ++c->n_overlap;
+    }
+    ++c->n_count;
+    if (p->seq != c->last[p->thread] + 1)
+    {
+        ++c->n_disorder;
+    }
+    c->last[p->thread] = p->seq;
+    __atomic_store_n(&c->running, 0, __ATOMIC_RELEASE);
+    return state_id;
+}
+/* LCOV_EXCL_STOP */
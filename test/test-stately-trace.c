@@ -0,0 +1,104 @@
+/*
+ * TRACE.C --Test stately's (optional) transition tracing.
+ *
+ * Remarks:
+ * Tracing is only compiled in with STATELY_TRACE; otherwise this
+ * test is skipped.
+ */
+/* LCOV_EXCL_START */
+#include <apex.h>
+#include <apex/log.h>
+#include <apex/stately.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+
+#ifdef STATELY_TRACE
+typedef enum TurnstileEvent
+{
+    coin,
+    turn,
+    n_events /* sentinel/size */
+} TurnstileEvent;
+
+typedef enum TurnstileState
+{
+    init,
+    locked,
+    unlocked,
+    n_states /* sentinel/size */
+} TurnstileState;
+
+static int coin_action(int state_id, int event_id, void* event_ctx, void* ctx);
+static int turn_action(int state_id, int event_id, void* event_ctx, void* ctx);
+
+static StatelyActionProc turnstile_actions[n_states][n_events] = {
+    [locked]   = {[coin] = coin_action},
+    [unlocked] = {[turn] = turn_action},
+};
+
+static StatelyState turnstile_states[n_states] = {
+    [init]     = {.init_state = locked, .action = turnstile_actions[init]},
+    [locked]   = {.action = turnstile_actions[locked]},
+    [unlocked] = {.action = turnstile_actions[unlocked]},
+};
+
+static int n_hook;
+
+static void hook(const StatelyTraceRecord* UNUSED(record), void* UNUSED(data))
+{
+    ++n_hook;
+}
+
+int main(int UNUSED(argc), char* UNUSED(argv[]))
+{
+    Stately            turnstile = {.state = turnstile_states};
+    StatelyTrace*      trace     = stately_trace_new(n_states, 4);
+    StatelyTraceRecord record[8];
+    size_t             n;
+
+    plan_tests(9);
+
+    ok(trace != NULL, "trace created");
+    trace->proc     = hook;
+    turnstile.trace = trace;
+    stately_init(&turnstile, NULL);
+    stately_event(&turnstile, coin, NULL);
+    stately_event(&turnstile, turn, NULL);
+    stately_event(&turnstile, turn, NULL); /* (no transition) */
+    stately_event(&turnstile, coin, NULL);
+    stately_event(&turnstile, turn, NULL);
+
+    number_eq(n_hook, 5, "%d", "hook called for each transition");
+    number_eq((long)trace->n_record, 5, "%ld", "5 transitions recorded");
+    n = stately_trace_read(trace, record, NEL(record));
+    number_eq(n, 4, "%zu", "ring keeps the last 4");
+    ok(record[0].from == locked && record[0].to == unlocked
+           && record[0].event_id == coin,
+       "oldest record: locked -> unlocked, on coin");
+    ok(record[3].from == unlocked && record[3].to == locked
+           && record[3].stc == &turnstile,
+       "newest record: unlocked -> locked");
+    ok(record[0].when <= record[3].when, "records are in time order");
+    number_eq((long)trace->n_event[locked], 3, "%ld", "3 events in state locked");
+    number_eq((long)trace->n_event[unlocked], 2, "%ld", "2 events in state unlocked");
+    stately_trace_free(trace);
+    return exit_status();
+}
+
+static int coin_action(int UNUSED(state_id), int UNUSED(event_id), void* UNUSED(event_ctx), void* UNUSED(ctx))
+{
+    return unlocked;
+}
+
+static int turn_action(int UNUSED(state_id), int UNUSED(event_id), void* UNUSED(event_ctx), void* UNUSED(ctx))
+{
+    return locked;
+}
+#else
+int main(int UNUSED(argc), char* UNUSED(argv[]))
+{
+    plan_skip_all("stately was built without STATELY_TRACE");
+    return exit_status();
+}
+#endif /* STATELY_TRACE */
+/* LCOV_EXCL_STOP */
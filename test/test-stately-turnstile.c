@@ -14,7 +14,7 @@
 #include <apex/tap.h>
 #include <apex/test.h>
 
-static char actions[100];
+static char actions[200];
 
 typedef enum TurnstileEvent
 {
@@ -78,12 +78,19 @@ static StatelyState turnstile_states[n_states] = {
 static Stately turnstile = {.state = turnstile_states};
 
 static void test_turnstile(void);
+static void test_batch(void);
 
 int main(int UNUSED(argc), char* UNUSED(argv[]))
 {
-    plan_tests(10);
+    plan_tests(24);
 
     test_turnstile();
+
+    turnstile.table = stately_compile(turnstile_states, n_states, n_events);
+    ok(turnstile.table != NULL, "compile: dispatch tables built");
+    test_turnstile(); /* (same results, from the tables) */
+    test_batch();
+    stately_free_table((StatelyTable*)turnstile.table);
     return exit_status();
 }
 
@@ -115,6 +122,35 @@ static void test_turnstile(void)
     number_eq(turnstile.state_id, 1, "%d", "on reset: transition to state 1");
 }
 
+static void test_batch(void)
+{
+    Stately      a = turnstile, b = turnstile, c = turnstile;
+    StatelyEvent event[] = {
+        {&a, turn, NULL},
+        {&c, turn, NULL},
+        {&b, coin, NULL},
+        {&a, coin, NULL},
+        {&c, coin, NULL},
+    };
+    size_t n_ok;
+
+    stately_init(&a, NULL);
+    stately_init(&b, NULL);
+    stately_init(&c, NULL);
+    stately_event(&c, coin, NULL);
+
+    actions[0] = '\0';
+    n_ok       = stately_event_batch(event, NEL(event));
+    number_eq(n_ok, NEL(event), "%zu", "batch: all events processed");
+    string_eq(actions,
+              "1/1: ignored 1/0: coin 2/0: unlocked! 1/0: coin 2/0: unlocked! "
+              "2/1: turn 1/1: locked! 1/0: coin 2/0: unlocked! ",
+              "batch: grouped by state, in order per instance");
+    ok(a.state_id == unlocked && b.state_id == unlocked
+           && c.state_id == unlocked,
+       "batch: all instances unlocked");
+}
+
 static void log_event(int state_id, int event_id, const char* msg)
 {
     char text[100];
@@ -0,0 +1,146 @@
+/*
+ * STRBUF.C --Unit tests for the growable string buffers.
+ *
+ * Contents:
+ * test_append()  --strbuf_add() etc. tests.
+ * test_grow()    --Growing beyond the small buffer.
+ * test_number()  --strbuf_int(), strbuf_fixed() tests.
+ * test_printf()  --strbuf_printf() tests.
+ * main()         --Tests entrypoint.
+ */
+#include <stdio.h>
+#include <apex/test.h>
+#include <apex/strbuf.h>
+
+/*
+ * test_append() --strbuf_add() etc. tests.
+ */
+static void test_append(void)
+{
+    StrBuf buf;
+    const char *word[] = { "a", "bc", "" };
+
+    strbuf_init(&buf);
+    ok(buf.len == 0 && strcmp(buf.str, "") == 0, "strbuf_init() is empty");
+    strbuf_str(&buf, "key");
+    strbuf_char(&buf, '=');
+    strbuf_view(&buf, strview_n("value...", 5));
+    string_eq(buf.str, "key=value", "strbuf_str(), _char(), _view()");
+    ok(buf.str == buf.small, "short text stays in the small buffer");
+
+    strbuf_clear(&buf);
+    strbuf_join(&buf, ',', NEL(word), word);
+    string_eq(buf.str, "a,bc,", "strbuf_join()");
+    strbuf_free(&buf);
+}
+
+/*
+ * test_grow() --Growing beyond the small buffer.
+ */
+static void test_grow(void)
+{
+    StrBuf buf;
+    size_t len = 0, n_good = 0;
+    char *str;
+
+    strbuf_init(&buf);
+    for (int i = 0; i < 1000; ++i)
+    {
+        strbuf_str(&buf, "0123456789");
+    }
+    for (size_t i = 0; i < buf.len; ++i)
+    {
+        n_good += buf.str[i] == (char) ('0' + i % 10);
+    }
+    ok(strbuf_ok(&buf) && buf.len == 10000 && n_good == 10000
+       && buf.str[buf.len] == '\0', "appends grow the buffer");
+    ok(buf.size >= 10001 && buf.size < 2 * 10001 + STRBUF_SMALL,
+       "the buffer grows by doubling");
+
+    str = strbuf_detach(&buf, &len);
+    ok(str != NULL && len == 10000 && strlen(str) == 10000
+       && buf.len == 0 && buf.str == buf.small,
+       "strbuf_detach() hands over the text");
+    free(str);
+
+    strbuf_str(&buf, "short");
+    str = strbuf_detach(&buf, NULL);
+    ok(str != NULL && strcmp(str, "short") == 0,
+       "strbuf_detach() copies small text");
+    free(str);
+}
+
+/*
+ * test_number() --strbuf_int(), strbuf_fixed() tests.
+ */
+static void test_number(void)
+{
+    static const double value[] = { 0.0, -0.0, 0.125, 2.5, 3.14159,
+        -1234567.891, 1e17, 0.000499
+    };
+    StrBuf buf;
+    char expect[400];
+    size_t n_good = 0;
+
+    strbuf_init(&buf);
+    strbuf_int(&buf, 0);
+    strbuf_char(&buf, ' ');
+    strbuf_int(&buf, -42);
+    strbuf_char(&buf, ' ');
+    strbuf_int(&buf, INT64_MIN);
+    strbuf_char(&buf, ' ');
+    strbuf_uint(&buf, UINT64_MAX);
+    string_eq(buf.str, "0 -42 -9223372036854775808 18446744073709551615",
+              "strbuf_int(), strbuf_uint()");
+
+    for (size_t i = 0; i < NEL(value); ++i)
+    {
+        for (int precision = 0; precision <= 9; precision += 3)
+        {
+            strbuf_clear(&buf);
+            strbuf_fixed(&buf, value[i], precision);
+            snprintf(expect, sizeof(expect), "%.*f", precision, value[i]);
+            n_good += strcmp(buf.str, expect) == 0;
+        }
+    }
+    number_eq(n_good, NEL(value) * 4, "%zu", "strbuf_fixed() matches printf()");
+
+    strbuf_clear(&buf);
+    strbuf_fixed(&buf, 1e300, 2);
+    snprintf(expect, sizeof(expect), "%.2f", 1e300);
+    ok(strlen(expect) > STRBUF_SMALL && strcmp(buf.str, expect) == 0,
+       "strbuf_fixed() falls back to snprintf()");
+    strbuf_free(&buf);
+}
+
+/*
+ * test_printf() --strbuf_printf() tests.
+ */
+static void test_printf(void)
+{
+    StrBuf buf;
+
+    strbuf_init(&buf);
+    strbuf_printf(&buf, "%s:%d", "host", 80);
+    string_eq(buf.str, "host:80", "strbuf_printf() formats in place");
+    strbuf_printf(&buf, "/%0200d", 7);
+    ok(buf.len == 7 + 201 && buf.str[buf.len - 1] == '7'
+       && strncmp(buf.str, "host:80/000", 11) == 0,
+       "strbuf_printf() grows the buffer");
+    strbuf_free(&buf);
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(13);
+
+    test_append();
+    test_grow();
+    test_number();
+    test_printf();
+
+    return exit_status();
+}
@@ -0,0 +1,118 @@
+/*
+ * STRVIEW.C --Unit tests for the string view functions.
+ *
+ * Contents:
+ * test_trim()    --strview_trim() tests.
+ * test_compare() --strview_cmp(), strview_prefix() etc. tests.
+ * test_split()   --strview_split() (and new_str_list()) tests.
+ * test_number()  --strview_int() etc. tests.
+ * main()         --Tests entrypoint.
+ */
+#include <apex/test.h>
+#include <apex/estring.h>
+#include <apex/strparse.h>
+#include <apex/strview.h>
+
+/*
+ * test_trim() --strview_trim() tests.
+ */
+static void test_trim(void)
+{
+    StrView view = strview_trim(strview(" \t key = value \n"));
+
+    ok(strview_eq_str(view, "key = value"), "strview_trim() trims both ends");
+    view = strview_trim(strview("   "));
+    ok(view.len == 0, "strview_trim() of whitespace is empty");
+}
+
+/*
+ * test_compare() --strview_cmp(), strview_prefix() etc. tests.
+ */
+static void test_compare(void)
+{
+    StrView abc = STRVIEW_LITERAL("abc");
+    StrView abcd = strview_n("abcdef", 4);
+
+    ok(strview_cmp(abc, abcd) < 0 && strview_cmp(abcd, abc) > 0
+       && strview_cmp(abc, strview("abc")) == 0,
+       "strview_cmp() orders prefixes first");
+    ok(strview_eq(abc, strview("abc")) && !strview_eq(abc, abcd),
+       "strview_eq()");
+    ok(strview_eq_str(abcd, "abcd") && !strview_eq_str(abcd, "abcde")
+       && !strview_eq_str(abcd, "abc"), "strview_eq_str() checks the length");
+    ok(strview_prefix(abcd, abc) && !strview_prefix(abc, abcd),
+       "strview_prefix()");
+    ok(strview_suffix(strview("file.csv"), STRVIEW_LITERAL(".csv"))
+       && !strview_suffix(strview("csv"), STRVIEW_LITERAL(".csv")),
+       "strview_suffix()");
+}
+
+/*
+ * test_split() --strview_split() (and new_str_list()) tests.
+ */
+static void test_split(void)
+{
+    const char text[] = "a,,bc,";
+    const char *expected[] = { "a", "", "bc", "" };
+    StrView rest = strview(text), field;
+    size_t n = 0, n_match = 0;
+    char **list;
+
+    while (strview_split(&rest, ',', &field))
+    {
+        n_match += n < NEL(expected) && strview_eq_str(field, expected[n]);
+        ++n;
+    }
+    ok(n == 4 && n_match == 4, "strview_split() gives n+1 fields");
+    number_eq(strview_count(strview(text), ','), 3, "%zu",
+              "strview_count()");
+
+    list = new_str_list(text, ',');
+    ok(list != NULL && strcmp(list[0], "a") == 0 && strcmp(list[1], "") == 0
+       && strcmp(list[2], "bc") == 0 && strcmp(list[3], "") == 0
+       && list[4] == NULL, "new_str_list() splits the same way");
+    free_str_list(list);
+}
+
+/*
+ * test_number() --strview_int() etc. tests.
+ */
+static void test_number(void)
+{
+    StrView rest = strview("12,-7,0x1f,3.5e2,abc,08"), field;
+    int i[4] = { 0 };
+    unsigned int u = 0;
+    double d = 0;
+
+    ok(strview_split(&rest, ',', &field) && strview_int(field, &i[0])
+       && i[0] == 12, "strview_int() parses a field in place");
+    ok(strview_split(&rest, ',', &field) && strview_int(field, &i[1])
+       && i[1] == -7, "strview_int() negative");
+    ok(strview_uint(strview("4000000000"), &u) && u == 4000000000u,
+       "strview_uint()");
+    ok(strview_split(&rest, ',', &field) && strview_int(field, &i[2])
+       && i[2] == 31, "strview_int() hex (via strtol())");
+    ok(strview_split(&rest, ',', &field) && strview_double(field, &d)
+       && d == 350.0, "strview_double()");
+    ok(strview_split(&rest, ',', &field) && !strview_int(field, &i[3]),
+       "strview_int() rejects non-numbers");
+    ok(strview_split(&rest, ',', &field) && !strview_int(field, &i[3]),
+       "strview_int() rejects bad octal");
+    ok(strview_int(strview_n("123", 2), &i[3]) && i[3] == 12,
+       "strview_int() stops at the view's end");
+}
+
+/*
+ * main() --Tests entrypoint.
+ */
+int main(void)
+{
+    plan_tests(18);
+
+    test_trim();
+    test_compare();
+    test_split();
+    test_number();
+
+    return exit_status();
+}
@@ -3,13 +3,23 @@
  *
  * Contents:
  * sym_get_test() --Test sym_path/sym_get.
+ * sym_index_test() --Test sym_get() on indexed tables.
+ * sym_match_test() --Test sym_match() against sym_path_match().
+ * sym_snapshot_test() --Test published snapshots and reclamation.
+ * enum_index_test() --Test Enum lookups via (and without) an index.
  *
  *
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <float.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <apex/tap.h>
 #include <apex.h>
@@ -96,6 +106,327 @@ static void sym_test(SymbolPtr dom, const char *pathname,
     free_sym_path(path);
 }
 
+/*
+ * sym_index_test() --Test sym_get() on indexed tables.
+ *
+ * Remarks:
+ * The table has n_sym generated names (and a duplicate of the first,
+ * which must be shadowed as for a linear scan).
+ */
+static void sym_index_test(size_t n_sym)
+{
+    SymbolPtr table = calloc(n_sym + 2, sizeof(*table));
+    char (*name)[24] = calloc(n_sym, sizeof(*name));
+    size_t n_ok = 0, n_found = 0;
+    Value val;
+
+    for (size_t i = 0; i < n_sym; ++i)
+    {
+        snprintf(name[i], sizeof(name[i]), "sym_%zu", i);
+        table[i].name = name[i];
+        table[i].type = INTEGER_TYPE;
+        table[i].value.integer = (int) i;
+    }
+    table[n_sym] = table[0];
+    table[n_sym].value.integer = -1;
+
+    ok(sym_index(table, 0) == 1, "sym_index(): %zu symbols", n_sym);
+    for (size_t i = 0; i < n_sym; ++i)
+    {
+        AtomPtr path = new_sym_path(name[i]);
+
+        if (sym_get_value(table, path, &val) == INTEGER_TYPE
+            && val.integer == (int) i)
+        {
+            ++n_ok;
+        }
+        free_sym_path(path);
+    }
+    ok(n_ok == n_sym, "indexed sym_get() finds every name (and the first)");
+    do
+    {
+        AtomPtr path = new_sym_path("no_such_sym");
+
+        ok(sym_get_value(table, path, &val) == VOID_TYPE,
+           "indexed sym_get() fails for a missing name");
+        free_sym_path(path);
+    } while (0);
+
+    sym_unindex(table);
+    for (size_t i = 0; i < n_sym; ++i)
+    {
+        AtomPtr path = new_sym_path(name[i]);
+
+        if (sym_get_value(table, path, &val) == INTEGER_TYPE
+            && val.integer == (int) i)
+        {
+            ++n_found;
+        }
+        free_sym_path(path);
+    }
+    ok(n_found == n_sym, "sym_unindex(): unindexed sym_get() agrees");
+    free(name);
+    free(table);
+}
+
+/*
+ * match_sum() --SymMatchProc: accumulate the patterns' bits.
+ */
+static void match_sum(void *data, void *context)
+{
+    *(unsigned long *) context |= 1ul << (uintptr_t) data;
+}
+
+/*
+ * sym_match_test() --Test sym_match() against sym_path_match().
+ */
+static void sym_match_test(void)
+{
+    const char *patterns[] = {
+        "a.b", "a.*", "*.b", "a[*].c", "x", "*", "a[2].c", "a.b"
+    };
+    const char *paths[] = {
+        "a.b", "a.c", "b.b", "a[3].c", "a[2].c", "a", "x", "a.b.c", "[1]"
+    };
+    AtomPtr pattern_path[NEL(patterns)];
+    SymMatchSetPtr set = new_sym_match();
+    size_t n_add = 0, n_same = 0;
+
+    for (size_t i = 0; i < NEL(patterns); ++i)
+    {
+        pattern_path[i] = new_sym_path(patterns[i]);
+        n_add += sym_match_add(set, pattern_path[i], (void *) i);
+    }
+    ok(set != NULL && n_add == NEL(patterns), "sym_match_add(): patterns");
+    for (size_t i = 0; i < NEL(paths); ++i)
+    {
+        AtomPtr path = new_sym_path(paths[i]);
+        size_t len = (size_t) vector_len(path) - 1;
+        unsigned long expect = 0, found = 0;
+        size_t n_expect = 0;
+
+        for (size_t j = 0; j < NEL(patterns); ++j)
+        {
+            if (sym_path_match(pattern_path[j],
+                               (size_t) vector_len(pattern_path[j]) - 1,
+                               path, len))
+            {
+                expect |= 1ul << j;
+                ++n_expect;
+            }
+        }
+        if (sym_match(set, path, match_sum, &found) == n_expect
+            && found == expect)
+        {
+            ++n_same;
+        }
+        free_sym_path(path);
+    }
+    ok(n_same == NEL(paths), "sym_match(): agrees with sym_path_match()");
+    do
+    {
+        AtomPtr path = new_sym_path("a.b");
+
+        ok(sym_match(set, path, NULL, NULL) == 4,
+           "sym_match(): exact, wildcard and duplicate patterns");
+        free_sym_path(path);
+    } while (0);
+    for (size_t i = 0; i < NEL(patterns); ++i)
+    {
+        free_sym_path(pattern_path[i]);
+    }
+    free_sym_match(set);
+}
+
+static int n_table_free;
+
+/*
+ * free_table() --SymFreeProc: free a table, and count it.
+ */
+static void free_table(SymbolPtr symtab)
+{
+    Value value = {.field = symtab };
+
+    sym_free_value(STRUCT_TYPE, value);
+    ++n_table_free;
+}
+
+/*
+ * version_table() --Make a table with a single "version" symbol.
+ */
+static SymbolPtr version_table(SYMBOL_INT version)
+{
+    Symbol sym = {.name = (char *) "version",.type = INTEGER_TYPE };
+    SymbolPtr table = NEW_VECTOR(Symbol, 1, &null_symbol);
+
+    sym.value.integer = version;
+    sym.name = strdup(sym.name);
+    return vector_insert(table, 0, 1, &sym);
+}
+
+typedef struct SnapshotReader_t
+{
+    SymConfigPtr config;
+    int *done;
+    int n_bad;                         /* No. of non-monotonic reads */
+    long n_read;
+} SnapshotReader;
+
+/*
+ * snapshot_reader() --Thread: read versions until the writer's done.
+ */
+static void *snapshot_reader(void *data)
+{
+    SnapshotReader *r = data;
+    SymReaderPtr reader = sym_config_reader(r->config);
+    AtomPtr path = new_sym_path("version");
+    SYMBOL_INT last = 0;
+
+    while (reader != NULL && !ATOMIC_LOAD_ACQUIRE(r->done))
+    {
+        SymSnapshotPtr snapshot = sym_read_begin(r->config, reader);
+        SYMBOL_INT version = -1;
+
+        if (!sym_get_int(snapshot->symtab, path, &version)
+            || version < last
+            || (unsigned long) version != snapshot->version)
+        {
+            ++r->n_bad;
+        }
+        last = version;
+        sym_read_end(reader);
+        ++r->n_read;
+        sched_yield();
+    }
+    if (reader == NULL)
+    {
+        r->n_bad = -1;
+    }
+    else
+    {
+        sym_config_unreader(reader);
+    }
+    free_sym_path(path);
+    return NULL;
+}
+
+/*
+ * sym_snapshot_test() --Test published snapshots and reclamation.
+ */
+static void sym_snapshot_test(void)
+{
+    SymConfig config;
+    SymReaderPtr reader;
+    SymSnapshotPtr snapshot;
+    SymbolPtr copy = sym_copy((SymbolPtr) & test_dom);
+    AtomPtr path = new_sym_path("a_struct.c");
+    char *str = NULL;
+
+    ok(copy != NULL && copy != (SymbolPtr) & test_dom
+       && sym_get_str(copy, path, &str) && strcmp(str, "foobar") == 0
+       && str != a_struct[2].value.string, "sym_copy(): deep copy");
+    free_sym_path(path);
+    free_table(copy);
+
+    n_table_free = 0;
+    ok(sym_config_init(&config, version_table(1), 4, free_table) == &config,
+       "sym_config_init()");
+    reader = sym_config_reader(&config);
+    snapshot = sym_read_begin(&config, reader);
+    ok(sym_publish(&config, version_table(2)) == 2 && n_table_free == 0
+       && snapshot->version == 1,
+       "sym_publish(): old snapshot kept while it's being read");
+    sym_read_end(reader);
+    ok(sym_config_reclaim(&config) == 1 && n_table_free == 1,
+       "sym_config_reclaim(): frees it after sym_read_end()");
+    snapshot = sym_read_begin(&config, reader);
+    ok(snapshot->version == 2, "sym_read_begin(): sees the new snapshot");
+    sym_read_end(reader);
+    sym_config_unreader(reader);
+
+    do
+    {
+        enum { N_READER = 3, N_VERSION = 200 };
+        pthread_t thread[N_READER];
+        SnapshotReader r[N_READER];
+        int done = 0;
+        int n_bad = 0;
+
+        for (int i = 0; i < N_READER; ++i)
+        {
+            r[i].config = &config;
+            r[i].done = &done;
+            r[i].n_bad = 0;
+            r[i].n_read = 0;
+            pthread_create(&thread[i], NULL, snapshot_reader, &r[i]);
+        }
+        for (SYMBOL_INT v = 3; v <= N_VERSION; ++v)
+        {
+            sym_publish(&config, version_table(v));
+            sched_yield();
+        }
+        ATOMIC_STORE_RELEASE(&done, 1);
+        for (int i = 0; i < N_READER; ++i)
+        {
+            pthread_join(thread[i], NULL);
+            n_bad += r[i].n_bad;
+        }
+        sym_config_reclaim(&config);
+        ok(n_bad == 0 && n_table_free == N_VERSION - 1,
+           "concurrent readers see consistent snapshots; all reclaimed");
+    } while (0);
+    sym_config_free(&config);
+    ok(n_table_free == 200, "sym_config_free(): frees the current table");
+}
+
+/*
+ * enum_index_test() --Test Enum lookups via (and without) an index.
+ */
+static void enum_index_test(void)
+{
+    enum { N_NAME = 200 };
+    static char names[N_NAME][8];
+    static Enum dense[N_NAME + 2];
+    static Enum sparse[] = {
+        {"ten", 10}, {"million", 1000000}, {"ten", 11}, {"minus", -7},
+        {"again", 10}, {NULL, 0}
+    };
+    int n_found = 0, n_named = 0, value = 0;
+
+    for (int i = 0; i < N_NAME; ++i)
+    {
+        snprintf(names[i], sizeof(names[i]), "kw%d", i);
+        dense[i].name = names[i];
+        dense[i].value = i * 2;
+    }
+    dense[N_NAME].name = "kw0";        /* (duplicate: never found) */
+    dense[N_NAME].value = -1;
+    dense[N_NAME + 1] = null_enum;
+
+    ok(enum_index(dense) != NULL && enum_index(sparse) != NULL,
+       "enum_index() indexes dense and sparse lists");
+    ok(enum_index(dense) == enum_index_lookup_(dense),
+       "enum_index() returns the registered index");
+    for (int i = 0; i < N_NAME; ++i)
+    {
+        n_found += enum_value(names[i], dense) == i * 2;
+        n_named += enum_name(i * 2, dense) == names[i]
+            && enum_name(i * 2 + 1, dense) == NULL;
+    }
+    ok(n_found == N_NAME, "enum_value() finds every name");
+    ok(n_named == N_NAME, "enum_name() finds every value");
+    ok(enum_value("kw200", dense) == -1 && enum_value("", dense) == -1,
+       "enum_value() rejects unknown names");
+    ok(str_enum("kw150", 100, dense, &value) == 0
+       && str_enum("kw50", 100, dense, &value) == 1 && value == 100,
+       "str_enum() respects n_items");
+    ok(enum_value("ten", sparse) == 10 && enum_value("minus", sparse) == -7
+       && enum_name(10, sparse) == sparse[0].name
+       && enum_name(1000000, sparse) == sparse[1].name
+       && enum_name(12, sparse) == NULL,
+       "sparse lists: first name/value wins");
+}
+
 /*
  * main...
  */
@@ -103,7 +434,7 @@ int main(void)
 {
     Value v;
 
-    plan_tests(33);
+    plan_tests(86);
 
     ok(new_sym_path(NULL) == NULL, "NULL path returns NULL");
 
@@ -202,5 +533,279 @@ int main(void)
              "array syntax to string");
     sym_test((SymbolPtr) & test_dom, "a_struct.c", STRING_TYPE, v,
              "struct syntax to string");
+
+    ok(sym_index((SymbolPtr) & test_dom, 1) == 1, "sym_index(): test dom");
+    v.integer = 1;
+    sym_test((SymbolPtr) & test_dom, "a_struct.a", INTEGER_TYPE, v,
+             "indexed struct syntax to int");
+    v.string = (char *) "foobar";
+    sym_test((SymbolPtr) & test_dom, "a_list[2]", STRING_TYPE, v,
+             "indexed array syntax to string");
+    sym_unindex((SymbolPtr) & test_dom);
+
+    sym_index_test(1000);
+
+    do
+    {
+        SymBinding port, name, none;
+        AtomPtr port_path = new_sym_path("a_struct.a");
+        AtomPtr name_path = new_sym_path("a_list[2]");
+        AtomPtr none_path = new_sym_path("a_struct.z");
+        SYMBOL_INT i = 0;
+        char *str = NULL;
+        ValuePtr vptr;
+
+        ok(sym_bind(&port, (SymbolPtr) & test_dom, port_path)
+           == INTEGER_TYPE && sym_bound_int(&port, &i) && i == 1,
+           "sym_bind(): struct path to int");
+        ok(sym_bind(&name, (SymbolPtr) & test_dom, name_path)
+           == STRING_TYPE && sym_bound_str(&name, &str)
+           && strcmp(str, "foobar") == 0, "sym_bind(): array path to string");
+        ok(sym_bind(&none, (SymbolPtr) & test_dom, none_path) == VOID_TYPE
+           && sym_bound(&none, &vptr) == VOID_TYPE && vptr == NULL,
+           "sym_bind(): missing path");
+        ok(sym_bound(&port, &vptr) == INTEGER_TYPE
+           && vptr == &a_struct[0].value, "sym_bound(): caches the value");
+        a_struct[0].value.integer = 7;
+        ok(sym_bound_int(&port, &i) && i == 7,
+           "sym_bound(): sees in-place updates");
+        a_struct[0].value.integer = 1;
+        sym_changed();
+        ok(port.generation != sym_generation
+           && sym_bound(&port, &vptr) == INTEGER_TYPE
+           && vptr == &a_struct[0].value
+           && port.generation == sym_generation,
+           "sym_changed(): bound path is re-resolved");
+        free_sym_path(none_path);
+        free_sym_path(name_path);
+        free_sym_path(port_path);
+    } while (0);
+
+    do
+    {
+        char buf[] = "server";
+        char *s1 = sym_intern("server");
+        char *s2 = sym_intern(buf);
+        SymbolPtr table = NEW_VECTOR(Symbol, 1, &null_symbol);
+        Symbol sym = {.type = STRING_TYPE };
+        Value val = {.field = table };
+
+        ok(s1 != NULL && s1 == s2 && s1 != buf, "sym_intern(): shared copy");
+        ok(sym_intern("port") != s1, "sym_intern(): distinct strings");
+        ok(sym_interned(s1) && !sym_interned(buf),
+           "sym_interned(): only the shared copy");
+
+        sym.name = s1;
+        sym.value.string = strdup("localhost");
+        table = vector_insert(table, vector_len(table) - 1, 1, &sym);
+        sym.name = strdup("port");
+        sym.value.string = sym_intern("8080");
+        table = vector_insert(table, vector_len(table) - 1, 1, &sym);
+        val.field = table;
+        do
+        {
+            Atom path[] = {
+                {.type = STRING_TYPE,.value.string = s1},
+                NULL_ATOM
+            };
+            Value v;
+
+            ok(sym_get_value(table, path, &v) == STRING_TYPE
+               && strcmp(v.string, "localhost") == 0,
+               "sym_get(): interned name");
+        } while (0);
+        sym_free_value(STRUCT_TYPE, val);   /* (mustn't free interned) */
+        ok(sym_intern("server") == s1, "sym_free_value(): interned kept");
+        sym_intern_free();
+    } while (0);
+
+    do
+    {
+        char image_path[] = "/tmp/test-symbol-XXXXXX";
+        const char *paths[] = {
+            "a", "b", "c", "a_list[0]", "a_list[1]", "a_list[2]",
+            "a_struct.a", "a_struct.b", "a_struct.c"
+        };
+        size_t n_same = 0;
+        SymImage image;
+        Value v, image_v;
+        int fd = mkstemp(image_path);
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        ok(fd >= 0 && sym_image_write(image_path, (SymbolPtr) & test_dom),
+           "sym_image_write(): test dom");
+        ok(sym_image_open(&image, image_path) == &image,
+           "sym_image_open(): test dom");
+        for (size_t i = 0; i < NEL(paths); ++i)
+        {
+            AtomPtr path = new_sym_path(paths[i]);
+            Type type = sym_get_value((SymbolPtr) & test_dom, path, &v);
+
+            if (sym_image_get(&image, path, &image_v) == type
+                && (type == STRING_TYPE
+                    ? strcmp(v.string, image_v.string) == 0
+                    : memcmp(&v, &image_v, sizeof(v)) == 0))
+            {
+                ++n_same;
+            }
+            free_sym_path(path);
+        }
+        ok(n_same == NEL(paths), "sym_image_get(): same values as sym_get()");
+        do
+        {
+            AtomPtr path = new_sym_path("a_struct.z");
+            AtomPtr list_path = new_sym_path("a_list[3]");
+
+            ok(sym_image_get(&image, path, &v) == VOID_TYPE
+               && sym_image_get(&image, list_path, &v) == VOID_TYPE,
+               "sym_image_get(): missing name/item");
+            free_sym_path(list_path);
+            free_sym_path(path);
+        } while (0);
+        sym_image_close(&image);
+
+        if ((fd = open(image_path, O_WRONLY | O_TRUNC)) >= 0)
+        {
+            if (write(fd, "not an image, really not", 24) < 0)
+            {
+                perror("write");
+            }
+            close(fd);
+        }
+        ok(sym_image_open(&image, image_path) == NULL && errno == EINVAL,
+           "sym_image_open(): rejects a bad image");
+        unlink(image_path);
+    } while (0);
+
+    do
+    {
+        const char *paths[] = {
+            "a", "b", "c", "a_list[0]", "a_list[1]", "a_list[2]",
+            "a_struct.a", "a_struct.b", "a_struct.c"
+        };
+        SymbolPtr compact = sym_compact((SymbolPtr) & test_dom);
+        size_t n_same = 0, n_inside = 0;
+        Value v, compact_v;
+        ValuePtr vptr;
+
+        ok(compact != NULL, "sym_compact(): test dom");
+        for (size_t i = 0; compact != NULL && i < NEL(paths); ++i)
+        {
+            AtomPtr path = new_sym_path(paths[i]);
+            Type type = sym_get_value((SymbolPtr) & test_dom, path, &v);
+
+            if (sym_get_value(compact, path, &compact_v) == type
+                && (type == STRING_TYPE
+                    ? strcmp(v.string, compact_v.string) == 0
+                    && v.string != compact_v.string
+                    : memcmp(&v, &compact_v, sizeof(v)) == 0))
+            {
+                ++n_same;
+            }
+            if (sym_get(compact, path, &vptr) != VOID_TYPE
+                && (char *) vptr > (char *) compact
+                && (char *) vptr < (char *) compact + 512)
+            {
+                ++n_inside;
+            }
+            free_sym_path(path);
+        }
+        ok(n_same == NEL(paths), "sym_compact(): same values, copied");
+        ok(n_inside == NEL(paths), "sym_compact(): values are contiguous");
+        sym_compact_free(compact);
+    } while (0);
+
+    do
+    {
+        const char *paths[] = {
+            "a", "b", "c", "a_list[0]", "a_list[1]", "a_list[2]",
+            "a_struct.a", "a_struct.b", "a_struct.c"
+        };
+        Atom small[] = {
+            {.type = INTEGER_TYPE,.value.integer = 1},
+            {.type = INTEGER_TYPE,.value.integer = -1},
+            {.type = INTEGER_TYPE,.value.integer = 300},
+            {.type = STRING_TYPE,.value.string = (char *) "ab"},
+            NULL_ATOM
+        };
+        const unsigned char small_pack[] = {
+            0x94, 0x01, 0xff, 0xcd, 0x01, 0x2c, 0xa2, 0x61, 0x62
+        };
+        SYMBOL_INT ints[] = {
+            0, 127, 128, -32, -33, 65536, -40000, SYMBOL_INT_MAX,
+            SYMBOL_INT_MIN
+        };
+        Value dom = {.field = (SymbolPtr) & test_dom };
+        char buf[256], insitu[256];
+        size_t len = sym_pack(NULL, 0, STRUCT_TYPE, dom), used;
+        size_t n_same = 0, n_insitu = 0, n_truncated = 0, n_int = 0;
+        AtomPtr copy, view;
+
+        ok(len > 0 && len < sizeof(buf)
+           && sym_pack(buf, sizeof(buf), STRUCT_TYPE, dom) == len,
+           "sym_pack(): test dom (%zu bytes)", len);
+        ok(sym_pack(insitu, sizeof(insitu), LIST_TYPE,
+                    (Value) {.list = small}) == sizeof(small_pack)
+           && memcmp(insitu, small_pack, sizeof(small_pack)) == 0,
+           "sym_pack(): MessagePack encoding");
+        memcpy(insitu, buf, len);
+        copy = sym_unpack(buf, len, 0, NULL);
+        view = sym_unpack(insitu, len, SYM_UNPACK_INSITU, NULL);
+        for (size_t i = 0; copy != NULL && view != NULL && i < NEL(paths);
+             ++i)
+        {
+            AtomPtr path = new_sym_path(paths[i]);
+            Type type = sym_get_value((SymbolPtr) & test_dom, path, &v);
+            Value copy_v, view_v;
+
+            if (sym_get_value(copy->value.field, path, &copy_v) == type
+                && sym_get_value(view->value.field, path, &view_v) == type
+                && (type == STRING_TYPE
+                    ? strcmp(v.string, copy_v.string) == 0
+                    && strcmp(v.string, view_v.string) == 0
+                    : memcmp(&v, &copy_v, sizeof(v)) == 0
+                    && memcmp(&v, &view_v, sizeof(v)) == 0))
+            {
+                ++n_same;
+            }
+            n_insitu += type != STRING_TYPE
+                || (view_v.string >= insitu && view_v.string < insitu + len
+                    && (copy_v.string < buf || copy_v.string >= buf + len));
+            free_sym_path(path);
+        }
+        ok(copy != NULL && view != NULL && n_same == NEL(paths),
+           "sym_unpack(): same values as sym_get()");
+        ok(n_insitu == NEL(paths),
+           "sym_unpack(): INSITU strings point into the buffer");
+        sym_unpack_free(view);
+        sym_unpack_free(copy);
+
+        for (size_t n = 0; n < len; ++n)
+        {
+            n_truncated += sym_unpack(buf, n, 0, NULL) == NULL
+                && errno == EINVAL;
+        }
+        ok(n_truncated == len, "sym_unpack(): rejects truncated input");
+        for (size_t i = 0; i < NEL(ints); ++i)
+        {
+            Value iv = {.integer = ints[i] };
+            size_t n = sym_pack(buf, sizeof(buf), INTEGER_TYPE, iv);
+
+            buf[n] = (char) 0xc0;      /* (trailing nil) */
+            copy = sym_unpack(buf, n + 1, 0, &used);
+            n_int += copy != NULL && used == n
+                && copy->type == INTEGER_TYPE
+                && copy->value.integer == ints[i];
+            sym_unpack_free(copy);
+        }
+        ok(n_int == NEL(ints), "sym_unpack(): integers round-trip");
+    } while (0);
+
+    sym_match_test();
+    sym_snapshot_test();
+    enum_index_test();
     return exit_status();
 }
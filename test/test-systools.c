@@ -4,7 +4,10 @@
  * Contents:
  * test_make_path() --Unit tests for make_path().
  * test_link_path() --Unit tests for link_path().
+ * test_make_path_cached() --make_path(), link_path() with cached directories.
  * test_dirname()   --Unit tests for path_basename(), path_dirname().
+ * test_resolve_path() --Unit tests for resolve_path(), open_path() etc.
+ * test_pidfd()     --Unit tests for the pid file and pidfd functions.
  *
  * Remarks:
  * Actually, all I'm testing at the moment is the make_path() function,
@@ -17,7 +20,9 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <apex/tap.h>
 #include <apex.h>
@@ -106,6 +111,50 @@ static void test_link_path(void)
     system(cmd);
 }
 
+/*
+ * test_make_path_cached() --make_path(), link_path() with cached directories.
+ *
+ * Remarks:
+ * make_path() remembers the directories it makes, so these check
+ * siblings, and directories removed behind its back.
+ */
+static void test_make_path_cached(void)
+{
+    char path[FILENAME_MAX], file[FILENAME_MAX], cmd[FILENAME_MAX];
+    char *root = getenv("TMPDIR");
+    struct stat stat_buf;
+
+    if (root == NULL)
+    {
+        root = (char *) ".";
+    }
+    snprintf(path, sizeof(path), "%s/%s", root, "m/2026/10/15/");
+    ok(make_path(path) && stat(path, &stat_buf) == 0
+       && S_ISDIR(stat_buf.st_mode), "make_path: deep path");
+    snprintf(path, sizeof(path), "%s/%s", root, "m/2026/10/16");
+    ok(make_path(path) && stat(path, &stat_buf) == 0
+       && S_ISDIR(stat_buf.st_mode), "make_path: sibling of a cached path");
+
+    snprintf(cmd, sizeof(cmd), "/bin/rm -rf %s/%s", root, "m/2026");
+    system(cmd);
+    ok(make_path(path) && stat(path, &stat_buf) == 0
+       && S_ISDIR(stat_buf.st_mode), "make_path: cached path removed");
+    snprintf(path, sizeof(path), "%s/%s", root, "m/2026/10/17");
+    ok(make_path(path) && stat(path, &stat_buf) == 0,
+       "make_path: remade sibling");
+
+    snprintf(path, sizeof(path), "%s/%s", root, "m/src");
+    touch(path);
+    snprintf(file, sizeof(file), "%s/%s", root, "m/2026/11/01/dst");
+    ok(link_path(path, file) && stat(file, &stat_buf) == 0,
+       "link_path: into a new directory");
+    snprintf(file, sizeof(file), "%s/%s", root, "m/src/x");
+    ok(!make_path(file), "make_path: blocked by a file");
+
+    snprintf(cmd, sizeof(cmd), "/bin/rm -rf %s/%s", root, "m");
+    system(cmd);
+    path_cache_clear();
+}
 
 /*
  * test_dirname() --Unit tests for path_basename(), path_dirname().
@@ -133,11 +182,160 @@ static void test_dirname(void)
        "path_dirname: absolute directory component");
 }
 
+/*
+ * test_resolve_path() --Unit tests for resolve_path(), open_path() etc.
+ *
+ * Remarks:
+ * The results are cached, so these check that creating and removing
+ * files (and directories) in the search path is noticed, and that a
+ * relative directory follows a chdir().
+ */
+static void test_resolve_path(void)
+{
+    char p1[FILENAME_MAX], p2[FILENAME_MAX], file[FILENAME_MAX + 8];
+    char env[2 * FILENAME_MAX + 1], cmd[FILENAME_MAX + 16];
+    char cwd[FILENAME_MAX];
+    const char *path[] = { p1, p2, NULL }, *here[] = { ".", NULL };
+    char *root = getenv("TMPDIR");
+    struct stat stat_buf;
+    FILE *fp;
+    int fd;
+
+    if (root == NULL)
+    {
+        root = (char *) ".";
+    }
+    snprintf(p1, sizeof(p1), "%s/%s", root, "p1");
+    snprintf(p2, sizeof(p2), "%s/%s", root, "p2");
+    make_path(p2);
+    snprintf(file, sizeof(file), "%s/%s", p2, "data");
+    touch(file);
+
+    ok(resolve_path(path, "data") == p2, "resolve_path: missing directory");
+    ok(resolve_path(path, "data") == p2, "resolve_path: (cached)");
+    make_path(p1);
+    ok(resolve_path(path, "data") == p2, "resolve_path: created directory");
+    snprintf(file, sizeof(file), "%s/%s", p1, "data");
+    touch(file);
+    ok(resolve_path(path, "data") == p1, "resolve_path: created file");
+    unlink(file);
+    ok(resolve_path(path, "data") == p2, "resolve_path: removed file");
+    ok(resolve_path(path, "nothing") == NULL, "resolve_path: no such file");
+
+    ok((fd = open_path_fd(path, "data", O_RDONLY, 0)) >= 0,
+       "open_path_fd: opens via the directory");
+    close(fd);
+    ok((fp = open_path(path, "new", "w")) != NULL,
+       "open_path: creates in the first directory");
+    fclose(fp);
+    ok(resolve_path(path, "new") == p1, "resolve_path: open_path's file");
+
+    snprintf(env, sizeof(env), "%s:%s", p2, p1);
+    setenv("TEST_PATH", env, 1);
+    ok((fp = open_env_path("TEST_PATH", "new", "r")) != NULL,
+       "open_env_path: searches the environment's path");
+    fclose(fp);
+    setenv("TEST_PATH", p2, 1);
+    ok(open_env_path("TEST_PATH", "new", "r") == NULL,
+       "open_env_path: notices a new value");
+
+    snprintf(cmd, sizeof(cmd), "/bin/rm -rf %s", p1);
+    system(cmd);
+    ok(resolve_path(path, "new") == NULL, "resolve_path: removed directory");
+
+    if (getcwd(cwd, sizeof(cwd)) != NULL && chdir(p2) == 0)
+    {
+        ok(resolve_path(here, "data") == here[0] && make_path("sub"),
+           "resolve_path, make_path: relative to the cwd");
+        chdir(cwd);
+        ok(resolve_path(here, "data") == NULL,
+           "resolve_path: relative to the new cwd");
+        ok(make_path("sub") && stat("sub", &stat_buf) == 0,
+           "make_path: relative to the new cwd");
+        rmdir("sub");
+    }
+    else
+    {
+        skip(3, "cannot change directory");
+    }
+
+    path_cache_clear();
+    snprintf(cmd, sizeof(cmd), "/bin/rm -rf %s", p2);
+    system(cmd);
+}
+
+/*
+ * test_pidfd() --Unit tests for the pid file and pidfd functions.
+ */
+static void test_pidfd(void)
+{
+    char path[FILENAME_MAX];
+    char *root = getenv("TMPDIR");
+    pid_t child[3], pid = 0;
+    int pidfd[NEL(child)], self;
+    TimeValue timeout = {.tv_sec = 5 };
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/pidfd-%d.pid",
+             root != NULL ? root : "/tmp", (int) getpid());
+    for (size_t i = 0; i < NEL(child); ++i)
+    {
+        if ((child[i] = fork()) == 0)
+        {
+            pause();
+            _exit(0);
+        }
+    }
+    if ((fp = fopen(path, "w")) != NULL)
+    {
+        fprintf(fp, "%10d\n", (int) child[0]);
+        fclose(fp);
+    }
+    ok(read_pidfile(path, &pid) && pid == child[0], "read_pidfile()");
+    ok(check_pidfile(path) == child[0], "check_pidfile(): running");
+
+    if ((self = open_pidfd(getpid())) < 0 && errno == ENOSYS)
+    {
+        skip(3, "no pidfd support");
+        for (size_t i = 0; i < NEL(child); ++i)
+        {
+            kill(child[i], SIGTERM);
+        }
+    }
+    else
+    {
+        close(self);
+        ok(open_pidfds(NEL(child), child, pidfd) == NEL(child),
+           "open_pidfds()");
+        ok(signal_pidfds(NEL(child), pidfd, SIGTERM) == NEL(child),
+           "signal_pidfds()");
+        ok(wait_pidfds(NEL(child), pidfd, &timeout) == 0
+           && pidfd[0] == -1 && pidfd[NEL(child) - 1] == -1,
+           "wait_pidfds(): all exited");
+    }
+    for (size_t i = 0; i < NEL(child); ++i)
+    {
+        waitpid(child[i], NULL, 0);
+    }
+    ok(check_pidfile(path) == 0, "check_pidfile(): exited");
+    if ((fp = fopen(path, "w")) != NULL)
+    {
+        fputs("not a pid\n", fp);
+        fclose(fp);
+    }
+    ok(!read_pidfile(path, &pid) && errno == EINVAL,
+       "read_pidfile(): bad pid file");
+    unlink(path);
+}
+
 int main(void)
 {
-    plan_tests(19);
+    plan_tests(47);
     test_make_path();
     test_link_path();
+    test_make_path_cached();
     test_dirname();
+    test_resolve_path();
+    test_pidfd();
     return exit_status();
 }
@@ -0,0 +1,285 @@
+/*
+ * TEST-TASK-POOL.C --Unit tests for the work-stealing task pool.
+ *
+ * Contents:
+ * test_submit()       --Test task_submit() and task_group_wait().
+ * test_external()     --Test submitting from several (non-worker) threads.
+ * test_nested()       --Test tasks that submit and wait for tasks.
+ * test_parallel_for() --Test parallel_for() covers its range exactly once.
+ * test_default()      --Test the shared default pool.
+ * test_overflow()     --Test a worker submitting more than its deque holds.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/task-pool.h>
+
+#define N_TASK 10000
+#define N_RANGE 1000000
+#define N_SUBMITTER 4
+
+static void test_submit(void);
+static void test_external(void);
+static void test_nested(void);
+static void test_parallel_for(void);
+static void test_default(void);
+static void test_overflow(void);
+
+int main(void)
+{
+    plan_tests(13);
+    test_submit();
+    test_external();
+    test_nested();
+    test_parallel_for();
+    test_default();
+    test_overflow();
+    return exit_status();
+}
+
+static unsigned int counter;
+
+/*
+ * count_task() --Count a task run: a TaskProc.
+ */
+static void count_task(void *data)
+{
+    (void) data;
+    __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * test_submit() --Test task_submit() and task_group_wait().
+ */
+static void test_submit(void)
+{
+    TaskPoolPtr pool = task_pool_new(4, TASK_POOL_PIN);
+    TaskGroup group;
+
+    ok(pool != NULL && task_pool_size(pool) == 4, "pool has 4 workers");
+    ok(task_pool_worker(pool) == -1, "the main thread isn't a worker");
+    counter = 0;
+    task_group_init(&group);
+    for (int i = 0; i < N_TASK; ++i)
+    {
+        task_submit(pool, &group, count_task, NULL);
+    }
+    task_group_wait(pool, &group);
+    ok(task_group_done(&group) && counter == N_TASK,
+       "all %d tasks run (%u)", N_TASK, counter);
+    task_pool_free(pool);
+}
+
+typedef struct Submitter_t
+{
+    TaskPoolPtr pool;
+    TaskGroup group;
+} Submitter;
+
+/*
+ * submitter() --Submit tasks, and wait for them: a pthread start proc.
+ */
+static void *submitter(void *data)
+{
+    Submitter *sub = data;
+
+    task_group_init(&sub->group);
+    for (int i = 0; i < N_TASK; ++i)
+    {
+        task_submit(sub->pool, &sub->group, count_task, NULL);
+    }
+    task_group_wait(sub->pool, &sub->group);
+    return NULL;
+}
+
+/*
+ * test_external() --Test submitting from several (non-worker) threads.
+ */
+static void test_external(void)
+{
+    TaskPoolPtr pool = task_pool_new(3, 0);
+    Submitter sub[N_SUBMITTER];
+    pthread_t thread[N_SUBMITTER];
+    int done = 1;
+
+    counter = 0;
+    for (int i = 0; i < N_SUBMITTER; ++i)
+    {
+        sub[i].pool = pool;
+        pthread_create(&thread[i], NULL, submitter, &sub[i]);
+    }
+    for (int i = 0; i < N_SUBMITTER; ++i)
+    {
+        pthread_join(thread[i], NULL);
+        done &= task_group_done(&sub[i].group);
+    }
+    ok(done, "each submitter's group is done");
+    ok(counter == N_SUBMITTER * N_TASK, "all %d tasks run (%u)",
+       N_SUBMITTER * N_TASK, counter);
+    task_pool_free(pool);
+}
+
+typedef struct Fib_t
+{
+    TaskPoolPtr pool;
+    int n;
+    long result;
+} Fib;
+
+/*
+ * fib_task() --Compute a Fibonacci No. with nested tasks: a TaskProc.
+ */
+static void fib_task(void *data)
+{
+    Fib *fib = data;
+
+    if (fib->n < 2)
+    {
+        fib->result = fib->n;
+    }
+    else
+    {
+        Fib sub[2] = {
+            {fib->pool, fib->n - 1, 0}, {fib->pool, fib->n - 2, 0}
+        };
+        TaskGroup group;
+
+        task_group_init(&group);
+        task_submit(fib->pool, &group, fib_task, &sub[0]);
+        fib_task(&sub[1]);
+        task_group_wait(fib->pool, &group);
+        fib->result = sub[0].result + sub[1].result;
+    }
+}
+
+/*
+ * test_nested() --Test tasks that submit and wait for tasks.
+ */
+static void test_nested(void)
+{
+    TaskPoolPtr pool = task_pool_new(4, 0);
+    Fib fib = { pool, 22, 0 };
+
+    fib_task(&fib);
+    ok(fib.result == 17711, "nested fib(22) = %ld", fib.result);
+    task_pool_free(pool);
+}
+
+typedef struct Cover_t
+{
+    TaskPoolPtr pool;
+    unsigned char *hit;
+    int bad_worker;
+} Cover;
+
+/*
+ * cover_range() --Mark a range of indexes as done: a TaskRangeProc.
+ */
+static void cover_range(void *data, size_t lo, size_t hi)
+{
+    Cover *cover = data;
+    int id = task_pool_worker(cover->pool);
+
+    if (id >= task_pool_size(cover->pool))
+    {
+        cover->bad_worker = 1;
+    }
+    for (size_t i = lo; i < hi; ++i)
+    {
+        ++cover->hit[i];
+    }
+}
+
+/*
+ * check_cover() --Check every index was done exactly once.
+ */
+static int check_cover(const unsigned char *hit, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (hit[i] != 1)
+        {
+            diag("index %zu done %d times", i, hit[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * test_parallel_for() --Test parallel_for() covers its range exactly once.
+ */
+static void test_parallel_for(void)
+{
+    TaskPoolPtr pool = task_pool_new(4, 0);
+    Cover cover = { pool, calloc(N_RANGE, 1), 0 };
+
+    parallel_for(pool, 0, N_RANGE, 0, cover_range, &cover);
+    ok(check_cover(cover.hit, N_RANGE), "default grain: all done once");
+    ok(!cover.bad_worker, "task_pool_worker() is in range");
+
+    memset(cover.hit, 0, N_RANGE);
+    parallel_for(pool, 10, N_RANGE, 1, cover_range, &cover);
+    ok(cover.hit[9] == 0 && check_cover(cover.hit + 10, N_RANGE - 10),
+       "grain 1, [10, %d): all done once", N_RANGE);
+
+    memset(cover.hit, 0, N_RANGE);
+    parallel_for(pool, 5, 5, 0, cover_range, &cover);
+    ok(cover.hit[5] == 0, "empty range: nothing done");
+    free(cover.hit);
+    task_pool_free(pool);
+}
+
+/*
+ * test_default() --Test the shared default pool.
+ */
+static void test_default(void)
+{
+    TaskPoolPtr pool = task_pool_default();
+    Cover cover = { pool, calloc(N_RANGE, 1), 0 };
+
+    ok(pool != NULL && pool == task_pool_default(),
+       "the default pool is shared");
+    task_pool_free(pool);              /* (ignored) */
+    parallel_for(NULL, 0, N_RANGE, 0, cover_range, &cover);
+    ok(check_cover(cover.hit, N_RANGE), "parallel_for(NULL, ...)");
+    free(cover.hit);
+}
+
+/*
+ * spawn_task() --Submit many tasks from a worker: a TaskProc.
+ */
+static void spawn_task(void *data)
+{
+    TaskPoolPtr pool = data;
+    TaskGroup group;
+
+    task_group_init(&group);
+    for (int i = 0; i < 4 * TASK_DEQUE_SIZE; ++i)
+    {
+        task_submit(pool, &group, count_task, NULL);
+    }
+    task_group_wait(pool, &group);
+}
+
+/*
+ * test_overflow() --Test a worker submitting more than its deque holds.
+ */
+static void test_overflow(void)
+{
+    TaskPoolPtr pool = task_pool_new(2, 0);
+    TaskGroup group;
+
+    counter = 0;
+    task_group_init(&group);
+    task_submit(pool, &group, spawn_task, pool);
+    task_group_wait(pool, &group);
+    ok(counter == 4 * TASK_DEQUE_SIZE, "overflowed tasks all run (%u)",
+       counter);
+    task_pool_free(pool);
+}
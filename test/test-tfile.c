@@ -11,10 +11,12 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <sys/wait.h>
 
 #include <apex/tap.h>
 #include <apex/systools.h>
 #include <apex/tfile.h>
+#include <apex/date.h>
 
 int main(void)
 {
@@ -25,7 +27,7 @@ int main(void)
     char record[] = "test-record";
     time_t t;
 
-    plan_tests(13);
+    plan_tests(31);
     time(&t);
 
     if (root == NULL)
@@ -84,5 +86,159 @@ int main(void)
        && stat_buf.st_size == 18, "nothing written to existing file");
     unlink(tfp->path);
     tfclose(tfp, t);
+
+    sprintf(path, "%s/%s", root, "tfile-%Y-%m-%d.txt");
+    {
+        TFileOptions opt = {.buf_size = 4096,.flush_interval = 10 };
+        char text[100];
+
+        ok((int) (tfp = tfopen_opt(path, t, NULL, NULL, &opt)),
+           "open fully-buffered");
+        fmt_time(text, sizeof(text), "%H:%M:%S", tfp->start);
+        ok(tfp->start <= t && t < tfp->end && tfp->end - tfp->start >= 82800
+           && strcmp(text, "00:00:00") == 0,
+           "daily name: time window is the day (%s)", text);
+        tfprintf(tfp, t, "%s\n", record);
+        ok(stat(tfp->path, &stat_buf) == 0 && stat_buf.st_size == 0,
+           "fully-buffered: output is held");
+        tfprintf(tfp, t + 5, "%s\n", record);
+        ok(stat(tfp->path, &stat_buf) == 0 && stat_buf.st_size == 0,
+           "fully-buffered: held within the flush interval");
+        tfprintf(tfp, t + 10, "%s\n", record);
+        ok(stat(tfp->path, &stat_buf) == 0
+           && stat_buf.st_size == 3 * sizeof record,
+           "fully-buffered: flushed after the flush interval");
+        tfprintf(tfp, t + 11, "%s\n", record);
+        tfflush(tfp);
+        ok(stat(tfp->path, &stat_buf) == 0
+           && stat_buf.st_size == 4 * sizeof record, "tfflush()");
+        unlink(tfp->path);
+        tfclose(tfp, t);
+    }
+
+    {                                  /* background rotation, gzip */
+        TFileOptions opt = {.flags = TFILE_BACKGROUND,.compress = "gzip" };
+        char first[FILENAME_MAX], second[FILENAME_MAX];
+
+        sprintf(path, "%s/%s", root, "tfile-bg/%Y%m%d-%H%M%S.txt");
+        ok((tfp = tfopen_opt(path, t, "prologue\n", "epilogue\n",
+                             &opt)) != NULL, "open with background rotation");
+        strcpy(first, tfp->path);
+        tfprintf(tfp, t, "%s\n", record);
+        tfprintf(tfp, t + 1, "%s\n", record);
+        strcpy(second, tfp->path);
+        tfprintf(tfp, t + 1, "%s\n", record);
+        ok(strcmp(first, second) != 0, "background: rotated");
+        tfclose(tfp, t + 1);
+
+        sprintf(path, "%s.gz", first);
+        ok(stat(first, &stat_buf) != 0 && stat(path, &stat_buf) == 0,
+           "background: rotated file is compressed");
+        unlink(path);
+        ok(stat(second, &stat_buf) == 0
+           && stat_buf.st_size == 9 + 2 * sizeof record + 9,
+           "background: current file is complete, uncompressed");
+        unlink(second);
+        sprintf(path, "%s/%s", root, "tfile-bg");
+        ok(rmdir(path) == 0, "background: unused pre-opened file removed");
+    }
+
+    {                                  /* several writers, atomic records */
+        TFileOptions opt = {.flags = TFILE_APPEND };
+        char line[1000], expected[1000];
+        int n_writer = 4, n_record = 500, n_line = 0, n_bad = 0;
+        FILE *fp;
+
+        sprintf(path, "%s/%s", root, "tfile-append-%Y.txt");
+        for (int i = 0; i < n_writer; ++i)
+        {
+            if (fork() == 0)
+            {
+                tfp = tfopen_opt(path, t, "prologue\n", NULL, &opt);
+                memset(line, 'a' + i, 300);
+                line[300] = '\0';
+                for (int j = 0; j < n_record; ++j)
+                {
+                    tfprintf(tfp, t, "%d %s\n", i, line);
+                }
+                tfclose(tfp, t);
+                _exit(0);
+            }
+        }
+        while (wait(NULL) > 0)
+        {
+            ;
+        }
+        ok((tfp = tfopen_opt(path, t, "prologue\n", "epilogue\n",
+                             &opt)) != NULL, "open for atomic appends");
+        ok(tfprintf(tfp, t, "last\n") == 5, "atomic tfprintf()");
+        strcpy(path, tfp->path);
+        tfclose(tfp, t);
+
+        fp = fopen(path, "r");
+        while (fp != NULL && fgets(line, sizeof(line), fp) != NULL)
+        {
+            int i = line[0] - '0';
+
+            ++n_line;
+            if (n_line == 1)
+            {
+                n_bad += strcmp(line, "prologue\n") != 0;
+                continue;
+            }
+            if (i >= 0 && i < n_writer)
+            {
+                memset(expected, 'a' + i, 300);
+                sprintf(expected + 300, "\n");
+                n_bad += strcmp(line + 2, expected) != 0;
+            }
+            else
+            {
+                n_bad += strcmp(line, "last\n") != 0
+                    && strcmp(line, "epilogue\n") != 0;
+            }
+        }
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        ok(n_line == 1 + n_writer * n_record + 2 && n_bad == 0,
+           "records from %d writers don't interleave (%d lines, %d bad)",
+           n_writer, n_line, n_bad);
+        unlink(path);
+    }
+
+    {                                  /* memory-mapped, with rotation */
+        TFileOptions opt = {.flags = TFILE_MMAP,.map_size = 4096 };
+        char first[FILENAME_MAX], second[FILENAME_MAX], text[1000];
+        int n_ok = 0;
+
+        sprintf(path, "%s/%s", root, "tfile-mmap-%Y%m%d-%H%M%S.txt");
+        ok((tfp = tfopen_opt(path, t, "prologue\n", "epilogue\n",
+                             &opt)) != NULL, "open memory-mapped");
+        strcpy(first, tfp->path);
+        memset(text, 'x', sizeof(text) - 2);
+        text[sizeof(text) - 2] = '\n';
+        text[sizeof(text) - 1] = '\0';
+        for (int i = 0; i < 10; ++i)
+        {                              /* (grows the 4K mapping) */
+            n_ok += tfprintf(tfp, t, "%s", text) == (int) strlen(text);
+        }
+        n_ok += tfwrite(record, sizeof(record) - 1, 1, tfp, t) == 1;
+        tfprintf(tfp, t + 1, "%s\n", record);
+        strcpy(second, tfp->path);
+        ok(n_ok == 11 && strcmp(first, second) != 0,
+           "mmap: records written, and rotated");
+        ok(stat(first, &stat_buf) == 0
+           && stat_buf.st_size == (off_t) (9 + 10 * strlen(text)
+                                           + sizeof(record) - 1 + 9),
+           "mmap: rotated file truncated to its length");
+        tfclose(tfp, t + 1);
+        ok(stat(second, &stat_buf) == 0
+           && stat_buf.st_size == 9 + sizeof(record) + 9,
+           "mmap: closed file truncated to its length");
+        unlink(first);
+        unlink(second);
+    }
     return exit_status();
 }
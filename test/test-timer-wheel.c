@@ -0,0 +1,201 @@
+/*
+ * TEST-TIMER-WHEEL.C --Unit tests for the timing wheel.
+ *
+ * Contents:
+ * test_expire()     --Test that timers expire at (and only at) their tick.
+ * test_far()        --Test timers beyond the wheel's horizon.
+ * test_cancel()     --Test cancelling and rescheduling timers.
+ * test_timeout()    --Test timer_wheel_timeout().
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <apex.h>
+#include <apex/tap.h>
+#include <apex/test.h>
+#include <apex/timer-wheel.h>
+
+static void test_expire(void);
+static void test_far(void);
+static void test_cancel(void);
+static void test_timeout(void);
+
+static TimeValue start = { 1000, 0 };
+static TimeValue tick = { 0, 1000 };   /* 1ms */
+
+int main(void)
+{
+    plan_tests(14);
+    test_expire();
+    test_far();
+    test_cancel();
+    test_timeout();
+    return exit_status();
+}
+
+/*
+ * at() --Return the time "msec" milliseconds after the start.
+ */
+static TimeValuePtr at(long msec, TimeValuePtr tv)
+{
+    tv->tv_sec = start.tv_sec + msec / 1000;
+    tv->tv_usec = start.tv_usec + (msec % 1000) * 1000;
+    return tv;
+}
+
+/*
+ * count_proc() --Count expiries in an int.
+ */
+static void count_proc(TimerPtr UNUSED(timer), void *data)
+{
+    *(int *) data += 1;
+}
+
+/*
+ * repeat_proc() --Reschedule the timer 5ms later, up to 3 times.
+ */
+static TimerWheelPtr repeat_wheel;
+
+static void repeat_proc(TimerPtr timer, void *data)
+{
+    TimeValue tv;
+    int *n = data;
+
+    if (++*n < 3)
+    {
+        timer_schedule(repeat_wheel, timer,
+                       at((long) timer->tick + 5, &tv));
+    }
+}
+
+/*
+ * test_expire() --Test that timers expire at (and only at) their tick.
+ */
+static void test_expire(void)
+{
+    TimerWheel wheel;
+    Timer timer[10];
+    int count[NEL(timer)] = { 0 };
+    int status = 1;
+    TimeValue tv;
+
+    ok(timer_wheel_init(&wheel, &start, &tick, 16, 8) != NULL,
+       "expire: init");
+    for (size_t i = 0; i < NEL(timer); ++i)
+    {
+        timer_init(&timer[i], count_proc, &count[i]);
+        timer_schedule(&wheel, &timer[i], at((long) i + 1, &tv));
+    }
+    for (size_t i = 0; i < NEL(timer); ++i)
+    {
+        timer_wheel_advance(&wheel, at((long) i + 1, &tv));
+        for (size_t j = 0; j < NEL(timer); ++j)
+        {
+            if (count[j] != (j <= i) || timer_pending(&timer[j]) == (j <= i))
+            {
+                status = 0;
+            }
+        }
+    }
+    ok(status, "expire: timers expire in order, once each");
+
+    Timer again;
+    int n_again = 0;
+
+    repeat_wheel = &wheel;
+    timer_init(&again, repeat_proc, &n_again);
+    timer_schedule(&wheel, &again, at(20, &tv));
+    ok(timer_wheel_advance(&wheel, at(100, &tv)) == 3 && n_again == 3,
+       "expire: callbacks can reschedule their timer");
+    timer_wheel_free(&wheel);
+}
+
+/*
+ * test_far() --Test timers beyond the wheel's horizon.
+ */
+static void test_far(void)
+{
+    TimerWheel wheel;
+    Timer near, far, farther;
+    int n_near = 0, n_far = 0, n_farther = 0;
+    TimeValue tv;
+
+    timer_wheel_init(&wheel, &start, &tick, 8, 2);
+    timer_init(&near, count_proc, &n_near);
+    timer_init(&far, count_proc, &n_far);
+    timer_init(&farther, count_proc, &n_farther);
+    timer_schedule(&wheel, &near, at(3, &tv));
+    timer_schedule(&wheel, &far, at(50, &tv));
+    timer_schedule(&wheel, &farther, at(60 * 1000, &tv));
+    ok(far.handle >= 0 && farther.handle >= 0 && near.handle < 0,
+       "far: distant timers go in the far heap");
+
+    Timer overflow;
+
+    timer_init(&overflow, count_proc, NULL);
+    ok(!timer_schedule(&wheel, &overflow, at(70, &tv)),
+       "far: schedule fails when the far heap is full");
+
+    timer_wheel_advance(&wheel, at(49, &tv));
+    ok(n_near == 1 && n_far == 0 && timer_pending(&far),
+       "far: far timer not yet due");
+    timer_wheel_advance(&wheel, at(50, &tv));
+    ok(n_far == 1 && n_farther == 0, "far: migrated timer expires");
+    timer_wheel_advance(&wheel, at(60 * 1000 + 10, &tv));
+    ok(n_farther == 1 && !timer_pending(&farther),
+       "far: wheel skips ahead to a distant timer");
+    timer_wheel_free(&wheel);
+}
+
+/*
+ * test_cancel() --Test cancelling and rescheduling timers.
+ */
+static void test_cancel(void)
+{
+    TimerWheel wheel;
+    Timer a, b;
+    int n_a = 0, n_b = 0;
+    TimeValue tv;
+
+    timer_wheel_init(&wheel, &start, &tick, 8, 4);
+    timer_init(&a, count_proc, &n_a);
+    timer_init(&b, count_proc, &n_b);
+    timer_schedule(&wheel, &a, at(2, &tv));
+    timer_schedule(&wheel, &b, at(100, &tv));
+    ok(timer_cancel(&wheel, &a) && timer_cancel(&wheel, &b)
+       && !timer_cancel(&wheel, &a), "cancel: near and far timers");
+    timer_wheel_advance(&wheel, at(200, &tv));
+    ok(n_a == 0 && n_b == 0, "cancel: cancelled timers don't expire");
+
+    timer_schedule(&wheel, &a, at(210, &tv));
+    timer_schedule(&wheel, &a, at(205, &tv));
+    timer_wheel_advance(&wheel, at(205, &tv));
+    ok(n_a == 1 && !timer_pending(&a), "cancel: reschedule moves a timer");
+    timer_wheel_free(&wheel);
+}
+
+/*
+ * test_timeout() --Test timer_wheel_timeout().
+ */
+static void test_timeout(void)
+{
+    TimerWheel wheel;
+    Timer a, b;
+    TimeValue tv, now, timeout;
+
+    timer_wheel_init(&wheel, &start, &tick, 8, 4);
+    timer_init(&a, NULL, NULL);
+    timer_init(&b, NULL, NULL);
+    ok(timer_wheel_timeout(&wheel, at(0, &now), &timeout) == NULL,
+       "timeout: NULL (forever) if no timers");
+    timer_schedule(&wheel, &a, at(5, &tv));
+    timer_wheel_timeout(&wheel, at(2, &now), &timeout);
+    ok(timeout.tv_sec == 0 && timeout.tv_usec == 3000,
+       "timeout: time to the next near timer");
+    timer_cancel(&wheel, &a);
+    timer_schedule(&wheel, &b, at(2500, &tv));
+    timer_wheel_timeout(&wheel, at(2, &now), &timeout);
+    ok(timeout.tv_sec == 2 && timeout.tv_usec == 498000,
+       "timeout: time to the next far timer");
+    timer_wheel_free(&wheel);
+}
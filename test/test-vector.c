@@ -8,6 +8,10 @@
  * test_insert()  --Run tests relating to Insert/Add/delete functions.
  * test_search()  --Run tests relating to Search functions.
  * test_visit()   --Run tests relating to Visit functions.
+ * test_reserve() --Run tests relating to reserve/shrink/growth.
+ * test_allocator() --Run tests relating to custom allocators.
+ * test_merge()   --Run tests relating to sort/merge functions.
+ * test_typed()   --Run tests of a vector defined with VECTOR_DEFINE().
  */
 #include <stdbool.h>
 #include <string.h>
@@ -15,6 +19,9 @@
 #include <apex/tap.h>
 #include <apex.h>
 #include <apex/vector.h>
+#include <apex/vector-typed.h>
+
+VECTOR_DEFINE(LongVector, long)
 
 static int compare_long(const void *v1, const void *v2);
 static int visit_long(const void *v1, const void *v2);
@@ -22,6 +29,10 @@ static void test_init(void);
 static void test_insert(void);
 static void test_search(void);
 static void test_visit(void);
+static void test_reserve(void);
+static void test_allocator(void);
+static void test_merge(void);
+static void test_typed(void);
 
 static char cbuf[] = { '0', '1', '2', '3', '4' };
 static short sbuf[] = { 0, 1, 2, 3, 4 };
@@ -30,11 +41,15 @@ static double dbuf[] = { 0.0, 1.0, 2.0, 3.0, 4.0 };
 
 int main(void)
 {
-    plan_tests(27);
+    plan_tests(48);
     test_init();
     test_insert();
     test_search();
     test_visit();
+    test_reserve();
+    test_allocator();
+    test_merge();
+    test_typed();
     return exit_status();
 }
 
@@ -288,3 +303,208 @@ static void test_visit(void)
     ok(result == NULL, "Unsuccessful visit_vector(%d)", i);
     free_vector(lv);
 }
+
+/*
+ * test_reserve() --Run tests relating to reserve/shrink/growth.
+ * test_allocator() --Run tests relating to custom allocators.
+ * test_merge()   --Run tests relating to sort/merge functions.
+ */
+static void test_reserve(void)
+{
+    long *lv, *base;
+    size_t i;
+    size_t n = NEL(lbuf);
+    VectorInfo vinfo;
+    int status;
+
+    lv = new_vector(sizeof(*lv), n, lbuf);
+    lv = vector_reserve(lv, 1000);
+    ok(lv != NULL && vector_info(lv, &vinfo)->n_el == 1000
+       && vinfo.n_used == n, "vector_reserve() allocates");
+
+    base = lv;
+    for (status = 1, i = n; i < 1000; ++i)
+    {
+        long value = (long) i;
+
+        lv = vector_add(lv, 1, &value);
+        if (lv != base)
+        {
+            status = 0;                /* moved: realloc'd */
+        }
+    }
+    ok(status && vector_len(lv) == 1000,
+       "vector_add() within reservation doesn't realloc");
+
+    lv = vector_reserve(lv, 10);
+    ok(vector_info(lv, &vinfo)->n_el == 1000,
+       "vector_reserve() doesn't shrink");
+
+    lv = vector_delete(lv, 500, 400);
+    lv = vector_shrink(lv);
+    ok(lv != NULL && vector_info(lv, &vinfo)->n_el == 600
+       && lv[499] == 499 && lv[500] == 900, "vector_shrink()");
+    free_vector(lv);
+
+    lv = new_vector(sizeof(*lv), n, lbuf);
+    ok(vector_set_growth(lv, 4.0) && !vector_set_growth(lv, 1.0),
+       "vector_set_growth()");
+    lv = vector_add(lv, 4, lbuf);       /* 8 -> more than 32 */
+    ok(vector_info(lv, &vinfo)->n_el >= 32, "growth factor is used");
+    free_vector(lv);
+}
+
+/*
+ * test_allocator() --Run tests relating to custom allocators.
+ * test_merge()   --Run tests relating to sort/merge functions.
+ */
+static void test_allocator(void)
+{
+    Arena arena;
+    ArenaMark mark;
+    VectorAllocator allocator;
+    long *lv;
+    size_t i;
+    int status;
+
+    arena_init(&arena, 64 * 1024);
+    ok(vector_arena_allocator(&allocator, &arena) == &allocator,
+       "vector_arena_allocator()");
+    arena_mark(&arena, &mark);
+    lv = new_vector_with(&allocator, sizeof(*lv), NEL(lbuf), lbuf);
+    for (i = 0; i < 100; ++i)
+    {
+        lv = vector_add(lv, NEL(lbuf), lbuf);
+    }
+    for (status = 1, i = 0; i < 101 * NEL(lbuf); ++i)
+    {
+        if (lv[i] != lbuf[i % NEL(lbuf)])
+        {
+            status = 0;
+        }
+    }
+    ok(lv != NULL && status && vector_len(lv) == 505,
+       "arena vector: vector_add()");
+    ok((char *) lv + vector_len(lv) * sizeof(*lv) <= arena.next
+       && arena.next - (char *) lv < 8 * 1024,
+       "arena vector: grown in place");
+    free_vector(lv);                   /* (no-op) */
+    arena_release(&arena, &mark);
+    arena_free(&arena);
+
+    ok(vector_mmap_allocator(&allocator) == &allocator,
+       "vector_mmap_allocator()");
+    lv = new_vector_with(&allocator, sizeof(*lv), 0, NULL);
+    for (i = 0; i < 1000000; ++i)
+    {
+        long value = (long) i;
+
+        lv = vector_add(lv, 1, &value);
+    }
+    for (status = 1, i = 0; i < 1000000; ++i)
+    {
+        if (lv[i] != (long) i)
+        {
+            status = 0;
+        }
+    }
+    ok(lv != NULL && status, "mmap vector: vector_add()");
+    lv = vector_delete(lv, 10, 1000000 - 20);
+    ok(lv != NULL && vector_len(lv) == 20 && lv[10] == 1000000 - 10,
+       "mmap vector: vector_delete() shrinks");
+    free_vector(lv);
+}
+
+/*
+ * test_merge() --Run tests relating to sort/merge functions.
+ */
+static void test_merge(void)
+{
+    long *lv;
+    long batch[100];
+    size_t i;
+    int status;
+    bool found;
+
+    lv = new_vector(sizeof(*lv), 0, NULL);
+    for (i = 0; i < NEL(batch); ++i)
+    {
+        batch[i] = (long) ((i * 37) % NEL(batch)) * 2;  /* evens, shuffled */
+    }
+    lv = vector_add(lv, NEL(batch), batch);
+    vector_sort(lv, compare_long);
+    for (status = 1, i = 0; i < NEL(batch); ++i)
+    {
+        if (lv[i] != (long) i * 2)
+        {
+            status = 0;
+        }
+    }
+    ok(status, "vector_sort()");
+
+    for (i = 0; i < NEL(batch); ++i)
+    {
+        batch[i] += 1;                 /* odds, shuffled */
+    }
+    lv = vector_merge_sorted(lv, NEL(batch), batch, compare_long);
+    for (status = 1, i = 0; i < 2 * NEL(batch); ++i)
+    {
+        if (lv[i] != (long) i)
+        {
+            status = 0;
+        }
+    }
+    ok(lv != NULL && status && vector_len(lv) == 200,
+       "vector_merge_sorted() interleaves");
+
+    batch[0] = -1;
+    batch[1] = 500;
+    lv = vector_merge_sorted(lv, 2, batch, compare_long);
+    ok(lv[0] == -1 && lv[201] == 500 && vector_len(lv) == 202
+       && search_vector(lv, &batch[1], compare_long, &found) == 201
+       && found, "vector_merge_sorted() at both ends");
+    free_vector(lv);
+}
+
+/*
+ * test_typed() --Run tests of a vector defined with VECTOR_DEFINE().
+ */
+static void test_typed(void)
+{
+    LongVector v;
+    long value;
+    int status = 1;
+
+    diag("%s()", __func__);
+    ok(LongVector_init(&v) == &v && v.n_used == 0 && v.item == NULL,
+       "LongVector_init() returns an empty vector");
+    for (long i = 0; i < 1000; ++i)
+    {
+        status &= LongVector_push(&v, &i);
+    }
+    for (size_t i = 0; i < v.n_used; ++i)
+    {
+        if (v.item[i] != (long) i)
+        {
+            status = 0;
+        }
+    }
+    ok(status && v.n_used == 1000 && v.n_el >= 1000,
+       "LongVector_push() 1000 items");
+
+    value = -1;
+    ok(LongVector_insert(&v, 0, 1, &value) && v.item[0] == -1
+       && v.item[1] == 0 && v.item[1000] == 999 && v.n_used == 1001,
+       "LongVector_insert() at the start");
+    LongVector_delete(&v, 0, 501);
+    LongVector_delete(&v, 400, 1000);  /* (clipped) */
+    ok(v.n_used == 400 && v.item[0] == 500 && v.item[399] == 899,
+       "LongVector_delete() clips to the end");
+
+    ok(LongVector_insert(&v, 402, NEL(lbuf), lbuf) && v.n_used == 407
+       && v.item[400] == 0 && v.item[401] == 0 && v.item[406] == 8,
+       "LongVector_insert() past the end zero-fills the gap");
+    ok(LongVector_shrink(&v) && v.n_el == v.n_used,
+       "LongVector_shrink()");
+    LongVector_free(&v);
+}